@@ -1,6 +1,3 @@
-#include <ESP_I2S.h>
-#include <wav_header.h>
-
 /*
  * ESP-MIAO: ESP32 WebSocket Client for Arduino IDE
  * 
@@ -12,11 +9,14 @@
  *   - LED on GPIO 2 (內建)
  *   - Relay on GPIO 26 (light)
  *   - Relay on GPIO 27 (fan)
+ *   - I2S 麥克風 INMP441 (SCK=32, WS=25, SD=33)
  * 
  * Arduino IDE 設定:
  *   1. 安裝 ESP32 Board: https://github.com/espressif/arduino-esp32
  *   2. 安裝 ArduinoJson: Library Manager -> ArduinoJson
  *   3. 安裝 WebSockets: Library Manager -> WebSockets by Markus Sattler
+ *   3a. 安裝 miao_stream: 將 firmware/esp32_edge_impulse/components/miao_stream
+ *       連結 / 複製到 Arduino/libraries（與 ESP-IDF 韌體共用的環形緩衝與串流格式）
  *   4. Board: ESP32 Dev Module
  *   5. Upload Speed: 115200
  * 
@@ -29,6 +29,7 @@
  * Serial 指令:
  *   0-3: 發送本地指令 (0=LIGHT_ON, 1=LIGHT_OFF, 2=FAN_ON, 3=FAN_OFF)
  *   t:文字: 發送 fallback 文字請求 (例如: t:打開電風扇)
+ *   a: 錄音 RECORD_MS 並以 binary 串流送到 Server (同 ESP-IDF 韌體的 audio_start + frame)
  *   s: 顯示目前狀態
  *   r: 重新連線
  */
@@ -36,6 +37,10 @@
 #include <WiFi.h>
 #include <WebSocketsClient.h>
 #include <ArduinoJson.h>
+#include <ESP_I2S.h>
+#include <esp_timer.h>
+#include <audio_ring_buffer.h>
+#include <stream_protocol.h>
 
 // ==================== 設定區 ====================
 
@@ -53,6 +58,19 @@ const int PIN_LED = 2;      // 內建 LED
 const int PIN_LIGHT = 26;   // Relay: light
 const int PIN_FAN = 27;     // Relay: fan
 
+// 麥克風 / 串流設定
+const int PIN_I2S_SCK = 32;
+const int PIN_I2S_WS = 25;
+const int PIN_I2S_SD = 33;
+const int SAMPLE_RATE = 16000;
+const uint32_t RECORD_MS = 3000;         // 每次串流的長度（無端點偵測，固定長度）
+const size_t FRAME_SAMPLES = 256;        // 每個 binary frame 16 ms（同 ESP-IDF 韌體）
+const size_t CAPTURE_BLOCK = 256;        // 擷取 Task 每次讀取的樣本數（= StreamChunkHeader.block_seq 的單位）
+const size_t RING_SAMPLES = 16384;       // 約 1 秒：loop() 被 WebSocket 卡住時的緩衝
+const int STREAM_READER = 0;             // 環形緩衝的讀取游標
+const int FRAMES_PER_LOOP = 4;           // 每次 loop() 最多送出的 frame，其餘留給下一輪
+const uint32_t CAPTURE_STALL_MS = 1000;  // 串流中超過此時間沒有新樣本即提前結束
+
 // ==================== 狀態機定義 ====================
 
 enum State {
@@ -89,6 +107,24 @@ State currentState = STATE_IDLE;
 bool isConnected = false;
 unsigned long lastHeartbeat = 0;
 
+I2SClass i2s;
+AudioRingBuffer captureRing;
+bool micReady = false;
+
+// 進行中的串流（僅 loop() 存取；擷取 Task 只寫入環形緩衝）
+struct AudioStream {
+  bool active;
+  uint32_t sessionId;
+  uint32_t startPos;        // 環形緩衝中的起點（絕對樣本位置）
+  int64_t startUs;          // 起點的 esp_timer 時間
+  size_t totalSamples;
+  size_t sentSamples;
+  uint32_t seq;
+  unsigned long lastDataMs;
+};
+AudioStream audioStream = {};
+uint8_t frameBuf[sizeof(StreamChunkHeader) + FRAME_SAMPLES * sizeof(int16_t)];
+
 // ==================== 工具函數 ====================
 
 void setState(State newState) {
@@ -232,6 +268,146 @@ String buildActionResult(bool success, const char* error = nullptr) {
   return output;
 }
 
+// ==================== 音訊擷取 / 串流 ====================
+
+// 擷取 Task：I2S → 環形緩衝（唯一寫入者），與 WebSocket 送出互不阻塞
+void captureTask(void*) {
+  int16_t block[CAPTURE_BLOCK];
+  for (;;) {
+    size_t got = i2s.readBytes((char*)block, sizeof(block));
+    if (got >= sizeof(int16_t)) {
+      captureRing.write(block, got / sizeof(int16_t));
+    } else {
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+  }
+}
+
+void setupMicrophone() {
+  i2s.setPins(PIN_I2S_SCK, PIN_I2S_WS, -1, PIN_I2S_SD);
+  if (!i2s.begin(I2S_MODE_STD, SAMPLE_RATE, I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO)) {
+    Serial.println("[MIC] I2S init failed, audio streaming disabled");
+    return;
+  }
+  if (!captureRing.init(RING_SAMPLES)) {
+    Serial.println("[MIC] Ring buffer allocation failed, audio streaming disabled");
+    return;
+  }
+  xTaskCreatePinnedToCore(captureTask, "capture", 4096, nullptr, 5, nullptr, 0);
+  micReady = true;
+  Serial.printf("[MIC] Capturing %d Hz (SCK=%d, WS=%d, SD=%d)\n",
+                SAMPLE_RATE, PIN_I2S_SCK, PIN_I2S_WS, PIN_I2S_SD);
+}
+
+void startAudioStream() {
+  if (!isConnected) {
+    Serial.println("[ERROR] Not connected to server");
+    return;
+  }
+  if (!micReady || audioStream.active) {
+    Serial.println(micReady ? "[ERROR] Already streaming" : "[ERROR] Microphone not available");
+    return;
+  }
+
+  audioStream = {};
+  audioStream.sessionId = esp_random();
+  audioStream.startPos = captureRing.seek_to(STREAM_READER, captureRing.write_pos());
+  audioStream.startUs = esp_timer_get_time();
+  audioStream.totalSamples = (size_t)SAMPLE_RATE * RECORD_MS / 1000;
+  audioStream.lastDataMs = millis();
+
+  char format[24];
+  snprintf(format, sizeof(format), "pcm_%dk_16bit", SAMPLE_RATE / 1000);
+  StreamStartInfo info = {};
+  info.device_id = DEVICE_ID;
+  info.timestamp_ms = getTimestamp();
+  info.audio_format = format;
+  info.sample_rate = SAMPLE_RATE;
+  info.total_samples = audioStream.totalSamples;
+  info.frame_samples = FRAME_SAMPLES;
+  info.chunk_header_bytes = sizeof(StreamChunkHeader);
+  info.timer_us = audioStream.startUs;
+  info.session_id = audioStream.sessionId;
+  info.confidence = 1.0f;
+  info.transfer_mode = "binary";
+  info.trace_id = audioStream.sessionId;
+  info.extra = "";
+  char json[560];
+  stream_start_json(json, sizeof(json), info);
+
+  setState(STATE_LISTEN);
+  Serial.printf("[SEND] %s\n", json);
+  if (!webSocket.sendTXT(json)) {
+    Serial.println("[ERROR] Failed to send audio_start");
+    setState(STATE_ERROR);
+    return;
+  }
+  audioStream.active = true;
+}
+
+void finishAudioStream(const char* reason) {
+  audioStream.active = false;
+  if (reason) {
+    // 提前結束：告知 Server 實際長度（少於 audio_start 的 total_samples）
+    char json[160];
+    stream_end_json(json, sizeof(json), DEVICE_ID, getTimestamp(), audioStream.sentSamples, reason, nullptr);
+    webSocket.sendTXT(json);
+  }
+  Serial.printf("[STREAM] %u samples in %lu frames (%s), overruns=%lu\n",
+                (unsigned)audioStream.sentSamples, (unsigned long)audioStream.seq, reason ? reason : "fixed",
+                (unsigned long)captureRing.overruns(STREAM_READER));
+  setState(STATE_WAIT_ACTION);
+}
+
+// 由 loop() 呼叫：已擷取的樣本以 StreamChunkHeader + PCM 的 binary frame 送出
+void pumpAudioStream() {
+  if (!audioStream.active) return;
+  if (!isConnected) {
+    audioStream.active = false;
+    Serial.println("[STREAM] Connection lost, stream abandoned");
+    return;
+  }
+
+  for (int i = 0; i < FRAMES_PER_LOOP; i++) {
+    size_t remaining = audioStream.totalSamples - audioStream.sentSamples;
+    size_t want = remaining < FRAME_SAMPLES ? remaining : FRAME_SAMPLES;
+    if (captureRing.available(STREAM_READER) < want) break;
+
+    // 讀者太慢被覆寫時 read() 會跳到最舊的有效樣本，以實際位置填 sample_offset
+    int16_t* pcm = (int16_t*)(frameBuf + sizeof(StreamChunkHeader));
+    size_t n = captureRing.read(STREAM_READER, pcm, want);
+    if (n == 0) break;
+    uint32_t first = captureRing.position(STREAM_READER) - (uint32_t)n;
+
+    StreamChunkHeader hdr = {};
+    hdr.seq = audioStream.seq;
+    hdr.block_seq = first / CAPTURE_BLOCK;
+    hdr.sample_offset = first - audioStream.startPos;
+    hdr.capture_us = audioStream.startUs + (int64_t)hdr.sample_offset * 1000000 / SAMPLE_RATE;
+    hdr.session_id = audioStream.sessionId;
+    memcpy(frameBuf, &hdr, sizeof(hdr));
+
+    if (!webSocket.sendBIN(frameBuf, sizeof(hdr) + n * sizeof(int16_t))) {
+      Serial.println("[ERROR] Binary send failed");
+      audioStream.active = false;
+      setState(STATE_ERROR);
+      return;
+    }
+    audioStream.seq++;
+    audioStream.sentSamples = hdr.sample_offset + n;
+    audioStream.lastDataMs = millis();
+    if (audioStream.sentSamples >= audioStream.totalSamples) {
+      finishAudioStream(nullptr);   // 已達 total_samples，Server 自行結束
+      return;
+    }
+  }
+
+  if (millis() - audioStream.lastDataMs > CAPTURE_STALL_MS) {
+    Serial.println("[STREAM] Capture stalled");
+    finishAudioStream("max_duration");
+  }
+}
+
 // ==================== 訊息處理 ====================
 
 void handleServerMessage(uint8_t* payload, size_t length) {
@@ -424,6 +600,12 @@ void processSerialCommand() {
     return;
   }
   
+  // a: 錄音並串流
+  if (input == "a") {
+    startAudioStream();
+    return;
+  }
+
   // s: 顯示狀態
   if (input == "s") {
     Serial.println("\n=== Status ===");
@@ -453,6 +635,7 @@ void processSerialCommand() {
     Serial.println("2: FAN_ON");
     Serial.println("3: FAN_OFF");
     Serial.println("t:文字: Fallback request (e.g., t:打開電風扇)");
+    Serial.println("a: Record and stream audio");
     Serial.println("s: Show status");
     Serial.println("r: Reconnect");
     Serial.println("h: Help");
@@ -501,6 +684,9 @@ void setup() {
   
   // 初始化 GPIO
   setupGPIO();
+
+  // 麥克風擷取（失敗時其餘功能照常）
+  setupMicrophone();
   
   // 連接 WiFi
   setupWiFi();
@@ -523,6 +709,7 @@ void setup() {
 
 void loop() {
   webSocket.loop();
+  pumpAudioStream();
   processSerialCommand();
   
   // 心跳 (可選)
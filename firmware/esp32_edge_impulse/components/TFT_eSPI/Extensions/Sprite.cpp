@@ -1865,6 +1865,78 @@ void TFT_eSprite::drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color)
 }
 
 
+/***************************************************************************************
+** Function name:           fillSpans
+** Description:             fill a list of horizontal runs with one colour
+***************************************************************************************/
+void TFT_eSprite::fillSpans(const Span *spans, uint32_t n, uint32_t color)
+{
+  if (!_created || _vpOoB) return;
+
+  // Viewport limits in Sprite coordinates, so each span only needs a min / max
+  const int32_t xmin = _vpX - _xDatum, xmax = _vpW - 1 - _xDatum;
+  const int32_t ymin = _vpY - _yDatum, ymax = _vpH - 1 - _yDatum;
+
+  if (_bpp == 16)
+  {
+    uint16_t c = (uint16_t)((color >> 8) | (color << 8));
+    uint32_t c32 = c | ((uint32_t)c << 16);
+    for (const Span *s = spans, *end = spans + n; s < end; s++) {
+      if (s->y < ymin || s->y > ymax) continue;
+      int32_t x0 = s->x0 < xmin ? xmin : s->x0;
+      int32_t x1 = s->x1 > xmax ? xmax : s->x1;
+      int32_t w = x1 - x0 + 1;
+      if (w < 1) continue;
+      uint16_t *p = _img + _iwidth * (s->y + _yDatum) + x0 + _xDatum;
+      if (((uintptr_t)p & 2) != 0) { *p++ = c; w--; }   // align to a 32-bit word
+      uint32_t *p32 = (uint32_t *)p;
+      for (; w >= 2; w -= 2) *p32++ = c32;
+      if (w) *(uint16_t *)p32 = c;
+    }
+  }
+  else if (_bpp == 8)
+  {
+    uint8_t c = (uint8_t)((color & 0xE000)>>8 | (color & 0x0700)>>6 | (color & 0x0018)>>3);
+    for (const Span *s = spans, *end = spans + n; s < end; s++) {
+      if (s->y < ymin || s->y > ymax) continue;
+      int32_t x0 = s->x0 < xmin ? xmin : s->x0;
+      int32_t x1 = s->x1 > xmax ? xmax : s->x1;
+      if (x1 < x0) continue;
+      memset(_img8 + _iwidth * (s->y + _yDatum) + x0 + _xDatum, c, x1 - x0 + 1);
+    }
+  }
+  else if (_bpp == 4)
+  {
+    // Even x is the high nibble (as drawPixel)
+    uint8_t c = (uint8_t)color & 0x0F;
+    uint8_t c2 = (uint8_t)(c | (c << 4));
+    for (const Span *s = spans, *end = spans + n; s < end; s++) {
+      if (s->y < ymin || s->y > ymax) continue;
+      int32_t x0 = (s->x0 < xmin ? xmin : s->x0) + _xDatum;
+      int32_t x1 = (s->x1 > xmax ? xmax : s->x1) + _xDatum;
+      if (x1 < x0) continue;
+      int32_t row = _iwidth * (s->y + _yDatum);
+      if (x0 & 0x01) {
+        uint8_t *b = _img4 + ((row + x0) >> 1);
+        *b = (uint8_t)((*b & 0xF0) | c);
+        x0++;
+      }
+      if (x1 >= x0 && (x1 & 0x01) == 0) {
+        uint8_t *b = _img4 + ((row + x1) >> 1);
+        *b = (uint8_t)((*b & 0x0F) | (c << 4));
+        x1--;
+      }
+      if (x1 > x0) memset(_img4 + ((row + x0) >> 1), c2, (x1 - x0 + 1) >> 1);
+    }
+  }
+  else // 1 bpp: coordinate rotation is handled per pixel
+  {
+    for (uint32_t i = 0; i < n; i++) {
+      drawFastHLine(spans[i].x0, spans[i].y, spans[i].x1 - spans[i].x0 + 1, color);
+    }
+  }
+}
+
 /***************************************************************************************
 ** Function name:           fillRect
 ** Description:             draw a filled rectangle
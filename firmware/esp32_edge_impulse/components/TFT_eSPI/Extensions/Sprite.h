@@ -87,6 +87,12 @@ class TFT_eSprite : public TFT_eSPI {
            // Fill a rectangular area with a color (aka draw a filled rectangle)
            fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
 
+           // Horizontal run of pixels x0..x1 (inclusive) on row y, in Sprite coordinates
+  struct   Span { int16_t y, x0, x1; };
+           // Fill n spans with one colour: the viewport is clipped once for the whole list and
+           // 16-bit Sprites are written two pixels per 32-bit word (4 and 8-bit via memset)
+  void     fillSpans(const Span *spans, uint32_t n, uint32_t color);
+
            // Set the coordinate rotation of the Sprite (for 1bpp Sprites only)
            // Note: this uses coordinate rotation and is primarily for ePaper which does not support
            // CGRAM rotation (like TFT drivers do) within the displays internal hardware
@@ -570,6 +570,187 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
 #if defined (ESP32_DMA) && !defined (TFT_PARALLEL_8_BIT) //       DMA FUNCTIONS
 ////////////////////////////////////////////////////////////////////////////////////////
 
+// Window set-up commands are queued as their own small transactions ahead of the pixel
+// data, so the bus goes from one image straight to the next window without the CPU
+// waiting for the previous DMA to finish. DC is set per transaction by dc_callback
+// (trans.user: 0 = command, 1 = data). Descriptors are reused in FIFO order, a slot is
+// only written after the transaction that last used it has been retrieved.
+#define DMA_QUEUE_SIZE 12
+
+static spi_transaction_t dmaTrans[DMA_QUEUE_SIZE];
+static uint8_t dmaTransIdx = 0;
+
+// Column address last queued while transactions were in flight, -1 = unknown. Cleared
+// whenever the queue drains as the bus may then be used by the non-DMA functions.
+static int32_t dmaCol0 = -1;
+static int32_t dmaCol1 = -1;
+
+// Shared bus arbiter (shareBus()). The display holds busMutex for a whole write transaction
+// (begin_tft_write() to end_tft_write(), e.g. startWrite() ... endWrite()), other devices take it
+// in busAcquire(). While the display pushes pixels, dmaYield() lends it to a waiting device at
+// each chunk boundary and takes it back after that device's busRelease(). busHandoff makes the
+// display wait until the waiter really owns the mutex, a plain give + take from a task on the
+// other core would usually get it straight back.
+static SemaphoreHandle_t busMutex   = nullptr;
+static SemaphoreHandle_t busHandoff = nullptr;
+static volatile uint32_t busWaiting = 0;     // Devices blocked in busAcquire()
+static volatile bool     busYielding = false; // Display has lent the bus and waits for busHandoff
+static uint32_t dmaChunk = 0;                 // Max pixel bytes per transaction, 0 = bus not shared
+
+static void busTake(void) { if (busMutex) xSemaphoreTake(busMutex, portMAX_DELAY); }
+static void busGive(void) { if (busMutex) xSemaphoreGive(busMutex); }
+
+/***************************************************************************************
+** Function name:           dmaQueue
+** Description:             Queue one transaction, data or bytes (len <= 4) is sent
+***************************************************************************************/
+static void dmaQueue(uint8_t &busy, bool dc_data, const void* data, const uint8_t* bytes, uint32_t len)
+{
+  esp_err_t ret;
+
+  // Queue full, retrieve the oldest transaction so its descriptor can be reused
+  if (busy >= DMA_QUEUE_SIZE) {
+    spi_transaction_t *rtrans;
+    ret = spi_device_get_trans_result(dmaHAL, &rtrans, portMAX_DELAY);
+    assert(ret == ESP_OK);
+    busy--;
+  }
+
+  spi_transaction_t* trans = &dmaTrans[dmaTransIdx];
+  dmaTransIdx = (dmaTransIdx + 1) % DMA_QUEUE_SIZE;
+
+  memset(trans, 0, sizeof(spi_transaction_t));
+
+  trans->user = dc_data ? (void *)1 : (void *)0;
+  trans->length = len * 8;   //Data length, in bits
+  if (bytes) {
+    trans->flags = SPI_TRANS_USE_TXDATA;
+    memcpy(trans->tx_data, bytes, len);
+  }
+  else trans->tx_buffer = data;
+
+  ret = spi_device_queue_trans(dmaHAL, trans, portMAX_DELAY);
+  assert(ret == ESP_OK);
+
+  busy++;
+}
+
+/***************************************************************************************
+** Function name:           dmaYield
+** Description:             Lend the bus to a device waiting in busAcquire()
+***************************************************************************************/
+// Only inside a write transaction: the queued DMA is allowed to finish, the TFT is deselected
+// and the transaction is reopened once the other device has released the bus. A RAMWR in
+// progress continues with the next data byte after CS goes low again.
+void TFT_eSPI::dmaYield(void)
+{
+  if (!busWaiting || locked) return;
+
+  dmaWait();
+  CS_H;
+  spi.endTransaction();
+
+  xSemaphoreTake(busHandoff, 0);   // Drop a stale hand-off from a waiter that timed out
+  busYielding = true;
+  busGive();
+  xSemaphoreTake(busHandoff, 1);   // Bounded, the waiter may time out before it gets the bus
+  busYielding = false;
+  busTake();
+
+  spi.beginTransaction(SPISettings(_spi_freq, MSBFIRST, TFT_SPI_MODE));
+  CS_L;
+  SET_BUS_WRITE_MODE;
+}
+
+/***************************************************************************************
+** Function name:           dmaQueueData
+** Description:             Queue pixel data, split into chunks when the bus is shared
+***************************************************************************************/
+// When shared, only the chunk being sent and the next one are in flight, so a device waiting
+// for the bus is held up by at most two chunks rather than a whole image.
+void TFT_eSPI::dmaQueueData(const void* data, uint32_t bytes)
+{
+  const uint8_t* p = (const uint8_t*)data;
+  uint32_t chunk = dmaChunk ? dmaChunk : bytes;
+
+  while (bytes) {
+    uint32_t n = bytes < chunk ? bytes : chunk;
+    dmaQueue(spiBusyCheck, true, p, nullptr, n);
+    p += n;
+    bytes -= n;
+    if (bytes) {
+      spi_transaction_t *rtrans;
+      while (spiBusyCheck > 1) {
+        esp_err_t ret = spi_device_get_trans_result(dmaHAL, &rtrans, portMAX_DELAY);
+        assert(ret == ESP_OK);
+        spiBusyCheck--;
+      }
+      dmaYield();
+    }
+  }
+}
+
+/***************************************************************************************
+** Function name:           shareBus
+** Description:             Arbitrate the SPI bus with other devices - returns true if OK
+***************************************************************************************/
+bool TFT_eSPI::shareBus(uint32_t chunk_bytes)
+{
+  if (!DMA_Enabled || !locked) return false;   // After initDMA(), outside a write transaction
+
+  if (!busMutex) {
+    busMutex = xSemaphoreCreateMutex();
+    busHandoff = xSemaphoreCreateBinary();
+    if (!busMutex || !busHandoff) {
+      if (busMutex) vSemaphoreDelete(busMutex);
+      if (busHandoff) vSemaphoreDelete(busHandoff);
+      busMutex = busHandoff = nullptr;
+      return false;
+    }
+  }
+
+  chunk_bytes &= ~3UL;   // Whole pixels, word aligned DMA
+  dmaChunk = chunk_bytes < 64 ? 64 : chunk_bytes;
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           busAcquire
+** Description:             Take the shared bus for another device - returns false on timeout
+***************************************************************************************/
+bool TFT_eSPI::busAcquire(uint32_t timeout_ms)
+{
+  if (!busMutex) return false;
+
+  __atomic_add_fetch(&busWaiting, 1, __ATOMIC_RELAXED);
+  bool ok = xSemaphoreTake(busMutex, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+  __atomic_sub_fetch(&busWaiting, 1, __ATOMIC_RELAXED);
+
+  if (ok && busYielding) {
+    busYielding = false;
+    xSemaphoreGive(busHandoff);
+  }
+  return ok;
+}
+
+/***************************************************************************************
+** Function name:           busRelease
+** Description:             Give the shared bus back after busAcquire()
+***************************************************************************************/
+void TFT_eSPI::busRelease(void)
+{
+  busGive();
+}
+
+/***************************************************************************************
+** Function name:           busHost
+** Description:             SPI host of the display bus (spi_host_device_t)
+***************************************************************************************/
+int TFT_eSPI::busHost(void)
+{
+  return (int)spi_host;
+}
+
 /***************************************************************************************
 ** Function name:           dmaBusy
 ** Description:             Check if DMA is busy
@@ -588,7 +769,7 @@ bool TFT_eSPI::dmaBusy(void)
   }
 
   //Serial.print("spiBusyCheck=");Serial.println(spiBusyCheck);
-  if (spiBusyCheck ==0) return false;
+  if (spiBusyCheck ==0) { dmaCol0 = dmaCol1 = -1; return false; }
   return true;
 }
 
@@ -608,6 +789,56 @@ void TFT_eSPI::dmaWait(void)
     assert(ret == ESP_OK);
   }
   spiBusyCheck = 0;
+  dmaCol0 = dmaCol1 = -1;
+}
+
+
+/***************************************************************************************
+** Function name:           setWindowDMA
+** Description:             Queue a window set-up behind any DMA still in progress
+***************************************************************************************/
+// Inclusive coordinates, as setWindow(). The column address is not sent again if it is
+// unchanged since the last queued window (e.g. consecutive strips of the same area).
+void TFT_eSPI::setWindowDMA(int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+  if (!DMA_Enabled) return;
+
+  addr_row = 0xFFFF;
+  addr_col = 0xFFFF;
+
+#if defined (ILI9225_DRIVER) || defined (SSD1351_DRIVER) || defined (SSD1963_DRIVER) || \
+    defined (RM68120_DRIVER) || defined (RPI_DISPLAY_TYPE)
+  // Window commands differ for these, fall back to the blocking set-up
+  dmaWait();
+  setWindow(x0, y0, x1, y1);
+#else
+  #ifdef CGRAM_OFFSET
+    x0+=colstart;
+    x1+=colstart;
+    y0+=rowstart;
+    y1+=rowstart;
+  #endif
+
+  uint8_t cmd;
+  uint8_t xy[4];
+
+  if (x0 != dmaCol0 || x1 != dmaCol1) {
+    cmd = TFT_CASET;
+    dmaQueue(spiBusyCheck, false, nullptr, &cmd, 1);
+    xy[0] = x0 >> 8; xy[1] = x0; xy[2] = x1 >> 8; xy[3] = x1;
+    dmaQueue(spiBusyCheck, true, nullptr, xy, 4);
+    dmaCol0 = x0;
+    dmaCol1 = x1;
+  }
+
+  cmd = TFT_PASET;
+  dmaQueue(spiBusyCheck, false, nullptr, &cmd, 1);
+  xy[0] = y0 >> 8; xy[1] = y0; xy[2] = y1 >> 8; xy[3] = y1;
+  dmaQueue(spiBusyCheck, true, nullptr, xy, 4);
+
+  cmd = TFT_RAMWR;
+  dmaQueue(spiBusyCheck, false, nullptr, &cmd, 1);
+#endif
 }
 
 
@@ -626,20 +857,7 @@ void TFT_eSPI::pushPixelsDMA(uint16_t* image, uint32_t len)
     for (uint32_t i = 0; i < len; i++) (image[i] = image[i] << 8 | image[i] >> 8);
   }
 
-  esp_err_t ret;
-  static spi_transaction_t trans;
-
-  memset(&trans, 0, sizeof(spi_transaction_t));
-
-  trans.user = (void *)1;
-  trans.tx_buffer = image;  //finally send the line data
-  trans.length = len * 16;        //Data length, in bits
-  trans.flags = 0;                //SPI_TRANS_USE_TXDATA flag
-
-  ret = spi_device_queue_trans(dmaHAL, &trans, portMAX_DELAY);
-  assert(ret == ESP_OK);
-
-  spiBusyCheck++;
+  dmaQueueData(image, len * 2);
 }
 
 
@@ -654,24 +872,20 @@ void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t
 
   uint32_t len = w*h;
 
-  dmaWait();
-
-  setAddrWindow(x, y, w, h);
-
-  esp_err_t ret;
-  static spi_transaction_t trans;
-
-  memset(&trans, 0, sizeof(spi_transaction_t));
+  dmaYield();   // Between images is a chunk boundary too
 
-  trans.user = (void *)1;
-  trans.tx_buffer = image;   //Data pointer
-  trans.length = len * 16;   //Data length, in bits
-  trans.flags = 0;           //SPI_TRANS_USE_TXDATA flag
+  // Window and pixels are queued behind the previous image, no wait here
+  setWindowDMA(x, y, x + w - 1, y + h - 1);
+  dmaQueueData(image, len * 2);
 
-  ret = spi_device_queue_trans(dmaHAL, &trans, portMAX_DELAY);
-  assert(ret == ESP_OK);
-
-  spiBusyCheck++;
+  // Retrieve everything queued before this image, on return only this image may still
+  // be in progress so a caller alternating two buffers can refill the other one
+  spi_transaction_t *rtrans;
+  while (spiBusyCheck > 1) {
+    esp_err_t ret = spi_device_get_trans_result(dmaHAL, &rtrans, portMAX_DELAY);
+    assert(ret == ESP_OK);
+    spiBusyCheck--;
+  }
 }
 
 
@@ -731,23 +945,10 @@ void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t
   }
 
   if (spiBusyCheck) dmaWait(); // In case we did not wait earlier
+  dmaYield();
 
-  setAddrWindow(x, y, dw, dh);
-
-  esp_err_t ret;
-  static spi_transaction_t trans;
-
-  memset(&trans, 0, sizeof(spi_transaction_t));
-
-  trans.user = (void *)1;
-  trans.tx_buffer = buffer;  //finally send the line data
-  trans.length = len * 16;   //Data length, in bits
-  trans.flags = 0;           //SPI_TRANS_USE_TXDATA flag
-
-  ret = spi_device_queue_trans(dmaHAL, &trans, portMAX_DELAY);
-  assert(ret == ESP_OK);
-
-  spiBusyCheck++;
+  setWindowDMA(x, y, x + dw - 1, y + dh - 1);
+  dmaQueueData(buffer, len * 2);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -809,12 +1010,12 @@ bool TFT_eSPI::initDMA(bool ctrl_cs)
     .duty_cycle_pos = 0,
     .cs_ena_pretrans = 0,
     .cs_ena_posttrans = 0,
-    .clock_speed_hz = SPI_FREQUENCY,
+    .clock_speed_hz = (int)_spi_freq,
     .input_delay_ns = 0,
     .spics_io_num = pin,
     .flags = SPI_DEVICE_NO_DUMMY, //0,
-    .queue_size = 1,
-    .pre_cb = 0, //dc_callback, //Callback to handle D/C line
+    .queue_size = DMA_QUEUE_SIZE,
+    .pre_cb = dc_callback, //Callback to handle D/C line
     #ifdef CONFIG_IDF_TARGET_ESP32
       .post_cb = 0
     #else
@@ -828,6 +1029,7 @@ bool TFT_eSPI::initDMA(bool ctrl_cs)
 
   DMA_Enabled = true;
   spiBusyCheck = 0;
+  dmaCol0 = dmaCol1 = -1;
   return true;
 }
 
@@ -839,8 +1041,9 @@ void TFT_eSPI::deInitDMA(void)
 {
   if (!DMA_Enabled) return;
   spi_bus_remove_device(dmaHAL);
-  spi_bus_free(spi_host);
+  spi_bus_free(spi_host);   // Fails while other devices are still attached to a shared bus
   DMA_Enabled = false;
+  dmaChunk = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -11,6 +11,7 @@
 // Include processor specific header
 #include "soc/spi_reg.h"
 #include "driver/spi_master.h"
+#include "freertos/semphr.h"
 #include "hal/gpio_ll.h"
 
 #if !defined(CONFIG_IDF_TARGET_ESP32C3) && !defined(CONFIG_IDF_TARGET_ESP32S2) && !defined(CONFIG_IDF_TARGET_ESP32)
@@ -118,6 +119,9 @@ SPI3_HOST = 2,  ///< actually SPI2
   #define ESP32_DMA
   // Code to check if DMA is busy, used by SPI DMA + transaction + endWrite functions
   #define DMA_BUSY_CHECK  dmaWait()
+  // Bus arbiter hooks, used by the start/end transaction functions (no-op unless shareBus() was called)
+  #define BUS_ACQUIRE     busTake()
+  #define BUS_RELEASE     busGive()
 #else
   #define DMA_BUSY_CHECK
 #endif
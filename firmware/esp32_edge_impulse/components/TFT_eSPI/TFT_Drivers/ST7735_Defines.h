@@ -152,6 +152,8 @@
 #define ST7735_RAMRD   0x2E
 
 #define ST7735_PTLAR   0x30
+#define ST7735_VSCRDEF 0x33 // Vertical scroll definition: top fixed, scroll and bottom fixed rows
+#define ST7735_VSCRSADD 0x37 // Vertical scroll start address
 #define ST7735_COLMOD  0x3A
 #define ST7735_MADCTL  0x36
 
@@ -168,6 +170,11 @@
 #define ST7735_PWCTR5  0xC4
 #define ST7735_VMCTR1  0xC5
 
+// Frame memory rows covered by VSCRDEF (TFA + VSA + BFA); 162 for the GM=11 (132 x 162) memory
+#ifndef ST7735_FRAME_ROWS
+  #define ST7735_FRAME_ROWS 162
+#endif
+
 #define ST7735_RDID1   0xDA
 #define ST7735_RDID2   0xDB
 #define ST7735_RDID3   0xDC
@@ -37,6 +37,11 @@
   #define SPI_BUSY_CHECK
 #endif
 
+#ifndef BUS_ACQUIRE
+  #define BUS_ACQUIRE
+  #define BUS_RELEASE
+#endif
+
 // Clipping macro for pushImage
 #define PI_CLIP                                        \
   if (_vpOoB) return;                                  \
@@ -74,8 +79,9 @@
 inline void TFT_eSPI::begin_tft_write(void){
   if (locked) {
     locked = false; // Flag to show SPI access now unlocked
+    BUS_ACQUIRE;    // Wait for other devices sharing the bus
 #if defined (SPI_HAS_TRANSACTION) && defined (SUPPORT_TRANSACTIONS) && !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
-    spi.beginTransaction(SPISettings(SPI_FREQUENCY, MSBFIRST, TFT_SPI_MODE));
+    spi.beginTransaction(SPISettings(_spi_freq, MSBFIRST, TFT_SPI_MODE));
 #endif
     CS_L;
     SET_BUS_WRITE_MODE;  // Some processors (e.g. ESP32) allow recycling the tx buffer when rx is not used
@@ -86,8 +92,9 @@ inline void TFT_eSPI::begin_tft_write(void){
 void TFT_eSPI::begin_nin_write(void){
   if (locked) {
     locked = false; // Flag to show SPI access now unlocked
+    BUS_ACQUIRE;    // Wait for other devices sharing the bus
 #if defined (SPI_HAS_TRANSACTION) && defined (SUPPORT_TRANSACTIONS) && !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
-    spi.beginTransaction(SPISettings(SPI_FREQUENCY, MSBFIRST, TFT_SPI_MODE));
+    spi.beginTransaction(SPISettings(_spi_freq, MSBFIRST, TFT_SPI_MODE));
 #endif
     CS_L;
     SET_BUS_WRITE_MODE;  // Some processors (e.g. ESP32) allow recycling the tx buffer when rx is not used
@@ -108,6 +115,7 @@ inline void TFT_eSPI::end_tft_write(void){
 #if defined (SPI_HAS_TRANSACTION) && defined (SUPPORT_TRANSACTIONS) && !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
       spi.endTransaction();
 #endif
+      BUS_RELEASE;
     }
   }
 }
@@ -123,6 +131,7 @@ inline void TFT_eSPI::end_nin_write(void){
 #if defined (SPI_HAS_TRANSACTION) && defined (SUPPORT_TRANSACTIONS) && !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
       spi.endTransaction();
 #endif
+      BUS_RELEASE;
     }
   }
 }
@@ -137,6 +146,7 @@ inline void TFT_eSPI::begin_tft_read(void){
 #if defined (SPI_HAS_TRANSACTION) && defined (SUPPORT_TRANSACTIONS) && !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
   if (locked) {
     locked = false;
+    BUS_ACQUIRE;
     spi.beginTransaction(SPISettings(SPI_READ_FREQUENCY, MSBFIRST, TFT_SPI_MODE));
     CS_L;
   }
@@ -160,11 +170,12 @@ inline void TFT_eSPI::end_tft_read(void){
       locked = true;
       CS_H;
       spi.endTransaction();
+      BUS_RELEASE;
     }
   }
 #else
   #if !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
-    spi.setFrequency(SPI_FREQUENCY);
+    spi.setFrequency(_spi_freq);
   #endif
    if(!inTransaction) {CS_H;}
 #endif
@@ -713,6 +724,7 @@ void TFT_eSPI::init(uint8_t tc)
 
 #elif defined (ST7735_DRIVER)
     tabcolor = tc;
+    _scrollHeight = 0; // Reset clears the scroll definition
     #include "TFT_Drivers/ST7735_Init.h"
 
 #elif defined (ILI9163_DRIVER)
@@ -5953,6 +5965,89 @@ SPIClass& TFT_eSPI::getSPIinstance(void)
 #endif
 
 
+/***************************************************************************************
+** Function name:           setSPIFrequency
+** Description:             Set the SPI write clock used by subsequent transactions
+***************************************************************************************/
+#if !defined (TFT_PARALLEL_8_BIT) && !defined (RP2040_PIO_INTERFACE)
+void TFT_eSPI::setSPIFrequency(uint32_t freq)
+{
+  DMA_BUSY_CHECK; // Do not change the clock under a running DMA transfer
+  _spi_freq = freq;
+  // Inside startWrite()/endWrite() the transaction is already open, apply directly
+  if (!locked) spi.setFrequency(freq);
+}
+#endif
+
+
+#if defined (ST7735_DRIVER)
+/***************************************************************************************
+** Function name:           setScrollArea
+** Description:             Define a hardware vertical scroll band (ST7735 VSCRDEF)
+***************************************************************************************/
+bool TFT_eSPI::setScrollArea(int32_t top, int32_t height)
+{
+  // VSCRSADD addresses frame memory rows, which only match screen rows without MV / MY
+  if (rotation != 0) return false;
+  int32_t tfa = rowstart + top;
+  if (top < 0 || height < 1 || top + height > _height || tfa + height > ST7735_FRAME_ROWS) return false;
+  int32_t bfa = ST7735_FRAME_ROWS - tfa - height;
+
+  DMA_BUSY_CHECK; // Commands cannot be interleaved with a running DMA transfer
+  begin_tft_write();
+  writecommand(ST7735_VSCRDEF);
+  writedata(tfa >> 8);    writedata(tfa);
+  writedata(height >> 8); writedata(height);
+  writedata(bfa >> 8);    writedata(bfa);
+  end_tft_write();
+
+  _scrollTop = top;
+  _scrollHeight = height;
+  _scrollOffset = 0;
+  scrollArea(0);
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           scrollArea
+** Description:             Move the scroll band by a number of rows (ST7735 VSCRSADD)
+***************************************************************************************/
+void TFT_eSPI::scrollArea(int32_t lines)
+{
+  if (_scrollHeight == 0) return;
+  _scrollOffset = (_scrollOffset + lines) % _scrollHeight;
+  if (_scrollOffset < 0) _scrollOffset += _scrollHeight;
+  int32_t vsp = rowstart + _scrollTop + _scrollOffset;
+
+  DMA_BUSY_CHECK;
+  begin_tft_write();
+  writecommand(ST7735_VSCRSADD);
+  writedata(vsp >> 8); writedata(vsp);
+  end_tft_write();
+}
+
+/***************************************************************************************
+** Function name:           scrollRow
+** Description:             Screen row y inside the scroll band -> row to draw into
+***************************************************************************************/
+int32_t TFT_eSPI::scrollRow(int32_t y)
+{
+  if (y < _scrollTop || y >= _scrollTop + _scrollHeight) return y;
+  return _scrollTop + (y - _scrollTop + _scrollOffset) % _scrollHeight;
+}
+
+/***************************************************************************************
+** Function name:           resetScrollArea
+** Description:             Restore the unscrolled row mapping
+***************************************************************************************/
+void TFT_eSPI::resetScrollArea(void)
+{
+  if (_scrollHeight == 0) return;
+  scrollArea(-_scrollOffset);
+  _scrollHeight = 0;
+}
+#endif
+
 /***************************************************************************************
 ** Function name:           verifySetupID
 ** Description:             Compare the ID if USER_SETUP_ID defined in user setup file
@@ -6004,7 +6099,7 @@ void TFT_eSPI::getSetup(setup_t &tft_settings)
   tft_settings.tft_spi_freq = 0;
 #else
   tft_settings.serial = true;
-  tft_settings.tft_spi_freq = SPI_FREQUENCY/100000;
+  tft_settings.tft_spi_freq = _spi_freq/100000;
   #ifdef SPI_READ_FREQUENCY
     tft_settings.tft_rd_freq = SPI_READ_FREQUENCY/100000;
   #endif
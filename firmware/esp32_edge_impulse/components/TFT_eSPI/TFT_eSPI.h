@@ -127,6 +127,11 @@
   #define SPI_READ_FREQUENCY 10000000
 #endif
 
+// Largest DMA pixel transaction when the bus is shared with other devices (see shareBus())
+#ifndef TFT_DMA_CHUNK_BYTES
+  #define TFT_DMA_CHUNK_BYTES 2048
+#endif
+
 // Some ST7789 boards do not work with Mode 0
 #ifndef TFT_SPI_MODE
   #if defined(ST7789_DRIVER) || defined(ST7789_2_DRIVER)
@@ -787,6 +792,21 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
 #if defined (ESP32) // ESP32 only at the moment
            // For case where pointer is a const and the image data must not be modified (clipped or byte swapped)
   void     pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t const* data);
+           // Queue the window set-up commands behind any DMA in progress (inclusive coordinates)
+           // The const pushImageDMA() uses this and returns with only its own image in progress
+  void     setWindowDMA(int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+
+           // Share the SPI bus with other devices (e.g. an SD card on the same host), call after
+           // initDMA() and before startWrite(). Pixel data is then queued in chunks of at most
+           // chunk_bytes and a device waiting in busAcquire() is given the bus between two chunks,
+           // one access per chunk, so neither side can starve the other. Keep startWrite()/endWrite()
+           // around each frame only: the display holds the bus for the whole write transaction.
+  bool     shareBus(uint32_t chunk_bytes = TFT_DMA_CHUNK_BYTES);
+           // Other bus users bracket every access (e.g. one SD command or sector write) with these.
+           // busAcquire() returns false on timeout or if shareBus() has not been called
+  static bool busAcquire(uint32_t timeout_ms);
+  static void busRelease(void);
+  static int  busHost(void);   // spi_host_device_t of the display bus, for adding other devices
 #endif
            // Push a block of pixels into a window set up using setAddrWindow()
   void     pushPixelsDMA(uint16_t* image, uint32_t len);
@@ -822,6 +842,25 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
   // Global variables
 #if !defined (TFT_PARALLEL_8_BIT) && !defined (RP2040_PIO_INTERFACE)
   static   SPIClass& getSPIinstance(void); // Get SPI class handle
+
+           // Change the SPI write clock at run time (default SPI_FREQUENCY), reads keep SPI_READ_FREQUENCY
+           // Call before initDMA(), the DMA device clock is set when it is attached to the bus
+  void     setSPIFrequency(uint32_t freq);
+  uint32_t getSPIFrequency(void) { return _spi_freq; }
+#endif
+
+#if defined (ST7735_DRIVER)
+           // Hardware vertical scroll (VSCRDEF / VSCRSADD), rotation 0 only: rows top..top+height-1
+           // become a band that wraps around. Full panel width, so the band must hold only scrolling
+           // content. Returns false if the rotation or the band does not fit
+  bool     setScrollArea(int32_t top, int32_t height);
+           // Shift the band content up by lines (negative = down), only the scroll pointer is sent
+  void     scrollArea(int32_t lines);
+           // Row to draw into so it appears at screen row y (rows outside the band map to themselves),
+           // e.g. the rows exposed by scrollArea()
+  int32_t  scrollRow(int32_t y);
+           // Back to the unscrolled mapping
+  void     resetScrollArea(void);
 #endif
   uint32_t textcolor, textbgcolor;         // Text foreground and background colours
 
@@ -858,6 +897,12 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            // Initialise the data bus GPIO and hardware interfaces
   void     initBus(void);
 
+#if defined (ESP32_DMA)
+           // Shared bus: queue pixel data in chunks, hand the bus over between them (see shareBus())
+  void     dmaQueueData(const void* data, uint32_t bytes);
+  void     dmaYield(void);
+#endif
+
            // Temporary  library development function  TODO: remove need for this
   void     pushSwapBytePixels(const void* data_in, uint32_t len);
 
@@ -902,6 +947,12 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
 
   bool     locked, inTransaction, lockTransaction; // SPI transaction and mutex lock flags
 
+  uint32_t _spi_freq = SPI_FREQUENCY;     // SPI write clock, see setSPIFrequency()
+
+#if defined (ST7735_DRIVER)
+  int32_t  _scrollTop = 0, _scrollHeight = 0, _scrollOffset = 0; // setScrollArea() band, 0 height = none
+#endif
+
  //-------------------------------------- protected ----------------------------------//
  protected:
 
@@ -0,0 +1,109 @@
+#include "dirty_region.h"
+
+#include <string.h>
+
+DirtyRegion::DirtyRegion(int16_t width, int16_t height)
+    : width_(width), height_(height), prev_count_(0), cur_count_(0), full_(true), overflow_(false) {
+}
+
+void DirtyRegion::begin_frame() {
+    cur_count_ = 0;
+    overflow_ = false;
+}
+
+void DirtyRegion::mark(int x, int y, int w, int h, uint32_t key) {
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > width_) w = width_ - x;
+    if (y + h > height_) h = height_ - y;
+    if (w <= 0 || h <= 0) return;
+
+    if (cur_count_ >= MAX_ELEMS) {
+        overflow_ = true;
+        return;
+    }
+    cur_[cur_count_++] = { { (int16_t)x, (int16_t)y, (int16_t)w, (int16_t)h }, key };
+}
+
+bool DirtyRegion::contains_(const Elem *list, int n, const Elem &e) {
+    for (int i = 0; i < n; i++) {
+        const Elem &o = list[i];
+        if (o.key == e.key && o.r.x == e.r.x && o.r.y == e.r.y && o.r.w == e.r.w && o.r.h == e.r.h) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ── Rect helpers ─────────────────────────────────────────────────────────────
+
+static int32_t area(const UiRect &r) {
+    return (int32_t)r.w * r.h;
+}
+
+static bool overlaps(const UiRect &a, const UiRect &b) {
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+static UiRect unite(const UiRect &a, const UiRect &b) {
+    int16_t x0 = a.x < b.x ? a.x : b.x;
+    int16_t y0 = a.y < b.y ? a.y : b.y;
+    int16_t x1 = (a.x + a.w) > (b.x + b.w) ? (a.x + a.w) : (b.x + b.w);
+    int16_t y1 = (a.y + a.h) > (b.y + b.h) ? (a.y + a.h) : (b.y + b.h);
+    return { x0, y0, (int16_t)(x1 - x0), (int16_t)(y1 - y0) };
+}
+
+int DirtyRegion::end_frame(UiRect *out) {
+    bool full = full_ || overflow_;
+    full_ = false;
+
+    // 新增 / 改變（本 frame 有、上 frame 沒有）與消失（上 frame 有、本 frame 沒有）的元素
+    UiRect rects[MAX_ELEMS * 2];
+    int n = 0;
+    if (!full) {
+        for (int i = 0; i < cur_count_; i++) {
+            if (!contains_(prev_, prev_count_, cur_[i])) rects[n++] = cur_[i].r;
+        }
+        for (int i = 0; i < prev_count_; i++) {
+            if (!contains_(cur_, cur_count_, prev_[i])) rects[n++] = prev_[i].r;
+        }
+    }
+
+    memcpy(prev_, cur_, sizeof(Elem) * cur_count_);
+    prev_count_ = cur_count_;
+    if (overflow_) full_ = true;   // 基準不完整，下一 frame 也整個重送
+
+    if (full) {
+        out[0] = { 0, 0, width_, height_ };
+        return 1;
+    }
+
+    // 合併至互不重疊且不超過 MAX_RECTS 個：重疊者直接合併，過多時合併增加面積最少的一對
+    while (true) {
+        int mi = -1, mj = -1;
+        int32_t best = INT32_MAX;
+        for (int i = 0; i < n && best > 0; i++) {
+            for (int j = i + 1; j < n; j++) {
+                UiRect u = unite(rects[i], rects[j]);
+                int32_t growth = overlaps(rects[i], rects[j]) ? 0
+                               : area(u) - area(rects[i]) - area(rects[j]);
+                if (growth < best) { best = growth; mi = i; mj = j; }
+                if (best == 0) break;
+            }
+        }
+        if (mi < 0 || (best > 0 && n <= MAX_RECTS)) break;
+        rects[mi] = unite(rects[mi], rects[mj]);
+        rects[mj] = rects[--n];
+    }
+
+    // 合計面積接近全畫面時，一次送整個畫面較省（少了每個矩形的位址設定）
+    int32_t total = 0;
+    for (int i = 0; i < n; i++) total += area(rects[i]);
+    if (total * 4 > (int32_t)width_ * height_ * 3) {
+        out[0] = { 0, 0, width_, height_ };
+        return 1;
+    }
+
+    memcpy(out, rects, sizeof(UiRect) * n);
+    return n;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+// ── Dirty-region tracker ─────────────────────────────────────────────────────
+// 每個 frame 以 (外框, key) 記錄畫出的元素；key 由繪製參數雜湊而來。
+// 與上一個 frame 比對：新增、消失或參數改變的元素外框就是螢幕上需重送的區域，
+// 其餘像素與畫面上現有內容相同。sprite 仍每 frame 全部重畫（僅 CPU），只省 SPI 傳輸。
+
+struct UiRect {
+    int16_t x, y, w, h;
+};
+
+class DirtyRegion {
+public:
+    static constexpr int MAX_ELEMS = 32;   // 每 frame 可追蹤的元素數，超過則整個畫面重送
+    static constexpr int MAX_RECTS = 4;    // 每 frame 最多送出的矩形數（其餘合併）
+
+    DirtyRegion(int16_t width, int16_t height);
+
+    /** 開始記錄新的 frame */
+    void begin_frame();
+
+    /** 記錄一個畫出的元素（外框會裁切至畫面內） */
+    void mark(int x, int y, int w, int h, uint32_t key);
+
+    /** 畫面內容未知（例如螢幕重新上電）：下一個 frame 整個重送 */
+    void invalidate() { full_ = true; }
+
+    /**
+     * 結束 frame，算出需重送的矩形（互不重疊）並以本 frame 作為下次比對基準。
+     * @return 矩形數，0 = 畫面無變化
+     */
+    int end_frame(UiRect *out);
+
+private:
+    struct Elem {
+        UiRect   r;
+        uint32_t key;
+    };
+
+    int16_t width_, height_;
+    Elem    prev_[MAX_ELEMS], cur_[MAX_ELEMS];
+    int     prev_count_, cur_count_;
+    bool    full_;       // 下一次 end_frame 整個畫面重送
+    bool    overflow_;   // 本 frame 元素數超過 MAX_ELEMS
+
+    static bool contains_(const Elem *list, int n, const Elem &e);
+};
+
+// 繪製參數 → 元素 key（FNV-1a）
+inline uint32_t ui_key_mix(uint32_t h, int v) {
+    for (int i = 0; i < 4; i++) {
+        h ^= (uint32_t)(v >> (i * 8)) & 0xFF;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+template <typename... T>
+inline uint32_t ui_key(T... v) {
+    uint32_t h = 2166136261u;
+    ((h = ui_key_mix(h, (int)v)), ...);
+    return h;
+}
@@ -0,0 +1,193 @@
+#include "display_list.h"
+
+UiItem *DisplayList::add_(UiOp op, uint8_t color, int top, int bottom) {
+    if (count_ >= MAX_ITEMS) return nullptr;
+    UiItem *it = &items_[count_++];
+    it->op     = op;
+    it->color  = color;
+    it->top    = (int16_t)top;
+    it->bottom = (int16_t)bottom;
+    return it;
+}
+
+void DisplayList::append(const DisplayList &other) {
+    for (int n = 0; n < other.count_ && count_ < MAX_ITEMS; n++) items_[count_++] = other.items_[n];
+}
+
+void DisplayList::rect(int x, int y, int w, int h, uint8_t color) {
+    if (w <= 0 || h <= 0) return;
+    UiItem *it = add_(UI_OP_RECT, color, y, y + h - 1);
+    if (!it) return;
+    it->rect = { (int16_t)x, (int16_t)y, (int16_t)w, (int16_t)h };
+}
+
+void DisplayList::spans(int cx, int cy, int ry, const int8_t *half, uint8_t color) {
+    UiItem *it = add_(UI_OP_SPANS, color, cy - ry, cy + ry);
+    if (!it) return;
+    it->spans = { (int16_t)cx, (int16_t)cy, (int16_t)ry, half };
+}
+
+void DisplayList::triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t color) {
+    // 依 y 排序（y0 <= y1 <= y2）
+    if (y0 > y1) { int t = y0; y0 = y1; y1 = t; t = x0; x0 = x1; x1 = t; }
+    if (y1 > y2) { int t = y1; y1 = y2; y2 = t; t = x1; x1 = x2; x2 = t; }
+    if (y0 > y1) { int t = y0; y0 = y1; y1 = t; t = x0; x0 = x1; x1 = t; }
+    UiItem *it = add_(UI_OP_TRIANGLE, color, y0, y2);
+    if (!it) return;
+    it->tri = { (int16_t)x0, (int16_t)y0, (int16_t)x1, (int16_t)y1, (int16_t)x2, (int16_t)y2 };
+}
+
+void DisplayList::dots(int ox, int oy, int sx, const UiPoint *pts, int n, int size, uint8_t color) {
+    if (n <= 0) return;
+    int ymin = pts[0].y, ymax = pts[0].y;
+    for (int i = 1; i < n; i++) {
+        if (pts[i].y < ymin) ymin = pts[i].y;
+        if (pts[i].y > ymax) ymax = pts[i].y;
+    }
+    UiItem *it = add_(UI_OP_DOTS, color, oy + ymin, oy + ymax + size - 1);
+    if (!it) return;
+    it->dots = { (int16_t)ox, (int16_t)oy, (int16_t)n, (int16_t)size, (int16_t)sx, pts };
+}
+
+void DisplayList::z(int x, int y, int size, uint8_t color) {
+    UiItem *it = add_(UI_OP_Z, color, y, y + size);
+    if (!it) return;
+    it->z = { (int16_t)x, (int16_t)y, (int16_t)size };
+}
+
+void DisplayList::rle(int x, int y, int w, int h, const uint8_t *data) {
+    UiItem *it = add_(UI_OP_RLE, 0, y, y + h - 1);
+    if (!it) return;
+    it->rle = { (int16_t)x, (int16_t)y, (int16_t)w, data };
+}
+
+void DisplayList::text(int x, int y, int w, int h, const uint32_t *bits, uint8_t color) {
+    if (w <= 0 || h <= 0) return;
+    UiItem *it = add_(UI_OP_TEXT, color, y, y + h - 1);
+    if (!it) return;
+    it->text = { (int16_t)x, (int16_t)y, (int16_t)(w < TEXT_MAX_W ? w : TEXT_MAX_W), bits };
+}
+
+// ── Rasterizer ───────────────────────────────────────────────────────────────
+
+// 填滿第 row 列的 [x0, x1]（畫面座標，含端點），裁切至區域 [rx, rx + w)。
+// 同 TFT_eSprite::fillSpans：對齊後每次寫入 32 位元（兩個像素）
+static inline void fill_span(uint16_t *row, int x0, int x1, int rx, int w, uint16_t c) {
+    x0 -= rx;
+    x1 -= rx;
+    if (x0 < 0) x0 = 0;
+    if (x1 >= w) x1 = w - 1;
+    int n = x1 - x0 + 1;
+    if (n <= 0) return;
+    uint16_t *p = row + x0;
+    if (((uintptr_t)p & 2) != 0) { *p++ = c; n--; }
+    uint32_t *p32 = (uint32_t *)p;
+    uint32_t c32 = c | ((uint32_t)c << 16);
+    for (; n >= 2; n -= 2) *p32++ = c32;
+    if (n) *(uint16_t *)p32 = c;
+}
+
+// 三角形第 y 列的 span（同 Adafruit / TFT_eSPI fillTriangle：上半段以 0-1、0-2 邊內插，
+// 下半段以 1-2、0-2 邊內插，整數除法截斷）
+static void triangle_span(const UiItem &it, int y, int *xa, int *xb) {
+    int x0 = it.tri.x0, y0 = it.tri.y0, x1 = it.tri.x1, y1 = it.tri.y1, x2 = it.tri.x2, y2 = it.tri.y2;
+    int a, b;
+    if (y0 == y2) {   // 退化為一列
+        a = b = x0;
+        if (x1 < a) a = x1; else if (x1 > b) b = x1;
+        if (x2 < a) a = x2; else if (x2 > b) b = x2;
+    } else {
+        int last = (y1 == y2) ? y1 : y1 - 1;
+        b = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
+        a = (y <= last) ? x0 + (x1 - x0) * (y - y0) / (y1 - y0)
+                        : x1 + (x2 - x1) * (y - y1) / (y2 - y1);
+        if (a > b) { int t = a; a = b; b = t; }
+    }
+    *xa = a;
+    *xb = b;
+}
+
+void DisplayList::render(uint16_t *buf, int rx, int ry, int w, int h, const uint16_t *colors) const {
+    if (bg_) {
+        for (int y = 0; y < h; y++) {
+            const uint8_t *src = bg_ + (ry + y) * bg_width_ / 2;
+            uint16_t *row = buf + y * w;
+            for (int x = 0, px = rx; x < w; x++, px++) {
+                uint8_t b = src[px >> 1];
+                row[x] = colors[(px & 1) ? (b >> 4) : (b & 0x0F)];
+            }
+        }
+    } else {
+        for (int i = 0; i < w * h; i++) buf[i] = colors[0];
+    }
+
+    for (int n = 0; n < count_; n++) {
+        const UiItem &it = items_[n];
+        int y_from = it.top > ry ? it.top : ry;
+        int y_to   = it.bottom < ry + h - 1 ? it.bottom : ry + h - 1;
+        uint16_t c = colors[it.color & 0x0F];
+
+        for (int y = y_from; y <= y_to; y++) {
+            uint16_t *row = buf + (y - ry) * w;
+            switch (it.op) {
+                case UI_OP_RECT:
+                    fill_span(row, it.rect.x, it.rect.x + it.rect.w - 1, rx, w, c);
+                    break;
+                case UI_OP_SPANS: {
+                    int dy = y - it.spans.cy;
+                    int hw = it.spans.half[dy < 0 ? -dy : dy];
+                    fill_span(row, it.spans.cx - hw, it.spans.cx + hw, rx, w, c);
+                    break;
+                }
+                case UI_OP_TRIANGLE: {
+                    int a, b;
+                    triangle_span(it, y, &a, &b);
+                    fill_span(row, a, b, rx, w, c);
+                    break;
+                }
+                case UI_OP_DOTS:
+                    for (int k = 0; k < it.dots.n; k++) {
+                        int py = it.dots.oy + it.dots.pts[k].y;
+                        if (y < py || y >= py + it.dots.size) continue;
+                        int px = it.dots.ox + it.dots.sx * it.dots.pts[k].x;
+                        fill_span(row, px, px + it.dots.size - 1, rx, w, c);
+                    }
+                    break;
+                case UI_OP_Z: {
+                    // 上下橫線各 size 點，斜線每列一點 (x + size - i, y + i)
+                    int i = y - it.z.y;
+                    if (i == 0 || i == it.z.size) fill_span(row, it.z.x, it.z.x + it.z.size - 1, rx, w, c);
+                    if (i < it.z.size) {
+                        int px = it.z.x + it.z.size - i;
+                        fill_span(row, px, px, rx, w, c);
+                    }
+                    break;
+                }
+                case UI_OP_TEXT: {
+                    // 連續的 1 位元合併成一段 span
+                    const uint32_t *bits = it.text.bits + (y - it.text.y) * TEXT_ROW_WORDS;
+                    for (int i = 0; i < it.text.w;) {
+                        if (!(bits[i >> 5] >> (i & 31) & 1)) {
+                            i++;
+                            continue;
+                        }
+                        int start = i;
+                        while (i < it.text.w && (bits[i >> 5] >> (i & 31) & 1)) i++;
+                        fill_span(row, it.text.x + start, it.text.x + i - 1, rx, w, c);
+                    }
+                    break;
+                }
+                case UI_OP_RLE: {
+                    // 每段 (長度 - 1) << 4 | 索引，該列剛好 w 個像素（載入時已檢查）
+                    const uint8_t *p = it.rle.data + ((const uint16_t *)it.rle.data)[y - it.rle.y];
+                    for (int px = it.rle.x, end = it.rle.x + it.rle.w; px < end; p++) {
+                        int len = (*p >> 4) + 1;
+                        if (*p & 0x0F) fill_span(row, px, px + len - 1, rx, w, colors[*p & 0x0F]);
+                        px += len;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
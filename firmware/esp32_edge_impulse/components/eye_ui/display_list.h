@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "shape_tables.h"
+
+// ── Display list ─────────────────────────────────────────────────────────────
+// 一個 frame 的繪圖指令。不保留 framebuffer：送出時將畫面區域逐條帶（strip）
+// 光柵化到小的行緩衝，背景為調色盤 0 或快取圖層（layer_cache.h）。所有圖形皆可逐列獨立計算出水平 span。
+
+enum UiOp : uint8_t {
+    UI_OP_RECT,       // 實心矩形
+    UI_OP_SPANS,      // 以半寬表描述的對稱圖形（EllipseSpans）
+    UI_OP_TRIANGLE,   // 實心三角形（同 TFT_eSPI fillTriangle 的掃描線算法）
+    UI_OP_DOTS,       // 點表上的 size x size 方塊（ArcPoints）
+    UI_OP_Z,          // 睡覺的 Z 字
+    UI_OP_RLE,        // 預先繪製的 RLE frame（eye_assets.h），索引 0 透明
+    UI_OP_TEXT,       // 逐列位元遮罩（glyph_atlas.h 的 TextRun），bit = 1 的像素填色
+};
+
+struct UiItem {
+    UiOp    op;
+    uint8_t color;          // 調色盤索引
+    int16_t top, bottom;    // 涵蓋的列範圍（含），光柵化時快速略過
+    union {
+        struct { int16_t x, y, w, h; } rect;
+        struct { int16_t cx, cy, ry; const int8_t *half; } spans;
+        struct { int16_t x0, y0, x1, y1, x2, y2; } tri;   // 已依 y 排序
+        struct { int16_t ox, oy, n, size, sx; const UiPoint *pts; } dots;   // x = ox + sx * pt.x
+        struct { int16_t x, y, size; } z;
+        struct { int16_t x, y, w; const uint8_t *data; } rle;
+        struct { int16_t x, y, w; const uint32_t *bits; } text;
+    };
+};
+
+class DisplayList {
+public:
+    static constexpr int MAX_ITEMS = 32;   // 超過的指令丟棄
+    static constexpr int TEXT_ROW_WORDS = 4;                     // text() 每列的 32 位元字組數
+    static constexpr int TEXT_MAX_W = TEXT_ROW_WORDS * 32;
+
+    DisplayList() : count_(0), bg_(nullptr), bg_width_(0) {}
+
+    void clear() {
+        count_ = 0;
+        bg_ = nullptr;
+    }
+
+    /** 以整個畫面的圖層（每像素 4 位元調色盤索引，低半位元組在左）取代索引 0 背景，clear() 後取消 */
+    void background(const uint8_t *layer, int width) {
+        bg_ = layer;
+        bg_width_ = width;
+    }
+
+    /** 複製 other 的全部指令（圖層快取不可用時直接繪製） */
+    void append(const DisplayList &other);
+
+    void rect(int x, int y, int w, int h, uint8_t color);
+    /** 第 |dy| 列（dy = -ry..ry）的範圍為 cx ± half[|dy|] */
+    void spans(int cx, int cy, int ry, const int8_t *half, uint8_t color);
+    void triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t color);
+    /** 每個點畫成左上角在 (ox + sx * pt.x, oy + pt.y) 的 size x size 方塊 */
+    void dots(int ox, int oy, int sx, const UiPoint *pts, int n, int size, uint8_t color);
+    void z(int x, int y, int size, uint8_t color);
+    /** data 為 frame 的列 offset 表 + RLE 資料（eye_assets.h 格式），左上角在 (x, y) */
+    void rle(int x, int y, int w, int h, const uint8_t *data);
+    /** bits 為 h 列、每列 TEXT_ROW_WORDS 字組的位元遮罩（bit i = x + i），左上角在 (x, y)，寬 w */
+    void text(int x, int y, int w, int h, const uint32_t *bits, uint8_t color);
+
+    /**
+     * 光柵化畫面區域 (x, y, w, h) 到 buf（w * h 像素，列優先）。
+     * @param colors 調色盤索引 → 寫入緩衝的像素值（面板位元組順序 RGB565）
+     */
+    void render(uint16_t *buf, int x, int y, int w, int h, const uint16_t *colors) const;
+
+private:
+    UiItem         items_[MAX_ITEMS];
+    int            count_;
+    const uint8_t *bg_;
+    int            bg_width_;
+
+    UiItem *add_(UiOp op, uint8_t color, int top, int bottom);
+};
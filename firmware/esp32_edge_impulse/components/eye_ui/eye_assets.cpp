@@ -0,0 +1,109 @@
+#include "eye_assets.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+
+static const char *TAG_ASSETS = "UI_ASSETS";
+
+#define EYE_ASSETS_MAX_W 128
+#define EYE_ASSETS_MAX_H 160
+
+static const uint8_t *assets = nullptr;   // mmap 起點，nullptr = 沒有可用資產
+static const EyeAssetHeader *header = nullptr;
+
+// 每列解碼後剛好 w 個像素、且不超出資產範圍
+static bool frame_valid(const EyeAssetFrame *f, uint32_t size) {
+    if (f->w == 0 || f->h == 0 || f->w > EYE_ASSETS_MAX_W || f->h > EYE_ASSETS_MAX_H) return false;
+    if (f->x < 0 || f->y < 0 || f->x + f->w > EYE_ASSETS_MAX_W || f->y + f->h > EYE_ASSETS_MAX_H) return false;
+    if ((f->data_offset & 1) || f->data_offset + f->h * 2u > size) return false;
+
+    const uint8_t *data = assets + f->data_offset;
+    const uint16_t *rows = (const uint16_t *)data;
+    for (int y = 0; y < f->h; y++) {
+        uint32_t pos = f->data_offset + rows[y];
+        int px = 0;
+        while (px < f->w) {
+            if (pos >= size) return false;
+            px += (assets[pos++] >> 4) + 1;
+        }
+        if (px != f->w) return false;
+    }
+    return true;
+}
+
+static bool assets_valid(uint32_t size) {
+    uint32_t anims_end = sizeof(EyeAssetHeader) + header->anim_count * sizeof(EyeAssetAnim);
+    if (anims_end > size) return false;
+    const EyeAssetAnim *anims = (const EyeAssetAnim *)(header + 1);
+    const EyeAssetFrame *frames = (const EyeAssetFrame *)(anims + header->anim_count);
+
+    for (int a = 0; a < header->anim_count; a++) {
+        const EyeAssetAnim &anim = anims[a];
+        if (anim.frame_count == 0 || anim.frame_ms == 0) return false;
+        uint32_t frames_end = anims_end + (anim.first_frame + anim.frame_count) * sizeof(EyeAssetFrame);
+        if (frames_end > size) return false;
+        for (int i = 0; i < anim.frame_count; i++) {
+            if (!frame_valid(&frames[anim.first_frame + i], size)) return false;
+        }
+    }
+    return true;
+}
+
+bool eye_assets_init(void) {
+    if (assets) return true;
+
+    const esp_partition_t *part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)EYE_ASSETS_SUBTYPE, EYE_ASSETS_LABEL);
+    if (!part) {
+        ESP_LOGI(TAG_ASSETS, "No %s partition, using drawn animations", EYE_ASSETS_LABEL);
+        return false;
+    }
+
+    EyeAssetHeader hdr;
+    if (esp_partition_read(part, 0, &hdr, sizeof(hdr)) != ESP_OK ||
+        hdr.magic != EYE_ASSETS_MAGIC || hdr.version != EYE_ASSETS_VERSION ||
+        hdr.total_size < sizeof(hdr) || hdr.total_size > part->size) {
+        ESP_LOGI(TAG_ASSETS, "No assets flashed, using drawn animations");
+        return false;
+    }
+
+    const void *ptr;
+    esp_partition_mmap_handle_t handle;
+    esp_err_t err = esp_partition_mmap(part, 0, hdr.total_size, ESP_PARTITION_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_ASSETS, "mmap failed: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    assets = (const uint8_t *)ptr;
+    header = (const EyeAssetHeader *)ptr;
+    if (!assets_valid(hdr.total_size)) {
+        ESP_LOGE(TAG_ASSETS, "Invalid asset data, using drawn animations");
+        esp_partition_munmap(handle);
+        assets = nullptr;
+        header = nullptr;
+        return false;
+    }
+
+    ESP_LOGI(TAG_ASSETS, "%d animations, %u bytes mapped", header->anim_count, (unsigned)hdr.total_size);
+    return true;
+}
+
+const EyeAssetAnim *eye_assets_find(int state) {
+    if (!header) return nullptr;
+    const EyeAssetAnim *anims = (const EyeAssetAnim *)(header + 1);
+    for (int a = 0; a < header->anim_count; a++) {
+        if (anims[a].state == state) return &anims[a];
+    }
+    return nullptr;
+}
+
+const EyeAssetFrame *eye_assets_frame(const EyeAssetAnim *anim, int i) {
+    const EyeAssetAnim *anims = (const EyeAssetAnim *)(header + 1);
+    const EyeAssetFrame *frames = (const EyeAssetFrame *)(anims + header->anim_count);
+    return &frames[anim->first_frame + i];
+}
+
+const uint8_t *eye_assets_data(const EyeAssetFrame *frame) {
+    return assets + frame->data_offset;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+// ── Pre-rendered animation assets ────────────────────────────────────────────
+// scripts/build_eye_assets.py 將設計師提供的 PNG frame 轉成 eye_assets.bin，燒到 eye_assets 分區。
+// 開機時 memory-map 整個資產，frame 直接從 flash 光柵化到行緩衝，沒有每 frame 的幾何計算。
+// 某狀態有資產時取代程式繪製的動畫；分區不存在或內容無效時全部維持程式繪製。
+//
+// 格式（little-endian，offset 皆相對檔頭）：
+//   EyeAssetHeader
+//   EyeAssetAnim   anims[anim_count]
+//   EyeAssetFrame  frames[...]            每個動畫 frame_count 個，從 anim.first_frame 開始
+//   frame data     uint16_t rows[h]       每列 RLE 資料相對 frame data 起點的 offset
+//                  uint8_t  rle[...]      每 byte 一段：(長度 - 1) << 4 | 調色盤索引，長度 1~16
+// 調色盤索引與 eye_ui.cpp 的 UiColor 相同；索引 0 為透明（背景本來就是索引 0）。
+
+#define EYE_ASSETS_MAGIC   0x31415945u   // "EYA1"
+#define EYE_ASSETS_VERSION 1
+#define EYE_ASSETS_LABEL   "eye_assets"
+#define EYE_ASSETS_SUBTYPE 0x40
+
+#define EYE_ASSET_LOOP 0x01   // 循環播放；否則停在最後一個 frame
+
+struct EyeAssetHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t anim_count;
+    uint32_t total_size;   // 整個資產的 bytes（mmap 的長度）
+};
+
+struct EyeAssetAnim {
+    uint8_t  state;         // ui_state_t
+    uint8_t  flags;         // EYE_ASSET_*
+    uint16_t frame_count;
+    uint16_t frame_ms;      // 每個 frame 的顯示時間
+    uint16_t first_frame;   // frames[] 中的索引
+};
+
+struct EyeAssetFrame {
+    int16_t  x, y;
+    uint16_t w, h;
+    uint32_t data_offset;
+};
+
+static_assert(sizeof(EyeAssetHeader) == 12, "asset header layout");
+static_assert(sizeof(EyeAssetAnim) == 8, "asset anim layout");
+static_assert(sizeof(EyeAssetFrame) == 12, "asset frame layout");
+
+/** memory-map 資產分區並檢查內容，失敗回傳 false（之後 eye_assets_find 一律回傳 nullptr） */
+bool eye_assets_init(void);
+
+/** 狀態對應的動畫，沒有則回傳 nullptr */
+const EyeAssetAnim *eye_assets_find(int state);
+
+/** 動畫的第 i 個 frame（i < frame_count） */
+const EyeAssetFrame *eye_assets_frame(const EyeAssetAnim *anim, int i);
+
+/** frame 的列 offset 表與 RLE 資料起點 */
+const uint8_t *eye_assets_data(const EyeAssetFrame *frame);
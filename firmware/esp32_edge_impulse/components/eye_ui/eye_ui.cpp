@@ -3,54 +3,184 @@
 #include "Arduino.h"
 #include <SPI.h>
 #include <TFT_eSPI.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 
+#include "esp_attr.h"
+#include "esp_cpu.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "nvs.h"
 #include "ui_state.h"
+#include "power_state.h"
+#include "trace_points.h"
+#include "contention.h"
+#include "dirty_region.h"
+#include "display_list.h"
+#include "layer_cache.h"
+#include "glyph_atlas.h"
+#include "eye_assets.h"
+#include "shape_tables.h"
 
 // ── Display power control ────────────────────────────────────────────────
+// 顯示器電源只由這個元件控制，分四個層級：
+//   DISP_OFF    電源切斷，暫存器與畫面 RAM 全失，恢復需完整 tft.init()（數百 ms）
+//   DISP_SLEEP  電源開著、面板 SLPIN：暫存器與畫面 RAM 保留，SLPOUT 後數 ms 即可寫入
+//   DISP_WARM   面板醒著但 DISPOFF：可先畫好 frame，點亮只差一個 DISPON
+//   DISP_ON     顯示中
+// 關螢幕先進 SLEEP；背光與面板共用同一路電源，SLEEP 持續 UI_DISPLAY_RAIL_OFF_MS 後才切電源。
 #define DISPLAY_EN_PIN   GPIO_NUM_4   // GPIO to control display power
-static bool display_is_on = false;
+#define UI_SLPOUT_SETTLE_MS 5          // ST7735：SLPOUT 後需等 5 ms 才能送下一個指令
+#define UI_SLPIN_GUARD_MS 120          // ST7735：SLPOUT 後 120 ms 內不可 SLPIN
+#define UI_PREWARM_HOLD_MS 3000        // VAD 預熱後等不到狀態事件就回到 SLEEP
+#define UI_DISPLAY_RAIL_OFF_MS 60000
 
-// ── TFT & Sprite instance ─────────────────────────────────────────────────────
+enum DisplayPower { DISP_OFF, DISP_SLEEP, DISP_WARM, DISP_ON };
+static DisplayPower disp_power = DISP_OFF;
+static uint32_t disp_power_ms = 0;   // 進入目前層級的時間
+static uint32_t slpout_ms = 0;       // 最近一次面板離開休眠的時間
+
+// ── TFT & render buffers ──────────────────────────────────────────────────────
 static TFT_eSPI tft = TFT_eSPI();
-static TFT_eSprite spr = TFT_eSprite(&tft);
+
+#define UI_WIDTH 128
+#define UI_HEIGHT 160
+
+// 不保留 framebuffer：每 frame 記錄 display list，送出時逐條帶光柵化到行緩衝（共 8 KB）。
+// 兩個行緩衝輪流使用：一個以 DMA 傳輸時，CPU 光柵化另一個
+#define UI_LINE_BUF_LINES 16
+#define UI_LINE_BUF_PX (UI_WIDTH * UI_LINE_BUF_LINES)
+static uint16_t *line_buf[2] = { nullptr, nullptr };   // nullptr = 已釋放（關螢幕）或配置失敗，不顯示
+static int line_buf_idx = 0;
+static bool use_dma = false;
+// 與 SD 卡等其他裝置共用 SPI 匯流排：只在送出 frame 期間持有匯流排，像素分段傳送，
+// 段與段之間讓給等待中的裝置（TFT_eSPI shareBus）
+static bool bus_shared = false;
+static DisplayList dl;
+
+// 只重送與上一個 frame 不同的區域（dirty_region.h）
+static DirtyRegion dirty(UI_WIDTH, UI_HEIGHT);
+
+// 臉部靜態圖層（layer_cache.h）：face_dl 每 frame 記錄臉部指令，只在參數改變時光柵化進快取
+static DisplayList face_dl;
+static LayerCache face_layers(UI_WIDTH, UI_HEIGHT);
 
 // ── Display power control functions ────────────────────────────────────────
-static void display_power_on(void) {
+static void display_set_power(DisplayPower power) {
+    disp_power = power;
+    disp_power_ms = millis();
+    ui_set_display_awake(power >= DISP_WARM);
+}
+
+// 電源開啟 + 完整初始化，結束時 DISPOFF（DISP_WARM）
+static void display_cold_start(void) {
     gpio_set_direction((gpio_num_t)DISPLAY_EN_PIN, GPIO_MODE_OUTPUT);
     gpio_set_level((gpio_num_t)DISPLAY_EN_PIN, 1);
     vTaskDelay(pdMS_TO_TICKS(10));
-    tft.init();
+    tft.init();                           // 初始化序列最後會 DISPON
+    tft.writecommand(ST7735_DISPOFF);
     tft.setRotation(0);
-    display_is_on = true;
+    dirty.invalidate();                   // 重新上電後畫面內容未知
+}
+
+// OFF / SLEEP → WARM
+static void display_wake_panel(void) {
+    if (disp_power == DISP_OFF) {
+        display_cold_start();
+        if (use_dma && !bus_shared) tft.startWrite();    // DMA 期間 CS 保持低電位
+    } else if (disp_power == DISP_SLEEP) {
+        // 休眠保留暫存器與畫面 RAM；唯一在 init 之後改過的 MADCTL 再寫一次
+        tft.writecommand(ST7735_SLPOUT);
+        vTaskDelay(pdMS_TO_TICKS(UI_SLPOUT_SETTLE_MS));
+        tft.setRotation(0);
+    } else {
+        return;
+    }
+    slpout_ms = millis();
+    display_set_power(DISP_WARM);
+}
+
+// WARM → ON：呼叫前先畫好 frame，點亮時就是新畫面
+static void display_power_on(void) {
+    if (disp_power != DISP_WARM) return;
+    if (use_dma) tft.dmaWait();           // 指令不能插在 DMA 傳輸中
+    tft.writecommand(ST7735_DISPON);
+    display_set_power(DISP_ON);
     ESP_LOGI("UI", "Display Powered ON");
 }
 
+// WARM / ON → SLEEP
 static void display_power_off(void) {
+    if (disp_power < DISP_WARM) return;
+    if (use_dma) tft.dmaWait();           // 最後一個 frame 送完
+    uint32_t awake_ms = millis() - slpout_ms;
+    if (awake_ms < UI_SLPIN_GUARD_MS) vTaskDelay(pdMS_TO_TICKS(UI_SLPIN_GUARD_MS - awake_ms));
+    tft.writecommand(ST7735_DISPOFF);
     tft.writecommand(ST7735_SLPIN);
+    display_set_power(DISP_SLEEP);
+    ESP_LOGI("UI", "Display sleeping");
+}
+
+// SLEEP → OFF
+static void display_rail_off(void) {
+    if (disp_power != DISP_SLEEP) return;
+    if (use_dma && !bus_shared) tft.endWrite();      // 釋放匯流排
     gpio_set_level((gpio_num_t)DISPLAY_EN_PIN, 0);
-    display_is_on = false;
+    display_set_power(DISP_OFF);
     ESP_LOGI("UI", "Display Powered OFF");
 }
 
 // ── UI config ───────────────────────────────────────────────────────────────
 #define UI_TEST_MODE 0
 #define UI_TEST_STEP_MS 5000
-#define UI_IDLE_FPS 20
-#define UI_LOG_FPS 0
+#define UI_IDLE_FPS 20        // 最高 frame rate；畫面沒有變化時不重畫
+#define UI_FRAME_MS (1000 / UI_IDLE_FPS)
+#define UI_LOG_FPS 0          // 1 = 定期輸出平均每 frame display list 建立 / 光柵化 + 送出時間與 CPU cycle 數
+#define UI_LOG_FPS_FRAMES 200
+#define UI_USE_DMA 1
+#if defined(CONFIG_ESP_MIAO_DISPLAY_SHARED_BUS)
+#define UI_SHARED_BUS 1       // 顯示匯流排與其他 SPI 裝置共用（eye_ui_bus_acquire）
+#else
+#define UI_SHARED_BUS 0
+#endif
+#define UI_LAYER_CACHE 1      // 1 = 臉部靜態圖層快取（每個變體 10 KB，首次使用時配置）
+#define UI_RELEASE_ON_SLEEP 1 // 1 = 關螢幕後釋放行緩衝與圖層快取，面板下次醒來時重新配置
+#if defined(CONFIG_ESP_MIAO_UI_PERF_HUD)
+#define UI_PERF_HUD 1         // 狀態列上方顯示 frame rate / core 0 負載 / 推論耗時
+#else
+#define UI_PERF_HUD 0
+#endif
+#define UI_TASK_STACK 8192
 static const char *TAG_UI = "UI";
 
 #define RGB(r, g, b) (((r & 0xF8) << 8) | ((g & 0xFC) << 3) | ((b) >> 3))
 #define PINK RGB(255, 100, 180)
 
+// 調色盤：繪圖函式的 color 參數為索引，背景為索引 0
+enum UiColor : uint8_t { UI_BLACK = 0, UI_WHITE, UI_PINK, UI_RED, UI_GREY };
+static const uint16_t ui_palette[16] = { TFT_BLACK, TFT_WHITE, PINK, RGB(255, 40, 40), RGB(130, 130, 130) };
+
+// 調色盤的面板位元組順序版本（行緩衝直接送出，不經 swap）
+static uint16_t ui_colors[16];
+
+static void build_colors(void) {
+    for (int i = 0; i < 16; i++) {
+        ui_colors[i] = (uint16_t)((ui_palette[i] << 8) | (ui_palette[i] >> 8));
+    }
+}
+
 // ── Animation state variables ────────────────────────────────────────────────
 static uint32_t anim_start_ms = 0;
+static uint32_t next_draw_ms = 0;   // 畫面下一次會改變的時間（動畫回報），到期才重畫
+static ui_telemetry_t telemetry = {};   // 每 frame 開頭讀取的音訊 / 串流即時數據
 
 static void anim_reset(void) {
     anim_start_ms = millis();
+    next_draw_ms = anim_start_ms;   // 狀態改變：立即重畫
 }
 
 static void ui_log_metrics(ui_state_t state) {
@@ -80,37 +210,68 @@ static uint32_t ui_state_timeout_ms(ui_state_t state) {
     }
 }
 
-// ── Cat Drawing Primitives (Using Sprite) ───────────────────────────
-
-static void fillEllipse(int cx, int cy, int rx, int ry, uint16_t color) {
-    for (int y = -ry; y <= ry; y++) {
-        float dy = (float)y / (float)ry;
-        float dx = sqrtf(1.0f - dy * dy);
-        int x_width = (int)(rx * dx);
-        spr.drawFastHLine(cx - x_width, cy + y, x_width * 2 + 1, color);
+// 狀態最短顯示時間：連續事件（WAKE→LISTENING→THINKING）時，期間內後續事件留在 ring 中，
+// 每個狀態都至少被看見這麼久
+static uint32_t ui_state_min_dwell_ms(ui_state_t state) {
+    switch (state) {
+        case UI_WAKE:
+        case UI_ACTION:
+            return 300;
+        case UI_ERROR:
+            return 500;
+        case UI_LISTENING:
+        case UI_THINKING:
+            return 150;
+        default:
+            return 0;
     }
 }
 
-static void drawZ(int x, int y, int size, uint16_t color) {
-    spr.drawFastHLine(x, y, size, color);
-    for (int i = 0; i < size; i++) {
-        spr.drawPixel(x + size - i, y + i, color);
-    }
-    spr.drawFastHLine(x, y + size, size, color);
+// ── Cat Drawing Primitives (Display List) ───────────────────────────
+// 每個 primitive 以外框 + 參數 key 登記到 dirty，供 push_frame 比對變化區域，並加入 display list
+// （臉部靜態元素加入 face_dl）
+
+enum UiShape { SHAPE_ELLIPSE = 1, SHAPE_Z, SHAPE_OMEGA, SHAPE_TRIANGLE, SHAPE_RECT, SHAPE_ARC_DOTS, SHAPE_ASSET,
+               SHAPE_TEXT };
+
+static void fillRectMarked(int x, int y, int w, int h, uint8_t color) {
+    dirty.mark(x, y, w, h, ui_key(SHAPE_RECT, x, y, w, h, color));
+    dl.rect(x, y, w, h, color);
 }
 
-static void drawThickOmega(int cx, int cy, uint16_t color) {
-    int rad = 12;
-    for (float a = 0; a < (float)M_PI; a += 0.1f) {
-        int lx = cx - rad + (int)(cosf(a) * rad);
-        int rx = cx + rad - (int)(cosf(a) * rad);
-        int y_pos = cy + (int)(sinf(a) * rad);
-        spr.fillRect(lx, y_pos, 2, 2, color);
-        spr.fillRect(rx, y_pos, 2, 2, color);
-    }
+static void fillTriangleMarked(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t color,
+                               DisplayList &out = dl) {
+    int xmin = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+    int xmax = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+    int ymin = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+    int ymax = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+    dirty.mark(xmin, ymin, xmax - xmin + 1, ymax - ymin + 1,
+               ui_key(SHAPE_TRIANGLE, x0, y0, x1, y1, x2, y2, color));
+    out.triangle(x0, y0, x1, y1, x2, y2, color);
 }
 
-static void drawCatFaceBase(int frame, bool isSleeping, uint16_t color = TFT_WHITE) {
+// 半徑為編譯期常數，每列半寬查 EllipseSpans（shape_tables.h）
+template <int RX, int RY>
+static void fillEllipse(int cx, int cy, uint8_t color, DisplayList &out = dl) {
+    static constexpr EllipseSpans<RX, RY> spans{};
+    dirty.mark(cx - RX, cy - RY, RX * 2 + 1, RY * 2 + 1, ui_key(SHAPE_ELLIPSE, cx, cy, RX, RY, color));
+    out.spans(cx, cy, RY, spans.half, color);
+}
+
+static void drawZ(int x, int y, int size, uint8_t color) {
+    dirty.mark(x, y, size + 1, size + 1, ui_key(SHAPE_Z, x, y, size, color));
+    dl.z(x, y, size, color);
+}
+
+static void drawThickOmega(int cx, int cy, uint8_t color, DisplayList &out = dl) {
+    constexpr int rad = 12;
+    static constexpr ArcPoints<rad, rad, false, 10> arc{};   // 0..π，每 0.1 rad
+    dirty.mark(cx - rad * 2, cy, rad * 4 + 2, rad + 2, ui_key(SHAPE_OMEGA, cx, cy, color));
+    out.dots(cx - rad, cy, 1, arc.p, arc.N, 2, color);
+    out.dots(cx + rad, cy, -1, arc.p, arc.N, 2, color);
+}
+
+static void drawCatFaceBase(int frame, bool isSleeping, uint8_t color = UI_WHITE) {
     float l_tip_x, l_tip_y, r_tip_x, r_tip_y;
     if (!isSleeping) {
         bool jitter = (frame % 40 > 30);
@@ -125,101 +286,559 @@ static void drawCatFaceBase(int frame, bool isSleeping, uint16_t color = TFT_WHI
         r_tip_x = (slowCycle > 140 && slowCycle < 170) ? 126.0f : 120.0f;
         r_tip_y = 25.0f;
     }
-    spr.fillTriangle(10, 32, 45, 32, (int)l_tip_x, (int)l_tip_y, color);
-    spr.fillTriangle(83, 32, 118, 32, (int)r_tip_x, (int)r_tip_y, color);
-    drawThickOmega(64, 120, color);
-    fillEllipse(64, 118, 6, 4, PINK);
+    face_dl.clear();
+    fillTriangleMarked(10, 32, 45, 32, (int)l_tip_x, (int)l_tip_y, color, face_dl);
+    fillTriangleMarked(83, 32, 118, 32, (int)r_tip_x, (int)r_tip_y, color, face_dl);
+    drawThickOmega(64, 120, color, face_dl);
+    fillEllipse<6, 4>(64, 118, UI_PINK, face_dl);
+
+#if UI_LAYER_CACHE
+    // 每個 frame 以快取圖層作為背景；另一個行緩衝可能仍在 DMA 傳輸，光柵化借用目前這個
+    int slot = isSleeping ? 1 : (color == UI_RED ? 2 : 0);
+    uint32_t key = ui_key((int)l_tip_x, (int)l_tip_y, (int)r_tip_x, (int)r_tip_y, color);
+    const uint8_t *layer = line_buf[line_buf_idx]
+        ? face_layers.get(slot, key, face_dl, line_buf[line_buf_idx], UI_LINE_BUF_PX) : nullptr;
+    if (layer) {
+        dl.background(layer, UI_WIDTH);
+        return;
+    }
+#endif
+    dl.append(face_dl);
 }
 
-static void idle_anim_step(void) {
-    uint32_t frame = millis() / 50;
+// ── Animations ──────────────────────────────────────────────────────────────
+// 每個 *_anim_step 畫出目前的 frame，並回傳畫面下一次改變的 frame 編號（millis() / UI_FRAME_MS）
+
+// frame 之後臉部（耳朵抖動 / 眨眼）下一次改變的 frame，對應 drawCatFaceBase 與 idle 眨眼的條件
+static uint32_t face_next_frame(uint32_t frame, bool isSleeping, bool blinks) {
+    for (uint32_t f = frame + 1;; f++) {
+        if (!isSleeping && (f % 40 == 31 || f % 40 == 0)) return f;
+        if (isSleeping && (f % 240 == 21 || f % 240 == 50 || f % 240 == 141 || f % 240 == 170)) return f;
+        if (blinks && (f % 100 == 95 || f % 100 == 0)) return f;
+    }
+}
+
+static uint32_t idle_anim_step(void) {
+    uint32_t frame = millis() / UI_FRAME_MS;
     drawCatFaceBase(frame, false);
     if (frame % 100 < 95) {
-        fillEllipse(40, 80, 12, 18, TFT_WHITE);
-        fillEllipse(88, 80, 12, 18, TFT_WHITE);
+        fillEllipse<12, 18>(40, 80, UI_WHITE);
+        fillEllipse<12, 18>(88, 80, UI_WHITE);
     } else {
-        spr.fillRect(28, 78, 24, 4, TFT_WHITE);
-        spr.fillRect(76, 78, 24, 4, TFT_WHITE);
+        fillRectMarked(28, 78, 24, 4, UI_WHITE);
+        fillRectMarked(76, 78, 24, 4, UI_WHITE);
     }
+    return face_next_frame(frame, false, true);
 }
 
-static void thinking_anim_step(void) {
-    uint32_t frame = millis() / 50;
-    drawCatFaceBase(frame, false);
-    for (float a = (float)M_PI; a < 2.0f * (float)M_PI; a += 0.2f) {
-        int lx = 40 + (int)(cosf(a) * 15);
-        int ly = 85 + (int)(sinf(a) * 10);
-        int rx = 88 + (int)(cosf(a) * 15);
-        int ry = 85 + (int)(sinf(a) * 10);
-        spr.fillRect(lx, ly, 3, 3, TFT_WHITE);
-        spr.fillRect(rx, ry, 3, 3, TFT_WHITE);
+// 以 3x3 點畫出半個橢圓弧（UPPER = 上半弧，每 0.2 rad 一點）的前 count 點，作為一個元素登記
+template <int RX, int RY, bool UPPER>
+static void drawArcDots(int cx, int cy, uint8_t color, int count = ArcPoints<RX, RY, UPPER, 20>::N) {
+    static constexpr ArcPoints<RX, RY, UPPER, 20> arc{};
+    if (count > arc.N) count = arc.N;
+    int top = UPPER ? cy - RY : cy;
+    dirty.mark(cx - RX, top, RX * 2 + 3, RY + 3, ui_key(SHAPE_ARC_DOTS, cx, cy, RX, RY, UPPER, color, count));
+    dl.dots(cx, cy, 1, arc.p, count, 3, color);
+}
+
+// 麥克風音量等級 0~3：最近切片頻帶能量峰值相對 VAD 閾值
+static int mic_level(void) {
+    if (telemetry.vad_threshold <= 0.0f) return 0;
+    float ratio = telemetry.vad_energy / telemetry.vad_threshold;
+    if (ratio < 0.5f) return 0;
+    if (ratio < 1.0f) return 1;
+    if (ratio < 2.0f) return 2;
+    return 3;
+}
+
+// 圓形眼睛，半徑 8 + level
+static void fillEye(int cx, int cy, int level, uint8_t color) {
+    switch (level) {
+        case 0:  fillEllipse<8, 8>(cx, cy, color); break;
+        case 1:  fillEllipse<9, 9>(cx, cy, color); break;
+        case 2:  fillEllipse<10, 10>(cx, cy, color); break;
+        default: fillEllipse<11, 11>(cx, cy, color); break;
     }
 }
 
-static void listening_anim_step(void) {
-    uint32_t frame = millis() / 50;
+// 瞇眼弧線：progress 0~1 決定畫出的點數
+static void drawThinkingEyes(float progress) {
+    constexpr int n = ArcPoints<15, 10, true, 20>::N;
+    int dots = 1 + (int)(progress * (n - 1) + 0.5f);
+    drawArcDots<15, 10, true>(40, 85, UI_WHITE, dots);
+    drawArcDots<15, 10, true>(88, 85, UI_WHITE, dots);
+}
+
+// THINKING：弧線隨指令串流進度畫滿（送完後等待 Server 回應時為完整弧線）
+static uint32_t thinking_anim_step(void) {
+    uint32_t frame = millis() / UI_FRAME_MS;
     drawCatFaceBase(frame, false);
-    int ox = (rand() % 5) - 2;
-    int oy = (rand() % 5) - 2;
-    fillEllipse(40 + ox, 80 + oy, 8, 8, TFT_WHITE);
-    fillEllipse(88 - ox, 80 - oy, 8, 8, TFT_WHITE);
+    drawThinkingEyes(telemetry.stream_progress);
+    return frame + 1;   // 進度隨時變化
+}
+
+// LISTENING：眼睛隨麥克風音量放大並抖動，安靜時靜止
+static uint32_t listening_anim_step(void) {
+    uint32_t frame = millis() / UI_FRAME_MS;
+    drawCatFaceBase(frame, false);
+    int level = mic_level();
+    int amp = level < 2 ? level : 2;
+    int ox = amp ? (rand() % (amp * 2 + 1)) - amp : 0;
+    int oy = amp ? (rand() % (amp * 2 + 1)) - amp : 0;
+    fillEye(40 + ox, 80 + oy, level, UI_WHITE);
+    fillEye(88 - ox, 80 - oy, level, UI_WHITE);
+    return frame + 1;   // 音量隨時變化
 }
 
-static void sleep_anim_step(void) {
-    uint32_t frame = millis() / 50;
+static uint32_t sleep_anim_step(void) {
+    uint32_t frame = millis() / UI_FRAME_MS;
     drawCatFaceBase(frame, true);
-    for (float a = 0; a < (float)M_PI; a += 0.2f) {
-        int lx = 40 + (int)(cosf(a) * 15);
-        int ly = 80 + (int)(sinf(a) * 5);
-        int rx = 88 + (int)(cosf(a) * 15);
-        int ry = 80 + (int)(sinf(a) * 5);
-        spr.fillRect(lx, ly, 3, 3, TFT_WHITE);
-        spr.fillRect(rx, ry, 3, 3, TFT_WHITE);
-    }
+    drawArcDots<15, 5, false>(40, 80, UI_WHITE);
+    drawArcDots<15, 5, false>(88, 80, UI_WHITE);
     int cycle = frame % 120;
-    drawZ(100, 50 - (cycle / 3), 8, TFT_WHITE);
-    if (cycle > 40) drawZ(110, 40 - ((cycle - 40) / 3), 5, TFT_WHITE);
-    if (cycle > 80) drawZ(115, 30 - ((cycle - 80) / 3), 3, TFT_WHITE);
+    drawZ(100, 50 - (cycle / 3), 8, UI_WHITE);
+    if (cycle > 40) drawZ(110, 40 - ((cycle - 40) / 3), 5, UI_WHITE);
+    if (cycle > 80) drawZ(115, 30 - ((cycle - 80) / 3), 3, UI_WHITE);
+    return frame + 1;   // Z 持續飄動
 }
 
-static void action_anim_step(void) {
-    thinking_anim_step();
+static uint32_t action_anim_step(void) {
+    uint32_t frame = millis() / UI_FRAME_MS;
+    drawCatFaceBase(frame, false);
+    drawThinkingEyes(1.0f);
+    return face_next_frame(frame, false, false);
 }
 
-static void error_anim_step(void) {
-    uint32_t frame = millis() / 50;
-    drawCatFaceBase(frame, false, RGB(255, 40, 40));
+static uint32_t error_anim_step(void) {
+    uint32_t frame = millis() / UI_FRAME_MS;
+    drawCatFaceBase(frame, false, UI_RED);
     int ox = (rand() % 5) - 2;
     int oy = (rand() % 5) - 2;
-    fillEllipse(40 + ox, 80 + oy, 8, 8, RGB(255, 40, 40));
-    fillEllipse(88 - ox, 80 - oy, 8, 8, RGB(255, 40, 40));
+    fillEllipse<8, 8>(40 + ox, 80 + oy, UI_RED);
+    fillEllipse<8, 8>(88 - ox, 80 - oy, UI_RED);
+    return frame + 1;
+}
+
+// 預先繪製的動畫（eye_assets.h）：frame_ms 換算成 UI frame 數，從進入狀態起播放
+static uint32_t asset_anim_step(const EyeAssetAnim *anim) {
+    uint32_t frame = millis() / UI_FRAME_MS;
+    uint32_t start = anim_start_ms / UI_FRAME_MS;
+    uint32_t ticks = anim->frame_ms / UI_FRAME_MS;
+    if (ticks == 0) ticks = 1;
+    uint32_t k = (frame - start) / ticks;
+    uint32_t i = k % anim->frame_count;
+    if (!(anim->flags & EYE_ASSET_LOOP) && k >= anim->frame_count) i = anim->frame_count - 1;
+
+    const EyeAssetFrame *f = eye_assets_frame(anim, i);
+    dirty.mark(f->x, f->y, f->w, f->h, ui_key(SHAPE_ASSET, anim->state, i));
+    dl.rle(f->x, f->y, f->w, f->h, eye_assets_data(f));
+    return start + (k + 1) * ticks;   // 停在最後一個 frame 時重畫結果相同，不會送出
+}
+
+// ── Status line ──────────────────────────────────────────────────────────────
+// 畫面底部一列 5x7 文字（glyph_atlas.h）：左側時鐘（系統時間，TimeManager 同步後才顯示）、
+// 右側 Wi-Fi RSSI；收到指令後 UI_STATUS_COMMAND_MS 內改為顯示指令。睡眠時不顯示。
+#define UI_STATUS_Y (UI_HEIGHT - GlyphAtlas::H - 2)
+#define UI_STATUS_COMMAND_MS 4000
+#define UI_STATUS_POLL_MS 5000            // RSSI 等非時鐘內容的檢查間隔
+#define UI_STATUS_MIN_EPOCH 1704067200    // 2024-01-01：早於此代表系統時間尚未同步
+
+static GlyphAtlas glyphs;
+static TextRun status_left, status_right;
+
+static void drawTextRun(const TextRun &run, int x, int y, uint8_t color) {
+    if (run.width() == 0) return;
+    dirty.mark(x, y, run.width(), GlyphAtlas::H, ui_key(SHAPE_TEXT, x, y, run.key(), color));
+    dl.text(x, y, run.width(), GlyphAtlas::H, run.bits(), color);
+}
+
+// 畫出狀態列，回傳內容下一次可能改變的 frame（文字未變時 TextRun 不重新拼字）
+static uint32_t drawStatusLine(void) {
+    uint32_t now = millis();
+    ui_status_t st;
+    ui_status_read(&st);
+    char left[UI_STATUS_TEXT_LEN] = "", right[8] = "";
+    uint32_t next_ms = now + UI_STATUS_POLL_MS;
+    if (st.command_ms && now - st.command_ms < UI_STATUS_COMMAND_MS) {
+        strlcpy(left, st.command, sizeof(left));
+        next_ms = st.command_ms + UI_STATUS_COMMAND_MS;
+    } else {
+        time_t t = time(nullptr);
+        if (t >= UI_STATUS_MIN_EPOCH) {
+            struct tm lt;
+            localtime_r(&t, &lt);
+            snprintf(left, sizeof(left), "%02d:%02d", lt.tm_hour, lt.tm_min);
+            uint32_t to_minute = (uint32_t)(60 - lt.tm_sec) * 1000;
+            if (to_minute < UI_STATUS_POLL_MS) next_ms = now + to_minute;
+        }
+        if (st.hint[0]) strlcpy(right, st.hint, sizeof(right));
+        else if (st.rssi) snprintf(right, sizeof(right), "%ddBm", st.rssi);
+    }
+    status_left.set(glyphs, left);
+    status_right.set(glyphs, right);
+    drawTextRun(status_left, 2, UI_STATUS_Y, UI_GREY);
+    drawTextRun(status_right, UI_WIDTH - 2 - status_right.width(), UI_STATUS_Y,
+                st.hint[0] ? UI_PINK : UI_GREY);
+    return (next_ms + UI_FRAME_MS - 1) / UI_FRAME_MS;
+}
+
+#if UI_PERF_HUD
+// ── Performance HUD ──────────────────────────────────────────────────────────
+// 狀態列上方一列：最近一秒實際畫出的 frame 數、core 0 負載（health Task，每 HEALTH_INTERVAL_S 更新）、
+// 最近一次推論（MFCC + NN）耗時。每秒更新一次，因此開啟時畫面至少每秒重畫一次。
+#define UI_HUD_Y (UI_STATUS_Y - GlyphAtlas::H - 3)
+
+static TextRun hud_run;
+static uint32_t hud_window_ms = 0, hud_frames = 0, hud_fps = 0;
+
+static uint32_t drawPerfHud(void) {
+    uint32_t now = millis();
+    hud_frames++;
+    if (now - hud_window_ms >= 1000) {
+        hud_fps = hud_frames * 1000 / (now - hud_window_ms);
+        hud_frames = 0;
+        hud_window_ms = now;
+    }
+    ui_perf_t perf;
+    ui_perf_read(&perf);
+    char cpu[6] = "--";
+    if (perf.cpu[0] >= 0) snprintf(cpu, sizeof(cpu), "%d%%", perf.cpu[0]);
+    char text[UI_STATUS_TEXT_LEN];
+    snprintf(text, sizeof(text), "%ufps c0 %s inf %ums", (unsigned)hud_fps, cpu,
+             (unsigned)((perf.infer_us + 500) / 1000));
+    hud_run.set(glyphs, text);
+    drawTextRun(hud_run, 2, UI_HUD_Y, UI_PINK);
+    return (hud_window_ms + 1000 + UI_FRAME_MS - 1) / UI_FRAME_MS;
+}
+#endif
+
+// ── SPI clock probe ──────────────────────────────────────────────────────────
+// ST7735 可承受的寫入時脈依模組與排線而異。首次開機由低到高以各時脈寫入測試圖樣、
+// 讀回（RAMRD）比對，取全部通過的最高時脈存入 NVS，之後開機直接套用。
+// 讀回需要 MISO 或 SDA 雙向讀取的接線；沒有讀回就無法驗證，維持 Kconfig 的 SPI_FREQUENCY。
+#define UI_SPI_NVS_NS  "eye_ui"
+#define UI_SPI_NVS_KEY "spi_hz"
+#if defined(TFT_SDA_READ) || (defined(TFT_MISO) && TFT_MISO >= 0)
+#define UI_SPI_CAN_READ 1
+#else
+#define UI_SPI_CAN_READ 0
+#endif
+
+#if UI_SPI_CAN_READ
+#define UI_SPI_PROBE_W 32
+#define UI_SPI_PROBE_H 4
+#define UI_SPI_PROBE_ROUNDS 3
+// ESP32 SPI 時脈為 80 MHz 的整數分頻，27 MHz 以上可用的只有 40 / 80 MHz
+static const uint32_t ui_spi_candidates[] = { 40000000, 80000000 };
+
+// 以目前寫入時脈送出一塊測試圖樣（交錯的 0x5555 / 0xAAAA 與亂數），讀回後比對
+static bool spi_pattern_ok(uint32_t seed) {
+    static uint16_t out[UI_SPI_PROBE_W * UI_SPI_PROBE_H], in[UI_SPI_PROBE_W * UI_SPI_PROBE_H];
+    for (int i = 0; i < UI_SPI_PROBE_W * UI_SPI_PROBE_H; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        out[i] = (i & 3) == 0 ? 0x5555 : (i & 3) == 1 ? 0xAAAA : (uint16_t)seed;
+    }
+    // swapBytes 關閉：readRect 回傳的位元組順序與 pushImage 送出的相同
+    tft.pushImage(0, 0, UI_SPI_PROBE_W, UI_SPI_PROBE_H, out);
+    tft.readRect(0, 0, UI_SPI_PROBE_W, UI_SPI_PROBE_H, in);
+    return memcmp(out, in, sizeof(out)) == 0;
+}
+#endif
+
+// 需在 initDMA 之前呼叫（DMA 裝置的時脈在掛上匯流排時決定）；會覆寫畫面左上角
+static void spi_probe(void) {
+    nvs_handle_t handle;
+    uint32_t saved = 0;
+    if (nvs_open(UI_SPI_NVS_NS, NVS_READONLY, &handle) == ESP_OK) {
+        nvs_get_u32(handle, UI_SPI_NVS_KEY, &saved);
+        nvs_close(handle);
+    }
+    if (saved) {
+        tft.setSPIFrequency(saved);
+        ESP_LOGI(TAG_UI, "SPI %u Hz (NVS)", (unsigned)saved);
+        return;
+    }
+
+#if UI_SPI_CAN_READ
+    // 基準時脈就比對失敗代表讀回本身不可靠，不做判斷
+    if (!spi_pattern_ok(1)) {
+        ESP_LOGW(TAG_UI, "SPI readback failed at %u Hz, probe skipped", (unsigned)tft.getSPIFrequency());
+        return;
+    }
+    uint32_t best = tft.getSPIFrequency();
+    for (uint32_t hz : ui_spi_candidates) {
+        if (hz <= best) continue;
+        tft.setSPIFrequency(hz);
+        bool ok = true;
+        for (int r = 0; r < UI_SPI_PROBE_ROUNDS && ok; r++) ok = spi_pattern_ok(hz + r);
+        if (!ok) break;
+        best = hz;
+    }
+    tft.setSPIFrequency(best);
+
+    if (nvs_open(UI_SPI_NVS_NS, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_set_u32(handle, UI_SPI_NVS_KEY, best);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+    ESP_LOGI(TAG_UI, "SPI %u Hz (probed, saved to NVS)", (unsigned)best);
+#else
+    ESP_LOGI(TAG_UI, "SPI %u Hz (no readback wiring, probe skipped)", (unsigned)tft.getSPIFrequency());
+#endif
+}
+
+// ── Render buffers ───────────────────────────────────────────────────────────
+// 行緩衝（8 KB 可 DMA 的內部 RAM）與已用的圖層變體（各 10 KB）只在面板醒著時需要。
+// 關螢幕後（UI_RELEASE_ON_SLEEP）歸還 heap，音訊端按需配置的緩衝（誤判錄音、TLS 等）即可使用；
+// 下一個狀態事件或 VAD 預熱喚醒面板（SLPOUT 快速恢復）時重新配置，圖層於第一個 frame 重建。
+static bool render_buffers_alloc(void) {
+    if (line_buf[0] && line_buf[1]) return true;
+#if CONFIG_ESP_MIAO_STATIC_ALLOC
+    DMA_ATTR static uint16_t line_storage[2][UI_LINE_BUF_PX];   // 內部 RAM、4-byte 對齊，可直接 DMA
+    line_buf[0] = line_storage[0];
+    line_buf[1] = line_storage[1];
+#else
+    for (int i = 0; i < 2; i++) {
+        line_buf[i] = (uint16_t *)heap_caps_malloc(UI_LINE_BUF_PX * sizeof(uint16_t), MALLOC_CAP_DMA);
+    }
+#endif
+    if (!line_buf[0] || !line_buf[1]) {
+        ESP_LOGE(TAG_UI, "Line buffer alloc failed, display disabled until next wake");
+        heap_caps_free(line_buf[0]);
+        heap_caps_free(line_buf[1]);
+        line_buf[0] = line_buf[1] = nullptr;
+        return false;
+    }
+    line_buf_idx = 0;
+    return true;
+}
+
+// 呼叫前面板已 SLPIN（display_power_off 已等 DMA 送完）
+static void render_buffers_release(void) {
+#if UI_RELEASE_ON_SLEEP
+    size_t freed = face_layers.release();
+#if !CONFIG_ESP_MIAO_STATIC_ALLOC
+    if (line_buf[0]) {
+        heap_caps_free(line_buf[0]);
+        heap_caps_free(line_buf[1]);
+        line_buf[0] = line_buf[1] = nullptr;
+        freed += 2 * UI_LINE_BUF_PX * sizeof(uint16_t);
+    }
+#endif
+    if (freed) {
+        ESP_LOGI(TAG_UI, "Render buffers released (%u B), free heap %u", (unsigned)freed,
+                 (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    }
+#endif
+}
+
+// 喚醒面板並備妥渲染緩衝
+static void display_resume(void) {
+    display_wake_panel();
+    render_buffers_alloc();
 }
 
 // ── Arduino setup / loop ─────────────────────────────────────────────────────
 static void setup_ui(void) {
-    tft.init();
-    tft.setRotation(0);
+    display_cold_start();
+    spi_probe();
     tft.fillScreen(ST7735_BLACK);
+    slpout_ms = millis();
+    display_set_power(DISP_WARM);   // 第一個狀態事件畫好 frame 後點亮
     
-    spr.setColorDepth(16);
-    if (spr.createSprite(128, 160) == NULL) {
-        ESP_LOGE(TAG_UI, "Failed to create sprite!");
+    build_colors();
+    glyphs.build();
+    eye_assets_init();
+
+    if (!render_buffers_alloc()) return;
+#if UI_USE_DMA
+    use_dma = tft.initDMA();
+#if UI_SHARED_BUS
+    if (use_dma) bus_shared = tft.shareBus(CONFIG_ESP_MIAO_DISPLAY_BUS_CHUNK);
+#endif
+    if (use_dma && !bus_shared) tft.startWrite();   // DMA 期間 CS 保持低電位
+#endif
+    ESP_LOGI(TAG_UI, "Strip renderer, push via %s%s", use_dma ? "DMA" : "blocking SPI",
+             bus_shared ? " (shared bus)" : "");
+}
+
+// 送出一個 frame 的變化區域：每個矩形切成數條帶，光柵化一條的同時 DMA 送出前一條，
+// 最後一條在記錄下一個 frame 時仍在傳輸
+static void push_frame(void) {
+    UiRect rects[DirtyRegion::MAX_RECTS];
+    int n = dirty.end_frame(rects);
+    if (n == 0 || !line_buf[1]) return;
+    TRACE_POINT(TP_UI_FRAME, n);
+
+    PowerHoldScope full_speed(PWR_HOLD_DISPLAY);   // 光柵化與 DMA 排程期間 CPU 全速
+    contention_token_t bus = contention_wait(CONTENTION_SPI);
+    if (bus_shared) {
+        tft.startWrite();   // 共用匯流排：只在這個 frame 期間選取面板
+        contention_acquired(CONTENTION_SPI, &bus);
+    }
+    for (int i = 0; i < n; i++) {
+        int x0 = rects[i].x;
+        int w = rects[i].w;
+        int y_end = rects[i].y + rects[i].h;
+        int lines = UI_LINE_BUF_PX / w;
+        for (int y = rects[i].y; y < y_end; y += lines) {
+            int h = (y_end - y) < lines ? (y_end - y) : lines;
+            // 另一個緩衝可能仍在傳輸；pushImageDMA 返回時只剩該次像素在傳輸，這個緩衝已送完
+            uint16_t *buf = line_buf[line_buf_idx];
+            line_buf_idx ^= 1;
+            dl.render(buf, x0, y, w, h, ui_colors);
+            if (use_dma) {
+                tft.pushImageDMA(x0, y, w, h, (const uint16_t *)buf);
+            } else {
+                tft.pushImage(x0, y, w, h, buf);   // 緩衝已是面板位元組順序（swapBytes 預設關閉）
+            }
+        }
+    }
+    if (bus_shared) {
+        tft.endWrite();     // 等最後一段送完再釋放，下一個 frame 前其他裝置可獨佔
+        contention_exit(CONTENTION_SPI, &bus);
     }
 }
 
-static void loop_ui(ui_state_t state) {
-    spr.fillSprite(ST7735_BLACK);
-    switch (state) {
-        case UI_IDLE:      idle_anim_step(); break;
-        case UI_WAKE:      idle_anim_step(); break;
-        case UI_LISTENING: listening_anim_step(); break;
-        case UI_THINKING:  thinking_anim_step(); break;
-        case UI_ACTION:    action_anim_step(); break;
-        case UI_ERROR:     error_anim_step(); break;
-        case UI_SLEEPING:  sleep_anim_step(); break;
-        default:           break;
+// 匯流排同時只有一個外部持有者，token 放在這裡即可（contention.h）
+static contention_token_t bus_token;
+
+bool eye_ui_bus_acquire(uint32_t timeout_ms) {
+    contention_token_t tok = contention_wait(CONTENTION_SPI);
+    if (!TFT_eSPI::busAcquire(timeout_ms)) return false;
+    contention_acquired(CONTENTION_SPI, &tok);
+    bus_token = tok;
+    return true;
+}
+
+void eye_ui_bus_release(void) {
+    contention_exit(CONTENTION_SPI, &bus_token);
+    TFT_eSPI::busRelease();
+}
+
+int eye_ui_bus_host(void) {
+    return TFT_eSPI::busHost();
+}
+
+// ── Frame profiler ───────────────────────────────────────────────────────────
+// 顯示 Task 寫入、telemetry Task 以 eye_ui_take_frame_stats 取出歸零（eye_ui.h）
+static portMUX_TYPE frame_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct {
+    uint32_t frames, late, late_max_ms, render_max_us, push_max_us;
+    uint64_t render_sum_us, push_sum_us;
+} frame_stats;
+
+static void frame_stats_add(uint32_t render_us, uint32_t push_us) {
+    portENTER_CRITICAL(&frame_stats_lock);
+    frame_stats.frames++;
+    frame_stats.render_sum_us += render_us;
+    frame_stats.push_sum_us += push_us;
+    if (render_us > frame_stats.render_max_us) frame_stats.render_max_us = render_us;
+    if (push_us > frame_stats.push_max_us) frame_stats.push_max_us = push_us;
+    portEXIT_CRITICAL(&frame_stats_lock);
+}
+
+// 開始畫的時間晚於畫面期限 late_ms：超過一個 frame 即視為錯過期限
+static void frame_stats_late(uint32_t late_ms) {
+    if (late_ms < UI_FRAME_MS) return;
+    portENTER_CRITICAL(&frame_stats_lock);
+    frame_stats.late++;
+    if (late_ms > frame_stats.late_max_ms) frame_stats.late_max_ms = late_ms;
+    portEXIT_CRITICAL(&frame_stats_lock);
+}
+
+void eye_ui_take_frame_stats(eye_ui_frame_stats_t *out) {
+    portENTER_CRITICAL(&frame_stats_lock);
+    uint32_t n = frame_stats.frames;
+    out->frames        = n;
+    out->late          = frame_stats.late;
+    out->late_max_ms   = frame_stats.late_max_ms;
+    out->render_avg_us = n ? (uint32_t)(frame_stats.render_sum_us / n) : 0;
+    out->render_max_us = frame_stats.render_max_us;
+    out->push_avg_us   = n ? (uint32_t)(frame_stats.push_sum_us / n) : 0;
+    out->push_max_us   = frame_stats.push_max_us;
+    memset(&frame_stats, 0, sizeof(frame_stats));
+    portEXIT_CRITICAL(&frame_stats_lock);
+}
+
+#if UI_LOG_FPS
+// cycle 數為顯示 Task 所在核心的 CCOUNT 差值（含等待 DMA 的時間；DFS 降頻時與 us 不成比例）
+static void ui_log_frame_time(int64_t render_us, int64_t push_us, uint32_t build_cyc, uint32_t push_cyc) {
+    static int64_t render_sum = 0, push_sum = 0;
+    static uint64_t build_cyc_sum = 0, push_cyc_sum = 0;
+    static uint32_t cyc_max = 0, rebuilds_last = 0;
+    static int frames = 0;
+    render_sum += render_us;
+    push_sum += push_us;
+    build_cyc_sum += build_cyc;
+    push_cyc_sum += push_cyc;
+    if (build_cyc + push_cyc > cyc_max) cyc_max = build_cyc + push_cyc;
+    if (++frames >= UI_LOG_FPS_FRAMES) {
+        ESP_LOGI(TAG_UI, "frame avg: build=%dus/%ucyc raster+push=%dus/%ucyc max=%ucyc layer_rebuilds=%u",
+                 (int)(render_sum / frames), (unsigned)(build_cyc_sum / frames), (int)(push_sum / frames),
+                 (unsigned)(push_cyc_sum / frames), (unsigned)cyc_max,
+                 (unsigned)(face_layers.rebuilds() - rebuilds_last));
+        render_sum = push_sum = 0;
+        build_cyc_sum = push_cyc_sum = 0;
+        cyc_max = 0;
+        rebuilds_last = face_layers.rebuilds();
+        frames = 0;
     }
-    spr.pushSprite(0, 0);
+}
+#endif
+
+// 畫一個 frame，回傳畫面下一次改變的時間（ms）
+static uint32_t loop_ui(ui_state_t state) {
+    int64_t t0 = esp_timer_get_time();
+#if UI_LOG_FPS
+    uint32_t c0 = esp_cpu_get_cycle_count();
+#endif
+    uint32_t next_frame;
+    ui_telemetry_read(&telemetry);
+    dirty.begin_frame();
+    dl.clear();
+    const EyeAssetAnim *asset = eye_assets_find(state);
+    if (asset) {
+        next_frame = asset_anim_step(asset);
+    } else {
+        switch (state) {
+            case UI_IDLE:      next_frame = idle_anim_step(); break;
+            case UI_WAKE:      next_frame = idle_anim_step(); break;
+            case UI_LISTENING: next_frame = listening_anim_step(); break;
+            case UI_THINKING:  next_frame = thinking_anim_step(); break;
+            case UI_ACTION:    next_frame = action_anim_step(); break;
+            case UI_ERROR:     next_frame = error_anim_step(); break;
+            case UI_SLEEPING:  next_frame = sleep_anim_step(); break;
+            default:           next_frame = millis() / UI_FRAME_MS + 1; break;
+        }
+    }
+    if (state != UI_SLEEPING) {
+        uint32_t status_next = drawStatusLine();
+        if ((int32_t)(status_next - next_frame) < 0) next_frame = status_next;
+    }
+#if UI_PERF_HUD
+    uint32_t hud_next = drawPerfHud();
+    if ((int32_t)(hud_next - next_frame) < 0) next_frame = hud_next;
+#endif
+    int64_t t1 = esp_timer_get_time();
+#if UI_LOG_FPS
+    uint32_t c1 = esp_cpu_get_cycle_count();
+#endif
+    push_frame();
+    int64_t t2 = esp_timer_get_time();
+    frame_stats_add((uint32_t)(t1 - t0), (uint32_t)(t2 - t1));
+#if UI_LOG_FPS
+    ui_log_frame_time(t1 - t0, t2 - t1, c1 - c0, esp_cpu_get_cycle_count() - c1);
+#endif
+    return next_frame * UI_FRAME_MS;
+}
+
+// 距離 deadline 的 ms（已過期為 0；uint32 回繞安全）
+static uint32_t ms_until(uint32_t deadline, uint32_t now) {
+    int32_t d = (int32_t)(deadline - now);
+    return d > 0 ? (uint32_t)d : 0;
 }
 
 // ── Display task ─────────────────────────────────────────────────────────────
@@ -233,29 +852,83 @@ static void display_task(void *arg) {
     uint32_t state_enter_ms = (uint32_t)millis();
     uint32_t last_activity_ms = state_enter_ms;
 
-    const TickType_t frame_ticks = pdMS_TO_TICKS(1000 / UI_IDLE_FPS);
-    TickType_t last_wake = xTaskGetTickCount();
     ui_event_t ev;
+    bool want_on = false;         // 收到狀態事件：畫好 frame 後點亮
+    bool prewarm_frame = false;   // VAD 預熱：先畫一個 frame，醒來時只需局部更新
     
     const uint32_t IDLE_TIMEOUT_MS = 30000;
+    const uint32_t SLEEP_OFF_MS = 5000;
 
     while (true) {
-        if (ui_pop_state(&ev, 0)) {
+        // UI_SLEEPING 以外的狀態不進 light sleep（動畫計時與面板時序）
+        power_hold(PWR_HOLD_UI, current_state != UI_SLEEPING);
+
+        // 睡到最早的期限（畫面變化 / 狀態逾時 / 關螢幕 / IDLE 超時 / 電源降級），新事件或預熱請求
+        // 到達時立即醒來；靜止畫面不佔 CPU 與 SPI
+        uint32_t now = (uint32_t)millis();
+        uint32_t wait_ms = UINT32_MAX;
+        bool drawing = disp_power == DISP_ON || (disp_power == DISP_WARM && (want_on || prewarm_frame));
+        if (drawing) {
+            wait_ms = ms_until(next_draw_ms, now);
+        }
+        if (disp_power == DISP_WARM && !want_on) {
+            uint32_t w = ms_until(disp_power_ms + UI_PREWARM_HOLD_MS, now);
+            if (w < wait_ms) wait_ms = w;
+        }
+        if (disp_power == DISP_SLEEP) {
+            uint32_t w = ms_until(disp_power_ms + UI_DISPLAY_RAIL_OFF_MS, now);
+            if (w < wait_ms) wait_ms = w;
+        }
+        uint32_t timeout_ms = ui_state_timeout_ms(current_state);
+        if (current_state != UI_IDLE && timeout_ms > 0) {
+            uint32_t w = ms_until(state_enter_ms + timeout_ms, now);
+            if (w < wait_ms) wait_ms = w;
+        }
+        if (current_state == UI_SLEEPING && disp_power == DISP_ON) {
+            uint32_t w = ms_until(state_enter_ms + SLEEP_OFF_MS, now);
+            if (w < wait_ms) wait_ms = w;
+        }
+        if (current_state == UI_IDLE && disp_power == DISP_ON) {
+            uint32_t w = ms_until(last_activity_ms + IDLE_TIMEOUT_MS, now);
+            if (w < wait_ms) wait_ms = w;
+        }
+        uint32_t dwell_ms = ms_until(state_enter_ms + ui_state_min_dwell_ms(current_state), now);
+        if (dwell_ms > 0 && dwell_ms < wait_ms) wait_ms = dwell_ms;
+        // 無條件進位到 tick，避免提早醒來後以 0 tick 空轉
+        TickType_t wait_ticks = wait_ms == UINT32_MAX ? portMAX_DELAY
+                              : (TickType_t)((wait_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+
+        bool got_event;
+        if (dwell_ms > 0) {
+            vTaskDelay(wait_ticks);   // 最短顯示時間內不取事件
+            got_event = false;
+        } else {
+            got_event = ui_pop_state(&ev, wait_ticks);
+        }
+        if (got_event) {
             current_state = ev.state;
             ui_apply_state(current_state);
             state_enter_ms = (uint32_t)millis();
             last_activity_ms = state_enter_ms;
             
-            // 重要：任何新狀態事件都要點亮螢幕
-            if (!display_is_on) {
-                display_power_on();
-            }
+            // 重要：任何新狀態事件都要點亮螢幕（先喚醒面板，畫完這個 frame 才 DISPON）
+            want_on = true;
+            display_resume();
+        } else if (ui_take_display_prewarm() && disp_power < DISP_WARM) {
+            ESP_LOGI(TAG_UI, "VAD pre-warm");
+            display_resume();
+            prewarm_frame = true;
+            next_draw_ms = (uint32_t)millis();
         }
 
-        // 執行動畫 (只有螢幕亮著才繪製)
-        if (display_is_on) {
-            loop_ui(current_state);
+        // 執行動畫 (只有面板醒著、且畫面到了該變化的時間才繪製)
+        drawing = disp_power == DISP_ON || (disp_power == DISP_WARM && (want_on || prewarm_frame));
+        if (drawing && ms_until(next_draw_ms, (uint32_t)millis()) == 0) {
+            frame_stats_late((uint32_t)millis() - next_draw_ms);
+            next_draw_ms = loop_ui(current_state);
+            prewarm_frame = false;
         }
+        if (want_on) display_power_on();
 
         // 狀態自動回歸邏輯
         if (current_state != UI_IDLE) {
@@ -268,14 +941,26 @@ static void display_task(void *arg) {
         }
 
         // SLEEPING 專屬邏輯：延遲關閉螢幕
-        if (current_state == UI_SLEEPING && display_is_on) {
-            if ((uint32_t)millis() - state_enter_ms >= 5000) {
+        if (current_state == UI_SLEEPING && disp_power == DISP_ON) {
+            if ((uint32_t)millis() - state_enter_ms >= SLEEP_OFF_MS) {
                 display_power_off();
+                render_buffers_release();
+                want_on = false;
             }
         }
 
+        // 預熱後沒有等到狀態事件：回到休眠；休眠夠久才切電源
+        if (disp_power == DISP_WARM && !want_on &&
+            (uint32_t)millis() - disp_power_ms >= UI_PREWARM_HOLD_MS) {
+            display_power_off();
+            render_buffers_release();
+        }
+        if (disp_power == DISP_SLEEP && (uint32_t)millis() - disp_power_ms >= UI_DISPLAY_RAIL_OFF_MS) {
+            display_rail_off();
+        }
+
         // IDLE 省電邏輯：超時後切換到 SLEEPING 狀態以顯示動畫，而不是直接關閉
-        if (current_state == UI_IDLE && display_is_on) {
+        if (current_state == UI_IDLE && disp_power == DISP_ON) {
             if ((uint32_t)millis() - last_activity_ms >= IDLE_TIMEOUT_MS) {
                 ESP_LOGI(TAG_UI, "IDLE timeout, transitioning to SLEEPING animation");
                 current_state = UI_SLEEPING;
@@ -283,16 +968,21 @@ static void display_task(void *arg) {
                 state_enter_ms = (uint32_t)millis(); // 重置時間以開始 5 秒動畫計時
             }
         }
-
-        vTaskDelayUntil(&last_wake, frame_ticks);
     }
 }
 
-void eye_ui_start(void) {
+void eye_ui_start(int priority, int core) {
     static bool started = false;
     if (started) return;
     started = true;
     ui_state_init();
     ui_publish_state(UI_IDLE);
-    xTaskCreatePinnedToCore(display_task, "display", 8192, NULL, 2, NULL, 1);
+#if CONFIG_ESP_MIAO_STATIC_ALLOC
+    static StackType_t display_stack[UI_TASK_STACK];
+    static StaticTask_t display_tcb;
+    xTaskCreateStaticPinnedToCore(display_task, "display", UI_TASK_STACK, NULL, priority,
+                                  display_stack, &display_tcb, core);
+#else
+    xTaskCreatePinnedToCore(display_task, "display", UI_TASK_STACK, NULL, priority, NULL, core);
+#endif
 }
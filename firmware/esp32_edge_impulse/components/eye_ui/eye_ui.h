@@ -1,14 +1,38 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Display power control pin
-#define DISPLAY_EN_PIN   GPIO_NUM_4   // GPIO to control display power
-
 // Call initArduino() in app_main() before calling this.
-void eye_ui_start(void);
+// display Task 以 priority 建立並釘在 core（應與網路同核，不佔用音訊 / 推論核心）
+void eye_ui_start(int priority, int core);
+
+// ── Frame profiler ───────────────────────────────────────────────────────────
+// 畫面只在內容改變時重畫，frames 為實際畫出的 frame 數（非固定 frame rate）
+typedef struct {
+    uint32_t frames;
+    uint32_t late;            // 晚於畫面期限一個 frame（UI_FRAME_MS）以上才開始畫的次數
+    uint32_t late_max_ms;
+    uint32_t render_avg_us;   // display list 建立
+    uint32_t render_max_us;
+    uint32_t push_avg_us;     // 光柵化 + 送出（DMA 排程）
+    uint32_t push_max_us;
+} eye_ui_frame_stats_t;
+
+// 取出並歸零上次呼叫以來的統計（telemetry Task 呼叫）
+void eye_ui_take_frame_stats(eye_ui_frame_stats_t *out);
+
+// ── Shared SPI bus（CONFIG_ESP_MIAO_DISPLAY_SHARED_BUS）─────────────────────
+// 同一條匯流排上的其他裝置（例如 SD 卡）每次存取（一個指令 / 一個 sector）前後呼叫。
+// 顯示 Task 送 frame 時每段像素之間讓出一次；未啟用共用或逾時回傳 false
+bool eye_ui_bus_acquire(uint32_t timeout_ms);
+void eye_ui_bus_release(void);
+// 顯示匯流排的 spi_host_device_t（以 spi_bus_add_device / sdspi 掛上其他裝置用）
+int eye_ui_bus_host(void);
 
 #ifdef __cplusplus
 }
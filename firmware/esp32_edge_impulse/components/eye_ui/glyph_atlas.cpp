@@ -0,0 +1,50 @@
+#include "glyph_atlas.h"
+#include "dirty_region.h"
+
+#include <string.h>
+
+#include "Arduino.h"
+#include <Fonts/glcdfont.c>   // font[]：每字 5 bytes，逐欄，bit 0 為最上列
+
+void GlyphAtlas::build() {
+    for (int c = FIRST; c <= LAST; c++) {
+        const uint8_t *cols = font + c * W;
+        uint8_t *out = rows_ + (c - FIRST) * H;
+        for (int y = 0; y < H; y++) {
+            uint8_t bits = 0;
+            for (int x = 0; x < W; x++) {
+                if (pgm_read_byte(cols + x) & (1 << y)) bits |= (uint8_t)(1 << x);
+            }
+            out[y] = bits;
+        }
+    }
+}
+
+uint8_t GlyphAtlas::row(char c, int y) const {
+    int i = (uint8_t)c;
+    if (i < FIRST || i > LAST) i = '?';
+    return rows_[(i - FIRST) * H + y];
+}
+
+bool TextRun::set(const GlyphAtlas &atlas, const char *text) {
+    if (!text) text = "";
+    if (strncmp(text, text_, MAX_CHARS) == 0) return false;
+    strncpy(text_, text, MAX_CHARS);
+    text_[MAX_CHARS] = '\0';
+    len_ = (int)strlen(text_);
+
+    memset(bits_, 0, sizeof(bits_));
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len_; i++) {
+        int x = i * GlyphAtlas::ADVANCE;
+        for (int y = 0; y < GlyphAtlas::H; y++) {
+            uint32_t g = atlas.row(text_[i], y);
+            uint32_t *row = bits_ + y * DisplayList::TEXT_ROW_WORDS;
+            row[x >> 5] |= g << (x & 31);
+            if ((x & 31) > 32 - GlyphAtlas::W) row[(x >> 5) + 1] |= g >> (32 - (x & 31));
+        }
+        h = ui_key_mix(h, (uint8_t)text_[i]);
+    }
+    key_ = ui_key_mix(h, len_);
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "display_list.h"
+
+// ── Glyph atlas / text runs ──────────────────────────────────────────────────
+// 狀態列文字：開機時將 TFT_eSPI 內建 5x7 字型（flash 中逐欄存放）的可列印 ASCII 轉成
+// 逐列位元遮罩放在 RAM（665 bytes）。TextRun 在文字改變時才由圖集拼出整段文字的每列位元遮罩，
+// 之後每個 frame 的光柵化只是按位元填入 span（DisplayList::text），成本與矩形複製相當。
+
+class GlyphAtlas {
+public:
+    static constexpr int FIRST = 32, LAST = 126;   // 收錄的字元範圍，其餘顯示為 '?'
+    static constexpr int W = 5, H = 7, ADVANCE = 6;
+
+    /** 由 flash 字型建立圖集（開機時呼叫一次） */
+    void build();
+
+    /** 字元 c 第 y 列的位元遮罩（bit x = 第 x 欄） */
+    uint8_t row(char c, int y) const;
+
+private:
+    uint8_t rows_[(LAST - FIRST + 1) * H];
+};
+
+class TextRun {
+public:
+    static constexpr int MAX_CHARS = DisplayList::TEXT_MAX_W / GlyphAtlas::ADVANCE;
+
+    TextRun() : len_(0), key_(0), text_{}, bits_{} {}
+
+    /**
+     * 設定文字；與目前內容相同時不重新拼字。
+     * @return true = 內容改變
+     */
+    bool set(const GlyphAtlas &atlas, const char *text);
+
+    /** 像素寬度（0 = 空字串） */
+    int width() const { return len_ ? len_ * GlyphAtlas::ADVANCE - 1 : 0; }
+    /** 內容雜湊（dirty region key） */
+    uint32_t key() const { return key_; }
+    /** GlyphAtlas::H 列，每列 DisplayList::TEXT_ROW_WORDS 個 32 位元字組 */
+    const uint32_t *bits() const { return bits_; }
+
+private:
+    int      len_;
+    uint32_t key_;
+    char     text_[MAX_CHARS + 1];
+    uint32_t bits_[GlyphAtlas::H * DisplayList::TEXT_ROW_WORDS];
+};
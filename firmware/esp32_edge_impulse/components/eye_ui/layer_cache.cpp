@@ -0,0 +1,45 @@
+#include "layer_cache.h"
+
+#include "esp_heap_caps.h"
+
+// 光柵化時以索引本身作為「顏色」，輸出即為調色盤索引
+static const uint16_t identity_colors[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+LayerCache::LayerCache(int16_t width, int16_t height)
+    : width_(width), height_(height), data_{}, key_{}, valid_{}, rebuilds_(0) {
+}
+
+const uint8_t *LayerCache::get(int slot, uint32_t key, const DisplayList &layer, uint16_t *scratch, int scratch_px) {
+    if (slot < 0 || slot >= SLOTS || scratch_px < width_) return nullptr;
+    if (valid_[slot] && key_[slot] == key) return data_[slot];
+
+    if (!data_[slot]) {
+        // 第一次使用該變體才配置（只讀不送 DMA，可放 PSRAM）
+        data_[slot] = (uint8_t *)heap_caps_malloc((size_t)width_ * height_ / 2, MALLOC_CAP_8BIT);
+        if (!data_[slot]) return nullptr;
+    }
+
+    int lines = scratch_px / width_;
+    uint8_t *out = data_[slot];
+    for (int y = 0; y < height_; y += lines) {
+        int h = (height_ - y) < lines ? (height_ - y) : lines;
+        layer.render(scratch, 0, y, width_, h, identity_colors);
+        for (int i = 0; i < width_ * h; i += 2) *out++ = (uint8_t)(scratch[i] | (scratch[i + 1] << 4));
+    }
+    key_[slot] = key;
+    valid_[slot] = true;
+    rebuilds_++;
+    return data_[slot];
+}
+
+size_t LayerCache::release() {
+    size_t freed = 0;
+    for (int slot = 0; slot < SLOTS; slot++) {
+        if (!data_[slot]) continue;
+        heap_caps_free(data_[slot]);
+        data_[slot] = nullptr;
+        valid_[slot] = false;
+        freed += (size_t)width_ * height_ / 2;
+    }
+    return freed;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "display_list.h"
+
+// ── Static layer cache ───────────────────────────────────────────────────────
+// 臉部（耳朵、嘴巴、鼻子）只在耳朵抖動時改變，卻原本每 frame 都重新光柵化。
+// 每個變體（清醒 / 睡覺 / 錯誤色）保留一張整個畫面的圖層，每像素 4 位元調色盤索引
+// （128 x 160 為 10 KB）；參數 key 改變時才重新光柵化，其餘 frame 由 DisplayList::background
+// 直接展開成背景，display list 只剩眼睛等動態元素。
+
+class LayerCache {
+public:
+    static constexpr int SLOTS = 3;
+
+    LayerCache(int16_t width, int16_t height);
+
+    /**
+     * 取得 slot 的圖層；key 與快取內容不同時先將 layer 光柵化進去。
+     * @param scratch    光柵化用的暫存緩衝（scratch_px 像素，至少一列）
+     * @return nullptr = 配置失敗（呼叫端改為每 frame 直接繪製）
+     */
+    const uint8_t *get(int slot, uint32_t key, const DisplayList &layer, uint16_t *scratch, int scratch_px);
+
+    /** 釋放所有圖層（面板關閉期間），下次 get() 重新配置並光柵化；回傳釋放的 bytes */
+    size_t release();
+
+    /** 累計重新光柵化次數 */
+    uint32_t rebuilds() const { return rebuilds_; }
+
+private:
+    int16_t  width_, height_;
+    uint8_t *data_[SLOTS];
+    uint32_t key_[SLOTS];
+    bool     valid_[SLOTS];
+    uint32_t rebuilds_;
+};
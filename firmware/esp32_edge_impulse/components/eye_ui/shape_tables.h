@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+// ── Compile-time shape tables ────────────────────────────────────────────────
+// 眼睛、鼻子、嘴巴的半徑都是固定的，span 與點座標在編譯期算好，每 frame 只剩整數 blit。
+// 取樣方式與原本 runtime 迴圈相同（float 角度累加、(int) 截斷），畫出的像素一致。
+
+struct UiPoint {
+    int8_t x, y;
+};
+
+namespace shape_detail {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// constexpr 版 sin / cos：化簡到 [-π, π] 後以泰勒級數展開（誤差遠小於 1 px）
+constexpr double sin_(double x) {
+    while (x > kPi) x -= 2 * kPi;
+    while (x < -kPi) x += 2 * kPi;
+    double term = x, sum = x;
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double cos_(double x) {
+    return sin_(x + kPi / 2);
+}
+
+constexpr int isqrt_(int v) {
+    int r = 0;
+    while ((r + 1) * (r + 1) <= v) r++;
+    return r;
+}
+
+// for (float a = a0; a < a1; a += step) 的迭代次數
+constexpr int steps_(float a0, float a1, float step) {
+    int n = 0;
+    for (float a = a0; a < a1; a += step) n++;
+    return n;
+}
+
+}  // namespace shape_detail
+
+// 實心橢圓：第 |y| 列（y = 0..RY）的半寬
+template <int RX, int RY>
+struct EllipseSpans {
+    int8_t half[RY + 1];
+
+    constexpr EllipseSpans() : half() {
+        // floor(RX * sqrt(1 - (y/RY)^2))，改以整數開根號計算
+        for (int y = 0; y <= RY; y++) {
+            half[y] = (int8_t)(shape_detail::isqrt_(RX * RX * (RY * RY - y * y)) / RY);
+        }
+    }
+};
+
+// 橢圓弧上的取樣點（相對圓心）：UPPER = π..2π（上半弧），否則 0..π（下半弧）；
+// 角度間隔 STEP_X100 / 100 rad
+template <int RX, int RY, bool UPPER, int STEP_X100>
+struct ArcPoints {
+    static constexpr float A0   = UPPER ? (float)shape_detail::kPi : 0.0f;
+    static constexpr float A1   = UPPER ? 2.0f * (float)shape_detail::kPi : (float)shape_detail::kPi;
+    static constexpr float STEP = STEP_X100 / 100.0f;
+    static constexpr int   N    = shape_detail::steps_(A0, A1, STEP);
+
+    UiPoint p[N];
+
+    constexpr ArcPoints() : p() {
+        int i = 0;
+        for (float a = A0; a < A1; a += STEP) {
+            // 先轉 float 再乘，與 cosf(a) * r 的截斷結果相同（例如 a = π 時為 -r 而非 -r + 1）
+            p[i].x = (int8_t)(int)((float)shape_detail::cos_(a) * RX);
+            p[i].y = (int8_t)(int)((float)shape_detail::sin_(a) * RY);
+            i++;
+        }
+    }
+};
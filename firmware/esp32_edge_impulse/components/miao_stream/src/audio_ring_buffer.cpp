@@ -0,0 +1,290 @@
+/*
+ * audio_ring_buffer.cpp - 單生產者 / 多消費者 PCM 環形緩衝實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "audio_ring_buffer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+static const char *TAG = "AudioRing";
+
+AudioRingBuffer::AudioRingBuffer()
+    : buf_(nullptr), mask_(0), usable_(0), write_pos_(0), filled_(false), held_drops_(0),
+      claim_lock_(portMUX_INITIALIZER_UNLOCKED)
+{
+    for (int i = 0; i < MAX_READERS; i++) {
+        readers_[i].pos.store(0);
+        readers_[i].overruns = 0;
+        readers_[i].max_lag  = 0;
+        readers_[i].policy.store(READER_DROP);
+        readers_[i].claimed  = false;
+        readers_[i].waiter   = nullptr;
+        readers_[i].wake_at.store(0);
+        readers_[i].armed.store(false);
+    }
+}
+
+static bool valid_capacity(size_t capacity_samples)
+{
+    if (capacity_samples == 0 || (capacity_samples & (capacity_samples - 1)) != 0) {
+        ESP_LOGE(TAG, "Capacity %u is not a power of two", (unsigned)capacity_samples);
+        return false;
+    }
+    return true;
+}
+
+bool AudioRingBuffer::init(size_t capacity_samples)
+{
+    if (buf_) return true;
+    if (!valid_capacity(capacity_samples)) return false;
+
+    const size_t bytes = capacity_samples * sizeof(int16_t);
+    int16_t *buf = static_cast<int16_t *>(heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (!buf) {
+        buf = static_cast<int16_t *>(heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    }
+    if (!buf) {
+        ESP_LOGE(TAG, "OOM: cannot allocate %u bytes", (unsigned)bytes);
+        return false;
+    }
+    return attach_(buf, capacity_samples);
+}
+
+bool AudioRingBuffer::init(int16_t *storage, size_t capacity_samples)
+{
+    if (buf_) return true;
+    if (!storage || !valid_capacity(capacity_samples)) return false;
+    return attach_(storage, capacity_samples);
+}
+
+bool AudioRingBuffer::attach_(int16_t *storage, size_t capacity_samples)
+{
+    const size_t bytes = capacity_samples * sizeof(int16_t);
+    buf_ = storage;
+    memset(buf_, 0, bytes);
+
+    mask_   = (uint32_t)capacity_samples - 1;
+    usable_ = (uint32_t)capacity_samples - (uint32_t)(capacity_samples / 8);
+    ESP_LOGI(TAG, "Ring buffer ready: %u samples (%u bytes)",
+             (unsigned)capacity_samples, (unsigned)bytes);
+    return true;
+}
+
+/* ---------- 游標登記 ---------- */
+
+int AudioRingBuffer::open_reader(ReaderPolicy policy)
+{
+    int reader = -1;
+    portENTER_CRITICAL(&claim_lock_);
+    for (int i = 0; i < MAX_READERS; i++) {
+        if (!readers_[i].claimed) {
+            readers_[i].claimed = true;
+            reader = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&claim_lock_);
+    if (reader < 0) {
+        ESP_LOGE(TAG, "No free reader (max %d)", MAX_READERS);
+        return -1;
+    }
+    seek_to_live(reader);
+    readers_[reader].overruns = 0;
+    readers_[reader].max_lag  = 0;
+    set_policy(reader, policy);
+    return reader;
+}
+
+bool AudioRingBuffer::claim_reader(int reader, ReaderPolicy policy)
+{
+    if (reader < 0 || reader >= MAX_READERS) return false;
+    portENTER_CRITICAL(&claim_lock_);
+    bool fresh = !readers_[reader].claimed;
+    readers_[reader].claimed = true;
+    portEXIT_CRITICAL(&claim_lock_);
+    seek_to_live(reader);
+    set_policy(reader, policy);
+    return fresh;
+}
+
+void AudioRingBuffer::close_reader(int reader)
+{
+    readers_[reader].policy.store(READER_DROP, std::memory_order_release);
+    readers_[reader].armed.store(false, std::memory_order_release);
+    portENTER_CRITICAL(&claim_lock_);
+    readers_[reader].claimed = false;
+    portEXIT_CRITICAL(&claim_lock_);
+}
+
+void AudioRingBuffer::set_policy(int reader, ReaderPolicy policy)
+{
+    readers_[reader].policy.store((uint8_t)policy, std::memory_order_release);
+}
+
+AudioRingBuffer::ReaderStats AudioRingBuffer::reader_stats(int reader) const
+{
+    const Reader &r = readers_[reader];
+    ReaderStats   st;
+    st.lag      = write_pos() - r.pos.load(std::memory_order_relaxed);
+    st.max_lag  = r.max_lag;
+    st.overruns = r.overruns;
+    st.policy   = r.policy.load(std::memory_order_relaxed);
+    return st;
+}
+
+/* ---------- 生產者 ---------- */
+
+size_t AudioRingBuffer::writable_(uint32_t w, size_t n) const
+{
+    for (int i = 0; i < MAX_READERS; i++) {
+        const Reader &r = readers_[i];
+        if (r.policy.load(std::memory_order_acquire) != READER_HOLD) continue;
+        uint32_t lag  = w - r.pos.load(std::memory_order_acquire);
+        size_t   room = (lag < usable_) ? usable_ - lag : 0;
+        if (n > room) n = room;
+    }
+    return n;
+}
+
+size_t AudioRingBuffer::write_impl_(const int16_t *samples, size_t n, BaseType_t *hp_task_woken)
+{
+    uint32_t w = write_pos_.load(std::memory_order_relaxed);
+
+    /* READER_HOLD 讀者未讀的資料不覆寫：只寫入放得下的部分，其餘捨棄 */
+    size_t fit = writable_(w, n);
+    if (fit < n) {
+        held_drops_.fetch_add((uint32_t)(n - fit), std::memory_order_relaxed);
+        n = fit;
+    }
+
+    size_t idx   = w & mask_;
+    size_t first = capacity() - idx;
+    if (first > n) first = n;
+    memcpy(buf_ + idx, samples, first * sizeof(int16_t));
+    if (n > first) {
+        memcpy(buf_, samples + first, (n - first) * sizeof(int16_t));
+    }
+
+    w += (uint32_t)n;
+    write_pos_.store(w, std::memory_order_release);
+    if (!filled_.load(std::memory_order_relaxed) && w >= usable_) {
+        filled_.store(true, std::memory_order_release);
+    }
+
+    /* 喚醒已達門檻的讀者 */
+    for (int i = 0; i < MAX_READERS; i++) {
+        Reader &r = readers_[i];
+        if (!r.armed.load(std::memory_order_acquire)) continue;
+        if ((int32_t)(w - r.wake_at.load(std::memory_order_relaxed)) < 0) continue;
+        if (r.armed.exchange(false, std::memory_order_acq_rel) && r.waiter) {
+            if (hp_task_woken) vTaskNotifyGiveFromISR(r.waiter, hp_task_woken);
+            else               xTaskNotifyGive(r.waiter);
+        }
+    }
+    return n;
+}
+
+/* ---------- 消費者 ---------- */
+
+void AudioRingBuffer::seek_to_live(int reader)
+{
+    readers_[reader].pos.store(write_pos(), std::memory_order_release);
+}
+
+uint32_t AudioRingBuffer::seek_to(int reader, uint32_t pos)
+{
+    uint32_t w      = write_pos();
+    uint32_t oldest = filled_.load(std::memory_order_acquire)
+                    ? (w - usable_) : 0;  // 開機初期尚未填滿
+
+    if ((int32_t)(pos - oldest) < 0) pos = oldest;
+    if ((int32_t)(w - pos) < 0)      pos = w;
+    readers_[reader].pos.store(pos, std::memory_order_release);
+    return pos;
+}
+
+size_t AudioRingBuffer::available(int reader) const
+{
+    uint32_t avail = write_pos() - readers_[reader].pos.load(std::memory_order_relaxed);
+    return (avail > usable_) ? usable_ : avail;
+}
+
+uint32_t AudioRingBuffer::catch_up(int reader)
+{
+    Reader  &r     = readers_[reader];
+    uint32_t pos   = r.pos.load(std::memory_order_relaxed);
+    uint32_t avail = write_pos() - pos;
+
+    if (avail > r.max_lag) r.max_lag = avail;
+    if (avail > usable_) {
+        uint32_t lost = avail - usable_;
+        r.overruns += lost;
+        pos        += lost;
+        r.pos.store(pos, std::memory_order_release);
+        ESP_LOGW(TAG, "Reader %d overrun: dropped %u samples", reader, (unsigned)lost);
+    }
+    return pos;
+}
+
+size_t AudioRingBuffer::read(int reader, int16_t *out, size_t n)
+{
+    Reader  &r     = readers_[reader];
+    uint32_t pos   = catch_up(reader);
+    uint32_t avail = write_pos() - pos;
+
+    if (avail > usable_) avail = usable_;   // catch_up 之後生產者可能又寫入
+    if (n > avail) n = avail;
+
+    size_t idx   = pos & mask_;
+    size_t first = capacity() - idx;
+    if (first > n) first = n;
+    memcpy(out, buf_ + idx, first * sizeof(int16_t));
+    if (n > first) {
+        memcpy(out + first, buf_, (n - first) * sizeof(int16_t));
+    }
+
+    /* release：READER_HOLD 時生產者看到新位置才會覆寫剛讀完的區段 */
+    r.pos.store(pos + (uint32_t)n, std::memory_order_release);
+    return n;
+}
+
+int AudioRingBuffer::segments(uint32_t pos, size_t n, const int16_t *seg[2], size_t len[2]) const
+{
+    if (!retained(pos) || (size_t)(write_pos() - pos) < n) return 0;
+
+    size_t idx   = pos & mask_;
+    size_t first = capacity() - idx;
+    if (first > n) first = n;
+
+    seg[0] = buf_ + idx;
+    len[0] = first;
+    seg[1] = buf_;
+    len[1] = n - first;
+    return (len[1] > 0) ? 2 : 1;
+}
+
+bool AudioRingBuffer::wait_for(int reader, size_t n, TickType_t timeout)
+{
+    Reader  &r   = readers_[reader];
+    uint32_t lag = write_pos() - r.pos.load(std::memory_order_relaxed);
+    if (lag > r.max_lag) r.max_lag = lag;
+    if (available(reader) >= n) return true;
+
+    r.waiter = xTaskGetCurrentTaskHandle();
+    r.wake_at.store(r.pos.load(std::memory_order_relaxed) + (uint32_t)n, std::memory_order_relaxed);
+    r.armed.store(true, std::memory_order_release);
+
+    TickType_t start = xTaskGetTickCount();
+    while (available(reader) < n) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) {
+            r.armed.store(false, std::memory_order_release);
+            return false;
+        }
+        ulTaskNotifyTake(pdTRUE, timeout - elapsed);
+    }
+    r.armed.store(false, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,203 @@
+#ifndef AUDIO_RING_BUFFER_H
+#define AUDIO_RING_BUFFER_H
+
+/* ============================================================
+ * audio_ring_buffer.h - 單生產者 / 多消費者 PCM 環形緩衝
+ * ESP-MIAO v0.8.0
+ *
+ * 生產者：AudioCapture 擷取 Task 或 I2S ISR（唯一寫入者）
+ * 消費者：WakeWordDetector / AudioStreamer（各自持有讀取游標）
+ *
+ * 寫入位置與各游標皆為單調遞增的樣本計數（uint32，自然溢位），
+ * 以 mask 取得實際索引；寫入端只更新 write_pos_，不需鎖。
+ *
+ * 同一份擷取資料扇出給多個消費者（Server 串流、誤觸錄音、裝置端模型…），
+ * 不重讀 I2S、不另外複製；每個游標各有過慢時的處理方式：
+ *   READER_DROP：生產者照常覆寫，讀者下次讀取時跳至最舊的有效資料（遺失舊資料）
+ *   READER_HOLD：生產者不覆寫此讀者尚未讀取的資料，放不下的新樣本直接捨棄
+ *                （擷取端不能真的阻塞：I2S DMA 不等人），捨棄量計入 held_drops()
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+class AudioRingBuffer {
+public:
+    /** 最多可同時掛載的讀取游標數 */
+    static constexpr int MAX_READERS = 4;
+
+    /** 讀者過慢時的處理方式 */
+    enum ReaderPolicy {
+        READER_DROP = 0,   // 覆寫讀者未讀資料（即時性優先，預設）
+        READER_HOLD = 1,   // 保留讀者未讀資料，捨棄新樣本（完整性優先）
+    };
+
+    /** 單一游標的延遲統計 */
+    struct ReaderStats {
+        uint32_t lag;        // 目前落後寫入位置的樣本數
+        uint32_t max_lag;    // 自上次 reset_lag_peak 以來讀取前的最大落後
+        uint32_t overruns;   // READER_DROP：被覆寫而遺失的樣本數
+        uint8_t  policy;     // ReaderPolicy
+    };
+
+    AudioRingBuffer();
+
+    /**
+     * 配置緩衝區（優先 PSRAM，否則使用內部 RAM）。
+     * @param capacity_samples 容量（int16 樣本數，必須為 2 的次方）
+     * @return true = 成功
+     */
+    bool init(size_t capacity_samples);
+
+    /**
+     * 使用呼叫端提供的緩衝區（靜態配置模式，不經 heap）。
+     * @param storage          至少 capacity_samples 個 int16，生命週期需涵蓋整個程式
+     * @param capacity_samples 容量（int16 樣本數，必須為 2 的次方）
+     */
+    bool init(int16_t *storage, size_t capacity_samples);
+
+    /* ---------- 生產者端（僅擷取 Task 呼叫） ---------- */
+
+    /**
+     * 寫入樣本並喚醒已達門檻的等待讀者。
+     * @return 實際寫入的樣本數（READER_HOLD 讀者未跟上時會少於 n，捨棄尾端）
+     */
+    size_t write(const int16_t *samples, size_t n) { return write_impl_(samples, n, nullptr); }
+
+    /**
+     * ISR 版本（I2S on_recv 回調使用）。
+     * @param hp_task_woken 有更高優先權 Task 被喚醒時設為 pdTRUE
+     */
+    size_t write_from_isr(const int16_t *samples, size_t n, BaseType_t *hp_task_woken)
+    {
+        return write_impl_(samples, n, hp_task_woken);
+    }
+
+    /* ---------- 游標登記 ---------- */
+
+    /**
+     * 登記一個新的讀取游標（自最新寫入位置開始）。
+     * 未經登記直接使用固定編號的游標仍然有效（預設 READER_DROP），
+     * 固定編號的擁有者應先 claim_reader 以免被後續 open_reader 取走。
+     * @return 游標編號，-1 = 已無空位
+     */
+    int open_reader(ReaderPolicy policy = READER_DROP);
+
+    /**
+     * 保留指定編號的游標並移至最新寫入位置（固定編號的消費者於初始化時呼叫）。
+     * @return false = 已被保留過（重複初始化時只重設游標與 policy）
+     */
+    bool claim_reader(int reader, ReaderPolicy policy = READER_DROP);
+
+    /** 釋放游標（READER_HOLD 的讀者一併解除對生產者的限制） */
+    void close_reader(int reader);
+
+    /**
+     * 變更游標的過慢處理方式（例如只在串流期間保留資料）。
+     * 切換為 READER_HOLD 時游標必須位於保留範圍內（先 seek_to / seek_to_live）。
+     */
+    void set_policy(int reader, ReaderPolicy policy);
+
+    /* ---------- 消費者端（每個游標僅由單一 Task 使用） ---------- */
+
+    /** 將游標移至最新寫入位置（丟棄尚未讀取的舊資料） */
+    void seek_to_live(int reader);
+
+    /**
+     * 將游標移至指定的絕對樣本位置（以 write_pos() 為座標），
+     * 若該位置已被覆寫則截斷至最舊的有效樣本。
+     * @return 實際設定的位置
+     */
+    uint32_t seek_to(int reader, uint32_t pos);
+
+    /**
+     * 零拷貝讀取前呼叫：游標已被覆寫時跳至最舊的有效資料並累計 overrun（同 read）。
+     * @return 游標位置
+     */
+    uint32_t catch_up(int reader);
+
+    /** 游標目前的絕對位置（下一個要讀取的樣本） */
+    uint32_t position(int reader) const { return readers_[reader].pos.load(std::memory_order_relaxed); }
+
+    /** 目前可讀取的樣本數 */
+    size_t available(int reader) const;
+
+    /**
+     * 非阻塞讀取，最多 n 個樣本。
+     * 若游標已被覆寫（讀者太慢），會先跳至最舊的有效資料並累計 overrun。
+     * @return 實際讀出的樣本數
+     */
+    size_t read(int reader, int16_t *out, size_t n);
+
+    /**
+     * 阻塞等待直到至少 n 個樣本可讀（以 Task Notification 喚醒，不輪詢）。
+     * @return true = 資料已就緒，false = 逾時
+     */
+    bool wait_for(int reader, size_t n, TickType_t timeout);
+
+    /**
+     * 零拷貝存取：取得絕對位置 pos 起 n 個樣本的唯讀指標（環繞時分兩段）。
+     * 不移動游標；呼叫端需以 retained() 確認使用期間未被覆寫。
+     * @return 段數（0 = 範圍無效，1 或 2）
+     */
+    int segments(uint32_t pos, size_t n, const int16_t *seg[2], size_t len[2]) const;
+
+    /** 位置 pos 的樣本是否仍保留在緩衝中（尚未被生產者覆寫） */
+    bool retained(uint32_t pos) const
+    {
+        uint32_t back = write_pos() - pos;
+        return (int32_t)back >= 0 && back <= usable_;
+    }
+
+    /** 生產者累計寫入樣本數 */
+    uint32_t write_pos() const { return write_pos_.load(std::memory_order_acquire); }
+
+    /** 指定游標因過慢而遺失的樣本數 */
+    uint32_t overruns(int reader) const { return readers_[reader].overruns; }
+
+    /** 指定游標的延遲統計（快照） */
+    ReaderStats reader_stats(int reader) const;
+
+    /** 重設指定游標的 max_lag（例如每次列印統計後） */
+    void reset_lag_peak(int reader) { readers_[reader].max_lag = 0; }
+
+    /** 因 READER_HOLD 讀者未跟上而被生產者捨棄的樣本數 */
+    uint32_t held_drops() const { return held_drops_.load(std::memory_order_relaxed); }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Reader {
+        std::atomic<uint32_t>      pos;        // READER_HOLD 時生產者會讀取
+        uint32_t                   overruns;
+        uint32_t                   max_lag;
+        std::atomic<uint8_t>       policy;
+        bool                       claimed;
+        TaskHandle_t               waiter;
+        std::atomic<uint32_t>      wake_at;
+        std::atomic<bool>          armed;
+    };
+
+    int16_t              *buf_;
+    uint32_t              mask_;
+    uint32_t              usable_;   // 容量扣除寫入保護區，避免讀取時被覆寫
+    std::atomic<uint32_t> write_pos_;
+    std::atomic<bool>     filled_;   // 已寫滿過 usable_（write_pos_ 溢位後仍成立）
+    std::atomic<uint32_t> held_drops_;
+    portMUX_TYPE          claim_lock_;
+    Reader                readers_[MAX_READERS];
+
+    bool attach_(int16_t *storage, size_t capacity_samples);
+
+    /* READER_HOLD 讀者允許寫入的樣本數（無 HOLD 讀者時為 n） */
+    size_t writable_(uint32_t w, size_t n) const;
+
+    /* hp_task_woken == nullptr 表示 Task 環境 */
+    size_t write_impl_(const int16_t *samples, size_t n, BaseType_t *hp_task_woken);
+};
+
+#endif // AUDIO_RING_BUFFER_H
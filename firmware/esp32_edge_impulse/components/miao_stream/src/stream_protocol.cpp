@@ -0,0 +1,36 @@
+/*
+ * stream_protocol.cpp - 音訊串流控制訊息格式化
+ * ESP-MIAO v0.8.0
+ */
+
+#include "stream_protocol.h"
+#include <stdio.h>
+
+int stream_start_json(char *buf, size_t cap, const StreamStartInfo &info)
+{
+    return snprintf(buf, cap,
+                    "{\"device_id\":\"%s\",\"timestamp\":%llu,\"type\":\"audio_start\","
+                    "\"payload\":{\"audio_format\":\"%s\",\"sample_rate\":%d,"
+                    "\"total_samples\":%u,\"preroll_samples\":%u,\"frame_samples\":%u,"
+                    "\"chunk_header_bytes\":%d,\"timer_us\":%lld,\"clock_err_us\":%u,"
+                    "\"endpointing\":%s,\"noise_suppression\":%s,"
+                    "\"session_id\":%lu,\"confidence\":%.3f,\"transfer_mode\":\"%s\","
+                    "\"trace_id\":\"%08lx\"%s}}",
+                    info.device_id, (unsigned long long)info.timestamp_ms,
+                    info.audio_format, info.sample_rate,
+                    (unsigned)info.total_samples, (unsigned)info.preroll_samples, (unsigned)info.frame_samples,
+                    info.chunk_header_bytes, (long long)info.timer_us, info.clock_err_us,
+                    info.endpointing ? "true" : "false", info.noise_suppression ? "true" : "false",
+                    (unsigned long)info.session_id, info.confidence, info.transfer_mode,
+                    (unsigned long)info.trace_id, info.extra ? info.extra : "");
+}
+
+int stream_end_json(char *buf, size_t cap, const char *device_id, uint64_t timestamp_ms,
+                    size_t total_samples, const char *reason, const char *extra)
+{
+    return snprintf(buf, cap,
+                    "{\"device_id\":\"%s\",\"timestamp\":%llu,\"type\":\"audio_end\","
+                    "\"payload\":{\"total_samples\":%u,\"reason\":\"%s\"%s}}",
+                    device_id, (unsigned long long)timestamp_ms,
+                    (unsigned)total_samples, reason, extra ? extra : "");
+}
@@ -0,0 +1,62 @@
+#ifndef STREAM_PROTOCOL_H
+#define STREAM_PROTOCOL_H
+
+/* ============================================================
+ * stream_protocol.h - 音訊串流的線上格式（ESP-IDF 韌體與 Arduino client 共用）
+ * ESP-MIAO v0.8.0
+ *
+ * 一次串流：audio_start（JSON）→ binary frame（StreamChunkHeader + PCM / ADPCM）→
+ * audio_end（JSON，選填）。只依賴 libc，兩種建置直接編譯同一份來源。
+ * ============================================================ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary frame 標頭（audio_start 的 chunk_header_bytes > 0 時置於每個 frame 開頭，little-endian）。
+ * 時間戳為 esp_timer 微秒；Server 以 audio_start 的 timestamp / timer_us 換算為牆鐘時間。
+ */
+struct StreamChunkHeader {
+    uint32_t seq;            // 本次串流內的 chunk 序號（0 起算，用於偵測遺失）
+    uint32_t block_seq;      // 第一個樣本所屬的 DMA 區塊序號
+    int64_t  capture_us;     // 第一個樣本的擷取時間
+    uint32_t session_id;     // audio_start 的 session_id（續傳時丟棄舊 session 的 frame）
+    uint32_t sample_offset;  // 第一個樣本相對串流開頭的位置（續傳時 Server 依此去除重複）
+};
+static_assert(sizeof(StreamChunkHeader) == 24, "StreamChunkHeader layout is part of the protocol");
+
+/* audio_start 的欄位；extra 為已格式化的選填欄位（以逗號開頭，可為空字串） */
+struct StreamStartInfo {
+    const char *device_id;
+    uint64_t    timestamp_ms;       // timer_us 當下的牆鐘時間
+    const char *audio_format;       // "pcm_16k_16bit" / "adpcm_16k_4bit" / "adpcm_8k_4bit"
+    int         sample_rate;        // 串流的取樣率（total / preroll / frame 的樣本數皆以此計）
+    size_t      total_samples;
+    size_t      preroll_samples;
+    size_t      frame_samples;      // 每個 frame 的樣本數（自適應 chunk 時為起始值；0 = 未告知）
+    int         chunk_header_bytes; // 0 = frame 不帶 StreamChunkHeader
+    int64_t     timer_us;
+    unsigned    clock_err_us;
+    bool        endpointing;        // true = 以 audio_end 結束（total_samples 為上限）
+    bool        noise_suppression;
+    uint32_t    session_id;
+    float       confidence;
+    const char *transfer_mode;      // "binary" / "udp"
+    uint32_t    trace_id;
+    const char *extra;
+};
+
+/**
+ * 格式化 audio_start。
+ * @return 同 snprintf（需要的長度；>= cap 表示被截斷）
+ */
+int stream_start_json(char *buf, size_t cap, const StreamStartInfo &info);
+
+/**
+ * 格式化 audio_end；extra 為 payload 內的選填欄位（以逗號開頭，例如 link / trace），可為 nullptr。
+ * @return 同 snprintf
+ */
+int stream_end_json(char *buf, size_t cap, const char *device_id, uint64_t timestamp_ms,
+                    size_t total_samples, const char *reason, const char *extra);
+
+#endif // STREAM_PROTOCOL_H
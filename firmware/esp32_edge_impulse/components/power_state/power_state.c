@@ -0,0 +1,118 @@
+#include "power_state.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+static const char *TAG = "Power";
+
+// 需要 CPU 全速的來源；其餘來源只阻止 light sleep
+#define PWR_MAX_MASK ((1u << PWR_HOLD_INFERENCE) | (1u << PWR_HOLD_STREAM) | (1u << PWR_HOLD_DISPLAY))
+
+static portMUX_TYPE pwr_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool        pwr_ready = false;
+static uint32_t    pwr_holds = 0;                // 目前宣告中的來源（bit = pwr_hold_t）
+static pwr_level_t pwr_level = PWR_LEVEL_MAX;
+static int64_t     pwr_since_us = 0;             // 進入目前層級的時間
+static uint64_t    pwr_resid_us[PWR_LEVEL_COUNT];
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t pwr_pm_locks[PWR_HOLD_COUNT];
+static const char *const pwr_names[PWR_HOLD_COUNT] = { "infer", "stream", "display", "speech", "ui" };
+#endif
+
+static pwr_level_t pwr_level_of(uint32_t holds) {
+    if (holds & PWR_MAX_MASK) return PWR_LEVEL_MAX;
+    return holds ? PWR_LEVEL_AWAKE : PWR_LEVEL_IDLE;
+}
+
+// 把目前層級累計到 now；需在 pwr_lock 內呼叫
+static void pwr_account(int64_t now) {
+    pwr_resid_us[pwr_level] += (uint64_t)(now - pwr_since_us);
+    pwr_since_us = now;
+}
+
+bool power_state_init(int max_mhz, int min_mhz, bool light_sleep) {
+    if (pwr_ready) return true;
+    bool ok = true;
+#if CONFIG_PM_ENABLE
+#if !CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    light_sleep = false;   // 自動 light sleep 需要 tickless idle
+#endif
+    esp_pm_config_t cfg = {
+        .max_freq_mhz = max_mhz,
+        .min_freq_mhz = min_mhz,
+        .light_sleep_enable = light_sleep,
+    };
+    esp_err_t err = esp_pm_configure(&cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_pm_configure failed (%s), staying at full clock", esp_err_to_name(err));
+        ok = false;
+    }
+    for (int i = 0; ok && i < PWR_HOLD_COUNT; i++) {
+        esp_pm_lock_type_t type = (PWR_MAX_MASK & (1u << i)) ? ESP_PM_CPU_FREQ_MAX : ESP_PM_NO_LIGHT_SLEEP;
+        if (esp_pm_lock_create(type, 0, pwr_names[i], &pwr_pm_locks[i]) != ESP_OK) {
+            ESP_LOGE(TAG, "PM lock '%s' create failed", pwr_names[i]);
+            ok = false;
+        }
+    }
+    if (ok) {
+        ESP_LOGI(TAG, "DFS %d-%d MHz, light sleep %s", min_mhz, max_mhz, light_sleep ? "on" : "off");
+    }
+#else
+    (void)max_mhz; (void)min_mhz; (void)light_sleep;
+    ESP_LOGI(TAG, "CONFIG_PM_ENABLE off: fixed clock, residency tracked only");
+#endif
+    portENTER_CRITICAL(&pwr_lock);
+    pwr_since_us = esp_timer_get_time();
+    pwr_level = pwr_level_of(pwr_holds);
+    pwr_ready = true;
+    portEXIT_CRITICAL(&pwr_lock);
+    return ok;
+}
+
+void power_hold(pwr_hold_t src, bool on) {
+    if (src >= PWR_HOLD_COUNT) return;
+    uint32_t bit = 1u << src;
+
+    portENTER_CRITICAL(&pwr_lock);
+    bool changed = pwr_ready && ((pwr_holds & bit) != 0) != on;
+    if (changed) {
+        pwr_holds = on ? (pwr_holds | bit) : (pwr_holds & ~bit);
+        pwr_level_t level = pwr_level_of(pwr_holds);
+        if (level != pwr_level) {
+            pwr_account(esp_timer_get_time());
+            pwr_level = level;
+        }
+    }
+    portEXIT_CRITICAL(&pwr_lock);
+
+#if CONFIG_PM_ENABLE
+    // 同一來源只有一個宣告者，鎖操作可在 critical section 外進行
+    if (changed && pwr_pm_locks[src]) {
+        if (on) esp_pm_lock_acquire(pwr_pm_locks[src]);
+        else    esp_pm_lock_release(pwr_pm_locks[src]);
+    }
+#endif
+}
+
+void power_take_residency(uint32_t out_ms[PWR_LEVEL_COUNT]) {
+    portENTER_CRITICAL(&pwr_lock);
+    if (pwr_ready) pwr_account(esp_timer_get_time());
+    for (int i = 0; i < PWR_LEVEL_COUNT; i++) {
+        out_ms[i] = (uint32_t)(pwr_resid_us[i] / 1000);
+        pwr_resid_us[i] = 0;
+    }
+    portEXIT_CRITICAL(&pwr_lock);
+}
+
+uint32_t power_holds(void) {
+    portENTER_CRITICAL(&pwr_lock);
+    uint32_t holds = pwr_holds;
+    portEXIT_CRITICAL(&pwr_lock);
+    return holds;
+}
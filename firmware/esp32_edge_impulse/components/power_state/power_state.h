@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ── 動態調頻（esp_pm DFS） ─────────────────────────────────────────────────────
+// 各來源只宣告「需要什麼」，重複宣告同一狀態不累加（每個來源只由一個 Task 宣告）：
+//   CPU 全速（ESP_PM_CPU_FREQ_MAX）  ：推論、喚醒 session / 指令串流、顯示 DMA 傳輸
+//   保持喚醒（ESP_PM_NO_LIGHT_SLEEP）：VAD 近期有語音、UI 不在 UI_SLEEPING
+//   皆無                             ：降到最低頻率，閒置時允許自動 light sleep
+// 未開啟 CONFIG_PM_ENABLE 時不改變時脈，只照樣記錄各層級的駐留時間。
+typedef enum {
+    PWR_HOLD_INFERENCE = 0,
+    PWR_HOLD_STREAM,
+    PWR_HOLD_DISPLAY,
+    PWR_HOLD_SPEECH,
+    PWR_HOLD_UI,
+    PWR_HOLD_COUNT
+} pwr_hold_t;
+
+typedef enum {
+    PWR_LEVEL_MAX = 0,   // CPU 全速
+    PWR_LEVEL_AWAKE,     // 最低頻率、不進 light sleep
+    PWR_LEVEL_IDLE,      // 最低頻率、允許 light sleep
+    PWR_LEVEL_COUNT
+} pwr_level_t;
+
+// 設定 DFS 範圍並建立各來源的 PM 鎖（須在任何 power_hold 之前呼叫）；
+// light_sleep 需要 CONFIG_FREERTOS_USE_TICKLESS_IDLE，否則忽略。false = esp_pm_configure 失敗（維持全速）
+bool power_state_init(int max_mhz, int min_mhz, bool light_sleep);
+// 宣告 / 撤銷一個來源的需求（任何 Task，不阻塞）
+void power_hold(pwr_hold_t src, bool on);
+// 各層級自上次取出以來的駐留時間（ms），取出後歸零
+void power_take_residency(uint32_t out_ms[PWR_LEVEL_COUNT]);
+// 目前宣告中的來源（bit = 1u << pwr_hold_t），供排程背景工作避開忙碌時段
+uint32_t power_holds(void);
+
+#ifdef __cplusplus
+}
+
+// 區塊內維持一個來源的需求（離開時自動撤銷）
+class PowerHoldScope {
+public:
+    explicit PowerHoldScope(pwr_hold_t src) : src_(src) { power_hold(src_, true); }
+    ~PowerHoldScope() { power_hold(src_, false); }
+
+    PowerHoldScope(const PowerHoldScope &) = delete;
+    PowerHoldScope &operator=(const PowerHoldScope &) = delete;
+
+private:
+    pwr_hold_t src_;
+};
+#endif
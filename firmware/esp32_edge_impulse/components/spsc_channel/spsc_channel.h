@@ -0,0 +1,226 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+// ── 單一生產者 / 單一消費者訊息通道 ──────────────────────────────────────────
+// 跨核心的 Task 交接（音訊 → 網路、網路 → 動作 worker）共用的無鎖 ring：
+//   生產者只寫 head_、消費者只寫 tail_，兩者以 acquire / release 交接 slot，不進 critical section、
+//   不經 FreeRTOS queue 的複製與排程點。head_ / tail_ 與各自的統計分放不同 cache line，
+//   兩個核心（或主機上的兩條執行緒）不會為同一條 line 來回搶寫。
+//   消費者可以 set_consumer() 登記自己：pop_wait() 沒有資料時以 Task notification 睡眠，
+//   生產者只在消費者確實在等待時才呼叫 xTaskNotifyGive（忙碌時每次 push 不必進核心）。
+//   消費者 Task 的預設 notification 只能給一個通道使用；殘留的通知讓 pop_wait 提早回傳 false，
+//   呼叫端重新判斷即可（同 ui_pop_state）。
+// 每個通道記錄深度與延遲（push 到 pop 的時間），spsc_channel_register() 登記後
+// perf console 的 "channels" 指令列印。多個生產者（或多個消費者）時不可使用。
+
+#ifndef SPSC_CACHE_LINE
+#if defined(CONFIG_ESP32S3_DATA_CACHE_LINE_SIZE)
+#define SPSC_CACHE_LINE CONFIG_ESP32S3_DATA_CACHE_LINE_SIZE
+#elif defined(ESP_PLATFORM)
+#define SPSC_CACHE_LINE 32
+#else
+#define SPSC_CACHE_LINE 64
+#endif
+#endif
+
+#define SPSC_REGISTRY_MAX 8
+
+struct SpscChannelStats {
+    uint32_t pushed;           // 開機以來
+    uint32_t popped;
+    uint32_t dropped;          // 通道已滿而被拒絕的 push
+    uint32_t depth;            // 目前
+    uint32_t depth_max;        // 以下為本區間（take_stats 取出後歸零）
+    uint32_t latency_avg_us;   // push 到 pop
+    uint32_t latency_max_us;
+};
+
+// 與 slot 型別無關的索引、喚醒與統計
+class SpscChannelCore {
+public:
+    /** 消費者 Task（nullptr = 不通知，消費者自行輪詢）；可由消費者在自己的 Task 內呼叫 */
+    void set_consumer(TaskHandle_t task) { consumer_.store(task, std::memory_order_release); }
+
+    uint32_t depth() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+    bool empty() const { return depth() == 0; }
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    /**
+     * 取出統計；區間欄位（深度 / 延遲的峰值與平均）取出後歸零。
+     * 同一時間只有一個讀取端（console），與生產 / 消費端並行時最多少算一筆峰值。
+     */
+    SpscChannelStats take_stats()
+    {
+        SpscChannelStats s;
+        s.pushed    = head_.load(std::memory_order_relaxed);
+        s.popped    = tail_.load(std::memory_order_relaxed);
+        s.dropped   = dropped_.load(std::memory_order_relaxed);
+        s.depth     = s.pushed - s.popped;
+        s.depth_max = depth_max_.exchange(0, std::memory_order_relaxed);
+        uint32_t n   = lat_count_.exchange(0, std::memory_order_relaxed);
+        uint32_t sum = lat_sum_us_.exchange(0, std::memory_order_relaxed);
+        s.latency_avg_us = n ? sum / n : 0;
+        s.latency_max_us = lat_max_us_.exchange(0, std::memory_order_relaxed);
+        return s;
+    }
+
+protected:
+    SpscChannelCore() : head_(0), dropped_(0), depth_max_(0), consumer_(nullptr),
+                        tail_(0), waiting_(false), lat_sum_us_(0), lat_count_(0), lat_max_us_(0) {}
+
+    static uint32_t now_us_() { return (uint32_t)esp_timer_get_time(); }   // 差值不受 32-bit 回繞影響
+
+    /* 生產者：slot 已寫入，發布並視需要喚醒 */
+    void publish_(uint32_t head)
+    {
+        head_.store(head + 1, std::memory_order_release);
+        uint32_t d = head + 1 - tail_.load(std::memory_order_relaxed);
+        if (d > depth_max_.load(std::memory_order_relaxed)) depth_max_.store(d, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);   // head_ 寫入先於讀取 waiting_（與 pop_wait 成對）
+        TaskHandle_t task = consumer_.load(std::memory_order_acquire);
+        if (task && waiting_.load(std::memory_order_relaxed) &&
+            waiting_.exchange(false, std::memory_order_acq_rel)) {
+            xTaskNotifyGive(task);
+        }
+    }
+
+    /* 消費者：slot 已讀出，記錄延遲並歸還 */
+    void release_(uint32_t tail, uint32_t stamp_us)
+    {
+        tail_.store(tail + 1, std::memory_order_release);
+        uint32_t lat = now_us_() - stamp_us;
+        lat_sum_us_.fetch_add(lat, std::memory_order_relaxed);
+        lat_count_.fetch_add(1, std::memory_order_relaxed);
+        if (lat > lat_max_us_.load(std::memory_order_relaxed)) lat_max_us_.store(lat, std::memory_order_relaxed);
+    }
+
+    /* 消費者：宣告即將睡眠；回傳 false = 宣告後發現已有資料，不必睡 */
+    bool arm_wait_()
+    {
+        waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);   // waiting_ 寫入先於重新讀取 head_
+        if (head_.load(std::memory_order_acquire) != tail_.load(std::memory_order_relaxed)) {
+            waiting_.store(false, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // 生產者寫入的欄位
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> head_;   // 下一個寫入位置（= 累計 push）
+    std::atomic<uint32_t>     dropped_;
+    std::atomic<uint32_t>     depth_max_;
+    std::atomic<TaskHandle_t> consumer_;
+
+    // 消費者寫入的欄位
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> tail_;   // 下一個讀取位置（= 累計 pop）
+    std::atomic<bool>         waiting_;
+    std::atomic<uint32_t>     lat_sum_us_;
+    std::atomic<uint32_t>     lat_count_;
+    std::atomic<uint32_t>     lat_max_us_;
+};
+
+// 不小於 n 的 2 的冪次
+constexpr uint32_t spsc_slot_count(uint32_t n)
+{
+    uint32_t s = 1;
+    while (s < n) s <<= 1;
+    return s;
+}
+
+/**
+ * 容量 N 的通道（slot 數取 N 以上的 2 的冪次，深度仍以 N 為上限）。
+ * T 以值複製，須可 memcpy。
+ */
+template <typename T, size_t N>
+class SpscChannel : public SpscChannelCore {
+    static_assert(N >= 1, "SpscChannel needs at least one slot");
+    static_assert(std::is_trivially_copyable<T>::value, "SpscChannel payload must be trivially copyable");
+
+public:
+    static constexpr uint32_t CAPACITY = (uint32_t)N;
+
+    /** 生產者：排入一筆（不阻塞）；false = 已滿，計入 dropped */
+    bool push(const T &value)
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= CAPACITY) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        Slot &s    = slots_[head & MASK];
+        s.value    = value;
+        s.stamp_us = now_us_();
+        publish_(head);
+        return true;
+    }
+
+    /** 消費者：取出最舊的一筆；false = 通道為空 */
+    bool pop(T *out)
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) return false;
+        const Slot &s = slots_[tail & MASK];
+        *out = s.value;
+        release_(tail, s.stamp_us);
+        return true;
+    }
+
+    /**
+     * 消費者：取出一筆，通道為空時最多等待 ticks（需先 set_consumer）。
+     * @return false = 逾時（或殘留的喚醒，重新判斷即可）
+     */
+    bool pop_wait(T *out, TickType_t ticks)
+    {
+        if (pop(out)) return true;
+        if (ticks == 0 || !arm_wait_()) return pop(out);
+        ulTaskNotifyTake(pdTRUE, ticks);
+        waiting_.store(false, std::memory_order_relaxed);
+        return pop(out);
+    }
+
+private:
+    static constexpr uint32_t SLOTS = spsc_slot_count(CAPACITY);
+    static constexpr uint32_t MASK  = SLOTS - 1;
+
+    struct Slot {
+        T        value;
+        uint32_t stamp_us;   // push 的時間（延遲統計）
+    };
+
+    alignas(SPSC_CACHE_LINE) Slot slots_[SLOTS];
+};
+
+// ── 通道登記（console 列印用） ────────────────────────────────────────────────
+
+struct SpscChannelEntry {
+    const char      *name;
+    SpscChannelCore *channel;
+};
+
+inline SpscChannelEntry      g_spsc_channels[SPSC_REGISTRY_MAX];
+inline std::atomic<int>      g_spsc_channel_count{0};
+
+/** 登記一個長期存在的通道（初始化時呼叫一次）；false = 登記表已滿 */
+inline bool spsc_channel_register(const char *name, SpscChannelCore *channel)
+{
+    int i = g_spsc_channel_count.fetch_add(1, std::memory_order_relaxed);
+    if (i >= SPSC_REGISTRY_MAX) {
+        g_spsc_channel_count.store(SPSC_REGISTRY_MAX, std::memory_order_relaxed);
+        return false;
+    }
+    g_spsc_channels[i] = { name, channel };
+    return true;
+}
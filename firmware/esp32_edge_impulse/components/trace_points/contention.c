@@ -0,0 +1,220 @@
+#include "contention.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// ── 統計表 ───────────────────────────────────────────────────────────────────
+
+static void stat_add(contention_stat_t *s, uint32_t us) {
+    s->count++;
+    s->total_us += us;
+    if (us > s->max_us) s->max_us = us;
+}
+
+void contention_map_hold(contention_map_t *m, contention_res_t res, uint8_t task, uint32_t us) {
+    if (res >= CONTENTION_RES_COUNT || task >= CONTENTION_TASKS) return;
+    stat_add(&m->hold[res][task], us);
+}
+
+void contention_map_block(contention_map_t *m, contention_res_t res, uint8_t holder, uint8_t waiter,
+                          uint32_t us, bool inverted) {
+    if (res >= CONTENTION_RES_COUNT || holder >= CONTENTION_TASKS || waiter > CONTENTION_ALL) return;
+    contention_stat_t *s = &m->blocked[res][holder][waiter];
+    stat_add(s, us);
+    if (inverted) s->inversions++;
+}
+
+// 表很小（3 × 8 × 9）：每次插入排序取前 max 條
+int contention_map_top(const contention_map_t *m, contention_edge_t *out, int max) {
+    int n = 0;
+    for (int r = 0; r < CONTENTION_RES_COUNT; r++) {
+        for (int h = 0; h < CONTENTION_TASKS; h++) {
+            for (int w = 0; w <= CONTENTION_ALL; w++) {
+                const contention_stat_t *s = &m->blocked[r][h][w];
+                if (!s->count) continue;
+                int i = n < max ? n++ : max;
+                while (i > 0 && out[i - 1].stat.total_us < s->total_us) {
+                    if (i < max) out[i] = out[i - 1];
+                    i--;
+                }
+                if (i < max) {
+                    contention_edge_t e = { (uint8_t)r, (uint8_t)h, (uint8_t)w, *s };
+                    out[i] = e;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+const char *contention_res_name(contention_res_t res) {
+    switch (res) {
+        case CONTENTION_HEAP:  return "heap";
+        case CONTENTION_FLASH: return "flash";
+        case CONTENTION_SPI:   return "spi";
+        default:               return "?";
+    }
+}
+
+#if CONFIG_ESP_MIAO_CONTENTION_MAP
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static contention_map_t s_total;      // 開機以來（console）
+static contention_map_t s_interval;   // 上次 contention_report_json 以來（health）
+
+static TaskHandle_t s_tasks[CONTENTION_TASKS - 1];
+static char         s_names[CONTENTION_TASKS][configMAX_TASK_NAME_LEN] = { [CONTENTION_TASKS - 1] = "other" };
+static volatile int s_task_count = 0;
+
+static uint8_t s_owner[CONTENTION_RES_COUNT]      = { CONTENTION_NONE, CONTENTION_NONE, CONTENTION_NONE };
+static uint8_t s_owner_prio[CONTENTION_RES_COUNT] = { 0 };
+
+// 目前 Task 的欄位；第一次出現時登記（名稱在登記時複製，Task 刪除後仍可列印）
+static uint8_t task_slot(void) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    int n = s_task_count;
+    for (int i = 0; i < n; i++) {
+        if (s_tasks[i] == self) return (uint8_t)i;
+    }
+    uint8_t slot = CONTENTION_TASKS - 1;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = n; i < s_task_count; i++) {
+        if (s_tasks[i] == self) slot = (uint8_t)i;   // 鎖外檢查之後才登記的
+    }
+    if (slot == CONTENTION_TASKS - 1 && s_task_count < CONTENTION_TASKS - 1) {
+        slot = (uint8_t)s_task_count;
+        s_tasks[slot] = self;
+        strncpy(s_names[slot], pcTaskGetName(self), configMAX_TASK_NAME_LEN - 1);
+        s_task_count = slot + 1;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return slot;
+}
+
+static const char *slot_name(uint8_t slot) {
+    return slot == CONTENTION_ALL ? "*" : s_names[slot];
+}
+
+static uint32_t elapsed_us(int64_t from, int64_t to) {
+    int64_t d = to - from;
+    return d <= 0 ? 0 : d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+}
+
+static void record_block(contention_res_t res, uint8_t holder, uint8_t waiter, uint32_t us, bool inverted) {
+    portENTER_CRITICAL(&s_lock);
+    contention_map_block(&s_total, res, holder, waiter, us, inverted);
+    contention_map_block(&s_interval, res, holder, waiter, us, inverted);
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static contention_token_t begin(contention_res_t res, bool occupy) {
+    contention_token_t tok = { esp_timer_get_time(), 0, CONTENTION_NONE, 0 };
+    uint8_t self = task_slot();
+    uint8_t prio = (uint8_t)uxTaskPriorityGet(NULL);
+    portENTER_CRITICAL(&s_lock);
+    tok.holder = s_owner[res];
+    tok.holder_prio = s_owner_prio[res];
+    if (occupy && tok.holder == CONTENTION_NONE) {
+        s_owner[res] = self;
+        s_owner_prio[res] = prio;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (occupy) tok.acquired_us = tok.t0_us;
+    return tok;
+}
+
+contention_token_t contention_wait(contention_res_t res) {
+    return begin(res, false);
+}
+
+contention_token_t contention_enter(contention_res_t res) {
+    return begin(res, true);
+}
+
+void contention_acquired(contention_res_t res, contention_token_t *tok) {
+    tok->acquired_us = esp_timer_get_time();
+    uint8_t self = task_slot();
+    uint8_t prio = (uint8_t)uxTaskPriorityGet(NULL);
+    uint32_t waited = elapsed_us(tok->t0_us, tok->acquired_us);
+    if (waited >= CONTENTION_MIN_WAIT_US && tok->holder != CONTENTION_NONE && tok->holder != self) {
+        record_block(res, tok->holder, self, waited, prio > tok->holder_prio);
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_owner[res] = self;
+    s_owner_prio[res] = prio;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void contention_exit(contention_res_t res, const contention_token_t *tok) {
+    if (!tok->acquired_us) return;   // 沒有取得（逾時）
+    int64_t now = esp_timer_get_time();
+    uint8_t self = task_slot();
+    uint32_t held = elapsed_us(tok->acquired_us, now);
+    bool call = res != CONTENTION_SPI;
+    portENTER_CRITICAL(&s_lock);
+    contention_map_hold(&s_total, res, self, held);
+    contention_map_hold(&s_interval, res, self, held);
+    if (s_owner[res] == self) s_owner[res] = CONTENTION_NONE;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (res == CONTENTION_FLASH) {
+        record_block(res, self, CONTENTION_ALL, held, false);
+    } else if (call && held >= CONTENTION_MIN_WAIT_US && tok->holder != CONTENTION_NONE && tok->holder != self) {
+        // heap：看不到鎖本身，進入時有人在裡面就把整段呼叫算作等待
+        record_block(res, tok->holder, self, held, (uint8_t)uxTaskPriorityGet(NULL) > tok->holder_prio);
+    }
+}
+
+int contention_report_json(char *buf, size_t cap) {
+    contention_edge_t top[CONTENTION_REPORT_EDGES];
+    portENTER_CRITICAL(&s_lock);
+    int n = contention_map_top(&s_interval, top, CONTENTION_REPORT_EDGES);
+    memset(&s_interval, 0, sizeof(s_interval));
+    portEXIT_CRITICAL(&s_lock);
+
+    int len = snprintf(buf, cap, "[");
+    for (int i = 0; i < n && len < (int)cap; i++) {
+        const contention_edge_t *e = &top[i];
+        len += snprintf(buf + len, cap - len, "%s[\"%s\",\"%s\",\"%s\",%lu,%llu,%lu,%lu]", i ? "," : "",
+                        contention_res_name((contention_res_t)e->res), slot_name(e->holder), slot_name(e->waiter),
+                        (unsigned long)e->stat.count, (unsigned long long)e->stat.total_us,
+                        (unsigned long)e->stat.max_us, (unsigned long)e->stat.inversions);
+    }
+    if (len < (int)cap) len += snprintf(buf + len, cap - len, "]");
+    return len;
+}
+
+void contention_print(void) {
+    static contention_map_t snap;   // 5.6 KB，不放在 console Task 的 stack 上
+    portENTER_CRITICAL(&s_lock);
+    snap = s_total;
+    portEXIT_CRITICAL(&s_lock);
+
+    printf("%-6s %-16s %8s %12s %8s\n", "res", "holder", "count", "total_us", "max_us");
+    for (int r = 0; r < CONTENTION_RES_COUNT; r++) {
+        for (int t = 0; t < CONTENTION_TASKS; t++) {
+            const contention_stat_t *s = &snap.hold[r][t];
+            if (!s->count) continue;
+            printf("%-6s %-16s %8lu %12llu %8lu\n", contention_res_name((contention_res_t)r), slot_name(t),
+                   (unsigned long)s->count, (unsigned long long)s->total_us, (unsigned long)s->max_us);
+        }
+    }
+
+    contention_edge_t edges[CONTENTION_RES_COUNT * CONTENTION_TASKS];
+    int n = contention_map_top(&snap, edges, sizeof(edges) / sizeof(edges[0]));
+    printf("\n%-6s %-16s %-16s %8s %12s %8s %5s\n", "res", "holder", "blocked", "count", "total_us", "max_us",
+           "inv");
+    for (int i = 0; i < n; i++) {
+        const contention_edge_t *e = &edges[i];
+        printf("%-6s %-16s %-16s %8lu %12llu %8lu %5lu\n", contention_res_name((contention_res_t)e->res),
+               slot_name(e->holder), slot_name(e->waiter), (unsigned long)e->stat.count,
+               (unsigned long long)e->stat.total_us, (unsigned long)e->stat.max_us,
+               (unsigned long)e->stat.inversions);
+    }
+}
+
+#endif // CONFIG_ESP_MIAO_CONTENTION_MAP
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ── 共用資源爭用表（CONFIG_ESP_MIAO_CONTENTION_MAP） ──────────────────────────
+// 推論、WebSocket、顯示與 Arduino Task 在兩個核心上爭用的資源，經這裡的包裝層記錄「誰擋住誰、多久」：
+//   CONTENTION_HEAP   熱路徑上的 heap 配置：heap 鎖是自旋鎖，看不到持有者；進入時另一個包裝呼叫
+//                     仍在進行，整段呼叫時間記為被該 Task 擋住
+//   CONTENTION_FLASH  NVS / 分區寫入：flash cache 關閉期間另一核心從 flash 執行的 Task 全部停住，
+//                     整段時間記為擋住 "*"
+//   CONTENTION_SPI    共用的顯示 SPI 匯流排（TFT_eSPI shareBus 互斥鎖）：等待時間記給開始等待時的持有者
+// 等待者優先權高於持有者（進入時的優先權）計一次 inversion：SPI 互斥鎖有優先權繼承，等待會被縮短；
+// heap 自旋鎖與 cache 關閉沒有，這類邊才是要先處理的。
+// health 報告附上本區間最長的 CONTENTION_REPORT_EDGES 條邊（contention_report_json，取出後歸零），
+// perf console 的 "contention" 指令列印開機以來的完整表格。關閉時包裝層不動作。
+#define CONTENTION_TASKS        8     // 登記的 Task 數，最後一格為「其他」（超過時併入）
+#define CONTENTION_ALL          CONTENTION_TASKS   // waiter 欄：所有 Task（flash cache 關閉）
+#define CONTENTION_NONE         0xFF
+#define CONTENTION_MIN_WAIT_US  20    // 少於此的等待視為沒有爭用
+#define CONTENTION_REPORT_EDGES 5
+
+typedef enum {
+    CONTENTION_HEAP = 0,
+    CONTENTION_FLASH,
+    CONTENTION_SPI,
+    CONTENTION_RES_COUNT
+} contention_res_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t inversions;   // 等待者優先權高於持有者的次數（只有 blocked 使用）
+    uint32_t max_us;
+    uint64_t total_us;
+} contention_stat_t;
+
+typedef struct {
+    contention_stat_t hold[CONTENTION_RES_COUNT][CONTENTION_TASKS];
+    contention_stat_t blocked[CONTENTION_RES_COUNT][CONTENTION_TASKS][CONTENTION_TASKS + 1];   // [holder][waiter]
+} contention_map_t;
+
+typedef struct {
+    uint8_t           res;      // contention_res_t
+    uint8_t           holder;
+    uint8_t           waiter;   // CONTENTION_ALL = 所有 Task
+    contention_stat_t stat;
+} contention_edge_t;
+
+// ── 統計表本身（不加鎖，呼叫端負責互斥；主機測試直接使用） ──
+void contention_map_hold(contention_map_t *m, contention_res_t res, uint8_t task, uint32_t us);
+void contention_map_block(contention_map_t *m, contention_res_t res, uint8_t holder, uint8_t waiter,
+                          uint32_t us, bool inverted);
+// 依被擋總時間由長到短取出最多 max 條邊，回傳條數
+int contention_map_top(const contention_map_t *m, contention_edge_t *out, int max);
+const char *contention_res_name(contention_res_t res);
+
+// 包裝層在兩次呼叫之間保存的狀態
+typedef struct {
+    int64_t t0_us;
+    int64_t acquired_us;    // 0 = 尚未取得
+    uint8_t holder;         // 開始時的持有者（CONTENTION_NONE = 無）
+    uint8_t holder_prio;
+} contention_token_t;
+
+#if CONFIG_ESP_MIAO_CONTENTION_MAP
+
+// 鎖型資源（SPI）：開始等待 → 取得 → contention_exit
+contention_token_t contention_wait(contention_res_t res);
+void contention_acquired(contention_res_t res, contention_token_t *tok);
+// 呼叫型資源（heap / flash）：進入即佔用，contention_exit 時結算
+contention_token_t contention_enter(contention_res_t res);
+void contention_exit(contention_res_t res, const contention_token_t *tok);
+
+#define CONTENTION_JSON_BYTES (CONTENTION_REPORT_EDGES * 80 + 2)   // contention_report_json 的上限
+
+// 本區間最長的邊，JSON 陣列 [["spi","display","sdcard",count,total_us,max_us,inversions],...]；
+// 取出後歸零。回傳寫入長度（同 snprintf，≥ cap 表示被截斷）
+int contention_report_json(char *buf, size_t cap);
+// 開機以來的持有與阻擋表格（console）
+void contention_print(void);
+
+#else
+
+#define CONTENTION_JSON_BYTES 0
+
+static inline contention_token_t contention_wait(contention_res_t res) {
+    (void)res;
+    contention_token_t tok = { 0, 0, CONTENTION_NONE, 0 };
+    return tok;
+}
+static inline void contention_acquired(contention_res_t res, contention_token_t *tok) {
+    (void)res;
+    (void)tok;
+}
+static inline contention_token_t contention_enter(contention_res_t res) {
+    return contention_wait(res);
+}
+static inline void contention_exit(contention_res_t res, const contention_token_t *tok) {
+    (void)res;
+    (void)tok;
+}
+static inline int contention_report_json(char *buf, size_t cap) {
+    (void)buf;
+    (void)cap;
+    return 0;
+}
+static inline void contention_print(void) {}
+
+#endif // CONFIG_ESP_MIAO_CONTENTION_MAP
+
+#ifdef __cplusplus
+}
+
+// 區塊內佔用一個呼叫型資源（離開時結算）
+class ContentionScope {
+public:
+    explicit ContentionScope(contention_res_t res) : res_(res), tok_(contention_enter(res)) {}
+    ~ContentionScope() { contention_exit(res_, &tok_); }
+
+    ContentionScope(const ContentionScope &) = delete;
+    ContentionScope &operator=(const ContentionScope &) = delete;
+
+private:
+    contention_res_t   res_;
+    contention_token_t tok_;
+};
+#endif
@@ -0,0 +1,91 @@
+#include "flight_recorder.h"
+
+#if CONFIG_ESP_MIAO_FLIGHT_RECORDER
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+static const char *TAG = "Flight";
+
+#define FLIGHT_MAGIC 0x464C5431u   // "FLT1"；版面改變時遞增，舊紀錄即視為無效
+
+RTC_NOINIT_ATTR flight_log_t flight_log;
+uint32_t flight_seq = 0;
+
+static flight_log_t *prev_log = NULL;
+static int           prev_events = 0;
+static const char   *boot_reason = "unknown";
+
+static const char *reset_reason_name(esp_reset_reason_t r) {
+    switch (r) {
+        case ESP_RST_POWERON:   return "poweron";
+        case ESP_RST_EXT:       return "ext";
+        case ESP_RST_SW:        return "sw";
+        case ESP_RST_PANIC:     return "panic";
+        case ESP_RST_INT_WDT:   return "int_wdt";
+        case ESP_RST_TASK_WDT:  return "task_wdt";
+        case ESP_RST_WDT:       return "wdt";
+        case ESP_RST_DEEPSLEEP: return "deepsleep";
+        case ESP_RST_BROWNOUT:  return "brownout";
+        case ESP_RST_SDIO:      return "sdio";
+        default:                return "unknown";
+    }
+}
+
+static int by_seq(const void *a, const void *b) {
+    uint32_t sa = ((const flight_event_t *)a)->seq;
+    uint32_t sb = ((const flight_event_t *)b)->seq;
+    return sa < sb ? -1 : sa > sb;
+}
+
+void flight_recorder_init(void) {
+    esp_reset_reason_t reason = esp_reset_reason();
+    boot_reason = reset_reason_name(reason);
+
+    // 上電時 RTC memory 內容隨機，magic 恰好相符也不採用
+    if (reason != ESP_RST_POWERON && flight_log.magic == FLIGHT_MAGIC) {
+        prev_log = (flight_log_t *)malloc(sizeof(flight_log_t));
+        if (prev_log) {
+            memcpy(prev_log, &flight_log, sizeof(flight_log_t));
+            int n = 0;
+            for (int i = 0; i < FLIGHT_EVENTS; i++) {
+                const flight_event_t *e = &prev_log->events[i];
+                if (e->seq != 0 && e->id != 0) prev_log->events[n++] = *e;   // 重開機當下寫到一半的格子 seq 仍為 0
+            }
+            qsort(prev_log->events, n, sizeof(flight_event_t), by_seq);
+            prev_events = n;
+            ESP_LOGW(TAG, "Reset (%s): kept %d events, %lu health samples from the previous boot", boot_reason, n,
+                     (unsigned long)prev_log->health_count);
+        }
+    }
+
+    memset(&flight_log, 0, sizeof(flight_log));
+    flight_log.magic = FLIGHT_MAGIC;
+}
+
+void flight_record_health(const flight_health_t *sample) {
+    uint32_t i = flight_log.health_count;
+    flight_log.health[i % FLIGHT_HEALTH] = *sample;
+    flight_log.health_count = i + 1;   // 只由 health Task 寫入
+}
+
+void flight_record_stage(int stage, uint32_t us) {
+    if (stage >= 0 && stage < FLIGHT_STAGES) flight_log.stage_us[stage] = us;
+}
+
+const flight_log_t *flight_recorder_previous(const char **reset_reason, int *n_events) {
+    if (reset_reason) *reset_reason = boot_reason;
+    if (n_events) *n_events = prev_events;
+    return prev_log;
+}
+
+void flight_recorder_release(void) {
+    free(prev_log);
+    prev_log = NULL;
+    prev_events = 0;
+}
+
+#endif // CONFIG_ESP_MIAO_FLIGHT_RECORDER
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ── 飛行記錄器（CONFIG_ESP_MIAO_FLIGHT_RECORDER） ───────────────────────────────
+// RTC slow memory（RTC_NOINIT，看門狗 / panic / brownout 重開機後仍保留）中的環形紀錄：
+//   events  ：最近 FLIGHT_EVENTS 個追蹤點（trace_points.h 的 TRACE_POINT 同時寫入）
+//   health  ：最近 FLIGHT_HEALTH 份 health 取樣（heap / 最低 stack 高水位）
+//   stage_us：推論管線各階段最後一次的耗時（StageProfiler::record）
+// 開機時 flight_recorder_init() 把上一次開機的紀錄複製到 heap 後清空 RTC 紀錄；
+// 連上 Server 後由 health Task 以 flight_record 訊息送出，用來判斷重開機前的效能異常。
+#define FLIGHT_EVENTS 256
+#define FLIGHT_HEALTH 16
+#define FLIGHT_STAGES 8      // ≥ ProfileStage 數
+
+typedef struct {
+    uint32_t seq;            // 本次開機的事件序號（從 1 起；0 = 空格）
+    uint32_t t_us;           // 開機後時間（esp_timer，低 32 位元）
+    uint16_t arg;
+    uint8_t  id;             // trace_point_t
+    uint8_t  core;
+} flight_event_t;
+
+typedef struct {
+    uint32_t uptime_s;
+    uint32_t heap_free;      // internal heap
+    uint32_t heap_min;       // 開機以來最低
+    uint32_t heap_largest;
+    uint16_t stack_min;      // 所有 Task 中最低的 stack 剩餘（bytes）
+    char     stack_task[10]; // 該 Task 名稱（截斷）
+} flight_health_t;
+
+typedef struct {
+    uint32_t        magic;
+    uint32_t        health_count;                // 累計筆數（環形索引 = count % FLIGHT_HEALTH）
+    uint32_t        stage_us[FLIGHT_STAGES];
+    flight_health_t health[FLIGHT_HEALTH];
+    flight_event_t  events[FLIGHT_EVENTS];
+} flight_log_t;
+
+#if CONFIG_ESP_MIAO_FLIGHT_RECORDER
+
+#include "esp_cpu.h"
+#include "esp_timer.h"
+
+extern flight_log_t flight_log;
+extern uint32_t     flight_seq;    // DRAM：RTC memory 不支援 atomic 指令
+
+// 任何 Task / ISR 皆可呼叫（由 trace_emit 呼叫）
+static inline __attribute__((always_inline)) void flight_record_event(uint8_t id, uint16_t arg) {
+    uint32_t seq = __atomic_add_fetch(&flight_seq, 1, __ATOMIC_RELAXED);
+    flight_event_t *e = &flight_log.events[seq % FLIGHT_EVENTS];
+    e->seq = 0;
+    e->t_us = (uint32_t)esp_timer_get_time();
+    e->arg = arg;
+    e->id = id;
+    e->core = (uint8_t)esp_cpu_get_core_id();
+    __atomic_store_n(&e->seq, seq, __ATOMIC_RELEASE);
+}
+
+// 最早在 app_main 開頭呼叫：保存上一次開機的紀錄（上電重開時不保存），並清空 RTC 紀錄
+void flight_recorder_init(void);
+void flight_record_health(const flight_health_t *sample);
+void flight_record_stage(int stage, uint32_t us);
+// 上一次開機的紀錄（事件依序號排序，僅有效筆數）；無則回傳 NULL。reset_reason 為本次開機的原因
+const flight_log_t *flight_recorder_previous(const char **reset_reason, int *n_events);
+// 已送出：釋放上一次開機紀錄的 heap 複本
+void flight_recorder_release(void);
+
+#else
+
+static inline void flight_recorder_init(void) {}
+static inline void flight_record_health(const flight_health_t *sample) { (void)sample; }
+static inline void flight_record_stage(int stage, uint32_t us) {
+    (void)stage;
+    (void)us;
+}
+static inline const flight_log_t *flight_recorder_previous(const char **reset_reason, int *n_events) {
+    (void)reset_reason;
+    (void)n_events;
+    return NULL;
+}
+static inline void flight_recorder_release(void) {}
+
+#endif // CONFIG_ESP_MIAO_FLIGHT_RECORDER
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,131 @@
+#include "trace_points.h"
+
+#if CONFIG_ESP_MIAO_TRACE_POINTS
+
+#include <string.h>
+#include "esp_app_trace.h"
+#include "esp_ipc.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "Trace";
+
+#if CONFIG_APPTRACE_DEST_JTAG
+#define TRACE_DEST ESP_APPTRACE_DEST_JTAG
+#else
+#define TRACE_DEST ESP_APPTRACE_DEST_UART
+#endif
+
+#define TRACE_TASK_STACK   3072
+#define TRACE_DRAIN_MS     50                // 每核 512 筆，足夠吸收 I2S + 推論 + 串流的尖峰
+#define TRACE_BATCH_EVENTS 64
+#define TRACE_WRITE_TMO_US 2000              // 主機讀得慢時寧可捨棄，不拖住 CORE_NET
+
+trace_ring_t trace_rings[SOC_CPU_CORES_NUM];
+
+// 送往主機的批次：header 帶該核心的同步點（esp_timer µs 與同一瞬間的 CCOUNT），
+// 主機以相鄰兩個同步點換算 cycle → µs，DFS 改變時脈也不會累積誤差
+typedef struct __attribute__((packed)) {
+    char     magic[4];        // "MTRC"
+    uint8_t  version;         // 1
+    uint8_t  core;
+    uint16_t count;           // 後接 count 筆 trace_event_t
+    uint32_t dropped;         // 該核心累計捨棄筆數
+    uint32_t sync_cycles;
+    int64_t  sync_us;
+    uint32_t ticks_per_us;    // 取同步點時的 CPU 時脈（只在第一個批次使用）
+} trace_batch_t;
+_Static_assert(sizeof(trace_batch_t) == 28, "trace_batch_t layout is shared with scripts/trace_view.py");
+
+static struct __attribute__((packed)) {
+    trace_batch_t hdr;
+    trace_event_t events[TRACE_BATCH_EVENTS];
+} trace_buf;
+
+static void trace_sync_here(void *arg) {
+    trace_batch_t *hdr = (trace_batch_t *)arg;
+    hdr->sync_cycles = esp_cpu_get_cycle_count();
+    hdr->sync_us = esp_timer_get_time();
+    hdr->ticks_per_us = esp_rom_get_cpu_ticks_per_us();
+}
+
+// 同步點須在目標核心上讀 CCOUNT（兩核的計數器互不相關）
+static void trace_sync(int core, trace_batch_t *hdr) {
+#if SOC_CPU_CORES_NUM > 1
+    if (core != esp_cpu_get_core_id()) {
+        esp_ipc_call_blocking(core, trace_sync_here, hdr);
+        return;
+    }
+#endif
+    trace_sync_here(hdr);
+}
+
+static void trace_send(int core, uint16_t n, bool connected) {
+    trace_ring_t *r = &trace_rings[core];
+    if (n == 0) return;
+    trace_buf.hdr.count = n;
+    trace_buf.hdr.dropped = r->dropped;
+    if (!connected || esp_apptrace_write(TRACE_DEST, &trace_buf, sizeof(trace_buf.hdr) + n * sizeof(trace_event_t),
+                                         TRACE_WRITE_TMO_US) != ESP_OK) {
+        r->dropped += n;
+    }
+}
+
+static void trace_drain(int core, bool connected) {
+    trace_ring_t *r = &trace_rings[core];
+    memcpy(trace_buf.hdr.magic, "MTRC", 4);
+    trace_buf.hdr.version = 1;
+    trace_buf.hdr.core = (uint8_t)core;
+    trace_sync(core, &trace_buf.hdr);
+
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    if (head - r->tail > TRACE_RING_EVENTS) {
+        r->dropped += head - r->tail - TRACE_RING_EVENTS;
+        r->tail = head - TRACE_RING_EVENTS;
+    }
+
+    uint16_t n = 0;
+    while (r->tail != head) {
+        const trace_event_t *e = &r->events[r->tail & (TRACE_RING_EVENTS - 1)];
+        uint8_t lap = __atomic_load_n(&e->lap, __ATOMIC_ACQUIRE);
+        if (lap == 0 || lap == trace_lap(r->tail - TRACE_RING_EVENTS)) break;   // 生產者尚未寫完，下一輪再送
+        trace_event_t ev = *e;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (lap != trace_lap(r->tail) || __atomic_load_n(&e->lap, __ATOMIC_RELAXED) != lap) {
+            r->dropped++;   // 讀取前後被下一圈覆寫
+        } else {
+            trace_buf.events[n++] = ev;
+        }
+        r->tail++;
+        if (n == TRACE_BATCH_EVENTS) {
+            trace_send(core, n, connected);
+            n = 0;
+        }
+    }
+    trace_send(core, n, connected);
+}
+
+static void trace_task(void *arg) {
+    (void)arg;
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(TRACE_DRAIN_MS));
+        bool connected = esp_apptrace_host_is_connected(TRACE_DEST);
+        for (int core = 0; core < SOC_CPU_CORES_NUM; core++) trace_drain(core, connected);
+        if (connected) esp_apptrace_flush(TRACE_DEST, TRACE_WRITE_TMO_US);
+    }
+}
+
+bool trace_points_start(int priority, int core) {
+    if (xTaskCreatePinnedToCore(trace_task, "trace", TRACE_TASK_STACK, NULL, priority, NULL, core) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start trace task");
+        return false;
+    }
+    ESP_LOGI(TAG, "Trace points on, %u events per core, draining to %s", (unsigned)TRACE_RING_EVENTS,
+             TRACE_DEST == ESP_APPTRACE_DEST_JTAG ? "JTAG" : "UART");
+    return true;
+}
+
+#endif // CONFIG_ESP_MIAO_TRACE_POINTS
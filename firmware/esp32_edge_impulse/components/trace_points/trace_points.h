@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "flight_recorder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ── 追蹤點（CONFIG_ESP_MIAO_TRACE_POINTS） ─────────────────────────────────────
+// 熱路徑上的 TRACE_POINT(id, arg) 寫一筆 8 bytes 事件（CPU cycle 時間戳）到所在核心的環形緩衝，
+// 不取鎖、不呼叫 ESP_LOG；低優先權的 trace Task 定期經 esp_app_trace（JTAG 或 UART）送到主機，
+// 由 scripts/trace_view.py 換算成時間軸。開啟 CONFIG_ESP_MIAO_FLIGHT_RECORDER 時同一事件另寫入
+// RTC memory 的飛行記錄（flight_recorder.h）。兩者皆未開啟時 TRACE_POINT 展開為空，連 arg 都不求值。
+//
+//   ID               發出位置                         arg
+//   TP_I2S_BLOCK     AudioCapture::push_block_        區塊樣本數（重取樣後）
+//   TP_VAD           推論 Task 每切片的 VAD 判定       1 = 語音 / 0 = 靜音
+//   TP_INFER_START   run_classifier 前                 —
+//   TP_INFER_END     run_classifier 後                 EI_IMPULSE_ERROR（0 = 成功）
+//   TP_WS_SEND       WebSocketClient::send_*           位元組數（上限 65535）
+//   TP_UI_FRAME      eye_ui push_frame                 變化矩形數
+// ID 只能往後新增（trace_view.py 以相同編號解碼）。
+typedef enum {
+    TP_I2S_BLOCK = 1,
+    TP_VAD,
+    TP_INFER_START,
+    TP_INFER_END,
+    TP_WS_SEND,
+    TP_UI_FRAME,
+    TP_COUNT
+} trace_point_t;
+
+typedef struct {
+    uint32_t cycles;   // 所在核心的 CCOUNT
+    uint16_t arg;
+    uint8_t  id;       // trace_point_t
+    uint8_t  lap;      // 0x80 | 圈數低 7 位元，最後寫入；drain 以此判斷事件已寫完
+} trace_event_t;
+
+#if CONFIG_ESP_MIAO_TRACE_POINTS
+
+#include "esp_cpu.h"
+#include "soc/soc_caps.h"
+
+#ifndef TRACE_RING_BITS
+#define TRACE_RING_BITS   9                      // 每核 512 筆（4 KB）
+#endif
+#define TRACE_RING_EVENTS (1u << TRACE_RING_BITS)
+
+typedef struct {
+    uint32_t      head;                          // 下一筆的序號（生產者 fetch_add）
+    uint32_t      tail;                          // 下一筆待送出的序號（只由 trace Task 存取）
+    uint32_t      dropped;                       // 送出前被覆寫或主機未連線而捨棄的筆數
+    trace_event_t events[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+extern trace_ring_t trace_rings[SOC_CPU_CORES_NUM];
+
+static inline uint8_t trace_lap(uint32_t seq) {
+    return (uint8_t)(0x80 | ((seq >> TRACE_RING_BITS) & 0x7F));
+}
+
+// 啟動 trace Task（app_trace 目的地由 sdkconfig 的 Application Level Tracing 設定決定）
+bool trace_points_start(int priority, int core);
+
+#else
+
+static inline bool trace_points_start(int priority, int core) {
+    (void)priority;
+    (void)core;
+    return false;
+}
+
+#endif // CONFIG_ESP_MIAO_TRACE_POINTS
+
+#if CONFIG_ESP_MIAO_TRACE_POINTS || CONFIG_ESP_MIAO_FLIGHT_RECORDER
+
+// 任何 Task / ISR 皆可呼叫：同核上的巢狀中斷以 fetch_add 各自取得序號，不會寫到同一格
+static inline __attribute__((always_inline)) void trace_emit(trace_point_t id, uint32_t arg) {
+    uint16_t arg16 = arg > 0xFFFF ? 0xFFFF : (uint16_t)arg;
+#if CONFIG_ESP_MIAO_TRACE_POINTS
+    trace_ring_t *r = &trace_rings[esp_cpu_get_core_id()];
+    uint32_t seq = __atomic_fetch_add(&r->head, 1, __ATOMIC_RELAXED);
+    trace_event_t *e = &r->events[seq & (TRACE_RING_EVENTS - 1)];
+    e->cycles = esp_cpu_get_cycle_count();
+    e->arg = arg16;
+    e->id = (uint8_t)id;
+    __atomic_store_n(&e->lap, trace_lap(seq), __ATOMIC_RELEASE);
+#endif
+#if CONFIG_ESP_MIAO_FLIGHT_RECORDER
+    flight_record_event((uint8_t)id, arg16);
+#endif
+}
+
+#define TRACE_POINT(id, arg) trace_emit((id), (uint32_t)(arg))
+
+#else
+
+#define TRACE_POINT(id, arg) ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,20 +1,236 @@
 #include "ui_state.h"
 
-static QueueHandle_t ui_queue = NULL;
+#include <stdatomic.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+// ── Event ring ───────────────────────────────────────────────────────────────
+// 多格 FIFO：連續發佈的狀態（WAKE→LISTENING→THINKING）依序保留，顯示端逐一播放。
+// 發佈端只在極短的 critical section 內改 ring，永不等待（推論 / 音訊 Task 可直接呼叫）。
+//
+// 合併規則：
+//   1. 與 ring 中最後一筆相同的狀態只更新時間戳，不另佔一格
+//   2. ring 滿時淘汰優先權最低（同優先權取最舊）的一筆；新事件比 ring 中全部都低則丟棄新事件
+
+#define UI_EVENT_SLOTS 8
+
+static ui_event_t ui_ring[UI_EVENT_SLOTS];
+static int ui_head = 0;    // 最舊一筆的索引
+static int ui_count = 0;
+static portMUX_TYPE ui_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t ui_signal = NULL;   // binary：ring 有新事件
+
+static int ui_priority(ui_state_t state) {
+    switch (state) {
+        case UI_ERROR:     return 5;
+        case UI_ACTION:    return 4;
+        case UI_WAKE:      return 3;
+        case UI_LISTENING:
+        case UI_THINKING:  return 2;
+        case UI_IDLE:      return 1;
+        default:           return 0;   // UI_SLEEPING
+    }
+}
+
+// 移除第 i 筆（相對 ui_head），後面的往前補；需在 ui_lock 內呼叫
+static void ui_ring_remove(int i) {
+    for (; i < ui_count - 1; i++) {
+        ui_ring[(ui_head + i) % UI_EVENT_SLOTS] = ui_ring[(ui_head + i + 1) % UI_EVENT_SLOTS];
+    }
+    ui_count--;
+}
 
 void ui_state_init(void) {
-    if (ui_queue) return;
-    ui_queue = xQueueCreate(1, sizeof(ui_event_t));
+    if (ui_signal) return;
+#if CONFIG_ESP_MIAO_STATIC_ALLOC
+    static StaticSemaphore_t ui_signal_buf;
+    ui_signal = xSemaphoreCreateBinaryStatic(&ui_signal_buf);
+#else
+    ui_signal = xSemaphoreCreateBinary();
+#endif
 }
 
 void ui_publish_state(ui_state_t state) {
-    if (!ui_queue) return;
+    if (!ui_signal) return;
     ui_event_t ev = { state, (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS) };
-    xQueueOverwrite(ui_queue, &ev);
+
+    bool queued = true;
+    portENTER_CRITICAL(&ui_lock);
+    if (ui_count > 0 && ui_ring[(ui_head + ui_count - 1) % UI_EVENT_SLOTS].state == state) {
+        ui_ring[(ui_head + ui_count - 1) % UI_EVENT_SLOTS].ts_ms = ev.ts_ms;
+    } else {
+        if (ui_count == UI_EVENT_SLOTS) {
+            int victim = 0;
+            for (int i = 1; i < ui_count; i++) {
+                if (ui_priority(ui_ring[(ui_head + i) % UI_EVENT_SLOTS].state) <
+                    ui_priority(ui_ring[(ui_head + victim) % UI_EVENT_SLOTS].state)) {
+                    victim = i;
+                }
+            }
+            if (ui_priority(ui_ring[(ui_head + victim) % UI_EVENT_SLOTS].state) <= ui_priority(state)) {
+                ui_ring_remove(victim);
+            } else {
+                queued = false;
+            }
+        }
+        if (queued) {
+            ui_ring[(ui_head + ui_count) % UI_EVENT_SLOTS] = ev;
+            ui_count++;
+        }
+    }
+    portEXIT_CRITICAL(&ui_lock);
+
+    if (queued) xSemaphoreGive(ui_signal);
+}
+
+static bool ui_take(ui_event_t *ev) {
+    bool ok = false;
+    portENTER_CRITICAL(&ui_lock);
+    if (ui_count > 0) {
+        *ev = ui_ring[ui_head];
+        ui_head = (ui_head + 1) % UI_EVENT_SLOTS;
+        ui_count--;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&ui_lock);
+    return ok;
 }
 
 bool ui_pop_state(ui_event_t *ev, TickType_t ticks) {
-    if (!ui_queue || !ev) return false;
-    return xQueueReceive(ui_queue, ev, ticks) == pdTRUE;
+    if (!ui_signal || !ev) return false;
+    if (ui_take(ev)) return true;
+    // ring 空：等待新事件（signal 可能是已取走事件的殘留，此時回傳 false，由呼叫端重新判斷）
+    if (xSemaphoreTake(ui_signal, ticks) != pdTRUE) return false;
+    return ui_take(ev);
 }
 
+// ── Display pre-warm ─────────────────────────────────────────────────────────
+// 與事件共用 ui_signal：ui_pop_state 因此回傳 false，顯示 Task 接著檢查請求旗標
+
+static atomic_bool ui_prewarm_wanted = false;
+static atomic_bool ui_display_awake = false;
+
+void ui_request_display_prewarm(void) {
+    if (atomic_load_explicit(&ui_display_awake, memory_order_relaxed)) return;
+    if (atomic_exchange(&ui_prewarm_wanted, true)) return;   // 已有待處理的請求
+    if (ui_signal) xSemaphoreGive(ui_signal);
+}
+
+bool ui_take_display_prewarm(void) {
+    return atomic_exchange(&ui_prewarm_wanted, false);
+}
+
+bool ui_display_is_awake(void) {
+    return atomic_load_explicit(&ui_display_awake, memory_order_relaxed);
+}
+
+void ui_set_display_awake(bool awake) {
+    atomic_store_explicit(&ui_display_awake, awake, memory_order_relaxed);
+    if (awake) atomic_store(&ui_prewarm_wanted, false);
+}
+
+// ── Telemetry ────────────────────────────────────────────────────────────────
+// 音訊欄位以 seqlock 保護：寫入前後各遞增 seq（寫入中為奇數），讀取端前後 seq 相同且為偶數
+// 才採用。讀取端可能與被搶占的寫入端在同一核心，因此重試次數有上限，不會空轉。
+// stream_progress 只有一個 32-bit 欄位，單一對齊寫入本身即完整，不需 seqlock。
+
+#define UI_TELEMETRY_READ_RETRIES 4
+
+static struct {
+    atomic_uint    seq;
+    volatile float rms, vad_energy, vad_threshold, confidence;
+} ui_audio;
+
+static volatile float ui_stream_progress = 0.0f;
+
+void ui_telemetry_publish_audio(float rms, float vad_energy, float vad_threshold, float confidence) {
+    unsigned seq = atomic_load_explicit(&ui_audio.seq, memory_order_relaxed);
+    atomic_store_explicit(&ui_audio.seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);   // seq 先於欄位寫入
+    ui_audio.rms           = rms;
+    ui_audio.vad_energy    = vad_energy;
+    ui_audio.vad_threshold = vad_threshold;
+    ui_audio.confidence    = confidence;
+    atomic_store_explicit(&ui_audio.seq, seq + 2, memory_order_release);
+}
+
+void ui_telemetry_publish_stream(float progress) {
+    ui_stream_progress = progress;
+}
+
+bool ui_telemetry_read(ui_telemetry_t *out) {
+    if (!out) return false;
+    out->stream_progress = ui_stream_progress;
+    for (int i = 0; i < UI_TELEMETRY_READ_RETRIES; i++) {
+        unsigned s0 = atomic_load_explicit(&ui_audio.seq, memory_order_acquire);
+        if (s0 & 1) continue;
+        float rms = ui_audio.rms, energy = ui_audio.vad_energy;
+        float threshold = ui_audio.vad_threshold, confidence = ui_audio.confidence;
+        atomic_thread_fence(memory_order_acquire);   // 欄位讀取先於第二次讀 seq
+        if (atomic_load_explicit(&ui_audio.seq, memory_order_relaxed) != s0) continue;
+        out->rms           = rms;
+        out->vad_energy    = energy;
+        out->vad_threshold = threshold;
+        out->confidence    = confidence;
+        return true;
+    }
+    return false;
+}
+
+// ── Status line ──────────────────────────────────────────────────────────────
+// 文字欄位無法單次寫入，與事件 ring 共用 ui_lock（只複製數十 bytes）
+
+static ui_status_t ui_status = {};
+
+void ui_status_publish_rssi(int rssi) {
+    portENTER_CRITICAL(&ui_lock);
+    ui_status.rssi = (int8_t)rssi;
+    portEXIT_CRITICAL(&ui_lock);
+}
+
+void ui_status_publish_command(const char *text, uint32_t now_ms) {
+    char buf[UI_STATUS_TEXT_LEN];
+    strlcpy(buf, text ? text : "", sizeof(buf));
+    portENTER_CRITICAL(&ui_lock);
+    memcpy(ui_status.command, buf, sizeof(buf));
+    ui_status.command_ms = now_ms ? now_ms : 1;
+    portEXIT_CRITICAL(&ui_lock);
+}
+
+void ui_status_publish_hint(const char *text) {
+    char buf[sizeof(ui_status.hint)];
+    strlcpy(buf, text ? text : "", sizeof(buf));
+    portENTER_CRITICAL(&ui_lock);
+    memcpy(ui_status.hint, buf, sizeof(buf));
+    portEXIT_CRITICAL(&ui_lock);
+}
+
+void ui_status_read(ui_status_t *out) {
+    if (!out) return;
+    portENTER_CRITICAL(&ui_lock);
+    *out = ui_status;
+    portEXIT_CRITICAL(&ui_lock);
+}
+
+// ── Performance HUD ──────────────────────────────────────────────────────────
+
+static atomic_int ui_perf_cpu[2] = { -1, -1 };
+static atomic_uint ui_perf_infer_us = 0;
+
+void ui_perf_publish_cpu(int core, int load_pct) {
+    if (core < 0 || core > 1) return;
+    atomic_store_explicit(&ui_perf_cpu[core], load_pct, memory_order_relaxed);
+}
+
+void ui_perf_publish_infer_us(uint32_t us) {
+    atomic_store_explicit(&ui_perf_infer_us, us, memory_order_relaxed);
+}
+
+void ui_perf_read(ui_perf_t *out) {
+    if (!out) return;
+    for (int c = 0; c < 2; c++) out->cpu[c] = (int8_t)atomic_load_explicit(&ui_perf_cpu[c], memory_order_relaxed);
+    out->infer_us = atomic_load_explicit(&ui_perf_infer_us, memory_order_relaxed);
+}
@@ -26,9 +26,70 @@ typedef struct {
 } ui_event_t;
 
 void ui_state_init(void);
+// 排入狀態事件（多格 FIFO，不阻塞；合併規則見 ui_state.c）
 void ui_publish_state(ui_state_t state);
+// 取出最舊的事件，ring 空時最多等待 ticks；false = 逾時（或殘留喚醒，重新判斷即可）
 bool ui_pop_state(ui_event_t *ev, TickType_t ticks);
 
+// ── Display pre-warm ─────────────────────────────────────────────────────────
+// 螢幕休眠時偵測到語音（VAD）先喚醒面板但不點亮，喚醒詞成立時第一個 frame 立即顯示。
+// 請求端不阻塞；面板已醒著時直接返回，不會喚醒顯示 Task。
+void ui_request_display_prewarm(void);
+// 顯示端：取出並清除待處理的請求
+bool ui_take_display_prewarm(void);
+// 顯示端：面板是否醒著（醒著時忽略請求）
+void ui_set_display_awake(bool awake);
+// 面板目前是否醒著（低功耗聆聽只在面板休眠時進入）
+bool ui_display_is_awake(void);
+
+// ── Telemetry ────────────────────────────────────────────────────────────────
+// 音訊端每切片寫入、顯示端每 frame 讀取的即時數據，不經事件佇列。
+// 寫入端不上鎖、不等待（seqlock）；每組欄位只有一個寫入 Task。
+typedef struct {
+    float rms;              // 最近切片 RMS
+    float vad_energy;       // 最近切片頻帶能量峰值
+    float vad_threshold;    // 目前 VAD 幀閾值（vad_energy 的參考尺度）
+    float confidence;       // 最近一次推論的最高喚醒詞信心值（平滑後）
+    float stream_progress;  // 指令串流進度 0~1
+} ui_telemetry_t;
+
+// 偵測 Task 專用
+void ui_telemetry_publish_audio(float rms, float vad_energy, float vad_threshold, float confidence);
+// 串流（session）Task 專用
+void ui_telemetry_publish_stream(float progress);
+// 讀取一致的快照；寫入端正在更新且重試用盡時保留 *out 原值並回傳 false
+bool ui_telemetry_read(ui_telemetry_t *out);
+
+// ── Status line ──────────────────────────────────────────────────────────────
+// 畫面底部狀態列的低頻資料（時鐘直接讀系統時間，由 TimeManager 維護）。寫入端不等待。
+#define UI_STATUS_TEXT_LEN 22   // 含結尾 '\0'；5x7 字型每列最多 21 字
+
+typedef struct {
+    int8_t   rssi;                         // dBm，0 = 未連線 / 未知
+    uint32_t command_ms;                   // 最近一次指令的時間（millis），0 = 尚無
+    char     command[UI_STATUS_TEXT_LEN];  // 最近辨識 / 執行的指令
+    char     hint[8];                      // 取代 RSSI 顯示的短提示（如喚醒延遲超標的 "slow"），"" = 無
+} ui_status_t;
+
+void ui_status_publish_rssi(int rssi);
+// 過長的文字截斷
+void ui_status_publish_command(const char *text, uint32_t now_ms);
+// NULL / "" 清除；過長的文字截斷
+void ui_status_publish_hint(const char *text);
+void ui_status_read(ui_status_t *out);
+
+// ── Performance HUD ──────────────────────────────────────────────────────────
+// 效能 HUD（CONFIG_ESP_MIAO_UI_PERF_HUD）顯示的數據：health Task 寫入各核心負載，
+// 推論 Task 寫入每切片推論耗時。各欄位單次寫入，不上鎖。
+typedef struct {
+    int8_t   cpu[2];     // 各核心負載 %，-1 = 未知
+    uint32_t infer_us;   // 最近一次推論（MFCC + NN）耗時
+} ui_perf_t;
+
+void ui_perf_publish_cpu(int core, int load_pct);
+void ui_perf_publish_infer_us(uint32_t us);
+void ui_perf_read(ui_perf_t *out);
+
 #ifdef __cplusplus
 }
 #endif
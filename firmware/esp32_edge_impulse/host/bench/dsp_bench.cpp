@@ -0,0 +1,423 @@
+/*
+ * dsp_bench.cpp - 擷取 / VAD / 後處理路徑的主機微基準（Google Benchmark）
+ * ESP-MIAO v0.8.0
+ *
+ * 輸入為固定種子的合成訊號（白噪音 + 語音頻帶正弦），每次執行結果可比較。
+ * 例：./dsp_bench --benchmark_filter=Vad --benchmark_repetitions=5
+ * `cmake --build build-host --target perf` 以此執行檔的中位數對照 bench/baselines/host.json
+ * （scripts/perf_gate.py；benchmark 與階段的對應見該腳本的 HOST_STAGES）。
+ */
+
+#include <benchmark/benchmark.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "pcm_convert.h"
+#include "resampler.h"
+#include "agc.h"
+#include "beamformer.h"
+#include "noise_suppressor.h"
+#include "audio_capture.h"
+#include "vad.h"
+#include "fft_radix4.h"
+#include "dsps_fft2r.h"
+#include "posterior_filter.h"
+#include "spectral_frontend.h"
+#include "adpcm.h"
+#include "stream_protocol.h"
+#include "display_list.h"
+
+/* 推論切片長度（同 EI_CLASSIFIER_SLICE_SIZE：4 切片 / 1 秒視窗） */
+static constexpr size_t kSliceSamples = SAMPLE_RATE / 4;
+
+/* 白噪音（amp_noise）+ 1 kHz 正弦（amp_tone），線性同餘產生器保持可重現 */
+static std::vector<int16_t> make_pcm(size_t n, float amp_noise, float amp_tone)
+{
+    std::vector<int16_t> pcm(n);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        float noise = ((int32_t)(seed >> 16) - 32768) / 32768.0f;
+        float tone  = sinf(2.0f * (float)M_PI * 1000.0f * i / SAMPLE_RATE);
+        pcm[i] = pcm_saturate_i16((int32_t)(amp_noise * noise + amp_tone * tone));
+    }
+    return pcm;
+}
+
+/* I2S DMA 區塊格式：左對齊 32-bit slot，Stereo 時兩個 slot */
+static std::vector<int32_t> make_i2s_block(size_t frames)
+{
+    std::vector<int16_t> pcm = make_pcm(frames, 2000.0f, 6000.0f);
+    std::vector<int32_t> raw(frames * AUDIO_I2S_SLOTS);
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < AUDIO_I2S_SLOTS; c++) raw[i * AUDIO_I2S_SLOTS + c] = (int32_t)pcm[i] << I2S_SAMPLE_SHIFT;
+    }
+    return raw;
+}
+
+/* 把 PCM 寫入 AudioCapture（replay 路徑）並取回一個零拷貝切片 */
+static bool fill_slice(AudioCapture &audio, const std::vector<int16_t> &pcm, AudioSlice *slice)
+{
+    audio.sync_reader(AUDIO_READER_DETECTOR);
+    audio.replay(pcm.data(), pcm.size());
+    return audio.acquire_slice(AUDIO_READER_DETECTOR, pcm.size(), slice);
+}
+
+/* ---------- 擷取轉換 ---------- */
+
+static void BM_PcmConvertI2s(benchmark::State &state)
+{
+    std::vector<int32_t> raw = make_i2s_block(DMA_BUF_LEN);
+    int16_t out[DMA_BUF_LEN];
+    for (auto _ : state) {
+        float sum = pcm_convert_i2s(raw.data(), DMA_BUF_LEN, AUDIO_I2S_SLOTS, out, nullptr, nullptr);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * DMA_BUF_LEN);
+}
+BENCHMARK(BM_PcmConvertI2s);
+
+static void BM_PcmConvertI2sFiltered(benchmark::State &state)
+{
+    std::vector<int32_t> raw = make_i2s_block(DMA_BUF_LEN);
+    int16_t   out[DMA_BUF_LEN];
+    PcmFilter filter;
+    pcm_filter_init(&filter, AUDIO_DC_BLOCK_POLE, 0.97f);
+    for (auto _ : state) {
+        float sum = pcm_convert_i2s(raw.data(), DMA_BUF_LEN, AUDIO_I2S_SLOTS, out, nullptr, &filter);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * DMA_BUF_LEN);
+}
+BENCHMARK(BM_PcmConvertI2sFiltered);
+
+static void BM_PcmToFloat(benchmark::State &state)
+{
+    std::vector<int16_t> pcm = make_pcm(kSliceSamples, 2000.0f, 6000.0f);
+    std::vector<float>   out(kSliceSamples);
+    for (auto _ : state) {
+        float sum = pcm_to_float(pcm.data(), pcm.size(), out.data());
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * kSliceSamples);
+}
+BENCHMARK(BM_PcmToFloat);
+
+/* 48 kHz → 16 kHz（CAPTURE_SAMPLE_RATE 高於管線速率時的擷取成本） */
+static void BM_Resample48kTo16k(benchmark::State &state)
+{
+    PolyphaseResampler rs;
+    if (!rs.init(48000, SAMPLE_RATE)) {
+        state.SkipWithError("resampler init failed");
+        return;
+    }
+    std::vector<int16_t> in = make_pcm(DMA_BUF_LEN, 2000.0f, 6000.0f);
+    std::vector<int16_t> out(rs.max_output(DMA_BUF_LEN));
+    for (auto _ : state) {
+        size_t n = rs.process(in.data(), in.size(), out.data());
+        benchmark::DoNotOptimize(n);
+    }
+    state.SetItemsProcessed(state.iterations() * DMA_BUF_LEN);
+}
+BENCHMARK(BM_Resample48kTo16k);
+
+static void BM_Agc(benchmark::State &state)
+{
+    Agc agc;
+    agc.init(AGC_TARGET_LEVEL, AGC_MAX_GAIN, AGC_NOISE_GATE, AGC_ATTACK_MS, AGC_RELEASE_MS, SAMPLE_RATE);
+    std::vector<int16_t> src = make_pcm(DMA_BUF_LEN, 500.0f, 1500.0f);
+    std::vector<int16_t> buf(DMA_BUF_LEN);
+    for (auto _ : state) {
+        state.PauseTiming();
+        buf = src;
+        state.ResumeTiming();
+        agc.process(buf.data(), buf.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * DMA_BUF_LEN);
+}
+BENCHMARK(BM_Agc);
+
+/* 雙麥克風延遲相加：右聲道為左聲道延遲 3 樣本（聲源偏左） */
+static void BM_Beamform(benchmark::State &state)
+{
+    std::vector<int16_t> src = make_pcm(DMA_BUF_LEN + 3, 2000.0f, 6000.0f);
+    std::vector<int16_t> left(src.begin() + 3, src.end());
+    std::vector<int16_t> right(src.begin(), src.begin() + DMA_BUF_LEN);
+    std::vector<int16_t> out(DMA_BUF_LEN);
+    static Beamformer beam;
+    beam.init(BEAMFORM_MAX_DELAY);
+    for (auto _ : state) {
+        beam.process(left.data(), right.data(), DMA_BUF_LEN, out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * DMA_BUF_LEN);
+    state.SetLabel("delay=" + std::to_string(beam.delay()));
+}
+BENCHMARK(BM_Beamform);
+
+/* 一個 DMA 區塊走完整擷取路徑：slot 還原 → 轉換 / 濾波 → 重取樣 → AGC → 環形緩衝 */
+static void BM_CaptureBlock(benchmark::State &state)
+{
+    static AudioCapture audio;
+    static bool ready = (audio.init_replay(), true);
+    (void)ready;
+    std::vector<int16_t> pcm = make_pcm(DMA_BUF_LEN, 2000.0f, 6000.0f);
+    for (auto _ : state) {
+        audio.replay(pcm.data(), pcm.size());
+    }
+    state.SetItemsProcessed(state.iterations() * DMA_BUF_LEN);
+}
+BENCHMARK(BM_CaptureBlock);
+
+/* ---------- 切片 / VAD ---------- */
+
+static AudioCapture &slice_source()
+{
+    static AudioCapture audio;
+    static bool ready = (audio.init_replay(), true);
+    (void)ready;
+    return audio;
+}
+
+static void BM_SliceToFloat(benchmark::State &state)
+{
+    AudioSlice slice;
+    if (!fill_slice(slice_source(), make_pcm(kSliceSamples, 2000.0f, 6000.0f), &slice)) {
+        state.SkipWithError("slice unavailable");
+        return;
+    }
+    std::vector<float> out(kSliceSamples);
+    for (auto _ : state) {
+        slice.to_float(0, slice.size, out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * kSliceSamples);
+}
+BENCHMARK(BM_SliceToFloat);
+
+/* range(0)：0 = 低噪音（靜音路徑），1 = 噪音 + 語音頻帶正弦（語音路徑） */
+static void BM_VadDetectSlice(benchmark::State &state)
+{
+    const bool speech = state.range(0) != 0;
+    AudioSlice slice;
+    if (!fill_slice(slice_source(),
+                    make_pcm(kSliceSamples, speech ? 2000.0f : 60.0f, speech ? 8000.0f : 0.0f), &slice)) {
+        state.SkipWithError("slice unavailable");
+        return;
+    }
+    VAD   vad;
+    float rms = 0.0f;
+    for (auto _ : state) {
+        VadResult r = vad.detect(slice, &rms);
+        benchmark::DoNotOptimize(r);
+    }
+    state.SetItemsProcessed(state.iterations() * kSliceSamples);
+    state.SetLabel(speech ? "speech" : "silence");
+}
+BENCHMARK(BM_VadDetectSlice)->Arg(0)->Arg(1);
+
+/* 單幀 band_rms：range(0) 0 = 浮點 FFT（VAD_ENGINE_FFT），1 = Q15 定點（VadQ15） */
+static void BM_VadFrameEnergy(benchmark::State &state)
+{
+    const bool q15 = state.range(0) != 0;
+    std::vector<int16_t> pcm = make_pcm(FFT_SIZE, 2000.0f, 8000.0f);
+    std::vector<float>   buf(FFT_SIZE);
+    pcm_to_float(pcm.data(), pcm.size(), buf.data());
+    VAD    vad;
+    VadQ15 fixed;
+    for (auto _ : state) {
+        if (q15) {
+            benchmark::DoNotOptimize(fixed.band_energy(pcm.data()));
+        }
+        else {
+            benchmark::DoNotOptimize(vad.detect(buf.data(), buf.size()));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * FFT_SIZE);
+    state.SetLabel(q15 ? "q15" : "float");
+}
+BENCHMARK(BM_VadFrameEnergy)->Arg(0)->Arg(1);
+
+/* VAD 的 N/2 點複數 FFT 核心：range(0) 0 = esp-dsp（主機為 ANSI 版本）+ 位元反轉，1 = 基 4 */
+static void BM_VadFftKernel(benchmark::State &state)
+{
+    const bool radix4 = state.range(0) != 0;
+    std::vector<int16_t> pcm = make_pcm(FFT_SIZE, 2000.0f, 8000.0f);
+    std::vector<float>   src(FFT_SIZE), z(FFT_SIZE);
+    pcm_to_float(pcm.data(), pcm.size(), src.data());
+    dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE);
+    for (auto _ : state) {
+        memcpy(z.data(), src.data(), FFT_SIZE * sizeof(float));
+        if (radix4) {
+            fft_radix4_fc32(z.data());
+        }
+        else {
+            dsps_fft2r_fc32(z.data(), FFT_SIZE / 2);
+            dsps_bit_rev_fc32(z.data(), FFT_SIZE / 2);
+        }
+        benchmark::DoNotOptimize(z.data());
+    }
+    state.SetItemsProcessed(state.iterations() * FFT_SIZE);
+    state.SetLabel(radix4 ? "radix-4" : "esp-dsp");
+}
+BENCHMARK(BM_VadFftKernel)->Arg(0)->Arg(1);
+
+/* float buffer 版本（AudioStreamer 端點偵測使用） */
+static void BM_VadDetectFloat(benchmark::State &state)
+{
+    std::vector<int16_t> pcm = make_pcm(kSliceSamples, 2000.0f, 8000.0f);
+    std::vector<float>   buf(kSliceSamples);
+    pcm_to_float(pcm.data(), pcm.size(), buf.data());
+    VAD vad;
+    for (auto _ : state) {
+        VadResult r = vad.detect(buf.data(), buf.size());
+        benchmark::DoNotOptimize(r);
+    }
+    state.SetItemsProcessed(state.iterations() * kSliceSamples);
+}
+BENCHMARK(BM_VadDetectFloat);
+
+/* ---------- MFCC 前端 ---------- */
+
+/* 模型的 MFCC 參數（同 spectral_q15_test），range(0)：0 = ENGINE_FLOAT，1 = ENGINE_Q15 */
+static void BM_SpectralFrontend(benchmark::State &state)
+{
+    const bool q15 = state.range(0) != 0;
+    MfccParams p;
+    p.frame_length = 400;
+    p.frame_stride = 320;
+    p.fft_length   = FFT_SIZE;
+    p.num_filters  = 32;
+    p.num_cepstral = 13;
+    p.low_hz       = 80.0f;
+    p.high_hz      = 0.0f;
+    p.pre_cof      = 0.98f;
+    p.pre_shift    = 1;
+    p.win_size     = 151;
+    static SpectralFrontend fe;   // 查表與滾動矩陣約 40 KB，不放在 stack
+    AudioSlice slice;
+    if (!fe.init(p, SAMPLE_RATE) ||
+        !fill_slice(slice_source(), make_pcm(kSliceSamples, 2000.0f, 8000.0f), &slice)) {
+        state.SkipWithError("front-end unavailable");
+        return;
+    }
+    fe.set_engine(q15 ? SpectralFrontend::ENGINE_Q15 : SpectralFrontend::ENGINE_FLOAT);
+    float energies[SpectralFrontend::MAX_SLICE_FRAMES];
+    float rms = 0.0f;
+    for (auto _ : state) {
+        size_t frames = fe.process(slice, energies, SpectralFrontend::MAX_SLICE_FRAMES, &rms);
+        benchmark::DoNotOptimize(frames);
+    }
+    state.SetItemsProcessed(state.iterations() * kSliceSamples);
+    state.SetLabel(q15 ? "q15" : "float");
+}
+BENCHMARK(BM_SpectralFrontend)->Arg(0)->Arg(1);
+
+/* ---------- 串流降噪 ---------- */
+
+/* 一個預設 chunk（STREAM_CHUNK_SAMPLES）降噪：每 hop 一次正向 + 反向 FFT */
+static void BM_NoiseSuppress(benchmark::State &state)
+{
+    static NoiseSuppressor ns;
+    if (!ns.init()) {
+        state.SkipWithError("FFT unavailable");
+        return;
+    }
+    std::vector<int16_t> src = make_pcm(STREAM_CHUNK_SAMPLES, 2000.0f, 6000.0f);
+    std::vector<int16_t> buf(STREAM_CHUNK_SAMPLES);
+    float energies[STREAM_CHUNK_SAMPLES / NoiseSuppressor::HOP + 1];
+    for (auto _ : state) {
+        state.PauseTiming();
+        buf = src;
+        state.ResumeTiming();
+        size_t frames = ns.process(buf.data(), buf.size(), FFT_ENERGY_THRESHOLD, energies,
+                                   sizeof(energies) / sizeof(energies[0]));
+        benchmark::DoNotOptimize(frames);
+    }
+    state.SetItemsProcessed(state.iterations() * STREAM_CHUNK_SAMPLES);
+}
+BENCHMARK(BM_NoiseSuppress);
+
+/* ---------- 後處理 ---------- */
+
+static void BM_PosteriorUpdate(benchmark::State &state)
+{
+    PosteriorFilter filter;
+    filter.init(WAKE_SMOOTH_SLICES, WAKE_SMOOTH_MAX != 0, 0.8f, 0.5f, WAKE_REFRACTORY_MS);
+    int64_t now_us = 0;
+    float   p      = 0.0f;
+    for (auto _ : state) {
+        p       = p > 0.95f ? 0.0f : p + 0.07f;
+        now_us += 250000;
+        bool fired = filter.update(p, true, now_us);
+        benchmark::DoNotOptimize(fired);
+    }
+}
+BENCHMARK(BM_PosteriorUpdate);
+
+/* ---------- 串流封包 ---------- */
+
+/* 一個 STREAM_CHUNK_SAMPLES frame：自環形緩衝切片複製 → IMA-ADPCM 編碼 → StreamChunkHeader（同 ContinuousStreamer） */
+static void BM_StreamPackFrame(benchmark::State &state)
+{
+    AudioSlice slice;
+    if (!fill_slice(slice_source(), make_pcm(STREAM_CHUNK_SAMPLES, 2000.0f, 6000.0f), &slice)) {
+        state.SkipWithError("slice unavailable");
+        return;
+    }
+    static int16_t pcm[STREAM_CHUNK_SAMPLES];
+    static uint8_t frame[sizeof(StreamChunkHeader) + ADPCM_BLOCK_HEADER_BYTES + STREAM_CHUNK_SAMPLES / 2];
+    uint32_t seq = 0;
+    for (auto _ : state) {
+        memcpy(pcm, slice.seg[0], slice.len[0] * sizeof(int16_t));
+        if (slice.len[1]) memcpy(pcm + slice.len[0], slice.seg[1], slice.len[1] * sizeof(int16_t));
+        AdpcmState adpcm;
+        adpcm_reset(&adpcm);
+        size_t body = adpcm_encode_block(pcm, slice.size, &adpcm, frame + sizeof(StreamChunkHeader));
+        StreamChunkHeader hdr = {};
+        hdr.seq           = seq++;
+        hdr.sample_offset = seq * STREAM_CHUNK_SAMPLES;
+        memcpy(frame, &hdr, sizeof(hdr));
+        benchmark::DoNotOptimize(body);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * STREAM_CHUNK_SAMPLES);
+}
+BENCHMARK(BM_StreamPackFrame);
+
+/* ---------- UI 光柵化 ---------- */
+
+/* IDLE 畫面（耳朵、ω 嘴、鼻子、兩眼）整個 128x160 以 16 列條帶光柵化（同 eye_ui push_frame 的全畫面重繪） */
+static void BM_UiRenderFrame(benchmark::State &state)
+{
+    constexpr int kWidth = 128, kHeight = 160, kStripLines = 16;
+    static constexpr EllipseSpans<12, 18> eye{};
+    static constexpr EllipseSpans<6, 4>   nose{};
+    static constexpr ArcPoints<12, 12, false, 10> omega{};
+    static uint16_t buf[kWidth * kStripLines];
+    uint16_t colors[16] = { 0x0000, 0xFFFF, 0x1FFE, 0x45F9, 0x5084 };
+
+    DisplayList dl;
+    dl.triangle(10, 32, 45, 32, 15, 5, 1);
+    dl.triangle(83, 32, 118, 32, 113, 5, 1);
+    dl.dots(64 - 12, 120, 1, omega.p, omega.N, 2, 1);
+    dl.dots(64 + 12, 120, -1, omega.p, omega.N, 2, 1);
+    dl.spans(64, 118, 4, nose.half, 2);
+    dl.spans(40, 80, 18, eye.half, 1);
+    dl.spans(88, 80, 18, eye.half, 1);
+    for (auto _ : state) {
+        for (int y = 0; y < kHeight; y += kStripLines) {
+            dl.render(buf, 0, y, kWidth, kStripLines, colors);
+            benchmark::ClobberMemory();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kWidth * kHeight);
+}
+BENCHMARK(BM_UiRenderFrame);
+
+BENCHMARK_MAIN();
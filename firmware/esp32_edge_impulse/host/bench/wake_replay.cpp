@@ -0,0 +1,26 @@
+/*
+ * wake_replay.cpp - 主機版錄音回放 benchmark（與 CONFIG_ESP_MIAO_BENCHMARK 韌體同一流程）
+ * ESP-MIAO v0.8.0
+ *
+ * 用法：wake_replay <clips_dir>
+ *   clips_dir 內的 PCM16 mono WAV（CAPTURE_SAMPLE_RATE）逐一經 AudioCapture::replay()
+ *   → VAD → EI 連續推論 → 後驗平滑，列印吞吐量、各階段耗時與 FR / FA。
+ */
+
+#include <stdio.h>
+#include "audio_capture.h"
+#include "vad.h"
+#include "wake_benchmark.h"
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <clips_dir>\n", argv[0]);
+        return 2;
+    }
+
+    static AudioCapture audio;
+    static VAD          vad;
+    audio.init_replay();
+    return wake_benchmark_run_dir(audio, vad, argv[1]) > 0 ? 0 : 1;
+}
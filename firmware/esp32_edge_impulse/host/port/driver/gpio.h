@@ -0,0 +1,12 @@
+#pragma once
+
+/* driver/gpio.h - 主機建置：config.h 用到的腳位編號 */
+
+typedef enum {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_2  = 2,
+    GPIO_NUM_4  = 4,
+    GPIO_NUM_25 = 25,
+    GPIO_NUM_32 = 32,
+    GPIO_NUM_33 = 33,
+} gpio_num_t;
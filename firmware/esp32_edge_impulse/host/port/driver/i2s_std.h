@@ -0,0 +1,96 @@
+#pragma once
+
+/* ============================================================
+ * driver/i2s_std.h - 主機建置：I2S standard 模式的型別與 API 宣告
+ *
+ * 只為了讓 audio_capture.cpp 原樣編譯；所有函式回傳
+ * ESP_ERR_NOT_SUPPORTED，主機上改由 AudioCapture::replay() 供給樣本。
+ * ============================================================ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+#define SOC_I2S_HW_VERSION_1 1
+#define SOC_I2S_SUPPORTS_APLL 1
+#define I2S_GPIO_UNUSED      GPIO_NUM_NC
+
+typedef struct i2s_channel_obj_t *i2s_chan_handle_t;
+
+typedef enum { I2S_NUM_0 = 0, I2S_NUM_1 = 1 } i2s_port_t;
+typedef enum { I2S_ROLE_MASTER, I2S_ROLE_SLAVE } i2s_role_t;
+typedef enum { I2S_CLK_SRC_DEFAULT, I2S_CLK_SRC_APLL } i2s_clock_src_t;
+typedef enum { I2S_MCLK_MULTIPLE_256 = 256 } i2s_mclk_multiple_t;
+typedef enum { I2S_DATA_BIT_WIDTH_16BIT = 16, I2S_DATA_BIT_WIDTH_32BIT = 32 } i2s_data_bit_width_t;
+typedef enum { I2S_SLOT_BIT_WIDTH_AUTO = 0 } i2s_slot_bit_width_t;
+typedef enum { I2S_SLOT_MODE_MONO = 1, I2S_SLOT_MODE_STEREO = 2 } i2s_slot_mode_t;
+typedef enum { I2S_STD_SLOT_LEFT = 1, I2S_STD_SLOT_RIGHT = 2, I2S_STD_SLOT_BOTH = 3 } i2s_std_slot_mask_t;
+
+typedef struct {
+    i2s_port_t id;
+    i2s_role_t role;
+    uint32_t   dma_desc_num;
+    uint32_t   dma_frame_num;
+    bool       auto_clear;
+} i2s_chan_config_t;
+
+#define I2S_CHANNEL_DEFAULT_CONFIG(port, role) { (port), (role), 6, 240, false }
+
+typedef struct {
+    uint32_t            sample_rate_hz;
+    i2s_clock_src_t     clk_src;
+    i2s_mclk_multiple_t mclk_multiple;
+    uint32_t            bclk_div;
+} i2s_std_clk_config_t;
+
+typedef struct {
+    i2s_data_bit_width_t data_bit_width;
+    i2s_slot_bit_width_t slot_bit_width;
+    i2s_slot_mode_t      slot_mode;
+    i2s_std_slot_mask_t  slot_mask;
+    uint32_t             ws_width;
+    bool                 ws_pol;
+    bool                 bit_shift;
+    bool                 msb_right;
+} i2s_std_slot_config_t;
+
+typedef struct {
+    gpio_num_t mclk, bclk, ws, dout, din;
+} i2s_std_gpio_config_t;
+
+typedef struct {
+    i2s_std_clk_config_t  clk_cfg;
+    i2s_std_slot_config_t slot_cfg;
+    i2s_std_gpio_config_t gpio_cfg;
+} i2s_std_config_t;
+
+typedef struct {
+    void  *data;
+    void  *dma_buf;
+    size_t size;
+} i2s_event_data_t;
+
+typedef bool (*i2s_isr_callback_t)(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx);
+
+typedef struct {
+    i2s_isr_callback_t on_recv;
+} i2s_event_callbacks_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg, i2s_chan_handle_t *tx, i2s_chan_handle_t *rx);
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t *std_cfg);
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t *cbs,
+                                              void *user_data);
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_reconfig_std_clock(i2s_chan_handle_t handle, const i2s_std_clk_config_t *clk_cfg);
+esp_err_t i2s_channel_reconfig_std_slot(i2s_chan_handle_t handle, const i2s_std_slot_config_t *slot_cfg);
+esp_err_t i2s_channel_read(i2s_chan_handle_t handle, void *dest, size_t size, size_t *bytes_read,
+                           uint32_t timeout_ms);
+#ifdef __cplusplus
+}
+#endif
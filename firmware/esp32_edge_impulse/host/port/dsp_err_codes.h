@@ -0,0 +1,10 @@
+#pragma once
+
+/* dsp_err_codes.h - 主機建置：esp-dsp 錯誤碼 */
+
+#define ESP_ERR_DSP_BASE              0x70000
+#define ESP_ERR_DSP_INVALID_LENGTH    (ESP_ERR_DSP_BASE + 1)
+#define ESP_ERR_DSP_INVALID_PARAM     (ESP_ERR_DSP_BASE + 2)
+#define ESP_ERR_DSP_PARAM_OUTOFRANGE  (ESP_ERR_DSP_BASE + 3)
+#define ESP_ERR_DSP_UNINITIALIZED     (ESP_ERR_DSP_BASE + 4)
+#define ESP_ERR_DSP_REINITIALIZED     (ESP_ERR_DSP_BASE + 5)
@@ -0,0 +1,87 @@
+/*
+ * dsps_fft2r.cpp - esp-dsp radix-2 複數 FFT 的主機實作（同 dsps_fft2r_fc32_ansi）
+ * ESP-MIAO v0.8.0
+ */
+
+#include "dsps_fft2r.h"
+#include "sdkconfig.h"
+#include <math.h>
+
+/* twiddle：w[2i] = cos(2πi/N)、w[2i+1] = sin(2πi/N)，再依位元反轉排列；
+ * 較小的 N 直接使用表格前段（與 esp-dsp 相同的共用方式） */
+static float s_twiddle[CONFIG_DSP_MAX_FFT_SIZE];
+static int   s_table_size = 0;
+
+static inline void swap_pair_(float *data, int i, int j)
+{
+    float r = data[2 * i], m = data[2 * i + 1];
+    data[2 * i]     = data[2 * j];
+    data[2 * i + 1] = data[2 * j + 1];
+    data[2 * j]     = r;
+    data[2 * j + 1] = m;
+}
+
+esp_err_t dsps_fft2r_init_fc32(float *fft_table_buff, int table_size)
+{
+    if (fft_table_buff != nullptr) return ESP_ERR_DSP_PARAM_OUTOFRANGE;   // 只支援內建表格
+    if (table_size > CONFIG_DSP_MAX_FFT_SIZE || (table_size & (table_size - 1)) != 0) {
+        return ESP_ERR_DSP_INVALID_LENGTH;
+    }
+    if (s_table_size != 0) return ESP_ERR_DSP_REINITIALIZED;
+
+    const int half = table_size / 2;
+    for (int i = 0; i < half; i++) {
+        double a = 2.0 * M_PI * i / table_size;
+        s_twiddle[2 * i]     = (float)cos(a);
+        s_twiddle[2 * i + 1] = (float)sin(a);
+    }
+    dsps_bit_rev_fc32(s_twiddle, half);
+    s_table_size = table_size;
+    return ESP_OK;
+}
+
+void dsps_fft2r_deinit_fc32(void)
+{
+    s_table_size = 0;
+}
+
+esp_err_t dsps_fft2r_fc32(float *data, int N)
+{
+    if (s_table_size == 0) return ESP_ERR_DSP_UNINITIALIZED;
+    if (N > s_table_size || (N & (N - 1)) != 0) return ESP_ERR_DSP_INVALID_LENGTH;
+
+    const float *w  = s_twiddle;
+    int          ie = 1;
+    for (int n2 = N / 2; n2 > 0; n2 >>= 1) {
+        int ia = 0;
+        for (int j = 0; j < ie; j++) {
+            float c = w[2 * j];
+            float s = w[2 * j + 1];
+            for (int i = 0; i < n2; i++) {
+                int   m  = ia + n2;
+                float re = c * data[2 * m] + s * data[2 * m + 1];
+                float im = c * data[2 * m + 1] - s * data[2 * m];
+                data[2 * m]      = data[2 * ia] - re;
+                data[2 * m + 1]  = data[2 * ia + 1] - im;
+                data[2 * ia]     += re;
+                data[2 * ia + 1] += im;
+                ia++;
+            }
+            ia += n2;
+        }
+        ie <<= 1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t dsps_bit_rev_fc32(float *data, int N)
+{
+    if (N <= 0 || (N & (N - 1)) != 0) return ESP_ERR_DSP_INVALID_LENGTH;
+    for (int i = 1, j = 0; i < N; i++) {
+        int bit = N >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) swap_pair_(data, i, j);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+/* ============================================================
+ * dsps_fft2r.h - 主機建置：esp-dsp radix-2 FFT 的可攜實作
+ *
+ * 與 esp-dsp 的 ANSI 版本相同：位元反轉排列的 twiddle 表、輸出為
+ * 位元反轉順序，需再呼叫 dsps_bit_rev_fc32()。VAD 因此走與裝置上
+ * 相同的實數 FFT 路徑（只是沒有 ae32 組語最佳化）。
+ * ============================================================ */
+
+#include "esp_err.h"
+#include "dsp_err_codes.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t dsps_fft2r_init_fc32(float *fft_table_buff, int table_size);
+void      dsps_fft2r_deinit_fc32(void);
+esp_err_t dsps_fft2r_fc32(float *data, int N);
+esp_err_t dsps_bit_rev_fc32(float *data, int N);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+
+/* esp_attr.h - 主機建置：記憶體區段屬性皆為空 */
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define DMA_ATTR
+#define WORD_ALIGNED_ATTR
+#define EXT_RAM_BSS_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
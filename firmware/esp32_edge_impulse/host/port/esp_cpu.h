@@ -0,0 +1,15 @@
+#pragma once
+
+/* esp_cpu.h - 主機建置：x86 為 TSC（低 32 位），其他架構為奈秒計數；只適合相對比較 */
+
+#include <stdint.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+/* esp_err.h - 主機建置：ESP-IDF 錯誤碼子集 */
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_INVALID_SIZE    0x104
+#define ESP_ERR_NOT_FOUND       0x105
+#define ESP_ERR_NOT_SUPPORTED   0x106
+#define ESP_ERR_TIMEOUT         0x107
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+const char *esp_err_to_name(esp_err_t code);
+void        host_abort_on_error(esp_err_t code, const char *expr, const char *file, int line);
+#ifdef __cplusplus
+}
+#endif
+
+#define ESP_ERROR_CHECK(x) do {                                                  \
+        esp_err_t err_rc_ = (x);                                                 \
+        if (err_rc_ != ESP_OK) host_abort_on_error(err_rc_, #x, __FILE__, __LINE__); \
+    } while (0)
@@ -0,0 +1,6 @@
+#pragma once
+
+/* esp_idf_version.h - 主機建置：視為 firmware 目標的 IDF 版本 */
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(5, 2, 0)
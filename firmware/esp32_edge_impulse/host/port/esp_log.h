@@ -0,0 +1,15 @@
+#pragma once
+
+/* esp_log.h - 主機建置：ESP_LOGx 輸出到 stderr（Debug / Verbose 不輸出） */
+
+#include <stdio.h>
+#include "esp_err.h"
+
+#define HOST_LOG_(letter, tag, fmt, ...) \
+    fprintf(stderr, letter " (%s) " fmt "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG_("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG_("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) HOST_LOG_("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { (void)(tag); } while (0)
+#define ESP_LOGV(tag, fmt, ...) do { (void)(tag); } while (0)
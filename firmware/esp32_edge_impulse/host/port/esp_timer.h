@@ -0,0 +1,13 @@
+#pragma once
+
+/* esp_timer.h - 主機建置：CLOCK_MONOTONIC 微秒 */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+int64_t esp_timer_get_time(void);
+#ifdef __cplusplus
+}
+#endif
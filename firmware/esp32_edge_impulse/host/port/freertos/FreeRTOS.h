@@ -0,0 +1,41 @@
+#pragma once
+
+/* ============================================================
+ * freertos/FreeRTOS.h - 主機建置：FreeRTOS 型別與常數子集
+ *
+ * 主機上沒有排程器：回放由單一執行緒同步完成，Task 建立一律失敗，
+ * Task Notification 退化為依逾時睡眠（見 host_port.cpp）。
+ * ============================================================ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"   // 同 IDF：經由 FreeRTOS.h 間接取得 CONFIG_*
+
+typedef uint32_t     TickType_t;
+typedef int          BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t      StackType_t;   // 同 IDF：stack 深度以 bytes 計
+typedef void        *TaskHandle_t;
+typedef void        *QueueHandle_t;
+typedef void        *SemaphoreHandle_t;
+typedef void        *EventGroupHandle_t;
+typedef uint32_t     EventBits_t;
+
+typedef struct { int unused; } portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portENTER_CRITICAL(mux)     ((void)(mux))
+#define portEXIT_CRITICAL(mux)      ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)  ((void)(mux))
+
+#define configTICK_RATE_HZ   1000
+#define portTICK_PERIOD_MS   1
+#define pdMS_TO_TICKS(ms)    ((TickType_t)(ms))
+#define portMAX_DELAY        ((TickType_t)0xffffffffu)
+#define tskNO_AFFINITY       0x7fffffff
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdFAIL  0
+#define pdPASS  1
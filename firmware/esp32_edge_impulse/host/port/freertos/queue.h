@@ -0,0 +1,5 @@
+#pragma once
+
+/* freertos/queue.h - 主機建置：rtos_alloc.h 引用，主機模組不建立 Queue */
+
+#include "freertos/FreeRTOS.h"
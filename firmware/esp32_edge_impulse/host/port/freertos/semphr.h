@@ -0,0 +1,5 @@
+#pragma once
+
+/* freertos/semphr.h - 主機建置：rtos_alloc.h 引用，主機模組不建立 Semaphore */
+
+#include "freertos/queue.h"
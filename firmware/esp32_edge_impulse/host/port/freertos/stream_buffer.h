@@ -0,0 +1,5 @@
+#pragma once
+
+/* freertos/stream_buffer.h - 主機建置：rtos_alloc.h 引用，主機模組不建立 Stream Buffer */
+
+#include "freertos/FreeRTOS.h"
@@ -0,0 +1,23 @@
+#pragma once
+
+/* freertos/task.h - 主機建置：Task 與 Task Notification 子集 */
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+BaseType_t   xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_bytes, void *arg,
+                                     UBaseType_t prio, TaskHandle_t *out_handle, BaseType_t core);
+void         vTaskDelete(TaskHandle_t task);
+void         vTaskDelay(TickType_t ticks);
+TickType_t   xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t   xTaskNotifyGive(TaskHandle_t task);
+void         vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *hp_task_woken);
+uint32_t     ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,162 @@
+/*
+ * host_port.cpp - 主機建置的 ESP-IDF / FreeRTOS 替身實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/i2s_std.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* ---------- esp_err ---------- */
+
+extern "C" const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:                return "ESP_OK";
+    case ESP_FAIL:              return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:       return "ESP_ERR_TIMEOUT";
+    default:                    return "UNKNOWN ERROR";
+    }
+}
+
+extern "C" void host_abort_on_error(esp_err_t code, const char *expr, const char *file, int line)
+{
+    fprintf(stderr, "ESP_ERROR_CHECK failed: %s (0x%x) at %s:%d\n  %s\n",
+            esp_err_to_name(code), (unsigned)code, file, line, expr);
+    abort();
+}
+
+/* ---------- 時間 ---------- */
+
+static int64_t monotonic_ns_()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+extern "C" int64_t esp_timer_get_time(void)
+{
+    return monotonic_ns_() / 1000;
+}
+
+extern "C" esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (esp_cpu_cycle_count_t)__rdtsc();
+#else
+    return (esp_cpu_cycle_count_t)monotonic_ns_();
+#endif
+}
+
+/* ---------- FreeRTOS（無排程器，單執行緒） ---------- */
+
+static int s_main_task;   // 唯一的「Task」：呼叫端執行緒
+
+extern "C" BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_bytes,
+                                              void *arg, UBaseType_t prio, TaskHandle_t *out_handle,
+                                              BaseType_t core)
+{
+    fprintf(stderr, "W (host) Task '%s' not started: no scheduler on the host build\n", name);
+    if (out_handle) *out_handle = nullptr;
+    return pdFAIL;
+}
+
+extern "C" void vTaskDelete(TaskHandle_t task)
+{
+    if (task == nullptr) exit(0);   // 同裝置：Task 自行結束 = 這條執行緒的工作結束
+}
+
+extern "C" void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { (time_t)(ticks / 1000), (long)(ticks % 1000) * 1000000L };
+    nanosleep(&ts, nullptr);
+}
+
+extern "C" TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(monotonic_ns_() / 1000000);
+}
+
+extern "C" TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return &s_main_task;
+}
+
+/* 生產者與消費者在同一執行緒：通知到來時消費者不在等待，取得即可略過 */
+extern "C" BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return pdPASS;
+}
+
+extern "C" void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *hp_task_woken)
+{
+}
+
+/* 等待中不會有人寫入：睡滿逾時，讓 wait_for 照常回報逾時 */
+extern "C" uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout)
+{
+    vTaskDelay(timeout);
+    return 0;
+}
+
+/* ---------- I2S（主機上不存在；樣本由 AudioCapture::replay 供給） ---------- */
+
+extern "C" esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg, i2s_chan_handle_t *tx,
+                                     i2s_chan_handle_t *rx)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+extern "C" esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t *std_cfg)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+extern "C" esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle,
+                                                         const i2s_event_callbacks_t *cbs, void *user_data)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+extern "C" esp_err_t i2s_channel_enable(i2s_chan_handle_t handle)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+extern "C" esp_err_t i2s_channel_disable(i2s_chan_handle_t handle)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+extern "C" esp_err_t i2s_channel_reconfig_std_clock(i2s_chan_handle_t handle, const i2s_std_clk_config_t *clk_cfg)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+extern "C" esp_err_t i2s_channel_reconfig_std_slot(i2s_chan_handle_t handle, const i2s_std_slot_config_t *slot_cfg)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+extern "C" esp_err_t i2s_channel_read(i2s_chan_handle_t handle, void *dest, size_t size, size_t *bytes_read,
+                                      uint32_t timeout_ms)
+{
+    if (bytes_read) *bytes_read = 0;
+    return ESP_ERR_NOT_SUPPORTED;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+/* ============================================================
+ * sdkconfig.h - 主機建置的固定 Kconfig 值
+ * ESP-MIAO v0.8.0
+ *
+ * 取代 ESP-IDF 產生的 sdkconfig.h，只列出 main/ 模組會讀到的選項。
+ * ============================================================ */
+
+#define CONFIG_FREERTOS_HZ          1000
+#define CONFIG_DSP_MAX_FFT_SIZE     4096
+#define CONFIG_ESP_MIAO_BENCHMARK   1     // AudioCapture::init_replay() / replay()
@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ * check.h - 主機測試共用的檢查巨集
+ * ESP-MIAO v0.8.0
+ *
+ * 每個測試執行檔一個 TU：CHECK 失敗時列印位置與訊息並計數、不中止，
+ * main 最後 return check_report("名稱")，有失敗時回傳非 0（ctest）。
+ */
+
+#include <stdio.h>
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...)                                          \
+    do {                                                          \
+        if (!(cond)) {                                            \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);           \
+            printf(__VA_ARGS__);                                  \
+            printf("\n");                                         \
+            s_failures++;                                         \
+        }                                                         \
+    } while (0)
+
+/** 列印結果並回傳 main 的結束碼 */
+static inline int check_report(const char *name)
+{
+    if (s_failures) {
+        printf("%d check(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("%s: all checks passed\n", name);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * contention_map_test.cpp - 共用資源爭用表測試
+ * ESP-MIAO v0.8.0
+ *
+ *   1. 持有與阻擋分別累計次數 / 總時間 / 最大值，inversion 只在標記時計數
+ *   2. top 依被擋總時間由長到短，超過上限時只留最長的幾條
+ *   3. 超出範圍的資源 / Task 不寫入
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "contention.h"
+
+static contention_map_t s_map;
+
+static void test_aggregate()
+{
+    memset(&s_map, 0, sizeof(s_map));
+    contention_map_hold(&s_map, CONTENTION_SPI, 1, 300);
+    contention_map_hold(&s_map, CONTENTION_SPI, 1, 700);
+    const contention_stat_t &h = s_map.hold[CONTENTION_SPI][1];
+    CHECK(h.count == 2 && h.total_us == 1000 && h.max_us == 700, "hold %lu/%llu/%lu",
+          (unsigned long)h.count, (unsigned long long)h.total_us, (unsigned long)h.max_us);
+
+    contention_map_block(&s_map, CONTENTION_SPI, 1, 2, 50, false);
+    contention_map_block(&s_map, CONTENTION_SPI, 1, 2, 150, true);
+    const contention_stat_t &b = s_map.blocked[CONTENTION_SPI][1][2];
+    CHECK(b.count == 2 && b.total_us == 200 && b.max_us == 150, "blocked %lu/%llu/%lu",
+          (unsigned long)b.count, (unsigned long long)b.total_us, (unsigned long)b.max_us);
+    CHECK(b.inversions == 1, "inversions %lu", (unsigned long)b.inversions);
+    CHECK(s_map.blocked[CONTENTION_SPI][2][1].count == 0, "edge direction swapped");
+
+    /* flash cache 關閉：waiter 為所有 Task */
+    contention_map_block(&s_map, CONTENTION_FLASH, 0, CONTENTION_ALL, 5000, false);
+    CHECK(s_map.blocked[CONTENTION_FLASH][0][CONTENTION_ALL].total_us == 5000, "flash edge missing");
+}
+
+static void test_top()
+{
+    memset(&s_map, 0, sizeof(s_map));
+    contention_map_block(&s_map, CONTENTION_HEAP, 0, 1, 100, false);
+    contention_map_block(&s_map, CONTENTION_SPI, 3, 2, 900, true);
+    contention_map_block(&s_map, CONTENTION_FLASH, 1, CONTENTION_ALL, 400, false);
+    contention_map_block(&s_map, CONTENTION_HEAP, 2, 0, 600, false);
+
+    contention_edge_t e[4];
+    int n = contention_map_top(&s_map, e, 4);
+    CHECK(n == 4, "top returned %d", n);
+    const uint64_t want[4] = { 900, 600, 400, 100 };
+    for (int i = 0; i < n; i++) {
+        CHECK(e[i].stat.total_us == want[i], "edge %d total %llu (want %llu)", i,
+              (unsigned long long)e[i].stat.total_us, (unsigned long long)want[i]);
+    }
+    CHECK(e[0].res == CONTENTION_SPI && e[0].holder == 3 && e[0].waiter == 2, "top edge %u %u->%u",
+          e[0].res, e[0].holder, e[0].waiter);
+    CHECK(e[2].waiter == CONTENTION_ALL, "flash edge waiter %u", e[2].waiter);
+
+    /* 上限 2：只留最長兩條 */
+    n = contention_map_top(&s_map, e, 2);
+    CHECK(n == 2 && e[0].stat.total_us == 900 && e[1].stat.total_us == 600, "truncated top %d: %llu, %llu", n,
+          (unsigned long long)e[0].stat.total_us, (unsigned long long)e[1].stat.total_us);
+
+    memset(&s_map, 0, sizeof(s_map));
+    CHECK(contention_map_top(&s_map, e, 4) == 0, "empty map has edges");
+}
+
+static void test_bounds()
+{
+    memset(&s_map, 0, sizeof(s_map));
+    contention_map_hold(&s_map, CONTENTION_RES_COUNT, 0, 10);
+    contention_map_hold(&s_map, CONTENTION_HEAP, CONTENTION_TASKS, 10);
+    contention_map_block(&s_map, CONTENTION_HEAP, CONTENTION_ALL, 0, 10, false);
+    contention_map_block(&s_map, CONTENTION_HEAP, 0, CONTENTION_ALL + 1, 10, false);
+    contention_edge_t e[1];
+    CHECK(contention_map_top(&s_map, e, 1) == 0, "out-of-range edge recorded");
+    CHECK(strcmp(contention_res_name(CONTENTION_SPI), "spi") == 0, "res name");
+}
+
+int main()
+{
+    test_aggregate();
+    test_top();
+    test_bounds();
+    return check_report("contention map");
+}
@@ -0,0 +1,80 @@
+/*
+ * continuous_gate_test.cpp - 連續串流閘門與頻寬限制測試
+ * ESP-MIAO v0.8.0
+ *
+ *   1. 前 preroll 片無決定；語音前補 preroll 片、語音後續送 hangover 片，其餘不送
+ *   2. 頻寬不足時丟棄，回補到容量一半才恢復；長期平均不超過上限
+ *   3. bytes_per_s = 0 不限制
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "check.h"
+#include "continuous_gate.h"
+
+static void test_gate()
+{
+    ContinuousGate g;
+    g.configure(1, 2, 0, 0);
+
+    /* 切片 0..9，語音在 4、5：送出 3（preroll）、4、5、6、7（hangover） */
+    const bool speech[10] = { 0, 0, 0, 0, 1, 1, 0, 0, 0, 0 };
+    const int  want[10]   = { -1, 0, 0, 0, 1, 1, 1, 1, 1, 0 };   // 推入切片 i 時決定切片 i-1
+    for (int i = 0; i < 10; i++) {
+        int d = g.push(speech[i]);
+        CHECK(d == want[i], "push %d: decision %d (want %d)", i, d, want[i]);
+    }
+
+    /* reset 後重新累積 preroll，之前的語音不再延續 */
+    g.reset();
+    CHECK(g.push(false) == -1, "first push after reset must be undecided");
+    CHECK(g.push(false) == 0, "hangover leaked across reset");
+
+    ContinuousGate none;
+    none.configure(0, 0, 0, 0);
+    CHECK(none.push(true) == 1 && none.push(false) == 0, "zero preroll / hangover: speech slices only");
+}
+
+static void test_rate_limit()
+{
+    ContinuousGate g;
+    g.configure(0, 0, 1000, 2);   // 1000 B/s，容量 2000 B
+
+    int64_t now = 0;
+    int     sent = 0;
+    while (g.take(100, now)) sent++;
+    CHECK(sent == 20 && g.throttled(), "burst sent %d frames (want 20)", sent);
+
+    /* 補回 900 B（< 容量一半）仍丟棄 */
+    now += 900000;
+    CHECK(!g.take(100, now), "resumed below half capacity");
+    /* 再 200 ms：1100 B ≥ 1000 B 恢復 */
+    now += 200000;
+    CHECK(g.take(100, now) && !g.throttled(), "not resumed at half capacity");
+
+    /* 持續以 2 倍速率要求 10 秒：送出量不超過 容量 + 速率 × 時間 */
+    ContinuousGate s;
+    s.configure(0, 0, 1000, 2);
+    uint32_t offered = 0;
+    for (now = 0; now < 10000000; now += 50000) {
+        s.take(100, now);
+        offered += 100;
+    }
+    CHECK(s.sent_bytes() <= 2000 + 10000 + 100, "sent %u bytes over 10 s", (unsigned)s.sent_bytes());
+    CHECK(s.sent_bytes() >= 10000, "sent only %u bytes over 10 s", (unsigned)s.sent_bytes());
+    CHECK(s.sent_bytes() + s.dropped_bytes() == offered, "sent + dropped != offered");
+
+    ContinuousGate free;
+    free.configure(0, 0, 0, 0);
+    for (int i = 0; i < 1000; i++) free.take(1400, 0);
+    CHECK(!free.throttled() && free.dropped_bytes() == 0, "unlimited gate dropped frames");
+}
+
+int main()
+{
+    test_gate();
+    test_rate_limit();
+    return check_report("continuous gate");
+}
@@ -0,0 +1,103 @@
+/*
+ * fft_radix4_test.cpp - 基 4 浮點 FFT 與位元反轉表測試
+ * ESP-MIAO v0.8.0
+ *
+ *   1. 編譯期位元反轉表與逐位元推算一致、每個索引恰好出現一次（對稱者不出現）
+ *   2. fft_radix4_fc32 與 double 直接 DFT 的最大誤差 < kMaxRelError × 峰值
+ *   3. 與 esp-dsp（dsps_fft2r + dsps_bit_rev，主機為 ANSI 版本）輸出一致
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "check.h"
+#include "config.h"
+#include "fft_radix4.h"
+#include "dsps_fft2r.h"
+
+static constexpr int    kH           = FFT_SIZE / 2;
+static constexpr double kMaxRelError = 1e-5;
+
+static void test_bit_reversal()
+{
+    std::vector<int> seen(kH, 0);
+    for (int p = 0; p < BitReversal<kH>::kPairs; p++) {
+        int i = kFftBitRev.pair[p][0], j = kFftBitRev.pair[p][1];
+        int r = 0;
+        for (int b = 1, v = i; b < kH; b <<= 1, v >>= 1) r = (r << 1) | (v & 1);
+        CHECK(i < j && r == j, "pair %d: (%d, %d), bitrev(%d) = %d", p, i, j, i, r);
+        seen[i]++;
+        seen[j]++;
+    }
+    int once = 0;
+    for (int i = 0; i < kH; i++) once += seen[i] == 1;
+    CHECK(once == 2 * BitReversal<kH>::kPairs, "%d indices swapped once, want %d", once,
+          2 * BitReversal<kH>::kPairs);
+}
+
+/* 白噪音 + 兩個正弦（含非整數 bin），固定種子 */
+static void make_input(float *z)
+{
+    uint32_t seed = 2024;
+    for (int n = 0; n < FFT_SIZE; n++) {
+        seed = seed * 1664525u + 1013904223u;
+        float noise = ((int32_t)(seed >> 16) - 32768) / 32768.0f;
+        z[n] = 3000.0f * noise + 8000.0f * sinf(0.31f * n) + 500.0f * cosf(1.7f * n + 0.4f);
+    }
+}
+
+static void test_against_dft()
+{
+    float z[FFT_SIZE];
+    make_input(z);
+    std::vector<double> ref(FFT_SIZE);
+    double peak = 0.0;
+    for (int k = 0; k < kH; k++) {
+        double re = 0.0, im = 0.0;
+        for (int n = 0; n < kH; n++) {
+            double a = -2.0 * M_PI * (double)k * n / kH;
+            re += z[2 * n] * cos(a) - z[2 * n + 1] * sin(a);
+            im += z[2 * n] * sin(a) + z[2 * n + 1] * cos(a);
+        }
+        ref[2 * k]     = re;
+        ref[2 * k + 1] = im;
+        peak = fmax(peak, hypot(re, im));
+    }
+
+    fft_radix4_fc32(z);
+    double err = 0.0;
+    for (int i = 0; i < FFT_SIZE; i++) err = fmax(err, fabs(z[i] - ref[i]));
+    CHECK(err < kMaxRelError * peak, "max error %.3f vs DFT (peak %.0f)", err, peak);
+}
+
+static void test_against_esp_dsp()
+{
+    float a[FFT_SIZE], b[FFT_SIZE];
+    make_input(a);
+    memcpy(b, a, sizeof(a));
+
+    esp_err_t err = dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE);
+    CHECK(err == ESP_OK || err == ESP_ERR_DSP_REINITIALIZED, "dsps_fft2r_init_fc32 0x%x", (unsigned)err);
+    dsps_fft2r_fc32(b, kH);
+    dsps_bit_rev_fc32(b, kH);
+    fft_radix4_fc32(a);
+
+    double diff = 0.0, peak = 0.0;
+    for (int i = 0; i < FFT_SIZE; i++) {
+        diff = fmax(diff, fabs((double)a[i] - b[i]));
+        peak = fmax(peak, fabs((double)b[i]));
+    }
+    CHECK(diff < kMaxRelError * peak, "radix-4 vs esp-dsp max diff %.3f (peak %.0f)", diff, peak);
+}
+
+int main()
+{
+    test_bit_reversal();
+    test_against_dft();
+    test_against_esp_dsp();
+    return check_report("fft radix-4");
+}
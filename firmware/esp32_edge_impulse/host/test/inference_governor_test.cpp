@@ -0,0 +1,110 @@
+/*
+ * inference_governor_test.cpp - 推論分級降級測試
+ * ESP-MIAO v0.8.0
+ *
+ *   1. 負載低於門檻不降級；持續高負載先關閉次要階段、再逐級加倍 stride，止於 max_stride
+ *   2. 切片被覆寫立即降一級；已在最低等級時只計數
+ *   3. 負載回落後需連續 INFER_GOV_RECOVER_RUNS 次才回升一級，最終回到 0
+ *   4. 無次要階段時第一級直接加倍 stride
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "check.h"
+#include "inference_governor.h"
+
+static const uint32_t kSliceUs = 250000;   // 4 切片 / 秒
+
+/* 以固定的「每切片耗時」餵 n 次推論（耗時依目前 stride 放大），回傳等級改變次數 */
+static int feed(InferenceGovernor &g, uint32_t per_slice_us, int n)
+{
+    int changes = 0;
+    for (int i = 0; i < n; i++) changes += g.on_inference(per_slice_us * g.stride());
+    return changes;
+}
+
+static void test_degrade_ladder()
+{
+    InferenceGovernor g;
+    g.configure(kSliceUs, 1, 2, true);
+    CHECK(g.max_level() == 2, "max level %d (want 2: secondary off, stride x2)", g.max_level());
+
+    feed(g, kSliceUs * 80 / 100, 200);
+    CHECK(g.level() == 0 && g.stride() == 1 && g.secondary_enabled(), "degraded at 80%% load (level %d)",
+          g.level());
+
+    /* 推論比切片還慢：先關閉次要階段 */
+    feed(g, kSliceUs * 95 / 100, INFER_GOV_DEGRADE_RUNS + 8);
+    CHECK(g.level() >= 1 && !g.secondary_enabled(), "level %d after sustained 95%% load", g.level());
+    feed(g, kSliceUs * 95 / 100, 4 * INFER_GOV_DEGRADE_RUNS + 40);
+    CHECK(g.level() == 2 && g.stride() == 2, "level %d stride %d (want 2, 2)", g.level(), g.stride());
+    CHECK(g.steps_down() == 2, "steps down %u (want 2)", (unsigned)g.steps_down());
+
+    /* stride 2 下每切片 95% 只占預算 47%：不再降、也不回升（回升預估 95% > 門檻） */
+    feed(g, kSliceUs * 95 / 100, 400);
+    CHECK(g.level() == 2, "level %d, want to stay at 2", g.level());
+}
+
+static void test_overrun()
+{
+    InferenceGovernor g;
+    g.configure(kSliceUs, 1, 4, true);
+    CHECK(g.max_level() == 3, "max level %d (want 3)", g.max_level());
+    CHECK(g.on_overrun() && g.level() == 1, "first overrun: level %d", g.level());
+    CHECK(g.on_overrun() && g.stride() == 2, "second overrun: stride %d", g.stride());
+    CHECK(g.on_overrun() && g.stride() == 4, "third overrun: stride %d", g.stride());
+    CHECK(!g.on_overrun() && g.level() == 3, "overrun at max level changed level to %d", g.level());
+    CHECK(g.overruns() == 4 && g.steps_down() == 3, "overruns %u steps %u", (unsigned)g.overruns(),
+          (unsigned)g.steps_down());
+}
+
+static void test_recovery()
+{
+    InferenceGovernor g;
+    g.configure(kSliceUs, 1, 4, true);
+    while (g.on_overrun()) {}
+
+    /* 每切片 20%：回升預估 40% < 60%，但需連續 RECOVER_RUNS 次 */
+    int changes = feed(g, kSliceUs * 20 / 100, INFER_GOV_RECOVER_RUNS - 1);
+    CHECK(changes == 0 && g.level() == 3, "recovered too early (level %d)", g.level());
+    feed(g, kSliceUs * 20 / 100, 1);
+    CHECK(g.level() == 2, "level %d after %d cool runs (want 2)", g.level(), INFER_GOV_RECOVER_RUNS);
+
+    feed(g, kSliceUs * 20 / 100, 3 * INFER_GOV_RECOVER_RUNS + 10);
+    CHECK(g.level() == 0 && g.stride() == 1 && g.secondary_enabled(), "level %d stride %d after recovery",
+          g.level(), g.stride());
+
+    /* 中途負載回升（平滑值超過回升門檻、未到降級門檻）會重新計數 */
+    g.on_overrun();
+    feed(g, kSliceUs * 20 / 100, INFER_GOV_RECOVER_RUNS / 2);
+    feed(g, kSliceUs * 90 / 100, 8);
+    CHECK(g.level() == 1, "level %d after a warm burst (want 1)", g.level());
+    feed(g, kSliceUs * 20 / 100, INFER_GOV_RECOVER_RUNS / 2);
+    CHECK(g.level() == 1, "recovery counter not reset by a hot run (level %d)", g.level());
+}
+
+static void test_no_secondary()
+{
+    InferenceGovernor g;
+    g.configure(kSliceUs, 2, 8, false);
+    CHECK(g.max_level() == 2, "max level %d (want 2: stride 4, 8)", g.max_level());
+    CHECK(g.secondary_enabled(), "no secondary stage must report enabled");
+    g.on_overrun();
+    CHECK(g.stride() == 4 && g.secondary_enabled(), "level 1 stride %d (want 4)", g.stride());
+
+    InferenceGovernor fixed;
+    fixed.configure(kSliceUs, 4, 2, false);
+    CHECK(fixed.max_level() == 0 && !fixed.on_overrun() && fixed.stride() == 4,
+          "base stride above max must not degrade");
+}
+
+int main()
+{
+    test_degrade_ladder();
+    test_overrun();
+    test_recovery();
+    test_no_secondary();
+    return check_report("inference governor");
+}
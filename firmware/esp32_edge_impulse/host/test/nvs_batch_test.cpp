@@ -0,0 +1,146 @@
+/*
+ * nvs_batch_test.cpp - NVS 延後寫入待寫表測試
+ * ESP-MIAO v0.8.0
+ *
+ *   1. 同一 ns / key 覆蓋舊值（保留第一次排入時間），pool 移除後保持連續
+ *   2. 表或 pool 已滿時拒絕，且不影響既有項目
+ *   3. 連續安靜 quiet_us 或最舊項目等待 max_defer_us 才寫出；中途有語音重新計算
+ *   4. requeue 放回寫出失敗的項目並保留原本的排入時間；寫出期間已有新值時保留新值
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "nvs_batch.h"
+
+static bool put_str(NvsBatch &b, const char *ns, const char *key, const char *s, int64_t now)
+{
+    return b.put(ns, key, NVS_VALUE_STR, s, strlen(s) + 1, now);
+}
+
+static const NvsBatchEntry *find(const NvsBatch &b, const char *key)
+{
+    for (int i = 0; i < b.count(); i++) {
+        if (strcmp(b.entry(i).key, key) == 0) return &b.entry(i);
+    }
+    return nullptr;
+}
+
+static void test_coalesce()
+{
+    static NvsBatch b;
+    b.clear();
+    CHECK(put_str(b, "storage", "srv_urls", "ws://a:1,ws://b:2", 100), "put urls");
+    uint8_t chan = 6;
+    CHECK(b.put("storage", "wifi_chan", NVS_VALUE_U8, &chan, 1, 200), "put chan");
+    CHECK(put_str(b, "storage", "srv_disc", "10.0.0.2:8000", 300), "put disc");
+
+    /* 覆蓋第一個值：舊值移除、後面的值往前搬 */
+    CHECK(put_str(b, "storage", "srv_urls", "ws://c:3", 400), "overwrite urls");
+    CHECK(b.count() == 3, "count %d", b.count());
+    CHECK(b.coalesced() == 1, "coalesced %lu", (unsigned long)b.coalesced());
+
+    const NvsBatchEntry *urls = find(b, "srv_urls");
+    const NvsBatchEntry *disc = find(b, "srv_disc");
+    const NvsBatchEntry *ch   = find(b, "wifi_chan");
+    CHECK(urls && strcmp((const char *)b.value(*urls), "ws://c:3") == 0, "urls value");
+    CHECK(urls && urls->queued_us == 100, "urls queued %lld", urls ? (long long)urls->queued_us : -1LL);
+    CHECK(disc && strcmp((const char *)b.value(*disc), "10.0.0.2:8000") == 0, "disc value after compaction");
+    CHECK(ch && ch->len == 1 && b.value(*ch)[0] == 6, "chan value after compaction");
+    CHECK(b.oldest_us() == 100, "oldest %lld", (long long)b.oldest_us());
+
+    /* 同名 key、不同 namespace 是不同項目 */
+    CHECK(put_str(b, "other", "srv_urls", "x", 500), "put other ns");
+    CHECK(b.count() == 4, "count %d", b.count());
+}
+
+static void test_full()
+{
+    static NvsBatch b;
+    b.clear();
+    char key[8];
+    for (int i = 0; i < NVS_BATCH_SLOTS; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        CHECK(put_str(b, "ns", key, "v", i), "put %d", i);
+    }
+    CHECK(!put_str(b, "ns", "extra", "v", 9), "slot overflow accepted");
+    CHECK(put_str(b, "ns", "k3", "w", 10), "overwrite in full table");
+
+    b.clear();
+    static uint8_t big[NVS_BATCH_POOL_BYTES];
+    memset(big, 0x5a, sizeof(big));
+    CHECK(b.put("ns", "big", NVS_VALUE_BLOB, big, sizeof(big) - 8, 0), "put big");
+    CHECK(!b.put("ns", "more", NVS_VALUE_BLOB, big, 16, 1), "pool overflow accepted");
+    CHECK(b.put("ns", "big", NVS_VALUE_BLOB, big, sizeof(big), 2), "overwrite reuses old space");
+    CHECK(b.count() == 1 && b.entry(0).len == sizeof(big), "big entry len %u", b.entry(0).len);
+    CHECK(!b.put("this_ns_is_too_long", "k", NVS_VALUE_U8, big, 1, 3), "long namespace accepted");
+}
+
+static void test_due()
+{
+    static NvsBatch b;
+    b.clear();
+    b.configure(500, 10000);
+
+    CHECK(!b.due(0, true), "empty batch due");
+    CHECK(put_str(b, "ns", "k", "v", 100), "put");
+    CHECK(!b.due(200, true), "due before quiet window");   // 安靜自 0 起算
+    CHECK(b.due(500, true), "not due after quiet window");
+    CHECK(b.quiet_enough(500), "quiet_enough");
+
+    /* 語音打斷安靜時段：重新計算 */
+    CHECK(!b.due(600, false), "due while busy");
+    CHECK(!b.due(700, true), "due right after busy");
+    CHECK(!b.due(1100, true), "due before new window");
+    CHECK(b.due(1200, true), "not due after new window");
+
+    /* 一直不安靜：最舊項目等到 max_defer 強制寫出 */
+    CHECK(!b.due(10000, false), "due before max defer");
+    CHECK(b.due(10100, false), "not due at max defer");
+    CHECK(!b.quiet_enough(10100), "quiet while busy");
+}
+
+static void test_requeue()
+{
+    static NvsBatch b, inflight;
+    b.clear();
+    inflight.clear();
+    CHECK(put_str(inflight, "storage", "wifi_ap", "home", 100), "put ap");
+    CHECK(put_str(inflight, "storage", "srv_urls", "ws://a:1", 200), "put urls");
+
+    /* 寫出期間 srv_urls 排入新值；兩個項目都寫出失敗 */
+    CHECK(put_str(b, "storage", "srv_urls", "ws://b:2", 900), "put newer urls");
+    for (int i = 0; i < inflight.count(); i++) {
+        const NvsBatchEntry &e = inflight.entry(i);
+        CHECK(b.requeue(e, inflight.value(e)), "requeue %s", e.key);
+    }
+    CHECK(b.count() == 2, "count %d", b.count());
+    const NvsBatchEntry *ap   = find(b, "wifi_ap");
+    const NvsBatchEntry *urls = find(b, "srv_urls");
+    CHECK(ap && strcmp((const char *)b.value(*ap), "home") == 0 && ap->queued_us == 100, "ap requeued");
+    CHECK(urls && strcmp((const char *)b.value(*urls), "ws://b:2") == 0, "newer urls value kept");
+    CHECK(urls && urls->queued_us == 200, "urls queued %lld", urls ? (long long)urls->queued_us : -1LL);
+    CHECK(b.oldest_us() == 100, "oldest %lld", (long long)b.oldest_us());
+
+    /* 表已滿時放不回 */
+    char key[NVS_BATCH_NAME_LEN];
+    for (int i = b.count(); i < NVS_BATCH_SLOTS; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        put_str(b, "ns", key, "v", 1000);
+    }
+    NvsBatchEntry extra = inflight.entry(0);
+    strcpy(extra.key, "lost");
+    CHECK(!b.requeue(extra, inflight.value(inflight.entry(0))), "requeue into a full table accepted");
+}
+
+int main()
+{
+    test_coalesce();
+    test_full();
+    test_due();
+    test_requeue();
+    return check_report("nvs batch");
+}
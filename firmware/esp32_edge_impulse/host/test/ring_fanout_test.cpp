@@ -0,0 +1,130 @@
+/*
+ * ring_fanout_test.cpp - 環形緩衝多消費者扇出測試
+ * ESP-MIAO v0.8.0
+ *
+ * 單一生產者寫入、多個游標各自讀取：
+ *   1. 游標登記：固定編號 claim 後 open_reader 只拿到其餘空位，滿了回傳 -1
+ *   2. 各游標讀到的樣本與寫入內容逐一相同（扇出不複製、互不影響）
+ *   3. READER_DROP 的慢讀者被覆寫：overruns 累計、跳到最舊的有效樣本，其他讀者不受影響
+ *   4. READER_HOLD 的慢讀者不被覆寫：寫入被截斷、held_drops 累計，讀者跟上後恢復寫入
+ *   5. max_lag 記錄讀取前的最大落後，reset_lag_peak 後歸零
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "check.h"
+#include "audio_ring_buffer.h"
+
+static constexpr size_t kCapacity = 1024;
+static constexpr size_t kUsable   = kCapacity - kCapacity / 8;   // 同 AudioRingBuffer::attach_
+static constexpr size_t kBlock    = 64;
+
+/* 樣本值 = 絕對位置（int16 截斷），讀取端可直接驗證位置 */
+static size_t write_ramp(AudioRingBuffer &ring, uint32_t *next, size_t n)
+{
+    std::vector<int16_t> block(n);
+    for (size_t i = 0; i < n; i++) block[i] = (int16_t)(*next + i);
+    size_t written = ring.write(block.data(), n);
+    *next += (uint32_t)written;
+    return written;
+}
+
+static bool read_matches(AudioRingBuffer &ring, int reader, size_t n)
+{
+    std::vector<int16_t> out(n);
+    if (ring.read(reader, out.data(), n) != n) return false;
+    uint32_t pos = ring.position(reader) - (uint32_t)n;   // read 可能先跳過被覆寫的部分
+    for (size_t i = 0; i < n; i++) {
+        if (out[i] != (int16_t)(pos + i)) return false;
+    }
+    return true;
+}
+
+static void test_registration()
+{
+    static int16_t   storage[kCapacity];
+    AudioRingBuffer ring;
+    CHECK(ring.init(storage, kCapacity), "init");
+    CHECK(ring.claim_reader(0), "claim 0");
+    CHECK(ring.claim_reader(1), "claim 1");
+    CHECK(!ring.claim_reader(1), "claim 1 twice should report already claimed");
+
+    int a = ring.open_reader();
+    int b = ring.open_reader(AudioRingBuffer::READER_HOLD);
+    CHECK(a == 2 && b == 3, "open_reader returned %d, %d (want 2, 3)", a, b);
+    CHECK(ring.open_reader() == -1, "open_reader should fail when all slots are taken");
+    CHECK(ring.reader_stats(b).policy == AudioRingBuffer::READER_HOLD, "policy of reader %d", b);
+
+    ring.close_reader(a);
+    CHECK(ring.open_reader() == a, "closed slot should be reused");
+}
+
+static void test_fanout_drop()
+{
+    static int16_t   storage[kCapacity];
+    AudioRingBuffer ring;
+    ring.init(storage, kCapacity);
+    int fast = ring.open_reader();
+    int slow = ring.open_reader();
+    uint32_t next = 0;
+
+    /* 快讀者每個區塊都讀，慢讀者完全不讀 */
+    for (int i = 0; i < 40; i++) {
+        CHECK(write_ramp(ring, &next, kBlock) == kBlock, "DROP readers must never limit the writer");
+        CHECK(read_matches(ring, fast, kBlock), "fast reader data mismatch at block %d", i);
+    }
+    CHECK(ring.overruns(fast) == 0, "fast reader overruns %u", (unsigned)ring.overruns(fast));
+
+    uint32_t lag = ring.reader_stats(slow).lag;
+    CHECK(lag == next, "slow reader lag %u (want %u)", (unsigned)lag, (unsigned)next);
+    CHECK(read_matches(ring, slow, kBlock), "slow reader should resume at the oldest retained sample");
+    CHECK(ring.overruns(slow) == next - kUsable, "slow reader overruns %u (want %u)",
+          (unsigned)ring.overruns(slow), (unsigned)(next - kUsable));
+    CHECK(ring.reader_stats(slow).max_lag == next, "slow reader max_lag %u", (unsigned)ring.reader_stats(slow).max_lag);
+    CHECK(ring.held_drops() == 0, "no HOLD reader, held_drops %u", (unsigned)ring.held_drops());
+
+    ring.reset_lag_peak(slow);
+    CHECK(ring.reader_stats(slow).max_lag == 0, "reset_lag_peak");
+}
+
+static void test_hold()
+{
+    static int16_t   storage[kCapacity];
+    AudioRingBuffer ring;
+    ring.init(storage, kCapacity);
+    int live = ring.open_reader();
+    int hold = ring.open_reader(AudioRingBuffer::READER_HOLD);
+    uint32_t next = 0;
+
+    /* 寫滿 HOLD 讀者的可用範圍後，新的樣本被捨棄 */
+    size_t accepted = 0;
+    for (size_t i = 0; i < kCapacity / kBlock; i++) accepted += write_ramp(ring, &next, kBlock);
+    CHECK(accepted == kUsable, "HOLD reader should cap the writer at %u, got %u",
+          (unsigned)kUsable, (unsigned)accepted);
+    CHECK(ring.held_drops() == kCapacity - kUsable, "held_drops %u (want %u)",
+          (unsigned)ring.held_drops(), (unsigned)(kCapacity - kUsable));
+
+    /* 整段未被覆寫：HOLD 讀者完整讀到第一個樣本起的所有資料 */
+    CHECK(read_matches(ring, hold, kUsable), "HOLD reader lost data");
+    CHECK(ring.overruns(hold) == 0, "HOLD reader overruns %u", (unsigned)ring.overruns(hold));
+    CHECK(read_matches(ring, live, kBlock), "DROP reader next to a HOLD reader");
+
+    /* 跟上之後恢復寫入；改回 DROP 後不再限制 */
+    CHECK(write_ramp(ring, &next, kBlock) == kBlock, "writer should resume after the HOLD reader caught up");
+    ring.set_policy(hold, AudioRingBuffer::READER_DROP);
+    for (size_t i = 0; i < kCapacity / kBlock; i++) {
+        CHECK(write_ramp(ring, &next, kBlock) == kBlock, "DROP policy must not limit the writer");
+    }
+    CHECK(ring.held_drops() == kCapacity - kUsable, "held_drops changed after switching to DROP");
+}
+
+int main()
+{
+    test_registration();
+    test_fanout_drop();
+    test_hold();
+    return check_report("ring fan-out");
+}
@@ -0,0 +1,104 @@
+/*
+ * seqlock_test.cpp - 遙測快照 seqlock 測試
+ * ESP-MIAO v0.8.0
+ *
+ *   1. 尚未寫入時 read 回 false，*out 不變
+ *   2. 單執行緒寫入後讀回相同內容，version 隨寫入遞增
+ *   3. 一個寫入執行緒持續更新（每次寫入間隔數 us），讀取執行緒讀到的每份快照都必須一致（不混合兩次寫入）
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "check.h"
+#include "seqlock.h"
+
+/* 每個欄位都由同一個 n 推得，讀到混合的快照即可察覺 */
+struct Payload {
+    uint32_t n;
+    uint32_t words[30];
+    float    f;
+    uint8_t  tail[3];
+};
+
+static void fill(Payload *p, uint32_t n)
+{
+    p->n = n;
+    for (int i = 0; i < 30; i++) p->words[i] = n * 31u + (uint32_t)i;
+    p->f = (float)(n & 0xffff);
+    for (int i = 0; i < 3; i++) p->tail[i] = (uint8_t)(n + i);
+}
+
+static bool consistent(const Payload &p)
+{
+    for (int i = 0; i < 30; i++) {
+        if (p.words[i] != p.n * 31u + (uint32_t)i) return false;
+    }
+    if (p.f != (float)(p.n & 0xffff)) return false;
+    for (int i = 0; i < 3; i++) {
+        if (p.tail[i] != (uint8_t)(p.n + i)) return false;
+    }
+    return true;
+}
+
+static void test_single_thread()
+{
+    Seqlock<Payload> lock;
+    Payload out;
+    fill(&out, 7);
+    CHECK(!lock.read(&out) && out.n == 7, "read before first write must fail and leave *out");
+    CHECK(lock.version() == 0, "version %u before write", (unsigned)lock.version());
+
+    Payload in;
+    fill(&in, 42);
+    lock.write(in);
+    fill(&in, 43);
+    lock.write(in);
+    CHECK(lock.read(&out) && out.n == 43 && consistent(out), "read back n=%u", (unsigned)out.n);
+    CHECK(lock.version() == 2, "version %u after two writes", (unsigned)lock.version());
+}
+
+static void test_concurrent()
+{
+    static Seqlock<Payload> lock;
+    std::atomic<bool>       stop(false);
+
+    std::thread writer([&] {
+        Payload p;
+        for (uint32_t n = 1; !stop.load(std::memory_order_relaxed); n++) {
+            fill(&p, n);
+            lock.write(p);
+            /* 韌體的寫入端最快每切片一次；不留空檔時讀取端 4 次重試幾乎都會撞上寫入中 */
+            std::this_thread::sleep_for(std::chrono::microseconds(2));
+        }
+    });
+
+    /* 讀到 100000 份快照或 2 秒為止（寫入執行緒可能晚於讀取端開始） */
+    uint32_t reads = 0, torn = 0, backwards = 0, last = 0;
+    auto     deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (reads < 100000 && std::chrono::steady_clock::now() < deadline) {
+        Payload p;
+        if (!lock.read(&p)) continue;
+        reads++;
+        if (!consistent(p)) torn++;
+        if (p.n < last) backwards++;
+        last = p.n;
+    }
+    stop = true;
+    writer.join();
+
+    CHECK(reads > 1000, "only %u successful reads in 2 s", (unsigned)reads);
+    CHECK(torn == 0, "%u torn snapshots out of %u reads", (unsigned)torn, (unsigned)reads);
+    CHECK(backwards == 0, "%u snapshots went backwards", (unsigned)backwards);
+}
+
+int main()
+{
+    test_single_thread();
+    test_concurrent();
+    return check_report("seqlock");
+}
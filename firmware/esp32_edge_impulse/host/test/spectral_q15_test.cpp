@@ -0,0 +1,152 @@
+/*
+ * spectral_q15_test.cpp - Q15 定點 MFCC 前端與浮點引擎的一致性測試
+ * ESP-MIAO v0.8.0
+ *
+ * 同一個模型視窗（model_variables.h 的 MFCC 參數）分別以 ENGINE_FLOAT 與 ENGINE_Q15 處理：
+ *   1. features()（mean/min-max，本模型 implementation v4 的正規化）最大絕對誤差
+ *      < SHARED_SPECTRUM_TOLERANCE（開機比對用的同一門檻）；mean/var 在穩態訊號上
+ *      視窗變異數趨近 0，float 前綴和相減本身就不穩定，不在此比較
+ *   2. VAD 頻帶能量相對誤差 < kMaxRelError（極小能量另有絕對容差）
+ *   3. features_i8() 與 float 特徵量化後相差不超過 1 LSB
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "config.h"
+#include "pcm_convert.h"
+#include "audio_capture.h"
+#include "spectral_frontend.h"
+
+static constexpr float  kMaxRelError   = 0.01f;
+static constexpr float  kMaxAbsError   = 2.0f;
+static constexpr size_t kWindowSamples = SAMPLE_RATE;   // 1 s 模型視窗
+static constexpr float  kI8Scale       = 1.0f / 256.0f; // 0~1 特徵的典型量化參數
+static constexpr int    kI8ZeroPoint   = -128;
+
+struct Signal {
+    const char *name;
+    float noise;      // 白噪音振幅
+    float tone;       // 正弦振幅
+    float tone_hz;
+    float chirp;      // 300~3400 Hz 掃頻振幅（類語音的時變頻譜）
+};
+
+static const Signal kSignals[] = {
+    {"noise 3",        3.0f,     0.0f,     0.0f,    0.0f},
+    {"noise 60",       60.0f,    0.0f,     0.0f,    0.0f},
+    {"noise 6000",     6000.0f,  0.0f,     0.0f,    0.0f},
+    {"tone 1000",      200.0f,   8000.0f,  1000.0f, 0.0f},
+    {"tone 6000",      50.0f,    20000.0f, 6000.0f, 0.0f},
+    {"chirp quiet",    10.0f,    0.0f,     0.0f,    300.0f},
+    {"chirp loud",     100.0f,   0.0f,     0.0f,    25000.0f},
+};
+
+/* 線性同餘白噪音 + 正弦 + 掃頻，飽和到 int16 */
+static std::vector<int16_t> make_signal(const Signal &s, size_t n, uint32_t seed)
+{
+    std::vector<int16_t> pcm(n);
+    double phase = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        float noise = ((int32_t)(seed >> 16) - 32768) / 32768.0f;
+        float t     = (float)i / SAMPLE_RATE;
+        phase += 2.0 * M_PI * (300.0 + 3100.0 * fmod(t * 3.0, 1.0)) / SAMPLE_RATE;
+        float x = s.noise * noise
+                + s.tone  * sinf(2.0f * (float)M_PI * s.tone_hz * t)
+                + s.chirp * (float)sin(phase) * (0.5f + 0.5f * sinf(2.0f * (float)M_PI * 4.0f * t));
+        pcm[i] = pcm_saturate_i16((int32_t)lrintf(x));
+    }
+    return pcm;
+}
+
+/* model_variables.h 的 MFCC 區塊（frame 0.025 s / stride 0.02 s、32 濾波器、13 cepstra） */
+static MfccParams model_params()
+{
+    MfccParams p;
+    p.frame_length = 400;
+    p.frame_stride = 320;
+    p.fft_length   = FFT_SIZE;
+    p.num_filters  = 32;
+    p.num_cepstral = 13;
+    p.low_hz       = 80.0f;
+    p.high_hz      = 0.0f;
+    p.pre_cof      = 0.98f;
+    p.pre_shift    = 1;
+    p.win_size     = 151;
+    return p;
+}
+
+static size_t run(SpectralFrontend &fe, const AudioSlice &window, float *energies, size_t cap)
+{
+    fe.reset();
+    fe.prime_preemphasis(window);
+    return fe.process(window, energies, cap, nullptr);
+}
+
+int main()
+{
+    static SpectralFrontend ref, q15;
+    if (!ref.init(model_params(), kWindowSamples) || !q15.init(model_params(), kWindowSamples)) {
+        printf("FAILED: front-end init\n");
+        return 1;
+    }
+    ref.set_engine(SpectralFrontend::ENGINE_FLOAT);
+    q15.set_engine(SpectralFrontend::ENGINE_Q15);
+
+    const size_t n = ref.feature_count();
+    std::vector<float>  want(n), got(n);
+    std::vector<int8_t> got_i8(n);
+    static float e_ref[SpectralFrontend::MAX_WINDOW_FRAMES], e_q15[SpectralFrontend::MAX_WINDOW_FRAMES];
+    int   failures = 0;
+    float worst = 0.0f;
+
+    for (const Signal &s : kSignals) {
+        std::vector<int16_t> pcm = make_signal(s, kWindowSamples, 4242u);
+        AudioSlice window = {};
+        window.size   = kWindowSamples;
+        window.seg[0] = pcm.data();
+        window.len[0] = kWindowSamples;
+
+        size_t frames = run(ref, window, e_ref, SpectralFrontend::MAX_WINDOW_FRAMES);
+        run(q15, window, e_q15, SpectralFrontend::MAX_WINDOW_FRAMES);
+        for (size_t f = 0; f < frames; f++) {
+            float err = fabsf(e_q15[f] - e_ref[f]);
+            if (err > kMaxRelError * e_ref[f] + kMaxAbsError) {
+                printf("FAIL %-12s frame %2zu: band energy float=%.1f q15=%.1f\n", s.name, f, e_ref[f], e_q15[f]);
+                failures++;
+            }
+        }
+
+        ref.features(want.data());
+        q15.features(got.data());
+        float diff = 0.0f;
+        for (size_t i = 0; i < n; i++) diff = fmaxf(diff, fabsf(got[i] - want[i]));
+        if (!(diff <= SHARED_SPECTRUM_TOLERANCE)) {
+            printf("FAIL %-12s max feature error %.5f\n", s.name, diff);
+            failures++;
+        }
+        worst = fmaxf(worst, diff);
+        printf("     %-12s max feature error %.5f\n", s.name, diff);
+
+        /* int8：與 Q15 引擎自己的 float 特徵量化比較（min-max 範圍 0~1） */
+        q15.features_i8(got_i8.data(), kI8Scale, kI8ZeroPoint);
+        for (size_t i = 0; i < n; i++) {
+            long q = lrintf(got[i] / kI8Scale) + kI8ZeroPoint;
+            q = q > 127 ? 127 : q < -128 ? -128 : q;
+            if (labs(q - got_i8[i]) > 1) {
+                printf("FAIL %-12s int8 feature %zu: %d != %ld\n", s.name, i, got_i8[i], q);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    printf("%s: %zu signals, worst feature error %.5f (tolerance %.3f)\n",
+           failures ? "FAILED" : "PASSED", sizeof(kSignals) / sizeof(kSignals[0]), worst,
+           SHARED_SPECTRUM_TOLERANCE);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * spsc_channel_test.cpp - 跨 Task SPSC 訊息通道測試
+ * ESP-MIAO v0.8.0
+ *
+ *   1. 空通道 pop / pop_wait 回 false，*out 不變
+ *   2. 容量 3（slot 數取 4）：第 4 筆 push 被拒、計入 dropped，取出順序與 push 相同
+ *   3. 索引跨越 slot 數多次回繞後仍依序取出，統計的 pushed / popped / depth_max 正確，take_stats 後區間欄位歸零
+ *   4. 一個生產者、一個消費者執行緒交接 200000 筆遞增序號（通道常滿），消費端看到的序號必須連續不缺、不重複
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+
+#include "check.h"
+#include "spsc_channel.h"
+
+struct Msg {
+    uint32_t seq;
+    uint32_t check;   // = ~seq，讀到未寫完的 slot 即可察覺
+};
+
+static void test_empty()
+{
+    SpscChannel<Msg, 3> ch;
+    Msg out = { 7, 0 };
+    CHECK(!ch.pop(&out) && out.seq == 7, "pop on an empty channel must fail and leave *out");
+    CHECK(!ch.pop_wait(&out, 0) && out.seq == 7, "pop_wait(0) on an empty channel must fail");
+    CHECK(ch.empty() && ch.depth() == 0, "depth %u on an empty channel", (unsigned)ch.depth());
+}
+
+static void test_full()
+{
+    SpscChannel<Msg, 3> ch;
+    for (uint32_t i = 0; i < 3; i++) CHECK(ch.push({ i, ~i }), "push %u below capacity failed", (unsigned)i);
+    CHECK(!ch.push({ 3, ~3u }), "push beyond CAPACITY=3 must fail even though there are 4 slots");
+    CHECK(ch.dropped() == 1, "dropped %u after one rejected push", (unsigned)ch.dropped());
+    CHECK(ch.depth() == 3, "depth %u when full", (unsigned)ch.depth());
+
+    Msg out;
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK(ch.pop(&out) && out.seq == i, "pop %u returned seq %u", (unsigned)i, (unsigned)out.seq);
+    }
+    CHECK(!ch.pop(&out), "channel must be empty after draining");
+    CHECK(ch.push({ 9, ~9u }), "push after draining failed");
+}
+
+static void test_wrap_and_stats()
+{
+    SpscChannel<Msg, 3> ch;
+    Msg      out;
+    uint32_t next = 0, expect = 0, bad = 0;
+    /* 每輪推 2 筆取 2 筆，索引跨越 4 個 slot 很多次 */
+    for (int round = 0; round < 50; round++) {
+        for (int k = 0; k < 2; k++, next++) ch.push({ next, ~next });
+        while (ch.pop(&out)) {
+            if (out.seq != expect || out.check != ~expect) bad++;
+            expect++;
+        }
+    }
+    CHECK(bad == 0, "%u out-of-order or corrupt messages after wraparound", (unsigned)bad);
+
+    SpscChannelStats st = ch.take_stats();
+    CHECK(st.pushed == 100 && st.popped == 100, "pushed %u popped %u", (unsigned)st.pushed, (unsigned)st.popped);
+    CHECK(st.depth == 0 && st.depth_max == 2, "depth %u depth_max %u", (unsigned)st.depth, (unsigned)st.depth_max);
+    CHECK(st.dropped == 0, "dropped %u", (unsigned)st.dropped);
+    CHECK(st.latency_max_us >= st.latency_avg_us, "latency max %u < avg %u", (unsigned)st.latency_max_us,
+          (unsigned)st.latency_avg_us);
+
+    st = ch.take_stats();
+    CHECK(st.pushed == 100 && st.depth_max == 0 && st.latency_max_us == 0,
+          "window fields must reset: pushed %u depth_max %u lat_max %u", (unsigned)st.pushed,
+          (unsigned)st.depth_max, (unsigned)st.latency_max_us);
+}
+
+static void test_concurrent()
+{
+    static SpscChannel<Msg, 8> ch;
+    const uint32_t kCount = 200000;
+
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < kCount;) {
+            if (ch.push({ i, ~i })) i++;
+            else std::this_thread::yield();
+        }
+    });
+
+    uint32_t expect = 0, bad = 0;
+    while (expect < kCount) {
+        Msg m;
+        if (!ch.pop(&m)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (m.seq != expect || m.check != ~expect) bad++;
+        expect = m.seq + 1;
+    }
+    producer.join();
+
+    CHECK(bad == 0, "%u messages out of order or torn", (unsigned)bad);
+    SpscChannelStats st = ch.take_stats();
+    CHECK(st.pushed == kCount && st.popped == kCount, "pushed %u popped %u", (unsigned)st.pushed,
+          (unsigned)st.popped);
+    CHECK(st.depth_max <= 8, "depth_max %u exceeds capacity", (unsigned)st.depth_max);
+}
+
+int main()
+{
+    test_empty();
+    test_full();
+    test_wrap_and_stats();
+    test_concurrent();
+    return check_report("spsc_channel");
+}
@@ -0,0 +1,79 @@
+/*
+ * stream_pacer_test.cpp - 上行節奏控制測試
+ * ESP-MIAO v0.8.0
+ *
+ *   1. 好鏈路：送出耗時穩定且遠短於音訊時長，在途上限維持最大
+ *   2. 排隊延遲（平滑送出耗時 - 基準）超過 STREAM_PACE_QUEUE_MS 時減半
+ *   3. 單一 frame 送得比音訊時長久即減半；減半後隔 window + 1 個 frame 才再減
+ *   4. 恢復後每個視窗加 1，回到最大
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "check.h"
+#include "stream_pacer.h"
+
+static const uint32_t kFrameUs = 64000;   // 1024 樣本 @ 16 kHz
+
+static void test_good_link()
+{
+    StreamPacer p;
+    p.reset(3);
+    for (int i = 0; i < 100; i++) p.on_sent(2000 + (i % 3) * 500, kFrameUs);
+    CHECK(p.window() == 3 && p.min_window() == 3, "window %u min %u (want 3)", p.window(), p.min_window());
+    CHECK(p.backoffs() == 0, "backoffs %u on a good link", (unsigned)p.backoffs());
+}
+
+static void test_queue_growth_and_recovery()
+{
+    StreamPacer p;
+    p.reset(3);
+    for (int i = 0; i < 10; i++) p.on_sent(2000, kFrameUs);
+    /* 送出緩衝滿：每個 frame 阻塞 60 ms（仍短於音訊時長），平滑值第三個 frame 超過 2 + 30 ms */
+    p.on_sent(60000, kFrameUs);
+    p.on_sent(60000, kFrameUs);
+    CHECK(p.window() == 3, "backed off too early (queue %u us)", (unsigned)p.queue_us());
+    p.on_sent(60000, kFrameUs);
+    CHECK(p.window() == 1 && p.backoffs() == 1, "window %u backoffs %u (want 1, 1)", p.window(),
+          (unsigned)p.backoffs());
+    for (int i = 0; i < 10; i++) p.on_sent(60000, kFrameUs);
+    CHECK(p.window() == 1 && p.min_window() == 1, "window must stay >= 1");
+
+    /* 佇列清空：平滑值回落後逐一加回 */
+    int frames = 0;
+    while (p.window() < 3 && frames < 100) {
+        p.on_sent(2000, kFrameUs);
+        frames++;
+    }
+    CHECK(p.window() == 3, "did not recover (window %u after %d frames)", p.window(), frames);
+    CHECK(frames > 3, "recovered after only %d frames", frames);
+}
+
+static void test_slower_than_realtime_and_hold()
+{
+    StreamPacer p;
+    p.reset(8);
+    /* 每個 frame 都送得比音訊久（基準即為此值，排隊估計為 0） */
+    int backoff_at[3] = {0, 0, 0};
+    for (int i = 1; i <= 12; i++) {
+        uint32_t before = p.backoffs();
+        p.on_sent(100000, kFrameUs);
+        if (p.backoffs() != before && before < 3) backoff_at[before] = i;
+    }
+    CHECK(backoff_at[0] == 1 && backoff_at[1] == 6 && backoff_at[2] == 9,
+          "back-offs at frames %d, %d, %d (want 1, 6, 9)", backoff_at[0], backoff_at[1], backoff_at[2]);
+    CHECK(p.window() == 1 && p.backoffs() == 3, "window %u backoffs %u", p.window(), (unsigned)p.backoffs());
+
+    p.reset(8);
+    CHECK(p.window() == 8 && p.backoffs() == 0 && p.queue_us() == 0, "reset did not clear state");
+}
+
+int main()
+{
+    test_good_link();
+    test_queue_growth_and_recovery();
+    test_slower_than_realtime_and_hold();
+    return check_report("stream pacer");
+}
@@ -0,0 +1,134 @@
+/*
+ * vad_q15_test.cpp - Q15 定點 VAD 與浮點參考的一致性測試
+ * ESP-MIAO v0.8.0
+ *
+ * 同一幀分別交給 VAD::detect（浮點 FFT 引擎）與 VadQ15::band_energy：
+ *   1. band_rms 相對誤差 < kMaxRelError（極小能量另有絕對容差）
+ *   2. 以 VAD_THRESHOLD_MIN / FFT_ENERGY_THRESHOLD 判斷的有聲 / 無聲結果相同
+ *      （浮點能量落在閾值 ± kMaxRelError 內的幀不計，兩者本來就可能各落一邊）
+ *   3. 環繞兩段的 AudioSlice 與連續緩衝結果逐位元相同
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "config.h"
+#include "pcm_convert.h"
+#include "audio_capture.h"
+#include "vad.h"
+
+static constexpr float kMaxRelError = 0.005f;
+static constexpr float kMaxAbsError = 2.0f;
+static constexpr int   kFramesPerSignal = 16;
+
+struct Signal {
+    const char *name;
+    float noise;      // 白噪音振幅
+    float tone;       // 正弦振幅
+    float tone_hz;
+    float hum;        // 100 Hz 頻帶外干擾振幅
+};
+
+static const Signal kSignals[] = {
+    {"silence",        0.0f,     0.0f,    0.0f,     0.0f},
+    {"noise 5",        5.0f,     0.0f,    0.0f,     0.0f},
+    {"noise 60",       60.0f,    0.0f,    0.0f,     0.0f},
+    {"noise 800",      800.0f,   0.0f,    0.0f,     0.0f},
+    {"noise 6000",     6000.0f,  0.0f,    0.0f,     0.0f},
+    {"noise 30000",    30000.0f, 0.0f,    0.0f,     0.0f},
+    {"tone 500",       100.0f,   3000.0f, 500.0f,   0.0f},
+    {"tone 1000",      200.0f,   8000.0f, 1000.0f,  0.0f},
+    {"tone 3000",      0.0f,     30000.0f, 3000.0f, 0.0f},
+    {"tone 6000",      50.0f,    20000.0f, 6000.0f, 0.0f},
+    {"hum + speech",   300.0f,   1500.0f, 800.0f,   20000.0f},
+    {"hum only",       20.0f,    0.0f,    0.0f,     25000.0f},
+};
+
+/* 線性同餘白噪音 + 正弦 + 頻帶外低頻，飽和到 int16 */
+static std::vector<int16_t> make_signal(const Signal &s, size_t n, uint32_t seed)
+{
+    std::vector<int16_t> pcm(n);
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        float noise = ((int32_t)(seed >> 16) - 32768) / 32768.0f;
+        float t     = (float)i / SAMPLE_RATE;
+        float x     = s.noise * noise
+                    + s.tone * sinf(2.0f * (float)M_PI * s.tone_hz * t)
+                    + s.hum  * sinf(2.0f * (float)M_PI * 100.0f * t);
+        pcm[i] = pcm_saturate_i16((int32_t)lrintf(x));
+    }
+    return pcm;
+}
+
+/* 浮點參考：單幀（FFT_SIZE 樣本）只分析一次，peak_energy 即該幀 band_rms */
+static float reference_energy(VAD &vad, const int16_t *frame)
+{
+    float buf[FFT_SIZE];
+    pcm_to_float(frame, FFT_SIZE, buf);
+    return vad.detect(buf, FFT_SIZE).peak_energy;
+}
+
+int main()
+{
+    static const float kThresholds[] = {VAD_THRESHOLD_MIN, FFT_ENERGY_THRESHOLD};
+
+    VAD    vad;
+    VadQ15 q15;
+    int    failures = 0, frames = 0, ambiguous = 0;
+    float  worst = 0.0f;
+
+    for (const Signal &s : kSignals) {
+        std::vector<int16_t> pcm = make_signal(s, FFT_SIZE * kFramesPerSignal, 12345u);
+        float sig_worst = 0.0f;
+        for (int f = 0; f < kFramesPerSignal; f++) {
+            const int16_t *frame = pcm.data() + f * FFT_SIZE;
+            float ref = reference_energy(vad, frame);
+            float got = (float)q15.band_energy(frame);
+            float err = fabsf(got - ref);
+            float rel = ref > 0.0f ? err / ref : 0.0f;
+            frames++;
+
+            if (err > kMaxRelError * ref + kMaxAbsError) {
+                printf("FAIL %-14s frame %2d: float=%.1f q15=%.0f (%.3f%%)\n", s.name, f, ref, got, 100.0f * rel);
+                failures++;
+            }
+            if (err > kMaxAbsError && rel > sig_worst) sig_worst = rel;
+
+            for (float th : kThresholds) {
+                if (fabsf(ref - th) <= kMaxRelError * th) {
+                    ambiguous++;
+                    continue;
+                }
+                if ((ref > th) != (got > th)) {
+                    printf("FAIL %-14s frame %2d: decision differs at threshold %.0f (float=%.1f q15=%.0f)\n",
+                           s.name, f, th, ref, got);
+                    failures++;
+                }
+            }
+        }
+        if (sig_worst > worst) worst = sig_worst;
+        printf("     %-14s max rel error %.4f%%\n", s.name, 100.0f * sig_worst);
+    }
+
+    /* 環繞切片：前段 300 樣本、後段 212 樣本，須與連續緩衝完全相同 */
+    std::vector<int16_t> pcm = make_signal(kSignals[7], FFT_SIZE, 777u);
+    AudioSlice slice = {};
+    slice.size   = FFT_SIZE;
+    slice.seg[0] = pcm.data();
+    slice.len[0] = 300;
+    slice.seg[1] = pcm.data() + 300;
+    slice.len[1] = FFT_SIZE - 300;
+    uint32_t contiguous = q15.band_energy(pcm.data());
+    uint32_t wrapped    = q15.band_energy(slice, 0);
+    if (contiguous != wrapped) {
+        printf("FAIL wrapped slice: %lu != %lu\n", (unsigned long)wrapped, (unsigned long)contiguous);
+        failures++;
+    }
+
+    printf("%s: %d frames, %d threshold comparisons skipped as ambiguous, worst rel error %.4f%%\n",
+           failures ? "FAILED" : "PASSED", frames, ambiguous, 100.0f * worst);
+    return failures ? 1 : 0;
+}
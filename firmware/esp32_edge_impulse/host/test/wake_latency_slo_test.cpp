@@ -0,0 +1,95 @@
+/*
+ * wake_latency_slo_test.cpp - 喚醒延遲 SLO 判定測試
+ * ESP-MIAO v0.8.0
+ *
+ *   1. 樣本不足 WAKE_SLO_MIN_SAMPLES 前不判定，即使每次都超標
+ *   2. nearest-rank p50 / p90 / max 與各段 p90
+ *   3. p90 超過 SLO 時轉為 degraded（只回報一次），超標段 = p90 / 預算比例最大者
+ *   4. p90 回到 SLO 的 WAKE_SLO_RECOVER_PCT% 以下才恢復；介於兩者之間維持 degraded
+ *   5. slo_ms = 0 只統計不判定
+ * 失敗時回傳非 0（ctest）。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "check.h"
+#include "wake_latency_slo.h"
+
+static const uint32_t kBudgets[WL_STAGE_COUNT] = {20, 100, 60, 40, 80};   // 合計 300 ms
+
+/* 各段（ms）→ record；回傳狀態是否改變 */
+static bool wake(WakeLatencySlo &slo, uint32_t queue, uint32_t link, uint32_t start,
+                 uint32_t capture, uint32_t send, WakeLatencyReport *rep)
+{
+    const uint32_t us[WL_STAGE_COUNT] = {queue * 1000, link * 1000, start * 1000,
+                                         capture * 1000, send * 1000};
+    return slo.record(us, rep);
+}
+
+static void test_min_samples()
+{
+    WakeLatencySlo slo;
+    slo.configure(300, kBudgets);
+    WakeLatencyReport rep;
+    for (int i = 0; i < WAKE_SLO_MIN_SAMPLES - 1; i++) {
+        CHECK(!wake(slo, 10, 900, 10, 10, 10, &rep), "changed before min samples (i=%d)", i);
+    }
+    CHECK(!slo.degraded(), "degraded with %d samples", WAKE_SLO_MIN_SAMPLES - 1);
+    CHECK(wake(slo, 10, 900, 10, 10, 10, &rep), "should turn degraded at min samples");
+    CHECK(rep.degraded && rep.samples == WAKE_SLO_MIN_SAMPLES, "report degraded=%d samples=%u",
+          rep.degraded, (unsigned)rep.samples);
+}
+
+static void test_percentiles()
+{
+    WakeLatencySlo slo;
+    slo.configure(0, kBudgets);
+    WakeLatencyReport rep;
+    /* 總延遲 110, 120, ..., 200 ms（10 筆）；send 段 = 10..100 ms */
+    for (uint32_t i = 1; i <= 10; i++) wake(slo, 20, 50, 20, 10, i * 10, &rep);
+    CHECK(rep.samples == 10, "samples %u", (unsigned)rep.samples);
+    CHECK(rep.p50_ms == 150, "p50 %u (want 150)", (unsigned)rep.p50_ms);
+    CHECK(rep.p90_ms == 190, "p90 %u (want 190)", (unsigned)rep.p90_ms);
+    CHECK(rep.max_ms == 200, "max %u (want 200)", (unsigned)rep.max_ms);
+    CHECK(rep.stage_p90_ms[WL_SEND] == 90, "send p90 %u (want 90)", (unsigned)rep.stage_p90_ms[WL_SEND]);
+    CHECK(rep.stage_p90_ms[WL_LINK] == 50, "link p90 %u (want 50)", (unsigned)rep.stage_p90_ms[WL_LINK]);
+    CHECK(!rep.degraded && !slo.degraded(), "slo_ms = 0 must never degrade");
+}
+
+static void test_degrade_and_recover()
+{
+    WakeLatencySlo slo;
+    slo.configure(300, kBudgets);
+    WakeLatencyReport rep;
+    int changes = 0;
+
+    /* 正常：約 150 ms */
+    for (int i = 0; i < WAKE_SLO_WINDOW; i++) changes += wake(slo, 5, 40, 30, 20, 55, &rep);
+    CHECK(changes == 0 && !rep.degraded, "healthy wakes changed state");
+
+    /* capture 段變慢（40 ms 預算 → 250 ms）：link 雖然也較高，但比例上 capture 最糟 */
+    for (int i = 0; i < WAKE_SLO_WINDOW; i++) changes += wake(slo, 5, 90, 30, 250, 55, &rep);
+    CHECK(changes == 1, "degraded should be reported once, got %d changes", changes);
+    CHECK(rep.degraded && rep.worst == WL_CAPTURE, "worst stage %s (want capture)",
+          WakeLatencySlo::stage_name(rep.worst));
+    CHECK(rep.p90_ms == 430, "p90 %u (want 430)", (unsigned)rep.p90_ms);
+
+    /* 回到 SLO 的 90%（270 ms）：高於恢復門檻，維持 degraded */
+    changes = 0;
+    for (int i = 0; i < WAKE_SLO_WINDOW; i++) changes += wake(slo, 5, 90, 30, 90, 55, &rep);
+    CHECK(changes == 0 && slo.degraded(), "p90 %u between recover threshold and SLO should stay degraded",
+          (unsigned)rep.p90_ms);
+
+    /* 回到 150 ms：恢復 */
+    for (int i = 0; i < WAKE_SLO_WINDOW; i++) changes += wake(slo, 5, 40, 30, 20, 55, &rep);
+    CHECK(changes == 1 && !slo.degraded() && !rep.degraded, "should recover once, changes %d", changes);
+}
+
+int main()
+{
+    test_min_samples();
+    test_percentiles();
+    test_degrade_and_recover();
+    return check_report("wake latency slo");
+}
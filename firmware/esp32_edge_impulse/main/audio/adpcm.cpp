@@ -0,0 +1,108 @@
+/*
+ * adpcm.cpp - IMA-ADPCM 編解碼實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "adpcm.h"
+
+static const int8_t kIndexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+static const int16_t kStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+void adpcm_reset(AdpcmState *state)
+{
+    state->predictor  = 0;
+    state->step_index = 0;
+}
+
+static inline uint8_t encode_sample_(int32_t sample, int32_t *pred, int *index)
+{
+    int32_t step = kStepTable[*index];
+    int32_t diff = sample - *pred;
+    uint8_t code = 0;
+    if (diff < 0) { code = 8; diff = -diff; }
+
+    /* 逐 bit 逼近，同時累加解碼端會重建的差值（與解碼完全一致） */
+    int32_t delta = step >> 3;
+    if (diff >= step) { code |= 4; diff -= step; delta += step; }
+    step >>= 1;
+    if (diff >= step) { code |= 2; diff -= step; delta += step; }
+    step >>= 1;
+    if (diff >= step) { code |= 1; delta += step; }
+
+    int32_t p = (code & 8) ? *pred - delta : *pred + delta;
+    if (p >  32767) p =  32767;
+    if (p < -32768) p = -32768;
+    *pred = p;
+
+    int i = *index + kIndexTable[code];
+    *index = (i < 0) ? 0 : (i > 88 ? 88 : i);
+    return code;
+}
+
+size_t adpcm_encode_block(const int16_t *pcm, size_t n, AdpcmState *state, uint8_t *out)
+{
+    int32_t pred  = state->predictor;
+    int     index = state->step_index;
+
+    out[0] = (uint8_t)(pred & 0xFF);
+    out[1] = (uint8_t)((pred >> 8) & 0xFF);
+    out[2] = (uint8_t)index;
+    out[3] = 0;
+
+    uint8_t *p = out + ADPCM_BLOCK_HEADER_BYTES;
+    for (size_t i = 0; i < n; i += 2) {
+        uint8_t lo = encode_sample_(pcm[i], &pred, &index);
+        uint8_t hi = (i + 1 < n) ? encode_sample_(pcm[i + 1], &pred, &index) : 0;
+        *p++ = (uint8_t)(lo | (hi << 4));
+    }
+
+    state->predictor  = (int16_t)pred;
+    state->step_index = (uint8_t)index;
+    return (size_t)(p - out);
+}
+
+static inline int16_t decode_sample_(uint8_t code, int32_t *pred, int *index)
+{
+    int32_t step  = kStepTable[*index];
+    int32_t delta = step >> 3;
+    if (code & 4) delta += step;
+    if (code & 2) delta += step >> 1;
+    if (code & 1) delta += step >> 2;
+
+    int32_t p = (code & 8) ? *pred - delta : *pred + delta;
+    if (p >  32767) p =  32767;
+    if (p < -32768) p = -32768;
+    *pred = p;
+
+    int i = *index + kIndexTable[code];
+    *index = (i < 0) ? 0 : (i > 88 ? 88 : i);
+    return (int16_t)p;
+}
+
+size_t adpcm_decode_block(const uint8_t *block, size_t len, int16_t *out, size_t max_samples)
+{
+    if (len < ADPCM_BLOCK_HEADER_BYTES) return 0;
+    int32_t pred  = (int16_t)(block[0] | (block[1] << 8));
+    int     index = block[2] > 88 ? 88 : block[2];
+
+    size_t n = 0;
+    for (size_t i = ADPCM_BLOCK_HEADER_BYTES; i < len && n < max_samples; i++) {
+        out[n++] = decode_sample_(block[i] & 0x0F, &pred, &index);
+        if (n < max_samples) out[n++] = decode_sample_(block[i] >> 4, &pred, &index);
+    }
+    return n;
+}
@@ -0,0 +1,46 @@
+#ifndef ADPCM_H
+#define ADPCM_H
+
+/* ============================================================
+ * adpcm.h - IMA-ADPCM 編解碼（4 bit / 樣本，上行串流 / 下行播放壓縮 4:1）
+ * ESP-MIAO v0.8.0
+ *
+ * 每次編碼輸出一個可獨立解碼的區塊：
+ *   [int16 predictor][uint8 step_index][uint8 0] + ceil(n/2) bytes nibble
+ * nibble 低 4 bit 在前；標頭記錄編碼前的狀態，遺失區塊不影響後續解碼。
+ * 狀態跨區塊延續，使連續區塊之間沒有重新收斂的誤差。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ADPCM_BLOCK_HEADER_BYTES 4
+
+typedef struct {
+    int16_t predictor;
+    uint8_t step_index;
+} AdpcmState;
+
+static inline size_t adpcm_block_bytes(size_t samples)
+{
+    return ADPCM_BLOCK_HEADER_BYTES + (samples + 1) / 2;
+}
+
+/** 將狀態歸零（每次串流開始時呼叫） */
+void adpcm_reset(AdpcmState *state);
+
+/**
+ * 編碼 n 個樣本為一個區塊。
+ * @param out 輸出緩衝（至少 adpcm_block_bytes(n) bytes）
+ * @return 寫入的 bytes 數
+ */
+size_t adpcm_encode_block(const int16_t *pcm, size_t n, AdpcmState *state, uint8_t *out);
+
+/**
+ * 解碼一個區塊（狀態取自區塊標頭，Server codec.py encode_ima_adpcm_block 的輸出）。
+ * @param max_samples 輸出緩衝容量
+ * @return 解碼出的樣本數（最多 max_samples）
+ */
+size_t adpcm_decode_block(const uint8_t *block, size_t len, int16_t *out, size_t max_samples);
+
+#endif // ADPCM_H
@@ -0,0 +1,78 @@
+/*
+ * agc.cpp - 定點自動增益控制實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "agc.h"
+#include <math.h>
+
+static int32_t coef_q15_(float time_ms, uint32_t sample_rate)
+{
+    if (time_ms <= 0.0f) return 32767;
+    float c = 1.0f - expf(-1000.0f / (time_ms * (float)sample_rate));
+    int32_t q = (int32_t)(c * 32768.0f + 0.5f);
+    return (q < 1) ? 1 : (q > 32767 ? 32767 : q);
+}
+
+Agc::Agc()
+    : target_(8000), gate_(0), max_gain_q12_(4096), attack_q15_(32767), release_q15_(32767),
+      env_(0), gain_q24_(1 << 24), target_gain_q12_(4096), counter_(0)
+{}
+
+void Agc::init(int32_t target_level, float max_gain, int32_t noise_gate,
+               float attack_ms, float release_ms, uint32_t sample_rate)
+{
+    target_       = target_level;
+    gate_         = noise_gate;
+    max_gain_q12_ = (int32_t)(max_gain * 4096.0f);
+    if (max_gain_q12_ < 4096)   max_gain_q12_ = 4096;
+    if (max_gain_q12_ > 65535)  max_gain_q12_ = 65535;  // 增益上限 16x（Q24 狀態不溢位）
+    attack_q15_   = coef_q15_(attack_ms, sample_rate);
+    release_q15_  = coef_q15_(release_ms, sample_rate);
+    env_             = 0;
+    gain_q24_        = 1 << 24;
+    target_gain_q12_ = 4096;
+    counter_         = 0;
+}
+
+void Agc::process(int16_t *samples, size_t n)
+{
+    int32_t env  = env_;
+    int32_t gain = gain_q24_;
+    int32_t tgt  = target_gain_q12_ << 12;
+
+    for (size_t i = 0; i < n; i++) {
+        int32_t x   = samples[i];
+        int32_t mag = (x < 0) ? -x : x;
+
+        /* 峰值包絡 */
+        int32_t k = (mag > env) ? attack_q15_ : release_q15_;
+        env += ((mag - env) * k) >> 15;
+
+        /* 目標增益：定期更新（除法不在每個樣本執行） */
+        if (++counter_ >= AGC_UPDATE_SAMPLES) {
+            counter_ = 0;
+            if (env > gate_) {
+                int32_t e = (env < 1) ? 1 : env;
+                int32_t t12 = (int32_t)(((int64_t)target_ << 12) / e);
+                if (t12 > max_gain_q12_) t12 = max_gain_q12_;
+                if (t12 < 4096)          t12 = 4096;
+                tgt = t12 << 12;
+            }
+            /* env <= gate：維持既有目標，避免在靜音時把噪音拉高 */
+        }
+
+        /* 增益平滑：降低用 attack（防爆音），提高用 release */
+        int32_t gk = (tgt < gain) ? attack_q15_ : release_q15_;
+        gain += (int32_t)(((int64_t)(tgt - gain) * gk) >> 15);
+
+        int32_t y = (x * (gain >> 12)) >> 12;
+        if (y >  32767) y =  32767;
+        if (y < -32768) y = -32768;
+        samples[i] = (int16_t)y;
+    }
+
+    env_             = env;
+    gain_q24_        = gain;
+    target_gain_q12_ = tgt >> 12;
+}
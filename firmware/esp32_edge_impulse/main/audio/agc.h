@@ -0,0 +1,52 @@
+#ifndef AGC_H
+#define AGC_H
+
+/* ============================================================
+ * agc.h - 定點自動增益控制（Q15 係數 / Q12 增益）
+ * ESP-MIAO v0.8.0
+ *
+ * 逐樣本追蹤峰值包絡（attack 快、release 慢），
+ * 每 AGC_UPDATE_SAMPLES 個樣本重新計算目標增益並平滑逼近，
+ * 包絡低於 noise gate 時維持現有增益，避免放大背景噪音。
+ * 狀態跨區塊延續，串流開始時即為目前的增益。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Agc {
+public:
+    Agc();
+
+    /**
+     * @param target_level  目標包絡（int16 振幅，例如 8000）
+     * @param max_gain      最大增益（例如 8.0，上限 16）
+     * @param noise_gate    低於此包絡不再提高增益
+     * @param attack_ms     包絡上升時間常數
+     * @param release_ms    包絡下降時間常數
+     * @param sample_rate   取樣率
+     */
+    void init(int32_t target_level, float max_gain, int32_t noise_gate,
+              float attack_ms, float release_ms, uint32_t sample_rate);
+
+    /** 原地套用增益（單一生產者，可於 ISR 呼叫） */
+    void process(int16_t *samples, size_t n);
+
+    /** 目前增益（線性倍率） */
+    float gain() const { return (float)gain_q24_ / 16777216.0f; }
+
+private:
+    static constexpr int AGC_UPDATE_SAMPLES = 32;
+
+    int32_t target_;
+    int32_t gate_;
+    int32_t max_gain_q12_;
+    int32_t attack_q15_;    // 包絡上升係數
+    int32_t release_q15_;   // 包絡下降係數（亦用於增益增加）
+    int32_t env_;           // 峰值包絡（int16 振幅）
+    int32_t gain_q24_;      // 平滑後增益（Q24 保留精度，套用時取 Q12）
+    int32_t target_gain_q12_;
+    int     counter_;
+};
+
+#endif // AGC_H
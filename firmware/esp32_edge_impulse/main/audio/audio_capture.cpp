@@ -3,19 +3,44 @@
  * ESP-MIAO v0.8.0
  *
  * 硬體：INMP441（BCK=32, WS=25, DIN=33）
- * 模式：Stereo 讀取 + 軟體取左聲道
+ * 模式：Mono 左 slot（預設）或 Stereo 讀取 + 軟體取左聲道（AUDIO_I2S_MONO_SLOT=0）
+ * 架構：I2S on_recv ISR（或擷取 Task）→ AudioRingBuffer → 各讀取游標
  */
 
 #include "audio_capture.h"
+#include "pcm_convert.h"
 #include "config.h"
+#include "rtos_alloc.h"
+#include "trace_points.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_idf_version.h"
 #include <math.h>
 #include <string.h>
 
 static const char *TAG = "AudioCapture";
 
-AudioCapture::AudioCapture() : rx_chan_(nullptr) {}
+// ESP32 單一 DMA 描述子上限 4092 bytes
+static_assert(I2S_DMA_DESC_BYTES <= 4092, "DMA_BUF_LEN too large for the selected slot mode");
+
+static_assert(!(AUDIO_BEAMFORM && AUDIO_I2S_MONO_SLOT), "Beamforming needs both I2S slots (AUDIO_I2S_MONO_SLOT=0)");
+static_assert(BEAMFORM_MAX_DELAY <= Beamformer::MAX_DELAY, "Mic spacing too wide for Beamformer::MAX_DELAY");
+
+static_assert(AUDIO_RING_SAMPLES / AUDIO_CAPTURE_BLOCK_FRAMES * CAPTURE_SAMPLE_RATE / SAMPLE_RATE <= AUDIO_STAMP_SLOTS,
+              "Block stamp ring does not cover the whole audio ring");
+
+AudioCapture::AudioCapture()
+    : rx_chan_(nullptr), capture_task_(nullptr), last_block_us_(0), convert_us_(0), stamp_count_(0),
+      slots_(AUDIO_I2S_SLOTS), capture_rate_(CAPTURE_SAMPLE_RATE), active_resampler_(&resampler_)
+#if LOW_POWER_LISTEN
+      , low_power_(false)
+#endif
+{
+    memset(&stats_, 0, sizeof(stats_));
+    memset(stamps_, 0, sizeof(stamps_));
+}
 
 void AudioCapture::init()
 {
@@ -30,25 +55,8 @@ void AudioCapture::init()
     i2s_std_config_t std_cfg;
     memset(&std_cfg, 0, sizeof(std_cfg));
 
-    std_cfg.clk_cfg.sample_rate_hz = SAMPLE_RATE;
-    std_cfg.clk_cfg.clk_src        = I2S_CLK_SRC_APLL;
-    std_cfg.clk_cfg.mclk_multiple  = I2S_MCLK_MULTIPLE_256;
-    std_cfg.clk_cfg.bclk_div       = 8;
-
-    std_cfg.slot_cfg.data_bit_width = I2S_DATA_BIT_WIDTH_32BIT;
-    std_cfg.slot_cfg.slot_bit_width = I2S_SLOT_BIT_WIDTH_AUTO;
-    std_cfg.slot_cfg.slot_mode      = I2S_SLOT_MODE_STEREO;
-    std_cfg.slot_cfg.slot_mask      = I2S_STD_SLOT_BOTH;
-    std_cfg.slot_cfg.ws_width       = I2S_DATA_BIT_WIDTH_32BIT;
-    std_cfg.slot_cfg.ws_pol         = false;
-    std_cfg.slot_cfg.bit_shift      = true;
-#if SOC_I2S_HW_VERSION_1
-    std_cfg.slot_cfg.msb_right      = false;
-#else
-    std_cfg.slot_cfg.left_align     = true;
-    std_cfg.slot_cfg.big_endian     = false;
-    std_cfg.slot_cfg.bit_order_lsb  = false;
-#endif
+    clk_config_(&std_cfg.clk_cfg, CAPTURE_SAMPLE_RATE);
+    slot_config_(&std_cfg.slot_cfg, AUDIO_I2S_MONO_SLOT);
 
     std_cfg.gpio_cfg.mclk = I2S_GPIO_UNUSED;
     std_cfg.gpio_cfg.bclk = I2S_BCK_GPIO;
@@ -58,47 +66,321 @@ void AudioCapture::init()
 
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(rx_chan_, &std_cfg));
 
-    /* 3. 啟用通道 */
+    /* 3. 前處理濾波 + 重取樣器 + 環形緩衝 */
+    if (!init_pipeline_()) return;
+
+#if AUDIO_CAPTURE_USE_ISR
+    /* 4. DMA 完成回調（須在 enable 前註冊） */
+    i2s_event_callbacks_t cbs = {};
+    cbs.on_recv = &AudioCapture::on_recv_isr_;
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(rx_chan_, &cbs, this));
+#endif
+
+    /* 5. 啟用通道 */
     ESP_ERROR_CHECK(i2s_channel_enable(rx_chan_));
 
-    ESP_LOGI(TAG, "I2S initialized: %d Hz, Stereo->Mono(Left), BCK=%d WS=%d DIN=%d",
-             SAMPLE_RATE, I2S_BCK_GPIO, I2S_WS_GPIO, I2S_DIN_GPIO);
+    ESP_LOGI(TAG, "I2S initialized: %d Hz (pipeline %d Hz), %s, DMA %dx%d bytes, BCK=%d WS=%d DIN=%d",
+             CAPTURE_SAMPLE_RATE, SAMPLE_RATE, AUDIO_I2S_MONO_SLOT ? "Mono(Left slot)" : "Stereo->Mono(Left)",
+             DMA_BUF_COUNT, I2S_DMA_DESC_BYTES,
+             I2S_BCK_GPIO, I2S_WS_GPIO, I2S_DIN_GPIO);
+
+#if !AUDIO_CAPTURE_USE_ISR
+    /* 6. 擷取 Task（阻塞讀取備援路徑） */
+    RTOS_TASK_CREATE(capture_task_entry_, "audio_cap",
+                     AUDIO_CAPTURE_TASK_STACK, this,
+                     AUDIO_CAPTURE_TASK_PRIO, &capture_task_,
+                     AUDIO_CAPTURE_TASK_CORE);
+#endif
+    ESP_LOGI(TAG, "Capture mode: %s", AUDIO_CAPTURE_USE_ISR ? "DMA on_recv ISR" : "reader task");
 }
 
-bool AudioCapture::read_audio_slice(float *out_buffer, size_t num_mono_samples,
-                                     float *out_rms)
+void AudioCapture::clk_config_(i2s_std_clk_config_t *clk, uint32_t rate)
 {
-    const size_t bytes_per_sample = sizeof(int32_t);
-    const size_t chunk_frames     = 256;
+    memset(clk, 0, sizeof(*clk));
+    clk->sample_rate_hz = rate;
+#if SOC_I2S_SUPPORTS_APLL
+    clk->clk_src        = I2S_CLK_SRC_APLL;
+#else
+    clk->clk_src        = I2S_CLK_SRC_DEFAULT;   // ESP32-S3 沒有 APLL
+#endif
+    clk->mclk_multiple  = I2S_MCLK_MULTIPLE_256;
+    clk->bclk_div       = 8;
+}
 
-    int32_t i2s_buf[chunk_frames * 2];
-    size_t  samples_read = 0;
-    float   sum_sq       = 0.0f;
+void AudioCapture::slot_config_(i2s_std_slot_config_t *slot, bool mono)
+{
+    memset(slot, 0, sizeof(*slot));
+    slot->data_bit_width = I2S_DATA_BIT_WIDTH_32BIT;
+    slot->slot_bit_width = I2S_SLOT_BIT_WIDTH_AUTO;
+    slot->slot_mode      = mono ? I2S_SLOT_MODE_MONO : I2S_SLOT_MODE_STEREO;
+    slot->slot_mask      = mono ? I2S_STD_SLOT_LEFT : I2S_STD_SLOT_BOTH;
+    slot->ws_width       = I2S_DATA_BIT_WIDTH_32BIT;
+    slot->ws_pol         = false;
+    slot->bit_shift      = true;
+#if SOC_I2S_HW_VERSION_1
+    slot->msb_right      = false;
+#else
+    slot->left_align     = true;
+    slot->big_endian     = false;
+    slot->bit_order_lsb  = false;
+#endif
+}
 
-    while (samples_read < num_mono_samples) {
-        size_t frames_to_read = num_mono_samples - samples_read;
-        if (frames_to_read > chunk_frames) frames_to_read = chunk_frames;
+/* 前處理濾波 + 重取樣器 + 環形緩衝（環形緩衝一律為 SAMPLE_RATE） */
+bool AudioCapture::init_pipeline_()
+{
+    pcm_filter_init(&filter_, AUDIO_DC_BLOCK_POLE, AUDIO_PRE_EMPHASIS);
+#if AUDIO_BEAMFORM
+    pcm_filter_init(&filter_right_, AUDIO_DC_BLOCK_POLE, AUDIO_PRE_EMPHASIS);
+    beam_.init(BEAMFORM_MAX_DELAY);
+    ESP_LOGI(TAG, "Beamformer: %d mm spacing, +/-%d samples @ %d Hz",
+             BEAMFORM_MIC_SPACING_MM, BEAMFORM_MAX_DELAY, CAPTURE_SAMPLE_RATE);
+#endif
+    if (Agc *agc = stages_.find<Agc>()) {
+        agc->init(AGC_TARGET_LEVEL, AGC_MAX_GAIN, AGC_NOISE_GATE, AGC_ATTACK_MS, AGC_RELEASE_MS, SAMPLE_RATE);
+    }
+    if (!resampler_.init(CAPTURE_SAMPLE_RATE, SAMPLE_RATE)) {
+        ESP_LOGE(TAG, "Resampler init failed");
+        return false;
+    }
+#if LOW_POWER_LISTEN
+    if (!resampler_low_.init(LOW_POWER_SAMPLE_RATE, SAMPLE_RATE)) {
+        ESP_LOGE(TAG, "Low-power resampler init failed");
+        return false;
+    }
+#endif
+#if CONFIG_ESP_MIAO_STATIC_ALLOC
+    EXT_RAM_BSS_ATTR static int16_t ring_storage[AUDIO_RING_SAMPLES];
+    if (!ring_.init(ring_storage, AUDIO_RING_SAMPLES)) {
+#else
+    if (!ring_.init(AUDIO_RING_SAMPLES)) {
+#endif
+        ESP_LOGE(TAG, "Ring buffer init failed");
+        return false;
+    }
+    ring_.claim_reader(AUDIO_READER_DETECTOR);
+    ring_.claim_reader(AUDIO_READER_STREAMER);
+    return true;
+}
+
+#if LOW_POWER_LISTEN
+/* ---------- 低功耗擷取切換 ---------- */
+
+bool AudioCapture::set_low_power(bool on)
+{
+    if (on == low_power_.load(std::memory_order_relaxed) || !rx_chan_) return on == low_power_;
+
+    uint32_t rate = on ? LOW_POWER_SAMPLE_RATE : CAPTURE_SAMPLE_RATE;
+    bool     mono = on || AUDIO_I2S_MONO_SLOT;
+
+    /* 停用後等一個 tick，確保進行中的 on_recv 回調已結束才更動生產者狀態 */
+    if (i2s_channel_disable(rx_chan_) != ESP_OK) return false;
+    vTaskDelay(1);
+
+    i2s_std_clk_config_t  clk;
+    i2s_std_slot_config_t slot;
+    clk_config_(&clk, rate);
+    slot_config_(&slot, mono);
+    esp_err_t ret = i2s_channel_reconfig_std_clock(rx_chan_, &clk);
+    if (ret == ESP_OK && !AUDIO_I2S_MONO_SLOT) ret = i2s_channel_reconfig_std_slot(rx_chan_, &slot);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Low-power reconfig failed: %s", esp_err_to_name(ret));
+        clk_config_(&clk, capture_rate_);
+        slot_config_(&slot, slots_ == 1);
+        i2s_channel_reconfig_std_clock(rx_chan_, &clk);
+        if (!AUDIO_I2S_MONO_SLOT) i2s_channel_reconfig_std_slot(rx_chan_, &slot);
+        i2s_channel_enable(rx_chan_);
+        return false;
+    }
+
+    /* 重取樣器從空的歷史開始（兩種速率的樣本不可混在同一濾波器內） */
+    PolyphaseResampler *rs = on ? &resampler_low_ : &resampler_;
+    rs->reset();
+    slots_            = mono ? 1 : 2;
+    capture_rate_     = rate;
+    active_resampler_ = rs;
+    last_block_us_    = 0;
+    low_power_.store(on, std::memory_order_relaxed);
+
+    ESP_ERROR_CHECK(i2s_channel_enable(rx_chan_));
+    ESP_LOGI(TAG, "Capture %s: %lu Hz, %s", on ? "low-power" : "full-rate",
+             (unsigned long)rate, mono ? "mono" : "stereo");
+    return true;
+}
+#endif
+
+#if CONFIG_ESP_MIAO_BENCHMARK
+/* ---------- 錄音回放（benchmark，取代 I2S） ---------- */
+
+void AudioCapture::init_replay()
+{
+    if (init_pipeline_()) ESP_LOGI(TAG, "Replay source ready (I2S disabled)");
+}
+
+void AudioCapture::replay(const int16_t *pcm, size_t samples)
+{
+    /* 還原成 I2S slot 格式後走與 DMA 區塊相同的轉換路徑（時間戳以實際寫入時刻為準） */
+    int32_t raw[DMA_BUF_LEN * AUDIO_I2S_SLOTS];
+    while (samples > 0) {
+        size_t frames = samples < DMA_BUF_LEN ? samples : DMA_BUF_LEN;
+        for (size_t i = 0; i < frames; i++) {
+            for (int c = 0; c < AUDIO_I2S_SLOTS; c++) {
+                raw[i * AUDIO_I2S_SLOTS + c] = (int32_t)pcm[i] * (1 << I2S_SAMPLE_SHIFT);
+            }
+        }
+        push_block_(raw, frames, nullptr);
+        pcm     += frames;
+        samples -= frames;
+    }
+}
+#endif
+
+/* ---------- 區塊寫入（唯一生產者） ---------- */
+
+void AudioCapture::push_block_(const int32_t *raw, size_t frames, BaseType_t *hp_task_woken)
+{
+    int64_t t0 = esp_timer_get_time();
+
+    /* 取左聲道（Stereo 時 stride=2），右移 + DC blocker / pre-emphasis + 飽和 */
+    pcm_convert_i2s(raw, frames, slots_, block_pcm_, nullptr, &filter_);
+#if AUDIO_BEAMFORM
+    /* 右聲道同樣轉換後，兩聲道延遲相加回寫 block_pcm_（重取樣前，延遲解析度 = 擷取取樣率）；
+     * 低功耗單聲道時略過 */
+    if (slots_ == 2) {
+        pcm_convert_i2s(raw + 1, frames, slots_, block_right_, nullptr, &filter_right_);
+        beam_.process(block_pcm_, block_right_, frames, block_pcm_);
+        stats_.beam_delay = beam_.delay();
+    }
+#endif
+
+    int16_t *pcm = block_pcm_;
+    size_t   n   = frames;
+    if (!active_resampler_->is_passthrough()) {
+        n   = active_resampler_->process(block_pcm_, frames, block_out_);
+        pcm = block_out_;
+    }
+    stages_.process(pcm, n);
+
+    /* 時間戳：DMA 完成時刻回推區塊第一個樣本 */
+    uint32_t         count = stamp_count_.load(std::memory_order_relaxed);
+    AudioBlockStamp &st    = stamps_[count % STAMP_SLOTS];
+    st.seq     = stats_.blocks;
+    st.pos     = ring_.write_pos();
+    st.t_us    = t0 - (int64_t)frames * 1000000 / capture_rate_;
+
+    /* READER_HOLD 讀者未跟上時尾端被捨棄：時間戳只涵蓋實際寫入的樣本 */
+    if (hp_task_woken) n = ring_.write_from_isr(pcm, n, hp_task_woken);
+    else               n = ring_.write(pcm, n);
+    st.samples = (uint32_t)n;
+    stamp_count_.store(count + 1, std::memory_order_release);
+    TRACE_POINT(TP_I2S_BLOCK, n);
+
+    int64_t t1 = esp_timer_get_time();
+    if (last_block_us_ != 0) {
+        uint32_t gap = (uint32_t)(t0 - last_block_us_);
+        if (gap > stats_.max_gap_us) stats_.max_gap_us = gap;
+    }
+    uint32_t cost = (uint32_t)(t1 - t0);
+    if (cost > stats_.max_isr_us) stats_.max_isr_us = cost;
+    convert_us_.fetch_add(cost, std::memory_order_relaxed);
+    last_block_us_ = t0;
+    stats_.blocks++;
+}
+
+bool AudioCapture::stamp_at(uint32_t pos, uint32_t *out_seq, int64_t *out_t_us) const
+{
+    uint32_t count = stamp_count_.load(std::memory_order_acquire);
+    uint32_t span  = (count < STAMP_SLOTS) ? count : STAMP_SLOTS - 1;  // 保留一格給生產者正在寫入的區塊
+
+    for (uint32_t k = 1; k <= span; k++) {
+        const AudioBlockStamp &st = stamps_[(count - k) % STAMP_SLOTS];
+        uint32_t off = pos - st.pos;
+        if ((int32_t)off < 0) continue;        // pos 在此區塊之前，繼續往舊的找
+        if (off >= st.samples) return false;   // pos 尚未擷取
+        if (out_seq)  *out_seq  = st.seq;
+        if (out_t_us) *out_t_us = st.t_us + (int64_t)off * 1000000 / SAMPLE_RATE;
+        return true;
+    }
+    return false;
+}
+
+/* ---------- DMA 回調（ISR 環境，不可阻塞 / 不可 log） ---------- */
+
+bool AudioCapture::on_recv_isr_(i2s_chan_handle_t handle, i2s_event_data_t *event, void *ctx)
+{
+    AudioCapture *self = static_cast<AudioCapture *>(ctx);
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+    const int32_t *raw = static_cast<const int32_t *>(event->dma_buf);
+#else
+    const int32_t *raw = *static_cast<int32_t **>(event->data);  // 舊版為指向 DMA buffer 指標的指標
+#endif
+    size_t frames = event->size / (self->slots_ * sizeof(int32_t));
+    if (frames > DMA_BUF_LEN) frames = DMA_BUF_LEN;
+
+    BaseType_t hp_task_woken = pdFALSE;
+    self->push_block_(raw, frames, &hp_task_woken);
+    return hp_task_woken == pdTRUE;
+}
+
+/* ---------- 擷取 Task（AUDIO_CAPTURE_USE_ISR=0） ---------- */
+
+void AudioCapture::capture_task_entry_(void *arg)
+{
+    static_cast<AudioCapture *>(arg)->capture_loop_();
+}
+
+void AudioCapture::capture_loop_()
+{
+    const size_t bytes_per_sample = sizeof(int32_t);
+    const size_t chunk_frames     = AUDIO_CAPTURE_BLOCK_FRAMES;
 
-        size_t bytes_read = 0;
+    static int32_t i2s_buf[AUDIO_CAPTURE_BLOCK_FRAMES * AUDIO_I2S_SLOTS];
+
+    while (true) {
+        int       slots      = slots_;
+        size_t    bytes_read = 0;
         esp_err_t ret = i2s_channel_read(rx_chan_, i2s_buf,
-                                         frames_to_read * 2 * bytes_per_sample,
-                                         &bytes_read, 1000);
+                                         chunk_frames * slots * bytes_per_sample,
+                                         &bytes_read, AUDIO_READ_TIMEOUT_MS);
+        if (ret == ESP_ERR_INVALID_STATE) {
+            vTaskDelay(1);          // set_low_power 切換中（通道暫停）
+            continue;
+        }
         if (ret != ESP_OK) {
+            stats_.read_errors++;
             ESP_LOGE(TAG, "I2S read failed: %s", esp_err_to_name(ret));
-            return false;
+            continue;
         }
+        if (slots != slots_) continue;   // 讀取期間切換了模式：丟棄舊格式的區塊
+
+        size_t got_frames = bytes_read / (slots * bytes_per_sample);
+        push_block_(i2s_buf, got_frames, nullptr);
+    }
+}
 
-        size_t got_frames = bytes_read / (2 * bytes_per_sample);
+/* ---------- 消費者讀取 ---------- */
 
-        for (size_t i = 0; i < got_frames; i++) {
-            int32_t raw_l = i2s_buf[i * 2];
-            int32_t s     = raw_l >> 11;
-            if (s >  32767) s =  32767;
-            if (s < -32768) s = -32768;
-            out_buffer[samples_read + i] = (float)s;
-            sum_sq += (float)(s * s);
-        }
-        samples_read += got_frames;
+bool AudioCapture::read_audio_slice(AudioReaderId reader, float *out_buffer,
+                                    size_t num_mono_samples, float *out_rms)
+{
+    if (!ring_.wait_for(reader, num_mono_samples, pdMS_TO_TICKS(AUDIO_READ_TIMEOUT_MS))) {
+        ESP_LOGE(TAG, "Slice wait timeout (reader=%d)", (int)reader);
+        return false;
+    }
+
+    int16_t pcm[AUDIO_CAPTURE_BLOCK_FRAMES];
+    size_t  samples_read = 0;
+    float   sum_sq       = 0.0f;
+
+    while (samples_read < num_mono_samples) {
+        size_t want = num_mono_samples - samples_read;
+        if (want > AUDIO_CAPTURE_BLOCK_FRAMES) want = AUDIO_CAPTURE_BLOCK_FRAMES;
+
+        size_t got = ring_.read(reader, pcm, want);
+        if (got == 0) return false;
+
+        sum_sq       += pcm_to_float(pcm, got, out_buffer + samples_read);
+        samples_read += got;
     }
 
     if (out_rms) {
@@ -107,38 +389,69 @@ bool AudioCapture::read_audio_slice(float *out_buffer, size_t num_mono_samples,
     return true;
 }
 
-bool AudioCapture::read_audio_to_buffer(int16_t *out_buffer, size_t num_samples)
+bool AudioCapture::acquire_slice(AudioReaderId reader, size_t num_samples, AudioSlice *out)
 {
-    const size_t bytes_per_sample = sizeof(int32_t);
-    const size_t chunk_frames     = 256;
-
-    int32_t i2s_buf[chunk_frames * 2];
-    size_t  samples_read = 0;
+    if (!ring_.wait_for(reader, num_samples, pdMS_TO_TICKS(AUDIO_READ_TIMEOUT_MS))) {
+        ESP_LOGE(TAG, "Slice wait timeout (reader=%d)", (int)reader);
+        return false;
+    }
 
-    while (samples_read < num_samples) {
-        size_t frames_to_read = num_samples - samples_read;
-        if (frames_to_read > chunk_frames) frames_to_read = chunk_frames;
+    /* 過舊的游標跳至最舊有效樣本並累計 overrun（同 read） */
+    uint32_t pos = ring_.catch_up(reader);
+    if (ring_.segments(pos, num_samples, out->seg, out->len) == 0) return false;
 
-        size_t bytes_read = 0;
-        esp_err_t ret = i2s_channel_read(rx_chan_, i2s_buf,
-                                         frames_to_read * 2 * bytes_per_sample,
-                                         &bytes_read, 1000);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "I2S read failed: %s", esp_err_to_name(ret));
-            return false;
-        }
+    out->pos  = pos;
+    out->size = num_samples;
+    ring_.seek_to(reader, pos + (uint32_t)num_samples);
+    return true;
+}
 
-        size_t got_frames = bytes_read / (2 * bytes_per_sample);
+void AudioSlice::to_float(size_t offset, size_t n, float *out) const
+{
+    if (offset < len[0]) {
+        size_t a = len[0] - offset;
+        if (a > n) a = n;
+        pcm_to_float(seg[0] + offset, a, out);
+        out    += a;
+        n      -= a;
+        offset  = 0;
+    } else {
+        offset -= len[0];
+    }
+    if (n > 0) pcm_to_float(seg[1] + offset, n, out);
+}
 
-        for (size_t i = 0; i < got_frames; i++) {
-            int32_t raw_l = i2s_buf[i * 2];
-            int32_t s     = raw_l >> 11;
-            if (s >  32767) s =  32767;
-            if (s < -32768) s = -32768;
-            out_buffer[samples_read + i] = (int16_t)s;
+float AudioSlice::sum_squares() const
+{
+    float acc = 0.0f;
+    for (int s = 0; s < 2; s++) {
+        for (size_t i = 0; i < len[s]; i++) {
+            float v = (float)seg[s][i];
+            acc += v * v;
         }
-        samples_read += got_frames;
     }
+    return acc;
+}
+
+bool AudioCapture::read_audio_to_buffer(AudioReaderId reader, int16_t *out_buffer,
+                                        size_t num_samples)
+{
+    if (!ring_.wait_for(reader, num_samples, pdMS_TO_TICKS(AUDIO_READ_TIMEOUT_MS))) {
+        ESP_LOGE(TAG, "Buffer wait timeout (reader=%d)", (int)reader);
+        return false;
+    }
+    return ring_.read(reader, out_buffer, num_samples) == num_samples;
+}
 
+bool AudioCapture::take_slice(AudioReaderId reader, size_t num_samples, AudioSlice *out)
+{
+    if (!ring_.wait_for(reader, num_samples, pdMS_TO_TICKS(AUDIO_READ_TIMEOUT_MS))) {
+        ESP_LOGE(TAG, "Buffer wait timeout (reader=%d)", (int)reader);
+        return false;
+    }
+    /* 落後超過保留範圍時同 read：跳到最舊的樣本 */
+    uint32_t pos = ring_.catch_up(reader);
+    if (!slice_at(pos, num_samples, out)) return false;
+    ring_.seek_to(reader, pos + (uint32_t)num_samples);
     return true;
 }
@@ -4,12 +4,25 @@
 /* ============================================================
  * audio_capture.h - I2S 音訊擷取（INMP441）
  * ESP-MIAO v0.8.0
+ *
+ * 由 I2S on_recv DMA 回調（或備援的擷取 Task）持續將資料寫入環形緩衝，
+ * 各消費者以自己的讀取游標取用，彼此不會互相搶走樣本。
  * ============================================================ */
 
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
 #include "driver/i2s_std.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+#include "audio_ring_buffer.h"
+#include "resampler.h"
+#include "pcm_convert.h"
+#include "agc.h"
+#include "beamformer.h"
+#include "stage_chain.h"
+#include "config.h"
 
 /* Debug 等級控制 */
 #define AUDIO_LOG_NONE   0
@@ -21,36 +34,276 @@
 #define AUDIO_LOG AUDIO_LOG_INFO
 #endif
 
+/* 環形緩衝讀取游標（每個消費者一個）；其餘空位由 AudioCapture::open_reader 動態登記 */
+enum AudioReaderId {
+    AUDIO_READER_DETECTOR = 0,  // WakeWordDetector 推論切片
+    AUDIO_READER_STREAMER = 1,  // AudioStreamer 串流
+    AUDIO_READER_FIXED    = 2,  // 固定編號數
+    AUDIO_READER_INVALID  = -1,
+};
+
+/* 擷取統計（量測 DMA 區塊時序是否穩定） */
+struct AudioCaptureStats {
+    uint32_t blocks;       // 已寫入環形緩衝的 DMA 區塊數
+    uint32_t read_errors;  // 阻塞讀取失敗次數（Task 模式）
+    uint32_t max_gap_us;   // 相鄰區塊最大間隔（理想值 = DMA_BUF_LEN / SAMPLE_RATE）
+    uint32_t max_isr_us;   // 單一區塊處理最長時間
+    int32_t  beam_delay;   // beamformer 目前轉向延遲（樣本，> 0 = 聲源偏左；AUDIO_BEAMFORM=0 時恆為 0）
+};
+
+/* 單一 DMA 區塊的擷取時間戳（映射到環形緩衝位置） */
+struct AudioBlockStamp {
+    uint32_t seq;       // 區塊序號（單調遞增）
+    uint32_t pos;       // 區塊第一個樣本的環形緩衝位置
+    uint32_t samples;   // 區塊樣本數（SAMPLE_RATE）
+    int64_t  t_us;      // 第一個樣本的擷取時間（esp_timer_get_time）
+};
+
+/*
+ * 環形緩衝中的一段切片（零拷貝檢視）。
+ * 有效期間：生產者再寫入約 AUDIO_RING_SAMPLES * 7/8 個樣本之前。
+ */
+struct AudioSlice {
+    uint32_t       pos;      // 第一個樣本的絕對位置
+    size_t         size;     // 樣本數
+    const int16_t *seg[2];   // 環繞時分兩段
+    size_t         len[2];
+
+    /** 讀取 [offset, offset+n) 並轉為 float（供 EI signal_t 按需取用） */
+    void to_float(size_t offset, size_t n, float *out) const;
+
+    /** 平方和（RMS 用） */
+    float sum_squares() const;
+};
+
 class AudioCapture {
 public:
     AudioCapture();
 
     /**
-     * 初始化 I2S 通道（APLL、Stereo模式）。
+     * 初始化 I2S 通道（APLL、Mono 左 slot 或 Stereo 模式）、環形緩衝，
+     * 並註冊 DMA 回調（AUDIO_CAPTURE_USE_ISR）或啟動擷取 Task。
      * 必須在使用任何 read 函式前呼叫。
      */
     void init();
 
+#if CONFIG_ESP_MIAO_BENCHMARK
+    /**
+     * Benchmark：只建立前處理與環形緩衝，不啟用 I2S；樣本由 replay() 寫入。
+     */
+    void init_replay();
+
+    /**
+     * 寫入錄音樣本（CAPTURE_SAMPLE_RATE mono int16），經過與 I2S 區塊相同的
+     * 轉換 / 濾波 / 重取樣 / AGC 後進入環形緩衝。呼叫端即生產者。
+     */
+    void replay(const int16_t *pcm, size_t samples);
+#endif
+
     /**
      * 讀取一個推論用 Slice（float，Left channel）。
+     * 等待環形緩衝累積足夠樣本後一次取出，不直接存取 I2S。
+     * @param reader      讀取游標
      * @param out_buffer  輸出 float 陣列（大小 = num_mono_samples）
      * @param num_mono_samples 要讀取的 mono 樣本數
      * @param out_rms     輸出 RMS 值（可為 NULL）
-     * @return true = 成功，false = I2S 讀取失敗
+     * @return true = 成功，false = 等待逾時
      */
-    bool read_audio_slice(float *out_buffer, size_t num_mono_samples,
-                          float *out_rms = nullptr);
+    bool read_audio_slice(AudioReaderId reader, float *out_buffer,
+                          size_t num_mono_samples, float *out_rms = nullptr);
+
+    /**
+     * 等待並取得一個切片的零拷貝檢視，游標前進 num_samples。
+     * @return true = 成功，false = 等待逾時
+     */
+    bool acquire_slice(AudioReaderId reader, size_t num_samples, AudioSlice *out);
+
+    /**
+     * 取得絕對位置 pos 起 num_samples 的切片檢視（不移動任何游標，例如回放歷史切片）。
+     * @return false = 範圍已被覆寫或尚未擷取
+     */
+    bool slice_at(uint32_t pos, size_t num_samples, AudioSlice *out) const
+    {
+        if (ring_.segments(pos, num_samples, out->seg, out->len) == 0) return false;
+        out->pos  = pos;
+        out->size = num_samples;
+        return true;
+    }
+
+    /** 切片是否仍未被生產者覆寫（推論完成後檢查） */
+    bool slice_valid(const AudioSlice &slice) const { return ring_.retained(slice.pos); }
 
     /**
      * 讀取串流用 int16_t 緩衝區（Left channel）。
+     * @param reader      讀取游標
      * @param out_buffer  輸出 int16_t 陣列
      * @param num_samples 要讀取的 mono 樣本數
-     * @return true = 成功，false = I2S 讀取失敗
+     * @return true = 成功，false = 等待逾時
      */
-    bool read_audio_to_buffer(int16_t *out_buffer, size_t num_samples);
+    bool read_audio_to_buffer(AudioReaderId reader, int16_t *out_buffer,
+                              size_t num_samples);
+
+    /**
+     * 同 read_audio_to_buffer，但不複製：取得游標後 num_samples 的切片檢視並前進游標。
+     * 檢視只在樣本被覆寫前有效，使用時以 slice_valid 確認。
+     * @return true = 成功，false = 等待逾時
+     */
+    bool take_slice(AudioReaderId reader, size_t num_samples, AudioSlice *out);
+
+    /** 將游標對齊到最新樣本（例如開始新的串流前） */
+    void sync_reader(AudioReaderId reader) { ring_.seek_to_live(reader); }
+
+    /**
+     * 登記額外的消費者（例如裝置端指令模型），自最新樣本開始讀取。
+     * @return 游標編號，AUDIO_READER_INVALID = 已無空位
+     */
+    AudioReaderId open_reader(AudioRingBuffer::ReaderPolicy policy = AudioRingBuffer::READER_DROP)
+    {
+        return (AudioReaderId)ring_.open_reader(policy);
+    }
+
+    void close_reader(AudioReaderId reader) { ring_.close_reader(reader); }
+
+    /** 切換游標過慢時的處理方式（READER_HOLD：不覆寫未讀資料，改捨棄新樣本） */
+    void set_reader_policy(AudioReaderId reader, AudioRingBuffer::ReaderPolicy policy)
+    {
+        ring_.set_policy(reader, policy);
+    }
+
+    /** 游標延遲統計（目前 / 最大落後、遺失樣本數），讀取後重設峰值 */
+    AudioRingBuffer::ReaderStats take_reader_stats(AudioReaderId reader)
+    {
+        AudioRingBuffer::ReaderStats st = ring_.reader_stats(reader);
+        ring_.reset_lag_peak(reader);
+        return st;
+    }
+
+    /** 游標目前的絕對樣本位置（可作為事件錨點，例如喚醒時刻） */
+    uint32_t reader_position(AudioReaderId reader) const { return ring_.position(reader); }
+
+    /**
+     * 將游標移至 anchor 往前 back_samples 的位置（受環形緩衝保留範圍限制）。
+     * @return 實際設定的位置
+     */
+    uint32_t rewind_reader(AudioReaderId reader, uint32_t anchor, size_t back_samples)
+    {
+        return ring_.seek_to(reader, anchor - (uint32_t)back_samples);
+    }
+
+#if LOW_POWER_LISTEN
+    /**
+     * 切換低功耗擷取：I2S 改為 LOW_POWER_SAMPLE_RATE、單聲道左 slot（beamforming 暫停），
+     * 經重取樣後環形緩衝仍為 SAMPLE_RATE，游標與 pre-roll 不受影響。
+     * 需短暫停用通道（約一個 DMA 區塊的空檔）；只可由單一 Task 呼叫。
+     * @return false = 重新設定失敗（維持原模式）
+     */
+    bool set_low_power(bool on);
+
+    bool low_power() const { return low_power_; }
+#endif
+
+    /** 取得環形緩衝（供統計 / 進階用途） */
+    const AudioRingBuffer &ring() const { return ring_; }
+
+    /**
+     * 查詢環形緩衝位置 pos 所屬的 DMA 區塊及該樣本的擷取時間。
+     * @param out_seq  區塊序號（可為 NULL）
+     * @param out_t_us 樣本 pos 的擷取時間（可為 NULL）
+     * @return false = 該位置太舊 / 尚未擷取
+     */
+    bool stamp_at(uint32_t pos, uint32_t *out_seq, int64_t *out_t_us) const;
+
+    /** 目前 AGC 增益（線性倍率，AUDIO_AGC_ENABLE=0 時恆為 1） */
+    float agc_gain() const
+    {
+        const Agc *agc = stages_.find<Agc>();
+        return agc ? agc->gain() : 1.0f;
+    }
+
+    /** 取得擷取統計（快照） */
+    AudioCaptureStats stats() const { return stats_; }
+
+    /** 重設區塊時序峰值（例如每次列印統計後） */
+    void reset_timing_peaks() { stats_.max_gap_us = 0; stats_.max_isr_us = 0; }
+
+    /** 自上次呼叫以來所有區塊的轉換耗時總和（us），取出後歸零 */
+    uint32_t take_convert_us() { return convert_us_.exchange(0, std::memory_order_relaxed); }
 
 private:
     i2s_chan_handle_t rx_chan_;
+    AudioRingBuffer   ring_;
+    TaskHandle_t      capture_task_;
+    AudioCaptureStats stats_;
+    int64_t           last_block_us_;
+    std::atomic<uint32_t> convert_us_;
+
+    /* 區塊時間戳環（僅生產者寫入，容量需涵蓋整個環形緩衝） */
+    static constexpr uint32_t STAMP_SLOTS = AUDIO_STAMP_SLOTS;
+    AudioBlockStamp           stamps_[STAMP_SLOTS];
+    std::atomic<uint32_t>     stamp_count_;
+
+    /* 重取樣後（SAMPLE_RATE）依序原地處理的階段；停用者編譯期移除 */
+    using Stages = StageChain<StageIf<AUDIO_AGC_ENABLE, Agc>>;
+
+    /* 單一生產者專用的區塊暫存（ISR 或擷取 Task） */
+    PcmFilter          filter_;
+    Stages             stages_;
+#if AUDIO_BEAMFORM
+    PcmFilter          filter_right_;
+    Beamformer         beam_;
+    int16_t            block_right_[DMA_BUF_LEN];
+#endif
+    PolyphaseResampler resampler_;
+    int16_t            block_pcm_[DMA_BUF_LEN];
+
+    /* 目前 I2S 設定（低功耗切換時更新；ISR 只在通道停用期間之外讀取） */
+    int                slots_;
+    uint32_t           capture_rate_;
+    PolyphaseResampler *active_resampler_;
+#if LOW_POWER_LISTEN
+    std::atomic<bool>  low_power_;
+    PolyphaseResampler resampler_low_;
+    static constexpr uint32_t MIN_CAPTURE_RATE =
+        LOW_POWER_SAMPLE_RATE < CAPTURE_SAMPLE_RATE ? LOW_POWER_SAMPLE_RATE : CAPTURE_SAMPLE_RATE;
+#else
+    static constexpr uint32_t MIN_CAPTURE_RATE = CAPTURE_SAMPLE_RATE;
+#endif
+    int16_t            block_out_[(DMA_BUF_LEN * SAMPLE_RATE + MIN_CAPTURE_RATE - 1) / MIN_CAPTURE_RATE + 1];
+
+    bool        init_pipeline_();
+    static void capture_task_entry_(void *arg);
+    void        capture_loop_();
+
+    static bool on_recv_isr_(i2s_chan_handle_t handle, i2s_event_data_t *event, void *ctx);
+
+    /* 轉換、重取樣並寫入一個 DMA 區塊（Task 或 ISR 環境） */
+    void push_block_(const int32_t *raw, size_t frames, BaseType_t *hp_task_woken);
+
+    /* I2S 時脈 / slot 設定（init 與低功耗切換共用） */
+    static void clk_config_(i2s_std_clk_config_t *clk, uint32_t rate);
+    static void slot_config_(i2s_std_slot_config_t *slot, bool mono);
+};
+
+/* 區塊內游標改為 READER_HOLD（離開時恢復 READER_DROP） */
+class AudioReaderHoldScope {
+public:
+    AudioReaderHoldScope(AudioCapture &audio, AudioReaderId reader, bool hold)
+        : audio_(audio), reader_(reader), hold_(hold)
+    {
+        if (hold_) audio_.set_reader_policy(reader_, AudioRingBuffer::READER_HOLD);
+    }
+    ~AudioReaderHoldScope()
+    {
+        if (hold_) audio_.set_reader_policy(reader_, AudioRingBuffer::READER_DROP);
+    }
+
+    AudioReaderHoldScope(const AudioReaderHoldScope &) = delete;
+    AudioReaderHoldScope &operator=(const AudioReaderHoldScope &) = delete;
+
+private:
+    AudioCapture &audio_;
+    AudioReaderId reader_;
+    bool          hold_;
 };
 
 #endif // AUDIO_CAPTURE_H
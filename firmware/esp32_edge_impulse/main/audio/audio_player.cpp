@@ -0,0 +1,182 @@
+/*
+ * audio_player.cpp - 喇叭播放與下行音訊 jitter buffer 實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "audio_player.h"
+#include "adpcm.h"
+#include "rtos_alloc.h"
+#include "esp_log.h"
+#include <math.h>
+#include <string.h>
+
+static const char *TAG = "AudioPlayer";
+
+static constexpr size_t kJitterBytes    = SPK_SAMPLE_RATE * SPK_JITTER_MS / 1000 * sizeof(int16_t);
+static constexpr size_t kPrebufferBytes = SPK_SAMPLE_RATE * SPK_PREBUFFER_MS / 1000 * sizeof(int16_t);
+static constexpr int    kUnderrunMs     = SPK_DMA_BUF_LEN * 1000 / SPK_SAMPLE_RATE;
+
+static_assert(kPrebufferBytes < kJitterBytes, "SPK_PREBUFFER_MS must be below SPK_JITTER_MS");
+
+AudioPlayer::AudioPlayer()
+    : tx_chan_(nullptr), jitter_(nullptr), write_lock_(nullptr), task_(nullptr), flush_(false),
+      next_seq_(0)
+{
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+bool AudioPlayer::init()
+{
+#if SPEAKER_ENABLE
+    if (task_) return true;
+    jitter_     = RTOS_STREAM_BUFFER_CREATE(kJitterBytes, sizeof(int16_t));
+    write_lock_ = RTOS_MUTEX_CREATE();
+    if (!jitter_ || !write_lock_ || !init_i2s_()) {
+        ESP_LOGE(TAG, "Speaker init failed");
+        return false;
+    }
+    synth_chirp_();
+    if (RTOS_TASK_CREATE(task_entry_, "spk_play", SPK_PLAYER_TASK_STACK, this,
+                         SPK_PLAYER_TASK_PRIO, &task_, SPK_PLAYER_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start player task");
+        task_ = nullptr;
+        return false;
+    }
+    ESP_LOGI(TAG, "Speaker ready: %d Hz, jitter %d ms, prebuffer %d ms, BCK=%d WS=%d DOUT=%d",
+             SPK_SAMPLE_RATE, SPK_JITTER_MS, SPK_PREBUFFER_MS,
+             SPK_I2S_BCK_GPIO, SPK_I2S_WS_GPIO, SPK_I2S_DOUT_GPIO);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool AudioPlayer::init_i2s_()
+{
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(SPK_I2S_PORT_NUM, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num  = SPK_DMA_BUF_COUNT;
+    chan_cfg.dma_frame_num = SPK_DMA_BUF_LEN;
+    chan_cfg.auto_clear    = true;   // 沒有新資料時送出靜音，而非重播舊 DMA 內容
+    if (i2s_new_channel(&chan_cfg, &tx_chan_, NULL) != ESP_OK) return false;
+
+    i2s_std_config_t std_cfg = {
+        .clk_cfg  = I2S_STD_CLK_DEFAULT_CONFIG(SPK_SAMPLE_RATE),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = SPK_I2S_BCK_GPIO,
+            .ws   = SPK_I2S_WS_GPIO,
+            .dout = SPK_I2S_DOUT_GPIO,
+            .din  = I2S_GPIO_UNUSED,
+            .invert_flags = {},
+        },
+    };
+    if (i2s_channel_init_std_mode(tx_chan_, &std_cfg) != ESP_OK ||
+        i2s_channel_enable(tx_chan_) != ESP_OK) {
+        i2s_del_channel(tx_chan_);
+        tx_chan_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void AudioPlayer::synth_chirp_()
+{
+    /* 線性上升掃頻，升餘弦包絡避免爆音 */
+    const float dt    = 1.0f / SPK_SAMPLE_RATE;
+    const float sweep = (float)(SPK_CHIRP_F1_HZ - SPK_CHIRP_F0_HZ) / (CHIRP_SAMPLES * dt);
+    float phase = 0.0f;
+    for (size_t i = 0; i < CHIRP_SAMPLES; i++) {
+        float t   = i * dt;
+        float env = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / (CHIRP_SAMPLES - 1));
+        chirp_[i] = (int16_t)(SPK_CHIRP_LEVEL * env * sinf(phase));
+        phase += 2.0f * (float)M_PI * (SPK_CHIRP_F0_HZ + sweep * t) * dt;
+    }
+}
+
+/* ---------- 寫入端 ---------- */
+
+void AudioPlayer::push_(const int16_t *pcm, size_t n, bool flush)
+{
+    size_t bytes = n * sizeof(int16_t);
+    xSemaphoreTake(write_lock_, portMAX_DELAY);
+    size_t sent = xStreamBufferSend(jitter_, pcm, bytes, 0);
+    xSemaphoreGive(write_lock_);
+    if (sent < bytes) stats_.dropped_samples += (bytes - sent) / sizeof(int16_t);
+    if (flush) flush_.store(true, std::memory_order_release);
+    xTaskNotifyGive(task_);
+}
+
+void AudioPlayer::on_frame(const uint8_t *data, size_t len)
+{
+    if (!task_) return;
+    AudioDownlinkHeader hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    const uint8_t *payload = data + sizeof(hdr);
+    size_t         body    = len - sizeof(hdr);
+
+    if (hdr.flags & AUDIO_DOWNLINK_FLAG_START) {
+        stats_.streams++;
+        next_seq_ = hdr.seq;
+    }
+    if (hdr.seq != next_seq_) stats_.seq_gaps++;
+    next_seq_ = hdr.seq + 1;
+    stats_.frames++;
+
+    size_t n;
+    if (hdr.codec == AUDIO_DOWNLINK_CODEC_ADPCM) {
+        size_t want = hdr.samples < SPK_FRAME_MAX_SAMPLES ? hdr.samples : SPK_FRAME_MAX_SAMPLES;
+        n = adpcm_decode_block(payload, body, decode_, want);
+    } else if (hdr.codec == AUDIO_DOWNLINK_CODEC_PCM) {
+        n = body / sizeof(int16_t);
+        if (n > SPK_FRAME_MAX_SAMPLES) n = SPK_FRAME_MAX_SAMPLES;
+        memcpy(decode_, payload, n * sizeof(int16_t));
+    } else {
+        ESP_LOGW(TAG, "Unknown downlink codec %u", (unsigned)hdr.codec);
+        return;
+    }
+    push_(decode_, n, (hdr.flags & AUDIO_DOWNLINK_FLAG_END) != 0);
+}
+
+void AudioPlayer::chirp()
+{
+    if (!task_) return;
+    stats_.chirps++;
+    push_(chirp_, CHIRP_SAMPLES, true);
+}
+
+/* ---------- 播放 Task ---------- */
+
+void AudioPlayer::task_entry_(void *arg)
+{
+    static_cast<AudioPlayer *>(arg)->run_();
+}
+
+void AudioPlayer::run_()
+{
+    bool playing = false;
+    while (1) {
+        if (!playing) {
+            /* 等待 prebuffer 水位，或串流結束 / chirp（不論多短都立即播放） */
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            if (xStreamBufferBytesAvailable(jitter_) < kPrebufferBytes &&
+                !flush_.load(std::memory_order_acquire)) {
+                continue;
+            }
+            playing = true;
+        }
+
+        size_t got = xStreamBufferReceive(jitter_, out_, sizeof(out_), pdMS_TO_TICKS(kUnderrunMs));
+        if (got == 0) {
+            /* 緩衝耗盡：已結束的串流正常停止，否則為 underrun（網路延遲超過 jitter buffer） */
+            if (!flush_.exchange(false, std::memory_order_acq_rel)) stats_.underruns++;
+            playing = false;
+            continue;
+        }
+
+        size_t n = got / sizeof(int16_t);
+        for (size_t i = 0; i < n; i++) out_[i] >>= SPK_VOLUME_SHIFT;
+        size_t written = 0;
+        i2s_channel_write(tx_chan_, out_, n * sizeof(int16_t), &written, portMAX_DELAY);
+    }
+}
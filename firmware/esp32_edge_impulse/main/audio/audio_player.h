@@ -0,0 +1,101 @@
+#ifndef AUDIO_PLAYER_H
+#define AUDIO_PLAYER_H
+
+/* ============================================================
+ * audio_player.h - 喇叭播放（I2S TX）與下行音訊 jitter buffer
+ * ESP-MIAO v0.8.0
+ *
+ * Server 以 WebSocket binary frame 串流提示音（Server downlink.py / wire.py）：
+ *   [magic 0xA5][codec][flags][stream_id][seq u16][samples u16] + payload
+ *     codec 0 = PCM16 LE，1 = IMA-ADPCM 區塊（同 adpcm.h）
+ *     flags bit0 = 串流第一個 frame，bit1 = 最後一個
+ * WS 事件 Task 解碼後寫入 jitter buffer（StreamBuffer），播放 Task 累積 SPK_PREBUFFER_MS 後
+ * 才開始寫入 I2S，之後緩衝耗盡即回到等待；DMA auto_clear 使閒置時輸出靜音。
+ * 喚醒提示音（chirp）開機時預先合成，直接寫入 jitter buffer 並立即播放，不經網路。
+ * SPEAKER_ENABLE=0 時 init() 不建立任何資源，其餘呼叫皆不動作。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "driver/i2s_std.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "config.h"
+
+#define AUDIO_DOWNLINK_MAGIC        0xA5
+#define AUDIO_DOWNLINK_CODEC_PCM    0
+#define AUDIO_DOWNLINK_CODEC_ADPCM  1
+#define AUDIO_DOWNLINK_FLAG_START   0x01
+#define AUDIO_DOWNLINK_FLAG_END     0x02
+
+struct __attribute__((packed)) AudioDownlinkHeader {
+    uint8_t  magic;
+    uint8_t  codec;
+    uint8_t  flags;
+    uint8_t  stream_id;
+    uint16_t seq;
+    uint16_t samples;
+};
+static_assert(sizeof(AudioDownlinkHeader) == 8, "Must match Server wire.py DOWNLINK_HEADER");
+
+/* 播放統計 */
+struct AudioPlayerStats {
+    uint32_t streams;         // 收到的下行串流（START frame）
+    uint32_t frames;
+    uint32_t seq_gaps;        // seq 不連續（Server 中止前一段或 frame 遺失）
+    uint32_t underruns;       // 串流未結束但緩衝已空
+    uint32_t dropped_samples; // jitter buffer 已滿而捨棄的樣本
+    uint32_t chirps;
+};
+
+class AudioPlayer {
+public:
+    AudioPlayer();
+
+    /**
+     * 建立 I2S TX 通道、jitter buffer、播放 Task，並合成喚醒提示音。
+     * @return false = SPEAKER_ENABLE=0 或初始化失敗（之後的呼叫皆不動作）
+     */
+    bool init();
+
+    bool enabled() const { return task_ != nullptr; }
+
+    /** binary frame 是否為下行音訊（其餘交給 server_action_parse_binary） */
+    static bool is_downlink_frame(const uint8_t *data, size_t len)
+    {
+        return len >= sizeof(AudioDownlinkHeader) && data[0] == AUDIO_DOWNLINK_MAGIC;
+    }
+
+    /** 下行音訊 frame（WS 事件 Task，不阻塞；緩衝滿時捨棄） */
+    void on_frame(const uint8_t *data, size_t len);
+
+    /** 播放喚醒提示音（任一 Task，不阻塞） */
+    void chirp();
+
+    AudioPlayerStats stats() const { return stats_; }
+
+private:
+    i2s_chan_handle_t    tx_chan_;
+    StreamBufferHandle_t jitter_;
+    SemaphoreHandle_t    write_lock_;   // jitter buffer 有兩個寫入者（WS 事件 Task / 喚醒 session）
+    TaskHandle_t         task_;
+    std::atomic<bool>    flush_;        // 串流已結束或為 chirp：不等 prebuffer，播完為止
+    uint16_t             next_seq_;     // 僅 WS 事件 Task 存取
+    AudioPlayerStats     stats_;
+
+    static constexpr size_t CHIRP_SAMPLES = SPK_SAMPLE_RATE * SPK_CHIRP_MS / 1000;
+    int16_t chirp_[CHIRP_SAMPLES];
+    int16_t decode_[SPK_FRAME_MAX_SAMPLES];   // 僅 WS 事件 Task 使用
+    int16_t out_[SPK_DMA_BUF_LEN];            // 僅播放 Task 使用
+
+    bool init_i2s_();
+    void synth_chirp_();
+    void push_(const int16_t *pcm, size_t n, bool flush);
+    static void task_entry_(void *arg);
+    void run_();
+};
+
+#endif // AUDIO_PLAYER_H
@@ -0,0 +1,76 @@
+/*
+ * beamformer.cpp - 雙麥克風延遲相加 beamformer 實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "beamformer.h"
+#include <string.h>
+
+Beamformer::Beamformer() : max_delay_(1), delay_(0)
+{
+    memset(corr_, 0, sizeof(corr_));
+    memset(left_, 0, sizeof(left_));
+    memset(right_, 0, sizeof(right_));
+}
+
+void Beamformer::init(int max_delay)
+{
+    if (max_delay < 1) max_delay = 1;
+    if (max_delay > MAX_DELAY) max_delay = MAX_DELAY;
+    max_delay_ = max_delay;
+    delay_     = 0;
+    memset(corr_, 0, sizeof(corr_));
+    memset(left_, 0, sizeof(left_));
+    memset(right_, 0, sizeof(right_));
+}
+
+void Beamformer::process(const int16_t *left, const int16_t *right, size_t n, int16_t *out)
+{
+    while (n > 0) {
+        size_t chunk = n < BLOCK ? n : BLOCK;
+        process_chunk_(left, right, chunk, out);
+        left  += chunk;
+        right += chunk;
+        out   += chunk;
+        n     -= chunk;
+    }
+}
+
+void Beamformer::process_chunk_(const int16_t *left, const int16_t *right, size_t n, int16_t *out)
+{
+    const int D = max_delay_;
+    memcpy(left_ + D, left, n * sizeof(int16_t));
+    memcpy(right_ + D, right, n * sizeof(int16_t));
+
+    /* 1. 各候選延遲的互相關（EMA 1/2^BEAMFORM_SMOOTH_SHIFT） */
+    for (int tau = -D; tau <= D; tau++) {
+        const int16_t *l = left_ + D - (tau > 0 ? tau : 0);
+        const int16_t *r = right_ + D - (tau < 0 ? -tau : 0);
+        int64_t acc = 0;
+        for (size_t i = 0; i < n; i++) acc += (int32_t)l[i] * r[i];
+        int64_t &c = corr_[tau + MAX_DELAY];
+        c += (acc - c) >> BEAMFORM_SMOOTH_SHIFT;
+    }
+    int best = delay_;
+    for (int tau = -D; tau <= D; tau++) {
+        if (corr_[tau + MAX_DELAY] > corr_[best + MAX_DELAY]) best = tau;
+    }
+
+    /* 2. 遲滯：明顯優於目前方向才轉向，避免在兩個延遲間來回跳動造成相位不連續 */
+    int64_t cur = corr_[delay_ + MAX_DELAY];
+    int64_t mag = cur < 0 ? -cur : cur;
+    if (best != delay_ && corr_[best + MAX_DELAY] - cur > (mag >> BEAMFORM_SWITCH_SHIFT)) {
+        delay_ = best;
+    }
+
+    /* 3. 對齊後相加（out 可能與 left 相同，來源已複製到 left_） */
+    const int16_t *l = left_ + D - (delay_ > 0 ? delay_ : 0);
+    const int16_t *r = right_ + D - (delay_ < 0 ? -delay_ : 0);
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (int16_t)(((int32_t)l[i] + r[i]) >> 1);
+    }
+
+    /* 保留尾端 D 個樣本給下一區塊 */
+    memmove(left_, left_ + n, D * sizeof(int16_t));
+    memmove(right_, right_ + n, D * sizeof(int16_t));
+}
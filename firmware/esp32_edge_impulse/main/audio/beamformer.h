@@ -0,0 +1,56 @@
+#ifndef BEAMFORMER_H
+#define BEAMFORMER_H
+
+/* ============================================================
+ * beamformer.h - 雙麥克風延遲相加 beamformer（定點，可於 ISR 呼叫）
+ * ESP-MIAO v0.8.0
+ *
+ * 左右兩顆 INMP441 共用 I2S（左 slot / 右 slot），每個 DMA 區塊：
+ *   1. 對 -D..+D 每個候選延遲 τ 計算互相關 Σ L[n-a]·R[n-b]
+ *      （a = max(τ,0)、b = max(-τ,0)），以 EMA 跨區塊平滑
+ *   2. 平滑後互相關最大的 τ 即最強聲源方向；超過目前方向一定比例才切換
+ *   3. 輸出 (L[n-a] + R[n-b]) / 2：對齊後同相相加，偏離方向的噪音部分抵消
+ * τ > 0 表示聲源偏左（左麥克風先收到）。D 由麥克風間距與取樣率決定。
+ * 全程整數運算：push_block_ 可能在 I2S ISR 內執行，不使用 FPU。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+class Beamformer {
+public:
+    /** 最大延遲上限（樣本數，決定歷史與互相關表大小） */
+    static constexpr int MAX_DELAY = 16;
+
+    Beamformer();
+
+    /**
+     * @param max_delay 最大延遲 D（樣本；1..MAX_DELAY，超出會被截斷）
+     */
+    void init(int max_delay);
+
+    /**
+     * 延遲相加一個區塊（跨區塊保留歷史，單一生產者）。
+     * @param out 輸出（n 個樣本，可與 left 相同）
+     */
+    void process(const int16_t *left, const int16_t *right, size_t n, int16_t *out);
+
+    /** 目前的轉向延遲（樣本，> 0 = 聲源偏左） */
+    int delay() const { return delay_; }
+
+private:
+    static constexpr size_t BLOCK = AUDIO_CAPTURE_BLOCK_FRAMES;
+
+    int     max_delay_;
+    int     delay_;
+    int64_t corr_[2 * MAX_DELAY + 1];   // 平滑後互相關，索引 = τ + MAX_DELAY
+
+    /* [0, D) 為上一區塊尾端，其後為本區塊 */
+    int16_t left_[MAX_DELAY + BLOCK];
+    int16_t right_[MAX_DELAY + BLOCK];
+
+    void process_chunk_(const int16_t *left, const int16_t *right, size_t n, int16_t *out);
+};
+
+#endif // BEAMFORMER_H
@@ -0,0 +1,51 @@
+/*
+ * energy_detector.cpp - 低功耗聆聽的幀能量偵測實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "energy_detector.h"
+#include <math.h>
+
+EnergyDetector::EnergyDetector() : noise_rms_(LOW_POWER_MIN_RMS), last_peak_(0.0f), acc_(0), fill_(0) {}
+
+void EnergyDetector::reset(float noise_rms)
+{
+    noise_rms_ = noise_rms > 1.0f ? noise_rms : 1.0f;
+    last_peak_ = 0.0f;
+    acc_       = 0;
+    fill_      = 0;
+}
+
+bool EnergyDetector::frame_(float rms)
+{
+    if (rms > last_peak_) last_peak_ = rms;
+
+    float threshold = noise_rms_ * LOW_POWER_WAKE_RATIO;
+    if (threshold < LOW_POWER_MIN_RMS) threshold = LOW_POWER_MIN_RMS;
+    if (rms > threshold) return true;
+
+    float a = rms < noise_rms_ ? LOW_POWER_NOISE_FALL : LOW_POWER_NOISE_RISE;
+    noise_rms_ += a * (rms - noise_rms_);
+    if (noise_rms_ < 1.0f) noise_rms_ = 1.0f;
+    return false;
+}
+
+bool EnergyDetector::detect(const AudioSlice &slice)
+{
+    last_peak_ = 0.0f;
+
+    /* 環繞的兩段視為連續 */
+    for (int s = 0; s < 2; s++) {
+        const int16_t *p = slice.seg[s];
+        for (size_t i = 0; i < slice.len[s]; i++) {
+            int32_t v = p[i];
+            acc_ += v * v;
+            if (++fill_ < LOW_POWER_FRAME_SAMPLES) continue;
+            bool hit = frame_(sqrtf((float)acc_ / LOW_POWER_FRAME_SAMPLES));
+            acc_  = 0;
+            fill_ = 0;
+            if (hit) return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,43 @@
+#ifndef ENERGY_DETECTOR_H
+#define ENERGY_DETECTOR_H
+
+/* ============================================================
+ * energy_detector.h - 低功耗聆聽的幀能量偵測
+ * ESP-MIAO v0.8.0
+ *
+ * 取代低功耗模式下的 FFT VAD：每 LOW_POWER_FRAME_SAMPLES 個樣本只做一次
+ * 整數平方和，幀 RMS 超過 max(LOW_POWER_MIN_RMS, 噪音底 × LOW_POWER_WAKE_RATIO) 即觸發。
+ * 噪音底對較安靜的幀快速下探、對未觸發的較吵幀緩慢上升（穩定的背景聲不會一直觸發）。
+ * 分幀跨切片連續（未滿一幀的平方和留到下一切片）。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "audio_capture.h"
+#include "config.h"
+
+class EnergyDetector {
+public:
+    EnergyDetector();
+
+    /** 以進入低功耗前的 VAD 背景 RMS 作為初始噪音底 */
+    void reset(float noise_rms);
+
+    /** 處理一個切片；任一幀超過門檻即回傳 true（其餘樣本捨棄，噪音底不以觸發幀更新） */
+    bool detect(const AudioSlice &slice);
+
+    float noise_rms() const { return noise_rms_; }
+
+    /** 最近一次 detect 中最大的幀 RMS */
+    float last_peak() const { return last_peak_; }
+
+private:
+    float   noise_rms_;
+    float   last_peak_;
+    int64_t acc_;       // 目前幀的平方和（int64，32 ms 幀不會溢位）
+    size_t  fill_;
+
+    bool frame_(float rms);
+};
+
+#endif // ENERGY_DETECTOR_H
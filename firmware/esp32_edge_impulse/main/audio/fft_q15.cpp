@@ -0,0 +1,41 @@
+/*
+ * fft_q15.cpp - Q15 定點複數 FFT 實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "fft_q15.h"
+#include "fft_radix4.h"
+
+void fft_q15(int32_t *z, const int16_t *twiddle_r, const int16_t *twiddle_i)
+{
+    const int H = FFT_SIZE / 2;
+
+    /* Bit-reversal permutation：編譯期交換對（fft_radix4.h） */
+    for (int p = 0; p < BitReversal<FFT_SIZE / 2>::kPairs; p++) {
+        int32_t *a = z + 2 * kFftBitRev.pair[p][0];
+        int32_t *b = z + 2 * kFftBitRev.pair[p][1];
+        int32_t  tr = a[0], ti = a[1];
+        a[0] = b[0];  a[1] = b[1];
+        b[0] = tr;    b[1] = ti;
+    }
+
+    /* 基 2 DIT，每級 >>1 */
+    for (int len = 2; len <= H; len <<= 1) {
+        int half = len >> 1;
+        int step = FFT_SIZE / len;   // W_len^k = W_N^(k·N/len)
+        for (int i = 0; i < H; i += len) {
+            for (int k = 0; k < half; k++) {
+                int32_t wr = twiddle_r[k * step];
+                int32_t wi = twiddle_i[k * step];
+                int32_t *a = z + 2 * (i + k);
+                int32_t *b = z + 2 * (i + k + half);
+                int32_t tr = (int32_t)(((int64_t)wr * b[0] - (int64_t)wi * b[1] + (1 << 14)) >> 15);
+                int32_t ti = (int32_t)(((int64_t)wr * b[1] + (int64_t)wi * b[0] + (1 << 14)) >> 15);
+                b[0] = (a[0] - tr + 1) >> 1;
+                b[1] = (a[1] - ti + 1) >> 1;
+                a[0] = (a[0] + tr + 1) >> 1;
+                a[1] = (a[1] + ti + 1) >> 1;
+            }
+        }
+    }
+}
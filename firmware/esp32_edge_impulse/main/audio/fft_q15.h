@@ -0,0 +1,30 @@
+#ifndef FFT_Q15_H
+#define FFT_Q15_H
+
+/* ============================================================
+ * fft_q15.h - Q15 定點複數 FFT（VadQ15 與 SpectralFrontend 共用）
+ * ESP-MIAO v0.8.0
+ *
+ * FFT_SIZE 點實數輸入以 N/2 點 interleaved 複數（z[n] = x[2n] + j·x[2n+1]）原地計算：
+ * bit-reversal（編譯期交換對）後基 2 DIT，旋轉因子為 Q15，每級 >>1 防溢位，結果為 DFT / (N/2)。
+ * 輸入分量須 < 2^23（每級最多成長 (1+√2)/2，8 級後仍 < 2^26）。
+ * ============================================================ */
+
+#include <stdint.h>
+#include "config.h"
+
+/* Q15 係數 × int32 資料，四捨五入 */
+static inline int32_t q15_mul(int32_t w, int32_t x)
+{
+    return (int32_t)(((int64_t)w * x + (1 << 14)) >> 15);
+}
+
+/**
+ * N/2 點複數 FFT（原地）。
+ * @param z          FFT_SIZE 個 int32（N/2 個 interleaved 複數）
+ * @param twiddle_r  W_N^k 實部（Q15，k < N/2）
+ * @param twiddle_i  W_N^k 虛部（Q15）
+ */
+void fft_q15(int32_t *z, const int16_t *twiddle_r, const int16_t *twiddle_i);
+
+#endif // FFT_Q15_H
@@ -0,0 +1,97 @@
+/*
+ * fft_radix4.cpp - 基 4 浮點複數 FFT 實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "fft_radix4.h"
+
+namespace {
+
+constexpr int kH = FFT_SIZE / 2;
+constexpr int kBits = BitReversal<kH>::bits();
+constexpr bool kRadix2First = (kBits & 1) != 0;   // 奇數級：先做一級基 2
+constexpr int kQ0 = kRadix2First ? 2 : 1;          // 第一個基 4 級的子 DFT 長度
+
+/* 所有基 4 級的 k 總數（q = kQ0, 4·kQ0, ... , kH/4） */
+constexpr int twiddle_count()
+{
+    int n = 0;
+    for (int q = kQ0; q * 4 <= kH; q *= 4) n += q;
+    return n;
+}
+
+/* 依使用順序排列：每級、每個 k 一組 {W^k, W^2k, W^3k}（W = e^{-j2π/4q}），實部 / 虛部交錯 */
+struct Radix4Twiddles {
+    float w[twiddle_count()][6];
+
+    constexpr Radix4Twiddles() : w()
+    {
+        int n = 0;
+        for (int q = kQ0; q * 4 <= kH; q *= 4) {
+            for (int k = 0; k < q; k++, n++) {
+                for (int r = 1; r <= 3; r++) {
+                    double angle         = -2.0 * kPi * r * k / (4.0 * q);
+                    w[n][2 * (r - 1)]     = (float)cx_cos(angle);
+                    w[n][2 * (r - 1) + 1] = (float)cx_sin(angle);
+                }
+            }
+        }
+    }
+};
+
+constexpr Radix4Twiddles kR4{};
+
+}  // namespace
+
+void fft_radix4_fc32(float *z)
+{
+    /* 位元反轉：查表交換 */
+    for (int p = 0; p < BitReversal<kH>::kPairs; p++) {
+        float *a = z + 2 * kFftBitRev.pair[p][0];
+        float *b = z + 2 * kFftBitRev.pair[p][1];
+        float  r = a[0], i = a[1];
+        a[0] = b[0];  a[1] = b[1];
+        b[0] = r;     b[1] = i;
+    }
+
+    if (kRadix2First) {
+        for (float *a = z; a < z + 2 * kH; a += 4) {
+            float r = a[2], i = a[3];
+            a[2] = a[0] - r;  a[3] = a[1] - i;
+            a[0] += r;        a[1] += i;
+        }
+    }
+
+    const float *w = kR4.w[0];
+    for (int q = kQ0; q * 4 <= kH; q *= 4) {
+        const int L = 4 * q;
+        for (int k = 0; k < q; k++, w += 6) {
+            const float w1r = w[0], w1i = w[1];
+            const float w2r = w[2], w2i = w[3];
+            const float w3r = w[4], w3i = w[5];
+            for (int i = k; i < kH; i += L) {
+                /* 位元反轉排列下四段依序為 F0、F2、F1、F3 */
+                float *p0 = z + 2 * i;
+                float *p1 = p0 + 2 * q;
+                float *p2 = p1 + 2 * q;
+                float *p3 = p2 + 2 * q;
+
+                float ar = p0[0], ai = p0[1];
+                float cr = w2r * p1[0] - w2i * p1[1], ci = w2r * p1[1] + w2i * p1[0];
+                float br = w1r * p2[0] - w1i * p2[1], bi = w1r * p2[1] + w1i * p2[0];
+                float dr = w3r * p3[0] - w3i * p3[1], di = w3r * p3[1] + w3i * p3[0];
+
+                float t0r = ar + cr, t0i = ai + ci;
+                float t1r = ar - cr, t1i = ai - ci;
+                float t2r = br + dr, t2i = bi + di;
+                float t3r = br - dr, t3i = bi - di;
+
+                /* X0 = t0 + t2、X1 = t1 - j·t3、X2 = t0 - t2、X3 = t1 + j·t3 */
+                p0[0] = t0r + t2r;  p0[1] = t0i + t2i;
+                p1[0] = t1r + t3i;  p1[1] = t1i - t3r;
+                p2[0] = t0r - t2r;  p2[1] = t0i - t2i;
+                p3[0] = t1r - t3i;  p3[1] = t1i + t3r;
+            }
+        }
+    }
+}
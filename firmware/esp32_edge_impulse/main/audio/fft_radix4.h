@@ -0,0 +1,86 @@
+#ifndef FFT_RADIX4_H
+#define FFT_RADIX4_H
+
+/* ============================================================
+ * fft_radix4.h - VAD 的基 4 浮點複數 FFT 與編譯期位元反轉表
+ * ESP-MIAO v0.8.0
+ *
+ * FFT_SIZE 點實數輸入以 N/2 點 interleaved 複數（z[n] = x[2n] + j·x[2n+1]）原地計算，
+ * 輸出為自然順序（與 esp-dsp dsps_fft2r + dsps_bit_rev 相同，可直接做實數頻譜分離）：
+ *   - 位元反轉：constexpr 產生的交換對（i < j）依序處理，不再每幀以 while 迴圈推算
+ *   - 基 4 DIT：輸入為基 2 位元反轉順序，四段子 DFT 依序為 F0 / F2 / F1 / F3；
+ *     log2(N/2) 為奇數時先做一級無旋轉因子的基 2
+ *   - 旋轉因子 W^k、W^2k、W^3k 依各級、依 k 的使用順序連續排列（constexpr，置於 flash），
+ *     k 在外層、區塊在內層，每組係數只載入一次、不跨步
+ * 每 4 點 3 次複數乘法（基 2 兩級為 4 次），級數減半，資料少讀寫一半。
+ * ============================================================ */
+
+#include <stdint.h>
+#include "config.h"
+
+/* ---------- 編譯期三角函數（VAD 的窗 / 旋轉因子 / biquad 係數表共用） ---------- */
+
+constexpr double kPi = 3.14159265358979323846;
+
+/* constexpr cos：化約至 [-π, π] 後以泰勒級數展開（誤差 < 1e-9） */
+constexpr double cx_cos(double x)
+{
+    long k = (long)(x / (2.0 * kPi) + (x >= 0.0 ? 0.5 : -0.5));
+    x -= (double)k * 2.0 * kPi;
+    double term = 1.0, sum = 1.0, x2 = x * x;
+    for (int n = 1; n <= 14; n++) {
+        term *= -x2 / (double)((2 * n - 1) * (2 * n));
+        sum  += term;
+    }
+    return sum;
+}
+
+constexpr double cx_sin(double x) { return cx_cos(x - kPi / 2.0); }
+
+/* 編譯期位元反轉交換對：N 點中 i < bitrev(i) 的 (i, j)，依 i 遞增 */
+template <int N>
+struct BitReversal {
+    static constexpr int bits()
+    {
+        int b = 0;
+        while ((1 << b) < N) b++;
+        return b;
+    }
+
+    static constexpr int reverse(int i)
+    {
+        int r = 0;
+        for (int b = 0; b < bits(); b++) r |= ((i >> b) & 1) << (bits() - 1 - b);
+        return r;
+    }
+
+    /* 對稱（i == bitrev(i)）的有 2^ceil(bits/2) 個，其餘兩兩成對 */
+    static constexpr int kPairs = (N - (1 << ((bits() + 1) / 2))) / 2;
+
+    uint16_t pair[kPairs][2];
+
+    constexpr BitReversal() : pair()
+    {
+        static_assert((N & (N - 1)) == 0 && N >= 4 && N <= 65536, "BitReversal needs a power-of-two size");
+        int n = 0;
+        for (int i = 0; i < N; i++) {
+            int j = reverse(i);
+            if (i < j) {
+                pair[n][0] = (uint16_t)i;
+                pair[n][1] = (uint16_t)j;
+                n++;
+            }
+        }
+    }
+};
+
+/* VAD / 頻譜前端共用（N/2 點複數） */
+inline constexpr BitReversal<FFT_SIZE / 2> kFftBitRev{};
+
+/**
+ * N/2 點複數 FFT（原地，輸出自然順序、不縮放）。
+ * @param z  FFT_SIZE 個 float（N/2 個 interleaved 複數）
+ */
+void fft_radix4_fc32(float *z);
+
+#endif // FFT_RADIX4_H
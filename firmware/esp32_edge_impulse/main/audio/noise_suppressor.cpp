@@ -0,0 +1,164 @@
+/*
+ * noise_suppressor.cpp - 頻譜減法降噪實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "noise_suppressor.h"
+#include "pcm_convert.h"
+#include "esp_log.h"
+#include "dsps_fft2r.h"
+#include "dsp_err_codes.h"
+#include <math.h>
+#include <string.h>
+
+static const char *TAG = "NoiseSup";
+
+/* 與 VAD 相同的人聲頻帶 bin 範圍 */
+static constexpr int kStartBin = (FFT_FREQ_MIN * FFT_SIZE) / SAMPLE_RATE;
+static constexpr int kEndBin   = ((FFT_FREQ_MAX * FFT_SIZE) / SAMPLE_RATE < FFT_SIZE / 2)
+                               ? (FFT_FREQ_MAX * FFT_SIZE) / SAMPLE_RATE : FFT_SIZE / 2;
+
+/* sqrt-Hann（periodic）：分析 × 合成 = Hann，50% 重疊相加恆為 1 */
+static float s_window[FFT_SIZE];
+static bool  s_window_ready = false;
+
+NoiseSuppressor::NoiseSuppressor()
+    : ready_(false), pos_(0), noise_frames_(0), energy_scale_(1.0f), mean_gain_(1.0f)
+{
+    memset(in_, 0, sizeof(in_));
+    memset(ola_, 0, sizeof(ola_));
+    memset(out_, 0, sizeof(out_));
+    memset(noise_, 0, sizeof(noise_));
+    memset(power_, 0, sizeof(power_));
+    memset(fft_, 0, sizeof(fft_));
+    for (size_t k = 0; k < BINS; k++) gain_[k] = 1.0f;
+}
+
+bool NoiseSuppressor::init()
+{
+    if (ready_) return true;
+
+    /* 表格與 VAD / EI SDK 共用（REINITIALIZED 亦可用） */
+    esp_err_t err = dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE);
+    if (err != ESP_OK && err != ESP_ERR_DSP_REINITIALIZED) {
+        ESP_LOGW(TAG, "esp-dsp FFT init failed (0x%x), noise suppression bypassed", (unsigned)err);
+        return false;
+    }
+
+    if (!s_window_ready) {
+        for (int i = 0; i < FFT_SIZE; i++) {
+            s_window[i] = sqrtf(0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / FFT_SIZE));
+        }
+        s_window_ready = true;
+    }
+
+    /* VAD 以 Hamming 窗計算 band_rms：兩窗的平均功率比換算為同一尺度（sqrt-Hann 平均功率 = 0.5） */
+    double hamming_power = 0.0;
+    for (int i = 0; i < FFT_SIZE; i++) {
+        double w = 0.54 - 0.46 * cos(2.0 * M_PI * i / (FFT_SIZE - 1));
+        hamming_power += w * w;
+    }
+    energy_scale_ = (float)sqrt(hamming_power / FFT_SIZE / 0.5);
+
+    ready_ = true;
+    ESP_LOGI(TAG, "Noise suppressor ready: %d-point STFT, hop %u, floor %.0f dB",
+             FFT_SIZE, (unsigned)HOP, 20.0f * log10f(NS_GAIN_FLOOR));
+    return true;
+}
+
+void NoiseSuppressor::reset(bool keep_noise)
+{
+    pos_       = 0;
+    mean_gain_ = 1.0f;
+    memset(in_, 0, sizeof(in_));
+    memset(ola_, 0, sizeof(ola_));
+    memset(out_, 0, sizeof(out_));
+    for (size_t k = 0; k < BINS; k++) gain_[k] = 1.0f;
+    if (!keep_noise) {
+        memset(noise_, 0, sizeof(noise_));
+        noise_frames_ = 0;
+    }
+}
+
+size_t NoiseSuppressor::process(int16_t *pcm, size_t n, float speech_threshold,
+                                float *energies, size_t max_energies)
+{
+    if (!ready_) return 0;
+
+    size_t frames = 0;
+    for (size_t i = 0; i < n; i++) {
+        int16_t x = pcm[i];
+        pcm[i] = out_[pos_];
+        in_[HOP + pos_] = (float)x;
+        if (++pos_ < HOP) continue;
+
+        float energy = frame_(speech_threshold);
+        if (energies && frames < max_energies) energies[frames] = energy;
+        frames++;
+        memmove(in_, in_ + HOP, HOP * sizeof(float));
+        pos_ = 0;
+    }
+    return (energies && frames > max_energies) ? max_energies : frames;
+}
+
+float NoiseSuppressor::frame_(float speech_threshold)
+{
+    const int N = FFT_SIZE;
+
+    /* 1. 分析窗 → 複數 FFT（虛部為 0） */
+    for (int i = 0; i < N; i++) {
+        fft_[2 * i]     = in_[i] * s_window[i];
+        fft_[2 * i + 1] = 0.0f;
+    }
+    dsps_fft2r_fc32(fft_, N);
+    dsps_bit_rev_fc32(fft_, N);
+
+    /* 2. 頻帶能量（VAD 尺度）與噪音頻譜更新 */
+    float band = 0.0f;
+    for (size_t k = 0; k < BINS; k++) {
+        power_[k] = fft_[2 * k] * fft_[2 * k] + fft_[2 * k + 1] * fft_[2 * k + 1];
+        if ((int)k >= kStartBin && (int)k < kEndBin) band += power_[k];
+    }
+    const int bins   = kEndBin - kStartBin;
+    float     energy = bins > 0 ? energy_scale_ * sqrtf(band / bins) : 0.0f;
+
+    if (energy < speech_threshold) {
+        /* 前 NS_NOISE_INIT_FRAMES 幀取平均快速收斂，之後以 EMA 追蹤 */
+        float a = (noise_frames_ < NS_NOISE_INIT_FRAMES) ? 1.0f / (float)(noise_frames_ + 1)
+                                                         : NS_NOISE_ALPHA;
+        for (size_t k = 0; k < BINS; k++) noise_[k] += a * (power_[k] - noise_[k]);
+        noise_frames_++;
+    }
+
+    /* 3. 頻譜減法增益（共軛對稱套用，反 FFT 結果為實數） */
+    const float floor2 = NS_GAIN_FLOOR * NS_GAIN_FLOOR;
+    float       g_sum  = 0.0f;
+    for (size_t k = 0; k < BINS; k++) {
+        float g = 1.0f;
+        if (noise_frames_ > 0) {
+            float r = power_[k] > 0.0f ? 1.0f - NS_OVERSUBTRACT * noise_[k] / power_[k] : 0.0f;
+            g = sqrtf(r > floor2 ? r : floor2);
+        }
+        /* 語音起始立即放大，衰減平滑 */
+        gain_[k] = (g > gain_[k]) ? g : gain_[k] * NS_GAIN_RELEASE + g * (1.0f - NS_GAIN_RELEASE);
+        g_sum   += gain_[k];
+
+        fft_[2 * k]     *= gain_[k];
+        fft_[2 * k + 1] *= -gain_[k];          // 取共軛：以正向 FFT 計算反 FFT
+        if (k > 0 && k < (size_t)N / 2) {
+            fft_[2 * (N - k)]     *= gain_[k];
+            fft_[2 * (N - k) + 1] *= -gain_[k];
+        }
+    }
+    mean_gain_ = g_sum / BINS;
+
+    /* 4. 反 FFT（conj(FFT(conj(X))) / N，只取實部）→ 合成窗 → 重疊相加 */
+    dsps_fft2r_fc32(fft_, N);
+    dsps_bit_rev_fc32(fft_, N);
+    const float inv_n = 1.0f / N;
+    for (size_t i = 0; i < HOP; i++) {
+        out_[i] = pcm_saturate_i16((int32_t)lrintf(ola_[i] + fft_[2 * i] * inv_n * s_window[i]));
+        ola_[i] = fft_[2 * (i + HOP)] * inv_n * s_window[i + HOP];
+    }
+    return energy;
+}
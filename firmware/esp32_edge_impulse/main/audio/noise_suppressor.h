@@ -0,0 +1,71 @@
+#ifndef NOISE_SUPPRESSOR_H
+#define NOISE_SUPPRESSOR_H
+
+/* ============================================================
+ * noise_suppressor.h - 串流前的頻譜減法降噪（STFT / WOLA）
+ * ESP-MIAO v0.8.0
+ *
+ * FFT_SIZE 點幀、50% 重疊，分析與合成皆用 sqrt-Hann 窗（相乘為 Hann，重疊相加完美重建）：
+ *   1. 每幀同時算出 300~3400Hz 頻帶能量（與 VAD 同尺度），低於 VAD 閾值的幀更新噪音頻譜
+ *   2. 增益 = sqrt(max(1 - NS_OVERSUBTRACT·N/|X|², floor²))，上升立即、下降平滑（抑制 musical noise）
+ *   3. 反 FFT 後重疊相加輸出
+ * 頻帶能量交給端點偵測 VAD（VAD::detect_energies），串流端不必再做一次 FFT。
+ * 輸出延遲 FFT_SIZE 個樣本（32 ms），樣本數與輸入相同，開頭為靜音。
+ * 風扇 / 吸塵器等穩態噪音效果最好；Server 端播放的提示音為非穩態，僅部分抑制。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+class NoiseSuppressor {
+public:
+    static constexpr size_t HOP  = FFT_SIZE / 2;
+    static constexpr size_t BINS = FFT_SIZE / 2 + 1;
+
+    NoiseSuppressor();
+
+    /**
+     * 初始化 FFT 表與窗函數（可重複呼叫）。
+     * @return false = esp-dsp FFT 不可用，process() 退為直通
+     */
+    bool init();
+
+    /** 清除重疊相加與增益狀態（新串流 / 續傳時呼叫）；keep_noise = 保留已學到的噪音頻譜 */
+    void reset(bool keep_noise = true);
+
+    /**
+     * 原地降噪 n 個樣本（輸出延遲 FFT_SIZE 個樣本）。
+     * @param speech_threshold 頻帶能量低於此值的幀視為噪音（通常為 VAD 目前閾值）
+     * @param energies         [out] 本次完成的各幀頻帶能量（可為 nullptr）
+     * @param max_energies     energies 容量
+     * @return 本次完成的幀數（最多 max_energies；未就緒時為 0）
+     */
+    size_t process(int16_t *pcm, size_t n, float speech_threshold,
+                   float *energies, size_t max_energies);
+
+    bool ready() const { return ready_; }
+
+    /** 最近一幀的平均增益（0~1，統計用） */
+    float mean_gain() const { return mean_gain_; }
+
+private:
+    bool     ready_;
+    size_t   pos_;                       // 本 hop 已收樣本數
+    uint32_t noise_frames_;              // 已納入噪音估計的幀數
+    float    energy_scale_;              // sqrt-Hann 頻帶能量 → VAD Hamming 尺度
+    float    mean_gain_;
+
+    float    in_[FFT_SIZE];              // [0, HOP) 上一 hop，[HOP, FFT_SIZE) 本 hop
+    float    ola_[HOP];                  // 上一幀後半（待與下一幀前半相加）
+    int16_t  out_[HOP];                  // 待輸出的完成樣本
+    float    noise_[BINS];               // 噪音功率頻譜
+    float    gain_[BINS];                // 平滑後的振幅增益
+    float    power_[BINS];               // 本幀功率頻譜（工作區）
+    alignas(16) float fft_[FFT_SIZE * 2]; // interleaved 複數工作區
+
+    /** 分析 in_ 一幀、更新 out_ / ola_，回傳頻帶能量 */
+    float frame_(float speech_threshold);
+};
+
+#endif // NOISE_SUPPRESSOR_H
@@ -0,0 +1,125 @@
+/*
+ * pcm_convert.cpp - I2S 原始樣本轉換實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "pcm_convert.h"
+
+/* DC blocker 輸出狀態保留的小數位數（輸入先飽和至 16-bit，確保 int32 不溢位） */
+#define PCM_DC_FRAC_BITS 12
+
+void pcm_filter_init(PcmFilter *f, float dc_pole, float pre_emphasis)
+{
+    f->dc_pole_q15 = (int32_t)(dc_pole * 32768.0f + 0.5f);
+    f->pe_coef_q15 = (int32_t)(pre_emphasis * 32768.0f + 0.5f);
+    if (f->dc_pole_q15 > 32767) f->dc_pole_q15 = 32767;
+    if (f->pe_coef_q15 > 32767) f->pe_coef_q15 = 32767;
+    f->dc_x1     = 0;
+    f->dc_y1 = 0;
+    f->pe_x1     = 0;
+}
+
+/* 逐樣本濾波路徑（IIR 有前後相依，無法展開） */
+static float convert_filtered_(const int32_t *src, size_t frames, size_t stride,
+                               int16_t *out16, float *outf, PcmFilter *f)
+{
+    float   acc    = 0.0f;
+    int32_t dc_x1  = f->dc_x1;
+    int32_t dc_y1  = f->dc_y1;
+    int32_t pe_x1  = f->pe_x1;
+    const int32_t a = f->dc_pole_q15;
+    const int32_t b = f->pe_coef_q15;
+
+    for (size_t i = 0; i < frames; i++) {
+        int32_t x = pcm_saturate_i16(src[i * stride] >> I2S_SAMPLE_SHIFT);
+
+        if (a) {
+            dc_y1 = ((x - dc_x1) << PCM_DC_FRAC_BITS) + (int32_t)(((int64_t)a * dc_y1) >> 15);
+            dc_x1 = x;
+            x     = dc_y1 >> PCM_DC_FRAC_BITS;
+        }
+        if (b) {
+            int32_t y = x - ((b * pe_x1) >> 15);
+            pe_x1 = x;
+            x     = y;
+        }
+
+        int16_t s = pcm_saturate_i16(x);
+        out16[i]  = s;
+        float fs  = (float)s;
+        if (outf) outf[i] = fs;
+        acc += fs * fs;
+    }
+
+    f->dc_x1     = dc_x1;
+    f->dc_y1 = dc_y1;
+    f->pe_x1     = pe_x1;
+    return acc;
+}
+
+float pcm_convert_i2s(const int32_t *src, size_t frames, size_t stride,
+                      int16_t *out16, float *outf, PcmFilter *filter)
+{
+    if (filter && (filter->dc_pole_q15 || filter->pe_coef_q15)) {
+        return convert_filtered_(src, frames, stride, out16, outf, filter);
+    }
+
+    float  acc0 = 0.0f, acc1 = 0.0f, acc2 = 0.0f, acc3 = 0.0f;
+    size_t i    = 0;
+
+    for (; i + 4 <= frames; i += 4) {
+        int16_t s0 = pcm_saturate_i16(src[(i + 0) * stride] >> I2S_SAMPLE_SHIFT);
+        int16_t s1 = pcm_saturate_i16(src[(i + 1) * stride] >> I2S_SAMPLE_SHIFT);
+        int16_t s2 = pcm_saturate_i16(src[(i + 2) * stride] >> I2S_SAMPLE_SHIFT);
+        int16_t s3 = pcm_saturate_i16(src[(i + 3) * stride] >> I2S_SAMPLE_SHIFT);
+        out16[i + 0] = s0;
+        out16[i + 1] = s1;
+        out16[i + 2] = s2;
+        out16[i + 3] = s3;
+
+        float f0 = (float)s0, f1 = (float)s1, f2 = (float)s2, f3 = (float)s3;
+        if (outf) {
+            outf[i + 0] = f0;
+            outf[i + 1] = f1;
+            outf[i + 2] = f2;
+            outf[i + 3] = f3;
+        }
+        acc0 += f0 * f0;
+        acc1 += f1 * f1;
+        acc2 += f2 * f2;
+        acc3 += f3 * f3;
+    }
+    for (; i < frames; i++) {
+        int16_t s = pcm_saturate_i16(src[i * stride] >> I2S_SAMPLE_SHIFT);
+        out16[i]  = s;
+        float f   = (float)s;
+        if (outf) outf[i] = f;
+        acc0 += f * f;
+    }
+    return (acc0 + acc1) + (acc2 + acc3);
+}
+
+float pcm_to_float(const int16_t *in, size_t n, float *out)
+{
+    /* 平方和在轉換迴圈內累加，不必像 esp-dsp dotprod 那樣再讀一次 out */
+    size_t i    = 0;
+    float  acc0 = 0.0f, acc1 = 0.0f, acc2 = 0.0f, acc3 = 0.0f;
+    for (; i + 4 <= n; i += 4) {
+        float f0 = (float)in[i + 0], f1 = (float)in[i + 1];
+        float f2 = (float)in[i + 2], f3 = (float)in[i + 3];
+        out[i + 0] = f0;
+        out[i + 1] = f1;
+        out[i + 2] = f2;
+        out[i + 3] = f3;
+        acc0 += f0 * f0;
+        acc1 += f1 * f1;
+        acc2 += f2 * f2;
+        acc3 += f3 * f3;
+    }
+    for (; i < n; i++) {
+        float f = (float)in[i];
+        out[i]  = f;
+        acc0   += f * f;
+    }
+    return (acc0 + acc1) + (acc2 + acc3);
+}
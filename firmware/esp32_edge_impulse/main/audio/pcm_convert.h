@@ -0,0 +1,68 @@
+#ifndef PCM_CONVERT_H
+#define PCM_CONVERT_H
+
+/* ============================================================
+ * pcm_convert.h - I2S 原始樣本轉換（共用單次轉換流程）
+ * ESP-MIAO v0.8.0
+ *
+ * 擷取 Task 與推論切片共用同一組轉換函式：
+ *   de-interleave → >> I2S_SAMPLE_SHIFT → 飽和 → int16 / float → 平方和
+ * 迴圈以 4 樣本展開並使用獨立累加器，讓 FPU 管線不被單一累加相依阻塞；
+ * 平方和與轉換在同一次走訪完成（不另以 esp-dsp dotprod 重讀輸出）。
+ *
+ * 可選的定點濾波（PcmFilter）於同一次走訪中逐樣本執行：
+ *   DC blocker：y[n] = x[n] - x[n-1] + a·y[n-1]（a 為 Q15，狀態保留小數位避免極限環）
+ *   Pre-emphasis：y[n] = x[n] - b·x[n-1]
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* INMP441 24-bit 資料左對齊於 32-bit slot，右移後取得 16-bit 動態範圍 */
+#ifndef I2S_SAMPLE_SHIFT
+#define I2S_SAMPLE_SHIFT 11
+#endif
+
+static inline int16_t pcm_saturate_i16(int32_t s)
+{
+    if (s >  32767) return  32767;
+    if (s < -32768) return -32768;
+    return (int16_t)s;
+}
+
+/* 定點濾波狀態（跨區塊延續，僅由單一生產者使用） */
+typedef struct {
+    int32_t dc_pole_q15;   // a（Q15），0 = 停用 DC blocker
+    int32_t dc_x1;
+    int32_t dc_y1;         // y[n-1]，含 PCM_DC_FRAC_BITS 位小數
+    int32_t pe_coef_q15;   // b（Q15），0 = 停用 pre-emphasis
+    int32_t pe_x1;
+} PcmFilter;
+
+/**
+ * 初始化濾波狀態。
+ * @param dc_pole      DC blocker 極點（例如 0.995，0 = 停用）
+ * @param pre_emphasis Pre-emphasis 係數（例如 0.97，0 = 停用）
+ */
+void pcm_filter_init(PcmFilter *f, float dc_pole, float pre_emphasis);
+
+/**
+ * 將 I2S DMA 區塊轉為 int16（可同時輸出 float 視圖）並回傳平方和。
+ * @param src     I2S 原始 32-bit 樣本（interleaved）
+ * @param frames  frame 數（每個 frame 取 1 個樣本）
+ * @param stride  每個 frame 的 slot 數（Stereo=2，Mono=1）
+ * @param out16   輸出 int16（不可為 NULL）
+ * @param outf    輸出 float（可為 NULL）
+ * @param filter  定點濾波狀態（NULL = 不濾波，走展開的快速路徑）
+ * @return 輸出樣本的平方和（供 RMS 計算）
+ */
+float pcm_convert_i2s(const int32_t *src, size_t frames, size_t stride,
+                      int16_t *out16, float *outf, PcmFilter *filter = nullptr);
+
+/**
+ * int16 → float 並回傳平方和（單次走訪）。
+ * @param out 輸出 float（大小 n）
+ */
+float pcm_to_float(const int16_t *in, size_t n, float *out);
+
+#endif // PCM_CONVERT_H
@@ -0,0 +1,110 @@
+/*
+ * resampler.cpp - 多相重取樣器實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "resampler.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include <math.h>
+#include <string.h>
+
+static const char *TAG = "Resampler";
+
+static uint32_t gcd_u32(uint32_t a, uint32_t b)
+{
+    while (b) { uint32_t t = a % b; a = b; b = t; }
+    return a;
+}
+
+PolyphaseResampler::PolyphaseResampler()
+    : up_(1), down_(1), frac_(0), coef_(nullptr), dpos_(0)
+{
+    memset(delay_, 0, sizeof(delay_));
+}
+
+PolyphaseResampler::~PolyphaseResampler()
+{
+    if (coef_) heap_caps_free(coef_);
+}
+
+bool PolyphaseResampler::init(uint32_t in_rate, uint32_t out_rate)
+{
+    if (in_rate == 0 || out_rate == 0) return false;
+
+    uint32_t g = gcd_u32(in_rate, out_rate);
+    up_   = out_rate / g;
+    down_ = in_rate / g;
+    reset();
+
+    if (coef_) { heap_caps_free(coef_); coef_ = nullptr; }
+    if (is_passthrough()) {
+        ESP_LOGI(TAG, "Passthrough (%lu Hz)", (unsigned long)in_rate);
+        return true;
+    }
+
+    const size_t n_coef = (size_t)up_ * TAPS;
+    coef_ = static_cast<int16_t *>(heap_caps_malloc(n_coef * sizeof(int16_t),
+                                                    MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    if (!coef_) {
+        ESP_LOGE(TAG, "OOM: %u coefficients", (unsigned)n_coef);
+        return false;
+    }
+
+    /* 原型低通（上取樣域），增益 L 以補償插零 */
+    const float fc     = 0.5f / (float)(up_ > down_ ? up_ : down_);
+    const float center = (float)(n_coef - 1) * 0.5f;
+    for (uint32_t p = 0; p < up_; p++) {
+        for (int i = 0; i < TAPS; i++) {
+            size_t k = p + (size_t)i * up_;
+            float  x = (float)k - center;
+            float  h = (fabsf(x) < 1e-6f) ? 2.0f * fc
+                                            : sinf(2.0f * (float)M_PI * fc * x) / ((float)M_PI * x);
+            float  w = 0.54f - 0.46f * cosf(2.0f * (float)M_PI * (float)k / (float)(n_coef - 1));
+            float  q = h * w * (float)up_ * 32768.0f;
+            if (q >  32767.0f) q =  32767.0f;
+            if (q < -32768.0f) q = -32768.0f;
+            coef_[p * TAPS + i] = (int16_t)lrintf(q);
+        }
+    }
+
+    ESP_LOGI(TAG, "%lu Hz -> %lu Hz (L=%lu, M=%lu, %d taps/phase)",
+             (unsigned long)in_rate, (unsigned long)out_rate,
+             (unsigned long)up_, (unsigned long)down_, TAPS);
+    return true;
+}
+
+void PolyphaseResampler::reset()
+{
+    frac_ = 0;
+    dpos_ = 0;
+    memset(delay_, 0, sizeof(delay_));
+}
+
+size_t PolyphaseResampler::process(const int16_t *in, size_t n, int16_t *out)
+{
+    if (is_passthrough()) {
+        memcpy(out, in, n * sizeof(int16_t));
+        return n;
+    }
+
+    size_t produced = 0;
+    for (size_t j = 0; j < n; j++) {
+        dpos_ = (dpos_ == 0) ? TAPS - 1 : dpos_ - 1;
+        delay_[dpos_] = delay_[dpos_ + TAPS] = in[j];
+
+        const int16_t *x = delay_ + dpos_;
+        while (frac_ < up_) {
+            const int16_t *h   = coef_ + frac_ * TAPS;
+            int32_t        acc = 0;
+            for (int i = 0; i < TAPS; i++) acc += (int32_t)h[i] * x[i];
+            acc >>= 15;
+            if (acc >  32767) acc =  32767;
+            if (acc < -32768) acc = -32768;
+            out[produced++] = (int16_t)acc;
+            frac_ += down_;
+        }
+        frac_ -= up_;
+    }
+    return produced;
+}
@@ -0,0 +1,63 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+/* ============================================================
+ * resampler.h - 有理數倍率多相 (polyphase) 重取樣器
+ * ESP-MIAO v0.8.0
+ *
+ * out_rate / in_rate = L / M（以最大公因數約分）
+ * 原型濾波器為 Hamming 窗 sinc，截止 = 0.5 / max(L, M)，
+ * 每個相位 RESAMPLER_TAPS_PER_PHASE 個 Q15 係數。
+ * 每個輸出樣本只計算一個相位，不實際插零 / 抽點。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef RESAMPLER_TAPS_PER_PHASE
+#define RESAMPLER_TAPS_PER_PHASE 16
+#endif
+
+class PolyphaseResampler {
+public:
+    PolyphaseResampler();
+    ~PolyphaseResampler();
+
+    /**
+     * 設計濾波器並配置係數表（不可於 ISR 呼叫）。
+     * @return true = 成功（in_rate == out_rate 時為直通模式）
+     */
+    bool init(uint32_t in_rate, uint32_t out_rate);
+
+    /** 輸入 / 輸出速率相同，process() 僅複製 */
+    bool is_passthrough() const { return up_ == down_; }
+
+    /** 輸入 in_frames 個樣本時最多產生的輸出樣本數 */
+    size_t max_output(size_t in_frames) const
+    {
+        return (in_frames * up_ + down_ - 1) / down_ + 1;
+    }
+
+    /**
+     * 串流式重取樣（保留跨區塊的濾波器狀態，可於 ISR 呼叫）。
+     * @param out 大小至少 max_output(n)
+     * @return 實際輸出的樣本數
+     */
+    size_t process(const int16_t *in, size_t n, int16_t *out);
+
+    /** 清除濾波器歷史 */
+    void reset();
+
+private:
+    static constexpr int TAPS = RESAMPLER_TAPS_PER_PHASE;
+
+    uint32_t up_;       // L
+    uint32_t down_;     // M
+    uint32_t frac_;     // 下一個輸出相對於目前輸入的相位（0 .. L-1 有效）
+    int16_t *coef_;     // [L][TAPS]，Q15
+    int      dpos_;
+    int16_t  delay_[TAPS * 2];  // 鏡像延遲線：delay_[dpos_ .. dpos_+TAPS-1] 由新到舊
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,461 @@
+/*
+ * spectral_frontend.cpp - MFCC 與 VAD 共用頻譜前端實作
+ * ESP-MIAO v0.8.0
+ *
+ * 幀以 fft_length 點實數 FFT 計算（同 VAD：N/2 點複數 FFT + 頻譜分離），
+ * 濾波器組依 speechpy filterbanks 建立（含其最後一個頻點的 -0.001 Hz 偏移），
+ * 只存非零的三角權重。
+ *
+ * ENGINE_Q15 與 float 引擎的尺度關係：幀左移 L 位後，Q15 FFT（每級 >>1）輸出 X·2^L / (N/2)，
+ * 頻譜分離保留 2 倍（不右移），power_q_ = 4·|X|²·2^2L / (N/2)²，
+ * 故 float power = power_q_ · 2^(5 - 2L)（N = 512，L 含預強調保留的小數位），在 log2 域加回即可。
+ */
+
+#include "spectral_frontend.h"
+#include "fft_q15.h"
+#include "esp_log.h"
+#include "dsps_fft2r.h"
+#include "dsp_err_codes.h"
+#include <math.h>
+#include <string.h>
+
+static const char *TAG = "Spectral";
+
+/* 與 VAD 相同的人聲頻帶 bin 範圍 */
+static constexpr int kStartBin = (FFT_FREQ_MIN * FFT_SIZE) / SAMPLE_RATE;
+static constexpr int kEndBin   = ((FFT_FREQ_MAX * FFT_SIZE) / SAMPLE_RATE < FFT_SIZE / 2)
+                               ? (FFT_FREQ_MAX * FFT_SIZE) / SAMPLE_RATE : FFT_SIZE / 2;
+
+static constexpr float kLogFloor = 1e-10f;   // log 前的零值替代（同 SDK zero_handling）
+
+/* Q15 引擎常數 */
+static constexpr int     kQ15PreBits   = 15;              // frame_q_ 的小數位（|y| < 2^16 → < 2^31）
+static constexpr int     kQ15FrameBits = 23;              // 區塊浮點左移後的幀峰值上限（fft_q15 輸入 < 2^23）
+static constexpr int     kQ15PowerExp  = 5;               // float power = power_q_ · 2^(kQ15PowerExp - 2L)
+static constexpr int32_t kLn2Q30       = 744261118;       // ln 2 · 2^30
+static constexpr float   kQ31ToFloat   = 1.0f / 2147483648.0f;
+static_assert(FFT_SIZE == 512, "kQ15PowerExp assumes a 256-point complex FFT (8 stages)");
+
+static inline int16_t to_q15(float v)
+{
+    long q = lrintf(v * 32768.0f);
+    return (int16_t)(q > 32767 ? 32767 : q < -32768 ? -32768 : q);
+}
+
+static inline double hz_to_mel(double hz)  { return 1127.0 * log(1.0 + hz / 700.0); }
+static inline double mel_to_hz(double mel) { return 700.0 * (exp(mel / 1127.0) - 1.0); }
+
+SpectralFrontend::SpectralFrontend()
+    : ready_(false), window_frames_(0), norm_(NORM_MEAN_MINMAX), engine_(ENGINE_FLOAT),
+      vad_scale_(0.0f), fill_(0), pre_cof_q15_(0), head_(0), count_(0)
+{
+    memset(&p_, 0, sizeof(p_));
+    memset(frame_, 0, sizeof(frame_));
+    memset(pre_hist_, 0, sizeof(pre_hist_));
+    memset(cep_, 0, sizeof(cep_));
+    memset(work_, 0, sizeof(work_));
+    memset(log2_lut_, 0, sizeof(log2_lut_));
+}
+
+bool SpectralFrontend::init(const MfccParams &p, size_t window_samples)
+{
+    ready_ = false;
+    if (p.fft_length != FFT_SIZE || p.frame_length <= 0 || p.frame_length > FFT_SIZE ||
+        p.frame_stride <= 0 || p.frame_stride > p.frame_length ||
+        p.num_filters <= 0 || p.num_filters > MAX_FILTERS ||
+        p.num_cepstral <= 0 || p.num_cepstral > p.num_filters || p.num_cepstral > MAX_CEPSTRAL ||
+        p.pre_shift < 0 || p.pre_shift > MAX_PRE_SHIFT || fabsf(p.pre_cof) > 1.0f ||
+        p.win_size <= 0 || p.win_size > MAX_CMVN_WIN || (p.win_size & 1) == 0 ||
+        window_samples < (size_t)p.frame_length) {
+        ESP_LOGW(TAG, "MFCC parameters out of range for the shared front-end");
+        return false;
+    }
+    int frames = (int)((window_samples - p.frame_length) / p.frame_stride) + 1;
+    if (frames > MAX_WINDOW_FRAMES) {
+        ESP_LOGW(TAG, "Model window of %d frames exceeds %d", frames, MAX_WINDOW_FRAMES);
+        return false;
+    }
+
+    /* 表格可能已由 EI SDK / VAD 初始化（REINITIALIZED 亦可用） */
+    esp_err_t err = dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE);
+    if (err != ESP_OK && err != ESP_ERR_DSP_REINITIALIZED) {
+        ESP_LOGW(TAG, "esp-dsp FFT init failed (0x%x)", (unsigned)err);
+        return false;
+    }
+
+    p_             = p;
+    window_frames_ = frames;
+
+    const int N = FFT_SIZE;
+    for (int k = 0; k < N / 2; k++) {
+        twiddle_r_[k] = cosf(-2.0f * (float)M_PI * k / N);
+        twiddle_i_[k] = sinf(-2.0f * (float)M_PI * k / N);
+    }
+
+    /* 預強調 y[n] = x[n] - c·x[n-s] 的功率增益 |H|² = 1 + c² - 2c·cos(ωs)，頻帶內取倒數還原 */
+    memset(deemph_, 0, sizeof(deemph_));
+    for (int k = kStartBin; k < kEndBin; k++) {
+        float w  = 2.0f * (float)M_PI * k * p.pre_shift / N;
+        float h2 = 1.0f + p.pre_cof * p.pre_cof - 2.0f * p.pre_cof * cosf(w);
+        deemph_[k] = h2 > 1e-6f ? 1.0f / h2 : 0.0f;
+    }
+
+    /* VAD band_rms = √(N·mean(w²) / L) · √(Σ|X|² / bins)，其中 N·mean(w²) = Σw²、Σ|X|² = N·Σpower */
+    double hamming_power = 0.0;
+    for (int i = 0; i < N; i++) {
+        double w = 0.54 - 0.46 * cos(2.0 * M_PI * i / (N - 1));
+        hamming_power += w * w;
+    }
+    const int bins = kEndBin - kStartBin;
+    vad_scale_ = bins > 0 ? (float)(hamming_power / p.frame_length / bins) : 0.0f;
+
+    /* mel 濾波器組（speechpy：頻點 = floor((coefficients + 1) · hz / fs)） */
+    const int    coefficients = BINS;
+    const double high = p.high_hz > 0.0f ? p.high_hz : SAMPLE_RATE / 2.0;
+    const double lo_mel = hz_to_mel(p.low_hz), hi_mel = hz_to_mel(high);
+    int index[MAX_FILTERS + 2];
+    for (int i = 0; i < p.num_filters + 2; i++) {
+        double hz = mel_to_hz(lo_mel + (hi_mel - lo_mel) * i / (p.num_filters + 1));
+        if (hz < p.low_hz) hz = p.low_hz;
+        if (hz > high) hz = high;
+        if (i == p.num_filters + 1) hz -= 0.001;
+        index[i] = (int)floor((coefficients + 1) * hz / SAMPLE_RATE);
+    }
+    int off = 0;
+    for (int f = 0; f < p.num_filters; f++) {
+        int left = index[f], middle = index[f + 1], right = index[f + 2];
+        if (right >= coefficients) right = coefficients - 1;
+        int len = right - left + 1;
+        if (left < 0 || len <= 0 || off + len > (int)(sizeof(fb_w_) / sizeof(fb_w_[0]))) {
+            ESP_LOGW(TAG, "Mel filter %d out of range", f);
+            return false;
+        }
+        fb_start_[f] = (int16_t)left;
+        fb_len_[f]   = (int16_t)len;
+        fb_off_[f]   = (int16_t)off;
+        for (int x = left; x <= right; x++) {
+            /* 同 speechpy triangle：先清零兩端，再依序套用上升 / 下降段 */
+            float v = 0.0f;
+            if (left < x && x <= middle)  v = (float)(x - left) / (float)(middle - left);
+            if (middle <= x && x < right) v = (float)(right - x) / (float)(right - middle);
+            fb_w_[off + x - left] = v;
+        }
+        off += len;
+    }
+
+    /* DCT-II（ortho） */
+    const int F = p.num_filters;
+    for (int j = 0; j < p.num_cepstral; j++) {
+        float s = j == 0 ? sqrtf(1.0f / F) : sqrtf(2.0f / F);
+        for (int n = 0; n < F; n++) {
+            dct_[j][n] = s * cosf((float)M_PI * j * (2 * n + 1) / (2.0f * F));
+        }
+    }
+
+    /* Q15 版本的係數 */
+    pre_cof_q15_ = (int32_t)lrintf(p.pre_cof * 32768.0f);   // |c| ≤ 1：c·x 與 y 皆在 int32 內
+    for (int k = 0; k < N / 2; k++) {
+        twiddle_q_r_[k] = to_q15(twiddle_r_[k]);
+        twiddle_q_i_[k] = to_q15(twiddle_i_[k]);
+    }
+    for (int i = 0; i < off; i++) fb_w_q_[i] = to_q15(fb_w_[i]);
+    for (int j = 0; j < p.num_cepstral; j++) {
+        for (int n = 0; n < F; n++) dct_q_[j][n] = to_q15(dct_[j][n]);
+    }
+    for (int i = 0; i <= LOG2_LUT_SIZE; i++) {
+        log2_lut_[i] = (int32_t)lrint(log2(1.0 + (double)i / LOG2_LUT_SIZE) * 65536.0);
+    }
+
+    reset();
+    ready_ = true;
+    ESP_LOGI(TAG, "Shared front-end: %d-sample frames / %d hop, %d filters, %d cepstra, %d frames/window",
+             p.frame_length, p.frame_stride, p.num_filters, p.num_cepstral, window_frames_);
+    return true;
+}
+
+void SpectralFrontend::reset()
+{
+    fill_  = 0;
+    head_  = 0;
+    count_ = 0;
+    memset(pre_hist_, 0, sizeof(pre_hist_));
+}
+
+void SpectralFrontend::prime_preemphasis(const AudioSlice &window)
+{
+    if (p_.pre_shift <= 0 || window.size < (size_t)p_.pre_shift) return;
+    window.to_float(window.size - p_.pre_shift, p_.pre_shift, pre_hist_);
+    if (engine_ == ENGINE_Q15) {
+        for (int i = 0; i < p_.pre_shift; i++) pre_hist_q_[i] = (int32_t)pre_hist_[i];
+    }
+}
+
+size_t SpectralFrontend::process(const AudioSlice &slice, float *energies, size_t max_energies, float *rms)
+{
+    if (rms) *rms = slice.size ? sqrtf(slice.sum_squares() / slice.size) : 0.0f;
+    if (!ready_) return 0;
+
+    size_t frames = 0;
+    for (int s = 0; s < 2; s++) {
+        for (size_t i = 0; i < slice.len[s]; i++) {
+            push_sample_(slice.seg[s][i], energies, max_energies, &frames);
+        }
+    }
+    return (energies && frames > max_energies) ? max_energies : frames;
+}
+
+void SpectralFrontend::push_sample_(int16_t x, float *energies, size_t max_energies, size_t *frames)
+{
+    if (engine_ == ENGINE_Q15) {
+        int32_t v = x;
+        if (p_.pre_shift > 0) {
+            /* Q15 結果不捨入：係數若捨入到整數樣本，小振幅時等於換了一個預強調係數，
+             * 低頻（預強調壓低 30 dB 以上）的 mel 能量會明顯偏移 */
+            int32_t y = v * (1 << kQ15PreBits) - pre_cof_q15_ * pre_hist_q_[0];
+            memmove(pre_hist_q_, pre_hist_q_ + 1, (p_.pre_shift - 1) * sizeof(int32_t));
+            pre_hist_q_[p_.pre_shift - 1] = v;
+            frame_q_[fill_++] = y;
+        }
+        else {
+            frame_q_[fill_++] = v * (1 << kQ15PreBits);
+        }
+    }
+    else {
+        float v = (float)x;
+        if (p_.pre_shift > 0) {
+            float y = v - p_.pre_cof * pre_hist_[0];
+            memmove(pre_hist_, pre_hist_ + 1, (p_.pre_shift - 1) * sizeof(float));
+            pre_hist_[p_.pre_shift - 1] = v;
+            v = y;
+        }
+        frame_[fill_++] = v;
+    }
+    if (fill_ < p_.frame_length) return;
+
+    float energy = engine_ == ENGINE_Q15 ? frame_analyse_q15_() : frame_analyse_();
+    if (energies && *frames < max_energies) energies[*frames] = energy;
+    (*frames)++;
+
+    /* frame_ / frame_q_ 同為 4 位元組元素 */
+    int keep = p_.frame_length - p_.frame_stride;
+    memmove(frame_, frame_ + p_.frame_stride, keep * sizeof(float));
+    fill_ = keep;
+}
+
+float SpectralFrontend::fft_power_()
+{
+    const int N = FFT_SIZE, H = N / 2;
+
+    /* 補零到 N 點；z[n] = x[2n] + j·x[2n+1] 原地 N/2 點複數 FFT */
+    memcpy(work_, frame_, p_.frame_length * sizeof(float));
+    memset(work_ + p_.frame_length, 0, (N - p_.frame_length) * sizeof(float));
+    dsps_fft2r_fc32(work_, H);
+    dsps_bit_rev_fc32(work_, H);
+
+    const float inv_n = 1.0f / N;
+    float total = 0.0f;
+    float x0 = work_[0] + work_[1], xh = work_[0] - work_[1];
+    power_[0] = x0 * x0 * inv_n;
+    power_[H] = xh * xh * inv_n;
+    total += power_[0] + power_[H];
+    for (int k = 1; k < H; k++) {
+        int   m   = H - k;
+        float zr  = work_[2 * k],  zi  = work_[2 * k + 1];
+        float mr  = work_[2 * m],  mi  = work_[2 * m + 1];
+        float fer = 0.5f * (zr + mr),  fei = 0.5f * (zi - mi);
+        float for_ = 0.5f * (zi + mi), foi = -0.5f * (zr - mr);
+        float xr  = fer + twiddle_r_[k] * for_ - twiddle_i_[k] * foi;
+        float xi  = fei + twiddle_r_[k] * foi + twiddle_i_[k] * for_;
+        power_[k] = (xr * xr + xi * xi) * inv_n;
+        total    += power_[k];
+    }
+    return total;
+}
+
+float SpectralFrontend::frame_analyse_()
+{
+    float total = fft_power_();
+
+    /* VAD 頻帶能量 */
+    float band = 0.0f;
+    for (int k = kStartBin; k < kEndBin; k++) band += power_[k] * deemph_[k];
+
+    /* log mel → DCT；第 0 維為 log 幀能量（SDK dc_elimination） */
+    float log_mel[MAX_FILTERS];
+    for (int f = 0; f < p_.num_filters; f++) {
+        const float *w = fb_w_ + fb_off_[f];
+        const float *x = power_ + fb_start_[f];
+        float s = 0.0f;
+        for (int i = 0; i < fb_len_[f]; i++) s += w[i] * x[i];
+        log_mel[f] = logf(s > 0.0f ? s : kLogFloor);
+    }
+    float *c = cep_[head_];
+    c[0] = logf(total > 0.0f ? total : kLogFloor);
+    for (int j = 1; j < p_.num_cepstral; j++) {
+        float s = 0.0f;
+        for (int n = 0; n < p_.num_filters; n++) s += dct_[j][n] * log_mel[n];
+        c[j] = s;
+    }
+    head_ = (head_ + 1) % window_frames_;
+    if (count_ < window_frames_) count_++;
+
+    return sqrtf(vad_scale_ * band * FFT_SIZE);
+}
+
+int32_t SpectralFrontend::log2_q16_(uint64_t v) const
+{
+    /* v > 0：整數部分為最高位元位置，小數部分取其後 8 位查表、再 16 位線性內插 */
+    int      msb = 63 - __builtin_clzll(v);
+    uint32_t m   = msb >= 31 ? (uint32_t)(v >> (msb - 31)) : (uint32_t)(v << (31 - msb));
+    int      idx = (m >> 23) & (LOG2_LUT_SIZE - 1);
+    int32_t  frac = (m >> 7) & 0xFFFF;
+    int32_t  lo = log2_lut_[idx], hi = log2_lut_[idx + 1];
+    return (msb << 16) + lo + (int32_t)(((int64_t)(hi - lo) * frac) >> 16);
+}
+
+float SpectralFrontend::frame_analyse_q15_()
+{
+    const int N = FFT_SIZE, H = N / 2;
+
+    /* 區塊浮點：依幀峰值移位到 < 2^23（大聲時右移、安靜時左移），每幀都用滿 FFT 的動態範圍 */
+    uint32_t peak = 0;
+    for (int i = 0; i < p_.frame_length; i++) {
+        int32_t v = frame_q_[i];
+        peak |= (uint32_t)(v < 0 ? -v : v);
+    }
+    int shift = peak ? __builtin_clz(peak) - (32 - kQ15FrameBits) : 0;
+    if (shift >= 0) {
+        for (int i = 0; i < p_.frame_length; i++) work_q_[i] = frame_q_[i] * (1 << shift);
+    }
+    else {
+        const int32_t round = 1 << (-shift - 1);
+        for (int i = 0; i < p_.frame_length; i++) work_q_[i] = (frame_q_[i] + round) >> -shift;
+    }
+    memset(work_q_ + p_.frame_length, 0, (N - p_.frame_length) * sizeof(int32_t));
+    fft_q15(work_q_, twiddle_q_r_, twiddle_q_i_);
+
+    /* 頻譜分離（保留 2 倍不右移），power_q_ = 4·|X|² */
+    const int32_t *z = work_q_;
+    uint64_t total = 0;
+    int64_t x0 = 2 * ((int64_t)z[0] + z[1]), xh = 2 * ((int64_t)z[0] - z[1]);
+    power_q_[0] = (uint64_t)(x0 * x0);
+    power_q_[H] = (uint64_t)(xh * xh);
+    total += power_q_[0] + power_q_[H];
+    for (int k = 1; k < H; k++) {
+        int     m    = H - k;
+        int32_t zr   = z[2 * k], zi = z[2 * k + 1];
+        int32_t mr   = z[2 * m], mi = z[2 * m + 1];
+        int32_t fer  = zr + mr,  fei = zi - mi;
+        int32_t for_ = zi + mi,  foi = mr - zr;
+        int32_t wr   = twiddle_q_r_[k], wi = twiddle_q_i_[k];
+        int64_t xr   = (int64_t)fer + q15_mul(wr, for_) - q15_mul(wi, foi);
+        int64_t xi   = (int64_t)fei + q15_mul(wr, foi) + q15_mul(wi, for_);
+        power_q_[k]  = (uint64_t)(xr * xr) + (uint64_t)(xi * xi);
+        total       += power_q_[k];
+    }
+    const int32_t exp_q16 = (kQ15PowerExp - 2 * (shift + kQ15PreBits)) * 65536;   // 換回 float 尺度的 log2 位移
+
+    /* VAD 頻帶能量（每幀一次縮放，與 float 引擎同尺度） */
+    float band = 0.0f;
+    for (int k = kStartBin; k < kEndBin; k++) band += (float)power_q_[k] * deemph_[k];
+    band = ldexpf(band, kQ15PowerExp - 2 * (shift + kQ15PreBits));
+
+    /* log mel（Q16 自然對數）→ Q15 DCT；功率 < 2^50，權重分高低位相乘避免 64-bit 溢位 */
+    static const int32_t kLogFloorQ16 = (int32_t)lrintf(logf(kLogFloor) * 65536.0f);
+    auto ln_q16 = [&](uint64_t v) -> int32_t {
+        if (v == 0) return kLogFloorQ16;
+        return (int32_t)(((int64_t)(log2_q16_(v) + exp_q16) * kLn2Q30) >> 30);
+    };
+    int32_t log_mel[MAX_FILTERS];
+    for (int f = 0; f < p_.num_filters; f++) {
+        const int16_t  *w = fb_w_q_ + fb_off_[f];
+        const uint64_t *x = power_q_ + fb_start_[f];
+        uint64_t s = 0;
+        for (int i = 0; i < fb_len_[f]; i++) {
+            s += (x[i] >> 15) * (uint64_t)w[i] + (((x[i] & 0x7FFF) * (uint64_t)w[i]) >> 15);
+        }
+        log_mel[f] = ln_q16(s);
+    }
+    float *c = cep_[head_];
+    c[0] = (float)ln_q16(total) * (1.0f / 65536.0f);
+    for (int j = 1; j < p_.num_cepstral; j++) {
+        int64_t s = 0;
+        for (int n = 0; n < p_.num_filters; n++) s += (int64_t)dct_q_[j][n] * log_mel[n];
+        c[j] = (float)s * kQ31ToFloat;
+    }
+    head_ = (head_ + 1) % window_frames_;
+    if (count_ < window_frames_) count_++;
+
+    return sqrtf(vad_scale_ * band * FFT_SIZE);
+}
+
+template <typename Sink>
+void SpectralFrontend::cmvnw_(Sink &&sink)
+{
+    const int rows = window_frames_, cols = p_.num_cepstral;
+    const int win  = p_.win_size, pad = (win - 1) / 2, period = 2 * rows;
+    const int first = count_ >= rows ? head_ : 0;   // 最舊的一幀
+
+    for (int j = 0; j < cols; j++) {
+        /* cmvnw：欄位以 symmetric 模式填補 pad 幀（可多次折返，同 np.pad），前綴和求各視窗平均 */
+        sum_[0] = 0.0f;
+        sq_[0]  = 0.0f;
+        for (int v = 0; v < rows + 2 * pad; v++) {
+            int m = ((v - pad) % period + period) % period;
+            int r = m < rows ? m : period - 1 - m;
+            float x = cep_[(first + r) % rows][j];
+            sum_[v + 1] = sum_[v] + x;
+            sq_[v + 1]  = sq_[v] + x * x;
+        }
+        for (int i = 0; i < rows; i++) {
+            float mean = (sum_[i + win] - sum_[i]) / win;
+            float y    = cep_[(first + i) % rows][j] - mean;
+            if (norm_ == NORM_MEAN_VAR) {
+                float var = (sq_[i + win] - sq_[i]) / win - mean * mean;
+                y /= sqrtf(var > 0.0f ? var : 0.0f) + 9.3132e-10f;   // + 2^-30
+            }
+            sink(i, j, y);
+        }
+    }
+}
+
+void SpectralFrontend::features(float *out)
+{
+    const int rows = window_frames_, cols = p_.num_cepstral;
+    cmvnw_([&](int i, int j, float y) { out[i * cols + j] = y; });
+
+    if (norm_ == NORM_MEAN_MINMAX) {
+        const int n = rows * cols;
+        float lo = out[0], hi = out[0];
+        for (int i = 1; i < n; i++) {
+            if (out[i] < lo) lo = out[i];
+            if (out[i] > hi) hi = out[i];
+        }
+        float scale = hi > lo ? 1.0f / (hi - lo) : 0.0f;
+        for (int i = 0; i < n; i++) out[i] = (out[i] - lo) * scale;
+    }
+}
+
+void SpectralFrontend::features_i8(int8_t *out, float scale, int32_t zero_point)
+{
+    const int cols = p_.num_cepstral;
+    auto quantize = [&](int i, int j, float v) {
+        long q = lrintf(v) + zero_point;
+        out[i * cols + j] = (int8_t)(q > 127 ? 127 : q < -128 ? -128 : q);
+    };
+    float k = scale > 0.0f ? 1.0f / scale : 0.0f;
+
+    if (norm_ == NORM_MEAN_MINMAX) {
+        /* 整體 min-max 需要完整統計：先掃一次取範圍，第二次重算並量化（不存 float 矩陣） */
+        float lo = INFINITY, hi = -INFINITY;
+        cmvnw_([&](int, int, float y) {
+            if (y < lo) lo = y;
+            if (y > hi) hi = y;
+        });
+        float mk = hi > lo ? k / (hi - lo) : 0.0f;
+        cmvnw_([&](int i, int j, float y) { quantize(i, j, (y - lo) * mk); });
+    }
+    else {
+        cmvnw_([&](int i, int j, float y) { quantize(i, j, y * k); });
+    }
+}
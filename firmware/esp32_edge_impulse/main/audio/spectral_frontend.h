@@ -0,0 +1,176 @@
+#ifndef SPECTRAL_FRONTEND_H
+#define SPECTRAL_FRONTEND_H
+
+/* ============================================================
+ * spectral_frontend.h - MFCC 與 VAD 共用的分幀頻譜前端
+ * ESP-MIAO v0.8.0
+ *
+ * 以模型的 MFCC 分幀（frame_length / frame_stride、預強調、fft_length 點實數 FFT）
+ * 每幀只算一次功率頻譜，同時產生：
+ *   1. MFCC 幀（mel 濾波器組 → log → DCT-II ortho，第 0 維換成 log 幀能量），
+ *      存入最近一個模型視窗的滾動矩陣；features() 套用 cmvnw 正規化，
+ *      與 EI extract_mfcc_features（implementation v4）相同
+ *   2. 300~3400Hz 頻帶能量：先除去預強調增益，再換算成 VAD Hamming band_rms 尺度，
+ *      交給 VAD::detect_energies，VAD 不必再做一次 FFT
+ * 分幀跨切片連續（未滿一幀的樣本留到下一切片），預強調亦延續前一樣本。
+ *
+ * ENGINE_Q15 為定點版本：int32 預強調、區塊浮點（依幀峰值左移）Q15 FFT、
+ * 64-bit 功率、Q15 mel 權重、log2 查表與 Q15 DCT，每幀的 MFCC 不需要浮點運算。
+ * features_i8() 把 cmvnw 正規化與 int8 量化合併，直接寫入模型的輸入張量。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "audio_capture.h"
+#include "config.h"
+
+/* MFCC 參數（由 EI ei_dsp_config_mfcc_t 換算，頻率與長度皆為樣本 / Hz） */
+struct MfccParams {
+    int   frame_length;   // 幀長（樣本）
+    int   frame_stride;   // 幀距（樣本）
+    int   fft_length;     // 須等於 FFT_SIZE
+    int   num_filters;
+    int   num_cepstral;
+    float low_hz;
+    float high_hz;
+    float pre_cof;        // 預強調係數
+    int   pre_shift;      // 預強調延遲（樣本）
+    int   win_size;       // cmvnw 視窗（幀，奇數）
+};
+
+class SpectralFrontend {
+public:
+    static constexpr int BINS              = FFT_SIZE / 2 + 1;
+    static constexpr int MAX_FILTERS       = 40;
+    static constexpr int MAX_CEPSTRAL      = 20;
+    static constexpr int MAX_WINDOW_FRAMES = 64;
+    static constexpr int MAX_CMVN_WIN      = 301;
+    static constexpr int MAX_PRE_SHIFT     = 4;
+    static constexpr int MAX_SLICE_FRAMES  = 32;
+    static constexpr int LOG2_LUT_SIZE     = 256;
+
+    /* features() 的正規化（EI 各版本 cmvnw 參數不同，由開機比對決定） */
+    enum Norm : uint8_t {
+        NORM_MEAN_MINMAX = 0,   // cmvnw 減平均後整體 min-max 縮放到 0~1
+        NORM_MEAN_VAR,          // cmvnw 減平均再除以視窗標準差
+    };
+
+    /* 每幀的頻譜 / MFCC 計算方式（開機比對通過才採用 ENGINE_Q15） */
+    enum Engine : uint8_t {
+        ENGINE_FLOAT = 0,   // esp-dsp fc32 FFT、float 濾波器組 / logf / DCT
+        ENGINE_Q15,         // 定點 FFT / 濾波器組 / 查表 log / DCT
+    };
+
+    SpectralFrontend();
+
+    /**
+     * 依 MFCC 參數建立濾波器組 / DCT / 旋轉因子表。
+     * @param window_samples 模型視窗樣本數（決定滾動矩陣幀數）
+     * @return false = 參數超出上限或 esp-dsp FFT 不可用
+     */
+    bool init(const MfccParams &p, size_t window_samples);
+
+    /** 清除分幀、預強調與滾動矩陣 */
+    void reset();
+
+    /**
+     * 以視窗尾端樣本作為預強調的前一樣本（同 speechpy np.roll），
+     * 讓 reset() 後處理單一完整視窗的結果與 SDK 逐視窗計算一致（開機比對用）。
+     */
+    void prime_preemphasis(const AudioSlice &window);
+
+    void set_norm(Norm norm) { norm_ = norm; }
+    Norm norm() const { return norm_; }
+
+    /** 切換引擎（同時 reset()，滾動矩陣需重新累積） */
+    void set_engine(Engine engine) { engine_ = engine; reset(); }
+    Engine engine() const { return engine_; }
+
+    /**
+     * 處理一個切片：完成的 MFCC 幀寫入滾動矩陣。
+     * @param energies      [out] 各完成幀的 VAD 頻帶能量（可為 nullptr）
+     * @param max_energies  energies 容量
+     * @param rms           [out] 切片 RMS（可為 nullptr）
+     * @return 本切片完成的幀數（最多 max_energies）
+     */
+    size_t process(const AudioSlice &slice, float *energies, size_t max_energies, float *rms);
+
+    /** 滾動矩陣已涵蓋整個模型視窗 */
+    bool window_full() const { return count_ >= window_frames_; }
+
+    /** 正規化後的模型輸入（列優先 window_frames × num_cepstral）寫入 out */
+    void features(float *out);
+
+    /**
+     * 同 features()，但正規化後直接量化為 int8（q = round(y / scale) + zero_point，飽和），
+     * 寫入 TFLite 量化輸入張量，不經 float 特徵矩陣。
+     */
+    void features_i8(int8_t *out, float scale, int32_t zero_point);
+
+    size_t feature_count() const { return (size_t)window_frames_ * p_.num_cepstral; }
+
+public:
+    bool       ready_;
+    MfccParams p_;
+    int        window_frames_;
+    Norm       norm_;
+    Engine     engine_;
+    float      vad_scale_;                 // 去預強調後的矩形窗頻帶能量 → VAD Hamming 尺度
+
+    /* 分幀與預強調狀態（依引擎使用 float 或 int32 版本） */
+    union {
+        float   frame_[FFT_SIZE];          // 預強調後、待湊滿一幀的樣本
+        int32_t frame_q_[FFT_SIZE];
+    };
+    int        fill_;
+    union {
+        float   pre_hist_[MAX_PRE_SHIFT];  // 最近 pre_shift 個原始樣本（預強調延續）
+        int32_t pre_hist_q_[MAX_PRE_SHIFT];
+    };
+
+    /* 查表 */
+    float      twiddle_r_[FFT_SIZE / 2];
+    float      twiddle_i_[FFT_SIZE / 2];
+    float      deemph_[BINS];              // 頻帶內 1/|H(k)|²（其餘為 0）
+    int16_t    fb_start_[MAX_FILTERS];     // 三角濾波器起始 bin
+    int16_t    fb_len_[MAX_FILTERS];
+    int16_t    fb_off_[MAX_FILTERS];       // 在 fb_w_ 中的位移
+    float      fb_w_[2 * BINS + MAX_FILTERS]; // 相鄰濾波器兩兩重疊（端點各多一格）
+    float      dct_[MAX_CEPSTRAL][MAX_FILTERS];
+
+    /* ENGINE_Q15 查表（由上面的 float 表四捨五入） */
+    int32_t    pre_cof_q15_;
+    int16_t    twiddle_q_r_[FFT_SIZE / 2];
+    int16_t    twiddle_q_i_[FFT_SIZE / 2];
+    int16_t    fb_w_q_[2 * BINS + MAX_FILTERS];
+    int16_t    dct_q_[MAX_CEPSTRAL][MAX_FILTERS];
+    int32_t    log2_lut_[LOG2_LUT_SIZE + 1];   // log2(1 + i / LOG2_LUT_SIZE)，Q16
+
+    /* 滾動矩陣（環形，head_ 為下一幀寫入位置） */
+    float      cep_[MAX_WINDOW_FRAMES][MAX_CEPSTRAL];
+    int        head_;
+    int        count_;
+    float      sum_[MAX_WINDOW_FRAMES + MAX_CMVN_WIN];   // cmvnw 對稱填補後的前綴和
+    float      sq_[MAX_WINDOW_FRAMES + MAX_CMVN_WIN];    // 前綴平方和（NORM_MEAN_VAR）
+
+    union {
+        alignas(16) float work_[FFT_SIZE]; // N/2 點 interleaved 複數工作區
+        int32_t work_q_[FFT_SIZE];
+    };
+    union {
+        float    power_[BINS];
+        uint64_t power_q_[BINS];           // 4·|X|²（區塊浮點尺度）
+    };
+
+    void  push_sample_(int16_t x, float *energies, size_t max_energies, size_t *frames);
+    float frame_analyse_();
+    float frame_analyse_q15_();
+    float fft_power_();
+    int32_t log2_q16_(uint64_t v) const;
+
+    /** cmvnw（減視窗平均，NORM_MEAN_VAR 再除標準差），逐值交給 sink(row, col, y) */
+    template <typename Sink>
+    void cmvnw_(Sink &&sink);
+};
+
+#endif // SPECTRAL_FRONTEND_H
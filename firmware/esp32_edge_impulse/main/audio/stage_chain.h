@@ -0,0 +1,66 @@
+#ifndef STAGE_CHAIN_H
+#define STAGE_CHAIN_H
+
+/* ============================================================
+ * stage_chain.h - 編譯期組合的原地音訊處理鏈
+ * ESP-MIAO v0.8.0
+ *
+ * StageChain<A, B, C> 依序對同一段 PCM 呼叫各階段的 process(int16_t *, size_t)，
+ * 以 fold expression 展開成直線呼叫（無虛擬函式、無函式指標），可被內聯進呼叫端迴圈。
+ * StageIf<條件, 階段> 在條件為 0 時換成空類型 SkipStage：不佔記憶體、process 為空，
+ * 取代散落各處的 #if 區塊。例如：
+ *
+ *   using CaptureStages = StageChain<StageIf<AUDIO_AGC_ENABLE, Agc>>;
+ *   if (Agc *agc = stages.find<Agc>()) agc->init(...);   // AGC 停用時整段消去
+ *
+ * 各階段須為單一生產者使用（ISR 可呼叫則階段本身須 ISR 安全）。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <tuple>
+#include <type_traits>
+
+/** 停用的階段：保留原類型以便 StageChain::get / enabled 查詢 */
+template <typename Stage>
+struct SkipStage {
+    void process(int16_t *, size_t) {}
+};
+
+template <bool Enabled, typename Stage>
+using StageIf = typename std::conditional<Enabled, Stage, SkipStage<Stage>>::type;
+
+template <typename... Stages>
+class StageChain {
+public:
+    /** 依序原地處理 n 個樣本 */
+    inline void process(int16_t *pcm, size_t n)
+    {
+        std::apply([pcm, n](auto &...stage) { (stage.process(pcm, n), ...); }, stages_);
+    }
+
+    /** 階段 Stage 是否編入此鏈（編譯期常數） */
+    template <typename Stage>
+    static constexpr bool enabled() { return (std::is_same<Stage, Stages>::value || ...); }
+
+    /** 取得階段（初始化 / 讀取狀態用）；停用的階段回傳 nullptr，分支於編譯期消去 */
+    template <typename Stage>
+    Stage *find()
+    {
+        if constexpr (enabled<Stage>()) return &std::get<Stage>(stages_);
+        else return nullptr;
+    }
+    template <typename Stage>
+    const Stage *find() const
+    {
+        if constexpr (enabled<Stage>()) return &std::get<Stage>(stages_);
+        else return nullptr;
+    }
+
+private:
+    std::tuple<Stages...> stages_;
+};
+
+static_assert(std::is_empty<SkipStage<int>>::value, "disabled stages must not take space");
+
+#endif // STAGE_CHAIN_H
@@ -2,42 +2,163 @@
  * vad.cpp - FFT 頻域語音活動偵測實作
  * ESP-MIAO v0.8.0
  *
- * 採用基 2 DIT FFT + 旋轉因子查表（優化版）
- * 計算 300Hz~3400Hz 人聲頻段能量，與閾值比較
+ * 實數輸入以 N/2 點複數 FFT + 頻譜分離計算，只還原 300Hz~3400Hz 人聲頻段的 bin，與閾值比較。
+ * N/2 點 FFT 依 VAD_FFT_KERNEL 使用 esp-dsp dsps_fft2r 或本地基 4 核心（fft_radix4.h）；
+ * esp-dsp 初始化失敗時也改用基 4 核心。
+ *
+ * VAD_ENGINE_BIQUAD 則以二階高通 / 低通（RBJ Butterworth）串接直接在 int16
+ * 樣本上濾波、累計平方和，依 Parseval 換算成 FFT band_rms 同尺度後比較。
+ *
+ * VAD_ENGINE_Q15 為 FFT 引擎的定點版本（VadQ15）：Q15 窗 / 旋轉因子、int32 資料、
+ * 64-bit 功率累計與整數開方，每幀不需要任何浮點運算。
  */
 
 #include "vad.h"
 #include "config.h"
+#include "fft_q15.h"
+#include "fft_radix4.h"
 #include "esp_log.h"
+#include "esp_cpu.h"
+#include "dsps_fft2r.h"
+#include "dsp_err_codes.h"
 #include <math.h>
 #include <string.h>
 
 static const char *TAG = "VAD";
 
-VAD::VAD()
-    : twiddle_initialized_(false),
-      frame_count_(0)
+/* ---------- 編譯期查表（置於 flash，所有 VAD 實例共用） ---------- */
+
+namespace {
+
+struct FftTables {
+    float hamming[FFT_SIZE];
+    float twiddle_r[FFT_SIZE / 2];
+    float twiddle_i[FFT_SIZE / 2];
+
+    constexpr FftTables() : hamming(), twiddle_r(), twiddle_i()
+    {
+        for (int i = 0; i < FFT_SIZE; i++) {
+            hamming[i] = (float)(0.54 - 0.46 * cx_cos(2.0 * kPi * i / (FFT_SIZE - 1)));
+        }
+        for (int i = 0; i < FFT_SIZE / 2; i++) {
+            double angle = -2.0 * kPi * i / FFT_SIZE;
+            twiddle_r[i] = (float)cx_cos(angle);
+            twiddle_i[i] = (float)cx_sin(angle);
+        }
+    }
+};
+
+constexpr FftTables kTables{};
+
+/* Q15 版本（由同一組係數四捨五入，1.0 飽和為 32767） */
+constexpr int16_t to_q15(double v)
 {
-    memset(&stats_, 0, sizeof(stats_));
-    memset(twiddle_r_, 0, sizeof(twiddle_r_));
-    memset(twiddle_i_, 0, sizeof(twiddle_i_));
+    double q = v * 32768.0;
+    q += (q >= 0.0) ? 0.5 : -0.5;
+    return (q > 32767.0) ? (int16_t)32767 : (q < -32768.0) ? (int16_t)-32768 : (int16_t)(long)q;
 }
 
-void VAD::init_twiddle_factors_()
+struct Q15Tables {
+    int16_t hamming[FFT_SIZE];
+    int16_t twiddle_r[FFT_SIZE / 2];
+    int16_t twiddle_i[FFT_SIZE / 2];
+
+    constexpr Q15Tables() : hamming(), twiddle_r(), twiddle_i()
+    {
+        for (int i = 0; i < FFT_SIZE; i++) hamming[i] = to_q15(kTables.hamming[i]);
+        for (int i = 0; i < FFT_SIZE / 2; i++) {
+            twiddle_r[i] = to_q15(kTables.twiddle_r[i]);
+            twiddle_i[i] = to_q15(kTables.twiddle_i[i]);
+        }
+    }
+};
+
+constexpr Q15Tables kQ15{};
+
+/* 窗乘積右移位數：int16 × Q15 < 2^30 → < 2^23，抵消 log2(N/2) 級 >>1 後與浮點 FFT 同尺度 */
+constexpr int kQ15WindowShift = 15 - 8;
+static_assert(FFT_SIZE == 512, "kQ15WindowShift assumes a 256-point complex FFT (8 stages)");
+
+/* RBJ cookbook 二階 Butterworth（Q = 1/√2），係數已除以 a0 */
+struct Biquad {
+    float b0, b1, b2, a1, a2;
+};
+
+constexpr Biquad make_biquad(double f0, bool highpass)
 {
-    if (twiddle_initialized_) return;
-    for (int i = 0; i < FFT_SIZE / 2; i++) {
-        float angle   = -2.0f * (float)M_PI * i / FFT_SIZE;
-        twiddle_r_[i] = cosf(angle);
-        twiddle_i_[i] = sinf(angle);
+    double w0    = 2.0 * kPi * f0 / SAMPLE_RATE;
+    double c     = cx_cos(w0);
+    double alpha = cx_sin(w0) / (2.0 * 0.70710678118654752);
+    double a0    = 1.0 + alpha;
+    double b     = highpass ? (1.0 + c) / 2.0 : (1.0 - c) / 2.0;
+    return Biquad{(float)(b / a0),
+                  (float)((highpass ? -2.0 * b : 2.0 * b) / a0),
+                  (float)(b / a0),
+                  (float)(-2.0 * c / a0),
+                  (float)((1.0 - alpha) / a0)};
+}
+
+constexpr Biquad kBand[2] = {
+    make_biquad(FFT_FREQ_MIN, true),
+    make_biquad(FFT_FREQ_MAX, false),
+};
+
+constexpr double hamming_power()
+{
+    double sum = 0.0;
+    for (int i = 0; i < FFT_SIZE; i++) sum += (double)kTables.hamming[i] * kTables.hamming[i];
+    return sum / FFT_SIZE;
+}
+
+constexpr int kStartBin = (FFT_FREQ_MIN * FFT_SIZE) / SAMPLE_RATE;
+constexpr int kEndBin   = ((FFT_FREQ_MAX * FFT_SIZE) / SAMPLE_RATE < FFT_SIZE / 2)
+                        ? (FFT_FREQ_MAX * FFT_SIZE) / SAMPLE_RATE : FFT_SIZE / 2;
+
+}  // namespace
+
+/* 一組 biquad 串接（TDF-II），回傳輸出平方和 */
+template <typename T>
+static inline float band_filter_run(float z[][2], int stages, const T *x, size_t n)
+{
+    float sum_sq = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        float v = (float)x[i];
+        for (int s = 0; s < stages; s++) {
+            const Biquad &q = kBand[s];
+            float y = q.b0 * v + z[s][0];
+            z[s][0] = q.b1 * v - q.a1 * y + z[s][1];
+            z[s][1] = q.b2 * v - q.a2 * y;
+            v = y;
+        }
+        sum_sq += v * v;
     }
-    twiddle_initialized_ = true;
+    return sum_sq;
 }
 
-void VAD::fft_compute_(float *real, float *imag, int n)
+VAD::VAD()
+    : dsp_ready_(false),
+      frame_count_(0),
+      floor_(VAD_TUNE_BASE)
 {
-    init_twiddle_factors_();
+    memset(work_, 0, sizeof(work_));
+    memset(imag_, 0, sizeof(imag_));
+    memset(band_z_, 0, sizeof(band_z_));
+    memset(&stats_, 0, sizeof(stats_));
+    stats_.threshold = FFT_ENERGY_THRESHOLD;
+#if VAD_ADAPTIVE_THRESHOLD
+    /* 起始噪音底讓初始閾值等於 FFT_ENERGY_THRESHOLD，之後依環境收斂 */
+    stats_.noise_floor = FFT_ENERGY_THRESHOLD / powf(10.0f, VAD_SNR_DB / 20.0f);
+#endif
+
+    /* Parseval：單邊頻帶 Σ|X[k]|² ≈ (N/2)·N·mean(w²)·σ²，band_rms = √(Σ / bins) */
+    const int bins = kEndBin - kStartBin;
+    band_scale_ = (bins > 0)
+                ? FFT_SIZE * sqrtf((float)hamming_power() / (2.0f * bins))
+                : 0.0f;
+}
 
+void VAD::fft_compute_(float *real, float *imag, int n)
+{
     // Bit-reversal permutation
     int j = 0;
     for (int i = 0; i < n - 1; i++) {
@@ -58,8 +179,8 @@ void VAD::fft_compute_(float *real, float *imag, int n)
         for (int i = 0; i < n; i += len) {
             for (int k = 0; k < half; k++) {
                 int   idx = k * step;
-                float wr  = twiddle_r_[idx];
-                float wi  = twiddle_i_[idx];
+                float wr  = kTables.twiddle_r[idx];
+                float wi  = kTables.twiddle_i[idx];
                 float tr  = wr * real[i + k + half] - wi * imag[i + k + half];
                 float ti  = wr * imag[i + k + half] + wi * real[i + k + half];
                 real[i + k + half] = real[i + k] - tr;
@@ -71,34 +192,74 @@ void VAD::fft_compute_(float *real, float *imag, int n)
     }
 }
 
-bool VAD::fft_detect_(const float *buffer, size_t length, float *fft_energy_out)
+bool VAD::init_dsp_()
 {
-    if (length < FFT_SIZE) {
-        if (fft_energy_out) *fft_energy_out = 0.0f;
+    if (dsp_ready_) return true;
+    /* 表格可能已由 EI SDK 初始化（REINITIALIZED 亦可用）；N/2 <= 表格大小即可共用 */
+    esp_err_t err = dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE);
+    if (err != ESP_OK && err != ESP_ERR_DSP_REINITIALIZED) {
+        ESP_LOGW(TAG, "esp-dsp FFT init failed (0x%x), using scalar FFT", (unsigned)err);
         return false;
     }
+    dsp_ready_ = true;
+    return true;
+}
 
-    static float real[FFT_SIZE];
-    static float imag[FFT_SIZE];
-
-    // Hamming windowing + copy
-    for (int i = 0; i < FFT_SIZE; i++) {
-        float window = 0.54f - 0.46f * cosf(2.0f * (float)M_PI * i / (FFT_SIZE - 1));
-        real[i] = buffer[i] * window;
-        imag[i] = 0.0f;
+void VAD::fft_half_()
+{
+    /* z[n] = x[2n] + j·x[2n+1]：work_ 的記憶體排列即為 interleaved 複數，原地運算 */
+#if VAD_FFT_KERNEL == VAD_FFT_KERNEL_ESP_DSP
+    if (init_dsp_()) {
+        dsps_fft2r_fc32(work_, FFT_SIZE / 2);
+        dsps_bit_rev_fc32(work_, FFT_SIZE / 2);
+        return;
     }
+#endif
+    fft_radix4_fc32(work_);
+}
+
+float VAD::band_power_split_(int start_bin, int end_bin)
+{
+    const int H = FFT_SIZE / 2;
 
-    fft_compute_(real, imag, FFT_SIZE);
+    /* 分離：X[k] = (Z[k] + Z*[H-k]) / 2 + W^k · (Z[k] - Z*[H-k]) / 2j */
+    float sum_power = 0.0f;
+    for (int k = start_bin; k < end_bin; k++) {
+        int   m   = (H - k) & (H - 1);
+        float zr  = work_[2 * k],  zi  = work_[2 * k + 1];
+        float mr  = work_[2 * m],  mi  = work_[2 * m + 1];
+        float fer = 0.5f * (zr + mr),  fei = 0.5f * (zi - mi);
+        float for_ = 0.5f * (zi + mi), foi = -0.5f * (zr - mr);
+        float wr  = kTables.twiddle_r[k], wi = kTables.twiddle_i[k];
+        float xr  = fer + wr * for_ - wi * foi;
+        float xi  = fei + wr * foi + wi * for_;
+        sum_power += xr * xr + xi * xi;
+    }
+    return sum_power;
+}
 
-    int   start_bin  = (FFT_FREQ_MIN * FFT_SIZE) / SAMPLE_RATE;
-    int   end_bin    = (FFT_FREQ_MAX * FFT_SIZE) / SAMPLE_RATE;
-    float sum_power  = 0.0f;
-    int   bin_count  = 0;
+/* 原本的 N 點複數基 2（虛部補零、每幀推算位元反轉），只留作 run_benchmark 的對照 */
+float VAD::band_power_scalar_(int start_bin, int end_bin)
+{
+    memset(imag_, 0, sizeof(imag_));
+    fft_compute_(work_, imag_, FFT_SIZE);
 
-    for (int i = start_bin; i < end_bin && i < FFT_SIZE / 2; i++) {
-        sum_power += (real[i] * real[i] + imag[i] * imag[i]);
-        bin_count++;
+    float sum_power = 0.0f;
+    for (int i = start_bin; i < end_bin; i++) {
+        sum_power += (work_[i] * work_[i] + imag_[i] * imag_[i]);
     }
+    return sum_power;
+}
+
+bool VAD::analyse_work_(float *fft_energy_out)
+{
+    // Hamming windowing（查表，原地）
+    for (int i = 0; i < FFT_SIZE; i++) work_[i] *= kTables.hamming[i];
+
+    const int bin_count = kEndBin - kStartBin;
+
+    fft_half_();
+    float sum_power = band_power_split_(kStartBin, kEndBin);
 
     float band_rms = (bin_count > 0) ? sqrtf(sum_power / bin_count) : 0.0f;
 
@@ -106,38 +267,372 @@ bool VAD::fft_detect_(const float *buffer, size_t length, float *fft_energy_out)
     return (band_rms > FFT_ENERGY_THRESHOLD);
 }
 
-bool VAD::detect(const float *buffer, size_t length,
-                 float *rms_val, float *fft_energy)
+/* ---------- Q15 定點引擎 ---------- */
+
+/* 64-bit 整數開方（逐位決定，無除法） */
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t root = 0;
+    uint64_t bit  = (uint64_t)1 << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= root + bit) {
+            v    -= root + bit;
+            root  = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+uint32_t VadQ15::band_energy(const int16_t *frame)
+{
+    for (int i = 0; i < FFT_SIZE; i++) {
+        work_[i] = ((int32_t)frame[i] * kQ15.hamming[i]) >> kQ15WindowShift;
+    }
+    return analyse_();
+}
+
+uint32_t VadQ15::band_energy(const AudioSlice &slice, size_t offset)
+{
+    /* 環繞時分兩段讀取 int16，不經 float 轉換 */
+    size_t n0 = 0;
+    if (offset < slice.len[0]) {
+        n0 = slice.len[0] - offset;
+        if (n0 > FFT_SIZE) n0 = FFT_SIZE;
+        const int16_t *src = slice.seg[0] + offset;
+        for (size_t i = 0; i < n0; i++) {
+            work_[i] = ((int32_t)src[i] * kQ15.hamming[i]) >> kQ15WindowShift;
+        }
+    }
+    const int16_t *src = slice.seg[1] + (offset + n0 - slice.len[0]);
+    for (size_t i = n0; i < FFT_SIZE; i++) {
+        work_[i] = ((int32_t)src[i - n0] * kQ15.hamming[i]) >> kQ15WindowShift;
+    }
+    return analyse_();
+}
+
+uint32_t VadQ15::analyse_()
+{
+    const int H = FFT_SIZE / 2;
+    int32_t  *z = work_;   // z[n] = x[2n] + j·x[2n+1]
+
+    fft_q15(z, kQ15.twiddle_r, kQ15.twiddle_i);
+
+    /* 頻譜分離（同 band_power_split_），功率以 64-bit 累計 */
+    uint64_t sum_power = 0;
+    for (int k = kStartBin; k < kEndBin; k++) {
+        int     m   = (H - k) & (H - 1);
+        int32_t zr  = z[2 * k], zi = z[2 * k + 1];
+        int32_t mr  = z[2 * m], mi = z[2 * m + 1];
+        int32_t fer = (zr + mr) >> 1,  fei = (zi - mi) >> 1;
+        int32_t for_ = (zi + mi) >> 1, foi = (mr - zr) >> 1;
+        int32_t wr  = kQ15.twiddle_r[k], wi = kQ15.twiddle_i[k];
+        int64_t xr  = fer + q15_mul(wr, for_) - q15_mul(wi, foi);
+        int64_t xi  = fei + q15_mul(wr, foi) + q15_mul(wi, for_);
+        sum_power += (uint64_t)(xr * xr) + (uint64_t)(xi * xi);
+    }
+
+    const int bin_count = kEndBin - kStartBin;
+    return (bin_count > 0) ? isqrt64(sum_power / bin_count) : 0;
+}
+
+/* ---------- Biquad 頻帶引擎 ---------- */
+
+float VAD::band_filter_(const int16_t *pcm, size_t n)
+{
+    return band_filter_run(band_z_, BAND_STAGES, pcm, n);
+}
+
+float VAD::band_filter_(const float *buffer, size_t n)
+{
+    return band_filter_run(band_z_, BAND_STAGES, buffer, n);
+}
+
+float VAD::band_energy_(float sum_sq, size_t n) const
+{
+    return (n > 0) ? band_scale_ * sqrtf(sum_sq / n) : 0.0f;
+}
+
+/* ---------- 分幀 ---------- */
+
+/* FFT 幀數：以 VAD_FRAME_HOP 步進，最後一幀對齊切片尾端，確保涵蓋全部樣本 */
+static inline size_t fft_frame_count(size_t length)
+{
+    if (length < FFT_SIZE) return 0;
+    return (length - FFT_SIZE + VAD_FRAME_HOP - 1) / VAD_FRAME_HOP + 1;
+}
+
+static inline size_t fft_frame_offset(size_t i, size_t length)
+{
+    size_t off = i * VAD_FRAME_HOP;
+    return (off + FFT_SIZE > length) ? length - FFT_SIZE : off;
+}
+
+VadResult VAD::begin_() const
+{
+    VadResult r  = {};
+    r.threshold  = stats_.threshold;
+    r.min_energy = INFINITY;
+    return r;
+}
+
+void VAD::add_frame_(VadResult &r, float energy)
+{
+    if (energy > r.threshold) r.voiced_frames++;
+    if (energy > r.peak_energy) r.peak_energy = energy;
+    if (energy < r.min_energy)  r.min_energy  = energy;
+    r.mean_energy += energy;
+    r.frames++;
+}
+
+void VAD::finish_(VadResult &r)
+{
+    if (r.frames > 0) {
+        r.mean_energy  /= r.frames;
+        r.speech_ratio  = (float)r.voiced_frames / r.frames;
+    }
+    else {
+        r.min_energy = 0.0f;
+    }
+    r.speech = (r.voiced_frames >= VAD_MIN_SPEECH_FRAMES);
+}
+
+void VAD::track_noise_(const VadResult &r)
+{
+#if VAD_ADAPTIVE_THRESHOLD
+    if (r.frames == 0) return;
+    /* 非對稱平滑：碰到更安靜的幀立即下探，說話 / 風扇變大時只緩慢上升 */
+    float k = (r.min_energy < stats_.noise_floor) ? VAD_NOISE_FALL : VAD_NOISE_RISE;
+    stats_.noise_floor = stats_.noise_floor * (1.0f - k) + r.min_energy * k;
+
+    static const float snr = powf(10.0f, VAD_SNR_DB / 20.0f);
+    float th = stats_.noise_floor * snr;
+    stats_.threshold = (th > floor_) ? th : floor_;
+#else
+    (void)r;
+#endif
+}
+
+VadResult VAD::detect(const float *buffer, size_t length, float *rms_val)
 {
     // RMS（調試用）
-    if (rms_val) {
+    float rms = 0.0f;
+    if (rms_val && length > 0) {
         float sum_sq = 0.0f;
         for (size_t i = 0; i < length; i++) sum_sq += buffer[i] * buffer[i];
-        *rms_val = sqrtf(sum_sq / length);
+        rms = sqrtf(sum_sq / length);
+        *rms_val = rms;
+    }
+
+    VadResult r = begin_();
+#if VAD_ENGINE == VAD_ENGINE_BIQUAD
+    for (size_t pos = 0; pos < length; pos += VAD_FRAME_HOP) {
+        size_t n = length - pos;
+        if (n > VAD_FRAME_HOP) n = VAD_FRAME_HOP;
+        add_frame_(r, band_energy_(band_filter_(buffer + pos, n), n));
+    }
+#else
+    size_t frames = fft_frame_count(length);
+    for (size_t i = 0; i < frames; i++) {
+        float energy = 0.0f;
+        memcpy(work_, buffer + fft_frame_offset(i, length), sizeof(work_));
+        analyse_work_(&energy);
+        add_frame_(r, energy);
+    }
+#endif
+    finish_(r);
+
+    update_stats_(r, rms_val ? &rms : nullptr);
+    return r;
+}
+
+VadResult VAD::detect(const AudioSlice &slice, float *rms_val)
+{
+    float rms = 0.0f;
+    if (rms_val && slice.size > 0) {
+        rms = sqrtf(slice.sum_squares() / slice.size);
+        *rms_val = rms;
+    }
+
+    VadResult r = begin_();
+#if VAD_ENGINE == VAD_ENGINE_BIQUAD
+    /* 直接在 int16 段上濾波，每 VAD_FRAME_HOP 個樣本為一幀；濾波器狀態跨切片延續 */
+    for (size_t pos = 0; pos < slice.size; pos += VAD_FRAME_HOP) {
+        size_t n = slice.size - pos;
+        if (n > VAD_FRAME_HOP) n = VAD_FRAME_HOP;
+
+        float  sum_sq = 0.0f;
+        size_t done   = 0;
+        if (pos < slice.len[0]) {
+            done = slice.len[0] - pos;
+            if (done > n) done = n;
+            sum_sq += band_filter_(slice.seg[0] + pos, done);
+        }
+        if (done < n) {
+            sum_sq += band_filter_(slice.seg[1] + (pos + done - slice.len[0]), n - done);
+        }
+        add_frame_(r, band_energy_(sum_sq, n));
+    }
+#elif VAD_ENGINE == VAD_ENGINE_Q15
+    /* 直接讀 int16 段做定點 FFT，每幀只有最後的能量轉成 float */
+    size_t frames = fft_frame_count(slice.size);
+    for (size_t i = 0; i < frames; i++) {
+        add_frame_(r, (float)q15_.band_energy(slice, fft_frame_offset(i, slice.size)));
+    }
+#else
+    /* 逐幀轉為 float 進工作區，不需要整段副本 */
+    size_t frames = fft_frame_count(slice.size);
+    for (size_t i = 0; i < frames; i++) {
+        float energy = 0.0f;
+        slice.to_float(fft_frame_offset(i, slice.size), FFT_SIZE, work_);
+        analyse_work_(&energy);
+        add_frame_(r, energy);
     }
+#endif
+    finish_(r);
+
+    update_stats_(r, rms_val ? &rms : nullptr);
+    return r;
+}
+
+VadResult VAD::detect_energies(const float *energies, size_t frames)
+{
+    VadResult r = begin_();
+    for (size_t i = 0; i < frames; i++) add_frame_(r, energies[i]);
+    finish_(r);
 
-    // FFT 偵測
-    float local_fft = 0.0f;
-    bool  result    = fft_detect_(buffer, length, &local_fft);
-    if (fft_energy) *fft_energy = local_fft;
+    update_stats_(r, nullptr);
+    return r;
+}
 
-    // 統計更新
+void VAD::update_stats_(const VadResult &r, const float *rms)
+{
     frame_count_++;
-    if (result) stats_.fft_triggers++;
-    stats_.fft_avg = stats_.fft_avg * 0.99f + local_fft * 0.01f;
-    if (rms_val) stats_.rms_avg = stats_.rms_avg * 0.99f + (*rms_val) * 0.01f;
+    if (r.speech) stats_.fft_triggers++;
+    stats_.fft_avg          = stats_.fft_avg * 0.99f + r.mean_energy * 0.01f;
+    stats_.speech_ratio_avg = stats_.speech_ratio_avg * 0.99f + r.speech_ratio * 0.01f;
+    track_noise_(r);
+    if (r.peak_energy > stats_.fft_peak) stats_.fft_peak = r.peak_energy;
+    if (rms) stats_.rms_avg = stats_.rms_avg * 0.99f + (*rms) * 0.01f;
 
 #if VAD_FFT_DEBUG
     if (frame_count_ % PRINT_STATS_INTERVAL == 0) {
-        ESP_LOGI(TAG, "[VAD Stats frame=%lu] fft_trig=%lu ml_trig=%lu rms_avg=%.2f fft_avg=%.2f(>%.0f?)",
+        ESP_LOGI(TAG, "[VAD Stats slice=%lu] fft_trig=%lu ml_trig=%lu rms_avg=%.2f fft_avg=%.2f(>%.0f?) "
+                 "floor=%.0f peak=%.0f speech=%.0f%% agc=%.2fx",
                  (unsigned long)frame_count_,
                  (unsigned long)stats_.fft_triggers,
                  (unsigned long)stats_.ml_triggered,
-                 stats_.rms_avg, stats_.fft_avg, (float)FFT_ENERGY_THRESHOLD);
+                 stats_.rms_avg, stats_.fft_avg, stats_.threshold, stats_.noise_floor,
+                 stats_.fft_peak, 100.0f * stats_.speech_ratio_avg,
+                 stats_.agc_gain);
+        stats_.fft_peak = 0.0f;
     }
 #endif
+}
 
-    return result;
+void VAD::run_benchmark(int frames)
+{
+    float   frame[FFT_SIZE];
+    int16_t pcm[FFT_SIZE];
+    for (int i = 0; i < FFT_SIZE; i++) {
+        float x = 8000.0f * sinf(2.0f * (float)M_PI * 1000.0f * i / SAMPLE_RATE)
+                + (float)((i * 7919) % 200 - 100);
+        pcm[i]   = (int16_t)x;
+        frame[i] = x * kTables.hamming[i];
+    }
+
+    const int start_bin = kStartBin;
+    const int end_bin   = kEndBin;
+
+    /* Biquad 引擎處理同樣 FFT_SIZE 個樣本的成本 */
+    float    band_sq = 0.0f;
+    uint32_t tb0 = esp_cpu_get_cycle_count();
+    for (int i = 0; i < frames; i++) band_sq = band_filter_(pcm, FFT_SIZE);
+    uint32_t tb1 = esp_cpu_get_cycle_count();
+    memset(band_z_, 0, sizeof(band_z_));
+    float band_rms = band_scale_ * sqrtf(band_sq / FFT_SIZE);
+
+    /* Q15 定點引擎（含窗乘法；浮點路徑的 frame 已預先乘窗） */
+    static VadQ15 q15;
+    uint32_t q15_rms = 0;
+    uint32_t tq0 = esp_cpu_get_cycle_count();
+    for (int i = 0; i < frames; i++) q15_rms = q15.band_energy(pcm);
+    uint32_t tq1 = esp_cpu_get_cycle_count();
+
+    /* 各路徑都原地運算，每次重新載入 work_（複製成本相同，不影響比較） */
+    float    p_scalar = 0.0f, p_r4 = 0.0f, p_dsp = 0.0f;
+    uint32_t t0 = esp_cpu_get_cycle_count();
+    for (int i = 0; i < frames; i++) {
+        memcpy(work_, frame, sizeof(work_));
+        p_scalar = band_power_scalar_(start_bin, end_bin);
+    }
+    uint32_t t1 = esp_cpu_get_cycle_count();
+    for (int i = 0; i < frames; i++) {
+        memcpy(work_, frame, sizeof(work_));
+        fft_radix4_fc32(work_);
+        p_r4 = band_power_split_(start_bin, end_bin);
+    }
+    uint32_t t2 = esp_cpu_get_cycle_count();
+    uint32_t c_scalar = (t1 - t0) / frames;
+    uint32_t c_r4     = (t2 - t1) / frames;
+    uint32_t c_dsp    = 0;
+    if (init_dsp_()) {
+        uint32_t t3 = esp_cpu_get_cycle_count();
+        for (int i = 0; i < frames; i++) {
+            memcpy(work_, frame, sizeof(work_));
+            dsps_fft2r_fc32(work_, FFT_SIZE / 2);
+            dsps_bit_rev_fc32(work_, FFT_SIZE / 2);
+            p_dsp = band_power_split_(start_bin, end_bin);
+        }
+        c_dsp = (esp_cpu_get_cycle_count() - t3) / frames;
+    }
+
+    /* 建置時的核心選擇（VAD_FFT_KERNEL）以此為準：實測較快的一方 */
+    const char *fastest = (c_dsp && c_dsp < c_r4) ? "esp-dsp" : "radix-4";
+    ESP_LOGI(TAG, "[Bench] FFT %d: radix-2 complex = %lu, radix-4 real = %lu (%.1fx), esp-dsp real = %lu "
+             "cycles/frame; fastest %s, built with %s",
+             FFT_SIZE, (unsigned long)c_scalar, (unsigned long)c_r4,
+             c_r4 ? (float)c_scalar / (float)c_r4 : 0.0f, (unsigned long)c_dsp, fastest,
+             VAD_FFT_KERNEL == VAD_FFT_KERNEL_RADIX4 ? "radix-4" : "esp-dsp");
+    ESP_LOGI(TAG, "[Bench] band power diff vs radix-2: radix-4 %.4f%%, esp-dsp %.4f%%",
+             p_scalar > 0.0f ? 100.0f * fabsf(p_r4 - p_scalar) / p_scalar : 0.0f,
+             (c_dsp && p_scalar > 0.0f) ? 100.0f * fabsf(p_dsp - p_scalar) / p_scalar : 0.0f);
+
+    float p_rfft = c_dsp ? p_dsp : p_r4;
+    int   bins     = end_bin - start_bin;
+    float fft_rms  = bins > 0 ? sqrtf(p_rfft / bins) : 0.0f;
+    ESP_LOGI(TAG, "[Bench] biquad band = %lu cycles/frame, band_rms fft=%.0f biquad=%.0f",
+             (unsigned long)((tb1 - tb0) / frames), fft_rms, band_rms);
+    ESP_LOGI(TAG, "[Bench] Q15 fixed = %lu cycles/frame, band_rms q15=%lu (%.3f%% vs fft)",
+             (unsigned long)((tq1 - tq0) / frames), (unsigned long)q15_rms,
+             fft_rms > 0.0f ? 100.0f * fabsf((float)q15_rms - fft_rms) / fft_rms : 0.0f);
+}
+
+void VAD::seed_noise_floor(float noise_floor)
+{
+#if VAD_ADAPTIVE_THRESHOLD
+    if (noise_floor <= 0.0f) return;
+    stats_.noise_floor = noise_floor;
+    float th = noise_floor * powf(10.0f, VAD_SNR_DB / 20.0f);
+    stats_.threshold = (th > floor_) ? th : floor_;
+#else
+    (void)noise_floor;
+#endif
+}
+
+void VAD::set_threshold_floor(float floor)
+{
+    if (floor <= 0.0f) return;
+    floor_ = floor;
+#if VAD_ADAPTIVE_THRESHOLD
+    if (stats_.threshold < floor_) stats_.threshold = floor_;
+#else
+    stats_.threshold = floor_;
+#endif
 }
 
 void VAD::record_ml_trigger()
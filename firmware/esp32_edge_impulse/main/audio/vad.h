@@ -2,13 +2,22 @@
 #define VAD_H
 
 /* ============================================================
- * vad.h - FFT 頻域語音活動偵測 (VAD)
+ * vad.h - 頻帶能量語音活動偵測 (VAD)
  * ESP-MIAO v0.8.0
+ *
+ * 引擎於編譯期以 VAD_ENGINE 選擇：
+ *   VAD_ENGINE_FFT    - FFT_SIZE 點幀的 FFT 頻帶能量
+ *   VAD_ENGINE_BIQUAD - 300Hz 高通 + 3400Hz 低通 biquad 串接
+ *   VAD_ENGINE_Q15    - 同 FFT 引擎，但整幀以定點運算（VadQ15），直接讀 int16 環形緩衝
+ *
+ * 兩種引擎皆以 VAD_FRAME_HOP 分幀涵蓋整個切片，回傳語音幀比例與峰值能量。
  * ============================================================ */
 
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "audio_capture.h"
+#include "config.h"
 
 /* Debug 等級控制 */
 #define VAD_LOG_NONE   0
@@ -25,7 +34,44 @@ struct VadStats {
     uint32_t fft_triggers;  // FFT 觸發次數
     uint32_t ml_triggered;  // ML 辨識成功次數
     float    rms_avg;       // RMS 滑動平均
-    float    fft_avg;       // FFT 能量滑動平均
+    float    fft_avg;       // 切片平均頻帶能量的滑動平均
+    float    fft_peak;      // 統計區間內的單幀最大頻帶能量
+    float    speech_ratio_avg; // 語音幀比例滑動平均
+    float    noise_floor;   // 目前噪音底（頻帶能量）
+    float    threshold;     // 目前生效的幀閾值
+    float    agc_gain;      // 目前擷取端 AGC 增益
+};
+
+/* 單一切片的 VAD 結果 */
+struct VadResult {
+    bool     speech;        // voiced_frames >= VAD_MIN_SPEECH_FRAMES
+    float    speech_ratio;  // 超過閾值的幀比例 (0~1)
+    float    peak_energy;   // 各幀頻帶能量最大值
+    float    mean_energy;   // 各幀頻帶能量平均
+    float    min_energy;    // 各幀頻帶能量最小值（噪音底估計來源）
+    float    threshold;     // 本切片使用的幀閾值
+    uint16_t frames;        // 本切片分析的幀數
+    uint16_t voiced_frames; // 超過閾值的幀數
+};
+
+/*
+ * Q15 定點頻帶能量（VAD_ENGINE_Q15 的每幀分析，亦可單獨使用）：
+ * int16 樣本 × Q15 Hamming 窗 → N/2 點複數 FFT（Q15 旋轉因子、int32 資料、每級 >>1）
+ * → 頻譜分離 → 頻帶功率以 64-bit 整數累計並整數開方，不用浮點除法與 sqrtf。
+ * 窗乘積右移 7 位與 8 級 >>1 互相抵消，輸出與浮點 FFT 引擎同尺度（共用閾值）。
+ */
+class VadQ15 {
+public:
+    /** 切片 [offset, offset + FFT_SIZE) 一幀的 300~3400Hz band_rms（可跨環繞兩段） */
+    uint32_t band_energy(const AudioSlice &slice, size_t offset);
+
+    /** 連續 FFT_SIZE 個樣本一幀的 band_rms */
+    uint32_t band_energy(const int16_t *frame);
+
+private:
+    int32_t work_[FFT_SIZE];   // N/2 點 interleaved 複數
+
+    uint32_t analyse_();
 };
 
 class VAD {
@@ -33,34 +79,84 @@ public:
     VAD();
 
     /**
-     * 執行 VAD 偵測（FFT 頻域能量分析）。
+     * 執行 VAD 偵測（分幀頻帶能量分析，涵蓋整段 buffer）。
      * @param buffer      音訊資料（float，16kHz mono）
      * @param length      樣本數
      * @param rms_val     輸出 RMS 值（可為 nullptr）
-     * @param fft_energy  輸出 FFT 能量值（可為 nullptr）
-     * @return true = 偵測到語音，false = 安靜
      */
-    bool detect(const float *buffer, size_t length,
-                float *rms_val = nullptr, float *fft_energy = nullptr);
+    VadResult detect(const float *buffer, size_t length, float *rms_val = nullptr);
+
+    /**
+     * 直接對環形緩衝切片執行 VAD（不需要整段 float 副本，逐幀轉換）。
+     */
+    VadResult detect(const AudioSlice &slice, float *rms_val = nullptr);
+
+    /**
+     * 以外部已算好的各幀頻帶能量判定（同 FFT band_rms 尺度，例如 NoiseSuppressor 的分析幀），
+     * 閾值 / 噪音底 / 統計更新與 detect() 相同，省去重複的 FFT。
+     */
+    VadResult detect_energies(const float *energies, size_t frames);
+
+    /**
+     * 效能比較（基 2 複數 FFT / 基 4 與 esp-dsp 實數 FFT / biquad 頻帶濾波 / Q15），以 CPU cycle 計。
+     * 於 VAD_FFT_BENCHMARK=1 時由 WakeWordDetector 開機呼叫。
+     */
+    void run_benchmark(int frames);
 
     /** 記錄 ML 觸發成功次數（由 WakeWordDetector 呼叫） */
     void record_ml_trigger();
 
+    /** 記錄目前 AGC 增益（由 WakeWordDetector 每個切片更新） */
+    void record_agc_gain(float gain) { stats_.agc_gain = gain; }
+
+    /**
+     * 以另一個 VAD 實例追蹤到的噪音底作為起始值（例如串流端點偵測沿用偵測端的環境估計）。
+     */
+    void seed_noise_floor(float noise_floor);
+
+    /**
+     * 執行期調整閾值下限（Server wake_tuning）：自適應模式取代 VAD_THRESHOLD_MIN，
+     * 固定模式直接作為幀閾值。
+     */
+    void set_threshold_floor(float floor);
+    float threshold_floor() const { return floor_; }
+
     /** 取得目前統計數據 */
     const VadStats &stats() const { return stats_; }
 
 private:
-    /* FFT 旋轉因子查表（針對 FFT_SIZE 512） */
-    float twiddle_r_[256];
-    float twiddle_i_[256];
-    bool  twiddle_initialized_;
+    /* FFT 工作區（每個實例各自持有，可多實例並行，例如每個麥克風聲道一個） */
+    bool  dsp_ready_;
+    float work_[FFT_SIZE];   // 視窗後的實數幀；原地視為 N/2 點 interleaved 複數
+    float imag_[FFT_SIZE];   // 基 2 對照路徑的虛部（run_benchmark）
+
+    /* Biquad 頻帶引擎：transposed direct form II 狀態，跨切片連續 */
+    static constexpr int BAND_STAGES = 2;
+    float band_z_[BAND_STAGES][2];
+    float band_scale_;       // 時域頻帶 RMS → FFT band_rms 尺度
+
+#if VAD_ENGINE == VAD_ENGINE_Q15
+    VadQ15 q15_;
+#endif
 
     VadStats stats_;
     uint32_t frame_count_;
+    float    floor_;         // 幀閾值下限（VAD_TUNE_BASE，可由 set_threshold_floor 調高）
 
-    void   init_twiddle_factors_();
     void   fft_compute_(float *real, float *imag, int n);
-    bool   fft_detect_(const float *buffer, size_t length, float *fft_energy_out);
+    bool   init_dsp_();
+    void   fft_half_();
+    float  band_power_split_(int start_bin, int end_bin);
+    float  band_power_scalar_(int start_bin, int end_bin);
+    bool   analyse_work_(float *fft_energy_out);
+    float  band_filter_(const int16_t *pcm, size_t n);
+    float  band_filter_(const float *buffer, size_t n);
+    float  band_energy_(float sum_sq, size_t n) const;
+    VadResult begin_() const;
+    static void add_frame_(VadResult &r, float energy);
+    static void finish_(VadResult &r);
+    void   track_noise_(const VadResult &r);
+    void   update_stats_(const VadResult &r, const float *rms);
 };
 
 #endif // VAD_H
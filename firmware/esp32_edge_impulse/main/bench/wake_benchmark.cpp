@@ -0,0 +1,291 @@
+/*
+ * wake_benchmark.cpp - 錄音回放 benchmark 實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "wake_benchmark.h"
+#include "config.h"
+#include "posterior_filter.h"
+#include "adpcm.h"
+#include "stream_protocol.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_spiffs.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_sys.h"
+#endif
+
+static const char *TAG = "Bench";
+
+/* 每切片各階段累計（cycle 來自 esp_cpu_get_cycle_count，MFCC / NN 取自 EI timing） */
+struct BenchStats {
+    uint32_t clips, positives, negatives;
+    uint32_t false_rejects, false_accepts;
+    uint64_t samples, negative_samples;
+    uint32_t slices;
+    uint64_t convert_cycles, vad_cycles, classifier_cycles, post_cycles, pack_cycles;
+    int64_t  dsp_us, nn_us;
+};
+
+static const AudioSlice *s_slice = nullptr;
+
+static int bench_get_data(size_t offset, size_t length, float *out_ptr)
+{
+    if (!s_slice || offset + length > s_slice->size) return -1;
+    s_slice->to_float(offset, length, out_ptr);
+    return 0;
+}
+
+/* 把切片編成串流 frame（每 STREAM_CHUNK_SAMPLES 一個 IMA-ADPCM 區塊 + StreamChunkHeader），
+ * 量測上行封包成本；frame 不送出 */
+static void pack_slice(const AudioSlice &slice, uint32_t *seq)
+{
+    static uint8_t frame[sizeof(StreamChunkHeader) + ADPCM_BLOCK_HEADER_BYTES + STREAM_CHUNK_SAMPLES / 2];
+    for (int s = 0; s < 2; s++) {
+        for (size_t off = 0; off < slice.len[s]; off += STREAM_CHUNK_SAMPLES) {
+            size_t n = slice.len[s] - off < STREAM_CHUNK_SAMPLES ? slice.len[s] - off : STREAM_CHUNK_SAMPLES;
+            AdpcmState adpcm;
+            adpcm_reset(&adpcm);
+            adpcm_encode_block(slice.seg[s] + off, n, &adpcm, frame + sizeof(StreamChunkHeader));
+            StreamChunkHeader hdr = {};
+            hdr.seq = (*seq)++;
+            memcpy(frame, &hdr, sizeof(hdr));
+        }
+    }
+}
+
+/* ---------- WAV ---------- */
+
+/* 讀到 data chunk 起點；只接受 PCM16 mono @ CAPTURE_SAMPLE_RATE */
+static bool wav_open_data(FILE *f, uint32_t *out_bytes)
+{
+    uint8_t riff[12];
+    if (fread(riff, 1, sizeof(riff), f) != sizeof(riff) ||
+        memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    bool fmt_ok = false;
+    uint8_t hdr[8];
+    while (fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr)) {
+        uint32_t size = hdr[4] | hdr[5] << 8 | hdr[6] << 16 | (uint32_t)hdr[7] << 24;
+        if (memcmp(hdr, "fmt ", 4) == 0 && size >= 16) {
+            uint8_t fmt[16];
+            if (fread(fmt, 1, sizeof(fmt), f) != sizeof(fmt)) return false;
+            uint16_t format   = fmt[0] | fmt[1] << 8;
+            uint16_t channels = fmt[2] | fmt[3] << 8;
+            uint32_t rate     = fmt[4] | fmt[5] << 8 | fmt[6] << 16 | (uint32_t)fmt[7] << 24;
+            uint16_t bits     = fmt[14] | fmt[15] << 8;
+            fmt_ok = format == 1 && channels == 1 && bits == 16 && rate == CAPTURE_SAMPLE_RATE;
+            if (!fmt_ok) {
+                ESP_LOGW(TAG, "Unsupported format %u / %u ch / %u bit / %lu Hz (need PCM16 mono %d Hz)",
+                         format, channels, bits, (unsigned long)rate, CAPTURE_SAMPLE_RATE);
+                return false;
+            }
+            size -= sizeof(fmt);
+        } else if (memcmp(hdr, "data", 4) == 0) {
+            *out_bytes = size;
+            return fmt_ok;
+        }
+        if (fseek(f, (long)(size + (size & 1)), SEEK_CUR) != 0) return false;
+    }
+    return false;
+}
+
+/* ---------- 單一片段 ---------- */
+
+/* 回傳觸發次數，-1 = 無法讀取 */
+static int run_clip(const char *path, AudioCapture &audio, VAD &vad, int label_index,
+                    BenchStats &st, uint64_t *out_samples)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    uint32_t bytes = 0;
+    if (!wav_open_data(f, &bytes)) {
+        fclose(f);
+        return -1;
+    }
+
+    /* 每個片段獨立：EI 連續模式狀態、游標與平滑歷史都重置 */
+    run_classifier_init();
+    audio.sync_reader(AUDIO_READER_DETECTOR);
+    PosteriorFilter posterior;
+    posterior.init(WAKE_SMOOTH_SLICES, WAKE_SMOOTH_MAX, WAKE_ON_THRESHOLD, WAKE_OFF_THRESHOLD,
+                   WAKE_REFRACTORY_MS);
+
+    signal_t signal;
+    signal.total_length = EI_CLASSIFIER_SLICE_SIZE;
+    signal.get_data     = &bench_get_data;
+
+    static int16_t     pcm[DMA_BUF_LEN];
+    ei_impulse_result_t result = {};
+    AudioSlice         slice   = {};
+    uint64_t           pipeline_samples = 0;   // 以音訊時間推進不應期，與回放速度無關
+    uint32_t           left     = bytes / sizeof(int16_t);
+    int                detections = 0;
+    uint32_t           pack_seq   = 0;
+
+    while (left > 0) {
+        size_t n = fread(pcm, sizeof(int16_t), left < DMA_BUF_LEN ? left : DMA_BUF_LEN, f);
+        if (n == 0) break;
+        left -= (uint32_t)n;
+        *out_samples += n;
+
+        uint32_t c0 = esp_cpu_get_cycle_count();
+        audio.replay(pcm, n);
+        st.convert_cycles += esp_cpu_get_cycle_count() - c0;
+
+        while (audio.ring().available(AUDIO_READER_DETECTOR) >= EI_CLASSIFIER_SLICE_SIZE) {
+            if (!audio.acquire_slice(AUDIO_READER_DETECTOR, EI_CLASSIFIER_SLICE_SIZE, &slice)) break;
+            pipeline_samples += EI_CLASSIFIER_SLICE_SIZE;
+            st.slices++;
+
+            vad.record_agc_gain(audio.agc_gain());
+            uint32_t  c1  = esp_cpu_get_cycle_count();
+            VadResult v   = vad.detect(slice);
+            uint32_t  c2  = esp_cpu_get_cycle_count();
+            s_slice = &slice;
+            EI_IMPULSE_ERROR res = run_classifier_continuous(&signal, &result, false);
+            uint32_t  c3  = esp_cpu_get_cycle_count();
+            if (res != EI_IMPULSE_OK) {
+                ESP_LOGE(TAG, "Inference failed (%d)", res);
+                continue;
+            }
+            int64_t now_us = (int64_t)(pipeline_samples * 1000000 / SAMPLE_RATE);
+            if (posterior.update(result.classification[label_index].value, v.speech, now_us)) {
+                detections++;
+            }
+            uint32_t  c4  = esp_cpu_get_cycle_count();
+            pack_slice(slice, &pack_seq);
+            uint32_t  c5  = esp_cpu_get_cycle_count();
+
+            st.vad_cycles        += c2 - c1;
+            st.classifier_cycles += c3 - c2;
+            st.post_cycles       += c4 - c3;
+            st.pack_cycles       += c5 - c4;
+            st.dsp_us            += result.timing.dsp_us;
+            st.nn_us             += result.timing.classification_us;
+        }
+    }
+    s_slice = nullptr;
+    fclose(f);
+    return detections;
+}
+
+/* ---------- 整體流程 ---------- */
+
+int wake_benchmark_run_dir(AudioCapture &audio, VAD &vad, const char *dir_path)
+{
+    int label_index = -1;
+    for (int i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) {
+        if (strcmp(ei_classifier_inferencing_categories[i], BENCH_POSITIVE_PREFIX) == 0) label_index = i;
+    }
+    if (label_index < 0) {
+        ESP_LOGE(TAG, "Model has no '%s' class", BENCH_POSITIVE_PREFIX);
+        return -1;
+    }
+
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        ESP_LOGE(TAG, "Cannot list %s", dir_path);
+        return -1;
+    }
+
+    BenchStats st = {};
+    const size_t prefix_len = strlen(BENCH_POSITIVE_PREFIX);
+    int64_t t0 = esp_timer_get_time();
+
+    struct dirent *e;
+    while ((e = readdir(dir)) != nullptr) {
+        size_t len = strlen(e->d_name);
+        if (len < 4 || strcasecmp(e->d_name + len - 4, ".wav") != 0) continue;
+
+        char path[300];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, e->d_name);
+        bool     positive = strncmp(e->d_name, BENCH_POSITIVE_PREFIX, prefix_len) == 0;
+        uint64_t samples  = 0;
+        int      hits     = run_clip(path, audio, vad, label_index, st, &samples);
+        if (hits < 0) {
+            ESP_LOGW(TAG, "Skip %s (not PCM16 mono %d Hz WAV)", e->d_name, CAPTURE_SAMPLE_RATE);
+            continue;
+        }
+
+        st.clips++;
+        st.samples += samples;
+        bool ok;
+        if (positive) {
+            st.positives++;
+            ok = hits > 0;
+            if (!ok) st.false_rejects++;
+        } else {
+            st.negatives++;
+            st.negative_samples += samples;
+            st.false_accepts += (uint32_t)hits;
+            ok = hits == 0;
+        }
+        printf("[Bench] %-32s %6.2f s  detections=%d  %s\r\n", e->d_name,
+               (double)samples / CAPTURE_SAMPLE_RATE, hits, ok ? "OK" : (positive ? "FR" : "FA"));
+    }
+    closedir(dir);
+
+    double wall_s  = (double)(esp_timer_get_time() - t0) / 1e6;
+    double audio_s = (double)st.samples / CAPTURE_SAMPLE_RATE;
+    double neg_h   = (double)st.negative_samples / CAPTURE_SAMPLE_RATE / 3600.0;
+    uint32_t n     = st.slices ? st.slices : 1;
+
+    printf("\r\n=== Benchmark (%lu clips, %lu slices) ===\r\n",
+           (unsigned long)st.clips, (unsigned long)st.slices);
+#ifdef ESP_PLATFORM
+    /* scripts/compare_device_bench.py 以此行區分兩份報告的硬體 */
+    printf("Target     : %s @ %d MHz, PSRAM %u KB, ring %u samples\r\n", CONFIG_IDF_TARGET,
+           (int)esp_rom_get_cpu_ticks_per_us(), (unsigned)(heap_caps_get_total_size(MALLOC_CAP_SPIRAM) / 1024),
+           (unsigned)AUDIO_RING_SAMPLES);
+#else
+    printf("Target     : host, ring %u samples\r\n", (unsigned)AUDIO_RING_SAMPLES);
+#endif
+    printf("Throughput : %.1f s audio in %.1f s (%.1fx real time)\r\n",
+           audio_s, wall_s, wall_s > 0 ? audio_s / wall_s : 0.0);
+    printf("Cycles/slice: convert=%llu vad=%llu classifier=%llu post=%llu pack=%llu\r\n",
+           (unsigned long long)(st.convert_cycles / n), (unsigned long long)(st.vad_cycles / n),
+           (unsigned long long)(st.classifier_cycles / n), (unsigned long long)(st.post_cycles / n),
+           (unsigned long long)(st.pack_cycles / n));
+    printf("EI timing  : MFCC avg=%lld us, NN avg=%lld us\r\n",
+           (long long)(st.dsp_us / n), (long long)(st.nn_us / n));
+    printf("Accuracy   : false rejects %lu/%lu, false accepts %lu in %lu negatives (%.2f / hour)\r\n",
+           (unsigned long)st.false_rejects, (unsigned long)st.positives,
+           (unsigned long)st.false_accepts, (unsigned long)st.negatives,
+           neg_h > 0 ? st.false_accepts / neg_h : 0.0);
+
+    return (int)st.clips;
+}
+
+#ifdef ESP_PLATFORM
+void wake_benchmark_run(AudioCapture &audio, VAD &vad)
+{
+    esp_vfs_spiffs_conf_t conf = {};
+    conf.base_path              = BENCH_MOUNT_PATH;
+    conf.partition_label        = BENCH_PARTITION_LABEL;
+    conf.max_files              = 2;
+    conf.format_if_mount_failed = false;
+    esp_err_t err = esp_vfs_spiffs_register(&conf);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Mount %s failed: %s", BENCH_PARTITION_LABEL, esp_err_to_name(err));
+        vTaskDelete(NULL);
+    }
+
+    wake_benchmark_run_dir(audio, vad, BENCH_MOUNT_PATH);
+
+    esp_vfs_spiffs_unregister(BENCH_PARTITION_LABEL);
+    vTaskDelete(NULL);
+}
+#endif
@@ -0,0 +1,38 @@
+#ifndef WAKE_BENCHMARK_H
+#define WAKE_BENCHMARK_H
+
+/* ============================================================
+ * wake_benchmark.h - 錄音回放 benchmark（CONFIG_ESP_MIAO_BENCHMARK）
+ * ESP-MIAO v0.8.0
+ *
+ * 從 bench 分區（SPIFFS，/bench）逐一讀取 WAV（PCM16 mono，CAPTURE_SAMPLE_RATE），
+ * 經 AudioCapture::replay() 取代 I2S 寫入環形緩衝，再以與 WakeWordDetector
+ * 相同的 VAD → EI 連續推論 → 後驗平滑流程盡速處理，最後列印：
+ *   - 吞吐量（音訊秒數 / 實際耗時）
+ *   - 每切片各階段 CPU cycle（轉換 / VAD / 分類器 / 後處理 / 串流封包），MFCC / NN 耗時
+ *   - false reject（檔名以 BENCH_POSITIVE_PREFIX 開頭、卻未觸發）與
+ *     false accept（其餘檔案中的觸發次數，另換算每小時）
+ *
+ * 推論不受 VAD_GATE_INFERENCE 略過，每個切片都量到分類器成本。
+ * 處理流程與平台無關，主機建置（host/）以同一份程式對本機資料夾執行。
+ * ============================================================ */
+
+#include "audio_capture.h"
+#include "vad.h"
+
+/**
+ * 處理 dir_path 內所有 WAV 並列印結果。
+ * @return 處理的片段數，-1 = 模型缺少喚醒類別或無法開啟資料夾
+ */
+int wake_benchmark_run_dir(AudioCapture &audio, VAD &vad, const char *dir_path);
+
+#ifdef ESP_PLATFORM
+/**
+ * 掛載 bench 分區並執行整個 benchmark（不返回；結束後刪除所在 Task）。
+ * @param audio 以 init_replay() 初始化的 AudioCapture
+ * @param vad   VAD
+ */
+void wake_benchmark_run(AudioCapture &audio, VAD &vad);
+#endif
+
+#endif // WAKE_BENCHMARK_H
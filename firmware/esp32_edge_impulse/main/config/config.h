@@ -6,6 +6,8 @@
  * ESP-MIAO v0.8.0
  * ============================================================ */
 
+#include "sdkconfig.h"   // Kconfig 選項與 CONFIG_IDF_TARGET_*
+
 /* ---------- Debug 等級定義 ---------- */
 
 #define LOG_LEVEL_NONE   0
@@ -18,10 +20,244 @@
 #define CONFIG_LOG_LEVEL LOG_LEVEL_INFO
 #endif
 
+/* ---------- 雙核分工 ---------- */
+
+// CORE_AUDIO：I2S 擷取（DMA 中斷 / 擷取 Task）與推論，專心處理音訊，不與網路搶 CPU
+// CORE_NET  ：WiFi / lwIP（IDF 預設釘在 Core 0）、WebSocket、喚醒 session、串流 TX、Server 動作、UI
+//
+//   Task             核心         優先權
+//   audio_cap        CORE_AUDIO   10     （AUDIO_CAPTURE_USE_ISR=0 時）
+//   ei_infer         CORE_AUDIO    5
+//   stream_tx        CORE_NET      6
+//   spk_play         CORE_NET      6     （SPEAKER_ENABLE=1 時）
+//   wake_session     CORE_NET      5
+//   websocket_task   不綁定*       4     （esp_websocket_client 內部 Task）
+//   wake_ack / srv_action / net_boot  CORE_NET 4
+//   continuous       CORE_NET      4     （CONTINUOUS_STREAM=1 時）
+//   ws_supervisor / time_sync        CORE_NET 3
+//   display          CORE_NET      2
+//   telemetry        CORE_NET      2
+//   health           CORE_NET      1
+//   task_stats       CORE_NET      1
+//   trace            CORE_NET      1     （CONFIG_ESP_MIAO_TRACE_POINTS 時）
+//   console          CORE_NET      1     （PERF_CONSOLE=1 時）
+//   httpd            CORE_NET      1     （TELEMETRY_HTTP=1 時）
+//
+// * esp_websocket_client 不提供核心設定；優先權低於推論，推論就緒時不會被它佔住
+#define CORE_AUDIO                1
+#define CORE_NET                  0
+
+// 推論 Task：MFCC + 分類器，與擷取同核
+#define INFERENCE_TASK_STACK      16384
+#define INFERENCE_TASK_PRIO       5
+#define INFERENCE_TASK_CORE       CORE_AUDIO
+
+// esp_websocket_client 的收發 Task
+#define WS_CLIENT_TASK_STACK      4096
+#define WS_CLIENT_TASK_PRIO       4
+
+// 眼睛 UI（display Task）
+#define UI_TASK_PRIO              2
+#define UI_TASK_CORE              CORE_NET
+
+// > 0：每隔此秒數以 vTaskList / vTaskGetRunTimeStats 印出各 Task 的核心與 CPU 佔比，
+// 用來確認分工（需 sdkconfig 開啟 FreeRTOS run time stats）
+#ifndef TASK_STATS_INTERVAL_S
+#define TASK_STATS_INTERVAL_S     0
+#endif
+#define TASK_STATS_TASK_STACK     3072
+#define TASK_STATS_TASK_PRIO      1
+#define TASK_STATS_TASK_CORE      CORE_NET
+#define TASK_STATS_BUF_LEN        1536
+
+// 追蹤點送出 Task（components/trace_points）：最低優先權，不搶熱路徑的 CPU
+#define TRACE_TASK_PRIO           1
+#define TRACE_TASK_CORE           CORE_NET
+
 /* ---------- 伺服器網路配置 ---------- */
 
-#define SERVER_URL  "ws://192.168.1.16:8000/ws/esp32_01"
-#define ACK_URL     "http://192.168.1.16:8000/ack"
+// Server 端點：依優先序、逗號分隔（最多 WS_MAX_ENDPOINTS 個）；首次開機寫入 NVS "srv_urls"，
+// 之後以 NVS 為準（WebSocketClient::save_endpoints() 重新佈建）
+// e.g. "ws://192.168.1.16:8000/ws/esp32_01,ws://192.168.1.20:8000/ws/esp32_01"
+#define SERVER_URLS "ws://192.168.1.16:8000/ws/esp32_01"
+#define ACK_PATH    "/ack"   // HTTP 喚醒 ACK：送往目前使用中端點的同一 host:port
+
+// 喚醒 ACK（Server 提示音）：由 ACK Task 非同步送出，優先走 WebSocket，斷線時改用常駐 HTTP 連線
+#define WAKE_ACK_TASK_STACK       4096
+#define WAKE_ACK_TASK_PRIO        4
+#define WAKE_ACK_TASK_CORE        CORE_NET
+#define WAKE_ACK_WS_TIMEOUT_MS    200
+#define WAKE_ACK_HTTP_TIMEOUT_MS  800
+
+// 推測性鏈路預熱：VAD 連續 LINK_WARMUP_SPEECH_SLICES 個語音切片、喚醒詞尚未觸發時，
+// 先關閉 modem-sleep 並送出 link_warmup（Server 預熱 Whisper / Ollama），斷線則要求立即重連；
+// 之後 LINK_WARMUP_HOLD_MS 內沒有新的語音即回到省電。0 = 停用
+#if defined(CONFIG_ESP_MIAO_LINK_WARMUP) && !defined(LINK_WARMUP)
+#define LINK_WARMUP 1
+#endif
+#ifndef LINK_WARMUP
+#define LINK_WARMUP 0
+#endif
+#define LINK_WARMUP_SPEECH_SLICES   2
+#define LINK_WARMUP_HOLD_MS         3000
+#define LINK_WARMUP_MIN_INTERVAL_MS 5000    // link_warmup 訊息最短間隔（Server 端另有預熱間隔）
+#define LINK_WARMUP_TASK_STACK      3072
+#define LINK_WARMUP_TASK_PRIO       3
+#define LINK_WARMUP_TASK_CORE       CORE_NET
+
+// WebSocket 連線監督 Task：應用層心跳 + 指數退避重連 + 預先解析的 Server 位址，
+// 讓閒置後的喚醒不必付出重連延遲
+#define WS_SUPERVISOR_TASK_STACK  4096
+#define WS_SUPERVISOR_TASK_PRIO   3
+#define WS_SUPERVISOR_TASK_CORE   CORE_NET
+#define WS_HEARTBEAT_MS           3000    // 心跳間隔（附帶重連統計）
+#define WS_LINK_TIMEOUT_MS        10000   // 超過此時間未收到任何資料（含 pong / heartbeat_ack）即判定斷線
+#define WS_CONNECT_TIMEOUT_MS     3000    // 單次連線嘗試等待 CONNECTED 的上限
+#define WS_BACKOFF_MIN_MS         250
+#define WS_BACKOFF_MAX_MS         8000
+#define WS_RESOLVE_RETRY_FAILS    3       // 連續失敗幾次後重新解析 DNS
+#define WS_HEARTBEAT_SEND_TIMEOUT_MS 500
+#define WS_PING_INTERVAL_S        5       // WebSocket ping（esp_websocket_client 自動送出）
+
+// 自適應保活：最近 WS_ACTIVE_HOLD_MS 內有語音（VAD）或喚醒 session 時照上面的間隔；
+// 之後改為 WS_HEARTBEAT_IDLE_MS 心跳與 WS_PING_IDLE_S ping，減少深夜時無線電被喚醒的次數。
+// 回到活躍時立即送一次心跳確認鏈路。WS_IDLE_DISCONNECT_MS > 0：安靜超過此時間主動斷線，
+// 下一段語音（VAD，與 LINK_WARMUP 同一時點）或 session 才重連
+#if defined(CONFIG_ESP_MIAO_WS_ADAPTIVE_KEEPALIVE) && !defined(WS_ADAPTIVE_KEEPALIVE)
+#define WS_ADAPTIVE_KEEPALIVE 1
+#endif
+#ifndef WS_ADAPTIVE_KEEPALIVE
+#define WS_ADAPTIVE_KEEPALIVE 0
+#endif
+#define WS_ACTIVE_HOLD_MS         120000
+#define WS_HEARTBEAT_IDLE_MS      30000
+#define WS_LINK_TIMEOUT_IDLE_MS   75000   // 需涵蓋兩次閒置心跳
+#define WS_PING_IDLE_S            60
+#ifdef CONFIG_ESP_MIAO_WS_IDLE_DISCONNECT_MIN
+#define WS_IDLE_DISCONNECT_MS     (CONFIG_ESP_MIAO_WS_IDLE_DISCONNECT_MIN * 60000LL)
+#else
+#define WS_IDLE_DISCONNECT_MS     0
+#endif
+
+// 多端點選擇：以非阻塞 TCP connect 耗時估計 RTT，分數 = RTT + 優先序 × BIAS；
+// 在線時定期探測，上行閒置時才切換到明顯較快的端點
+#define WS_PROBE_TIMEOUT_MS       500
+#define WS_PROBE_INTERVAL_S       60
+#define WS_ENDPOINT_BIAS_MS       20      // 每降一級優先序的分數懲罰
+#define WS_FAILBACK_MARGIN_MS     30      // 新端點需快過目前端點此值才切換（避免來回跳動）
+#define WS_SWITCH_IDLE_MS         10000   // 最近此時間內有送出音訊則延後切換
+
+// Server 探索：第一個端點的位址改由 mDNS（_esp-miao._tcp）提供，找到後存入 NVS "srv_disc"，
+// 下次開機直接使用；只在沒有快取或連續 WS_RESOLVE_RETRY_FAILS 次連線失敗時背景重新查詢
+#if defined(CONFIG_ESP_MIAO_SERVER_DISCOVERY) && !defined(WS_DISCOVERY)
+#define WS_DISCOVERY 1
+#endif
+#ifndef WS_DISCOVERY
+#define WS_DISCOVERY 0
+#endif
+#define WS_DISCOVERY_SERVICE          "_esp-miao"
+#define WS_DISCOVERY_PROTO            "_tcp"
+#define WS_DISCOVERY_TIMEOUT_MS       1500
+#define WS_DISCOVERY_MAX_RESULTS      4
+#define WS_DISCOVERY_MIN_INTERVAL_S   30      // 連線持續失敗時的最短查詢間隔
+#define WS_DISCOVERY_TASK_STACK       3072
+#define WS_DISCOVERY_TASK_PRIO        2
+#define WS_DISCOVERY_TASK_CORE        CORE_NET
+
+// Server 下行訊息：就地 token 化（json_tok），token 表放在 WS 事件 Task 堆疊上
+#define WS_JSON_MAX_TOKENS        32
+// 握手時提供 subprotocol；Server 支援時下行控制訊息改為定長 binary frame（直接 memcpy，不解析 JSON），
+// 未協商成功時照常收 JSON
+#if defined(CONFIG_ESP_MIAO_WS_BINARY_CONTROL) && !defined(WS_BINARY_CONTROL)
+#define WS_BINARY_CONTROL 1
+#endif
+#ifndef WS_BINARY_CONTROL
+#define WS_BINARY_CONTROL 0
+#endif
+#define WS_CONTROL_SUBPROTOCOL    "esp-miao.bin1"   // 同 Server wire.py CONTROL_SUBPROTOCOL
+// wss:// 端點改用自有 TLS 傳輸（network/tls_transport）：每個端點在 RAM 保留 TLS session，
+// 重連（含喚醒時的 emergency_reconnect）以 session ticket 續用，不再做完整握手；
+// Server 憑證可釘選於 NVS "srv_cert"。0 = wss:// 使用 client 內建的 SSL 傳輸（每次完整握手）
+#if defined(CONFIG_ESP_MIAO_WS_TLS) && !defined(WS_TLS)
+#define WS_TLS 1
+#endif
+#ifndef WS_TLS
+#define WS_TLS 0
+#endif
+
+// Server 動作（action / play / time_sync）由 worker Task 處理，WS 事件 Task 只解析與排入
+#define SERVER_ACTION_QUEUE_LEN   4
+#define SERVER_ACTION_TASK_STACK  4096
+#define SERVER_ACTION_TASK_PRIO   4
+#define SERVER_ACTION_TASK_CORE   CORE_NET
+#define SERVER_ACTION_WAIT_MS     6000   // 串流結束（或最近一個 progress 事件）後等待 Server 回應動作（期間維持 UI_THINKING）
+
+// 追問視窗：Server 回覆 action 後 FOLLOWUP_WINDOW_MS 內，偵測端 VAD 連續 FOLLOWUP_SPEECH_SLICES 個語音切片
+// 即直接串流下一句（不需喚醒詞；session 未結束，鏈路仍在低延遲模式），最多連續 FOLLOWUP_MAX_TURNS 句；0 = 停用
+#ifndef FOLLOWUP_WINDOW_MS
+#define FOLLOWUP_WINDOW_MS        4000
+#endif
+#define FOLLOWUP_ARM_DELAY_MS     700    // 回應後先略過這段時間（動作提示音不算追問）
+#define FOLLOWUP_SPEECH_SLICES    2
+#define FOLLOWUP_MAX_TURNS        3
+
+// 開機：網路（WiFi → WebSocket → 時間同步）於背景 Task 啟動，推論不等待
+#define BOOT_NET_TASK_STACK       4096
+#define BOOT_NET_TASK_PRIO        4
+#define BOOT_NET_TASK_CORE        CORE_NET
+
+/* ---------- 低功耗聆聽 ---------- */
+
+// UI 為 UI_SLEEPING、VAD 連續 LOW_POWER_ENTER_MS 無語音且不在 session 中時：I2S 降為 LOW_POWER_SAMPLE_RATE
+// 單聲道（左 slot），FFT VAD / 模型停止，只以 EnergyDetector 逐幀檢查；環形緩衝仍經重取樣維持 SAMPLE_RATE，
+// pre-roll 不中斷。任一幀超過門檻即在該切片恢復全速擷取，並從最近一個模型視窗重新處理。0 = 停用
+#if defined(CONFIG_ESP_MIAO_LOW_POWER_LISTEN) && !defined(LOW_POWER_LISTEN)
+#define LOW_POWER_LISTEN 1
+#endif
+#ifndef LOW_POWER_LISTEN
+#define LOW_POWER_LISTEN 0
+#endif
+#define LOW_POWER_SAMPLE_RATE     8000
+#define LOW_POWER_ENTER_MS        10000
+#define LOW_POWER_FRAME_SAMPLES   512       // 能量偵測幀長（SAMPLE_RATE 樣本，32 ms）
+#define LOW_POWER_WAKE_RATIO      3.0f      // 幀 RMS 超過噪音底此倍數即觸發
+#define LOW_POWER_MIN_RMS         150.0f    // 觸發門檻下限（int16 RMS）
+#define LOW_POWER_NOISE_FALL      0.5f      // 噪音底平滑：較安靜的幀快速下探
+#define LOW_POWER_NOISE_RISE      0.02f     //             較吵的幀（未觸發）緩慢上升
+
+/* ---------- 動態調頻（esp_pm） ---------- */
+
+// sdkconfig CONFIG_PM_ENABLE 時生效（power_state 元件）：推論 / 喚醒 session / 顯示 DMA 期間 CPU 全速，
+// VAD 安靜超過 PM_SPEECH_HOLD_MS 且 UI 進入 UI_SLEEPING 後降到 PM_CPU_FREQ_MIN_MHZ 並允許自動 light sleep。
+// I2S 擷取期間驅動自行持有 APB 鎖：安靜時段實際停在 80 MHz，light sleep 只在擷取停止時發生。
+#ifdef CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#define PM_CPU_FREQ_MAX_MHZ       CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#else
+#define PM_CPU_FREQ_MAX_MHZ       240
+#endif
+#define PM_CPU_FREQ_MIN_MHZ       80
+#define PM_LIGHT_SLEEP            1       // 另需 CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#define PM_SPEECH_HOLD_MS         2000    // 最後一個語音切片後維持喚醒的時間
+
+/* ---------- 時間同步 ---------- */
+
+// 主要時間來源：經 WebSocket 的 NTP 式往返同步（t0/t1/t2/t3，取 RTT 最小樣本）
+#define TIME_SYNC_INTERVAL_S        300
+#define TIME_SYNC_RETRY_MS          2000
+#define TIME_SYNC_BURST             4
+#define TIME_SYNC_BURST_GAP_MS      50
+#define TIME_SYNC_REPLY_TIMEOUT_MS  500
+#define TIME_SYNC_TASK_STACK        3072
+#define TIME_SYNC_TASK_PRIO         3
+#define TIME_SYNC_TASK_CORE         CORE_NET
+#define TIME_DRIFT_MIN_SPAN_S       60     // 兩次同步間隔達此秒數才更新漂移估計
+#define TIME_DRIFT_MAX_PPM          200.0f
+
+// SNTP（選用）；TIME_SNTP_WAIT_S = 0 時不阻塞開機
+#ifndef TIME_SNTP_ENABLE
+#define TIME_SNTP_ENABLE            0
+#endif
+#define TIME_SNTP_WAIT_S            0
 
 /* ---------- 時區 ---------- */
 
@@ -29,21 +265,164 @@
 
 /* ---------- GPIO 腳位定義 ---------- */
 
+// ESP32 DevKit V1 為預設；ESP32-S3（sdkconfig.defaults.esp32s3）的 GPIO26~32 接 flash，
+// 八線 PSRAM 另佔 GPIO33~37，麥克風 / 喇叭改接下方腳位（TFT 腳位見 sdkconfig.defaults.esp32s3）
 #define LED_PIN         GPIO_NUM_2
 
+// LED 由 LEDC 驅動（HardwareController 樣式引擎，非阻塞）
+#define LED_LEDC_TIMER        LEDC_TIMER_0
+#define LED_LEDC_CHANNEL      LEDC_CHANNEL_0
+#define LED_LEDC_RESOLUTION   LEDC_TIMER_10_BIT
+#define LED_LEDC_FREQ_HZ      5000
+#define LED_MAX_DUTY          1023      // (1 << 10) - 1
+#define LED_BLINK_TIMES       3         // 喚醒 / 聆聽提示
+#define LED_BLINK_ON_MS       100
+#define LED_BLINK_OFF_MS      100
+#define LED_BREATHE_MS        600       // 思考中呼吸：漸亮 / 漸暗各一段
+#define LED_ERROR_REPEAT      3         // 錯誤雙閃次數
+
+// 本機繼電器（HardwareController）：target:GPIO，逗號分隔，! = 低電位動作（例如 "light:26,fan:!27"）。
+// NVS "hw"/"relays" 字串存在時取代此預設；target 名稱同 Server COMMAND_MAP
+#ifdef CONFIG_ESP_MIAO_LOCAL_RELAYS
+#define LOCAL_RELAY_TABLE     CONFIG_ESP_MIAO_LOCAL_RELAYS
+#else
+#define LOCAL_RELAY_TABLE     ""
+#endif
+#define LOCAL_RELAY_MAX       4
+
+#if CONFIG_IDF_TARGET_ESP32S3
+#define I2S_BCK_GPIO    GPIO_NUM_5
+#define I2S_WS_GPIO     GPIO_NUM_6
+#define I2S_DIN_GPIO    GPIO_NUM_7
+#else
 #define I2S_BCK_GPIO    GPIO_NUM_32
 #define I2S_WS_GPIO     GPIO_NUM_25
 #define I2S_DIN_GPIO    GPIO_NUM_33
+#endif
 
-// ST7735 TFT Display Power (GPIO4)
-#define DISPLAY_EN_PIN  4
+// ST7735 電源（GPIO4）由 eye_ui 元件管理
 
 /* ---------- I2S 音訊配置 ---------- */
 
-#define SAMPLE_RATE     16000
+#define SAMPLE_RATE     16000     // 管線速率：EI 模型 / VAD / 串流（須等於 EI_CLASSIFIER_FREQUENCY）
+
+// I2S 硬體取樣率（例如 8000 低功耗待機、48000 部分麥克風表現較佳），
+// 與 SAMPLE_RATE 不同時由 PolyphaseResampler 轉換後才寫入環形緩衝
+#ifndef CAPTURE_SAMPLE_RATE
+#define CAPTURE_SAMPLE_RATE SAMPLE_RATE
+#endif
 #define I2S_PORT_NUM    I2S_NUM_0
 #define DMA_BUF_COUNT   8
-#define DMA_BUF_LEN     256
+#define DMA_BUF_LEN     256       // 每個 DMA 描述子的 frame 數
+
+// 雙麥克風 beamforming：第二顆 INMP441 的 L/R 腳接 VDD（右 slot），與左麥克風共用 BCK / WS / DIN；
+// 兩聲道延遲相加後的 mono 訊號供 VAD / 模型 / 串流使用
+#if defined(CONFIG_ESP_MIAO_BEAMFORM) && !defined(AUDIO_BEAMFORM)
+#define AUDIO_BEAMFORM 1
+#endif
+#ifndef AUDIO_BEAMFORM
+#define AUDIO_BEAMFORM 0
+#endif
+#ifdef CONFIG_ESP_MIAO_MIC_SPACING_MM
+#define BEAMFORM_MIC_SPACING_MM CONFIG_ESP_MIAO_MIC_SPACING_MM
+#else
+#define BEAMFORM_MIC_SPACING_MM 60        // 兩顆麥克風音孔中心距離
+#endif
+// 最大延遲 = 間距 / 聲速（343 m/s）× 擷取取樣率，無條件進位
+#define BEAMFORM_MAX_DELAY      ((BEAMFORM_MIC_SPACING_MM * CAPTURE_SAMPLE_RATE + 342999) / 343000)
+#define BEAMFORM_SMOOTH_SHIFT   3         // 互相關 EMA：每區塊 1/8（約 130 ms @16kHz）
+#define BEAMFORM_SWITCH_SHIFT   3         // 新方向需高出目前方向 1/8 才轉向
+
+// 1 = 硬體僅接收左 slot（Mono，DMA 頻寬與緩衝減半）
+// 0 = Stereo 讀取 + 軟體取左聲道（L/R 腳位接法特殊的板子使用），beamforming 時固定為 0
+#ifndef AUDIO_I2S_MONO_SLOT
+#define AUDIO_I2S_MONO_SLOT (AUDIO_BEAMFORM ? 0 : 1)
+#endif
+#define AUDIO_I2S_SLOTS         (AUDIO_I2S_MONO_SLOT ? 1 : 2)
+#define I2S_DMA_DESC_BYTES      (DMA_BUF_LEN * AUDIO_I2S_SLOTS * 4)  // 32-bit slot
+#define I2S_DMA_TOTAL_BYTES     (DMA_BUF_COUNT * I2S_DMA_DESC_BYTES)
+
+/* ---------- 喇叭（下行音訊） ---------- */
+
+// I2S TX 接 MAX98357A 等 I2S 功放：Server 把提示音以 WebSocket binary frame（audio_player.h）串流到
+// 裝置本身播放，喚醒提示音（chirp）於本機合成、不經網路。
+// 0 = 停用（提示音照舊由 Server 端喇叭播放）
+#if defined(CONFIG_ESP_MIAO_SPEAKER) && !defined(SPEAKER_ENABLE)
+#define SPEAKER_ENABLE 1
+#endif
+#ifndef SPEAKER_ENABLE
+#define SPEAKER_ENABLE 0
+#endif
+#define SPK_I2S_PORT_NUM        I2S_NUM_1
+#if CONFIG_IDF_TARGET_ESP32S3
+#define SPK_I2S_BCK_GPIO        GPIO_NUM_15
+#define SPK_I2S_WS_GPIO         GPIO_NUM_16
+#define SPK_I2S_DOUT_GPIO       GPIO_NUM_17
+#else
+#define SPK_I2S_BCK_GPIO        GPIO_NUM_26
+#define SPK_I2S_WS_GPIO         GPIO_NUM_27
+#define SPK_I2S_DOUT_GPIO       GPIO_NUM_22
+#endif
+#define SPK_SAMPLE_RATE         16000
+#define SPK_DOWNLINK_FORMAT     "adpcm_16k_4bit"   // wake_detected 的 playback_format（Server 依此編碼）
+#define SPK_DMA_BUF_COUNT       4
+#define SPK_DMA_BUF_LEN         256       // frame 數；閒置時 DMA 自動輸出靜音（auto_clear）
+#define SPK_FRAME_MAX_SAMPLES   640       // 單一下行 frame 上限（Server DOWNLINK_FRAME_MS = 20 ms 為 320）
+#define SPK_JITTER_MS           400       // jitter buffer 容量，須大於 Server DOWNLINK_LEAD_MS
+#define SPK_PREBUFFER_MS        60        // 串流累積此長度才開始播放（END frame 或 chirp 不等待）
+#define SPK_VOLUME_SHIFT        1         // 輸出衰減（右移位數，0 = 原音量）
+#define SPK_CHIRP_MS            90        // 喚醒提示音：SPK_CHIRP_F0_HZ → F1 上升掃頻，升餘弦包絡
+#define SPK_CHIRP_F0_HZ         1200
+#define SPK_CHIRP_F1_HZ         2400
+#define SPK_CHIRP_LEVEL         8000
+#define SPK_PLAYER_TASK_STACK   3072
+#define SPK_PLAYER_TASK_PRIO    6
+#define SPK_PLAYER_TASK_CORE    CORE_NET
+
+/* ---------- 擷取前處理（定點濾波，於轉換時逐樣本執行） ---------- */
+
+// DC blocker 極點（0 = 停用）；INMP441 有直流偏移，會墊高 RMS 與 VAD 能量
+#ifndef AUDIO_DC_BLOCK_POLE
+#define AUDIO_DC_BLOCK_POLE   0.995f
+#endif
+// Pre-emphasis 係數（0 = 停用）；EI MFCC 已內建 pre-emphasis，預設關閉避免重複
+#ifndef AUDIO_PRE_EMPHASIS
+#define AUDIO_PRE_EMPHASIS    0.0f
+#endif
+
+// AGC（定點，於擷取端套用，VAD / 模型 / 串流共用同一增益）
+#ifndef AUDIO_AGC_ENABLE
+#define AUDIO_AGC_ENABLE      1
+#endif
+#define AGC_TARGET_LEVEL      8000      // 目標峰值包絡（約 -12 dBFS）
+#define AGC_MAX_GAIN          8.0f      // 最大增益（上限 16）
+#define AGC_NOISE_GATE        300       // 包絡低於此值不再提高增益
+#define AGC_ATTACK_MS         5.0f
+#define AGC_RELEASE_MS        500.0f
+
+/* ---------- 擷取 Task / 環形緩衝 ---------- */
+
+// 必須為 2 的次方，需涵蓋 pre-roll + ACK 延遲。有 PSRAM（ESP32-S3 profile）時環形緩衝放在 PSRAM，
+// 加倍為約 4.1 秒：連線等待（WAKE_LINK_WAIT_MS）與回放 / 錄音可回溯的範圍都跟著加長
+#ifndef AUDIO_RING_SAMPLES
+#if CONFIG_SPIRAM
+#define AUDIO_RING_SAMPLES         65536
+#else
+#define AUDIO_RING_SAMPLES         32768     // 約 2.05 秒 @16kHz
+#endif
+#endif
+#define AUDIO_STAMP_SLOTS          (AUDIO_RING_SAMPLES / 128)   // 區塊時間戳環（DMA_BUF_LEN 區塊數的 2 倍）
+#define AUDIO_CAPTURE_BLOCK_FRAMES DMA_BUF_LEN
+#define AUDIO_READ_TIMEOUT_MS      1000
+#define AUDIO_CAPTURE_TASK_STACK   4096
+#define AUDIO_CAPTURE_TASK_PRIO    10        // 高於推論 Task，確保 DMA 及時被清空
+#define AUDIO_CAPTURE_TASK_CORE    CORE_AUDIO
+
+// 1 = I2S on_recv DMA 回調直接寫入環形緩衝（不需擷取 Task）
+// 0 = 擷取 Task 以阻塞式 i2s_channel_read 讀取
+#ifndef AUDIO_CAPTURE_USE_ISR
+#define AUDIO_CAPTURE_USE_ISR      1
+#endif
 
 /* ---------- 錄音配置 ---------- */
 
@@ -52,15 +431,292 @@
 // 2KB chunk: 1024 samples x 2 bytes
 #define STREAM_CHUNK_SAMPLES 1024
 
+// Pre-roll：喚醒確認前保留於環形緩衝、串流時優先送出的音訊長度
+// CONFIG_ESP_MIAO_WAKE_VERIFY_WINDOW：涵蓋整個喚醒詞視窗（模型輸入 1 s），Server 收齊即做第二階段驗證
+#if defined(CONFIG_ESP_MIAO_WAKE_VERIFY_WINDOW) && !defined(STREAM_PREROLL_MS)
+#define STREAM_PREROLL_MS    1000
+#endif
+#ifndef STREAM_PREROLL_MS
+#define STREAM_PREROLL_MS    500
+#endif
+#define STREAM_PREROLL_SAMPLES (SAMPLE_RATE * STREAM_PREROLL_MS / 1000)
+
+// 端點偵測：喚醒後以 VAD 判斷語音結束，尾端靜音達 STREAM_END_SILENCE_MS 即提前結束並送出 audio_end；
+// 串流長度限制在 [STREAM_MIN_MS, STREAM_MAX_MS]（不含 pre-roll）。0 = 固定送 RECORD_DURATION_SEC
+#ifndef STREAM_ENDPOINTING
+#define STREAM_ENDPOINTING    1
+#endif
+#define STREAM_MIN_MS         600
+#define STREAM_MAX_MS         5000
+#define STREAM_END_SILENCE_MS 700
+#if STREAM_ENDPOINTING
+#define STREAM_COMMAND_SAMPLES (SAMPLE_RATE * STREAM_MAX_MS / 1000)
+#else
+#define STREAM_COMMAND_SAMPLES AUDIO_SAMPLES_3S
+#endif
+
+// 1 = 每個 binary frame 前加上 StreamChunkHeader（序號 + 擷取時間戳 + session / 樣本偏移）
+#ifndef STREAM_CHUNK_HEADER
+#define STREAM_CHUNK_HEADER  1
+#endif
+
+// 斷線續傳：串流中送出失敗時緊急重連並送 audio_resume，Server 回報已收樣本數後
+// 由環形緩衝自該位置重送（已被覆寫的部分 Server 以靜音填補）；需 STREAM_CHUNK_HEADER
+#ifndef STREAM_RESUME
+#define STREAM_RESUME        STREAM_CHUNK_HEADER
+#endif
+#define STREAM_RESUME_ATTEMPTS     2
+#define STREAM_RESUME_RECONNECT_MS 2000
+#define STREAM_RESUME_ACK_MS       1000
+#if STREAM_RESUME && !STREAM_CHUNK_HEADER
+#error "STREAM_RESUME requires STREAM_CHUNK_HEADER"
+#endif
+
+// 串流期間串流游標改為 READER_HOLD：網路停頓時擷取端不覆寫尚未送出的音訊（續傳一定補得回），
+// 改為捨棄新樣本；同時間推論游標也跟著少了這段即時音訊。預設關閉（即時性優先）
+#if defined(CONFIG_ESP_MIAO_STREAM_HOLD) && !defined(STREAM_READER_HOLD)
+#define STREAM_READER_HOLD 1
+#endif
+#ifndef STREAM_READER_HOLD
+#define STREAM_READER_HOLD 0
+#endif
+
+// UDP 音訊上行：audio_start / audio_end 仍走 WebSocket，音訊 frame 改以 datagram 送到
+// Server 的 STREAM_UDP_PORT，避免 TCP 重傳造成整段串流停頓；遺失的 frame 不重送，
+// 由 Server 的 jitter buffer 重排並補償。需 STREAM_CHUNK_HEADER（序號 / sample_offset）
+#if defined(CONFIG_ESP_MIAO_STREAM_UDP) && !defined(STREAM_UDP)
+#define STREAM_UDP 1
+#endif
+#ifndef STREAM_UDP
+#define STREAM_UDP 0
+#endif
+#ifdef CONFIG_ESP_MIAO_STREAM_UDP_PORT
+#define STREAM_UDP_PORT       CONFIG_ESP_MIAO_STREAM_UDP_PORT
+#else
+#define STREAM_UDP_PORT       8001
+#endif
+#define STREAM_UDP_MAX_DATAGRAM 1400     // 不超過 MTU，避免 IP 分段（一段遺失即整個 frame 遺失）
+#define STREAM_UDP_SEND_RETRIES 3        // WiFi TX 緩衝已滿時的重試次數（每次 2 ms）
+#define STREAM_UDP_TOS          0xB8     // DSCP EF → WMM AC_VO
+#if STREAM_UDP && !STREAM_CHUNK_HEADER
+#error "STREAM_UDP requires STREAM_CHUNK_HEADER"
+#endif
+
+// 連續串流（Server 端喚醒）：Server 以 continuous 訊息逐裝置開啟後，VAD 判為語音的切片
+// （含前 PREROLL / 後 HANGOVER 個切片）以 ADPCM 持續經 UDP 送到 Server，由 Server 的
+// ASR + 喚醒片語判斷喚醒；本地喚醒詞改為送出 wake_hint（confirm 模式下 Server 以此確認）。
+// 頻寬以 token bucket 限制（平均 max_kbps、可累積 BURST_S 秒），超出時丟棄語音 frame。0 = 停用
+#if defined(CONFIG_ESP_MIAO_CONTINUOUS_STREAM) && !defined(CONTINUOUS_STREAM)
+#define CONTINUOUS_STREAM 1
+#endif
+#ifndef CONTINUOUS_STREAM
+#define CONTINUOUS_STREAM 0
+#endif
+#define CONTINUOUS_PREROLL_SLICES   1       // 語音開始前補送的切片（喚醒詞開頭常低於 VAD 門檻）
+#define CONTINUOUS_HANGOVER_SLICES  2       // 語音結束後續送的切片（字間停頓不切斷）
+#define CONTINUOUS_FRAME_SAMPLES    640     // 40 ms / datagram（ADPCM 324 bytes + header）
+#define CONTINUOUS_BURST_S          20      // token bucket 容量（秒，以 max_kbps 計）
+#define CONTINUOUS_QUEUE_LEN        8       // 推論 Task → 串流 Task 的切片通道（SPSC）
+#define CONTINUOUS_STATS_INTERVAL_S 60
+#define CONTINUOUS_TASK_STACK       4096
+#define CONTINUOUS_TASK_PRIO        4
+#define CONTINUOUS_TASK_CORE        CORE_NET
+#if CONTINUOUS_STREAM && !STREAM_CHUNK_HEADER
+#error "CONTINUOUS_STREAM requires STREAM_CHUNK_HEADER"
+#endif
+
+// 自適應 chunk：串流開始時依 RSSI 選擇起始大小，其後每 STREAM_ADAPT_FRAMES 個 frame
+// 比較送出耗時與音訊時長：慢於 SLOW_PCT 加倍（減少每 frame 開銷），快於 FAST_PCT 減半（降低延遲）。
+// 0 = 固定 STREAM_CHUNK_SAMPLES
+#ifndef STREAM_ADAPTIVE_CHUNK
+#define STREAM_ADAPTIVE_CHUNK    1
+#endif
+#define STREAM_CHUNK_MIN_SAMPLES 256       // 16 ms
+#define STREAM_CHUNK_MAX_SAMPLES 2048      // 128 ms
+#define STREAM_RSSI_GOOD         (-60)     // dBm，以上從 MIN × 2 起步
+#define STREAM_RSSI_POOR         (-72)     // dBm，以下從 MAX 起步
+#define STREAM_SEND_SLOW_PCT     50
+#define STREAM_SEND_FAST_PCT     10
+#define STREAM_ADAPT_FRAMES      4
+#if STREAM_ADAPTIVE_CHUNK
+#define STREAM_SLOT_SAMPLES      STREAM_CHUNK_MAX_SAMPLES
+#else
+#define STREAM_SLOT_SAMPLES      STREAM_CHUNK_SAMPLES
+#endif
+
+// 上行節奏：依每個 frame 的送出耗時（lwIP 送出緩衝滿時才阻塞）估計排隊延遲，
+// 超過 STREAM_PACE_QUEUE_MS 時在途 frame 上限減半，正常時逐一加回（logic/stream_pacer.h）
+#if defined(CONFIG_ESP_MIAO_STREAM_PACING) && !defined(STREAM_PACING)
+#define STREAM_PACING 1
+#endif
+#ifndef STREAM_PACING
+#define STREAM_PACING 0
+#endif
+#if defined(CONFIG_ESP_MIAO_STREAM_PACE_QUEUE_MS) && !defined(STREAM_PACE_QUEUE_MS)
+#define STREAM_PACE_QUEUE_MS CONFIG_ESP_MIAO_STREAM_PACE_QUEUE_MS
+#endif
+#ifndef STREAM_PACE_QUEUE_MS
+#define STREAM_PACE_QUEUE_MS 30
+#endif
+
+// 多緩衝上行：session Task 讀取 / 編碼一個 frame 時，TX Task 送出另一個；
+// 所有 frame 皆在途時填入端等待（背壓），取代固定的每 chunk 延遲。
+// STREAM_PACING 多一個緩衝，由節奏控制決定實際使用幾個
+#if STREAM_PACING
+#define STREAM_TX_BUFFERS      3
+#else
+#define STREAM_TX_BUFFERS      2
+#endif
+#define STREAM_TX_TASK_STACK   4096
+#define STREAM_TX_TASK_PRIO    6         // 高於 session Task，frame 一就緒即送出
+#define STREAM_TX_TASK_CORE    CORE_NET
+#define STREAM_SEND_TIMEOUT_MS 1000      // 單一 frame 送出逾時（取代 portMAX_DELAY）
+
+// 上行編碼：PCM = 原始 16-bit；ADPCM = IMA-ADPCM 4-bit（頻寬 1/4，每 chunk 可獨立解碼）
+#define STREAM_CODEC_PCM     0
+#define STREAM_CODEC_ADPCM   1
+#ifndef STREAM_CODEC
+#define STREAM_CODEC         STREAM_CODEC_ADPCM
+#endif
+
+// 弱訊號節點的半速率上行：串流開始時 RSSI 低於 STREAM_LOW_RATE_RSSI 則低通後 2:1 抽點
+// （16 kHz → 8 kHz）再編碼，audio_start 宣告降低後的取樣率；Server 轉回 16 kHz 再做 ASR
+#if defined(CONFIG_ESP_MIAO_STREAM_LOW_RATE) && !defined(STREAM_LOW_RATE)
+#define STREAM_LOW_RATE 1
+#endif
+#ifndef STREAM_LOW_RATE
+#define STREAM_LOW_RATE 0
+#endif
+#if defined(CONFIG_ESP_MIAO_STREAM_LOW_RATE_RSSI) && !defined(STREAM_LOW_RATE_RSSI)
+#define STREAM_LOW_RATE_RSSI CONFIG_ESP_MIAO_STREAM_LOW_RATE_RSSI
+#endif
+#ifndef STREAM_LOW_RATE_RSSI
+#define STREAM_LOW_RATE_RSSI (-75)       // dBm
+#endif
+
+// 串流降噪：擷取環形緩衝 → AudioStreamer 之間以 STFT 頻譜減法壓低風扇 / 吸塵器等穩態噪音，
+// 降低 Server 端 Whisper no_speech / 幻覺過濾的觸發；分析幀同時供端點偵測 VAD 使用（不重算 FFT）。
+// 輸出延遲 FFT_SIZE 個樣本。0 = 直通
+#if defined(CONFIG_ESP_MIAO_NOISE_SUPPRESS) && !defined(STREAM_NOISE_SUPPRESS)
+#define STREAM_NOISE_SUPPRESS 1
+#endif
+#ifndef STREAM_NOISE_SUPPRESS
+#define STREAM_NOISE_SUPPRESS 0
+#endif
+#define NS_OVERSUBTRACT       2.0f      // 噪音功率過減係數（越大越乾淨、失真越多）
+#define NS_GAIN_FLOOR         0.1f      // 最低振幅增益（-20 dB，保留一點底噪避免 musical noise）
+#define NS_GAIN_RELEASE       0.6f      // 增益下降平滑（每幀 16 ms；上升不平滑）
+#define NS_NOISE_ALPHA        0.05f     // 噪音頻譜 EMA 係數（非語音幀）
+#define NS_NOISE_INIT_FRAMES  8         // 前幾個噪音幀以平均值快速收斂
+
 /* ---------- VAD (FFT) 參數 ---------- */
 
+// VAD 引擎：FFT = 512 點頻譜頻帶能量；BIQUAD = 帶通 biquad 串接逐樣本累計能量
+// （每樣本約 10 次乘加，可逐區塊處理整個切片；輸出已換算成與 FFT 相同尺度，共用閾值）；
+// Q15 = FFT 引擎的定點版本（ESP32 FPU 無 SIMD、浮點除法 / 開方慢），同尺度、同閾值
+#define VAD_ENGINE_FFT        0
+#define VAD_ENGINE_BIQUAD     1
+#define VAD_ENGINE_Q15        2
+#if defined(CONFIG_ESP_MIAO_VAD_Q15) && !defined(VAD_ENGINE)
+#define VAD_ENGINE            VAD_ENGINE_Q15
+#endif
+#ifndef VAD_ENGINE
+#define VAD_ENGINE            VAD_ENGINE_FFT
+#endif
+
+// FFT 引擎的 N/2 點複數 FFT 核心：ESP_DSP = esp-dsp dsps_fft2r（ESP32 / S3 有組語版本）；
+// RADIX4 = 基 4 + 編譯期位元反轉表 + 依序排列的旋轉因子（audio/fft_radix4.h），
+// 無 esp-dsp 組語的目標較快。VAD_FFT_BENCHMARK=1 開機時兩者與原本的基 2 並列比較
+#define VAD_FFT_KERNEL_ESP_DSP 0
+#define VAD_FFT_KERNEL_RADIX4  1
+#if defined(CONFIG_ESP_MIAO_VAD_FFT_RADIX4) && !defined(VAD_FFT_KERNEL)
+#define VAD_FFT_KERNEL        VAD_FFT_KERNEL_RADIX4
+#endif
+#ifndef VAD_FFT_KERNEL
+#define VAD_FFT_KERNEL        VAD_FFT_KERNEL_ESP_DSP
+#endif
+
 #define FFT_SIZE              512
 #define FFT_FREQ_MIN          300       // 人聲最低頻率 (Hz)
 #define FFT_FREQ_MAX          3400      // 人聲最高頻率 (Hz)
 #define FFT_ENERGY_THRESHOLD  25000.0f  // 閾值 (根據 2026-03-03 測試建議)
-#define FFT_GAIN              1.0f      // 增益因子
+#define FFT_GAIN              1.0f      // 增益因子（未使用；輸入增益由 AGC 控制）
+
+// 分幀：每 VAD_FRAME_HOP 個樣本一幀（< FFT_SIZE 即重疊），最後一幀對齊切片尾端
+#ifndef VAD_FRAME_HOP
+#define VAD_FRAME_HOP         FFT_SIZE
+#endif
+#define VAD_MIN_SPEECH_FRAMES 1         // 切片內至少幾幀超過閾值才判定為語音
+
+// 自適應閾值：追蹤各切片最小幀能量（minimum statistics）作為噪音底，
+// 閾值 = max(VAD_THRESHOLD_MIN, 噪音底 × SNR)；0 = 固定使用 FFT_ENERGY_THRESHOLD
+#ifndef VAD_ADAPTIVE_THRESHOLD
+#define VAD_ADAPTIVE_THRESHOLD 1
+#endif
+#define VAD_SNR_DB            6.0f      // 語音需高於噪音底的幅度比 (dB)
+#define VAD_THRESHOLD_MIN     4000.0f   // 安靜房間的閾值下限，避免微噪觸發
+#define VAD_NOISE_RISE        0.01f     // 噪音底上升係數（每切片，慢：約 25 秒）
+#define VAD_NOISE_FALL        0.2f      // 噪音底下降係數（每切片，快）
+
+// 省電：VAD 連續 VAD_GATE_SILENT_SLICES 個切片無語音後暫停 EI 推論（MFCC + NN），
+// 第一個語音切片時由環形緩衝回放前 (SLICES_PER_MODEL_WINDOW - 1) 個切片重建特徵視窗
+#ifndef VAD_GATE_INFERENCE
+#define VAD_GATE_INFERENCE    1
+#endif
+#define VAD_GATE_SILENT_SLICES 8        // 約 2 秒（250 ms / slice）
+
+// 共用頻譜前端：以模型的 MFCC 分幀每幀只做一次 FFT，同時產生 MFCC 特徵與 VAD 頻帶能量
+// （偵測端 VAD 不再自己做 FFT）。開機時對一個視窗比對 SDK extract_mfcc_features，
+// 正規化後最大誤差超過 SHARED_SPECTRUM_TOLERANCE 則維持原路徑
+#ifndef SHARED_SPECTRUM
+#define SHARED_SPECTRUM       1
+#endif
+#define SHARED_SPECTRUM_TOLERANCE 0.02f
+
+// 共用頻譜前端的定點引擎：Q15 FFT（區塊浮點）/ mel 權重 / log2 查表 / DCT，開機比對未過則退回 float 引擎。
+// int8 量化的 EON 模型另把正規化結果直接量化寫入輸入張量，略過 SDK 的 float 特徵矩陣與量化
+#if defined(CONFIG_ESP_MIAO_MFCC_Q15) && !defined(SHARED_SPECTRUM_Q15)
+#define SHARED_SPECTRUM_Q15   1
+#endif
+#ifndef SHARED_SPECTRUM_Q15
+#define SHARED_SPECTRUM_Q15   0
+#endif
+
+// EI SDK 專用配置區：ei_malloc / ei_calloc / ei_free 改由固定大小的堆疊式配置區供應
+// （MFCC 分幀 / 功率頻譜 / mel 濾波器組 / 特徵矩陣），不與 WebSocket / cJSON 共用 heap。
+// 大小依模型切片估算；放不下（退回模式的整窗推論）時改用 heap 並計入統計
+#if defined(CONFIG_ESP_MIAO_EI_ARENA) && !defined(EI_ARENA)
+#define EI_ARENA 1
+#endif
+#ifndef EI_ARENA
+#define EI_ARENA 0
+#endif
+#define EI_ARENA_STRIDE       (SAMPLE_RATE / 50)   // MFCC 幀距 20 ms（model_variables frame_stride）
+#define EI_ARENA_FILTERS      32                   // mel 濾波器數（model_variables num_filters）
+#ifndef EI_ARENA_BYTES
+#define EI_ARENA_BYTES                                                                        \
+    (sizeof(float) * ((EI_CLASSIFIER_SLICE_SIZE / EI_ARENA_STRIDE + 2) * (FFT_SIZE + FFT_SIZE / 2 + 1) \
+                      + EI_ARENA_FILTERS * (FFT_SIZE / 2 + 1)                                 \
+                      + 2 * EI_CLASSIFIER_NN_INPUT_FRAME_SIZE)                                \
+     + 4096)                                                                                  // 區塊標頭與 SDK 小型暫存
+#endif
+
+// 兩階段喚醒（需 VAD_GATE_INFERENCE，共用回放）：第一階段以 VAD 語音幀比例常駐判斷，
+// 觸發後才開啟第二階段 EI 推論；取代上面「連續安靜 N 切片才暫停」的判定
+#ifndef WAKE_CASCADE
+#define WAKE_CASCADE          1
+#endif
+#define WAKE_STAGE1_WINDOW_SLICES 4     // 第一階段視窗（約 1 秒，同模型視窗）
+#define WAKE_STAGE1_THRESHOLD 0.35f     // 視窗內語音幀比例門檻（喚醒詞約需 0.35 秒有聲）
+#define WAKE_STAGE2_HOLD_SLICES 6       // 最後一次觸發後第二階段保持開啟（約 1.5 秒）
+#if WAKE_CASCADE && !VAD_GATE_INFERENCE
+#error "WAKE_CASCADE requires VAD_GATE_INFERENCE (model window replay)"
+#endif
 
 #define VAD_FFT_DEBUG         0         // 1=開啟 VAD 統計 Debug 日誌
+#ifndef VAD_FFT_BENCHMARK
+#define VAD_FFT_BENCHMARK     0         // 1=開機時比較基 2 / 基 4 / esp-dsp FFT 的 cycle 數
+#endif
 
 #define PRINT_STATS_INTERVAL  30        // 每多少幀打印一次統計
 
@@ -68,6 +724,312 @@
 
 #define USE_BINARY_STREAM     1         // 固定使用 Binary 串流模式
 
+// 喚醒串流 session Task（提示音 / LED / 串流），與 WiFi / lwIP 同核，不佔用推論核心
+#define WAKE_SESSION_TASK_STACK  6144
+#define WAKE_SESSION_TASK_PRIO   5
+#define WAKE_SESSION_TASK_CORE   CORE_NET
+
+// 喚醒時尚未連線（開機中 / 重連中）：指令音訊留在環形緩衝等待連線，
+// 上限為 pre-roll 起點被覆寫前的時間
+#define WAKE_LINK_WAIT_MS \
+    ((int)((AUDIO_RING_SAMPLES - STREAM_PREROLL_SAMPLES) * 1000LL / SAMPLE_RATE))
+
+// 信心值平滑 / 遲滯 / 不應期（Kconfig 可調，未設定時使用下列預設）
+#ifdef CONFIG_ESP_MIAO_WAKE_SMOOTH_SLICES
+#define WAKE_SMOOTH_SLICES    CONFIG_ESP_MIAO_WAKE_SMOOTH_SLICES
+#else
+#define WAKE_SMOOTH_SLICES    2
+#endif
+#ifdef CONFIG_ESP_MIAO_WAKE_SMOOTH_MAX
+#define WAKE_SMOOTH_MAX       1
+#else
+#define WAKE_SMOOTH_MAX       0         // 0 = 移動平均，1 = 取 N 次最大值
+#endif
+#ifdef CONFIG_ESP_MIAO_WAKE_ON_PCT
+#define WAKE_ON_THRESHOLD     (CONFIG_ESP_MIAO_WAKE_ON_PCT / 100.0f)
+#else
+#define WAKE_ON_THRESHOLD     ((float)EI_CLASSIFIER_THRESHOLD)
+#endif
+#ifdef CONFIG_ESP_MIAO_WAKE_OFF_PCT
+#define WAKE_OFF_THRESHOLD    (CONFIG_ESP_MIAO_WAKE_OFF_PCT / 100.0f)
+#else
+#define WAKE_OFF_THRESHOLD    0.5f
+#endif
+#ifdef CONFIG_ESP_MIAO_WAKE_REFRACTORY_MS
+#define WAKE_REFRACTORY_MS    CONFIG_ESP_MIAO_WAKE_REFRACTORY_MS
+#else
+#define WAKE_REFRACTORY_MS    1500
+#endif
+
+// Server 依誤喚醒率（喚醒後轉錄為空 / not_understood）推送 wake_tuning，套用後寫入 NVS "wake_tune"；
+// 只能在編譯期預設與下列上限之間調整（不會比出廠設定更敏感），0 = 忽略並使用編譯期門檻
+#ifndef WAKE_TUNING_ENABLE
+#define WAKE_TUNING_ENABLE    1
+#endif
+#define WAKE_TUNE_MAX         0.98f
+#if VAD_ADAPTIVE_THRESHOLD
+#define VAD_TUNE_BASE         VAD_THRESHOLD_MIN       // 調整對象：自適應閾值的下限
+#else
+#define VAD_TUNE_BASE         FFT_ENERGY_THRESHOLD    // 調整對象：固定閾值
+#endif
+#define VAD_TUNE_MAX          (VAD_TUNE_BASE * 8.0f)
+
+// 切片數（CONFIG_ESP_MIAO_SLICES_PER_WINDOW）> 4 時，開機量測推論耗時；
+// 超過切片週期的 INFERENCE_BUDGET_PCT 即退回每視窗 INFERENCE_COARSE_SLICES 次完整推論
+#define INFERENCE_BUDGET_PCT     80
+#define INFERENCE_COARSE_SLICES  4
+
+// 執行期推論降級（logic/inference_governor.h）：推論耗時 / (stride × 切片週期) 的平滑負載連續
+// INFER_GOV_DEGRADE_RUNS 次超過 INFER_GOV_DEGRADE_PCT（或切片在推論中被覆寫）即降一級：
+// 先關閉串流降噪（下一個 session 生效），再將推論間隔加倍，每視窗至少 INFER_GOV_MIN_DECISIONS 次；
+// 預估負載連續 INFER_GOV_RECOVER_RUNS 次低於 INFER_GOV_RECOVER_PCT 才回升。等級隨 telemetry 回報
+#if defined(CONFIG_ESP_MIAO_INFER_GOVERNOR) && !defined(INFER_GOVERNOR)
+#define INFER_GOVERNOR 1
+#endif
+#ifndef INFER_GOVERNOR
+#define INFER_GOVERNOR 0
+#endif
+#define INFER_GOV_DEGRADE_PCT    90
+#define INFER_GOV_DEGRADE_RUNS   8       // 約 2 秒（4 切片 / 視窗）
+#define INFER_GOV_RECOVER_PCT    60
+#define INFER_GOV_RECOVER_RUNS   120     // 約 30 秒，避免在門檻附近來回切換
+#define INFER_GOV_MIN_DECISIONS  2
+
+/* ---------- 推論剖析（telemetry） ---------- */
+
+// 每切片各階段耗時（I2S 等待 / 轉換 / VAD / MFCC / NN / 後處理 / UI 發佈）以直方圖累計，
+// 每 TELEMETRY_INTERVAL_S 秒由 telemetry Task 送出 min / avg / p99，0 = 關閉
+#ifndef TELEMETRY_INTERVAL_S
+#define TELEMETRY_INTERVAL_S      10
+#endif
+#define TELEMETRY_TASK_STACK      4608   // 報告 JSON（含 server 往返）約 0.9 KB 在堆疊上
+#define TELEMETRY_TASK_PRIO       2
+#define TELEMETRY_TASK_CORE       CORE_NET
+#define TELEMETRY_SEND_TIMEOUT_MS 500
+
+// 喚醒 → 第一個音訊 byte 送出的延遲 SLO：最近 WAKE_SLO_WINDOW 次的 p90 超過 WAKE_SLO_MS
+// 即送出 latency_slo（state=degraded，附超出預算最多的階段）並在狀態列提示，恢復時再送一次。0 = 只記錄
+#ifdef CONFIG_ESP_MIAO_WAKE_SLO_MS
+#define WAKE_SLO_MS               CONFIG_ESP_MIAO_WAKE_SLO_MS
+#endif
+#ifndef WAKE_SLO_MS
+#define WAKE_SLO_MS               300
+#endif
+#define WAKE_SLO_WINDOW           32
+#define WAKE_SLO_MIN_SAMPLES      8       // 樣本不足時不判定
+#define WAKE_SLO_RECOVER_PCT      80      // p90 回到 SLO 的此比例以下才恢復
+#define WAKE_SLO_BUDGET_QUEUE_MS    20    // 各段預算（合計約等於 SLO）
+#define WAKE_SLO_BUDGET_LINK_MS     100
+#define WAKE_SLO_BUDGET_START_MS    60
+#define WAKE_SLO_BUDGET_CAPTURE_MS  40
+#define WAKE_SLO_BUDGET_SEND_MS     80
+
+/* ---------- NVS 延後寫入 ---------- */
+
+// 執行期的設定寫入（AP 快取、Server 下發的端點 / 門檻、探索結果）先排入 logic/nvs_writer.h，
+// 同一 key 只寫最後一次；推論閘門關閉、沒有串流且 VAD 安靜連續 NVS_WB_QUIET_MS 後一次寫完，
+// 一直忙碌時最舊的值最多延後 NVS_WB_MAX_DEFER_S。0 = 直接寫入（原行為）
+#if defined(CONFIG_ESP_MIAO_NVS_WRITE_BEHIND) && !defined(NVS_WRITE_BEHIND)
+#define NVS_WRITE_BEHIND 1
+#endif
+#ifndef NVS_WRITE_BEHIND
+#define NVS_WRITE_BEHIND 0
+#endif
+#define NVS_WB_POLL_MS            50
+#define NVS_WB_QUIET_MS           1000
+#define NVS_WB_MAX_DEFER_S        120
+#define NVS_WB_TASK_STACK         3072
+#define NVS_WB_TASK_PRIO          1
+#define NVS_WB_TASK_CORE          CORE_NET
+
+/* ---------- 健康狀態（health） ---------- */
+
+// 每 HEALTH_INTERVAL_S 秒送出各 heap 區域 free / 最大區塊 / 歷史最低、
+// 每個 Task 的 stack 剩餘高水位與各核心 CPU 負載，0 = 關閉
+#ifndef HEALTH_INTERVAL_S
+#define HEALTH_INTERVAL_S         30
+#endif
+#define HEALTH_TASK_STACK         3072
+#define HEALTH_TASK_PRIO          1
+#define HEALTH_TASK_CORE          CORE_NET
+#define HEALTH_MAX_TASKS          32        // uxTaskGetSystemState 容量（超過則該次不列 stack / CPU）
+#define HEALTH_STACK_WARN_BYTES   512       // stack 剩餘低於此值時本地警示
+#define HEALTH_SEND_TIMEOUT_MS    500
+
+/* ---------- 遙測 HTTP 端點 ---------- */
+
+// GET /telemetry（JSON）與 /telemetry.bin（TelemetrySnapshot）供機群輪詢（network/telemetry_http.h）。
+// 內容為各 Task 在既有取樣點發布的 seqlock 快照；回應間隔短於 TELEMETRY_HTTP_MIN_INTERVAL_MS 時回 429
+#if defined(CONFIG_ESP_MIAO_TELEMETRY_HTTP) && !defined(TELEMETRY_HTTP)
+#define TELEMETRY_HTTP 1
+#endif
+#ifndef TELEMETRY_HTTP
+#define TELEMETRY_HTTP 0
+#endif
+#if defined(CONFIG_ESP_MIAO_TELEMETRY_HTTP_PORT) && !defined(TELEMETRY_HTTP_PORT)
+#define TELEMETRY_HTTP_PORT CONFIG_ESP_MIAO_TELEMETRY_HTTP_PORT
+#endif
+#ifndef TELEMETRY_HTTP_PORT
+#define TELEMETRY_HTTP_PORT 8080
+#endif
+#if defined(CONFIG_ESP_MIAO_TELEMETRY_HTTP_MIN_INTERVAL_MS) && !defined(TELEMETRY_HTTP_MIN_INTERVAL_MS)
+#define TELEMETRY_HTTP_MIN_INTERVAL_MS CONFIG_ESP_MIAO_TELEMETRY_HTTP_MIN_INTERVAL_MS
+#endif
+#ifndef TELEMETRY_HTTP_MIN_INTERVAL_MS
+#define TELEMETRY_HTTP_MIN_INTERVAL_MS 1000
+#endif
+#define TELEMETRY_HTTP_TASK_STACK   4096
+#define TELEMETRY_HTTP_TASK_PRIO    1
+#define TELEMETRY_HTTP_MAX_SOCKETS  2
+#define TELEMETRY_HTTP_JSON_LEN     1536
+
+/* ---------- 效能 console（UART REPL） ---------- */
+
+// esp_console REPL：stats / tasks / heap / bench / set，免重燒韌體即可查看統計與調整門檻。
+// 最低優先權跑在 CORE_NET，只讀取統計；bench 以合成音訊執行，不讀取擷取環形緩衝
+#if defined(CONFIG_ESP_MIAO_PERF_CONSOLE) && !defined(PERF_CONSOLE)
+#define PERF_CONSOLE 1
+#endif
+#ifndef PERF_CONSOLE
+#define PERF_CONSOLE 0
+#endif
+#define PERF_CONSOLE_TASK_STACK   6144
+#define PERF_CONSOLE_TASK_PRIO    1
+#define PERF_CONSOLE_TASK_CORE    CORE_NET
+#define PERF_CONSOLE_BENCH_MAX    1000      // bench 單次最多執行次數
+
+/* ---------- 錄音回放 benchmark（CONFIG_ESP_MIAO_BENCHMARK） ---------- */
+
+// bench 分區（SPIFFS）放 WAV 片段；檔名以 BENCH_POSITIVE_PREFIX 開頭者應觸發喚醒，其餘不應觸發
+#define BENCH_PARTITION_LABEL    "bench"
+#define BENCH_MOUNT_PATH         "/bench"
+#define BENCH_POSITIVE_PREFIX    "heymiaomiao"
+
+/* ---------- 誤觸發錄音（資料集收集） ---------- */
+
+// 喚醒詞信心值落在 [CLIP_BAND_LOW, 喚醒門檻) 的上升緣（可能的漏喚醒）與 Server 判定的誤喚醒（false_wake），
+// 各保存觸發點前 CLIP_MS 的音訊（IMA-ADPCM）到 clips 分區（SPIFFS）；閒置時背景上傳到 Server CLIP_UPLOAD_PATH
+#if defined(CONFIG_ESP_MIAO_CLIP_RECORDER) && !defined(CLIP_RECORDER)
+#define CLIP_RECORDER 1
+#endif
+#ifndef CLIP_RECORDER
+#define CLIP_RECORDER 0
+#endif
+#define CLIP_MS                  1500      // 須小於環形緩衝保留範圍（AUDIO_RING_SAMPLES * 7/8）
+#define CLIP_SAMPLES             (CLIP_MS * SAMPLE_RATE / 1000)
+#define CLIP_BLOCK_SAMPLES       1000      // 每個 ADPCM 區塊（可獨立解碼）
+#define CLIP_BAND_LOW            0.5f      // 漏喚醒候選：平滑信心值下限
+#define CLIP_COOLDOWN_MS         10000     // 漏喚醒候選最短間隔（同一段噪音只錄一次）
+#define CLIP_MAX_FILES           24        // 超過時刪除最舊的片段
+#define CLIP_PARTITION_LABEL     "clips"
+#define CLIP_MOUNT_PATH          "/clips"
+#define CLIP_UPLOAD_PATH         "/clips/" DEVICE_ID
+#define CLIP_UPLOAD_IDLE_MS      30000     // 無喚醒 / session 此時間後才上傳
+#define CLIP_UPLOAD_TIMEOUT_MS   5000
+#define CLIP_TASK_STACK          4096
+#define CLIP_TASK_PRIO           4         // 編碼須在環形緩衝覆寫前完成（數 ms）；上傳時暫降為 1
+#define CLIP_TASK_CORE           CORE_NET
+
+/* ---------- 模型分區（不重燒韌體更新模型權重） ---------- */
+
+// model 分區分兩槽，各放一份由 scripts/build_model_image.py 產生的權重 / 量化參數映像；
+// 開機取最新的有效槽，以 esp_partition_mmap 映射後由推論直接讀取（取代編譯進 app 的權重）。
+// Server 推送 model_update 時下載到另一槽，驗證 CRC 後於下一個切片切換，不需重新開機
+#if defined(CONFIG_ESP_MIAO_MODEL_PARTITION) && !defined(MODEL_PARTITION)
+#define MODEL_PARTITION 1
+#endif
+#ifndef MODEL_PARTITION
+#define MODEL_PARTITION 0
+#endif
+#define MODEL_PARTITION_LABEL    "model"
+#define MODEL_PARTITION_SUBTYPE  0x41
+#define MODEL_SLOT_BYTES         0x8000    // 每槽大小（4 KB 的倍數，可整槽抹除）
+#define MODEL_DOWNLOAD_PATH      "/model"
+#define MODEL_DOWNLOAD_TIMEOUT_MS 5000
+
+/* ---------- 模型權重常駐 DRAM ---------- */
+
+// EON 模型的常數張量預設在 flash，經 cache 映射讀取；兩次推論之間 Wi-Fi / UI / 串流程式碼會把
+// cache 擠掉，每次推論都要重新自 flash 載入。開機時依層執行順序把小張量（bias、shape、小卷積核）
+// 複製到內部 DRAM，預算用完或單一張量過大者（大型全連接權重）仍由 flash 讀取。
+// 開機前後各量 MODEL_PIN_PROBE_SLICES 次 NN 耗時，差值即 flash cache miss 每次推論的代價
+#if defined(CONFIG_ESP_MIAO_MODEL_WEIGHT_PIN) && !defined(MODEL_WEIGHT_PIN)
+#define MODEL_WEIGHT_PIN 1
+#endif
+#ifndef MODEL_WEIGHT_PIN
+#define MODEL_WEIGHT_PIN 0
+#endif
+#define MODEL_PIN_BUDGET_BYTES   16384     // 常駐 DRAM 上限
+#define MODEL_PIN_MAX_TENSOR     4096      // 超過此大小的張量留在 flash
+#define MODEL_PIN_PROBE_SLICES   4
+
+/* ---------- 裝置端指令（直連 MQTT） ---------- */
+
+// 喚醒後由同一 EI 模型的指令類別（light_on / light_off / fan_on / fan_off）辨識常用指令，
+// 高信心命中即直接發佈到目標裝置的 control_topic，略過 Server（Whisper / LLM）往返；
+// 模型沒有這些類別、MQTT 未連線或目標裝置未知時仍走 Server 路徑
+#ifdef CONFIG_ESP_MIAO_LOCAL_CMD
+#define LOCAL_CMD_ENABLE          1
+#define LOCAL_CMD_MQTT_URI        CONFIG_ESP_MIAO_MQTT_URI
+#define LOCAL_CMD_MQTT_USER       CONFIG_ESP_MIAO_MQTT_USER
+#define LOCAL_CMD_MQTT_PASSWORD   CONFIG_ESP_MIAO_MQTT_PASSWORD
+#else
+#define LOCAL_CMD_ENABLE          0
+#define LOCAL_CMD_MQTT_URI        "mqtt://192.168.1.16:1883"
+#define LOCAL_CMD_MQTT_USER       ""
+#define LOCAL_CMD_MQTT_PASSWORD   ""
+#endif
+#define LOCAL_CMD_THRESHOLD       0.85f   // 指令類別平滑後的觸發門檻（誤觸代價高於喚醒）
+#define LOCAL_CMD_WINDOW_MS       3000    // 喚醒後此時間內才接受指令類別
+#define LOCAL_CMD_MQTT_QOS        1
+#define LOCAL_CMD_DISCOVERY_TOPIC "home/discovery"   // 裝置註冊（retained），學習 control_topic / commands
+#define LOCAL_CMD_LIGHT_TOPIC     "lamp/command"      // 尚未收到 discovery 時的預設（mqtt_for_esp32 範例）
+#define LOCAL_CMD_FAN_TOPIC       "home/fan/command"
+#define LOCAL_CMD_JSON_TOKENS     64     // discovery 訊息含 aliases / action_keywords
+// 致動器 discovery 附 espnow_mac 時，同一指令另以 ESP-NOW 單播直送（不經 AP / Broker）；
+// MQTT 照常發佈，Broker 離線時 ESP-NOW 單獨送達也視為已處理
+#if defined(CONFIG_ESP_MIAO_LOCAL_CMD_ESPNOW) && !defined(LOCAL_CMD_ESPNOW)
+#define LOCAL_CMD_ESPNOW          1
+#endif
+#ifndef LOCAL_CMD_ESPNOW
+#define LOCAL_CMD_ESPNOW          0
+#endif
+
+// 控制詞（模型需有 cancel / repeat 類別）：cancel 於 session 中立即中止串流並回到待機，
+// repeat 於待機時重播上一個動作（裝置端指令重新發佈、Server 動作在本機重新執行），皆不經 Server
+#if defined(CONFIG_ESP_MIAO_CONTROL_WORDS) && !defined(CONTROL_WORDS)
+#define CONTROL_WORDS             1
+#endif
+#ifndef CONTROL_WORDS
+#define CONTROL_WORDS             0
+#endif
+#define CONTROL_WORD_THRESHOLD    0.85f   // 同指令類別：誤觸代價高於喚醒
+#define CONTROL_CANCEL_COOLDOWN_MS 1000   // 取消詞不應期（session 內可能重複說）
+#define CONTROL_REPEAT_COOLDOWN_MS 3000   // 重複詞不應期（避免一句話重播兩次）
+
+/* ---------- WiFi 連線設定檔 ---------- */
+
+// 閒置時 modem-sleep 省電；喚醒 session（ACK / 串流 / 等待回應）期間自動切為 WIFI_PS_NONE
+#define WIFI_PS_IDLE              WIFI_PS_MIN_MODEM
+#define WIFI_LISTEN_INTERVAL      3        // WIFI_PS_MAX_MODEM 時的 DTIM 間隔數
+// 快速重連：NVS 快取上次的 BSSID / 頻道，開機直接連線不掃描；連續失敗即退回全頻掃描
+#define WIFI_FAST_CONNECT         1
+#define WIFI_FAST_CONNECT_RETRIES 2
+#define WIFI_ROAM_11KV            1        // 802.11k/v（Radio Measurement / BSS Transition）
+
+// 靜態 IP（Kconfig；空字串 = DHCP）
+#ifdef CONFIG_ESP_MIAO_STATIC_IP
+#define WIFI_STATIC_IP        CONFIG_ESP_MIAO_STATIC_IP
+#define WIFI_STATIC_NETMASK   CONFIG_ESP_MIAO_STATIC_NETMASK
+#define WIFI_STATIC_GATEWAY   CONFIG_ESP_MIAO_STATIC_GATEWAY
+#define WIFI_STATIC_DNS       CONFIG_ESP_MIAO_STATIC_DNS
+#else
+#define WIFI_STATIC_IP        ""
+#define WIFI_STATIC_NETMASK   "255.255.255.0"
+#define WIFI_STATIC_GATEWAY   ""
+#define WIFI_STATIC_DNS       ""
+#endif
+
 /* ---------- WiFi 設備 ID ---------- */
 
 #define DEVICE_ID   "esp32_01"
@@ -0,0 +1,65 @@
+#ifndef RTOS_ALLOC_H
+#define RTOS_ALLOC_H
+
+/* ============================================================
+ * rtos_alloc.h - Task / Queue / 同步物件的建立（動態或靜態配置）
+ * ESP-MIAO v0.8.0
+ *
+ * CONFIG_ESP_MIAO_STATIC_ALLOC=y 時，每個呼叫點展開成自己的靜態
+ * Stack / TCB / Queue 儲存區（由 linker 放在內部 RAM 的 .bss），
+ * 開機後 heap 用量固定，長時間運行也不會因這些物件而碎片化。
+ *
+ * 靜態模式下每個呼叫點只能成功執行一次：所有模組皆為單例，
+ * 且建立前都會檢查 handle 是否已存在。
+ * ============================================================ */
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/stream_buffer.h"
+
+#if CONFIG_ESP_MIAO_STATIC_ALLOC
+
+/* 回傳 pdPASS / pdFAIL，與 xTaskCreatePinnedToCore 相同；stack 單位為 bytes */
+#define RTOS_TASK_CREATE(fn, name, stack, arg, prio, handle, core) ({                  \
+    static StackType_t  rtos_stack_[(stack)];                                          \
+    static StaticTask_t rtos_tcb_;                                                     \
+    TaskHandle_t  rtos_task_ = xTaskCreateStaticPinnedToCore((fn), (name), (stack),    \
+                                   (arg), (prio), rtos_stack_, &rtos_tcb_, (core));    \
+    TaskHandle_t *rtos_out_  = (handle);                                               \
+    if (rtos_out_) *rtos_out_ = rtos_task_;                                            \
+    rtos_task_ ? pdPASS : pdFAIL; })
+
+#define RTOS_QUEUE_CREATE(len, item_size) ({                                           \
+    static uint8_t       rtos_q_storage_[(len) * (item_size)];                         \
+    static StaticQueue_t rtos_q_;                                                      \
+    xQueueCreateStatic((len), (item_size), rtos_q_storage_, &rtos_q_); })
+
+#define RTOS_EVENT_GROUP_CREATE() ({                                                   \
+    static StaticEventGroup_t rtos_eg_;                                                \
+    xEventGroupCreateStatic(&rtos_eg_); })
+
+#define RTOS_MUTEX_CREATE() ({                                                         \
+    static StaticSemaphore_t rtos_mutex_;                                              \
+    xSemaphoreCreateMutexStatic(&rtos_mutex_); })
+
+#define RTOS_STREAM_BUFFER_CREATE(size, trigger) ({                                    \
+    static uint8_t              rtos_sb_storage_[(size) + 1];                          \
+    static StaticStreamBuffer_t rtos_sb_;                                              \
+    xStreamBufferCreateStatic((size), (trigger), rtos_sb_storage_, &rtos_sb_); })
+
+#else
+
+#define RTOS_TASK_CREATE(fn, name, stack, arg, prio, handle, core) \
+    xTaskCreatePinnedToCore((fn), (name), (stack), (arg), (prio), (handle), (core))
+#define RTOS_QUEUE_CREATE(len, item_size) xQueueCreate((len), (item_size))
+#define RTOS_EVENT_GROUP_CREATE()         xEventGroupCreate()
+#define RTOS_MUTEX_CREATE()               xSemaphoreCreateMutex()
+#define RTOS_STREAM_BUFFER_CREATE(size, trigger) xStreamBufferCreate((size), (trigger))
+
+#endif
+
+#endif // RTOS_ALLOC_H
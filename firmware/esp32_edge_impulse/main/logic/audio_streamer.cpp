@@ -5,71 +5,652 @@
 
 #include "audio_streamer.h"
 #include "config.h"
+#include "rtos_alloc.h"
+#include "adpcm.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_random.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "ui_state.h"
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
 static const char *TAG = "AudioStreamer";
 
+static_assert(STREAM_PREROLL_SAMPLES < AUDIO_RING_SAMPLES * 7 / 8,
+              "STREAM_PREROLL_MS exceeds what the capture ring buffer retains");
+
 AudioStreamer::AudioStreamer(WebSocketClient &ws, AudioCapture &audio, TimeManager &timemgr)
-    : ws_(ws), audio_(audio), timemgr_(timemgr)
-{}
+    : ws_(ws), audio_(audio), timemgr_(timemgr),
+      free_q_(nullptr), resume_q_(nullptr), tx_failed_(false), cancel_(CANCEL_NONE),
+      first_sent_us_(0), ns_allowed_(true), rate_div_(1)
+{
+#if STREAM_PACING
+    n_parked_ = 0;
+#endif
+}
+
+bool AudioStreamer::init()
+{
+    if (free_q_) return true;
+
+    free_q_   = RTOS_QUEUE_CREATE(STREAM_TX_BUFFERS, sizeof(uint8_t));
+    resume_q_ = RTOS_QUEUE_CREATE(1, sizeof(ResumeAck));
+    if (!free_q_ || !resume_q_) {
+        ESP_LOGE(TAG, "Failed to create TX queues");
+        return false;
+    }
+    for (uint8_t i = 0; i < STREAM_TX_BUFFERS; i++) {
+        slots_[i].send_us = -1;
+        xQueueSend(free_q_, &i, 0);
+    }
+#if STREAM_NOISE_SUPPRESS
+    ns_.init();   // 失敗時直通，不影響串流
+#endif
+#if STREAM_LOW_RATE
+    if (!decim_.init(SAMPLE_RATE, SAMPLE_RATE / 2)) {
+        ESP_LOGW(TAG, "Decimator init failed, weak links stream at full rate");
+    }
+#endif
+
+    if (RTOS_TASK_CREATE(tx_task_entry_, "stream_tx", STREAM_TX_TASK_STACK, this,
+                         STREAM_TX_TASK_PRIO, nullptr, STREAM_TX_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start stream TX task");
+        return false;
+    }
+    spsc_channel_register("stream_tx", &tx_ch_);
+    ESP_LOGI(TAG, "Stream TX ready: %d x %u-byte frames", STREAM_TX_BUFFERS,
+             (unsigned)sizeof(TxSlot::frame));
+    return true;
+}
+
+/* ---------- TX Task：依序送出 slot，送完歸還 ---------- */
 
-bool AudioStreamer::stream(size_t total_samples, float confidence)
+void AudioStreamer::tx_task_entry_(void *arg)
 {
+    auto   *self = static_cast<AudioStreamer *>(arg);
+    uint8_t idx;
+    self->tx_ch_.set_consumer(xTaskGetCurrentTaskHandle());
+    while (1) {
+        if (!self->tx_ch_.pop_wait(&idx, portMAX_DELAY)) continue;
+
+        /* 失敗後仍歸還後續 slot，讓填入端能收尾；已失敗的串流不再送出 */
+        TxSlot &slot = self->slots_[idx];
+        slot.send_us = -1;
+        if (self->udp_.is_open()) {
+            /* UDP：送不出的 frame 視為遺失，由 Server 補償，不中止串流 */
+            int64_t t0 = esp_timer_get_time();
+            if (self->send_udp_(slot)) {
+                int64_t t1 = esp_timer_get_time();
+                slot.send_us = t1 - t0;
+                int64_t none = 0;
+                self->first_sent_us_.compare_exchange_strong(none, t1, std::memory_order_relaxed);
+            }
+        } else if (!self->tx_failed_.load(std::memory_order_acquire)) {
+            int64_t t0 = esp_timer_get_time();
+            if (self->ws_.send_binary((const char *)slot.frame, slot.len,
+                                      pdMS_TO_TICKS(STREAM_SEND_TIMEOUT_MS))) {
+                int64_t t1 = esp_timer_get_time();
+                slot.send_us = t1 - t0;
+                int64_t none = 0;
+                self->first_sent_us_.compare_exchange_strong(none, t1, std::memory_order_relaxed);
+            } else {
+                ESP_LOGE(TAG, "Binary send failed (%u bytes)", (unsigned)slot.len);
+                self->tx_failed_.store(true, std::memory_order_release);
+            }
+        }
+        xQueueSend(self->free_q_, &idx, portMAX_DELAY);
+    }
+}
+
+bool AudioStreamer::send_udp_(const TxSlot &slot)
+{
+#if STREAM_RING_PAYLOAD
+    if (slot.ring.size) {
+        /* 環形緩衝保留約 2 秒，遠多於在途 frame；仍先確認樣本未被覆寫，否則視為遺失 */
+        if (!audio_.slice_valid(slot.ring)) return false;
+        struct iovec iov[3] = {
+            { (void *)slot.frame, HDR_BYTES },
+            { (void *)slot.ring.seg[0], slot.ring.len[0] * sizeof(int16_t) },
+            { (void *)slot.ring.seg[1], slot.ring.len[1] * sizeof(int16_t) },
+        };
+        return udp_.send_iov(iov, slot.ring.len[1] ? 3 : 2);
+    }
+#endif
+    return udp_.send(slot.frame, slot.len);
+}
+
+bool AudioStreamer::drain_tx_()
+{
+#if STREAM_PACING
+    unpark_slots_();
+#endif
+    uint8_t idx[STREAM_TX_BUFFERS];
+    int     got = 0;
+    while (got < STREAM_TX_BUFFERS &&
+           xQueueReceive(free_q_, &idx[got], pdMS_TO_TICKS(STREAM_SEND_TIMEOUT_MS * 2)) == pdTRUE) {
+        account_send_(slots_[idx[got]], 0);
+        slots_[idx[got]].send_us = -1;
+        got++;
+    }
+    for (int i = 0; i < got; i++) {
+        xQueueSend(free_q_, &idx[i], 0);
+    }
+    if (got < STREAM_TX_BUFFERS) {
+        ESP_LOGE(TAG, "TX drain timeout (%d/%d frames returned)", got, STREAM_TX_BUFFERS);
+        return false;
+    }
+    return !tx_failed_.load(std::memory_order_acquire);
+}
+
+/* ---------- 鏈路統計 / 自適應 chunk ---------- */
+
+size_t AudioStreamer::begin_link_()
+{
+    wifi_ap_record_t ap = {};
+    int rssi = (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) ? ap.rssi : 0;
+
+    /* UDP：一個 frame 必須裝進一個不分段的 datagram */
+    size_t cap = STREAM_SLOT_SAMPLES;
+    while (udp_.is_open() && cap > STREAM_CHUNK_MIN_SAMPLES && frame_bytes_(cap) > STREAM_UDP_MAX_DATAGRAM) {
+        cap /= 2;
+    }
+
+    size_t chunk = STREAM_CHUNK_SAMPLES;
+#if STREAM_ADAPTIVE_CHUNK
+    if (rssi != 0) {
+        if (rssi >= STREAM_RSSI_GOOD)     chunk = STREAM_CHUNK_MIN_SAMPLES * 2;
+        else if (rssi < STREAM_RSSI_POOR) chunk = STREAM_CHUNK_MAX_SAMPLES;
+    }
+#endif
+    if (chunk > cap) chunk = cap;
+
+#if STREAM_PACING
+    pacer_.reset(STREAM_TX_BUFFERS);
+#endif
+    link_ = {};
+    link_.chunk_cap   = cap;
+    link_.rssi        = rssi;
+    link_.chunk_start = chunk;
+    link_.chunk_min   = chunk;
+    link_.chunk_max   = chunk;
+    return chunk;
+}
+
+size_t AudioStreamer::account_send_(const TxSlot &slot, size_t chunk)
+{
+    if (slot.send_us < 0) return chunk;
+
+    link_.frames++;
+    link_.send_us_total += slot.send_us;
+    if (slot.send_us > link_.send_us_max) link_.send_us_max = slot.send_us;
+#if STREAM_PACING
+    pacer_.on_sent((uint32_t)slot.send_us, (uint32_t)((int64_t)slot.samples * 1000000 / SAMPLE_RATE));
+#endif
+
+#if STREAM_ADAPTIVE_CHUNK
+    link_.win_frames++;
+    link_.win_send_us  += slot.send_us;
+    link_.win_audio_us += (int64_t)slot.samples * 1000000 / SAMPLE_RATE;
+    if (chunk == 0 || link_.win_frames < STREAM_ADAPT_FRAMES || link_.win_audio_us <= 0) {
+        return chunk;
+    }
+
+    /* 送出耗時佔音訊時長的比例：過高表示每 frame 開銷 / 重送拖累，過低表示可用更小的 frame */
+    int64_t pct = link_.win_send_us * 100 / link_.win_audio_us;
+    if (pct > STREAM_SEND_SLOW_PCT && chunk < link_.chunk_cap) {
+        chunk *= 2;
+    } else if (pct < STREAM_SEND_FAST_PCT && chunk > STREAM_CHUNK_MIN_SAMPLES) {
+        chunk /= 2;
+    }
+    if (chunk < link_.chunk_min) link_.chunk_min = chunk;
+    if (chunk > link_.chunk_max) link_.chunk_max = chunk;
+    link_.win_frames   = 0;
+    link_.win_send_us  = 0;
+    link_.win_audio_us = 0;
+#endif
+    return chunk;
+}
+
+#if STREAM_PACING
+void AudioStreamer::pace_slots_(size_t *chunk)
+{
+    const uint8_t keep_out = STREAM_TX_BUFFERS - pacer_.window();
+    while (n_parked_ > keep_out) {
+        xQueueSend(free_q_, &parked_[--n_parked_], 0);
+    }
+    /* 只取已歸還的 slot，不等待；在途的 slot 歸還後再保留 */
+    uint8_t idx;
+    while (n_parked_ < keep_out && xQueueReceive(free_q_, &idx, 0) == pdTRUE) {
+        *chunk = account_send_(slots_[idx], *chunk);
+        slots_[idx].send_us = -1;
+        parked_[n_parked_++] = idx;
+    }
+}
+
+void AudioStreamer::unpark_slots_()
+{
+    while (n_parked_ > 0) {
+        xQueueSend(free_q_, &parked_[--n_parked_], 0);
+    }
+}
+#endif
+
+/* ---------- 斷線續傳 ---------- */
+
+void AudioStreamer::on_resume_ack(uint32_t session_id, bool accepted, uint32_t received_samples)
+{
+    if (!resume_q_) return;
+    ResumeAck ack = { session_id, received_samples, accepted };
+    xQueueOverwrite(resume_q_, &ack);
+}
+
+bool AudioStreamer::resume_(uint32_t session_id, uint32_t next_seq, uint32_t start_pos, size_t *sent)
+{
+    /* 送出失敗後 TX Task 只歸還 slot，先收回全部在途 frame */
+    drain_tx_();
+    ESP_LOGW(TAG, "Stream %08lx interrupted near sample %zu, reconnecting...",
+             (unsigned long)session_id, *sent);
+
+    if (!ws_.emergency_reconnect(STREAM_RESUME_RECONNECT_MS)) return false;
+
+    xQueueReset(resume_q_);
+    char json[160];
+    snprintf(json, sizeof(json),
+             "{\"device_id\":\"%s\",\"timestamp\":%llu,\"type\":\"audio_resume\","
+             "\"payload\":{\"session_id\":%lu,\"seq\":%lu}}",
+             DEVICE_ID, (unsigned long long)timemgr_.get_timestamp_ms(),
+             (unsigned long)session_id, (unsigned long)next_seq);
+    if (!ws_.send_text(json, strlen(json), pdMS_TO_TICKS(STREAM_SEND_TIMEOUT_MS))) {
+        ESP_LOGE(TAG, "Failed to send audio_resume");
+        return false;
+    }
+
+    ResumeAck  ack      = {};
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(STREAM_RESUME_ACK_MS);
+    do {
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(deadline - now) <= 0 ||
+            xQueueReceive(resume_q_, &ack, deadline - now) != pdTRUE) {
+            ESP_LOGE(TAG, "No audio_resume_ack from server");
+            return false;
+        }
+    } while (ack.session_id != session_id);
+
+    if (!ack.accepted) {
+        ESP_LOGE(TAG, "Server rejected resume of stream %08lx", (unsigned long)session_id);
+        return false;
+    }
+
+    /* 自 Server 已收位置重送；已被覆寫的部分跳過（Server 依 sample_offset 補靜音） */
+    size_t   received = (size_t)ack.received * rate_div_;   // Server 以串流速率計
+    if (received > *sent) received = *sent;
+    uint32_t want     = start_pos + (uint32_t)received;
+    uint32_t got      = audio_.rewind_reader(AUDIO_READER_STREAMER, want, 0);
+    if (got != want) {
+        ESP_LOGW(TAG, "%lu samples no longer in ring, server will zero-fill",
+                 (unsigned long)(got - want));
+    }
+    *sent = (size_t)(got - start_pos);
+    link_.resumes++;
+    tx_failed_.store(false, std::memory_order_release);
+    ESP_LOGI(TAG, "Stream %08lx resumed at sample %zu", (unsigned long)session_id, *sent);
+    return true;
+}
+
+bool AudioStreamer::stream(size_t command_samples, float confidence, uint32_t wake_pos,
+                           float noise_floor, StreamTrace *trace)
+{
+    StreamTrace local_trace = {};
+    if (!trace) trace = &local_trace;
+    if (!free_q_) {
+        ESP_LOGE(TAG, "Streamer not initialised");
+        return false;
+    }
     if (!ws_.is_connected()) {
         ESP_LOGE(TAG, "WebSocket not connected, cannot stream");
         return false;
     }
 
-    /* 1. 發送 audio_start JSON */
-    char start_json[256];
-    snprintf(start_json, sizeof(start_json),
-             "{\"device_id\":\"%s\",\"timestamp\":%llu,\"type\":\"audio_start\","
-             "\"payload\":{\"total_samples\":%zu,\"confidence\":%.3f,"
-             "\"transfer_mode\":\"binary\"}}",
-             DEVICE_ID, (unsigned long long)timemgr_.get_timestamp_ms(),
-             total_samples, confidence);
+    /* 1. 定位串流游標：喚醒點往前 pre-roll（受環形緩衝保留範圍限制） */
+    uint32_t start_pos = audio_.rewind_reader(AUDIO_READER_STREAMER, wake_pos,
+                                              STREAM_PREROLL_SAMPLES);
+    AudioReaderHoldScope hold(audio_, AUDIO_READER_STREAMER, STREAM_READER_HOLD);
+    /* 本次串流游標的延遲 / 遺失（DROP：被覆寫；HOLD：擷取端捨棄）以起點差值計算 */
+    const uint32_t ring_overruns0 = audio_.take_reader_stats(AUDIO_READER_STREAMER).overruns;
+    const uint32_t ring_held0     = audio_.ring().held_drops();
+    uint32_t end_pos   = wake_pos + (uint32_t)command_samples;
+    size_t   preroll   = ((int32_t)(wake_pos - start_pos) > 0) ? (size_t)(wake_pos - start_pos) : 0;
+    size_t   total_samples = ((int32_t)(end_pos - start_pos) > 0) ? (size_t)(end_pos - start_pos) : 0;
+
+    /* 2. 發送 audio_start JSON */
+    const uint32_t session_id = esp_random();
+
+#if STREAM_NOISE_SUPPRESS
+    const bool ns_active = ns_.ready() && ns_allowed_.load(std::memory_order_relaxed);
+#else
+    const bool ns_active = false;
+#endif
+
+    /* UDP 上行：目前 WebSocket 端點的位址；開不了 socket 時照常走 WebSocket */
+#if STREAM_UDP
+    {
+        char ip[16];
+        if (!ws_.server_ip(ip, sizeof(ip)) || !udp_.open(ip, STREAM_UDP_PORT)) {
+            ESP_LOGW(TAG, "UDP uplink unavailable, streaming over WebSocket");
+        }
+    }
+#endif
+    const bool udp = udp_.is_open();
+
+    /* 鏈路統計與起始 chunk；弱訊號時本次串流改以半速率送出（整段偶數個樣本，抽點後長度剛好減半） */
+    size_t chunk = begin_link_();
+    rate_div_    = 1;
+#if STREAM_LOW_RATE
+    if (link_.rssi != 0 && link_.rssi < STREAM_LOW_RATE_RSSI && !decim_.is_passthrough()) {
+        rate_div_ = 2;
+        decim_.reset();
+        total_samples &= ~(size_t)1;
+    }
+#endif
+#if STREAM_CODEC == STREAM_CODEC_ADPCM
+    const char *format_fmt = "adpcm_%dk_4bit";
+#else
+    const char *format_fmt = "pcm_%dk_16bit";
+#endif
+    char audio_format[24];
+    snprintf(audio_format, sizeof(audio_format), format_fmt, SAMPLE_RATE / rate_div_ / 1000);
+
+    /* timestamp 與 timer_us 取同一時刻，Server 以此換算每個 frame 的擷取時間 */
+    const int64_t now_us = esp_timer_get_time();
+    trace->stream_start_us = now_us;
+    /* 選填欄位：生效中的門檻（Server 據此計算下一次 wake_tuning）、模型映像版本、追問視窗的前一句 */
+    char extra_json[160] = "";
+    int  extra = 0;
+#if WAKE_TUNING_ENABLE
+    if (trace->wake_threshold > 0.0f) {   // 非喚醒觸發的串流（benchmark 等）沒有門檻可回報
+        extra += snprintf(extra_json, sizeof(extra_json),
+                          ",\"wake_threshold\":%.3f,\"vad_threshold\":%.0f,\"tuning_version\":%lu",
+                          trace->wake_threshold, trace->vad_threshold, (unsigned long)trace->tuning_version);
+    }
+#endif
+#if MODEL_PARTITION
+    if (extra < (int)sizeof(extra_json)) {
+        extra += snprintf(extra_json + extra, sizeof(extra_json) - extra, ",\"model_generation\":%lu",
+                          (unsigned long)trace->model_generation);
+    }
+#endif
+    if (trace->followup_of && extra < (int)sizeof(extra_json)) {
+        snprintf(extra_json + extra, sizeof(extra_json) - extra,
+                 ",\"followup\":true,\"followup_of\":\"%08lx\"", (unsigned long)trace->followup_of);
+    }
+    StreamStartInfo info = {};
+    info.device_id          = DEVICE_ID;
+    info.timestamp_ms       = timemgr_.epoch_us_at(now_us) / 1000;
+    info.audio_format       = audio_format;
+    info.sample_rate        = SAMPLE_RATE / rate_div_;
+    info.total_samples      = total_samples / rate_div_;
+    info.preroll_samples    = preroll / rate_div_;
+    info.frame_samples      = chunk / rate_div_;
+    info.chunk_header_bytes = STREAM_CHUNK_HEADER ? (int)sizeof(StreamChunkHeader) : 0;
+    info.timer_us           = now_us;
+    info.clock_err_us       = (unsigned)timemgr_.uncertainty_us();
+    info.endpointing        = STREAM_ENDPOINTING;
+    info.noise_suppression  = ns_active;
+    info.session_id         = session_id;
+    info.confidence         = confidence;
+    info.transfer_mode      = udp ? "udp" : "binary";
+    info.trace_id           = trace->trace_id;
+    info.extra              = extra_json;
+    char start_json[560];
+    stream_start_json(start_json, sizeof(start_json), info);
 
     if (!ws_.send_text(start_json, strlen(start_json))) {
         ESP_LOGE(TAG, "Failed to send audio_start");
+        udp_.close();
         return false;
     }
 
-    /* 2. 分塊串流 PCM */
-    const size_t CHUNK = STREAM_CHUNK_SAMPLES;
-    int16_t *buf = (int16_t *)malloc(CHUNK * sizeof(int16_t));
-    if (!buf) {
-        ESP_LOGE(TAG, "OOM: cannot allocate chunk buffer");
-        return false;
-    }
+    /* 3. 分塊串流（pre-roll 先送出，其後接續即時音訊）。
+     *    本 Task 讀取 / 編碼下一個 frame 的同時，TX Task 送出前一個；
+     *    slot 全部在途時在 free_q_ 等待，即為網路背壓 */
+    size_t   sent     = 0;
+    ui_telemetry_publish_stream(0.0f);
+    uint32_t seq      = 0;
+    uint32_t tx_waits = 0;     // 取 slot 時需等待的次數（網路跟不上擷取）
+#if STREAM_RESUME
+    int      resume_attempts = 0;
+#endif
+    bool     ok       = true;
+    bool     cancelled = false;
+    tx_failed_.store(false, std::memory_order_release);
+    first_sent_us_.store(0, std::memory_order_relaxed);
+#if STREAM_CODEC == STREAM_CODEC_ADPCM
+    AdpcmState adpcm;
+    adpcm_reset(&adpcm);
+#endif
+
+    const char  *end_reason  = "max_duration";
+#if STREAM_ENDPOINTING
+    /* 端點偵測：只看喚醒點之後的 chunk，尾端靜音累計達門檻且超過最短長度即結束 */
+    const size_t min_total   = preroll + (size_t)SAMPLE_RATE * STREAM_MIN_MS / 1000;
+    const size_t end_silence = (size_t)SAMPLE_RATE * STREAM_END_SILENCE_MS / 1000;
+    size_t       silence     = 0;
+    bool         ended       = false;
+    vad_.seed_noise_floor(noise_floor);
+#endif
+#if STREAM_NOISE_SUPPRESS
+    /* 噪音頻譜跨串流保留（同一環境），重疊相加狀態自 pre-roll 重新開始 */
+    ns_.reset();
+    float  ns_energy[NS_MAX_FRAMES];
+    size_t ns_frames = 0;
+#endif
+
+    /* 外層迴圈：送出失敗時重連續傳，自 Server 已收位置重新進入內層迴圈 */
+    while (ok) {
+        while (sent < total_samples) {
+            if (tx_failed_.load(std::memory_order_acquire)) break;
+            uint8_t why = cancel_.load(std::memory_order_acquire);
+            if (why != CANCEL_NONE) {
+                /* 指令已在裝置端處理 / Server 要求中止 / 取消詞：停在目前位置，續傳時也不再補送 */
+                end_reason    = (why == CANCEL_SERVER) ? "server_cancel"
+                              : (why == CANCEL_USER) ? "user_cancel" : "local_command";
+                cancelled     = true;
+                total_samples = sent;
+                break;
+            }
 
-    size_t sent = 0;
-    bool   ok   = true;
+#if STREAM_PACING
+            pace_slots_(&chunk);
+#endif
+            uint8_t idx;
+            if (xQueueReceive(free_q_, &idx, 0) != pdTRUE) {
+                tx_waits++;
+                if (xQueueReceive(free_q_, &idx, pdMS_TO_TICKS(STREAM_SEND_TIMEOUT_MS * 2)) != pdTRUE) {
+                    ESP_LOGE(TAG, "No free TX slot, network stalled at sample %zu", sent);
+                    tx_failed_.store(true, std::memory_order_release);
+                    break;
+                }
+            }
+            TxSlot &slot = slots_[idx];
+            chunk = account_send_(slot, chunk);
+            slot.send_us = -1;
+
+            size_t to_read = total_samples - sent;
+            if (to_read > chunk) to_read = chunk;
+            slot.samples = to_read;
 
-    while (sent < total_samples) {
-        size_t to_read = total_samples - sent;
-        if (to_read > CHUNK) to_read = CHUNK;
+#if STREAM_CODEC == STREAM_CODEC_ADPCM
+            int16_t *buf = pcm_;
+#else
+            int16_t *buf = (int16_t *)(slot.frame + HDR_BYTES);
+#endif
+            uint32_t chunk_pos = audio_.reader_position(AUDIO_READER_STREAMER);
 
-        if (audio_.read_audio_to_buffer(buf, to_read)) {
-            if (!ws_.send_binary((const char *)buf, to_read * sizeof(int16_t))) {
-                ESP_LOGE(TAG, "Binary send failed at sample %zu", sent);
+            bool read_ok;
+#if STREAM_RING_PAYLOAD
+            slot.ring.size = 0;
+            if (udp_.is_open() && rate_div_ == 1) {
+                read_ok = audio_.take_slice(AUDIO_READER_STREAMER, to_read, &slot.ring);
+                chunk_pos = slot.ring.pos;
+            } else
+#endif
+            {
+                read_ok = audio_.read_audio_to_buffer(AUDIO_READER_STREAMER, buf, to_read);
+            }
+            if (!read_ok) {
+                ESP_LOGE(TAG, "I2S read failed during streaming");
+                xQueueSend(free_q_, &idx, 0);
                 ok = false;
                 break;
             }
+
+#if STREAM_NOISE_SUPPRESS
+            /* 原地降噪（輸出延遲 FFT_SIZE），同時取得各分析幀的降噪前頻帶能量 */
+            ns_frames = ns_.process(buf, to_read, vad_.stats().threshold, ns_energy, NS_MAX_FRAMES);
+#if !STREAM_ENDPOINTING
+            (void)ns_frames;
+#endif
+#endif
+
+            size_t out_n = to_read;   // 送出的樣本數（串流速率）
+#if STREAM_LOW_RATE
+            if (rate_div_ > 1) out_n = decim_.process(buf, to_read, buf);   // 原地抽點（輸出不超前輸入）
+#endif
+
+#if STREAM_CHUNK_HEADER
+            /* 讀取完成後樣本必已擷取，時間戳查詢一定落在保留範圍內 */
+            StreamChunkHeader hdr = {};
+            hdr.seq           = seq;
+            hdr.session_id    = session_id;
+            hdr.sample_offset = (uint32_t)(sent / rate_div_);
+            audio_.stamp_at(chunk_pos, &hdr.block_seq, &hdr.capture_us);
+            memcpy(slot.frame, &hdr, sizeof(hdr));
+#else
+            (void)chunk_pos;
+#endif
+#if STREAM_CODEC == STREAM_CODEC_ADPCM
+            slot.len = HDR_BYTES + adpcm_encode_block(buf, out_n, &adpcm, slot.frame + HDR_BYTES);
+#else
+            slot.len = HDR_BYTES + out_n * sizeof(int16_t);
+#endif
+            tx_ch_.push(idx);   // 容量 = slot 數，不會滿
+            if (seq == 0) trace->first_frame_us = esp_timer_get_time();
             sent += to_read;
-        } else {
-            ESP_LOGE(TAG, "I2S read failed during streaming");
+            seq++;
+            ui_telemetry_publish_stream((float)sent / (float)total_samples);
+
+#if STREAM_ENDPOINTING
+            if (!ended && sent > preroll) {
+                bool speech;
+#if STREAM_NOISE_SUPPRESS
+                if (ns_active) {
+                    /* 沿用降噪的分析幀，不再對本 chunk 做 FFT；無完整幀時不以靜音結束 */
+                    speech = ns_frames == 0 || vad_.detect_energies(ns_energy, ns_frames).speech;
+                } else
+#endif
+                {
+                    /* 直接以環形緩衝檢視本 chunk；小於一個 FFT 幀時往前延伸至 FFT_SIZE（自適應 chunk 可能只有 256） */
+                    size_t     span = (to_read < FFT_SIZE) ? FFT_SIZE : to_read;
+                    AudioSlice view = {};
+                    speech = audio_.slice_at(chunk_pos + (uint32_t)to_read - (uint32_t)span, span, &view)
+                           ? vad_.detect(view).speech
+                           : true;   // 無法檢視時不以靜音結束
+                }
+                silence = speech ? 0 : silence + to_read;
+                if (sent >= min_total && silence >= end_silence) {
+                    /* 固定終點：續傳時只補送到此為止 */
+                    end_reason    = "silence";
+                    ended         = true;
+                    total_samples = sent;
+                }
+            }
+#endif
+        }
+
+        /* 所有 frame 送完才送 audio_end / 回報結果 */
+        bool drained = drain_tx_();
+        if (drained) trace->last_frame_us = esp_timer_get_time();
+        trace->first_sent_us = first_sent_us_.load(std::memory_order_relaxed);
+        if (!ok || drained) break;
+#if STREAM_RESUME
+        if (resume_attempts++ < STREAM_RESUME_ATTEMPTS &&
+            resume_(session_id, seq, start_pos, &sent)) {
+#if STREAM_CODEC == STREAM_CODEC_ADPCM
+            adpcm_reset(&adpcm);
+#endif
+#if STREAM_NOISE_SUPPRESS
+            ns_.reset();   // 續傳位置不連續
+#endif
+#if STREAM_LOW_RATE
+            decim_.reset();
+#endif
+            continue;
+        }
+#endif
+        ESP_LOGE(TAG, "Binary send failed near sample %zu", sent);
+        ok = false;
+    }
+    if (ok) ui_telemetry_publish_stream(1.0f);   // 提前結束（端點 / 裝置端指令）也視為送完
+
+    /* 告知 Server 實際長度（提前結束時少於 audio_start 的 total_samples）；
+     * 中止時無論是否端點偵測都送出，讓 Server 丟棄已收音訊；
+     * UDP 模式一律送出（遺失的 frame 可能正是最後一個，Server 無法靠長度判斷結束） */
+    const uint32_t udp_dropped = udp_.dropped();
+    udp_.close();
+    const AudioRingBuffer::ReaderStats ring = audio_.take_reader_stats(AUDIO_READER_STREAMER);
+    const uint32_t ring_lost = (ring.overruns - ring_overruns0) + (audio_.ring().held_drops() - ring_held0);
+    if (ok && (STREAM_ENDPOINTING || cancelled || udp)) {
+#if STREAM_PACING
+        const unsigned pace_min = pacer_.min_window(), pace_backoffs = pacer_.backoffs();
+#else
+        const unsigned pace_min = STREAM_TX_BUFFERS, pace_backoffs = 0;
+#endif
+        char link_json[568];
+        snprintf(link_json, sizeof(link_json),
+                 ",\"link\":{\"rssi\":%d,\"chunk_start\":%zu,\"chunk_end\":%zu,"
+                 "\"chunk_min\":%zu,\"chunk_max\":%zu,\"frames\":%u,"
+                 "\"send_avg_us\":%lld,\"send_max_us\":%lld,\"tx_waits\":%u,"
+                 "\"pace_min\":%u,\"pace_backoffs\":%u,"
+                 "\"resumes\":%u,\"udp_dropped\":%u,\"ring_lag_max\":%u,\"ring_lost\":%u},"
+                 "\"trace\":{\"wake_us\":%lld,\"ack_us\":%lld,\"stream_start_us\":%lld,"
+                 "\"first_frame_us\":%lld,\"first_sent_us\":%lld,\"last_frame_us\":%lld}",
+                 link_.rssi, link_.chunk_start, chunk, link_.chunk_min, link_.chunk_max,
+                 (unsigned)link_.frames,
+                 (long long)(link_.frames ? link_.send_us_total / link_.frames : 0),
+                 (long long)link_.send_us_max, (unsigned)tx_waits, pace_min, pace_backoffs,
+                 (unsigned)link_.resumes,
+                 (unsigned)udp_dropped, (unsigned)ring.max_lag, (unsigned)ring_lost,
+                 (long long)trace->wake_us, (long long)trace->ack_us, (long long)trace->stream_start_us,
+                 (long long)trace->first_frame_us, (long long)trace->first_sent_us,
+                 (long long)trace->last_frame_us);
+        char end_json[688];
+        stream_end_json(end_json, sizeof(end_json), DEVICE_ID, timemgr_.get_timestamp_ms(),
+                        sent / rate_div_, end_reason, link_json);
+        if (!ws_.send_text(end_json, strlen(end_json))) {
+            ESP_LOGE(TAG, "Failed to send audio_end");
             ok = false;
-            break;
         }
-        vTaskDelay(pdMS_TO_TICKS(2)); // 讓 TCP stack 喘氣
     }
 
-    free(buf);
-    if (ok) ESP_LOGI(TAG, "Streamed %zu samples OK", sent);
+    if (ok) ESP_LOGI(TAG, "Streamed %zu samples OK (pre-roll %zu, end=%s, %s, %s, tx_waits=%u)",
+                     sent, preroll, (STREAM_ENDPOINTING || cancelled) ? end_reason : "fixed", audio_format,
+                     udp ? "udp" : "ws", (unsigned)tx_waits);
+    if (udp && udp_dropped) ESP_LOGW(TAG, "UDP: %u frames not sent", (unsigned)udp_dropped);
+#if STREAM_NOISE_SUPPRESS
+    if (ns_active) ESP_LOGI(TAG, "Noise suppression: last frame gain %.2f", ns_.mean_gain());
+#endif
+    ESP_LOGI(TAG, "Link: rssi=%d chunk %zu->%zu [%zu..%zu], send avg=%lld us max=%lld us (%u frames)",
+             link_.rssi, link_.chunk_start, chunk, link_.chunk_min, link_.chunk_max,
+             (long long)(link_.frames ? link_.send_us_total / link_.frames : 0),
+             (long long)link_.send_us_max, (unsigned)link_.frames);
+#if STREAM_PACING
+    if (pacer_.backoffs()) {
+        ESP_LOGI(TAG, "Pacing: in-flight %u..%d, %u back-offs, queue ~%u ms", (unsigned)pacer_.min_window(),
+                 STREAM_TX_BUFFERS, (unsigned)pacer_.backoffs(), (unsigned)(pacer_.queue_us() / 1000));
+    }
+#endif
     return ok;
 }
@@ -8,9 +8,48 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "config.h"
+#include "spsc_channel.h"
+#include "adpcm.h"
 #include "websocket_client.h"
+#include "udp_audio_sender.h"
 #include "audio_capture.h"
 #include "time_manager.h"
+#include "vad.h"
+#include "noise_suppressor.h"
+#include "resampler.h"
+#include "stream_pacer.h"
+#include "stream_protocol.h"
+
+/*
+ * PCM 且不降噪時 payload 就是環形緩衝中的樣本：UDP 上行以 sendmsg 由標頭 + 環形緩衝的
+ * 一或兩段（環繞點前後）組成 datagram，不複製進 slot。WebSocket 仍複製：傳輸層送出時
+ * 就地 mask 資料，而環形緩衝同時被推論 / VAD 讀取。
+ */
+#define STREAM_RING_PAYLOAD (STREAM_CODEC == STREAM_CODEC_PCM && !STREAM_NOISE_SUPPRESS)
+
+/*
+ * 端到端追蹤：trace_id 於喚醒時產生並附在 audio_start，裝置端各階段時間（esp_timer 微秒，
+ * 0 = 未發生）於 audio_end 的 trace 欄位回報，Server 換算為牆鐘後與 ASR / 意圖 / MQTT 併成一條時間線。
+ */
+struct StreamTrace {
+    uint32_t trace_id;
+    int64_t  wake_us;         // 喚醒確認
+    int64_t  session_us;      // Session Task 取得喚醒請求
+    int64_t  ack_us;          // 喚醒 ACK 排入 ACK Task
+    int64_t  stream_start_us; // audio_start 送出（stream() 填入）
+    int64_t  first_frame_us;  // 第一個 frame 排入 TX（stream() 填入）
+    int64_t  first_sent_us;   // 第一個 frame 送出完成（TX Task 記錄，stream() 填入）
+    int64_t  last_frame_us;   // 全部 frame 送完（stream() 填入）
+    float    wake_threshold;  // 觸發時生效的喚醒門檻 / VAD 閾值下限（wake_tuning）
+    float    vad_threshold;
+    uint32_t tuning_version;  // 0 = 編譯期預設
+    uint32_t model_generation; // 生效中的 model 分區映像（0 = 編譯進 app 的權重）
+    uint32_t followup_of;     // 追問視窗內的串流：前一句的 trace_id（0 = 喚醒詞觸發）
+};
 
 class AudioStreamer {
 public:
@@ -22,17 +61,164 @@ public:
     AudioStreamer(WebSocketClient &ws, AudioCapture &audio, TimeManager &timemgr);
 
     /**
-     * 串流指定樣本數的音訊。
-     * @param total_samples  要串流的 PCM 樣本數（int16）
-     * @param confidence     ML 信心度（附帶至 audio_start JSON）
+     * 建立 TX Task 與 frame 佇列（需在 stream() 前呼叫一次）。
+     * @return true = 成功
+     */
+    bool init();
+
+    /**
+     * 串流喚醒點前的 pre-roll 與其後指定樣本數的音訊。
+     * 實際送出的 pre-roll 長度會寫入 audio_start 的 preroll_samples。
+     * STREAM_ENDPOINTING=1 時 command_samples 為上限，偵測到語音結束即提前停止並送出 audio_end。
+     * @param command_samples 喚醒點之後要串流的 PCM 樣本數上限（int16）
+     * @param confidence      ML 信心度（附帶至 audio_start JSON）
+     * @param wake_pos        喚醒確認時的環形緩衝位置（AudioCapture::reader_position）
+     * @param noise_floor     偵測端 VAD 的噪音底（端點偵測起始值，0 = 預設）
+     * @param trace           本次喚醒的追蹤資料（串流各階段時間由此填入；nullptr = 不追蹤）
      * @return true = 全部送出成功
      */
-    bool stream(size_t total_samples, float confidence);
+    bool stream(size_t command_samples, float confidence, uint32_t wake_pos,
+                float noise_floor = 0.0f, StreamTrace *trace = nullptr);
+
+    /**
+     * Server 回覆 audio_resume_ack（由 WebSocket 資料回調呼叫）。
+     * @param received_samples Server 已連續收到的樣本數（自此重送）
+     */
+    void on_resume_ack(uint32_t session_id, bool accepted, uint32_t received_samples);
+
+    enum CancelReason : uint8_t {
+        CANCEL_NONE = 0,
+        CANCEL_LOCAL,    // 指令已在裝置端處理（audio_end reason=local_command）
+        CANCEL_SERVER,   // Server 要求中止，例如其他節點的串流勝出（reason=server_cancel）
+        CANCEL_USER,     // 使用者說了取消詞（reason=user_cancel）
+    };
+
+    /**
+     * 中止串流（可由任一 Task 呼叫）：
+     * stream() 停止送出、送出 audio_end（reason 依 CancelReason）後返回 true。
+     * 旗標保留至 reset_cancel()，串流開始前呼叫亦有效；先到的原因優先。
+     */
+    void cancel(CancelReason reason = CANCEL_LOCAL)
+    {
+        uint8_t none = CANCEL_NONE;
+        cancel_.compare_exchange_strong(none, reason, std::memory_order_acq_rel);
+    }
+    void reset_cancel() { cancel_.store(CANCEL_NONE, std::memory_order_release); }
+
+    /**
+     * 允許 / 暫停串流降噪（推論降級時由推論 Task 呼叫）；下一個 session 開始時生效，
+     * 不在串流中途切換。STREAM_NOISE_SUPPRESS=0 時無作用。
+     */
+    void set_noise_suppression(bool enabled) { ns_allowed_.store(enabled, std::memory_order_relaxed); }
 
 private:
+    static constexpr size_t HDR_BYTES = STREAM_CHUNK_HEADER ? sizeof(StreamChunkHeader) : 0;
+#if STREAM_CODEC == STREAM_CODEC_ADPCM
+    static constexpr size_t PAYLOAD_BYTES = ADPCM_BLOCK_HEADER_BYTES + (STREAM_SLOT_SAMPLES + 1) / 2;
+#else
+    static constexpr size_t PAYLOAD_BYTES = STREAM_SLOT_SAMPLES * sizeof(int16_t);
+#endif
+
+    /** 一個 frame（標頭 + 編碼後 payload）的長度 */
+    static constexpr size_t frame_bytes_(size_t samples)
+    {
+#if STREAM_CODEC == STREAM_CODEC_ADPCM
+        return HDR_BYTES + ADPCM_BLOCK_HEADER_BYTES + (samples + 1) / 2;
+#else
+        return HDR_BYTES + samples * sizeof(int16_t);
+#endif
+    }
+
+    /* 一個待送出的 binary frame（標頭 + payload）；PCM 編碼時 payload 即樣本本身 */
+    struct TxSlot {
+        alignas(4) uint8_t frame[HDR_BYTES + PAYLOAD_BYTES];
+        size_t             len;
+        size_t             samples;
+        int64_t            send_us;   // TX Task 填入的送出耗時（-1 = 尚未送出 / 失敗）
+#if STREAM_RING_PAYLOAD
+        AudioSlice         ring;      // size > 0：payload 在環形緩衝（frame 只有標頭）
+#endif
+    };
+
+    /* 單次串流的鏈路統計（audio_end 的 link 欄位） */
+    struct LinkStats {
+        int      rssi;
+        size_t   chunk_start;
+        size_t   chunk_min;
+        size_t   chunk_max;
+        uint32_t frames;
+        int64_t  send_us_total;
+        int64_t  send_us_max;
+        uint32_t resumes;
+        size_t   chunk_cap;    // chunk 上限（UDP 模式受 datagram 大小限制）
+        /* 目前評估窗 */
+        uint32_t win_frames;
+        int64_t  win_send_us;
+        int64_t  win_audio_us;
+    };
+
     WebSocketClient &ws_;
+    UdpAudioSender   udp_;     // STREAM_UDP：本次串流的 datagram 上行（未開啟 = WebSocket）
     AudioCapture    &audio_;
     TimeManager     &timemgr_;
+    VAD              vad_;     // 端點偵測專用（僅 session Task 使用，與偵測端 VAD 互不干擾）
+#if STREAM_NOISE_SUPPRESS
+    /* 一個 chunk 最多完成的降噪分析幀數 */
+    static constexpr size_t NS_MAX_FRAMES = STREAM_SLOT_SAMPLES / NoiseSuppressor::HOP + 1;
+    NoiseSuppressor  ns_;      // 串流前降噪（僅 session Task 使用）
+#endif
+#if STREAM_LOW_RATE
+    PolyphaseResampler decim_; // 弱訊號串流的 2:1 抽點（SAMPLE_RATE → SAMPLE_RATE / 2）
+#endif
+    int              rate_div_; // 本次串流的抽點倍率（1 = SAMPLE_RATE）；線上的樣本數 / 位置皆已除以此值
+
+    TxSlot            slots_[STREAM_TX_BUFFERS];
+#if STREAM_PACING
+    StreamPacer       pacer_;                      // 在途 frame 上限（僅 session Task 使用）
+    uint8_t           parked_[STREAM_TX_BUFFERS];  // 超出上限、暫不使用的空閒 slot
+    uint8_t           n_parked_;
+#endif
+#if STREAM_CODEC == STREAM_CODEC_ADPCM
+    int16_t           pcm_[STREAM_SLOT_SAMPLES];   // 編碼前的 PCM
+#endif
+    struct ResumeAck {
+        uint32_t session_id;
+        uint32_t received;
+        bool     accepted;
+    };
+
+    QueueHandle_t     free_q_;   // 可填入的 slot 索引
+    SpscChannel<uint8_t, STREAM_TX_BUFFERS> tx_ch_;   // 待送出的 slot 索引（依序；串流 Task → TX Task）
+    QueueHandle_t     resume_q_; // 最新一筆 ResumeAck（長度 1）
+    std::atomic<bool> tx_failed_;
+    std::atomic<uint8_t> cancel_;   // CancelReason
+    std::atomic<int64_t> first_sent_us_;   // 本次串流第一個 frame 送出完成的時間（0 = 尚未）
+    std::atomic<bool>    ns_allowed_;      // set_noise_suppression
+
+    LinkStats         link_;
+
+    static void tx_task_entry_(void *arg);
+    /** 以 UDP datagram 送出一個 slot */
+    bool send_udp_(const TxSlot &slot);
+    /** 依 RSSI 選擇起始 chunk 大小並重置鏈路統計 */
+    size_t begin_link_();
+    /** 記錄歸還 slot 的送出耗時，必要時調整 chunk 大小 */
+    size_t account_send_(const TxSlot &slot, size_t chunk);
+#if STREAM_PACING
+    /** 依 pacer_ 的上限保留 / 放回空閒 slot（free_q_ 的背壓即限制在途 frame 數） */
+    void pace_slots_(size_t *chunk);
+    /** 保留的 slot 全部放回 free_q_ */
+    void unpark_slots_();
+#endif
+    /**
+     * 斷線續傳：重連、送出 audio_resume 並等待 Server 回報已收樣本數，
+     * 將串流游標移回 start_pos + 已收樣本數。
+     * @param sent [in/out] 續傳位置（樣本偏移）
+     * @return false = 無法續傳，串流應中止
+     */
+    bool resume_(uint32_t session_id, uint32_t next_seq, uint32_t start_pos, size_t *sent);
+    /** 等待所有在途 frame 送完（audio_end 需在最後一個 frame 之後） */
+    bool drain_tx_();
 };
 
 #endif // AUDIO_STREAMER_H
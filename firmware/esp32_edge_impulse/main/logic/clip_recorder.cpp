@@ -0,0 +1,270 @@
+/*
+ * clip_recorder.cpp - 誤觸發錄音實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "clip_recorder.h"
+#include "rtos_alloc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_spiffs.h"
+#include "esp_http_client.h"
+#include "freertos/task.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *TAG = "ClipRec";
+
+static_assert(CLIP_SAMPLES <= AUDIO_RING_SAMPLES * 7 / 8 - AUDIO_RING_SAMPLES / 8,
+              "CLIP_MS too long to copy out of the capture ring before it is overwritten");
+
+ClipRecorder::ClipRecorder(AudioCapture &audio, WebSocketClient &ws)
+    : audio_(audio), ws_(ws), q_(nullptr), ready_(false), busy_(false),
+      last_near_miss_us_(0), last_activity_us_(0), first_index_(0), next_index_(0),
+      pending_len_(0), pending_trace_(0)
+{}
+
+bool ClipRecorder::init()
+{
+    if (q_) return ready_;
+
+    esp_vfs_spiffs_conf_t conf = {};
+    conf.base_path              = CLIP_MOUNT_PATH;
+    conf.partition_label        = CLIP_PARTITION_LABEL;
+    conf.max_files              = 2;
+    conf.format_if_mount_failed = true;
+    esp_err_t err = esp_vfs_spiffs_register(&conf);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Mount %s failed: %s", CLIP_PARTITION_LABEL, esp_err_to_name(err));
+        return false;
+    }
+    scan_();
+
+    q_ = RTOS_QUEUE_CREATE(4, sizeof(Request));
+    if (!q_ ||
+        RTOS_TASK_CREATE(task_entry_, "clip_rec", CLIP_TASK_STACK, this,
+                         CLIP_TASK_PRIO, nullptr, CLIP_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start clip task");
+        return false;
+    }
+    ready_ = true;
+    ESP_LOGI(TAG, "Clip recorder ready: %lu clip(s) waiting for upload",
+             (unsigned long)(next_index_ - first_index_));
+    return true;
+}
+
+/* ---------- 推論 / worker Task 端（只排入請求） ---------- */
+
+void ClipRecorder::post_(const Request &req)
+{
+    if (!ready_) return;
+    if (xQueueSend(q_, &req, 0) != pdTRUE) ESP_LOGW(TAG, "Queue full, clip request dropped");
+}
+
+void ClipRecorder::on_near_miss(uint32_t end_pos, float confidence)
+{
+    int64_t now = esp_timer_get_time();
+    if (last_near_miss_us_ != 0 && now - last_near_miss_us_ < (int64_t)CLIP_COOLDOWN_MS * 1000) return;
+    last_near_miss_us_ = now;
+    post_({ OP_NEAR_MISS, end_pos, confidence, 0, (uint32_t)time(nullptr) });
+}
+
+void ClipRecorder::on_wake(uint32_t end_pos, float confidence, uint32_t trace_id)
+{
+    post_({ OP_WAKE, end_pos, confidence, trace_id, (uint32_t)time(nullptr) });
+}
+
+void ClipRecorder::on_false_wake(uint32_t trace_id)
+{
+    post_({ OP_FALSE_WAKE, 0, 0.0f, trace_id, 0 });
+}
+
+/* ---------- 錄音 Task ---------- */
+
+void ClipRecorder::task_entry_(void *arg)
+{
+    static_cast<ClipRecorder *>(arg)->loop_();
+}
+
+void ClipRecorder::loop_()
+{
+    Request req;
+    while (1) {
+        if (xQueueReceive(q_, &req, pdMS_TO_TICKS(CLIP_UPLOAD_IDLE_MS)) != pdTRUE) {
+            /* 閒置：一次上傳一個，下一個等下一輪（不與喚醒 / 串流搶頻寬） */
+            if (!busy_.load(std::memory_order_relaxed) && first_index_ != next_index_ &&
+                esp_timer_get_time() - last_activity_us_ >= (int64_t)CLIP_UPLOAD_IDLE_MS * 1000 &&
+                ws_.is_connected()) {
+                vTaskPrioritySet(nullptr, 1);
+                upload_oldest_();
+                vTaskPrioritySet(nullptr, CLIP_TASK_PRIO);
+            }
+            continue;
+        }
+        last_activity_us_ = esp_timer_get_time();
+
+        switch (req.op) {
+            case OP_NEAR_MISS: {
+                size_t len = encode_(req, CLIP_NEAR_MISS, work_);
+                if (len > 0 && write_(work_, len)) {
+                    ESP_LOGI(TAG, "Near-miss clip saved (conf=%.3f)", req.confidence);
+                }
+                break;
+            }
+            case OP_WAKE:
+                pending_len_   = encode_(req, CLIP_FALSE_WAKE, pending_);
+                pending_trace_ = req.trace_id;
+                break;
+            case OP_FALSE_WAKE:
+                if (pending_len_ == 0 || pending_trace_ != req.trace_id) {
+                    ESP_LOGD(TAG, "False wake %08lx: no matching clip", (unsigned long)req.trace_id);
+                    break;
+                }
+                if (write_(pending_, pending_len_)) {
+                    ESP_LOGI(TAG, "False-wake clip saved (trace %08lx)", (unsigned long)req.trace_id);
+                }
+                pending_len_ = 0;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+size_t ClipRecorder::encode_(const Request &req, ClipKind kind, uint8_t *out)
+{
+    AudioSlice slice;
+    if (!audio_.slice_at(req.end_pos - CLIP_SAMPLES, CLIP_SAMPLES, &slice)) {
+        ESP_LOGW(TAG, "Clip range no longer in the capture ring");
+        return 0;
+    }
+
+    ClipHeader hdr = {};
+    memcpy(hdr.magic, "MCLP", 4);
+    hdr.version       = 1;
+    hdr.kind          = kind;
+    hdr.sample_rate   = SAMPLE_RATE;
+    hdr.samples       = CLIP_SAMPLES;
+    hdr.confidence    = req.confidence;
+    hdr.trace_id      = req.trace_id;
+    hdr.unix_time     = req.unix_time > 1000000000u ? req.unix_time : 0;   // 未校時的牆鐘不可信
+    hdr.block_samples = CLIP_BLOCK_SAMPLES;
+    memcpy(out, &hdr, sizeof(hdr));
+    size_t len = sizeof(hdr);
+
+    /* 逐區塊自環形緩衝複製（環繞時分兩段）後編碼，狀態跨區塊延續 */
+    AdpcmState state;
+    adpcm_reset(&state);
+    size_t seg = 0, off = 0;
+    for (size_t done = 0; done < CLIP_SAMPLES;) {
+        size_t n = CLIP_SAMPLES - done < CLIP_BLOCK_SAMPLES ? CLIP_SAMPLES - done : CLIP_BLOCK_SAMPLES;
+        for (size_t i = 0; i < n; i++) {
+            if (off == slice.len[seg]) { seg++; off = 0; }
+            block_[i] = slice.seg[seg][off++];
+        }
+        len  += adpcm_encode_block(block_, n, &state, out + len);
+        done += n;
+    }
+
+    /* 編碼期間生產者持續寫入：確認起點仍未被覆寫 */
+    if (!audio_.slice_valid(slice)) {
+        ESP_LOGW(TAG, "Capture ring overran the clip, discarded");
+        return 0;
+    }
+    return len;
+}
+
+/* ---------- clips 分區 ---------- */
+
+void ClipRecorder::path_(uint32_t index, char *out, size_t cap) const
+{
+    snprintf(out, cap, CLIP_MOUNT_PATH "/c%06lu.bin", (unsigned long)index);
+}
+
+void ClipRecorder::scan_()
+{
+    /* 檔名編號連續遞增：最小者最舊、最大者 + 1 為下一個 */
+    first_index_ = UINT32_MAX;
+    next_index_  = 0;
+    DIR *dir = opendir(CLIP_MOUNT_PATH);
+    if (dir) {
+        struct dirent *e;
+        while ((e = readdir(dir)) != nullptr) {
+            unsigned long index;
+            if (sscanf(e->d_name, "c%lu.bin", &index) != 1) continue;
+            if (index < first_index_) first_index_ = (uint32_t)index;
+            if (index + 1 > next_index_) next_index_ = (uint32_t)index + 1;
+        }
+        closedir(dir);
+    }
+    if (first_index_ == UINT32_MAX) first_index_ = next_index_;
+}
+
+bool ClipRecorder::write_(const uint8_t *data, size_t len)
+{
+    char path[32];
+    while (next_index_ - first_index_ >= CLIP_MAX_FILES) {
+        path_(first_index_++, path, sizeof(path));
+        unlink(path);
+        ESP_LOGW(TAG, "Clip store full, dropped oldest");
+    }
+
+    path_(next_index_, path, sizeof(path));
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "Open %s failed", path);
+        return false;
+    }
+    bool ok = fwrite(data, 1, len, f) == len;
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        ESP_LOGE(TAG, "Write %s failed (partition full?)", path);
+        unlink(path);
+        return false;
+    }
+    next_index_++;
+    return true;
+}
+
+bool ClipRecorder::upload_oldest_()
+{
+    char path[32];
+    path_(first_index_, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        first_index_++;   // 缺號（寫入失敗後殘留的編號）
+        return false;
+    }
+    size_t len = fread(work_, 1, sizeof(work_), f);
+    fclose(f);
+
+    char url[96];
+    if (len < sizeof(ClipHeader) || !ws_.http_url(CLIP_UPLOAD_PATH, url, sizeof(url))) return false;
+
+    esp_http_client_config_t cfg = {};
+    cfg.url        = url;
+    cfg.method     = HTTP_METHOD_POST;
+    cfg.timeout_ms = CLIP_UPLOAD_TIMEOUT_MS;
+    ws_.apply_tls(cfg);
+    esp_http_client_handle_t http = esp_http_client_init(&cfg);
+    if (!http) return false;
+    esp_http_client_set_header(http, "Content-Type", "application/octet-stream");
+    esp_http_client_set_post_field(http, (const char *)work_, (int)len);
+    esp_err_t err    = esp_http_client_perform(http);
+    int       status = esp_http_client_get_status_code(http);
+    esp_http_client_cleanup(http);
+
+    if (err != ESP_OK || status != 200) {
+        ESP_LOGW(TAG, "Upload %s failed: %s (HTTP %d)", path, esp_err_to_name(err), status);
+        return false;
+    }
+    unlink(path);
+    first_index_++;
+    ESP_LOGI(TAG, "Uploaded %s (%u bytes), %lu left", path, (unsigned)len,
+             (unsigned long)(next_index_ - first_index_));
+    return true;
+}
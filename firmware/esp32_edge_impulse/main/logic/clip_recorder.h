@@ -0,0 +1,109 @@
+#ifndef CLIP_RECORDER_H
+#define CLIP_RECORDER_H
+
+/* ============================================================
+ * clip_recorder.h - 誤觸發錄音（重新訓練喚醒詞模型的資料集）
+ * ESP-MIAO v0.8.0
+ *
+ * 推論 Task 只排入請求（環形緩衝位置）即返回；錄音 Task 從環形緩衝取出觸發點前
+ * CLIP_SAMPLES 個樣本，編碼為 IMA-ADPCM 後寫入 clips 分區：
+ *   - 漏喚醒候選（near miss）：信心值落在門檻下方的區間，直接寫檔
+ *   - 喚醒：先編碼保留在 RAM，Server 以 false_wake（同 trace_id）判定誤喚醒時才寫檔
+ * 閒置 CLIP_UPLOAD_IDLE_MS 後以 HTTP POST 逐一上傳（Server clips.py），成功即刪除。
+ *
+ * 檔案格式（little-endian）：
+ *   ClipHeader（28 bytes）+ ceil(samples / block_samples) 個 ADPCM 區塊（adpcm.h 格式）
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "audio_capture.h"
+#include "adpcm.h"
+#include "websocket_client.h"
+#include "config.h"
+
+enum ClipKind : uint8_t {
+    CLIP_NEAR_MISS  = 0,   // 信心值接近門檻但未喚醒（漏喚醒候選）
+    CLIP_FALSE_WAKE = 1,   // 喚醒後 Server 判定為誤喚醒
+};
+
+#pragma pack(push, 1)
+struct ClipHeader {
+    char     magic[4];        // "MCLP"
+    uint8_t  version;         // 1
+    uint8_t  kind;            // ClipKind
+    uint16_t sample_rate;
+    uint32_t samples;
+    float    confidence;      // 觸發時的平滑信心值
+    uint32_t trace_id;        // 喚醒的 trace_id（near miss 為 0）
+    uint32_t unix_time;       // 觸發時間（未校時為 0）
+    uint16_t block_samples;
+    uint16_t reserved;
+};
+#pragma pack(pop)
+static_assert(sizeof(ClipHeader) == 28, "ClipHeader layout is shared with the server");
+
+class ClipRecorder {
+public:
+    ClipRecorder(AudioCapture &audio, WebSocketClient &ws);
+
+    /** 掛載 clips 分區、建立錄音 Task；失敗時之後的請求皆忽略 */
+    bool init();
+
+    /** 漏喚醒候選：錄下 end_pos 之前的 CLIP_SAMPLES（CLIP_COOLDOWN_MS 內只錄一次） */
+    void on_near_miss(uint32_t end_pos, float confidence);
+
+    /** 喚醒：編碼保留在 RAM，等待 Server 判定（新的喚醒取代舊的） */
+    void on_wake(uint32_t end_pos, float confidence, uint32_t trace_id);
+
+    /** Server 判定 trace_id 為誤喚醒：保留的片段寫入 flash */
+    void on_false_wake(uint32_t trace_id);
+
+    /** 喚醒 session 進行中不上傳（推論 Task 每切片更新） */
+    void set_busy(bool busy) { busy_.store(busy, std::memory_order_relaxed); }
+
+private:
+    struct Request {
+        uint8_t  op;           // Op
+        uint32_t end_pos;
+        float    confidence;
+        uint32_t trace_id;
+        uint32_t unix_time;
+    };
+    enum Op : uint8_t { OP_NEAR_MISS, OP_WAKE, OP_FALSE_WAKE };
+
+    static constexpr size_t BLOCKS    = (CLIP_SAMPLES + CLIP_BLOCK_SAMPLES - 1) / CLIP_BLOCK_SAMPLES;
+    static constexpr size_t MAX_BYTES = sizeof(ClipHeader) + BLOCKS * ADPCM_BLOCK_HEADER_BYTES +
+                                        (CLIP_SAMPLES + BLOCKS) / 2;
+
+    AudioCapture     &audio_;
+    WebSocketClient  &ws_;
+    QueueHandle_t     q_;
+    bool              ready_;
+    std::atomic<bool> busy_;
+    int64_t           last_near_miss_us_;   // 推論 Task 專用
+    int64_t           last_activity_us_;    // 錄音 Task 專用
+    uint32_t          first_index_;         // clips 分區內最舊 / 下一個檔案編號
+    uint32_t          next_index_;
+
+    /* 錄音 Task 專用 */
+    int16_t           block_[CLIP_BLOCK_SAMPLES];
+    uint8_t           work_[MAX_BYTES];     // 編碼 / 上傳緩衝
+    uint8_t           pending_[MAX_BYTES];  // 等待 Server 判定的最近一次喚醒
+    size_t            pending_len_;
+    uint32_t          pending_trace_;
+
+    static void task_entry_(void *arg);
+    void        loop_();
+    void        post_(const Request &req);
+    size_t      encode_(const Request &req, ClipKind kind, uint8_t *out);
+    bool        write_(const uint8_t *data, size_t len);
+    bool        upload_oldest_();
+    void        scan_();
+    void        path_(uint32_t index, char *out, size_t cap) const;
+};
+
+#endif // CLIP_RECORDER_H
@@ -0,0 +1,66 @@
+/*
+ * continuous_gate.cpp - 連續串流的 VAD 閘門與頻寬限制實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "continuous_gate.h"
+
+static const int32_t kNoSpeech = INT32_MIN / 2;
+
+ContinuousGate::ContinuousGate()
+{
+    configure(0, 0, 0, 0);
+}
+
+void ContinuousGate::configure(int preroll, int hangover, uint32_t bytes_per_s, uint32_t burst_s)
+{
+    preroll_       = preroll > 0 ? preroll : 0;
+    hangover_      = hangover > 0 ? hangover : 0;
+    rate_          = bytes_per_s;
+    capacity_      = (int64_t)bytes_per_s * (burst_s ? burst_s : 1) * 1000000;
+    tokens_        = capacity_;   // 開啟時即可送出一整段突發
+    last_us_       = -1;
+    throttled_     = false;
+    sent_bytes_    = 0;
+    dropped_bytes_ = 0;
+    reset();
+}
+
+void ContinuousGate::reset()
+{
+    index_       = 0;
+    last_speech_ = kNoSpeech;
+}
+
+int ContinuousGate::push(bool speech)
+{
+    int32_t i = index_++;
+    if (speech) last_speech_ = i;
+    int32_t j = i - preroll_;
+    if (j < 0) return -1;
+    return last_speech_ >= j - hangover_ ? 1 : 0;
+}
+
+bool ContinuousGate::take(uint32_t bytes, int64_t now_us)
+{
+    if (rate_ == 0) {
+        sent_bytes_ += bytes;
+        return true;
+    }
+    if (last_us_ >= 0 && now_us > last_us_) {
+        tokens_ += (now_us - last_us_) * rate_;
+        if (tokens_ > capacity_) tokens_ = capacity_;
+    }
+    last_us_ = now_us;
+
+    const int64_t cost = (int64_t)bytes * 1000000;
+    if (throttled_ && tokens_ >= capacity_ / 2) throttled_ = false;
+    if (!throttled_ && tokens_ < cost) throttled_ = true;
+    if (throttled_) {
+        dropped_bytes_ += bytes;
+        return false;
+    }
+    tokens_ -= cost;
+    sent_bytes_ += bytes;
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef CONTINUOUS_GATE_H
+#define CONTINUOUS_GATE_H
+
+/* ============================================================
+ * continuous_gate.h - 連續串流的 VAD 閘門與頻寬限制
+ * ESP-MIAO v0.8.0
+ *
+ * 閘門：每個切片推入 VAD 結果，延遲 preroll 個切片後決定是否送出：
+ *   切片 j 送出 ⇔ [j - hangover, j + preroll] 內任一切片為語音
+ * 也就是語音前補 preroll 片、語音後續送 hangover 片。
+ * 頻寬：token bucket，平均 bytes_per_s、容量 burst_s 秒；token 不足即開始丟棄，
+ * 回補到容量一半才恢復（避免在門檻附近一個 frame 送、一個 frame 丟）。
+ * 純計算、無 RTOS 相依（主機測試直接使用）。
+ * ============================================================ */
+
+#include <stdint.h>
+
+class ContinuousGate {
+public:
+    ContinuousGate();
+
+    /**
+     * @param preroll     語音開始前補送的切片數
+     * @param hangover    語音結束後續送的切片數
+     * @param bytes_per_s 平均頻寬上限，0 = 不限
+     * @param burst_s     token bucket 容量（秒）
+     */
+    void configure(int preroll, int hangover, uint32_t bytes_per_s, uint32_t burst_s);
+
+    /** 清除切片歷史（頻寬狀態保留） */
+    void reset();
+
+    /**
+     * 推入最新切片的 VAD 結果。
+     * @return 1 = 送出 preroll 個切片之前的那一片，0 = 不送，-1 = 尚未累積 preroll 片
+     */
+    int push(bool speech);
+
+    /**
+     * 要送出 bytes 個 byte：token 足夠則扣除。
+     * @param now_us 單調時間（esp_timer_get_time）
+     * @return false = 超出頻寬，丟棄
+     */
+    bool take(uint32_t bytes, int64_t now_us);
+
+    bool     throttled() const { return throttled_; }
+    uint32_t sent_bytes() const { return sent_bytes_; }
+    uint32_t dropped_bytes() const { return dropped_bytes_; }
+
+private:
+    int      preroll_;
+    int      hangover_;
+    int32_t  index_;         // 已推入的切片數
+    int32_t  last_speech_;   // 最近一個語音切片的索引
+    int64_t  rate_;          // bytes / s
+    int64_t  capacity_;      // byte·µs
+    int64_t  tokens_;        // byte·µs
+    int64_t  last_us_;
+    bool     throttled_;
+    uint32_t sent_bytes_;
+    uint32_t dropped_bytes_;
+};
+
+#endif // CONTINUOUS_GATE_H
@@ -0,0 +1,225 @@
+/*
+ * continuous_streamer.cpp - 連續串流（Server 端喚醒）實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "continuous_streamer.h"
+#include "rtos_alloc.h"
+#include "adpcm.h"
+#include "stream_protocol.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "Continuous";
+
+ContinuousStreamer::ContinuousStreamer(AudioCapture &audio, WebSocketClient &ws)
+    : audio_(audio), ws_(ws), task_(nullptr), enabled_(false), serving_(false),
+      config_seen_(0), overflows_base_(0), pushed_(0), session_id_(0), seq_(0), base_pos_(0),
+      based_(false), lost_frames_(0), sent_frames_(0), last_stats_us_(0)
+{}
+
+bool ContinuousStreamer::init()
+{
+    if (!CONTINUOUS_STREAM || task_) return true;
+    if (RTOS_TASK_CREATE(task_entry_, "continuous", CONTINUOUS_TASK_STACK, this,
+                         CONTINUOUS_TASK_PRIO, &task_, CONTINUOUS_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start continuous stream task");
+        return false;
+    }
+    spsc_channel_register("continuous", &ch_);
+    return true;
+}
+
+void ContinuousStreamer::configure(bool enable, uint16_t max_kbps, bool confirm)
+{
+    if (!task_) return;
+    Msg msg = {};
+    msg.kind     = MSG_CONFIG;
+    msg.flag     = enable;
+    msg.confirm  = confirm;
+    msg.max_kbps = max_kbps;
+    /* 關閉立即生效：推論 Task 不再送切片進來 */
+    if (!enable) enabled_.store(false, std::memory_order_relaxed);
+    /* 連續多筆設定只需套用最後一筆，不必排隊等串流 Task */
+    config_.write(msg);
+    xTaskNotifyGive(task_);
+}
+
+void ContinuousStreamer::on_slice(uint32_t pos, uint32_t samples, bool speech)
+{
+    if (!task_ || !enabled_.load(std::memory_order_relaxed)) return;
+    Msg msg = {};
+    msg.kind    = MSG_SLICE;
+    msg.flag    = speech;
+    msg.pos     = pos;
+    msg.samples = samples;
+    ch_.push(msg);   // 滿時計入 ch_.dropped()
+}
+
+void ContinuousStreamer::hint(float confidence, uint32_t pos)
+{
+    if (!task_ || !enabled_.load(std::memory_order_relaxed)) return;
+    Msg msg = {};
+    msg.kind       = MSG_HINT;
+    msg.pos        = pos;
+    msg.confidence = confidence;
+    ch_.push(msg);
+}
+
+/* ---------- 串流 Task ---------- */
+
+void ContinuousStreamer::task_entry_(void *arg)
+{
+    auto *self = static_cast<ContinuousStreamer *>(arg);
+    Msg   msg;
+    self->ch_.set_consumer(xTaskGetCurrentTaskHandle());
+    while (1) {
+        self->poll_config_();
+        if (!self->ch_.pop_wait(&msg, pdMS_TO_TICKS(1000))) {
+            self->log_stats_(false);
+            continue;
+        }
+        switch (msg.kind) {
+        case MSG_SLICE:  self->handle_slice_(msg); break;
+        case MSG_HINT:   self->send_hint_(msg); break;
+        default:         break;
+        }
+        self->log_stats_(false);
+    }
+}
+
+void ContinuousStreamer::poll_config_()
+{
+    uint32_t version = config_.version();
+    if (version == config_seen_) return;
+    Msg msg;
+    if (!config_.read(&msg)) return;   // 寫入中：下一輪再套用
+    config_seen_ = version;
+    apply_config_(msg);
+}
+
+void ContinuousStreamer::apply_config_(const Msg &msg)
+{
+    if (serving_.load(std::memory_order_relaxed) || udp_.is_open()) log_stats_(true);
+    serving_.store(false, std::memory_order_relaxed);
+    udp_.close();
+    if (!msg.flag) {
+        enabled_.store(false, std::memory_order_relaxed);
+        ESP_LOGI(TAG, "Continuous streaming off");
+        return;
+    }
+
+    char ip[16];
+    if (!ws_.server_ip(ip, sizeof(ip)) || !udp_.open(ip, STREAM_UDP_PORT)) {
+        enabled_.store(false, std::memory_order_relaxed);
+        ESP_LOGE(TAG, "UDP uplink unavailable, continuous streaming not started");
+        return;
+    }
+    gate_.configure(CONTINUOUS_PREROLL_SLICES, CONTINUOUS_HANGOVER_SLICES,
+                    (uint32_t)msg.max_kbps * 1000 / 8, CONTINUOUS_BURST_S);
+    session_id_  = esp_random();
+    seq_         = 0;
+    pushed_      = 0;
+    based_       = false;
+    lost_frames_ = 0;
+    sent_frames_ = 0;
+    overflows_base_ = ch_.dropped();
+
+    char json[256];
+    int  len = snprintf(json, sizeof(json),
+                        "{\"device_id\":\"%s\",\"timestamp\":%lld,\"type\":\"continuous_start\","
+                        "\"payload\":{\"session_id\":%lu,\"audio_format\":\"adpcm_16k_4bit\","
+                        "\"sample_rate\":%d,\"frame_samples\":%d,\"timer_us\":%lld}}",
+                        DEVICE_ID, (long long)(esp_timer_get_time() / 1000), (unsigned long)session_id_,
+                        SAMPLE_RATE, CONTINUOUS_FRAME_SAMPLES, (long long)esp_timer_get_time());
+    if (!ws_.send_text(json, (size_t)len, pdMS_TO_TICKS(WAKE_ACK_WS_TIMEOUT_MS))) {
+        /* Server 重連後會再送 continuous */
+        udp_.close();
+        enabled_.store(false, std::memory_order_relaxed);
+        ESP_LOGW(TAG, "continuous_start not sent");
+        return;
+    }
+    enabled_.store(true, std::memory_order_relaxed);
+    serving_.store(true, std::memory_order_relaxed);
+    last_stats_us_ = esp_timer_get_time();
+    ESP_LOGI(TAG, "Continuous streaming on: session %08lx, %u kbps cap%s", (unsigned long)session_id_,
+             (unsigned)msg.max_kbps, msg.confirm ? ", local confirmation" : "");
+}
+
+void ContinuousStreamer::handle_slice_(const Msg &msg)
+{
+    if (!udp_.is_open()) return;
+    if (!based_) {
+        base_pos_ = msg.pos;
+        based_    = true;
+    }
+    delay_[pushed_++ % (CONTINUOUS_PREROLL_SLICES + 1)] = { msg.pos, msg.samples };
+    /* 決定的是 preroll 片之前那一片，即延遲線中最舊的一格 */
+    if (gate_.push(msg.flag) == 1) {
+        send_slice_(delay_[pushed_ % (CONTINUOUS_PREROLL_SLICES + 1)]);
+    }
+}
+
+void ContinuousStreamer::send_slice_(const Pending &slice)
+{
+    static int16_t pcm[CONTINUOUS_FRAME_SAMPLES];
+    static uint8_t frame[sizeof(StreamChunkHeader) + ADPCM_BLOCK_HEADER_BYTES + CONTINUOUS_FRAME_SAMPLES / 2];
+
+    for (uint32_t off = 0; off < slice.samples; off += CONTINUOUS_FRAME_SAMPLES) {
+        const uint32_t pos = slice.pos + off;
+        const size_t   n   = slice.samples - off < CONTINUOUS_FRAME_SAMPLES ? slice.samples - off
+                                                                             : CONTINUOUS_FRAME_SAMPLES;
+        AudioSlice view;
+        if (!audio_.slice_at(pos, n, &view)) {
+            lost_frames_++;   // 已被覆寫：Server 依 sample_offset 視為缺口
+            continue;
+        }
+        memcpy(pcm, view.seg[0], view.len[0] * sizeof(int16_t));
+        if (view.len[1]) memcpy(pcm + view.len[0], view.seg[1], view.len[1] * sizeof(int16_t));
+
+        /* 每個 frame 獨立解碼：遺失或被閘門切開都不影響下一段 */
+        AdpcmState adpcm;
+        adpcm_reset(&adpcm);
+        const size_t body = adpcm_encode_block(pcm, n, &adpcm, frame + sizeof(StreamChunkHeader));
+        if (!gate_.take((uint32_t)(sizeof(StreamChunkHeader) + body), esp_timer_get_time())) continue;
+
+        StreamChunkHeader hdr = {};
+        hdr.seq           = seq_++;
+        hdr.session_id    = session_id_;
+        hdr.sample_offset = pos - base_pos_;
+        audio_.stamp_at(pos, &hdr.block_seq, &hdr.capture_us);
+        memcpy(frame, &hdr, sizeof(hdr));
+        if (udp_.send(frame, sizeof(hdr) + body)) sent_frames_++;
+    }
+}
+
+void ContinuousStreamer::send_hint_(const Msg &msg)
+{
+    if (!serving_.load(std::memory_order_relaxed)) return;
+    char json[192];
+    int  len = snprintf(json, sizeof(json),
+                        "{\"device_id\":\"%s\",\"timestamp\":%lld,\"type\":\"wake_hint\","
+                        "\"payload\":{\"session_id\":%lu,\"confidence\":%.3f,\"sample_offset\":%lu}}",
+                        DEVICE_ID, (long long)(esp_timer_get_time() / 1000), (unsigned long)session_id_,
+                        msg.confidence, (unsigned long)(based_ ? msg.pos - base_pos_ : 0));
+    if (!ws_.send_text(json, (size_t)len, pdMS_TO_TICKS(WAKE_ACK_WS_TIMEOUT_MS))) {
+        ESP_LOGW(TAG, "wake_hint not sent");
+    }
+}
+
+void ContinuousStreamer::log_stats_(bool force)
+{
+    if (!udp_.is_open()) return;
+    int64_t now = esp_timer_get_time();
+    if (!force && now - last_stats_us_ < (int64_t)CONTINUOUS_STATS_INTERVAL_S * 1000000) return;
+    last_stats_us_ = now;
+    ESP_LOGI(TAG, "Continuous: %lu frames, %lu B sent, %lu B over cap, %lu lost, %lu slices skipped, "
+             "%lu UDP drops%s",
+             (unsigned long)sent_frames_, (unsigned long)gate_.sent_bytes(),
+             (unsigned long)gate_.dropped_bytes(), (unsigned long)lost_frames_,
+             (unsigned long)(ch_.dropped() - overflows_base_), (unsigned long)udp_.dropped(),
+             gate_.throttled() ? " (throttled)" : "");
+}
@@ -0,0 +1,117 @@
+#ifndef CONTINUOUS_STREAMER_H
+#define CONTINUOUS_STREAMER_H
+
+/* ============================================================
+ * continuous_streamer.h - 連續串流（Server 端喚醒）
+ * ESP-MIAO v0.8.0
+ *
+ * Server 送來 continuous（enable）後，推論 Task 每處理一個切片就把
+ * 位置與 VAD 結果交給這裡；串流 Task 經 ContinuousGate 延遲 / 篩選後，
+ * 直接從擷取環形緩衝讀取語音切片，以 CONTINUOUS_FRAME_SAMPLES 為單位
+ * 編成 ADPCM，加上 StreamChunkHeader（sample_offset 自開啟起連續計算，
+ * 中間沒送的靜音也算在內，Server 以此切分語句）經 UDP 送出。
+ * 開啟時另以 WebSocket 送 continuous_start（session_id / 格式），Server 以
+ * session_id 對應 datagram；每次重連 Server 會重送 continuous，即換新的 session。
+ * 串流 Task 是唯一讀寫串流狀態者：切片與喚醒提示（都來自推論 Task）經 SPSC 通道交接，
+ * 設定只取最新一筆，經 seqlock 發布後以 Task notification 喚醒串流 Task。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "config.h"
+#include "spsc_channel.h"
+#include "seqlock.h"
+#include "audio_capture.h"
+#include "websocket_client.h"
+#include "udp_audio_sender.h"
+#include "continuous_gate.h"
+
+class ContinuousStreamer {
+public:
+    ContinuousStreamer(AudioCapture &audio, WebSocketClient &ws);
+
+    /**
+     * 建立串流 Task（CONTINUOUS_STREAM=0 時不動作）。
+     * @return true = 成功或已停用
+     */
+    bool init();
+
+    /**
+     * Server 的 continuous 設定（Server 動作 Task 呼叫，不阻塞）。
+     * @param enable   開啟 / 關閉
+     * @param max_kbps 平均上行頻寬上限，0 = 不限
+     * @param confirm  Server 需要本地喚醒詞確認（僅記錄於 log）
+     */
+    void configure(bool enable, uint16_t max_kbps, bool confirm);
+
+    /**
+     * 推論 Task 處理完一個切片（不阻塞；通道滿時該切片視為靜音）。
+     * @param pos     切片第一個樣本的絕對位置
+     * @param samples 切片樣本數
+     * @param speech  VAD 判為語音（session 進行中呼叫端傳 false）
+     */
+    void on_slice(uint32_t pos, uint32_t samples, bool speech);
+
+    /** 本地喚醒詞觸發：送出 wake_hint（不阻塞） */
+    void hint(float confidence, uint32_t pos);
+
+    /** 已開啟（低功耗聆聽須暫停） */
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    /** Server 正在處理喚醒：本地喚醒詞只送 wake_hint，不另開 session */
+    bool serving() const { return serving_.load(std::memory_order_relaxed) && ws_.is_connected(); }
+
+private:
+    enum MsgKind : uint8_t { MSG_CONFIG, MSG_SLICE, MSG_HINT };
+
+    struct Msg {
+        MsgKind  kind;
+        bool     flag;        // CONFIG: enable；SLICE: speech
+        bool     confirm;
+        uint16_t max_kbps;
+        uint32_t pos;
+        uint32_t samples;
+        float    confidence;
+    };
+
+    struct Pending {
+        uint32_t pos;
+        uint32_t samples;
+    };
+
+    AudioCapture     &audio_;
+    WebSocketClient  &ws_;
+    TaskHandle_t      task_;
+    SpscChannel<Msg, CONTINUOUS_QUEUE_LEN> ch_;   // 切片 / 喚醒提示（推論 Task → 串流 Task）
+    Seqlock<Msg>      config_;                    // 最新的 CONFIG（Server 動作 Task 寫入）
+    std::atomic<bool> enabled_;
+    std::atomic<bool> serving_;
+
+    /* 以下僅串流 Task 使用 */
+    UdpAudioSender udp_;
+    ContinuousGate gate_;
+    Pending        delay_[CONTINUOUS_PREROLL_SLICES + 1];
+    uint32_t       config_seen_;     // 已套用的 config_ 版本
+    uint32_t       overflows_base_;  // 本 session 開始時的 ch_.dropped()（通道已滿而略過的切片）
+    uint32_t       pushed_;
+    uint32_t       session_id_;
+    uint32_t       seq_;
+    uint32_t       base_pos_;
+    bool           based_;
+    uint32_t       lost_frames_;   // 音訊已被覆寫（串流 Task 落後）
+    uint32_t       sent_frames_;
+    int64_t        last_stats_us_;
+
+    static void task_entry_(void *arg);
+    void        poll_config_();
+    void        apply_config_(const Msg &msg);
+    void        handle_slice_(const Msg &msg);
+    void        send_slice_(const Pending &slice);
+    void        send_hint_(const Msg &msg);
+    void        log_stats_(bool force);
+};
+
+#endif // CONTINUOUS_STREAMER_H
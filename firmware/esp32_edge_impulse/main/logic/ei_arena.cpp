@@ -0,0 +1,122 @@
+/*
+ * ei_arena.cpp - Edge Impulse SDK 專用配置區實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "ei_arena.h"
+#include "config.h"
+#include "contention.h"
+
+#if EI_ARENA
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "model-parameters/model_metadata.h"
+#include "edge-impulse-sdk/porting/ei_classifier_porting.h"
+#include <string.h>
+
+static const char *TAG = "EiArena";
+
+static constexpr size_t ALIGN = 16;   // 同 SDK tensor arena 對齊，float / 向量化載入皆安全
+
+/* 每個區塊前的標頭：區塊大小（含標頭）、下方區塊的位移、是否已釋放 */
+struct BlockHeader {
+    uint32_t size;
+    uint32_t prev;    // 下方區塊的標頭位移；NO_BLOCK = 最底層
+    uint32_t freed;
+    uint32_t reserved;
+};
+static_assert(sizeof(BlockHeader) % ALIGN == 0, "header must keep payload alignment");
+
+static constexpr uint32_t NO_BLOCK = UINT32_MAX;
+static constexpr size_t   CAPACITY = (EI_ARENA_BYTES + ALIGN - 1) / ALIGN * ALIGN;
+
+alignas(ALIGN) static uint8_t s_arena[CAPACITY];
+static uint32_t s_top  = 0;          // 下一個區塊的位移
+static uint32_t s_last = NO_BLOCK;   // 最上方區塊的標頭位移
+static uint32_t s_peak = 0;
+static uint32_t s_fallbacks = 0;
+
+static inline BlockHeader *header_at(uint32_t off)
+{
+    return reinterpret_cast<BlockHeader *>(s_arena + off);
+}
+
+static inline bool in_arena(const void *ptr)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(ptr);
+    return p >= s_arena && p < s_arena + CAPACITY;
+}
+
+static void *arena_alloc(size_t size)
+{
+    size_t need = sizeof(BlockHeader) + (size + ALIGN - 1) / ALIGN * ALIGN;
+    if (size == 0 || need > CAPACITY - s_top) {
+        /* 放不下：改用 heap（內部 RAM 優先），第一次與之後每 100 次記錄一次 */
+        if (s_fallbacks++ % 100 == 0) {
+            ESP_LOGW(TAG, "%u bytes do not fit (%lu/%u in use), using heap (%lu so far)",
+                     (unsigned)size, (unsigned long)s_top, (unsigned)CAPACITY, (unsigned long)s_fallbacks);
+        }
+        ContentionScope heap(CONTENTION_HEAP);
+        void *p = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        return p ? p : heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+
+    BlockHeader *h = header_at(s_top);
+    h->size  = (uint32_t)need;
+    h->prev  = s_last;
+    h->freed = 0;
+    s_last   = s_top;
+    s_top   += (uint32_t)need;
+    if (s_top > s_peak) s_peak = s_top;
+    return h + 1;
+}
+
+static void arena_free(void *ptr)
+{
+    if (!ptr) return;
+    if (!in_arena(ptr)) {
+        ContentionScope heap(CONTENTION_HEAP);
+        heap_caps_free(ptr);
+        return;
+    }
+    header_at((uint32_t)(static_cast<uint8_t *>(ptr) - s_arena) - sizeof(BlockHeader))->freed = 1;
+
+    /* 由頂端往下回收所有已釋放的區塊 */
+    while (s_last != NO_BLOCK && header_at(s_last)->freed) {
+        s_top  = s_last;
+        s_last = header_at(s_last)->prev;
+    }
+}
+
+void *ei_malloc(size_t size)
+{
+    return arena_alloc(size);
+}
+
+void *ei_calloc(size_t nitems, size_t size)
+{
+    if (size != 0 && nitems > SIZE_MAX / size) return nullptr;
+    void *p = arena_alloc(nitems * size);
+    if (p) memset(p, 0, nitems * size);
+    return p;
+}
+
+void ei_free(void *ptr)
+{
+    arena_free(ptr);
+}
+
+EiArenaStats ei_arena_stats()
+{
+    return { (uint32_t)CAPACITY, s_top, s_peak, s_fallbacks };
+}
+
+#else
+
+EiArenaStats ei_arena_stats()
+{
+    return { 0, 0, 0, 0 };
+}
+
+#endif // EI_ARENA
@@ -0,0 +1,30 @@
+#ifndef EI_ARENA_H
+#define EI_ARENA_H
+
+/* ============================================================
+ * ei_arena.h - Edge Impulse SDK 專用配置區（EI_ARENA）
+ * ESP-MIAO v0.8.0
+ *
+ * 取代 SDK espressif port 的 weak ei_malloc / ei_calloc / ei_free：
+ * 由內部 DRAM 中 EI_ARENA_BYTES 的靜態區以堆疊方式配置（bump + 由頂端回收），
+ * MFCC 的暫存矩陣於同一次推論內配置、釋放，近似後進先出；
+ * 非頂端的釋放先標記，待其上方皆釋放後一併回收，因此長時間運行也不會碎片化。
+ * 放不下的請求改由 heap 供應並計數，用以調整 EI_ARENA_BYTES。
+ *
+ * 只供推論 Task（與開機校正）使用，不加鎖。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct EiArenaStats {
+    uint32_t capacity;    // 配置區大小（bytes）
+    uint32_t in_use;      // 目前已用（含標頭與尚未回收的已釋放區塊）
+    uint32_t peak;        // 開機以來最高用量
+    uint32_t fallbacks;   // 放不下而改用 heap 的次數（累計）
+};
+
+/** 取得配置區統計（EI_ARENA=0 時全為 0） */
+EiArenaStats ei_arena_stats();
+
+#endif // EI_ARENA_H
@@ -5,37 +5,283 @@
 
 #include "hardware_controller.h"
 #include "esp_log.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "esp_idf_version.h"
+#include "driver/ledc.h"
+#include "nvs.h"
+#include <stdlib.h>
+#include <string.h>
 
 static const char *TAG = "HW";
 
-HardwareController::HardwareController() {}
+#define RELAY_NVS_NS  "hw"
+#define RELAY_NVS_KEY "relays"
+
+HardwareController::HardwareController()
+    : relay_count_(0), timer_(nullptr), lock_(nullptr), ready_(false), steady_(false),
+      step_count_(0), step_(0), repeats_left_(0), due_us_(0) {}
 
 void HardwareController::init()
 {
-#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
-    esp_rom_gpio_pad_select_gpio(LED_PIN);
-#elif ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 0, 0)
-    gpio_pad_select_gpio(LED_PIN);
-#endif
-    gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
-    gpio_set_level(LED_PIN, 0);
-    ESP_LOGI(TAG, "LED init on GPIO %d", (int)LED_PIN);
+    ledc_timer_config_t tcfg = {};
+    tcfg.speed_mode      = LEDC_LOW_SPEED_MODE;
+    tcfg.duty_resolution = LED_LEDC_RESOLUTION;
+    tcfg.timer_num       = LED_LEDC_TIMER;
+    tcfg.freq_hz         = LED_LEDC_FREQ_HZ;
+    tcfg.clk_cfg         = LEDC_AUTO_CLK;
+    ESP_ERROR_CHECK(ledc_timer_config(&tcfg));
+
+    ledc_channel_config_t ccfg = {};
+    ccfg.gpio_num   = LED_PIN;
+    ccfg.speed_mode = LEDC_LOW_SPEED_MODE;
+    ccfg.channel    = LED_LEDC_CHANNEL;
+    ccfg.timer_sel  = LED_LEDC_TIMER;
+    ccfg.duty       = 0;
+    ccfg.hpoint     = 0;
+    ESP_ERROR_CHECK(ledc_channel_config(&ccfg));
+    ESP_ERROR_CHECK(ledc_fade_func_install(0));
+
+    lock_ = xSemaphoreCreateMutex();
+    esp_timer_create_args_t args = {};
+    args.callback = &HardwareController::timer_cb_;
+    args.arg      = this;
+    args.name     = "led_pattern";
+    ESP_ERROR_CHECK(esp_timer_create(&args, &timer_));
+    ready_ = true;
+    ESP_LOGI(TAG, "LED init on GPIO %d (LEDC ch%d, %d Hz)", (int)LED_PIN, (int)LED_LEDC_CHANNEL, LED_LEDC_FREQ_HZ);
+}
+
+/* ---------- LEDC ---------- */
+
+void HardwareController::apply_(uint16_t duty, uint16_t fade_ms)
+{
+    if (fade_ms > 0) {
+        ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, LED_LEDC_CHANNEL, duty, fade_ms);
+        ledc_fade_start(LEDC_LOW_SPEED_MODE, LED_LEDC_CHANNEL, LEDC_FADE_NO_WAIT);
+    } else {
+        /* 先停止可能進行中的硬體漸變，否則 set_duty 會被漸變覆寫 */
+        ledc_fade_stop(LEDC_LOW_SPEED_MODE, LED_LEDC_CHANNEL);
+        ledc_set_duty(LEDC_LOW_SPEED_MODE, LED_LEDC_CHANNEL, duty);
+        ledc_update_duty(LEDC_LOW_SPEED_MODE, LED_LEDC_CHANNEL);
+    }
+}
+
+/* ---------- 樣式引擎（呼叫端與 esp_timer Task 共用，以 lock_ 保護） ---------- */
+
+void HardwareController::enter_step_()
+{
+    const Step &s = steps_[step_];
+    apply_(s.duty, s.fade_ms);
+    due_us_ = esp_timer_get_time() + (int64_t)s.hold_ms * 1000;
+    esp_timer_start_once(timer_, (uint64_t)s.hold_ms * 1000);
+}
+
+void HardwareController::start_(const Step *steps, int count, int repeats)
+{
+    if (!ready_) return;
+    if (count > MAX_STEPS) count = MAX_STEPS;
+
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    esp_timer_stop(timer_);     // 未啟動時回傳 ESP_ERR_INVALID_STATE，忽略
+    for (int i = 0; i < count; i++) steps_[i] = steps[i];
+    step_count_   = count;
+    step_         = 0;
+    repeats_left_ = repeats;
+    if (count > 0) {
+        enter_step_();
+    } else {
+        apply_(steady_ ? LED_MAX_DUTY : 0, 0);
+    }
+    xSemaphoreGive(lock_);
+}
+
+void HardwareController::stop_looping_()
+{
+    if (!ready_) return;
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    if (repeats_left_ < 0) {
+        esp_timer_stop(timer_);
+        step_count_   = 0;
+        repeats_left_ = 0;
+        apply_(steady_ ? LED_MAX_DUTY : 0, 0);
+    }
+    xSemaphoreGive(lock_);
+}
+
+void HardwareController::advance_()
+{
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    /* start_ 取代樣式時，已觸發但等待 lock_ 的舊回調不可推進新樣式 */
+    if (step_count_ == 0 || esp_timer_get_time() < due_us_) {
+        xSemaphoreGive(lock_);
+        return;
+    }
+    if (++step_ >= step_count_) {
+        step_ = 0;
+        if (repeats_left_ > 0) repeats_left_--;
+        if (repeats_left_ == 0) {
+            step_count_ = 0;
+            apply_(steady_ ? LED_MAX_DUTY : 0, 0);
+            xSemaphoreGive(lock_);
+            return;
+        }
+    }
+    enter_step_();
+    xSemaphoreGive(lock_);
+}
+
+void HardwareController::timer_cb_(void *arg)
+{
+    static_cast<HardwareController *>(arg)->advance_();
 }
 
+/* ---------- 公開介面 ---------- */
+
 void HardwareController::set_led(bool on)
 {
-    gpio_set_level(LED_PIN, on ? 1 : 0);
+    steady_ = on;
+    start_(nullptr, 0, 0);
 }
 
 void HardwareController::blink_led(int times, int on_ms, int off_ms)
 {
-    for (int i = 0; i < times; i++) {
-        set_led(true);
-        vTaskDelay(pdMS_TO_TICKS(on_ms));
-        set_led(false);
-        vTaskDelay(pdMS_TO_TICKS(off_ms));
+    const Step steps[2] = {
+        { LED_MAX_DUTY, 0, (uint16_t)on_ms },
+        { 0,            0, (uint16_t)off_ms },
+    };
+    start_(steps, 2, times > 0 ? times : 1);
+}
+
+void HardwareController::play(LedPattern pattern)
+{
+    switch (pattern) {
+        case LED_PATTERN_BLINK:
+            blink_led(LED_BLINK_TIMES, LED_BLINK_ON_MS, LED_BLINK_OFF_MS);
+            break;
+        case LED_PATTERN_BREATHE: {
+            const Step steps[2] = {
+                { LED_MAX_DUTY, LED_BREATHE_MS, LED_BREATHE_MS },
+                { 0,            LED_BREATHE_MS, LED_BREATHE_MS },
+            };
+            start_(steps, 2, -1);
+            break;
+        }
+        case LED_PATTERN_ERROR: {
+            const Step steps[4] = {
+                { LED_MAX_DUTY, 0, 80 },
+                { 0,            0, 80 },
+                { LED_MAX_DUTY, 0, 80 },
+                { 0,            0, 500 },
+            };
+            start_(steps, 4, LED_ERROR_REPEAT);
+            break;
+        }
+        case LED_PATTERN_OFF:
+        default:
+            start_(nullptr, 0, 0);
+            break;
+    }
+}
+
+void HardwareController::show_state(ui_state_t state)
+{
+    switch (state) {
+        case UI_LISTENING: play(LED_PATTERN_BLINK);   break;
+        case UI_THINKING:  play(LED_PATTERN_BREATHE); break;
+        case UI_ERROR:     play(LED_PATTERN_ERROR);   break;
+        case UI_ACTION:    blink_led(1, 200, 0);      break;
+        case UI_WAKE:      break;   // 緊接著是 UI_LISTENING，避免兩個樣式互相截斷
+        default:           stop_looping_();           break;
+    }
+}
+
+/* ---------- 本機繼電器 ---------- */
+
+bool HardwareController::parse_relay_(const char *item, size_t len, Relay *out)
+{
+    const char *colon = (const char *)memchr(item, ':', len);
+    if (!colon || colon == item || (size_t)(colon - item) >= sizeof(out->target)) return false;
+
+    size_t name_len = colon - item;
+    memcpy(out->target, item, name_len);
+    out->target[name_len] = '\0';
+
+    const char *p = colon + 1;
+    out->active_low = *p == '!';
+    if (out->active_low) p++;
+    char *end = nullptr;
+    long pin  = strtol(p, &end, 10);
+    if (end == p || end != item + len) return false;
+
+    /* 不可佔用狀態 LED / I2S 腳位 */
+    out->pin = (gpio_num_t)pin;
+    if (!GPIO_IS_VALID_OUTPUT_GPIO(out->pin) || out->pin == LED_PIN ||
+        out->pin == I2S_BCK_GPIO || out->pin == I2S_WS_GPIO || out->pin == I2S_DIN_GPIO) {
+        return false;
+    }
+    out->on = false;
+    return true;
+}
+
+int HardwareController::load_relays()
+{
+    char table[96];
+    snprintf(table, sizeof(table), "%s", LOCAL_RELAY_TABLE);
+    nvs_handle_t handle;
+    if (nvs_open(RELAY_NVS_NS, NVS_READONLY, &handle) == ESP_OK) {
+        size_t len = sizeof(table);
+        if (nvs_get_str(handle, RELAY_NVS_KEY, table, &len) != ESP_OK) {
+            snprintf(table, sizeof(table), "%s", LOCAL_RELAY_TABLE);
+        }
+        nvs_close(handle);
+    }
+
+    relay_count_ = 0;
+    for (const char *item = table; *item && relay_count_ < LOCAL_RELAY_MAX;) {
+        const char *comma = strchr(item, ',');
+        size_t      len   = comma ? (size_t)(comma - item) : strlen(item);
+        Relay       r;
+        if (len > 0 && parse_relay_(item, len, &r)) {
+            gpio_reset_pin(r.pin);
+            gpio_set_direction(r.pin, GPIO_MODE_OUTPUT);
+            gpio_set_level(r.pin, r.active_low ? 1 : 0);
+            relays_[relay_count_++] = r;
+            ESP_LOGI(TAG, "Local relay '%s' on GPIO %d%s", r.target, (int)r.pin, r.active_low ? " (active low)" : "");
+        } else if (len > 0) {
+            ESP_LOGW(TAG, "Invalid relay entry '%.*s' ignored", (int)len, item);
+        }
+        if (!comma) break;
+        item = comma + 1;
+    }
+    return relay_count_;
+}
+
+const HardwareController::Relay *HardwareController::find_relay_(const char *target) const
+{
+    for (int i = 0; i < relay_count_; i++) {
+        if (strcmp(relays_[i].target, target) == 0) return &relays_[i];
+    }
+    return nullptr;
+}
+
+bool HardwareController::has_relay(const char *target) const
+{
+    return find_relay_(target) != nullptr;
+}
+
+bool HardwareController::apply_action(const char *action, const char *target, const char *value)
+{
+    bool toggle = strcmp(value, "toggle") == 0;
+    if (!toggle && strcmp(value, "on") != 0 && strcmp(value, "off") != 0) return false;
+
+    if (strcmp(action, "led_set") == 0) {
+        set_led(toggle ? !steady_ : value[1] == 'n');
+        return true;
     }
+    if (strcmp(action, "relay_set") != 0) return false;
+
+    Relay *r = const_cast<Relay *>(find_relay_(target));
+    if (!r) return false;
+    r->on = toggle ? !r->on : value[1] == 'n';
+    gpio_set_level(r->pin, r->on != r->active_low ? 1 : 0);
+    ESP_LOGI(TAG, "Relay %s -> %s (GPIO %d)", r->target, r->on ? "on" : "off", (int)r->pin);
+    return true;
 }
@@ -4,23 +4,108 @@
 /* ============================================================
  * hardware_controller.h - LED / GPIO 硬體控制
  * ESP-MIAO v0.8.0
+ *
+ * LED 由 LEDC 驅動（亮度 / 硬體漸變），閃爍與呼吸等樣式由 esp_timer 逐步推進：
+ * 呼叫端只排入樣式即返回，不在自己的 Task 上等待。
+ * 樣式結束（或被 OFF 取消）後回到 set_led 設定的常駐狀態（例如 Server led_set）。
+ *
+ * 本機繼電器表（target → GPIO，NVS 覆寫 Kconfig 預設）：目標就接在語音節點上時，
+ * relay_set 動作直接驅動 GPIO，不經 MQTT Broker。
  * ============================================================ */
 
+#include <stdint.h>
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "ui_state.h"
 #include "config.h"
 
+/* LED 樣式 */
+enum LedPattern : uint8_t {
+    LED_PATTERN_OFF = 0,   // 停止樣式，回到常駐狀態
+    LED_PATTERN_BLINK,     // 閃爍 n 次後結束
+    LED_PATTERN_BREATHE,   // 呼吸（漸亮 / 漸暗），持續到下一個樣式
+    LED_PATTERN_ERROR,     // 快速雙閃，重複 LED_ERROR_REPEAT 次後結束
+};
+
 class HardwareController {
 public:
     HardwareController();
 
-    /** 初始化 LED GPIO */
+    /** 初始化 LED（LEDC 計時器 / 通道、漸變服務、樣式計時器） */
     void init();
 
-    /** 閃爍 LED n 次（各 on_ms/off_ms 毫秒） */
+    /** 非阻塞閃爍 LED n 次（各 on_ms/off_ms 毫秒），取代目前的樣式 */
     void blink_led(int times, int on_ms = 100, int off_ms = 100);
 
-    /** 設定 LED 狀態 */
+    /** 非阻塞播放樣式（BLINK 使用 LED_BLINK_* 預設） */
+    void play(LedPattern pattern);
+
+    /**
+     * 依 UI 狀態播放對應樣式：聆聽閃爍、思考呼吸、錯誤雙閃、動作單閃；
+     * 其餘狀態只停止持續中的呼吸，有限次數的樣式（例如錯誤雙閃）照常播完。
+     */
+    void show_state(ui_state_t state);
+
+    /** 設定 LED 常駐狀態（同時取消進行中的樣式） */
     void set_led(bool on);
+
+    /**
+     * 載入本機繼電器表並設定 GPIO（全部關閉）。
+     * 格式 "light:26,fan:!27"（! = 低電位動作）；NVS "hw"/"relays" 存在時取代 LOCAL_RELAY_TABLE。
+     * @return 有效項目數
+     */
+    int load_relays();
+
+    /** target 是否接在本機（名稱同 Server COMMAND_MAP 的 target） */
+    bool has_relay(const char *target) const;
+
+    /**
+     * 執行 Server / 裝置端指令的 Action：relay_set 驅動本機繼電器，led_set 設定狀態 LED。
+     * @param value "on" / "off" / "toggle"
+     * @return false = 非本機目標或不支援的動作（交給其他路徑）
+     */
+    bool apply_action(const char *action, const char *target, const char *value);
+
+private:
+    /* 本機繼電器 */
+    struct Relay {
+        char       target[16];
+        gpio_num_t pin;
+        bool       active_low;
+        bool       on;
+    };
+    Relay relays_[LOCAL_RELAY_MAX];
+    int   relay_count_;
+
+    const Relay *find_relay_(const char *target) const;
+    bool         parse_relay_(const char *item, size_t len, Relay *out);
+
+    /* 樣式步驟：漸變 fade_ms 到 duty，之後維持到 hold_ms（自步驟開始起算） */
+    struct Step {
+        uint16_t duty;
+        uint16_t fade_ms;
+        uint16_t hold_ms;
+    };
+    static constexpr int MAX_STEPS = 16;
+
+    esp_timer_handle_t timer_;
+    SemaphoreHandle_t  lock_;
+    bool               ready_;
+    bool               steady_;         // 常駐狀態（樣式結束後恢復）
+    Step               steps_[MAX_STEPS];
+    int                step_count_;
+    int                step_;
+    int                repeats_left_;   // < 0 = 無限重複
+    int64_t            due_us_;         // 目前步驟結束時刻（過期回調辨識用）
+
+    void        start_(const Step *steps, int count, int repeats);
+    void        enter_step_();
+    void        stop_looping_();
+    void        apply_(uint16_t duty, uint16_t fade_ms);
+    void        advance_();
+    static void timer_cb_(void *arg);
 };
 
 #endif // HARDWARE_CONTROLLER_H
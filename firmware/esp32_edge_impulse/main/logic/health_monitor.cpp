@@ -0,0 +1,268 @@
+/*
+ * health_monitor.cpp - heap / stack / CPU 健康狀態取樣實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "health_monitor.h"
+#include "rtos_alloc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_idf_version.h"
+#include "power_state.h"
+#include "ui_state.h"
+#include "esp_wifi.h"
+#include "flight_recorder.h"
+#include "contention.h"
+#include "nvs_writer.h"
+#include "stage_profiler.h"
+#include "telemetry_block.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "Health";
+
+/* JSON 欄位名稱與對應的 heap capability */
+struct HeapRegion {
+    const char *name;
+    uint32_t    caps;
+};
+
+static const HeapRegion kHeapRegions[] = {
+    { "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+    { "dma",      MALLOC_CAP_DMA },
+    { "iram",     MALLOC_CAP_EXEC },      // IRAM heap（僅 32-bit 存取）
+#if CONFIG_SPIRAM
+    { "spiram",   MALLOC_CAP_SPIRAM },
+#endif
+};
+
+static TaskHandle_t idle_task_handle(int core)
+{
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    return xTaskGetIdleTaskHandleForCore(core);
+#else
+    return xTaskGetIdleTaskHandleForCPU(core);
+#endif
+}
+
+HealthMonitor::HealthMonitor(WebSocketClient &ws)
+    : ws_(ws), seq_(0), started_(false), total_prev_(0), have_prev_(false)
+{
+    memset(idle_prev_, 0, sizeof(idle_prev_));
+}
+
+bool HealthMonitor::start()
+{
+#if HEALTH_INTERVAL_S > 0
+    if (started_) return true;
+    if (RTOS_TASK_CREATE(task_entry_, "health", HEALTH_TASK_STACK, this,
+                         HEALTH_TASK_PRIO, nullptr, HEALTH_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start health task");
+        return false;
+    }
+    started_ = true;
+#endif
+    return true;
+}
+
+/* ---------- health Task ---------- */
+
+void HealthMonitor::task_entry_(void *arg)
+{
+    auto *self = static_cast<HealthMonitor *>(arg);
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(HEALTH_INTERVAL_S * 1000));
+        self->sample_and_send_();
+    }
+}
+
+void HealthMonitor::sample_and_send_()
+{
+    uint32_t    total_rt = 0;
+    UBaseType_t n_tasks  = uxTaskGetSystemState(tasks_, HEALTH_MAX_TASKS, &total_rt);
+    if (n_tasks == 0) {
+        ESP_LOGW(TAG, "More than %d tasks, raise HEALTH_MAX_TASKS", HEALTH_MAX_TASKS);
+    }
+
+    /* CPU 負載：100 - IDLE 佔比（執行時間計數器為 esp_timer us，每核心各自累計） */
+    int      cpu[portNUM_PROCESSORS];
+    uint32_t idle_now[portNUM_PROCESSORS];
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        TaskHandle_t idle = idle_task_handle(c);
+        idle_now[c] = 0;
+        for (UBaseType_t i = 0; i < n_tasks; i++) {
+            if (tasks_[i].xHandle == idle) idle_now[c] = tasks_[i].ulRunTimeCounter;
+        }
+        uint32_t span = total_rt - total_prev_;
+        if (!have_prev_ || n_tasks == 0 || span == 0) {
+            cpu[c] = -1;
+        } else {
+            uint32_t idle_d = idle_now[c] - idle_prev_[c];
+            cpu[c] = idle_d >= span ? 0 : (int)(100 - (uint64_t)idle_d * 100 / span);
+        }
+    }
+    if (n_tasks > 0) {
+        memcpy(idle_prev_, idle_now, sizeof(idle_prev_));
+        total_prev_ = total_rt;
+        have_prev_  = true;
+    }
+
+    uint32_t power_ms[PWR_LEVEL_COUNT];
+    power_take_residency(power_ms);
+
+    /* 本地警示照常執行，即使尚未連線 */
+    flight_health_t fh = {};
+    fh.stack_min = UINT16_MAX;
+    for (UBaseType_t i = 0; i < n_tasks; i++) {
+        if (tasks_[i].usStackHighWaterMark < HEALTH_STACK_WARN_BYTES) {
+            ESP_LOGW(TAG, "Task %s stack low: %u bytes left", tasks_[i].pcTaskName,
+                     (unsigned)tasks_[i].usStackHighWaterMark);
+        }
+        if (tasks_[i].usStackHighWaterMark < fh.stack_min) {
+            fh.stack_min = (uint16_t)tasks_[i].usStackHighWaterMark;
+            strncpy(fh.stack_task, tasks_[i].pcTaskName, sizeof(fh.stack_task) - 1);
+        }
+    }
+    fh.uptime_s     = (uint32_t)(esp_timer_get_time() / 1000000);
+    fh.heap_free    = (uint32_t)heap_caps_get_free_size(kHeapRegions[0].caps);
+    fh.heap_min     = (uint32_t)heap_caps_get_minimum_free_size(kHeapRegions[0].caps);
+    fh.heap_largest = (uint32_t)heap_caps_get_largest_free_block(kHeapRegions[0].caps);
+    flight_record_health(&fh);
+
+    /* 效能 HUD 的核心負載與狀態列的 Wi-Fi 訊號（未連線時清除） */
+    for (int c = 0; c < portNUM_PROCESSORS && c < 2; c++) ui_perf_publish_cpu(c, cpu[c]);
+    wifi_ap_record_t ap;
+    int8_t rssi = esp_wifi_sta_get_ap_info(&ap) == ESP_OK ? ap.rssi : 0;
+    ui_status_publish_rssi(rssi);
+
+#if TELEMETRY_HTTP
+    TelemetryHealth th = {};
+    th.uptime_s      = fh.uptime_s;
+    th.heap_free     = fh.heap_free;
+    th.heap_min_free = fh.heap_min;
+    th.heap_largest  = fh.heap_largest;
+    th.stack_min     = n_tasks > 0 ? fh.stack_min : 0;
+    memcpy(th.stack_task, fh.stack_task, sizeof(fh.stack_task));
+    th.rssi          = rssi;
+    th.cpu[1]        = -1;
+    for (int c = 0; c < portNUM_PROCESSORS && c < 2; c++) th.cpu[c] = (int8_t)cpu[c];
+    telemetry_publish_health(th);
+#endif
+
+    if (!ws_.is_connected()) return;
+    send_flight_record_();
+
+    int64_t now = esp_timer_get_time();
+    static char json[1536 + 96 + CONTENTION_JSON_BYTES];   // 只有 health Task 使用，不佔 stack；96 = nvs 欄位
+    int     len = snprintf(json, sizeof(json),
+                           "{\"device_id\":\"%s\",\"timestamp\":%lld,\"type\":\"health\","
+                           "\"payload\":{\"seq\":%u,\"uptime_s\":%lld,\"heap\":{",
+                           DEVICE_ID, (long long)(now / 1000), (unsigned)seq_++,
+                           (long long)(now / 1000000));
+
+    const int n_regions = sizeof(kHeapRegions) / sizeof(kHeapRegions[0]);
+    for (int r = 0; r < n_regions && len < (int)sizeof(json); r++) {
+        uint32_t caps = kHeapRegions[r].caps;
+        len += snprintf(json + len, sizeof(json) - len, "%s\"%s\":[%u,%u,%u]", r ? "," : "",
+                        kHeapRegions[r].name, (unsigned)heap_caps_get_free_size(caps),
+                        (unsigned)heap_caps_get_largest_free_block(caps),
+                        (unsigned)heap_caps_get_minimum_free_size(caps));
+    }
+    if (len < (int)sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "},\"stacks\":{");
+    for (UBaseType_t i = 0; i < n_tasks && len < (int)sizeof(json); i++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s\"%s\":%u", i ? "," : "",
+                        tasks_[i].pcTaskName, (unsigned)tasks_[i].usStackHighWaterMark);
+    }
+    if (len < (int)sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "},\"cpu\":[");
+    for (int c = 0; c < portNUM_PROCESSORS && len < (int)sizeof(json); c++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s%d", c ? "," : "", cpu[c]);
+    }
+    if (len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, "],\"power\":[%lu,%lu,%lu]",
+                        (unsigned long)power_ms[PWR_LEVEL_MAX], (unsigned long)power_ms[PWR_LEVEL_AWAKE],
+                        (unsigned long)power_ms[PWR_LEVEL_IDLE]);
+    }
+    /* NVS 寫入：[寫入 key 數, 批次, 強制批次, 覆蓋省下, 最長延後 ms, 平均延後 ms, 最長 flash 佔用 us, 合計 us, 失敗 key 數] */
+    NvsWriterStats nvs;
+    nvs_writer_take_stats(&nvs);
+    if (len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"nvs\":[%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu]",
+                        (unsigned long)nvs.writes, (unsigned long)nvs.flushes, (unsigned long)nvs.forced,
+                        (unsigned long)nvs.coalesced, (unsigned long)nvs.defer_max_ms,
+                        (unsigned long)nvs.defer_avg_ms, (unsigned long)nvs.busy_max_us,
+                        (unsigned long)nvs.busy_total_us, (unsigned long)nvs.failed);
+    }
+#if CONFIG_ESP_MIAO_CONTENTION_MAP
+    if (len < (int)sizeof(json)) len += snprintf(json + len, sizeof(json) - len, ",\"contention\":");
+    if (len < (int)sizeof(json)) len += contention_report_json(json + len, sizeof(json) - len);
+#endif
+    if (len < (int)sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "}}");
+    if (len >= (int)sizeof(json)) {
+        ESP_LOGW(TAG, "Health report truncated, not sent");
+        return;
+    }
+
+    if (!ws_.send_text(json, (size_t)len, pdMS_TO_TICKS(HEALTH_SEND_TIMEOUT_MS))) {
+        ESP_LOGW(TAG, "Health send failed");
+    }
+}
+
+/* ---------- 飛行記錄（上一次開機） ---------- */
+
+void HealthMonitor::send_flight_record_()
+{
+    const char *reason;
+    int         n_events;
+    const flight_log_t *log = flight_recorder_previous(&reason, &n_events);
+    if (!log) return;
+
+    /* 每筆事件最多約 24 字元；只在重開機後送一次，直接向 heap 借用 */
+    const size_t cap  = 512 + FLIGHT_HEALTH * 72 + (size_t)n_events * 24;
+    char        *json = static_cast<char *>(malloc(cap));
+    if (!json) {
+        ESP_LOGW(TAG, "No memory for flight record (%u bytes)", (unsigned)cap);
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int     len = snprintf(json, cap,
+                           "{\"device_id\":\"%s\",\"timestamp\":%lld,\"type\":\"flight_record\","
+                           "\"payload\":{\"reset_reason\":\"%s\",\"stages_us\":{",
+                           DEVICE_ID, (long long)(now / 1000), reason);
+    for (int s = 0; s < PROF_STAGE_COUNT && len < (int)cap; s++) {
+        len += snprintf(json + len, cap - len, "%s\"%s\":%lu", s ? "," : "",
+                        StageProfiler::stage_name((ProfileStage)s), (unsigned long)log->stage_us[s]);
+    }
+    if (len < (int)cap) len += snprintf(json + len, cap - len, "},\"health\":[");
+
+    /* 環形由舊到新 */
+    uint32_t count = log->health_count;
+    uint32_t first = count > FLIGHT_HEALTH ? count - FLIGHT_HEALTH : 0;
+    for (uint32_t k = first; k < count && len < (int)cap; k++) {
+        const flight_health_t &h = log->health[k % FLIGHT_HEALTH];
+        char task[sizeof(h.stack_task) + 1];
+        memcpy(task, h.stack_task, sizeof(h.stack_task));
+        task[sizeof(h.stack_task)] = '\0';
+        len += snprintf(json + len, cap - len, "%s[%lu,%lu,%lu,%lu,%u,\"%s\"]", k > first ? "," : "",
+                        (unsigned long)h.uptime_s, (unsigned long)h.heap_free, (unsigned long)h.heap_min,
+                        (unsigned long)h.heap_largest, (unsigned)h.stack_min, task);
+    }
+    if (len < (int)cap) len += snprintf(json + len, cap - len, "],\"events\":[");
+    for (int i = 0; i < n_events && len < (int)cap; i++) {
+        const flight_event_t &e = log->events[i];
+        len += snprintf(json + len, cap - len, "%s[%lu,%u,%u,%u]", i ? "," : "", (unsigned long)e.t_us,
+                        (unsigned)e.core, (unsigned)e.id, (unsigned)e.arg);
+    }
+    if (len < (int)cap) len += snprintf(json + len, cap - len, "]}}");
+
+    if (len >= (int)cap) {
+        ESP_LOGW(TAG, "Flight record truncated, dropped");
+        flight_recorder_release();
+    } else if (ws_.send_text(json, (size_t)len, pdMS_TO_TICKS(HEALTH_SEND_TIMEOUT_MS))) {
+        ESP_LOGI(TAG, "Flight record sent (%s, %d events)", reason, n_events);
+        flight_recorder_release();
+    }
+    free(json);   // 送出失敗則下一次取樣重試
+}
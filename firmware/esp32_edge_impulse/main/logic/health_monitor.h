@@ -0,0 +1,58 @@
+#ifndef HEALTH_MONITOR_H
+#define HEALTH_MONITOR_H
+
+/* ============================================================
+ * health_monitor.h - heap / stack 高水位 / CPU 負載週期取樣與上報
+ * ESP-MIAO v0.8.0
+ *
+ * health Task 每 HEALTH_INTERVAL_S 秒取樣一次，以 health 文字訊息送往 Server：
+ *   {"type":"health","payload":{"seq":..,"uptime_s":..,
+ *    "heap":{"internal":[free,largest,min_free],"dma":[..],"iram":[..],"spiram":[..]},
+ *    "stacks":{"ei_infer":min_free_bytes,...},"cpu":[core0_pct,core1_pct],
+ *    "power":[max_ms,awake_ms,idle_ms]}}
+ * stacks 涵蓋所有 Task（uxTaskGetSystemState），用來調整各 *_TASK_STACK；
+ * min_free 為開機以來最低值，持續下降代表有洩漏。
+ * cpu 由兩次取樣間各核心 IDLE Task 的執行時間換算，第一份報告為 -1。
+ * power 為兩次取樣間各動態調頻層級的駐留時間（power_state.h：全速 / 低頻喚醒 / 低頻可 light sleep）。
+ *
+ * CONFIG_ESP_MIAO_FLIGHT_RECORDER：每次取樣另寫入 RTC memory 的飛行記錄；重開機後第一次連上
+ * Server 時送出上一次開機的紀錄：
+ *   {"type":"flight_record","payload":{"reset_reason":"task_wdt","stages_us":{"nn":..,...},
+ *    "health":[[uptime_s,free,min_free,largest,stack_min,"task"],...],
+ *    "events":[[t_us,core,id,arg],...]}}
+ * ============================================================ */
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "config.h"
+#include "websocket_client.h"
+
+class HealthMonitor {
+public:
+    explicit HealthMonitor(WebSocketClient &ws);
+
+    /**
+     * 建立 health Task（HEALTH_INTERVAL_S == 0 時不動作）。
+     * @return true = 成功或已關閉
+     */
+    bool start();
+
+private:
+    WebSocketClient &ws_;
+    uint32_t         seq_;
+    bool             started_;
+
+    /* 上一次取樣的 IDLE 執行時間與總時間（CPU 負載差分） */
+    uint32_t         idle_prev_[portNUM_PROCESSORS];
+    uint32_t         total_prev_;
+    bool             have_prev_;
+
+    TaskStatus_t     tasks_[HEALTH_MAX_TASKS];
+
+    static void task_entry_(void *arg);
+    void sample_and_send_();
+    void send_flight_record_();
+};
+
+#endif // HEALTH_MONITOR_H
@@ -0,0 +1,88 @@
+/*
+ * inference_governor.cpp - 推論負載監測與分級降級實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "inference_governor.h"
+
+InferenceGovernor::InferenceGovernor()
+{
+    configure(1, 1, 1, false);
+}
+
+void InferenceGovernor::configure(uint32_t slice_us, int base_stride, int max_stride, bool has_secondary)
+{
+    slice_us_      = slice_us ? slice_us : 1;
+    base_stride_   = base_stride > 0 ? base_stride : 1;
+    has_secondary_ = has_secondary;
+    /* stride 加倍的級數：base·2^n <= max_stride */
+    int doublings = 0;
+    while ((base_stride_ << (doublings + 1)) <= max_stride) doublings++;
+    max_level_  = (has_secondary_ ? 1 : 0) + doublings;
+    level_      = 0;
+    load_pm_    = 0;
+    hot_        = 0;
+    cool_       = 0;
+    steps_down_ = 0;
+    overruns_   = 0;
+}
+
+int InferenceGovernor::stride_of_(int level) const
+{
+    int doublings = has_secondary_ ? level - 1 : level;
+    return doublings > 0 ? base_stride_ << doublings : base_stride_;
+}
+
+void InferenceGovernor::set_level_(int level)
+{
+    if (level > level_) steps_down_++;
+    /* 換 stride 後舊的平均不再代表新預算下的負載 */
+    if (stride_of_(level) != stride_of_(level_)) {
+        load_pm_ = (uint32_t)((uint64_t)load_pm_ * stride_of_(level_) / stride_of_(level));
+    }
+    level_ = level;
+    hot_   = 0;
+    cool_  = 0;
+}
+
+bool InferenceGovernor::on_inference(uint32_t busy_us)
+{
+    uint64_t budget = (uint64_t)slice_us_ * stride();
+    uint32_t pm     = (uint32_t)((uint64_t)busy_us * 1000 / budget);
+    load_pm_ = load_pm_ ? load_pm_ + (((int32_t)pm - (int32_t)load_pm_) >> 3) : pm;
+
+    if (load_pm_ > (uint32_t)INFER_GOV_DEGRADE_PCT * 10) {
+        cool_ = 0;
+        if (++hot_ >= INFER_GOV_DEGRADE_RUNS && level_ < max_level_) {
+            set_level_(level_ + 1);
+            return true;
+        }
+        return false;
+    }
+    hot_ = 0;
+    if (level_ == 0) return false;
+
+    /* 回到上一級後的預估負載（stride 減半則加倍） */
+    uint32_t projected = (uint32_t)((uint64_t)load_pm_ * stride() / stride_of_(level_ - 1));
+    if (projected >= (uint32_t)INFER_GOV_RECOVER_PCT * 10) {
+        cool_ = 0;
+        return false;
+    }
+    if (++cool_ >= INFER_GOV_RECOVER_RUNS) {
+        set_level_(level_ - 1);
+        return true;
+    }
+    return false;
+}
+
+bool InferenceGovernor::on_overrun()
+{
+    overruns_++;
+    if (level_ >= max_level_) {
+        hot_ = 0;
+        cool_ = 0;
+        return false;
+    }
+    set_level_(level_ + 1);
+    return true;
+}
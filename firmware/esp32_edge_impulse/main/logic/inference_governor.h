@@ -0,0 +1,72 @@
+#ifndef INFERENCE_GOVERNOR_H
+#define INFERENCE_GOVERNOR_H
+
+/* ============================================================
+ * inference_governor.h - 推論負載監測與分級降級
+ * ESP-MIAO v0.8.0
+ *
+ * 外殼過熱（esp_pm 降頻）、Wi-Fi 中斷 / flash cache 爭用都會讓推論耗時慢慢變長；
+ * 開機校正（calibrate_inference_）只量一次，這裡在執行期持續追蹤：
+ *   load  本次推論（切片開始處理到推論結束）耗時 / (stride × 切片週期)，指數平均 1/8
+ * load 連續 INFER_GOV_DEGRADE_RUNS 次超過 INFER_GOV_DEGRADE_PCT 即降一級；
+ * 切片在推論期間被覆寫（真正少了一個切片）則立即降一級。等級：
+ *   0      正常（stride = 開機校正值，次要階段開啟）
+ *   1      關閉次要階段（串流降噪；無次要階段時略過此級）
+ *   2 ..   stride 加倍（每視窗推論次數減半），最多到 max_stride
+ * 回升時以「回到上一級後的預估負載」判斷（stride 減半 = load 加倍），
+ * 連續 INFER_GOV_RECOVER_RUNS 次低於 INFER_GOV_RECOVER_PCT 才回升一級。
+ * 降級只減少推論次數，不略過切片：VAD / 頻譜前端仍逐片處理。
+ * 純計算、無 RTOS 相依（主機測試直接使用）。
+ * ============================================================ */
+
+#include <stdint.h>
+#include "config.h"
+
+class InferenceGovernor {
+public:
+    InferenceGovernor();
+
+    /**
+     * @param slice_us      切片週期
+     * @param base_stride   開機校正的推論間隔（切片數）
+     * @param max_stride    最大推論間隔
+     * @param has_secondary 是否有可關閉的次要階段
+     */
+    void configure(uint32_t slice_us, int base_stride, int max_stride, bool has_secondary);
+
+    /**
+     * 一次推論完成。
+     * @param busy_us 本切片開始處理到推論結束的耗時（涵蓋 stride() 個切片）
+     * @return true = 等級改變
+     */
+    bool on_inference(uint32_t busy_us);
+
+    /** 切片在推論期間被覆寫：立即降一級。@return true = 等級改變 */
+    bool on_overrun();
+
+    int      level() const { return level_; }
+    int      max_level() const { return max_level_; }
+    int      stride() const { return stride_of_(level_); }
+    bool     secondary_enabled() const { return !has_secondary_ || level_ == 0; }
+    /** 平滑後的負載（%） */
+    uint32_t load_pct() const { return load_pm_ / 10; }
+    uint32_t steps_down() const { return steps_down_; }
+    uint32_t overruns() const { return overruns_; }
+
+private:
+    uint32_t slice_us_;
+    int      base_stride_;
+    int      max_level_;
+    bool     has_secondary_;
+    int      level_;
+    uint32_t load_pm_;       // 千分比，0 = 尚無樣本
+    uint16_t hot_;           // 連續超過降級門檻的次數
+    uint16_t cool_;          // 連續低於回升門檻的次數
+    uint32_t steps_down_;
+    uint32_t overruns_;
+
+    int  stride_of_(int level) const;
+    void set_level_(int level);
+};
+
+#endif // INFERENCE_GOVERNOR_H
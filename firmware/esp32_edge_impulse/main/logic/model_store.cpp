@@ -0,0 +1,190 @@
+/*
+ * model_store.cpp - model 分區 A/B 映像管理實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "model_store.h"
+#include "model_weights.h"
+#include "config.h"
+#include "contention.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_http_client.h"
+#include <string.h>
+
+static const char *TAG = "ModelStore";
+
+static constexpr uint16_t IMAGE_FORMAT = 1;
+
+ModelStore::ModelStore(WebSocketClient &ws)
+    : ws_(ws), part_(nullptr), map_(nullptr), lock_(portMUX_INITIALIZER_UNLOCKED),
+      active_(NO_SLOT), pending_(NO_SLOT), generation_(0)
+{
+}
+
+bool ModelStore::init()
+{
+    part_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)MODEL_PARTITION_SUBTYPE,
+                                     MODEL_PARTITION_LABEL);
+    if (!part_ || part_->size < SLOTS * MODEL_SLOT_BYTES) {
+        ESP_LOGW(TAG, "No %s partition, using compiled-in weights", MODEL_PARTITION_LABEL);
+        part_ = nullptr;
+        return false;
+    }
+
+    const void *ptr;
+    esp_partition_mmap_handle_t handle;
+    esp_err_t err = esp_partition_mmap(part_, 0, SLOTS * MODEL_SLOT_BYTES, ESP_PARTITION_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "mmap failed: %s", esp_err_to_name(err));
+        part_ = nullptr;
+        return false;
+    }
+    map_ = static_cast<const uint8_t *>(ptr);   // 常駐映射，不 munmap
+
+    int best = NO_SLOT;
+    for (int slot = 0; slot < SLOTS; slot++) {
+        if (!slot_valid_(slot)) continue;
+        if (best == NO_SLOT || slot_header_(slot)->generation > slot_header_(best)->generation) best = slot;
+    }
+    if (best == NO_SLOT) {
+        ESP_LOGI(TAG, "No model image flashed, using compiled-in weights (layout %08lx)",
+                 (unsigned long)model_weights_layout());
+        return true;
+    }
+    pending_.store(best, std::memory_order_relaxed);
+    ESP_LOGI(TAG, "Model image generation %lu in slot %d", (unsigned long)slot_header_(best)->generation, best);
+    return true;
+}
+
+const ModelImageHeader *ModelStore::slot_header_(int slot) const
+{
+    return reinterpret_cast<const ModelImageHeader *>(map_ + slot * MODEL_SLOT_BYTES);
+}
+
+bool ModelStore::slot_valid_(int slot) const
+{
+    const ModelImageHeader *h = slot_header_(slot);
+    if (memcmp(h->magic, "MMDL", 4) != 0 || h->format != IMAGE_FORMAT) return false;
+    if (h->tensor_count != model_weights_tensor_count() || h->layout != model_weights_layout()) {
+        ESP_LOGW(TAG, "Slot %d image was built for another model (layout %08lx)", slot, (unsigned long)h->layout);
+        return false;
+    }
+    if (h->payload_bytes > MODEL_SLOT_BYTES - sizeof(*h)) return false;
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(h + 1), h->payload_bytes) == h->crc32;
+}
+
+bool ModelStore::fetch(uint32_t generation, uint32_t size, uint32_t crc32)
+{
+    if (!map_) return false;
+    if (size < sizeof(ModelImageHeader) || size > MODEL_SLOT_BYTES) {
+        ESP_LOGW(TAG, "Model image generation %lu too large (%lu bytes)", (unsigned long)generation,
+                 (unsigned long)size);
+        return false;
+    }
+
+    /* 選槽：使用中的槽以外那一個；尚未換綁的舊下載一併取消 */
+    int target = NO_SLOT;
+    portENTER_CRITICAL(&lock_);
+    uint32_t newest = generation_.load(std::memory_order_relaxed);
+    int pending = pending_.load(std::memory_order_relaxed);
+    if (pending != NO_SLOT && slot_header_(pending)->generation > newest) newest = slot_header_(pending)->generation;
+    bool stale = generation <= newest;
+    if (!stale) {
+        target = active_ == 0 ? 1 : 0;
+        pending_.store(NO_SLOT, std::memory_order_relaxed);
+    }
+    portEXIT_CRITICAL(&lock_);
+    if (stale) return true;
+
+    ESP_LOGI(TAG, "Downloading model generation %lu (%lu bytes) into slot %d", (unsigned long)generation,
+             (unsigned long)size, target);
+    if (!download_(target, size)) return false;
+
+    const ModelImageHeader *h = slot_header_(target);
+    if (!slot_valid_(target) || h->generation != generation || h->crc32 != crc32) {
+        ESP_LOGW(TAG, "Downloaded model image failed verification (generation %lu)", (unsigned long)h->generation);
+        return false;
+    }
+
+    pending_.store(target, std::memory_order_release);
+    return true;
+}
+
+bool ModelStore::download_(int slot, uint32_t size)
+{
+    char url[96];
+    if (!ws_.http_url(MODEL_DOWNLOAD_PATH, url, sizeof(url))) return false;
+
+    const size_t base = (size_t)slot * MODEL_SLOT_BYTES;
+    esp_err_t err;
+    {
+        ContentionScope flash(CONTENTION_FLASH);   // 整個 slot 的抹除：最長的 cache 關閉期間
+        err = esp_partition_erase_range(part_, base, MODEL_SLOT_BYTES);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Erase slot %d failed: %s", slot, esp_err_to_name(err));
+        return false;
+    }
+
+    esp_http_client_config_t cfg = {};
+    cfg.url        = url;
+    cfg.method     = HTTP_METHOD_GET;
+    cfg.timeout_ms = MODEL_DOWNLOAD_TIMEOUT_MS;
+    ws_.apply_tls(cfg);
+    esp_http_client_handle_t http = esp_http_client_init(&cfg);
+    if (!http) return false;
+
+    uint32_t received = 0;
+    err = esp_http_client_open(http, 0);
+    if (err == ESP_OK && esp_http_client_fetch_headers(http) >= 0 && esp_http_client_get_status_code(http) == 200) {
+        uint8_t chunk[512];
+        while (received < size) {
+            int n = esp_http_client_read(http, (char *)chunk, sizeof(chunk));
+            if (n <= 0) break;
+            if (received + (uint32_t)n > size) n = (int)(size - received);
+            ContentionScope flash(CONTENTION_FLASH);
+            if (esp_partition_write(part_, base + received, chunk, n) != ESP_OK) break;
+            received += (uint32_t)n;
+        }
+    }
+    int status = esp_http_client_get_status_code(http);
+    esp_http_client_close(http);
+    esp_http_client_cleanup(http);
+
+    if (received != size) {
+        ESP_LOGW(TAG, "Model download failed: %s (HTTP %d, %lu/%lu bytes)", esp_err_to_name(err), status,
+                 (unsigned long)received, (unsigned long)size);
+        return false;
+    }
+    return true;
+}
+
+bool ModelStore::apply_pending(float *wake_threshold)
+{
+    *wake_threshold = 0.0f;
+    if (pending_.load(std::memory_order_relaxed) == NO_SLOT) return false;   // 每切片的快速路徑
+
+    portENTER_CRITICAL(&lock_);
+    int slot = pending_.exchange(NO_SLOT, std::memory_order_relaxed);
+    if (slot != NO_SLOT) active_ = slot;     // 先標記使用中，fetch 不會再選到此槽
+    portEXIT_CRITICAL(&lock_);
+    if (slot == NO_SLOT) return false;
+
+    const ModelImageHeader *h = slot_header_(slot);
+    if (!model_weights_bind(reinterpret_cast<const uint8_t *>(h + 1), h->payload_bytes)) {
+        ESP_LOGE(TAG, "Model image generation %lu rejected, using compiled-in weights",
+                 (unsigned long)h->generation);
+        model_weights_bind(nullptr, 0);
+        portENTER_CRITICAL(&lock_);
+        active_ = NO_SLOT;
+        portEXIT_CRITICAL(&lock_);
+        generation_.store(0, std::memory_order_relaxed);
+        return true;
+    }
+    generation_.store(h->generation, std::memory_order_relaxed);
+    *wake_threshold = h->wake_threshold > 0.0f && h->wake_threshold < 1.0f ? h->wake_threshold : 0.0f;
+    ESP_LOGI(TAG, "Model generation %lu active (slot %d, %lu bytes mapped)", (unsigned long)h->generation, slot,
+             (unsigned long)h->payload_bytes);
+    return true;
+}
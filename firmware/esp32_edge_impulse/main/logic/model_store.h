@@ -0,0 +1,79 @@
+#ifndef MODEL_STORE_H
+#define MODEL_STORE_H
+
+/* ============================================================
+ * model_store.h - model 分區的喚醒詞模型映像（A/B 兩槽，免重燒韌體更新）
+ * ESP-MIAO v0.8.0
+ *
+ * model 分區（partitions.csv）分成兩個 MODEL_SLOT_BYTES 的槽，整個分區開機時 mmap 一次：
+ *   ModelImageHeader（32 bytes）+ 酬載（model_weights.h 格式）
+ * 開機取 CRC 正確、架構相符且 generation 最大的槽；都沒有則使用編譯進 app 的權重。
+ *
+ * 更新流程：Server 發現 audio_start 回報的 model_generation 較舊時推送 model_update，
+ * worker Task 呼叫 fetch() 以 HTTP GET 下載到非使用中的槽並驗證，推論 Task 於下一個切片
+ * 呼叫 apply_pending() 換綁。下載中斷 / 斷電只會留下 CRC 錯誤的槽，使用中的槽不受影響。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "esp_partition.h"
+#include "websocket_client.h"
+
+#pragma pack(push, 1)
+struct ModelImageHeader {
+    char     magic[4];        // "MMDL"
+    uint16_t format;          // 1
+    uint16_t tensor_count;    // 須等於編譯模型的張量數
+    uint32_t layout;          // model_weights_layout()
+    uint32_t generation;      // Server 遞增的版本（隨 audio_start 回報，0 = 編譯進 app 的權重）
+    uint32_t payload_bytes;
+    uint32_t crc32;           // 酬載的 CRC-32（zlib 相容）
+    float    wake_threshold;  // 此模型建議的喚醒門檻，0 = 沿用目前值
+    uint32_t reserved;
+};
+#pragma pack(pop)
+static_assert(sizeof(ModelImageHeader) == 32, "ModelImageHeader layout is shared with the server");
+
+class ModelStore {
+public:
+    ModelStore(WebSocketClient &ws);
+
+    /** mmap model 分區並選出最新的有效槽（於下一次 apply_pending 換綁） */
+    bool init();
+
+    /**
+     * 下載 Server 的映像到非使用中的槽並驗證（worker Task，阻塞數百 ms）。
+     * generation 不比目前（含待換綁）新時直接返回 true。
+     */
+    bool fetch(uint32_t generation, uint32_t size, uint32_t crc32);
+
+    /**
+     * 推論 Task 於兩次推論之間呼叫：有待換綁的槽則換綁。
+     * @param wake_threshold 換綁成功時填入映像建議的門檻（0 = 沿用）
+     * @return true = 已換綁（呼叫端應重設連續推論狀態）
+     */
+    bool apply_pending(float *wake_threshold);
+
+    /** 生效中的 generation（0 = 編譯進 app 的權重） */
+    uint32_t generation() const { return generation_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int NO_SLOT = -1;
+    static constexpr int SLOTS   = 2;
+
+    WebSocketClient        &ws_;
+    const esp_partition_t  *part_;
+    const uint8_t          *map_;          // 整個分區的 mmap
+    portMUX_TYPE            lock_;         // 推論 Task 換綁與 worker Task 選槽互斥
+    int                     active_;       // 已換綁的槽（NO_SLOT = 編譯進 app 的權重）
+    std::atomic<int>        pending_;      // 已驗證、待推論 Task 換綁的槽
+    std::atomic<uint32_t>   generation_;
+
+    const ModelImageHeader *slot_header_(int slot) const;
+    bool                    slot_valid_(int slot) const;
+    bool                    download_(int slot, uint32_t size);
+};
+
+#endif // MODEL_STORE_H
@@ -0,0 +1,241 @@
+/*
+ * model_weights.cpp - EON 編譯模型常數張量換綁實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "model_weights.h"
+#include "config.h"
+
+#if MODEL_PARTITION || MODEL_WEIGHT_PIN
+
+/* 與 Edge Impulse 匯出檔同一個編譯單元，才能存取其匿名 namespace 中的 tensorData[]；
+ * main/CMakeLists.txt 已將該檔自 MODEL_FILES 移除，避免重複定義 */
+#include EI_MODEL_COMPILED_SOURCE
+#include <string.h>
+#include "esp_heap_caps.h"
+
+static constexpr size_t TENSOR_COUNT = sizeof(tensorData) / sizeof(tensorData[0]);
+
+/* 編譯進 app 的原始綁定（第一次換綁前保存） */
+static void              *s_builtin_data[TENSOR_COUNT];
+static TfLiteQuantization s_builtin_quant[TENSOR_COUNT];
+static bool               s_saved = false;
+
+/* 換綁後的量化參數：scale / zero_point 指向酬載 */
+static TfLiteAffineQuantization s_quant[TENSOR_COUNT];
+
+/* 常駐 DRAM 的副本（nullptr = 由 flash 讀取），全部位於 s_pin_arena 中 */
+static uint8_t      *s_pinned[TENSOR_COUNT];
+static uint8_t      *s_pin_arena = nullptr;
+static ModelPinStats s_pin_stats = {};
+static bool          s_pin_done  = false;
+
+static inline size_t pad16(size_t n)
+{
+    return (n + 15) & ~(size_t)15;
+}
+
+static void save_builtin()
+{
+    if (s_saved) return;
+    for (size_t i = 0; i < TENSOR_COUNT; i++) {
+        s_builtin_data[i]  = tensorData[i].data;
+        s_builtin_quant[i] = tensorData[i].quantization;
+    }
+    s_saved = true;
+}
+
+static uint32_t builtin_quant_count(size_t i)
+{
+    const TfLiteQuantization &q = s_saved ? s_builtin_quant[i] : tensorData[i].quantization;
+    if (q.type != kTfLiteAffineQuantization || !q.params) return 0;
+    return (uint32_t)static_cast<const TfLiteAffineQuantization *>(q.params)->scale->size;
+}
+
+static inline bool is_constant(size_t i)
+{
+    return tensorData[i].allocation_type == kTfLiteMmapRo;
+}
+
+/* 換綁常數資料：常駐的張量把新內容複製進 DRAM 副本，其餘直接指向來源 */
+static void bind_data(size_t i, void *src)
+{
+    if (s_pinned[i]) {
+        if (src != s_pinned[i]) memcpy(s_pinned[i], src, tensorData[i].bytes);
+        tensorData[i].data = s_pinned[i];
+    } else {
+        tensorData[i].data = src;
+    }
+}
+
+size_t model_weights_tensor_count()
+{
+    return TENSOR_COUNT;
+}
+
+uint32_t model_weights_layout()
+{
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](uint32_t v) {
+        for (int b = 0; b < 4; b++) {
+            hash ^= (v >> (8 * b)) & 0xFF;
+            hash *= 16777619u;
+        }
+    };
+    for (size_t i = 0; i < TENSOR_COUNT; i++) {
+        mix((uint32_t)tensorData[i].type);
+        mix(is_constant(i) ? 1 : 0);
+        mix((uint32_t)tensorData[i].bytes);
+        mix(builtin_quant_count(i));
+    }
+    return hash;
+}
+
+bool model_weights_bind(const uint8_t *payload, size_t len)
+{
+    save_builtin();
+    if (!payload) {
+        for (size_t i = 0; i < TENSOR_COUNT; i++) {
+            bind_data(i, s_builtin_data[i]);
+            tensorData[i].quantization = s_builtin_quant[i];
+        }
+        return true;
+    }
+    if ((uintptr_t)payload % 16 != 0) return false;
+
+    /* 第一輪：逐筆驗證，任何一筆不符都不動 tensorData */
+    const uint8_t          *data[TENSOR_COUNT]  = {};
+    const TfLiteFloatArray *scale[TENSOR_COUNT] = {};
+    const TfLiteIntArray   *zero[TENSOR_COUNT]  = {};
+    uint32_t                qdim[TENSOR_COUNT]  = {};
+    size_t off = 0;
+    for (size_t i = 0; i < TENSOR_COUNT; i++) {
+        ModelImageEntry e;
+        if (len - off < sizeof(e)) return false;
+        memcpy(&e, payload + off, sizeof(e));
+        off += sizeof(e);
+
+        if (e.data_bytes != (is_constant(i) ? tensorData[i].bytes : 0)) return false;
+        if (e.quant_count != builtin_quant_count(i)) return false;
+        if (e.data_bytes) {
+            if (len - off < pad16(e.data_bytes)) return false;
+            data[i] = payload + off;
+            off += pad16(e.data_bytes);
+        }
+        if (e.quant_count) {
+            size_t array_bytes = pad16(sizeof(int) + e.quant_count * 4);
+            if (len - off < 2 * array_bytes) return false;
+            scale[i] = reinterpret_cast<const TfLiteFloatArray *>(payload + off);
+            zero[i]  = reinterpret_cast<const TfLiteIntArray *>(payload + off + array_bytes);
+            if ((uint32_t)scale[i]->size != e.quant_count || (uint32_t)zero[i]->size != e.quant_count) return false;
+            qdim[i] = e.quant_dim;
+            off += 2 * array_bytes;
+        }
+    }
+    if (off != len) return false;
+
+    /* 第二輪：換綁（常數資料直接指向 mmap 的 flash，常駐的張量才複製） */
+    for (size_t i = 0; i < TENSOR_COUNT; i++) {
+        bind_data(i, data[i] ? const_cast<uint8_t *>(data[i]) : s_builtin_data[i]);
+        if (scale[i]) {
+            s_quant[i].scale               = const_cast<TfLiteFloatArray *>(scale[i]);
+            s_quant[i].zero_point          = const_cast<TfLiteIntArray *>(zero[i]);
+            s_quant[i].quantized_dimension = (int32_t)qdim[i];
+            tensorData[i].quantization     = { kTfLiteAffineQuantization, &s_quant[i] };
+        } else {
+            tensorData[i].quantization = s_builtin_quant[i];
+        }
+    }
+    return true;
+}
+
+bool model_weights_pin(size_t budget, size_t max_tensor, ModelPinStats *stats)
+{
+    if (s_pin_done) {
+        if (stats) *stats = s_pin_stats;
+        return s_pin_arena != nullptr;
+    }
+    s_pin_done = true;
+    save_builtin();
+
+    /* 常數張量依第一次被節點讀取的先後排序：前幾層的 bias / 卷積核先常駐 */
+    size_t order[TENSOR_COUNT];
+    bool   seen[TENSOR_COUNT] = {};
+    size_t n = 0;
+    for (size_t k = 0; k < tflNodes_subgraph_index[1]; k++) {
+        const TfLiteIntArray *in = tflNodes[k].inputs;
+        for (int j = 0; j < in->size; j++) {
+            int t = in->data[j];
+            if (t < 0 || (size_t)t >= TENSOR_COUNT || seen[t] || !is_constant(t)) continue;
+            seen[t]    = true;
+            order[n++] = (size_t)t;
+        }
+    }
+
+    ModelPinStats st = {};
+    size_t total = 0;
+    bool   take[TENSOR_COUNT] = {};
+    for (size_t k = 0; k < n; k++) {
+        size_t bytes = tensorData[order[k]].bytes;
+        if (bytes <= max_tensor && total + pad16(bytes) <= budget) {
+            take[order[k]] = true;
+            total += pad16(bytes);
+        } else {
+            st.flash_tensors++;
+            st.flash_bytes += bytes;
+        }
+    }
+    if (total) {
+        s_pin_arena = static_cast<uint8_t *>(heap_caps_aligned_alloc(16, total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    }
+    if (!s_pin_arena) {
+        for (size_t k = 0; k < n; k++) {
+            if (!take[order[k]]) continue;
+            st.flash_tensors++;
+            st.flash_bytes += tensorData[order[k]].bytes;
+        }
+        s_pin_stats = st;
+        if (stats) *stats = st;
+        return false;
+    }
+
+    /* 依執行順序連續擺放（目前綁定的內容，可能已是 model 分區的權重） */
+    size_t off = 0;
+    for (size_t k = 0; k < n; k++) {
+        size_t i = order[k];
+        if (!take[i]) continue;
+        s_pinned[i] = s_pin_arena + off;
+        off += pad16(tensorData[i].bytes);
+        bind_data(i, tensorData[i].data);
+        st.pinned_tensors++;
+    }
+    st.pinned_bytes = (uint32_t)total;
+    s_pin_stats = st;
+    if (stats) *stats = st;
+    return true;
+}
+
+#else
+
+size_t model_weights_tensor_count()
+{
+    return 0;
+}
+
+uint32_t model_weights_layout()
+{
+    return 0;
+}
+
+bool model_weights_bind(const uint8_t *payload, size_t)
+{
+    return payload == nullptr;
+}
+
+bool model_weights_pin(size_t, size_t, ModelPinStats *stats)
+{
+    if (stats) *stats = {};
+    return false;
+}
+
+#endif // MODEL_PARTITION || MODEL_WEIGHT_PIN
@@ -0,0 +1,64 @@
+#ifndef MODEL_WEIGHTS_H
+#define MODEL_WEIGHTS_H
+
+/* ============================================================
+ * model_weights.h - 替換 EON 編譯模型的常數張量與量化參數
+ * ESP-MIAO v0.8.0
+ *
+ * model_weights.cpp 直接 #include Edge Impulse 匯出的 *_compiled.cpp（EI_MODEL_COMPILED_SOURCE），
+ * 以便改寫其 tensorData[] 表中的資料指標與量化參數；EON 每次推論都由此表重新建立張量，
+ * 因此換綁後的下一次推論即使用新權重。只接受與編譯模型同架構的映像（張量數、型別、大小、
+ * 量化通道數皆相同），通常是同一個 Edge Impulse 專案以更多資料重新訓練的結果。
+ *
+ * 映像酬載（ModelImageHeader 之後，scripts/build_model_image.py 產生，little-endian）：
+ *   依 tensorData[] 順序，每個張量一筆 ModelImageEntry（16 bytes），其後依序接
+ *     常數資料 data_bytes（僅 kTfLiteMmapRo 張量，大小須與編譯模型相同）
+ *     TfLiteFloatArray scale[quant_count]、TfLiteIntArray zero_point[quant_count]
+ *   每段補齊到 16 bytes（int8 / int32 / float 載入皆對齊）。
+ *
+ * 權重常駐（MODEL_WEIGHT_PIN）：model_weights_pin 依層執行順序把小常數張量複製到內部 DRAM
+ * 的一塊連續空間，其餘仍由 flash cache 讀取；之後的 model_weights_bind 把新權重複製進同一份副本
+ * （同架構映像的張量大小相同），常駐集合不變。
+ *
+ * 只可於推論 Task、兩次推論之間呼叫 model_weights_bind / model_weights_pin。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct ModelImageEntry {
+    uint32_t data_bytes;      // 常數張量的資料大小；activation 張量為 0
+    uint32_t quant_count;     // 量化通道數；未量化為 0
+    uint32_t quant_dim;       // TfLiteAffineQuantization::quantized_dimension
+    uint32_t reserved;
+};
+static_assert(sizeof(ModelImageEntry) == 16, "ModelImageEntry layout is shared with build_model_image.py");
+
+/** 編譯模型的張量數 */
+size_t model_weights_tensor_count();
+
+/** 編譯模型的架構指紋（各張量型別 / 配置 / 大小 / 量化通道數的 FNV-1a），映像須相同 */
+uint32_t model_weights_layout();
+
+/**
+ * 驗證酬載並換綁所有張量（任一筆不符則完全不變）。
+ * @param payload 映像酬載（須持續有效，通常是 mmap 的 flash）；nullptr = 換回編譯進 app 的權重
+ * @return false = 酬載與編譯模型不符
+ */
+bool model_weights_bind(const uint8_t *payload, size_t len);
+
+struct ModelPinStats {
+    uint32_t pinned_tensors;
+    uint32_t pinned_bytes;    // 內部 DRAM 副本（含 16 bytes 對齊）
+    uint32_t flash_tensors;
+    uint32_t flash_bytes;     // 仍由 flash cache 讀取的常數資料
+};
+
+/**
+ * 依第一次被讀取的先後（tflNodes 執行順序）把常數張量複製到內部 DRAM：
+ * 大於 max_tensor 的留在 flash，累計到 budget 為止。只做一次，重複呼叫只回報統計。
+ * @return false = 沒有張量常駐（未啟用、全部超過限制或 DRAM 配置失敗）
+ */
+bool model_weights_pin(size_t budget, size_t max_tensor, ModelPinStats *stats);
+
+#endif // MODEL_WEIGHTS_H
@@ -0,0 +1,102 @@
+/*
+ * nvs_batch.cpp - NVS 延後寫入的待寫表與排程判斷實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "nvs_batch.h"
+#include <string.h>
+
+NvsBatch::NvsBatch() : count_(0), used_(0), quiet_since_(-1), coalesced_(0)
+{
+    configure(0, 0);
+}
+
+void NvsBatch::configure(int64_t quiet_us, int64_t max_defer_us)
+{
+    quiet_us_     = quiet_us;
+    max_defer_us_ = max_defer_us;
+}
+
+bool NvsBatch::put(const char *ns, const char *key, NvsValueType type, const void *data, size_t len,
+                   int64_t now_us)
+{
+    if (strlen(ns) >= NVS_BATCH_NAME_LEN || strlen(key) >= NVS_BATCH_NAME_LEN) return false;
+
+    int64_t queued = now_us;
+    int     found  = -1;
+    for (int i = 0; i < count_; i++) {
+        if (strcmp(entries_[i].ns, ns) == 0 && strcmp(entries_[i].key, key) == 0) found = i;
+    }
+    /* 覆蓋後的空間（舊值移除）足夠才動表，失敗時保留舊值 */
+    size_t free_bytes = NVS_BATCH_POOL_BYTES - used_ + (found >= 0 ? entries_[found].len : 0);
+    if (len > free_bytes || (found < 0 && count_ == NVS_BATCH_SLOTS)) return false;
+    if (found >= 0) {
+        queued = entries_[found].queued_us;
+        remove_(found);
+        coalesced_++;
+    }
+
+    NvsBatchEntry &e = entries_[count_++];
+    strcpy(e.ns, ns);
+    strcpy(e.key, key);
+    e.type      = type;
+    e.len       = (uint16_t)len;
+    e.offset    = used_;
+    e.queued_us = queued;
+    memcpy(pool_ + used_, data, len);
+    used_ += (uint16_t)len;
+    return true;
+}
+
+bool NvsBatch::requeue(const NvsBatchEntry &e, const uint8_t *value)
+{
+    for (int i = 0; i < count_; i++) {
+        if (strcmp(entries_[i].ns, e.ns) == 0 && strcmp(entries_[i].key, e.key) == 0) {
+            if (e.queued_us < entries_[i].queued_us) entries_[i].queued_us = e.queued_us;
+            return true;
+        }
+    }
+    return put(e.ns, e.key, e.type, value, e.len, e.queued_us);
+}
+
+/* 移除項目並把之後的值往前搬，pool 保持連續 */
+void NvsBatch::remove_(int i)
+{
+    const uint16_t off = entries_[i].offset;
+    const uint16_t len = entries_[i].len;
+    memmove(pool_ + off, pool_ + off + len, used_ - off - len);
+    used_ -= len;
+    for (int j = i; j < count_ - 1; j++) entries_[j] = entries_[j + 1];
+    count_--;
+    for (int j = 0; j < count_; j++) {
+        if (entries_[j].offset > off) entries_[j].offset -= len;
+    }
+}
+
+bool NvsBatch::due(int64_t now_us, bool quiet)
+{
+    if (!quiet) quiet_since_ = -1;
+    else if (quiet_since_ < 0) quiet_since_ = now_us;
+    if (count_ == 0) return false;
+    return quiet_enough(now_us) || now_us - oldest_us() >= max_defer_us_;
+}
+
+bool NvsBatch::quiet_enough(int64_t now_us) const
+{
+    return quiet_since_ >= 0 && now_us - quiet_since_ >= quiet_us_;
+}
+
+int64_t NvsBatch::oldest_us() const
+{
+    int64_t oldest = INT64_MAX;
+    for (int i = 0; i < count_; i++) {
+        if (entries_[i].queued_us < oldest) oldest = entries_[i].queued_us;
+    }
+    return oldest;
+}
+
+void NvsBatch::clear()
+{
+    count_ = 0;
+    used_  = 0;
+}
@@ -0,0 +1,94 @@
+#ifndef NVS_BATCH_H
+#define NVS_BATCH_H
+
+/* ============================================================
+ * nvs_batch.h - NVS 延後寫入的待寫表與排程判斷
+ * ESP-MIAO v0.8.0
+ *
+ * 每次 NVS 寫入都會關閉 flash cache，另一核心從 flash 執行的推論隨之停住。
+ * 設定值改為先放進這張表，同一 namespace / key 的新值覆蓋舊值（只寫最後一次），
+ * 等到安靜的時段再一次寫完：
+ *   due()：有待寫項目，且已連續安靜 quiet_us；或最舊的項目已等待 max_defer_us
+ * 值放在共用的 byte pool 內（端點清單最長約 384 B，其餘只有數 byte），
+ * 覆蓋時移除舊值再附加到尾端；寫出失敗的項目以 requeue() 放回，等下一個安靜時段重試。
+ * 純計算、無 RTOS 相依（主機測試直接使用）；呼叫端負責互斥。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NVS_BATCH_SLOTS      8
+#define NVS_BATCH_POOL_BYTES 768
+#define NVS_BATCH_NAME_LEN   16    // 與 NVS_KEY_NAME_MAX_SIZE 相同（含結尾 0）
+
+enum NvsValueType : uint8_t {
+    NVS_VALUE_U8 = 0,
+    NVS_VALUE_STR,     // len 含結尾 0
+    NVS_VALUE_BLOB,
+};
+
+struct NvsBatchEntry {
+    char         ns[NVS_BATCH_NAME_LEN];
+    char         key[NVS_BATCH_NAME_LEN];
+    NvsValueType type;
+    uint16_t     len;
+    uint16_t     offset;      // pool 內位置
+    int64_t      queued_us;   // 第一次排入的時間（被覆蓋時保留，延後上限不會被反覆更新推遲）
+};
+
+class NvsBatch {
+public:
+    NvsBatch();
+
+    /**
+     * @param quiet_us     連續安靜多久才寫入
+     * @param max_defer_us 最舊項目等待的上限，到期不論是否安靜都寫入
+     */
+    void configure(int64_t quiet_us, int64_t max_defer_us);
+
+    /**
+     * 排入一個值；同一 ns / key 已在表中時覆蓋。
+     * @return false = 名稱過長或表 / pool 已滿（呼叫端應先寫出再重試）
+     */
+    bool put(const char *ns, const char *key, NvsValueType type, const void *data, size_t len,
+             int64_t now_us);
+
+    /**
+     * 放回寫出失敗的項目，保留原本的 queued_us（下一個安靜時段重試）。
+     * 寫出期間同一 ns / key 已排入新值時保留新值，只沿用較早的排入時間。
+     * @return false = 表 / pool 已滿，該值遺失
+     */
+    bool requeue(const NvsBatchEntry &e, const uint8_t *value);
+
+    /**
+     * 目前是否該寫出；每次輪詢呼叫一次以追蹤安靜時段。
+     * @param quiet 此刻沒有推論 / 串流 / 語音
+     */
+    bool due(int64_t now_us, bool quiet);
+
+    /** 安靜時段的長度是否已足夠（due() 為 true 時區分排程內寫出或逾時強制寫出） */
+    bool quiet_enough(int64_t now_us) const;
+
+    int                  count() const { return count_; }
+    const NvsBatchEntry &entry(int i) const { return entries_[i]; }
+    const uint8_t       *value(const NvsBatchEntry &e) const { return pool_ + e.offset; }
+    int64_t              oldest_us() const;
+    uint32_t             coalesced() const { return coalesced_; }   // 被覆蓋而省下的寫入（累計）
+
+    /** 清空待寫項目（安靜時段與累計數保留） */
+    void clear();
+
+private:
+    NvsBatchEntry entries_[NVS_BATCH_SLOTS];
+    uint8_t       pool_[NVS_BATCH_POOL_BYTES];
+    int           count_;
+    uint16_t      used_;
+    int64_t       quiet_us_;
+    int64_t       max_defer_us_;
+    int64_t       quiet_since_;   // -1 = 目前不安靜
+    uint32_t      coalesced_;
+
+    void remove_(int i);
+};
+
+#endif // NVS_BATCH_H
@@ -0,0 +1,260 @@
+/*
+ * nvs_writer.cpp - NVS 延後寫入實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "nvs_writer.h"
+#include "nvs_batch.h"
+#include "config.h"
+#include "rtos_alloc.h"
+#include "contention.h"
+#include "power_state.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include <string.h>
+
+static const char *TAG = "NvsWriter";
+
+/* 有任一來源宣告時不寫 flash：推論進行中、串流中、VAD 近期有語音 */
+static const uint32_t kBusyHolds =
+    (1u << PWR_HOLD_INFERENCE) | (1u << PWR_HOLD_STREAM) | (1u << PWR_HOLD_SPEECH);
+
+static SemaphoreHandle_t s_lock       = nullptr;   // s_batch / s_stats
+static SemaphoreHandle_t s_flush_lock = nullptr;   // 同時只有一個批次在寫；s_inflight
+static NvsBatch          s_batch;
+static NvsBatch          s_inflight;               // 寫出中的批次（不佔 Task stack）
+static NvsWriterStats    s_stats;
+static uint64_t          s_defer_sum_ms = 0;
+static uint32_t          s_defer_count  = 0;
+static uint32_t          s_coalesced_taken = 0;
+static bool              s_deferred = false;       // 背景 Task 已啟動
+static bool              s_retrying = false;       // 有放回重試的項目：只在安靜時段寫出
+
+static esp_err_t set_value_(nvs_handle_t h, const NvsBatchEntry &e, const uint8_t *v)
+{
+    switch (e.type) {
+    case NVS_VALUE_U8:  return nvs_set_u8(h, e.key, v[0]);
+    case NVS_VALUE_STR: return nvs_set_str(h, e.key, (const char *)v);
+    default:            return nvs_set_blob(h, e.key, v, e.len);
+    }
+}
+
+/*
+ * 依 namespace 分組寫出 s_inflight；須持有 s_flush_lock。
+ * 背景寫出時，open / set / commit 失敗的項目以原本的排入時間放回 s_batch 重試
+ * （commit 失敗時整個 namespace 都視為未寫入）；立即寫入模式由呼叫端取得錯誤。
+ */
+static esp_err_t write_inflight_(bool forced)
+{
+    const int n = s_inflight.count();
+    if (n == 0) return ESP_OK;
+
+    bool      done[NVS_BATCH_SLOTS]   = {};
+    bool      failed[NVS_BATCH_SLOTS] = {};
+    esp_err_t first_err   = ESP_OK;
+    int       written     = 0;
+    int       groups      = 0;
+    uint32_t  busy_max    = 0;
+    uint32_t  busy_total  = 0;
+    uint32_t  defer_max   = 0;
+    uint64_t  defer_sum   = 0;
+    const int64_t start   = esp_timer_get_time();
+
+    for (int i = 0; i < n; i++) {
+        if (done[i]) continue;
+        const char *ns = s_inflight.entry(i).ns;
+        nvs_handle_t h;
+        int        ns_written = 0;
+        esp_err_t  commit_err = ESP_FAIL;
+        esp_err_t  err        = nvs_open(ns, NVS_READWRITE, &h);
+        if (err == ESP_OK) {
+            const int64_t t0 = esp_timer_get_time();
+            {
+                ContentionScope flash(CONTENTION_FLASH);   // 每個 set 都會關閉 flash cache
+                for (int j = i; j < n; j++) {
+                    const NvsBatchEntry &e = s_inflight.entry(j);
+                    if (done[j] || strcmp(e.ns, ns) != 0) continue;
+                    esp_err_t set_err = set_value_(h, e, s_inflight.value(e));
+                    if (set_err == ESP_OK) {
+                        ns_written++;
+                    } else {
+                        failed[j] = true;
+                        if (err == ESP_OK) err = set_err;
+                    }
+                }
+                commit_err = nvs_commit(h);
+                if (err == ESP_OK) err = commit_err;
+            }
+            const uint32_t busy = (uint32_t)(esp_timer_get_time() - t0);
+            busy_total += busy;
+            if (busy > busy_max) busy_max = busy;
+            nvs_close(h);
+        }
+        groups++;
+
+        if (commit_err == ESP_OK) written += ns_written;
+
+        for (int j = i; j < n; j++) {
+            const NvsBatchEntry &e = s_inflight.entry(j);
+            if (done[j] || strcmp(e.ns, ns) != 0) continue;
+            done[j] = true;
+            if (commit_err != ESP_OK) failed[j] = true;
+            uint32_t defer = (uint32_t)((start - e.queued_us) / 1000);
+            defer_sum += defer;
+            if (defer > defer_max) defer_max = defer;
+        }
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Write to namespace '%s' failed: %s", ns, esp_err_to_name(err));
+            if (first_err == ESP_OK) first_err = err;
+        }
+    }
+
+    int failures = 0, lost = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int j = 0; j < n; j++) {
+        if (!failed[j]) continue;
+        failures++;
+        const NvsBatchEntry &e = s_inflight.entry(j);
+        if (s_deferred && !s_batch.requeue(e, s_inflight.value(e))) lost++;
+    }
+    if (s_deferred) s_retrying = failures > lost;
+    s_stats.failed += failures;
+    s_stats.writes += written;
+    s_stats.flushes++;
+    if (forced) s_stats.forced++;
+    s_stats.busy_total_us += busy_total;
+    if (busy_max > s_stats.busy_max_us) s_stats.busy_max_us = busy_max;
+    if (defer_max > s_stats.defer_max_ms) s_stats.defer_max_ms = defer_max;
+    s_defer_sum_ms += defer_sum;
+    s_defer_count  += n;
+    xSemaphoreGive(s_lock);
+    s_inflight.clear();
+
+    if (s_deferred && failures) {
+        ESP_LOGW(TAG, "%d key(s) not written, %d requeued for the next quiet period", failures,
+                 failures - lost);
+    }
+    if (s_deferred) {
+        ESP_LOGI(TAG, "Wrote %d key(s) in %d namespace(s)%s: deferred up to %lu ms, flash busy %lu us",
+                 written, groups, forced ? " (forced)" : "", (unsigned long)defer_max,
+                 (unsigned long)busy_total);
+    }
+    return first_err;
+}
+
+/* 取出目前的待寫表並寫出 */
+static esp_err_t flush_(bool forced)
+{
+    xSemaphoreTake(s_flush_lock, portMAX_DELAY);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_inflight = s_batch;
+    s_batch.clear();
+    xSemaphoreGive(s_lock);
+    esp_err_t err = write_inflight_(forced);
+    xSemaphoreGive(s_flush_lock);
+    return err;
+}
+
+static esp_err_t put_(const char *ns, const char *key, NvsValueType type, const void *data, size_t len)
+{
+    if (!s_lock) {
+        ESP_LOGE(TAG, "Write to %s/%s before nvs_writer_start()", ns, key);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > NVS_BATCH_POOL_BYTES) return ESP_ERR_INVALID_SIZE;
+
+    if (!s_deferred) {
+        /* 立即寫入：經同一路徑以取得相同的統計 */
+        xSemaphoreTake(s_flush_lock, portMAX_DELAY);
+        s_inflight.clear();
+        esp_err_t err = s_inflight.put(ns, key, type, data, len, esp_timer_get_time())
+                            ? write_inflight_(false) : ESP_ERR_INVALID_ARG;
+        xSemaphoreGive(s_flush_lock);
+        return err;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool ok = s_batch.put(ns, key, type, data, len, esp_timer_get_time());
+        xSemaphoreGive(s_lock);
+        if (ok) return ESP_OK;
+        if (attempt == 0) flush_(true);   // 表已滿：在呼叫端 Task 先寫出
+    }
+    return ESP_ERR_INVALID_ARG;   // 名稱過長
+}
+
+static void task_entry_(void *arg)
+{
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(NVS_WB_POLL_MS));
+        const int64_t now   = esp_timer_get_time();
+        const bool    quiet = (power_holds() & kBusyHolds) == 0;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool due       = s_batch.due(now, quiet);
+        bool scheduled = s_batch.quiet_enough(now);
+        /* 放回的項目保留原本的排入時間，早已超過延後上限：忙碌時不每次輪詢都強制重試 */
+        if (s_retrying && !scheduled) due = false;
+        xSemaphoreGive(s_lock);
+        if (due) flush_(!scheduled);
+    }
+}
+
+bool nvs_writer_start()
+{
+    if (s_lock) return true;
+    s_lock       = RTOS_MUTEX_CREATE();
+    s_flush_lock = RTOS_MUTEX_CREATE();
+    if (!s_lock || !s_flush_lock) {
+        ESP_LOGE(TAG, "Failed to create locks");
+        return false;
+    }
+#if NVS_WRITE_BEHIND
+    s_batch.configure((int64_t)NVS_WB_QUIET_MS * 1000, (int64_t)NVS_WB_MAX_DEFER_S * 1000000);
+    if (RTOS_TASK_CREATE(task_entry_, "nvs_writer", NVS_WB_TASK_STACK, nullptr,
+                         NVS_WB_TASK_PRIO, nullptr, NVS_WB_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start writer task, writing NVS directly");
+        return false;
+    }
+    s_deferred = true;
+#else
+    (void)task_entry_;
+#endif
+    return true;
+}
+
+esp_err_t nvs_writer_set_u8(const char *ns, const char *key, uint8_t value)
+{
+    return put_(ns, key, NVS_VALUE_U8, &value, 1);
+}
+
+esp_err_t nvs_writer_set_str(const char *ns, const char *key, const char *value)
+{
+    return put_(ns, key, NVS_VALUE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_writer_set_blob(const char *ns, const char *key, const void *data, size_t len)
+{
+    return put_(ns, key, NVS_VALUE_BLOB, data, len);
+}
+
+esp_err_t nvs_writer_flush()
+{
+    if (!s_lock || !s_deferred) return ESP_OK;
+    return flush_(true);
+}
+
+void nvs_writer_take_stats(NvsWriterStats *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    out->defer_avg_ms = s_defer_count ? (uint32_t)(s_defer_sum_ms / s_defer_count) : 0;
+    out->coalesced    = s_batch.coalesced() - s_coalesced_taken;
+    s_coalesced_taken = s_batch.coalesced();
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_defer_sum_ms = 0;
+    s_defer_count  = 0;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,51 @@
+#ifndef NVS_WRITER_H
+#define NVS_WRITER_H
+
+/* ============================================================
+ * nvs_writer.h - NVS 延後寫入（write-behind）
+ * ESP-MIAO v0.8.0
+ *
+ * 執行期的設定寫入排入 NvsBatch（nvs_batch.h），由背景 Task 每 NVS_WB_POLL_MS
+ * 檢查一次：推論閘門關閉、沒有串流、VAD 安靜（power_holds() 沒有
+ * INFERENCE / STREAM / SPEECH）連續 NVS_WB_QUIET_MS 即依 namespace 分組一次寫完；
+ * 一直忙碌時最舊的值等待 NVS_WB_MAX_DEFER_S 後強制寫出。
+ * 寫入失敗的值放回待寫表，下一個安靜時段重試（計入 failed）。
+ * NVS_WRITE_BEHIND=0 時 set_* 立即寫入，統計照常記錄（可比較兩種模式的 flash 佔用）。
+ * 排入後、寫出前讀取 NVS 仍會得到舊值；重開機前未寫出的值會遺失，
+ * 使用者佈建（憑證、端點清單）寫入後應呼叫 nvs_writer_flush()。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+struct NvsWriterStats {
+    uint32_t writes;          // 寫入 flash 的 key 數
+    uint32_t flushes;         // 批次數（每批每個 namespace 一次 commit）
+    uint32_t forced;          // 非安靜時段寫出的批次（逾時 / 表滿 / nvs_writer_flush）
+    uint32_t coalesced;       // 被新值覆蓋而省下的寫入
+    uint32_t defer_max_ms;    // 排入到寫出的最長延遲
+    uint32_t defer_avg_ms;
+    uint32_t busy_max_us;     // 單一 namespace 寫入（flash cache 反覆關閉）的最長時間
+    uint32_t busy_total_us;
+    uint32_t failed;          // open / set / commit 失敗的 key（背景寫出時放回重試）
+};
+
+/** 建立鎖與背景 Task（NVS_WRITE_BEHIND=0 時只建立鎖）；須在任何 nvs_writer_set_* 之前、nvs_flash_init 之後呼叫 */
+bool nvs_writer_start();
+
+/**
+ * 排入一個值（同一 ns / key 覆蓋尚未寫出的舊值；表滿時先在呼叫端 Task 寫出）。
+ * @return ESP_OK = 已排入（或 NVS_WRITE_BEHIND=0 時已寫入）
+ */
+esp_err_t nvs_writer_set_u8(const char *ns, const char *key, uint8_t value);
+esp_err_t nvs_writer_set_str(const char *ns, const char *key, const char *value);
+esp_err_t nvs_writer_set_blob(const char *ns, const char *key, const void *data, size_t len);
+
+/** 立即在呼叫端 Task 寫出所有待寫值，回傳第一個錯誤 */
+esp_err_t nvs_writer_flush();
+
+/** 自上次取出以來的統計，取出後歸零 */
+void nvs_writer_take_stats(NvsWriterStats *out);
+
+#endif // NVS_WRITER_H
@@ -0,0 +1,352 @@
+/*
+ * perf_console.cpp - UART 效能 console 實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "perf_console.h"
+
+#if PERF_CONSOLE
+
+#include "wake_word_detector.h"
+#include "stage_profiler.h"
+#include "rtos_alloc.h"
+#include "contention.h"
+#include "spsc_channel.h"
+#include "esp_console.h"
+#include "esp_heap_caps.h"
+#include "esp_idf_version.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+
+static const char *TAG = "Console";
+
+static SemaphoreHandle_t s_ei_mutex = nullptr;
+
+EiRuntimeGuard::EiRuntimeGuard() : held_(s_ei_mutex)
+{
+    if (held_) xSemaphoreTake(held_, portMAX_DELAY);
+}
+
+EiRuntimeGuard::~EiRuntimeGuard()
+{
+    if (held_) xSemaphoreGive(held_);
+}
+
+PerfConsole *PerfConsole::instance_ = nullptr;
+
+PerfConsole::PerfConsole(WakeWordDetector &detector, VAD &vad)
+    : detector_(detector), vad_(vad)
+{
+}
+
+bool PerfConsole::start()
+{
+    if (instance_) return true;
+    instance_  = this;
+    s_ei_mutex = RTOS_MUTEX_CREATE();
+
+    esp_console_repl_config_t repl_cfg = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_cfg.prompt          = "miao>";
+    repl_cfg.task_stack_size = PERF_CONSOLE_TASK_STACK;
+    repl_cfg.task_priority   = PERF_CONSOLE_TASK_PRIO;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+    repl_cfg.task_core_id    = PERF_CONSOLE_TASK_CORE;   // 較舊的 IDF 不綁核（優先權仍為最低）
+#endif
+    esp_console_dev_uart_config_t uart_cfg = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    esp_console_repl_t *repl = nullptr;
+    esp_err_t err = esp_console_new_repl_uart(&uart_cfg, &repl_cfg, &repl);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "REPL init failed: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    const esp_console_cmd_t cmds[] = {
+        { "stats", "VAD statistics, wake threshold and per-stage timing of the current telemetry window",
+          nullptr, &PerfConsole::cmd_stats_, nullptr },
+        { "tasks", "Task list and CPU usage (needs FreeRTOS trace facility / run time stats)",
+          nullptr, &PerfConsole::cmd_tasks_, nullptr },
+        { "heap", "Free / largest block / minimum free of each heap region", nullptr, &PerfConsole::cmd_heap_,
+          nullptr },
+        { "contention", "Heap / flash / SPI holds and who blocked whom since boot", nullptr,
+          &PerfConsole::cmd_contention_, nullptr },
+        { "channels", "Cross-task SPSC channels: traffic, drops, depth and handoff latency of this window",
+          nullptr, &PerfConsole::cmd_channels_, nullptr },
+        { "bench", "Run one stage N times on synthetic audio", "vad|mfcc|nn [N]", &PerfConsole::cmd_bench_,
+          nullptr },
+        { "set", "Override the wake threshold (not saved) or toggle per-slice debug output",
+          "threshold <wake> [vad_floor] | vad_debug on|off", &PerfConsole::cmd_set_, nullptr },
+    };
+    for (const esp_console_cmd_t &cmd : cmds) ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+    esp_console_register_help_command();
+
+    err = esp_console_start_repl(repl);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "REPL start failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+/* ---------- stats / tasks / heap ---------- */
+
+int PerfConsole::cmd_stats_(int, char **)
+{
+    PerfConsole *self = instance_;
+    VadStats     v    = self->vad_.stats();   // 推論 Task 持續更新，複製後顯示
+    WakeTuning   t    = self->detector_.tuning();
+    printf("VAD  : fft_trig=%lu ml_trig=%lu rms_avg=%.2f fft_avg=%.1f peak=%.1f speech=%.0f%%\n",
+           (unsigned long)v.fft_triggers, (unsigned long)v.ml_triggered, v.rms_avg, v.fft_avg, v.fft_peak,
+           100.0f * v.speech_ratio_avg);
+    printf("       noise_floor=%.1f threshold=%.1f agc=%.2fx\n", v.noise_floor, v.threshold, v.agc_gain);
+    printf("Wake : threshold=%.3f vad_floor=%.0f (tuning v%lu) vad_debug=%s\n", t.wake_threshold, t.vad_threshold,
+           (unsigned long)t.version, self->detector_.vad_debug() ? "on" : "off");
+
+#if TELEMETRY_INTERVAL_S > 0
+    StageProfiler::Summary s[PROF_STAGE_COUNT];
+    self->detector_.profiler().peek(s);
+    printf("%-9s %7s %7s %7s %7s %7s  (us, current %ds window)\n", "stage", "count", "min", "avg", "p99", "max",
+           TELEMETRY_INTERVAL_S);
+    for (int i = 0; i < PROF_STAGE_COUNT; i++) {
+        if (s[i].count == 0) continue;
+        printf("%-9s %7lu %7lu %7lu %7lu %7lu\n", StageProfiler::stage_name((ProfileStage)i),
+               (unsigned long)s[i].count, (unsigned long)s[i].min_us, (unsigned long)s[i].avg_us,
+               (unsigned long)s[i].p99_us, (unsigned long)s[i].max_us);
+    }
+#else
+    printf("Stage profiler off (TELEMETRY_INTERVAL_S = 0)\n");
+#endif
+    return 0;
+}
+
+int PerfConsole::cmd_tasks_(int, char **)
+{
+#if configUSE_TRACE_FACILITY && configUSE_STATS_FORMATTING_FUNCTIONS && configGENERATE_RUN_TIME_STATS
+    static char buf[TASK_STATS_BUF_LEN];
+    vTaskList(buf);
+    printf("name            state prio stack num core\n%s\n", buf);
+    vTaskGetRunTimeStats(buf);
+    printf("name            time          %%\n%s", buf);
+#else
+    printf("Enable FreeRTOS trace facility, stats formatting and run time stats in menuconfig\n");
+#endif
+    return 0;
+}
+
+int PerfConsole::cmd_heap_(int, char **)
+{
+    static const struct {
+        const char *name;
+        uint32_t    caps;
+    } regions[] = {
+        { "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+        { "dma",      MALLOC_CAP_DMA },
+        { "iram",     MALLOC_CAP_EXEC },
+#if CONFIG_SPIRAM
+        { "spiram",   MALLOC_CAP_SPIRAM },
+#endif
+    };
+    printf("%-9s %8s %8s %8s\n", "region", "free", "largest", "min_free");
+    for (const auto &r : regions) {
+        printf("%-9s %8u %8u %8u\n", r.name, (unsigned)heap_caps_get_free_size(r.caps),
+               (unsigned)heap_caps_get_largest_free_block(r.caps), (unsigned)heap_caps_get_minimum_free_size(r.caps));
+    }
+    return 0;
+}
+
+int PerfConsole::cmd_contention_(int, char **)
+{
+#if CONFIG_ESP_MIAO_CONTENTION_MAP
+    contention_print();
+#else
+    printf("Enable CONFIG_ESP_MIAO_CONTENTION_MAP in menuconfig\n");
+#endif
+    return 0;
+}
+
+int PerfConsole::cmd_channels_(int, char **)
+{
+    int n = g_spsc_channel_count.load(std::memory_order_acquire);
+    if (n > SPSC_REGISTRY_MAX) n = SPSC_REGISTRY_MAX;
+    printf("%-12s %9s %9s %7s %5s %9s %10s %10s\n", "channel", "pushed", "popped", "dropped", "depth",
+           "depth_max", "lat_avg_us", "lat_max_us");
+    for (int i = 0; i < n; i++) {
+        const SpscChannelEntry &e = g_spsc_channels[i];
+        if (!e.name) continue;   // 登記中
+        SpscChannelStats st = e.channel->take_stats();
+        printf("%-12s %9lu %9lu %7lu %5lu %9lu %10lu %10lu\n", e.name, (unsigned long)st.pushed,
+               (unsigned long)st.popped, (unsigned long)st.dropped, (unsigned long)st.depth,
+               (unsigned long)st.depth_max, (unsigned long)st.latency_avg_us, (unsigned long)st.latency_max_us);
+    }
+    return 0;
+}
+
+/* ---------- bench ---------- */
+
+/* 合成 1 秒視窗：150 Hz 基頻 + 諧波、4 Hz 音節包絡與固定種子白噪音（每次結果可比） */
+static const int16_t *s_bench_pcm = nullptr;
+
+static void synth_audio(int16_t *out, size_t n)
+{
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < n; i++) {
+        float t     = (float)i / EI_CLASSIFIER_FREQUENCY;
+        float env   = 0.55f + 0.45f * sinf(2.0f * (float)M_PI * 4.0f * t);
+        float voice = 0.0f;
+        for (int h = 1; h <= 6; h++) voice += sinf(2.0f * (float)M_PI * 150.0f * h * t) / h;
+        seed        = seed * 1664525u + 1013904223u;
+        float noise = ((int32_t)(seed >> 16) - 32768) / 32768.0f;
+        out[i]      = (int16_t)(3000.0f * env * voice + 300.0f * noise);
+    }
+}
+
+static int bench_get_data(size_t offset, size_t length, float *out_ptr)
+{
+    if (offset + length > EI_CLASSIFIER_RAW_SAMPLE_COUNT) return -1;
+    for (size_t i = 0; i < length; i++) out_ptr[i] = (float)s_bench_pcm[offset + i];
+    return 0;
+}
+
+struct BenchTimes {
+    uint32_t runs;
+    int64_t  min_us, max_us, sum_us;
+
+    void add(int64_t us)
+    {
+        if (runs == 0 || us < min_us) min_us = us;
+        if (us > max_us) max_us = us;
+        sum_us += us;
+        runs++;
+    }
+};
+
+int PerfConsole::cmd_bench_(int argc, char **argv)
+{
+    if (argc < 2) {
+        printf("usage: bench vad|mfcc|nn [N]\n");
+        return 1;
+    }
+    int n = argc > 2 ? atoi(argv[2]) : 100;
+    if (n < 1) n = 1;
+    if (n > PERF_CONSOLE_BENCH_MAX) n = PERF_CONSOLE_BENCH_MAX;
+
+    int16_t *pcm = static_cast<int16_t *>(malloc(EI_CLASSIFIER_RAW_SAMPLE_COUNT * sizeof(int16_t)));
+    if (!pcm) {
+        printf("out of memory\n");
+        return 1;
+    }
+    synth_audio(pcm, EI_CLASSIFIER_RAW_SAMPLE_COUNT);
+    s_bench_pcm = pcm;
+
+    signal_t signal;
+    signal.total_length = EI_CLASSIFIER_RAW_SAMPLE_COUNT;
+    signal.get_data     = &bench_get_data;
+
+    BenchTimes times = {};
+    const char *what = argv[1];
+    int         rc   = 0;
+    if (strcmp(what, "vad") == 0) {
+        /* 獨立的 VAD 實例：不影響推論 Task 的噪音底與統計 */
+        VAD   *vad   = new VAD();
+        float *slice = static_cast<float *>(malloc(EI_CLASSIFIER_SLICE_SIZE * sizeof(float)));
+        if (vad && slice) {
+            const size_t span = EI_CLASSIFIER_RAW_SAMPLE_COUNT - EI_CLASSIFIER_SLICE_SIZE;
+            for (int i = 0; i < n; i++) {
+                bench_get_data((i * EI_CLASSIFIER_SLICE_SIZE) % (span + 1), EI_CLASSIFIER_SLICE_SIZE, slice);
+                int64_t t0 = esp_timer_get_time();
+                vad->detect(slice, EI_CLASSIFIER_SLICE_SIZE);
+                times.add(esp_timer_get_time() - t0);
+            }
+        } else {
+            printf("out of memory\n");
+            rc = 1;
+        }
+        free(slice);
+        delete vad;
+    } else if (strcmp(what, "mfcc") == 0) {
+        const ei_model_dsp_t &block = ei_dsp_blocks[0];
+        if (block.extract_fn != &extract_mfcc_features) {
+            printf("model DSP block is not MFCC\n");
+            rc = 1;
+        }
+        for (int i = 0; i < n && rc == 0; i++) {
+            EiRuntimeGuard guard;   // 特徵矩陣同樣經 ei_malloc 配置，一併放在鎖內
+            ei::matrix_t   features(1, EI_CLASSIFIER_NN_INPUT_FRAME_SIZE);
+            int64_t        t0  = esp_timer_get_time();
+            int            err = extract_mfcc_features(&signal, &features, block.config, EI_CLASSIFIER_FREQUENCY);
+            times.add(esp_timer_get_time() - t0);
+            if (err != EIDSP_OK) {
+                printf("MFCC failed (%d)\n", err);
+                rc = 1;
+            }
+        }
+    } else if (strcmp(what, "nn") == 0) {
+        for (int i = 0; i < n && rc == 0; i++) {
+            EiRuntimeGuard       guard;
+            ei_impulse_result_t  result = {};
+            EI_IMPULSE_ERROR     err    = run_classifier(&signal, &result, false);
+            if (err != EI_IMPULSE_OK) {
+                printf("Inference failed (%d)\n", err);
+                rc = 1;
+            } else {
+                times.add(result.timing.classification_us);
+            }
+        }
+    } else {
+        printf("unknown stage '%s' (vad|mfcc|nn)\n", what);
+        rc = 1;
+    }
+
+    s_bench_pcm = nullptr;
+    free(pcm);
+    if (times.runs > 0) {
+        /* console Task 優先權最低，可能被網路 / UI 搶占：以 min 為準 */
+        printf("%s x%lu: min %lld us, avg %lld us, max %lld us\n", what, (unsigned long)times.runs,
+               (long long)times.min_us, (long long)(times.sum_us / times.runs), (long long)times.max_us);
+    }
+    return rc;
+}
+
+/* ---------- set ---------- */
+
+int PerfConsole::cmd_set_(int argc, char **argv)
+{
+    PerfConsole *self = instance_;
+    if (argc >= 3 && strcmp(argv[1], "threshold") == 0) {
+        WakeTuning t     = self->detector_.tuning();
+        float      wake  = strtof(argv[2], nullptr);
+        float      floor = argc >= 4 ? strtof(argv[3], nullptr) : t.vad_threshold;
+        if (!self->detector_.override_tuning(wake, floor)) {
+            printf("invalid threshold\n");
+            return 1;
+        }
+        printf("applied on the next slice (not saved; the server's next wake_tuning replaces it)\n");
+        return 0;
+    }
+    if (argc >= 3 && strcmp(argv[1], "vad_debug") == 0) {
+        self->detector_.set_vad_debug(strcmp(argv[2], "on") == 0);
+        return 0;
+    }
+    printf("usage: set threshold <wake> [vad_floor] | set vad_debug on|off\n");
+    return 1;
+}
+
+#else
+
+PerfConsole::PerfConsole(WakeWordDetector &detector, VAD &vad)
+    : detector_(detector), vad_(vad)
+{
+}
+
+bool PerfConsole::start()
+{
+    return true;
+}
+
+#endif // PERF_CONSOLE
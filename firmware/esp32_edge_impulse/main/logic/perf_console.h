@@ -0,0 +1,76 @@
+#ifndef PERF_CONSOLE_H
+#define PERF_CONSOLE_H
+
+/* ============================================================
+ * perf_console.h - UART 效能 console（esp_console REPL，PERF_CONSOLE）
+ * ESP-MIAO v0.8.0
+ *
+ * 開發板上免重燒韌體即可查看統計與調整參數，REPL Task 以最低優先權跑在 CORE_NET：
+ *   stats                  VadStats、目前門檻、各階段耗時（StageProfiler 本區間 count/min/avg/p99/max）
+ *   tasks                  vTaskList + vTaskGetRunTimeStats
+ *   heap                   各 heap 區域 free / 最大區塊 / 歷史最低
+ *   contention             heap / flash / SPI 的持有時間與「誰擋住誰」（CONTENTION_MAP）
+ *   channels               各 SPSC 通道的 push / pop / 丟棄數、深度與交接延遲（本區間峰值 / 平均）
+ *   bench vad|mfcc|nn [N]  以合成音訊執行單一階段 N 次（預設 100），列印 min / avg / max
+ *   set threshold W [V]    暫時覆寫喚醒門檻（與 VAD 閾值下限），不寫入 NVS
+ *   set vad_debug on|off   每切片信心值 / VAD 除錯輸出（VAD_FFT_DEBUG 的執行期開關）
+ * 只讀取統計、不讀取擷取環形緩衝；bench 使用自己的 VAD 實例與合成音訊，
+ * mfcc / nn 每一輪以 EiRuntimeGuard 與推論 Task 輪流使用 EI runtime。
+ * ============================================================ */
+
+#include "config.h"
+#include "vad.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+class WakeWordDetector;
+
+/*
+ * EI runtime（tflite 張量 arena、EI_ARENA 的堆疊式配置器）同時只能有一個 Task 使用：
+ * 推論 Task 每個切片、console bench 每一輪各持有一次。PERF_CONSOLE=0 時為空物件。
+ */
+#if PERF_CONSOLE
+class EiRuntimeGuard {
+public:
+    EiRuntimeGuard();
+    ~EiRuntimeGuard();
+    EiRuntimeGuard(const EiRuntimeGuard &)            = delete;
+    EiRuntimeGuard &operator=(const EiRuntimeGuard &) = delete;
+
+private:
+    SemaphoreHandle_t held_;
+};
+#else
+class EiRuntimeGuard {
+public:
+    EiRuntimeGuard() {}
+};
+#endif
+
+class PerfConsole {
+public:
+    PerfConsole(WakeWordDetector &detector, VAD &vad);
+
+    /**
+     * 建立 EI runtime 互斥鎖並啟動 UART REPL（PERF_CONSOLE=0 時不動作）。
+     * 須在推論 Task 建立之前呼叫。
+     * @return true = 成功或已關閉
+     */
+    bool start();
+
+private:
+    WakeWordDetector &detector_;
+    VAD              &vad_;
+
+    static PerfConsole *instance_;   // esp_console 指令為 C 函式指標
+
+    static int cmd_stats_(int argc, char **argv);
+    static int cmd_tasks_(int argc, char **argv);
+    static int cmd_heap_(int argc, char **argv);
+    static int cmd_contention_(int argc, char **argv);
+    static int cmd_channels_(int argc, char **argv);
+    static int cmd_bench_(int argc, char **argv);
+    static int cmd_set_(int argc, char **argv);
+};
+
+#endif // PERF_CONSOLE_H
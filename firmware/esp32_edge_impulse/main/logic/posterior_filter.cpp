@@ -0,0 +1,74 @@
+/*
+ * posterior_filter.cpp - 喚醒詞信心值平滑與遲滯判定實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "posterior_filter.h"
+#include <string.h>
+
+PosteriorFilter::PosteriorFilter()
+    : window_(1), count_(0), head_(0), use_max_(false), on_(1.0f), off_(0.0f),
+      refractory_us_(0), hold_until_us_(0), armed_(true), smoothed_(0.0f)
+{
+    memset(hist_, 0, sizeof(hist_));
+}
+
+void PosteriorFilter::init(int window, bool use_max, float on_threshold, float off_threshold,
+                           uint32_t refractory_ms)
+{
+    if (window < 1)          window = 1;
+    if (window > MAX_WINDOW) window = MAX_WINDOW;
+    if (off_threshold > on_threshold) off_threshold = on_threshold;
+
+    window_        = window;
+    use_max_       = use_max;
+    on_            = on_threshold;
+    off_           = off_threshold;
+    refractory_us_ = (int64_t)refractory_ms * 1000;
+    hold_until_us_ = 0;
+    armed_         = true;
+    clear();
+}
+
+void PosteriorFilter::set_on_threshold(float on_threshold)
+{
+    on_ = on_threshold;
+    if (off_ > on_) off_ = on_;
+}
+
+void PosteriorFilter::clear()
+{
+    memset(hist_, 0, sizeof(hist_));
+    count_    = 0;
+    head_     = 0;
+    smoothed_ = 0.0f;
+}
+
+void PosteriorFilter::restart_refractory(int64_t now_us)
+{
+    hold_until_us_ = now_us + refractory_us_;
+    clear();
+}
+
+bool PosteriorFilter::update(float posterior, bool gate, int64_t now_us)
+{
+    hist_[head_] = posterior;
+    head_ = (head_ + 1) % window_;
+    if (count_ < window_) count_++;
+
+    /* 視窗未填滿時以現有樣本計算（平均以 window_ 為分母，避免開頭單一尖峰觸發） */
+    float acc = 0.0f;
+    for (int i = 0; i < count_; i++) {
+        if (use_max_) { if (hist_[i] > acc) acc = hist_[i]; }
+        else          acc += hist_[i];
+    }
+    smoothed_ = use_max_ ? acc : acc / (float)window_;
+
+    if (!armed_ && smoothed_ < off_) armed_ = true;
+    if (!armed_ || now_us < hold_until_us_) return false;
+    if (smoothed_ < on_ || !gate) return false;
+
+    armed_         = false;
+    hold_until_us_ = now_us + refractory_us_;
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef POSTERIOR_FILTER_H
+#define POSTERIOR_FILTER_H
+
+/* ============================================================
+ * posterior_filter.h - 喚醒詞信心值平滑與遲滯判定
+ * ESP-MIAO v0.8.0
+ *
+ * 每次推論輸入一個後驗機率（heymiaomiao 信心值）：
+ *   1. 最近 N 次取平均或最大值（平滑，抑制單一切片尖峰）
+ *   2. 平滑值 >= on 門檻且已解除武裝鎖定時觸發
+ *   3. 觸發後需平滑值降到 off 門檻以下（遲滯）且超過不應期才能再次觸發
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+class PosteriorFilter {
+public:
+    /** 平滑視窗上限（切片數） */
+    static constexpr int MAX_WINDOW = 10;
+
+    PosteriorFilter();
+
+    /**
+     * @param window         平滑視窗（推論次數，1 = 不平滑，上限 MAX_WINDOW）
+     * @param use_max        true = 取 N 次最大值，false = 取平均
+     * @param on_threshold   觸發門檻
+     * @param off_threshold  重新武裝門檻（< on_threshold）
+     * @param refractory_ms  觸發後的不應期
+     */
+    void init(int window, bool use_max, float on_threshold, float off_threshold,
+              uint32_t refractory_ms);
+
+    /**
+     * 輸入一次推論結果。
+     * @param posterior  本次信心值 (0~1)
+     * @param gate       額外條件（例如 VAD 判定為語音），false 時不觸發但仍更新平滑
+     * @param now_us     目前時間 (esp_timer_get_time)
+     * @return true = 觸發喚醒
+     */
+    bool update(float posterior, bool gate, int64_t now_us);
+
+    /** 清除平滑歷史（例如推論暫停後，舊結果已不連續） */
+    void clear();
+
+    /** 從 now_us 起重新計算不應期並清除歷史（例如喚醒串流結束後） */
+    void restart_refractory(int64_t now_us);
+
+    /** 最近一次的平滑值 */
+    float smoothed() const { return smoothed_; }
+
+    /** 執行期調整觸發門檻（Server wake_tuning）；off 門檻超過新門檻時一併下修 */
+    void set_on_threshold(float on_threshold);
+    float on_threshold() const { return on_; }
+
+private:
+    float    hist_[MAX_WINDOW];
+    int      window_;
+    int      count_;
+    int      head_;
+    bool     use_max_;
+    float    on_;
+    float    off_;
+    int64_t  refractory_us_;
+    int64_t  hold_until_us_;
+    bool     armed_;
+    float    smoothed_;
+};
+
+#endif // POSTERIOR_FILTER_H
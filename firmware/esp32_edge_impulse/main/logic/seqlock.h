@@ -0,0 +1,75 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+/* ============================================================
+ * seqlock.h - 單一寫入端、不上鎖的快照區段
+ * ESP-MIAO v0.8.0
+ *
+ * 寫入前後各遞增 seq（寫入中為奇數）；讀取端前後 seq 相同且為偶數才採用，否則重試，
+ * 重試次數有上限（讀取端可能與被搶占的寫入端同核心，不空轉）。寫入端永不等待，
+ * 因此音訊核心可直接發布，讀取端（HTTP / console）不會讓它停下。
+ * 資料以 32-bit atomic 字組逐字複製，T 須可 memcpy。同 ui_state.c 的 telemetry seqlock。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+#ifndef SEQLOCK_READ_RETRIES
+#define SEQLOCK_READ_RETRIES 4
+#endif
+
+template <typename T>
+class Seqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock payload must be trivially copyable");
+
+public:
+    Seqlock() : seq_(0)
+    {
+        for (auto &w : words_) w.store(0, std::memory_order_relaxed);
+    }
+
+    /** 只能有一個寫入 Task */
+    void write(const T &value)
+    {
+        uint32_t buf[WORDS] = {};
+        memcpy(buf, &value, sizeof(T));
+        uint32_t s = seq_.load(std::memory_order_relaxed);
+        seq_.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);   // seq 先於資料寫入
+        for (size_t i = 0; i < WORDS; i++) words_[i].store(buf[i], std::memory_order_relaxed);
+        seq_.store(s + 2, std::memory_order_release);
+    }
+
+    /**
+     * 讀取一致的快照。
+     * @return false = 尚未寫入過，或寫入端正在更新且重試用盡（*out 不變）
+     */
+    bool read(T *out) const
+    {
+        uint32_t buf[WORDS];
+        for (int r = 0; r < SEQLOCK_READ_RETRIES; r++) {
+            uint32_t s0 = seq_.load(std::memory_order_acquire);
+            if (s0 == 0) return false;
+            if (s0 & 1) continue;
+            for (size_t i = 0; i < WORDS; i++) buf[i] = words_[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);   // 資料讀取先於第二次讀 seq
+            if (seq_.load(std::memory_order_relaxed) != s0) continue;
+            memcpy(out, buf, sizeof(T));
+            return true;
+        }
+        return false;
+    }
+
+    /** 已完成的寫入次數 */
+    uint32_t version() const { return seq_.load(std::memory_order_acquire) / 2; }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + 3) / 4;
+
+    std::atomic<uint32_t> seq_;
+    std::atomic<uint32_t> words_[WORDS];
+};
+
+#endif // SEQLOCK_H
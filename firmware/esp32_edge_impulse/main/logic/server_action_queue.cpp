@@ -0,0 +1,354 @@
+/*
+ * server_action_queue.cpp - Server 下行訊息佇列實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "server_action_queue.h"
+#include "config.h"
+#include "rtos_alloc.h"
+#include "json_tok.h"
+#include "esp_log.h"
+#include "freertos/task.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "ServerAction";
+
+/* ---------- 解析 ---------- */
+
+static const char *const kProgressNames[PROGRESS_STAGE_COUNT] = {
+    "asr_started", "asr_done", "intent_done", "dispatched",
+};
+
+const char *server_progress_name(ServerProgress stage)
+{
+    return stage < PROGRESS_STAGE_COUNT ? kProgressNames[stage] : "?";
+}
+
+bool server_action_parse(const char *json, ServerAction *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!json) return false;
+
+    JsonTok toks[WS_JSON_MAX_TOKENS];
+    int n = json_tokenize(json, strlen(json), toks, WS_JSON_MAX_TOKENS);
+    if (n <= 0 || toks[0].type != JSON_OBJECT) {
+        ESP_LOGW(TAG, "Invalid JSON (%d)", n);
+        return false;
+    }
+
+    char type[24] = "";
+    json_get_str(json, toks, n, 0, "type", type, sizeof(type));
+    int payload = json_get(json, toks, n, 0, "payload");
+
+    if (strcmp(type, "action") == 0) {
+        out->type = SERVER_MSG_ACTION;
+        auto &a = out->action;
+        json_get_str(json, toks, n, payload, "target", a.target, sizeof(a.target));
+        json_get_str(json, toks, n, payload, "value", a.value, sizeof(a.value));
+        json_get_str(json, toks, n, payload, "sound", a.sound, sizeof(a.sound));
+        return json_get_str(json, toks, n, payload, "action", a.action, sizeof(a.action));
+    }
+    if (strcmp(type, "play") == 0) {
+        out->type = SERVER_MSG_PLAY;
+        return json_get_str(json, toks, n, payload, "audio", out->play.audio,
+                            sizeof(out->play.audio));
+    }
+    if (strcmp(type, "time_sync") == 0) {
+        long long seconds = 0, ms = 0;
+        out->type = SERVER_MSG_TIME_SYNC;
+        json_get_int(json, toks, n, payload, "ms", &ms);
+        out->time_sync.ms = (int32_t)ms;
+        if (!json_get_int(json, toks, n, payload, "seconds", &seconds)) return false;
+        out->time_sync.seconds = seconds;
+
+        long long seq = 0, t0 = 0, t1 = 0, t2 = 0;
+        out->time_sync.round_trip = json_get_int(json, toks, n, payload, "seq", &seq) &&
+                                    json_get_int(json, toks, n, payload, "t0", &t0) &&
+                                    json_get_int(json, toks, n, payload, "t1", &t1) &&
+                                    json_get_int(json, toks, n, payload, "t2", &t2);
+        out->time_sync.seq = (uint32_t)seq;
+        out->time_sync.t0  = t0;
+        out->time_sync.t1  = t1;
+        out->time_sync.t2  = t2;
+        return true;
+    }
+    if (strcmp(type, "audio_resume_ack") == 0) {
+        long long session = 0, received = 0;
+        bool accepted = false;
+        out->type = SERVER_MSG_RESUME_ACK;
+        json_get_bool(json, toks, n, payload, "accepted", &accepted);
+        json_get_int(json, toks, n, payload, "received_samples", &received);
+        out->resume_ack.accepted         = accepted;
+        out->resume_ack.received_samples = (uint32_t)received;
+        if (!json_get_int(json, toks, n, payload, "session_id", &session)) return false;
+        out->resume_ack.session_id = (uint32_t)session;
+        return true;
+    }
+
+    if (strcmp(type, "audio_cancel") == 0) {
+        out->type = SERVER_MSG_AUDIO_CANCEL;
+        json_get_str(json, toks, n, payload, "winner", out->cancel.winner, sizeof(out->cancel.winner));
+        return json_get_str(json, toks, n, payload, "reason", out->cancel.reason,
+                            sizeof(out->cancel.reason));
+    }
+
+    if (strcmp(type, "wake_tuning") == 0) {
+        long long version = 0;
+        auto &t = out->tuning;
+        out->type = SERVER_MSG_WAKE_TUNING;
+        if (!json_get_int(json, toks, n, payload, "version", &version)) return false;
+        t.version = (uint32_t)version;
+        return json_get_float(json, toks, n, payload, "wake_threshold", &t.wake_threshold) &&
+               json_get_float(json, toks, n, payload, "vad_threshold", &t.vad_threshold);
+    }
+
+    if (strcmp(type, "false_wake") == 0) {
+        char trace[12] = "";
+        out->type = SERVER_MSG_FALSE_WAKE;
+        json_get_str(json, toks, n, payload, "reason", out->false_wake.reason, sizeof(out->false_wake.reason));
+        if (!json_get_str(json, toks, n, payload, "trace_id", trace, sizeof(trace))) return false;
+        out->false_wake.trace_id = (uint32_t)strtoul(trace, nullptr, 16);
+        return true;
+    }
+
+    if (strcmp(type, "model_update") == 0) {
+        long long generation = 0, size = 0, crc = 0;
+        out->type = SERVER_MSG_MODEL_UPDATE;
+        if (!json_get_int(json, toks, n, payload, "generation", &generation) ||
+            !json_get_int(json, toks, n, payload, "size", &size) ||
+            !json_get_int(json, toks, n, payload, "crc32", &crc)) return false;
+        out->model_update.generation = (uint32_t)generation;
+        out->model_update.size       = (uint32_t)size;
+        out->model_update.crc32      = (uint32_t)crc;
+        return true;
+    }
+
+    if (strcmp(type, "progress") == 0) {
+        char stage[16] = "";
+        long long elapsed = 0;
+        out->type = SERVER_MSG_PROGRESS;
+        json_get_int(json, toks, n, payload, "elapsed_ms", &elapsed);
+        out->progress.elapsed_ms = (uint32_t)elapsed;
+        if (!json_get_str(json, toks, n, payload, "stage", stage, sizeof(stage))) return false;
+        for (int i = 0; i < PROGRESS_STAGE_COUNT; i++) {
+            if (strcmp(stage, kProgressNames[i]) == 0) {
+                out->progress.stage = (ServerProgress)i;
+                return true;
+            }
+        }
+        return false;   // 較新的 Server 新增的階段
+    }
+
+    if (strcmp(type, "continuous") == 0) {
+        long long kbps = 0;
+        out->type = SERVER_MSG_CONTINUOUS;
+        out->continuous.confirm = false;
+        json_get_bool(json, toks, n, payload, "confirm", &out->continuous.confirm);
+        json_get_int(json, toks, n, payload, "max_kbps", &kbps);
+        out->continuous.max_kbps = (uint16_t)(kbps < 0 ? 0 : kbps > 0xFFFF ? 0xFFFF : kbps);
+        return json_get_bool(json, toks, n, payload, "enable", &out->continuous.enable);
+    }
+
+    ESP_LOGD(TAG, "Ignored server message: %s", type[0] ? type : "(untyped)");
+    return false;
+}
+
+bool server_list_parse(const char *json, char *uris, size_t cap)
+{
+    if (!json || !strstr(json, "\"server_list\"")) return false;   // 其他訊息不再 token 化一次
+    JsonTok toks[WS_JSON_MAX_TOKENS];
+    int n = json_tokenize(json, strlen(json), toks, WS_JSON_MAX_TOKENS);
+    if (n <= 0 || toks[0].type != JSON_OBJECT) return false;
+
+    char type[24] = "";
+    json_get_str(json, toks, n, 0, "type", type, sizeof(type));
+    if (strcmp(type, "server_list") != 0) return false;
+    int payload = json_get(json, toks, n, 0, "payload");
+    return json_get_str(json, toks, n, payload, "uris", uris, cap) && uris[0];
+}
+
+/* 定長字串欄位：Server 保證截斷後仍留 NUL，這裡再保險一次 */
+static const uint8_t *take_str(const uint8_t *p, char *dst, size_t size)
+{
+    memcpy(dst, p, size);
+    dst[size - 1] = '\0';
+    return p + size;
+}
+
+template <typename T>
+static const uint8_t *take(const uint8_t *p, T *dst)
+{
+    memcpy(dst, p, sizeof(T));   // ESP32 為 little-endian，與 frame 相同
+    return p + sizeof(T);
+}
+
+bool server_action_parse_binary(const uint8_t *data, size_t len, ServerAction *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!data || len < CONTROL_FRAME_HEADER || data[0] != CONTROL_FRAME_MAGIC) {
+        ESP_LOGW(TAG, "Invalid control frame (%u bytes)", (unsigned)len);
+        return false;
+    }
+    if (data[1] != CONTROL_FRAME_VERSION) {
+        ESP_LOGW(TAG, "Unsupported control frame version %u", (unsigned)data[1]);
+        return false;
+    }
+
+    uint8_t        type = data[2];
+    const uint8_t *p    = data + CONTROL_FRAME_HEADER;
+    size_t         body = len - CONTROL_FRAME_HEADER;
+
+    switch (type) {
+        case SERVER_MSG_ACTION: {
+            auto &a = out->action;
+            if (body < sizeof(a.action) + sizeof(a.target) + sizeof(a.value) + sizeof(a.sound)) break;
+            p = take_str(p, a.action, sizeof(a.action));
+            p = take_str(p, a.target, sizeof(a.target));
+            p = take_str(p, a.value, sizeof(a.value));
+            take_str(p, a.sound, sizeof(a.sound));
+            out->type = SERVER_MSG_ACTION;
+            return a.action[0] != '\0';
+        }
+        case SERVER_MSG_PLAY:
+            if (body < sizeof(out->play.audio)) break;
+            take_str(p, out->play.audio, sizeof(out->play.audio));
+            out->type = SERVER_MSG_PLAY;
+            return true;
+
+        case SERVER_MSG_TIME_SYNC: {
+            auto &t = out->time_sync;
+            if (body < 1 + 8 + 4 + 4 + 8 * 3) break;
+            uint8_t flags;
+            p = take(p, &flags);
+            p = take(p, &t.seconds);
+            p = take(p, &t.ms);
+            p = take(p, &t.seq);
+            p = take(p, &t.t0);
+            p = take(p, &t.t1);
+            take(p, &t.t2);
+            t.round_trip = (flags & 0x01) != 0;
+            out->type = SERVER_MSG_TIME_SYNC;
+            return true;
+        }
+        case SERVER_MSG_RESUME_ACK: {
+            auto &r = out->resume_ack;
+            if (body < 4 + 4 + 1) break;
+            uint8_t accepted;
+            p = take(p, &r.session_id);
+            p = take(p, &r.received_samples);
+            take(p, &accepted);
+            r.accepted = accepted != 0;
+            out->type = SERVER_MSG_RESUME_ACK;
+            return true;
+        }
+        case SERVER_MSG_AUDIO_CANCEL: {
+            auto &c = out->cancel;
+            if (body < sizeof(c.reason) + sizeof(c.winner)) break;
+            p = take_str(p, c.reason, sizeof(c.reason));
+            take_str(p, c.winner, sizeof(c.winner));
+            out->type = SERVER_MSG_AUDIO_CANCEL;
+            return true;
+        }
+        case SERVER_MSG_WAKE_TUNING: {
+            auto &t = out->tuning;
+            if (body < 4 + 4 + 4) break;
+            p = take(p, &t.wake_threshold);
+            p = take(p, &t.vad_threshold);
+            take(p, &t.version);
+            out->type = SERVER_MSG_WAKE_TUNING;
+            return true;
+        }
+        case SERVER_MSG_FALSE_WAKE: {
+            auto &f = out->false_wake;
+            if (body < 4 + sizeof(f.reason)) break;
+            p = take(p, &f.trace_id);
+            take_str(p, f.reason, sizeof(f.reason));
+            out->type = SERVER_MSG_FALSE_WAKE;
+            return true;
+        }
+        case SERVER_MSG_MODEL_UPDATE: {
+            auto &m = out->model_update;
+            if (body < 4 + 4 + 4) break;
+            p = take(p, &m.generation);
+            p = take(p, &m.size);
+            take(p, &m.crc32);
+            out->type = SERVER_MSG_MODEL_UPDATE;
+            return true;
+        }
+        case SERVER_MSG_PROGRESS: {
+            auto &g = out->progress;
+            if (body < 1 + 4) break;
+            uint8_t stage;
+            p = take(p, &stage);
+            take(p, &g.elapsed_ms);
+            if (stage >= PROGRESS_STAGE_COUNT) return false;
+            g.stage   = (ServerProgress)stage;
+            out->type = SERVER_MSG_PROGRESS;
+            return true;
+        }
+        case SERVER_MSG_CONTINUOUS: {
+            auto &c = out->continuous;
+            if (body < 1 + 2) break;
+            uint8_t flags;
+            p = take(p, &flags);
+            take(p, &c.max_kbps);
+            c.enable  = flags & 0x01;
+            c.confirm = flags & 0x02;
+            out->type = SERVER_MSG_CONTINUOUS;
+            return true;
+        }
+        case CONTROL_FRAME_HEARTBEAT_ACK:
+            return false;   // 收到即已更新 last_rx_us_
+
+        default:
+            ESP_LOGD(TAG, "Ignored control frame type %u", (unsigned)type);
+            return false;
+    }
+    ESP_LOGW(TAG, "Control frame type %u too short (%u bytes)", (unsigned)type, (unsigned)len);
+    return false;
+}
+
+/* ---------- 佇列 / worker ---------- */
+
+ServerActionQueue::ServerActionQueue()
+    : handler_(nullptr), started_(false)
+{}
+
+bool ServerActionQueue::init(server_action_cb_t handler)
+{
+    if (started_) return true;
+    handler_ = handler;
+    if (RTOS_TASK_CREATE(task_entry_, "srv_action", SERVER_ACTION_TASK_STACK, this,
+                         SERVER_ACTION_TASK_PRIO, nullptr,
+                         SERVER_ACTION_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start server action task");
+        return false;
+    }
+    spsc_channel_register("srv_action", &ch_);
+    started_ = true;
+    return true;
+}
+
+bool ServerActionQueue::post(const ServerAction &action)
+{
+    if (!started_) return false;
+    if (!ch_.push(action)) {
+        ESP_LOGW(TAG, "Queue full, dropped type=%d (total %u)", (int)action.type,
+                 (unsigned)ch_.dropped());
+        return false;
+    }
+    return true;
+}
+
+void ServerActionQueue::task_entry_(void *arg)
+{
+    auto *self = static_cast<ServerActionQueue *>(arg);
+    self->ch_.set_consumer(xTaskGetCurrentTaskHandle());
+    ServerAction action;
+    while (1) {
+        if (self->ch_.pop_wait(&action, portMAX_DELAY) && self->handler_) {
+            self->handler_(action);
+        }
+    }
+}
@@ -0,0 +1,167 @@
+#ifndef SERVER_ACTION_QUEUE_H
+#define SERVER_ACTION_QUEUE_H
+
+/* ============================================================
+ * server_action_queue.h - Server 下行訊息佇列
+ * ESP-MIAO v0.8.0
+ *
+ * WS 事件 Task 只負責解析成固定大小的 ServerAction 並排入佇列，
+ * 實際處理（UI / GPIO / 校時）交由 worker Task，避免阻塞 ping/pong 與收包。
+ * 佇列為 SpscChannel（spsc_channel.h）：生產者只有 WS 事件 Task，消費者只有 worker Task。
+ *
+ * 下行訊息可為 JSON 文字或定長 binary frame（協商 WS_CONTROL_SUBPROTOCOL 時，Server wire.py）：
+ *   [magic 0xE5][version 1][type = ServerActionType] + 各類型欄位（little-endian，字串為 NUL 補齊定長）
+ *     ACTION        action[16] target[24] value[12] sound[32]
+ *     PLAY          audio[32]
+ *     TIME_SYNC     flags u8 (bit0 = round_trip) | seconds i64 | ms i32 | seq u32 | t0 t1 t2 i64
+ *     RESUME_ACK    session_id u32 | received_samples u32 | accepted u8
+ *     AUDIO_CANCEL  reason[16] winner[24]
+ *     6 (heartbeat_ack)  seq u32（只代表鏈路存活，不產生 ServerAction）
+ *     WAKE_TUNING   wake_threshold f32 | vad_threshold f32 | version u32
+ *     FALSE_WAKE    trace_id u32 | reason[16]
+ *     MODEL_UPDATE  generation u32 | size u32 | crc32 u32
+ *     PROGRESS      stage u8 (ServerProgress) | elapsed_ms u32
+ *     CONTINUOUS    flags u8 (bit0 = enable, bit1 = confirm) | max_kbps u16
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "config.h"
+#include "spsc_channel.h"
+
+enum ServerActionType : uint8_t {
+    SERVER_MSG_UNKNOWN = 0,
+    SERVER_MSG_ACTION,       // {"type":"action","payload":{action,target,value,sound}}
+    SERVER_MSG_PLAY,         // {"type":"play","payload":{audio}}
+    SERVER_MSG_TIME_SYNC,    // {"type":"time_sync","payload":{seconds,ms[,seq,t0,t1,t2]}}
+    SERVER_MSG_RESUME_ACK,   // {"type":"audio_resume_ack",...}（由 WS 事件 Task 直接處理，不排入佇列）
+    SERVER_MSG_AUDIO_CANCEL, // {"type":"audio_cancel","payload":{reason[,winner]}}（其他節點勝出等）
+    SERVER_MSG_WAKE_TUNING = 7, // {"type":"wake_tuning","payload":{wake_threshold,vad_threshold,version}}（6 = heartbeat_ack）
+    SERVER_MSG_FALSE_WAKE,      // {"type":"false_wake","payload":{trace_id,reason}}（轉錄為空 / not_understood）
+    SERVER_MSG_MODEL_UPDATE,    // {"type":"model_update","payload":{generation,size,crc32}}（映像於 GET /model）
+    SERVER_MSG_PROGRESS,        // {"type":"progress","payload":{stage,elapsed_ms}}（串流結束後的處理進度）
+    SERVER_MSG_CONTINUOUS,      // {"type":"continuous","payload":{enable,max_kbps,confirm}}（Server 端喚醒）
+};
+
+/* Server 處理串流的進度事件，順序同 Server wire.PROGRESS_STAGES */
+enum ServerProgress : uint8_t {
+    PROGRESS_ASR_STARTED = 0,
+    PROGRESS_ASR_DONE,
+    PROGRESS_INTENT_DONE,
+    PROGRESS_DISPATCHED,     // 指令已送往 MQTT：UI 即切到 UI_ACTION，不等回覆
+    PROGRESS_STAGE_COUNT
+};
+
+/** progress 的 stage 名稱（JSON 欄位與 telemetry 共用） */
+const char *server_progress_name(ServerProgress stage);
+
+struct ServerAction {
+    ServerActionType type;
+    union {
+        struct {
+            char action[16];
+            char target[24];
+            char value[12];
+            char sound[32];
+        } action;
+        struct {
+            char audio[32];
+        } play;
+        struct {
+            int64_t  seconds;
+            int32_t  ms;
+            bool     round_trip;   // 回覆 time_sync_request（附 seq / t0 / t1 / t2）
+            uint32_t seq;
+            int64_t  t0, t1, t2;   // t0 = 裝置 esp_timer；t1 / t2 = Server Unix us
+            int64_t  rx_us;        // t3：WS 事件 Task 收到時的 esp_timer
+        } time_sync;
+        struct {
+            uint32_t session_id;
+            uint32_t received_samples;
+            bool     accepted;
+        } resume_ack;
+        struct {
+            char reason[16];       // "duplicate_wake"
+            char winner[24];       // 保留串流的裝置（可為空）
+        } cancel;
+        struct {
+            float    wake_threshold;
+            float    vad_threshold;
+            uint32_t version;
+        } tuning;
+        struct {
+            uint32_t trace_id;     // audio_start 的 trace_id（十六進位字串）
+            char     reason[16];   // "asr_empty" / "not_understood"
+        } false_wake;
+        struct {
+            uint32_t generation;
+            uint32_t size;         // 映像大小（header + 酬載）
+            uint32_t crc32;        // 酬載的 CRC-32（同 ModelImageHeader::crc32）
+        } model_update;
+        struct {
+            ServerProgress stage;
+            uint32_t       elapsed_ms;   // Server 端自開始處理起的耗時
+            int64_t        rx_us;        // WS 事件 Task 收到時的 esp_timer
+        } progress;
+        struct {
+            bool     enable;
+            bool     confirm;        // Server 需要本地喚醒詞（wake_hint）確認
+            uint16_t max_kbps;       // 平均上行頻寬上限，0 = 不限
+        } continuous;
+    };
+};
+
+/**
+ * 將 Server 文字訊息解析為 ServerAction（就地 token 化，不配置記憶體）。
+ * @return true = 已知類型且必要欄位齊全
+ */
+bool server_action_parse(const char *json, ServerAction *out);
+
+#define CONTROL_FRAME_MAGIC          0xE5
+#define CONTROL_FRAME_VERSION        1
+#define CONTROL_FRAME_HEADER         3
+#define CONTROL_FRAME_HEARTBEAT_ACK  6
+
+/**
+ * 將 Server binary 控制 frame 解析為 ServerAction（固定位移 memcpy）。
+ * @return true = 已知類型且長度正確
+ */
+bool server_action_parse_binary(const uint8_t *data, size_t len, ServerAction *out);
+
+/**
+ * 叢集模式的端點清單 {"type":"server_list","payload":{"uris":"ws://...,ws://..."}}：
+ * 長度不定、不排入 ServerActionQueue（由 WS 事件 Task 直接交給 WebSocketClient::set_endpoints）。
+ * @return true = 是 server_list 且 uris 放得進 cap
+ */
+bool server_list_parse(const char *json, char *uris, size_t cap);
+
+/** 動作處理回調（於 worker Task 內呼叫） */
+typedef void (*server_action_cb_t)(const ServerAction &action);
+
+class ServerActionQueue {
+public:
+    ServerActionQueue();
+
+    /**
+     * 建立佇列與 worker Task。
+     * @param handler 每筆動作的處理函式
+     * @return true = 成功
+     */
+    bool init(server_action_cb_t handler);
+
+    /**
+     * 排入一筆動作（不阻塞；佇列滿時丟棄並回傳 false）。只能由 WS 事件 Task 呼叫。
+     */
+    bool post(const ServerAction &action);
+
+private:
+    SpscChannel<ServerAction, SERVER_ACTION_QUEUE_LEN> ch_;
+    server_action_cb_t handler_;
+    bool               started_;
+
+    static void task_entry_(void *arg);
+};
+
+#endif // SERVER_ACTION_QUEUE_H
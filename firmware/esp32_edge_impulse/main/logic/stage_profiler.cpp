@@ -0,0 +1,245 @@
+/*
+ * stage_profiler.cpp - 推論管線各階段耗時統計實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "stage_profiler.h"
+#include "config.h"
+#include "rtos_alloc.h"
+#include "flight_recorder.h"
+#include "telemetry_block.h"
+#include "eye_ui.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "Profiler";
+
+/* JSON 欄位名稱，順序同 ProfileStage */
+static const char *const kStageNames[PROF_STAGE_COUNT] = {
+    "i2s_wait", "convert", "vad", "mfcc", "nn", "post", "ui", "stage1",
+};
+static const char *const kRoundTripNames[RTT_STAGE_COUNT] = {
+    "asr_started", "asr_done", "intent_done", "dispatched", "reply",
+};
+static_assert(PROF_STAGE_COUNT <= FLIGHT_STAGES, "flight_log_t.stage_us too small for ProfileStage");
+
+const char *StageProfiler::stage_name(ProfileStage stage)
+{
+    return stage < PROF_STAGE_COUNT ? kStageNames[stage] : "?";
+}
+
+StageProfiler::StageProfiler(WebSocketClient &ws)
+    : ws_(ws), lock_(portMUX_INITIALIZER_UNLOCKED), seq_(0), window_start_us_(0), started_(false),
+      degrade_(0), degrade_steps_(0), degrade_overruns_(0)
+{
+    memset(stages_, 0, sizeof(stages_));
+    memset(round_trip_, 0, sizeof(round_trip_));
+    memset(weights_, 0, sizeof(weights_));
+}
+
+bool StageProfiler::start()
+{
+#if TELEMETRY_INTERVAL_S > 0
+    if (started_) return true;
+    window_start_us_ = esp_timer_get_time();
+    if (RTOS_TASK_CREATE(task_entry_, "telemetry", TELEMETRY_TASK_STACK, this,
+                         TELEMETRY_TASK_PRIO, nullptr, TELEMETRY_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start telemetry task");
+        return false;
+    }
+    started_ = true;
+#endif
+    return true;
+}
+
+/* ---------- 直方圖 ---------- */
+
+/* us < 4 各一格；之後每倍頻 4 格：[4,5),[5,6),[6,7),[7,8),[8,10),... */
+int StageProfiler::bucket_(uint32_t us)
+{
+    if (us < 4) return (int)us;
+    int msb = 31 - __builtin_clz(us);
+    int b   = 4 * (msb - 1) + (int)((us >> (msb - 2)) & 3);
+    return b < HIST_BUCKETS ? b : HIST_BUCKETS - 1;
+}
+
+uint32_t StageProfiler::bucket_upper_(int b)
+{
+    if (b < 4) return (uint32_t)b;
+    int msb = b / 4 + 1;
+    int sub = b & 3;
+    return ((uint32_t)(5 + sub) << (msb - 2)) - 1;
+}
+
+uint32_t StageProfiler::p99_(const StageStats &s)
+{
+    if (s.count == 0) return 0;
+    uint32_t rank = s.count - s.count / 100;   // 第 ceil(0.99 n) 個樣本
+    uint32_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += s.hist[b];
+        if (seen >= rank) {
+            uint32_t upper = bucket_upper_(b);
+            return upper < s.max_us ? upper : s.max_us;
+        }
+    }
+    return s.max_us;
+}
+
+/* ---------- 記錄（推論 Task） ---------- */
+
+void StageProfiler::record(ProfileStage stage, uint32_t us)
+{
+    flight_record_stage(stage, us);   // 未開啟 CONFIG_ESP_MIAO_FLIGHT_RECORDER 時為空函式
+#if TELEMETRY_INTERVAL_S > 0
+    StageStats &s = stages_[stage];
+    int b = bucket_(us);
+    portENTER_CRITICAL(&lock_);
+    if (s.count == 0 || us < s.min_us) s.min_us = us;
+    if (us > s.max_us) s.max_us = us;
+    s.count++;
+    s.sum_us += us;
+    if (s.hist[b] != UINT16_MAX) s.hist[b]++;
+    portEXIT_CRITICAL(&lock_);
+#endif
+}
+
+void StageProfiler::peek(Summary out[PROF_STAGE_COUNT])
+{
+    StageStats snap[PROF_STAGE_COUNT];
+    portENTER_CRITICAL(&lock_);
+    memcpy(snap, stages_, sizeof(snap));
+    portEXIT_CRITICAL(&lock_);
+    for (int i = 0; i < PROF_STAGE_COUNT; i++) {
+        const StageStats &s = snap[i];
+        out[i] = { s.count, s.min_us, (uint32_t)(s.count ? s.sum_us / s.count : 0), p99_(s), s.max_us };
+    }
+}
+
+void StageProfiler::set_degrade(int level, int stride, bool secondary, uint32_t load_pct, uint32_t steps,
+                                uint32_t overruns)
+{
+    uint32_t load = load_pct > 255 ? 255 : load_pct;
+    degrade_.store((uint32_t)(level & 0xff) | (uint32_t)(stride & 0xff) << 8 | (secondary ? 1u << 16 : 0) |
+                       load << 24,
+                   std::memory_order_relaxed);
+    degrade_steps_.store(steps, std::memory_order_relaxed);
+    degrade_overruns_.store(overruns, std::memory_order_relaxed);
+}
+
+void StageProfiler::set_weights(uint32_t pinned_bytes, uint32_t flash_bytes, uint32_t flash_nn_us,
+                                uint32_t pinned_nn_us)
+{
+    /* start() 之前呼叫，telemetry Task 建立後才讀取 */
+    weights_[0] = pinned_bytes;
+    weights_[1] = flash_bytes;
+    weights_[2] = flash_nn_us;
+    weights_[3] = pinned_nn_us;
+}
+
+void StageProfiler::record_round_trip(RoundTripStage stage, uint32_t ms)
+{
+    if (stage >= RTT_STAGE_COUNT) return;
+    portENTER_CRITICAL(&lock_);
+    RoundTripStats &r = round_trip_[stage];
+    r.count++;
+    r.sum_ms += ms;
+    if (ms > r.max_ms) r.max_ms = ms;
+    portEXIT_CRITICAL(&lock_);
+}
+
+/* ---------- telemetry Task ---------- */
+
+void StageProfiler::task_entry_(void *arg)
+{
+    auto *self = static_cast<StageProfiler *>(arg);
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(TELEMETRY_INTERVAL_S * 1000));
+        self->send_report_();
+    }
+}
+
+void StageProfiler::send_report_()
+{
+    /* 取出並歸零：不論是否送出，每份報告只涵蓋一個區間 */
+    StageStats     snap[PROF_STAGE_COUNT];
+    RoundTripStats rtt[RTT_STAGE_COUNT];
+    portENTER_CRITICAL(&lock_);
+    memcpy(snap, stages_, sizeof(snap));
+    memset(stages_, 0, sizeof(stages_));
+    memcpy(rtt, round_trip_, sizeof(rtt));
+    memset(round_trip_, 0, sizeof(round_trip_));
+    portEXIT_CRITICAL(&lock_);
+
+    int64_t now         = esp_timer_get_time();
+    int64_t interval_ms = (now - window_start_us_) / 1000;
+    window_start_us_    = now;
+#if TELEMETRY_HTTP
+    Summary sum[PROF_STAGE_COUNT];
+    for (int i = 0; i < PROF_STAGE_COUNT; i++) {
+        const StageStats &s = snap[i];
+        sum[i] = { s.count, s.min_us, (uint32_t)(s.count ? s.sum_us / s.count : 0), p99_(s), s.max_us };
+    }
+    telemetry_publish_stages(sum, (uint32_t)interval_ms);
+#endif
+    if (!ws_.is_connected()) return;
+
+    char json[960];
+    int  len = snprintf(json, sizeof(json),
+                        "{\"device_id\":\"%s\",\"timestamp\":%lld,\"type\":\"telemetry\","
+                        "\"payload\":{\"seq\":%u,\"interval_ms\":%lld,\"stages\":{",
+                        DEVICE_ID, (long long)(now / 1000), (unsigned)seq_++, (long long)interval_ms);
+    for (int i = 0; i < PROF_STAGE_COUNT && len < (int)sizeof(json); i++) {
+        const StageStats &s = snap[i];
+        len += snprintf(json + len, sizeof(json) - len, "%s\"%s\":[%u,%u,%u,%u]",
+                        i ? "," : "", kStageNames[i], (unsigned)s.count, (unsigned)s.min_us,
+                        (unsigned)(s.count ? s.sum_us / s.count : 0), (unsigned)p99_(s));
+    }
+    /* UI frame 統計（顯示 Task 的 frame profiler，同一區間） */
+    eye_ui_frame_stats_t ui;
+    eye_ui_take_frame_stats(&ui);
+    if (len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, "},\"ui\":[%u,%u,%u,%u,%u,%u,%u]",
+                        (unsigned)ui.frames, (unsigned)ui.late, (unsigned)ui.late_max_ms,
+                        (unsigned)ui.render_avg_us, (unsigned)ui.render_max_us,
+                        (unsigned)ui.push_avg_us, (unsigned)ui.push_max_us);
+    }
+    /* 推論降級（INFER_GOVERNOR）：[level, stride, ns, load_pct, steps, overruns] */
+    uint32_t dg = degrade_.load(std::memory_order_relaxed);
+    if (dg && len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"degrade\":[%u,%u,%u,%u,%u,%u]",
+                        (unsigned)(dg & 0xff), (unsigned)((dg >> 8) & 0xff), (unsigned)((dg >> 16) & 1),
+                        (unsigned)(dg >> 24), (unsigned)degrade_steps_.load(std::memory_order_relaxed),
+                        (unsigned)degrade_overruns_.load(std::memory_order_relaxed));
+    }
+    /* 權重常駐（MODEL_WEIGHT_PIN）：[pinned_bytes, flash_bytes, flash_nn_us, pinned_nn_us] */
+    if (weights_[0] && len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"weights\":[%u,%u,%u,%u]", (unsigned)weights_[0],
+                        (unsigned)weights_[1], (unsigned)weights_[2], (unsigned)weights_[3]);
+    }
+    /* 裝置觀察到的 Server 往返（區間內有串流 session 才附上） */
+    bool any_rtt = false;
+    for (int i = 0; i < RTT_STAGE_COUNT; i++) any_rtt |= rtt[i].count > 0;
+    if (any_rtt && len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"server\":{");
+        for (int i = 0; i < RTT_STAGE_COUNT && len < (int)sizeof(json); i++) {
+            const RoundTripStats &r = rtt[i];
+            len += snprintf(json + len, sizeof(json) - len, "%s\"%s\":[%u,%u,%u]", i ? "," : "",
+                            kRoundTripNames[i], (unsigned)r.count,
+                            (unsigned)(r.count ? r.sum_ms / r.count : 0), (unsigned)r.max_ms);
+        }
+        if (len < (int)sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "}");
+    }
+    if (len < (int)sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "}}");
+    if (len >= (int)sizeof(json)) {
+        ESP_LOGW(TAG, "Telemetry report truncated, not sent");
+        return;
+    }
+
+    if (!ws_.send_text(json, (size_t)len, pdMS_TO_TICKS(TELEMETRY_SEND_TIMEOUT_MS))) {
+        ESP_LOGW(TAG, "Telemetry send failed");
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef STAGE_PROFILER_H
+#define STAGE_PROFILER_H
+
+/* ============================================================
+ * stage_profiler.h - 推論管線各階段耗時統計與 telemetry 上報
+ * ESP-MIAO v0.8.0
+ *
+ * 推論 Task 每個切片呼叫 record()（只有極短的 critical section），
+ * telemetry Task 每 TELEMETRY_INTERVAL_S 秒取出並歸零統計，
+ * 以 telemetry 文字訊息送往 Server：
+ *   {"type":"telemetry","payload":{"seq":..,"interval_ms":..,
+ *    "stages":{"i2s_wait":[count,min_us,avg_us,p99_us],...},
+ *    "ui":[frames,late,late_max_ms,render_avg_us,render_max_us,push_avg_us,push_max_us],
+ *    "degrade":[level,stride,ns,load_pct,steps,overruns],
+ *    "weights":[pinned_bytes,flash_bytes,flash_nn_us,pinned_nn_us],
+ *    "server":{"asr_started":[count,avg_ms,max_ms],...,"reply":[...]}}}
+ * weights 為開機時權重常駐 DRAM 的結果與前後的 NN 耗時（MODEL_WEIGHT_PIN，每份都附上）。
+ * server 為裝置觀察到的 Server 往返：串流送完到各 progress 事件 / 最終回覆到達（區間內有 session 才附上）。
+ * p99 取自每倍頻 4 格的對數直方圖（最多高估 25%，且不超過實測最大值）。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "websocket_client.h"
+
+enum ProfileStage : uint8_t {
+    PROF_I2S_WAIT = 0,   // 等待切片就緒（acquire_slice 阻塞時間）
+    PROF_CONVERT,        // 切片涵蓋的 DMA 區塊轉換 / 重取樣 / 寫入環形緩衝
+    PROF_VAD,
+    PROF_MFCC,           // EI result.timing.dsp_us
+    PROF_NN,             // EI result.timing.classification_us
+    PROF_POST,           // 後驗平滑與喚醒判定
+    PROF_UI,             // UI telemetry / 預熱發佈
+    PROF_STAGE1,         // 兩階段喚醒的第一階段（WAKE_CASCADE）
+    PROF_STAGE_COUNT
+};
+
+/* 串流送完後的 Server 往返，前四項同 ServerProgress，最後為 action / play 回覆 */
+enum RoundTripStage : uint8_t {
+    RTT_ASR_STARTED = 0,
+    RTT_ASR_DONE,
+    RTT_INTENT_DONE,
+    RTT_DISPATCHED,
+    RTT_REPLY,
+    RTT_STAGE_COUNT
+};
+
+class StageProfiler {
+public:
+    explicit StageProfiler(WebSocketClient &ws);
+
+    /**
+     * 建立 telemetry Task（TELEMETRY_INTERVAL_S == 0 時不動作）。
+     * @return true = 成功或已關閉
+     */
+    bool start();
+
+    /** 記錄一個階段耗時（推論 Task 呼叫） */
+    void record(ProfileStage stage, uint32_t us);
+
+    /** telemetry / flight_record 中的階段名稱 */
+    static const char *stage_name(ProfileStage stage);
+
+    struct Summary {
+        uint32_t count, min_us, avg_us, p99_us, max_us;
+    };
+
+    /** 目前統計區間（尚未上報）的各階段摘要，不歸零（perf console 呼叫） */
+    void peek(Summary out[PROF_STAGE_COUNT]);
+
+    /**
+     * 推論降級狀態（InferenceGovernor，推論 Task 每次推論後呼叫），隨下一份 telemetry 回報。
+     * @param secondary 次要階段（串流降噪）是否仍開啟
+     */
+    void set_degrade(int level, int stride, bool secondary, uint32_t load_pct, uint32_t steps, uint32_t overruns);
+
+    /** 權重常駐 DRAM 的結果（開機一次）：常駐 / 仍在 flash 的 bytes，常駐前後每次推論的 NN 耗時 */
+    void set_weights(uint32_t pinned_bytes, uint32_t flash_bytes, uint32_t flash_nn_us, uint32_t pinned_nn_us);
+
+    /** 記錄一次 Server 往返（串流送完 → 事件到達，ServerActionQueue worker 呼叫） */
+    void record_round_trip(RoundTripStage stage, uint32_t ms);
+
+private:
+    static constexpr int HIST_BUCKETS = 76;   // 每倍頻 4 格，涵蓋到約 1 秒（更長的併入最後一格）
+
+    struct StageStats {
+        uint32_t count;
+        uint32_t min_us;
+        uint32_t max_us;
+        uint64_t sum_us;
+        uint16_t hist[HIST_BUCKETS];
+    };
+
+    struct RoundTripStats {
+        uint32_t count;
+        uint32_t sum_ms;
+        uint32_t max_ms;
+    };
+
+    WebSocketClient &ws_;
+    StageStats       stages_[PROF_STAGE_COUNT];
+    RoundTripStats   round_trip_[RTT_STAGE_COUNT];
+    portMUX_TYPE     lock_;
+    uint32_t         seq_;
+    int64_t          window_start_us_;
+    bool             started_;
+    /* 降級狀態：level | stride << 8 | secondary << 16 | load_pct << 24（0 = 未回報） */
+    std::atomic<uint32_t> degrade_;
+    std::atomic<uint32_t> degrade_steps_;
+    std::atomic<uint32_t> degrade_overruns_;
+    /* 開機設定一次，之後只讀：pinned_bytes, flash_bytes, flash_nn_us, pinned_nn_us（全 0 = 未回報） */
+    uint32_t         weights_[4];
+
+    static int      bucket_(uint32_t us);
+    static uint32_t bucket_upper_(int b);
+    static uint32_t p99_(const StageStats &s);
+
+    static void task_entry_(void *arg);
+    void send_report_();
+};
+
+#endif // STAGE_PROFILER_H
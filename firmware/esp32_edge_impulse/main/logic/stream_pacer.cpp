@@ -0,0 +1,46 @@
+/*
+ * stream_pacer.cpp - 依送出回饋調整上行在途 frame 數實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "stream_pacer.h"
+
+StreamPacer::StreamPacer()
+{
+    reset(1);
+}
+
+void StreamPacer::reset(uint8_t max_window)
+{
+    max_window_  = max_window ? max_window : 1;
+    window_      = max_window_;
+    min_window_  = max_window_;
+    good_        = 0;
+    hold_        = 0;
+    base_us_     = UINT32_MAX;
+    smoothed_us_ = 0;
+    backoffs_    = 0;
+}
+
+void StreamPacer::on_sent(uint32_t send_us, uint32_t audio_us)
+{
+    if (send_us < base_us_) base_us_ = send_us;
+    smoothed_us_ = smoothed_us_ ? smoothed_us_ + ((int32_t)(send_us - smoothed_us_) >> 2) : send_us;
+
+    const bool congested = queue_us() > (uint32_t)STREAM_PACE_QUEUE_MS * 1000 || send_us > audio_us;
+    if (hold_) hold_--;
+    if (congested) {
+        good_ = 0;
+        if (!hold_ && window_ > 1) {
+            window_ /= 2;
+            if (window_ < min_window_) min_window_ = window_;
+            backoffs_++;
+            hold_ = window_ + 1;   // 在途中的 frame 仍反映減半前的佇列
+        }
+        return;
+    }
+    if (++good_ >= window_ && window_ < max_window_) {
+        window_++;
+        good_ = 0;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef STREAM_PACER_H
+#define STREAM_PACER_H
+
+/* ============================================================
+ * stream_pacer.h - 依送出回饋調整上行在途 frame 數
+ * ESP-MIAO v0.8.0
+ *
+ * send（WebSocket / UDP）只在 lwIP 送出緩衝已滿時阻塞，等 ACK / Wi-Fi TX 完成騰出空間，
+ * 因此單一 frame 的送出耗時即是「送出佇列已滿」的回饋：
+ *   base     本次串流最短的送出耗時（佇列空時的固定開銷）
+ *   smoothed 送出耗時的指數平均（1/4）
+ *   queue    smoothed - base：資料在 lwIP / Wi-Fi 佇列中排隊的估計
+ * queue 超過 STREAM_PACE_QUEUE_MS，或單一 frame 送得比其音訊時長還久時，在途上限減半
+ * （每次減半後至少隔一個視窗才再減）；連續一個視窗（= 目前上限個 frame）都正常才加 1。
+ * 好鏈路上在途 frame 加深、pre-roll 與追趕盡快送完；擁擠時 frame 留在環形緩衝，
+ * 不堆在送出佇列裡（取消 / 續傳也不必等佇列清空）。
+ * 純計算、無 RTOS 相依（主機測試直接使用）。
+ * ============================================================ */
+
+#include <stdint.h>
+#include "config.h"
+
+class StreamPacer {
+public:
+    StreamPacer();
+
+    /** 新串流（或續傳後的新連線）：上限回到 max_window，清除基準 */
+    void reset(uint8_t max_window);
+
+    /**
+     * 一個 frame 送出完成。
+     * @param send_us  送出耗時
+     * @param audio_us 該 frame 的音訊時長
+     */
+    void on_sent(uint32_t send_us, uint32_t audio_us);
+
+    /** 目前允許的在途 frame 數（1 .. max_window） */
+    uint8_t window() const { return window_; }
+
+    uint8_t  min_window() const { return min_window_; }
+    uint32_t backoffs() const { return backoffs_; }
+    /** 估計的排隊延遲（us） */
+    uint32_t queue_us() const { return smoothed_us_ > base_us_ ? smoothed_us_ - base_us_ : 0; }
+
+private:
+    uint8_t  max_window_;
+    uint8_t  window_;
+    uint8_t  min_window_;
+    uint8_t  good_;        // 連續正常的 frame 數
+    uint8_t  hold_;        // 減半後暫不再減的 frame 數
+    uint32_t base_us_;
+    uint32_t smoothed_us_;
+    uint32_t backoffs_;
+};
+
+#endif // STREAM_PACER_H
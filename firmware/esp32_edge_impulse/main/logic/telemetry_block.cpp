@@ -0,0 +1,58 @@
+/*
+ * telemetry_block.cpp - 裝置遙測快照實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "telemetry_block.h"
+#include "seqlock.h"
+#include "esp_timer.h"
+#include <string.h>
+
+static Seqlock<TelemetryVad>      s_vad;
+static Seqlock<TelemetryStages>   s_stages;
+static Seqlock<WakeLatencyReport> s_latency;
+static Seqlock<TelemetryHealth>   s_health;
+static uint32_t                   s_slices = 0;   // 推論 Task 專用
+
+void telemetry_publish_vad(const VadStats &stats, float wake_threshold)
+{
+    TelemetryVad v;
+    v.stats          = stats;
+    v.wake_threshold = wake_threshold;
+    v.slices         = ++s_slices;
+    s_vad.write(v);
+}
+
+void telemetry_publish_stages(const StageProfiler::Summary stages[PROF_STAGE_COUNT], uint32_t interval_ms)
+{
+    TelemetryStages t;
+    t.interval_ms = interval_ms;
+    memcpy(t.stages, stages, sizeof(t.stages));
+    s_stages.write(t);
+}
+
+void telemetry_publish_latency(const WakeLatencyReport &report)
+{
+    s_latency.write(report);
+}
+
+void telemetry_publish_health(const TelemetryHealth &health)
+{
+    s_health.write(health);
+}
+
+void telemetry_read(TelemetrySnapshot *out)
+{
+    static TelemetrySnapshot last = {};   // 讀取失敗的區段沿用此值（單一讀取 Task）
+
+    if (s_vad.read(&last.vad))         last.valid |= TELEMETRY_VALID_VAD;
+    if (s_stages.read(&last.stages))   last.valid |= TELEMETRY_VALID_STAGES;
+    if (s_latency.read(&last.latency)) last.valid |= TELEMETRY_VALID_LATENCY;
+    if (s_health.read(&last.health))   last.valid |= TELEMETRY_VALID_HEALTH;
+
+    last.magic    = TELEMETRY_MAGIC;
+    last.version  = TELEMETRY_VERSION;
+    last.size     = (uint16_t)sizeof(TelemetrySnapshot);
+    last.uptime_s = (uint32_t)(esp_timer_get_time() / 1000000);
+    *out = last;
+}
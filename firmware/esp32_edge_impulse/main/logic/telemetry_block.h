@@ -0,0 +1,78 @@
+#ifndef TELEMETRY_BLOCK_H
+#define TELEMETRY_BLOCK_H
+
+/* ============================================================
+ * telemetry_block.h - 裝置遙測快照（HTTP 輪詢用）
+ * ESP-MIAO v0.8.0
+ *
+ * 各資料由原本就持有它的 Task 在既有的取樣點發布到自己的 seqlock 區段：
+ *   vad      推論 Task，每切片（VadStats 與喚醒門檻）
+ *   stages   telemetry Task，每 TELEMETRY_INTERVAL_S 上一個區間的 StageProfiler 摘要
+ *   latency  session Task，每次喚醒後的 WakeLatencySlo 摘要
+ *   health   health Task，每 HEALTH_INTERVAL_S 的 heap / CPU / RSSI / stack 高水位
+ * telemetry_read() 只讀取這些區段，不取任何鎖、不呼叫音訊核心的物件；
+ * 寫入端不等待，讀取端再頻繁也不會拖慢推論。
+ * ============================================================ */
+
+#include <stdint.h>
+#include "config.h"
+#include "vad.h"
+#include "stage_profiler.h"
+#include "wake_latency_slo.h"
+
+#define TELEMETRY_MAGIC   0x4c45544du   // 線上位元組為 "MTEL"
+#define TELEMETRY_VERSION 1
+
+struct TelemetryVad {
+    VadStats stats;
+    float    wake_threshold;
+    uint32_t slices;        // 發布次數（切片數）
+};
+
+struct TelemetryStages {
+    uint32_t                interval_ms;
+    StageProfiler::Summary  stages[PROF_STAGE_COUNT];
+};
+
+struct TelemetryHealth {
+    uint32_t uptime_s;      // 取樣時間
+    uint32_t heap_free;     // internal
+    uint32_t heap_min_free;
+    uint32_t heap_largest;
+    uint32_t stack_min;     // 所有 Task 中最低的 stack 高水位（bytes）
+    char     stack_task[16];
+    int8_t   rssi;          // dBm，0 = 未連線
+    int8_t   cpu[2];        // 各核心負載 %，-1 = 未知
+};
+
+/* HTTP 的 binary 格式即此結構（little-endian、自然對齊）；valid 位元標示各區段是否已有資料 */
+struct TelemetrySnapshot {
+    uint32_t          magic;
+    uint16_t          version;
+    uint16_t          size;          // sizeof(TelemetrySnapshot)
+    uint32_t          uptime_s;      // 讀取時間
+    uint32_t          valid;         // TELEMETRY_VALID_*
+    TelemetryVad      vad;
+    TelemetryStages   stages;
+    WakeLatencyReport latency;
+    TelemetryHealth   health;
+};
+
+#define TELEMETRY_VALID_VAD     (1u << 0)
+#define TELEMETRY_VALID_STAGES  (1u << 1)
+#define TELEMETRY_VALID_LATENCY (1u << 2)
+#define TELEMETRY_VALID_HEALTH  (1u << 3)
+
+/* 發布端：各函式只能由上述對應的單一 Task 呼叫 */
+void telemetry_publish_vad(const VadStats &stats, float wake_threshold);
+void telemetry_publish_stages(const StageProfiler::Summary stages[PROF_STAGE_COUNT], uint32_t interval_ms);
+void telemetry_publish_latency(const WakeLatencyReport &report);
+void telemetry_publish_health(const TelemetryHealth &health);
+
+/**
+ * 讀取各區段的最新快照（每個區段各自一致；寫入中且重試用盡的區段沿用上一次讀到的值）。
+ * 只能由一個 Task 呼叫（HTTP server Task）。
+ */
+void telemetry_read(TelemetrySnapshot *out);
+
+#endif // TELEMETRY_BLOCK_H
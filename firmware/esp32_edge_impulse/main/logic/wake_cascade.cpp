@@ -0,0 +1,47 @@
+/*
+ * wake_cascade.cpp - 兩階段喚醒偵測的第一階段實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "wake_cascade.h"
+#include <string.h>
+
+WakeCascade::WakeCascade()
+    : head_(0), voiced_sum_(0), frame_sum_(0), hold_(0)
+{
+    memset(voiced_, 0, sizeof(voiced_));
+    memset(frames_, 0, sizeof(frames_));
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+bool WakeCascade::update(const VadResult &vad)
+{
+    /* 滑動視窗：減去最舊切片、加上本切片 */
+    voiced_sum_ += vad.voiced_frames - voiced_[head_];
+    frame_sum_  += vad.frames - frames_[head_];
+    voiced_[head_] = vad.voiced_frames;
+    frames_[head_] = vad.frames;
+    head_ = (head_ + 1) % WAKE_STAGE1_WINDOW_SLICES;
+    stats_.slices++;
+
+    if (vad.speech && score() >= WAKE_STAGE1_THRESHOLD) {
+        if (hold_ == 0) stats_.fires++;
+        hold_ = WAKE_STAGE2_HOLD_SLICES;
+    } else if (hold_ > 0) {
+        hold_--;
+    }
+    if (hold_ > 0) stats_.stage2_slices++;
+    return hold_ > 0;
+}
+
+float WakeCascade::score() const
+{
+    return frame_sum_ ? (float)voiced_sum_ / (float)frame_sum_ : 0.0f;
+}
+
+WakeCascade::Stats WakeCascade::take_stats()
+{
+    Stats s = stats_;
+    memset(&stats_, 0, sizeof(stats_));
+    return s;
+}
@@ -0,0 +1,55 @@
+#ifndef WAKE_CASCADE_H
+#define WAKE_CASCADE_H
+
+/* ============================================================
+ * wake_cascade.h - 兩階段喚醒偵測的第一階段（常駐、極低成本）
+ * ESP-MIAO v0.8.0
+ *
+ * 第一階段只用 VAD 已算好的每切片結果：最近 WAKE_STAGE1_WINDOW_SLICES 個切片
+ * 的語音幀比例 >= WAKE_STAGE1_THRESHOLD（「嘿喵喵」約 0.8~1.2 秒連續有聲）時觸發，
+ * 第二階段（EI MFCC + NN）從此開啟，直到最後一次觸發後 WAKE_STAGE2_HOLD_SLICES 個切片。
+ * 開啟時由呼叫端自環形緩衝回放前一個模型視窗，第二階段不缺喚醒詞開頭。
+ * 兩個階段各自有門檻：第一階段為語音幀比例，第二階段仍為 PosteriorFilter 的 on/off。
+ * ============================================================ */
+
+#include <stdint.h>
+#include "config.h"
+#include "vad.h"
+
+class WakeCascade {
+public:
+    struct Stats {
+        uint32_t slices;         // 第一階段處理的切片數
+        uint32_t fires;          // 第一階段觸發次數（第二階段由關轉開）
+        uint32_t stage2_slices;  // 第二階段開啟的切片數
+        uint32_t confirmed;      // 第二階段確認的喚醒次數
+    };
+
+    WakeCascade();
+
+    /**
+     * 輸入本切片的 VAD 結果（推論 Task 每切片呼叫）。
+     * @return true = 第二階段應執行本切片
+     */
+    bool update(const VadResult &vad);
+
+    /** 第二階段確認喚醒（統計用） */
+    void record_confirmed() { stats_.confirmed++; }
+
+    /** 最近視窗的語音幀比例 (0~1) */
+    float score() const;
+
+    /** 取出並歸零統計 */
+    Stats take_stats();
+
+private:
+    uint16_t voiced_[WAKE_STAGE1_WINDOW_SLICES];
+    uint16_t frames_[WAKE_STAGE1_WINDOW_SLICES];
+    int      head_;
+    uint32_t voiced_sum_;
+    uint32_t frame_sum_;
+    uint32_t hold_;          // 第二階段剩餘開啟切片數（0 = 關閉）
+    Stats    stats_;
+};
+
+#endif // WAKE_CASCADE_H
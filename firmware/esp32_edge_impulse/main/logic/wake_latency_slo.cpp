@@ -0,0 +1,103 @@
+/*
+ * wake_latency_slo.cpp - 喚醒 → 第一個音訊 byte 延遲 SLO 實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "wake_latency_slo.h"
+#include <string.h>
+
+static const char *const kStageNames[WL_STAGE_COUNT] = {
+    "queue", "link", "start", "capture", "send",
+};
+
+WakeLatencySlo::WakeLatencySlo()
+    : slo_ms_(WAKE_SLO_MS), count_(0), next_(0), degraded_(false)
+{
+    static const uint32_t kBudgets[WL_STAGE_COUNT] = {
+        WAKE_SLO_BUDGET_QUEUE_MS, WAKE_SLO_BUDGET_LINK_MS, WAKE_SLO_BUDGET_START_MS,
+        WAKE_SLO_BUDGET_CAPTURE_MS, WAKE_SLO_BUDGET_SEND_MS,
+    };
+    memcpy(budget_ms_, kBudgets, sizeof(budget_ms_));
+    memset(stage_us_, 0, sizeof(stage_us_));
+    memset(total_us_, 0, sizeof(total_us_));
+}
+
+void WakeLatencySlo::configure(uint32_t slo_ms, const uint32_t budget_ms[WL_STAGE_COUNT])
+{
+    slo_ms_ = slo_ms;
+    for (int s = 0; s < WL_STAGE_COUNT; s++) budget_ms_[s] = budget_ms[s] ? budget_ms[s] : 1;
+}
+
+const char *WakeLatencySlo::stage_name(WakeLatencyStage stage)
+{
+    return stage < WL_STAGE_COUNT ? kStageNames[stage] : "?";
+}
+
+uint32_t WakeLatencySlo::percentile_(uint32_t *vals, int n, int pct)
+{
+    for (int i = 1; i < n; i++) {   // n 很小：插入排序
+        uint32_t v = vals[i];
+        int      j = i - 1;
+        while (j >= 0 && vals[j] > v) {
+            vals[j + 1] = vals[j];
+            j--;
+        }
+        vals[j + 1] = v;
+    }
+    int rank = (pct * n + 99) / 100;   // nearest-rank：ceil(pct% × n)
+    return vals[rank > 0 ? rank - 1 : 0];
+}
+
+void WakeLatencySlo::summary(WakeLatencyReport *out) const
+{
+    memset(out, 0, sizeof(*out));
+    out->degraded = degraded_;
+    out->samples  = count_;
+    if (count_ == 0) return;
+
+    uint32_t vals[WAKE_SLO_WINDOW];
+    memcpy(vals, total_us_, count_ * sizeof(uint32_t));
+    out->p50_ms = (percentile_(vals, count_, 50) + 500) / 1000;
+    out->p90_ms = (percentile_(vals, count_, 90) + 500) / 1000;
+    out->max_ms = (vals[count_ - 1] + 500) / 1000;   // 已排序
+
+    /* 各段 p90 相對預算：比例最大者即「吃掉預算」的一段 */
+    uint64_t worst_ratio = 0;
+    for (int s = 0; s < WL_STAGE_COUNT; s++) {
+        for (int i = 0; i < count_; i++) vals[i] = stage_us_[i][s];
+        uint32_t p90_us = percentile_(vals, count_, 90);
+        out->stage_p90_ms[s] = (p90_us + 500) / 1000;
+        uint64_t ratio = (uint64_t)p90_us * 1000 / budget_ms_[s];
+        if (ratio > worst_ratio) {
+            worst_ratio = ratio;
+            out->worst  = (WakeLatencyStage)s;
+        }
+    }
+}
+
+bool WakeLatencySlo::record(const uint32_t stage_us[WL_STAGE_COUNT], WakeLatencyReport *out)
+{
+    uint32_t total = 0;
+    for (int s = 0; s < WL_STAGE_COUNT; s++) {
+        stage_us_[next_][s] = stage_us[s];
+        total += stage_us[s];
+    }
+    total_us_[next_] = total;
+    next_ = (uint16_t)((next_ + 1) % WAKE_SLO_WINDOW);
+    if (count_ < WAKE_SLO_WINDOW) count_++;
+
+    WakeLatencyReport rep;
+    summary(&rep);
+    bool changed = false;
+    if (slo_ms_ > 0 && count_ >= WAKE_SLO_MIN_SAMPLES) {
+        if (!degraded_ && rep.p90_ms > slo_ms_) {
+            degraded_ = changed = true;
+        } else if (degraded_ && rep.p90_ms * 100 <= slo_ms_ * WAKE_SLO_RECOVER_PCT) {
+            degraded_ = false;
+            changed   = true;
+        }
+    }
+    rep.degraded = degraded_;
+    if (out) *out = rep;
+    return changed;
+}
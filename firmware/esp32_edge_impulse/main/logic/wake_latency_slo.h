@@ -0,0 +1,82 @@
+#ifndef WAKE_LATENCY_SLO_H
+#define WAKE_LATENCY_SLO_H
+
+/* ============================================================
+ * wake_latency_slo.h - 喚醒 → 第一個音訊 byte 送出的延遲 SLO
+ * ESP-MIAO v0.8.0
+ *
+ * 每次喚醒自 on_wake_word_detected_ 量到第一個 frame 的 send 成功返回，拆成五段：
+ *   queue    喚醒確認 → session Task 取得請求
+ *   link     → ACK 排入（WebSocket 斷線時含等待連線）
+ *   start    → audio_start 送出（pre-roll 定位、UDP socket）
+ *   capture  → 第一個 frame 排入 TX（讀取 / 降噪 / 編碼）
+ *   send     → 第一個 frame 送出完成（send_binary / UDP）
+ * 保留最近 WAKE_SLO_WINDOW 次。總延遲 p90 超過 SLO 時轉為 degraded，並指出 p90 超出
+ * 各段預算比例最大的一段；p90 回到 SLO 的 WAKE_SLO_RECOVER_PCT% 以下才恢復（避免來回跳動）。
+ * 純計算、無 RTOS 相依（主機測試直接使用）；呼叫端負責上報與 UI 提示。
+ * ============================================================ */
+
+#include <stdint.h>
+#include "config.h"
+
+enum WakeLatencyStage : uint8_t {
+    WL_QUEUE = 0,
+    WL_LINK,
+    WL_START,
+    WL_CAPTURE,
+    WL_SEND,
+    WL_STAGE_COUNT
+};
+
+/* 目前視窗的摘要 */
+struct WakeLatencyReport {
+    bool             degraded;
+    uint16_t         samples;
+    uint32_t         p50_ms;
+    uint32_t         p90_ms;
+    uint32_t         max_ms;
+    uint32_t         stage_p90_ms[WL_STAGE_COUNT];
+    WakeLatencyStage worst;       // p90 / 預算比例最大的一段
+};
+
+class WakeLatencySlo {
+public:
+    WakeLatencySlo();
+
+    /**
+     * 設定 SLO 與各段預算（預設取自 config.h 的 WAKE_SLO_*）。
+     * @param slo_ms    總延遲 p90 上限，0 = 只統計不判定
+     * @param budget_ms 各段預算（指出超標段用；0 視為 1 ms）
+     */
+    void configure(uint32_t slo_ms, const uint32_t budget_ms[WL_STAGE_COUNT]);
+
+    /**
+     * 加入一次喚醒的各段耗時。
+     * @param stage_us 各段耗時（us）
+     * @param out      摘要（可為 NULL）
+     * @return true = 狀態改變（轉為 degraded 或恢復）
+     */
+    bool record(const uint32_t stage_us[WL_STAGE_COUNT], WakeLatencyReport *out);
+
+    /** 目前視窗的摘要（不改變狀態） */
+    void summary(WakeLatencyReport *out) const;
+
+    bool degraded() const { return degraded_; }
+
+    /** 上報 / log 用的階段名稱 */
+    static const char *stage_name(WakeLatencyStage stage);
+
+private:
+    uint32_t slo_ms_;
+    uint32_t budget_ms_[WL_STAGE_COUNT];
+    uint32_t stage_us_[WAKE_SLO_WINDOW][WL_STAGE_COUNT];
+    uint32_t total_us_[WAKE_SLO_WINDOW];
+    uint16_t count_;
+    uint16_t next_;
+    bool     degraded_;
+
+    /* vals 會被排序；n <= WAKE_SLO_WINDOW，nearest-rank */
+    static uint32_t percentile_(uint32_t *vals, int n, int pct);
+};
+
+#endif // WAKE_LATENCY_SLO_H
@@ -0,0 +1,68 @@
+/*
+ * wake_tuning.cpp - Server 下發的喚醒 / VAD 門檻實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "wake_tuning.h"
+#include "config.h"
+#include "nvs_writer.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include <math.h>
+#include <string.h>
+
+static const char *TAG = "WakeTuning";
+
+#define WAKE_TUNE_NVS_NS  "wake_tune"
+#define WAKE_TUNE_NVS_KEY "tuning"
+
+WakeTuning wake_tuning_defaults()
+{
+    WakeTuning t = { WAKE_ON_THRESHOLD, VAD_TUNE_BASE, 0 };
+    return t;
+}
+
+static float clampf_(float v, float lo, float hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+bool wake_tuning_clamp(WakeTuning *t)
+{
+    if (!isfinite(t->wake_threshold) || !isfinite(t->vad_threshold) ||
+        t->wake_threshold <= 0.0f || t->vad_threshold <= 0.0f) {
+        return false;
+    }
+    t->wake_threshold = clampf_(t->wake_threshold, WAKE_ON_THRESHOLD, WAKE_TUNE_MAX);
+    t->vad_threshold  = clampf_(t->vad_threshold, VAD_TUNE_BASE, VAD_TUNE_MAX);
+    return true;
+}
+
+bool wake_tuning_load(WakeTuning *out)
+{
+    *out = wake_tuning_defaults();
+    nvs_handle_t handle;
+    if (nvs_open(WAKE_TUNE_NVS_NS, NVS_READONLY, &handle) != ESP_OK) return false;
+
+    WakeTuning stored;
+    size_t len = sizeof(stored);
+    bool ok = nvs_get_blob(handle, WAKE_TUNE_NVS_KEY, &stored, &len) == ESP_OK &&
+              len == sizeof(stored) && wake_tuning_clamp(&stored);
+    nvs_close(handle);
+    if (!ok) return false;
+    *out = stored;
+    return true;
+}
+
+bool wake_tuning_save(const WakeTuning &t)
+{
+    WakeTuning stored;
+    if (wake_tuning_load(&stored) && memcmp(&stored, &t, sizeof(t)) == 0) return true;
+
+    esp_err_t err = nvs_writer_set_blob(WAKE_TUNE_NVS_NS, WAKE_TUNE_NVS_KEY, &t, sizeof(t));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to persist tuning v%lu: %s", (unsigned long)t.version, esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
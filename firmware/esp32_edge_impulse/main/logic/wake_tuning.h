@@ -0,0 +1,39 @@
+#ifndef WAKE_TUNING_H
+#define WAKE_TUNING_H
+
+/* ============================================================
+ * wake_tuning.h - Server 下發的喚醒 / VAD 門檻（NVS 持久化）
+ * ESP-MIAO v0.8.0
+ *
+ * Server 依各裝置的誤喚醒率（喚醒後轉錄為空或 not_understood）推送 wake_tuning：
+ *   wake_threshold  喚醒詞（STREAM 類別）平滑後的觸發門檻
+ *   vad_threshold   VAD 幀閾值下限（自適應模式）或固定閾值
+ *   version         Server 遞增的版本，隨 audio_start 回報
+ * 數值夾限於編譯期預設與 WAKE_TUNE_MAX / VAD_TUNE_MAX 之間：只能比出廠設定更保守。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct WakeTuning {
+    float    wake_threshold;
+    float    vad_threshold;
+    uint32_t version;          // 0 = 編譯期預設（未曾調整）
+};
+
+/** 編譯期預設值（version 0） */
+WakeTuning wake_tuning_defaults();
+
+/**
+ * 夾限至允許範圍。
+ * @return false = 數值無效（NaN / 非正值），t 不變
+ */
+bool wake_tuning_clamp(WakeTuning *t);
+
+/** 自 NVS 讀取；沒有紀錄或內容無效時回傳 false，out 為預設值 */
+bool wake_tuning_load(WakeTuning *out);
+
+/** 排入 NVS 延後寫入（nvs_writer.h；與已存值相同時不排入） */
+bool wake_tuning_save(const WakeTuning &t);
+
+#endif // WAKE_TUNING_H
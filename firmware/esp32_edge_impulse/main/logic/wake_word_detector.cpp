@@ -5,19 +5,66 @@
 
 #include "wake_word_detector.h"
 #include "config.h"
+#include "ei_arena.h"
+#include "rtos_alloc.h"
 #include "esp_log.h"
-#include "esp_http_client.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_cpu.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "ui_state.h"
+#include "power_state.h"
+#include "trace_points.h"
+#include "perf_console.h"
+#include "telemetry_block.h"
+#include "model_weights.h"
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
 /* Edge Impulse SDK */
 #include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+#if SHARED_SPECTRUM_INT8
+#include "edge-impulse-sdk/classifier/ei_aligned_malloc.h"
+#endif
 
 static const char *TAG = "WakeWord";
 
+static_assert(SAMPLE_RATE == EI_CLASSIFIER_FREQUENCY,
+              "SAMPLE_RATE must match the model; change CAPTURE_SAMPLE_RATE to capture at another rate");
+
+/* 切片直接取自環形緩衝：推論期間生產者至少還要能再寫入一個切片而不覆寫它 */
+static_assert(EI_CLASSIFIER_SLICE_SIZE * 2 <= AUDIO_RING_SAMPLES * 7 / 8,
+              "EI_CLASSIFIER_SLICE_SIZE too large for zero-copy slices from the capture ring");
+
+#if VAD_GATE_INFERENCE
+/* 回放需要目前切片之前的整個模型視窗仍保留在環形緩衝內（另留一個切片給回放期間的寫入） */
+static_assert(EI_CLASSIFIER_SLICE_SIZE * (EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW + 1) <= AUDIO_RING_SAMPLES * 7 / 8,
+              "AUDIO_RING_SAMPLES too small to replay the model window after VAD gating");
+#endif
+
+static_assert(EI_CLASSIFIER_RAW_SAMPLE_COUNT % EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW == 0,
+              "EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW must divide the model window");
+
+/* 喚醒詞表：新增關鍵字只需加一列（類別名稱須存在於模型）。
+ * 所有類別共用同一次推論；同一切片有多個類別觸發（發音相近）時只執行平滑信心值最高者 */
+static const WakeLabelSpec kWakeLabels[] = {
+    { "heymiaomiao", WAKE_ON_THRESHOLD, WAKE_REFRACTORY_MS, WAKE_ACTION_STREAM, LOCAL_CMD_NONE },
+#if LOCAL_CMD_ENABLE
+    /* 喚醒後 LOCAL_CMD_WINDOW_MS 內才受理；類別名稱對應 Server COMMAND_MAP */
+    { "light_on",    LOCAL_CMD_THRESHOLD, WAKE_REFRACTORY_MS, WAKE_ACTION_COMMAND, LOCAL_CMD_LIGHT_ON },
+    { "light_off",   LOCAL_CMD_THRESHOLD, WAKE_REFRACTORY_MS, WAKE_ACTION_COMMAND, LOCAL_CMD_LIGHT_OFF },
+    { "fan_on",      LOCAL_CMD_THRESHOLD, WAKE_REFRACTORY_MS, WAKE_ACTION_COMMAND, LOCAL_CMD_FAN_ON },
+    { "fan_off",     LOCAL_CMD_THRESHOLD, WAKE_REFRACTORY_MS, WAKE_ACTION_COMMAND, LOCAL_CMD_FAN_OFF },
+#endif
+#if CONTROL_WORDS
+    /* cancel 只在 session 中受理，repeat 只在待機時受理 */
+    { "cancel",      CONTROL_WORD_THRESHOLD, CONTROL_CANCEL_COOLDOWN_MS, WAKE_ACTION_CANCEL, LOCAL_CMD_NONE },
+    { "repeat",      CONTROL_WORD_THRESHOLD, CONTROL_REPEAT_COOLDOWN_MS, WAKE_ACTION_REPEAT, LOCAL_CMD_NONE },
+#endif
+};
+
 /* static 單例（供 ei_get_data_ C-style callback 使用） */
 WakeWordDetector *WakeWordDetector::instance_ = nullptr;
 
@@ -27,73 +74,843 @@ WakeWordDetector::WakeWordDetector(AudioCapture       &audio,
                                    VAD                &vad,
                                    WebSocketClient    &ws,
                                    HardwareController &hw,
-                                   AudioStreamer       &streamer)
-    : audio_(audio), vad_(vad), ws_(ws), hw_(hw), streamer_(streamer),
-      on_server_action_(nullptr)
+                                   AudioStreamer       &streamer,
+                                   WifiManager         &wifi,
+                                   MqttCommandClient   &mqtt,
+                                   AudioPlayer         &player)
+    : audio_(audio), vad_(vad), ws_(ws), hw_(hw), streamer_(streamer), wifi_(wifi), mqtt_(mqtt),
+      ack_(ws, player), warmup_(ws, wifi), continuous_(audio, ws), profiler_(ws),
+#if CLIP_RECORDER
+      recorder_(audio, ws),
+#endif
+#if MODEL_PARTITION
+      model_(ws),
+#endif
+      on_server_action_(nullptr), wake_label_count_(0),
+      tuning_q_(nullptr), tuning_(wake_tuning_defaults()), session_q_(nullptr),
+      action_q_(nullptr), session_busy_(false), reply_wait_us_(0), last_progress_us_(0), followup_q_(nullptr), followup_armed_(false),
+      command_until_us_(0), local_handled_(false), repeat_q_(nullptr),
+      window_stride_(1), stride_resync_(false), vad_debug_(VAD_FFT_DEBUG)
 {
     instance_ = this;
-    memset(slice_buf_, 0, sizeof(slice_buf_));
+    memset(&slice_, 0, sizeof(slice_));
+    memset(&timing_, 0, sizeof(timing_));
+#if SHARED_SPECTRUM
+    shared_spectrum_ = false;
+    maf_pos_         = 0;
+    direct_input_    = false;
+    memset(maf_, 0, sizeof(maf_));
+#endif
 }
 
 /* ------------------------------------------------------------------ */
 
 int WakeWordDetector::ei_get_data_(size_t offset, size_t length, float *out_ptr)
 {
-    if (!instance_) return -1;
-    memcpy(out_ptr, instance_->slice_buf_ + offset, length * sizeof(float));
+    if (!instance_ || offset + length > instance_->slice_.size) return -1;
+    instance_->slice_.to_float(offset, length, out_ptr);
     return 0;
 }
 
 /* ------------------------------------------------------------------ */
 
-static void send_ack_()
+int WakeWordDetector::warm_up_()
+{
+    const AudioSlice    current  = slice_;
+    ei_impulse_result_t result   = {};
+    int                 replayed = 0;
+
+    signal_t signal;
+    signal.total_length = EI_CLASSIFIER_SLICE_SIZE;
+    signal.get_data     = &WakeWordDetector::ei_get_data_;
+
+    for (int k = EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW - 1; k >= 1; k--) {
+        uint32_t pos = current.pos - (uint32_t)(k * EI_CLASSIFIER_SLICE_SIZE);
+        if (!audio_.slice_at(pos, EI_CLASSIFIER_SLICE_SIZE, &slice_)) continue;
+        if (run_classifier_continuous(&signal, &result, false) == EI_IMPULSE_OK) replayed++;
+    }
+
+    slice_ = current;
+    return replayed;
+}
+
+/* ------------------------------------------------------------------ */
+
+void WakeWordDetector::publish_state_(ui_state_t state)
+{
+    ui_publish_state(state);
+    hw_.show_state(state);
+}
+
+/* ------------------------------------------------------------------ */
+
+void WakeWordDetector::resolve_wake_labels_()
+{
+    wake_label_count_ = 0;
+    for (const WakeLabelSpec &spec : kWakeLabels) {
+        int index = -1;
+        for (uint16_t i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) {
+            if (strcmp(ei_classifier_inferencing_categories[i], spec.label) == 0) {
+                index = i;
+                break;
+            }
+        }
+        if (index < 0 || wake_label_count_ >= EI_CLASSIFIER_LABEL_COUNT) {
+            ESP_LOGE(TAG, "Wake label '%s' not in model, ignored", spec.label);
+            continue;
+        }
+
+        WakeLabel &w = wake_labels_[wake_label_count_++];
+        w.spec  = &spec;
+        w.index = (uint16_t)index;
+        w.posterior.init(WAKE_SMOOTH_SLICES, WAKE_SMOOTH_MAX, spec.threshold, WAKE_OFF_THRESHOLD,
+                         spec.cooldown_ms);
+        static const char *const kActions[] = { "stream", "log", "command", "cancel", "repeat" };
+        printf("Wake: '%s' (class %d) %s of %d, on=%.2f off=%.2f refractory=%d ms, action=%s\r\n",
+               spec.label, index, WAKE_SMOOTH_MAX ? "max" : "mean", WAKE_SMOOTH_SLICES,
+               spec.threshold, (float)WAKE_OFF_THRESHOLD, spec.cooldown_ms, kActions[spec.action]);
+    }
+}
+
+void WakeWordDetector::calibrate_inference_()
+{
+    if (EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW <= INFERENCE_COARSE_SLICES) return;
+
+    const int64_t budget_us = (int64_t)EI_CLASSIFIER_SLICE_SIZE * 1000000 / EI_CLASSIFIER_FREQUENCY
+                            * INFERENCE_BUDGET_PCT / 100;
+    ei_impulse_result_t result = {};
+    int64_t worst_us = 0;
+
+    signal_t signal;
+    signal.total_length = EI_CLASSIFIER_SLICE_SIZE;
+    signal.get_data     = &WakeWordDetector::ei_get_data_;
+
+    /* 一個完整視窗的切片，讓特徵矩陣填滿後的穩態耗時也被量到 */
+    for (int i = 0; i < EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW; i++) {
+        if (!audio_.acquire_slice(AUDIO_READER_DETECTOR, EI_CLASSIFIER_SLICE_SIZE, &slice_)) continue;
+        int64_t t0 = esp_timer_get_time();
+        if (run_classifier_continuous(&signal, &result, false) != EI_IMPULSE_OK) continue;
+        int64_t dt = esp_timer_get_time() - t0;
+        if (dt > worst_us) worst_us = dt;
+    }
+
+    if (worst_us > budget_us) {
+        window_stride_ = (EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW + INFERENCE_COARSE_SLICES - 1)
+                       / INFERENCE_COARSE_SLICES;
+        ESP_LOGW(TAG, "Inference %lld us exceeds %lld us budget for %d slices/window; "
+                 "falling back to full-window inference every %d slices",
+                 (long long)worst_us, (long long)budget_us,
+                 EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW, window_stride_);
+    } else {
+        ESP_LOGI(TAG, "Inference %lld us fits %lld us budget, %d slices/window",
+                 (long long)worst_us, (long long)budget_us, EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW);
+    }
+}
+
+#if MODEL_WEIGHT_PIN
+uint32_t WakeWordDetector::probe_nn_us_(int n)
+{
+    ei_impulse_result_t result = {};
+    signal_t signal;
+    signal.total_length = EI_CLASSIFIER_SLICE_SIZE;
+    signal.get_data     = &WakeWordDetector::ei_get_data_;
+
+    int64_t sum_us = 0;
+    int     runs   = 0;
+    for (int i = 0; i < n; i++) {
+        if (!audio_.acquire_slice(AUDIO_READER_DETECTOR, EI_CLASSIFIER_SLICE_SIZE, &slice_)) continue;
+        if (run_classifier_continuous(&signal, &result, false) != EI_IMPULSE_OK) continue;
+        sum_us += result.timing.classification_us;
+        runs++;
+    }
+    return runs ? (uint32_t)(sum_us / runs) : 0;
+}
+
+void WakeWordDetector::pin_weights_()
+{
+    /* 量測時 cache 內仍是麥克風暖機的程式碼與資料，接近推論切片之間被擠掉後的情況 */
+    uint32_t flash_us = probe_nn_us_(MODEL_PIN_PROBE_SLICES);
+    ModelPinStats st;
+    if (!model_weights_pin(MODEL_PIN_BUDGET_BYTES, MODEL_PIN_MAX_TENSOR, &st)) {
+        ESP_LOGW(TAG, "Weight pinning: nothing pinned, %lu tensors (%lu B) read from flash",
+                 (unsigned long)st.flash_tensors, (unsigned long)st.flash_bytes);
+        return;
+    }
+    uint32_t pinned_us = probe_nn_us_(MODEL_PIN_PROBE_SLICES);
+    profiler_.set_weights(st.pinned_bytes, st.flash_bytes, flash_us, pinned_us);
+    ESP_LOGI(TAG, "Weight pinning: %lu tensors (%lu B) in DRAM, %lu (%lu B) in flash; "
+             "NN %lu us -> %lu us per inference",
+             (unsigned long)st.pinned_tensors, (unsigned long)st.pinned_bytes,
+             (unsigned long)st.flash_tensors, (unsigned long)st.flash_bytes,
+             (unsigned long)flash_us, (unsigned long)pinned_us);
+}
+#endif
+
+#if SHARED_SPECTRUM
+bool WakeWordDetector::init_shared_spectrum_()
+{
+    const ei_model_dsp_t &block = ei_dsp_blocks[0];
+    if (ei_dsp_blocks_size != 1 || block.extract_fn != &extract_mfcc_features) {
+        ESP_LOGI(TAG, "Shared spectrum: model DSP block is not MFCC, disabled");
+        return false;
+    }
+    const ei_dsp_config_mfcc_t *cfg = (const ei_dsp_config_mfcc_t *)block.config;
+    MfccParams p;
+    p.frame_length = (int)(cfg->frame_length * EI_CLASSIFIER_FREQUENCY + 0.5f);
+    p.frame_stride = (int)(cfg->frame_stride * EI_CLASSIFIER_FREQUENCY + 0.5f);
+    p.fft_length   = cfg->fft_length;
+    p.num_filters  = cfg->num_filters;
+    p.num_cepstral = cfg->num_cepstral;
+    p.low_hz       = (float)cfg->low_frequency;
+    p.high_hz      = (float)cfg->high_frequency;
+    p.pre_cof      = cfg->pre_cof;
+    p.pre_shift    = cfg->pre_shift;
+    p.win_size     = cfg->win_size;
+    if (!frontend_.init(p, EI_CLASSIFIER_RAW_SAMPLE_COUNT) ||
+        frontend_.feature_count() != EI_CLASSIFIER_NN_INPUT_FRAME_SIZE) {
+        ESP_LOGW(TAG, "Shared spectrum: front-end does not fit the model, disabled");
+        return false;
+    }
+
+    /* 對最近一個完整視窗比對 SDK 的 MFCC（SDK 版本的 cmvnw 參數不同，兩種正規化都試） */
+    const AudioSlice saved = slice_;
+    AudioSlice window;
+    if (!audio_.slice_at(saved.pos + saved.size - EI_CLASSIFIER_RAW_SAMPLE_COUNT,
+                         EI_CLASSIFIER_RAW_SAMPLE_COUNT, &window)) {
+        ESP_LOGW(TAG, "Shared spectrum: no full window to verify, disabled");
+        return false;
+    }
+    signal_t signal;
+    signal.total_length = EI_CLASSIFIER_RAW_SAMPLE_COUNT;
+    signal.get_data     = &WakeWordDetector::ei_get_data_;
+    ei::matrix_t reference(1, EI_CLASSIFIER_NN_INPUT_FRAME_SIZE);
+    slice_ = window;
+    int err = extract_mfcc_features(&signal, &reference, block.config, EI_CLASSIFIER_FREQUENCY);
+    slice_ = saved;
+    if (err != EIDSP_OK) {
+        ESP_LOGW(TAG, "Shared spectrum: SDK MFCC failed (%d), disabled", err);
+        return false;
+    }
+
+    /* 定點引擎先試，超出容差再退回 float 引擎 */
+    static const SpectralFrontend::Engine kEngines[] = {
+#if SHARED_SPECTRUM_Q15
+        SpectralFrontend::ENGINE_Q15,
+#endif
+        SpectralFrontend::ENGINE_FLOAT,
+    };
+    float best = INFINITY;
+    SpectralFrontend::Norm best_norm = SpectralFrontend::NORM_MEAN_MINMAX;
+    for (SpectralFrontend::Engine engine : kEngines) {
+        static const SpectralFrontend::Norm kNorms[] = {
+            SpectralFrontend::NORM_MEAN_MINMAX, SpectralFrontend::NORM_MEAN_VAR,
+        };
+        best = INFINITY;
+        frontend_.set_engine(engine);
+        for (SpectralFrontend::Norm norm : kNorms) {
+            frontend_.reset();
+            frontend_.set_norm(norm);
+            frontend_.prime_preemphasis(window);
+            frontend_.process(window, nullptr, 0, nullptr);
+            frontend_.features(features_);
+            float diff = 0.0f;
+            for (int i = 0; i < EI_CLASSIFIER_NN_INPUT_FRAME_SIZE; i++) {
+                float d = fabsf(features_[i] - reference.buffer[i]);
+                if (d > diff) diff = d;
+            }
+            if (diff < best) {
+                best      = diff;
+                best_norm = norm;
+            }
+        }
+        if (best <= SHARED_SPECTRUM_TOLERANCE) break;
+        if (engine == SpectralFrontend::ENGINE_Q15) {
+            ESP_LOGW(TAG, "Shared spectrum: Q15 engine differs from SDK by %.4f, trying float", best);
+        }
+    }
+    frontend_.reset();
+    frontend_.set_norm(best_norm);
+    if (!audio_.slice_valid(window)) {
+        ESP_LOGW(TAG, "Shared spectrum: window overwritten during verification, disabled");
+        return false;
+    }
+    if (!(best <= SHARED_SPECTRUM_TOLERANCE)) {
+        ESP_LOGW(TAG, "Shared spectrum: features differ from SDK by %.4f (> %.4f), disabled",
+                 best, SHARED_SPECTRUM_TOLERANCE);
+        return false;
+    }
+    ESP_LOGI(TAG, "Shared spectrum enabled: max feature error %.5f (%s normalisation, %s engine)", best,
+             best_norm == SpectralFrontend::NORM_MEAN_VAR ? "mean/var" : "mean/min-max",
+             frontend_.engine() == SpectralFrontend::ENGINE_Q15 ? "Q15" : "float");
+#if SHARED_SPECTRUM_INT8
+    direct_input_ = probe_direct_input_();
+#endif
+    return true;
+}
+
+#if SHARED_SPECTRUM_INT8
+static const ei_config_tflite_eon_graph_t *eon_graph_()
+{
+    const auto *block = (const ei_learning_block_config_tflite_graph_t *)
+                        ei_default_impulse.impulse->learning_blocks[0].config;
+    return block->compiled ? (const ei_config_tflite_eon_graph_t *)block->graph_config : nullptr;
+}
+
+bool WakeWordDetector::probe_direct_input_()
 {
-    esp_http_client_config_t cfg = {};
-    cfg.url        = ACK_URL;
-    cfg.method     = HTTP_METHOD_GET;
-    cfg.timeout_ms = 800;
+    const ei_config_tflite_eon_graph_t *graph = eon_graph_();
+    if (!graph || ei_default_impulse.impulse->learning_blocks_size != 1) return false;
+    if (graph->model_init(ei_aligned_calloc) != kTfLiteOk) return false;
+    TfLiteTensor input, output;
+    bool ok = graph->model_input(0, &input) == kTfLiteOk &&
+              graph->model_output(0, &output) == kTfLiteOk &&
+              input.type == kTfLiteInt8 && output.type == kTfLiteInt8 &&
+              input.bytes == EI_CLASSIFIER_NN_INPUT_FRAME_SIZE &&
+              output.bytes == EI_CLASSIFIER_LABEL_COUNT;
+    graph->model_reset(ei_aligned_free);
+    ESP_LOGI(TAG, "Shared spectrum: %s", ok ? "int8 features written straight into the model input"
+                                            : "model input is not int8, using run_inference");
+    return ok;
+}
 
-    esp_http_client_handle_t c = esp_http_client_init(&cfg);
-    if (!c) { ESP_LOGE("ACK", "init failed"); return; }
-    esp_err_t err = esp_http_client_perform(c);
-    if (err == ESP_OK)
-        ESP_LOGI("ACK", "OK status=%d", (int)esp_http_client_get_status_code(c));
+EI_IMPULSE_ERROR WakeWordDetector::invoke_direct_(ei_impulse_result_t *result)
+{
+    const ei_config_tflite_eon_graph_t *graph = eon_graph_();
+    int64_t t0 = esp_timer_get_time();
+    if (graph->model_init(ei_aligned_calloc) != kTfLiteOk) return EI_IMPULSE_TFLITE_ERROR;
+    TfLiteTensor input, output;
+    graph->model_input(0, &input);
+    graph->model_output(0, &output);
+    frontend_.features_i8(input.data.int8, input.params.scale, input.params.zero_point);
+    int64_t t1 = esp_timer_get_time();
+
+    TfLiteStatus status = graph->model_invoke();
+    if (status == kTfLiteOk) {
+        for (int i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) {
+            result->classification[i].label = ei_classifier_inferencing_categories[i];
+            result->classification[i].value =
+                (output.data.int8[i] - output.params.zero_point) * output.params.scale;
+        }
+    }
+    graph->model_reset(ei_aligned_free);
+    int64_t t2 = esp_timer_get_time();
+
+    result->timing.dsp_us            = t1 - t0;   // 正規化 + 量化（含 arena 初始化）
+    result->timing.classification_us = t2 - t1;
+    result->timing.classification    = (int)(result->timing.classification_us / 1000);
+    return status == kTfLiteOk ? EI_IMPULSE_OK : EI_IMPULSE_TFLITE_ERROR;
+}
+#endif
+
+EI_IMPULSE_ERROR WakeWordDetector::classify_shared_(ei_impulse_result_t *result)
+{
+    EI_IMPULSE_ERROR res;
+#if SHARED_SPECTRUM_INT8
+    if (direct_input_) {
+        res = invoke_direct_(result);
+    }
     else
-        ESP_LOGE("ACK", "FAILED: %s", esp_err_to_name(err));
-    esp_http_client_cleanup(c);
+#endif
+    {
+        int64_t t0 = esp_timer_get_time();
+        frontend_.features(features_);
+        int64_t norm_us = esp_timer_get_time() - t0;
+
+        ei::matrix_t features(1, EI_CLASSIFIER_NN_INPUT_FRAME_SIZE, features_);
+        ei_feature_t feature = { &features, ei_dsp_blocks[0].blockId };
+        res = run_inference(&ei_default_impulse, &feature, result, false);
+        result->timing.dsp_us = norm_us;   // MFCC 幀已在前端（vad 階段）算好，這裡只剩正規化
+    }
+    if (res != EI_IMPULSE_OK) return res;
+
+    /* 同 run_classifier_continuous 的 enable_maf：各類別取最近 SHARED_MAF_LEN 次平均 */
+    for (int i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) {
+        maf_[i][maf_pos_] = result->classification[i].value;
+        float sum = 0.0f;
+        for (int k = 0; k < SHARED_MAF_LEN; k++) sum += maf_[i][k];
+        result->classification[i].value = sum / SHARED_MAF_LEN;
+    }
+    maf_pos_ = (maf_pos_ + 1) % SHARED_MAF_LEN;
+    return res;
+}
+#endif
+
+void WakeWordDetector::record_timing_(int64_t dsp_us, int64_t nn_us, int64_t total_us,
+                                      uint32_t cycles)
+{
+    timing_.runs++;
+    timing_.cycles += cycles;
+    if (cycles > timing_.cycles_max) timing_.cycles_max = cycles;
+    timing_.dsp_us   += dsp_us;
+    timing_.nn_us    += nn_us;
+    timing_.total_us += total_us;
+    if (dsp_us   > timing_.dsp_max_us)   timing_.dsp_max_us   = dsp_us;
+    if (nn_us    > timing_.nn_max_us)    timing_.nn_max_us    = nn_us;
+    if (total_us > timing_.total_max_us) timing_.total_max_us = total_us;
+}
+
+void WakeWordDetector::log_timing_()
+{
+    if (timing_.runs == 0) return;
+    const int64_t budget_us = (int64_t)EI_CLASSIFIER_SLICE_SIZE * 1000000 / EI_CLASSIFIER_FREQUENCY;
+    const int64_t n = timing_.runs;
+    ESP_LOGI(TAG, "Inference: DSP avg=%lld max=%lld us, NN avg=%lld max=%lld us, total avg=%lld max=%lld us, "
+             "cycles avg=%llu max=%lu (budget %lld us/slice, %d slices/window, runs=%lu)",
+             (long long)(timing_.dsp_us / n), (long long)timing_.dsp_max_us,
+             (long long)(timing_.nn_us / n), (long long)timing_.nn_max_us,
+             (long long)(timing_.total_us / n), (long long)timing_.total_max_us,
+             (unsigned long long)(timing_.cycles / n), (unsigned long)timing_.cycles_max,
+             (long long)budget_us, EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW,
+             (unsigned long)timing_.runs);
+    memset(&timing_, 0, sizeof(timing_));
+}
+
+void WakeWordDetector::apply_degrade_()
+{
+    int prev       = window_stride_;
+    window_stride_ = governor_.stride();
+    if (prev > 1 && window_stride_ == 1) stride_resync_ = true;
+    streamer_.set_noise_suppression(governor_.secondary_enabled());
+    profiler_.set_degrade(governor_.level(), window_stride_, governor_.secondary_enabled(), governor_.load_pct(),
+                          governor_.steps_down(), governor_.overruns());
+    if (governor_.level() > 0) {
+        ESP_LOGW(TAG, "Inference degraded to level %d/%d (load %lu%%): %s, inference every %d slice(s)",
+                 governor_.level(), governor_.max_level(), (unsigned long)governor_.load_pct(),
+                 governor_.secondary_enabled() ? "noise suppression on" : "noise suppression off",
+                 window_stride_);
+    } else {
+        ESP_LOGI(TAG, "Inference back to full rate (load %lu%%)", (unsigned long)governor_.load_pct());
+    }
+}
+
+void WakeWordDetector::apply_tuning_(const WakeTuning &t)
+{
+    tuning_ = t;
+    for (int i = 0; i < wake_label_count_; i++) {
+        if (wake_labels_[i].spec->action == WAKE_ACTION_STREAM) {
+            wake_labels_[i].posterior.set_on_threshold(t.wake_threshold);
+        }
+    }
+    vad_.set_threshold_floor(t.vad_threshold);
+    ESP_LOGI(TAG, "Wake tuning v%lu: threshold %.3f, VAD floor %.0f",
+             (unsigned long)t.version, t.wake_threshold, t.vad_threshold);
+}
+
+bool WakeWordDetector::override_tuning(float wake_threshold, float vad_threshold)
+{
+    WakeTuning t = { wake_threshold, vad_threshold, tuning_.version };
+    if (!tuning_q_ || !wake_tuning_clamp(&t)) return false;
+    xQueueOverwrite(tuning_q_, &t);
+    return true;
+}
+
+void WakeWordDetector::apply_model_()
+{
+#if MODEL_PARTITION
+    float threshold;
+    if (!model_.apply_pending(&threshold)) return;
+    /* 連續推論的特徵視窗與平滑狀態屬於舊權重：清空後約一個視窗內重新累積 */
+    run_classifier_init();
+    if (threshold > 0.0f) {
+        WakeTuning t = tuning_;
+        t.wake_threshold = threshold;
+        apply_tuning_(t);
+    }
+#endif
 }
 
 /* ------------------------------------------------------------------ */
 
-void WakeWordDetector::on_wake_word_detected_(float confidence)
+void WakeWordDetector::start_session_task_()
+{
+    if (session_q_) return;
+    ack_.init();
+    warmup_.init();
+    continuous_.init();
+#if CLIP_RECORDER
+    recorder_.init();
+#endif
+    session_q_  = RTOS_QUEUE_CREATE(1, sizeof(WakeRequest));
+    action_q_   = RTOS_QUEUE_CREATE(1, sizeof(ServerActionType));
+    followup_q_ = RTOS_QUEUE_CREATE(1, sizeof(WakeRequest));
+    if (!session_q_ || !action_q_ || !followup_q_ ||
+        RTOS_TASK_CREATE(session_task_entry_, "wake_session", WAKE_SESSION_TASK_STACK,
+                         this, WAKE_SESSION_TASK_PRIO, nullptr,
+                         WAKE_SESSION_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start wake session task");
+    }
+}
+
+void WakeWordDetector::session_task_entry_(void *arg)
+{
+    auto *self = static_cast<WakeWordDetector *>(arg);
+    WakeRequest req;
+    while (1) {
+        if (xQueueReceive(self->session_q_, &req, portMAX_DELAY) == pdTRUE) {
+            self->run_session_(req);
+            self->session_busy_.store(false, std::memory_order_release);
+        }
+    }
+}
+
+bool WakeWordDetector::on_wake_word_detected_(float confidence)
 {
+    if (CONTINUOUS_STREAM && continuous_.serving()) {
+        /* Server 端喚醒：音訊已在連續串流中，本地偵測只作為提示（confirm 模式下由 Server 確認） */
+        ESP_LOGI(TAG, ">>> Wake hint (conf=%.3f), server decides", confidence);
+        continuous_.hint(confidence, audio_.reader_position(AUDIO_READER_DETECTOR));
+        return false;
+    }
+    /* 喚醒錨點：觸發切片的結尾；其前的 pre-roll 與之後 ACK/LED 期間的音訊都保留在環形緩衝 */
+    WakeRequest req = { confidence, audio_.reader_position(AUDIO_READER_DETECTOR),
+                        vad_.stats().noise_floor, esp_random(), esp_timer_get_time(), tuning_ };
+
+    bool expected = false;
+    if (!session_q_ || !session_busy_.compare_exchange_strong(expected, true)) {
+        ESP_LOGW(TAG, "Wake (conf=%.3f) ignored, session busy", confidence);
+        return false;
+    }
     ESP_LOGI(TAG, ">>> WAKE WORD DETECTED! (conf=%.3f)", confidence);
-    ui_publish_state(UI_WAKE);
+    publish_state_(UI_WAKE);
+
+    /* 新 session：清除上一輪的回應通知與裝置端指令狀態，開放指令類別 */
+    xQueueReset(action_q_);
+    local_handled_.store(false, std::memory_order_release);
+    streamer_.reset_cancel();
+    command_until_us_ = esp_timer_get_time() + (int64_t)LOCAL_CMD_WINDOW_MS * 1000;
+
+    xQueueSend(session_q_, &req, 0);
+#if CLIP_RECORDER
+    recorder_.on_wake(req.wake_pos, confidence, req.trace_id);   // Server 判定誤喚醒時才寫入 flash
+#endif
+    return true;
+}
+
+void WakeWordDetector::on_followup_speech_()
+{
+    /* 語音已持續 FOLLOWUP_SPEECH_SLICES 個切片：起點仍在 pre-roll 範圍內 */
+    WakeRequest req = { 0.0f, audio_.reader_position(AUDIO_READER_DETECTOR),
+                        vad_.stats().noise_floor, esp_random(), esp_timer_get_time(), tuning_ };
+    ESP_LOGI(TAG, ">>> Follow-up speech, streaming without wake word");
+    xQueueOverwrite(followup_q_, &req);
+}
+
+bool WakeWordDetector::wait_followup_(WakeRequest *out)
+{
+    vTaskDelay(pdMS_TO_TICKS(FOLLOWUP_ARM_DELAY_MS));
+    xQueueReset(followup_q_);
+    followup_armed_.store(true, std::memory_order_release);
+    bool heard = xQueueReceive(followup_q_, out, pdMS_TO_TICKS(FOLLOWUP_WINDOW_MS)) == pdTRUE;
+    followup_armed_.store(false, std::memory_order_release);
+    return heard;
+}
+
+bool WakeWordDetector::publish_local_command_(LocalCommandId id, ServerAction *action)
+{
+    /* 目標接在本機：relay_set 動作直接驅動 GPIO，不經 Broker */
+    const LocalCommandSpec *cmd   = MqttCommandClient::spec(id);
+    bool                    local = cmd && hw_.has_relay(cmd->target);
+    if (!cmd || (!local && !mqtt_.publish(id))) return false;
+    ESP_LOGI(TAG, ">>> Local command %s via %s, server round trip skipped",
+             cmd->name, local ? "local relay" : "MQTT");
 
-    /* 緊急重連（若 WS 斷線） */
+    /* 比照 Server 的 command_request 回覆（relay_set），UI 與 session 等待一致 */
+    memset(action, 0, sizeof(*action));
+    action->type = SERVER_MSG_ACTION;
+    snprintf(action->action.action, sizeof(action->action.action), "relay_set");
+    snprintf(action->action.target, sizeof(action->action.target), "%s", cmd->target);
+    snprintf(action->action.value, sizeof(action->action.value), "%s", cmd->value);
+    return true;
+}
+
+bool WakeWordDetector::on_local_command_(const WakeLabel &w)
+{
+    ServerAction action;
+    if (!publish_local_command_(w.spec->command, &action)) {
+        ESP_LOGW(TAG, "Local command '%s' not published, leaving it to the server", w.spec->label);
+        return false;
+    }
+    local_handled_.store(true, std::memory_order_release);
+    streamer_.cancel();
+    on_server_action(action);
+
+    /* on_server_action 記下的是 Server 動作；改記為裝置端指令，重播時重新發佈 */
+    RepeatAction last = { w.spec->command, action };
+    if (repeat_q_) xQueueOverwrite(repeat_q_, &last);
+    return true;
+}
+
+void WakeWordDetector::on_cancel_word_(const WakeLabel &w)
+{
+    ESP_LOGI(TAG, ">>> Cancel word '%s' (conf=%.3f), session aborted on device",
+             w.spec->label, w.posterior.smoothed());
+    local_handled_.store(true, std::memory_order_release);
+    streamer_.cancel(AudioStreamer::CANCEL_USER);
+
+    /* 比照 Server 的 audio_cancel：session 不再等待回應，直接回到待機 */
+    ServerActionType type = SERVER_MSG_AUDIO_CANCEL;
+    if (action_q_) xQueueOverwrite(action_q_, &type);
+}
+
+bool WakeWordDetector::on_repeat_word_(const WakeLabel &w)
+{
+    RepeatAction last;
+    if (!repeat_q_ || xQueuePeek(repeat_q_, &last, 0) != pdTRUE) {
+        ESP_LOGI(TAG, "Repeat word '%s': nothing to repeat", w.spec->label);
+        return false;
+    }
+    if (last.command != LOCAL_CMD_NONE) {
+        ServerAction action;
+        if (!publish_local_command_(last.command, &action)) {
+            ESP_LOGW(TAG, "Repeat word '%s': command not published", w.spec->label);
+            return false;
+        }
+        last.action = action;
+    }
+    ESP_LOGI(TAG, ">>> Repeat word '%s' (conf=%.3f): %s %s=%s", w.spec->label, w.posterior.smoothed(),
+             last.action.action.action, last.action.action.target, last.action.action.value);
+    on_server_action(last.action);
+    if (last.command != LOCAL_CMD_NONE && repeat_q_) xQueueOverwrite(repeat_q_, &last);
+    return true;
+}
+
+void WakeWordDetector::on_server_action(const ServerAction &action)
+{
+    static_assert((int)RTT_REPLY == (int)PROGRESS_STAGE_COUNT, "RoundTripStage must mirror ServerProgress");
+    if (action.type == SERVER_MSG_PROGRESS) {
+        /* 只計入本機正在等待的 session（追問 / 舊 session 的遲到事件略過） */
+        int64_t from = reply_wait_us_.load(std::memory_order_acquire);
+        if (from <= 0) return;
+        const auto &g = action.progress;
+        profiler_.record_round_trip((RoundTripStage)g.stage, (uint32_t)((g.rx_us - from) / 1000));
+        last_progress_us_.store(g.rx_us, std::memory_order_release);
+        ESP_LOGD(TAG, "Server progress: %s at +%lld ms (server %lu ms)", server_progress_name(g.stage),
+                 (long long)((g.rx_us - from) / 1000), (unsigned long)g.elapsed_ms);
+        if (g.stage == PROGRESS_DISPATCHED) publish_state_(UI_ACTION);   // 指令已送出，不等回覆
+        return;
+    }
+    if (action.type == SERVER_MSG_ACTION || action.type == SERVER_MSG_PLAY) {
+        int64_t from = reply_wait_us_.exchange(0, std::memory_order_acq_rel);
+        if (from > 0) {
+            profiler_.record_round_trip(RTT_REPLY, (uint32_t)((esp_timer_get_time() - from) / 1000));
+        }
+        publish_state_(UI_ACTION);   // eye_ui 逾時後自行回到 IDLE
+        if (action_q_) xQueueOverwrite(action_q_, &action.type);
+    }
+    if (action.type == SERVER_MSG_ACTION && repeat_q_) {
+        RepeatAction last = { LOCAL_CMD_NONE, action };
+        xQueueOverwrite(repeat_q_, &last);
+    }
+    if (action.type == SERVER_MSG_AUDIO_CANCEL) {
+        /* 多個節點聽到同一次喚醒：Server 保留其他節點的串流，本機停止送出並回到待機 */
+        ESP_LOGI(TAG, ">>> Stream cancelled by server (%s, kept %s)", action.cancel.reason,
+                 action.cancel.winner[0] ? action.cancel.winner : "-");
+        streamer_.cancel(AudioStreamer::CANCEL_SERVER);
+        if (action_q_) xQueueOverwrite(action_q_, &action.type);
+    }
+#if WAKE_TUNING_ENABLE
+    if (action.type == SERVER_MSG_WAKE_TUNING) {
+        WakeTuning t = { action.tuning.wake_threshold, action.tuning.vad_threshold, action.tuning.version };
+        if (!wake_tuning_clamp(&t)) {
+            ESP_LOGW(TAG, "Invalid wake tuning v%lu ignored", (unsigned long)action.tuning.version);
+        } else {
+            if (tuning_q_) xQueueOverwrite(tuning_q_, &t);
+            wake_tuning_save(t);   // flash 寫入在 worker Task，不佔推論時間
+        }
+    }
+#endif
+#if CLIP_RECORDER
+    if (action.type == SERVER_MSG_FALSE_WAKE) {
+        ESP_LOGI(TAG, "Server flagged wake %08lx as false (%s)", (unsigned long)action.false_wake.trace_id,
+                 action.false_wake.reason);
+        recorder_.on_false_wake(action.false_wake.trace_id);
+    }
+#endif
+#if CONTINUOUS_STREAM
+    if (action.type == SERVER_MSG_CONTINUOUS) {
+        continuous_.configure(action.continuous.enable, action.continuous.max_kbps, action.continuous.confirm);
+    }
+#endif
+#if MODEL_PARTITION
+    if (action.type == SERVER_MSG_MODEL_UPDATE) {
+        /* 下載與寫入 flash 在 worker Task；推論 Task 於下一個切片換綁 */
+        if (!model_.fetch(action.model_update.generation, action.model_update.size, action.model_update.crc32)) {
+            ESP_LOGW(TAG, "Model generation %lu not installed", (unsigned long)action.model_update.generation);
+        }
+    }
+#endif
+    if (on_server_action_) on_server_action_(action);
+}
+
+void WakeWordDetector::run_session_(const WakeRequest &req)
+{
+    /* 整個 session（ACK / 串流 / 等待回應）關閉 WiFi 省電、CPU 全速，結束後回到 modem-sleep / 動態調頻 */
+    WifiLowLatencyScope low_latency(wifi_);
+    PowerHoldScope      full_speed(PWR_HOLD_STREAM);
+
+    const int64_t    session_us = esp_timer_get_time();
+    ServerActionType reply;
+
+    /* 連線由監督 Task 維持；尚未連線（開機中 / 重連中）則保留指令音訊等待連線 */
     if (!ws_.is_connected()) {
-        ESP_LOGW(TAG, "WS down. Attempting emergency reconnect...");
-        bool ok = ws_.emergency_reconnect(2000);
-        ESP_LOGI(TAG, "Emergency reconnect %s", ok ? "SUCCESS" : "FAILED");
+        int64_t t0 = esp_timer_get_time();
+        ESP_LOGW(TAG, "WS down. Holding command for link (max %d ms)...", WAKE_LINK_WAIT_MS);
+        bool ok = ws_.wait_connected(WAKE_LINK_WAIT_MS);
+        ESP_LOGI(TAG, "Link %s after %lld ms", ok ? "ready" : "NOT ready",
+                 (long long)((esp_timer_get_time() - t0) / 1000));
     }
 
-    /* 提示音 */
-    send_ack_();
+    /* 提示音（排入 ACK Task 即返回，不等待 Server 回應） */
+    StreamTrace trace = {};
+    trace.trace_id = req.trace_id;
+    trace.wake_us  = req.wake_us;
+    trace.session_us = session_us;
+    trace.wake_threshold = req.tuning.wake_threshold;
+    trace.vad_threshold  = req.tuning.vad_threshold;
+    trace.tuning_version = req.tuning.version;
+#if MODEL_PARTITION
+    trace.model_generation = model_.generation();
+#endif
+    ack_.notify(req.confidence);
+    trace.ack_us   = esp_timer_get_time();
+
+    /* LED 閃爍 3 次（樣式由 esp_timer 推進，直接開始串流） */
+    publish_state_(UI_LISTENING);
+
+    /* 提示期間指令已在裝置端處理：不必串流（回應通知已在 action_q_） */
+    if (local_handled_.load(std::memory_order_acquire)) {
+        ESP_LOGI(TAG, ">>> Handled on device (command / cancel word), stream skipped");
+        xQueueReceive(action_q_, &reply, 0);
+        return;
+    }
 
-    /* LED 閃爍 3 次 */
-    ui_publish_state(UI_LISTENING);
-    hw_.blink_led(3, 100, 100);
+    reply = stream_command_(req, &trace);
+
+#if FOLLOWUP_WINDOW_MS > 0
+    /* 追問視窗：動作完成後 session 不結束（WiFi 仍為低延遲），有人接著說話就直接串流下一句 */
+    uint32_t previous = req.trace_id;
+    for (int turn = 0; reply == SERVER_MSG_ACTION && turn < FOLLOWUP_MAX_TURNS; turn++) {
+        WakeRequest next;
+        if (!wait_followup_(&next)) break;
+        xQueueReset(action_q_);
+        streamer_.reset_cancel();
+        publish_state_(UI_LISTENING);
+
+        StreamTrace followup = {};
+        followup.trace_id       = next.trace_id;
+        followup.wake_us        = next.wake_us;
+        followup.wake_threshold = next.tuning.wake_threshold;
+        followup.vad_threshold  = next.tuning.vad_threshold;
+        followup.tuning_version = next.tuning.version;
+#if MODEL_PARTITION
+        followup.model_generation = model_.generation();
+#endif
+        followup.followup_of    = previous;
+        reply    = stream_command_(next, &followup);
+        previous = next.trace_id;
+    }
+#endif
+}
 
+ServerActionType WakeWordDetector::stream_command_(const WakeRequest &req, StreamTrace *trace)
+{
     /* 串流音訊 */
-    ESP_LOGI(TAG, ">>> Starting 3-sec audio stream...");
-    ui_publish_state(UI_THINKING);
-    bool ok = streamer_.stream(AUDIO_SAMPLES_3S, confidence);
+    ESP_LOGI(TAG, ">>> Starting audio stream (%s)...",
+             STREAM_ENDPOINTING ? "until end of speech" : "3 sec");
+    publish_state_(UI_THINKING);
+    bool ok = streamer_.stream(STREAM_COMMAND_SAMPLES, req.confidence, req.wake_pos,
+                               req.noise_floor, trace);
+
+    if (!ok) {
+        ESP_LOGE(TAG, ">>> Stream FAILED");
+        publish_state_(UI_ERROR);
+        vTaskDelay(pdMS_TO_TICKS(500));
+        publish_state_(UI_IDLE);
+        return SERVER_MSG_UNKNOWN;
+    }
+
+    /* 等待 Server 回應（action / play 到達時 on_server_action 已切到 UI_ACTION）。
+     * Server 仍在回報進度（progress）時延長等待：逾時從最近一個事件起算，而非固定從串流結束 */
+    ESP_LOGI(TAG, ">>> Stream OK");
+    int64_t wait_from = esp_timer_get_time();
+    last_progress_us_.store(0, std::memory_order_relaxed);
+    reply_wait_us_.store(wait_from, std::memory_order_release);
+    if (!trace->followup_of) account_latency_(*trace);
+    ServerActionType reply;
+    int64_t deadline = wait_from + (int64_t)SERVER_ACTION_WAIT_MS * 1000;
+    for (;;) {
+        int64_t remaining = deadline - esp_timer_get_time();
+        if (remaining > 0 && xQueueReceive(action_q_, &reply, pdMS_TO_TICKS(remaining / 1000 + 1)) == pdTRUE) {
+            reply_wait_us_.store(0, std::memory_order_release);
+            ESP_LOGI(TAG, ">>> Server replied (type=%d)", (int)reply);
+            if (reply == SERVER_MSG_AUDIO_CANCEL) publish_state_(UI_IDLE);
+            return reply;
+        }
+        int64_t extended = last_progress_us_.load(std::memory_order_acquire) + (int64_t)SERVER_ACTION_WAIT_MS * 1000;
+        if (extended <= deadline) break;
+        deadline = extended;
+        publish_state_(UI_THINKING);   // eye_ui 的 THINKING 逾時重新起算
+    }
+    reply_wait_us_.store(0, std::memory_order_release);
+    ESP_LOGW(TAG, ">>> No server reply within %d ms of the last update", SERVER_ACTION_WAIT_MS);
+    publish_state_(UI_IDLE);
+    return SERVER_MSG_UNKNOWN;
+}
 
-    if (ok)  ESP_LOGI(TAG, ">>> Stream OK");
-    else     { ESP_LOGE(TAG, ">>> Stream FAILED"); ui_publish_state(UI_ERROR); }
+void WakeWordDetector::account_latency_(const StreamTrace &trace)
+{
+    /* 各段的起點與終點（任一點未發生就不計入：例如 UDP 全部送不出） */
+    const int64_t points[WL_STAGE_COUNT + 1] = {
+        trace.wake_us, trace.session_us, trace.ack_us, trace.stream_start_us,
+        trace.first_frame_us, trace.first_sent_us,
+    };
+    uint32_t stage_us[WL_STAGE_COUNT];
+    for (int s = 0; s <= WL_STAGE_COUNT; s++) {
+        if (points[s] <= 0) return;
+    }
+    for (int s = 0; s < WL_STAGE_COUNT; s++) {
+        int64_t d    = points[s + 1] - points[s];
+        stage_us[s] = d > 0 ? (uint32_t)d : 0;
+    }
+
+    WakeLatencyReport rep;
+    bool changed = slo_.record(stage_us, &rep);
+#if TELEMETRY_HTTP
+    telemetry_publish_latency(rep);
+#endif
+    ESP_LOGI(TAG, "Wake-to-first-byte %lld ms (queue %lu / link %lu / start %lu / capture %lu / send %lu us)",
+             (long long)((trace.first_sent_us - trace.wake_us) / 1000),
+             (unsigned long)stage_us[WL_QUEUE], (unsigned long)stage_us[WL_LINK],
+             (unsigned long)stage_us[WL_START], (unsigned long)stage_us[WL_CAPTURE],
+             (unsigned long)stage_us[WL_SEND]);
+    if (!changed) return;
 
-    vTaskDelay(pdMS_TO_TICKS(500));
-    ui_publish_state(UI_IDLE);
+    const char *worst = WakeLatencySlo::stage_name(rep.worst);
+    if (rep.degraded) {
+        ESP_LOGW(TAG, "Wake latency SLO missed: p90 %lu ms > %d ms over %u wakes (worst stage: %s)",
+                 (unsigned long)rep.p90_ms, WAKE_SLO_MS, (unsigned)rep.samples, worst);
+    } else {
+        ESP_LOGI(TAG, "Wake latency back within SLO: p90 %lu ms", (unsigned long)rep.p90_ms);
+    }
+    ui_status_publish_hint(rep.degraded ? "slow" : nullptr);
+
+    char json[448];
+    int  len = snprintf(json, sizeof(json),
+                        "{\"device_id\":\"%s\",\"timestamp\":%lld,\"type\":\"latency_slo\","
+                        "\"payload\":{\"state\":\"%s\",\"samples\":%u,\"slo_ms\":%d,"
+                        "\"p50_ms\":%lu,\"p90_ms\":%lu,\"max_ms\":%lu,\"stage\":\"%s\",\"stages_p90_ms\":{",
+                        DEVICE_ID, (long long)(esp_timer_get_time() / 1000),
+                        rep.degraded ? "degraded" : "ok", (unsigned)rep.samples, WAKE_SLO_MS,
+                        (unsigned long)rep.p50_ms, (unsigned long)rep.p90_ms, (unsigned long)rep.max_ms, worst);
+    for (int s = 0; s < WL_STAGE_COUNT && len < (int)sizeof(json); s++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s\"%s\":%lu", s ? "," : "",
+                        WakeLatencySlo::stage_name((WakeLatencyStage)s), (unsigned long)rep.stage_p90_ms[s]);
+    }
+    if (len < (int)sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "}}}");
+    if (len >= (int)sizeof(json)) return;
+    if (!ws_.send_text(json, len, pdMS_TO_TICKS(TELEMETRY_SEND_TIMEOUT_MS))) {
+        ESP_LOGW(TAG, "latency_slo report not sent");
+    }
 }
 
 /* ------------------------------------------------------------------ */
@@ -107,59 +924,437 @@ void WakeWordDetector::run()
            (int)(EI_CLASSIFIER_RAW_SAMPLE_COUNT * 1000 / EI_CLASSIFIER_FREQUENCY),
            EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW);
     printf("Threshold: %.2f\r\n", (float)EI_CLASSIFIER_THRESHOLD);
-    printf("VAD: FFT Energy Threshold = %.0f\r\n\r\n", FFT_ENERGY_THRESHOLD);
+    printf("VAD: %s engine, Energy Threshold = %.0f%s\r\n\r\n",
+           VAD_ENGINE == VAD_ENGINE_BIQUAD ? "biquad" : VAD_ENGINE == VAD_ENGINE_Q15 ? "Q15 FFT" : "FFT",
+           FFT_ENERGY_THRESHOLD,
+           VAD_ADAPTIVE_THRESHOLD ? " (initial, adaptive)" : "");
 
     run_classifier_init();
 
+#if VAD_FFT_BENCHMARK
+    vad_.run_benchmark(50);
+#endif
+
     printf("Warming up microphone...\r\n");
     for (int i = 0; i < 8; i++) {
-        audio_.read_audio_slice(slice_buf_, EI_CLASSIFIER_SLICE_SIZE, nullptr);
+        audio_.acquire_slice(AUDIO_READER_DETECTOR, EI_CLASSIFIER_SLICE_SIZE, &slice_);
     }
-    printf("Started.\r\n");
-    ui_publish_state(UI_IDLE);
+#if MODEL_WEIGHT_PIN
+    pin_weights_();   // 校正量的是常駐後的耗時
+#endif
+    calibrate_inference_();
+#if INFER_GOVERNOR
+    governor_.configure((uint32_t)((int64_t)EI_CLASSIFIER_SLICE_SIZE * 1000000 / EI_CLASSIFIER_FREQUENCY),
+                        window_stride_, EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW / INFER_GOV_MIN_DECISIONS,
+                        STREAM_NOISE_SUPPRESS);
+#endif
+#if SHARED_SPECTRUM
+    shared_spectrum_ = init_shared_spectrum_();
+#endif
+    resolve_wake_labels_();
+#if WAKE_TUNING_ENABLE || PERF_CONSOLE
+    tuning_q_ = RTOS_QUEUE_CREATE(1, sizeof(WakeTuning));
+#endif
+#if CONTROL_WORDS
+    repeat_q_ = RTOS_QUEUE_CREATE(1, sizeof(RepeatAction));
+#endif
+#if WAKE_TUNING_ENABLE
+    WakeTuning stored;
+    if (wake_tuning_load(&stored)) apply_tuning_(stored);
+#endif
+#if MODEL_PARTITION
+    model_.init();
+    apply_model_();   // 映像建議的門檻優先於舊權重時期的 wake_tuning
+#endif
+    start_session_task_();
+    profiler_.start();
+    printf("Started (wake word live at %lld ms).\r\n", (long long)(esp_timer_get_time() / 1000));
+    publish_state_(UI_IDLE);
 
     ei_impulse_result_t result = {};
+    uint32_t slice_count   = 0;
+    int64_t  last_slice_us = esp_timer_get_time();
+    uint32_t max_slice_us  = 0;
+#if VAD_GATE_INFERENCE
+    uint32_t silent_slices = 0;     // VAD 連續無語音切片數
+    uint32_t gated_slices  = 0;     // 統計區間內略過推論的切片數
+    bool     gated         = false;
+#endif
+    int      stride_phase  = 0;
+    uint32_t speech_slices = 0;     // VAD 連續語音切片數（鏈路預熱）
+    bool     session_was_busy = false;
+    float    ui_confidence = 0.0f;  // 最近一次推論的最高信心值（UI telemetry）
+    int64_t  last_speech_us = last_slice_us;   // 最近一個 VAD 語音切片（動態調頻 / 低功耗聆聽）
+#if LOW_POWER_LISTEN
+    uint32_t lp_entries = 0, lp_wakes = 0;     // 統計區間內進入 / 離開低功耗聆聽次數
+#endif
+#if CLIP_RECORDER
+    float    band_peak = 0.0f;      // 喚醒詞信心值進入漏喚醒區間後的峰值（0 = 不在區間內）
+#endif
+
+    /* 推論期間 CPU 全速；VAD 閘控時才撤銷 */
+    power_hold(PWR_HOLD_INFERENCE, true);
 
     while (1) {
-        float rms = 0.0f, fft_energy = 0.0f;
+        float rms = 0.0f;
+
+        WakeTuning tuning;
+        if (tuning_q_ && xQueueReceive(tuning_q_, &tuning, 0) == pdTRUE) apply_tuning_(tuning);
+        apply_model_();
 
-        if (!audio_.read_audio_slice(slice_buf_, EI_CLASSIFIER_SLICE_SIZE, nullptr)) {
+        int64_t wait_us = esp_timer_get_time();
+        if (!audio_.acquire_slice(AUDIO_READER_DETECTOR, EI_CLASSIFIER_SLICE_SIZE, &slice_)) {
             vTaskDelay(pdMS_TO_TICKS(100));
             continue;
         }
 
-        bool vad_passed = vad_.detect(slice_buf_, EI_CLASSIFIER_SLICE_SIZE,
-                                      &rms, &fft_energy);
+        /* 切片時序：理想值 = EI_CLASSIFIER_SLICE_SIZE / SAMPLE_RATE */
+        int64_t now_us = esp_timer_get_time();
+        profiler_.record(PROF_I2S_WAIT, (uint32_t)(now_us - wait_us));
+        profiler_.record(PROF_CONVERT, audio_.take_convert_us());
+        uint32_t slice_us = (uint32_t)(now_us - last_slice_us);
+        if (slice_us > max_slice_us) max_slice_us = slice_us;
+        last_slice_us = now_us;
+        if (++slice_count % PRINT_STATS_INTERVAL == 0) {
+            AudioCaptureStats cs = audio_.stats();
+            ESP_LOGI(TAG, "Timing: slice max=%lu us, DMA gap max=%lu us, block cost max=%lu us, blocks=%lu, errors=%lu",
+                     (unsigned long)max_slice_us, (unsigned long)cs.max_gap_us,
+                     (unsigned long)cs.max_isr_us, (unsigned long)cs.blocks,
+                     (unsigned long)cs.read_errors);
+            /* 各消費者落後擷取端的程度（串流游標的峰值由 AudioStreamer 每次串流重設） */
+            AudioRingBuffer::ReaderStats det = audio_.take_reader_stats(AUDIO_READER_DETECTOR);
+            AudioRingBuffer::ReaderStats str = audio_.ring().reader_stats(AUDIO_READER_STREAMER);
+            ESP_LOGI(TAG, "Ring lag: detector max=%lu lost=%lu, streamer max=%lu lost=%lu, held drops=%lu",
+                     (unsigned long)det.max_lag, (unsigned long)det.overruns,
+                     (unsigned long)str.max_lag, (unsigned long)str.overruns,
+                     (unsigned long)audio_.ring().held_drops());
+#if AUDIO_BEAMFORM
+            ESP_LOGI(TAG, "Beam steering: %ld samples (%s)", (long)cs.beam_delay,
+                     cs.beam_delay > 0 ? "left" : cs.beam_delay < 0 ? "right" : "broadside");
+#endif
+#if VAD_GATE_INFERENCE
+            ESP_LOGI(TAG, "Inference gated on %lu/%d slices", (unsigned long)gated_slices,
+                     PRINT_STATS_INTERVAL);
+            gated_slices = 0;
+#endif
+#if EI_ARENA
+            EiArenaStats ea = ei_arena_stats();
+            ESP_LOGI(TAG, "EI arena: peak %lu/%lu bytes, heap fallbacks %lu",
+                     (unsigned long)ea.peak, (unsigned long)ea.capacity, (unsigned long)ea.fallbacks);
+#endif
+#if LOW_POWER_LISTEN
+            ESP_LOGI(TAG, "Low-power listen: %s, entered %lu, woke %lu, noise floor %.0f",
+                     audio_.low_power() ? "active" : "off", (unsigned long)lp_entries,
+                     (unsigned long)lp_wakes, energy_.noise_rms());
+            lp_entries = lp_wakes = 0;
+#endif
+#if WAKE_CASCADE
+            WakeCascade::Stats cas = cascade_.take_stats();
+            ESP_LOGI(TAG, "Cascade: stage1 fired %lu, stage2 ran %lu/%lu slices, confirmed %lu",
+                     (unsigned long)cas.fires, (unsigned long)cas.stage2_slices,
+                     (unsigned long)cas.slices, (unsigned long)cas.confirmed);
+#endif
+#if INFER_GOVERNOR
+            ESP_LOGI(TAG, "Inference governor: level %d/%d, stride %d, load %lu%%, steps down %lu, overruns %lu",
+                     governor_.level(), governor_.max_level(), window_stride_,
+                     (unsigned long)governor_.load_pct(), (unsigned long)governor_.steps_down(),
+                     (unsigned long)governor_.overruns());
+#endif
+            log_timing_();
+            audio_.reset_timing_peaks();
+            max_slice_us = 0;
+        }
+
+        /* session 結束：從此刻起算不應期，並清除串流期間累積的信心值 */
+        bool session_busy = session_busy_.load(std::memory_order_acquire);
+        if (session_was_busy && !session_busy) {
+            for (int i = 0; i < wake_label_count_; i++) {
+                wake_labels_[i].posterior.restart_refractory(now_us);
+            }
+        }
+        session_was_busy = session_busy;
+#if CLIP_RECORDER
+        recorder_.set_busy(session_busy);
+#endif
+
+#if LOW_POWER_LISTEN
+        if (audio_.low_power()) {
+            /* 低功耗聆聽：只做幀能量偵測；觸發（或螢幕被其他來源喚醒）時恢復全速擷取 */
+            int64_t t_lp = esp_timer_get_time();
+            bool    wake = energy_.detect(slice_) || session_busy || ui_display_is_awake();
+            profiler_.record(PROF_VAD, (uint32_t)(esp_timer_get_time() - t_lp));
+            if (!wake || !audio_.set_low_power(false)) continue;
+            lp_wakes++;
+            last_speech_us = now_us;
+            power_hold(PWR_HOLD_INFERENCE, true);
+            /* 從觸發切片往前一個模型視窗重新走完整管線（環形緩衝一直維持 SAMPLE_RATE），喚醒詞開頭不遺失 */
+            audio_.rewind_reader(AUDIO_READER_DETECTOR, slice_.pos,
+                                 (EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW - 1) * EI_CLASSIFIER_SLICE_SIZE);
+#if SHARED_SPECTRUM
+            if (shared_spectrum_) frontend_.reset();
+#endif
+            ESP_LOGD(TAG, "Energy %.0f over noise floor %.0f, full pipeline resumed",
+                     energy_.last_peak(), energy_.noise_rms());
+            continue;
+        }
+#endif
+
+        vad_.record_agc_gain(audio_.agc_gain());
+        int64_t   t_vad = esp_timer_get_time();
+#if SHARED_SPECTRUM
+        /* 共用頻譜：MFCC 幀與 VAD 頻帶能量出自同一次 FFT（每切片執行，耗時計入 vad 階段） */
+        VadResult vad;
+        if (shared_spectrum_) {
+            size_t frames = frontend_.process(slice_, spectrum_energy_, SpectralFrontend::MAX_SLICE_FRAMES, &rms);
+            vad = vad_.detect_energies(spectrum_energy_, frames);
+        } else {
+            vad = vad_.detect(slice_, &rms);
+        }
+#else
+        VadResult vad   = vad_.detect(slice_, &rms);
+#endif
+        bool vad_passed = vad.speech;
+        TRACE_POINT(TP_VAD, vad_passed);
+        if (vad_passed) last_speech_us = now_us;
+        power_hold(PWR_HOLD_SPEECH, now_us - last_speech_us < (int64_t)PM_SPEECH_HOLD_MS * 1000);
+        int64_t   t_ui  = esp_timer_get_time();
+        ui_telemetry_publish_audio(rms, vad.peak_energy, vad.threshold, ui_confidence);
+#if TELEMETRY_HTTP
+        telemetry_publish_vad(vad_.stats(), tuning_.wake_threshold);
+#endif
+        if (vad_passed) ui_request_display_prewarm();   // 螢幕休眠時先喚醒面板
+        /* 持續語音、尚未喚醒：先把 WiFi / WebSocket / Server 模型熱起來（每段語音一次） */
+        speech_slices = vad_passed ? speech_slices + 1 : 0;
+#if FOLLOWUP_WINDOW_MS > 0
+        if (speech_slices == FOLLOWUP_SPEECH_SLICES &&
+            followup_armed_.exchange(false, std::memory_order_acq_rel)) {
+            on_followup_speech_();
+        }
+#endif
+        if (speech_slices == LINK_WARMUP_SPEECH_SLICES) {
+            ws_.note_activity();   // 保活回到活躍間隔；閒置斷線中則立即重連
+            if (LINK_WARMUP && !session_busy) {
+                warmup_.notify(speech_slices * EI_CLASSIFIER_SLICE_SIZE * 1000 / SAMPLE_RATE, vad.peak_energy);
+            }
+        }
+        /* 連續串流：session 進行中的音訊已由 AudioStreamer 送出，閘門視為靜音 */
+        if (CONTINUOUS_STREAM) continuous_.on_slice(slice_.pos, (uint32_t)slice_.size, vad_passed && !session_busy);
+        profiler_.record(PROF_VAD, (uint32_t)(t_ui - t_vad));
+        profiler_.record(PROF_UI, (uint32_t)(esp_timer_get_time() - t_ui));
+
+#if LOW_POWER_LISTEN
+        /* 螢幕休眠且長時間無語音：I2S 降速單聲道，VAD / 模型停止（CPU 由 esp_pm 降頻） */
+        if (!session_busy && !ui_display_is_awake() && !continuous_.enabled() &&
+            now_us - last_speech_us >= (int64_t)LOW_POWER_ENTER_MS * 1000 && audio_.set_low_power(true)) {
+            energy_.reset(vad_.stats().rms_avg);
+            power_hold(PWR_HOLD_INFERENCE, false);
+            for (int i = 0; i < wake_label_count_; i++) wake_labels_[i].posterior.clear();
+            ui_confidence = 0.0f;
+            lp_entries++;
+            ESP_LOGD(TAG, "Low-power listen entered (noise floor %.0f)", energy_.noise_rms());
+            continue;
+        }
+#endif
+
+#if WAKE_CASCADE
+        /* 第一階段（VAD 語音幀比例）常駐；未觸發時第二階段不執行 */
+        int64_t t_s1   = esp_timer_get_time();
+        bool    stage2 = cascade_.update(vad);
+        profiler_.record(PROF_STAGE1, (uint32_t)(esp_timer_get_time() - t_s1));
+#endif
+
+        /* 回放與推論期間持有 EI runtime（tflite arena / EI_ARENA），與 console bench 互斥；
+         * PERF_CONSOLE=0 時為空物件。持有到本切片結束 */
+        EiRuntimeGuard ei_guard;
+
+#if VAD_GATE_INFERENCE
+        /* 長時間安靜時略過 MFCC + NN；恢復時先回放歷史切片，模型視窗不缺上下文 */
+        silent_slices = vad_passed ? 0 : silent_slices + 1;
+#if WAKE_CASCADE
+        bool idle = !stage2;
+#else
+        bool idle = silent_slices > VAD_GATE_SILENT_SLICES;
+#endif
+        power_hold(PWR_HOLD_INFERENCE, !idle);
+        if (idle) {
+            if (!gated) {
+                ESP_LOGD(TAG, "Stage 2 idle, inference gated");
+                for (int i = 0; i < wake_label_count_; i++) wake_labels_[i].posterior.clear();
+                ui_confidence = 0.0f;
+            }
+            gated = true;
+            gated_slices++;
+            continue;
+        }
+        bool replay = gated && window_stride_ == 1;
+#if SHARED_SPECTRUM
+        replay = replay && !shared_spectrum_;   // 共用頻譜的特徵矩陣閘控期間仍持續更新，不需回放
+#endif
+        if (replay) {
+            int n = warm_up_();
+            stride_resync_ = false;
+            ESP_LOGD(TAG, "Voice resumed, replayed %d slices", n);
+            if (!audio_.slice_valid(slice_)) {
+                ESP_LOGW(TAG, "Slice overwritten during warm-up, skipped");
+                audio_.sync_reader(AUDIO_READER_DETECTOR);
+#if INFER_GOVERNOR
+                if (governor_.on_overrun()) apply_degrade_();
+#endif
+                continue;
+            }
+        }
+        gated = false;
+#endif
+#if INFER_GOVERNOR
+        /* 降級解除、回到連續模式：EI 連續特徵視窗停在降級前，先回放歷史切片（共用頻譜不需要） */
+        if (stride_resync_) {
+            stride_resync_ = false;
+            bool resync = window_stride_ == 1;
+#if SHARED_SPECTRUM
+            resync = resync && !shared_spectrum_;
+#endif
+            if (resync) {
+                warm_up_();
+                if (!audio_.slice_valid(slice_)) {
+                    ESP_LOGW(TAG, "Slice overwritten during resync, skipped");
+                    audio_.sync_reader(AUDIO_READER_DETECTOR);
+                    if (governor_.on_overrun()) apply_degrade_();
+                    continue;
+                }
+            }
+        }
+#endif
 
         signal_t signal;
         signal.total_length = EI_CLASSIFIER_SLICE_SIZE;
         signal.get_data     = &WakeWordDetector::ei_get_data_;
 
-        EI_IMPULSE_ERROR res = run_classifier_continuous(&signal, &result, false);
+        EI_IMPULSE_ERROR res;
+        int64_t  t0 = esp_timer_get_time();
+        uint32_t c0 = esp_cpu_get_cycle_count();
+#if SHARED_SPECTRUM
+        if (shared_spectrum_) {
+            /* 退回模式同樣每 window_stride_ 個切片推論一次；特徵矩陣未滿（開機第一秒）則略過 */
+            if (++stride_phase < window_stride_ || !frontend_.window_full()) continue;
+            stride_phase = 0;
+            TRACE_POINT(TP_INFER_START, 0);
+            res = classify_shared_(&result);
+        } else
+#endif
+        if (window_stride_ == 1) {
+            TRACE_POINT(TP_INFER_START, 0);
+            res = run_classifier_continuous(&signal, &result, false);
+        } else {
+            /* 退回模式：每 window_stride_ 個切片對最近 1 秒視窗做一次完整推論 */
+            if (++stride_phase < window_stride_) continue;
+            stride_phase = 0;
+            uint32_t win_pos = slice_.pos + EI_CLASSIFIER_SLICE_SIZE - EI_CLASSIFIER_RAW_SAMPLE_COUNT;
+            if (!audio_.slice_at(win_pos, EI_CLASSIFIER_RAW_SAMPLE_COUNT, &slice_)) continue;
+            signal.total_length = EI_CLASSIFIER_RAW_SAMPLE_COUNT;
+            TRACE_POINT(TP_INFER_START, 0);
+            res = run_classifier(&signal, &result, false);
+        }
+        TRACE_POINT(TP_INFER_END, res);
         if (res != EI_IMPULSE_OK) {
             printf("ERR: Inference failed (%d)\r\n", res);
             continue;
         }
+        uint32_t cycles = esp_cpu_get_cycle_count() - c0;   // 同核量測（推論 Task 已綁核）
+        record_timing_(result.timing.dsp_us, result.timing.classification_us,
+                       esp_timer_get_time() - t0, cycles);
+        profiler_.record(PROF_MFCC, (uint32_t)result.timing.dsp_us);
+        profiler_.record(PROF_NN, (uint32_t)result.timing.classification_us);
+        ui_perf_publish_infer_us((uint32_t)(result.timing.dsp_us + result.timing.classification_us));
+        if (!audio_.slice_valid(slice_)) {
+            /* 推論過慢，切片在讀取期間已被覆寫 */
+            ESP_LOGW(TAG, "Slice overwritten during inference, result discarded");
+            audio_.sync_reader(AUDIO_READER_DETECTOR);
+#if INFER_GOVERNOR
+            if (governor_.on_overrun()) apply_degrade_();
+#endif
+            continue;
+        }
+#if INFER_GOVERNOR
+        /* 本切片開始處理（切片就緒）到推論結束，對照 stride 個切片週期 */
+        if (governor_.on_inference((uint32_t)(esp_timer_get_time() - now_us))) {
+            apply_degrade_();
+        } else {
+            profiler_.set_degrade(governor_.level(), window_stride_, governor_.secondary_enabled(),
+                                  governor_.load_pct(), governor_.steps_down(), governor_.overruns());
+        }
+#endif
 
-        float confidence = 0.0f;
-        for (uint16_t i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) {
-            if (strcmp(ei_classifier_inferencing_categories[i], "heymiaomiao") == 0) {
-                confidence = result.classification[i].value;
-
-#if VAD_FFT_DEBUG
-                if (confidence > 0.3f) {
-                    printf("[DEBUG] Conf: %.3f RMS: %.2f FFT: %.2f(>%.0f?) Pass: %s\n",
-                           confidence, rms, fft_energy, FFT_ENERGY_THRESHOLD,
-                           vad_passed ? "YES" : "NO");
+        int64_t now = esp_timer_get_time();
+        ui_confidence = 0.0f;
+        WakeLabel *fired   = nullptr;   // 本切片觸發的類別中平滑信心值最高者
+        bool       handled = local_handled_.load(std::memory_order_relaxed);
+        for (int i = 0; i < wake_label_count_; i++) {
+            WakeLabel &w     = wake_labels_[i];
+            float confidence = result.classification[w.index].value;
+            /* 喚醒詞 / 重複詞只在閒置時受理；指令類別只在喚醒後的指令視窗內、取消詞在整個 session 內受理 */
+            bool  armed;
+            switch (w.spec->action) {
+            case WAKE_ACTION_COMMAND: armed = session_busy && now <= command_until_us_ && !handled; break;
+            case WAKE_ACTION_CANCEL:  armed = session_busy && !handled; break;
+            default:                  armed = !session_busy; break;
+            }
+            bool  wake       = w.posterior.update(confidence, vad_passed && armed, now);
+            if (w.posterior.smoothed() > ui_confidence) ui_confidence = w.posterior.smoothed();
+#if CLIP_RECORDER
+            /* 漏喚醒候選：信心值進入 [CLIP_BAND_LOW, 門檻) 後未喚醒就回落，片段結束於回落的切片 */
+            if (w.spec->action == WAKE_ACTION_STREAM && armed) {
+                float s = w.posterior.smoothed();
+                if (wake) {
+                    band_peak = 0.0f;
+                } else if (s >= CLIP_BAND_LOW) {
+                    if (s > band_peak) band_peak = s;
+                } else if (band_peak > 0.0f) {
+                    recorder_.on_near_miss(slice_.pos + EI_CLASSIFIER_SLICE_SIZE, band_peak);
+                    band_peak = 0.0f;
                 }
+            }
 #endif
 
-                if (confidence >= EI_CLASSIFIER_THRESHOLD && vad_passed) {
-                    vad_.record_ml_trigger();
-                    on_wake_word_detected_(confidence);
-                }
+#if VAD_FFT_DEBUG || PERF_CONSOLE
+            if (confidence > 0.3f && vad_debug_.load(std::memory_order_relaxed)) {
+                printf("[DEBUG] %s Conf: %.3f (smoothed %.3f) RMS: %.2f FFT peak: %.2f(>%.0f?) speech: %d/%d Pass: %s\n",
+                       w.spec->label, confidence, w.posterior.smoothed(), rms, vad.peak_energy, vad.threshold,
+                       vad.voiced_frames, vad.frames, vad_passed ? "YES" : "NO");
+            }
+#endif
+
+            if (wake && (!fired || w.posterior.smoothed() > fired->posterior.smoothed())) fired = &w;
+        }
+
+        /* 發音相近的類別同時觸發時只執行最有把握的一個（其餘已一併進入各自的不應期） */
+        if (fired) {
+            WakeLabel &w = *fired;
+            vad_.record_ml_trigger();
+            switch (w.spec->action) {
+            case WAKE_ACTION_LOG:
+                ESP_LOGI(TAG, "Wake label '%s' (conf=%.3f), log only", w.spec->label, w.posterior.smoothed());
+                break;
+            case WAKE_ACTION_COMMAND:
+                on_local_command_(w);
+                break;
+            case WAKE_ACTION_CANCEL:
+                on_cancel_word_(w);
+                break;
+            case WAKE_ACTION_REPEAT:
+                on_repeat_word_(w);
+                break;
+            case WAKE_ACTION_STREAM:
+                ESP_LOGI(TAG, "Wake label '%s'", w.spec->label);
+                if (!on_wake_word_detected_(w.posterior.smoothed())) break;
+#if VAD_GATE_INFERENCE
+                silent_slices = 0;
+#endif
+#if WAKE_CASCADE
+                cascade_.record_confirmed();
+#endif
                 break;
             }
         }
+        profiler_.record(PROF_POST, (uint32_t)(esp_timer_get_time() - now));   // 含喚醒時的 session 排入
     }
 }
@@ -7,22 +7,70 @@
  *
  * 職責：
  *   - 持續讀取音訊切片並執行 Edge Impulse 推論
- *   - 整合 FFT VAD 前置過濾
- *   - 偵測到喚醒詞後協調 HardwareController / AudioStreamer
+ *   - 整合 FFT VAD 前置過濾（持續語音時先行預熱鏈路，LINK_WARMUP）
+ *   - 偵測到喚醒詞後交由 session Task 協調 HardwareController / AudioStreamer，
+ *     串流期間推論持續進行（session 進行中不再觸發新的喚醒）
+ *   - 喚醒後的指令類別高信心命中時直接發佈 MQTT 並中止串流（LOCAL_CMD_ENABLE）
+ *   - 套用 Server 依誤喚醒率下發的門檻（wake_tuning，NVS 持久化，開機載入）
+ *   - 動作完成後的追問視窗：VAD 偵測到語音即直接串流下一句，不需再說喚醒詞
  * ============================================================ */
 
 #include <stddef.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "audio_capture.h"
+#include "audio_player.h"
 #include "vad.h"
+#include "spectral_frontend.h"
+#include "energy_detector.h"
 #include "websocket_client.h"
+#include "wifi_manager.h"
+#include "wake_ack_client.h"
+#include "link_warmup.h"
+#include "continuous_streamer.h"
+#include "mqtt_command_client.h"
 #include "hardware_controller.h"
 #include "audio_streamer.h"
+#include "server_action_queue.h"
+#include "posterior_filter.h"
+#include "wake_tuning.h"
+#include "stage_profiler.h"
+#include "wake_latency_slo.h"
+#include "inference_governor.h"
+#include "wake_cascade.h"
+#include "clip_recorder.h"
+#include "model_store.h"
+#include "model-parameters/model_metadata.h"
+#if SHARED_SPECTRUM
+#include "edge-impulse-sdk/classifier/ei_classifier_types.h"
+#endif
 
-/**
- * 伺服器動作回調（由 main.cpp 注入）。
- * @param json_str  NULL-terminated JSON 字串
- */
-typedef void (*server_action_cb_t)(const char *json_str);
+/* int8 量化的 EON 編譯模型才能由 Q15 前端直接寫入輸入張量 */
+#if SHARED_SPECTRUM && SHARED_SPECTRUM_Q15 && EI_CLASSIFIER_COMPILED == 1 && \
+    EI_CLASSIFIER_QUANTIZATION_ENABLED == 1 && EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TFLITE
+#define SHARED_SPECTRUM_INT8 1
+#else
+#define SHARED_SPECTRUM_INT8 0
+#endif
+
+/* 喚醒詞觸發後的動作 */
+enum WakeAction {
+    WAKE_ACTION_STREAM = 0,   // 喚醒提示 + 串流指令音訊至 Server
+    WAKE_ACTION_LOG    = 1,   // 僅記錄（例如新關鍵字上線前的現場評估）
+    WAKE_ACTION_COMMAND = 2,  // 喚醒後的指令類別：直接發佈 MQTT，略過 Server
+    WAKE_ACTION_CANCEL = 3,   // session 中的取消詞：立即中止串流 / 回應等待並回到待機
+    WAKE_ACTION_REPEAT = 4,   // 待機時的重複詞：在本機重播上一個動作
+};
+
+/* 喚醒詞規格（wake_word_detector.cpp 的 kWakeLabels 表） */
+struct WakeLabelSpec {
+    const char *label;        // EI 模型類別名稱
+    float       threshold;    // 平滑後的觸發門檻
+    int         cooldown_ms;  // 觸發後的不應期
+    WakeAction  action;
+    LocalCommandId command;   // WAKE_ACTION_COMMAND 時的指令（其餘為 LOCAL_CMD_NONE）
+};
 
 class WakeWordDetector {
 public:
@@ -32,41 +80,255 @@ public:
      * @param ws      已初始化的 WebSocketClient
      * @param hw      已初始化的 HardwareController
      * @param streamer 已初始化的 AudioStreamer
+     * @param wifi    已初始化的 WifiManager（session 期間切換低延遲省電模式）
+     * @param mqtt    MqttCommandClient（裝置端指令直連；未啟動時指令類別退回 Server 路徑）
+     * @param player  AudioPlayer（喚醒提示音於本機播放；SPEAKER_ENABLE=0 時不動作）
      */
     WakeWordDetector(AudioCapture       &audio,
                      VAD                &vad,
                      WebSocketClient    &ws,
                      HardwareController &hw,
-                     AudioStreamer      &streamer);
+                     AudioStreamer      &streamer,
+                     WifiManager        &wifi,
+                     MqttCommandClient  &mqtt,
+                     AudioPlayer        &player);
 
     /**
-     * 設定伺服器動作回調（在 run() 前呼叫）。
+     * 設定伺服器動作回調（在 run() 前呼叫；於 ServerActionQueue worker Task 內執行）。
      */
     void set_server_action_cb(server_action_cb_t cb) { on_server_action_ = cb; }
 
+    /**
+     * Server 動作進入點（由 ServerActionQueue worker Task 呼叫）：
+     * 驅動 UI_ACTION（audio_cancel 則中止串流）、結束 session 的回應等待，
+     * wake_tuning 則寫入 NVS 並交給推論 Task 套用，再交給 set_server_action_cb 的回調。
+     */
+    void on_server_action(const ServerAction &action);
+
     /**
      * 啟動推論迴圈（此函式不會返回）。
      * 設計為在獨立 FreeRTOS task 中執行。
      */
     void run();
 
+    /* ---------- perf console（PERF_CONSOLE） ---------- */
+
+    /** 各階段耗時統計（console `stats` 讀取目前區間） */
+    StageProfiler &profiler() { return profiler_; }
+
+    /** 目前生效的門檻（推論 Task 寫入，其他 Task 讀取僅供顯示） */
+    WakeTuning tuning() const { return tuning_; }
+
+    /**
+     * 暫時覆寫門檻（console `set threshold`）：推論 Task 於下一個切片套用，不寫入 NVS，
+     * 重開機或 Server 下一次 wake_tuning 即恢復。
+     * @return false = 數值無效
+     */
+    bool override_tuning(float wake_threshold, float vad_threshold);
+
+    /** 每切片 VAD / 信心值除錯輸出的執行期開關（初始值 VAD_FFT_DEBUG） */
+    void set_vad_debug(bool on) { vad_debug_.store(on, std::memory_order_relaxed); }
+    bool vad_debug() const { return vad_debug_.load(std::memory_order_relaxed); }
+
 private:
     AudioCapture       &audio_;
     VAD                &vad_;
     WebSocketClient    &ws_;
     HardwareController &hw_;
     AudioStreamer       &streamer_;
+    WifiManager         &wifi_;
+    MqttCommandClient   &mqtt_;
+    WakeAckClient       ack_;      // 喚醒提示音請求（ACK Task，不阻塞 session）
+    LinkWarmup          warmup_;   // VAD 上升緣的推測性鏈路預熱（預熱 Task）
+    ContinuousStreamer  continuous_; // Server 端喚醒的連續串流（Server 以 continuous 開啟）
+    StageProfiler       profiler_; // 每切片各階段耗時，定期以 telemetry 上報
+    WakeLatencySlo      slo_;      // 喚醒 → 第一個音訊 byte 的延遲 SLO（session Task 專用）
+    WakeCascade         cascade_;  // 兩階段喚醒的第一階段（WAKE_CASCADE）
+#if CLIP_RECORDER
+    ClipRecorder        recorder_; // 誤觸發錄音（漏喚醒候選 / Server 判定的誤喚醒）
+#endif
+#if MODEL_PARTITION
+    ModelStore          model_;    // model 分區的權重映像（Server model_update 下載，推論 Task 換綁）
+#endif
+#if LOW_POWER_LISTEN
+    EnergyDetector      energy_;   // 低功耗聆聽時取代 VAD / 模型的幀能量偵測
+#endif
     server_action_cb_t  on_server_action_;
 
-    /* Edge Impulse 音訊切片緩衝（靜態分配於物件內） */
-    float slice_buf_[/* EI_CLASSIFIER_SLICE_SIZE */ 4000];
+    /* 推論各階段耗時（統計區間內累計；EI 連續模式每切片只計算新切片的 MFCC 幀） */
+    struct StageTiming {
+        uint32_t runs;
+        int64_t  dsp_us, nn_us, total_us;
+        int64_t  dsp_max_us, nn_max_us, total_max_us;
+        uint64_t cycles;       // 整次推論的 CPU cycle（不受 esp_timer 解析度影響，比較記憶體配置用）
+        uint32_t cycles_max;
+    };
+    StageTiming timing_;
+
+    /* 已解析的喚醒詞：類別索引於 init 時查一次，推論迴圈不再比對字串 */
+    struct WakeLabel {
+        const WakeLabelSpec *spec;
+        uint16_t             index;       // result.classification[] 索引
+        PosteriorFilter      posterior;   // 信心值平滑 + 遲滯 + 不應期
+    };
+    WakeLabel wake_labels_[EI_CLASSIFIER_LABEL_COUNT];
+    int       wake_label_count_;
+
+    void resolve_wake_labels_();
+
+    /* Server 下發的門檻：worker Task 排入 tuning_q_（長度 1，覆寫），推論 Task 於下一個切片套用 */
+    QueueHandle_t tuning_q_;
+    WakeTuning    tuning_;       // 推論 Task 目前生效的門檻（隨 audio_start 回報）
+
+    /** 套用至 STREAM 類別的觸發門檻與 VAD 閾值下限（推論 Task 內呼叫） */
+    void apply_tuning_(const WakeTuning &t);
+
+    /** 換綁 model 分區中已驗證的新權重（推論 Task、兩次推論之間呼叫） */
+    void apply_model_();
+
+    /* 喚醒 session（獨立 Task，自 AUDIO_READER_STREAMER 游標讀取共用環形緩衝） */
+    struct WakeRequest {
+        float    confidence;
+        uint32_t wake_pos;     // 觸發切片結尾的環形緩衝位置
+        float    noise_floor;  // 偵測端 VAD 噪音底（端點偵測起始值）
+        uint32_t trace_id;     // 端到端追蹤 id（audio_start 的 trace_id）
+        int64_t  wake_us;      // 喚醒確認時間
+        WakeTuning tuning;     // 觸發時生效的門檻
+    };
+    QueueHandle_t     session_q_;
+    QueueHandle_t     action_q_;     // session 等待 Server 回應（長度 1，僅作通知）
+    std::atomic<bool> session_busy_;
+    /* Server 往返計時：串流送完的時間（0 = 未在等待回覆）與最近一個 progress 事件到達時間 */
+    std::atomic<int64_t> reply_wait_us_;
+    std::atomic<int64_t> last_progress_us_;
+
+    /* 裝置端指令（僅推論 Task 寫入；local_handled_ 供 session Task 讀取） */
+    int64_t           command_until_us_;   // 指令類別受理截止時間（喚醒時設定）
+    std::atomic<bool> local_handled_;      // 本次 session 的指令已直接發佈
+
+    /** 指令類別命中：發佈 MQTT、中止串流並比照 Server action 更新 UI；失敗回傳 false */
+    bool on_local_command_(const WakeLabel &w);
+
+    /**
+     * 發佈裝置端指令（目標為本機繼電器時不經 Broker），並填好對應的 relay_set 動作。
+     * @return false = 指令未知或 MQTT 未送出
+     */
+    bool publish_local_command_(LocalCommandId id, ServerAction *action);
+
+    /* 上一個已執行的動作（repeat 詞重播）：worker / 推論 Task 以 xQueueOverwrite 寫入，長度 1 */
+    struct RepeatAction {
+        LocalCommandId command;   // 裝置端指令（重播時重新發佈）；LOCAL_CMD_NONE = Server 動作
+        ServerAction   action;
+    };
+    QueueHandle_t repeat_q_;
+
+    /** 取消詞：中止串流（audio_end reason=user_cancel）並結束 session 的回應等待 */
+    void on_cancel_word_(const WakeLabel &w);
+
+    /** 重複詞：重播 repeat_q_ 的動作；沒有可重播的動作回傳 false */
+    bool on_repeat_word_(const WakeLabel &w);
+
+    void        start_session_task_();
+    static void session_task_entry_(void *arg);
+    void        run_session_(const WakeRequest &req);
+
+    /** 串流一句指令並等待 Server 回應；回傳回應類型（串流失敗或逾時為 SERVER_MSG_UNKNOWN） */
+    ServerActionType stream_command_(const WakeRequest &req, StreamTrace *trace);
+
+    /** 喚醒觸發的串流成功後記入延遲 SLO；狀態改變時送出 latency_slo 並切換狀態列提示 */
+    void account_latency_(const StreamTrace &trace);
+
+    /* 追問視窗：session Task 武裝，推論 Task 於 VAD 連續語音時排入 followup_q_（長度 1） */
+    QueueHandle_t     followup_q_;
+    std::atomic<bool> followup_armed_;
+
+    /** 等待追問語音（FOLLOWUP_WINDOW_MS）；false = 視窗內沒有人說話 */
+    bool wait_followup_(WakeRequest *out);
+
+    /** 推論 Task：武裝中且語音持續時提交追問請求 */
+    void on_followup_speech_();
+
+    /* 每幾個切片推論一次：1 = 連續模式（每切片）；> 1 = 退回模式，以完整 1 秒視窗推論。
+     * 開機校正決定起始值，INFER_GOVERNOR 於執行期依負載調整（僅推論 Task 讀寫） */
+    int window_stride_;
+
+    /* 執行期推論降級（推論 Task 專用） */
+    InferenceGovernor governor_;
+    bool              stride_resync_;   // 剛回到連續模式：EI 連續特徵視窗需先回放重建
+
+    /** 套用 governor_ 的新等級：stride、串流降噪、telemetry 與日誌 */
+    void apply_degrade_();
+
+    std::atomic<bool> vad_debug_;
+
+    /* 目前推論中的切片（環形緩衝零拷貝檢視，由 ei_get_data_ 按需轉 float） */
+    AudioSlice slice_;
 
     static int ei_get_data_(size_t offset, size_t length, float *out_ptr);
 
+    /**
+     * 推論閘控結束後回放 slice_ 之前的切片，重建 EI 連續特徵視窗（結果丟棄）。
+     * @return 成功回放的切片數
+     */
+    int warm_up_();
+
+    /**
+     * 開機量測連續推論耗時，超出切片週期預算時切換為退回模式（window_stride_ > 1）。
+     */
+    void calibrate_inference_();
+
+#if MODEL_WEIGHT_PIN
+    /** 最近 n 個切片連續推論的平均 NN 耗時（開機量測用，結果丟棄） */
+    uint32_t probe_nn_us_(int n);
+
+    /** 小常數張量常駐 DRAM，並量測前後的 NN 耗時（flash cache miss 代價） */
+    void pin_weights_();
+#endif
+
+#if SHARED_SPECTRUM
+    /* 共用頻譜前端：每切片一次 FFT 同時產生 MFCC 幀與 VAD 頻帶能量（開機比對通過才啟用） */
+    static constexpr int SHARED_MAF_LEN = (EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW >> 1) > 0
+                                        ? (EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW >> 1) : 1;
+    SpectralFrontend frontend_;
+    bool             shared_spectrum_;
+    float            spectrum_energy_[SpectralFrontend::MAX_SLICE_FRAMES];
+    float            features_[EI_CLASSIFIER_NN_INPUT_FRAME_SIZE];
+    float            maf_[EI_CLASSIFIER_LABEL_COUNT][SHARED_MAF_LEN];   // 同 SDK 連續模式的結果平均
+    int              maf_pos_;
+    bool             direct_input_;   // int8 EON 模型：特徵直接量化寫入輸入張量
+
+    /**
+     * 以模型的 MFCC 參數初始化前端，並對環形緩衝最近一個視窗比對 SDK extract_mfcc_features；
+     * 誤差超過 SHARED_SPECTRUM_TOLERANCE 時維持原本的 EI 連續推論 + 獨立 VAD FFT。
+     */
+    bool init_shared_spectrum_();
+
+    /** 以前端特徵執行 NN（run_inference）；timing.dsp_us 只含特徵正規化 */
+    EI_IMPULSE_ERROR classify_shared_(ei_impulse_result_t *result);
+
+#if SHARED_SPECTRUM_INT8
+    /** 確認 EON 模型的輸入 / 輸出為 int8 且大小與特徵相符（開機一次） */
+    bool probe_direct_input_();
+
+    /**
+     * 直接驅動 EON 模型：features_i8() 寫入輸入張量 → invoke → 反量化輸出，
+     * 略過 run_inference 的 float 特徵矩陣與逐值量化（每次推論的 init / reset 同 SDK）。
+     */
+    EI_IMPULSE_ERROR invoke_direct_(ei_impulse_result_t *result);
+#endif
+#endif
+
+    void record_timing_(int64_t dsp_us, int64_t nn_us, int64_t total_us, uint32_t cycles);
+    void log_timing_();
+
     /* 用於 ei_get_data_ static callback 的單例指標 */
     static WakeWordDetector *instance_;
 
-    void on_wake_word_detected_(float confidence);
+    /** 提交喚醒 session；session 進行中則忽略並回傳 false */
+    bool on_wake_word_detected_(float confidence);
+
+    /** UI 狀態事件（eye_ui）並同步 LED 樣式 */
+    void publish_state_(ui_state_t state);
 };
 
 #endif // WAKE_WORD_DETECTOR_H
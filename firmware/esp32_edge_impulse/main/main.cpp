@@ -6,71 +6,191 @@
  *
  * 架構：物件導向模組化（Phase 1-4 完成）
  *   Config / TimeManager / AudioCapture / VAD /
- *   WifiManager / WebSocketClient /
+ *   WifiManager / WebSocketClient / MqttCommandClient /
  *   HardwareController / AudioStreamer / WakeWordDetector
  */
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "sdkconfig.h"
-#include "cJSON.h"
+#include <stdio.h>
+#include <string.h>
 
 #include "Arduino.h"
 #include "eye_ui.h"
 #include "ui_state.h"
+#include "power_state.h"
+#include "trace_points.h"
 
 /* ---------- v0.8.0 模組引入 ---------- */
 #include "config.h"
+#include "rtos_alloc.h"
 #include "time_manager.h"
 #include "audio_capture.h"
+#include "audio_player.h"
 #include "vad.h"
 #include "wifi_manager.h"
 #include "websocket_client.h"
+#include "server_action_queue.h"
 #include "hardware_controller.h"
 #include "audio_streamer.h"
+#include "mqtt_command_client.h"
 #include "wake_word_detector.h"
+#include "health_monitor.h"
+#include "nvs_writer.h"
+#include "perf_console.h"
+#include "telemetry_http.h"
+#if CONFIG_ESP_MIAO_BENCHMARK
+#include "wake_benchmark.h"
+#endif
 
 static const char *TAG = "ESP-MIAO";
 
 /* ---------- 全域物件 ---------- */
 static TimeManager         g_time_mgr;
 static AudioCapture        g_audio;
+static AudioPlayer         g_player;
 static VAD                 g_vad;
 static WifiManager         g_wifi;
 static WebSocketClient     g_ws;
+static MqttCommandClient   g_mqtt;
 static HardwareController  g_hw;
 static AudioStreamer        g_streamer(g_ws, g_audio, g_time_mgr);
 static WakeWordDetector    *g_detector = nullptr;
+static HealthMonitor       g_health(g_ws);
+static TelemetryHttp       g_telemetry_http;
 
 /* ---------- 伺服器動作處理 ---------- */
-static void handle_server_action(const char *json_str)
+static ServerActionQueue   g_actions;
+
+/* WS 事件 Task：只解析與排入，不在此處理（避免阻塞 ping/pong 與收包） */
+static void post_server_action(ServerAction &action, int64_t rx_us)
 {
-    if (!json_str) return;
-    ESP_LOGI(TAG, "Server action: %s", json_str);
+    if (action.type == SERVER_MSG_TIME_SYNC) action.time_sync.rx_us = rx_us;
+    if (action.type == SERVER_MSG_PROGRESS) action.progress.rx_us = rx_us;
+
+    /* 串流續傳回覆直接交給 AudioStreamer（僅 xQueueOverwrite） */
+    if (action.type == SERVER_MSG_RESUME_ACK) {
+        g_streamer.on_resume_ack(action.resume_ack.session_id, action.resume_ack.accepted,
+                                 action.resume_ack.received_samples);
+        return;
+    }
+    g_actions.post(action);
+}
 
-    cJSON *root = cJSON_Parse(json_str);
-    if (!root) { ESP_LOGW(TAG, "Invalid JSON"); return; }
+static void handle_server_message(const char *json_str)
+{
+    int64_t rx_us = esp_timer_get_time();   // time_sync 往返的 t3 / progress 到達時間，解析前蓋章
+    ServerAction action;
+    if (server_action_parse(json_str, &action)) {
+        post_server_action(action, rx_us);
+        return;
+    }
+    /* 叢集模式：Server 依負載下發的端點清單（監督 Task 套用，這裡只複製） */
+    char uris[WS_MAX_ENDPOINTS * 128];
+    if (server_list_parse(json_str, uris, sizeof(uris))) g_ws.set_endpoints(uris);
+}
 
-    cJSON *action = cJSON_GetObjectItem(root, "action");
-    if (cJSON_IsString(action) && action->valuestring) {
-        ESP_LOGI(TAG, "Action: %s", action->valuestring);
+/* Server binary frame：下行音訊，或協商 WS_CONTROL_SUBPROTOCOL 後的控制 frame（同一組 ServerAction，不經 JSON） */
+static void handle_server_frame(const uint8_t *data, size_t len)
+{
+    /* 下行音訊（Server downlink.py）：直接解碼進 jitter buffer，不經 ServerActionQueue */
+    if (AudioPlayer::is_downlink_frame(data, len)) {
+        g_player.on_frame(data, len);
+        return;
+    }
+    int64_t rx_us = esp_timer_get_time();
+    ServerAction action;
+    if (server_action_parse_binary(data, len, &action)) post_server_action(action, rx_us);
+}
+
+/* ServerActionQueue worker Task */
+static void dispatch_server_action(const ServerAction &action)
+{
+    if (action.type == SERVER_MSG_TIME_SYNC) {
+        const auto &t = action.time_sync;
+        if (t.round_trip) g_time_mgr.on_sync_reply(t.seq, t.t0, t.t1, t.t2, t.rx_us);
+        else              g_time_mgr.sync_from_server((long)t.seconds, (int)t.ms);
+        return;
+    }
+    if (g_detector) g_detector->on_server_action(action);
+}
+
+/* WakeWordDetector 的 server action 回調：裝置端的實際動作 */
+static void apply_server_action(const ServerAction &action)
+{
+    switch (action.type) {
+        case SERVER_MSG_ACTION: {
+            const auto &a = action.action;
+            ESP_LOGI(TAG, "Action: %s target=%s value=%s", a.action, a.target, a.value);
+            g_hw.apply_action(a.action, a.target, a.value);   // 本機 LED / 繼電器；其餘目標由 Server 經 MQTT 處理
+            char status[UI_STATUS_TEXT_LEN];
+            snprintf(status, sizeof(status), "%s %s", a.action, a.target);
+            ui_status_publish_command(status, (uint32_t)(esp_timer_get_time() / 1000));
+            break;
+        }
+        case SERVER_MSG_PLAY:
+            ESP_LOGI(TAG, "Play: %s", action.play.audio);
+            break;
+        default:
+            break;
     }
-    cJSON_Delete(root);
 }
 
 /* ---------- 推論 Task wrapper ---------- */
+/* I2S 在此初始化：DMA 中斷配置在呼叫端核心，讓擷取 ISR 與推論同在 CORE_AUDIO */
 static void inference_task(void *arg)
 {
     auto *det = static_cast<WakeWordDetector *>(arg);
+    g_audio.init();
     det->run(); // 不返回
 }
 
+#if TASK_STATS_INTERVAL_S > 0
+/* ---------- Task 分工報告 ---------- */
+static void task_stats_task(void *arg)
+{
+    static char buf[TASK_STATS_BUF_LEN];
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(TASK_STATS_INTERVAL_S * 1000));
+        vTaskList(buf);
+        ESP_LOGI(TAG, "Tasks (name state prio stack num core):\n%s", buf);
+        vTaskGetRunTimeStats(buf);
+        ESP_LOGI(TAG, "CPU (name ticks %%):\n%s", buf);
+    }
+}
+#endif
+
+/* ---------- 網路啟動 Task ---------- */
+/* WiFi → WebSocket → 時間同步依序在背景完成；推論與音訊擷取不等待網路 */
+static void net_boot_task(void *arg)
+{
+    g_wifi.wait_connected(portMAX_DELAY);
+    g_ws.start();
+    g_mqtt.start();   // LOCAL_CMD_ENABLE=0 時不動作
+    ESP_LOGI(TAG, "Network up at %lld ms", (long long)(esp_timer_get_time() / 1000));
+
+    g_time_mgr.start_server_sync(g_ws);
+    g_time_mgr.init(TIME_SNTP_WAIT_S);
+    vTaskDelete(NULL);
+}
+
+#if CONFIG_ESP_MIAO_BENCHMARK
+/* ---------- Benchmark（錄音回放，不啟動 I2S / UI / 網路） ---------- */
+static void bench_task(void *arg)
+{
+    g_audio.init_replay();
+    wake_benchmark_run(g_audio, g_vad);
+}
+#endif
+
 /* ---------- app_main ---------- */
 extern "C" int app_main()
 {
+    flight_recorder_init();   // 重開機前的飛行記錄須在任何 TRACE_POINT 之前取出
     initArduino();
 
     esp_err_t ret = nvs_flash_init();
@@ -80,29 +200,55 @@ extern "C" int app_main()
     }
     ESP_ERROR_CHECK(ret);
 
+#if CONFIG_ESP_MIAO_BENCHMARK
+    RTOS_TASK_CREATE(bench_task, "bench", INFERENCE_TASK_STACK, NULL,
+                     INFERENCE_TASK_PRIO, NULL, INFERENCE_TASK_CORE);
+    return 0;
+#endif
+
+    /* 動態調頻：須在 UI / 推論 Task 宣告需求之前設定 */
+    power_state_init(PM_CPU_FREQ_MAX_MHZ, PM_CPU_FREQ_MIN_MHZ, PM_LIGHT_SLEEP);
+    trace_points_start(TRACE_TASK_PRIO, TRACE_TASK_CORE);   // 未開啟 CONFIG_ESP_MIAO_TRACE_POINTS 時不動作
+    nvs_writer_start();   // 執行期設定寫入延後到安靜時段（須在 WiFi / WebSocket 初始化之前）
+
     /* UI */
     ui_state_init();
-    eye_ui_start();
-
-    /* Display power (GPIO4) */
-    gpio_reset_pin((gpio_num_t)DISPLAY_EN_PIN);
-    gpio_set_direction((gpio_num_t)DISPLAY_EN_PIN, GPIO_MODE_OUTPUT);
-    gpio_set_level((gpio_num_t)DISPLAY_EN_PIN, 0);
+    eye_ui_start(UI_TASK_PRIO, UI_TASK_CORE);
 
-    /* 硬體 / 網路初始化 */
+    /* 硬體 / 網路初始化（WiFi 與 WebSocket 只啟動，連線由 net_boot Task 完成） */
     g_hw.init();
+    g_hw.load_relays();
+    g_player.init();   // SPEAKER_ENABLE=0 時不動作
     g_wifi.init();
-    g_time_mgr.init();
 
-    g_ws.set_data_callback(handle_server_action);
-    g_ws.init(SERVER_URL);
+    g_actions.init(dispatch_server_action);   // 連線即收到 time_sync，需先建立
+    g_ws.set_data_callback(handle_server_message);
+    g_ws.set_binary_callback(handle_server_frame);
+    g_ws.init(SERVER_URLS);
+    RTOS_TASK_CREATE(net_boot_task, "net_boot", BOOT_NET_TASK_STACK, NULL,
+                     BOOT_NET_TASK_PRIO, NULL, BOOT_NET_TASK_CORE);
 
-    g_audio.init();
+    /* 音訊擷取（推論 Task 內初始化）與推論與網路並行啟動；連線前的喚醒由 session 保留指令音訊至連線完成 */
+    g_streamer.init();
 
     /* 建立 WakeWordDetector */
-    static WakeWordDetector detector(g_audio, g_vad, g_ws, g_hw, g_streamer);
+    static WakeWordDetector detector(g_audio, g_vad, g_ws, g_hw, g_streamer, g_wifi, g_mqtt, g_player);
+    detector.set_server_action_cb(apply_server_action);
     g_detector = &detector;
 
-    xTaskCreate(inference_task, "ei_infer", 16384, g_detector, 5, NULL);
+    /* UART 效能 console（須在推論 Task 之前建立 EI runtime 互斥鎖） */
+    static PerfConsole console(detector, g_vad);
+    console.start();
+
+    RTOS_TASK_CREATE(inference_task, "ei_infer", INFERENCE_TASK_STACK, g_detector,
+                     INFERENCE_TASK_PRIO, NULL, INFERENCE_TASK_CORE);
+
+    g_health.start();
+    g_telemetry_http.start();   // 遙測 HTTP 端點（TELEMETRY_HTTP=1 時）
+
+#if TASK_STATS_INTERVAL_S > 0
+    RTOS_TASK_CREATE(task_stats_task, "task_stats", TASK_STATS_TASK_STACK, NULL,
+                     TASK_STATS_TASK_PRIO, NULL, TASK_STATS_TASK_CORE);
+#endif
     return 0;
 }
@@ -0,0 +1,119 @@
+/*
+ * espnow_link.cpp - 裝置端指令 ESP-NOW 直送實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "espnow_link.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_wifi.h"
+#include "esp_idf_version.h"
+#include "esp_random.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "EspNow";
+
+EspNowLink *EspNowLink::instance_ = nullptr;
+
+EspNowLink::EspNowLink()
+    : started_(false), seq_(0), delivered_(0), failed_(0)
+{
+}
+
+/* ---------- 初始化 ---------- */
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 5, 0)
+static void send_cb(const esp_now_send_info_t *info, esp_now_send_status_t status)
+{
+    (void)info;
+#else
+static void send_cb(const uint8_t *mac, esp_now_send_status_t status)
+{
+    (void)mac;
+#endif
+    EspNowLink::on_sent(status == ESP_NOW_SEND_SUCCESS);
+}
+
+bool EspNowLink::start()
+{
+    if (!LOCAL_CMD_ESPNOW || started_) return started_;
+
+    esp_err_t err = esp_now_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_now_init failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    instance_ = this;
+    seq_ = (uint16_t)esp_random();   // 重開機後不與致動器記住的上一筆 seq 相撞
+    esp_now_register_send_cb(send_cb);
+    started_ = true;
+    ESP_LOGI(TAG, "ESP-NOW ready");
+    return true;
+}
+
+void EspNowLink::on_sent(bool ok)
+{
+    if (!instance_) return;
+    /* WiFi Task 內執行：只計數，不記錄 log */
+    (ok ? instance_->delivered_ : instance_->failed_).fetch_add(1, std::memory_order_relaxed);
+}
+
+/* ---------- Peer ---------- */
+
+bool EspNowLink::add_peer(const uint8_t mac[6])
+{
+    if (!started_) return false;
+    if (esp_now_is_peer_exist(mac)) return true;
+
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, mac, 6);
+    peer.channel = 0;              // 0 = 跟隨 STA 目前頻道
+    peer.ifidx   = WIFI_IF_STA;
+    peer.encrypt = false;
+    esp_err_t err = esp_now_add_peer(&peer);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Add peer " MACSTR " failed: %s", MAC2STR(mac), esp_err_to_name(err));
+        return false;
+    }
+    ESP_LOGI(TAG, "Peer " MACSTR " added", MAC2STR(mac));
+    return true;
+}
+
+bool EspNowLink::parse_mac(const char *str, uint8_t mac[6])
+{
+    unsigned int b[6];
+    char tail;
+    if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x%c", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &tail) != 6) {
+        return false;
+    }
+    for (int i = 0; i < 6; i++) mac[i] = (uint8_t)b[i];
+    return true;
+}
+
+/* ---------- 送出 ---------- */
+
+bool EspNowLink::send(const uint8_t mac[6], const char *payload)
+{
+    if (!started_) return false;
+    size_t len = strlen(payload);
+    if (len == 0 || len > ESPNOW_PAYLOAD_MAX) return false;
+
+    /* seq 只在推論 Task 遞增（單一呼叫端）；致動器忽略與上一筆相同 seq 的 frame */
+    uint8_t frame[ESPNOW_HEADER_LEN + ESPNOW_PAYLOAD_MAX];
+    memcpy(frame, ESPNOW_FRAME_MAGIC, 3);
+    frame[3] = ESPNOW_FRAME_VERSION;
+    seq_++;
+    frame[4] = (uint8_t)(seq_ & 0xFF);
+    frame[5] = (uint8_t)(seq_ >> 8);
+    memcpy(frame + ESPNOW_HEADER_LEN, payload, len);
+
+    esp_err_t err = esp_now_send(mac, frame, ESPNOW_HEADER_LEN + len);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_now_send failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef ESPNOW_LINK_H
+#define ESPNOW_LINK_H
+
+/* ============================================================
+ * espnow_link.h - 裝置端指令 ESP-NOW 直送（語音節點 → 致動器）
+ * ESP-MIAO v0.8.0
+ *
+ * 致動器在 discovery 附上 espnow_mac 時，裝置端指令除了 MQTT 之外
+ * 也以 ESP-NOW 單播直接送到該 MAC，不經 AP / Broker，數 ms 內動作。
+ * MQTT 仍是權威路徑：致動器的 state 回報照常走 Broker。
+ * 雙方須連在同一 AP（ESP-NOW 使用 STA 目前的頻道）。
+ *
+ * Frame（與 mqtt_for_esp32 範例一致）：
+ *   "EMC" | version(1) | seq(uint16 LE) | payload（commands[value]，e.g. "ON"）
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#define ESPNOW_FRAME_MAGIC    "EMC"
+#define ESPNOW_FRAME_VERSION  1
+#define ESPNOW_HEADER_LEN     6
+#define ESPNOW_PAYLOAD_MAX    16
+
+class EspNowLink {
+public:
+    EspNowLink();
+
+    /** 初始化 ESP-NOW（WiFi STA 啟動後呼叫；LOCAL_CMD_ESPNOW=0 時不動作） */
+    bool start();
+
+    bool is_started() const { return started_; }
+
+    /** 登記單播 peer（重複登記無副作用；可在任意 Task 呼叫） */
+    bool add_peer(const uint8_t mac[6]);
+
+    /**
+     * 送出一筆指令（排入 WiFi 驅動即返回；MAC 層 ACK 結果由回調統計）。
+     * @return false = 未啟動 / 送出佇列失敗
+     */
+    bool send(const uint8_t mac[6], const char *payload);
+
+    uint32_t delivered() const { return delivered_.load(std::memory_order_relaxed); }
+    uint32_t failed() const { return failed_.load(std::memory_order_relaxed); }
+
+    /** "aa:bb:cc:dd:ee:ff" → mac；格式錯誤回傳 false */
+    static bool parse_mac(const char *str, uint8_t mac[6]);
+
+    /** 送出結果（WiFi Task 的 esp_now 回調轉呼叫） */
+    static void on_sent(bool ok);
+
+private:
+    bool                  started_;
+    uint16_t              seq_;
+    std::atomic<uint32_t> delivered_;
+    std::atomic<uint32_t> failed_;
+
+    static EspNowLink    *instance_;   // esp_now 回調沒有 user arg
+};
+
+#endif // ESPNOW_LINK_H
@@ -0,0 +1,165 @@
+/*
+ * json_tok.cpp - 不配置記憶體的 JSON tokenizer 實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "json_tok.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline bool is_container(const JsonTok &t)
+{
+    return t.type == JSON_OBJECT || t.type == JSON_ARRAY;
+}
+
+static int add_token(JsonTok *toks, int *n, int max_toks, JsonType type,
+                     int start, int end, int parent)
+{
+    if (*n >= max_toks) return JSON_ERROR_NOMEM;
+    JsonTok &t = toks[*n];
+    t.type   = type;
+    t.start  = start;
+    t.end    = end;
+    t.size   = 0;
+    t.parent = parent;
+    if (parent >= 0) toks[parent].size++;
+    return (*n)++;
+}
+
+int json_tokenize(const char *js, size_t len, JsonTok *toks, int max_toks)
+{
+    int n     = 0;
+    int super = -1;   // 目前的容器，或等待值的 key
+
+    for (size_t pos = 0; pos < len && js[pos] != '\0'; pos++) {
+        char c = js[pos];
+        switch (c) {
+            case '{':
+            case '[': {
+                int i = add_token(toks, &n, max_toks, c == '{' ? JSON_OBJECT : JSON_ARRAY,
+                                  (int)pos, -1, super);
+                if (i < 0) return i;
+                super = i;
+                break;
+            }
+            case '}':
+            case ']': {
+                while (super >= 0 && !is_container(toks[super])) super = toks[super].parent;
+                if (super < 0 || toks[super].end != -1 ||
+                    toks[super].type != (c == '}' ? JSON_OBJECT : JSON_ARRAY)) {
+                    return JSON_ERROR_INVAL;
+                }
+                toks[super].end = (int)pos + 1;
+                super = toks[super].parent;
+                break;
+            }
+            case '"': {
+                size_t start = pos + 1;
+                size_t i     = start;
+                while (i < len && js[i] != '\0' && js[i] != '"') {
+                    if (js[i] == '\\') i++;
+                    i++;
+                }
+                if (i >= len || js[i] != '"') return JSON_ERROR_PART;
+                int t = add_token(toks, &n, max_toks, JSON_STRING, (int)start, (int)i, super);
+                if (t < 0) return t;
+                pos = i;
+                break;
+            }
+            case ':':
+                super = n - 1;   // 接著的值屬於剛剛的 key
+                break;
+            case ',':
+                if (super >= 0 && !is_container(toks[super])) super = toks[super].parent;
+                break;
+            case ' ': case '\t': case '\r': case '\n':
+                break;
+            default: {
+                size_t i = pos;
+                while (i < len && js[i] != '\0' && !strchr(" \t\r\n,:]}", js[i])) i++;
+                int t = add_token(toks, &n, max_toks, JSON_PRIMITIVE, (int)pos, (int)i, super);
+                if (t < 0) return t;
+                pos = i - 1;
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (is_container(toks[i]) && toks[i].end == -1) return JSON_ERROR_PART;
+    }
+    return n;
+}
+
+bool json_eq(const char *js, const JsonTok &tok, const char *s)
+{
+    size_t len = strlen(s);
+    return (size_t)(tok.end - tok.start) == len && strncmp(js + tok.start, s, len) == 0;
+}
+
+int json_get(const char *js, const JsonTok *toks, int n, int obj, const char *key)
+{
+    if (obj < 0 || obj >= n || toks[obj].type != JSON_OBJECT) return -1;
+    for (int i = obj + 1; i + 1 < n && toks[i].start < toks[obj].end; i++) {
+        if (toks[i].parent == obj && toks[i].type == JSON_STRING && json_eq(js, toks[i], key)) {
+            return (toks[i].size > 0) ? i + 1 : -1;
+        }
+    }
+    return -1;
+}
+
+bool json_get_str(const char *js, const JsonTok *toks, int n, int obj, const char *key,
+                  char *out, size_t cap)
+{
+    int v = json_get(js, toks, n, obj, key);
+    if (v < 0 || toks[v].type != JSON_STRING || cap == 0) return false;
+
+    size_t o = 0;
+    for (int i = toks[v].start; i < toks[v].end && o + 1 < cap; i++) {
+        char c = js[i];
+        if (c == '\\' && i + 1 < toks[v].end) {
+            c = js[++i];
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                default:  break;    // \" \\ \/ 及其他照原字元（不處理 \uXXXX）
+            }
+        }
+        out[o++] = c;
+    }
+    out[o] = '\0';
+    return true;
+}
+
+bool json_get_int(const char *js, const JsonTok *toks, int n, int obj, const char *key,
+                  long long *out)
+{
+    int v = json_get(js, toks, n, obj, key);
+    if (v < 0 || toks[v].type != JSON_PRIMITIVE) return false;
+    char c = js[toks[v].start];
+    if (c != '-' && (c < '0' || c > '9')) return false;
+    *out = strtoll(js + toks[v].start, nullptr, 10);   // 後接分隔字元即停止
+    return true;
+}
+
+bool json_get_float(const char *js, const JsonTok *toks, int n, int obj, const char *key,
+                    float *out)
+{
+    int v = json_get(js, toks, n, obj, key);
+    if (v < 0 || toks[v].type != JSON_PRIMITIVE) return false;
+    char c = js[toks[v].start];
+    if (c != '-' && (c < '0' || c > '9')) return false;
+    *out = strtof(js + toks[v].start, nullptr);
+    return true;
+}
+
+bool json_get_bool(const char *js, const JsonTok *toks, int n, int obj, const char *key,
+                   bool *out)
+{
+    int v = json_get(js, toks, n, obj, key);
+    if (v < 0 || toks[v].type != JSON_PRIMITIVE) return false;
+    if (json_eq(js, toks[v], "true"))  { *out = true;  return true; }
+    if (json_eq(js, toks[v], "false")) { *out = false; return true; }
+    return false;
+}
@@ -0,0 +1,68 @@
+#ifndef JSON_TOK_H
+#define JSON_TOK_H
+
+/* ============================================================
+ * json_tok.h - 不配置記憶體的 JSON tokenizer（jsmn 風格）
+ * ESP-MIAO v0.8.0
+ *
+ * 將字串切成 token（起訖位置 + 父 token），不複製、不配置；
+ * 物件的 key 為 STRING token，其值為緊接的下一個 token（parent = key）。
+ * 僅供解析 Server 送來的少量固定格式訊息。
+ * ============================================================ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+enum JsonType : uint8_t {
+    JSON_UNDEFINED = 0,
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_PRIMITIVE,   // number / true / false / null
+};
+
+#define JSON_ERROR_NOMEM  (-1)   // token 不足
+#define JSON_ERROR_INVAL  (-2)   // 非法字元 / 括號不匹配
+#define JSON_ERROR_PART   (-3)   // 字串不完整
+
+struct JsonTok {
+    JsonType type;
+    int      start;    // 第一個字元（STRING 不含引號）
+    int      end;      // 最後一個字元的下一個
+    int      size;     // 子項數（物件 = key 數、key = 1）
+    int      parent;   // 父 token 索引（-1 = 最上層）
+};
+
+/**
+ * 切分 JSON。
+ * @return token 數（>= 0），或 JSON_ERROR_*
+ */
+int json_tokenize(const char *js, size_t len, JsonTok *toks, int max_toks);
+
+/** token 內容是否等於 s */
+bool json_eq(const char *js, const JsonTok &tok, const char *s);
+
+/**
+ * 在物件 obj 中尋找 key 對應的值。
+ * @return 值的 token 索引，-1 = 不存在
+ */
+int json_get(const char *js, const JsonTok *toks, int n, int obj, const char *key);
+
+/** 取字串值（處理基本跳脫字元，截斷至 cap-1）；失敗回傳 false */
+bool json_get_str(const char *js, const JsonTok *toks, int n, int obj, const char *key,
+                  char *out, size_t cap);
+
+/** 取整數值 */
+bool json_get_int(const char *js, const JsonTok *toks, int n, int obj, const char *key,
+                  long long *out);
+
+/** 取數值（整數或小數） */
+bool json_get_float(const char *js, const JsonTok *toks, int n, int obj, const char *key,
+                    float *out);
+
+/** 取布林值 */
+bool json_get_bool(const char *js, const JsonTok *toks, int n, int obj, const char *key,
+                   bool *out);
+
+#endif // JSON_TOK_H
@@ -0,0 +1,80 @@
+/*
+ * link_warmup.cpp - 推測性鏈路預熱實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "link_warmup.h"
+#include "config.h"
+#include "rtos_alloc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <stdio.h>
+
+static const char *TAG = "LinkWarmup";
+
+LinkWarmup::LinkWarmup(WebSocketClient &ws, WifiManager &wifi)
+    : ws_(ws), wifi_(wifi), q_(nullptr), last_sent_us_(0)
+{}
+
+bool LinkWarmup::init()
+{
+    if (!LINK_WARMUP || q_) return true;
+    q_ = RTOS_QUEUE_CREATE(1, sizeof(Request));
+    if (!q_ ||
+        RTOS_TASK_CREATE(task_entry_, "link_warmup", LINK_WARMUP_TASK_STACK, this,
+                         LINK_WARMUP_TASK_PRIO, nullptr, LINK_WARMUP_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start warm-up task");
+        return false;
+    }
+    return true;
+}
+
+void LinkWarmup::notify(uint32_t speech_ms, float vad_energy)
+{
+    if (!q_) return;
+    Request req = { speech_ms, vad_energy };
+    xQueueOverwrite(q_, &req);
+}
+
+/* ---------- 預熱 Task ---------- */
+
+void LinkWarmup::task_entry_(void *arg)
+{
+    auto   *self = static_cast<LinkWarmup *>(arg);
+    Request req;
+    while (1) {
+        if (xQueueReceive(self->q_, &req, portMAX_DELAY) != pdTRUE) continue;
+
+        /* 持續有語音就延長；安靜 HOLD_MS 後回到 modem-sleep */
+        WifiLowLatencyScope low_latency(self->wifi_);
+        do {
+            self->warm_(req);
+        } while (xQueueReceive(self->q_, &req, pdMS_TO_TICKS(LINK_WARMUP_HOLD_MS)) == pdTRUE);
+        ESP_LOGD(TAG, "No speech for %d ms, back to power save", LINK_WARMUP_HOLD_MS);
+    }
+}
+
+void LinkWarmup::warm_(const Request &req)
+{
+    if (!ws_.is_connected()) {
+        /* 只要求監督 Task 略過退避立即重連，不在此等待 */
+        ws_.wait_connected(0);
+        ESP_LOGI(TAG, "Speech while WS down, reconnect requested");
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (last_sent_us_ && now - last_sent_us_ < (int64_t)LINK_WARMUP_MIN_INTERVAL_MS * 1000) return;
+
+    char json[160];
+    int  len = snprintf(json, sizeof(json),
+                        "{\"device_id\":\"%s\",\"timestamp\":%lld,\"type\":\"link_warmup\","
+                        "\"payload\":{\"speech_ms\":%lu,\"vad_energy\":%.1f}}",
+                        DEVICE_ID, (long long)(now / 1000), (unsigned long)req.speech_ms,
+                        req.vad_energy);
+    if (ws_.send_text(json, (size_t)len, pdMS_TO_TICKS(WAKE_ACK_WS_TIMEOUT_MS))) {
+        last_sent_us_ = now;
+        ESP_LOGD(TAG, "link_warmup sent (%lu ms speech)", (unsigned long)req.speech_ms);
+    }
+}
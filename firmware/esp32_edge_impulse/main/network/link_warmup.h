@@ -0,0 +1,54 @@
+#ifndef LINK_WARMUP_H
+#define LINK_WARMUP_H
+
+/* ============================================================
+ * link_warmup.h - 推測性鏈路預熱（VAD 上升緣，喚醒詞觸發前）
+ * ESP-MIAO v0.8.0
+ *
+ * 喚醒詞通常在語音開始後 0.5–1 秒才確認；這段時間內先：
+ *   - 切為 WIFI_PS_NONE（AP 不再緩衝下行、上行不必等 DTIM）
+ *   - WebSocket 已連線：送出 link_warmup，Server 預熱 Whisper / Ollama
+ *   - 斷線：要求監督 Task 立即重試，喚醒時不必 emergency_reconnect
+ * 呼叫端（推論 Task）只排入請求即返回；持續語音期間維持低延遲，
+ * 安靜 LINK_WARMUP_HOLD_MS 後釋放（喚醒 session 另持有自己的低延遲參考）。
+ * ============================================================ */
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "websocket_client.h"
+#include "wifi_manager.h"
+
+class LinkWarmup {
+public:
+    LinkWarmup(WebSocketClient &ws, WifiManager &wifi);
+
+    /**
+     * 建立預熱 Task 與請求佇列（LINK_WARMUP=0 時不動作）。
+     * @return true = 成功或已停用
+     */
+    bool init();
+
+    /**
+     * VAD 偵測到持續語音（不阻塞；尚未處理的舊請求會被覆寫）。
+     * @param speech_ms  連續語音長度
+     * @param vad_energy 觸發切片的 FFT 峰值能量
+     */
+    void notify(uint32_t speech_ms, float vad_energy);
+
+private:
+    struct Request {
+        uint32_t speech_ms;
+        float    vad_energy;
+    };
+
+    WebSocketClient &ws_;
+    WifiManager     &wifi_;
+    QueueHandle_t    q_;
+    int64_t          last_sent_us_;   // 上次送出 link_warmup（僅預熱 Task 使用）
+
+    static void task_entry_(void *arg);
+    void        warm_(const Request &req);
+};
+
+#endif // LINK_WARMUP_H
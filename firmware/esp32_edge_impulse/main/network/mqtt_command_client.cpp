@@ -0,0 +1,197 @@
+/*
+ * mqtt_command_client.cpp - 裝置端指令直連 MQTT 實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "mqtt_command_client.h"
+#include "config.h"
+#include "json_tok.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *TAG = "MqttCommand";
+
+/* 指令目標與預設 topic（索引即 routes_ 索引） */
+static const struct {
+    const char *target;
+    const char *default_topic;
+} kTargets[] = {
+    { "light", LOCAL_CMD_LIGHT_TOPIC },
+    { "fan",   LOCAL_CMD_FAN_TOPIC },
+};
+
+/* 同 Server 的 COMMAND_MAP */
+static const LocalCommandSpec kCommands[] = {
+    { LOCAL_CMD_LIGHT_ON,  "LIGHT_ON",  "light", "on" },
+    { LOCAL_CMD_LIGHT_OFF, "LIGHT_OFF", "light", "off" },
+    { LOCAL_CMD_FAN_ON,    "FAN_ON",    "fan",   "on" },
+    { LOCAL_CMD_FAN_OFF,   "FAN_OFF",   "fan",   "off" },
+};
+
+static int target_index(const char *target)
+{
+    for (int i = 0; i < (int)(sizeof(kTargets) / sizeof(kTargets[0])); i++) {
+        if (strcmp(kTargets[i].target, target) == 0) return i;
+    }
+    return -1;
+}
+
+MqttCommandClient::MqttCommandClient()
+    : client_(nullptr), connected_(false), lock_(portMUX_INITIALIZER_UNLOCKED)
+{
+    static_assert(sizeof(kTargets) / sizeof(kTargets[0]) == TARGET_COUNT,
+                  "kTargets must match routes_");
+    memset(routes_, 0, sizeof(routes_));
+    for (int i = 0; i < TARGET_COUNT; i++) {
+        snprintf(routes_[i].topic, sizeof(routes_[i].topic), "%s", kTargets[i].default_topic);
+        snprintf(routes_[i].on, sizeof(routes_[i].on), "ON");
+        snprintf(routes_[i].off, sizeof(routes_[i].off), "OFF");
+    }
+}
+
+const LocalCommandSpec *MqttCommandClient::spec(LocalCommandId cmd)
+{
+    for (const LocalCommandSpec &s : kCommands) {
+        if (s.id == cmd) return &s;
+    }
+    return nullptr;
+}
+
+/* ---------- 連線 ---------- */
+
+void MqttCommandClient::start()
+{
+    if (!LOCAL_CMD_ENABLE || client_) return;
+    espnow_.start();   // LOCAL_CMD_ESPNOW=0 時不動作；peer 於收到 discovery 時登記
+
+    esp_mqtt_client_config_t cfg = {};
+    cfg.broker.address.uri = LOCAL_CMD_MQTT_URI;
+    if (LOCAL_CMD_MQTT_USER[0]) {
+        cfg.credentials.username                = LOCAL_CMD_MQTT_USER;
+        cfg.credentials.authentication.password = LOCAL_CMD_MQTT_PASSWORD;
+    }
+    cfg.credentials.client_id = DEVICE_ID;
+
+    client_ = esp_mqtt_client_init(&cfg);
+    if (!client_) {
+        ESP_LOGE(TAG, "MQTT init failed");
+        return;
+    }
+    esp_mqtt_client_register_event(client_, MQTT_EVENT_ANY, &MqttCommandClient::event_handler_, this);
+    esp_mqtt_client_start(client_);
+    ESP_LOGI(TAG, "MQTT started: %s", LOCAL_CMD_MQTT_URI);
+}
+
+void MqttCommandClient::event_handler_(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    auto *self = static_cast<MqttCommandClient *>(arg);
+    auto *ev   = static_cast<esp_mqtt_event_handle_t>(data);
+
+    switch ((esp_mqtt_event_id_t)id) {
+        case MQTT_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "MQTT connected");
+            self->connected_ = true;
+            esp_mqtt_client_subscribe(self->client_, LOCAL_CMD_DISCOVERY_TOPIC, 0);
+            break;
+
+        case MQTT_EVENT_DISCONNECTED:
+            ESP_LOGW(TAG, "MQTT disconnected");
+            self->connected_ = false;
+            break;
+
+        case MQTT_EVENT_DATA:
+            /* discovery 訊息遠小於 esp-mqtt 接收緩衝；分段交付的大訊息直接忽略 */
+            if (ev->current_data_offset != 0 || ev->data_len != ev->total_data_len) break;
+            if (ev->topic_len == (int)strlen(LOCAL_CMD_DISCOVERY_TOPIC) &&
+                strncmp(ev->topic, LOCAL_CMD_DISCOVERY_TOPIC, ev->topic_len) == 0) {
+                self->on_discovery_(ev->data, ev->data_len);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* ---------- 裝置註冊 ---------- */
+
+void MqttCommandClient::on_discovery_(const char *json, int len)
+{
+    JsonTok toks[LOCAL_CMD_JSON_TOKENS];
+    int n = json_tokenize(json, (size_t)len, toks, LOCAL_CMD_JSON_TOKENS);
+    if (n <= 0 || toks[0].type != JSON_OBJECT) {
+        ESP_LOGW(TAG, "Invalid discovery payload (%d)", n);
+        return;
+    }
+
+    char name[32] = "";
+    if (!json_get_str(json, toks, n, 0, "name", name, sizeof(name))) {
+        json_get_str(json, toks, n, 0, "device_id", name, sizeof(name));
+    }
+    Route r = {};
+    if (!json_get_str(json, toks, n, 0, "control_topic", r.topic, sizeof(r.topic))) return;
+    int commands = json_get(json, toks, n, 0, "commands");
+    if (!json_get_str(json, toks, n, commands, "on", r.on, sizeof(r.on))) snprintf(r.on, sizeof(r.on), "ON");
+    if (!json_get_str(json, toks, n, commands, "off", r.off, sizeof(r.off))) snprintf(r.off, sizeof(r.off), "OFF");
+    char mac[18];
+    r.has_mac = json_get_str(json, toks, n, 0, "espnow_mac", mac, sizeof(mac)) &&
+                EspNowLink::parse_mac(mac, r.mac) && espnow_.add_peer(r.mac);
+
+    /* 裝置名稱或任一 alias 等於指令 target 即視為該目標 */
+    int aliases = json_get(json, toks, n, 0, "aliases");
+    for (int t = 0; t < TARGET_COUNT; t++) {
+        bool match = strcasecmp(name, kTargets[t].target) == 0;
+        for (int i = aliases + 1; !match && aliases >= 0 && i < n; i++) {
+            if (toks[i].parent != aliases || toks[i].type != JSON_STRING) continue;
+            int alen = toks[i].end - toks[i].start;
+            match = alen == (int)strlen(kTargets[t].target) &&
+                    strncasecmp(json + toks[i].start, kTargets[t].target, alen) == 0;
+        }
+        if (!match) continue;
+
+        portENTER_CRITICAL(&lock_);
+        routes_[t] = r;
+        portEXIT_CRITICAL(&lock_);
+        ESP_LOGI(TAG, "Target '%s' -> %s (%s, on=%s off=%s%s)", kTargets[t].target, r.topic,
+                 name, r.on, r.off, r.has_mac ? ", espnow" : "");
+    }
+}
+
+/* ---------- 發佈 ---------- */
+
+bool MqttCommandClient::publish(LocalCommandId cmd)
+{
+    const LocalCommandSpec *s = spec(cmd);
+    int t = s ? target_index(s->target) : -1;
+    if (t < 0 || !client_) return false;
+
+    /* 同 dispatch_command：commands[value]（預設 ON / OFF） */
+    char topic[sizeof(routes_[0].topic)];
+    char payload[sizeof(routes_[0].on)];
+    uint8_t mac[6];
+    portENTER_CRITICAL(&lock_);
+    const Route &r = routes_[t];
+    memcpy(topic, r.topic, sizeof(topic));
+    memcpy(payload, strcmp(s->value, "on") == 0 ? r.on : r.off, sizeof(payload));
+    memcpy(mac, r.mac, sizeof(mac));
+    bool has_mac = r.has_mac;
+    portEXIT_CRITICAL(&lock_);
+
+    /* ESP-NOW 先送：不經 AP 轉送與 Broker，致動器數 ms 內動作 */
+    bool direct = has_mac && espnow_.send(mac, payload);
+    if (direct) ESP_LOGI(TAG, "ESP-NOW -> " MACSTR ": %s (%s)", MAC2STR(mac), payload, s->name);
+
+    if (!topic[0] || !is_connected()) return direct;
+
+    /* enqueue：由 MQTT Task 送出，推論 Task 不等待網路 */
+    int msg_id = esp_mqtt_client_enqueue(client_, topic, payload, 0, LOCAL_CMD_MQTT_QOS, 0, true);
+    if (msg_id < 0) {
+        ESP_LOGE(TAG, "Publish %s failed", s->name);
+        return direct;
+    }
+    ESP_LOGI(TAG, "MQTT Publish: [%s] -> %s (%s)", topic, payload, s->name);
+    return true;
+}
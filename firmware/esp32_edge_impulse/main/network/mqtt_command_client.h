@@ -0,0 +1,84 @@
+#ifndef MQTT_COMMAND_CLIENT_H
+#define MQTT_COMMAND_CLIENT_H
+
+/* ============================================================
+ * mqtt_command_client.h - 裝置端指令直連 MQTT
+ * ESP-MIAO v0.8.0
+ *
+ * 裝置端辨識出的指令不經 Server，直接發佈到目標裝置的 control_topic。
+ * 指令與目標對應同 Server 的 COMMAND_MAP（models.py），payload 同 dispatch_command：
+ * 取裝置 discovery 的 commands[value]，未定義時為 ON / OFF。
+ * 目標裝置由 LOCAL_CMD_DISCOVERY_TOPIC 的註冊訊息學習（名稱或 aliases 命中 target），
+ * 未收到前使用 config.h 的預設 topic。
+ * discovery 附 espnow_mac 時（LOCAL_CMD_ESPNOW）同一指令另以 ESP-NOW 直送致動器，
+ * Broker 不可用時仍能動作；MQTT 照常發佈作為權威狀態路徑。
+ * ============================================================ */
+
+#include <stddef.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "mqtt_client.h"
+#include "espnow_link.h"
+
+/* 指令 ID（與 Server models.py 的 Command 相同） */
+enum LocalCommandId {
+    LOCAL_CMD_NONE      = -1,
+    LOCAL_CMD_LIGHT_ON  = 0,
+    LOCAL_CMD_LIGHT_OFF = 1,
+    LOCAL_CMD_FAN_ON    = 2,
+    LOCAL_CMD_FAN_OFF   = 3,
+};
+
+/* COMMAND_MAP 的一列 */
+struct LocalCommandSpec {
+    LocalCommandId id;
+    const char    *name;     // e.g. "LIGHT_ON"
+    const char    *target;   // e.g. "light"
+    const char    *value;    // "on" / "off"
+};
+
+class MqttCommandClient {
+public:
+    MqttCommandClient();
+
+    /**
+     * 連線 Broker 並訂閱 discovery（網路就緒後呼叫；LOCAL_CMD_ENABLE=0 時不動作）。
+     */
+    void start();
+
+    bool is_connected() const { return connected_.load(std::memory_order_acquire); }
+
+    /**
+     * 發佈指令（ESP-NOW 直送 + 排入 esp-mqtt outbox 即返回，不阻塞呼叫端）。
+     * @return false = 兩條路徑皆未送出：未連線且無 ESP-NOW peer / 未知指令 / 無目標（應改走 Server 路徑）
+     */
+    bool publish(LocalCommandId cmd);
+
+    /** 指令對應表查詢；未知指令回傳 nullptr */
+    static const LocalCommandSpec *spec(LocalCommandId cmd);
+
+    const EspNowLink &espnow() const { return espnow_; }
+
+private:
+    static constexpr int TARGET_COUNT = 2;   // light / fan（mqtt_command_client.cpp 的 kTargets）
+
+    /* 一個指令目標（COMMAND_MAP 的 target）的發佈路徑 */
+    struct Route {
+        char topic[64];
+        char on[16];      // commands["on"]
+        char off[16];     // commands["off"]
+        uint8_t mac[6];   // espnow_mac（has_mac 為 true 時有效）
+        bool has_mac;
+    };
+
+    esp_mqtt_client_handle_t client_;
+    std::atomic<bool>        connected_;
+    portMUX_TYPE             lock_;     // routes_：MQTT Task 寫入，推論 Task 讀取
+    Route                    routes_[TARGET_COUNT];
+    EspNowLink               espnow_;
+
+    static void event_handler_(void *arg, esp_event_base_t base, int32_t id, void *data);
+    void on_discovery_(const char *json, int len);
+};
+
+#endif // MQTT_COMMAND_CLIENT_H
@@ -0,0 +1,163 @@
+/*
+ * server_discovery.cpp - 以 mDNS 找出 Server 實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "server_discovery.h"
+#include "config.h"
+#include "rtos_alloc.h"
+#include "nvs_writer.h"
+#include "mdns.h"
+#include "esp_log.h"
+#include "esp_netif_ip_addr.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "ServerDiscovery";
+
+#define DISC_NVS_NS  "storage"
+#define DISC_NVS_KEY "srv_disc"   // "ip:port"
+
+ServerDiscovery::ServerDiscovery()
+    : task_(nullptr), cb_(nullptr), cb_arg_(nullptr), lock_(portMUX_INITIALIZER_UNLOCKED),
+      port_(0), last_query_us_(0)
+{
+    memset(ip_, 0, sizeof(ip_));
+}
+
+void ServerDiscovery::init(found_cb_t cb, void *arg)
+{
+    cb_     = cb;
+    cb_arg_ = arg;
+
+    nvs_handle_t nvs;
+    char   buf[24];
+    size_t len = sizeof(buf);
+    if (nvs_open(DISC_NVS_NS, NVS_READONLY, &nvs) == ESP_OK) {
+        if (nvs_get_str(nvs, DISC_NVS_KEY, buf, &len) == ESP_OK) {
+            char *colon = strchr(buf, ':');
+            if (colon && colon - buf < (int)sizeof(ip_)) {
+                *colon = '\0';
+                memcpy(ip_, buf, strlen(buf) + 1);
+                port_ = (uint16_t)atoi(colon + 1);
+                ESP_LOGI(TAG, "Cached server %s:%u", ip_, (unsigned)port_);
+            }
+        }
+        nvs_close(nvs);
+    }
+
+    if (RTOS_TASK_CREATE(task_entry_, "srv_disc", WS_DISCOVERY_TASK_STACK, this,
+                         WS_DISCOVERY_TASK_PRIO, &task_, WS_DISCOVERY_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start discovery task");
+        task_ = nullptr;
+    }
+}
+
+bool ServerDiscovery::address(char *ip, size_t cap, uint16_t *port) const
+{
+    taskENTER_CRITICAL(&lock_);
+    bool ok = ip_[0] && strlen(ip_) < cap;
+    if (ok) {
+        memcpy(ip, ip_, strlen(ip_) + 1);
+        *port = port_;
+    }
+    taskEXIT_CRITICAL(&lock_);
+    return ok;
+}
+
+void ServerDiscovery::request()
+{
+    if (task_) xTaskNotifyGive(task_);
+}
+
+/* ---------- 查詢 Task ---------- */
+
+void ServerDiscovery::task_entry_(void *arg)
+{
+    static_cast<ServerDiscovery *>(arg)->run_();
+}
+
+void ServerDiscovery::run_()
+{
+    bool mdns_ready = false;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);   // 多次要求合併為一次查詢
+        int64_t now = esp_timer_get_time();
+        if (last_query_us_ && now - last_query_us_ < (int64_t)WS_DISCOVERY_MIN_INTERVAL_S * 1000000) continue;
+        last_query_us_ = now;
+
+        if (!mdns_ready) {
+            esp_err_t err = mdns_init();
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "mdns_init failed: %s", esp_err_to_name(err));
+                continue;
+            }
+            mdns_ready = true;
+        }
+
+        char     ip[16];
+        uint16_t port = 0;
+        if (!query_(ip, sizeof(ip), &port)) continue;
+
+        taskENTER_CRITICAL(&lock_);
+        bool changed = strcmp(ip, ip_) != 0 || port != port_;
+        if (changed) {
+            memcpy(ip_, ip, sizeof(ip_));
+            port_ = port;
+        }
+        taskEXIT_CRITICAL(&lock_);
+        if (!changed) continue;
+
+        ESP_LOGI(TAG, "Server found at %s:%u", ip, (unsigned)port);
+        save_(ip, port);
+        if (cb_) cb_(cb_arg_);
+    }
+}
+
+/* PTR 查詢：有多台 Server 時優先沿用目前位址，否則取第一個有 IPv4 的結果 */
+bool ServerDiscovery::query_(char *ip, size_t cap, uint16_t *port)
+{
+    int64_t t0 = esp_timer_get_time();
+    mdns_result_t *results = nullptr;
+    esp_err_t err = mdns_query_ptr(WS_DISCOVERY_SERVICE, WS_DISCOVERY_PROTO, WS_DISCOVERY_TIMEOUT_MS,
+                                   WS_DISCOVERY_MAX_RESULTS, &results);
+    if (err != ESP_OK || !results) {
+        ESP_LOGW(TAG, "No %s.%s service found (%s)", WS_DISCOVERY_SERVICE, WS_DISCOVERY_PROTO,
+                 err == ESP_OK ? "no answer" : esp_err_to_name(err));
+        if (results) mdns_query_results_free(results);
+        return false;
+    }
+
+    char current[16];
+    uint16_t current_port = 0;
+    bool have_current = address(current, sizeof(current), &current_port);
+    bool found = false;
+    for (mdns_result_t *r = results; r; r = r->next) {
+        for (mdns_ip_addr_t *a = r->addr; a; a = a->next) {
+            if (a->addr.type != ESP_IPADDR_TYPE_V4) continue;
+            char candidate[16];
+            snprintf(candidate, sizeof(candidate), IPSTR, IP2STR(&a->addr.u_addr.ip4));
+            bool is_current = have_current && strcmp(candidate, current) == 0 && r->port == current_port;
+            if (!found || is_current) {
+                snprintf(ip, cap, "%s", candidate);
+                *port = r->port;
+                found = true;
+            }
+            if (is_current) break;
+        }
+    }
+    mdns_query_results_free(results);
+    ESP_LOGI(TAG, "mDNS query %s in %lld ms", found ? "answered" : "returned no IPv4 address",
+             (long long)((esp_timer_get_time() - t0) / 1000));
+    return found;
+}
+
+void ServerDiscovery::save_(const char *ip, uint16_t port)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%s:%u", ip, (unsigned)port);
+    nvs_writer_set_str(DISC_NVS_NS, DISC_NVS_KEY, buf);
+}
@@ -0,0 +1,58 @@
+#ifndef SERVER_DISCOVERY_H
+#define SERVER_DISCOVERY_H
+
+/* ============================================================
+ * server_discovery.h - 以 mDNS 找出 Server（_esp-miao._tcp）
+ * ESP-MIAO v0.8.0
+ *
+ * Server 的 DHCP 位址變動後，寫死在 SERVER_URLS 的 IP 會讓重連全部失敗。
+ * 找到的位址存入 NVS "srv_disc"，下次開機直接使用（不等 mDNS，開機到可用的時間不變）；
+ * 只有沒有快取、或連線連續失敗時，才由背景 Task 重新查詢。
+ * 查詢結果由 WebSocketClient 套用到第一個端點（保留 scheme、路徑與主機名稱）。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+class ServerDiscovery {
+public:
+    /** 找到與目前不同的位址時呼叫（在查詢 Task 內執行，只應通知其他 Task） */
+    typedef void (*found_cb_t)(void *arg);
+
+    ServerDiscovery();
+
+    /**
+     * 讀取 NVS 快取並建立查詢 Task（需在 nvs_flash_init() 之後呼叫）。
+     */
+    void init(found_cb_t cb, void *arg);
+
+    /**
+     * 目前已知的 Server 位址（NVS 快取或最近一次查詢結果）。
+     * @return false = 尚未找到
+     */
+    bool address(char *ip, size_t cap, uint16_t *port) const;
+
+    /**
+     * 要求背景查詢（不阻塞；查詢中的要求會合併，WS_DISCOVERY_MIN_INTERVAL_S 內不重複查詢）。
+     * 需在 WiFi 取得 IP 後呼叫。
+     */
+    void request();
+
+private:
+    TaskHandle_t         task_;
+    found_cb_t           cb_;
+    void                *cb_arg_;
+    mutable portMUX_TYPE lock_;      // ip_ / port_：查詢 Task 寫入，監督 Task 讀取
+    char                 ip_[16];
+    uint16_t             port_;
+    int64_t              last_query_us_;   // 僅查詢 Task 使用
+
+    static void task_entry_(void *arg);
+    void run_();
+    bool query_(char *ip, size_t cap, uint16_t *port);
+    void save_(const char *ip, uint16_t port);
+};
+
+#endif // SERVER_DISCOVERY_H
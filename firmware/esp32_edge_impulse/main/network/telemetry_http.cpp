@@ -0,0 +1,138 @@
+/*
+ * telemetry_http.cpp - 裝置端遙測 HTTP 端點實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "telemetry_http.h"
+#include "telemetry_block.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+
+static const char *TAG = "TelemetryHttp";
+
+TelemetryHttp::TelemetryHttp() : server_(nullptr), last_us_(0), served_(0), limited_(0) {}
+
+bool TelemetryHttp::start()
+{
+#if TELEMETRY_HTTP
+    if (server_) return true;
+    httpd_config_t cfg    = HTTPD_DEFAULT_CONFIG();
+    cfg.server_port       = TELEMETRY_HTTP_PORT;
+    cfg.ctrl_port         = TELEMETRY_HTTP_PORT + 1;
+    cfg.core_id           = CORE_NET;
+    cfg.task_priority     = TELEMETRY_HTTP_TASK_PRIO;
+    cfg.stack_size        = TELEMETRY_HTTP_TASK_STACK;
+    cfg.max_open_sockets  = TELEMETRY_HTTP_MAX_SOCKETS;
+    cfg.max_uri_handlers  = 2;
+    cfg.lru_purge_enable  = true;   // 連線數滿時關閉最久未用的，輪詢端不會卡住
+    cfg.recv_wait_timeout = 2;
+    cfg.send_wait_timeout = 2;
+
+    esp_err_t err = httpd_start(&server_, &cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "httpd_start failed: %s", esp_err_to_name(err));
+        server_ = nullptr;
+        return false;
+    }
+    const httpd_uri_t uris[] = {
+        { "/telemetry",     HTTP_GET, &TelemetryHttp::handle_json_, this },
+        { "/telemetry.bin", HTTP_GET, &TelemetryHttp::handle_bin_,  this },
+    };
+    for (const httpd_uri_t &u : uris) httpd_register_uri_handler(server_, &u);
+    ESP_LOGI(TAG, "Telemetry on :%d/telemetry (min interval %d ms)", TELEMETRY_HTTP_PORT,
+             TELEMETRY_HTTP_MIN_INTERVAL_MS);
+#endif
+    return true;
+}
+
+bool TelemetryHttp::admit_(httpd_req_t *req)
+{
+    int64_t now = esp_timer_get_time();
+    if (last_us_ && now - last_us_ < (int64_t)TELEMETRY_HTTP_MIN_INTERVAL_MS * 1000) {
+        limited_++;
+        char retry[12];
+        snprintf(retry, sizeof(retry), "%d", (TELEMETRY_HTTP_MIN_INTERVAL_MS + 999) / 1000);
+        httpd_resp_set_status(req, "429 Too Many Requests");
+        httpd_resp_set_hdr(req, "Retry-After", retry);
+        httpd_resp_send(req, nullptr, 0);
+        return false;
+    }
+    last_us_ = now;
+    served_++;
+    return true;
+}
+
+esp_err_t TelemetryHttp::handle_bin_(httpd_req_t *req)
+{
+    auto *self = static_cast<TelemetryHttp *>(req->user_ctx);
+    if (!self->admit_(req)) return ESP_OK;
+
+    static TelemetrySnapshot snap;   // server 只有一個 Task
+    telemetry_read(&snap);
+    httpd_resp_set_type(req, "application/octet-stream");
+    return httpd_resp_send(req, (const char *)&snap, sizeof(snap));
+}
+
+esp_err_t TelemetryHttp::handle_json_(httpd_req_t *req)
+{
+    auto *self = static_cast<TelemetryHttp *>(req->user_ctx);
+    if (!self->admit_(req)) return ESP_OK;
+
+    static TelemetrySnapshot snap;
+    static char              json[TELEMETRY_HTTP_JSON_LEN];
+    telemetry_read(&snap);
+
+    int len = snprintf(json, sizeof(json), "{\"device_id\":\"%s\",\"uptime_s\":%u",
+                       DEVICE_ID, (unsigned)snap.uptime_s);
+    if (snap.valid & TELEMETRY_VALID_HEALTH) {
+        const TelemetryHealth &h = snap.health;
+        len += snprintf(json + len, sizeof(json) - len,
+                        ",\"health\":{\"sampled_s\":%u,\"rssi\":%d,\"cpu\":[%d,%d],"
+                        "\"heap\":[%u,%u,%u],\"stack_min\":[%u,\"%s\"]}",
+                        (unsigned)h.uptime_s, h.rssi, h.cpu[0], h.cpu[1], (unsigned)h.heap_free,
+                        (unsigned)h.heap_largest, (unsigned)h.heap_min_free, (unsigned)h.stack_min, h.stack_task);
+    }
+    if ((snap.valid & TELEMETRY_VALID_VAD) && len < (int)sizeof(json)) {
+        const VadStats &v = snap.vad.stats;
+        len += snprintf(json + len, sizeof(json) - len,
+                        ",\"vad\":{\"slices\":%u,\"fft_triggers\":%u,\"ml_triggered\":%u,\"rms_avg\":%.2f,"
+                        "\"fft_avg\":%.1f,\"fft_peak\":%.1f,\"speech_ratio\":%.3f,\"noise_floor\":%.1f,"
+                        "\"threshold\":%.1f,\"agc_gain\":%.2f,\"wake_threshold\":%.3f}",
+                        (unsigned)snap.vad.slices, (unsigned)v.fft_triggers, (unsigned)v.ml_triggered, v.rms_avg,
+                        v.fft_avg, v.fft_peak, v.speech_ratio_avg, v.noise_floor, v.threshold, v.agc_gain,
+                        snap.vad.wake_threshold);
+    }
+    if ((snap.valid & TELEMETRY_VALID_STAGES) && len < (int)sizeof(json)) {
+        /* 各階段 [count, min, avg, p99, max]（us），同 telemetry 訊息的上一個區間 */
+        len += snprintf(json + len, sizeof(json) - len, ",\"stages\":{\"interval_ms\":%u",
+                        (unsigned)snap.stages.interval_ms);
+        for (int i = 0; i < PROF_STAGE_COUNT && len < (int)sizeof(json); i++) {
+            const StageProfiler::Summary &s = snap.stages.stages[i];
+            len += snprintf(json + len, sizeof(json) - len, ",\"%s\":[%u,%u,%u,%u,%u]",
+                            StageProfiler::stage_name((ProfileStage)i), (unsigned)s.count, (unsigned)s.min_us,
+                            (unsigned)s.avg_us, (unsigned)s.p99_us, (unsigned)s.max_us);
+        }
+        if (len < (int)sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "}");
+    }
+    if ((snap.valid & TELEMETRY_VALID_LATENCY) && len < (int)sizeof(json)) {
+        const WakeLatencyReport &r = snap.latency;
+        len += snprintf(json + len, sizeof(json) - len,
+                        ",\"latency_slo\":{\"state\":\"%s\",\"samples\":%u,\"slo_ms\":%d,\"p50_ms\":%u,"
+                        "\"p90_ms\":%u,\"max_ms\":%u,\"stage\":\"%s\",\"stages_p90_ms\":{",
+                        r.degraded ? "degraded" : "ok", (unsigned)r.samples, WAKE_SLO_MS, (unsigned)r.p50_ms,
+                        (unsigned)r.p90_ms, (unsigned)r.max_ms, WakeLatencySlo::stage_name(r.worst));
+        for (int s = 0; s < WL_STAGE_COUNT && len < (int)sizeof(json); s++) {
+            len += snprintf(json + len, sizeof(json) - len, "%s\"%s\":%u", s ? "," : "",
+                            WakeLatencySlo::stage_name((WakeLatencyStage)s), (unsigned)r.stage_p90_ms[s]);
+        }
+        if (len < (int)sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "}}");
+    }
+    if (len < (int)sizeof(json)) len += snprintf(json + len, sizeof(json) - len, "}");
+    if (len >= (int)sizeof(json)) {
+        ESP_LOGW(TAG, "Telemetry JSON truncated");
+        return httpd_resp_send_500(req);
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
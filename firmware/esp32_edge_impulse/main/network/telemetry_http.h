@@ -0,0 +1,46 @@
+#ifndef TELEMETRY_HTTP_H
+#define TELEMETRY_HTTP_H
+
+/* ============================================================
+ * telemetry_http.h - 裝置端遙測 HTTP 端點（TELEMETRY_HTTP）
+ * ESP-MIAO v0.8.0
+ *
+ * 機群健康檢查直接輪詢各 ESP32，不經 WebSocket / Server：
+ *   GET /telemetry      JSON（VAD、各階段耗時、喚醒延遲 SLO、heap、CPU、RSSI）
+ *   GET /telemetry.bin  TelemetrySnapshot 原始結構（telemetry_block.h）
+ * esp_http_server 的 Task 跑在 CORE_NET、最低優先權，最多 TELEMETRY_HTTP_MAX_SOCKETS 條連線；
+ * 內容只來自 telemetry_block 的 seqlock 快照，不碰音訊核心。兩次回應間隔短於
+ * TELEMETRY_HTTP_MIN_INTERVAL_MS 時回 429（Retry-After），輪詢再密也只佔固定的 CPU。
+ * ============================================================ */
+
+#include <stdint.h>
+#include "esp_http_server.h"
+#include "config.h"
+
+class TelemetryHttp {
+public:
+    TelemetryHttp();
+
+    /**
+     * 啟動 HTTP server（TELEMETRY_HTTP=0 時不動作）。
+     * @return true = 成功或已停用
+     */
+    bool start();
+
+    uint32_t served() const { return served_; }
+    uint32_t limited() const { return limited_; }
+
+private:
+    httpd_handle_t server_;
+    int64_t        last_us_;    // 上次回應的時間（僅 server Task 使用）
+    uint32_t       served_;
+    uint32_t       limited_;
+
+    /** 速率限制：true = 可回應；否則已送出 429 */
+    bool admit_(httpd_req_t *req);
+
+    static esp_err_t handle_json_(httpd_req_t *req);
+    static esp_err_t handle_bin_(httpd_req_t *req);
+};
+
+#endif // TELEMETRY_HTTP_H
@@ -0,0 +1,230 @@
+/*
+ * tls_transport.cpp - wss:// 的 TLS 傳輸層實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "tls_transport.h"
+#include "esp_crt_bundle.h"
+#include "esp_transport_ws.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "TlsTransport";
+
+#define TLS_NVS_NS       "storage"
+#define TLS_NVS_KEY_CERT "srv_cert"
+
+TlsTransport::TlsTransport()
+    : tls_(nullptr), slot_(0), pinned_pem_(nullptr), pinned_len_(0)
+{
+    memset(sessions_, 0, sizeof(sessions_));
+    memset(hostname_, 0, sizeof(hostname_));
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+esp_transport_handle_t TlsTransport::init()
+{
+    load_pinned_cert_();
+
+    esp_transport_handle_t tls = esp_transport_init();
+    if (!tls) return nullptr;
+    esp_transport_set_context_data(tls, this);
+    esp_transport_set_func(tls, connect_, read_, write_, close_, poll_read_, poll_write_, destroy_);
+    esp_transport_set_default_port(tls, 443);
+
+    esp_transport_handle_t ws = esp_transport_ws_init(tls);
+    if (!ws) {
+        esp_transport_destroy(tls);
+        return nullptr;
+    }
+    return ws;
+}
+
+void TlsTransport::select(int slot, const char *hostname)
+{
+    slot_ = slot >= 0 && slot < TLS_MAX_SESSIONS ? slot : 0;
+    snprintf(hostname_, sizeof(hostname_), "%s", hostname ? hostname : "");
+}
+
+void TlsTransport::forget_sessions()
+{
+    for (int i = 0; i < TLS_MAX_SESSIONS; i++) {
+        if (sessions_[i]) esp_tls_free_client_session(sessions_[i]);
+        sessions_[i] = nullptr;
+    }
+}
+
+esp_err_t TlsTransport::save_pinned_cert(const char *pem)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(TLS_NVS_NS, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) return err;
+    err = pem ? nvs_set_str(nvs, TLS_NVS_KEY_CERT, pem) : nvs_erase_key(nvs, TLS_NVS_KEY_CERT);
+    if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+    if (err == ESP_OK) err = nvs_commit(nvs);
+    nvs_close(nvs);
+    return err;
+}
+
+/* NVS "srv_cert" → RAM（ECDSA P-256 憑證約 700 bytes；開機一次，之後握手不再讀 flash） */
+void TlsTransport::load_pinned_cert_()
+{
+    nvs_handle_t nvs;
+    if (nvs_open(TLS_NVS_NS, NVS_READONLY, &nvs) != ESP_OK) return;
+    size_t len = 0;
+    if (nvs_get_str(nvs, TLS_NVS_KEY_CERT, nullptr, &len) == ESP_OK && len > 1) {
+        pinned_pem_ = static_cast<char *>(malloc(len));
+        if (pinned_pem_ && nvs_get_str(nvs, TLS_NVS_KEY_CERT, pinned_pem_, &len) == ESP_OK) {
+            pinned_len_ = len;
+        } else {
+            free(pinned_pem_);
+            pinned_pem_ = nullptr;
+        }
+    }
+    nvs_close(nvs);
+    ESP_LOGI(TAG, "Server certificate: %s", pinned_pem_ ? "pinned (NVS)" : "CA bundle");
+}
+
+void TlsTransport::close_tls_()
+{
+    if (tls_) esp_tls_conn_destroy(tls_);   // 同時關閉 socket
+    tls_ = nullptr;
+}
+
+/* 握手完成後取出 session（含 ticket）取代該端點的舊 session */
+void TlsTransport::store_session_()
+{
+    esp_tls_client_session_t *s = esp_tls_get_client_session(tls_);
+    if (!s) return;
+    if (sessions_[slot_]) esp_tls_free_client_session(sessions_[slot_]);
+    sessions_[slot_] = s;
+}
+
+/* ---------- esp_transport 回調 ---------- */
+
+TlsTransport *TlsTransport::self_(esp_transport_handle_t t)
+{
+    return static_cast<TlsTransport *>(esp_transport_get_context_data(t));
+}
+
+int TlsTransport::connect_(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    TlsTransport *self = self_(t);
+    self->close_tls_();
+    self->tls_ = esp_tls_init();
+    if (!self->tls_) return -1;
+
+    esp_tls_cfg_t cfg = {};
+    cfg.timeout_ms     = timeout_ms;
+    cfg.common_name    = self->hostname_[0] ? self->hostname_ : nullptr;   // host 為 IP
+    cfg.client_session = self->sessions_[self->slot_];
+    if (self->pinned_pem_) {
+        cfg.cacert_buf   = reinterpret_cast<const unsigned char *>(self->pinned_pem_);
+        cfg.cacert_bytes = self->pinned_len_;
+    } else {
+        cfg.crt_bundle_attach = esp_crt_bundle_attach;
+    }
+
+    bool offered = cfg.client_session != nullptr;
+    int64_t t0 = esp_timer_get_time();
+    if (esp_tls_conn_new_sync(host, (int)strlen(host), port, &cfg, self->tls_) != 1) {
+        ESP_LOGW(TAG, "TLS handshake with %s failed%s", host, offered ? " (session dropped)" : "");
+        /* Server 拒絕 ticket 時 mbedTLS 會自動改做完整握手；仍失敗則不再提供這個 session */
+        if (offered) {
+            esp_tls_free_client_session(self->sessions_[self->slot_]);
+            self->sessions_[self->slot_] = nullptr;
+        }
+        self->stats_.failures++;
+        self->close_tls_();
+        return -1;
+    }
+
+    TlsHandshakeStats &st = self->stats_;
+    st.last_ms      = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    st.last_offered = offered;
+    st.handshakes++;
+    if (offered) st.offered++;
+    ESP_LOGI(TAG, "TLS up in %u ms (%s)", (unsigned)st.last_ms,
+             offered ? "session offered" : "full handshake");
+    self->store_session_();
+    return 0;
+}
+
+int TlsTransport::poll_read_(esp_transport_handle_t t, int timeout_ms)
+{
+    TlsTransport *self = self_(t);
+    int fd = -1;
+    if (!self->tls_ || esp_tls_get_conn_sockfd(self->tls_, &fd) != ESP_OK || fd < 0) return -1;
+    if (esp_tls_get_bytes_avail(self->tls_) > 0) return 1;   // 已解密、尚未讀取的資料
+
+    fd_set rfds, efds;
+    FD_ZERO(&rfds);
+    FD_ZERO(&efds);
+    FD_SET(fd, &rfds);
+    FD_SET(fd, &efds);
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    int r = select(fd + 1, &rfds, nullptr, &efds, timeout_ms >= 0 ? &tv : nullptr);
+    if (r > 0 && FD_ISSET(fd, &efds)) return -1;
+    return r;
+}
+
+int TlsTransport::poll_write_(esp_transport_handle_t t, int timeout_ms)
+{
+    TlsTransport *self = self_(t);
+    int fd = -1;
+    if (!self->tls_ || esp_tls_get_conn_sockfd(self->tls_, &fd) != ESP_OK || fd < 0) return -1;
+
+    fd_set wfds, efds;
+    FD_ZERO(&wfds);
+    FD_ZERO(&efds);
+    FD_SET(fd, &wfds);
+    FD_SET(fd, &efds);
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    int r = select(fd + 1, nullptr, &wfds, &efds, timeout_ms >= 0 ? &tv : nullptr);
+    if (r > 0 && FD_ISSET(fd, &efds)) return -1;
+    return r;
+}
+
+int TlsTransport::read_(esp_transport_handle_t t, char *buf, int len, int timeout_ms)
+{
+    TlsTransport *self = self_(t);
+    int poll = poll_read_(t, timeout_ms);
+    if (poll < 0) return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    if (poll == 0) return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+
+    ssize_t n = esp_tls_conn_read(self->tls_, buf, len);
+    if (n == ESP_TLS_ERR_SSL_WANT_READ || n == ESP_TLS_ERR_SSL_TIMEOUT) return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    if (n == 0) return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    return (int)n;
+}
+
+int TlsTransport::write_(esp_transport_handle_t t, const char *buf, int len, int timeout_ms)
+{
+    TlsTransport *self = self_(t);
+    int poll = poll_write_(t, timeout_ms);
+    if (poll <= 0) return poll;
+
+    /* esp_tls_conn_write 會寫完全部（依 TLS record 上限分段） */
+    ssize_t n = esp_tls_conn_write(self->tls_, buf, len);
+    if (n == ESP_TLS_ERR_SSL_WANT_READ || n == ESP_TLS_ERR_SSL_WANT_WRITE) return 0;
+    return (int)n;
+}
+
+int TlsTransport::close_(esp_transport_handle_t t)
+{
+    self_(t)->close_tls_();
+    return 0;
+}
+
+int TlsTransport::destroy_(esp_transport_handle_t t)
+{
+    TlsTransport *self = self_(t);
+    self->close_tls_();
+    self->forget_sessions();
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef TLS_TRANSPORT_H
+#define TLS_TRANSPORT_H
+
+/* ============================================================
+ * tls_transport.h - wss:// 的 TLS 傳輸層（session 續用 + 釘選憑證）
+ * ESP-MIAO v0.8.0
+ *
+ * esp_websocket_client 內建的 SSL 傳輸每次連線都做完整握手（憑證鏈驗證 +
+ * ECDHE，ESP32 上數百 ms），重連時也一樣。這裡以 esp_tls 實作一個
+ * esp_transport，包上 WebSocket 傳輸後交給 client 作為 ext_transport：
+ *   - 每個端點保留最近一次握手的 TLS session（RAM），重連時以 session ticket
+ *     續用：省去憑證驗證與公鑰運算，只剩 1 RTT + 對稱運算
+ *   - Server 憑證釘選：NVS "srv_cert"（PEM）開機讀入 RAM 一次，每次握手直接使用；
+ *     未設定時改用 ESP-IDF 憑證包
+ *   - URI 的 host 已換成預先解析的 IP：SNI 與憑證名稱檢查改用原本的主機名稱
+ * 搭配 ECDSA P-256 Server 憑證與硬體加速 mbedTLS（sdkconfig.defaults），
+ * 完整握手也只有 RSA 憑證的一小部分時間。
+ * ============================================================ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_tls.h"
+#include "esp_transport.h"
+
+#ifndef TLS_MAX_SESSIONS
+#define TLS_MAX_SESSIONS 3   // 同 WS_MAX_ENDPOINTS：每個端點一個 session
+#endif
+
+/* 最近一次握手（由 WebSocket client Task 更新，隨 tls_stats 讀取） */
+struct TlsHandshakeStats {
+    uint32_t handshakes;   // 成功握手次數
+    uint32_t offered;      // 其中帶著快取 session 的次數（Server 接受時即為續用）
+    uint32_t failures;
+    uint32_t last_ms;      // 最近一次握手耗時（TCP connect + TLS）
+    bool     last_offered;
+};
+
+class TlsTransport {
+public:
+    TlsTransport();
+
+    /**
+     * 建立 TLS 傳輸與其上的 WebSocket 傳輸（esp_websocket_client_config_t::ext_transport）。
+     * 同時讀入 NVS 的釘選憑證。
+     * @return WebSocket 傳輸；失敗回傳 nullptr
+     */
+    esp_transport_handle_t init();
+
+    /**
+     * 下一次連線的端點（連線前由 WebSocketClient 設定）。
+     * @param slot     session 槽位（端點索引）
+     * @param hostname 原始主機名稱，用於 SNI 與憑證名稱檢查
+     */
+    void select(int slot, const char *hostname);
+
+    /** 丟棄所有快取的 session（例如 Server 更換憑證後） */
+    void forget_sessions();
+
+    /** NVS 釘選的憑證（PEM）；nullptr = 使用憑證包 */
+    const char *pinned_cert() const { return pinned_pem_; }
+
+    const TlsHandshakeStats &stats() const { return stats_; }
+
+    /**
+     * 儲存釘選的 Server 憑證（PEM，下次開機生效）；nullptr = 清除，改用憑證包。
+     */
+    static esp_err_t save_pinned_cert(const char *pem);
+
+private:
+    esp_tls_t                *tls_;
+    esp_tls_client_session_t *sessions_[TLS_MAX_SESSIONS];
+    int                       slot_;
+    char                      hostname_[64];
+    char                     *pinned_pem_;   // 開機讀入一次，之後每次握手共用
+    size_t                    pinned_len_;   // 含結尾 '\0'（mbedTLS 解析 PEM 的要求）
+    TlsHandshakeStats         stats_;
+
+    void load_pinned_cert_();
+    void close_tls_();
+    void store_session_();
+
+    static TlsTransport *self_(esp_transport_handle_t t);
+    static int connect_(esp_transport_handle_t t, const char *host, int port, int timeout_ms);
+    static int read_(esp_transport_handle_t t, char *buf, int len, int timeout_ms);
+    static int write_(esp_transport_handle_t t, const char *buf, int len, int timeout_ms);
+    static int poll_read_(esp_transport_handle_t t, int timeout_ms);
+    static int poll_write_(esp_transport_handle_t t, int timeout_ms);
+    static int close_(esp_transport_handle_t t);
+    static int destroy_(esp_transport_handle_t t);
+};
+
+#endif // TLS_TRANSPORT_H
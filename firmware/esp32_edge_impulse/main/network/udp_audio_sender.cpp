@@ -0,0 +1,87 @@
+/*
+ * udp_audio_sender.cpp - UDP 音訊上行實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "udp_audio_sender.h"
+#include "config.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <errno.h>
+#include <string.h>
+
+static const char *TAG = "UdpAudio";
+
+UdpAudioSender::UdpAudioSender() : fd_(-1), dropped_(0) {}
+
+UdpAudioSender::~UdpAudioSender()
+{
+    close();
+}
+
+bool UdpAudioSender::open(const char *ip, uint16_t port)
+{
+    close();
+    dropped_ = 0;
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) {
+        ESP_LOGE(TAG, "Bad server address %s", ip);
+        return false;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "socket() failed: errno %d", errno);
+        return false;
+    }
+    /* 語音優先：WMM AC_VO（DSCP EF），擁擠的 2.4 GHz 上較少排隊 */
+    int tos = STREAM_UDP_TOS;
+    setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "connect() failed: errno %d", errno);
+        ::close(fd);
+        return false;
+    }
+    fd_ = fd;
+    ESP_LOGI(TAG, "Audio uplink via UDP %s:%u", ip, (unsigned)port);
+    return true;
+}
+
+/* ---------- 送出 ---------- */
+
+bool UdpAudioSender::send(const uint8_t *data, size_t len)
+{
+    struct iovec iov = { (void *)data, len };
+    return send_iov(&iov, 1);
+}
+
+bool UdpAudioSender::send_iov(const struct iovec *iov, int count)
+{
+    if (fd_ < 0) return false;
+    size_t len = 0;
+    for (int i = 0; i < count; i++) len += iov[i].iov_len;
+
+    struct msghdr msg = {};
+    msg.msg_iov    = (struct iovec *)iov;
+    msg.msg_iovlen = count;
+    for (int attempt = 0; attempt <= STREAM_UDP_SEND_RETRIES; attempt++) {
+        if (::sendmsg(fd_, &msg, 0) == (ssize_t)len) return true;
+        /* ENOMEM = WiFi TX 緩衝已滿，稍候即可；其餘錯誤不重試 */
+        if (errno != ENOMEM && errno != EAGAIN) break;
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+    dropped_++;
+    return false;
+}
+
+void UdpAudioSender::close()
+{
+    if (fd_ < 0) return;
+    ::close(fd_);
+    fd_ = -1;
+}
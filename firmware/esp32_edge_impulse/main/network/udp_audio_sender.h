@@ -0,0 +1,57 @@
+#ifndef UDP_AUDIO_SENDER_H
+#define UDP_AUDIO_SENDER_H
+
+/* ============================================================
+ * udp_audio_sender.h - UDP 音訊上行（RTP 式：序號 + 時間戳，不重傳）
+ * ESP-MIAO v0.8.0
+ *
+ * WebSocket 上行每個 frame 都要逐 byte mask，且走 TCP：一個封包遺失，
+ * 其後整段串流都要等重傳（head-of-line blocking）。UDP 模式下
+ * audio_start / audio_end 等控制訊息仍走 WebSocket，音訊 frame
+ * （StreamChunkHeader + payload，格式同 binary 模式）改以 datagram
+ * 送到 Server 的 UDP_AUDIO_PORT；遺失的 frame 由 Server 依 seq /
+ * sample_offset 以 jitter buffer 重排並做遺失補償，不重送。
+ * ============================================================ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+class UdpAudioSender {
+public:
+    UdpAudioSender();
+    ~UdpAudioSender();
+
+    /**
+     * 建立 socket 並 connect 到 Server（只設定預設目的地，不交握）。
+     * @param ip   Server IPv4（WebSocketClient::server_ip）
+     * @param port Server UDP 埠（STREAM_UDP_PORT）
+     * @return false = 建立失敗，呼叫端改走 WebSocket
+     */
+    bool open(const char *ip, uint16_t port);
+
+    bool is_open() const { return fd_ >= 0; }
+
+    /**
+     * 送出一個 datagram；WiFi 驅動緩衝已滿（ENOMEM）時短暫重試。
+     * @return false = 未送出（該 frame 視為遺失，不中止串流）
+     */
+    bool send(const uint8_t *data, size_t len);
+
+    /**
+     * 由多段資料組成一個 datagram 送出（sendmsg，不先複製成連續緩衝）。
+     * @return false = 未送出（同 send）
+     */
+    bool send_iov(const struct iovec *iov, int count);
+
+    void close();
+
+    /** 本次開啟後未能送出的 frame 數 */
+    uint32_t dropped() const { return dropped_; }
+
+private:
+    int      fd_;
+    uint32_t dropped_;
+};
+
+#endif // UDP_AUDIO_SENDER_H
@@ -0,0 +1,118 @@
+/*
+ * wake_ack_client.cpp - 喚醒 ACK 非同步送出實作
+ * ESP-MIAO v0.8.0
+ */
+
+#include "wake_ack_client.h"
+#include "config.h"
+#include "rtos_alloc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "WakeAck";
+
+WakeAckClient::WakeAckClient(WebSocketClient &ws, AudioPlayer &player)
+    : ws_(ws), player_(player), q_(nullptr), http_(nullptr)
+{
+    url_[0] = '\0';
+}
+
+bool WakeAckClient::init()
+{
+    if (q_) return true;
+    q_ = RTOS_QUEUE_CREATE(1, sizeof(float));
+    if (!q_ ||
+        RTOS_TASK_CREATE(task_entry_, "wake_ack", WAKE_ACK_TASK_STACK, this,
+                         WAKE_ACK_TASK_PRIO, nullptr, WAKE_ACK_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start ACK task");
+        return false;
+    }
+    return true;
+}
+
+void WakeAckClient::notify(float confidence)
+{
+    player_.chirp();   // 本機提示音：不等網路
+    if (!q_) return;
+    xQueueOverwrite(q_, &confidence);
+}
+
+void WakeAckClient::task_entry_(void *arg)
+{
+    auto *self = static_cast<WakeAckClient *>(arg);
+    float confidence;
+    while (1) {
+        if (xQueueReceive(self->q_, &confidence, portMAX_DELAY) == pdTRUE) {
+            self->send_(confidence);
+        }
+    }
+}
+
+void WakeAckClient::send_(float confidence)
+{
+    /* 1. 已開啟的 WebSocket：無需新的 TCP 連線 */
+    if (ws_.is_connected()) {
+        char json[224];
+        int  len;
+        if (player_.enabled()) {
+            len = snprintf(json, sizeof(json),
+                           "{\"device_id\":\"%s\",\"timestamp\":%lld,\"type\":\"wake_detected\","
+                           "\"payload\":{\"confidence\":%.3f,\"chirp\":true,\"playback_format\":\"%s\"}}",
+                           DEVICE_ID, (long long)(esp_timer_get_time() / 1000), confidence,
+                           SPK_DOWNLINK_FORMAT);
+        } else {
+            len = snprintf(json, sizeof(json),
+                           "{\"device_id\":\"%s\",\"timestamp\":%lld,\"type\":\"wake_detected\","
+                           "\"payload\":{\"confidence\":%.3f}}",
+                           DEVICE_ID, (long long)(esp_timer_get_time() / 1000), confidence);
+        }
+        if (ws_.send_text(json, (size_t)len, pdMS_TO_TICKS(WAKE_ACK_WS_TIMEOUT_MS))) {
+            ESP_LOGI(TAG, "OK via WebSocket");
+            return;
+        }
+        ESP_LOGW(TAG, "WebSocket send failed, falling back to HTTP");
+    }
+
+    /* 2. 常駐 keep-alive HTTP 連線 */
+    send_http_();
+}
+
+bool WakeAckClient::send_http_()
+{
+    char url[sizeof(url_)];
+    /* 已在本機播放提示音：Server 只記錄，不再播放 */
+    if (!ws_.http_url(player_.enabled() ? ACK_PATH "?chirp=1" : ACK_PATH, url, sizeof(url))) {
+        ESP_LOGE(TAG, "No server address for HTTP ACK");
+        return false;
+    }
+    if (http_ && strcmp(url, url_) != 0) {   // 端點已切換
+        esp_http_client_cleanup(http_);
+        http_ = nullptr;
+    }
+    if (!http_) {
+        memcpy(url_, url, sizeof(url_));
+        esp_http_client_config_t cfg = {};
+        cfg.url               = url_;
+        cfg.method            = HTTP_METHOD_GET;
+        cfg.timeout_ms        = WAKE_ACK_HTTP_TIMEOUT_MS;
+        cfg.keep_alive_enable = true;
+        ws_.apply_tls(cfg);
+        http_ = esp_http_client_init(&cfg);
+        if (!http_) { ESP_LOGE(TAG, "HTTP init failed"); return false; }
+    }
+
+    esp_err_t err = esp_http_client_perform(http_);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "OK via HTTP status=%d", (int)esp_http_client_get_status_code(http_));
+        return true;
+    }
+
+    /* 連線已失效：丟棄，下次重建 */
+    ESP_LOGE(TAG, "HTTP FAILED: %s", esp_err_to_name(err));
+    esp_http_client_cleanup(http_);
+    http_ = nullptr;
+    return false;
+}
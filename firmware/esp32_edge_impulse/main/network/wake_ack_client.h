@@ -0,0 +1,49 @@
+#ifndef WAKE_ACK_CLIENT_H
+#define WAKE_ACK_CLIENT_H
+
+/* ============================================================
+ * wake_ack_client.h - 喚醒 ACK（Server 端提示音）非同步送出
+ * ESP-MIAO v0.8.0
+ *
+ * 呼叫端只排入請求即返回；ACK Task 優先以已連線的 WebSocket 送出
+ * wake_detected 文字訊息，斷線時改用常駐 keep-alive HTTP 連線
+ * （目前 WebSocket 端點的 host:port + ACK_PATH）。
+ * 裝置有喇叭（SPEAKER_ENABLE）時提示音於 notify() 當下在本機播放，
+ * wake_detected 附 chirp / playback_format，Server 不再播放並改將回饋音串流到裝置。
+ * ============================================================ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_http_client.h"
+#include "websocket_client.h"
+#include "audio_player.h"
+
+class WakeAckClient {
+public:
+    WakeAckClient(WebSocketClient &ws, AudioPlayer &player);
+
+    /**
+     * 建立 ACK Task 與請求佇列。
+     * @return true = 成功
+     */
+    bool init();
+
+    /**
+     * 排入一筆 ACK（不阻塞；尚未送出的舊請求會被覆寫）。
+     * @param confidence 喚醒信心值（附帶於 wake_detected）
+     */
+    void notify(float confidence);
+
+private:
+    WebSocketClient          &ws_;
+    AudioPlayer              &player_;
+    QueueHandle_t             q_;
+    esp_http_client_handle_t  http_;       // 常駐連線，僅 ACK Task 使用
+    char                      url_[64];    // http_ 對應的 URL（端點切換時重建）
+
+    static void task_entry_(void *arg);
+    void send_(float confidence);
+    bool send_http_();
+};
+
+#endif // WAKE_ACK_CLIENT_H
@@ -5,17 +5,101 @@
 
 #include "websocket_client.h"
 #include "config.h"
+#include "rtos_alloc.h"
+#include "trace_points.h"
+#include "nvs_writer.h"
+#include "esp_crt_bundle.h"
 #include "esp_log.h"
-#include <string.h>
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "nvs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 static const char *TAG = "WebSocketClient";
 
+#define WS_NVS_NS       "storage"
+#define WS_NVS_KEY_URIS "srv_urls"
+#define WS_NVS_KEY_MGD  "srv_managed"   // u8：1 = srv_urls 由 Server 下發（server_list）
+
+/* 監督 Task 事件位元 */
+#define WS_EVT_UP    (1 << 0)   // 已連線
+#define WS_EVT_DOWN  (1 << 1)   // 斷線事件（喚醒監督 Task）
+#define WS_EVT_KICK  (1 << 2)   // 要求立即重試（略過退避）
+#define WS_EVT_FOUND (1 << 3)   // mDNS 找到新的 Server 位址
+#define WS_EVT_LIST  (1 << 4)   // Server 下發新的端點清單（set_endpoints）
+#define WS_EVT_ACTIVE (1 << 5)  // 閒置中出現語音活動（note_activity）
+
+/* 重連耗時分布上界（ms）；超過最後一個上界歸入最後一格 */
+static const uint32_t kReconnectBucketMs[WS_RECONNECT_BUCKETS - 1] = {
+    100, 250, 500, 1000, 2000, 5000,
+};
+
 WebSocketClient::WebSocketClient()
-    : client_(nullptr), connected_(false), on_data_(nullptr)
-{}
+    : client_(nullptr), connected_(false), on_data_(nullptr), on_binary_(nullptr), tx_lock_(nullptr),
+#if WS_TLS
+      use_tls_(false),
+#endif
+      endpoint_count_(0), active_(0), managed_(false), uris_lock_(portMUX_INITIALIZER_UNLOCKED),
+      events_(nullptr), last_rx_us_(0), last_bin_tx_us_(0), last_probe_us_(0),
+      last_hb_us_(0), down_since_us_(0),
+      next_attempt_us_(0), backoff_ms_(WS_BACKOFF_MIN_MS), fail_streak_(0), hb_seq_(0),
+      last_activity_us_(0), quiet_(false), parked_(false), active_since_us_(0),
+      rx_len_(0), rx_active_(false), rx_binary_(false), rx_overflow_(false)
+{
+    memset(endpoints_, 0, sizeof(endpoints_));
+    memset(&stats_, 0, sizeof(stats_));
+    uris_[0]         = '\0';
+    pending_uris_[0] = '\0';
+}
+
+/* ---------- 下行訊息重組 ---------- */
+
+void WebSocketClient::on_rx_(const esp_websocket_event_data_t *ev)
+{
+    /* op_code=1: text / 2: binary frame 起始；0: continuation；其餘（ping=9, pong=10 等）忽略 */
+    if ((ev->op_code == 1 || ev->op_code == 2) && ev->payload_offset == 0) {
+        rx_len_      = 0;
+        rx_active_   = true;
+        rx_binary_   = ev->op_code == 2;
+        rx_overflow_ = false;
+    } else if (!rx_active_ || (ev->op_code != 1 && ev->op_code != 0)) {
+        return;
+    }
+
+    if (ev->data_len > 0 && !rx_overflow_) {
+        if (rx_len_ + ev->data_len < sizeof(rx_buf_)) {
+            memcpy(rx_buf_ + rx_len_, ev->data_ptr, ev->data_len);
+            rx_len_ += ev->data_len;
+        } else {
+            rx_overflow_ = true;
+        }
+    }
+
+    /* 單一 frame 可能被 client 分多次事件交付（payload_offset 遞增） */
+    bool frame_done = ev->payload_offset + ev->data_len >= ev->payload_len;
+    if (!frame_done || !ev->fin) return;
+
+    rx_active_ = false;
+    if (rx_overflow_) {
+        ESP_LOGW(TAG, "Message exceeds %d bytes, dropped", WS_RX_BUFFER_SIZE);
+        return;
+    }
+    if (rx_len_ == 0) return;
+    if (rx_binary_) {
+        if (on_binary_) on_binary_(reinterpret_cast<const uint8_t *>(rx_buf_), rx_len_);
+    } else if (on_data_) {
+        rx_buf_[rx_len_] = '\0';
+        on_data_(rx_buf_);
+    }
+}
 
 /* ---------- static event handler ---------- */
 
@@ -28,30 +112,30 @@ void WebSocketClient::event_handler_(void *arg, esp_event_base_t base,
     switch (id) {
         case WEBSOCKET_EVENT_CONNECTED:
             ESP_LOGI(TAG, "WEBSOCKET_EVENT_CONNECTED");
-            self->connected_ = true;
+            self->last_rx_us_ = esp_timer_get_time();
+            self->connected_  = true;
+            xEventGroupSetBits(self->events_, WS_EVT_UP);
             break;
 
         case WEBSOCKET_EVENT_DISCONNECTED:
             ESP_LOGW(TAG, "WEBSOCKET_EVENT_DISCONNECTED");
             self->connected_ = false;
+            self->rx_active_ = false;
+            xEventGroupClearBits(self->events_, WS_EVT_UP);
+            xEventGroupSetBits(self->events_, WS_EVT_DOWN);
             break;
 
         case WEBSOCKET_EVENT_DATA:
-            /* op_code=1: text frame，其餘（binary=2, ping=9, pong=10 等）忽略 */
-            if (ev->op_code == 1 && ev->data_len > 0 && self->on_data_) {
-                char *buf = static_cast<char *>(malloc(ev->data_len + 1));
-                if (buf) {
-                    memcpy(buf, ev->data_ptr, ev->data_len);
-                    buf[ev->data_len] = '\0';
-                    self->on_data_(buf);
-                    free(buf);
-                }
-            }
+            /* 任何資料（含 pong / heartbeat_ack）都代表鏈路存活 */
+            self->last_rx_us_ = esp_timer_get_time();
+            self->on_rx_(ev);
             break;
 
         case WEBSOCKET_EVENT_ERROR:
             ESP_LOGE(TAG, "WEBSOCKET_EVENT_ERROR: op_code=%d", ev->op_code);
             self->connected_ = false;
+            xEventGroupClearBits(self->events_, WS_EVT_UP);
+            xEventGroupSetBits(self->events_, WS_EVT_DOWN);
             break;
 
         default:
@@ -61,53 +145,665 @@ void WebSocketClient::event_handler_(void *arg, esp_event_base_t base,
 
 /* ---------- init ---------- */
 
-void WebSocketClient::init(const char *uri)
+void WebSocketClient::init(const char *default_uris)
+{
+    /* 端點清單：NVS 優先；未設定時寫入預設值（之後可由 save_endpoints() 覆寫） */
+    char uris[WS_MAX_ENDPOINTS * 128];
+    size_t len = sizeof(uris);
+    nvs_handle_t nvs;
+    bool from_nvs = false;
+    uint8_t managed = 0;
+    if (nvs_open(WS_NVS_NS, NVS_READONLY, &nvs) == ESP_OK) {
+        from_nvs = nvs_get_str(nvs, WS_NVS_KEY_URIS, uris, &len) == ESP_OK;
+        nvs_get_u8(nvs, WS_NVS_KEY_MGD, &managed);
+        nvs_close(nvs);
+    }
+    if (!from_nvs) nvs_writer_set_str(WS_NVS_NS, WS_NVS_KEY_URIS, default_uris);
+    if (!from_nvs || parse_endpoints_(uris) == 0) {
+        parse_endpoints_(default_uris);
+        snprintf(uris, sizeof(uris), "%s", default_uris);
+        managed = 0;
+    }
+    memcpy(uris_, uris, sizeof(uris_));
+    managed_ = managed != 0;
+
+    for (int i = 0; i < endpoint_count_; i++) {
+        ESP_LOGI(TAG, "Endpoint %d: %s", i, endpoints_[i].uri);
+    }
+    events_  = RTOS_EVENT_GROUP_CREATE();
+    tx_lock_ = RTOS_MUTEX_CREATE();
+#if WS_DISCOVERY
+    discovery_.init(&WebSocketClient::on_discovered_, this);
+#endif
+}
+
+#if WS_DISCOVERY
+void WebSocketClient::on_discovered_(void *arg)
+{
+    WebSocketClient *self = static_cast<WebSocketClient *>(arg);
+    if (self->events_) xEventGroupSetBits(self->events_, WS_EVT_FOUND);
+}
+#endif
+
+esp_err_t WebSocketClient::save_endpoints(const char *uris)
+{
+    /* 手動佈建：排入後立即寫出，蓋過尚未寫出的 Server 下發清單 */
+    esp_err_t err = nvs_writer_set_str(WS_NVS_NS, WS_NVS_KEY_URIS, uris);
+    if (err == ESP_OK) err = nvs_writer_set_u8(WS_NVS_NS, WS_NVS_KEY_MGD, 0);   // 恢復 mDNS 位址
+    if (err == ESP_OK) err = nvs_writer_flush();
+    return err;
+}
+
+void WebSocketClient::set_endpoints(const char *uris)
+{
+    if (!uris || !uris[0] || strlen(uris) >= sizeof(pending_uris_) || !events_) return;
+    taskENTER_CRITICAL(&uris_lock_);
+    bool same = strcmp(uris, uris_) == 0;
+    if (!same) memcpy(pending_uris_, uris, strlen(uris) + 1);
+    taskEXIT_CRITICAL(&uris_lock_);
+    if (!same) xEventGroupSetBits(events_, WS_EVT_LIST);
+}
+
+/* 監督 Task：套用 pending_uris_，沿用目前連線所在的端點 */
+void WebSocketClient::apply_endpoints_()
+{
+    char uris[sizeof(pending_uris_)];
+    taskENTER_CRITICAL(&uris_lock_);
+    memcpy(uris, pending_uris_, sizeof(uris));
+    taskEXIT_CRITICAL(&uris_lock_);
+
+    char current[sizeof(endpoints_[0].uri)];
+    memcpy(current, endpoints_[active_].uri, sizeof(current));
+    if (parse_endpoints_(uris) == 0) {   // 全部無效（URI 過長）：保留原清單
+        ESP_LOGW(TAG, "Server endpoint list rejected");
+        parse_endpoints_(uris_);
+        return;
+    }
+    taskENTER_CRITICAL(&uris_lock_);
+    memcpy(uris_, uris, sizeof(uris_));
+    taskEXIT_CRITICAL(&uris_lock_);
+    managed_ = true;
+
+    /* 目前連線所在的端點不在新清單中時 active_ 為 0：連線照常使用，下次重連改用新清單 */
+    for (int i = 0; i < endpoint_count_; i++) {
+        if (strcmp(endpoints_[i].uri, current) == 0) active_ = i;
+    }
+    resolve_all_();
+    last_probe_us_ = 0;   // 下一個心跳週期即依新順序探測
+
+    if (nvs_writer_set_str(WS_NVS_NS, WS_NVS_KEY_URIS, uris) == ESP_OK) {
+        nvs_writer_set_u8(WS_NVS_NS, WS_NVS_KEY_MGD, 1);
+    }
+    ESP_LOGI(TAG, "Endpoint list from server: %s (active %d)", uris, (int)active_);
+}
+
+/* 逗號分隔 → endpoints_（去除空白；超過 WS_MAX_ENDPOINTS 的部分忽略） */
+int WebSocketClient::parse_endpoints_(const char *uris)
+{
+    endpoint_count_ = 0;
+    const char *p = uris;
+    while (*p && endpoint_count_ < WS_MAX_ENDPOINTS) {
+        p += strspn(p, " ,");
+        size_t n = strcspn(p, ",");
+        size_t end = n;
+        while (end > 0 && p[end - 1] == ' ') end--;
+        if (end > 0 && end < sizeof(endpoints_[0].uri)) {
+            WsEndpoint &ep = endpoints_[endpoint_count_++];
+            memset(&ep, 0, sizeof(ep));
+            memcpy(ep.uri, p, end);
+            snprintf(ep.resolved, sizeof(ep.resolved), "%s", ep.uri);
+            ep.rtt_us = -1;
+        } else if (end > 0) {
+            ESP_LOGW(TAG, "Endpoint URI too long, skipped");
+        }
+        p += n;
+    }
+    active_ = 0;
+    return endpoint_count_;
+}
+
+void WebSocketClient::start()
 {
+    if (client_ || !events_ || endpoint_count_ == 0) return;
+    resolve_all_();
+#if WS_DISCOVERY
+    /* 沒有快取：背景查詢，先以 SERVER_URLS 的位址連線（不等 mDNS） */
+    char ip[16];
+    uint16_t port;
+    if (!discovery_.address(ip, sizeof(ip), &port)) discovery_.request();
+#endif
+    if (endpoint_count_ > 1) {
+        int best = probe_best_();
+        active_  = best >= 0 ? best : 0;
+    }
+    last_probe_us_ = esp_timer_get_time();
+    const WsEndpoint &ep = endpoints_[active_];
+
+    /* 自動重連關閉：改由監督 Task 以指數退避重連 */
     esp_websocket_client_config_t ws_cfg = {};
-    ws_cfg.uri                   = uri;
-    ws_cfg.reconnect_timeout_ms  = 5000;
+    ws_cfg.uri                   = ep.resolved;
     ws_cfg.network_timeout_ms    = 5000;
-    ws_cfg.ping_interval_sec     = 5;
-    ws_cfg.disable_auto_reconnect = false;
+    ws_cfg.ping_interval_sec     = WS_PING_INTERVAL_S;
+    ws_cfg.disable_auto_reconnect = true;
+    ws_cfg.task_prio             = WS_CLIENT_TASK_PRIO;   // 不可綁核，優先權需低於推論
+    ws_cfg.task_stack            = WS_CLIENT_TASK_STACK;
+    if (WS_BINARY_CONTROL) ws_cfg.subprotocol = WS_CONTROL_SUBPROTOCOL;   // 舊 Server 忽略，照常送 JSON
+#if WS_TLS
+    /* 同一個 client 只有一個傳輸層：依第一個端點決定，全部端點需同為 ws:// 或 wss:// */
+    if (endpoints_[0].tls) {
+        ws_cfg.ext_transport = tls_.init();
+        use_tls_ = ws_cfg.ext_transport != nullptr;
+        if (!use_tls_) ESP_LOGE(TAG, "TLS transport init failed, using the built-in one");
+        for (int i = 1; i < endpoint_count_; i++) {
+            if (!endpoints_[i].tls) ESP_LOGW(TAG, "Endpoint %d is not wss://, it will not connect", i);
+        }
+        tls_.select(active_, ep.host);
+    }
+#endif
 
     client_ = esp_websocket_client_init(&ws_cfg);
     esp_websocket_register_events(client_, WEBSOCKET_EVENT_ANY,
                                   &WebSocketClient::event_handler_, this);
     esp_websocket_client_start(client_);
-    ESP_LOGI(TAG, "WebSocket started: %s", uri);
+    ESP_LOGI(TAG, "WebSocket started: %s (endpoint %d)", ep.resolved, (int)active_);
+
+    /* 首次連線交給 client 本身；逾時後才由監督 Task 接手 */
+    next_attempt_us_ = esp_timer_get_time() + (int64_t)WS_CONNECT_TIMEOUT_MS * 1000;
+    if (RTOS_TASK_CREATE(supervisor_entry_, "ws_supervisor", WS_SUPERVISOR_TASK_STACK,
+                         this, WS_SUPERVISOR_TASK_PRIO, nullptr,
+                         WS_SUPERVISOR_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start supervisor task");
+    }
 }
 
-/* ---------- send ---------- */
+bool WebSocketClient::http_url(const char *path, char *out, size_t cap) const
+{
+    const WsEndpoint &ep = endpoints_[active_];
+    if (!ep.ip[0]) return false;
+    return snprintf(out, cap, "%s://%s:%u%s", ep.tls ? "https" : "http",
+                    ep.ip, (unsigned)ep.port, path) < (int)cap;
+}
 
-bool WebSocketClient::send_text(const char *data, size_t len)
+void WebSocketClient::apply_tls(esp_http_client_config_t &cfg) const
 {
-    if (!client_ || !connected_) return false;
-    return esp_websocket_client_send_text(client_, data, (int)len, portMAX_DELAY) >= 0;
+    const WsEndpoint &ep = endpoints_[active_];
+    if (!ep.tls) return;
+    cfg.common_name = ep.host;
+#if WS_TLS
+    if (tls_.pinned_cert()) {
+        cfg.cert_pem = tls_.pinned_cert();
+        return;
+    }
+#endif
+    cfg.crt_bundle_attach = esp_crt_bundle_attach;
 }
 
-bool WebSocketClient::send_binary(const char *data, size_t len)
+bool WebSocketClient::server_ip(char *out, size_t cap) const
 {
-    if (!client_ || !connected_) return false;
-    return esp_websocket_client_send_bin(client_, data, (int)len, portMAX_DELAY) >= 0;
+    const WsEndpoint &ep = endpoints_[active_];
+    if (!ep.ip[0]) return false;
+    return snprintf(out, cap, "%s", ep.ip) < (int)cap;
 }
 
-/* ---------- emergency reconnect ---------- */
+/* ---------- 預先解析 Server 位址 ---------- */
 
-bool WebSocketClient::emergency_reconnect(uint32_t wait_ms)
+/* 將 ep.uri 的 host 換成 IPv4 位址寫入 ep.resolved；失敗時沿用上次結果 */
+bool WebSocketClient::resolve_(WsEndpoint &ep)
 {
-    if (!client_) return false;
-    ESP_LOGW(TAG, "Emergency reconnect...");
+    const char *host = strstr(ep.uri, "://");
+    bool tls = strncmp(ep.uri, "wss://", 6) == 0;
+    host = host ? host + 3 : ep.uri;
+    size_t host_len = strcspn(host, ":/");
+    ep.port = host[host_len] == ':' ? (uint16_t)atoi(host + host_len + 1) : (tls ? 443 : 80);
+    ep.tls  = tls;
+    char *name = ep.host;
+    if (host_len == 0 || host_len >= sizeof(ep.host)) return false;
+    memcpy(name, host, host_len);
+    name[host_len] = '\0';
+
+#if WS_DISCOVERY
+    /* 第一個端點：使用 mDNS 找到（或 NVS 快取）的位址，主機名稱仍供 TLS 使用 */
+    char     disc_ip[16];
+    uint16_t disc_port;
+    if (!managed_ && &ep == &endpoints_[0] && discovery_.address(disc_ip, sizeof(disc_ip), &disc_port)) {
+        const char *path = host + host_len + strcspn(host + host_len, "/");
+        snprintf(ep.resolved, sizeof(ep.resolved), "%.*s%s:%u%s",
+                 (int)(host - ep.uri), ep.uri, disc_ip, (unsigned)disc_port, path);
+        memcpy(ep.ip, disc_ip, sizeof(ep.ip));
+        ep.port = disc_port;
+        return true;
+    }
+#endif
+
+    struct addrinfo hints = {};
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *res = nullptr;
+    int64_t t0 = esp_timer_get_time();
+    if (getaddrinfo(name, nullptr, &hints, &res) != 0 || !res) {
+        ESP_LOGW(TAG, "DNS lookup failed for %s", name);
+        return false;
+    }
+
+    char ip[16];
+    inet_ntop(AF_INET, &((struct sockaddr_in *)res->ai_addr)->sin_addr, ip, sizeof(ip));
+    freeaddrinfo(res);
+    snprintf(ep.resolved, sizeof(ep.resolved), "%.*s%s%s",
+             (int)(host - ep.uri), ep.uri, ip, host + host_len);
+    memcpy(ep.ip, ip, sizeof(ep.ip));
+    ESP_LOGI(TAG, "Resolved %s -> %s (%lld ms)", name, ip,
+             (long long)((esp_timer_get_time() - t0) / 1000));
+    return true;
+}
+
+void WebSocketClient::resolve_all_()
+{
+    for (int i = 0; i < endpoint_count_; i++) resolve_(endpoints_[i]);
+}
+
+/* ---------- 端點探測與選擇 ---------- */
+
+/* 非阻塞 TCP connect 耗時（≈ 1 RTT + accept 延遲）；-1 = 逾時 / 不可達 */
+int32_t WebSocketClient::probe_(const WsEndpoint &ep) const
+{
+    if (!ep.ip[0]) return -1;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(ep.port);
+    if (inet_pton(AF_INET, ep.ip, &addr.sin_addr) != 1) return -1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) return -1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    int32_t rtt = -1;
+    int64_t t0  = esp_timer_get_time();
+    int r = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (r == 0) {
+        rtt = (int32_t)(esp_timer_get_time() - t0);
+    } else if (errno == EINPROGRESS) {
+        fd_set wfds;
+        FD_ZERO(&wfds);
+        FD_SET(fd, &wfds);
+        struct timeval tv = { WS_PROBE_TIMEOUT_MS / 1000, (WS_PROBE_TIMEOUT_MS % 1000) * 1000 };
+        if (select(fd + 1, nullptr, &wfds, nullptr, &tv) == 1) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err == 0) rtt = (int32_t)(esp_timer_get_time() - t0);
+        }
+    }
+    close(fd);
+    return rtt;
+}
+
+/* 探測全部端點，回傳分數最佳者（RTT + 優先序偏置）；全部不可達回傳 -1 */
+int WebSocketClient::probe_best_()
+{
+    int best = -1;
+    int64_t best_score = 0;
+    for (int i = 0; i < endpoint_count_; i++) {
+        WsEndpoint &ep = endpoints_[i];
+        if (!ep.ip[0]) resolve_(ep);
+        ep.rtt_us = probe_(ep);
+        ESP_LOGD(TAG, "Probe endpoint %d: %ld us", i, (long)ep.rtt_us);
+        if (ep.rtt_us < 0) continue;
+        int64_t score = ep.rtt_us + (int64_t)i * WS_ENDPOINT_BIAS_MS * 1000;
+        if (best < 0 || score < best_score) {
+            best       = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+/* 在線時定期探測：有更佳端點且上行閒置時切換（回傳 true = 已中斷目前連線） */
+bool WebSocketClient::maybe_failback_(int64_t now)
+{
+    if (endpoint_count_ < 2) return false;
+    if (now - last_probe_us_ < (int64_t)WS_PROBE_INTERVAL_S * 1000000) return false;
+    if (now - last_bin_tx_us_ < (int64_t)WS_SWITCH_IDLE_MS * 1000) return false;   // 串流中延後
+    last_probe_us_ = now;
+
+    int cur  = active_;
+    int best = probe_best_();
+    if (best < 0 || best == cur) return false;
+    const WsEndpoint &a = endpoints_[cur];
+    const WsEndpoint &b = endpoints_[best];
+    int64_t cur_score  = a.rtt_us < 0 ? INT64_MAX
+                                      : a.rtt_us + (int64_t)cur * WS_ENDPOINT_BIAS_MS * 1000;
+    int64_t best_score = b.rtt_us + (int64_t)best * WS_ENDPOINT_BIAS_MS * 1000;
+    if (best_score + (int64_t)WS_FAILBACK_MARGIN_MS * 1000 >= cur_score) return false;
+
+    ESP_LOGI(TAG, "Switching endpoint %d (%ld us) -> %d (%ld us)",
+             cur, (long)a.rtt_us, best, (long)b.rtt_us);
+    stats_.failovers++;
+    active_    = best;
+    connected_ = false;
+    xEventGroupClearBits(events_, WS_EVT_UP);
+    return true;
+}
+
+/* ---------- 連線監督 Task ---------- */
+
+void WebSocketClient::supervisor_entry_(void *arg)
+{
+    static_cast<WebSocketClient *>(arg)->supervise_();
+}
+
+void WebSocketClient::supervise_()
+{
+    bool was_up = false;
+    last_activity_us_ = esp_timer_get_time();   // 開機視為活躍
+    while (1) {
+        /* 在線：每個心跳週期醒來；斷線：等到下一次嘗試時間（斷線 / KICK 事件提早喚醒）；
+         * 閒置斷線：等到有語音活動或 session */
+        const bool quiet  = quiet_.load(std::memory_order_relaxed);
+        TickType_t wait   = pdMS_TO_TICKS(quiet ? WS_HEARTBEAT_IDLE_MS : WS_HEARTBEAT_MS);
+        if (parked_.load(std::memory_order_relaxed)) {
+            wait = portMAX_DELAY;
+        } else if (!is_connected()) {
+            int64_t left_us = next_attempt_us_ - esp_timer_get_time();
+            wait = left_us > 0 ? pdMS_TO_TICKS(left_us / 1000) : 0;
+        }
+        EventBits_t bits = xEventGroupWaitBits(events_, WS_EVT_DOWN | WS_EVT_KICK | WS_EVT_FOUND | WS_EVT_LIST |
+                                                        WS_EVT_ACTIVE,
+                                               pdTRUE, pdFALSE, wait);
+        int64_t now = esp_timer_get_time();
+
+        if (bits & WS_EVT_LIST) apply_endpoints_();
+
+        /* 新位址：更新第一個端點；目前連線正常時沿用，下次重連才使用 */
+        if (bits & WS_EVT_FOUND) {
+            resolve_(endpoints_[0]);
+            ESP_LOGI(TAG, "Endpoint 0 now %s", endpoints_[0].resolved);
+            if (!is_connected()) {
+                active_          = 0;
+                next_attempt_us_ = now;
+            }
+        }
+
+        if (parked_.load(std::memory_order_relaxed)) {
+            if (!(bits & (WS_EVT_KICK | WS_EVT_ACTIVE))) continue;
+            parked_.store(false, std::memory_order_release);
+            ESP_LOGI(TAG, "Activity after idle disconnect, reconnecting");
+            backoff_ms_      = WS_BACKOFF_MIN_MS;
+            next_attempt_us_ = now;
+        }
+        update_keepalive_(now);
+
+        if (is_connected()) {
+            /* 剛回到活躍時上一筆下行可能已是閒置心跳之前：逾時自回到活躍起算 */
+            const bool    idle    = quiet_.load(std::memory_order_relaxed);
+            const int64_t rx_ref  = last_rx_us_ > active_since_us_ ? (int64_t)last_rx_us_ : active_since_us_;
+            const int64_t timeout = (int64_t)(idle ? WS_LINK_TIMEOUT_IDLE_MS : WS_LINK_TIMEOUT_MS) * 1000;
+            if (now - rx_ref <= timeout) {
+                was_up = true;
+                if (WS_IDLE_DISCONNECT_MS > 0 && now - last_activity_us_ >= (int64_t)WS_IDLE_DISCONNECT_MS * 1000) {
+                    park_();
+                    was_up = false;
+                    continue;
+                }
+                if (!maybe_failback_(now)) {
+                    int64_t hb_us = (int64_t)(idle ? WS_HEARTBEAT_IDLE_MS : WS_HEARTBEAT_MS) * 1000;
+                    if (now - last_hb_us_ >= hb_us) send_heartbeat_();
+                    continue;
+                }
+                next_attempt_us_ = now;
+            } else {
+                ESP_LOGW(TAG, "No data for %lld ms, link considered dead",
+                         (long long)((now - last_rx_us_) / 1000));
+                stats_.link_timeouts++;
+                connected_ = false;
+                xEventGroupClearBits(events_, WS_EVT_UP);
+                next_attempt_us_ = now;
+            }
+        }
+
+        if (was_up) {   // 剛斷線：開始計時、退避歸零
+            was_up           = false;
+            down_since_us_   = now;
+            backoff_ms_      = WS_BACKOFF_MIN_MS;
+            next_attempt_us_ = now;
+        }
+        if (bits & WS_EVT_KICK) next_attempt_us_ = now;
+        if (now < next_attempt_us_) continue;
+
+        /* 多端點：重連前重新探測，選目前最佳者；全部不可達則輪替 */
+        if (endpoint_count_ > 1 && fail_streak_ > 0) {
+            int best = probe_best_();
+            active_  = best >= 0 ? best : (active_ + 1) % endpoint_count_;
+            last_probe_us_ = esp_timer_get_time();
+        }
+
+        if (connect_once_()) {
+            if (down_since_us_) {
+                record_reconnect_((uint32_t)((esp_timer_get_time() - down_since_us_) / 1000));
+            }
+            down_since_us_ = 0;
+            backoff_ms_    = WS_BACKOFF_MIN_MS;
+            fail_streak_   = 0;
+            last_hb_us_    = 0;   // 重連後立即送一次心跳（回報統計）
+            was_up         = true;
+            continue;
+        }
+
+        stats_.failures++;
+        if (++fail_streak_ % WS_RESOLVE_RETRY_FAILS == 0) {
+            resolve_all_();
+#if WS_DISCOVERY
+            discovery_.request();   // Server 可能換了位址：背景重新查詢
+#endif
+        }
+        uint32_t delay_ms = backoff_ms_ + esp_random() % (backoff_ms_ / 4 + 1);
+        next_attempt_us_  = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+        ESP_LOGW(TAG, "Connect attempt %u failed (endpoint %d), retry in %u ms",
+                 (unsigned)fail_streak_, (int)active_, (unsigned)delay_ms);
+        backoff_ms_ = backoff_ms_ * 2 > WS_BACKOFF_MAX_MS ? WS_BACKOFF_MAX_MS : backoff_ms_ * 2;
+    }
+}
+
+bool WebSocketClient::connect_once_()
+{
+    esp_websocket_client_stop(client_);   // 未在執行時回傳 ESP_FAIL，可忽略
+#if WS_TLS
+    if (use_tls_) tls_.select(active_, endpoints_[active_].host);   // 帶上該端點快取的 session
+#endif
+    esp_websocket_client_set_uri(client_, endpoints_[active_].resolved);
+    if (esp_websocket_client_start(client_) != ESP_OK) return false;
+    EventBits_t bits = xEventGroupWaitBits(events_, WS_EVT_UP, pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(WS_CONNECT_TIMEOUT_MS));
+    return (bits & WS_EVT_UP) != 0;
+}
+
+void WebSocketClient::note_activity()
+{
+    last_activity_us_.store(esp_timer_get_time(), std::memory_order_relaxed);
+    /* 只在閒置 / 斷線中喚醒監督 Task：活躍時每個語音段只是一次 atomic 寫入 */
+    if (events_ && (quiet_.load(std::memory_order_relaxed) || parked_.load(std::memory_order_relaxed))) {
+        xEventGroupSetBits(events_, WS_EVT_ACTIVE);
+    }
+}
+
+void WebSocketClient::update_keepalive_(int64_t now)
+{
+    if (!WS_ADAPTIVE_KEEPALIVE) return;
+    bool quiet = now - last_activity_us_ >= (int64_t)WS_ACTIVE_HOLD_MS * 1000;
+    if (quiet == quiet_.load(std::memory_order_relaxed)) return;
+
+    quiet_.store(quiet, std::memory_order_relaxed);
+    esp_websocket_client_set_ping_interval_sec(client_, quiet ? WS_PING_IDLE_S : WS_PING_INTERVAL_S);
+    if (!quiet) {
+        active_since_us_ = now;
+        last_hb_us_      = 0;   // 立即送心跳：喚醒詞確認前先知道鏈路是否還活著
+    }
+    ESP_LOGI(TAG, "Keepalive %s: heartbeat %d ms, ping %d s", quiet ? "idle" : "active",
+             quiet ? WS_HEARTBEAT_IDLE_MS : WS_HEARTBEAT_MS, quiet ? WS_PING_IDLE_S : WS_PING_INTERVAL_S);
+}
+
+void WebSocketClient::park_()
+{
+    ESP_LOGI(TAG, "No activity for %lld min, disconnecting until speech",
+             (long long)(WS_IDLE_DISCONNECT_MS / 60000));
+    parked_.store(true, std::memory_order_release);
+    connected_ = false;
+    xEventGroupClearBits(events_, WS_EVT_UP);
     esp_websocket_client_stop(client_);
-    vTaskDelay(pdMS_TO_TICKS(100));
-    esp_websocket_client_start(client_);
+    down_since_us_ = 0;   // 主動斷線不計入重連統計
+}
 
-    uint32_t waited = 0;
-    while (waited < wait_ms && (!connected_ || !esp_websocket_client_is_connected(client_))) {
-        vTaskDelay(pdMS_TO_TICKS(100));
-        waited += 100;
+void WebSocketClient::send_heartbeat_()
+{
+    const WsLinkStats &st = stats_;
+    char json[384];
+    int32_t tls_ms = -1;
+    uint32_t tls_resumed = 0;
+#if WS_TLS
+    if (use_tls_) {
+        tls_ms      = (int32_t)tls_.stats().last_ms;
+        tls_resumed = tls_.stats().offered;
     }
+#endif
+    int  len = snprintf(json, sizeof(json),
+                        "{\"device_id\":\"%s\",\"timestamp\":%lld,\"type\":\"heartbeat\","
+                        "\"payload\":{\"seq\":%u,\"reconnects\":%u,\"failures\":%u,"
+                        "\"link_timeouts\":%u,\"reconnect_last_ms\":%u,\"reconnect_max_ms\":%u,"
+                        "\"reconnect_hist\":[%u,%u,%u,%u,%u,%u,%u],\"endpoint\":%d,"
+                        "\"endpoint_rtt_us\":%ld,\"failovers\":%u,\"tls_handshake_ms\":%ld,"
+                        "\"tls_resumed\":%u}}",
+                        DEVICE_ID, (long long)(esp_timer_get_time() / 1000), (unsigned)hb_seq_++,
+                        (unsigned)st.reconnects, (unsigned)st.failures,
+                        (unsigned)st.link_timeouts, (unsigned)st.last_ms, (unsigned)st.max_ms,
+                        (unsigned)st.hist[0], (unsigned)st.hist[1], (unsigned)st.hist[2],
+                        (unsigned)st.hist[3], (unsigned)st.hist[4], (unsigned)st.hist[5],
+                        (unsigned)st.hist[6], (int)active_,
+                        (long)endpoints_[active_].rtt_us, (unsigned)st.failovers,
+                        (long)tls_ms, (unsigned)tls_resumed);
+    last_hb_us_ = esp_timer_get_time();
+    if (!send_text(json, (size_t)len, pdMS_TO_TICKS(WS_HEARTBEAT_SEND_TIMEOUT_MS))) {
+        ESP_LOGW(TAG, "Heartbeat send failed");
+    }
+}
+
+void WebSocketClient::record_reconnect_(uint32_t ms)
+{
+    int b = 0;
+    while (b < WS_RECONNECT_BUCKETS - 1 && ms >= kReconnectBucketMs[b]) b++;
+    stats_.hist[b]++;
+    stats_.reconnects++;
+    stats_.last_ms = ms;
+    if (ms > stats_.max_ms) stats_.max_ms = ms;
+
+    const uint32_t *h = stats_.hist;
+    ESP_LOGI(TAG, "Reconnected in %u ms (#%u, max %u ms) "
+             "hist <100:%u <250:%u <500:%u <1s:%u <2s:%u <5s:%u >=5s:%u",
+             (unsigned)ms, (unsigned)stats_.reconnects, (unsigned)stats_.max_ms,
+             (unsigned)h[0], (unsigned)h[1], (unsigned)h[2], (unsigned)h[3],
+             (unsigned)h[4], (unsigned)h[5], (unsigned)h[6]);
+}
+
+/* ---------- send ---------- */
+
+bool WebSocketClient::send_text(const char *data, size_t len, TickType_t timeout)
+{
+    if (!client_ || !is_connected()) return false;
+    TRACE_POINT(TP_WS_SEND, len);
+    if (xSemaphoreTake(tx_lock_, timeout) != pdTRUE) return false;
+    bool ok = esp_websocket_client_send_text(client_, data, (int)len, timeout) >= 0;
+    xSemaphoreGive(tx_lock_);
+    return ok;
+}
+
+bool WebSocketClient::send_binary(const char *data, size_t len, TickType_t timeout)
+{
+    if (!client_ || !is_connected()) return false;
+    last_bin_tx_us_ = esp_timer_get_time();
+    TRACE_POINT(TP_WS_SEND, len);
+    if (xSemaphoreTake(tx_lock_, timeout) != pdTRUE) return false;
+    bool ok = esp_websocket_client_send_bin(client_, data, (int)len, timeout) >= 0;
+    xSemaphoreGive(tx_lock_);
+    return ok;
+}
+
+bool WebSocketClient::send_binary_iov(const WsIoVec *iov, size_t count, TickType_t timeout)
+{
+    if (!client_ || !is_connected()) return false;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += iov[i].len;
+    last_bin_tx_us_ = esp_timer_get_time();
+    TRACE_POINT(TP_WS_SEND, total);
+    if (xSemaphoreTake(tx_lock_, timeout) != pdTRUE) return false;
+
+    /* 小分段（例如 StreamChunkHeader）暫存合併，大分段直接由原緩衝送出 */
+    char   stage[WS_IOV_COALESCE_BYTES];
+    size_t staged  = 0;
+    bool   started = false;   // 已送出第一個 frame（之後為 continuation）
+    bool   ok      = true;
+    auto fragment = [&](const char *p, size_t n) {
+        int r = started ? esp_websocket_client_send_cont_msg(client_, p, (int)n, timeout)
+                        : esp_websocket_client_send_bin_partial(client_, p, (int)n, timeout);
+        started = true;
+        return r >= 0;
+    };
+
+    for (size_t i = 0; ok && i < count; i++) {
+        const char *p = (const char *)iov[i].data;
+        size_t      n = iov[i].len;
+        if (n == 0) continue;
+        if (n < sizeof(stage)) {
+            if (staged + n > sizeof(stage)) {
+                ok = fragment(stage, staged);
+                staged = 0;
+            }
+            memcpy(stage + staged, p, n);
+            staged += n;
+            continue;
+        }
+        if (staged) {
+            ok = fragment(stage, staged);
+            staged = 0;
+        }
+        if (ok) ok = fragment(p, n);
+    }
+
+    if (ok) {
+        if (!started) {
+            /* 全部併入暫存：一般的單一 frame */
+            ok = esp_websocket_client_send_bin(client_, stage, (int)staged, timeout) >= 0;
+        } else {
+            if (staged) ok = fragment(stage, staged);
+            if (ok) ok = esp_websocket_client_send_fin(client_, timeout) >= 0;
+        }
+    }
+    xSemaphoreGive(tx_lock_);
+    return ok;
+}
+
+/* ---------- reconnect ---------- */
+
+bool WebSocketClient::wait_connected(uint32_t wait_ms)
+{
+    note_activity();   // 要用到鏈路：session / 預熱都算活動
+    if (is_connected()) return true;
+    if (!events_) return false;
+    if (client_) xEventGroupSetBits(events_, WS_EVT_KICK);   // start() 前：只等待開機連線
+    EventBits_t bits = xEventGroupWaitBits(events_, WS_EVT_UP, pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(wait_ms));
+    return (bits & WS_EVT_UP) != 0;
+}
+
+bool WebSocketClient::emergency_reconnect(uint32_t wait_ms)
+{
+    if (!client_ || !events_) return false;
+    ESP_LOGW(TAG, "Emergency reconnect...");
+    note_activity();
+    connected_ = false;
+    xEventGroupClearBits(events_, WS_EVT_UP);
+    xEventGroupSetBits(events_, WS_EVT_KICK);
 
-    if (connected_ && esp_websocket_client_is_connected(client_)) {
+    EventBits_t bits = xEventGroupWaitBits(events_, WS_EVT_UP, pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(wait_ms));
+    if (bits & WS_EVT_UP) {
         ESP_LOGI(TAG, "Emergency reconnect SUCCESS.");
         return true;
     }
@@ -4,12 +4,29 @@
 /* ============================================================
  * websocket_client.h - WebSocket 連線管理
  * ESP-MIAO v0.8.0
+ *
+ * 連線由監督 Task 維持：應用層心跳判定鏈路存活、斷線時指數退避重連，
+ * 並使用預先解析的 Server IP，喚醒時通常已在線、不需現場重連。
+ * 心跳 / ping 間隔依最近的語音活動調整（WS_ADAPTIVE_KEEPALIVE），長時間安靜可主動斷線。
  * ============================================================ */
 
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <atomic>
 #include "esp_idf_version.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "config.h"
+#if WS_TLS
+#include "tls_transport.h"
+#endif
+#if WS_DISCOVERY
+#include "server_discovery.h"
+#endif
 
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
 #include "esp_websocket_client.h"
@@ -25,12 +42,63 @@
 #define WS_LOG WS_LOG_INFO
 #endif
 
+/* Server 端點數上限（依優先序；NVS "srv_urls" 逗號分隔） */
+#ifndef WS_MAX_ENDPOINTS
+#define WS_MAX_ENDPOINTS 3
+#endif
+
+/* 文字訊息重組緩衝（預先配置；超出的訊息整則丟棄） */
+#ifndef WS_RX_BUFFER_SIZE
+#define WS_RX_BUFFER_SIZE 1024
+#endif
+
+/* send_binary_iov：小於此長度的相鄰分段先併成一個 frame（避免每段各有 frame 標頭與 TCP 片段） */
+#ifndef WS_IOV_COALESCE_BYTES
+#define WS_IOV_COALESCE_BYTES 64
+#endif
+
+/* 重連耗時分布格數（上界見 websocket_client.cpp kReconnectBucketMs；最後一格為以上） */
+#define WS_RECONNECT_BUCKETS 7
+
+/* 連線監督統計（由監督 Task 更新，隨心跳回報 Server） */
+struct WsLinkStats {
+    uint32_t reconnects;                   // 斷線後成功重連次數
+    uint32_t failures;                     // 失敗的連線嘗試
+    uint32_t link_timeouts;                // 心跳逾時判定斷線次數
+    uint32_t last_ms;                      // 最近一次斷線 → 重新連上耗時
+    uint32_t max_ms;
+    uint32_t hist[WS_RECONNECT_BUCKETS];   // 斷線 → 重新連上耗時分布
+    uint32_t failovers;                    // 因 RTT 較佳而背景切換端點的次數
+};
+
+/* send_binary_iov 的一段資料 */
+struct WsIoVec {
+    const void *data;
+    size_t      len;
+};
+
+/* Server 端點 */
+struct WsEndpoint {
+    char     uri[128];        // 原始 URI
+    char     resolved[128];   // host 換成已解析 IP 的 URI
+    char     ip[16];          // 已解析 IPv4（空 = 尚未解析）
+    char     host[64];        // 原始主機名稱（TLS 的 SNI 與憑證名稱檢查）
+    uint16_t port;
+    bool     tls;             // wss://
+    int32_t  rtt_us;          // 最近一次 TCP 連線探測耗時（-1 = 不可達 / 未探測）
+};
+
 /**
  * 收到文字訊息時的回調（由外部模組注入）。
  * @param data  NULL-terminated 文字字串
  */
 typedef void (*ws_data_callback_t)(const char *data);
 
+/**
+ * 收到二進位訊息時的回調（Server binary 控制 frame，WS_BINARY_CONTROL）。
+ */
+typedef void (*ws_binary_callback_t)(const uint8_t *data, size_t len);
+
 class WebSocketClient {
 public:
     WebSocketClient();
@@ -41,28 +109,112 @@ public:
     void set_data_callback(ws_data_callback_t cb) { on_data_ = cb; }
 
     /**
-     * 初始化並啟動 WebSocket 連線。
-     * @param uri  WebSocket URI (e.g. "ws://192.168.1.16:8000/ws/esp32_01")
+     * 設定收到二進位訊息時的回調（需在 init() 前呼叫）。
+     */
+    void set_binary_callback(ws_binary_callback_t cb) { on_binary_ = cb; }
+
+    /**
+     * 初始化（不連線；可在 WiFi 連線前呼叫，之後 wait_connected() 即可等待連線）。
+     * 端點清單讀自 NVS；未設定時使用 default_uris 並寫入 NVS。
+     * @param default_uris 依優先序、逗號分隔的 WebSocket URI
+     *                     (e.g. "ws://192.168.1.16:8000/ws/esp32_01,ws://192.168.1.20:8000/ws/esp32_01")
+     * 需在 nvs_flash_init() 之後呼叫。
+     */
+    void init(const char *default_uris);
+
+    /**
+     * 儲存端點清單至 NVS（下次開機生效）。
      */
-    void init(const char *uri);
+    esp_err_t save_endpoints(const char *uris);
+
+    /**
+     * 以 Server 下發的端點清單取代目前清單（叢集模式 server_list；於 WS 事件 Task 呼叫，不阻塞）。
+     * 與目前清單相同時不做事；否則由監督 Task 寫入 NVS 並套用：目前連線的端點仍在清單中則沿用，
+     * 之後的定期探測依新順序偏好第一個端點（上行閒置時才切換）。
+     * 套用後第一個端點不再以 mDNS 位址取代。
+     */
+    void set_endpoints(const char *uris);
+
+    /**
+     * 目前端點的 HTTP URL（喚醒 ACK 備援用；wss:// 端點為 https://）。
+     * @param path 例如 "/ack"
+     * @return false = 尚未解析出端點位址
+     */
+    bool http_url(const char *path, char *out, size_t cap) const;
+
+    /**
+     * wss:// 端點：為 http_url() 的請求設定 Server 憑證（釘選憑證或憑證包）與主機名稱
+     * （URL 的 host 為 IP）。明文端點不做任何事。cfg 需在 http_url() 取得的端點仍有效時使用。
+     */
+    void apply_tls(esp_http_client_config_t &cfg) const;
+
+#if WS_TLS
+    /**
+     * 儲存釘選的 Server 憑證（PEM；nullptr = 改用憑證包），下次開機生效。
+     */
+    static esp_err_t save_server_cert(const char *pem) { return TlsTransport::save_pinned_cert(pem); }
+#endif
+
+    /**
+     * 目前端點已解析的 IPv4 位址（UDP 音訊上行用）。
+     * @return false = 尚未解析出端點位址
+     */
+    bool server_ip(char *out, size_t cap) const;
+
+    /**
+     * 解析 Server 位址並啟動連線與監督 Task（需在 WiFi 取得 IP 後呼叫）。
+     */
+    void start();
 
     /** 是否已連線 */
-    bool is_connected() const { return connected_; }
+    bool is_connected() const { return connected_.load(std::memory_order_acquire); }
+
+    /**
+     * 等待連線可用；斷線時要求監督 Task 立即重試（略過退避）。
+     * @param wait_ms 最多等待毫秒數
+     * @return true = 已連線
+     */
+    bool wait_connected(uint32_t wait_ms);
+
+    /**
+     * 記錄語音活動（推論 Task 於每段語音開始時呼叫，不阻塞）：保活回到活躍間隔，
+     * 閒置斷線中則立即重連。
+     */
+    void note_activity();
+
+    /** 是否因長時間安靜而主動斷線（WS_IDLE_DISCONNECT_MS） */
+    bool parked() const { return parked_.load(std::memory_order_acquire); }
+
+    /** 連線監督統計 */
+    const WsLinkStats &link_stats() const { return stats_; }
 
     /**
      * 傳送文字訊息。
+     * @param timeout 等待送出的最長時間
      * @return true = 成功
      */
-    bool send_text(const char *data, size_t len);
+    bool send_text(const char *data, size_t len, TickType_t timeout = portMAX_DELAY);
 
     /**
      * 傳送二進位訊息。
+     * @param timeout 等待送出的最長時間
      * @return true = 成功
      */
-    bool send_binary(const char *data, size_t len);
+    bool send_binary(const char *data, size_t len, TickType_t timeout = portMAX_DELAY);
 
     /**
-     * 緊急重連（喚醒詞偵測到但 WS 斷線時使用）。
+     * 由多段資料組成一則二進位訊息，不先複製成連續緩衝：各段以分段 frame
+     * （binary + continuation + FIN）送出，Server 收到的仍是一則訊息。
+     * 傳輸層送出時會就地 mask 資料、送完再還原，呼叫期間分段不可被其他 Task 讀取
+     * （例如音訊環形緩衝仍在被推論讀取的區段）。
+     * @param timeout 等待送出的最長時間（每個 frame）
+     * @return true = 成功；失敗時訊息可能只送出一部分，連線應視為不可用
+     */
+    bool send_binary_iov(const WsIoVec *iov, size_t count, TickType_t timeout = portMAX_DELAY);
+
+    /**
+     * 強制重連（鏈路已知不可用時使用，例如串流送出失敗）：
+     * 由監督 Task 立即重建連線，呼叫端等待結果。
      * @param wait_ms 最多等待毫秒數
      * @return true = 重連成功
      */
@@ -73,8 +225,71 @@ public:
 
 private:
     esp_websocket_client_handle_t client_;
-    bool                          connected_;
+    std::atomic<bool>             connected_;
     ws_data_callback_t            on_data_;
+    ws_binary_callback_t          on_binary_;
+    SemaphoreHandle_t             tx_lock_;   // 分段訊息的 frame 之間不可插入其他訊息：所有送出共用
+#if WS_TLS
+    TlsTransport                  tls_;       // wss:// 端點：session 續用 + 釘選憑證
+    bool                          use_tls_;   // client 以 tls_ 作為 ext_transport
+#endif
+#if WS_DISCOVERY
+    ServerDiscovery               discovery_;   // 第一個端點的位址改由 mDNS / NVS 快取提供
+    static void on_discovered_(void *arg);
+#endif
+
+    /* Server 端點（init 後僅監督 Task 修改） */
+    WsEndpoint           endpoints_[WS_MAX_ENDPOINTS];
+    int                  endpoint_count_;
+    std::atomic<int>     active_;              // 目前使用的端點索引
+    bool                 managed_;             // 清單由 Server 下發（server_list），不套用 mDNS 位址
+
+    /* 端點清單字串：目前套用中 / set_endpoints() 待套用（uris_lock_ 保護） */
+    portMUX_TYPE         uris_lock_;
+    char                 uris_[WS_MAX_ENDPOINTS * 128];
+    char                 pending_uris_[WS_MAX_ENDPOINTS * 128];
+
+    /* 連線監督（除 last_rx_us_ / last_bin_tx_us_ 外僅監督 Task 存取） */
+    EventGroupHandle_t   events_;
+    std::atomic<int64_t> last_rx_us_;          // 最近一次收到任何資料（含 pong）
+    std::atomic<int64_t> last_bin_tx_us_;      // 最近一次送出二進位 frame（串流中不切換端點）
+    int64_t              last_probe_us_;
+    int64_t              last_hb_us_;
+    int64_t              down_since_us_;       // 0 = 非斷線中
+    int64_t              next_attempt_us_;
+    uint32_t             backoff_ms_;
+    uint32_t             fail_streak_;
+    uint32_t             hb_seq_;
+    WsLinkStats          stats_;
+
+    /* 自適應保活（last_activity_us_ / quiet_ / parked_ 由其他 Task 讀寫，其餘僅監督 Task） */
+    std::atomic<int64_t> last_activity_us_;    // 最近一次語音活動 / session
+    std::atomic<bool>    quiet_;               // 目前使用閒置間隔
+    std::atomic<bool>    parked_;              // 閒置主動斷線中
+    int64_t              active_since_us_;     // 最近一次由閒置回到活躍（鏈路逾時自此起算）
+
+    static void supervisor_entry_(void *arg);
+    void supervise_();
+    int  parse_endpoints_(const char *uris);
+    void apply_endpoints_();
+    bool resolve_(WsEndpoint &ep);
+    void resolve_all_();
+    int32_t probe_(const WsEndpoint &ep) const;
+    int  probe_best_();
+    bool maybe_failback_(int64_t now);
+    bool connect_once_();
+    void send_heartbeat_();
+    void update_keepalive_(int64_t now);
+    void park_();
+    void record_reconnect_(uint32_t ms);
+
+    /* 下行訊息重組（事件 Task 內使用，不需鎖；分段 / 續接 frame 依 payload_offset 拼接） */
+    char   rx_buf_[WS_RX_BUFFER_SIZE];
+    size_t rx_len_;
+    bool   rx_active_;     // 正在接收文字 / 二進位訊息
+    bool   rx_binary_;     // 本則為 binary frame（op_code=2）
+    bool   rx_overflow_;   // 本則超出緩衝，收完後丟棄
+    void   on_rx_(const esp_websocket_event_data_t *ev);
 
     static void event_handler_(void *arg, esp_event_base_t base,
                                int32_t id, void *data);
@@ -5,22 +5,28 @@
 
 #include "wifi_manager.h"
 #include "config.h"
+#include "rtos_alloc.h"
+#include "nvs_writer.h"
 #include "esp_log.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "nvs.h"
 #include "nvs_flash.h"
+#include "esp_timer.h"
 #include "sdkconfig.h"
 #include <string.h>
 
 static const char *TAG = "WifiManager";
 
 WifiManager::WifiManager()
-    : event_group_(nullptr), connected_(false)
+    : event_group_(nullptr), connected_(false), netif_(nullptr), ps_lock_(nullptr),
+      low_latency_refs_(0), start_us_(0), cached_channel_(0), bssid_locked_(false),
+      fast_fails_(0)
 {
     ssid_[0]     = '\0';
     password_[0] = '\0';
+    memset(cached_bssid_, 0, sizeof(cached_bssid_));
 }
 
 /* ---------- static event handler ---------- */
@@ -33,14 +39,32 @@ void WifiManager::event_handler_(void *arg, esp_event_base_t base,
     if (base == WIFI_EVENT && id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
 
+    } else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_CONNECTED) {
+        auto *event = static_cast<wifi_event_sta_connected_t *>(data);
+        self->fast_fails_ = 0;
+        self->save_ap_cache_(event->bssid, event->channel);
+
     } else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED) {
-        esp_wifi_connect();
+        bool was_connected = self->connected_;
+        self->connected_ = false;
         xEventGroupClearBits(self->event_group_, BIT0);
+
+        /* 快取的 AP 連不上（換頻道 / 換 AP）：放棄鎖定，改為全頻掃描 */
+        if (self->bssid_locked_ && ++self->fast_fails_ >= WIFI_FAST_CONNECT_RETRIES) {
+            ESP_LOGW(TAG, "Cached AP unreachable, falling back to full scan");
+            self->apply_sta_config_(false);
+        } else if (self->bssid_locked_ && was_connected) {
+            /* 已連上過：解除 BSSID 鎖定以允許漫遊（頻道仍作為優先掃描提示） */
+            self->apply_sta_config_(false);
+        }
+        esp_wifi_connect();
         ESP_LOGI(TAG, "retry to connect to the AP");
 
     } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t *event = static_cast<ip_event_got_ip_t *>(data);
-        ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        ESP_LOGI(TAG, "got ip:" IPSTR " (%lld ms since start%s)", IP2STR(&event->ip_info.ip),
+                 (long long)((esp_timer_get_time() - self->start_us_) / 1000),
+                 self->bssid_locked_ ? ", cached AP" : "");
         self->connected_ = true;
         xEventGroupSetBits(self->event_group_, BIT0);
     }
@@ -76,10 +100,9 @@ esp_err_t WifiManager::load_credentials_()
         ssid_[sizeof(ssid_) - 1]         = '\0';
         password_[sizeof(password_) - 1] = '\0';
 
-        nvs_set_str(handle, "wifi_ssid", ssid_);
-        nvs_set_str(handle, "wifi_pass", password_);
-        nvs_commit(handle);
-        ESP_LOGI(TAG, "Kconfig defaults saved to NVS.");
+        nvs_writer_set_str(NVS_NS, "wifi_ssid", ssid_);
+        nvs_writer_set_str(NVS_NS, "wifi_pass", password_);
+        ESP_LOGI(TAG, "Kconfig defaults queued for NVS.");
     } else {
         ESP_LOGI(TAG, "Credentials loaded from NVS.");
     }
@@ -88,20 +111,128 @@ esp_err_t WifiManager::load_credentials_()
     return ESP_OK;
 }
 
-/* ---------- 儲存憑證 ---------- */
+/* ---------- AP 快取（BSSID / 頻道） ---------- */
 
-esp_err_t WifiManager::save_credentials(const char *ssid, const char *password)
+void WifiManager::load_ap_cache_()
 {
     nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NS, NVS_READWRITE, &handle);
-    if (err != ESP_OK) return err;
+    if (nvs_open(NVS_NS, NVS_READONLY, &handle) != ESP_OK) return;
 
-    err = nvs_set_str(handle, "wifi_ssid", ssid);
-    if (err != ESP_OK) { nvs_close(handle); return err; }
-    err = nvs_set_str(handle, "wifi_pass", password);
-    if (err != ESP_OK) { nvs_close(handle); return err; }
-    err = nvs_commit(handle);
+    size_t  len  = sizeof(cached_bssid_);
+    uint8_t chan = 0;
+    if (nvs_get_blob(handle, "wifi_bssid", cached_bssid_, &len) == ESP_OK &&
+        len == sizeof(cached_bssid_) &&
+        nvs_get_u8(handle, "wifi_chan", &chan) == ESP_OK) {
+        cached_channel_ = chan;
+        ESP_LOGI(TAG, "Cached AP %02x:%02x:%02x:%02x:%02x:%02x ch %u",
+                 cached_bssid_[0], cached_bssid_[1], cached_bssid_[2],
+                 cached_bssid_[3], cached_bssid_[4], cached_bssid_[5], chan);
+    }
     nvs_close(handle);
+}
+
+/* 僅在 AP 改變時寫入，避免每次重連都寫 flash */
+void WifiManager::save_ap_cache_(const uint8_t bssid[6], uint8_t channel)
+{
+    if (channel == cached_channel_ && memcmp(bssid, cached_bssid_, sizeof(cached_bssid_)) == 0) {
+        return;
+    }
+    memcpy(cached_bssid_, bssid, sizeof(cached_bssid_));
+    cached_channel_ = channel;
+
+    /* WiFi 事件 Task 內：排入延後寫入，不在重連當下關閉 flash cache */
+    nvs_writer_set_blob(NVS_NS, "wifi_bssid", cached_bssid_, sizeof(cached_bssid_));
+    nvs_writer_set_u8(NVS_NS, "wifi_chan", cached_channel_);
+    ESP_LOGI(TAG, "AP cache updated (ch %u)", channel);
+}
+
+/* ---------- STA 設定 ---------- */
+
+void WifiManager::apply_sta_config_(bool lock_bssid)
+{
+    wifi_config_t wifi_config = {};
+    strncpy((char *)wifi_config.sta.ssid,     ssid_,     sizeof(wifi_config.sta.ssid) - 1);
+    strncpy((char *)wifi_config.sta.password, password_, sizeof(wifi_config.sta.password) - 1);
+    wifi_config.sta.listen_interval = WIFI_LISTEN_INTERVAL;
+    wifi_config.sta.sort_method     = WIFI_CONNECT_AP_BY_SIGNAL;
+#if WIFI_ROAM_11KV
+    wifi_config.sta.rm_enabled  = 1;
+    wifi_config.sta.btm_enabled = 1;
+#endif
+
+    bssid_locked_ = lock_bssid && cached_channel_ != 0;
+    if (bssid_locked_) {
+        /* 指定 BSSID + 頻道：直接連線，不做全頻掃描 */
+        wifi_config.sta.bssid_set   = true;
+        memcpy(wifi_config.sta.bssid, cached_bssid_, sizeof(cached_bssid_));
+        wifi_config.sta.channel     = cached_channel_;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+    } else {
+        wifi_config.sta.channel     = cached_channel_;   // 0 = 不指定；否則自此頻道開始掃描
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+}
+
+/* ---------- 靜態 IP ---------- */
+
+void WifiManager::apply_static_ip_()
+{
+    if (WIFI_STATIC_IP[0] == '\0') return;
+
+    esp_netif_ip_info_t ip = {};
+    if (esp_netif_str_to_ip4(WIFI_STATIC_IP, &ip.ip) != ESP_OK ||
+        esp_netif_str_to_ip4(WIFI_STATIC_NETMASK, &ip.netmask) != ESP_OK ||
+        esp_netif_str_to_ip4(WIFI_STATIC_GATEWAY, &ip.gw) != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid static IP config, using DHCP");
+        return;
+    }
+    esp_netif_dhcpc_stop(netif_);
+    if (esp_netif_set_ip_info(netif_, &ip) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set static IP, using DHCP");
+        esp_netif_dhcpc_start(netif_);
+        return;
+    }
+
+    esp_netif_dns_info_t dns = {};
+    const char *dns_str = WIFI_STATIC_DNS[0] ? WIFI_STATIC_DNS : WIFI_STATIC_GATEWAY;
+    esp_ip4_addr_t dns_ip;
+    if (esp_netif_str_to_ip4(dns_str, &dns_ip) == ESP_OK) {
+        dns.ip.u_addr.ip4.addr = dns_ip.addr;
+        dns.ip.type            = ESP_IPADDR_TYPE_V4;
+        esp_netif_set_dns_info(netif_, ESP_NETIF_DNS_MAIN, &dns);
+    }
+    ESP_LOGI(TAG, "Static IP %s (DHCP disabled)", WIFI_STATIC_IP);
+}
+
+/* ---------- 省電模式 ---------- */
+
+void WifiManager::acquire_low_latency()
+{
+    if (!ps_lock_) return;
+    xSemaphoreTake(ps_lock_, portMAX_DELAY);
+    if (low_latency_refs_++ == 0) esp_wifi_set_ps(WIFI_PS_NONE);
+    xSemaphoreGive(ps_lock_);
+}
+
+void WifiManager::release_low_latency()
+{
+    if (!ps_lock_) return;
+    xSemaphoreTake(ps_lock_, portMAX_DELAY);
+    if (low_latency_refs_ > 0 && --low_latency_refs_ == 0) esp_wifi_set_ps(WIFI_PS_IDLE);
+    xSemaphoreGive(ps_lock_);
+}
+
+/* ---------- 儲存憑證 ---------- */
+
+esp_err_t WifiManager::save_credentials(const char *ssid, const char *password)
+{
+    /* 使用者佈建：排入後立即寫出，之後的延後寫入不會蓋回舊值 */
+    esp_err_t err = nvs_writer_set_str(NVS_NS, "wifi_ssid", ssid);
+    if (err != ESP_OK) return err;
+    err = nvs_writer_set_str(NVS_NS, "wifi_pass", password);
+    if (err != ESP_OK) return err;
+    err = nvs_writer_flush();
     ESP_LOGI(TAG, "Credentials saved to NVS.");
     return err;
 }
@@ -110,13 +241,19 @@ esp_err_t WifiManager::save_credentials(const char *ssid, const char *password)
 
 void WifiManager::init()
 {
-    event_group_ = xEventGroupCreate();
+    start_us_    = esp_timer_get_time();
+    event_group_ = RTOS_EVENT_GROUP_CREATE();
+    ps_lock_     = RTOS_MUTEX_CREATE();
 
     ESP_ERROR_CHECK(load_credentials_());
+#if WIFI_FAST_CONNECT
+    load_ap_cache_();
+#endif
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    netif_ = esp_netif_create_default_wifi_sta();
+    apply_static_ip_();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -127,17 +264,17 @@ void WifiManager::init()
     ESP_ERROR_CHECK(esp_event_handler_instance_register(
         IP_EVENT, IP_EVENT_STA_GOT_IP, &WifiManager::event_handler_, this, &inst_got_ip));
 
-    wifi_config_t wifi_config = {};
-    strncpy((char *)wifi_config.sta.ssid,     ssid_,     sizeof(wifi_config.sta.ssid) - 1);
-    strncpy((char *)wifi_config.sta.password, password_, sizeof(wifi_config.sta.password) - 1);
-
     ESP_LOGI(TAG, "Connecting to SSID: %s", ssid_);
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    apply_sta_config_(WIFI_FAST_CONNECT);
     ESP_ERROR_CHECK(esp_wifi_start());
+    esp_wifi_set_ps(WIFI_PS_IDLE);
+}
 
-    xEventGroupWaitBits(event_group_, BIT0, pdFALSE, pdFALSE, portMAX_DELAY);
-    ESP_LOGI(TAG, "WiFi connected.");
+bool WifiManager::wait_connected(TickType_t timeout)
+{
+    if (!event_group_) return false;
+    return (xEventGroupWaitBits(event_group_, BIT0, pdFALSE, pdFALSE, timeout) & BIT0) != 0;
 }
 
 bool WifiManager::is_connected() const
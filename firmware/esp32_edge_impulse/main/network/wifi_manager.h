@@ -4,12 +4,18 @@
 /* ============================================================
  * wifi_manager.h - WiFi 連線管理（NVS 憑證 + 事件處理）
  * ESP-MIAO v0.8.0
+ *
+ * 連線設定檔：NVS 快取 BSSID / 頻道（開機免掃描）、可選靜態 IP（免 DHCP）、
+ * 802.11k/v 漫遊；閒置 modem-sleep，低延遲請求期間切為 WIFI_PS_NONE。
  * ============================================================ */
 
+#include <stdint.h>
 #include "esp_err.h"
 #include "esp_event.h"
+#include "esp_netif.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 
 /* Debug 等級控制 */
 #define WIFI_LOG_NONE   0
@@ -26,11 +32,17 @@ public:
     WifiManager();
 
     /**
-     * 初始化 WiFi（讀取 NVS 憑證 → 連線 → 阻塞等待取得 IP）。
+     * 初始化 WiFi（讀取 NVS 憑證 → 開始連線），不等待取得 IP。
      * 需在 nvs_flash_init() 之後呼叫。
      */
     void init();
 
+    /**
+     * 等待取得 IP。
+     * @return true = 已連線
+     */
+    bool wait_connected(TickType_t timeout);
+
     /** 是否已取得 IP（已連線） */
     bool is_connected() const;
 
@@ -39,13 +51,35 @@ public:
      */
     esp_err_t save_credentials(const char *ssid, const char *password);
 
+    /**
+     * 請求 / 釋放低延遲模式（可巢狀）：計數 > 0 時 WIFI_PS_NONE，歸零時回到 WIFI_PS_IDLE。
+     * 建議以 WifiLowLatencyScope 使用。
+     */
+    void acquire_low_latency();
+    void release_low_latency();
+
 private:
     EventGroupHandle_t event_group_;
     bool               connected_;
+    esp_netif_t       *netif_;
+    SemaphoreHandle_t  ps_lock_;
+    int                low_latency_refs_;
+    int64_t            start_us_;
 
     char ssid_[32];
     char password_[64];
 
+    /* 上次成功連線的 AP（NVS 快取） */
+    uint8_t cached_bssid_[6];
+    uint8_t cached_channel_;     // 0 = 無快取
+    bool    bssid_locked_;       // 目前設定鎖定快取 BSSID（僅開機首次連線）
+    int     fast_fails_;         // 鎖定 BSSID 時的連續失敗次數
+
+    void      load_ap_cache_();
+    void      save_ap_cache_(const uint8_t bssid[6], uint8_t channel);
+    void      apply_sta_config_(bool lock_bssid);
+    void      apply_static_ip_();
+
     /* NVS partition name */
     static constexpr const char *NVS_NS = "storage";
 
@@ -55,4 +89,17 @@ private:
                                int32_t id, void *data);
 };
 
+/* 區塊內維持 WIFI_PS_NONE（離開時自動釋放） */
+class WifiLowLatencyScope {
+public:
+    explicit WifiLowLatencyScope(WifiManager &wifi) : wifi_(wifi) { wifi_.acquire_low_latency(); }
+    ~WifiLowLatencyScope() { wifi_.release_low_latency(); }
+
+    WifiLowLatencyScope(const WifiLowLatencyScope &) = delete;
+    WifiLowLatencyScope &operator=(const WifiLowLatencyScope &) = delete;
+
+private:
+    WifiManager &wifi_;
+};
+
 #endif // WIFI_MANAGER_H
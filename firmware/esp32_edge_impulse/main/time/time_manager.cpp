@@ -1,34 +1,46 @@
 /*
- * time_manager.cpp - NTP 時間同步管理實作
+ * time_manager.cpp - 時間同步管理實作
  * ESP-MIAO v0.8.0
  */
 
 #include "time_manager.h"
+#include "config.h"
+#include "rtos_alloc.h"
+#include "websocket_client.h"
 #include "esp_log.h"
 #include "esp_sntp.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <stdio.h>
 #include <time.h>
 #include <sys/time.h>
 
 static const char *TAG = "TimeManager";
 
+TimeManager::TimeManager()
+    : lock_(portMUX_INITIALIZER_UNLOCKED), clock_{}, ws_(nullptr), reply_q_(nullptr), seq_(0)
+{}
+
 void TimeManager::init(int max_retry)
 {
+    // 設定時區 Taipei (UTC+8)
+    setenv("TZ", "CST-8", 1);
+    tzset();
+
+#if TIME_SNTP_ENABLE
     ESP_LOGI(TAG, "Initializing SNTP...");
     esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
     esp_sntp_setservername(0, "pool.ntp.org");
     esp_sntp_setservername(1, "time.google.com");
     esp_sntp_init();
 
-    // 設定時區 Taipei (UTC+8)
-    setenv("TZ", "CST-8", 1);
-    tzset();
-
-    // 等待時間同步
+    // 等待時間同步（0 = 不等待，背景完成）
     int retry = 0;
-    while (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET && ++retry < max_retry) {
+    while (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET && retry++ < max_retry) {
         ESP_LOGI(TAG, "Waiting for system time to be set... (%d/%d)", retry, max_retry);
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
+    if (retry == 0 || sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET) return;
 
     time_t now;
     struct tm timeinfo;
@@ -40,17 +52,48 @@ void TimeManager::init(int max_retry)
              timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
              timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
 #endif
+#else
+    (void)max_retry;
+#endif
 }
 
-uint64_t TimeManager::get_timestamp_ms() const
+/* ---------- 時鐘換算 ---------- */
+
+int64_t TimeManager::epoch_us_at(int64_t timer_us) const
 {
+    portENTER_CRITICAL(&lock_);
+    ClockModel c = clock_;
+    portEXIT_CRITICAL(&lock_);
+
+    if (c.synced) {
+        int64_t dt = timer_us - c.base_timer_us;
+        return timer_us + c.offset_us + (int64_t)((double)dt * c.drift_ppm / 1e6);
+    }
     struct timeval tv;
     gettimeofday(&tv, NULL);
-    return (uint64_t)tv.tv_sec * 1000 + (tv.tv_usec / 1000);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec - (esp_timer_get_time() - timer_us);
+}
+
+uint64_t TimeManager::get_timestamp_ms() const
+{
+    return (uint64_t)(epoch_us_at(esp_timer_get_time()) / 1000);
+}
+
+uint32_t TimeManager::uncertainty_us() const
+{
+    portENTER_CRITICAL(&lock_);
+    uint32_t u = clock_.synced ? clock_.uncertainty_us : 0;
+    portEXIT_CRITICAL(&lock_);
+    return u;
 }
 
 void TimeManager::sync_from_server(long seconds, int ms)
 {
+    portENTER_CRITICAL(&lock_);
+    bool synced = clock_.synced;
+    portEXIT_CRITICAL(&lock_);
+    if (synced) return;   // 已有延遲補償的同步結果
+
     struct timeval tv = {
         .tv_sec  = (time_t)seconds,
         .tv_usec = (suseconds_t)(ms * 1000)
@@ -63,3 +106,115 @@ void TimeManager::sync_from_server(long seconds, int ms)
              timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
              timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
 }
+
+/* ---------- 往返同步 ---------- */
+
+void TimeManager::start_server_sync(WebSocketClient &ws)
+{
+    if (reply_q_) return;
+    ws_      = &ws;
+    reply_q_ = RTOS_QUEUE_CREATE(TIME_SYNC_BURST, sizeof(SyncSample));
+    if (!reply_q_ ||
+        RTOS_TASK_CREATE(task_entry_, "time_sync", TIME_SYNC_TASK_STACK, this,
+                         TIME_SYNC_TASK_PRIO, nullptr, TIME_SYNC_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start time sync task");
+    }
+}
+
+void TimeManager::on_sync_reply(uint32_t seq, int64_t t0, int64_t t1, int64_t t2, int64_t t3)
+{
+    if (!reply_q_) return;
+    SyncSample s = { seq, t0, t1, t2, t3 };
+    xQueueSend(reply_q_, &s, 0);
+}
+
+void TimeManager::task_entry_(void *arg)
+{
+    static_cast<TimeManager *>(arg)->sync_loop_();
+}
+
+void TimeManager::sync_loop_()
+{
+    while (1) {
+        bool ok = ws_->wait_connected(TIME_SYNC_RETRY_MS) && sync_round_();
+        vTaskDelay(pdMS_TO_TICKS(ok ? TIME_SYNC_INTERVAL_S * 1000 : TIME_SYNC_RETRY_MS));
+    }
+}
+
+/* 連送 TIME_SYNC_BURST 次請求，取 RTT 最小的樣本（排隊延遲最少、對稱性最好） */
+bool TimeManager::sync_round_()
+{
+    SyncSample s, best = {};
+    int64_t best_rtt = INT64_MAX;
+
+    xQueueReset(reply_q_);
+    for (int i = 0; i < TIME_SYNC_BURST; i++) {
+        uint32_t seq = ++seq_;
+        int64_t  t0  = esp_timer_get_time();
+        char json[160];
+        int  len = snprintf(json, sizeof(json),
+                            "{\"device_id\":\"%s\",\"timestamp\":%llu,\"type\":\"time_sync_request\","
+                            "\"payload\":{\"seq\":%lu,\"t0\":%lld}}",
+                            DEVICE_ID, (unsigned long long)(epoch_us_at(t0) / 1000),
+                            (unsigned long)seq, (long long)t0);
+        if (!ws_->send_text(json, (size_t)len, pdMS_TO_TICKS(TIME_SYNC_REPLY_TIMEOUT_MS))) break;
+
+        /* 丟棄逾時後才到的舊回覆 */
+        TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(TIME_SYNC_REPLY_TIMEOUT_MS);
+        TickType_t left;
+        while ((left = deadline - xTaskGetTickCount()) <= pdMS_TO_TICKS(TIME_SYNC_REPLY_TIMEOUT_MS) &&
+               xQueueReceive(reply_q_, &s, left) == pdTRUE) {
+            if (s.seq != seq || s.t0 != t0) continue;
+            int64_t rtt = (s.t3 - s.t0) - (s.t2 - s.t1);
+            if (rtt >= 0 && rtt < best_rtt) { best_rtt = rtt; best = s; }
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(TIME_SYNC_BURST_GAP_MS));
+    }
+    if (best_rtt == INT64_MAX) {
+        ESP_LOGW(TAG, "Time sync: no reply");
+        return false;
+    }
+
+    /* offset = ((t1 - t0) + (t2 - t3)) / 2，對應裝置端 (t0 + t3) / 2 的時刻 */
+    int64_t offset = ((best.t1 - best.t0) + (best.t2 - best.t3)) / 2;
+    apply_((best.t0 + best.t3) / 2, offset, best_rtt);
+    return true;
+}
+
+void TimeManager::apply_(int64_t mid_timer_us, int64_t offset_us, int64_t rtt_us)
+{
+    portENTER_CRITICAL(&lock_);
+    ClockModel c = clock_;
+    portEXIT_CRITICAL(&lock_);
+
+    /* 漂移：兩次同步間原始偏移的變化率（間隔太短時不更新，以平滑值抑制雜訊） */
+    float   drift  = c.drift_ppm;
+    int64_t span   = mid_timer_us - c.base_timer_us;
+    int64_t err_us = 0;
+    if (c.synced) {
+        err_us = offset_us - (c.offset_us + (int64_t)((double)span * c.drift_ppm / 1e6));
+        if (span >= (int64_t)TIME_DRIFT_MIN_SPAN_S * 1000000) {
+            float measured = (float)((double)(offset_us - c.offset_us) * 1e6 / (double)span);
+            drift = (drift == 0.0f) ? measured : drift * 0.7f + measured * 0.3f;
+            if (drift >  TIME_DRIFT_MAX_PPM) drift =  TIME_DRIFT_MAX_PPM;
+            if (drift < -TIME_DRIFT_MAX_PPM) drift = -TIME_DRIFT_MAX_PPM;
+        }
+    }
+
+    ClockModel n = { true, mid_timer_us, offset_us, drift, (uint32_t)(rtt_us / 2) };
+    portENTER_CRITICAL(&lock_);
+    clock_ = n;
+    portEXIT_CRITICAL(&lock_);
+
+    /* 系統時間（localtime / log）一併對齊 */
+    int64_t now_us = epoch_us_at(esp_timer_get_time());
+    struct timeval tv = { .tv_sec = (time_t)(now_us / 1000000),
+                          .tv_usec = (suseconds_t)(now_us % 1000000) };
+    settimeofday(&tv, NULL);
+
+#if TIME_LOG >= TIME_LOG_LEVEL_INFO
+    ESP_LOGI(TAG, "Server time sync: rtt=%lld us, +/-%u us, step=%lld us, drift=%.1f ppm",
+             (long long)rtt_us, (unsigned)n.uncertainty_us, (long long)err_us, drift);
+#endif
+}
@@ -2,11 +2,17 @@
 #define TIME_MANAGER_H
 
 /* ============================================================
- * time_manager.h - NTP 時間同步管理
+ * time_manager.h - 時間同步管理
  * ESP-MIAO v0.8.0
+ *
+ * 主要時間來源為 Server：經既有 WebSocket 以 NTP 式四時間戳（t0/t1/t2/t3）
+ * 估計 esp_timer 與 Server 時鐘的偏移，定期重新同步並以 esp_timer 估計漂移。
+ * SNTP 為選用（TIME_SNTP_ENABLE），且預設不等待。
  * ============================================================ */
 
 #include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 
 /* Debug 等級控制 */
 #define TIME_LOG_LEVEL_NONE   0
@@ -18,14 +24,18 @@
 #define TIME_LOG TIME_LOG_LEVEL_INFO
 #endif
 
+class WebSocketClient;
+
 class TimeManager {
 public:
+    TimeManager();
+
     /**
-     * 初始化 SNTP 並等待時間同步。
+     * 設定時區；TIME_SNTP_ENABLE 時啟動 SNTP 並最多等待 max_retry 秒。
      * 需在 WiFi 連線完成後呼叫。
-     * @param max_retry 最大重試次數，預設 10 次
+     * @param max_retry 最大等待秒數（0 = 不等待）
      */
-    void init(int max_retry = 10);
+    void init(int max_retry);
 
     /**
      * 取得目前 Unix 時間戳（毫秒）。
@@ -34,11 +44,60 @@ public:
     uint64_t get_timestamp_ms() const;
 
     /**
-     * 透過 Server time_sync 訊息直接設定系統時間（RTC 同步）。
+     * 將 esp_timer 時間換算為 Unix 時間（微秒）。
+     * 尚未與 Server 同步時以系統時間（SNTP / time_sync）換算。
+     */
+    int64_t epoch_us_at(int64_t timer_us) const;
+
+    /** 最近一次同步的誤差上界（最佳樣本 RTT 的一半，us）；0 = 尚未同步 */
+    uint32_t uncertainty_us() const;
+
+    /**
+     * 透過 Server time_sync 訊息直接設定系統時間（RTC 同步，未補償網路延遲）。
+     * 已完成往返同步時忽略。
      * @param seconds Unix 秒數
      * @param ms      毫秒部分
      */
     void sync_from_server(long seconds, int ms);
+
+    /**
+     * 啟動往返同步 Task（連線後立即同步，之後每 TIME_SYNC_INTERVAL_S 秒）。
+     */
+    void start_server_sync(WebSocketClient &ws);
+
+    /**
+     * 往返同步回覆（由 Server 動作 worker 呼叫）。
+     * @param t0 請求送出時的 esp_timer（裝置）
+     * @param t1 Server 收到請求（Unix us）
+     * @param t2 Server 送出回覆（Unix us）
+     * @param t3 收到回覆時的 esp_timer（WS 事件 Task 蓋章）
+     */
+    void on_sync_reply(uint32_t seq, int64_t t0, int64_t t1, int64_t t2, int64_t t3);
+
+private:
+    /* epoch_us(t) = t + offset_us + drift_ppm * (t - base_timer_us) / 1e6 */
+    struct ClockModel {
+        bool     synced;
+        int64_t  base_timer_us;
+        int64_t  offset_us;
+        float    drift_ppm;
+        uint32_t uncertainty_us;
+    };
+    struct SyncSample {
+        uint32_t seq;
+        int64_t  t0, t1, t2, t3;
+    };
+
+    mutable portMUX_TYPE lock_;
+    ClockModel           clock_;
+    WebSocketClient     *ws_;
+    QueueHandle_t        reply_q_;
+    uint32_t             seq_;
+
+    static void task_entry_(void *arg);
+    void sync_loop_();
+    bool sync_round_();
+    void apply_(int64_t mid_timer_us, int64_t offset_us, int64_t rtt_us);
 };
 
 #endif // TIME_MANAGER_H
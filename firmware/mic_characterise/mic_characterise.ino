@@ -0,0 +1,316 @@
+#include <Arduino.h>
+#include <driver/i2s.h>
+#include <esp_timer.h>
+#include <math.h>
+
+/*
+ * ESP-MIAO: I2S microphone characterisation (INMP441)
+ *
+ * Replaces the ad-hoc level printing of esp32_mic_test* with one measurement run whose
+ * results are JSON lines on Serial (115200), one object per pass plus a summary:
+ *
+ *   1. "mic" pass (no load, RATE_MS): DC offset, noise floor, effective bits, clipping rate
+ *      per gain shift, and sample-rate accuracy against esp_timer (timed on DMA RX_DONE events)
+ *   2. "dma" passes: every DMA_CONFIGS entry under a simulated processing load (LOAD_PCT of each
+ *      block busy, plus a STALL_MS stall every STALL_EVERY blocks ~ Wi-Fi / TCP retransmits);
+ *      counts RX queue overflows and samples lost against the esp_timer clock
+ *   3. "summary": the smallest shift within CLIP_TARGET and the lowest-latency DMA config
+ *      without loss, i.e. the I2S_SAMPLE_SHIFT / DMA_BUF_COUNT / DMA_BUF_LEN to use in config.h
+ *
+ * Run it twice: once in a quiet room (noise floor, effective bits) and once while speaking
+ * loudly at ~30 cm (clipping per shift). Capture with e.g.
+ *   arduino-cli monitor -p /dev/ttyUSB0 -c baudrate=115200 | grep '^{' > mic.jsonl
+ */
+
+#define I2S_WS   25
+#define I2S_SD   33
+#define I2S_SCK  32
+
+#define I2S_PORT I2S_NUM_0
+
+#define SAMPLE_RATE  16000
+#define READ_FRAMES  256          // frames per i2s_read (AUDIO_CAPTURE_BLOCK_FRAMES in the firmware)
+#define WARMUP_MS    500          // INMP441 start-up spike
+#define RATE_MS      10000        // "mic" pass length
+#define SWEEP_MS     5000         // each "dma" pass length
+
+// ===== Simulated load =====
+#define LOAD_PCT     50           // busy share of every block (inference + stream encode)
+#define STALL_EVERY  32           // every Nth block also stalls...
+#define STALL_MS     40           // ...this long
+
+// ===== Gain shift candidates (int16 = raw32 >> shift) =====
+#define SHIFT_MIN    8
+#define SHIFT_MAX    16
+#define SHIFT_COUNT  (SHIFT_MAX - SHIFT_MIN + 1)
+#define CLIP_TARGET  1e-4         // accepted share of clipped samples
+#define NOISE_PCTL   10           // noise floor = this percentile of block RMS (robust to speech)
+
+struct DmaConfig {
+  int count;
+  int len;                        // frames per descriptor (len * 4 bytes <= 4092)
+};
+const DmaConfig DMA_CONFIGS[] = {
+  {2, 256}, {3, 256}, {4, 256}, {8, 256}, {16, 256},
+  {2, 512}, {4, 512}, {8, 512},
+  {4, 1000},
+};
+const int DMA_CONFIG_COUNT = sizeof(DMA_CONFIGS) / sizeof(DMA_CONFIGS[0]);
+
+#define MAX_BLOCKS  (RATE_MS * (SAMPLE_RATE / 1000) / READ_FRAMES + 1)
+
+int32_t sBuffer[READ_FRAMES];
+float blockRms[MAX_BLOCKS];
+QueueHandle_t i2sEvents = nullptr;
+
+struct MicStats {
+  uint64_t samples;
+  double sum;                     // 24-bit LSB
+  int32_t minv, maxv;
+  uint32_t orBits;                // OR of all raw words: which bits ever toggle
+  uint64_t clips[SHIFT_COUNT];
+  int blocks;
+};
+
+struct DmaStats {
+  uint32_t overflows;             // I2S_EVENT_RX_Q_OVF: DMA wrapped onto an unread buffer
+  uint64_t received;
+  int64_t expected;               // elapsed esp_timer time * SAMPLE_RATE
+  uint32_t maxReadUs;
+};
+
+// ==================== I2S ====================
+
+bool i2sInstall(int dmaCount, int dmaLen) {
+  const i2s_config_t i2s_config = {
+    .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
+    .sample_rate = SAMPLE_RATE,
+    .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
+    .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+    .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+    .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+    .dma_buf_count = dmaCount,
+    .dma_buf_len = dmaLen,
+    .use_apll = false,
+    .tx_desc_auto_clear = false,
+    .fixed_mclk = 0
+  };
+  if (i2s_driver_install(I2S_PORT, &i2s_config, 64, &i2sEvents) != ESP_OK) {
+    return false;
+  }
+
+  const i2s_pin_config_t pin_config = {
+    .bck_io_num = I2S_SCK,
+    .ws_io_num = I2S_WS,
+    .data_out_num = -1,
+    .data_in_num = I2S_SD
+  };
+  i2s_set_pin(I2S_PORT, &pin_config);
+  i2s_start(I2S_PORT);
+
+  size_t bytesIn = 0;
+  int64_t until = esp_timer_get_time() + WARMUP_MS * 1000LL;
+  while (esp_timer_get_time() < until) {
+    i2s_read(I2S_PORT, sBuffer, sizeof(sBuffer), &bytesIn, portMAX_DELAY);
+  }
+  xQueueReset(i2sEvents);
+  return true;
+}
+
+void i2sRemove() {
+  i2s_stop(I2S_PORT);
+  i2s_driver_uninstall(I2S_PORT);
+  i2sEvents = nullptr;
+}
+
+// ==================== Pass 1: microphone ====================
+
+void accumulate(MicStats &m, const int32_t *raw, int n) {
+  double blockSum = 0, blockSq = 0;
+  for (int i = 0; i < n; i++) {
+    int32_t x = raw[i] >> 8;      // INMP441: 24-bit, left-justified in the 32-bit slot
+    m.sum += x;
+    blockSum += x;
+    blockSq += (double)x * x;
+    if (x < m.minv) m.minv = x;
+    if (x > m.maxv) m.maxv = x;
+    m.orBits |= (uint32_t)raw[i];
+    for (int s = 0; s < SHIFT_COUNT; s++) {
+      int32_t v = raw[i] >> (SHIFT_MIN + s);
+      if (v > 32767 || v < -32768) m.clips[s]++;
+    }
+  }
+  m.samples += n;
+  if (m.blocks < MAX_BLOCKS) {
+    double mean = blockSum / n;
+    blockRms[m.blocks++] = sqrtf(fmax(0.0, blockSq / n - mean * mean));   // AC RMS of the block
+  }
+}
+
+int cmpFloat(const void *a, const void *b) {
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+// effective bits of a noise-limited 24-bit converter: (DR - 1.76) / 6.02, DR = full-scale sine / noise
+float effectiveBits(float noiseRms) {
+  if (noiseRms <= 0) return 24;
+  float dr = 20 * log10f((8388608.0f / sqrtf(2)) / noiseRms);
+  return (dr - 1.76f) / 6.02f;
+}
+
+int runMicPass(float *noiseRmsOut) {
+  MicStats m = {};
+  m.minv = INT32_MAX;
+  m.maxv = INT32_MIN;
+
+  // sample rate: time DMA RX_DONE events (ISR -> queue), each one is dma_buf_len new frames
+  const int dmaLen = 256;
+  i2sInstall(4, dmaLen);
+  int64_t firstUs = 0, lastUs = 0;
+  uint32_t doneEvents = 0, overflows = 0;
+  int64_t until = esp_timer_get_time() + RATE_MS * 1000LL;
+  while (esp_timer_get_time() < until) {
+    i2s_event_t ev;
+    if (xQueueReceive(i2sEvents, &ev, pdMS_TO_TICKS(100)) != pdTRUE) continue;
+    int64_t now = esp_timer_get_time();
+    if (ev.type == I2S_EVENT_RX_Q_OVF) {
+      overflows++;
+    } else if (ev.type == I2S_EVENT_RX_DONE) {
+      if (doneEvents++ == 0) firstUs = now;
+      lastUs = now;
+      size_t bytesIn = 0;
+      while (i2s_read(I2S_PORT, sBuffer, sizeof(sBuffer), &bytesIn, 0) == ESP_OK && bytesIn > 0) {
+        accumulate(m, sBuffer, bytesIn / 4);
+      }
+    }
+  }
+  i2sRemove();
+
+  float measuredRate = 0;
+  if (doneEvents > 1 && lastUs > firstUs) {
+    measuredRate = (float)((double)(doneEvents - 1) * dmaLen * 1e6 / (double)(lastUs - firstUs));
+  }
+
+  qsort(blockRms, m.blocks, sizeof(float), cmpFloat);
+  float noiseRms = m.blocks ? blockRms[m.blocks * NOISE_PCTL / 100] : 0;
+  float dc = m.samples ? (float)(m.sum / m.samples) : 0;
+  int activeBits = m.orBits ? 32 - __builtin_ctz(m.orBits) : 0;
+  *noiseRmsOut = noiseRms;
+
+  Serial.printf("{\"pass\":\"mic\",\"samples\":%llu,\"dc_offset\":%.1f,\"dc_dbfs\":%.1f,"
+                "\"noise_rms\":%.1f,\"noise_dbfs\":%.1f,\"peak_dbfs\":%.1f,"
+                "\"active_bits\":%d,\"effective_bits\":%.1f,"
+                "\"sample_rate\":%.2f,\"rate_error_ppm\":%.0f,\"rx_overflows\":%u,\"shifts\":[",
+                (unsigned long long)m.samples, dc, 20 * log10f(fabsf(dc) / 8388608.0f + 1e-9f),
+                noiseRms, 20 * log10f(noiseRms / 8388608.0f + 1e-9f),
+                20 * log10f(fmaxf(fabsf((float)m.minv), fabsf((float)m.maxv)) / 8388608.0f + 1e-9f),
+                activeBits, effectiveBits(noiseRms),
+                measuredRate, measuredRate ? (measuredRate / SAMPLE_RATE - 1) * 1e6 : 0.0f, overflows);
+
+  int recommended = SHIFT_MAX;
+  for (int s = 0; s < SHIFT_COUNT; s++) {
+    int shift = SHIFT_MIN + s;
+    float clipRate = m.samples ? (float)m.clips[s] / m.samples : 0;
+    // noise floor in int16 LSB after the shift (< 1 LSB: the shift discards the noise floor)
+    float noiseLsb = noiseRms * 256.0f / (float)(1UL << shift);
+    Serial.printf("%s{\"shift\":%d,\"clip_rate\":%.6f,\"noise_lsb\":%.2f}",
+                  s ? "," : "", shift, clipRate, noiseLsb);
+    if (clipRate <= CLIP_TARGET && shift < recommended) recommended = shift;
+  }
+  Serial.println("]}");
+  return recommended;
+}
+
+// ==================== Pass 2: DMA buffering under load ====================
+
+void busyWaitUs(int64_t us) {
+  int64_t until = esp_timer_get_time() + us;
+  while (esp_timer_get_time() < until) {
+  }
+}
+
+DmaStats runDmaPass(const DmaConfig &cfg) {
+  DmaStats d = {};
+  if (!i2sInstall(cfg.count, cfg.len)) {
+    d.expected = -1;
+    return d;
+  }
+
+  const int64_t blockUs = (int64_t)READ_FRAMES * 1000000 / SAMPLE_RATE;
+  int64_t start = esp_timer_get_time();
+  int64_t until = start + SWEEP_MS * 1000LL;
+  uint32_t block = 0;
+  while (esp_timer_get_time() < until) {
+    size_t bytesIn = 0;
+    int64_t t0 = esp_timer_get_time();
+    i2s_read(I2S_PORT, sBuffer, sizeof(sBuffer), &bytesIn, portMAX_DELAY);
+    uint32_t readUs = (uint32_t)(esp_timer_get_time() - t0);
+    if (readUs > d.maxReadUs) d.maxReadUs = readUs;
+    d.received += bytesIn / 4;
+
+    busyWaitUs(blockUs * LOAD_PCT / 100);
+    if (++block % STALL_EVERY == 0) {
+      delay(STALL_MS);
+    }
+
+    i2s_event_t ev;
+    while (xQueueReceive(i2sEvents, &ev, 0) == pdTRUE) {
+      if (ev.type == I2S_EVENT_RX_Q_OVF) d.overflows++;
+    }
+  }
+  // samples the DMA produced but that were overwritten before being read
+  d.expected = (esp_timer_get_time() - start) * SAMPLE_RATE / 1000000;
+  i2sRemove();
+  return d;
+}
+
+// ==================== Main ====================
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  Serial.println("ESP32 INMP441 characterisation start");
+
+  float noiseRms = 0;
+  int shift = runMicPass(&noiseRms);
+
+  int best = -1;
+  float bestLatency = 0;
+  for (int i = 0; i < DMA_CONFIG_COUNT; i++) {
+    const DmaConfig &cfg = DMA_CONFIGS[i];
+    DmaStats d = runDmaPass(cfg);
+    float latencyMs = (float)cfg.count * cfg.len * 1000 / SAMPLE_RATE;   // worst-case buffered audio
+    if (d.expected < 0) {
+      Serial.printf("{\"pass\":\"dma\",\"dma_buf_count\":%d,\"dma_buf_len\":%d,\"error\":\"install failed\"}\n",
+                    cfg.count, cfg.len);
+      continue;
+    }
+    // the reader ends up to one buffer behind: tolerate one DMA buffer of "loss"
+    int64_t lost = d.expected - (int64_t)d.received - cfg.len;
+    if (lost < 0) lost = 0;
+    Serial.printf("{\"pass\":\"dma\",\"dma_buf_count\":%d,\"dma_buf_len\":%d,\"buffer_ms\":%.1f,"
+                  "\"load_pct\":%d,\"stall_ms\":%d,\"rx_overflows\":%u,\"received\":%llu,"
+                  "\"lost_samples\":%lld,\"max_read_us\":%u}\n",
+                  cfg.count, cfg.len, latencyMs, LOAD_PCT, STALL_MS, d.overflows,
+                  (unsigned long long)d.received, (long long)lost, d.maxReadUs);
+    if (d.overflows == 0 && lost == 0 && (best < 0 || latencyMs < bestLatency)) {
+      best = i;
+      bestLatency = latencyMs;
+    }
+  }
+
+  if (best >= 0) {
+    Serial.printf("{\"pass\":\"summary\",\"i2s_sample_shift\":%d,\"noise_rms\":%.1f,"
+                  "\"dma_buf_count\":%d,\"dma_buf_len\":%d,\"buffer_ms\":%.1f}\n",
+                  shift, noiseRms, DMA_CONFIGS[best].count, DMA_CONFIGS[best].len, bestLatency);
+  } else {
+    Serial.printf("{\"pass\":\"summary\",\"i2s_sample_shift\":%d,\"noise_rms\":%.1f,"
+                  "\"dma_buf_count\":null,\"dma_buf_len\":null}\n", shift, noiseRms);
+  }
+  Serial.println("ESP32 INMP441 characterisation done (reset to run again)");
+}
+
+void loop() {
+  delay(1000);
+}
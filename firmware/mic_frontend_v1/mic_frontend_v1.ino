@@ -1,6 +1,9 @@
 #include <Arduino.h>
 #include <driver/i2s.h>
 #include <math.h>
+#include <esp_rom_crc.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
 
 #define I2S_WS   25
 #define I2S_SD   33
@@ -12,6 +15,44 @@
 #define SAMPLE_RATE 16000
 #define BUFFER_LEN  512
 
+// ===== PCM Dump (training data collection) =====
+// DUMP_OFF:    monitor only (text log at 115200)
+// DUMP_SERIAL: continuous framed PCM over USB-serial at DUMP_BAUD; text log is muted
+// DUMP_UDP:    continuous framed PCM, one datagram per frame, to DUMP_HOST:DUMP_PORT
+// Host side: python scripts/mic_dump_receiver.py serial /dev/ttyUSB0  (or: udp)
+#define DUMP_OFF    0
+#define DUMP_SERIAL 1
+#define DUMP_UDP    2
+#define DUMP_MODE   DUMP_OFF
+
+#define DUMP_BAUD     2000000
+#define DUMP_WIFI_SSID "YOUR_WIFI_SSID"
+#define DUMP_WIFI_PASS "YOUR_WIFI_PASSWORD"
+#define DUMP_HOST     "192.168.1.103"
+#define DUMP_PORT     5006
+
+#define DUMP_SYNC       0x4D43504DUL   // "MPCM" little-endian
+#define DUMP_FLAG_VAD   0x0001         // VAD active while this frame was captured
+
+// frame = DumpFrameHeader + samples * int16 (little-endian)
+// crc = CRC-32 (zlib) over seq..flags then the PCM payload; the receiver drops bad frames
+// and fills sequence gaps with silence
+struct __attribute__((packed)) DumpFrameHeader {
+  uint32_t sync;
+  uint32_t seq;
+  uint16_t samples;
+  uint16_t flags;
+  uint32_t crc;
+};
+static_assert(sizeof(DumpFrameHeader) == 16, "DumpFrameHeader layout is shared with mic_dump_receiver.py");
+
+// the serial port carries binary frames in DUMP_SERIAL mode: keep text off the wire
+#if DUMP_MODE == DUMP_SERIAL
+#define LOGF(...)  do {} while (0)
+#else
+#define LOGF(...)  Serial.printf(__VA_ARGS__)
+#endif
+
 //=== wav file structure
 struct WAVHeader {
   char riff[4] = {'R','I','F','F'};
@@ -51,6 +92,14 @@ uint32_t silenceFrames = 0;
 int32_t sBuffer[BUFFER_LEN];
 uint32_t loopcount; 
 
+// ===== Dump State =====
+uint8_t dumpFrame[sizeof(DumpFrameHeader) + BUFFER_LEN * sizeof(int16_t)];
+uint32_t dumpSeq = 0;
+uint32_t dumpOverflows = 0;    // frames not fully written (serial TX buffer full / UDP send failed)
+#if DUMP_MODE == DUMP_UDP
+WiFiUDP dumpUdp;
+#endif
+
 // ===== VAD State =====
 bool vad_active = false;
 uint32_t vad_last_active = 0;
@@ -85,14 +134,59 @@ void i2s_setpin() {
   i2s_set_pin(I2S_PORT, &pin_config);
 }
 
+void dumpBegin() {
+#if DUMP_MODE == DUMP_UDP
+  WiFi.mode(WIFI_STA);
+  WiFi.setSleep(false);   // modem sleep delays datagrams by up to a beacon interval
+  WiFi.begin(DUMP_WIFI_SSID, DUMP_WIFI_PASS);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(250);
+  }
+  LOGF("[DUMP] UDP -> %s:%d (ip %s)\n", DUMP_HOST, DUMP_PORT, WiFi.localIP().toString().c_str());
+#endif
+}
+
+// one frame per i2s_read: header + PCM copied into dumpFrame by the caller
+void dumpSend(int samples, bool vad) {
+#if DUMP_MODE != DUMP_OFF
+  DumpFrameHeader *hdr = (DumpFrameHeader *)dumpFrame;
+  hdr->sync = DUMP_SYNC;
+  hdr->seq = dumpSeq++;
+  hdr->samples = samples;
+  hdr->flags = vad ? DUMP_FLAG_VAD : 0;
+  size_t payload = samples * sizeof(int16_t);
+  uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&hdr->seq, 8);
+  hdr->crc = esp_rom_crc32_le(crc, dumpFrame + sizeof(DumpFrameHeader), payload);
+  size_t len = sizeof(DumpFrameHeader) + payload;
+#if DUMP_MODE == DUMP_SERIAL
+  // never block the I2S loop: a frame that does not fit is skipped whole (the receiver sees a seq gap)
+  if (Serial.availableForWrite() < (int)len) {
+    dumpOverflows++;
+    return;
+  }
+  Serial.write(dumpFrame, len);
+#else
+  if (!dumpUdp.beginPacket(DUMP_HOST, DUMP_PORT) || dumpUdp.write(dumpFrame, len) != len || !dumpUdp.endPacket()) {
+    dumpOverflows++;
+  }
+#endif
+#endif
+}
+
 void setup() {
   
   pinMode(INDICATOR_LED, OUTPUT);
 
+#if DUMP_MODE == DUMP_SERIAL
+  Serial.setTxBufferSize(8 * sizeof(dumpFrame));   // ~250 ms of audio to ride out host hiccups
+  Serial.begin(DUMP_BAUD);
+#else
   Serial.begin(115200);
+#endif
   delay(1000);
 
-  Serial.println("ESP32 INMP441 Audio Monitor Start");
+  LOGF("ESP32 INMP441 Audio Monitor Start\n");
+  dumpBegin();
 
   i2s_install();
   i2s_setpin();
@@ -102,10 +196,10 @@ void setup() {
   // ===== Recorder Init =====
   recordBuffer = (int16_t*) heap_caps_malloc(RECORD_SAMPLES * sizeof(int16_t), MALLOC_CAP_8BIT);
   if (!recordBuffer) {
-    Serial.println("Recorder malloc failed!");
+    LOGF("Recorder malloc failed!\n");
     while (1);
   }
-  Serial.printf("Recorder buffer ready: %u samples\n", RECORD_SAMPLES);
+  LOGF("Recorder buffer ready: %u samples\n", RECORD_SAMPLES);
   
   // Before go into loop(), I will eliminate the initial spike while micphone being starting to recieve signal.
   loopcount=0;
@@ -121,17 +215,17 @@ void recorderStart() {
   recordIndex = 0;
   silenceFrames = 0;
   isRecording = true;
-  Serial.println("=== REC START ===");
+  LOGF("=== REC START ===\n");
 }
 
 void recorderStop() {
   isRecording = false;
-  Serial.printf("=== REC STOP, samples=%u ===\n", recordIndex);
+  LOGF("=== REC STOP, samples=%u ===\n", recordIndex);
   
   for (int i = 0; i < 32 && i < recordIndex; i++) {
-    Serial.printf("%d,", recordBuffer[i]);
+    LOGF("%d,", recordBuffer[i]);
   }
-  Serial.println();
+  LOGF("\n");
 
   WAVHeader hdr;
   hdr.dataSize = recordIndex * 2;
@@ -139,7 +233,7 @@ void recorderStop() {
   hdr.byteRate = hdr.sampleRate * hdr.blockAlign;
   hdr.size = hdr.dataSize + sizeof(WAVHeader) - 8;
 
-Serial.printf("WAV size=%u bytes\n", hdr.dataSize + sizeof(WAVHeader));
+LOGF("WAV size=%u bytes\n", hdr.dataSize + sizeof(WAVHeader));
 
 
 }
@@ -162,6 +256,7 @@ void loop() {
   i2s_read(I2S_PORT, sBuffer, sizeof(sBuffer), &bytesIn, portMAX_DELAY);
 
   int samples = bytesIn / 4;
+  int16_t *dumpPcm = (int16_t *)(dumpFrame + sizeof(DumpFrameHeader));
 
   float rms = 0;
   float peak = 0;
@@ -187,10 +282,12 @@ void loop() {
     if(av>peak)peak=av;
 
     recorderPush(pcm);
+    dumpPcm[i] = pcm;
 
   }
 
   rms = sqrtf(rms / samples);
+  dumpSend(samples, vad_active);
   
   if (isRecording) {
     // peak可能對突刺太敏感。
@@ -228,7 +325,7 @@ void loop() {
   if (!vad_active && smooth > VAD_ON_THRESHOLD) {
       vad_active = true;
       vad_last_active = now;
-      Serial.println("[VAD] WAKE");
+      LOGF("[VAD] WAKE\n");
       digitalWrite(INDICATOR_LED, HIGH);
 
       if (!isRecording) recorderStart();
@@ -241,7 +338,7 @@ void loop() {
 
       if (now - vad_last_active > VAD_HOLD_MS) {
           vad_active = false;
-          Serial.println("[VAD] END");
+          LOGF("[VAD] END\n");
           digitalWrite(INDICATOR_LED, LOW);
 
           if (isRecording) recorderStop();
@@ -262,8 +359,8 @@ void loop() {
     //               rms, smooth, peak, ESP.getFreeHeap());
 
     // === VAD message ===
-    Serial.printf("rms=%8.2f smooth=%8.2f peak=%8.2f vad=%d heap=%u\n",
-                  rms, smooth, peak, vad_active, ESP.getFreeHeap());
+    LOGF("rms=%8.2f smooth=%8.2f peak=%8.2f vad=%d heap=%u dump_seq=%u dump_overflows=%u\n",
+         rms, smooth, peak, vad_active, ESP.getFreeHeap(), dumpSeq, dumpOverflows);
 
   }
 }
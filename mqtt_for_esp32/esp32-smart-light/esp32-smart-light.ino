@@ -2,37 +2,108 @@
 #include <WiFi.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
-#include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include <mqtt_client.h>   // ESP-IDF esp_mqtt_client（arduino-esp32 3.x 內建）
+#include <esp_timer.h>
+#include <esp_now.h>     // 語音節點的 ESP-NOW 直送指令（不經 AP / Broker）
 #include "credential.h"
 
 // ====================【自訂參數設定區】====================
-const int relayPin = 5; 
+const int relayPin = 5;
 
 const char* mqttCommandTopic = "lamp/command";
 const char* mqttStatusTopic  = "home/light_01/status"; // 僅用於 Availability (LWT)
 const char* mqttStateTopic   = "home/light_01/state";  // 用於功能狀態回報 (State)
 
 // ====================【系統變數】====================
-WiFiClient espClient;
-PubSubClient mqttClient(espClient);
+esp_mqtt_client_handle_t mqttClient = nullptr;
 AsyncWebServer server(80);
 
-// ====================【MQTT訊息處理】====================
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  String message;
-  for (unsigned int i = 0; i < length; i++) {
-    message += (char)payload[i];
+// 狀態回報交給 echoTask 發佈：MQTT 事件回調只負責立即切換 GPIO，不等網路
+enum EchoKind : uint8_t { ECHO_ONLINE, ECHO_STATE };
+struct EchoMsg {
+  EchoKind kind;
+  bool     on;
+  int64_t  received_us;   // 收到指令的時間，用於量測 指令 → GPIO → 回報 延遲
+};
+QueueHandle_t echoQueue = nullptr;
+
+// ====================【繼電器控制】====================
+void setRelay(bool on, int64_t received_us) {
+  digitalWrite(relayPin, on ? HIGH : LOW);
+  EchoMsg msg = { ECHO_STATE, on, received_us };
+  xQueueSend(echoQueue, &msg, 0);
+}
+
+// ====================【MQTT事件處理】====================
+// 在 esp_mqtt_client 的專屬 task 中執行；連線、重連與 QoS 1 重送都由 client 處理
+void mqttEventHandler(void* arg, esp_event_base_t base, int32_t eventId, void* eventData) {
+  esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)eventData;
+  switch ((esp_mqtt_event_id_t)eventId) {
+    case MQTT_EVENT_CONNECTED: {
+      Serial.printf("MQTT連線成功！(session_present=%d)\n", event->session_present);
+      // 持久 session：broker 已保留訂閱時不必重訂，斷線期間的 QoS 1 指令會補送
+      if (!event->session_present) {
+        esp_mqtt_client_subscribe(mqttClient, mqttCommandTopic, 1);
+      }
+      EchoMsg msg = { ECHO_ONLINE, false, 0 };
+      xQueueSend(echoQueue, &msg, 0);
+      break;
+    }
+    case MQTT_EVENT_DISCONNECTED:
+      Serial.println("MQTT斷線，自動重連中...");
+      break;
+    case MQTT_EVENT_DATA: {
+      int64_t now = esp_timer_get_time();
+      // 指令僅數個位元組，不會分段；主題比對需用長度（非 NUL 結尾）
+      if (event->topic_len != (int)strlen(mqttCommandTopic) ||
+          strncmp(event->topic, mqttCommandTopic, event->topic_len) != 0) {
+        break;
+      }
+      if (event->data_len == 2 && strncmp(event->data, "ON", 2) == 0) {
+        setRelay(true, now);
+      } else if (event->data_len == 3 && strncmp(event->data, "OFF", 3) == 0) {
+        setRelay(false, now);
+      }
+      Serial.printf("收到MQTT訊息 [%.*s]: %.*s\n", event->topic_len, event->topic,
+                    event->data_len, event->data);
+      break;
+    }
+    default:
+      break;
   }
-  Serial.printf("收到MQTT訊息 [%s]: %s\n", topic, message.c_str());
-
-  if (message == "ON") {
-    digitalWrite(relayPin, HIGH);
-    mqttClient.publish(mqttStateTopic, "{\"state\":\"ON\",\"device_id\":\"light_01\"}");
-  } else if (message == "OFF") {
-    digitalWrite(relayPin, LOW);
-    mqttClient.publish(mqttStateTopic, "{\"state\":\"OFF\",\"device_id\":\"light_01\"}");
+}
+
+// ====================【ESP-NOW 直送指令】====================
+// Frame 同語音節點 espnow_link.h："EMC" | version(1) | seq(uint16 LE) | payload（ON / OFF）
+// 在 WiFi Task 中執行：只切換 GPIO 並排入狀態回報（照常經 MQTT 回報，MQTT 仍為權威狀態）
+uint16_t lastEspNowSeq = 0;
+bool haveEspNowSeq = false;
+
+void onEspNowRecv(const esp_now_recv_info_t* info, const uint8_t* data, int len) {
+  int64_t now = esp_timer_get_time();
+  if (len < 6 || memcmp(data, "EMC", 3) != 0 || data[3] != 1) return;
+  uint16_t seq = data[4] | (data[5] << 8);
+  if (haveEspNowSeq && seq == lastEspNowSeq) return;   // 重複的 frame
+  lastEspNowSeq = seq;
+  haveEspNowSeq = true;
+
+  const char* payload = (const char*)data + 6;
+  int plen = len - 6;
+  if (plen == 2 && strncmp(payload, "ON", 2) == 0) {
+    setRelay(true, now);
+  } else if (plen == 3 && strncmp(payload, "OFF", 3) == 0) {
+    setRelay(false, now);
+  }
+}
+
+void startEspNow() {
+  if (esp_now_init() != ESP_OK) {
+    Serial.println("ESP-NOW 初始化失敗，僅使用 MQTT");
+    return;
   }
+  esp_now_register_recv_cb(onEspNowRecv);
+  Serial.printf("ESP-NOW 就緒：%s\n", WiFi.macAddress().c_str());
 }
 
 // ====================【WiFi連線管理】====================
@@ -40,14 +111,14 @@ void connectToWiFi() {
   Serial.println("正在連接WiFi...");
   WiFi.mode(WIFI_STA);
   WiFi.begin(ssid, password);
-  
+
   int retry = 0;
   while (WiFi.status() != WL_CONNECTED && retry < 20) {
     delay(500);
     Serial.print(".");
     retry++;
   }
-  
+
   if (WiFi.status() == WL_CONNECTED) {
     Serial.println("\nWiFi連線成功！");
     // --- 實驗性變因：省電模式選擇 ---
@@ -63,12 +134,13 @@ void sendDiscoveryMessage() {
   StaticJsonDocument<1024> doc;
   doc["device_id"] = "light_01";
   doc["device_type"] = "relay";
-  
+
   JsonArray aliases = doc.createNestedArray("aliases");
   aliases.add("燈"); aliases.add("電燈"); aliases.add("燈光"); aliases.add("light");
-  
+
   doc["control_topic"] = mqttCommandTopic;
-  
+  doc["espnow_mac"] = WiFi.macAddress();   // 語音節點據此登記 ESP-NOW peer
+
   JsonObject commands = doc.createNestedObject("commands");
   commands["on"] = "ON";
   commands["off"] = "OFF";
@@ -76,44 +148,73 @@ void sendDiscoveryMessage() {
   JsonObject action_keywords = doc.createNestedObject("action_keywords");
   JsonArray kw_on = action_keywords.createNestedArray("on");
   kw_on.add("開"); kw_on.add("打開"); kw_on.add("開啟");
-  
+
   JsonArray kw_off = action_keywords.createNestedArray("off");
   kw_off.add("關"); kw_off.add("關閉"); kw_off.add("關掉");
 
   String payload;
   serializeJson(doc, payload);
-  mqttClient.publish(discoveryTopic, payload.c_str(), true);
+  esp_mqtt_client_publish(mqttClient, discoveryTopic, payload.c_str(), 0, 1, 1);
 }
 
-// ====================【MQTT連線管理】====================
-void connectToMQTT() {
-  if (!mqttClient.connected()) {
-    Serial.print("正在連接MQTT...");
-    String clientId = "ESP32-Light-" + WiFi.macAddress();
-    
-    String lwtPayload = "{\"status\":\"offline\",\"device_id\":\"light_01\"}";
-    
-    if (mqttClient.connect(clientId.c_str(), mqtt_user, mqtt_password, 
-                          mqttStatusTopic, 1, true, lwtPayload.c_str())) {
-      Serial.println("MQTT連線成功！");
-      mqttClient.publish(mqttStatusTopic, "{\"status\":\"online\",\"device_id\":\"light_01\"}", true);
+// ====================【狀態回報 Task】====================
+void echoTask(void*) {
+  EchoMsg msg;
+  for (;;) {
+    if (xQueueReceive(echoQueue, &msg, portMAX_DELAY) != pdTRUE) continue;
+    if (msg.kind == ECHO_ONLINE) {
+      esp_mqtt_client_publish(mqttClient, mqttStatusTopic,
+                              "{\"status\":\"online\",\"device_id\":\"light_01\"}", 0, 1, 1);
       sendDiscoveryMessage();
-      mqttClient.subscribe(mqttCommandTopic);
-    } else {
-      delay(5000);
+      continue;
+    }
+    int64_t queuedUs = esp_timer_get_time() - msg.received_us;
+    esp_mqtt_client_publish(mqttClient, mqttStateTopic,
+                            msg.on ? "{\"state\":\"ON\",\"device_id\":\"light_01\"}"
+                                   : "{\"state\":\"OFF\",\"device_id\":\"light_01\"}",
+                            0, 1, 0);
+    if (msg.received_us > 0) {   // HTTP 觸發不計
+      Serial.printf("狀態回報 %s：收到指令後 %lld us 送出（排隊 %lld us）\n", msg.on ? "ON" : "OFF",
+                    esp_timer_get_time() - msg.received_us, queuedUs);
     }
   }
 }
 
+// ====================【MQTT連線管理】====================
+void startMQTT() {
+  static char uri[64];
+  static char clientId[32];
+  snprintf(uri, sizeof(uri), "mqtt://%s:1883", mqtt_server);
+  // 固定 client id 才能搭配持久 session（clean session = false）
+  snprintf(clientId, sizeof(clientId), "ESP32-Light-%s", WiFi.macAddress().c_str());
+
+  esp_mqtt_client_config_t cfg = {};
+  cfg.broker.address.uri = uri;
+  cfg.credentials.client_id = clientId;
+  cfg.credentials.username = mqtt_user;
+  cfg.credentials.authentication.password = mqtt_password;
+  cfg.session.keepalive = 60;
+  cfg.session.disable_clean_session = true;
+  cfg.session.last_will.topic = mqttStatusTopic;
+  cfg.session.last_will.msg = "{\"status\":\"offline\",\"device_id\":\"light_01\"}";
+  cfg.session.last_will.qos = 1;
+  cfg.session.last_will.retain = 1;
+  cfg.network.reconnect_timeout_ms = 5000;
+  cfg.buffer.size = 1024;
+  cfg.task.priority = 5;
+
+  mqttClient = esp_mqtt_client_init(&cfg);
+  esp_mqtt_client_register_event(mqttClient, MQTT_EVENT_ANY, mqttEventHandler, nullptr);
+  esp_mqtt_client_start(mqttClient);
+}
+
 void setupHttpServer() {
   server.on("/on", HTTP_GET, [](AsyncWebServerRequest *request){
-    digitalWrite(relayPin, HIGH);
-    mqttClient.publish(mqttStateTopic, "{\"state\":\"ON\",\"device_id\":\"light_01\"}");
+    setRelay(true, 0);
     request->send(200, "text/plain", "燈已開啟");
   });
   server.on("/off", HTTP_GET, [](AsyncWebServerRequest *request){
-    digitalWrite(relayPin, LOW);
-    mqttClient.publish(mqttStateTopic, "{\"state\":\"OFF\",\"device_id\":\"light_01\"}");
+    setRelay(false, 0);
     request->send(200, "text/plain", "燈已關閉");
   });
   server.begin();
@@ -123,23 +224,21 @@ void setup() {
   Serial.begin(115200);
   pinMode(relayPin, OUTPUT);
   digitalWrite(relayPin, LOW);
+  echoQueue = xQueueCreate(8, sizeof(EchoMsg));
+  xTaskCreate(echoTask, "mqtt_echo", 4096, nullptr, 4, nullptr);
   connectToWiFi();
-  mqttClient.setServer(mqtt_server, 1883);
-  mqttClient.setBufferSize(1024);
-  mqttClient.setCallback(mqttCallback);
-  mqttClient.setKeepAlive(60); 
+  startEspNow();
+  startMQTT();
   setupHttpServer();
 }
 
 void loop() {
+  // MQTT 由 esp_mqtt_client 的 task 以事件驅動處理，這裡只看守 WiFi
   if (WiFi.status() != WL_CONNECTED) {
     connectToWiFi();
     // 重新連線後再次確認模式 (請在此同步調整)
     // WiFi.setSleep(WIFI_PS_NONE);
     WiFi.setSleep(WIFI_PS_MIN_MODEM);
   }
-  if (!mqttClient.connected()) {
-    connectToMQTT();
-  }
-  mqttClient.loop();
+  delay(1000);
 }
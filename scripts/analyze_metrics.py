@@ -1,21 +1,47 @@
 import json
 import argparse
+from datetime import datetime
 from pathlib import Path
-from typing import List, Dict
+from typing import List, Dict, Optional, Tuple
 import statistics
 
-def load_metrics(log_path: str) -> List[Dict]:
+from esp_miao.metrics.blocklog import read_records
+
+# Timeline points in causal order: device stages, server receive, then server processing
+TIMELINE_ORDER = [
+    "wake", "ack", "stream_start", "first_frame", "server_first_byte",
+    "last_frame", "server_last_byte", "request", "asr_done", "intent", "mqtt_ack", "done",
+]
+
+def parse_time(value: Optional[str]) -> Optional[float]:
+    """Epoch seconds or an ISO date/datetime (local time)."""
+    if value is None:
+        return None
+    try:
+        return float(value)
+    except ValueError:
+        return datetime.fromisoformat(value).timestamp()
+
+def load_metrics(log_path: str, since: Optional[float] = None, until: Optional[float] = None) -> List[Dict]:
+    """A block log directory (METRICS_LOG_FORMAT=blocks) is read through its time index;
+    a legacy JSONL file is parsed in full and filtered."""
     data = []
     path = Path(log_path)
     if not path.exists():
         return []
-        
+    # Request records only (edge_telemetry / edge_health share the log)
+    if path.is_dir():
+        return [d for d in read_records(path, since, until) if "type" not in d]
+
     with open(path, "r", encoding="utf-8") as f:
         for line in f:
             try:
-                data.append(json.loads(line))
+                record = json.loads(line)
             except json.JSONDecodeError:
                 continue
+            ts = record.get("timestamp", 0)
+            if "type" not in record and (since is None or ts >= since) and (until is None or ts <= until):
+                data.append(record)
     return data
 
 def get_stats(data: List[Dict]) -> Dict:
@@ -44,6 +70,36 @@ def get_stats(data: List[Dict]) -> Dict:
         "error_rate": errors / total
     }
 
+def timeline_breakdown(data: List[Dict]) -> List[Tuple[str, int, float, float]]:
+    """Per segment between consecutive timeline points: (segment, n, mean ms, p95 ms)."""
+    segments: Dict[Tuple[int, int], List[float]] = {}
+    for d in data:
+        timeline = d.get("timeline")
+        if not timeline:
+            continue
+        points = [i for i, name in enumerate(TIMELINE_ORDER) if name in timeline]
+        for a, b in zip(points, points[1:]):
+            delta = timeline[TIMELINE_ORDER[b]] - timeline[TIMELINE_ORDER[a]]
+            segments.setdefault((a, b), []).append(delta)
+    rows = []
+    for (a, b), deltas in sorted(segments.items()):
+        p95 = statistics.quantiles(deltas, n=20)[18] if len(deltas) >= 2 else deltas[0]
+        rows.append((f"{TIMELINE_ORDER[a]} -> {TIMELINE_ORDER[b]}", len(deltas), statistics.mean(deltas), p95))
+    return rows
+
+def print_timeline(name: str, data: List[Dict]):
+    rows = timeline_breakdown(data)
+    traced = sum(1 for d in data if d.get("trace_id"))
+    print(f"=== Timeline Breakdown: {name} (traced={traced}) ===\n")
+    if not rows:
+        print("No timeline data.\n")
+        return
+    print(f"{'Segment':<38} | {'N':>5} | {'Mean':>9} | {'P95':>9}")
+    print("-" * 70)
+    for label, n, mean, p95 in rows:
+        print(f"{label:<38} | {n:>5} | {mean:>7.0f}ms | {p95:>7.0f}ms")
+    print("\n")
+
 def print_single(name: str, s: Dict):
     print(f"=== Metrics Analysis: {name} (N={s['n']}) ===\n")
     print(f"{'Metric':<25} | {'Value':<10}")
@@ -93,14 +149,21 @@ def print_comparison(s1: Dict, name1: str, s2: Dict, name2: str):
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description="Analyze and Compare metrics.")
-    parser.add_argument("files", nargs="+", help="One or two metrics files to analyze")
+    parser.add_argument("files", nargs="+",
+                        help="One or two metrics logs to analyze (block log directory or JSONL file)")
+    parser.add_argument("--since", help="Only records at or after this time (epoch s or ISO date/datetime)")
+    parser.add_argument("--until", help="Only records at or before this time (epoch s or ISO date/datetime)")
+    parser.add_argument("--timeline", action="store_true",
+                        help="Break down the wake -> MQTT ack timeline of traced requests")
     args = parser.parse_args()
     
     results = []
     for f in args.files:
-        data = load_metrics(f)
+        data = load_metrics(f, parse_time(args.since), parse_time(args.until))
         if data:
             results.append((f, get_stats(data)))
+            if args.timeline:
+                print_timeline(f, data)
         else:
             print(f"Warning: Could not load data from {f}")
 
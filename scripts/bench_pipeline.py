@@ -0,0 +1,210 @@
+"""Offline pipeline benchmark: labelled clips -> transcribe_audio -> parse_intent_with_llm -> mocked dispatch.
+
+Corpus layout: a directory with WAV clips (16-bit mono, any rate) and a labels.jsonl manifest,
+one line per clip:
+    {"file": "light_on_01.wav", "action": "relay_set", "target": "light", "value": "on", "text": "開燈"}
+"action": "unknown" marks a clip that should not resolve to a command; "text" (optional)
+enables the ASR character error rate. Output is JSON with sorted keys and per-clip rows in
+file order, so two runs (e.g. before / after an ASR or LLM tuning change) diff cleanly:
+    python scripts/bench_pipeline.py corpus/ -o before.json
+    python scripts/bench_pipeline.py corpus/ -o after.json --compare before.json
+"""
+import argparse
+import asyncio
+import json
+import math
+import time
+import wave
+from pathlib import Path
+from typing import Dict, List, Optional
+from unittest.mock import AsyncMock, patch
+
+from esp_miao import config
+from esp_miao.asr_pool import asr_pool
+from esp_miao.audio import pcm_to_float32, resample_linear, trim_silence, transcribe_audio, warm_up_whisper
+from esp_miao.dispatch import dispatch_command, mqtt_dispatcher
+from esp_miao.intent import intent_cache, normalize_transcript, parse_intent_with_llm, warm_up_llm
+from esp_miao.metrics import MetricsContext
+
+STAGES = ("asr", "intent", "dispatch", "total")
+QUANTILES = (0.5, 0.9, 0.95, 0.99)
+# Settings that change what this benchmark measures; recorded so a diff shows what was tuned
+CONFIG_KEYS = (
+    "WHISPER_MODEL", "WHISPER_DEVICE", "WHISPER_COMPUTE_TYPE", "WHISPER_CPU_THREADS",
+    "ASR_PROCESSES", "LLM_MODEL", "LLM_TIMEOUT_S",
+)
+
+
+def load_corpus(directory: Path) -> List[Dict]:
+    labels = []
+    with open(directory / "labels.jsonl", "r", encoding="utf-8") as f:
+        for line in f:
+            if line.strip():
+                labels.append(json.loads(line))
+    return sorted(labels, key=lambda l: l["file"])
+
+
+def read_clip(path: Path):
+    """Return (float32 samples at the Whisper rate, clip seconds)."""
+    with wave.open(str(path), "rb") as w:
+        if w.getnchannels() != 1 or w.getsampwidth() != 2:
+            raise ValueError(f"{path.name}: expected mono 16-bit WAV")
+        rate = w.getframerate()
+        pcm = w.readframes(w.getnframes())
+    return resample_linear(pcm_to_float32(pcm), rate), len(pcm) / 2 / rate
+
+
+def char_error_rate(reference: str, hypothesis: str) -> float:
+    """Levenshtein distance over normalized characters / reference length."""
+    ref, hyp = normalize_transcript(reference), normalize_transcript(hypothesis)
+    if not ref:
+        return 0.0 if not hyp else 1.0
+    row = list(range(len(hyp) + 1))
+    for i, r in enumerate(ref, 1):
+        prev, row[0] = row[0], i
+        for j, h in enumerate(hyp, 1):
+            prev, row[j] = row[j], min(row[j] + 1, row[j - 1] + 1, prev + (r != h))
+    return row[-1] / len(ref)
+
+
+def intent_matches(label: Dict, intent: Dict) -> bool:
+    if label.get("action") == "unknown":
+        return intent.get("action") == "unknown"
+    return all(str(intent.get(k, "")).lower() == str(label.get(k, "")).lower()
+               for k in ("action", "target", "value"))
+
+
+def percentiles(values: List[float]) -> Dict[str, float]:
+    ranked = sorted(values)
+    result = {"mean": round(sum(ranked) / len(ranked), 4) if ranked else 0.0}
+    for q in QUANTILES:
+        result[f"p{round(q * 100)}"] = ranked[max(1, math.ceil(q * len(ranked))) - 1] if ranked else 0.0
+    return result
+
+
+async def run_clip(label: Dict, directory: Path) -> Dict:
+    samples, clip_s = read_clip(directory / label["file"])
+    ctx = MetricsContext(f"bench_{label['file']}", "bench")
+    t0 = time.perf_counter()
+    samples, _, _ = trim_silence(samples)
+    text = await transcribe_audio(samples, "pcm_16k_16bit", device_id="bench")
+    t_asr = time.perf_counter()
+    intent = await parse_intent_with_llm(text, ctx)
+    t_intent = time.perf_counter()
+    if intent.get("action") != "unknown" and intent.get("target"):
+        await dispatch_command(intent["target"], str(intent.get("value", "")), ctx)
+    t_done = time.perf_counter()
+
+    row = {
+        "file": label["file"],
+        "clip_s": round(clip_s, 3),
+        "text": text,
+        "intent": {k: intent.get(k) for k in ("action", "target", "value")},
+        "correct": intent_matches(label, intent),
+        "llm_called": bool(ctx.data.get("llm_called")),
+        "latency": {
+            "asr": round(t_asr - t0, 4),
+            "intent": round(t_intent - t_asr, 4),
+            "dispatch": round(t_done - t_intent, 4),
+            "total": round(t_done - t0, 4),
+        },
+    }
+    if label.get("text"):
+        row["cer"] = round(char_error_rate(label["text"], text), 4)
+    return row
+
+
+async def run_bench(directory: Path, concurrency: int, repeat: int, use_cache: bool) -> Dict:
+    labels = load_corpus(directory)
+    if not use_cache:
+        intent_cache.max_size = 0   # every clip pays for its own intent resolution
+
+    llm_warm = await warm_up_llm()
+    warmup = {"asr": await warm_up_whisper(), "llm_s": round(llm_warm, 3) if llm_warm is not None else None}
+
+    semaphore = asyncio.Semaphore(max(1, concurrency))
+
+    async def bounded(label: Dict) -> Dict:
+        async with semaphore:
+            return await run_clip(label, directory)
+
+    # Dispatch is mocked at the MQTT publish: device lookup and payload mapping still run
+    try:
+        with patch.object(mqtt_dispatcher, "send", new=AsyncMock(return_value=True)):
+            t0 = time.perf_counter()
+            rows = await asyncio.gather(*(bounded(l) for _ in range(repeat) for l in labels))
+            wall_s = time.perf_counter() - t0
+    finally:
+        if asr_pool.running:
+            await asr_pool.stop()
+
+    commands = [r for r, l in zip(rows, labels * repeat) if l.get("action") != "unknown"]
+    cers = [r["cer"] for r in rows if "cer" in r]
+    llm_calls = sum(r["llm_called"] for r in rows)
+    return {
+        "corpus": str(directory),
+        "config": {k: getattr(config, k, None) for k in CONFIG_KEYS},
+        "settings": {"concurrency": concurrency, "repeat": repeat, "intent_cache": use_cache},
+        "warmup": warmup,
+        "clips": len(labels),
+        "requests": len(rows),
+        "accuracy": {
+            "intent": round(sum(r["correct"] for r in rows) / len(rows), 4) if rows else 0.0,
+            "commands": round(sum(r["correct"] for r in commands) / len(commands), 4) if commands else None,
+            "asr_cer": round(sum(cers) / len(cers), 4) if cers else None,
+        },
+        "routing": {
+            "keyword": len(rows) - llm_calls,
+            "llm": llm_calls,
+            "keyword_ratio": round((len(rows) - llm_calls) / len(rows), 4) if rows else 0.0,
+        },
+        "latency": {stage: percentiles([r["latency"][stage] for r in rows]) for stage in STAGES},
+        "throughput": {
+            "wall_s": round(wall_s, 3),
+            "requests_per_s": round(len(rows) / wall_s, 3) if wall_s else 0.0,
+            "audio_s_per_s": round(sum(r["clip_s"] for r in rows) / wall_s, 3) if wall_s else 0.0,
+        },
+        "results": rows,
+    }
+
+
+def print_report(report: Dict, baseline: Optional[Dict] = None):
+    acc, routing, thr = report["accuracy"], report["routing"], report["throughput"]
+    print(f"Clips: {report['clips']}  Requests: {report['requests']}  "
+          f"Concurrency: {report['settings']['concurrency']}")
+    print(f"Intent accuracy: {acc['intent']:.1%}  Keyword ratio: {routing['keyword_ratio']:.1%}"
+          + (f"  ASR CER: {acc['asr_cer']:.1%}" if acc["asr_cer"] is not None else ""))
+    print(f"Throughput: {thr['requests_per_s']:.2f} req/s  ({thr['audio_s_per_s']:.2f} audio s/s)")
+    print(f"{'Stage':<10} | {'p50':>8} | {'p95':>8} | {'p99':>8}" + (" | Δp95 vs baseline" if baseline else ""))
+    for stage in STAGES:
+        s = report["latency"][stage]
+        line = f"{stage:<10} | {s['p50']:>7.3f}s | {s['p95']:>7.3f}s | {s['p99']:>7.3f}s"
+        if baseline and stage in baseline.get("latency", {}):
+            line += f" | {s['p95'] - baseline['latency'][stage]['p95']:+.3f}s"
+        print(line)
+    if baseline:
+        delta = acc["intent"] - baseline["accuracy"]["intent"]
+        print(f"Intent accuracy vs baseline: {delta:+.1%}")
+        changed = {r["file"]: r["correct"] for r in baseline.get("results", [])}
+        for r in report["results"]:
+            if r["file"] in changed and changed[r["file"]] != r["correct"]:
+                print(f"  {'fixed' if r['correct'] else 'broke'}: {r['file']} -> {r['text']!r} {r['intent']}")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Benchmark ASR -> intent -> dispatch over a labelled clip corpus.")
+    parser.add_argument("corpus", type=Path, help="Directory with WAV clips and labels.jsonl")
+    parser.add_argument("-o", "--output", default="bench_results.json", help="Where to write the JSON report")
+    parser.add_argument("--concurrency", type=int, default=1, help="Clips in flight at once")
+    parser.add_argument("--repeat", type=int, default=1, help="Run the corpus this many times")
+    parser.add_argument("--intent-cache", action="store_true",
+                        help="Keep the intent cache enabled (repeats then skip intent resolution)")
+    parser.add_argument("--compare", help="Previous report to diff latency and accuracy against")
+    args = parser.parse_args()
+
+    report = asyncio.run(run_bench(args.corpus, args.concurrency, args.repeat, args.intent_cache))
+    Path(args.output).write_text(json.dumps(report, ensure_ascii=False, indent=2, sort_keys=True) + "\n",
+                                 encoding="utf-8")
+    baseline = json.loads(Path(args.compare).read_text(encoding="utf-8")) if args.compare else None
+    print_report(report, baseline)
+    print(f"Report written to {args.output}")
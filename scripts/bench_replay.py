@@ -0,0 +1,210 @@
+"""Server capacity benchmark: replay recorded device sessions in-process, no devices needed.
+
+Record sessions by running the server with STREAM_CAPTURE_DIR set (one .cap file per voice
+session, wake to audio_end, with the original inter-message timing). This script feeds them
+through websocket_endpoint as N virtual devices at once, raising N until the reply latency
+(device end of speech -> reply) breaks the SLO, and reports the highest sustainable
+sessions per second with per-stage latency and CPU for the current ASR / LLM configuration:
+    STREAM_CAPTURE_DIR=captures python -m esp_miao.server       # collect captures
+    python scripts/bench_replay.py captures/ -o small.json
+    WHISPER_MODEL=medium python scripts/bench_replay.py captures/ -o medium.json --compare small.json
+--speed 1 keeps the original pacing (the device streams in real time); --speed 0 sends as
+fast as possible and measures pure processing throughput.
+"""
+import argparse
+import asyncio
+import itertools
+import json
+import math
+import os
+import time
+from pathlib import Path
+from typing import Dict, List, Optional
+from unittest.mock import AsyncMock, patch
+
+from esp_miao import app as server
+from esp_miao import config
+from esp_miao.asr_pool import asr_pool
+from esp_miao.dispatch import mqtt_dispatcher
+from esp_miao.metrics.aggregator import LATENCY_STAGES
+from esp_miao.replay import Capture, ReplayWebSocket, read_capture
+
+QUANTILES = (0.5, 0.9, 0.95, 0.99)
+# Settings that change what this benchmark measures; recorded so a diff shows what was tuned
+CONFIG_KEYS = (
+    "WHISPER_MODEL", "WHISPER_DEVICE", "WHISPER_COMPUTE_TYPE", "WHISPER_CPU_THREADS",
+    "ASR_PROCESSES", "LLM_MODEL", "LLM_TIMEOUT_S",
+)
+CLK_TCK = os.sysconf("SC_CLK_TCK")
+
+
+def load_captures(paths: List[Path]) -> List[Capture]:
+    files = []
+    for path in paths:
+        files.extend(sorted(path.glob("*.cap")) if path.is_dir() else [path])
+    captures = [read_capture(f) for f in files]
+    return [c for c in captures if c.messages]
+
+
+def percentiles(values: List[float]) -> Dict[str, float]:
+    ranked = sorted(values)
+    result = {"mean": round(sum(ranked) / len(ranked), 4) if ranked else 0.0}
+    for q in QUANTILES:
+        result[f"p{round(q * 100)}"] = ranked[max(1, math.ceil(q * len(ranked))) - 1] if ranked else 0.0
+    return result
+
+
+def cpu_seconds() -> Dict[str, float]:
+    """CPU time of this process (event loop, in-process ASR threads) and of the ASR worker processes."""
+    workers = 0.0
+    for pid in asr_pool.pids():
+        try:
+            fields = Path(f"/proc/{pid}/stat").read_text().rsplit(")", 1)[1].split()
+            workers += (int(fields[11]) + int(fields[12])) / CLK_TCK   # utime + stime
+        except (OSError, IndexError, ValueError):
+            pass
+    return {"server": time.process_time(), "asr_workers": workers}
+
+
+async def replay_session(capture: Capture, device_id: str, speed: float) -> Dict:
+    async def settle():
+        # 說完話後的處理在 finish_stream 建立的 Task：等它送出回覆
+        task = server.processing_tasks.get(device_id)
+        if task is not None:
+            await asyncio.wait([task])
+
+    ws = ReplayWebSocket(capture, speed=speed, settle=settle)
+    await server.websocket_endpoint(ws, device_id)
+    done = time.monotonic()
+    replies = [m for m in ws.sent if isinstance(m, str) and '"time_sync"' not in m]
+    return {
+        "capture": capture.path.name,
+        "reply_s": round(done - ws.finished, 4) if ws.finished else None,
+        "replied": bool(replies),
+    }
+
+
+async def run_level(captures: List[Capture], concurrency: int, sessions: int, speed: float) -> Dict:
+    """concurrency virtual devices each replay captures back to back until sessions are done."""
+    contexts: List[Dict] = []
+    record = server.aggregator.record
+
+    def collect(ctx):
+        contexts.append(dict(ctx.data))
+        record(ctx)
+
+    order = itertools.cycle(captures)
+    remaining = [sessions]
+
+    async def device(slot: int) -> List[Dict]:
+        rows = []
+        while remaining[0] > 0:
+            remaining[0] -= 1
+            rows.append(await replay_session(next(order), f"replay-{slot}", speed))
+        return rows
+
+    cpu0 = cpu_seconds()
+    with patch.object(server.aggregator, "record", new=collect):
+        t0 = time.perf_counter()
+        results = await asyncio.gather(*(device(i) for i in range(concurrency)))
+        wall_s = time.perf_counter() - t0
+    cpu1 = cpu_seconds()
+
+    rows = [r for rs in results for r in rs]
+    reply = [r["reply_s"] for r in rows if r["reply_s"] is not None]
+    cpu = {k: round(cpu1[k] - cpu0[k], 3) for k in cpu0}
+    done = len(rows)
+    return {
+        "concurrency": concurrency,
+        "sessions": done,
+        "replied": sum(r["replied"] for r in rows),
+        "errors": sum(1 for c in contexts if c.get("error_type")),
+        "wall_s": round(wall_s, 3),
+        "sessions_per_s": round(done / wall_s, 3) if wall_s else 0.0,
+        "reply_latency": percentiles(reply),
+        # Stages that did not run keep their 0.0 default and are left out, as in the aggregator
+        "stages": {
+            stage: percentiles([c[key] for c in contexts if c.get(key)])
+            for stage, key in LATENCY_STAGES.items() if any(c.get(key) for c in contexts)
+        },
+        "cpu": {
+            **{f"{k}_s": v for k, v in cpu.items()},
+            "per_session_s": {k: round(v / done, 4) for k, v in cpu.items()} if done else {},
+            "cores_busy": round(sum(cpu.values()) / wall_s, 2) if wall_s else 0.0,
+        },
+    }
+
+
+async def run_bench(captures: List[Capture], levels: List[int], sessions: int, speed: float,
+                    slo_s: float) -> Dict:
+    # 虛擬裝置互不相干：關閉多節點喚醒去重，否則同時重播的 session 會互相取消
+    server.manager.wake_arbiter.window_s = 0
+    runs = []
+    async with server.lifespan(server.app):
+        # Dispatch is mocked at the MQTT publish: device lookup and payload mapping still run
+        with patch.object(mqtt_dispatcher, "send", new=AsyncMock(return_value=True)):
+            await run_level(captures, 1, min(len(captures), 2), 0)   # 暖機：模型載入不算進第一級
+            for level in levels:
+                run = await run_level(captures, level, max(sessions, level), speed)
+                run["sustainable"] = run["errors"] == 0 and run["reply_latency"]["p95"] <= slo_s
+                runs.append(run)
+                print(f"concurrency {level:>3}: {run['sessions_per_s']:.2f} sessions/s, "
+                      f"reply p95 {run['reply_latency']['p95']:.3f}s, "
+                      f"{run['cpu']['cores_busy']:.2f} cores{'' if run['sustainable'] else '  (over SLO)'}")
+                if not run["sustainable"]:
+                    break
+    best = max((r for r in runs if r["sustainable"]), key=lambda r: r["sessions_per_s"], default=None)
+    return {
+        "captures": [c.path.name for c in captures],
+        "audio_s": round(sum(c.duration_s for c in captures), 3),
+        "config": {k: getattr(config, k, None) for k in CONFIG_KEYS},
+        "settings": {"speed": speed, "sessions": sessions, "slo_s": slo_s, "levels": levels},
+        "max_sustainable": {
+            "concurrency": best["concurrency"] if best else 0,
+            "sessions_per_s": best["sessions_per_s"] if best else 0.0,
+        },
+        "runs": runs,
+    }
+
+
+def print_report(report: Dict, baseline: Optional[Dict] = None):
+    best = report["max_sustainable"]
+    print(f"Captures: {len(report['captures'])} ({report['audio_s']:.1f}s)  "
+          f"speed: {report['settings']['speed'] or 'max'}  SLO p95 <= {report['settings']['slo_s']}s")
+    line = f"Max sustainable: {best['sessions_per_s']:.2f} sessions/s at concurrency {best['concurrency']}"
+    if baseline:
+        line += f"  ({best['sessions_per_s'] - baseline['max_sustainable']['sessions_per_s']:+.2f} vs baseline)"
+    print(line)
+    if not report["runs"]:
+        return
+    last = next((r for r in reversed(report["runs"]) if r["sustainable"]), report["runs"][0])
+    print(f"{'Stage':<10} | {'p50':>8} | {'p95':>8}   (concurrency {last['concurrency']})")
+    for stage, s in last["stages"].items():
+        print(f"{stage:<10} | {s['p50']:>7.3f}s | {s['p95']:>7.3f}s")
+    per = last["cpu"]["per_session_s"]
+    print("CPU per session: " + ", ".join(f"{k} {v:.3f}s" for k, v in per.items()))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Replay recorded device sessions to find server capacity.")
+    parser.add_argument("captures", type=Path, nargs="+", help=".cap files or directories of them")
+    parser.add_argument("-o", "--output", default="replay_results.json", help="Where to write the JSON report")
+    parser.add_argument("--speed", type=float, default=1.0,
+                        help="Playback speed of the captured timing (1 = real time, 0 = as fast as possible)")
+    parser.add_argument("--concurrency", default="1,2,4,8,16",
+                        help="Comma-separated virtual device counts, tried in order until the SLO breaks")
+    parser.add_argument("--sessions", type=int, default=20, help="Sessions replayed per concurrency level")
+    parser.add_argument("--slo-s", type=float, default=2.0, help="Reply latency p95 budget (end of speech -> reply)")
+    parser.add_argument("--compare", help="Previous report to diff capacity against")
+    args = parser.parse_args()
+
+    captures = load_captures(args.captures)
+    if not captures:
+        parser.error("no captures found")
+    levels = [int(n) for n in args.concurrency.split(",") if n.strip()]
+    report = asyncio.run(run_bench(captures, levels, args.sessions, args.speed, args.slo_s))
+    Path(args.output).write_text(json.dumps(report, ensure_ascii=False, indent=2, sort_keys=True) + "\n",
+                                 encoding="utf-8")
+    baseline = json.loads(Path(args.compare).read_text(encoding="utf-8")) if args.compare else None
+    print_report(report, baseline)
+    print(f"Report written to {args.output}")
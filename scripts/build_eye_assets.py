@@ -0,0 +1,149 @@
+"""
+將眼睛動畫的 PNG frame 打包成 eye_assets.bin（格式見 firmware/esp32_edge_impulse/components/eye_ui/eye_assets.h）。
+
+manifest（JSON，frame 路徑相對 manifest 所在目錄）：
+    {
+      "animations": [
+        {"state": "sleeping", "frame_ms": 100, "loop": true,
+         "frames": ["sleep/000.png", "sleep/001.png"]}
+      ]
+    }
+
+每個 frame 是 128x160 的整張畫面，顏色對應到最接近的調色盤色（與 eye_ui.cpp 的 ui_palette 相同），
+黑色（索引 0）為背景 / 透明，只保留非背景像素的外框。
+
+燒錄：
+    parttool.py write_partition --partition-name eye_assets --input eye_assets.bin
+或把輸出放在 firmware/esp32_edge_impulse/assets/eye_assets.bin，idf.py flash 會一併燒錄。
+"""
+import argparse
+import json
+import struct
+import sys
+from pathlib import Path
+
+from PIL import Image
+
+MAGIC = 0x31415945  # "EYA1"
+VERSION = 1
+FLAG_LOOP = 0x01
+
+WIDTH, HEIGHT = 128, 160
+PARTITION_SIZE = 0x80000  # partitions.csv 的 eye_assets
+
+# ui_state_t
+STATES = {
+    "sleeping": 0,
+    "idle": 1,
+    "wake": 2,
+    "listening": 3,
+    "thinking": 4,
+    "action": 5,
+    "error": 6,
+}
+
+# 與 eye_ui.cpp 的 ui_palette 相同順序：UI_BLACK, UI_WHITE, UI_PINK, UI_RED
+PALETTE = [
+    (0, 0, 0),
+    (255, 255, 255),
+    (255, 100, 180),
+    (255, 40, 40),
+]
+
+HEADER = struct.Struct("<IHHI")   # magic, version, anim_count, total_size
+ANIM = struct.Struct("<BBHHH")    # state, flags, frame_count, frame_ms, first_frame
+FRAME = struct.Struct("<hhHHI")   # x, y, w, h, data_offset
+
+
+def nearest_index(rgb):
+    return min(range(len(PALETTE)),
+               key=lambda i: sum((a - b) ** 2 for a, b in zip(rgb, PALETTE[i])))
+
+
+def load_frame(path: Path):
+    img = Image.open(path).convert("RGB")
+    if img.size != (WIDTH, HEIGHT):
+        raise ValueError(f"{path}: 尺寸 {img.size}，需要 {WIDTH}x{HEIGHT}")
+    cache = {}
+    pixels = []
+    for rgb in img.getdata():
+        if rgb not in cache:
+            cache[rgb] = nearest_index(rgb)
+        pixels.append(cache[rgb])
+    return [pixels[y * WIDTH:(y + 1) * WIDTH] for y in range(HEIGHT)]
+
+
+def encode_frame(rows):
+    """裁切到非背景像素的外框，回傳 (x, y, w, h, data)；全是背景時為 1x1 透明"""
+    ys = [y for y, row in enumerate(rows) if any(row)]
+    if not ys:
+        return 0, 0, 1, 1, struct.pack("<H", 2) + bytes([0x00])
+    xs = [x for row in rows for x, c in enumerate(row) if c]
+    x0, x1, y0, y1 = min(xs), max(xs), ys[0], ys[-1]
+    w, h = x1 - x0 + 1, y1 - y0 + 1
+
+    offsets, rle = [], bytearray()
+    for row in rows[y0:y1 + 1]:
+        offsets.append(h * 2 + len(rle))
+        x = x0
+        while x <= x1:
+            c, n = row[x], 1
+            while x + n <= x1 and row[x + n] == c and n < 16:
+                n += 1
+            rle.append((n - 1) << 4 | c)
+            x += n
+    if offsets[-1] > 0xFFFF:
+        raise ValueError("frame 資料超過 64 KB")
+    return x0, y0, w, h, struct.pack(f"<{h}H", *offsets) + bytes(rle)
+
+
+def build(manifest_path: Path) -> bytes:
+    manifest = json.loads(manifest_path.read_text(encoding="utf-8"))
+    base = manifest_path.parent
+    anims = manifest["animations"]
+
+    anim_table, frame_table, blobs = [], [], []
+    for anim in anims:
+        state = STATES[anim["state"]]
+        frames = anim["frames"]
+        if not frames:
+            raise ValueError(f"{anim['state']}: 沒有 frame")
+        flags = FLAG_LOOP if anim.get("loop", True) else 0
+        anim_table.append((state, flags, len(frames), int(anim["frame_ms"]), len(frame_table)))
+        for name in frames:
+            frame_table.append(encode_frame(load_frame(base / name)))
+
+    data_start = HEADER.size + ANIM.size * len(anim_table) + FRAME.size * len(frame_table)
+    offset = data_start
+    frame_bytes = bytearray()
+    for x, y, w, h, data in frame_table:
+        frame_bytes += FRAME.pack(x, y, w, h, offset)
+        blob = data + (b"\0" if len(data) & 1 else b"")  # 列 offset 表需 2-byte 對齊
+        blobs.append(blob)
+        offset += len(blob)
+
+    out = bytearray(HEADER.pack(MAGIC, VERSION, len(anim_table), offset))
+    for entry in anim_table:
+        out += ANIM.pack(*entry)
+    out += frame_bytes
+    for blob in blobs:
+        out += blob
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="打包眼睛動畫資產")
+    parser.add_argument("manifest", help="動畫 manifest JSON")
+    parser.add_argument("-o", "--output", default="eye_assets.bin", help="輸出檔")
+    args = parser.parse_args()
+
+    data = build(Path(args.manifest))
+    if len(data) > PARTITION_SIZE:
+        print(f"資產 {len(data)} bytes 超過分區大小 {PARTITION_SIZE}", file=sys.stderr)
+        sys.exit(1)
+    Path(args.output).write_bytes(data)
+    print(f"已輸出 {args.output}（{len(data)} bytes）")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+"""
+將 Edge Impulse 匯出的 EON 模型（tflite-model/*_compiled.cpp）打包成 model 分區映像
+（格式見 firmware/esp32_edge_impulse/main/logic/model_store.h、model_weights.h）。
+
+同一個專案以更多資料重新訓練、架構不變時，只有常數張量（權重 / bias）與量化參數會變；
+韌體（CONFIG_ESP_MIAO_MODEL_PARTITION）以 layout 指紋確認映像與編譯進 app 的模型同架構後，
+直接 mmap 映像中的權重推論，不需重新燒錄韌體。
+
+    python scripts/build_model_image.py new-export/tflite-model/tflite_learn_905178_5_compiled.cpp \\
+        --generation 2 --wake-threshold 0.82 -o model.bin
+
+交給 Server（.env 的 MODEL_IMAGE 指向 model.bin），裝置下次 audio_start 回報較舊的 model_generation
+時即收到 model_update 並自 GET /model 下載；或直接燒錄第一槽：
+    parttool.py write_partition --partition-name model --input model.bin
+"""
+import argparse
+import re
+import struct
+import sys
+import zlib
+from pathlib import Path
+
+MAGIC = b"MMDL"
+FORMAT = 1
+HEADER = struct.Struct("<4sHHIIIIfI")   # ModelImageHeader
+ENTRY = struct.Struct("<IIII")          # ModelImageEntry
+SLOT_BYTES = 0x8000                     # config.h MODEL_SLOT_BYTES
+
+# TfLiteType 列舉值與各型別的 struct 格式
+TFLITE_TYPES = {
+    "kTfLiteFloat32": (1, "f"),
+    "kTfLiteInt32": (2, "i"),
+    "kTfLiteUInt8": (3, "B"),
+    "kTfLiteInt16": (7, "h"),
+    "kTfLiteInt8": (9, "b"),
+}
+
+_ARRAY = re.compile(r"(?:int8_t|uint8_t|int16_t|int32_t|float)\s+(tensor_data\d+)\[[^\]]*\]\s*=\s*\{(.*?)\};", re.S)
+_TFARRAY = re.compile(r"const TfArray<\d+, (?:float|int)> (\w+) = \{ \d+, \{ (.*?) \} \};")
+_QUANT = re.compile(r"const TfLiteAffineQuantization (\w+) = \{ \(TfLiteFloatArray\*\)&(?:g0::)?(\w+), "
+                    r"\(TfLiteIntArray\*\)&(?:g0::)?(\w+), (\d+) \};")
+_TENSOR = re.compile(r"\{ (kTfLiteMmapRo|kTfLiteArenaRw), (kTfLite\w+), \(\w+\*\)(g0::\w+|\(tensor_arena \+ \d+\)), "
+                     r"\(TfLiteIntArray\*\)&g0::\w+, (\d+), \{(kTfLite\w+), (.*?)\}, \},")
+
+
+def _numbers(text: str) -> list:
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)   # 匯出檔在多維陣列中加了 /* [0][0][][] */ 索引註解
+    return [t.strip() for t in text.split(",") if t.strip()]
+
+
+def parse_compiled(path: Path) -> list:
+    """tensorData[] 依序的張量描述：type / constant / bytes / data 值 / (scale, zero, dim)"""
+    src = path.read_text(encoding="utf-8")
+    arrays = {name: _numbers(body) for name, body in _ARRAY.findall(src)}
+    tfarrays = {name: _numbers(body) for name, body in _TFARRAY.findall(src)}
+    quants = {name: (scale, zero, int(dim)) for name, scale, zero, dim in _QUANT.findall(src)}
+
+    start = src.find("TensorInfo_t tensorData[] = {")
+    if start < 0:
+        raise ValueError(f"{path}: tensorData[] not found (not an EON compiled model?)")
+    table = src[start:src.find("};", start)]
+
+    tensors = []
+    for alloc, ttype, data, nbytes, qtype, qparams in _TENSOR.findall(table):
+        if ttype not in TFLITE_TYPES:
+            raise ValueError(f"{path}: unsupported tensor type {ttype}")
+        tensor = {"type": ttype, "constant": alloc == "kTfLiteMmapRo", "bytes": int(nbytes),
+                  "data": None, "quant": None}
+        if tensor["constant"]:
+            tensor["data"] = arrays[data.split("::")[1]]
+        if qtype == "kTfLiteAffineQuantization":
+            scale, zero, dim = quants[re.search(r"&g0::(\w+)", qparams).group(1)]
+            tensor["quant"] = (tfarrays[scale], tfarrays[zero], dim)
+        tensors.append(tensor)
+    if not tensors:
+        raise ValueError(f"{path}: no tensors parsed from tensorData[]")
+    return tensors
+
+
+def layout_hash(tensors: list) -> int:
+    """同 model_weights_layout()：各張量型別 / 是否常數 / 大小 / 量化通道數的 FNV-1a"""
+    h = 2166136261
+    for t in tensors:
+        words = (TFLITE_TYPES[t["type"]][0], 1 if t["constant"] else 0, t["bytes"],
+                 len(t["quant"][0]) if t["quant"] else 0)
+        for byte in struct.pack("<4I", *words):
+            h = ((h ^ byte) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def _pad16(data: bytes) -> bytes:
+    return data + b"\0" * (-len(data) % 16)
+
+
+def build_payload(tensors: list) -> bytes:
+    out = bytearray()
+    for i, t in enumerate(tensors):
+        quant_count = len(t["quant"][0]) if t["quant"] else 0
+        out += ENTRY.pack(t["bytes"] if t["constant"] else 0, quant_count, t["quant"][2] if t["quant"] else 0, 0)
+        if t["constant"]:
+            fmt = TFLITE_TYPES[t["type"]][1]
+            values = [float(v) if fmt == "f" else int(v) for v in t["data"]]
+            data = struct.pack(f"<{len(values)}{fmt}", *values)
+            if len(data) != t["bytes"]:
+                raise ValueError(f"tensor {i}: {len(data)} bytes of data, tensorData[] says {t['bytes']}")
+            out += _pad16(data)
+        if quant_count:
+            scale, zero, _ = t["quant"]
+            if len(zero) != quant_count:
+                raise ValueError(f"tensor {i}: {quant_count} scales but {len(zero)} zero points")
+            out += _pad16(struct.pack(f"<i{quant_count}f", quant_count, *(float(v) for v in scale)))
+            out += _pad16(struct.pack(f"<i{quant_count}i", quant_count, *(int(v) for v in zero)))
+    return bytes(out)
+
+
+def build_image(tensors: list, generation: int, wake_threshold: float = 0.0) -> bytes:
+    payload = build_payload(tensors)
+    header = HEADER.pack(MAGIC, FORMAT, len(tensors), layout_hash(tensors), generation, len(payload),
+                         zlib.crc32(payload), wake_threshold, 0)
+    return header + payload
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Pack an EON compiled model into a model partition image.")
+    parser.add_argument("compiled", type=Path, help="tflite-model/*_compiled.cpp of the retrained model")
+    parser.add_argument("--generation", type=int, required=True, help="Image version, must increase (>= 1)")
+    parser.add_argument("--wake-threshold", type=float, default=0.0,
+                        help="Wake threshold to use with this model (0 = keep the device's current one)")
+    parser.add_argument("--device-model", type=Path,
+                        help="*_compiled.cpp built into the device firmware; checks the architecture matches")
+    parser.add_argument("-o", "--output", type=Path, default=Path("model.bin"))
+    args = parser.parse_args()
+
+    if args.generation < 1 or not 0.0 <= args.wake_threshold < 1.0:
+        parser.error("generation must be >= 1 and wake threshold in [0, 1)")
+    tensors = parse_compiled(args.compiled)
+    if args.device_model is not None:
+        expected = layout_hash(parse_compiled(args.device_model))
+        if layout_hash(tensors) != expected:
+            sys.exit(f"Architecture differs from {args.device_model.name}: the device would reject this image "
+                     "(reflash the firmware instead)")
+    image = build_image(tensors, args.generation, args.wake_threshold)
+    if len(image) > SLOT_BYTES:
+        sys.exit(f"Image is {len(image)} bytes, a model slot holds {SLOT_BYTES}")
+    args.output.write_bytes(image)
+    print(f"{args.output}: generation {args.generation}, {len(tensors)} tensors, layout {layout_hash(tensors):08x}, "
+          f"{len(image)} bytes")
@@ -0,0 +1,99 @@
+"""Compare on-device wake benchmark runs across hardware targets (e.g. ESP32 vs ESP32-S3).
+
+Capture the serial output of the firmware built with CONFIG_ESP_MIAO_BENCHMARK on each board
+(same bench_clips/ partition image), then:
+    idf.py -p /dev/ttyUSB0 monitor | tee esp32.log        # ESP32 DevKit V1
+    idf.py -p /dev/ttyACM0 monitor | tee esp32s3.log      # ESP32-S3 (USB Serial/JTAG console)
+    python scripts/compare_device_bench.py esp32.log esp32s3.log
+The first log is the baseline; every other run is shown with its speed-up against it.
+Only the last "=== Benchmark" summary in each log is used.
+"""
+import argparse
+import json
+import re
+from pathlib import Path
+from typing import Dict, List
+
+_PATTERNS = {
+    "target": re.compile(r"Target\s*: (?P<target>\S+)(?: @ (?P<mhz>\d+) MHz, PSRAM (?P<psram_kb>\d+) KB)?"),
+    "throughput": re.compile(r"Throughput : (?P<audio_s>[\d.]+) s audio in (?P<wall_s>[\d.]+) s "
+                             r"\((?P<realtime>[\d.]+)x real time\)"),
+    "cycles": re.compile(r"Cycles/slice: convert=(?P<convert>\d+) vad=(?P<vad>\d+) "
+                         r"classifier=(?P<classifier>\d+) post=(?P<post>\d+)(?: pack=(?P<pack>\d+))?"),
+    "ei": re.compile(r"EI timing  : MFCC avg=(?P<mfcc_us>-?\d+) us, NN avg=(?P<nn_us>-?\d+) us"),
+    "accuracy": re.compile(r"Accuracy   : false rejects (?P<fr>\d+)/(?P<positives>\d+), "
+                           r"false accepts (?P<fa>\d+) in (?P<negatives>\d+) negatives "
+                           r"\((?P<fa_per_hour>[\d.]+) / hour\)"),
+}
+# Lower is better for every metric except real-time factor
+ROWS = (
+    ("realtime", "Real-time factor", True),
+    ("mfcc_us", "MFCC us/slice", False),
+    ("nn_us", "NN us/slice", False),
+    ("convert_us", "Convert us/slice", False),
+    ("vad_us", "VAD us/slice", False),
+    ("classifier_us", "Classifier us/slice", False),
+    ("post_us", "Post us/slice", False),
+    ("pack_us", "Stream pack us/slice", False),
+    ("fr", "False rejects", False),
+    ("fa_per_hour", "False accepts / hour", False),
+)
+
+
+def parse_log(path: Path) -> Dict:
+    """Metrics from the last benchmark summary in a serial log."""
+    text = path.read_text(encoding="utf-8", errors="replace")
+    start = text.rfind("=== Benchmark")
+    if start < 0:
+        raise ValueError(f"{path}: no '=== Benchmark' summary found")
+    summary = text[start:]
+    result: Dict = {"log": path.name}
+    for name, pattern in _PATTERNS.items():
+        m = pattern.search(summary)
+        if m is None:
+            if name == "target":
+                result["target"] = path.stem       # logs from firmware without the Target line
+                continue
+            raise ValueError(f"{path}: '{name}' line missing from the benchmark summary")
+        for key, value in m.groupdict().items():
+            if value is None:
+                continue
+            result[key] = value if key == "target" else float(value)
+    # Cycles are per slice at each chip's own clock; microseconds make targets comparable
+    if "mhz" in result:
+        for key in ("convert", "vad", "classifier", "post", "pack"):
+            if key in result:                  # pack: firmware before the stream-pack stage lacks it
+                result[f"{key}_us"] = round(result[key] / result["mhz"], 1)
+    return result
+
+
+def print_comparison(runs: List[Dict]):
+    base = runs[0]
+    header = f"{'metric':<24}" + "".join(f" | {r['target'][:18]:>18}" for r in runs)
+    print(header)
+    print("-" * len(header))
+    for key, label, higher_is_better in ROWS:
+        cells = []
+        for r in runs:
+            value = r.get(key)
+            cell = "-" if value is None else f"{value:g}"
+            if r is not base and value and base.get(key):
+                speedup = value / base[key] if higher_is_better else base[key] / value
+                cell += f" ({speedup:.2f}x)"
+            cells.append(f" | {cell:>18}")
+        print(f"{label:<24}" + "".join(cells))
+    for r in runs:
+        if "mhz" in r:
+            print(f"{r['target']}: {r['mhz']:g} MHz, PSRAM {r.get('psram_kb', 0):g} KB ({r['log']})")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compare CONFIG_ESP_MIAO_BENCHMARK serial logs across targets.")
+    parser.add_argument("logs", type=Path, nargs="+", help="Serial logs; the first one is the baseline")
+    parser.add_argument("--json", help="Also write the parsed metrics to this file")
+    args = parser.parse_args()
+
+    runs = [parse_log(p) for p in args.logs]
+    print_comparison(runs)
+    if args.json:
+        Path(args.json).write_text(json.dumps(runs, indent=2, sort_keys=True) + "\n", encoding="utf-8")
@@ -0,0 +1,187 @@
+"""Receive the framed PCM dump of firmware/mic_frontend_v1 (DUMP_MODE) and write WAV files.
+
+Serial (DUMP_SERIAL, needs pyserial) or UDP (DUMP_UDP):
+    python scripts/mic_dump_receiver.py serial /dev/ttyUSB0 --out dump/
+    python scripts/mic_dump_receiver.py udp --udp-port 5006 --out dump/
+    python scripts/mic_dump_receiver.py serial /dev/ttyUSB0 --vad-only   # one WAV per VAD segment
+
+Frames match DumpFrameHeader in mic_frontend_v1.ino. Frames with a bad CRC are dropped, and
+sequence gaps are filled with silence so each file keeps real-time length. By default
+recordings rotate every --segment-s seconds.
+"""
+import argparse
+import socket
+import struct
+import time
+import wave
+import zlib
+from pathlib import Path
+from typing import Iterator, Optional, Tuple
+
+HEADER = struct.Struct("<4sIHHI")   # DumpFrameHeader
+SYNC = b"MPCM"
+FLAG_VAD = 0x0001
+SAMPLE_RATE = 16000
+MAX_SAMPLES = 4096                  # sanity bound while resynchronising
+MAX_GAP_FRAMES = 64                 # larger jumps are a device reset, not loss: start a new file
+
+Frame = Tuple[int, int, bytes]      # (seq, flags, pcm)
+
+
+def parse_frames(buf: bytearray, stats: dict) -> Iterator[Frame]:
+    """Consume complete frames from buf (serial byte stream), resynchronising on the sync word."""
+    while True:
+        start = buf.find(SYNC)
+        if start < 0:
+            stats["skipped_bytes"] += max(0, len(buf) - (len(SYNC) - 1))
+            del buf[:max(0, len(buf) - (len(SYNC) - 1))]
+            return
+        if start:
+            stats["skipped_bytes"] += start
+            del buf[:start]
+        if len(buf) < HEADER.size:
+            return
+        frame = decode_frame(bytes(buf[:HEADER.size]), buf, stats)
+        if frame is None:
+            if stats.pop("_need_more", False):
+                return
+            del buf[:len(SYNC)]   # false sync inside PCM: search again after it
+            continue
+        n = HEADER.size + len(frame[2])
+        del buf[:n]
+        yield frame
+
+
+def decode_frame(header: bytes, data, stats: dict) -> Optional[Frame]:
+    _, seq, samples, flags, crc = HEADER.unpack(header)
+    if samples > MAX_SAMPLES:
+        stats["bad_frames"] += 1
+        return None
+    end = HEADER.size + samples * 2
+    if len(data) < end:
+        stats["_need_more"] = True
+        return None
+    pcm = bytes(data[HEADER.size:end])
+    if zlib.crc32(pcm, zlib.crc32(header[4:12])) != crc:
+        stats["bad_frames"] += 1
+        return None
+    return seq, flags, pcm
+
+
+class WavSink:
+    """Rolling WAV files (every segment_s) or one file per VAD-active run (vad_only)."""
+
+    def __init__(self, out: Path, segment_s: float, vad_only: bool):
+        self.out = out
+        self.segment_samples = int(segment_s * SAMPLE_RATE)
+        self.vad_only = vad_only
+        self.wav: Optional[wave.Wave_write] = None
+        self.samples = 0
+        self.files = 0
+        out.mkdir(parents=True, exist_ok=True)
+
+    def write(self, pcm: bytes, vad: bool):
+        if self.vad_only and not vad:
+            self.close()
+            return
+        if self.wav is None:
+            self._open()
+        self.wav.writeframes(pcm)
+        self.samples += len(pcm) // 2
+        if not self.vad_only and self.samples >= self.segment_samples:
+            self.close()
+
+    def _open(self):
+        stamp = time.strftime("%Y%m%d_%H%M%S")
+        path = self.out / f"{'vad' if self.vad_only else 'dump'}_{stamp}_{self.files:04d}.wav"
+        self.wav = wave.open(str(path), "wb")
+        self.wav.setnchannels(1)
+        self.wav.setsampwidth(2)
+        self.wav.setframerate(SAMPLE_RATE)
+        self.samples = 0
+        self.files += 1
+        print(f"writing {path}")
+
+    def close(self):
+        if self.wav is not None:
+            self.wav.close()
+            self.wav = None
+
+
+def serial_frames(port: str, baud: int, stats: dict) -> Iterator[Frame]:
+    import serial   # pyserial
+
+    buf = bytearray()
+    with serial.Serial(port, baud, timeout=0.5) as s:
+        s.reset_input_buffer()
+        while True:
+            buf += s.read(max(1, s.in_waiting))
+            yield from parse_frames(buf, stats)
+
+
+def udp_frames(host: str, port: int, stats: dict) -> Iterator[Frame]:
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+        sock.bind((host, port))
+        while True:
+            datagram, _ = sock.recvfrom(65536)
+            if len(datagram) < HEADER.size or datagram[:4] != SYNC:
+                stats["bad_frames"] += 1
+                continue
+            frame = decode_frame(datagram[:HEADER.size], datagram, stats)
+            stats.pop("_need_more", None)
+            if frame is not None:
+                yield frame
+
+
+def receive(frames: Iterator[Frame], sink: WavSink, stats: dict, report_s: float = 10.0):
+    last_seq: Optional[int] = None
+    last_report = time.monotonic()
+    for seq, flags, pcm in frames:
+        vad = bool(flags & FLAG_VAD)
+        if last_seq is not None:
+            gap = (seq - last_seq - 1) & 0xFFFFFFFF
+            if gap > MAX_GAP_FRAMES:
+                sink.close()   # device restarted
+            elif gap:
+                stats["lost_frames"] += gap
+                sink.write(b"\0" * len(pcm) * gap, vad)
+        last_seq = seq
+        stats["frames"] += 1
+        sink.write(pcm, vad)
+        now = time.monotonic()
+        if now - last_report >= report_s:
+            last_report = now
+            print(f"frames={stats['frames']} lost={stats['lost_frames']} bad={stats['bad_frames']} "
+                  f"skipped_bytes={stats['skipped_bytes']} files={sink.files}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("transport", choices=["serial", "udp"])
+    parser.add_argument("port", nargs="?", default="/dev/ttyUSB0", help="serial device (serial transport)")
+    parser.add_argument("--baud", type=int, default=2000000, help="must match DUMP_BAUD")
+    parser.add_argument("--bind", default="0.0.0.0", help="UDP listen address")
+    parser.add_argument("--udp-port", type=int, default=5006, help="must match DUMP_PORT")
+    parser.add_argument("--out", type=Path, default=Path("dump"))
+    parser.add_argument("--segment-s", type=float, default=600, help="rotate files every N seconds")
+    parser.add_argument("--vad-only", action="store_true", help="one file per VAD-active segment")
+    args = parser.parse_args()
+
+    stats = {"frames": 0, "lost_frames": 0, "bad_frames": 0, "skipped_bytes": 0}
+    if args.transport == "serial":
+        frames = serial_frames(args.port, args.baud, stats)
+    else:
+        frames = udp_frames(args.bind, args.udp_port, stats)
+    sink = WavSink(args.out, args.segment_s, args.vad_only)
+    try:
+        receive(frames, sink, stats)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        sink.close()
+        print(f"done: {stats}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,212 @@
+"""Performance regression gate: compare firmware microbenchmarks against checked-in per-target baselines.
+
+Inputs are Google Benchmark JSON from the host build (dsp_bench) and/or serial logs with the
+CONFIG_ESP_MIAO_BENCHMARK summary (device, or host wake_replay). Every metric belongs to a
+pipeline stage (capture, VAD, MFCC, NN, stream pack, UI render, post); the gate prints a
+per-stage diff table against firmware/esp32_edge_impulse/host/bench/baselines/<target>.json
+and exits 1 when any metric got slower by more than --threshold percent. Host benchmarks run
+with repetitions carry their coefficient of variation; a slowdown within twice the larger CV
+of the two runs is shown as "noisy" instead of failing the gate.
+    cmake --build build-host --target perf                   # host: runs dsp_bench, then this script
+    python scripts/perf_gate.py build-host/perf.json
+    idf.py -p /dev/ttyUSB0 monitor | tee esp32.log
+    python scripts/perf_gate.py esp32.log                      # device: target taken from the log
+    python scripts/perf_gate.py esp32.log --update             # record a new baseline
+Host times depend on the machine: record host.json on the machine that runs the gate.
+"""
+import argparse
+import json
+import sys
+from datetime import date
+from pathlib import Path
+from typing import Dict, List, Optional, Tuple
+
+from compare_device_bench import parse_log
+
+BASELINE_DIR = Path(__file__).resolve().parent.parent / "firmware" / "esp32_edge_impulse" / "host" / "bench" / "baselines"
+STAGE_ORDER = ("capture", "vad", "mfcc", "nn", "stream_pack", "ui_render", "post")
+
+# dsp_bench benchmark (name before the first '/') -> stage
+HOST_STAGES = {
+    "BM_PcmConvertI2s": "capture",
+    "BM_PcmConvertI2sFiltered": "capture",
+    "BM_PcmToFloat": "capture",
+    "BM_Resample48kTo16k": "capture",
+    "BM_Agc": "capture",
+    "BM_Beamform": "capture",
+    "BM_CaptureBlock": "capture",
+    "BM_SliceToFloat": "capture",
+    "BM_VadDetectSlice": "vad",
+    "BM_VadFrameEnergy": "vad",
+    "BM_VadFftKernel": "vad",
+    "BM_VadDetectFloat": "vad",
+    "BM_SpectralFrontend": "mfcc",
+    "BM_NoiseSuppress": "stream_pack",
+    "BM_StreamPackFrame": "stream_pack",
+    "BM_UiRenderFrame": "ui_render",
+    "BM_PosteriorUpdate": "post",
+}
+# Benchmark summary field -> (stage, unit). Cycle counts only exist on device logs.
+LOG_METRICS = {
+    "convert": ("capture", "cycles"),
+    "vad": ("vad", "cycles"),
+    "mfcc_us": ("mfcc", "us"),
+    "nn_us": ("nn", "us"),
+    "classifier": ("nn", "cycles"),
+    "pack": ("stream_pack", "cycles"),
+    "post": ("post", "cycles"),
+}
+_NS_PER_UNIT = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+Metric = Dict[str, object]   # {"stage", "value", "unit"[, "cv"]}
+
+
+def load_gbench(path: Path) -> Tuple[Dict[str, Metric], Dict]:
+    """Median CPU time per benchmark (plain runs when there were no repetitions), in ns."""
+    data = json.loads(path.read_text(encoding="utf-8"))
+    medians: Dict[str, float] = {}
+    singles: Dict[str, float] = {}
+    cvs: Dict[str, float] = {}
+    for b in data.get("benchmarks", []):
+        if b.get("error_occurred"):
+            continue
+        name = b.get("run_name", b["name"])
+        ns = b["cpu_time"] * _NS_PER_UNIT[b.get("time_unit", "ns")]
+        if b.get("run_type") == "aggregate":
+            if b.get("aggregate_name") == "median":
+                medians[name] = ns
+            elif b.get("aggregate_name") == "cv":
+                cvs[name] = b["cpu_time"] * 100.0   # CV is reported as a fraction
+        else:
+            singles.setdefault(name, ns)
+    metrics: Dict[str, Metric] = {}
+    for name, ns in {**singles, **medians}.items():
+        stage = HOST_STAGES.get(name.split("/")[0])
+        if stage is None:
+            print(f"warning: {name} has no stage in HOST_STAGES, skipped", file=sys.stderr)
+            continue
+        metrics[name] = {"stage": stage, "value": round(ns, 1), "unit": "ns"}
+        if name in cvs:
+            metrics[name]["cv"] = round(cvs[name], 1)
+    ctx = data.get("context", {})
+    context = {k: ctx[k] for k in ("num_cpus", "mhz_per_cpu", "library_build_type") if k in ctx}
+    return metrics, context
+
+
+def load_log(path: Path) -> Tuple[str, Dict[str, Metric], Dict]:
+    run = parse_log(path)
+    metrics: Dict[str, Metric] = {}
+    for key, (stage, unit) in LOG_METRICS.items():
+        value = run.get(key)
+        if value is None or value < 0 or (unit == "cycles" and "mhz" not in run):
+            continue   # host cycle counts are not comparable across runs; EI reports -1 when unmeasured
+        metrics[f"slice.{key}"] = {"stage": stage, "value": value, "unit": unit}
+    context = {"mhz": run["mhz"]} if "mhz" in run else {}
+    return run["target"].rstrip(","), metrics, context   # host summary: "Target     : host, ring ..."
+
+
+def load_inputs(paths: List[Path]) -> Tuple[str, Dict[str, Metric], Dict]:
+    target: Optional[str] = None
+    metrics: Dict[str, Metric] = {}
+    context: Dict = {}
+    for path in paths:
+        if path.suffix == ".json":
+            found, (m, ctx) = "host", load_gbench(path)
+        else:
+            found, m, ctx = load_log(path)
+        if target is not None and found != target:
+            raise SystemExit(f"{path}: target {found} does not match {target} from the other inputs")
+        target = found
+        metrics.update(m)
+        context.update(ctx)
+    return target or "host", metrics, context
+
+
+def _stage_rank(stage: str) -> int:
+    return STAGE_ORDER.index(stage) if stage in STAGE_ORDER else len(STAGE_ORDER)
+
+
+def compare(baseline: Dict[str, Metric], current: Dict[str, Metric], threshold: float) -> List[str]:
+    """Print the per-stage diff table; return the metrics that regressed past the threshold."""
+    regressed: List[str] = []
+    rows = sorted({**baseline, **current}.items(), key=lambda item: (_stage_rank(item[1]["stage"]), item[0]))
+    header = f"{'stage':<12} {'metric':<30} {'baseline':>12} {'current':>12} {'delta':>8}  unit"
+    print(header)
+    print("-" * len(header))
+    stage = None
+    worst: Dict[str, float] = {}
+    for name, _ in rows:
+        base, cur = baseline.get(name), current.get(name)
+        ref = cur or base
+        label = ref["stage"] if ref["stage"] != stage else ""
+        stage = ref["stage"]
+        base_s = f"{base['value']:.1f}" if base else "-"
+        cur_s = f"{cur['value']:.1f}" if cur else "-"
+        if base and cur and base["value"] > 0:
+            delta = (cur["value"] - base["value"]) / base["value"] * 100.0
+            worst[stage] = max(worst.get(stage, delta), delta)
+            flag = ""
+            noise = 2.0 * max(base.get("cv", 0.0), cur.get("cv", 0.0))
+            if delta > threshold and delta <= noise:
+                flag = f"  noisy (cv {noise / 2:.0f}%)"
+            elif delta > threshold:
+                flag = "  REGRESSED"
+                regressed.append(name)
+            elif delta < -threshold:
+                flag = "  faster"
+            delta_s = f"{delta:+.1f}%"
+        else:
+            delta_s, flag = "-", ("  new" if cur else "  missing")
+        print(f"{label:<12} {name:<30} {base_s:>12} {cur_s:>12} {delta_s:>8}  {ref['unit']}{flag}")
+    if worst:
+        print("\nWorst change per stage: " +
+              ", ".join(f"{s} {worst[s]:+.1f}%" for s in sorted(worst, key=_stage_rank)))
+    return regressed
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Compare firmware microbenchmarks against per-target baselines.")
+    parser.add_argument("inputs", type=Path, nargs="+",
+                        help="dsp_bench --benchmark_out JSON and/or serial logs with the benchmark summary")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="Fail when a metric is slower than the baseline by more than this percent")
+    parser.add_argument("--baselines", type=Path, default=BASELINE_DIR, help="Directory with <target>.json")
+    parser.add_argument("--target", help="Override the target detected from the inputs (baseline file name)")
+    parser.add_argument("--update", action="store_true", help="Write the inputs as the new baseline and exit")
+    args = parser.parse_args()
+
+    target, current, context = load_inputs(args.inputs)
+    target = args.target or target
+    if not current:
+        print("No metrics found in the inputs", file=sys.stderr)
+        return 2
+    path = args.baselines / f"{target}.json"
+
+    if args.update:
+        path.parent.mkdir(parents=True, exist_ok=True)
+        doc = {"target": target, "recorded": date.today().isoformat(), "context": context, "metrics": current}
+        path.write_text(json.dumps(doc, indent=2, sort_keys=True) + "\n", encoding="utf-8")
+        print(f"Baseline for {target} written to {path} ({len(current)} metrics)")
+        return 0
+
+    if not path.exists():
+        compare({}, current, args.threshold)
+        print(f"\nNo baseline for {target} at {path}; record one with --update")
+        return 0
+    doc = json.loads(path.read_text(encoding="utf-8"))
+    base_ctx = doc.get("context", {})
+    for key in ("num_cpus", "mhz_per_cpu", "mhz"):
+        if key in base_ctx and key in context and base_ctx[key] != context[key]:
+            print(f"warning: baseline {key}={base_ctx[key]}, this run {key}={context[key]} "
+                  f"(different machine or clock; deltas include that)", file=sys.stderr)
+    print(f"Target {target}, baseline recorded {doc.get('recorded', '?')}, threshold {args.threshold:g}%\n")
+    regressed = compare(doc.get("metrics", {}), current, args.threshold)
+    if regressed:
+        print(f"\n{len(regressed)} metric(s) regressed by more than {args.threshold:g}%: {', '.join(regressed)}")
+        return 1
+    print("\nNo regression beyond the threshold")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,141 @@
+"""Decode firmware trace points (CONFIG_ESP_MIAO_TRACE_POINTS) into a timeline.
+
+The firmware drains its per-core trace rings through Application Level Tracing. Capture the
+stream with OpenOCD (JTAG destination):
+    openocd -f board/esp32-wrover-kit-3.3v.cfg -c "init; esp apptrace start file://trace.bin 0 -1 -1 0 0"
+or by saving the raw bytes of the trace UART (UART destination), then:
+    python scripts/trace_view.py trace.bin
+    python scripts/trace_view.py trace.bin --chrome trace.json   # open in ui.perfetto.dev / chrome://tracing
+Batch layout matches components/trace_points/trace_points.c (trace_batch_t + trace_event_t).
+"""
+import argparse
+import json
+import struct
+from collections import defaultdict
+from pathlib import Path
+from typing import Dict, List, NamedTuple, Tuple
+
+BATCH = struct.Struct("<4sBBHIIqI")   # trace_batch_t
+EVENT = struct.Struct("<IHBB")        # trace_event_t
+MAGIC = b"MTRC"
+
+# trace_point_t; ids are append-only in trace_points.h
+NAMES = {1: "i2s_block", 2: "vad", 3: "infer_start", 4: "infer_end", 5: "ws_send", 6: "ui_frame"}
+INFER_START, INFER_END = 3, 4
+
+
+class Event(NamedTuple):
+    t_us: float
+    core: int
+    id: int
+    arg: int
+
+
+def _signed32(v: int) -> int:
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def decode(data: bytes) -> Tuple[List[Event], Dict[int, int]]:
+    """Convert every batch to microseconds on the esp_timer clock.
+
+    Each batch carries a sync point (CCOUNT and esp_timer read together on that core). The cycle
+    rate is taken from consecutive sync points of the same core, so DFS clock changes between
+    batches do not accumulate error; the first batch of a core uses the reported ticks_per_us.
+    """
+    events, dropped = [], {}
+    last_sync = {}
+    pos = 0
+    while True:
+        pos = data.find(MAGIC, pos)   # resynchronise after partial captures
+        if pos < 0 or pos + BATCH.size > len(data):
+            break
+        _, version, core, count, drops, sync_cycles, sync_us, ticks_per_us = BATCH.unpack_from(data, pos)
+        end = pos + BATCH.size + count * EVENT.size
+        if version != 1 or end > len(data):
+            pos += 1
+            continue
+        rate = float(ticks_per_us or 1)
+        if core in last_sync:
+            prev_cycles, prev_us = last_sync[core]
+            span_us = sync_us - prev_us
+            if span_us > 0:
+                measured = ((sync_cycles - prev_cycles) & 0xFFFFFFFF) / span_us
+                if 1.0 <= measured <= 1000.0:
+                    rate = measured
+        last_sync[core] = (sync_cycles, sync_us)
+        dropped[core] = drops
+        for i in range(count):
+            cycles, arg, tid, _ = EVENT.unpack_from(data, pos + BATCH.size + i * EVENT.size)
+            t_us = sync_us + _signed32((cycles - sync_cycles) & 0xFFFFFFFF) / rate
+            events.append(Event(t_us, core, tid, arg))
+        pos = end
+    events.sort(key=lambda e: e.t_us)
+    return events, dropped
+
+
+def _percentile(values: List[float], q: float) -> float:
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(q * len(ordered)))]
+
+
+def summarize(events: List[Event], dropped: Dict[int, int]) -> str:
+    if not events:
+        return "No trace batches found"
+    span_s = (events[-1].t_us - events[0].t_us) / 1e6
+    lines = [f"{len(events)} events over {span_s:.2f} s, dropped per core: "
+             + ", ".join(f"core{c}={n}" for c, n in sorted(dropped.items())),
+             f"{'trace point':<14}{'core':>5}{'count':>8}{'rate/s':>9}{'gap avg':>10}{'gap p99':>10}{'gap max':>10}"]
+    last: Dict[tuple, float] = {}
+    gaps: Dict[tuple, List[float]] = defaultdict(list)
+    counts: Dict[tuple, int] = defaultdict(int)
+    starts: Dict[int, float] = {}
+    infer_us: List[float] = []
+    for e in events:
+        key = (e.id, e.core)
+        counts[key] += 1
+        if key in last:
+            gaps[key].append(e.t_us - last[key])
+        last[key] = e.t_us
+        if e.id == INFER_START:
+            starts[e.core] = e.t_us
+        elif e.id == INFER_END and e.core in starts:
+            infer_us.append(e.t_us - starts.pop(e.core))
+    for (tid, core), n in sorted(counts.items()):
+        g = gaps[(tid, core)]
+        rate = n / span_s if span_s > 0 else 0.0
+        stats = (f"{sum(g) / len(g):>10.0f}{_percentile(g, 0.99):>10.0f}{max(g):>10.0f}" if g
+                 else f"{'-':>10}{'-':>10}{'-':>10}")
+        lines.append(f"{NAMES.get(tid, f'id{tid}'):<14}{core:>5}{n:>8}{rate:>9.1f}{stats}")
+    if infer_us:
+        lines.append(f"Inference: {len(infer_us)} runs, avg {sum(infer_us) / len(infer_us):.0f} us, "
+                     f"p99 {_percentile(infer_us, 0.99):.0f} us, max {max(infer_us):.0f} us")
+    return "\n".join(lines)
+
+
+def chrome_trace(events: List[Event]) -> dict:
+    """Chrome trace event format: inference as duration slices, everything else as instants."""
+    out = []
+    for e in events:
+        base = {"pid": 0, "tid": e.core, "ts": e.t_us, "name": NAMES.get(e.id, f"id{e.id}"), "args": {"arg": e.arg}}
+        if e.id == INFER_START:
+            out.append(dict(base, name="inference", ph="B"))
+        elif e.id == INFER_END:
+            out.append(dict(base, name="inference", ph="E"))
+        else:
+            out.append(dict(base, ph="i", s="t"))
+    out += [{"pid": 0, "tid": c, "ph": "M", "name": "thread_name", "args": {"name": f"core {c}"}}
+            for c in sorted({e.core for e in events})]
+    return {"traceEvents": out, "displayTimeUnit": "ms"}
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Decode ESP-MIAO firmware trace point captures.")
+    parser.add_argument("capture", type=Path, help="Raw app_trace capture (OpenOCD file:// or trace UART dump)")
+    parser.add_argument("--chrome", type=Path, help="Also write a Chrome / Perfetto trace JSON file")
+    args = parser.parse_args()
+
+    events, dropped = decode(args.capture.read_bytes())
+    print(summarize(events, dropped))
+    if args.chrome:
+        args.chrome.write_text(json.dumps(chrome_trace(events)))
+        print(f"Wrote {args.chrome}")
@@ -6,10 +6,10 @@ import os
 import time
 from contextlib import asynccontextmanager
 from pathlib import Path
-from typing import Optional
+from typing import Optional, Union
 
-from fastapi import FastAPI, WebSocket, WebSocketDisconnect, HTTPException
-from fastapi.responses import FileResponse
+from fastapi import FastAPI, WebSocket, WebSocketDisconnect, HTTPException, Request
+from fastapi.responses import FileResponse, PlainTextResponse
 
 from .models import (
     Action,
@@ -17,38 +17,110 @@ from .models import (
     AudioRequest,
     AudioStreamStart,
     AudioStreamChunk,
+    AudioStreamEnd,
+    AudioStreamResume,
+    AudioResumeAck,
+    AudioResumeAckPayload,
+    AudioCancel,
+    AudioCancelPayload,
     CommandRequest,
+    ContinuousStart,
+    FalseWake,
+    FalseWakePayload,
     FallbackRequest,
+    FlightRecord,
+    Heartbeat,
+    HeartbeatAck,
+    HeartbeatAckPayload,
+    LatencySlo,
+    LinkWarmup,
+    ModelUpdate,
+    ModelUpdatePayload,
     Play,
     PlayPayload,
+    Progress,
+    ProgressPayload,
+    Telemetry,
+    Health,
     TimeSync,
     TimeSyncPayload,
+    TimeSyncRequest,
+    WakeDetected,
+    WakeHint,
+    WakeTuning,
+    WakeTuningPayload,
+    RECONNECT_BUCKETS_MS,
     ALLOWED_ACTIONS,
     COMMAND_MAP,
 )
 
 from .config import (
     LOAD_MODEL_ON_START,
+    DEVICE_REGISTRY_PATH,
     DEBUG_AUDIO_SAVE,
     LOG_LEVEL,
     AUDIO_DIR,
     LOCAL_SOUND_DIR,
+    SOUND_PRELOAD,
+    EDGE_STACK_WARN_BYTES,
+    STREAMING_ASR,
+    STREAMING_SPECULATE,
+    COMMAND_CLASSIFIER,
+    UDP_AUDIO_PORT,
+    UDP_END_GRACE_S,
+    STREAM_STALL_MS,
+    LOOP_LAG_INTERVAL_MS,
+    FOLLOWUP_CONTEXT_S,
+    CLIP_MAX_BYTES,
+    WAKE_VERIFY,
+    WAKE_VERIFY_MIN_MS,
+    NOISE_PROFILE,
+    STREAM_PROGRESS,
 )
 
 from .connection import (
+    RequestWorker,
     mqtt_client,
     device_table,
     manager,
     action_validator,
+    StreamTiming,
+    StreamSession,
     MQTT_BROKER,
     MQTT_PORT,
 )
 
 from .utils import play_local_sound, get_action_sound
-from .dispatch import dispatch_command
-from .intent import parse_intent_with_llm
-from .audio import transcribe_audio, get_whisper_model
-from .metrics import init_metrics, shutdown_metrics, metrics_logger, aggregator, MetricsContext
+from .sound_player import sound_player
+from .downlink import audio_downlink
+from .dispatch import dispatch_command, dispatch_commands, mqtt_dispatcher
+from .udp_audio import udp_audio
+from .continuous import Utterance, continuous
+from .prewarm import prewarmer
+from .wake_tuning import wake_tuner
+from .intent import (
+    parse_intent_with_llm, extract_intent_from_text, intent_commands, warm_up_llm, llm_session, pinyin_stats,
+)
+from .cluster import cluster
+from .debug_audio import debug_audio
+from .replay import open_capture
+from .intent_index import intent_index
+from .audio import (
+    transcribe_audio, warm_up_whisper, whisper_loaded, whisper_profile, sample_rate_from_format, whisper_batcher,
+    bias_stats, cascade_stats, pcm_to_float32, resample, trim_silence, WHISPER_SAMPLE_RATE,
+)
+from .streaming_asr import StreamingTranscriber, Speculation
+from .scheduler import scheduler
+from .asr_pool import asr_pool
+from .classifier import command_classifier
+from .wake_verify import WakeVerifier, wake_verifier
+from .denoise import noise_profiles
+from .hallucination import segment_filter
+from .codec import codec_from_format
+from .clips import ClipError, save_clip
+from .model_image import model_images
+from .flight_record import summarize_flight_record
+from .metrics import init_metrics, shutdown_metrics, metrics_logger, aggregator, loop_lag, MetricsContext, StreamArrival
 from .version import __version__
 
 # --- Logging setup ---
@@ -58,7 +130,37 @@ logging.basicConfig(
 )
 logger = logging.getLogger("esp-miao.app")
 
+# 串流途中的 partial ASR（STREAMING_ASR=1），每個裝置一個
+streaming_sessions: dict[str, StreamingTranscriber] = {}
+# 串流結束後的背景處理（ASR + 意圖 + 派送），同一裝置的新 audio_start 會中止它
+processing_tasks: dict[str, asyncio.Task] = {}
+# 每個裝置最近一次成功派送的動作 (monotonic, target, value)：追問視窗內的下一句可延續它
+last_actions: dict[str, tuple[float, str, str]] = {}
+# 每個裝置 audio_start 回報的模型映像版本（CONFIG_ESP_MIAO_MODEL_PARTITION 的裝置才有）
+model_generations: dict[str, int] = {}
+
+
+request_workers: dict[str, RequestWorker] = {}
+
 # --- Message Handlers ---
+async def play_feedback(device_id: str, filename: str):
+    """Feedback sound on the device's own speaker when it announced one, otherwise on the server's."""
+    if not audio_downlink.play(device_id, filename):
+        await play_local_sound(filename)
+
+
+async def send_progress(device_id: str, stage: str, metrics_ctx: MetricsContext):
+    """串流處理進度：裝置據此記錄往返時間與切換 UI（不等回覆，送不出也不影響處理）。"""
+    if not STREAM_PROGRESS:
+        return
+    msg = Progress(
+        device_id="server",
+        timestamp=int(time.time() * 1000),
+        payload=ProgressPayload(stage=stage, elapsed_ms=round((time.time() - metrics_ctx.start_time) * 1000)),
+    )
+    await manager.send_to_device(device_id, msg.model_dump())
+
+
 async def handle_command_request(device_id: str, data: dict) -> dict:
     """Handle local command from esp-sr."""
     try:
@@ -73,14 +175,14 @@ async def handle_command_request(device_id: str, data: dict) -> dict:
             is_valid, error = action_validator.validate("relay_set", target, value)
             if not is_valid:
                 logger.warning(f"Action validation failed: {error}")
-                await play_local_sound("error.wav")
+                await play_feedback(device_id, "error.wav")
                 return Play(
                     device_id=device_id,
                     timestamp=int(time.time() * 1000),
                     payload=PlayPayload(audio="error.wav"),
                 ).model_dump()
 
-            await play_local_sound(get_action_sound(target, value))
+            await play_feedback(device_id, get_action_sound(target, value))
             await dispatch_command(target, value)
             return Action(
                 device_id=device_id,
@@ -94,7 +196,7 @@ async def handle_command_request(device_id: str, data: dict) -> dict:
             ).model_dump()
         else:
             logger.warning(f"Unknown command ID: {cmd_id}")
-            await play_local_sound("error.wav")
+            await play_feedback(device_id, "error.wav")
             return Play(
                 device_id=device_id,
                 timestamp=int(time.time() * 1000),
@@ -119,12 +221,13 @@ async def handle_fallback_request(device_id: str, data: dict) -> dict:
         text = msg.payload.text
         if not text and msg.payload.audio_base64:
             text = await transcribe_audio(
-                msg.payload.audio_base64, msg.payload.audio_format or "pcm_16k_16bit"
+                base64.b64decode(msg.payload.audio_base64), msg.payload.audio_format or "pcm_16k_16bit",
+                device_id=device_id,
             )
 
         if not text:
             logger.warning("No text or audio in fallback request")
-            await play_local_sound("not_understood.wav")
+            await play_feedback(device_id, "not_understood.wav")
             return Play(
                 device_id=device_id,
                 timestamp=int(time.time() * 1000),
@@ -132,10 +235,10 @@ async def handle_fallback_request(device_id: str, data: dict) -> dict:
             ).model_dump()
 
         logger.info(f"Fallback request: {text}")
-        intent = parse_intent_with_llm(text)
+        intent = await parse_intent_with_llm(text)
 
         if intent.get("action") == "unknown":
-            await play_local_sound("not_understood.wav")
+            await play_feedback(device_id, "not_understood.wav")
             return Play(
                 device_id=device_id,
                 timestamp=int(time.time() * 1000),
@@ -147,19 +250,19 @@ async def handle_fallback_request(device_id: str, data: dict) -> dict:
         target = intent.get("target", "")
         value = intent.get("value", "")
 
-        is_valid, error = action_validator.validate(action, target, value)
-        if not is_valid:
+        commands, error = validate_commands(action, intent)
+        if not commands:
             logger.warning(f"LLM action validation failed: {error}")
             # Fail-safe: return error instead of executing unsafe action
-            await play_local_sound("error.wav")
+            await play_feedback(device_id, "error.wav")
             return Play(
                 device_id=device_id,
                 timestamp=int(time.time() * 1000),
                 payload=PlayPayload(audio="error.wav"),
             ).model_dump()
 
-        await play_local_sound(get_action_sound(target, value))
-        await dispatch_command(target, value)
+        await play_feedback(device_id, get_action_sound(target, value))
+        await dispatch_commands(commands)
         return Action(
             device_id=device_id,
             timestamp=int(time.time() * 1000),
@@ -184,10 +287,10 @@ async def handle_audio_request(device_id: str, data: dict) -> dict:
     """Handle standard audio_request from ESP32."""
     try:
         msg = AudioRequest(**data)
-        audio_base64 = msg.payload.audio_base64
+        audio_bytes = base64.b64decode(msg.payload.audio_base64)
         audio_format = msg.payload.audio_format or "pcm_16k_16bit"
         confidence = msg.payload.confidence
-        return await process_complete_audio(device_id, audio_base64, audio_format, confidence)
+        return await process_complete_audio(device_id, audio_bytes, audio_format, confidence)
     except Exception as e:
         logger.error(f"Audio request error: {e}")
         return Play(
@@ -198,67 +301,119 @@ async def handle_audio_request(device_id: str, data: dict) -> dict:
 
 
 async def process_complete_audio(
-    device_id: str, audio_base64: str, audio_format: str, confidence: Optional[float] = None
+    device_id: str, audio_bytes: Union[bytes, bytearray, memoryview], audio_format: str, confidence: Optional[float] = None,
+    timing: Optional[StreamTiming] = None, text: Optional[str] = None, followup: bool = False,
+    session: Optional[StreamingTranscriber] = None, arrival: Optional[dict] = None,
 ) -> dict:
-    """Core audio processing pipeline (ASR + LLM)."""
+    """Core audio processing pipeline (ASR + LLM). A given text (streaming partial) skips ASR.
+
+    session: the stream's partial transcriber, whose speculative intent parse is reused when it
+    was started on the final transcript.
+    arrival: StreamArrival.summary() of a WebSocket binary stream, stored as rx_* fields.
+    """
     # 1. Start Metrics Context
     request_id = f"{device_id}_{int(time.time()*1000)}"
     metrics_ctx = MetricsContext(request_id, device_id)
+    if followup:
+        metrics_ctx.set_flag("followup", True)
+    if timing is not None:
+        # 裝置端各階段（喚醒 → ACK → 串流開始 → 第一 / 最後一個 frame）與 Server 收到音訊的時間併入同一條時間線
+        device_events = {
+            name[:-3]: timing.to_epoch_ms(us) for name, us in (timing.device_trace or {}).items() if us
+        }
+        if timing.first_rx_ms is not None:
+            device_events["server_first_byte"] = timing.first_rx_ms
+        if timing.last_rx_ms is not None:
+            device_events["server_last_byte"] = timing.last_rx_ms
+        metrics_ctx.merge_device_trace(timing.trace_id, device_events)
+        if timing.last_capture_end_us is not None:
+            # 最後一個樣本擷取 → Server 開始處理（依賴裝置 SNTP 與 Server 時鐘同步）
+            capture_end_ms = timing.to_epoch_ms(timing.last_capture_end_us)
+            metrics_ctx.record_latency(
+                "network_latency", round(max(time.time() * 1000 - capture_end_ms, 0.0) / 1000, 3)
+            )
+        metrics_ctx.mark_stage("stream_chunks", timing.chunks)
+        metrics_ctx.mark_stage("dropped_chunks", timing.dropped_chunks)
+        metrics_ctx.set_flag("chunk_dropped", timing.dropped_chunks > 0)
+        if timing.link:
+            for key in ("rssi", "chunk_start", "chunk_end", "send_avg_us", "send_max_us", "tx_waits",
+                        "pace_min", "pace_backoffs", "ring_lag_max", "ring_lost"):
+                metrics_ctx.mark_stage(f"link_{key}", timing.link.get(key))
+        if timing.session_id is not None:
+            metrics_ctx.mark_stage("stream_resumes", timing.resumes)
+            metrics_ctx.mark_stage("lost_samples", timing.lost_samples)
+            metrics_ctx.set_flag("stream_resumed", timing.resumes > 0)
+        if timing.conceal:
+            metrics_ctx.mark_stage("concealed_samples", timing.lost_samples)
+            if timing.link:
+                metrics_ctx.mark_stage("link_udp_dropped", timing.link.get("udp_dropped"))
+    if arrival is not None:
+        # 到達間隔 / 抖動 / 停頓歸因：區分無線鏈路、裝置端送出節奏與 Server event loop 停頓
+        for key, value in arrival.items():
+            metrics_ctx.mark_stage(f"rx_{key}", value)
+        metrics_ctx.set_flag("rx_stalled", arrival["stalls"] > 0)
     
     try:
-        # Decode base64 audio
-        audio_bytes = base64.b64decode(audio_base64)
-        
         # If confidence not provided, try to get from session
-        if confidence is None:
-            confidence = manager.session_confidence.get(device_id)
+        if confidence is None and device_id in manager.sessions:
+            confidence = manager.sessions[device_id].confidence
 
         logger.info(f" Audio processing: {len(audio_bytes)} bytes (confidence: {confidence})")
+        if confidence is not None:
+            metrics_ctx.mark_stage("wake_confidence", confidence)
 
         # --- 背景儲存邏輯 (Background Storage) ---
-        def save_audio_file():
-            try:
-                timestamp = int(time.time())
-                conf_str = f"conf{confidence:.2f}_" if confidence is not None else ""
-                audio_filename = f"{conf_str}recorded_{device_id}_{timestamp}.wav"
-                audio_path = AUDIO_DIR / audio_filename
-
-                from struct import pack
-                with open(audio_path, "wb") as f:
-                    data_size = len(audio_bytes)
-                    f.write(b"RIFF")
-                    f.write(pack("<I", 36 + data_size))
-                    f.write(b"WAVE")
-                    f.write(b"fmt ")
-                    f.write(pack("<I", 16))
-                    f.write(pack("<H", 1))
-                    f.write(pack("<H", 1)) # mono
-                    f.write(pack("<I", 16000)) # 16kHz
-                    f.write(pack("<I", 16000 * 2)) # byte rate
-                    f.write(pack("<H", 2)) # block align
-                    f.write(pack("<H", 16)) # 16-bit
-                    f.write(b"data")
-                    f.write(pack("<I", data_size))
-                    f.write(audio_bytes)
-                logger.debug(f"Audio debug file saved: {audio_path}")
-            except Exception as e:
-                logger.error(f"Failed to save debug audio: {e}")
-
-        # 使用 asyncio.to_thread 在背景儲存，不阻塞主流程
+        # 排入 debug_audio 的寫入執行緒，不阻塞主流程；串流緩衝處理完即歸還 pool，須先複製一份
         if DEBUG_AUDIO_SAVE:
-            asyncio.create_task(asyncio.to_thread(save_audio_file))
-
-        # --- 啟動 ASR (Faster-Whisper) ---
+            debug_audio.submit(device_id, bytes(audio_bytes), sample_rate_from_format(audio_format), confidence)
+
+        # --- 第一階段：指令模板分類器，高信心時跳過 Whisper 與意圖解析 ---
+        features = None
+        if COMMAND_CLASSIFIER and text is None:
+            t_cls = time.time()
+            match, features = await asyncio.to_thread(command_classifier.classify_pcm, audio_bytes, audio_format)
+            metrics_ctx.record_latency("classifier_latency", round(time.time() - t_cls, 3))
+            if match is not None:
+                logger.info(f"Classifier hit for {device_id}: {match}")
+                metrics_ctx.mark_stage("recognition_stage", "classifier")
+                metrics_ctx.mark_stage("classifier_distance", match["distance"])
+                metrics_ctx.mark_stage("classifier_margin", match["margin"])
+                return await act_on_intent(device_id, match["intent"], metrics_ctx)
+        metrics_ctx.mark_stage("recognition_stage", "partial" if text is not None else "asr")
+        await send_progress(device_id, "asr_started", metrics_ctx)
+
+        # --- 啟動 ASR (Faster-Whisper)；最後一個 partial 已涵蓋整段時直接沿用 ---
         t0 = time.time()
-        text = await transcribe_audio(audio_base64, audio_format)
+        metrics_ctx.set_flag("asr_from_partial", text is not None)
+        if text is None:
+            # 去除前後靜音再送 Whisper（裝置未做端點偵測時固定送 3 秒，短指令後多為靜音）
+            samples = resample(pcm_to_float32(audio_bytes), sample_rate_from_format(audio_format))
+            speech, lead_s, trail_s = trim_silence(samples)
+            if NOISE_PROFILE:
+                # 前後靜音即該房間的噪音樣本：更新裝置噪音譜後對語音段做頻譜相減
+                start = round(lead_s * WHISPER_SAMPLE_RATE)
+                speech, denoised = noise_profiles.process(device_id, samples, start, start + len(speech))
+                metrics_ctx.set_flag("denoised", denoised)
+            samples = speech
+            metrics_ctx.mark_stage("trimmed_s", round(lead_s + trail_s, 3))
+            metrics_ctx.mark_stage("asr_input_s", round(len(samples) / WHISPER_SAMPLE_RATE, 3))
+            text = await transcribe_audio(samples, "pcm_16k_16bit", device_id=device_id, metrics_ctx=metrics_ctx)
         metrics_ctx.record_latency("asr_latency", round(time.time() - t0, 3))
+        metrics_ctx.mark_event("asr_done")
+        await send_progress(device_id, "asr_done", metrics_ctx)
+        if timing is not None and timing.last_capture_end_us is not None:
+            # 最後一個樣本擷取 → ASR 完成（依賴裝置 SNTP 與 Server 時鐘同步）
+            capture_end_ms = timing.to_epoch_ms(timing.last_capture_end_us)
+            metrics_ctx.record_latency(
+                "mic_to_asr_latency", round((time.time() * 1000 - capture_end_ms) / 1000, 3)
+            )
         metrics_ctx.mark_stage("asr_text", text)
         metrics_ctx.mark_stage("asr_text_length", len(text))
         
         if not text:
             metrics_ctx.set_flag("asr_empty", True)
             logger.info(f"ASR result is empty (Silence/Noise), skipping intent parsing for {device_id}")
-            await play_local_sound("not_understood.wav")
+            await play_feedback(device_id, "not_understood.wav")
             
             # Record & Return
             metrics_logger.log(metrics_ctx.finalize())
@@ -270,14 +425,96 @@ async def process_complete_audio(
             ).model_dump()
             
         logger.info(f"ASR result: {text}")
+        speculation = None
+        if session is not None and session.speculations:
+            metrics_ctx.mark_stage("speculations", session.speculations)
+            speculation = session.take_speculation(text)
+            if speculation is None:
+                metrics_ctx.mark_stage("speculation", "miss")
+        reply = await act_on_text(device_id, text, metrics_ctx, speculation)
+
+        # 關鍵字直接命中並成功派送的錄音即為可靠樣本，加入分類器模板
+        data = metrics_ctx.data
+        if (features is not None and data.get("dispatch_success") and data.get("keyword_action_found")
+                and not data.get("llm_called") and not data.get("multi_command")):
+            command_classifier.enroll(features, data["final_target"], data["final_value"])
+        return reply
 
+    except Exception as e:
+        logger.error(f"Processing failed: {e}")
+        metrics_ctx.set_error(str(e))
+        metrics_logger.log(metrics_ctx.finalize())
+        aggregator.record(metrics_ctx)
+        return Play(
+            device_id=device_id,
+            timestamp=int(time.time() * 1000),
+            payload=PlayPayload(audio="error.wav"),
+        ).model_dump()
+
+
+async def act_on_text(device_id: str, text: str, metrics_ctx: MetricsContext,
+                      speculation: Optional[Speculation] = None) -> dict:
+    """Intent parsing for a transcript (or the speculative parse already started on it), then act_on_intent."""
+    try:
         # Parse intent with LLM (Will fallback to Keywords if clear match)
         t1 = time.time()
-        intent = parse_intent_with_llm(text, metrics_ctx)
+        if speculation is not None:
+            intent = await speculation.join(metrics_ctx)
+        else:
+            intent = await parse_intent_with_llm(text, metrics_ctx)
+        if metrics_ctx.data.get("followup"):
+            intent = continue_intent(device_id, text, intent, metrics_ctx)
         metrics_ctx.record_latency("intent_latency", round(time.time() - t1, 3))
+        metrics_ctx.mark_event("intent")
+        return await act_on_intent(device_id, intent, metrics_ctx)
+
+    except Exception as e:
+        logger.error(f"Processing failed: {e}")
+        metrics_ctx.set_error(str(e))
+        metrics_logger.log(metrics_ctx.finalize())
+        aggregator.record(metrics_ctx)
+        return Play(
+            device_id=device_id,
+            timestamp=int(time.time() * 1000),
+            payload=PlayPayload(audio="error.wav"),
+        ).model_dump()
+
 
+def continue_intent(device_id: str, text: str, intent: dict, metrics_ctx: MetricsContext) -> dict:
+    """追問只說了裝置（「還有風扇」）：沿用同一 session 上一個動作的 value。"""
+    if intent.get("action") != "unknown":
+        return intent
+    previous = last_actions.get(device_id)
+    if previous is None or time.monotonic() - previous[0] > FOLLOWUP_CONTEXT_S:
+        return intent
+    target = intent.get("target") or extract_intent_from_text(text)["target"]
+    if not target:
+        return intent
+    metrics_ctx.set_flag("followup_inherited", True)
+    logger.info(f"Follow-up from {device_id}: '{text}' continues '{previous[2]}' -> {target}")
+    return {"action": "relay_set", "target": target, "value": previous[2]}
+
+
+def validate_commands(action: str, intent: dict) -> tuple[list[dict], Optional[str]]:
+    """多裝置意圖（「關燈和風扇」）逐一驗證：回傳通過的指令與第一個拒絕原因，未通過的略過。"""
+    commands, error = [], None
+    for command in intent_commands(intent):
+        is_valid, reason = action_validator.validate(action, command["target"], command["value"])
+        if is_valid:
+            commands.append(command)
+        else:
+            logger.warning(f"Command {command['target']}={command['value']} rejected: {reason}")
+            error = error or reason
+    return commands, error
+
+
+async def act_on_intent(device_id: str, intent: dict, metrics_ctx: MetricsContext) -> dict:
+    """Validation and dispatch for a resolved intent; records metrics and returns the reply."""
+    try:
+        await send_progress(device_id, "intent_done", metrics_ctx)
         if intent.get("action") == "unknown":
-            await play_local_sound("not_understood.wav")
+            metrics_ctx.set_flag("not_understood", True)
+            await play_feedback(device_id, "not_understood.wav")
             # Record & Return
             metrics_logger.log(metrics_ctx.finalize())
             aggregator.record(metrics_ctx)
@@ -296,11 +533,11 @@ async def process_complete_audio(
         metrics_ctx.mark_stage("final_target", target)
         metrics_ctx.mark_stage("final_value", value)
 
-        is_valid, error = action_validator.validate(action, target, value)
-        if not is_valid:
+        commands, error = validate_commands(action, intent)
+        if not commands:
             metrics_ctx.set_flag("validator_pass", False)
             metrics_ctx.mark_stage("reject_reason", error)
-            await play_local_sound("error.wav")
+            await play_feedback(device_id, "error.wav")
             
             metrics_logger.log(metrics_ctx.finalize())
             aggregator.record(metrics_ctx)
@@ -312,8 +549,14 @@ async def process_complete_audio(
             
         metrics_ctx.set_flag("validator_pass", True)
 
-        await play_local_sound(get_action_sound(target, value))
-        await dispatch_command(target, value, metrics_ctx)
+        await play_feedback(device_id, get_action_sound(target, value))
+        if len(commands) > 1:
+            metrics_ctx.set_flag("multi_command", True)
+        if error:
+            metrics_ctx.mark_stage("reject_reason", error)
+        await dispatch_commands(commands, metrics_ctx)
+        await send_progress(device_id, "dispatched", metrics_ctx)
+        last_actions[device_id] = (time.monotonic(), target, value)
         
         # Record Success
         metrics_logger.log(metrics_ctx.finalize())
@@ -342,34 +585,515 @@ async def process_complete_audio(
         ).model_dump()
 
 
+async def handle_wake_detected(device_id: str, data: dict):
+    """Play the wake ack sound; no reply, the device does not wait for one."""
+    try:
+        msg = WakeDetected(**data)
+        logger.info(f"Wake detected: {device_id} (confidence: {msg.payload.confidence})")
+        audio_downlink.set_format(device_id, msg.payload.playback_format)
+        # 裝置已在本機喇叭播放喚醒提示音（不經網路）
+        if not msg.payload.chirp:
+            await play_local_sound("ack.wav")
+    except Exception as e:
+        logger.error(f"Wake detected error: {e}")
+
+
+async def prewarm_whisper() -> Optional[float]:
+    """延遲載入模式下，第一次 link_warmup 即在 ASR 執行緒載入並暖機 Whisper。"""
+    if whisper_loaded():
+        return None
+    t0 = time.perf_counter()
+    await warm_up_whisper()
+    return round(time.perf_counter() - t0, 3)
+
+
+async def seed_llm_session():
+    try:
+        await warm_up_llm()
+    except Exception as e:
+        logger.warning(f"LLM warm-up failed: {e}")
+
+
+def handle_link_warmup(device_id: str, data: dict):
+    """Device VAD heard sustained speech: warm the backends in case a wake word follows."""
+    try:
+        msg = LinkWarmup(**data)
+        started = prewarmer.request(device_id)
+        logger.debug(
+            f"Link warm-up from {device_id} after {msg.payload.speech_ms} ms of speech"
+            f"{', pre-warming backends' if started else ''}"
+        )
+    except Exception as e:
+        logger.error(f"Link warm-up error: {e}")
+
+
+async def handle_continuous_start(device_id: str, data: dict):
+    """Device opened its continuous (server-side wake word) UDP stream."""
+    try:
+        msg = ContinuousStart(**data)
+        if not continuous.opted_in(device_id) or udp_audio.transport is None:
+            # 設定已變更 / UDP 上行未開：要求裝置關閉，改回本地喚醒
+            logger.warning(f"Continuous stream from {device_id} refused (not opted in or UDP disabled)")
+            await manager.send_to_device(device_id, continuous.config_message(enable=False))
+            return
+        previous = continuous.start(device_id, msg.payload.session_id, msg.payload.sample_rate)
+        if previous is not None:
+            udp_audio.finish(previous)
+        udp_audio.register(msg.payload.session_id, device_id, sink=continuous.on_frames)
+    except Exception as e:
+        logger.error(f"Continuous start error: {e}")
+
+
+def handle_wake_hint(device_id: str, data: dict):
+    """Local wake word during continuous streaming: kept to confirm the matching utterance."""
+    try:
+        msg = WakeHint(**data)
+        continuous.hint(device_id, msg.payload.sample_offset, msg.payload.confidence)
+        logger.debug(f"Wake hint from {device_id} (conf={msg.payload.confidence:.3f})")
+    except Exception as e:
+        logger.error(f"Wake hint error: {e}")
+
+
+def on_continuous_utterance(utterance: Utterance):
+    """ContinuousListener 切出一句話：裝置沒有進行中的 session / 處理時，背景轉錄並比對喚醒片語。"""
+    device_id = utterance.device_id
+    busy = processing_tasks.get(device_id)
+    if device_id in manager.sessions or (busy is not None and not busy.done()):
+        continuous.skipped_busy += 1
+        return
+    task = asyncio.create_task(process_continuous_utterance(utterance))
+    processing_tasks[device_id] = task
+
+    def forget(done: asyncio.Task):
+        if processing_tasks.get(device_id) is done:
+            del processing_tasks[device_id]
+
+    task.add_done_callback(forget)
+
+
+async def process_continuous_utterance(utterance: Utterance):
+    """Server 端喚醒：轉錄開頭為喚醒片語（或剛只說了喚醒片語）時，其後的文字當作指令處理。
+
+    沒有喚醒片語的語句佔多數，以 background 轉錄（ASR 負載高時可被捨棄），不記入 metrics。
+    """
+    device_id = utterance.device_id
+    armed = continuous.take_armed(device_id)
+    t0 = time.time()
+    text = await transcribe_audio(utterance.pcm, "pcm_16k_16bit", device_id=device_id, background=not armed)
+    asr_s = round(time.time() - t0, 3)
+    command = text.strip() if armed else continuous.match_wake(text)
+    if command is None:
+        continuous.no_wake += 1
+        return
+    if continuous.confirm and not armed and utterance.hint is None:
+        continuous.unconfirmed += 1
+        logger.info(f"Continuous wake from {device_id} without local confirmation ignored: {text}")
+        return
+    continuous.wakes += 1
+    if not command:
+        # 只說了喚醒片語：提示音後等下一句
+        logger.info(f">>> Continuous wake from {device_id}, waiting for the command")
+        continuous.arm(device_id)
+        await play_feedback(device_id, "ack.wav")
+        return
+
+    metrics_ctx = MetricsContext(f"{device_id}_{int(time.time() * 1000)}", device_id)
+    metrics_ctx.set_flag("continuous", True)
+    metrics_ctx.mark_stage("recognition_stage", "continuous")
+    if utterance.hint is not None:
+        metrics_ctx.mark_stage("wake_confidence", utterance.hint)
+    metrics_ctx.record_latency("asr_latency", asr_s)
+    metrics_ctx.mark_event("asr_done")
+    metrics_ctx.mark_stage("asr_text", text)
+    metrics_ctx.mark_stage("asr_text_length", len(text))
+    logger.info(f">>> Continuous wake from {device_id}: {command}")
+    response = await act_on_text(device_id, command, metrics_ctx)
+    if response is not None and not await manager.send_to_device(device_id, response):
+        logger.warning(f"Reply to {device_id} not delivered")
+
+
+def handle_time_sync_request(device_id: str, data: dict, t1_us: int) -> Optional[dict]:
+    """Answer an NTP-style clock probe; t1_us is stamped when the frame was received."""
+    try:
+        msg = TimeSyncRequest(**data)
+        t2_us = time.time_ns() // 1000
+        return TimeSync(
+            device_id="server",
+            timestamp=t2_us // 1000,
+            payload=TimeSyncPayload(
+                seconds=t2_us // 1_000_000,
+                ms=(t2_us // 1000) % 1000,
+                seq=msg.payload.seq,
+                t0=msg.payload.t0,
+                t1=t1_us,
+                t2=t2_us,
+            ),
+        ).model_dump()
+    except Exception as e:
+        logger.error(f"Time sync request error: {e}")
+        return None
+
+
+async def handle_heartbeat(device_id: str, data: dict) -> Optional[dict]:
+    """Answer the device heartbeat and keep its reconnect histogram."""
+    try:
+        msg = Heartbeat(**data)
+        stats = msg.payload
+        if manager.record_heartbeat(device_id, stats):
+            labels = [f"<{b}" for b in RECONNECT_BUCKETS_MS] + [f">={RECONNECT_BUCKETS_MS[-1]}"]
+            hist = " ".join(f"{label}:{n}" for label, n in zip(labels, stats.reconnect_hist))
+            logger.info(
+                f"Link reconnects: {device_id} total={stats.reconnects} "
+                f"last={stats.reconnect_last_ms}ms max={stats.reconnect_max_ms}ms "
+                f"failures={stats.failures} timeouts={stats.link_timeouts} "
+                f"endpoint={stats.endpoint} failovers={stats.failovers} [{hist}]"
+                + (f" tls={stats.tls_handshake_ms}ms resumed={stats.tls_resumed}" if stats.tls_handshake_ms >= 0 else "")
+            )
+        return HeartbeatAck(
+            device_id="server",
+            timestamp=int(time.time() * 1000),
+            payload=HeartbeatAckPayload(seq=stats.seq),
+        ).model_dump()
+    except Exception as e:
+        logger.error(f"Heartbeat error: {e}")
+        return None
+
+
+def handle_telemetry(device_id: str, data: dict):
+    """Ingest the device's per-stage inference profile next to the server-side metrics."""
+    try:
+        msg = Telemetry(**data)
+        stages = aggregator.record_telemetry(device_id, msg.payload.stages)
+        record = {
+            "type": "edge_telemetry",
+            "device_id": device_id,
+            "timestamp": int(time.time()),
+            "seq": msg.payload.seq,
+            "interval_ms": msg.payload.interval_ms,
+            "stages": stages,
+        }
+        round_trip = aggregator.record_round_trip(device_id, msg.payload.server)
+        if round_trip:
+            record["server"] = round_trip
+        ui = None
+        if msg.payload.ui is not None:
+            ui = aggregator.record_ui_frames(device_id, msg.payload.ui, msg.payload.interval_ms)
+            if ui is not None:
+                record["ui"] = ui
+        if msg.payload.degrade is not None:
+            degrade = aggregator.record_degrade(device_id, msg.payload.degrade)
+            if degrade is not None:
+                record["degrade"] = degrade
+                if degrade["level"] > 0:
+                    # 裝置推論跟不上（降頻 / 過熱）：已關閉降噪或拉長推論間隔，喚醒延遲會變長
+                    logger.warning(
+                        f"Edge inference degraded on {device_id}: level {degrade['level']}, "
+                        f"stride {degrade['stride']}, load {degrade['load_pct']}%, "
+                        f"overruns {degrade['overruns']}"
+                    )
+        if msg.payload.weights is not None:
+            weights = aggregator.record_weights(device_id, msg.payload.weights)
+            if weights is not None:
+                record["weights"] = weights
+        metrics_logger.log(record)
+        summary = " ".join(
+            f"{name}={st['avg_us']}/{st['p99_us']}us" for name, st in stages.items()
+        )
+        if ui is not None:
+            # 畫面只在內容改變時重繪：fps 是實際畫出的幀數，late 是錯過 50ms 節拍的幀
+            summary += (f" ui={ui['fps']}fps late={ui['late']}(max {ui['late_max_ms']}ms) "
+                        f"render={ui['render_avg_us']}/{ui['render_max_us']}us "
+                        f"push={ui['push_avg_us']}/{ui['push_max_us']}us")
+        if round_trip:
+            # 裝置端看到的 Server 往返：串流送完 → 各進度事件 / 最終回覆到達（含網路）
+            summary += " server=" + " ".join(
+                f"{name}:{st['avg_ms']}/{st['max_ms']}ms" for name, st in round_trip.items()
+            )
+        logger.debug(f"Edge telemetry {device_id} (avg/p99): {summary}")
+    except Exception as e:
+        logger.error(f"Telemetry error: {e}")
+
+
+def handle_health(device_id: str, data: dict):
+    """Ingest the device's heap / stack / CPU sample; warn on tight stacks."""
+    try:
+        msg = Health(**data)
+        p = msg.payload
+        health = aggregator.record_health(device_id, p.uptime_s, p.heap, p.stacks, p.cpu, p.power,
+                                           p.contention, p.nvs)
+        metrics_logger.log({
+            "type": "edge_health",
+            "device_id": device_id,
+            "timestamp": int(time.time()),
+            "seq": p.seq,
+            **health,
+        })
+        tight = [f"{name}={left}B" for name, left in health["stacks"].items() if left < EDGE_STACK_WARN_BYTES]
+        if tight:
+            logger.warning(f"Edge health {device_id}: low stack headroom {' '.join(tight)}")
+        internal = health["heap"].get("internal")
+        if internal:
+            logger.debug(
+                f"Edge health {device_id}: internal free={internal['free']} largest={internal['largest']} "
+                f"min_drop={internal['min_free_drop']} cpu={health['cpu']}"
+            )
+        power = health.get("power")
+        if power:
+            logger.debug(f"Edge power {device_id}: full clock {power['full_clock_ratio']:.0%} "
+                         f"(max={power['max_ms']}ms awake={power['awake_ms']}ms idle={power['idle_ms']}ms)")
+        contention = health.get("contention")
+        if contention:
+            top = contention[0]
+            logger.debug(f"Edge contention {device_id}: {top['resource']} held by {top['holder']} blocked "
+                         f"{top['waiter']} {top['count']}x total={top['total_us']}us max={top['max_us']}us "
+                         f"inversions={top['inversions']}")
+        nvs = health.get("nvs")
+        if nvs:
+            logger.debug(f"Edge NVS {device_id}: {nvs['writes']} key(s) in {nvs['batches']} batch(es) "
+                         f"({nvs['forced']} forced, {nvs['coalesced']} coalesced), deferred max "
+                         f"{nvs['defer_max_ms']}ms, flash busy max {nvs['busy_max_us']}us")
+            if nvs["failed"]:
+                logger.warning(f"Edge NVS {device_id}: {nvs['failed']} key(s) failed to write, requeued for retry")
+    except Exception as e:
+        logger.error(f"Health error: {e}")
+
+
+def handle_latency_slo(device_id: str, data: dict):
+    """Log a wake latency SLO transition; degraded names the stage eating the budget."""
+    try:
+        msg = LatencySlo(**data)
+        p = msg.payload
+        metrics_logger.log({
+            "type": "edge_latency_slo",
+            "device_id": device_id,
+            "timestamp": int(time.time()),
+            **p.model_dump(),
+        })
+        stages = " ".join(f"{name}={ms}ms" for name, ms in p.stages_p90_ms.items())
+        if p.state == "degraded":
+            logger.warning(f"Edge {device_id} wake latency p90 {p.p90_ms}ms > SLO {p.slo_ms}ms "
+                           f"over {p.samples} wakes, worst stage {p.stage} (p90 {stages})")
+        else:
+            logger.info(f"Edge {device_id} wake latency back within SLO: p90 {p.p90_ms}ms (p90 {stages})")
+    except Exception as e:
+        logger.error(f"Latency SLO error: {e}")
+
+
+def handle_flight_record(device_id: str, data: dict):
+    """Log what preceded a device reset (its previous boot's flight recorder)."""
+    try:
+        msg = FlightRecord(**data)
+        p = msg.payload
+        summary = summarize_flight_record(p.reset_reason, p.stages_us, p.health, p.events)
+        metrics_logger.log({
+            "type": "edge_flight_record",
+            "device_id": device_id,
+            "timestamp": int(time.time()),
+            **summary,
+            "trace": p.events,
+            "health": p.health,
+        })
+        hints = "; ".join(summary["hints"]) or "no anomaly in the flight record"
+        logger.warning(f"Edge reset {device_id} ({p.reset_reason}, {summary['events']} events): {hints}")
+    except Exception as e:
+        logger.error(f"Flight record error: {e}")
+
+
 async def handle_audio_start(device_id: str, data: dict):
     """Signal clear buffer for new streaming session."""
     try:
         msg = AudioStreamStart(**data)
-        manager.clear_audio_buffer(
-            device_id, 
-            confidence=msg.payload.confidence,
+        audio_format = msg.payload.audio_format
+        codec = codec_from_format(audio_format)
+        if msg.payload.sample_rate and sample_rate_from_format(audio_format) != msg.payload.sample_rate:
+            audio_format = f"pcm_{msg.payload.sample_rate // 1000}k_16bit"
+        elif codec != "pcm":
+            # 緩衝內存放的是解碼後的 PCM
+            audio_format = f"pcm_{sample_rate_from_format(audio_format) // 1000}k_16bit"
+        udp = msg.payload.transfer_mode == "udp"
+        timing = None
+        if udp or msg.payload.trace_id is not None or (msg.payload.transfer_mode == "binary" and (
+            msg.payload.chunk_header_bytes > 0 or codec != "pcm"
+        )):
+            timing = StreamTiming(
+                header_bytes=msg.payload.chunk_header_bytes,
+                sample_rate=sample_rate_from_format(audio_format),
+                codec=codec,
+                epoch_ms=msg.timestamp,
+                timer_us=msg.payload.timer_us or 0,
+                session_id=msg.payload.session_id,
+                conceal=udp,   # UDP 不重傳：遺失的 frame 以前文延續
+                trace_id=msg.payload.trace_id,
+            )
+        if udp:
+            if udp_audio.transport is None or msg.payload.session_id is None:
+                logger.warning(f"UDP stream from {device_id} but UDP audio uplink is disabled / no session_id")
+            else:
+                udp_audio.register(msg.payload.session_id, device_id)
+        abort_processing(device_id, "superseded by a new audio_start")
+        worker = request_workers.get(device_id)
+        if worker is not None:
+            worker.cancel_current("superseded by a new audio_start")
+        followup = msg.payload.followup
+        if not followup:
+            wake_tuner.observe(device_id, msg.payload.wake_threshold, msg.payload.vad_threshold,
+                               msg.payload.tuning_version)
+        if msg.payload.model_generation is not None:
+            model_generations[device_id] = msg.payload.model_generation
+        lead = prewarmer.stream_started(device_id)
+        if lead is not None:
+            logger.info(f"Stream start: {device_id} link warm-up arrived {lead}s ahead")
+        # 端點偵測模式下 total_samples 只是上限（仍用於預配置緩衝），改由 audio_end 結束
+        # 追問沒有喚醒詞：不列入喚醒結果統計，也不參與多節點去重
+        stream = manager.start_session(
+            device_id,
+            confidence=None if followup else msg.payload.confidence,
             transfer_mode=msg.payload.transfer_mode,
-            total_samples=msg.payload.total_samples
+            total_samples=msg.payload.total_samples,
+            audio_format=audio_format,
+            timing=timing,
+            bounded=not msg.payload.endpointing,
+            followup=followup,
         )
-        logger.info(f"Stream start: {device_id} mode={msg.payload.transfer_mode}, total={msg.payload.total_samples}")
+        # 喚醒詞視窗在 pre-roll 內：收齊即驗證（追問沒有喚醒詞）
+        preroll = msg.payload.preroll_samples
+        if WAKE_VERIFY and not followup and preroll * 1000 >= WAKE_VERIFY_MIN_MS * sample_rate_from_format(audio_format):
+            stream.preroll_bytes = preroll * 2
+        if msg.payload.transfer_mode == "binary":
+            stream.arrival = StreamArrival(
+                sample_rate=sample_rate_from_format(audio_format), preroll_samples=preroll,
+                stall_s=STREAM_STALL_MS / 1000, probe=loop_lag,
+            )
+        logger.info(
+            f"Stream start: {device_id} mode={msg.payload.transfer_mode}, format={audio_format}, codec={codec}, "
+            f"total={msg.payload.total_samples}, preroll={msg.payload.preroll_samples}, "
+            f"frame={msg.payload.frame_samples or '?'}, "
+            f"endpointing={msg.payload.endpointing}, ns={msg.payload.noise_suppression}"
+            + (f", follow-up of {msg.payload.followup_of}" if followup else "")
+        )
+        previous = streaming_sessions.pop(device_id, None)
+        if previous is not None:
+            previous.cancel()
+        if STREAMING_ASR:
+            streaming_sessions[device_id] = StreamingTranscriber(
+                device_id, audio_format, on_commit=commit_streaming_intent,
+                speculate=parse_intent_with_llm if STREAMING_SPECULATE else None,
+            )
+        # 多個節點聽到同一次喚醒：只保留信心最高的串流
+        if not followup:
+            for loser in manager.wake_arbiter.register(device_id, msg.payload.confidence):
+                await cancel_duplicate_stream(loser, winner=manager.wake_arbiter.winner)
     except Exception as e:
         logger.error(f"Audio start error: {e}")
 
 
+def abort_processing(device_id: str, reason: str) -> bool:
+    """Cancel the device's in-flight stream processing; its reply is never sent."""
+    task = processing_tasks.pop(device_id, None)
+    if task is None or task.done():
+        return False
+    task.cancel()
+    logger.info(f"Aborted processing of {device_id}'s previous stream: {reason}")
+    return True
+
+
+async def cancel_stream(device_id: str, reason: str, detail: str, winner: Optional[str] = None):
+    """Stop the device's stream (or the processing of the one it just ended) and send it back to idle."""
+    transcriber = streaming_sessions.pop(device_id, None)
+    if transcriber is not None:
+        transcriber.cancel()
+    abort_processing(device_id, detail)
+    stream = manager.cancel_session(device_id)
+    session_id = stream.timing.session_id if stream is not None and stream.timing is not None else None
+    cancel = AudioCancel(
+        device_id=device_id,
+        timestamp=int(time.time() * 1000),
+        payload=AudioCancelPayload(reason=reason, winner=winner, session_id=session_id),
+    )
+    if not await manager.send_to_device(device_id, cancel.model_dump()):
+        logger.warning(f"audio_cancel to {device_id} not delivered")
+
+
+async def cancel_duplicate_stream(device_id: str, winner: Optional[str]):
+    """Another node's stream of the same wake was kept: stop this one early."""
+    logger.info(f"Duplicate wake: cancelling stream of {device_id}, kept {winner}")
+    await cancel_stream(device_id, "duplicate_wake", f"duplicate wake, kept {winner}", winner=winner)
+
+
+def check_wake_window(device_id: str):
+    """The wake-word window (pre-roll) has fully arrived: verify it in the background, before ASR."""
+    stream = manager.sessions.get(device_id)
+    if (stream is None or not stream.preroll_bytes or stream.wake_check is not None
+            or len(stream) < stream.preroll_bytes):
+        return
+    window = bytes(stream.audio()[:stream.preroll_bytes])   # 串流緩衝處理完即歸還 pool：先複製
+    stream.wake_check = asyncio.create_task(verify_wake(device_id, stream, window))
+
+
+async def verify_wake(device_id: str, stream: StreamSession, window: bytes):
+    """回傳喚醒視窗的特徵（結果確定後加入模板）；驗證不通過即取消串流，回傳 None。"""
+    try:
+        features = await asyncio.to_thread(WakeVerifier.features, window, stream.audio_format)
+        result = await asyncio.to_thread(wake_verifier.verify, device_id, features)
+    except Exception as e:
+        logger.error(f"Wake verification error: {e}")
+        return None
+    if result is None or result["accepted"]:
+        if result is not None:
+            logger.debug(f"Wake verified for {device_id}: {result}")
+        return features
+    current = manager.sessions.get(device_id)
+    if stream.cancelled or (current is not None and current is not stream):
+        return None   # 已被取消或已有新的串流
+    logger.info(f"Wake rejected for {device_id}: distance {result['distance']} "
+                f"(spread {result['spread']}, false-wake {result.get('negative')}), cancelling before ASR")
+    await cancel_stream(device_id, "wake_rejected", "wake verification failed")
+    return None
+
+
+def feed_streaming_asr(device_id: str):
+    """Give the partial transcriber a look at the buffer after new audio was appended."""
+    session = streaming_sessions.get(device_id)
+    stream = manager.sessions.get(device_id)
+    if session is not None and stream is not None:
+        session.feed(stream.audio())
+
+
+async def commit_streaming_intent(session: StreamingTranscriber, text: str, intent: dict):
+    """A stable partial matched a keyword intent: act now and reply without waiting for the stream end."""
+    device_id = session.device_id
+    metrics_ctx = MetricsContext(f"{device_id}_{int(time.time()*1000)}", device_id)
+    metrics_ctx.set_flag("streaming_commit", True)
+    metrics_ctx.mark_stage("asr_text", text)
+    metrics_ctx.mark_stage("asr_text_length", len(text))
+    metrics_ctx.mark_stage("asr_partials", session.partials)
+    metrics_ctx.record_latency("stream_commit_latency", session.commit_latency)
+    stream = manager.sessions.get(device_id)
+    if stream is not None and stream.confidence is not None:
+        metrics_ctx.mark_stage("wake_confidence", stream.confidence)
+    response = await act_on_text(device_id, text, metrics_ctx)
+    if not await manager.send_to_device(device_id, response):
+        logger.warning(f"Streaming commit reply to {device_id} not delivered")
+    await push_wake_tuning(device_id)
+
+
 async def handle_audio_chunk(device_id: str, data: dict) -> Optional[dict]:
     """Receive chunk and process if is_last."""
     try:
         msg = AudioStreamChunk(**data)
         # Verify transfer mode
-        if manager.transfer_modes.get(device_id) != "base64":
-            logger.warning(f"Received Base64 chunk for {device_id} but mode is {manager.transfer_modes.get(device_id)}")
+        stream = manager.sessions.get(device_id)
+        mode = stream.transfer_mode if stream is not None else None
+        if mode != "base64":
+            logger.warning(f"Received Base64 chunk for {device_id} but mode is {mode}")
             
         chunk_data = base64.b64decode(msg.payload.data_base64)
         manager.append_audio_data(device_id, chunk_data)
+        check_wake_window(device_id)
+        feed_streaming_asr(device_id)
 
         if msg.payload.is_last:
-            return await process_stream_end(device_id)
+            finish_stream(device_id)
 
         return None
     except Exception as e:
@@ -377,32 +1101,279 @@ async def handle_audio_chunk(device_id: str, data: dict) -> Optional[dict]:
         return None
 
 
-async def process_stream_end(device_id: str) -> Optional[dict]:
-    """Finalize and process audio buffer."""
+async def handle_audio_end(device_id: str, data: dict) -> Optional[dict]:
+    """Finish an endpointed stream as soon as the device reports end of speech."""
     try:
-        full_audio = manager.get_audio_data(device_id)
-        full_audio_b64 = base64.b64encode(full_audio).decode("utf-8")
-        # Get confidence before clearing
-        confidence = manager.session_confidence.get(device_id)
-        
-        # Process first
-        result = await process_complete_audio(
-            device_id, full_audio_b64, "pcm_16k_16bit", confidence
+        msg = AudioStreamEnd(**data)
+        stream = manager.sessions.get(device_id)
+        if stream is not None and stream.transfer_mode == "udp":
+            await drain_udp_stream(device_id, stream, wait=msg.payload.reason not in ("local_command", "server_cancel", "user_cancel"))
+            stream = manager.sessions.get(device_id)
+        received = len(stream) // 2 if stream is not None else 0
+        if stream is not None and stream.cancelled:
+            manager.discard_session(device_id)
+            logger.info(f"Stream end: {device_id} stream was cancelled ({msg.payload.reason}), ignored")
+            return None
+        if msg.payload.reason in ("local_command", "server_cancel", "user_cancel"):
+            # The device already published the command to MQTT (or stopped on audio_cancel / a cancel word); drop the audio
+            session = streaming_sessions.pop(device_id, None)
+            if session is not None:
+                session.cancel()
+            manager.discard_session(device_id)
+            logger.info(f"Stream end: {device_id} command handled on device, {received} samples discarded")
+            return None
+        if received == 0:
+            logger.warning(f"audio_end from {device_id} without stream data, ignored")
+            return None
+        if received != msg.payload.total_samples:
+            logger.warning(
+                f"audio_end sample mismatch for {device_id}: "
+                f"received {received}, device sent {msg.payload.total_samples}"
+            )
+        timing = stream.timing
+        if timing is not None and msg.payload.link is not None:
+            timing.link = msg.payload.link.model_dump()
+        if timing is not None and msg.payload.trace is not None:
+            timing.device_trace = msg.payload.trace.model_dump()
+        logger.info(f"Stream end: {device_id} samples={received}, reason={msg.payload.reason}")
+        if msg.payload.link is not None:
+            link = msg.payload.link
+            logger.info(
+                f"Stream link: {device_id} rssi={link.rssi} chunk={link.chunk_start}->{link.chunk_end} "
+                f"send_avg={link.send_avg_us}us max={link.send_max_us}us waits={link.tx_waits}"
+            )
+        finish_stream(device_id)
+        return None
+    except Exception as e:
+        logger.error(f"Audio end error: {e}")
+        return None
+
+
+async def handle_audio_resume(device_id: str, data: dict) -> Optional[dict]:
+    """Continue a stream interrupted by a reconnect; tell the device where to resend from."""
+    try:
+        msg = AudioStreamResume(**data)
+        timing = manager.resume_stream(device_id, msg.payload.session_id, msg.payload.seq)
+        received = timing.received_samples if timing is not None else 0
+        if timing is None:
+            logger.warning(f"Resume rejected: {device_id} session={msg.payload.session_id:#x}")
+        else:
+            logger.info(
+                f"Stream resume: {device_id} session={msg.payload.session_id:#x} "
+                f"from sample {received} (resume #{timing.resumes})"
+            )
+        return AudioResumeAck(
+            device_id=device_id,
+            timestamp=int(time.time() * 1000),
+            payload=AudioResumeAckPayload(
+                session_id=msg.payload.session_id,
+                accepted=timing is not None,
+                received_samples=received,
+            ),
+        ).model_dump()
+    except Exception as e:
+        logger.error(f"Audio resume error: {e}")
+        return None
+
+
+def ingest_frame(device_id: str, chunk_data: bytes, rx: Optional[float] = None, busy_s: float = 0.0):
+    """One binary audio frame (WebSocket or UDP): strip the header, buffer it, finish a bounded stream.
+
+    rx: monotonic time the WebSocket read loop received the frame (UDP frames leave the jitter
+    buffer in bursts and are not timed); busy_s: time the loop spent on the previous message.
+    """
+    stream = manager.sessions.get(device_id)
+    if stream is not None and stream.timing is not None:
+        chunk_data = stream.timing.consume(chunk_data)
+    if rx is not None and stream is not None and stream.arrival is not None:
+        capture_us = stream.timing.last_capture_us if stream.timing is not None else None
+        stream.arrival.record(rx, capture_us, busy_s)
+    manager.append_audio_data(device_id, chunk_data)
+    check_wake_window(device_id)
+    feed_streaming_asr(device_id)
+
+    # Check if we have received enough bytes
+    stream = manager.sessions[device_id]
+    expected = stream.expected_bytes
+    current = len(stream)
+
+    if expected > 0 and current >= expected:
+        logger.info(f"Binary stream complete for {device_id} ({current}/{expected} bytes)")
+        finish_stream(device_id)
+
+
+def ingest_udp_frames(device_id: str, frames: list[bytes]):
+    """Jitter buffer released in-order frames; drop them if the stream already ended."""
+    for frame in frames:
+        stream = manager.sessions.get(device_id)
+        if stream is None or stream.transfer_mode != "udp" or stream.cancelled:
+            return
+        ingest_frame(device_id, frame)
+
+
+async def drain_udp_stream(device_id: str, stream: StreamSession, wait: bool = True):
+    """audio_end rode the WebSocket: give late datagrams a moment, then flush the jitter buffer."""
+    session_id = stream.timing.session_id if stream.timing is not None else None
+    if wait and UDP_END_GRACE_S > 0:
+        await asyncio.sleep(UDP_END_GRACE_S)
+    ingest_udp_frames(device_id, udp_audio.finish(session_id))
+
+
+def finish_stream(device_id: str):
+    """Detach the ended stream and process it in the background.
+
+    The WebSocket loop keeps receiving meanwhile, so a new audio_start from the same device
+    (or a duplicate-wake cancel) can abort the processing before it replies.
+    """
+    stream = manager.end_session(device_id) or StreamSession()
+    transcriber = streaming_sessions.pop(device_id, None)
+    if stream.timing is not None:
+        stream.timing.last_rx_ms = time.time() * 1000
+    if stream.transfer_mode == "udp" and stream.timing is not None:
+        udp_audio.finish(stream.timing.session_id)   # 已達長度上限：之後的 datagram 丟棄
+    if stream.cancelled:
+        if transcriber is not None:
+            transcriber.cancel()
+        return
+    task = asyncio.create_task(reply_to_stream(device_id, stream, transcriber))
+    processing_tasks[device_id] = task
+
+    def forget(done: asyncio.Task):
+        if processing_tasks.get(device_id) is done:
+            del processing_tasks[device_id]
+
+    task.add_done_callback(forget)
+
+
+async def reply_to_stream(device_id: str, stream: StreamSession, transcriber: Optional[StreamingTranscriber]):
+    response = await process_stream_end(device_id, stream, transcriber)
+    if response is not None and not await manager.send_to_device(device_id, response):
+        logger.warning(f"Reply to {device_id} not delivered")
+    await flag_false_wake(device_id, stream, response)
+    await learn_wake_window(device_id, stream, response)
+    await push_wake_tuning(device_id)
+    await offer_model_update(device_id)
+
+
+def is_not_understood(response: dict) -> bool:
+    """回覆為聽不懂提示音：該次喚醒視為誤喚醒。"""
+    return response.get("type") == "play" and (response.get("payload") or {}).get("audio") == "not_understood.wav"
+
+
+async def flag_false_wake(device_id: str, stream: StreamSession, response: Optional[dict]):
+    """喚醒後聽不懂（空白 / 無法理解）即誤喚醒：告知裝置，有 CLIP_RECORDER 的裝置會保留該次錄音。"""
+    trace_id = stream.timing.trace_id if stream.timing is not None else None
+    if stream.followup or not trace_id or response is None:
+        return
+    if not is_not_understood(response):
+        return
+    message = FalseWake(
+        device_id=device_id, timestamp=int(time.time() * 1000),
+        payload=FalseWakePayload(trace_id=trace_id),
+    )
+    await manager.send_to_device(device_id, message.model_dump())
+
+
+async def learn_wake_window(device_id: str, stream: StreamSession, response: Optional[dict]):
+    """結果已知的喚醒視窗加入驗證模板：聽懂為正例、聽不懂為反例（被拒絕的視窗不加入）。"""
+    if stream.wake_check is None or response is None:
+        return
+    features = await stream.wake_check
+    if features is not None:
+        wake_verifier.enroll(device_id, features, genuine=not is_not_understood(response))
+
+
+async def push_wake_tuning(device_id: str):
+    """誤喚醒率偏離目標時下發新門檻（在回覆送出之後，不延遲本次回應）。"""
+    payload = wake_tuner.evaluate(device_id, aggregator.wake_history(device_id))
+    if payload is None:
+        return
+    # 新門檻下重新累計，避免舊結果連續觸發調整
+    aggregator.reset_wake_history(device_id)
+    message = WakeTuning(
+        device_id=device_id, timestamp=int(time.time() * 1000), payload=WakeTuningPayload(**payload)
+    )
+    if not await manager.send_to_device(device_id, message.model_dump()):
+        logger.warning(f"Wake tuning for {device_id} not delivered")
+
+
+async def offer_model_update(device_id: str):
+    """裝置的模型映像較舊時通知下載（回覆之後送出；裝置於 worker Task 下載，推論 Task 換綁）。"""
+    image = model_images.offer(device_id, model_generations.get(device_id))
+    if image is None:
+        return
+    message = ModelUpdate(
+        device_id=device_id, timestamp=int(time.time() * 1000),
+        payload=ModelUpdatePayload(generation=image.generation, size=image.size, crc32=image.crc32),
+    )
+    if await manager.send_to_device(device_id, message.model_dump()):
+        logger.info(f"Offered model generation {image.generation} to {device_id} "
+                    f"(running {model_generations.get(device_id)})")
+    else:
+        logger.warning(f"Model update for {device_id} not delivered")
+
+
+async def process_stream_end(device_id: str, stream: StreamSession,
+                             session: Optional[StreamingTranscriber] = None) -> Optional[dict]:
+    """Finalize and process a detached stream; its buffer goes back to the pool afterwards."""
+    try:
+        # 串流本身不複製、不經 base64，ASR 直接以 numpy 檢視其緩衝
+        full_audio = stream.audio()
+
+        # Streaming ASR: 已提前執行則不再處理；最後一個 partial 涵蓋整段則沿用其文字
+        text = None
+        if session is not None:
+            await session.finish()
+            if session.committed is not None:
+                logger.info(
+                    f"Stream end: {device_id} intent already committed from partial "
+                    f"({session.commit_latency}s after start), {len(full_audio) // 2} samples not re-transcribed"
+                )
+                return None
+            if session.covers(len(full_audio)):
+                text = session.partial_text
+
+        arrival = None
+        if stream.arrival is not None:
+            arrival = stream.arrival.summary(len(full_audio) // 2)
+            log = logger.warning if arrival["stalls"] else logger.debug
+            log(
+                f"Stream arrival: {device_id} {arrival['duration_ms']}ms for {arrival['audio_ms']}ms live audio, "
+                f"gap p50/p95/max={arrival['gap_p50_ms']}/{arrival['gap_p95_ms']}/{arrival['gap_max_ms']}ms "
+                f"jitter={arrival['jitter_ms']}ms stalls={arrival['stalls']} "
+                f"(server {arrival['stalls_server']}, device {arrival['stalls_device']}, "
+                f"network {arrival['stalls_network']})"
+            )
+
+        return await process_complete_audio(
+            device_id, full_audio, stream.audio_format, stream.confidence, stream.timing, text=text,
+            followup=stream.followup, session=session, arrival=arrival,
         )
-        
-        # Then clear
-        manager.clear_audio_buffer(device_id)
-        return result
+    except asyncio.CancelledError:
+        logger.info(f"Stream processing for {device_id} cancelled")
+        raise
     except Exception as e:
         logger.error(f"Stream process error: {e}")
-        manager.clear_audio_buffer(device_id)
         return None
+    finally:
+        if session is not None:
+            session.cancel()   # 未被沿用的推測解析（空白轉錄、處理中止）
+        stream.release()
 
 
 # --- FastAPI App ---
 @asynccontextmanager
 async def lifespan(app: FastAPI):
     logger.info(f"ESP-MIAO Server v{__version__} starting...")
+
+    # 上次的裝置表先載入（MQTT 連線後到達的 discovery 再逐一覆蓋）：重啟後第一個指令即可找到目標
+    if DEVICE_REGISTRY_PATH:
+        device_table.load_registry(DEVICE_REGISTRY_PATH)
+
+    # 叢集模式：LWT 與訂閱須在連線前設定
+    if cluster.enabled:
+        cluster.bind(manager.list_connected_devices, lambda: len(manager.streaming_devices()))
+        cluster.attach()
     
     # Initialize MQTT
     try:
@@ -411,28 +1382,70 @@ async def lifespan(app: FastAPI):
         mqtt_client.loop_start()
     except Exception as e:
         logger.error(f"MQTT Connection Error: {e}")
+    if cluster.enabled:
+        cluster.start(manager.send_to_device)
+        logger.info(f"Cluster node {cluster.node_id} ({cluster.url}, capacity {cluster.capacity})")
 
-    # Initialize Whisper (Only if requested on start)
+    # Initialize Whisper (Only if requested on start)：於 ASR 執行緒載入並暖機，記錄 cold / warm 延遲
     if LOAD_MODEL_ON_START:
         try:
-            get_whisper_model()
+            await warm_up_whisper()
         except Exception as e:
             logger.error(f"Failed to load Whisper model on start: {e}")
     else:
         logger.info("Whisper model will be loaded lazily on first request.")
 
+    # Ollama 模型常駐並預先評估 prompt 前綴（背景執行，Ollama 尚未啟動時只記錄警告）
+    if LOAD_MODEL_ON_START:
+        asyncio.create_task(seed_llm_session())
+
+    # 提示音預載到記憶體，經常駐輸出串流播放（/ack 與動作提示音不再 fork aplay）
+    if SOUND_PRELOAD and sound_player.preload():
+        sound_player.start()
+
+    # 裝置 VAD 偵測到語音（喚醒前）時的推測性預熱
+    prewarmer.add("whisper", prewarm_whisper)
+    prewarmer.add("llm", warm_up_llm)
+
+    # UDP 音訊上行（控制訊息仍走 WebSocket）
+    if UDP_AUDIO_PORT > 0:
+        udp_audio.on_frames = ingest_udp_frames
+        continuous.on_utterance = on_continuous_utterance
+        try:
+            await udp_audio.start(UDP_AUDIO_PORT)
+        except OSError as e:
+            logger.error(f"UDP audio uplink disabled, cannot bind :{UDP_AUDIO_PORT}: {e}")
+
+    # 只有其他裝置仍在串流時，批次轉錄才等待時間窗
+    whisper_batcher.peer_probe = lambda device_id: any(
+        d != device_id for d in manager.streaming_devices()
+    )
+
     logger.info(f"Devices registered: {[d.name for d in device_table.devices]}")
     logger.info(f"Allowed actions: {ALLOWED_ACTIONS}")
     # Ensure audio directory exists
     AUDIO_DIR.mkdir(parents=True, exist_ok=True)
+    if DEBUG_AUDIO_SAVE:
+        debug_audio.start()
     
     # Start Metrics Logger (disabled via ESP_MIAO_METRICS=0)
     if os.getenv("ESP_MIAO_METRICS", "1") == "1":
         init_metrics()
+    # event loop 延遲取樣與停頓 stack 抓取（阻塞呼叫的回歸在正式環境即可看到）
+    if LOOP_LAG_INTERVAL_MS > 0:
+        loop_lag.start()
     
     yield
     
     logger.info("ESP-MIAO Server shutting down...")
+    loop_lag.stop()
+    if cluster.enabled:
+        cluster.leave()
+    udp_audio.stop()
+    await sound_player.stop()
+    await asyncio.to_thread(debug_audio.stop)
+    if asr_pool.running:
+        await asr_pool.stop()
     # Stop Metrics Logger
     if os.getenv("ESP_MIAO_METRICS", "1") == "1":
         shutdown_metrics()
@@ -441,6 +1454,7 @@ async def lifespan(app: FastAPI):
     mqtt_client.loop_stop()
     mqtt_client.disconnect()
     logger.info("MQTT client stopped.")
+    scheduler.shutdown()
 
 
 app = FastAPI(
@@ -457,11 +1471,63 @@ async def root():
         "status": "ok",
         "service": "esp-miao",
         "version": __version__,
-        "devices": len(device_table.devices),
+        "devices": len(device_table.current.device_list),
+        "device_table": device_table.snapshot(),
         "connected": manager.list_connected_devices(),
+        "links": {
+            device_id: stats.model_dump() for device_id, stats in manager.link_health.items()
+        },
+        "edge_stages": aggregator.edge_snapshot(),
+        "edge_ui": aggregator.ui_snapshot(),
+        "edge_round_trip": aggregator.round_trip_snapshot(),
+        "edge_degrade": aggregator.degrade_snapshot(),
+        "edge_weights": aggregator.weights_snapshot(),
+        "edge_health": aggregator.health_snapshot(),
+        "stream_buffers": manager.buffer_pool.snapshot(),
+        "wake_dedup": manager.wake_arbiter.snapshot(),
+        "wake_tuning": {**wake_tuner.snapshot(), "outcomes": aggregator.wake_snapshot()},
+        "binary_control": sorted(manager.binary_control),
+        "udp_audio": udp_audio.snapshot(),
+        "continuous": continuous.snapshot(),
+        "prewarm": prewarmer.snapshot(),
+        "llm": llm_session.snapshot(),
+        "intent_index": intent_index.snapshot(),
+        "cluster": cluster.snapshot() if cluster.enabled else None,
+        "debug_audio": debug_audio.snapshot() if DEBUG_AUDIO_SAVE else None,
+        "keyword_pinyin": pinyin_stats,
+        "sound_player": sound_player.snapshot(),
+        "downlink": audio_downlink.snapshot(),
+        "event_loop": loop_lag.snapshot(),
+        "inference": {
+            **scheduler.snapshot(),
+            "asr_batches": whisper_batcher.batches,
+            "asr_batched_requests": whisper_batcher.batched_requests,
+            "asr_pool": asr_pool.snapshot(),
+        },
+        "asr_profile": whisper_profile,
+        "asr_bias": bias_stats,
+        "asr_cascade": cascade_stats,
+        "asr_segments": segment_filter.snapshot(),
+        "dispatch": mqtt_dispatcher.snapshot(),
+        "command_templates": command_classifier.snapshot(),
+        "wake_verify": wake_verifier.snapshot(),
+        "noise_profiles": noise_profiles.snapshot(),
+        "requests": {
+            "queued": {d: w.queue.qsize() for d, w in request_workers.items()},
+            "dropped": RequestWorker.dropped,
+            "cancelled": RequestWorker.cancelled,
+        },
     }
 
 
+@app.get("/metrics", response_class=PlainTextResponse)
+async def prometheus_metrics():
+    """Prometheus scrape endpoint: request counters and per-stage latency percentiles."""
+    return PlainTextResponse(
+        aggregator.prometheus_text() + loop_lag.prometheus_text(), media_type="text/plain; version=0.0.4"
+    )
+
+
 @app.get("/devices")
 async def list_devices():
     """List registered devices."""
@@ -500,15 +1566,42 @@ async def get_audio(filename: str):
 @app.get("/audio")
 async def list_audio():
     """List available audio files."""
+    if DEBUG_AUDIO_SAVE:
+        return {"files": debug_audio.files()}   # 取自索引，不掃描目錄
     if not AUDIO_DIR.exists():
         return {"files": []}
     files = [f.name for f in AUDIO_DIR.glob("*.wav")]
     return {"files": files}
 
+@app.post("/clips/{device_id}")
+async def upload_clip(device_id: str, request: Request):
+    """False-trigger clip uploaded by a device's clip recorder (near miss / false wake)."""
+    data = await request.body()
+    if len(data) > CLIP_MAX_BYTES:
+        raise HTTPException(status_code=413, detail="Clip too large")
+    try:
+        path = save_clip(device_id, data)
+    except ClipError as e:
+        # 格式錯誤重傳也不會成功：回 400 以外的狀態碼會讓裝置保留並重試
+        logger.warning(f"Rejected clip from {device_id}: {e}")
+        raise HTTPException(status_code=400, detail=str(e))
+    return {"status": "ok", "file": path.name}
+
+
+@app.get("/model")
+async def get_model_image():
+    """Current wake word model image (MODEL_IMAGE), downloaded by devices after a model_update."""
+    image = model_images.current()
+    if image is None:
+        raise HTTPException(status_code=404, detail="No model image")
+    return FileResponse(image.path, media_type="application/octet-stream")
+
+
 @app.get("/ack")
-async def ack():
-    """Ack reply after wake up. """
-    await play_local_sound("ack.wav")
+async def ack(chirp: bool = False):
+    """Ack reply after wake up (HTTP fallback for wake_detected when the WebSocket is down)."""
+    if not chirp:
+        await play_local_sound("ack.wav")
     return {"status": "ack"}
 
 
@@ -529,18 +1622,41 @@ async def websocket_endpoint(websocket: WebSocket, device_id: str):
             ms=int((now - int(now)) * 1000)
         )
     )
-    await websocket.send_text(json.dumps(sync_msg.model_dump()))
+    await manager.send_to_device(device_id, sync_msg.model_dump())
     logger.info(f"Sent TimeSync to {device_id}")
-
+    # 叢集模式：依目前各節點負載下發端點清單（本節點過載時把裝置導向其他節點）
+    if cluster.enabled:
+        await cluster.steer(device_id, manager.send_to_device)
+    # 連續串流（Server 端喚醒）：每次連線重送，裝置以新的 session_id 回覆 continuous_start
+    if continuous.opted_in(device_id) and udp_audio.transport is not None:
+        await manager.send_to_device(device_id, continuous.config_message())
+
+    # ASR / LLM 請求在另一個 Task 處理，讀取迴圈不被阻塞
+    previous = request_workers.pop(device_id, None)
+    if previous is not None:
+        previous.close()
+    worker = request_workers[device_id] = RequestWorker(device_id, manager.send_to_device)
+
+    prev_rx = None   # 讀取迴圈處理上一則訊息的耗時：binary 停頓歸因用
+    capture = open_capture(device_id, websocket.scope.get("subprotocols", []))
     try:
         while True:
             # Receive either text or bytes
+            waiting = time.monotonic()
             message = await websocket.receive()
+            recv_us = time.time_ns() // 1000  # t1 for time_sync_request
+            rx_mono = time.monotonic()
+            busy_s = waiting - prev_rx if prev_rx is not None else 0.0
+            prev_rx = rx_mono
             
             # Handle disconnection event
             if message["type"] == "websocket.disconnect":
                 logger.info(f"Disconnect event for {device_id}")
                 break
+            if capture is not None:
+                payload = message.get("text", message.get("bytes"))
+                if payload is not None:
+                    capture.record(payload, rx_mono)
 
             if "text" in message:
                 raw_msg = message["text"]
@@ -553,11 +1669,45 @@ async def websocket_endpoint(websocket: WebSocket, device_id: str):
 
                     response = None
                     if msg_type == "command_request":
-                        response = await handle_command_request(device_id, data)
+                        worker.submit(handle_command_request, data)
+                        continue
                     elif msg_type == "fallback_request":
-                        response = await handle_fallback_request(device_id, data)
+                        worker.submit(handle_fallback_request, data)
+                        continue
                     elif msg_type == "audio_request":
-                        response = await handle_audio_request(device_id, data)
+                        worker.submit(handle_audio_request, data)
+                        continue
+                    elif msg_type == "time_sync_request":
+                        response = handle_time_sync_request(device_id, data, recv_us)
+                        if response is None:
+                            continue
+                    elif msg_type == "heartbeat":
+                        response = await handle_heartbeat(device_id, data)
+                        if response is None:
+                            continue
+                    elif msg_type == "telemetry":
+                        handle_telemetry(device_id, data)
+                    elif msg_type == "health":
+                        handle_health(device_id, data)
+                        continue
+                    elif msg_type == "flight_record":
+                        handle_flight_record(device_id, data)
+                        continue
+                    elif msg_type == "latency_slo":
+                        handle_latency_slo(device_id, data)
+                        continue
+                    elif msg_type == "wake_detected":
+                        await handle_wake_detected(device_id, data)
+                        continue
+                    elif msg_type == "link_warmup":
+                        handle_link_warmup(device_id, data)
+                        continue
+                    elif msg_type == "continuous_start":
+                        await handle_continuous_start(device_id, data)
+                        continue
+                    elif msg_type == "wake_hint":
+                        handle_wake_hint(device_id, data)
+                        continue
                     elif msg_type == "audio_start":
                         await handle_audio_start(device_id, data)
                         continue
@@ -565,6 +1715,14 @@ async def websocket_endpoint(websocket: WebSocket, device_id: str):
                         response = await handle_audio_chunk(device_id, data)
                         if response is None:
                             continue
+                    elif msg_type == "audio_end":
+                        response = await handle_audio_end(device_id, data)
+                        if response is None:
+                            continue
+                    elif msg_type == "audio_resume":
+                        response = await handle_audio_resume(device_id, data)
+                        if response is None:
+                            continue
                     elif msg_type == "action_result":
                         logger.info(f"Action result from {device_id}: {data}")
                         manager.resolve_pending(device_id, data)
@@ -574,7 +1732,7 @@ async def websocket_endpoint(websocket: WebSocket, device_id: str):
                         continue
 
                     if response:
-                        await websocket.send_text(json.dumps(response))
+                        await manager.send_to_device(device_id, response)
 
                 except json.JSONDecodeError as e:
                     logger.error(f"JSON decode error: {e}")
@@ -583,20 +1741,12 @@ async def websocket_endpoint(websocket: WebSocket, device_id: str):
                 chunk_data = message["bytes"]
                 logger.debug(f"Received BINARY from {device_id}: {len(chunk_data)} bytes")
                 
-                if manager.transfer_modes.get(device_id) != "binary":
-                    logger.warning(f"Received binary for {device_id} but mode is {manager.transfer_modes.get(device_id)}")
-                
-                manager.append_audio_data(device_id, chunk_data)
-                
-                # Check if we have received enough bytes
-                expected = manager.expected_bytes.get(device_id, 0)
-                current = len(manager.audio_buffers.get(device_id, []))
-                
-                if expected > 0 and current >= expected:
-                    logger.info(f"Binary stream complete for {device_id} ({current}/{expected} bytes)")
-                    response = await process_stream_end(device_id)
-                    if response:
-                        await websocket.send_text(json.dumps(response))
+                stream = manager.sessions.get(device_id)
+                mode = stream.transfer_mode if stream is not None else None
+                if mode != "binary":
+                    logger.warning(f"Received binary for {device_id} but mode is {mode}")
+
+                ingest_frame(device_id, chunk_data, rx_mono, busy_s)
             
             else:
                 logger.debug(f"Ignored WebSocket message: {message.get('type')}")
@@ -606,4 +1756,15 @@ async def websocket_endpoint(websocket: WebSocket, device_id: str):
     except Exception as e:
         logger.error(f"WebSocket error in {device_id}: {e}")
     finally:
-        manager.disconnect(device_id)
+        worker.close()
+        if capture is not None:
+            capture.close()
+        if request_workers.get(device_id) is worker:
+            del request_workers[device_id]
+        # 裝置已以新連線重連時，舊連線只收掉自己的資源：連線、控制格式、串流、叢集與下行狀態都屬於新連線
+        if manager.disconnect(device_id, websocket):
+            cluster.forget(device_id)
+            audio_downlink.forget(device_id)
+            continuous_session = continuous.stop(device_id)
+            if continuous_session is not None:
+                udp_audio.finish(continuous_session)
@@ -0,0 +1,296 @@
+"""Multi-process ASR: worker processes with their own Whisper model, audio handed over in shared memory."""
+
+import asyncio
+import itertools
+import logging
+import multiprocessing as mp
+import queue
+import signal
+import threading
+import time
+from multiprocessing import shared_memory
+from typing import Callable, Optional
+
+import numpy as np
+
+from .config import ASR_PROCESSES, ASR_PROCESS_MAX_S, WHISPER_CPU_AFFINITY
+from .scheduler import parse_cpu_list, _pin_current_thread
+
+logger = logging.getLogger("esp-miao.asr_pool")
+
+SAMPLE_RATE = 16000  # 與 audio.WHISPER_SAMPLE_RATE 相同（此模組不匯入 audio，子行程才載入 faster-whisper）
+
+
+class AsrWorkerCrashed(RuntimeError):
+    """worker 行程在解碼途中結束（segfault / OOM）；該請求失敗，worker 已自動重啟。"""
+
+
+def _worker_main(index: int, shm_name: str, capacity: int, requests, results):
+    """子行程：載入並暖機模型後依序處理請求，音訊直接從 shared memory 讀取（不經 pickle）。"""
+    # Ctrl+C 會送到整個行程群組；由主行程 stop() 結束 worker
+    signal.signal(signal.SIGINT, signal.SIG_IGN)
+    _pin_current_thread(parse_cpu_list(WHISPER_CPU_AFFINITY))
+    from . import audio
+
+    shm = shared_memory.SharedMemory(name=shm_name)
+    buffer = np.ndarray((capacity,), dtype=np.float32, buffer=shm.buf)
+    try:
+        try:
+            profile = audio._load_and_warm_up()
+        except Exception as e:
+            results.put(("failed", index, None, repr(e)))
+            return
+        results.put(("ready", index, None, profile))
+        model = audio.get_whisper_model()
+        while True:
+            job = requests.get()
+            if job is None:
+                break
+            job_id, n, beam_size, prompt = job
+            before = dict(audio.bias_stats)
+            try:
+                # 主行程在結果回傳前不會改寫此 worker 的緩衝，不需複製
+                text, language = audio._decode(model, buffer[:n], beam_size, prompt)
+                bias = {k: audio.bias_stats[k] - before[k] for k in before}
+                results.put(("done", index, job_id, (text, language, bias)))
+            except Exception as e:
+                results.put(("error", index, job_id, repr(e)))
+    finally:
+        del buffer
+        shm.close()
+
+
+class _Worker:
+    def __init__(self, index: int, capacity: int):
+        self.index = index
+        self.shm = shared_memory.SharedMemory(create=True, size=capacity * 4)
+        self.buffer = np.ndarray((capacity,), dtype=np.float32, buffer=self.shm.buf)
+        self.proc: Optional[mp.process.BaseProcess] = None
+        self.requests = None
+        self.ready: Optional[asyncio.Future] = None
+        self.job: Optional[tuple[int, asyncio.Future]] = None
+        self.healthy = False
+        self.generation = 0   # 每次重啟 +1；閒置佇列中舊行程的項目據此略過
+
+
+class AsrProcessPool:
+    """N 個 worker 行程各自載入一份 Whisper 模型，ASR 推論不再與 event loop 共用 GIL。
+
+    每個 worker 配一塊 ASR_PROCESS_MAX_S 秒的 float32 shared memory：主行程把 session 音訊
+    寫入閒置 worker 的緩衝後只送出 (job_id, 樣本數, beam_size, prompt)，結果經共用 Queue 回傳，
+    由讀取執行緒轉交 event loop。worker 在解碼中崩潰時該請求拋出 AsrWorkerCrashed，
+    並重新啟動一個 worker；WebSocket 連線與其他 worker 不受影響。
+    排隊與公平性仍由 scheduler 的 ASR lane 負責（lane 並行數 = ASR_PROCESSES）。
+    """
+
+    def __init__(self, processes: int = ASR_PROCESSES, max_s: float = ASR_PROCESS_MAX_S,
+                 target: Callable = _worker_main, start_method: str = "spawn"):
+        self.size = max(0, processes)
+        self.capacity = int(max_s * SAMPLE_RATE)
+        self._target = target
+        # 預設 spawn：fork 會複製 event loop、MQTT 執行緒與已載入的 CTranslate2 狀態
+        self._ctx = mp.get_context(start_method)
+        self._workers: list[_Worker] = []
+        self._idle: Optional[asyncio.Queue] = None
+        self._results = None
+        self._reader: Optional[threading.Thread] = None
+        self._loop: Optional[asyncio.AbstractEventLoop] = None
+        self._starting: Optional[asyncio.Future] = None
+        self._jobs = itertools.count(1)
+        self._running = False
+        self.profile: dict = {}
+        self.decodes = 0
+        self.errors = 0
+        self.crashes = 0      # 解碼中或閒置時意外結束的 worker
+        self.truncated = 0    # 超過 ASR_PROCESS_MAX_S 而截斷的音訊
+        self.last_handoff_ms: Optional[float] = None   # 寫入 shared memory + 送出請求
+
+    @property
+    def enabled(self) -> bool:
+        return self.size > 0
+
+    @property
+    def running(self) -> bool:
+        return self._running
+
+    async def start(self) -> dict:
+        """啟動全部 worker 並等待模型載入完成（並行呼叫只啟動一次）；回傳 worker 0 的模型設定。"""
+        if self._running:
+            return self.profile
+        if self._starting is not None:
+            return await asyncio.shield(self._starting)
+        self._loop = asyncio.get_running_loop()
+        self._starting = self._loop.create_future()
+        try:
+            self._results = self._ctx.Queue()
+            self._idle = asyncio.Queue()
+            self._workers = [_Worker(i, self.capacity) for i in range(self.size)]
+            self._running = True
+            self._reader = threading.Thread(target=self._read_results, name="asr-pool", daemon=True)
+            self._reader.start()
+            t0 = time.perf_counter()
+            await asyncio.gather(*(self._spawn(w) for w in self._workers))
+            self.profile["pool_start_s"] = round(time.perf_counter() - t0, 3)
+            logger.info(f"ASR pool ready: {self.size} processes in {self.profile['pool_start_s']:.2f}s")
+            self._starting.set_result(self.profile)
+        except BaseException as e:
+            self._starting.set_exception(e)
+            self._starting.exception()   # 已由呼叫端處理，避免 "never retrieved" 警告
+            await self.stop()
+            raise
+        finally:
+            self._starting = None
+        return self.profile
+
+    async def _spawn(self, worker: _Worker):
+        worker.requests = self._ctx.Queue()
+        worker.ready = self._loop.create_future()
+        worker.proc = self._ctx.Process(
+            target=self._target, name=f"asr-{worker.index}", daemon=True,
+            args=(worker.index, worker.shm.name, self.capacity, worker.requests, self._results),
+        )
+        worker.proc.start()
+        profile = await worker.ready
+        if not self.profile:
+            self.profile.update(profile, processes=self.size)
+        worker.healthy = True
+        worker.generation += 1
+        self._idle.put_nowait((worker, worker.generation))
+
+    async def stop(self):
+        self._running = False
+        for worker in self._workers:
+            worker.healthy = False
+            if worker.proc is not None and worker.proc.is_alive():
+                worker.requests.put(None)
+        for worker in self._workers:
+            if worker.proc is not None:
+                await asyncio.to_thread(worker.proc.join, 2.0)
+                if worker.proc.is_alive():
+                    worker.proc.kill()
+            if worker.job is not None and not worker.job[1].done():
+                worker.job[1].set_exception(AsrWorkerCrashed("ASR pool stopped"))
+            del worker.buffer
+            worker.shm.close()
+            worker.shm.unlink()
+        self._workers = []
+        if self._reader is not None:
+            await asyncio.to_thread(self._reader.join, 1.0)
+            self._reader = None
+
+    async def decode(self, samples: np.ndarray, beam_size: int, prompt: Optional[str]) -> tuple[str, str, dict]:
+        """交給一個閒置 worker 解碼；回傳 (文字, 語言, 詞彙偏置計數增量)。"""
+        if len(samples) > self.capacity:
+            # 指令在開頭；超長錄音的尾段多半是未被截掉的雜音
+            self.truncated += 1
+            logger.warning(f"ASR input {len(samples) / SAMPLE_RATE:.1f}s exceeds ASR_PROCESS_MAX_S, truncated")
+            samples = samples[:self.capacity]
+        while True:
+            worker, generation = await self._idle.get()
+            if worker.healthy and generation == worker.generation:
+                break
+        t0 = time.perf_counter()
+        n = len(samples)
+        worker.buffer[:n] = samples
+        job_id = next(self._jobs)
+        future = self._loop.create_future()
+        worker.job = (job_id, future)
+        worker.requests.put((job_id, n, beam_size, prompt))
+        self.last_handoff_ms = round((time.perf_counter() - t0) * 1000, 3)
+        # 呼叫端被取消時 worker 仍在解碼；結果抵達後才回到閒置佇列
+        return await asyncio.shield(future)
+
+    def _read_results(self):
+        """讀取執行緒：把結果轉交 event loop，並定期檢查 worker 是否存活。"""
+        while self._running:
+            try:
+                message = self._results.get(timeout=0.5)
+            except queue.Empty:
+                message = None
+            except (EOFError, OSError):
+                break
+            try:
+                if message is not None:
+                    self._loop.call_soon_threadsafe(self._on_message, *message)
+                self._loop.call_soon_threadsafe(self._check_alive)
+            except RuntimeError:   # event loop 已關閉
+                break
+
+    def _on_message(self, kind: str, index: int, job_id: Optional[int], payload):
+        if index >= len(self._workers):
+            return
+        worker = self._workers[index]
+        if kind == "ready":
+            if worker.ready is not None and not worker.ready.done():
+                worker.ready.set_result(payload)
+            return
+        if kind == "failed":
+            if worker.ready is not None and not worker.ready.done():
+                worker.ready.set_exception(RuntimeError(f"ASR worker {index} failed to load model: {payload}"))
+            return
+        if worker.job is None or worker.job[0] != job_id:
+            return
+        future = worker.job[1]
+        worker.job = None
+        if kind == "done":
+            self.decodes += 1
+            if not future.done():
+                future.set_result(payload)
+        else:
+            self.errors += 1
+            if not future.done():
+                future.set_exception(RuntimeError(payload))
+        if worker.healthy and self._running:
+            self._idle.put_nowait((worker, worker.generation))
+
+    def _check_alive(self):
+        if not self._running:
+            return
+        for worker in self._workers:
+            if worker.proc is None or worker.proc.is_alive():
+                continue
+            if worker.ready is not None and not worker.ready.done():
+                # 模型載入階段即結束：不重試，交由 start() 回報
+                worker.ready.set_exception(
+                    RuntimeError(f"ASR worker {worker.index} exited with {worker.proc.exitcode}")
+                )
+                worker.proc = None
+                continue
+            if not worker.healthy:
+                continue
+            self.crashes += 1
+            worker.healthy = False
+            logger.error(f"ASR worker {worker.index} exited with {worker.proc.exitcode}, restarting")
+            if worker.job is not None:
+                future = worker.job[1]
+                worker.job = None
+                if not future.done():
+                    future.set_exception(AsrWorkerCrashed(f"ASR worker {worker.index} crashed"))
+            task = asyncio.ensure_future(self._spawn(worker))
+            task.add_done_callback(self._respawned)
+
+    @staticmethod
+    def _respawned(task: asyncio.Task):
+        if not task.cancelled() and task.exception() is not None:
+            logger.error(f"ASR worker restart failed: {task.exception()}")
+
+    def pids(self) -> list[int]:
+        """目前存活的 worker 行程（重播基準統計 ASR 的 CPU 時間用）。"""
+        return [w.proc.pid for w in self._workers if w.proc is not None and w.proc.pid is not None]
+
+    def snapshot(self) -> dict:
+        return {
+            "processes": self.size,
+            "running": self._running,
+            "alive": sum(1 for w in self._workers if w.healthy),
+            "busy": sum(1 for w in self._workers if w.job is not None),
+            "decodes": self.decodes,
+            "errors": self.errors,
+            "crashes": self.crashes,
+            "truncated": self.truncated,
+            "slot_s": self.capacity / SAMPLE_RATE,
+            "last_handoff_ms": self.last_handoff_ms,
+        }
+
+
+asr_pool = AsrProcessPool()
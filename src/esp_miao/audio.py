@@ -1,97 +1,529 @@
-import base64
-import io
+import asyncio
+import os
+import threading
 import time
 import logging
-import asyncio
-from struct import pack
-from typing import Optional
+from typing import Callable, Optional, Union
+
+import numpy as np
 from faster_whisper import WhisperModel
-from .config import inference_executor
+from faster_whisper.audio import pad_or_trim
+from faster_whisper.tokenizer import Tokenizer
+from .config import (
+    ACTION_KEYWORDS, ASR_BATCH_WINDOW_S, ASR_BATCH_MAX, ASR_WORKERS, ASR_PROCESSES,
+    ASR_VOCAB_BIAS, ASR_BIAS_MIN_LOGPROB, ASR_BIAS_MAX_TERMS,
+    ASR_CASCADE_MODEL, ASR_CASCADE_MAX_S, ASR_CASCADE_MIN_LOGPROB,
+    WHISPER_MODEL, WHISPER_DEVICE, WHISPER_COMPUTE_TYPE, WHISPER_CPU_THREADS,
+    WHISPER_CPU_AFFINITY, WHISPER_WARMUP,
+    SERVER_TRIM, VAD_SNR_DB, VAD_THRESHOLD_MIN, TRIM_PAD_MS, TRIM_MIN_MS,
+)
+from .asr_pool import asr_pool
+from .connection import device_table
+from .hallucination import segment_filter
+from .intent import extract_intent_from_text
+from .metrics import MetricsContext
+from .scheduler import scheduler, LaneBusy, DeadlineExceeded, parse_cpu_list
 
 logger = logging.getLogger("esp-miao.audio")
 
+DEFAULT_SAMPLE_RATE = 16000
+WHISPER_SAMPLE_RATE = 16000  # faster-whisper 的 ndarray 輸入取樣率
+WHISPER_WINDOW_SAMPLES = 30 * WHISPER_SAMPLE_RATE  # 單一 mel 視窗（30 秒），批次解碼上限
+WHISPER_MAX_TOKENS = 448                           # Whisper decoder 序列長度上限
+
+# 與韌體 VAD 相同的分析幀（FFT_SIZE、FFT_FREQ_MIN / MAX）
+VAD_FRAME = 512
+VAD_START_BIN = 300 * VAD_FRAME // WHISPER_SAMPLE_RATE
+VAD_END_BIN = min(3400 * VAD_FRAME // WHISPER_SAMPLE_RATE, VAD_FRAME // 2)
+_VAD_WINDOW = (np.hamming(VAD_FRAME) * 32768.0).astype(np.float32)  # 換回 int16 尺度
+
+
+def sample_rate_from_format(audio_format: Optional[str], default: int = DEFAULT_SAMPLE_RATE) -> int:
+    """由 audio_format（例如 "pcm_8k_16bit"、"pcm_48k_16bit"）解析取樣率。"""
+    if audio_format:
+        for part in audio_format.split("_"):
+            if part.endswith("k") and part[:-1].isdigit():
+                return int(part[:-1]) * 1000
+    return default
+
+
 # --- ASR Pipeline (Faster-Whisper) ---
 whisper_model: Optional[WhisperModel] = None
+cascade_model: Optional[WhisperModel] = None
+_whisper_lock = threading.Lock()
+# 實際採用的模型設定與載入 / 暖機耗時（GET / 的 "asr_profile"）
+whisper_profile: dict = {}
+
+
+def available_cpus() -> int:
+    """本行程可用的核心數（考慮親和性 / cgroup 綁核）。"""
+    if WHISPER_CPU_AFFINITY:
+        return len(parse_cpu_list(WHISPER_CPU_AFFINITY))
+    if hasattr(os, "sched_getaffinity"):
+        return len(os.sched_getaffinity(0))
+    return os.cpu_count() or 1
+
+
+def select_whisper_profile() -> dict:
+    """由設定與偵測到的核心數決定 WhisperModel 參數。
+
+    CPU：compute_type 預設 int8；cpu_threads 未指定時平分給 ASR_WORKERS 個並行推論
+    （多行程模式為 ASR_PROCESSES 個 worker，各自只有一個推論執行緒），
+    核心數 > 2 時保留一核給 event loop / MQTT。CUDA：compute_type 預設 float16。
+    """
+    device = WHISPER_DEVICE
+    if device == "auto":
+        try:
+            import ctranslate2
+            device = "cuda" if ctranslate2.get_cuda_device_count() > 0 else "cpu"
+        except Exception:
+            device = "cpu"
+    compute_type = WHISPER_COMPUTE_TYPE or ("float16" if device == "cuda" else "int8")
+    num_workers = 1 if ASR_PROCESSES > 0 else max(1, ASR_WORKERS)
+    cpu_threads = WHISPER_CPU_THREADS
+    if cpu_threads <= 0:
+        cores = available_cpus()
+        usable = cores - 1 if cores > 2 and not WHISPER_CPU_AFFINITY else cores
+        cpu_threads = max(1, usable // max(1, ASR_PROCESSES or ASR_WORKERS))
+    return {
+        "model": WHISPER_MODEL,
+        "device": device,
+        "compute_type": compute_type,
+        "cpu_threads": cpu_threads,
+        "num_workers": num_workers,
+    }
+
+
+def _load_model(profile: dict) -> tuple[WhisperModel, float]:
+    logger.info(f"Initializing Whisper model {profile}...")
+    start_time = time.perf_counter()
+    model = WhisperModel(
+        profile["model"],
+        device=profile["device"],
+        compute_type=profile["compute_type"],
+        cpu_threads=profile["cpu_threads"],
+        num_workers=profile["num_workers"],
+    )
+    elapsed = time.perf_counter() - start_time
+    logger.info(f"Whisper model {profile['model']} loaded in {elapsed:.2f} seconds.")
+    return model, elapsed
+
 
 def get_whisper_model() -> WhisperModel:
-    """單例模式獲取 Whisper 模型，支援延遲加載。"""
+    """單例模式獲取 Whisper 模型，支援延遲加載（多個 ASR 執行緒同時呼叫時只載入一次）。"""
     global whisper_model
     if whisper_model is None:
-        logger.info("Initializing Whisper model (base, cpu)...")
-        start_time = time.perf_counter()
-        whisper_model = WhisperModel("base", device="cpu", compute_type="int8")
-        elapsed = time.perf_counter() - start_time
-        logger.info(f"Whisper model loaded in {elapsed:.2f} seconds.")
+        with _whisper_lock:
+            if whisper_model is None:
+                profile = select_whisper_profile()
+                whisper_model, elapsed = _load_model(profile)
+                whisper_profile.update(profile, load_s=round(elapsed, 3))
     return whisper_model
 
 
+def cascade_enabled() -> bool:
+    """級聯的小模型只在本行程推論（多行程模式的 worker 各自只載入 WHISPER_MODEL）。"""
+    return bool(ASR_CASCADE_MODEL) and not asr_pool.enabled
+
+
+def get_cascade_model() -> WhisperModel:
+    """級聯第一層的小模型（與 WHISPER_MODEL 相同的裝置 / 執行緒設定，常駐）。"""
+    global cascade_model
+    if cascade_model is None:
+        with _whisper_lock:
+            if cascade_model is None:
+                profile = dict(select_whisper_profile(), model=ASR_CASCADE_MODEL)
+                cascade_model, elapsed = _load_model(profile)
+                whisper_profile.update(cascade_model=ASR_CASCADE_MODEL, cascade_load_s=round(elapsed, 3))
+    return cascade_model
+
+
+def whisper_loaded() -> bool:
+    return whisper_model is not None or asr_pool.running
+
+
+def _load_and_warm_up() -> dict:
+    """阻塞：載入模型；WHISPER_WARMUP 時以 1 秒靜音解碼兩次（第一次含 kernel / cache 冷啟動）。"""
+    model = get_whisper_model()
+    if WHISPER_WARMUP:
+        silence = np.zeros(WHISPER_SAMPLE_RATE, dtype=np.float32)
+        timings = []
+        for _ in range(2):
+            t0 = time.perf_counter()
+            _transcribe_one(model, silence, beam_size=1)
+            timings.append(round(time.perf_counter() - t0, 3))
+        whisper_profile.update(cold_decode_s=timings[0], warm_decode_s=timings[1])
+        logger.info(f"Whisper warm-up: cold decode {timings[0]:.2f}s, warm decode {timings[1]:.2f}s")
+    if cascade_enabled():
+        small = get_cascade_model()
+        if WHISPER_WARMUP:
+            _transcribe_one(small, np.zeros(WHISPER_SAMPLE_RATE, dtype=np.float32), beam_size=1)
+    return dict(whisper_profile)
+
+
+async def warm_up_whisper() -> dict:
+    """啟動時於 ASR 執行緒載入並暖機（親和性與 CTranslate2 執行緒皆由該執行緒建立）。
+    多行程模式改為啟動 worker 行程，各自載入並暖機。"""
+    if asr_pool.enabled:
+        whisper_profile.update(await asr_pool.start())
+        return dict(whisper_profile)
+    return await scheduler.run_asr("warmup", _load_and_warm_up)
+
+
+def pcm_to_float32(audio: Union[bytes, bytearray, memoryview]) -> np.ndarray:
+    """16-bit little-endian PCM → float32 [-1, 1)。np.frombuffer 直接檢視緩衝，只在轉型時複製一次。"""
+    usable = len(audio) & ~1  # 奇數位元組（不完整樣本）捨棄
+    samples = np.frombuffer(audio, dtype="<i2", count=usable // 2).astype(np.float32)
+    samples *= 1.0 / 32768.0
+    return samples
+
+
+def resample_linear(samples: np.ndarray, from_rate: int, to_rate: int = WHISPER_SAMPLE_RATE) -> np.ndarray:
+    """線性內插改變取樣率（faster-whisper 的 ndarray 輸入固定 16 kHz；韌體預設即為 16 kHz）。"""
+    if from_rate == to_rate or len(samples) == 0:
+        return samples
+    n_out = int(round(len(samples) * to_rate / from_rate))
+    positions = np.arange(n_out, dtype=np.float64) * (from_rate / to_rate)
+    return np.interp(positions, np.arange(len(samples)), samples).astype(np.float32)
+
+
+try:
+    import soxr  # 選用：有安裝時以 soxr 做高品質重取樣
+except ImportError:
+    soxr = None
+
+RESAMPLE_MAX_PHASES = 64   # up × down 超過此值（如 44.1k ↔ 16k）時改用線性內插
+RESAMPLE_TAPS_PER_PHASE = 16
+
+
+def resample(samples: np.ndarray, from_rate: int, to_rate: int = WHISPER_SAMPLE_RATE) -> np.ndarray:
+    """
+    帶限重取樣（遠端節點的 8 kHz 串流升到 16 kHz 時，線性內插的鏡像頻率會落在 4–8 kHz 語音頻段）。
+    有安裝 soxr 時使用 soxr；否則整數比例以 numpy 向量化的 Hamming 窗 sinc 多相濾波，
+    其餘比例退回 resample_linear。
+    """
+    if from_rate == to_rate or len(samples) == 0:
+        return samples
+    if soxr is not None:
+        return soxr.resample(samples, from_rate, to_rate, quality="HQ").astype(np.float32, copy=False)
+    g = np.gcd(from_rate, to_rate)
+    up, down = to_rate // g, from_rate // g
+    if up * down > RESAMPLE_MAX_PHASES:
+        return resample_linear(samples, from_rate, to_rate)
+    taps = RESAMPLE_TAPS_PER_PHASE * max(up, down) + 1
+    cutoff = 0.5 / max(up, down)
+    n = np.arange(taps) - (taps - 1) / 2
+    kernel = (2 * cutoff * up) * np.sinc(2 * cutoff * n) * np.hamming(taps)
+    stuffed = np.zeros(len(samples) * up, dtype=np.float32)
+    stuffed[::up] = samples
+    out = np.convolve(stuffed, kernel.astype(np.float32), mode="same")[::down]
+    return out[: int(round(len(samples) * to_rate / from_rate))]
+
+
+def trim_silence(samples: np.ndarray) -> tuple[np.ndarray, float, float]:
+    """去除 16 kHz 音訊前後的靜音，回傳 (音訊, 前段秒數, 後段秒數)。
+
+    噪音底取各幀頻帶 RMS 的第 10 百分位（整段錄音皆可見，不需韌體的逐切片收斂）。
+    找不到語音幀時原樣回傳，交由 Whisper 的 no_speech 判斷。結果是原陣列的切片，不複製。
+    """
+    n = len(samples) // VAD_FRAME
+    if not SERVER_TRIM or n < 2:
+        return samples, 0.0, 0.0
+    frames = samples[:n * VAD_FRAME].reshape(n, VAD_FRAME) * _VAD_WINDOW
+    power = np.abs(np.fft.rfft(frames, axis=1)[:, VAD_START_BIN:VAD_END_BIN]) ** 2
+    band_rms = np.sqrt(power.mean(axis=1))
+
+    noise_floor = float(np.percentile(band_rms, 10))
+    threshold = max(noise_floor * 10.0 ** (VAD_SNR_DB / 20.0), VAD_THRESHOLD_MIN)
+    voiced = np.nonzero(band_rms > threshold)[0]
+    if len(voiced) == 0:
+        return samples, 0.0, 0.0
+
+    pad = TRIM_PAD_MS * WHISPER_SAMPLE_RATE // 1000
+    start = max(int(voiced[0]) * VAD_FRAME - pad, 0)
+    end = min((int(voiced[-1]) + 1) * VAD_FRAME + pad, len(samples))
+    # 不短於 TRIM_MIN_MS：先向後、再向前補足
+    min_len = TRIM_MIN_MS * WHISPER_SAMPLE_RATE // 1000
+    if end - start < min_len:
+        end = min(start + min_len, len(samples))
+        start = max(end - min_len, 0)
+    return samples[start:end], start / WHISPER_SAMPLE_RATE, (len(samples) - end) / WHISPER_SAMPLE_RATE
+
+
+def _transcribe_one(
+    model: WhisperModel, samples: np.ndarray, beam_size: int, prompt: Optional[str] = None
+) -> tuple[str, str, float]:
+    """阻塞：單段音訊走 model.transcribe（長度不限），回傳 (文字, 語言, 最低片段 avg_logprob)。"""
+    segments, info = model.transcribe(
+        samples, 
+        beam_size=beam_size, # 優化：縮小 beam_size 換取速度
+        language="zh",
+        no_speech_threshold=0.6,
+        log_prob_threshold=-1.0,
+        initial_prompt=prompt,
+    )
+    text_segments, logprobs = [], []
+    for clean_text, logprob in segment_filter.run(segments):   # 取一段才解碼一段，幻聽時提早停止
+        text_segments.append(clean_text)
+        logprobs.append(logprob)
+    return "".join(text_segments).strip(), info.language, min(logprobs, default=float("-inf"))
+
+
+# 詞彙偏置模式的 greedy 結果採用 / 改以 beam 重解碼次數（GET / 的 "asr_bias"）
+bias_stats = {"greedy_accepted": 0, "beam_fallback": 0}
+
+
+def _decode(
+    model: WhisperModel, samples: np.ndarray, beam_size: int, prompt: Optional[str]
+) -> tuple[str, str]:
+    """阻塞：有詞彙提示時先 greedy 解碼，信心足夠即採用，否則以 beam_size 重解碼。"""
+    if prompt is None or beam_size <= 1:
+        text, language, _ = _transcribe_one(model, samples, beam_size, prompt)
+        return text, language
+    text, language, confidence = _transcribe_one(model, samples, 1, prompt)
+    if text and confidence >= ASR_BIAS_MIN_LOGPROB:
+        bias_stats["greedy_accepted"] += 1
+        return text, language
+    bias_stats["beam_fallback"] += 1
+    text, language, _ = _transcribe_one(model, samples, beam_size, prompt)
+    return text, language
+
+
+async def _run_decode(device_id: str, samples: np.ndarray, beam_size: int, prompt: Optional[str],
+                      background: bool = False) -> tuple[str, str]:
+    """經 ASR lane 執行一次 _decode：多行程模式交給 worker 行程（首次使用時啟動），否則在 ASR 執行緒。"""
+    if not asr_pool.enabled:
+        return await scheduler.run_asr(
+            device_id, lambda: _decode(get_whisper_model(), samples, beam_size, prompt), background=background
+        )
+    if not asr_pool.running:
+        await warm_up_whisper()
+    text, language, bias = await scheduler.run_asr_async(
+        device_id, lambda: asr_pool.decode(samples, beam_size, prompt), background=background
+    )
+    for key, delta in bias.items():
+        bias_stats[key] += delta
+    return text, language
+
+
+# 級聯小模型的嘗試 / 採用 / 升級到 WHISPER_MODEL 次數（GET / 的 "asr_cascade"）
+cascade_stats = {"tried": 0, "accepted": 0, "escalated": 0}
+
+
+async def _cascade_decode(device_id: str, samples: np.ndarray, prompt: Optional[str],
+                          metrics_ctx: Optional[MetricsContext]) -> Optional[str]:
+    """小模型 greedy 解碼；片段信心足夠且關鍵字比對找得到目標與動作才採用，否則回傳 None。
+
+    只看 logprob 不夠：小模型常把裝置名稱聽成同音字而信心仍高，關鍵字比對不完整時交給大模型，
+    避免短指令變成 not_understood 或落到 LLM。
+    """
+    t0 = time.perf_counter()
+    text, language, confidence = await scheduler.run_asr(
+        device_id, lambda: _transcribe_one(get_cascade_model(), samples, 1, prompt)
+    )
+    elapsed = time.perf_counter() - t0
+    intent = extract_intent_from_text(text) if text else None
+    accepted = bool(
+        intent and confidence >= ASR_CASCADE_MIN_LOGPROB
+        and intent["target"] and intent["action"] != "unknown"
+    )
+    cascade_stats["tried"] += 1
+    cascade_stats["accepted" if accepted else "escalated"] += 1
+    if metrics_ctx is not None:
+        metrics_ctx.record_latency("asr_small_latency", round(elapsed, 3))
+        metrics_ctx.mark_stage("asr_tier", "small" if accepted else "large")
+    logger.info(
+        f"ASR ({ASR_CASCADE_MODEL}) [{language}] in {elapsed:.2f}s: {text!r} "
+        f"(logprob {confidence:.2f}, {'accepted' if accepted else 'escalating'})"
+    )
+    return text if accepted else None
+
+
+_vocab_prompt: tuple[int, Optional[str]] = (-1, None)
+
+
+def vocabulary_prompt() -> Optional[str]:
+    """以裝置別名與動作關鍵字組成 initial_prompt，讓解碼偏向指令詞彙（裝置表變更時重建）。"""
+    global _vocab_prompt
+    if not ASR_VOCAB_BIAS:
+        return None
+    version = device_table.vocab_version
+    if _vocab_prompt[0] != version:
+        terms: list[str] = []
+        for alias in device_table.alias_map:
+            terms.append(alias)
+        keyword_maps = [ACTION_KEYWORDS] + [device_table.get_action_keywords(d.name) for d in device_table.devices]
+        for keywords in keyword_maps:
+            for words in keywords.values():
+                terms.extend(words)
+        # 去重保序；只取中文詞（英文關鍵字對中文解碼沒有幫助），數量受 prompt 長度限制
+        unique = [t for t in dict.fromkeys(terms) if t and not t.isascii()][:ASR_BIAS_MAX_TERMS]
+        _vocab_prompt = (version, "、".join(unique) + "。" if unique else None)
+        logger.debug(f"ASR vocabulary prompt: {_vocab_prompt[1]}")
+    return _vocab_prompt[1]
+
+
+def _transcribe_batch(
+    model: WhisperModel, batch: list[np.ndarray], beam_size: int, prompt: Optional[str] = None
+) -> list[str]:
+    """阻塞：多段 ≤30 秒的音訊以一次 CTranslate2 encode / generate 批次解碼。
+
+    每段各自補齊成一個 30 秒 mel 視窗（與 model.transcribe 的單視窗相同），不加時間戳。
+    prompt 與 model.transcribe 的 initial_prompt 相同方式編為前文 token。
+    """
+    features = np.stack([pad_or_trim(model.feature_extractor(samples)) for samples in batch])
+    encoder_output = model.encode(features)
+    tokenizer = Tokenizer(model.hf_tokenizer, model.model.is_multilingual, task="transcribe", language="zh")
+    previous = tokenizer.encode(" " + prompt.strip()) if prompt else []
+    prompt_tokens = model.get_prompt(tokenizer, previous, without_timestamps=True)
+    results = model.model.generate(
+        encoder_output,
+        [prompt_tokens] * len(batch),
+        beam_size=beam_size,
+        max_length=WHISPER_MAX_TOKENS,
+        return_scores=True,
+        return_no_speech_prob=True,
+    )
+    texts = []
+    for result in results:
+        clean_text = segment_filter.accept(tokenizer.decode(result.sequences_ids[0]), result.no_speech_prob)
+        texts.append(clean_text or "")
+    return texts
+
+
+class WhisperBatcher:
+    """收集同一時間窗內抵達的完整轉錄請求，以一次批次推論處理後分送結果。
+
+    兩個房間同時喚醒時，RPi4 上兩次 Whisper 依序執行約等於兩倍延遲；批次解碼共用
+    encoder / decoder 的矩陣運算，總吞吐量較高。只有一台裝置在講話（peer_probe 回傳
+    False）時不等待時間窗，單人延遲不變；批次大小為 1 時照舊走 model.transcribe。
+    """
+
+    def __init__(self, window_s: float = ASR_BATCH_WINDOW_S, max_batch: int = ASR_BATCH_MAX):
+        self.window_s = window_s
+        self.max_batch = max_batch
+        # (device_id) -> 是否還有其他裝置正在串流；None = 一律等待時間窗
+        self.peer_probe: Optional[Callable[[str], bool]] = None
+        # (beam_size, prompt) -> 請求；同一批次的解碼參數必須相同
+        self._pending: dict[tuple, list[tuple[str, np.ndarray, asyncio.Future]]] = {}
+        self._timers: dict[tuple, asyncio.TimerHandle] = {}
+        self._tasks: set[asyncio.Task] = set()
+        self.batches = 0
+        self.batched_requests = 0
+
+    @property
+    def enabled(self) -> bool:
+        return self.window_s > 0 and self.max_batch > 1
+
+    async def submit(self, device_id: str, samples: np.ndarray, beam_size: int,
+                     prompt: Optional[str] = None) -> str:
+        loop = asyncio.get_running_loop()
+        future = loop.create_future()
+        key = (beam_size, prompt)
+        pending = self._pending.setdefault(key, [])
+        pending.append((device_id, samples, future))
+
+        if len(pending) >= self.max_batch:
+            self._flush(key)
+        elif len(pending) == 1:
+            wait = self.window_s if self.peer_probe is None or self.peer_probe(device_id) else 0.0
+            if wait > 0:
+                self._timers[key] = loop.call_later(wait, self._flush, key)
+            else:
+                self._flush(key)
+        return await future
+
+    def _flush(self, key: tuple):
+        timer = self._timers.pop(key, None)
+        if timer is not None:
+            timer.cancel()
+        batch = self._pending.pop(key, [])
+        if batch:
+            task = asyncio.ensure_future(self._run(batch, *key))
+            self._tasks.add(task)
+            task.add_done_callback(self._tasks.discard)
+
+    async def _run(self, batch: list, beam_size: int, prompt: Optional[str]):
+        device_ids = [device_id for device_id, _, _ in batch]
+        samples = [s for _, s, _ in batch]
+        try:
+            if len(batch) == 1:
+                text, language = await _run_decode(device_ids[0], samples[0], beam_size, prompt)
+                if text:
+                    logger.info(f"ASR (Whisper) [{language}]: {text}")
+                texts = [text]
+            else:
+                t0 = time.perf_counter()
+                texts = await scheduler.run_asr(
+                    device_ids[0], lambda: _transcribe_batch(get_whisper_model(), samples, beam_size, prompt)
+                )
+                self.batches += 1
+                self.batched_requests += len(batch)
+                logger.info(
+                    f"ASR (Whisper) batch of {len(batch)} {device_ids} in "
+                    f"{time.perf_counter() - t0:.2f}s: {texts}"
+                )
+        except Exception as e:
+            for _, _, future in batch:
+                if not future.done():
+                    future.set_exception(e)
+            return
+        for (_, _, future), text in zip(batch, texts):
+            if not future.done():
+                future.set_result(text)
+
+
+whisper_batcher = WhisperBatcher()
+
+
 async def transcribe_audio(
-    audio_base64: str, audio_format: str = "pcm_16k_16bit"
+    audio: Union[bytes, bytearray, np.ndarray],
+    audio_format: str = "pcm_16k_16bit",
+    beam_size: int = 3,
+    device_id: str = "",
+    background: bool = False,
+    metrics_ctx: Optional[MetricsContext] = None,
 ) -> str:
     """
-    Transcribe audio to text using faster-whisper.
+    Transcribe raw 16-bit PCM (or an already converted float32 array) using faster-whisper.
+    PCM 直接轉為 float32 ndarray 交給 model.transcribe，不經 WAV 封裝與解碼。
+    Streaming partials pass beam_size=1 (greedy) to keep each pass short, and background=True
+    so the ASR lane may drop them under load; a dropped request returns "".
+    Final transcriptions of ≤30 s go through whisper_batcher and may share one batched decode
+    (not with ASR_PROCESSES, where concurrent requests already run in separate worker processes).
+    With ASR_VOCAB_BIAS the device vocabulary is passed as initial_prompt and a confident
+    greedy result skips the beam search.
+    With ASR_CASCADE_MODEL, short final transcriptions try the small model first and only
+    escalate to WHISPER_MODEL when it is unsure or no command matches; per-tier latencies
+    go into metrics_ctx.
     """
     try:
-        model = get_whisper_model()
-        
-        # Decode base64 to bytes
-        audio_bytes = base64.b64decode(audio_base64)
-        
-        # 使用 io.BytesIO 在記憶體中建立 WAV 格式資料，避免磁碟 I/O
-        wav_buf = io.BytesIO()
-        sample_rate = 16000
-        bits_per_sample = 16
-        channels = 1
-        data_size = len(audio_bytes)
-        
-        wav_buf.write(b"RIFF")
-        wav_buf.write(pack("<I", 36 + data_size))
-        wav_buf.write(b"WAVE")
-        wav_buf.write(b"fmt ")
-        wav_buf.write(pack("<I", 16))
-        wav_buf.write(pack("<H", 1))
-        wav_buf.write(pack("<H", channels))
-        wav_buf.write(pack("<I", sample_rate))
-        wav_buf.write(pack("<I", sample_rate * channels * (bits_per_sample // 8)))
-        wav_buf.write(pack("<H", channels * (bits_per_sample // 8)))
-        wav_buf.write(pack("<H", bits_per_sample))
-        wav_buf.write(b"data")
-        wav_buf.write(pack("<I", data_size))
-        wav_buf.write(audio_bytes)
-        wav_buf.seek(0)
-
-        # 定義阻塞推論的同步函式
-        def run_transcription():
-            segments, info = model.transcribe(
-                wav_buf, 
-                beam_size=3, # 優化：縮小 beam_size 換取速度
-                language="zh",
-                no_speech_threshold=0.6,
-                log_prob_threshold=-1.0
-            )
-            
-            text_segments = []
-            for segment in segments:
-                if segment.no_speech_prob < 0.7:
-                    clean_text = segment.text.strip()
-                    # 幻聽攔截邏輯保持不變
-                    if len(clean_text) >= 4:
-                        half = len(clean_text) // 2
-                        if clean_text[:half] == clean_text[half:]:
-                            continue
-                        if all(c == clean_text[0] for c in clean_text[:4]):
-                            continue
-                    text_segments.append(clean_text)
-            return "".join(text_segments).strip(), info
-
-        # 使用全域受限的 executor 執行阻塞式的 Whisper 推論，防止 CPU 飽和
-        loop = asyncio.get_event_loop()
-        text, info = await loop.run_in_executor(inference_executor, run_transcription)
-        
-        if text:
-            logger.info(f"ASR (Whisper) [{info.language}]: {text}")
+        samples = audio if isinstance(audio, np.ndarray) else pcm_to_float32(audio)
+        samples = resample(samples, sample_rate_from_format(audio_format))
+
+        prompt = vocabulary_prompt()
+        if (not background and cascade_enabled()
+                and len(samples) <= ASR_CASCADE_MAX_S * WHISPER_SAMPLE_RATE):
+            text = await _cascade_decode(device_id, samples, prompt, metrics_ctx)
+            if text is not None:
+                return text
+
+        t0 = time.perf_counter()
+        if (not background and whisper_batcher.enabled and not asr_pool.enabled
+                and len(samples) <= WHISPER_WINDOW_SAMPLES):
+            text = await whisper_batcher.submit(device_id, samples, beam_size, prompt)
+        else:
+            # 經 ASR lane（專屬執行緒或 worker 行程、裝置間公平排隊）執行 Whisper 推論，防止 CPU 飽和
+            text, language = await _run_decode(device_id, samples, beam_size, prompt, background=background)
+            if text:
+                logger.info(f"ASR (Whisper) [{language}]: {text}")
+        if metrics_ctx is not None:
+            metrics_ctx.record_latency("asr_large_latency", round(time.perf_counter() - t0, 3))
         return text
 
+    except (LaneBusy, DeadlineExceeded) as e:
+        logger.warning(f"ASR request from {device_id or 'unknown'} not run: {e}")
+        return ""
     except Exception as e:
         logger.error(f"ASR error: {e}")
         return ""
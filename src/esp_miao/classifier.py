@@ -0,0 +1,156 @@
+"""First-stage command classifier: MFCC + DTW templates learned from confirmed commands."""
+
+import logging
+from typing import Optional
+
+import numpy as np
+
+from .config import (
+    COMMAND_CLASSIFIER_TEMPLATES,
+    COMMAND_CLASSIFIER_MIN_TEMPLATES,
+    COMMAND_CLASSIFIER_SPREAD,
+    COMMAND_CLASSIFIER_MARGIN,
+)
+from .audio import pcm_to_float32, resample, sample_rate_from_format
+from .connection import device_table
+
+logger = logging.getLogger("esp-miao.classifier")
+
+SAMPLE_RATE = 16000
+FRAME = 400           # 25 ms
+HOP = 320             # 20 ms（指令約 1 秒 → 50 幀，DTW 成本很低）
+N_FFT = 512
+N_MELS = 26
+N_MFCC = 13
+TRIM_RATIO = 0.1      # 幀 RMS 低於最大值此比例視為前後靜音
+
+
+def _mel_filterbank(n_mels: int = N_MELS, n_fft: int = N_FFT, sr: int = SAMPLE_RATE) -> np.ndarray:
+    def hz_to_mel(f):
+        return 2595.0 * np.log10(1.0 + f / 700.0)
+
+    def mel_to_hz(m):
+        return 700.0 * (10.0 ** (m / 2595.0) - 1.0)
+
+    mels = np.linspace(hz_to_mel(80.0), hz_to_mel(sr / 2 * 0.95), n_mels + 2)
+    bins = np.floor((n_fft + 1) * mel_to_hz(mels) / sr).astype(int)
+    fbank = np.zeros((n_mels, n_fft // 2 + 1), dtype=np.float32)
+    for m in range(1, n_mels + 1):
+        lo, center, hi = bins[m - 1], bins[m], bins[m + 1]
+        for k in range(lo, center):
+            fbank[m - 1, k] = (k - lo) / max(center - lo, 1)
+        for k in range(center, hi):
+            fbank[m - 1, k] = (hi - k) / max(hi - center, 1)
+    return fbank
+
+
+_FBANK = _mel_filterbank()
+_WINDOW = np.hamming(FRAME).astype(np.float32)
+# DCT-II（正交化）取前 N_MFCC 係數，略過 c0（能量）
+_DCT = np.cos(np.pi / N_MELS * (np.arange(N_MELS) + 0.5)[None, :] * np.arange(1, N_MFCC + 1)[:, None])
+_DCT = (_DCT * np.sqrt(2.0 / N_MELS)).astype(np.float32)
+
+
+def mfcc_features(samples: np.ndarray) -> Optional[np.ndarray]:
+    """16 kHz float32 → (幀, N_MFCC)；去除前後靜音並做 cepstral mean normalization。"""
+    if len(samples) < FRAME:
+        return None
+    frames = np.lib.stride_tricks.sliding_window_view(samples, FRAME)[::HOP]
+    rms = np.sqrt(np.mean(frames * frames, axis=1))
+    voiced = np.nonzero(rms >= rms.max() * TRIM_RATIO)[0] if rms.max() > 0 else []
+    if len(voiced) < 5:
+        return None
+    frames = frames[voiced[0]:voiced[-1] + 1] * _WINDOW
+    power = np.abs(np.fft.rfft(frames, N_FFT)) ** 2
+    log_mel = np.log(power @ _FBANK.T + 1e-10)
+    ceps = log_mel @ _DCT.T
+    return (ceps - ceps.mean(axis=0)).astype(np.float32)
+
+
+def dtw_distance(a: np.ndarray, b: np.ndarray) -> float:
+    """平均每幀的 DTW 距離；步進 (i-1,j) / (i-1,j-1) / (i-1,j-2)，可整列向量化。
+
+    限制 b 的長度不超過 a 的兩倍（反之亦然），語速差異過大的配對視為不相符。
+    """
+    if len(b) > 2 * len(a) or len(a) > 2 * len(b):
+        return float("inf")
+    cost = np.sqrt(((a[:, None, :] - b[None, :, :]) ** 2).sum(axis=2))
+    acc = np.full(len(b), np.inf)
+    acc[0] = cost[0, 0]
+    for i in range(1, len(a)):
+        prev = acc
+        best = prev.copy()
+        best[1:] = np.minimum(best[1:], prev[:-1])
+        best[2:] = np.minimum(best[2:], prev[:-2])
+        acc = cost[i] + best
+    return float(acc[-1] / len(a))
+
+
+class CommandClassifier:
+    """從已確認（關鍵字命中且成功派送）的指令錄音學習模板，新語音以 DTW 最近鄰分類。
+
+    判定為高信心需同時滿足：
+      - 該指令已有至少 COMMAND_CLASSIFIER_MIN_TEMPLATES 個模板，且已學到兩種以上指令
+      - 最近距離不超過該指令模板彼此間平均距離 × COMMAND_CLASSIFIER_SPREAD（自我校準）
+      - 其他指令的最近距離 / 最近距離 ≥ COMMAND_CLASSIFIER_MARGIN
+    不確定時回傳 None，照常走 Whisper + 意圖解析。
+    """
+
+    def __init__(self, max_templates: int = COMMAND_CLASSIFIER_TEMPLATES):
+        self.max_templates = max_templates
+        self._templates: dict[tuple[str, str], list[np.ndarray]] = {}
+        self._spread: dict[tuple[str, str], float] = {}
+
+    def classify(self, features: Optional[np.ndarray]) -> Optional[dict]:
+        """回傳 {"intent", "distance", "margin"}（高信心）或 None。"""
+        if features is None:
+            return None
+        best: dict[tuple[str, str], float] = {}
+        # 於背景執行緒呼叫：先複製，enroll() 可同時在 event loop 修改
+        for key, templates in list(self._templates.items()):
+            device = device_table.get_device(key[0])
+            if device is None:
+                continue
+            best[key] = min(dtw_distance(features, t) for t in list(templates))
+        if len(best) < 2:
+            return None
+        ranked = sorted(best.items(), key=lambda kv: kv[1])
+        (key, d1), (_, d2) = ranked[0], ranked[1]
+        margin = d2 / d1 if d1 > 0 else float("inf")
+        spread = self._spread.get(key)
+        if (len(self._templates[key]) < COMMAND_CLASSIFIER_MIN_TEMPLATES or spread is None
+                or d1 > spread * COMMAND_CLASSIFIER_SPREAD or margin < COMMAND_CLASSIFIER_MARGIN):
+            logger.debug(f"Classifier unsure: best {key} d={d1:.2f} margin={margin:.2f}")
+            return None
+        target, value = key
+        return {
+            "intent": {"action": "relay_set", "target": target, "value": value},
+            "distance": round(d1, 3),
+            "margin": round(margin, 3),
+        }
+
+    def classify_pcm(self, audio: bytes, audio_format: str) -> tuple[Optional[dict], Optional[np.ndarray]]:
+        """阻塞：PCM → 特徵 → 分類；特徵一併回傳，供確認後 enroll()。"""
+        samples = resample(pcm_to_float32(audio), sample_rate_from_format(audio_format))
+        features = mfcc_features(samples)
+        return self.classify(features), features
+
+    def enroll(self, features: Optional[np.ndarray], target: str, value: str):
+        """加入一筆已確認的指令錄音（每個指令保留最新 max_templates 筆）。"""
+        if features is None or self.max_templates <= 0:
+            return
+        key = (target, value)
+        templates = self._templates.setdefault(key, [])
+        templates.append(features)
+        del templates[:-self.max_templates]
+        if len(templates) >= 2:
+            pairs = [dtw_distance(a, b) for i, a in enumerate(templates) for b in templates[i + 1:]]
+            finite = [d for d in pairs if d != float("inf")]
+            self._spread[key] = sum(finite) / len(finite) if finite else None
+        logger.debug(f"Classifier enrolled {key}: {len(templates)} templates")
+
+    def snapshot(self) -> dict:
+        return {f"{t}:{v}": len(ts) for (t, v), ts in self._templates.items()}
+
+
+command_classifier = CommandClassifier()
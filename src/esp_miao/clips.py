@@ -0,0 +1,88 @@
+"""False-trigger clips uploaded by devices (dataset collection for wake word retraining)."""
+
+import json
+import logging
+import re
+import struct
+import time
+import wave
+from pathlib import Path
+from typing import Optional
+
+from .codec import ADPCM_BLOCK_HEADER, decode_ima_adpcm_block
+from .config import CLIP_DIR
+
+logger = logging.getLogger("esp-miao.clips")
+
+# 對應韌體 logic/clip_recorder.h ClipHeader（28 bytes，little-endian）+ ADPCM 區塊
+CLIP_HEADER = struct.Struct("<4sBBHIfIIHH")
+CLIP_MAGIC = b"MCLP"
+CLIP_KINDS = {0: "near_miss", 1: "false_wake"}
+
+_SAFE_NAME = re.compile(r"[^A-Za-z0-9_.-]")
+
+
+class ClipError(ValueError):
+    """上傳內容不是可解析的片段。"""
+
+
+def parse_clip(data: bytes) -> tuple[dict, bytes]:
+    """片段檔 → (metadata, 16-bit PCM)；格式錯誤時拋出 ClipError。"""
+    if len(data) < CLIP_HEADER.size:
+        raise ClipError("clip shorter than its header")
+    (magic, version, kind, sample_rate, samples, confidence,
+     trace_id, unix_time, block_samples, _) = CLIP_HEADER.unpack_from(data)
+    if magic != CLIP_MAGIC or version != 1:
+        raise ClipError(f"unknown clip format {magic!r} v{version}")
+    if kind not in CLIP_KINDS or not sample_rate or not block_samples:
+        raise ClipError("invalid clip header")
+
+    # 每個區塊 block_samples 個樣本（最後一個可能較短），位元組數同韌體 adpcm_block_bytes()
+    pcm = bytearray()
+    offset = CLIP_HEADER.size
+    remaining = samples
+    while remaining > 0:
+        n = min(block_samples, remaining)
+        size = ADPCM_BLOCK_HEADER.size + (n + 1) // 2
+        if offset + size > len(data):
+            raise ClipError(f"clip truncated at {samples - remaining}/{samples} samples")
+        pcm += decode_ima_adpcm_block(data[offset:offset + size])[:n * 2]
+        offset += size
+        remaining -= n
+
+    meta = {
+        "kind": CLIP_KINDS[kind],
+        "sample_rate": sample_rate,
+        "samples": samples,
+        "duration_s": round(samples / sample_rate, 3),
+        "confidence": round(confidence, 4),
+        "trace_id": f"{trace_id:08x}" if trace_id else None,
+        "device_time": unix_time or None,
+    }
+    return meta, bytes(pcm)
+
+
+def save_clip(device_id: str, data: bytes, clip_dir: Optional[Path] = None) -> Path:
+    """解析並存成 <clip_dir>/<kind>/<device>_<time>.wav 與同名 .json；回傳 WAV 路徑。"""
+    meta, pcm = parse_clip(data)
+    meta["device_id"] = device_id
+    meta["received_at"] = int(time.time())
+
+    out_dir = (clip_dir or CLIP_DIR) / meta["kind"]
+    out_dir.mkdir(parents=True, exist_ok=True)
+    stamp = meta["device_time"] or meta["received_at"]
+    base = f"{_SAFE_NAME.sub('_', device_id)}_{stamp}"
+    path = out_dir / f"{base}.wav"
+    n = 1
+    while path.exists():   # 同一秒的多個片段（或未校時的裝置）
+        path = out_dir / f"{base}_{n}.wav"
+        n += 1
+
+    with wave.open(str(path), "wb") as w:
+        w.setnchannels(1)
+        w.setsampwidth(2)
+        w.setframerate(meta["sample_rate"])
+        w.writeframes(pcm)
+    path.with_suffix(".json").write_text(json.dumps(meta, ensure_ascii=False, indent=2))
+    logger.info(f"Saved {meta['kind']} clip from {device_id}: {path.name} (conf={meta['confidence']})")
+    return path
@@ -0,0 +1,229 @@
+"""Multi-node deployment: node load, the device table and device placement shared over MQTT."""
+
+import asyncio
+import json
+import logging
+import threading
+import time
+from typing import Any, Awaitable, Callable, Optional
+
+from .config import (
+    CLUSTER_NODE_ID, CLUSTER_WS_URL, CLUSTER_TOPIC, CLUSTER_CAPACITY,
+    CLUSTER_PUBLISH_S, CLUSTER_STALE_S, CLUSTER_REBALANCE_MARGIN, CLUSTER_MAX_ENDPOINTS,
+)
+from .connection import DynamicDeviceTable, DeviceTableSnapshot, device_table, mqtt_client, connect_listeners
+from .metrics import aggregator
+from .models import ServerList, ServerListPayload
+
+logger = logging.getLogger("esp-miao.cluster")
+
+Sender = Callable[[str, dict], Awaitable[bool]]
+
+
+class ClusterNode:
+    """同一個 broker 上的多台 Server（MQTT retained 訊息，不需額外的協調服務）。
+
+    - <topic>/nodes/<id>：各節點的負載（連線裝置數、串流數、容量），定期發佈；LWT 清除
+    - <topic>/registry/<id>：各節點的裝置表，發佈後轉發；其他節點登記自己尚未知道的裝置，
+      之後啟動的節點連上 broker 即取得全部裝置，指令由任何一個節點經 MQTT 送出皆可
+    - 連線中的裝置依各節點利用率排序端點清單（server_list），由韌體存入 NVS 並依序偏好；
+      原節點只在其他節點利用率低 margin 以上時讓出第一順位，每個發佈週期最多導走一台
+    """
+
+    def __init__(self, node_id: str = CLUSTER_NODE_ID, url: str = CLUSTER_WS_URL,
+                 capacity: int = CLUSTER_CAPACITY, client: Any = mqtt_client,
+                 table: DynamicDeviceTable = device_table, topic: str = CLUSTER_TOPIC,
+                 stale_s: float = CLUSTER_STALE_S, margin: float = CLUSTER_REBALANCE_MARGIN,
+                 clock: Callable[[], float] = time.monotonic):
+        self.node_id = node_id
+        self.url = url.rstrip("/")
+        self.capacity = max(1, capacity)
+        self.client = client
+        self.table = table
+        self.topic = topic
+        self.stale_s = stale_s
+        self.margin = margin
+        self.clock = clock
+        self.connected: Callable[[], list[str]] = lambda: []
+        self.streams: Callable[[], int] = lambda: 0
+        self._peers: dict[str, tuple[float, dict]] = {}   # 節點 -> (收到時間, 負載)；MQTT 執行緒寫入
+        self._lock = threading.Lock()
+        self._sent: dict[str, str] = {}    # 裝置 -> 最近下發的端點清單
+        self._leaving: set[str] = set()    # 已被導向其他節點、尚未斷線的裝置（不計入本節點負載）
+        self._task: Optional[asyncio.Task] = None
+        self.steered = 0
+        self.registry_merged = 0
+
+    @property
+    def enabled(self) -> bool:
+        return bool(self.node_id)
+
+    def bind(self, connected: Callable[[], list[str]], streams: Callable[[], int]):
+        """本節點負載的來源（連線中的裝置、進行中的串流數）。"""
+        self.connected = connected
+        self.streams = streams
+
+    def attach(self):
+        """須在 MQTT 連線前呼叫：設定 LWT、訂閱與裝置表轉發。"""
+        self.client.will_set(f"{self.topic}/nodes/{self.node_id}", b"", qos=1, retain=True)
+        self.client.message_callback_add(f"{self.topic}/#", self.on_message)
+        connect_listeners.append(self.on_connect)
+        self.table.publish_listeners.append(self.publish_registry)
+
+    def on_connect(self, client):
+        client.subscribe(f"{self.topic}/#", qos=1)
+        self.publish_status()
+        self.publish_registry(self.table.current)
+
+    # --- 發佈 ---
+
+    def local_status(self) -> dict:
+        devices = [d for d in self.connected() if d not in self._leaving]
+        return {
+            "node": self.node_id, "url": self.url,
+            "devices": len(devices), "streams": self.streams(), "capacity": self.capacity,
+        }
+
+    def publish_status(self):
+        status = self.local_status()
+        self.client.publish(f"{self.topic}/nodes/{self.node_id}", json.dumps(status), qos=1, retain=True)
+        aggregator.record_node(self.node_id, status["devices"], status["streams"], self.capacity)
+
+    def publish_registry(self, snapshot: DeviceTableSnapshot):
+        if not snapshot.device_list:
+            return   # 剛啟動、尚未有裝置：不以空表覆蓋自己上次的 retained 內容
+        data = self.table.registry_data(snapshot)
+        self.client.publish(f"{self.topic}/registry/{self.node_id}",
+                            json.dumps(data, ensure_ascii=False), qos=1, retain=True)
+
+    def leave(self):
+        """正常關閉：清除本節點的 retained 負載，其他節點立即不再把裝置導向這裡。"""
+        if self._task is not None:
+            self._task.cancel()
+            self._task = None
+        self.client.publish(f"{self.topic}/nodes/{self.node_id}", b"", qos=1, retain=True)
+
+    # --- 接收（MQTT 網路執行緒）---
+
+    def on_message(self, client, userdata, msg):
+        parts = msg.topic[len(self.topic) + 1:].split("/")
+        if len(parts) != 2 or parts[1] == self.node_id:
+            return
+        kind, node = parts
+        try:
+            data = json.loads(msg.payload) if msg.payload else None
+        except ValueError as e:
+            logger.warning(f"Malformed cluster message on {msg.topic}: {e}")
+            return
+        if kind == "nodes":
+            with self._lock:
+                if data is None:
+                    self._peers.pop(node, None)
+                else:
+                    self._peers[node] = (self.clock(), data)
+            if data is None:
+                aggregator.forget_node(node)
+                logger.info(f"Cluster node {node} left")
+            else:
+                aggregator.record_node(node, data.get("devices", 0), data.get("streams", 0), data.get("capacity", 1))
+        elif kind == "registry" and data is not None:
+            merged = self.table.restore(data, f"node {node}")
+            self.registry_merged += merged
+            if merged:
+                logger.info(f"Cluster: {merged} devices learned from node {node}")
+
+    # --- 裝置配置 ---
+
+    def live_nodes(self) -> dict[str, dict]:
+        """本節點與 stale_s 內回報過的其他節點 -> 負載。"""
+        now = self.clock()
+        with self._lock:
+            stale = [n for n, (t, _) in self._peers.items() if now - t > self.stale_s]
+            for node in stale:
+                del self._peers[node]
+            nodes = {n: s for n, (_, s) in self._peers.items() if s.get("url")}
+        for node in stale:
+            aggregator.forget_node(node)
+        nodes[self.node_id] = self.local_status()
+        return nodes
+
+    def placement(self, nodes: dict[str, dict]) -> list[str]:
+        """本節點上一台裝置的節點偏好順序：加入該節點後的利用率由低到高，原節點在 margin 內優先。"""
+        def cost(node: str) -> float:
+            s = nodes[node]
+            extra = 0 if node == self.node_id else 1   # 裝置已計入本節點
+            return (s.get("devices", 0) + extra) / max(1, s.get("capacity", 1))
+
+        order = sorted(nodes, key=lambda n: (cost(n), n != self.node_id, n))
+        if order[0] != self.node_id and cost(self.node_id) - cost(order[0]) <= self.margin:
+            order.remove(self.node_id)
+            order.insert(0, self.node_id)
+        return order
+
+    async def steer(self, device_id: str, send: Sender, nodes: Optional[dict[str, dict]] = None,
+                    allow_leave: bool = True) -> bool:
+        """端點清單與上次下發的不同時送出 server_list；回傳是否把裝置導向其他節點。"""
+        nodes = nodes or self.live_nodes()
+        if len(nodes) < 2:
+            return False
+        order = self.placement(nodes)
+        leaves = order[0] != self.node_id
+        if leaves and not allow_leave:
+            order.remove(self.node_id)
+            order.insert(0, self.node_id)
+            leaves = False
+        chosen = order[:CLUSTER_MAX_ENDPOINTS]
+        if self.node_id not in chosen:
+            chosen[-1] = self.node_id   # 目前連線的節點留在清單中，裝置不必斷線即可套用
+        uris = ",".join(f"{nodes[n]['url']}/ws/{device_id}" for n in chosen)
+        if uris == self._sent.get(device_id):
+            return False
+        message = ServerList(
+            device_id=device_id, timestamp=int(time.time() * 1000), payload=ServerListPayload(uris=uris),
+        )
+        if not await send(device_id, message.model_dump()):
+            return False
+        self._sent[device_id] = uris
+        if leaves:
+            self._leaving.add(device_id)
+            self.steered += 1
+            logger.info(f"Steering {device_id} to node {order[0]} ({uris})")
+        else:
+            self._leaving.discard(device_id)
+        return leaves
+
+    def forget(self, device_id: str):
+        """裝置斷線：下次連上（本節點或其他節點）重新下發。"""
+        self._sent.pop(device_id, None)
+        self._leaving.discard(device_id)
+
+    async def run(self, send: Sender):
+        """定期發佈負載並重新排序連線中裝置的端點清單。"""
+        while True:
+            try:
+                await self.run_once(send)
+            except Exception as e:
+                logger.warning(f"Cluster rebalance failed: {e}")
+            await asyncio.sleep(CLUSTER_PUBLISH_S)
+
+    async def run_once(self, send: Sender):
+        self.publish_status()
+        moved = False
+        for device_id in self.connected():
+            moved |= await self.steer(device_id, send, allow_leave=not moved)
+
+    def start(self, send: Sender):
+        if self._task is None:
+            self._task = asyncio.create_task(self.run(send))
+
+    def snapshot(self) -> dict:
+        return {
+            "node": self.node_id,
+            **aggregator.cluster_snapshot(),
+            "steered": self.steered,
+            "leaving": len(self._leaving),
+            "registry_merged": self.registry_merged,
+        }
+
+
+cluster = ClusterNode()
@@ -0,0 +1,133 @@
+"""Audio codecs shared with the firmware (uplink decode, downlink encode)."""
+
+import struct
+import sys
+from array import array
+
+# 對應韌體 audio/adpcm.h：[int16 predictor][uint8 step_index][uint8 0] + nibbles（低 4 bit 在前）
+ADPCM_BLOCK_HEADER = struct.Struct("<hBB")
+
+_INDEX_TABLE = (-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8)
+_STEP_TABLE = (
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+)
+
+
+def codec_from_format(audio_format: str) -> str:
+    """由 audio_format 判斷上行編碼（"adpcm_16k_4bit" → "ima_adpcm"，其餘為 "pcm"）。"""
+    return "ima_adpcm" if audio_format and audio_format.startswith("adpcm") else "pcm"
+
+
+def decode_ima_adpcm_block(block: bytes) -> bytes:
+    """Decode one self-contained IMA-ADPCM block into little-endian 16-bit PCM."""
+    if len(block) < ADPCM_BLOCK_HEADER.size:
+        return b""
+    pred, index, _ = ADPCM_BLOCK_HEADER.unpack_from(block)
+    index = min(max(index, 0), 88)
+    out = array("h")
+
+    for byte in block[ADPCM_BLOCK_HEADER.size:]:
+        for code in (byte & 0x0F, byte >> 4):
+            step = _STEP_TABLE[index]
+            delta = step >> 3
+            if code & 4:
+                delta += step
+            if code & 2:
+                delta += step >> 1
+            if code & 1:
+                delta += step >> 2
+            pred = pred - delta if code & 8 else pred + delta
+            pred = max(-32768, min(32767, pred))
+            index = min(max(index + _INDEX_TABLE[code], 0), 88)
+            out.append(pred)
+
+    if sys.byteorder != "little":
+        out.byteswap()
+    return out.tobytes()
+
+
+def encode_ima_adpcm_block(pcm: bytes, state: tuple[int, int] = (0, 0)) -> tuple[bytes, tuple[int, int]]:
+    """Encode 16-bit PCM into one self-contained IMA-ADPCM block (same layout as the uplink).
+
+    state = (predictor, step_index)，跨區塊延續；回傳 (區塊, 新狀態)。
+    """
+    samples = array("h")
+    samples.frombytes(pcm[:len(pcm) & ~1])
+    if sys.byteorder != "little":
+        samples.byteswap()
+    pred, index = state
+    out = bytearray(ADPCM_BLOCK_HEADER.pack(pred, index, 0))
+
+    def encode(sample: int) -> int:
+        nonlocal pred, index
+        step = _STEP_TABLE[index]
+        diff = sample - pred
+        code = 0
+        if diff < 0:
+            code = 8
+            diff = -diff
+        # 逐 bit 逼近，累加解碼端會重建的差值（同韌體 adpcm.cpp）
+        delta = step >> 3
+        if diff >= step:
+            code |= 4
+            diff -= step
+            delta += step
+        step >>= 1
+        if diff >= step:
+            code |= 2
+            diff -= step
+            delta += step
+        step >>= 1
+        if diff >= step:
+            code |= 1
+            delta += step
+        pred = pred - delta if code & 8 else pred + delta
+        pred = max(-32768, min(32767, pred))
+        index = min(max(index + _INDEX_TABLE[code], 0), 88)
+        return code
+
+    for i in range(0, len(samples), 2):
+        lo = encode(samples[i])
+        hi = encode(samples[i + 1]) if i + 1 < len(samples) else 0
+        out.append(lo | (hi << 4))
+    return bytes(out), (pred, index)
+
+
+# 遺失補償：重複最後一個週期並逐週期衰減，約 CONCEAL_FADE_PERIODS 個週期後為靜音
+CONCEAL_PERIOD_SAMPLES = 160   # 10 ms @ 16 kHz
+CONCEAL_FADE_PERIODS = 4
+
+
+def conceal_loss(previous: bytes, samples: int) -> bytes:
+    """Fill a gap of lost samples from the audio before it (16-bit PCM).
+
+    Whisper 對突然的靜音段比對平滑衰減的重複更敏感（易斷詞 / 幻覺），
+    短暫遺失以前一段音訊延續；無前文時退回靜音。
+    """
+    if samples <= 0:
+        return b""
+    tail = array("h")
+    tail.frombytes(previous[-CONCEAL_PERIOD_SAMPLES * 2:])
+    if not tail:
+        return bytes(samples * 2)
+    if sys.byteorder != "little":
+        tail.byteswap()
+
+    period = len(tail)
+    out = array("h", bytes(samples * 2))
+    fade_len = period * CONCEAL_FADE_PERIODS
+    for i in range(min(samples, fade_len)):
+        gain = 1.0 - i / fade_len
+        out[i] = int(tail[i % period] * gain)
+
+    if sys.byteorder != "little":
+        out.byteswap()
+    return out.tobytes()
@@ -1,35 +1,295 @@
 import os
 from pathlib import Path
 from dotenv import load_dotenv
-from concurrent.futures import ThreadPoolExecutor
 
 # --- Load Environment Variables ---
 load_dotenv()
 
-# --- Global Executor for CPU-bound tasks ---
-# 在 RPi4 上，建議限制 max_workers=1 以避免多個 ASR/LLM 任務併發導致系統崩潰
-inference_executor = ThreadPoolExecutor(max_workers=1)
+# --- Whisper Model Profile ---
+WHISPER_MODEL = os.getenv("WHISPER_MODEL", "base")
+WHISPER_DEVICE = os.getenv("WHISPER_DEVICE", "cpu")            # cpu / cuda / auto
+# 未設定時 CPU 用 int8、CUDA 用 float16
+WHISPER_COMPUTE_TYPE = os.getenv("WHISPER_COMPUTE_TYPE", "")
+WHISPER_CPU_THREADS = int(os.getenv("WHISPER_CPU_THREADS", "0"))  # 0 = 依可用核心數自動選擇
+# ASR 執行緒（與其衍生的 CTranslate2 執行緒）綁定的 CPU，例如 "1-3"；空白 = 不綁定
+WHISPER_CPU_AFFINITY = os.getenv("WHISPER_CPU_AFFINITY", "")
+# 啟動載入模型後以一段靜音解碼兩次：暖機並記錄 cold / warm 延遲
+WHISPER_WARMUP = os.getenv("WHISPER_WARMUP", "1") == "1"
+
+# 以裝置別名 / 動作關鍵字作為 initial_prompt 偏置解碼；先 greedy，片段 avg_logprob 皆不低於
+# ASR_BIAS_MIN_LOGPROB 即採用，否則以 beam search 重解碼
+ASR_VOCAB_BIAS = os.getenv("ASR_VOCAB_BIAS", "0") == "1"
+ASR_BIAS_MIN_LOGPROB = float(os.getenv("ASR_BIAS_MIN_LOGPROB", "-0.5"))
+ASR_BIAS_MAX_TERMS = int(os.getenv("ASR_BIAS_MAX_TERMS", "40"))  # Whisper prompt 上限約 220 token
+
+# 模型級聯：去靜音後短於 ASR_CASCADE_MAX_S 的語音先以小模型 greedy 解碼，片段 avg_logprob 皆不低於
+# ASR_CASCADE_MIN_LOGPROB 且關鍵字比對找得到目標與動作即採用，否則交給 WHISPER_MODEL；兩個模型常駐
+# 空白 = 停用（多行程模式 ASR_PROCESSES 下亦不使用）
+ASR_CASCADE_MODEL = os.getenv("ASR_CASCADE_MODEL", "")
+ASR_CASCADE_MAX_S = float(os.getenv("ASR_CASCADE_MAX_S", "1.5"))
+ASR_CASCADE_MIN_LOGPROB = float(os.getenv("ASR_CASCADE_MIN_LOGPROB", "-0.6"))
+
+# 片段後處理（hallucination.py）：no_speech_prob 達此值或疑似幻聽（重複）的片段丟棄；
+# ASR_EARLY_STOP 時第一個被丟棄的片段即停止解碼後續視窗
+ASR_NO_SPEECH_REJECT = float(os.getenv("ASR_NO_SPEECH_REJECT", "0.7"))
+ASR_EARLY_STOP = os.getenv("ASR_EARLY_STOP", "1") == "1"
+
+# --- Silence Trimming ---
+# ASR 前以能量 VAD 去除前後靜音（Whisper 成本隨輸入長度增加）
+# 判定與韌體 VAD 相同：512 點 Hamming 幀、300–3400 Hz 頻帶 RMS（int16 尺度），
+# 閾值 = max(噪音底 × VAD_SNR_DB, VAD_THRESHOLD_MIN)；數值須與韌體 config.h 一致
+SERVER_TRIM = os.getenv("SERVER_TRIM", "1") == "1"
+VAD_SNR_DB = float(os.getenv("VAD_SNR_DB", "6.0"))
+VAD_THRESHOLD_MIN = float(os.getenv("VAD_THRESHOLD_MIN", "4000.0"))
+TRIM_PAD_MS = int(os.getenv("TRIM_PAD_MS", "200"))   # 語音前後保留（弱起音、尾音）
+TRIM_MIN_MS = int(os.getenv("TRIM_MIN_MS", "600"))   # 同韌體 STREAM_MIN_MS
+
+# --- Noise Profile (denoise.py) ---
+# 每台裝置由串流前後靜音學習房間的穩態噪音譜，送 Whisper 前做頻譜相減（需 SERVER_TRIM 找出靜音段）
+NOISE_PROFILE = os.getenv("NOISE_PROFILE", "1") == "1"
+NOISE_PROFILE_MIN_MS = int(os.getenv("NOISE_PROFILE_MIN_MS", "150"))   # 靜音段短於此值不更新噪音譜
+NOISE_PROFILE_WEIGHT = float(os.getenv("NOISE_PROFILE_WEIGHT", "0.3"))   # 每次更新的指數平均權重
+NOISE_SUBTRACT_ALPHA = float(os.getenv("NOISE_SUBTRACT_ALPHA", "1.5"))   # 過減係數
+NOISE_SUBTRACT_FLOOR_DB = float(os.getenv("NOISE_SUBTRACT_FLOOR_DB", "-15.0"))   # 增益下限（避免音樂噪音）
+
+# --- Command Classifier (classifier.py) ---
+# Whisper 之前先以 MFCC + DTW 模板比對常用指令；模板由已確認的指令錄音自動學習
+# 高信心即直接派送，否則照常轉錄；0 = 停用
+COMMAND_CLASSIFIER = os.getenv("COMMAND_CLASSIFIER", "0") == "1"
+COMMAND_CLASSIFIER_TEMPLATES = int(os.getenv("COMMAND_CLASSIFIER_TEMPLATES", "5"))      # 每個指令保留的模板數
+COMMAND_CLASSIFIER_MIN_TEMPLATES = int(os.getenv("COMMAND_CLASSIFIER_MIN_TEMPLATES", "3"))
+COMMAND_CLASSIFIER_SPREAD = float(os.getenv("COMMAND_CLASSIFIER_SPREAD", "1.0"))  # 相對於模板間平均距離
+COMMAND_CLASSIFIER_MARGIN = float(os.getenv("COMMAND_CLASSIFIER_MARGIN", "1.3"))  # 次佳指令距離 / 最佳距離
+
+# --- Wake Verification (wake_verify.py) ---
+# 串流開頭的 pre-roll 含喚醒詞視窗（韌體 CONFIG_ESP_MIAO_WAKE_VERIFY_WINDOW 送出 1 秒），收齊即與該裝置
+# 已確認的喚醒錄音比對（MFCC + DTW）；明顯不像時在 ASR 之前取消串流（audio_cancel reason=wake_rejected）
+WAKE_VERIFY = os.getenv("WAKE_VERIFY", "0") == "1"
+WAKE_VERIFY_MIN_MS = int(os.getenv("WAKE_VERIFY_MIN_MS", "800"))      # pre-roll 短於此值不驗證（舊韌體預設 500 ms）
+WAKE_VERIFY_TEMPLATES = int(os.getenv("WAKE_VERIFY_TEMPLATES", "8"))  # 每台裝置正例 / 反例各保留的模板數
+WAKE_VERIFY_MIN_TEMPLATES = int(os.getenv("WAKE_VERIFY_MIN_TEMPLATES", "5"))
+WAKE_VERIFY_SPREAD = float(os.getenv("WAKE_VERIFY_SPREAD", "1.5"))   # 相對於正例彼此間平均距離
+
+# --- Inference Scheduling (scheduler.py) ---
+# ASR 與 LLM 各自一條 lane：慢的 LLM 不會讓下一台裝置的 ASR 排在後面
+# 在 RPi4 上，建議 ASR_WORKERS=1 以避免多個 Whisper 推論併發導致系統崩潰
+ASR_WORKERS = int(os.getenv("ASR_WORKERS", "1"))
+ASR_QUEUE_MAX = int(os.getenv("ASR_QUEUE_MAX", "8"))
+LLM_CONCURRENCY = int(os.getenv("LLM_CONCURRENCY", "1"))  # Ollama 同機時亦佔 CPU
+LLM_QUEUE_MAX = int(os.getenv("LLM_QUEUE_MAX", "8"))
+# 使用者耐心上限（秒）：排隊超過此時間仍未開始的請求直接丟棄
+USER_PATIENCE_S = float(os.getenv("USER_PATIENCE_S", "8.0"))
+# 同一時間窗內抵達的完整轉錄合併為一次 Whisper 批次推論；0 = 停用
+ASR_BATCH_WINDOW_S = float(os.getenv("ASR_BATCH_WINDOW_S", "0.05"))
+ASR_BATCH_MAX = int(os.getenv("ASR_BATCH_MAX", "4"))
+# ASR 多行程模式：N 個 worker 行程各載入一份模型，音訊經 shared memory 交給 worker，
+# ASR 可跨核擴展且不與 WebSocket / MQTT 共用 GIL，單一解碼崩潰只重啟該 worker。
+# 每個行程各佔一份模型記憶體（base int8 約 150 MB）；0 = 於本行程的 ASR 執行緒推論
+ASR_PROCESSES = int(os.getenv("ASR_PROCESSES", "0"))
+ASR_PROCESS_MAX_S = float(os.getenv("ASR_PROCESS_MAX_S", "30"))  # 每個 worker 的 shared memory 容量（秒）
+
+# --- Metrics Log (metrics/logger.py) ---
+# blocks = 壓縮區塊、依大小輪替並維護時間索引（analyze_metrics.py 只讀取指定時間窗）；
+# jsonl = 舊格式，單一不限大小的 metrics.jsonl
+METRICS_LOG_FORMAT = os.getenv("METRICS_LOG_FORMAT", "blocks")
+METRICS_LOG_DIR = Path(os.getenv("METRICS_LOG_DIR", "metrics"))
+METRICS_SEGMENT_MB = float(os.getenv("METRICS_SEGMENT_MB", "8"))
+METRICS_MAX_SEGMENTS = int(os.getenv("METRICS_MAX_SEGMENTS", "16"))  # 最多保留的 segment 數（超過即刪最舊）
+
+# --- Event Loop Lag (metrics/loop_lag.py) ---
+# 取樣 Task 每 LOOP_LAG_INTERVAL_MS 醒來一次，遲到的時間即 loop 延遲（GET / 的 event_loop、/metrics）；
+# loop 超過 LOOP_STALL_MS 沒有回來時，監看執行緒抓取 loop 執行緒的 stack 與目前的 Task 並記錄警告（0 = 不抓取）
+LOOP_LAG_INTERVAL_MS = int(os.getenv("LOOP_LAG_INTERVAL_MS", "20"))
+LOOP_STALL_MS = int(os.getenv("LOOP_STALL_MS", "250"))
+
+# --- False-trigger Clips (clips.py) ---
+# 裝置 CLIP_RECORDER 上傳的漏喚醒 / 誤喚醒片段，存成 WAV + JSON（重新訓練喚醒詞模型的資料集）
+CLIP_DIR = Path(os.getenv("CLIP_DIR", "clips"))
+CLIP_MAX_BYTES = int(os.getenv("CLIP_MAX_BYTES", "65536"))  # 單一上傳上限（1.5 s ADPCM 約 12 KB）
+
+# 喚醒詞模型映像（scripts/build_model_image.py 產生）：CONFIG_ESP_MIAO_MODEL_PARTITION 的裝置
+# 回報較舊的 model_generation 時推送 model_update，裝置自 GET /model 下載；空字串 = 不提供
+MODEL_IMAGE = os.getenv("MODEL_IMAGE", "")
 
 # --- Resource Configuration ---
 LOAD_MODEL_ON_START = os.getenv("LOAD_MODEL_ON_START", "1") == "1"
 DEBUG_AUDIO_SAVE = os.getenv("DEBUG_AUDIO_SAVE", "0") == "1"
+# 除錯錄音由單一背景執行緒寫入：佇列上限（滿了丟棄並計數，不拖慢回覆）、
+# 總容量上限（MB）與保留時數，超過時由舊到新刪除；0 = 不限
+DEBUG_AUDIO_QUEUE = int(os.getenv("DEBUG_AUDIO_QUEUE", "16"))
+DEBUG_AUDIO_MAX_MB = int(os.getenv("DEBUG_AUDIO_MAX_MB", "200"))
+DEBUG_AUDIO_MAX_AGE_H = float(os.getenv("DEBUG_AUDIO_MAX_AGE_H", "72"))
+# 串流擷取：每個語音 session（喚醒到 audio_end）依原始到達時間寫成一個 .cap 檔，
+# 供 scripts/bench_replay.py 不經裝置重播；空字串 = 關閉
+STREAM_CAPTURE_DIR = os.getenv("STREAM_CAPTURE_DIR", "")
 LOG_LEVEL = os.getenv("LOG_LEVEL", "INFO").upper()
+# wss:// / https://：兩者皆設定時 uvicorn 以 TLS 提供服務（建議 ECDSA P-256 憑證，裝置握手較快）；
+# 空字串 = 明文 ws:// / http://
+SSL_CERTFILE = os.getenv("SSL_CERTFILE", "")
+SSL_KEYFILE = os.getenv("SSL_KEYFILE", "")
 
 # --- Path Configuration ---
 BASE_DIR = Path(__file__).parent
 AUDIO_DIR = BASE_DIR / "audio"
 LOCAL_SOUND_DIR = BASE_DIR / "playsound"
+# 啟動時把 playsound/*.wav 預載到記憶體，經常駐的 aplay 串流播放；0 = 每次播放各起一個 aplay
+SOUND_PRELOAD = os.getenv("SOUND_PRELOAD", "1") == "1"
+
+# --- Downlink Audio (downlink.py) ---
+# 裝置於 wake_detected 宣告 playback_format（有喇叭）時，提示音經 WebSocket binary frame 串流到裝置本身播放；
+# 未宣告的裝置照舊由 Server 本機喇叭播放；0 = 一律本機播放
+DOWNLINK_AUDIO = os.getenv("DOWNLINK_AUDIO", "1") == "1"
+DOWNLINK_FRAME_MS = 20
+# 先一次送出的音訊長度（裝置 jitter buffer 起始水位），之後最多領先播放進度 DOWNLINK_LEAD_MS；
+# 領先量須小於韌體 SPK_JITTER_MS
+DOWNLINK_PREBUFFER_MS = int(os.getenv("DOWNLINK_PREBUFFER_MS", "120"))
+DOWNLINK_LEAD_MS = int(os.getenv("DOWNLINK_LEAD_MS", "200"))
 
 # --- WebSocket Configuration ---
 TIMEOUT_SECONDS = 10.0
+# 串流中斷線後保留已收音訊、等待裝置 audio_resume 的秒數
+STREAM_RESUME_TIMEOUT = float(os.getenv("STREAM_RESUME_TIMEOUT", "10"))
+# 串流緩衝於 audio_start 依 total_samples 預配置，處理完歸還 pool；最多保留的閒置緩衝數
+STREAM_BUFFER_POOL = int(os.getenv("STREAM_BUFFER_POOL", "8"))
+# 每個連線的請求佇列（command / fallback / audio_request 在 WebSocket 讀取迴圈之外依序處理）；
+# 佇列滿時新請求直接丟棄並記錄，讀取迴圈不等待
+REQUEST_QUEUE_MAX = int(os.getenv("REQUEST_QUEUE_MAX", "4"))
+# 多個節點在此秒數內先後送出 audio_start 視為同一次喚醒：只保留喚醒信心最高的串流，
+# 其餘送 audio_cancel 提前中止；0 = 停用
+WAKE_DEDUP_WINDOW_S = float(os.getenv("WAKE_DEDUP_WINDOW_S", "0.3"))
+# 串流結束後的處理進度（asr_started / asr_done / intent_done / dispatched）即時送回裝置：
+# 裝置據此記錄各階段往返時間、於派送當下切換 UI，且仍有進度時延長等待回覆；0 = 只送最終回覆
+STREAM_PROGRESS = os.getenv("STREAM_PROGRESS", "1") == "1"
+# 喚醒門檻自動調整：最近 WAKE_TUNE_WINDOW 次喚醒中轉錄為空 / not_understood（誤喚醒）比例
+# 高於 WAKE_TUNE_TARGET 時調高裝置的喚醒門檻（或 VAD 閾值下限），遠低於時逐步放回；0 = 停用
+WAKE_TUNING = os.getenv("WAKE_TUNING", "1") == "1"
+WAKE_TUNE_TARGET = float(os.getenv("WAKE_TUNE_TARGET", "0.2"))
+WAKE_TUNE_WINDOW = int(os.getenv("WAKE_TUNE_WINDOW", "50"))
+WAKE_TUNE_MIN_SAMPLES = int(os.getenv("WAKE_TUNE_MIN_SAMPLES", "20"))
+WAKE_TUNE_STEP = float(os.getenv("WAKE_TUNE_STEP", "0.02"))
+WAKE_TUNE_COOLDOWN_S = float(os.getenv("WAKE_TUNE_COOLDOWN_S", "600"))
+# 追問（裝置動作後的視窗內不需喚醒詞）：只說出裝置沒說動作時（「還有風扇」）沿用上一個動作的 value，
+# 上一個動作超過此秒數即不再延續
+FOLLOWUP_CONTEXT_S = float(os.getenv("FOLLOWUP_CONTEXT_S", "15"))
+# 裝置握手時提供 esp-miao.bin1 subprotocol 則下行控制訊息改送定長 binary frame（wire.py）；0 = 一律 JSON
+CONTROL_BINARY = os.getenv("CONTROL_BINARY", "1") == "1"
+# UDP 音訊上行（audio_start transfer_mode="udp"）：音訊 frame 以 datagram 送到此埠，控制訊息仍走 WebSocket；0 = 停用
+UDP_AUDIO_PORT = int(os.getenv("UDP_AUDIO_PORT", "8001"))
+# jitter buffer 最多暫存的亂序 frame 數：超過即放棄等待缺少的 frame，以遺失補償填補
+UDP_JITTER_FRAMES = int(os.getenv("UDP_JITTER_FRAMES", "4"))
+# 收到 audio_end（走 WebSocket，可能比最後幾個 datagram 先到）後再等候的秒數
+UDP_END_GRACE_S = float(os.getenv("UDP_END_GRACE_S", "0.05"))
+# 連續串流（Server 端喚醒）：列出的裝置（逗號分隔，"*" = 全部）連線後即被要求持續以 UDP 送出 VAD 語音，
+# 由 Server 的 ASR 比對喚醒片語（需韌體 CONFIG_ESP_MIAO_CONTINUOUS_STREAM 與 UDP_AUDIO_PORT）；空 = 停用
+CONTINUOUS_DEVICES = {d.strip() for d in os.getenv("CONTINUOUS_DEVICES", "").split(",") if d.strip()}
+CONTINUOUS_MAX_KBPS = int(os.getenv("CONTINUOUS_MAX_KBPS", "48"))      # 裝置平均上行頻寬上限，0 = 不限
+# 1 = 還需裝置本地喚醒詞（wake_hint）落在同一段語音內才接受（降低 ASR 誤認的誤喚醒）
+CONTINUOUS_CONFIRM = os.getenv("CONTINUOUS_CONFIRM", "0") == "1"
+CONTINUOUS_WAKE_PHRASES = tuple(
+    p.strip() for p in os.getenv("CONTINUOUS_WAKE_PHRASES", "嘿喵喵,喵喵,hey miaomiao").split(",") if p.strip()
+)
+CONTINUOUS_GAP_MS = int(os.getenv("CONTINUOUS_GAP_MS", "400"))          # 兩段語音間隔超過此值即切成不同語句
+CONTINUOUS_MAX_UTTERANCE_S = float(os.getenv("CONTINUOUS_MAX_UTTERANCE_S", "8"))
+# 只說喚醒片語時：此秒數內的下一句不需喚醒片語即視為指令
+CONTINUOUS_ARM_S = float(os.getenv("CONTINUOUS_ARM_S", "5"))
+# WebSocket binary 串流兩個 frame 間隔超過此值記為停頓，並歸因於 Server / 裝置 / 網路（metrics 的 rx_* 欄位）
+STREAM_STALL_MS = int(os.getenv("STREAM_STALL_MS", "100"))
+
+# --- Streaming ASR ---
+# 串流途中即以累積的音訊做 partial 轉錄（greedy），連續 STREAMING_ASR_STABLE 個 partial
+# 解析出相同的關鍵字意圖即提前執行，不等 audio_end；0 = 串流結束後才轉錄
+STREAMING_ASR = os.getenv("STREAMING_ASR", "0") == "1"
+STREAMING_ASR_INTERVAL_S = float(os.getenv("STREAMING_ASR_INTERVAL_S", "0.8"))  # 每累積多少秒新音訊做一次 partial
+STREAMING_ASR_MIN_S = float(os.getenv("STREAMING_ASR_MIN_S", "1.0"))            # 第一個 partial 前的最短音訊（含 pre-roll）
+STREAMING_ASR_STABLE = int(os.getenv("STREAMING_ASR_STABLE", "2"))
+# 串流結束時最後一個 partial 若只差這麼多秒音訊，直接沿用其文字，不再做完整轉錄
+STREAMING_ASR_TAIL_S = float(os.getenv("STREAMING_ASR_TAIL_S", "0.3"))
+# 關鍵字無法直接採用的 partial，若與前一個 partial 相同（說完了、只剩尾音），先以其文字啟動 LLM
+# 意圖解析；最終轉錄相同即沿用結果，不同則取消。0 = 串流結束後才呼叫 LLM
+STREAMING_SPECULATE = os.getenv("STREAMING_SPECULATE", "0") == "1"
+STREAMING_SPECULATE_MIN_CHARS = int(os.getenv("STREAMING_SPECULATE_MIN_CHARS", "2"))
+
+# 裝置 health 報告：Task stack 歷史最低剩餘低於此值（bytes）時記錄警告
+EDGE_STACK_WARN_BYTES = int(os.getenv("EDGE_STACK_WARN_BYTES", "512"))
 
 # --- MQTT Configuration ---
 MQTT_BROKER = os.getenv("MQTT_BROKER", "192.168.1.16")
 MQTT_PORT = int(os.getenv("MQTT_PORT", 1883))
 MQTT_TOPIC = os.getenv("MQTT_TOPIC", "home/generic/command")
 MQTT_DISCOVERY_TOPIC = "home/discovery"
+# discovery 合併：DISCOVERY_DEBOUNCE_S 內無新訊息才套用整批（0 = 逐則立即套用），
+# 持續湧入時最多延遲 DISCOVERY_DEBOUNCE_MAX_S
+DISCOVERY_DEBOUNCE_S = float(os.getenv("DISCOVERY_DEBOUNCE_S", "0.2"))
+DISCOVERY_DEBOUNCE_MAX_S = float(os.getenv("DISCOVERY_DEBOUNCE_MAX_S", "1.0"))
+# 裝置表快照：每次發佈後寫入，啟動時於 MQTT 連線前載入，重啟後不必等每個裝置重送 discovery；
+# 之後到達的 discovery 照常覆蓋。空白 = 不保存
+DEVICE_REGISTRY_PATH = os.getenv("DEVICE_REGISTRY_PATH", "device_registry.json")
 MQTT_AUTH_USER = os.getenv("MQTT_AUTH_USER")
 MQTT_AUTH_PASSWORD = os.getenv("MQTT_AUTH_PASSWORD")
+# 指令以 QoS 1 發佈並等待 broker PUBACK；曾回報 home/<id>/state 的裝置另等待其 state 回報確認動作，
+# 逾時未確認才重送（最多 MQTT_DISPATCH_RETRIES 次）
+MQTT_QOS = int(os.getenv("MQTT_QOS", "1"))
+MQTT_ACK_TIMEOUT_S = float(os.getenv("MQTT_ACK_TIMEOUT_S", "1.0"))
+MQTT_STATE_TIMEOUT_S = float(os.getenv("MQTT_STATE_TIMEOUT_S", "1.0"))
+MQTT_DISPATCH_RETRIES = int(os.getenv("MQTT_DISPATCH_RETRIES", "1"))
+
+# --- Cluster（多台 Server 共用同一個 broker）---
+# CLUSTER_NODE_ID 非空即啟用：各節點以 retained 訊息發佈自身負載（<CLUSTER_TOPIC>/nodes/<id>）
+# 與裝置表（<CLUSTER_TOPIC>/registry），並依負載排序下發給裝置的端點清單（server_list）。
+# CLUSTER_WS_URL = 裝置連到本節點的位址（ws://ip:port，不含 /ws/<device_id>）；
+# CLUSTER_CAPACITY = 本節點可承載的裝置數（依 ASR 能力，x86 可設得比 RPi 大）；
+# 其他節點的利用率低於本節點超過 CLUSTER_REBALANCE_MARGIN 才把裝置導走，每個發佈週期最多導走一台
+CLUSTER_NODE_ID = os.getenv("CLUSTER_NODE_ID", "")
+CLUSTER_WS_URL = os.getenv("CLUSTER_WS_URL", "")
+CLUSTER_TOPIC = os.getenv("CLUSTER_TOPIC", "esp-miao/cluster")
+CLUSTER_CAPACITY = int(os.getenv("CLUSTER_CAPACITY", "8"))
+CLUSTER_PUBLISH_S = float(os.getenv("CLUSTER_PUBLISH_S", "10"))
+CLUSTER_STALE_S = float(os.getenv("CLUSTER_STALE_S", "35"))
+CLUSTER_REBALANCE_MARGIN = float(os.getenv("CLUSTER_REBALANCE_MARGIN", "0.25"))
+# 韌體 WS_MAX_ENDPOINTS
+CLUSTER_MAX_ENDPOINTS = 3
+
+# --- LLM Intent Parsing ---
+LLM_MODEL = os.getenv("LLM_MODEL", "qwen2.5:0.5b")
+# 單次意圖解析上限（秒），逾時改用關鍵字結果
+LLM_TIMEOUT_S = float(os.getenv("LLM_TIMEOUT_S", "3.0"))
+LLM_MAX_TOKENS = int(os.getenv("LLM_MAX_TOKENS", "64"))  # 一行 JSON 足夠，限制生成長度
+# 以 Ollama format（JSON schema）限制輸出：target 只能是目前的裝置、value 只能是 on / off，
+# 模型無法輸出多餘文字或格式錯誤的 JSON；需 Ollama ≥ 0.5。0 = 自由生成後以正規式擷取
+LLM_JSON_SCHEMA = os.getenv("LLM_JSON_SCHEMA", "1") == "1"
+LLM_SCHEMA_MAX_TOKENS = int(os.getenv("LLM_SCHEMA_MAX_TOKENS", "32"))  # 受限輸出約 20 token
+# 預熱時要求 Ollama 保留模型的時間（Ollama keep_alive 格式，e.g. "30m"、"-1" = 永久）
+LLM_KEEP_ALIVE = os.getenv("LLM_KEEP_ALIVE", "30m")
+
+# --- Speculative Warm-up ---
+# 裝置 VAD 偵測到持續語音（喚醒詞尚未觸發）時送出 link_warmup：Server 預先載入 Whisper、要求 Ollama 載入模型。
+# 兩次預熱的最短間隔（秒），期間的 link_warmup 只記錄；0 = 不預熱
+PREWARM_MIN_INTERVAL_S = float(os.getenv("PREWARM_MIN_INTERVAL_S", "60"))
+
+# --- Intent Cache ---
+# 以正規化後的轉錄文字快取最終意圖（LRU + TTL），裝置別名 / 關鍵字變更時整批失效；0 = 停用
+INTENT_CACHE_SIZE = int(os.getenv("INTENT_CACHE_SIZE", "128"))
+INTENT_CACHE_TTL_S = float(os.getenv("INTENT_CACHE_TTL_S", "3600"))
+# 正規化時折疊的常見 ASR 誤字（Whisper 常輸出簡體或同音字）
+INTENT_HOMOPHONES = {
+    "开": "開", "关": "關", "灯": "燈", "电": "電", "风": "風", "帮": "幫",
+    "机": "機", "扫": "掃", "启": "啟", "闭": "閉", "气": "氣", "登": "燈",
+}
+# 句尾語助詞（正規化時移除）
+INTENT_TRAILING_PARTICLES = "吧啊呀啦喔哦嘛囉"
+# 關鍵字比對找不到目標或動作時，改以不分聲調的拼音再比對一次（同音 / 近音字），減少落到 LLM 的次數；
+# 3 個音節以上的別名 / 關鍵字允許 KEYWORD_PINYIN_MAX_EDITS 個音節差一個字母。0 = 只比對原字
+KEYWORD_PINYIN = os.getenv("KEYWORD_PINYIN", "1") == "1"
+KEYWORD_PINYIN_MAX_EDITS = int(os.getenv("KEYWORD_PINYIN_MAX_EDITS", "1"))
+
+# --- Intent Embedding Index (intent_index.py) ---
+# 關鍵字沒命中時，先以 Ollama 嵌入模型比對「別名 × 動作關鍵字」產生的指令範例，
+# 相似度夠高即直接採用，只有新說法才呼叫 LLM；範例隨裝置表（Discovery）重建。0 = 停用
+INTENT_INDEX = os.getenv("INTENT_INDEX", "0") == "1"
+INTENT_EMBED_MODEL = os.getenv("INTENT_EMBED_MODEL", "paraphrase-multilingual")
+INTENT_INDEX_MIN_SIMILARITY = float(os.getenv("INTENT_INDEX_MIN_SIMILARITY", "0.85"))  # 餘弦相似度
+INTENT_INDEX_MARGIN = float(os.getenv("INTENT_INDEX_MARGIN", "0.03"))  # 與最像的「不同意圖」範例的差距
+INTENT_INDEX_MAX_EXEMPLARS = int(os.getenv("INTENT_INDEX_MAX_EXEMPLARS", "2000"))
 
 # --- LLM Intent Parsing Keywords ---
 # @deprecated: Global ACTION_KEYWORDS will be replaced by per-device keywords from discovery.
@@ -1,97 +1,411 @@
 import logging
 import json
 import asyncio
+import os
+import struct
+import threading
+import time
 import paho.mqtt.client as mqtt
-from typing import Optional
+from dataclasses import dataclass, field
+from pathlib import Path
+from types import MappingProxyType
+from typing import Any, Awaitable, Callable, Mapping, Optional, Union
 from fastapi import WebSocket
-from .models import Device, DeviceTable, ActionValidator
+from .models import Device, DeviceTable, ActionValidator, HeartbeatPayload
+from .codec import decode_ima_adpcm_block, conceal_loss, CONCEAL_PERIOD_SAMPLES
+from .wire import CONTROL_SUBPROTOCOL, encode_control
+from .metrics.stream_arrival import StreamArrival
+from .matcher import AhoCorasick, PinyinMatcher
 from .config import (
     MQTT_BROKER, MQTT_PORT, MQTT_TOPIC, MQTT_DISCOVERY_TOPIC,
-    MQTT_AUTH_USER, MQTT_AUTH_PASSWORD, TIMEOUT_SECONDS, ACTION_KEYWORDS
+    MQTT_AUTH_USER, MQTT_AUTH_PASSWORD, TIMEOUT_SECONDS, ACTION_KEYWORDS,
+    STREAM_RESUME_TIMEOUT, STREAM_BUFFER_POOL, WAKE_DEDUP_WINDOW_S, CONTROL_BINARY,
+    DISCOVERY_DEBOUNCE_S, DISCOVERY_DEBOUNCE_MAX_S, REQUEST_QUEUE_MAX,
+    KEYWORD_PINYIN, KEYWORD_PINYIN_MAX_EDITS,
 )
 
 logger = logging.getLogger("esp-miao.connection")
 
 # --- Device & Discovery Support ---
+@dataclass(frozen=True)
+class DeviceTableSnapshot:
+    """裝置表某一版本的唯讀快照。
+
+    請求處理端取得參照後直接讀取、不加鎖；寫入端（MQTT 執行緒）每次變更另建一份並整個替換，
+    已發佈的快照與其中的 Device 物件不再修改。
+    """
+    devices: Mapping[str, Device]
+    device_list: tuple[Device, ...]
+    aliases: Mapping[str, str]                      # alias -> device_name
+    groups: Mapping[str, tuple[str, ...]]           # group alias -> 成員裝置（依註冊順序）
+    action_keywords: Mapping[str, dict[str, list[str]]]
+    matcher: AhoCorasick
+    pinyin_matcher: PinyinMatcher    # 與 matcher 相同的模式與值，以拼音比對（KEYWORD_PINYIN=0 時為空）
+    vocab_version: int
+
+
 class DynamicDeviceTable:
-    def __init__(self, devices: list[Device] = None):
-        self._devices: dict[str, Device] = {d.name: d for d in (devices or [])}
-        self._aliases: dict[str, str] = {} # alias -> device_name
-        self._action_keyword_map: dict[str, dict[str, list[str]]] = {} # device_name -> {on: [], off: []}
-        self._update_aliases()
-
-    def _update_aliases(self):
-        """Rebuild alias map from current devices."""
-        self._aliases = {}
-        # Add dynamic aliases from discovered devices
+    """名稱 / 別名索引隨 discovery 增量維護，讀取端只看已發佈的 DeviceTableSnapshot。
+
+    submit_discovery() 把 debounce_s 內陸續到達的 discovery 合併成一批（同一裝置只取最新一則，
+    持續湧入時最多延遲 debounce_max_s），停電復電後大量裝置同時重開機也只重建一次關鍵字自動機；
+    update_device() 立即套用。
+    load_registry() 之後每次發佈都把裝置表寫回同一檔案（含別名、關鍵字與上線狀態），
+    Server 重啟時先載入即可使用，不必等每個裝置重送 discovery。
+    """
+
+    REGISTRY_FORMAT = 1
+
+    def __init__(self, devices: list[Device] = None, debounce_s: float = DISCOVERY_DEBOUNCE_S,
+                 debounce_max_s: float = DISCOVERY_DEBOUNCE_MAX_S):
+        self._lock = threading.Lock()   # 寫入端狀態；讀取端不使用
+        self._devices: dict[str, Device] = {}
+        self._alias_owners: dict[str, list[str]] = {}   # alias -> 列出此別名的裝置（後註冊者優先）
+        self._aliases: dict[str, str] = {}
+        self._action_keyword_map: dict[str, dict[str, list[str]]] = {}  # device_name -> {on: [], off: []}
+        self.debounce_s = debounce_s
+        self.debounce_max_s = max(debounce_s, debounce_max_s)
+        self._pending: dict[str, dict] = {}
+        self._pending_since: Optional[float] = None
+        self._last_discovery = 0.0
+        self._timer: Optional[threading.Timer] = None
+        self.discovery_messages = 0
+        self.discovery_batches = 0
+        self.unchanged = 0      # 內容與現有登記相同而略過的 discovery
+        self.publishes = 0
+        self.registry_path: Optional[Path] = None
+        self.restored: set[str] = set()   # 由快照載入、尚未收到 discovery 確認的裝置
+        self.registry_saves = 0
+        # 每次發佈後以新快照呼叫（持有 _lock，於寫入端執行緒）：叢集模式轉發給其他節點
+        self.publish_listeners: list[Callable[[DeviceTableSnapshot], None]] = []
+        self._current = DeviceTableSnapshot(
+            MappingProxyType({}), (), MappingProxyType({}), MappingProxyType({}), MappingProxyType({}),
+            AhoCorasick(), PinyinMatcher(), 0,
+        )
+        with self._lock:
+            for dev in devices or []:
+                self._put_device(dev, None)
+            self._publish(vocab_changed=True)
+
+    # --- 寫入端（持有 _lock） ---
+
+    def _index_aliases(self, name: str, old: list[str], new: list[str]) -> bool:
+        """增量更新別名索引；回傳別名是否有變。"""
+        old_set = {a.lower() for a in old}
+        new_set = {a.lower() for a in new}
+        for alias in old_set - new_set:
+            owners = self._alias_owners[alias]
+            owners.remove(name)
+            if owners:
+                self._aliases[alias] = owners[-1]
+            else:
+                del self._alias_owners[alias]
+                del self._aliases[alias]
+        for alias in sorted(new_set - old_set):
+            self._alias_owners.setdefault(alias, []).append(name)
+            self._aliases[alias] = name
+        return old_set != new_set
+
+    def _put_device(self, dev: Device, action_kws: Optional[dict]) -> Optional[bool]:
+        """登記或更新一個裝置；None = 與現有內容相同，否則回傳詞彙（裝置名 / 別名 / 關鍵字）是否變更。"""
+        old = self._devices.get(dev.name)
+        if old == dev and (not action_kws or self._action_keyword_map.get(dev.name) == action_kws):
+            return None
+        self._devices[dev.name] = dev
+        vocab_changed = self._index_aliases(dev.name, old.aliases if old else [], dev.aliases or [])
+        vocab_changed |= old is None or old.groups != dev.groups
+        if action_kws and self._action_keyword_map.get(dev.name) != action_kws:
+            self._action_keyword_map[dev.name] = action_kws
+            vocab_changed = True
+            logger.info(f"Custom action keywords registered for {dev.name}")
+        return vocab_changed
+
+    def _publish(self, vocab_changed: bool):
+        previous = self._current
+        if vocab_changed:
+            aliases = MappingProxyType(dict(self._aliases))
+            groups = MappingProxyType(self._index_groups())
+            action_keywords = MappingProxyType(dict(self._action_keyword_map))
+            matcher, pinyin_matcher = self._build_matchers()
+            vocab_version = previous.vocab_version + 1
+        else:
+            aliases, groups, action_keywords = previous.aliases, previous.groups, previous.action_keywords
+            matcher, pinyin_matcher = previous.matcher, previous.pinyin_matcher
+            vocab_version = previous.vocab_version
+        # 單一參照替換：讀取端看到的永遠是完整的舊版或新版
+        self._current = DeviceTableSnapshot(
+            MappingProxyType(dict(self._devices)), tuple(self._devices.values()),
+            aliases, groups, action_keywords, matcher, pinyin_matcher, vocab_version,
+        )
+        self.publishes += 1
+        if self.registry_path is not None:
+            self._save_registry(self._current)
+        for listener in self.publish_listeners:
+            listener(self._current)
+
+    def registry_data(self, snapshot: DeviceTableSnapshot) -> dict:
+        """裝置表快照的保存格式（檔案與叢集共用）。"""
+        return {
+            "format": self.REGISTRY_FORMAT,
+            "vocab_version": snapshot.vocab_version,
+            "saved_at": int(time.time()),
+            "devices": [
+                dict(dev.model_dump(), action_keywords=self._action_keyword_map.get(dev.name))
+                for dev in snapshot.device_list
+            ],
+        }
+
+    def _save_registry(self, snapshot: DeviceTableSnapshot):
+        """寫入暫存檔再原子替換：寫到一半斷電時仍保留上一版快照。"""
+        data = self.registry_data(snapshot)
+        tmp = self.registry_path.with_name(self.registry_path.name + ".tmp")
+        try:
+            tmp.write_text(json.dumps(data, ensure_ascii=False), encoding="utf-8")
+            os.replace(tmp, self.registry_path)
+            self.registry_saves += 1
+        except OSError as e:
+            logger.warning(f"Device registry not saved to {self.registry_path}: {e}")
+
+    def _index_groups(self) -> dict[str, tuple[str, ...]]:
+        """群組別名（「所有燈」）-> 成員裝置；與裝置別名不同，同一群組可有多個裝置。"""
+        groups: dict[str, list[str]] = {}
         for dev in self._devices.values():
-            if dev.aliases:
-                for alias in dev.aliases:
-                    self._aliases[alias.lower()] = dev.name
-
-    def update_device(self, dev_info: dict):
-        """Register or update a device from MQTT discovery."""
+            for group in {g.lower() for g in dev.groups}:
+                groups.setdefault(group, []).append(dev.name)
+        return {group: tuple(members) for group, members in groups.items()}
+
+    def _build_matchers(self) -> tuple[AhoCorasick, PinyinMatcher]:
+        """別名與所有關鍵字表編入同一個自動機，一次掃描即可取得目標與動作候選；拼音 trie 登記相同內容。
+
+        值：("target", device_name)、("group", group_alias) 或 ("action", owner, action_value)，
+        owner 為 None 表示全域關鍵字。模式與待比對文字同樣去空白、轉小寫。
+        """
+        matcher = AhoCorasick()
+        pinyin = PinyinMatcher(KEYWORD_PINYIN_MAX_EDITS)
+        patterns = [(alias.replace(" ", ""), ("target", device_name)) for alias, device_name in self._aliases.items()]
+        patterns += [(group.replace(" ", ""), ("group", group)) for group in self._index_groups()]
+        keyword_maps = [(None, ACTION_KEYWORDS)] + list(self._action_keyword_map.items())
+        for owner, keywords in keyword_maps:
+            for action_value, words in keywords.items():
+                for word in words:
+                    patterns.append((word.replace(" ", "").lower(), ("action", owner, action_value)))
+        for pattern, value in patterns:
+            matcher.add(pattern, value)
+            if KEYWORD_PINYIN:
+                pinyin.add(pattern, value)
+        matcher.build()
+        return matcher, pinyin
+
+    @staticmethod
+    def _device_from_discovery(dev_info: dict) -> Optional[Device]:
         name = dev_info.get("name") or dev_info.get("device_id")
         if not name:
             logger.warning("Received discovery payload without name/device_id")
-            return
-        
-        dev_type = dev_info.get("type") or dev_info.get("device_type", "unknown")
-        action_kws = dev_info.get("action_keywords")
-        
-        new_dev = Device(
+            return None
+        return Device(
             name=name,
-            type=dev_type,
+            type=dev_info.get("type") or dev_info.get("device_type", "unknown"),
             gpio=dev_info.get("gpio"),
             aliases=dev_info.get("aliases", []),
+            groups=dev_info.get("groups", []),
             control_topic=dev_info.get("control_topic", MQTT_TOPIC),
             commands=dev_info.get("commands", {"on": "ON", "off": "OFF"}),
-            action_keywords=action_kws
+            action_keywords=dev_info.get("action_keywords"),
         )
-        self._devices[name] = new_dev
-        
-        # Update action keyword map if provided
-        if action_kws:
-            self._action_keyword_map[name] = action_kws
-            logger.info(f"Custom action keywords registered for {name}")
 
-        self._update_aliases()
-        logger.info(f"Device registered/updated: {name} ({new_dev.type})")
+    def _apply_discovery(self, payloads) -> int:
+        """套用一批 discovery 並發佈一次；回傳實際變更的裝置數。"""
+        changed, vocab_changed = 0, False
+        with self._lock:
+            for dev_info in payloads:
+                new_dev = self._device_from_discovery(dev_info)
+                if new_dev is None:
+                    continue
+                self.restored.discard(new_dev.name)
+                result = self._put_device(new_dev, dev_info.get("action_keywords"))
+                if result is None:
+                    self.unchanged += 1
+                    continue
+                changed += 1
+                vocab_changed |= result
+                logger.info(f"Device registered/updated: {new_dev.name} ({new_dev.type})")
+            if changed:
+                self._publish(vocab_changed)
+        return changed
+
+    # --- 寫入 API ---
+
+    def load_registry(self, path: Union[str, Path]) -> int:
+        """載入裝置表快照並從此保存到該檔案；回傳載入的裝置數（檔案不存在或格式不符為 0）。
+
+        須在 MQTT 連線前呼叫：之後到達的 discovery 照常覆蓋快照內容。
+        """
+        self.registry_path = Path(path)
+        try:
+            data = json.loads(self.registry_path.read_text(encoding="utf-8"))
+        except FileNotFoundError:
+            return 0
+        except (OSError, ValueError) as e:
+            logger.warning(f"Device registry {path} unreadable, starting empty: {e}")
+            return 0
+        loaded = self.restore(data, str(path))
+        age = int(time.time()) - data.get("saved_at", 0)
+        logger.info(f"Device registry: restored {loaded} devices from {path} (saved {age}s ago)")
+        return loaded
+
+    def restore(self, data: dict, source: str) -> int:
+        """登記快照中本地尚未知道的裝置（已由 discovery 登記者較新，不覆蓋）；回傳新登記的裝置數。"""
+        if data.get("format") != self.REGISTRY_FORMAT:
+            logger.warning(f"Device registry from {source} has format {data.get('format')}, ignored")
+            return 0
+        loaded = 0
+        with self._lock:
+            for dev_info in data.get("devices", []):
+                try:
+                    dev = Device(**dev_info)
+                except Exception as e:
+                    logger.warning(f"Skipping registry entry {dev_info.get('name')}: {e}")
+                    continue
+                if dev.name in self._devices:
+                    continue   # 已由 discovery 登記，較新
+                self._put_device(dev, dev_info.get("action_keywords"))
+                self.restored.add(dev.name)
+                loaded += 1
+            if loaded:
+                self._publish(vocab_changed=True)
+        return loaded
+
+    def update_device(self, dev_info: dict):
+        """Register or update a device from MQTT discovery (applied immediately)."""
+        self._apply_discovery([dev_info])
+
+    def submit_discovery(self, dev_info: dict):
+        """MQTT discovery 入口：debounce 後批次套用（debounce_s <= 0 時立即套用）。"""
+        self.discovery_messages += 1
+        if self.debounce_s <= 0:
+            self.update_device(dev_info)
+            return
+        name = dev_info.get("name") or dev_info.get("device_id") or ""
+        with self._lock:
+            now = time.monotonic()
+            self._pending[name] = dev_info
+            self._last_discovery = now
+            if self._pending_since is None:
+                self._pending_since = now
+            if self._timer is None:
+                self._arm_flush(self.debounce_s)
+
+    def _arm_flush(self, delay: float):
+        self._timer = threading.Timer(max(0.0, delay), self._flush_when_quiet)
+        self._timer.daemon = True
+        self._timer.start()
+
+    def _flush_when_quiet(self):
+        with self._lock:
+            now = time.monotonic()
+            quiet_at = self._last_discovery + self.debounce_s
+            deadline = self._pending_since + self.debounce_max_s if self._pending_since is not None else now
+            if now < quiet_at and now < deadline:
+                # 仍在湧入：延到安靜下來（或達上限）為止；每批只有一個計時執行緒
+                self._arm_flush(min(quiet_at, deadline) - now)
+                return
+            self._timer = None
+        self.flush_discovery()
+
+    def flush_discovery(self) -> int:
+        """立即套用所有待處理的 discovery；回傳實際變更的裝置數。"""
+        with self._lock:
+            if self._timer is not None and self._timer is not threading.current_thread():
+                self._timer.cancel()
+            self._timer = None
+            pending, self._pending = list(self._pending.values()), {}
+            self._pending_since = None
+        if not pending:
+            return 0
+        self.discovery_batches += 1
+        return self._apply_discovery(pending)
 
     def set_device_status(self, name: str, is_online: bool):
         """Update device online/offline status without removing it."""
-        if name in self._devices:
-            self._devices[name].is_online = is_online
-            status_str = "online" if is_online else "offline"
-            logger.info(f"Device '{name}' status updated to {status_str}")
-        else:
-            logger.warning(f"set_device_status: '{name}' not found in table")
+        with self._lock:
+            device = self._devices.get(name)
+            if device is None:
+                logger.warning(f"set_device_status: '{name}' not found in table")
+                return
+            if device.is_online == is_online:
+                return
+            # 已發佈的 Device 不可修改：換成新物件再發佈
+            self._devices[name] = device.model_copy(update={"is_online": is_online})
+            self._publish(vocab_changed=False)
+        status_str = "online" if is_online else "offline"
+        logger.info(f"Device '{name}' status updated to {status_str}")
 
     def remove_device(self, name: str):
         """Remove device from table (e.g., on specific cleanup)."""
-        if name in self._devices:
-            del self._devices[name]
-            if name in self._action_keyword_map:
-                del self._action_keyword_map[name]
-            self._update_aliases()
-            logger.info(f"Device permanently removed: {name}")
-        else:
-            logger.warning(f"remove_device: '{name}' not found in table")
+        with self._lock:
+            device = self._devices.pop(name, None)
+            if device is None:
+                logger.warning(f"remove_device: '{name}' not found in table")
+                return
+            self._index_aliases(name, device.aliases or [], [])
+            self._action_keyword_map.pop(name, None)
+            self._publish(vocab_changed=True)
+        logger.info(f"Device permanently removed: {name}")
+
+    # --- 讀取 API（不加鎖，讀目前發佈的快照） ---
+
+    @property
+    def current(self) -> DeviceTableSnapshot:
+        return self._current
 
     def get_action_keywords(self, device_name: str) -> dict[str, list[str]]:
         """Get action keywords for device, fallback to global defaults."""
-        return self._action_keyword_map.get(device_name, ACTION_KEYWORDS)
+        return self._current.action_keywords.get(device_name, ACTION_KEYWORDS)
 
     @property
     def devices(self) -> list[Device]:
-        return list(self._devices.values())
+        return list(self._current.device_list)
+
+    @property
+    def alias_map(self) -> Mapping[str, str]:
+        return self._current.aliases
+
+    def group_members(self, group: str) -> tuple[str, ...]:
+        return self._current.groups.get(group, ())
+
+    @property
+    def keyword_matcher(self) -> AhoCorasick:
+        """別名 / 動作關鍵字自動機（詞彙變更時重建）。"""
+        return self._current.matcher
 
     @property
-    def alias_map(self) -> dict[str, str]:
-        return self._aliases
+    def pinyin_matcher(self) -> PinyinMatcher:
+        """同 keyword_matcher 的拼音版（同音 / 近音字）。"""
+        return self._current.pinyin_matcher
+
+    @property
+    def vocab_version(self) -> int:
+        """裝置 / 別名 / 關鍵字變更時遞增（意圖快取以此失效）。"""
+        return self._current.vocab_version
 
     def get_device(self, name: str) -> Optional[Device]:
-        return self._devices.get(name)
+        return self._current.devices.get(name)
+
+    def snapshot(self) -> dict:
+        current = self._current
+        return {
+            "devices": len(current.device_list),
+            "aliases": len(current.aliases),
+            "groups": len(current.groups),
+            "vocab_version": current.vocab_version,
+            "publishes": self.publishes,
+            "discovery_messages": self.discovery_messages,
+            "discovery_batches": self.discovery_batches,
+            "discovery_unchanged": self.unchanged,
+            "discovery_pending": len(self._pending),
+            "restored_unconfirmed": len(self.restored),
+            "registry_saves": self.registry_saves,
+        }
 
 # Initialize with an empty table (Discovery-first)
 device_table = DynamicDeviceTable()
@@ -101,6 +415,10 @@ action_validator = ActionValidator(device_table)
 
 # --- MQTT Setup ---
 mqtt_client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+# 裝置 state 回報（home/<id>/state）的監聽者：(device_id, state)，於 MQTT 網路執行緒呼叫
+state_listeners: list[Callable[[str, Any], None]] = []
+# 每次連上 broker 後呼叫（client）：額外的訂閱須在此重做
+connect_listeners: list[Callable[[Any], None]] = []
 
 if MQTT_AUTH_USER and MQTT_AUTH_PASSWORD:
     mqtt_client.username_pw_set(MQTT_AUTH_USER, MQTT_AUTH_PASSWORD)
@@ -110,7 +428,10 @@ def on_connect(client, userdata, flags, rc, properties):
         logger.info("Connected to MQTT Broker!")
         client.subscribe(MQTT_DISCOVERY_TOPIC)
         client.subscribe("home/+/status")
-        logger.info(f"Subscribed to discovery ({MQTT_DISCOVERY_TOPIC}) and status topics")
+        client.subscribe("home/+/state", qos=1)
+        logger.info(f"Subscribed to discovery ({MQTT_DISCOVERY_TOPIC}), status and state topics")
+        for listener in connect_listeners:
+            listener(client)
     else:
         logger.error(f"Failed to connect to MQTT Broker, return code {rc}")
 
@@ -121,7 +442,7 @@ def on_message(client, userdata, msg):
         if msg.topic == MQTT_DISCOVERY_TOPIC:
             payload = json.loads(msg.payload.decode())
             logger.info(f"Processing discovery payload: {payload}")
-            device_table.update_device(payload)
+            device_table.submit_discovery(payload)
         elif msg.topic.endswith("/status") or msg.topic.endswith("/state"):
             payload = json.loads(msg.payload.decode())
             logger.info(f"Processing {msg.topic.split('/')[-1]} payload: {payload}")
@@ -140,6 +461,8 @@ def on_message(client, userdata, msg):
             if "state" in payload:
                 device_table.set_device_status(device_id, True)
                 logger.debug(f"Device {device_id} reported functional state: {payload.get('state')}")
+                for listener in state_listeners:
+                    listener(device_id, payload.get("state"))
     except Exception as e:
         logger.warning(f"MQTT message processing error on topic {msg.topic}: {e}")
 
@@ -152,6 +475,304 @@ def on_log(client, userdata, level, buf):
 mqtt_client.on_log = on_log
 mqtt_client.on_message = on_message
 
+# --- Binary Stream Timing ---
+CHUNK_HEADER_FORMAT = "<IIq"  # seq, block_seq, capture_us（對應韌體 StreamChunkHeader）
+CHUNK_HEADER_SIZE = struct.calcsize(CHUNK_HEADER_FORMAT)
+# 可續傳標頭：再加上 session_id, sample_offset（chunk_header_bytes >= 24）
+CHUNK_HEADER_V2_FORMAT = "<IIqII"
+CHUNK_HEADER_V2_SIZE = struct.calcsize(CHUNK_HEADER_V2_FORMAT)
+
+
+@dataclass
+class StreamTiming:
+    """Per-stream chunk header bookkeeping (sequence gaps, capture timestamps, uplink codec)."""
+
+    header_bytes: int = 0
+    sample_rate: int = 16000
+    codec: str = "pcm"       # "pcm" 或 "ima_adpcm"（每個 frame 為一個獨立區塊）
+    epoch_ms: int = 0        # audio_start timestamp（裝置牆鐘）
+    timer_us: int = 0        # 與 epoch_ms 同一時刻的裝置 esp_timer
+    next_seq: int = 0
+    chunks: int = 0
+    dropped_chunks: int = 0
+    first_capture_us: Optional[int] = None
+    last_capture_end_us: Optional[int] = None
+    last_capture_us: Optional[int] = None   # 最近一個 frame 的擷取時間（到達抖動 / 停頓歸因用）
+    link: Optional[dict] = None  # audio_end 回報的裝置端鏈路統計
+    session_id: Optional[int] = None  # audio_start 的 session_id（可續傳串流）
+    received_samples: int = 0         # 已寫入緩衝的連續樣本數（續傳時回報給裝置）
+    duplicate_samples: int = 0        # 續傳重送、已去除的樣本數
+    lost_samples: int = 0             # 無法補回、以靜音（或遺失補償）填補的樣本數
+    resumes: int = 0
+    conceal: bool = False             # 遺失的樣本以 conceal_loss 延續前文（UDP 上行），否則補靜音
+    tail: bytes = b""                 # 最後寫入的一個補償週期（conceal 時）
+    trace_id: Optional[str] = None        # audio_start 的 trace_id（裝置於喚醒時產生）
+    device_trace: Optional[dict] = None   # audio_end 回報的裝置端階段時間（esp_timer 微秒）
+    first_rx_ms: Optional[float] = None   # Server 收到第一個 frame（牆鐘毫秒）
+    last_rx_ms: Optional[float] = None    # 串流結束（audio_end 或收滿）
+
+    def to_epoch_ms(self, capture_us: int) -> float:
+        """Convert a device esp_timer timestamp to device wall-clock milliseconds."""
+        return self.epoch_ms + (capture_us - self.timer_us) / 1000.0
+
+    def decode(self, payload: bytes) -> bytes:
+        """Decode one frame payload into 16-bit PCM."""
+        if self.codec == "ima_adpcm":
+            return decode_ima_adpcm_block(payload)
+        return payload
+
+    def consume(self, data: bytes) -> bytes:
+        """Strip and account for the chunk header, returning the decoded PCM payload."""
+        if self.first_rx_ms is None:
+            self.first_rx_ms = time.time() * 1000
+        self.last_capture_us = None
+        if self.header_bytes <= 0 or len(data) < self.header_bytes:
+            pcm = self.decode(data)
+            self.received_samples += len(pcm) // 2
+            return pcm
+        offset = None
+        if self.header_bytes >= CHUNK_HEADER_V2_SIZE:
+            seq, _block_seq, capture_us, session_id, offset = struct.unpack_from(
+                CHUNK_HEADER_V2_FORMAT, data
+            )
+            if self.session_id is not None and session_id != self.session_id:
+                logger.warning(f"Dropping frame of stale session {session_id:#x} (current {self.session_id:#x})")
+                return b""
+        else:
+            seq, _block_seq, capture_us = struct.unpack_from(CHUNK_HEADER_FORMAT, data)
+        pcm = self.decode(data[self.header_bytes:])
+
+        if seq != self.next_seq:
+            gap = seq - self.next_seq
+            if gap > 0:
+                self.dropped_chunks += gap
+            logger.warning(f"Chunk sequence gap: expected {self.next_seq}, got {seq}")
+        self.next_seq = seq + 1
+        self.chunks += 1
+
+        if capture_us > 0:
+            self.last_capture_us = capture_us
+            if self.first_capture_us is None:
+                self.first_capture_us = capture_us
+            samples = len(pcm) // 2
+            self.last_capture_end_us = capture_us + samples * 1_000_000 // self.sample_rate
+        if offset is not None:
+            pcm = self.place(offset, pcm)
+        self.received_samples += len(pcm) // 2
+        if self.conceal and pcm:
+            self.tail = (self.tail + pcm)[-CONCEAL_PERIOD_SAMPLES * 2:]
+        return pcm
+
+    def place(self, offset: int, pcm: bytes) -> bytes:
+        """Align a frame at sample_offset: trim resent overlap, fill samples that were lost."""
+        if offset < self.received_samples:
+            overlap = min(self.received_samples - offset, len(pcm) // 2)
+            self.duplicate_samples += overlap
+            return pcm[overlap * 2:]
+        if offset > self.received_samples:
+            gap = offset - self.received_samples
+            self.lost_samples += gap
+            logger.warning(f"Stream gap: {gap} samples missing before offset {offset}")
+            fill = conceal_loss(self.tail, gap) if self.conceal else bytes(gap * 2)
+            return fill + pcm
+        return pcm
+
+
+class AudioBufferPool:
+    """Reuse stream buffers across sessions instead of allocating one per audio_start."""
+
+    def __init__(self, max_free: int = STREAM_BUFFER_POOL):
+        self.max_free = max_free
+        self._free: list[bytearray] = []
+        self.allocated = 0
+        self.reused = 0
+
+    def acquire(self, capacity: int) -> bytearray:
+        """取容量足夠的最小閒置緩衝；沒有則新配置（內容未清除，由寫入長度界定有效範圍）。"""
+        fits = [b for b in self._free if len(b) >= capacity]
+        if fits:
+            buffer = min(fits, key=len)
+            self._free.remove(buffer)
+            self.reused += 1
+            return buffer
+        self.allocated += 1
+        return bytearray(capacity)
+
+    def release(self, buffer: bytearray):
+        if not buffer or len(self._free) >= self.max_free:
+            return
+        if any(b is buffer for b in self._free):
+            return
+        self._free.append(buffer)
+
+    def snapshot(self) -> dict:
+        return {"free": len(self._free), "allocated": self.allocated, "reused": self.reused}
+
+
+@dataclass
+class StreamSession:
+    """One device's audio stream: context from audio_start plus a preallocated PCM buffer."""
+
+    transfer_mode: str = "base64"
+    confidence: Optional[float] = None
+    expected_bytes: int = 0           # 0 = 由 audio_end / is_last 結束
+    audio_format: str = "pcm_16k_16bit"
+    timing: Optional[StreamTiming] = None
+    pool: Optional[AudioBufferPool] = field(default=None, repr=False)
+    buffer: bytearray = field(default_factory=bytearray, repr=False)
+    size: int = 0                     # 已寫入的位元組數
+    cancelled: bool = False           # Server 已取消（多節點去重），其後的音訊直接丟棄
+    followup: bool = False            # 追問視窗內的下一句（沒有喚醒詞，延續上一個動作）
+    preroll_bytes: int = 0            # 開頭的喚醒詞視窗長度（0 = 不做第二階段驗證）
+    arrival: Optional[StreamArrival] = field(default=None, repr=False)   # WebSocket binary 的到達時間統計
+    wake_check: Optional[asyncio.Task] = field(default=None, repr=False)   # 驗證結果：視窗特徵 / None
+
+    def __len__(self) -> int:
+        return self.size
+
+    def append(self, data: bytes):
+        """經 memoryview 寫入預配置緩衝；超出容量（端點偵測上限估計不足）時加倍。"""
+        if self.cancelled:
+            return
+        end = self.size + len(data)
+        if end > len(self.buffer):
+            grown = self._acquire(max(end, 2 * len(self.buffer)))
+            memoryview(grown)[:self.size] = memoryview(self.buffer)[:self.size]
+            self._release()
+            self.buffer = grown
+        memoryview(self.buffer)[self.size:end] = data
+        self.size = end
+
+    def audio(self) -> memoryview:
+        """已收音訊的唯讀檢視（不複製）；release() 之後不可再使用。"""
+        return memoryview(self.buffer)[:self.size].toreadonly()
+
+    def release(self):
+        """處理完畢：緩衝歸還 pool 供下一個串流重複使用。"""
+        self._release()
+        self.buffer = bytearray()
+        self.size = 0
+
+    def _acquire(self, capacity: int) -> bytearray:
+        return self.pool.acquire(capacity) if self.pool is not None else bytearray(capacity)
+
+    def _release(self):
+        if self.pool is not None:
+            self.pool.release(self.buffer)
+
+
+class RequestWorker:
+    """One connection's request processing, off the WebSocket reader.
+
+    讀取迴圈只排入 command / fallback / audio_request，由此 Task 依序處理並回覆；
+    處理 ASR / LLM 期間 ping、audio_start 與音訊 frame 照常讀取。
+    佇列滿（REQUEST_QUEUE_MAX）時新請求丟棄；新的 audio_start 中止處理中的請求；斷線時全部取消。
+    """
+
+    dropped = 0      # 全部連線合計（GET / 回報）
+    cancelled = 0
+
+    def __init__(self, device_id: str, send: Callable[[str, dict], Awaitable[bool]],
+                 maxsize: int = REQUEST_QUEUE_MAX):
+        self.device_id = device_id
+        self.send = send
+        self.queue: asyncio.Queue = asyncio.Queue(maxsize=max(1, maxsize))
+        self.current: Optional[asyncio.Task] = None
+        self.closed = False
+        self.task = asyncio.create_task(self._run())
+
+    def submit(self, handler, data: dict) -> bool:
+        """排入一個請求（不等待）；佇列已滿回傳 False。"""
+        try:
+            self.queue.put_nowait((handler, data))
+            return True
+        except asyncio.QueueFull:
+            RequestWorker.dropped += 1
+            logger.warning(f"Request queue of {self.device_id} full, dropped {data.get('type')}")
+            return False
+
+    def cancel_current(self, reason: str) -> bool:
+        """中止處理中的請求（其回覆不會送出），佇列中的照常處理。"""
+        if self.current is None or self.current.done():
+            return False
+        self.current.cancel()
+        RequestWorker.cancelled += 1
+        logger.info(f"Cancelled {self.device_id}'s in-flight request: {reason}")
+        return True
+
+    def close(self):
+        self.closed = True
+        self.task.cancel()
+
+    async def _run(self):
+        while True:
+            handler, data = await self.queue.get()
+            self.current = asyncio.create_task(handler(self.device_id, data))
+            try:
+                response = await self.current
+            except asyncio.CancelledError:
+                if self.closed:
+                    self.current.cancel()
+                    raise
+                continue
+            finally:
+                self.current = None
+            if response and not await self.send(self.device_id, response):
+                logger.warning(f"Reply to {self.device_id}'s {data.get('type')} not delivered")
+
+
+@dataclass
+class SuspendedStream:
+    """Binary stream state kept across a WebSocket drop, waiting for audio_resume."""
+
+    session: StreamSession
+    suspended_at: float
+
+
+class WakeArbiter:
+    """Group audio_start events of several nodes hearing the same wake word; keep the best stream.
+
+    window_s 內先後到達的 audio_start 為同一組，喚醒信心最高者勝出（相同時先到者），
+    其餘裝置應取消；落選的前任勝出者也會被取消。
+    """
+
+    def __init__(self, window_s: float = WAKE_DEDUP_WINDOW_S):
+        self.window_s = window_s
+        self._opened = float("-inf")
+        self._winner: Optional[str] = None
+        self._best = 0.0
+        self.groups = 0
+        self.cancelled = 0
+
+    def register(self, device_id: str, confidence: Optional[float],
+                 now: Optional[float] = None) -> list[str]:
+        """登記一個 audio_start，回傳應取消串流的裝置。"""
+        if self.window_s <= 0:
+            return []
+        now = time.monotonic() if now is None else now
+        score = confidence or 0.0
+        if self._winner is None or now - self._opened > self.window_s:
+            self._opened = now
+            self.groups += 1
+            self._winner, self._best = device_id, score
+            return []
+        if self._winner == device_id:           # 同一裝置重新開始串流
+            self._best = score
+            return []
+        self.cancelled += 1
+        if score > self._best:
+            loser, self._winner, self._best = self._winner, device_id, score
+            return [loser]
+        return [device_id]
+
+    @property
+    def winner(self) -> Optional[str]:
+        return self._winner
+
+    def snapshot(self) -> dict:
+        return {"window_s": self.window_s, "groups": self.groups, "cancelled": self.cancelled}
+
+
 # --- Connection Manager (WebSocket) ---
 class ConnectionManager:
     """Manage active WebSocket connections with timeout support."""
@@ -159,71 +780,185 @@ class ConnectionManager:
     def __init__(self):
         self.active_connections: dict[str, WebSocket] = {}
         self.pending_responses: dict[str, asyncio.Future] = {}
-        self.audio_buffers: dict[str, bytearray] = {}  # Store chunked audio per device
-        self.session_confidence: dict[str, float] = {}  # Store confidence per session
-        self.transfer_modes: dict[str, str] = {}  # "base64" or "binary"
-        self.expected_bytes: dict[str, int] = {}  # Expected total bytes for binary mode
+        self.sessions: dict[str, StreamSession] = {}  # Current audio stream per device
+        self.buffer_pool = AudioBufferPool()
+        self.wake_arbiter = WakeArbiter()
+        self.suspended_streams: dict[str, SuspendedStream] = {}  # Interrupted resumable streams
+        self.link_health: dict[str, HeartbeatPayload] = {}  # Last heartbeat per device (kept across reconnects)
+        self.binary_control: set[str] = set()  # Devices that negotiated binary control frames
 
     async def connect(self, device_id: str, websocket: WebSocket):
-        await websocket.accept()
+        # 裝置提供 CONTROL_SUBPROTOCOL 才改送 binary 控制 frame；舊韌體不帶 subprotocol，照常 JSON
+        binary = CONTROL_BINARY and CONTROL_SUBPROTOCOL in websocket.scope.get("subprotocols", [])
+        await websocket.accept(subprotocol=CONTROL_SUBPROTOCOL if binary else None)
         self.active_connections[device_id] = websocket
-        self.audio_buffers[device_id] = bytearray()
-        logger.info(f"Device connected: {device_id}")
+        if binary:
+            self.binary_control.add(device_id)
+        else:
+            self.binary_control.discard(device_id)
+        logger.info(f"Device connected: {device_id} ({'binary' if binary else 'json'} control)")
+
+    def disconnect(self, device_id: str, websocket: Optional[WebSocket] = None) -> bool:
+        """Tear down the device's link state; returns False when websocket is no longer its connection.
 
-    def disconnect(self, device_id: str):
+        A device can reconnect before its old socket is detected as dead: the stale reader must
+        not remove the new socket, its negotiated control format or the stream it just resumed.
+        """
+        if websocket is not None and self.active_connections.get(device_id) is not websocket:
+            return False
         if device_id in self.active_connections:
             del self.active_connections[device_id]
             logger.info(f"Device disconnected: {device_id}")
-        if device_id in self.audio_buffers:
-            del self.audio_buffers[device_id]
-        if device_id in self.session_confidence:
-            del self.session_confidence[device_id]
-        if device_id in self.transfer_modes:
-            del self.transfer_modes[device_id]
-        if device_id in self.expected_bytes:
-            del self.expected_bytes[device_id]
+        self.binary_control.discard(device_id)
+        session = self.sessions.pop(device_id, None)
+        if session is not None and not self._suspend_stream(device_id, session):
+            session.release()
         # Cancel any pending futures
         if device_id in self.pending_responses:
             self.pending_responses[device_id].cancel()
             del self.pending_responses[device_id]
+        return True
+
+    def _suspend_stream(self, device_id: str, session: StreamSession) -> bool:
+        """Keep an in-progress resumable stream so a reconnecting device can continue it."""
+        timing = session.timing
+        if timing is None or timing.session_id is None or session.transfer_mode != "binary":
+            return False
+        self._drop_suspended(device_id)
+        self.suspended_streams[device_id] = SuspendedStream(session=session, suspended_at=time.monotonic())
+        logger.info(
+            f"Suspended stream {timing.session_id:#x} of {device_id} "
+            f"at {timing.received_samples} samples"
+        )
+        return True
+
+    def _drop_suspended(self, device_id: str):
+        suspended = self.suspended_streams.pop(device_id, None)
+        if suspended is not None:
+            suspended.session.release()
+
+    def resume_stream(self, device_id: str, session_id: int, seq: int = 0) -> Optional[StreamTiming]:
+        """Restore a suspended stream; returns its timing state or None if it cannot be resumed."""
+        suspended = self.suspended_streams.get(device_id)
+        if suspended is None:
+            # 舊連線尚未被偵測中斷時，串流狀態仍在使用中
+            live = self.sessions.get(device_id)
+            if live is not None and live.timing is not None and live.timing.session_id == session_id:
+                live.timing.next_seq = seq
+                live.timing.resumes += 1
+                return live.timing
+            return None
+        if suspended.session.timing.session_id != session_id:
+            self._drop_suspended(device_id)
+            return None
+        if time.monotonic() - suspended.suspended_at > STREAM_RESUME_TIMEOUT:
+            logger.warning(f"Stream {session_id:#x} of {device_id} expired before resume")
+            self._drop_suspended(device_id)
+            return None
 
-    def clear_audio_buffer(self, device_id: str, confidence: Optional[float] = None, 
-                           transfer_mode: str = "base64", total_samples: int = 0):
-        """Clear the audio buffer for a device and set session context."""
-        if device_id in self.audio_buffers:
-            self.audio_buffers[device_id] = bytearray()
-        
-        if confidence is not None:
-            self.session_confidence[device_id] = confidence
-        else:
-            self.session_confidence.pop(device_id, None)
+        del self.suspended_streams[device_id]
+        session = suspended.session
+        session.timing.next_seq = seq
+        session.timing.resumes += 1
+        previous = self.sessions.get(device_id)
+        if previous is not None and previous is not session:
+            previous.release()
+        self.sessions[device_id] = session
+        return session.timing
+
+    def record_heartbeat(self, device_id: str, stats: HeartbeatPayload) -> int:
+        """Store the latest link stats; return reconnects new since the previous heartbeat."""
+        previous = self.link_health.get(device_id)
+        self.link_health[device_id] = stats
+        if previous is None or stats.reconnects < previous.reconnects:
+            return 0  # first heartbeat, or the device rebooted and reset its counters
+        return stats.reconnects - previous.reconnects
+
+    def start_session(self, device_id: str, confidence: Optional[float] = None,
+                      transfer_mode: str = "base64", total_samples: int = 0,
+                      audio_format: str = "pcm_16k_16bit",
+                      timing: Optional[StreamTiming] = None,
+                      bounded: bool = True, followup: bool = False) -> StreamSession:
+        """Begin a new stream; the buffer is sized from total_samples (an upper bound if not bounded)."""
+        self._drop_suspended(device_id)
+        previous = self.sessions.pop(device_id, None)
+        if previous is not None:
+            previous.release()
+        capacity = total_samples * 2  # 16-bit = 2 bytes per sample
+        session = StreamSession(
+            transfer_mode=transfer_mode,
+            confidence=confidence,
+            expected_bytes=capacity if bounded else 0,
+            audio_format=audio_format,
+            timing=timing,
+            followup=followup,
+            pool=self.buffer_pool,
+            buffer=self.buffer_pool.acquire(capacity) if capacity > 0 else bytearray(),
+        )
+        self.sessions[device_id] = session
+        logger.debug(
+            f"Started stream for {device_id}, mode: {transfer_mode}, "
+            f"capacity: {capacity}, expected: {session.expected_bytes}"
+        )
+        return session
 
-        self.transfer_modes[device_id] = transfer_mode
-        self.expected_bytes[device_id] = total_samples * 2  # 16-bit = 2 bytes per sample
-            
-        logger.debug(f"Cleared audio buffer for {device_id}, mode: {transfer_mode}, expected: {self.expected_bytes[device_id]}")
+    def end_session(self, device_id: str) -> Optional[StreamSession]:
+        """Detach the stream; the caller reads session.audio() and calls release() when done."""
+        return self.sessions.pop(device_id, None)
+
+    def cancel_session(self, device_id: str) -> Optional[StreamSession]:
+        """Drop the audio but keep the session so chunks still in flight are ignored."""
+        session = self.sessions.get(device_id)
+        if session is not None:
+            session.release()
+            session.cancelled = True
+        return session
+
+    def discard_session(self, device_id: str):
+        session = self.sessions.pop(device_id, None)
+        if session is not None:
+            session.release()
 
     def append_audio_data(self, device_id: str, data: bytes):
-        """Append data to the audio buffer for a device."""
-        if device_id not in self.audio_buffers:
-            self.audio_buffers[device_id] = bytearray()
-        self.audio_buffers[device_id].extend(data)
+        """Append data to the device's stream (a bare stream without audio_start grows on demand)."""
+        session = self.sessions.get(device_id)
+        if session is None:
+            session = self.sessions[device_id] = StreamSession(pool=self.buffer_pool)
+        session.append(data)
 
     def get_audio_data(self, device_id: str) -> bytes:
-        """Get the full audio data from the buffer."""
-        return bytes(self.audio_buffers.get(device_id, b""))
+        """Copy of the audio received so far (tests / debugging; the pipeline uses session.audio())."""
+        session = self.sessions.get(device_id)
+        return bytes(session.audio()) if session is not None else b""
 
     async def send_to_device(self, device_id: str, message: dict) -> bool:
         """Send message to device. Returns True if successful."""
         if device_id in self.active_connections:
             try:
-                await self.active_connections[device_id].send_text(json.dumps(message))
+                websocket = self.active_connections[device_id]
+                frame = encode_control(message) if device_id in self.binary_control else None
+                if frame is not None:
+                    await websocket.send_bytes(frame)
+                else:
+                    await websocket.send_text(json.dumps(message))
                 return True
             except Exception as e:
                 logger.error(f"Failed to send to {device_id}: {e}")
                 return False
         return False
 
+    async def send_bytes(self, device_id: str, frame: bytes) -> bool:
+        """Send a binary frame (downlink audio) to the device. Returns True if successful."""
+        websocket = self.active_connections.get(device_id)
+        if websocket is None:
+            return False
+        try:
+            await websocket.send_bytes(frame)
+            return True
+        except Exception as e:
+            logger.error(f"Failed to send binary to {device_id}: {e}")
+            return False
+
     async def send_with_timeout(
         self, device_id: str, message: dict, timeout: float = TIMEOUT_SECONDS
     ) -> Optional[dict]:
@@ -256,5 +991,9 @@ class ConnectionManager:
     def list_connected_devices(self) -> list[str]:
         return list(self.active_connections.keys())
 
+    def streaming_devices(self) -> list[str]:
+        """Devices with audio buffered for a stream that has not ended yet."""
+        return [device_id for device_id, session in self.sessions.items() if session.size]
+
 
 manager = ConnectionManager()
@@ -0,0 +1,209 @@
+"""Continuous streaming: the device streams VAD speech all the time and the server decides the wake word."""
+
+import asyncio
+import logging
+import re
+import struct
+import time
+from dataclasses import dataclass, field
+from typing import Callable, Optional
+
+from .codec import decode_ima_adpcm_block
+from .config import (
+    CONTINUOUS_DEVICES, CONTINUOUS_MAX_KBPS, CONTINUOUS_CONFIRM, CONTINUOUS_WAKE_PHRASES,
+    CONTINUOUS_GAP_MS, CONTINUOUS_MAX_UTTERANCE_S, CONTINUOUS_ARM_S,
+)
+from .connection import CHUNK_HEADER_V2_FORMAT, CHUNK_HEADER_V2_SIZE
+from .models import Continuous, ContinuousPayload
+
+logger = logging.getLogger("esp-miao.continuous")
+
+_HEADER = struct.Struct(CHUNK_HEADER_V2_FORMAT)
+# 喚醒片語之前最多容許的字元（「欸，嘿喵喵」、ASR 多出的語助詞）
+_WAKE_LEAD_CHARS = 2
+_STRIP = " \t,.!?;:，。！？；：、"
+
+
+def compile_wake_phrases(phrases) -> list[re.Pattern]:
+    """每個片語的字元之間容許空白 / 標點（ASR 常斷成「嘿，喵喵」、「hey miao miao」），長的優先。"""
+    patterns = []
+    for phrase in sorted(phrases, key=len, reverse=True):
+        chars = [re.escape(c) for c in phrase if not c.isspace()]
+        if chars:
+            patterns.append(re.compile(r"[\W_]*".join(chars), re.IGNORECASE))
+    return patterns
+
+
+@dataclass
+class Utterance:
+    """VAD 語音依 sample_offset 的間隔切出的一句話（16-bit PCM）。"""
+    device_id: str
+    start: int                       # 串流內的樣本位置
+    end: int
+    pcm: bytearray = field(default_factory=bytearray)
+    hint: Optional[float] = None     # 落在這句話內的本地喚醒詞信心（wake_hint）
+
+
+@dataclass
+class _Stream:
+    session_id: int
+    sample_rate: int
+    current: Optional[Utterance] = None
+    timer: Optional[asyncio.TimerHandle] = None
+    hints: list[tuple[int, float]] = field(default_factory=list)   # (sample_offset, confidence)
+    armed_until: float = 0.0
+
+
+class ContinuousListener:
+    """Server 端喚醒：CONTINUOUS_DEVICES 的裝置連線後被要求持續送出 VAD 語音（UDP、ADPCM）。
+
+    datagram 依 header 的 sample_offset 組成語句：相鄰 frame 之間缺少的樣本少於 gap 視為遺失並補靜音，
+    超過 gap（裝置閘門已關）即切句；gap 時間內沒有新的 frame、或長度到達上限也切句。
+    切出的語句交給 on_utterance（app 排入 ASR + 喚醒片語比對）。
+    """
+
+    def __init__(self, devices=CONTINUOUS_DEVICES, phrases=CONTINUOUS_WAKE_PHRASES,
+                 gap_ms: int = CONTINUOUS_GAP_MS, max_utterance_s: float = CONTINUOUS_MAX_UTTERANCE_S,
+                 arm_s: float = CONTINUOUS_ARM_S, confirm: bool = CONTINUOUS_CONFIRM,
+                 max_kbps: int = CONTINUOUS_MAX_KBPS):
+        self.devices = set(devices)
+        self.patterns = compile_wake_phrases(phrases)
+        self.gap_s = gap_ms / 1000
+        self.max_utterance_s = max_utterance_s
+        self.arm_s = arm_s
+        self.confirm = confirm
+        self.max_kbps = max_kbps
+        self.on_utterance: Optional[Callable[[Utterance], None]] = None
+        self.streams: dict[str, _Stream] = {}
+        self.frames = 0
+        self.bytes = 0
+        self.utterances = 0
+        self.wakes = 0           # 含喚醒片語（或已 armed）的語句
+        self.no_wake = 0         # ASR 後沒有喚醒片語
+        self.unconfirmed = 0     # confirm 模式下缺少 wake_hint
+        self.skipped_busy = 0    # 該裝置已有 session / 處理中
+
+    def opted_in(self, device_id: str) -> bool:
+        return "*" in self.devices or device_id in self.devices
+
+    def config_message(self, enable: bool = True) -> dict:
+        return Continuous(
+            device_id="server", timestamp=int(time.time() * 1000),
+            payload=ContinuousPayload(enable=enable, max_kbps=self.max_kbps, confirm=self.confirm),
+        ).model_dump()
+
+    def start(self, device_id: str, session_id: int, sample_rate: int = 16000) -> Optional[int]:
+        """continuous_start：回傳被取代的舊 session_id（重連 / 裝置重開）。"""
+        previous = self.stop(device_id)
+        self.streams[device_id] = _Stream(session_id, sample_rate)
+        logger.info(f"Continuous stream {session_id:08x} from {device_id}")
+        return previous
+
+    def stop(self, device_id: str) -> Optional[int]:
+        """斷線：未完成的語句丟棄，回傳 session_id 供 UDP 接收端登出。"""
+        stream = self.streams.pop(device_id, None)
+        if stream is None:
+            return None
+        if stream.timer is not None:
+            stream.timer.cancel()
+        return stream.session_id
+
+    def hint(self, device_id: str, sample_offset: int, confidence: float):
+        """wake_hint：記錄位置，與同一段語音的語句配對（確認模式）。"""
+        stream = self.streams.get(device_id)
+        if stream is None:
+            return
+        stream.hints.append((sample_offset, confidence))
+        del stream.hints[:-8]
+
+    def arm(self, device_id: str):
+        """只說了喚醒片語：接下來 arm_s 內的一句話不需喚醒片語。"""
+        stream = self.streams.get(device_id)
+        if stream is not None:
+            stream.armed_until = time.monotonic() + self.arm_s
+
+    def take_armed(self, device_id: str) -> bool:
+        stream = self.streams.get(device_id)
+        if stream is None or stream.armed_until < time.monotonic():
+            return False
+        stream.armed_until = 0.0
+        return True
+
+    def match_wake(self, text: str) -> Optional[str]:
+        """轉錄開頭為喚醒片語時回傳其後的指令（可為空字串），否則 None。"""
+        head = text.lstrip(_STRIP)
+        for pattern in self.patterns:
+            m = pattern.search(head)
+            if m is not None and m.start() <= _WAKE_LEAD_CHARS:
+                return head[m.end():].strip(_STRIP)
+        return None
+
+    def on_frames(self, device_id: str, frames: list[bytes]):
+        """UdpAudioReceiver 的 sink（event loop 內，依 seq 排序後）。"""
+        stream = self.streams.get(device_id)
+        if stream is None:
+            return
+        gap = round(self.gap_s * stream.sample_rate)
+        limit = round(self.max_utterance_s * stream.sample_rate)
+        for frame in frames:
+            if len(frame) <= CHUNK_HEADER_V2_SIZE:
+                continue
+            offset = _HEADER.unpack_from(frame)[4]
+            pcm = decode_ima_adpcm_block(frame[CHUNK_HEADER_V2_SIZE:])
+            self.frames += 1
+            self.bytes += len(frame)
+            current = stream.current
+            if current is not None and offset < current.end:
+                continue   # jitter buffer 跳過後才到的 frame
+            if current is not None and offset - current.end > gap:
+                self._emit(device_id, stream)
+                current = None
+            if current is None:
+                current = stream.current = Utterance(device_id, offset, offset)
+            current.pcm += bytes((offset - current.end) * 2)   # 遺失的 frame 補靜音
+            current.pcm += pcm
+            current.end = offset + len(pcm) // 2
+            if current.end - current.start >= limit:
+                self._emit(device_id, stream)
+        if stream.current is not None:
+            if stream.timer is not None:
+                stream.timer.cancel()
+            stream.timer = asyncio.get_running_loop().call_later(self.gap_s, self.flush, device_id)
+
+    def flush(self, device_id: str):
+        """gap 時間內沒有新的語音：結束目前的語句。"""
+        stream = self.streams.get(device_id)
+        if stream is not None and stream.current is not None:
+            self._emit(device_id, stream)
+
+    def _emit(self, device_id: str, stream: _Stream):
+        utterance, stream.current = stream.current, None
+        if stream.timer is not None:
+            stream.timer.cancel()
+            stream.timer = None
+        margin = round(self.gap_s * stream.sample_rate)
+        for offset, confidence in stream.hints:
+            if utterance.start - margin <= offset <= utterance.end + margin:
+                utterance.hint = max(confidence, utterance.hint or 0.0)
+        stream.hints = [h for h in stream.hints if h[0] > utterance.end + margin]
+        self.utterances += 1
+        if self.on_utterance is not None:
+            self.on_utterance(utterance)
+
+    def snapshot(self) -> dict:
+        return {
+            "devices": sorted(self.devices),
+            "active": sorted(self.streams),
+            "confirm": self.confirm,
+            "max_kbps": self.max_kbps,
+            "frames": self.frames,
+            "bytes": self.bytes,
+            "utterances": self.utterances,
+            "wakes": self.wakes,
+            "no_wake": self.no_wake,
+            "unconfirmed": self.unconfirmed,
+            "skipped_busy": self.skipped_busy,
+        }
+
+
+continuous = ContinuousListener()
@@ -0,0 +1,185 @@
+"""Debug recordings of every processed utterance, written off the request path within a disk budget."""
+
+import json
+import logging
+import os
+import queue
+import threading
+import time
+import wave
+from collections import OrderedDict
+from pathlib import Path
+from typing import Optional
+
+from .config import AUDIO_DIR, DEBUG_AUDIO_QUEUE, DEBUG_AUDIO_MAX_MB, DEBUG_AUDIO_MAX_AGE_H
+
+logger = logging.getLogger("esp-miao.debug_audio")
+
+INDEX_NAME = "index.jsonl"
+# 超出容量時一次刪到上限的這個比例，索引不必每寫一個檔就整個重寫
+EVICT_TO_RATIO = 0.9
+
+
+class DebugAudioWriter:
+    """DEBUG_AUDIO_SAVE 的錄音：請求端只排入佇列，由單一背景執行緒寫 WAV 與索引。
+
+    - 佇列滿（磁碟慢、負載高）時新的錄音直接丟棄並計數，不拖慢回覆
+    - 索引（index.jsonl，每行一個檔案）取代目錄掃描；開機時讀一次，索引不存在才掃描重建
+    - 總容量超過 max_bytes 或檔案超過 max_age_s 時由舊到新刪除
+    """
+
+    def __init__(self, directory: Path = AUDIO_DIR, max_queue: int = DEBUG_AUDIO_QUEUE,
+                 max_bytes: int = DEBUG_AUDIO_MAX_MB * 1024 * 1024,
+                 max_age_s: float = DEBUG_AUDIO_MAX_AGE_H * 3600):
+        self.directory = Path(directory)
+        self.max_bytes = max_bytes
+        self.max_age_s = max_age_s
+        self._queue: queue.Queue = queue.Queue(maxsize=max(1, max_queue))
+        self._entries: "OrderedDict[str, dict]" = OrderedDict()   # 檔名 -> 索引項，舊到新
+        self._lock = threading.Lock()    # _entries：寫入執行緒修改，列表端讀取
+        self._thread: Optional[threading.Thread] = None
+        self.total_bytes = 0
+        self.saved = 0
+        self.dropped = 0
+        self.evicted = 0
+
+    @property
+    def index_path(self) -> Path:
+        return self.directory / INDEX_NAME
+
+    def start(self):
+        if self._thread is not None:
+            return
+        self.directory.mkdir(parents=True, exist_ok=True)
+        self._load_index()
+        self._thread = threading.Thread(target=self._run, name="debug-audio", daemon=True)
+        self._thread.start()
+
+    def stop(self, timeout: float = 2.0):
+        """寫完已排入的錄音後結束（最多等 timeout 秒）。"""
+        if self._thread is None:
+            return
+        self._queue.put(None)
+        self._thread.join(timeout)
+        self._thread = None
+
+    def submit(self, device_id: str, pcm: bytes, sample_rate: int, confidence: Optional[float] = None) -> bool:
+        """排入一段 16-bit PCM（呼叫端須傳入自己的複本）；佇列已滿回傳 False。"""
+        if self._thread is None:
+            self.start()
+        try:
+            self._queue.put_nowait((device_id, pcm, sample_rate, confidence, time.time()))
+            return True
+        except queue.Full:
+            self.dropped += 1
+            logger.warning(f"Debug audio queue full, dropped recording from {device_id}")
+            return False
+
+    def files(self) -> list[str]:
+        """已保存的錄音檔名（新到舊），取自索引。"""
+        with self._lock:
+            return list(reversed(self._entries))
+
+    def snapshot(self) -> dict:
+        return {
+            "files": len(self._entries),
+            "mb": round(self.total_bytes / (1024 * 1024), 2),
+            "saved": self.saved,
+            "dropped": self.dropped,
+            "evicted": self.evicted,
+            "queued": self._queue.qsize(),
+        }
+
+    # --- 寫入執行緒 ---
+
+    def _run(self):
+        while True:
+            job = self._queue.get()
+            if job is None:
+                return
+            try:
+                self._write(*job)
+            except Exception as e:
+                logger.error(f"Failed to save debug audio: {e}")
+
+    def _write(self, device_id: str, pcm: bytes, sample_rate: int, confidence: Optional[float], saved_at: float):
+        conf_str = f"conf{confidence:.2f}_" if confidence is not None else ""
+        base = f"{conf_str}recorded_{device_id}_{int(saved_at)}"
+        name, n = f"{base}.wav", 1
+        while name in self._entries:   # 同一秒的多段錄音
+            name, n = f"{base}_{n}.wav", n + 1
+        path = self.directory / name
+        with wave.open(str(path), "wb") as w:
+            w.setnchannels(1)
+            w.setsampwidth(2)
+            w.setframerate(sample_rate)
+            w.writeframes(pcm)
+        entry = {
+            "file": name, "device_id": device_id, "confidence": confidence,
+            "sample_rate": sample_rate, "bytes": path.stat().st_size, "saved_at": int(saved_at),
+        }
+        with self._lock:
+            self._entries[name] = entry
+        self.total_bytes += entry["bytes"]
+        self.saved += 1
+        if self._evict(time.time()):
+            self._rewrite_index()
+        else:
+            with open(self.index_path, "a", encoding="utf-8") as f:
+                f.write(json.dumps(entry, ensure_ascii=False) + "\n")
+        logger.debug(f"Audio debug file saved: {path}")
+
+    def _evict(self, now: float) -> bool:
+        """刪除過期檔案，容量超過上限時再由舊到新刪到上限的 EVICT_TO_RATIO；回傳是否有刪除。"""
+        removed = []
+        with self._lock:
+            while self._entries:
+                name, entry = next(iter(self._entries.items()))
+                expired = self.max_age_s > 0 and now - entry["saved_at"] > self.max_age_s
+                over = self.max_bytes > 0 and self.total_bytes > (
+                    self.max_bytes * EVICT_TO_RATIO if removed else self.max_bytes)
+                if not expired and not over:
+                    break
+                del self._entries[name]
+                self.total_bytes -= entry["bytes"]
+                removed.append(name)
+        for name in removed:
+            try:
+                (self.directory / name).unlink()
+            except FileNotFoundError:
+                pass
+        self.evicted += len(removed)
+        if removed:
+            logger.info(f"Evicted {len(removed)} debug recordings ({self.total_bytes // 1024} KB kept)")
+        return bool(removed)
+
+    def _rewrite_index(self):
+        with self._lock:
+            lines = [json.dumps(e, ensure_ascii=False) + "\n" for e in self._entries.values()]
+        tmp = self.index_path.with_name(INDEX_NAME + ".tmp")
+        tmp.write_text("".join(lines), encoding="utf-8")
+        os.replace(tmp, self.index_path)
+
+    def _load_index(self):
+        entries: "OrderedDict[str, dict]" = OrderedDict()
+        if self.index_path.exists():
+            for line in self.index_path.read_text(encoding="utf-8").splitlines():
+                try:
+                    entry = json.loads(line)
+                    entries[entry["file"]] = entry
+                except (ValueError, KeyError):
+                    continue   # 斷電時寫到一半的最後一行
+        else:
+            # 沒有索引（舊版留下的錄音）：掃描一次並建立
+            for path in sorted(self.directory.glob("*recorded_*.wav"), key=lambda p: p.stat().st_mtime):
+                stat = path.stat()
+                entries[path.name] = {"file": path.name, "bytes": stat.st_size, "saved_at": int(stat.st_mtime)}
+        with self._lock:
+            self._entries = entries
+        self.total_bytes = sum(e["bytes"] for e in entries.values())
+        self._evict(time.time())
+        self._rewrite_index()
+        logger.info(f"Debug audio: {len(entries)} recordings indexed ({self.total_bytes // 1024} KB)")
+
+
+debug_audio = DebugAudioWriter()
@@ -0,0 +1,101 @@
+"""Per-device noise profiles and spectral subtraction before Whisper."""
+
+import logging
+import threading
+from typing import Optional
+
+import numpy as np
+
+from .config import (
+    NOISE_PROFILE_MIN_MS,
+    NOISE_PROFILE_WEIGHT,
+    NOISE_SUBTRACT_ALPHA,
+    NOISE_SUBTRACT_FLOOR_DB,
+)
+
+logger = logging.getLogger("esp-miao.denoise")
+
+SAMPLE_RATE = 16000
+FRAME = 512                 # 同 trim_silence 的 VAD 幀
+HOP = FRAME // 2
+_WINDOW = np.sqrt(np.hanning(FRAME + 1)[:FRAME]).astype(np.float32)   # 分析 / 合成各一次，50% 重疊相加為 1
+
+
+def _frames(samples: np.ndarray) -> np.ndarray:
+    """50% 重疊的加窗幀（最後不足一幀補零），以 stride 檢視切幀。"""
+    n = -(-(len(samples) - FRAME) // HOP) + 1 if len(samples) > FRAME else 1
+    padded = np.zeros((n - 1) * HOP + FRAME, dtype=np.float32)
+    padded[:len(samples)] = samples
+    view = np.lib.stride_tricks.sliding_window_view(padded, FRAME)[::HOP]
+    return view * _WINDOW
+
+
+class NoiseProfiles:
+    """每台裝置（房間）一個穩態噪音功率譜（風扇、冰箱），跨串流與重新連線保留。
+
+    由串流前後的靜音段（trim_silence 去掉的部分）學習，每次以 NOISE_PROFILE_WEIGHT 指數平均；
+    靜音段短於 NOISE_PROFILE_MIN_MS 時不更新。送 Whisper 前以過減法頻譜相減：
+    G = sqrt(max(1 - α·N/P, 10^(NOISE_SUBTRACT_FLOOR_DB/10)))，與 STFT 同為 O(音訊長度)。
+    """
+
+    def __init__(self):
+        self._spectra: dict[str, np.ndarray] = {}
+        self._updates: dict[str, int] = {}
+        self._lock = threading.Lock()   # learn / suppress 於背景執行緒呼叫
+        self.applied = 0
+
+    def learn(self, device_id: str, silence: np.ndarray) -> bool:
+        """以一段靜音（16 kHz float32）更新該裝置的噪音譜；太短時不更新。"""
+        if len(silence) * 1000 < NOISE_PROFILE_MIN_MS * SAMPLE_RATE:
+            return False
+        power = (np.abs(np.fft.rfft(_frames(silence), axis=1)) ** 2).mean(axis=0)
+        with self._lock:
+            prev = self._spectra.get(device_id)
+            self._spectra[device_id] = power if prev is None else prev + NOISE_PROFILE_WEIGHT * (power - prev)
+            self._updates[device_id] = self._updates.get(device_id, 0) + 1
+        return True
+
+    def profile(self, device_id: str) -> Optional[np.ndarray]:
+        with self._lock:
+            return self._spectra.get(device_id)
+
+    def suppress(self, device_id: str, samples: np.ndarray) -> Optional[np.ndarray]:
+        """以該裝置的噪音譜做頻譜相減；尚無噪音譜時回傳 None（呼叫端沿用原音訊）。"""
+        noise = self.profile(device_id)
+        if noise is None or len(samples) == 0:
+            return None
+        spec = np.fft.rfft(_frames(samples), axis=1)
+        power = np.abs(spec) ** 2
+        floor = 10.0 ** (NOISE_SUBTRACT_FLOOR_DB / 10.0)
+        gain = np.sqrt(np.maximum(1.0 - NOISE_SUBTRACT_ALPHA * noise / np.maximum(power, 1e-12), floor))
+        frames = np.fft.irfft(spec * gain, n=FRAME, axis=1).astype(np.float32) * _WINDOW
+        # 重疊相加：偶數幀與奇數幀各自互不重疊，兩次 reshape 即可
+        out = np.zeros((len(frames) - 1) * HOP + FRAME, dtype=np.float32)
+        for parity in (0, 1):
+            part = frames[parity::2]
+            start = parity * HOP
+            out[start:start + len(part) * FRAME] += part.reshape(-1)
+        self.applied += 1
+        return out[:len(samples)]
+
+    def process(self, device_id: str, samples: np.ndarray, start: int, end: int) -> tuple[np.ndarray, bool]:
+        """samples[start:end] 為語音段（trim_silence 結果）：以其餘靜音更新噪音譜，再對語音段相減。
+        回傳 (送 Whisper 的音訊, 是否已相減)。"""
+        self.learn(device_id, np.concatenate((samples[:start], samples[end:])))
+        speech = samples[start:end]
+        cleaned = self.suppress(device_id, speech)
+        return (speech, False) if cleaned is None else (cleaned, True)
+
+    def snapshot(self) -> dict:
+        with self._lock:
+            devices = {
+                d: {
+                    "updates": self._updates.get(d, 0),
+                    "noise_db": round(10 * float(np.log10(max(float(s.mean()), 1e-12))), 1),
+                }
+                for d, s in self._spectra.items()
+            }
+        return {"devices": devices, "applied": self.applied}
+
+
+noise_profiles = NoiseProfiles()
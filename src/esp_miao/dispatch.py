@@ -1,34 +1,197 @@
+import asyncio
 import logging
-from typing import Optional
-from .connection import mqtt_client, device_table
-from .config import MQTT_TOPIC
+import time
+from typing import Any, Optional
+from .connection import mqtt_client, device_table, state_listeners
+from .config import (
+    MQTT_TOPIC, MQTT_QOS, MQTT_ACK_TIMEOUT_S, MQTT_STATE_TIMEOUT_S, MQTT_DISPATCH_RETRIES,
+)
 from .metrics import MetricsContext
 
 logger = logging.getLogger("esp-miao.dispatch")
 
-async def dispatch_command(target: str, value: str, metrics_ctx: Optional[MetricsContext] = None):
+
+class MqttDispatcher:
+    """QoS 1 publish → 等待 broker PUBACK → 等待裝置 state 回報（home/<id>/state）確認已動作。
+
+    paho 的回調在其網路執行緒執行，一律以 call_soon_threadsafe 轉回 event loop。
+    只有曾回報過 state 的裝置才等待確認；逾時未確認才重新發佈（relay 指令可重複執行）。
+    未收到 PUBACK 不重送：paho 會在重連後自行重傳 QoS 1 訊息。
+    """
+
+    def __init__(self):
+        self._loop: Optional[asyncio.AbstractEventLoop] = None
+        self._acks: dict[int, asyncio.Future] = {}
+        self._waiters: dict[str, list[asyncio.Future]] = {}
+        self.state_devices: set[str] = set()    # 會回報 state 的裝置（可確認動作）
+        self.sent = 0
+        self.confirmed = 0
+        self.retries = 0
+        self.unconfirmed = 0
+
+    # --- paho 回調（網路執行緒） ---
+
+    def on_publish(self, client, userdata, mid, reason_code=None, properties=None):
+        if self._loop is not None:
+            self._loop.call_soon_threadsafe(self._resolve_ack, mid)
+
+    def on_state(self, device_id: str, state: Any):
+        self.state_devices.add(device_id)
+        if self._loop is not None:
+            self._loop.call_soon_threadsafe(self._resolve_state, device_id, state)
+
+    def _resolve_ack(self, mid: int):
+        future = self._acks.pop(mid, None)
+        if future is not None and not future.done():
+            future.set_result(True)
+
+    def _resolve_state(self, device_id: str, state: Any):
+        for future in self._waiters.pop(device_id, []):
+            if not future.done():
+                future.set_result(state)
+
+    # --- 發佈 ---
+
+    async def _wait_ack(self, mid: int) -> bool:
+        future = self._loop.create_future()
+        self._acks[mid] = future   # publish() 之後同步登記；PUBACK 回調排在本協程讓出之後
+        try:
+            await asyncio.wait_for(future, MQTT_ACK_TIMEOUT_S)
+            return True
+        except asyncio.TimeoutError:
+            return False
+        finally:
+            self._acks.pop(mid, None)
+
+    def _expect_state(self, device_id: str) -> asyncio.Future:
+        future = self._loop.create_future()
+        self._waiters.setdefault(device_id, []).append(future)
+        return future
+
+    def _forget_state(self, device_id: str, future: asyncio.Future):
+        waiters = self._waiters.get(device_id)
+        if waiters and future in waiters:
+            waiters.remove(future)
+            if not waiters:
+                del self._waiters[device_id]
+
+    async def send(self, target: str, topic: str, payload: str,
+                   metrics_ctx: Optional[MetricsContext] = None) -> bool:
+        """回傳是否成功：可確認的裝置需收到 state 回報，其餘以 PUBACK（QoS 0 為 rc）為準。"""
+        self._loop = asyncio.get_running_loop()
+        confirmable = target in self.state_devices
+        attempts = 1 + (MQTT_DISPATCH_RETRIES if confirmable else 0)
+        t0 = time.monotonic()
+
+        for attempt in range(1, attempts + 1):
+            # 先登記再發佈，state 回報不會早於等待者
+            state = self._expect_state(target) if confirmable else None
+            result = mqtt_client.publish(topic, payload, qos=MQTT_QOS)
+            self.sent += 1
+            if result.rc != 0:
+                if state is not None:
+                    self._forget_state(target, state)
+                logger.error(f"Failed to publish MQTT command for {target} (rc={result.rc})")
+                if metrics_ctx: metrics_ctx.set_error(f"mqtt_error_rc{result.rc}")
+                return False
+            if metrics_ctx: metrics_ctx.mark_stage("dispatch_attempts", attempt)
+
+            if MQTT_QOS > 0:
+                if not await self._wait_ack(result.mid):
+                    if state is not None:
+                        self._forget_state(target, state)
+                    logger.error(f"No PUBACK for {target} within {MQTT_ACK_TIMEOUT_S}s")
+                    if metrics_ctx: metrics_ctx.set_error("mqtt_no_puback")
+                    return False
+                if metrics_ctx and attempt == 1:
+                    metrics_ctx.record_latency("dispatch_ack_latency", round(time.monotonic() - t0, 3))
+                    metrics_ctx.mark_event("mqtt_ack")
+            logger.info(f"MQTT Publish: [{topic}] -> {payload} (for {target}, attempt {attempt})")
+            if state is None:
+                return True
+
+            try:
+                reported = await asyncio.wait_for(state, MQTT_STATE_TIMEOUT_S)
+            except asyncio.TimeoutError:
+                self._forget_state(target, state)
+                if attempt < attempts:
+                    self.retries += 1
+                    logger.warning(f"{target} did not confirm {payload} within {MQTT_STATE_TIMEOUT_S}s, retrying")
+                continue
+            self.confirmed += 1
+            actuation = round(time.monotonic() - t0, 3)
+            logger.info(f"{target} confirmed state {reported} {actuation}s after publish")
+            if metrics_ctx:
+                metrics_ctx.set_flag("dispatch_confirmed", True)
+                metrics_ctx.mark_stage("dispatch_state", reported)
+                metrics_ctx.record_latency("actuation_latency", actuation)
+                # 請求開始（音訊到齊）→ 裝置回報已動作
+                metrics_ctx.record_latency("request_to_actuation", round(time.time() - metrics_ctx.start_time, 3))
+            return True
+
+        self.unconfirmed += 1
+        logger.warning(f"{target} never confirmed {payload} after {attempts} attempts")
+        if metrics_ctx:
+            metrics_ctx.set_flag("dispatch_confirmed", False)
+            metrics_ctx.set_error("actuation_unconfirmed")
+        return False
+
+    def snapshot(self) -> dict:
+        return {
+            "sent": self.sent,
+            "confirmed": self.confirmed,
+            "retries": self.retries,
+            "unconfirmed": self.unconfirmed,
+            "state_devices": sorted(self.state_devices),
+        }
+
+
+mqtt_dispatcher = MqttDispatcher()
+mqtt_client.on_publish = mqtt_dispatcher.on_publish
+state_listeners.append(mqtt_dispatcher.on_state)
+
+
+async def dispatch_command(target: str, value: str, metrics_ctx: Optional[MetricsContext] = None) -> bool:
     """通用指令派發器，全面採用 MQTT 模式。"""
+    if await _dispatch(target, value, metrics_ctx):
+        if metrics_ctx: metrics_ctx.set_flag("dispatch_success", True)
+        return True
+    return False
+
+
+async def dispatch_commands(commands: list[dict], metrics_ctx: Optional[MetricsContext] = None) -> bool:
+    """一句話控制多個裝置：同時發佈、各自等待 PUBACK / state，總延遲約等於最慢的一個。
+
+    延遲類 metrics 由最後完成者寫入，即整批的延遲；全部成功才算 dispatch_success。
+    """
+    if len(commands) == 1:
+        return await dispatch_command(commands[0]["target"], commands[0]["value"], metrics_ctx)
+    if metrics_ctx: metrics_ctx.mark_stage("dispatch_commands", len(commands))
+    results = await asyncio.gather(*(_dispatch(c["target"], c["value"], metrics_ctx) for c in commands))
+    if metrics_ctx: metrics_ctx.set_flag("dispatch_success", all(results))
+    failed = [c["target"] for c, ok in zip(commands, results) if not ok]
+    if failed:
+        logger.warning(f"Batched dispatch: {len(failed)}/{len(commands)} failed ({', '.join(failed)})")
+    return not failed
+
+
+async def _dispatch(target: str, value: str, metrics_ctx: Optional[MetricsContext]) -> bool:
     device = device_table.get_device(target)
     if not device:
         logger.warning(f"Attempted to control unregistered device: {target}")
         if metrics_ctx: metrics_ctx.set_error("unregistered_device")
-        return
+        return False
 
     # MQTT 模式
     if metrics_ctx: metrics_ctx.mark_stage("dispatch_type", "mqtt")
-    
+
     topic = device.control_topic if device.control_topic else MQTT_TOPIC
     commands = device.commands if device.commands else {"on": "ON", "off": "OFF"}
     cmd_payload = commands.get(value.lower(), value.upper())
 
     try:
-        result = mqtt_client.publish(topic, cmd_payload)
-        if result.rc == 0:
-            logger.info(f"MQTT Publish: [{topic}] -> {cmd_payload} (for {target})")
-            if metrics_ctx: metrics_ctx.set_flag("dispatch_success", True)
-        else:
-            logger.error(f"Failed to publish MQTT command for {target} (rc={result.rc})")
-            if metrics_ctx: metrics_ctx.set_error(f"mqtt_error_rc{result.rc}")
+        return await mqtt_dispatcher.send(target, topic, cmd_payload, metrics_ctx)
     except Exception as e:
         logger.error(f"MQTT Publish Error for {target}: {e}")
         if metrics_ctx: metrics_ctx.set_error("mqtt_exception")
+        return False
@@ -0,0 +1,176 @@
+"""Downlink audio: feedback sounds streamed to the device's own speaker over its WebSocket."""
+
+import asyncio
+import logging
+import time
+import wave
+from typing import Awaitable, Callable, Optional
+
+import numpy as np
+
+from .audio import pcm_to_float32, resample, sample_rate_from_format
+from .codec import codec_from_format, encode_ima_adpcm_block
+from .config import (
+    DOWNLINK_AUDIO, DOWNLINK_FRAME_MS, DOWNLINK_PREBUFFER_MS, DOWNLINK_LEAD_MS, LOCAL_SOUND_DIR,
+)
+from .connection import manager
+from .sound_player import sound_player
+from .wire import (
+    DOWNLINK_CODEC_ADPCM, DOWNLINK_CODEC_PCM, DOWNLINK_FLAG_END, DOWNLINK_FLAG_START, encode_downlink,
+)
+
+logger = logging.getLogger("esp-miao.downlink")
+
+# 編碼後的一個 frame：(樣本數, payload)
+Frame = tuple[int, bytes]
+
+
+class AudioDownlink:
+    """把提示音（或合成語音）切成 DOWNLINK_FRAME_MS 的 frame，以 WebSocket binary frame 送到裝置喇叭。
+
+    裝置在 wake_detected 宣告 playback_format 才會走這條路徑；提示音依 (檔名, 格式) 編碼一次後快取。
+    開頭 DOWNLINK_PREBUFFER_MS 一次送出，之後依播放進度節流（最多領先 DOWNLINK_LEAD_MS），
+    裝置端 jitter buffer 不會溢位；同一裝置的新提示音會中止前一段。
+    """
+
+    def __init__(self, send: Optional[Callable[[str, bytes], Awaitable[bool]]] = None,
+                 frame_ms: int = DOWNLINK_FRAME_MS, prebuffer_ms: int = DOWNLINK_PREBUFFER_MS,
+                 lead_ms: int = DOWNLINK_LEAD_MS):
+        self._send = send or manager.send_bytes
+        self.frame_ms = frame_ms
+        self.prebuffer_s = prebuffer_ms / 1000
+        self.lead_s = max(lead_ms, prebuffer_ms) / 1000
+        self.formats: dict[str, tuple[int, int]] = {}   # device_id -> (codec, sample_rate)
+        self._cache: dict[tuple[str, int, int], list[Frame]] = {}
+        self._tasks: dict[str, asyncio.Task] = {}
+        self._stream_id = 0
+        self.streams = 0
+        self.frames = 0
+        self.bytes = 0
+        self.interrupted = 0   # 被同一裝置的新提示音中止
+        self.failed = 0        # 送出失敗（連線中斷）
+
+    def set_format(self, device_id: str, playback_format: Optional[str]):
+        """記錄裝置喇叭的下行格式（e.g. "adpcm_16k_4bit"）；None = 裝置沒有喇叭。"""
+        if not DOWNLINK_AUDIO or not playback_format:
+            self.formats.pop(device_id, None)
+            return
+        codec = DOWNLINK_CODEC_ADPCM if codec_from_format(playback_format) == "ima_adpcm" else DOWNLINK_CODEC_PCM
+        self.formats[device_id] = (codec, sample_rate_from_format(playback_format))
+
+    def forget(self, device_id: str):
+        """裝置斷線：不再下行，並中止進行中的串流。"""
+        self.formats.pop(device_id, None)
+        task = self._tasks.pop(device_id, None)
+        if task is not None:
+            task.cancel()
+
+    def play(self, device_id: str, filename: str) -> bool:
+        """串流提示音到裝置（不等待播完）；False = 裝置沒有喇叭或音檔不可用（呼叫端改由 Server 播放）。"""
+        fmt = self.formats.get(device_id)
+        if fmt is None:
+            return False
+        key = (filename, *fmt)
+        frames = self._cache.get(key)
+        if frames is None:
+            pcm, rate = self._load(filename)
+            if pcm is None:
+                return False
+            frames = self._cache[key] = self.encode(pcm, rate, *fmt)
+        self._start(device_id, frames, fmt)
+        return True
+
+    def send_pcm(self, device_id: str, pcm: bytes, sample_rate: int) -> bool:
+        """串流任意 16-bit mono PCM（例如 TTS 輸出，不快取）；False = 裝置沒有喇叭。"""
+        fmt = self.formats.get(device_id)
+        if fmt is None:
+            return False
+        self._start(device_id, self.encode(pcm, sample_rate, *fmt), fmt)
+        return True
+
+    def encode(self, pcm: bytes, sample_rate: int, codec: int, device_rate: int) -> list[Frame]:
+        samples = resample(pcm_to_float32(pcm), sample_rate, device_rate)
+        pcm16 = (np.clip(samples, -1.0, 32767 / 32768) * 32768).astype("<i2").tobytes()
+        per_frame = device_rate * self.frame_ms // 1000
+        frames: list[Frame] = []
+        state = (0, 0)
+        for offset in range(0, len(pcm16) // 2, per_frame):
+            chunk = pcm16[offset * 2:(offset + per_frame) * 2]
+            if codec == DOWNLINK_CODEC_ADPCM:
+                payload, state = encode_ima_adpcm_block(chunk, state)
+            else:
+                payload = chunk
+            frames.append((len(chunk) // 2, payload))
+        return frames
+
+    @staticmethod
+    def _load(filename: str) -> tuple[Optional[bytes], int]:
+        """16-bit mono PCM 與取樣率（優先使用 sound_player 已預載的內容）。"""
+        sound = sound_player.sounds.get(filename)
+        try:
+            if sound is not None:
+                pcm, rate, channels, width = sound.pcm, sound.rate, sound.channels, sound.sampwidth
+            else:
+                with wave.open(str(LOCAL_SOUND_DIR / filename), "rb") as w:
+                    pcm = w.readframes(w.getnframes())
+                    rate, channels, width = w.getframerate(), w.getnchannels(), w.getsampwidth()
+        except (OSError, wave.Error, EOFError) as e:
+            logger.warning(f"Downlink sound {filename} unavailable: {e}")
+            return None, 0
+        if width != 2:
+            logger.warning(f"Downlink sound {filename}: only 16-bit PCM is supported")
+            return None, 0
+        if channels > 1:
+            frames = np.frombuffer(pcm, dtype="<i2", count=len(pcm) // (2 * channels) * channels)
+            pcm = frames.reshape(-1, channels).mean(axis=1).astype("<i2").tobytes()
+        return pcm, rate
+
+    def _start(self, device_id: str, frames: list[Frame], fmt: tuple[int, int]):
+        previous = self._tasks.pop(device_id, None)
+        if previous is not None and not previous.done():
+            previous.cancel()
+            self.interrupted += 1
+        self._stream_id = (self._stream_id + 1) & 0xFF
+        task = asyncio.create_task(self._stream(device_id, self._stream_id, frames, fmt))
+        self._tasks[device_id] = task
+        self.streams += 1
+
+        def forget(done: asyncio.Task):
+            if self._tasks.get(device_id) is done:
+                del self._tasks[device_id]
+
+        task.add_done_callback(forget)
+
+    async def _stream(self, device_id: str, stream_id: int, frames: list[Frame], fmt: tuple[int, int]):
+        codec, rate = fmt
+        start = time.monotonic()
+        sent_s = 0.0
+        last = len(frames) - 1
+        for seq, (samples, payload) in enumerate(frames):
+            # 假設播放自第一個 frame 送出時開始（實際更晚），領先量只會被高估，不會塞爆裝置緩衝
+            ahead = sent_s - (time.monotonic() - start)
+            if sent_s >= self.prebuffer_s and ahead > self.lead_s:
+                await asyncio.sleep(ahead - self.lead_s)
+            flags = (DOWNLINK_FLAG_START if seq == 0 else 0) | (DOWNLINK_FLAG_END if seq == last else 0)
+            frame = encode_downlink(codec, flags, stream_id, seq, samples, payload)
+            if not await self._send(device_id, frame):
+                self.failed += 1
+                return
+            self.frames += 1
+            self.bytes += len(frame)
+            sent_s += samples / rate
+
+    def snapshot(self) -> dict:
+        return {
+            "speakers": {device_id: {"codec": codec, "sample_rate": rate}
+                         for device_id, (codec, rate) in self.formats.items()},
+            "streams": self.streams,
+            "frames": self.frames,
+            "bytes": self.bytes,
+            "interrupted": self.interrupted,
+            "failed": self.failed,
+            "cached_sounds": len(self._cache),
+        }
+
+
+audio_downlink = AudioDownlink()
@@ -2,16 +2,21 @@
 """ESP32 Simulator for testing WebSocket communication.
 
 Updated 2026-03-05: Added time_sync support and fixed attribute errors.
+Load mode (--load 1,2,4,8): N simulated rooms stream recorded PCM over the binary protocol
+and the run reports per-request latency / errors and where p95 exceeds the budget.
 """
 
 import argparse
 import asyncio
 import base64
 import json
+import math
 import os
+import random
 import sys
 import time
-from dataclasses import dataclass
+import wave
+from dataclasses import dataclass, field
 from enum import Enum
 from typing import Optional
 
@@ -310,13 +315,259 @@ class ESP32Simulator:
             if self.reader_task: self.reader_task.cancel()
             print("Disconnected.")
 
+# --- Load Test (multi-device) ---
+
+LOAD_SAMPLE_RATE = 16000
+LOAD_CHUNK_SAMPLES = 1024   # firmware STREAM_CHUNK_SAMPLES (64 ms per binary frame)
+REPLY_TYPES = ("action", "play", "audio_cancel")
+
+
+def load_pcm(path: str) -> bytes:
+    """Read a recording as 16 kHz mono PCM16 (.wav, anything else is taken as raw PCM)."""
+    if path.lower().endswith(".wav"):
+        with wave.open(path, "rb") as w:
+            if (w.getframerate(), w.getnchannels(), w.getsampwidth()) != (LOAD_SAMPLE_RATE, 1, 2):
+                raise ValueError(f"{path}: expected 16 kHz mono 16-bit WAV")
+            return w.readframes(w.getnframes())
+    with open(path, "rb") as f:
+        data = f.read()
+    return data[:len(data) & ~1]
+
+
+def percentile(values: list, q: float) -> float:
+    """Nearest-rank percentile of an ascending list (0.0 when empty)."""
+    if not values:
+        return 0.0
+    return values[max(1, math.ceil(q * len(values))) - 1]
+
+
+@dataclass
+class LoadStats:
+    """Results of one load stage (all rooms share one instance; single event loop, no locking)."""
+    rooms: int
+    latencies: list = field(default_factory=list)   # audio_end sent -> reply, seconds
+    errors: dict = field(default_factory=dict)      # kind -> count (timeout, disconnect, connect)
+    cancelled: int = 0                              # audio_cancel from wake dedup, not a failure
+
+    def error(self, kind: str):
+        self.errors[kind] = self.errors.get(kind, 0) + 1
+
+    @property
+    def requests(self) -> int:
+        return len(self.latencies) + sum(self.errors.values())
+
+    def ranked(self) -> list:
+        # A failed request never got its answer: rank it as infinitely slow so that
+        # a server shedding load cannot look fast on the requests it did answer.
+        return sorted(self.latencies) + [math.inf] * sum(self.errors.values())
+
+    def summary(self, budget: float) -> dict:
+        ranked = self.ranked()
+        p95 = percentile(ranked, 0.95)
+        return {
+            "rooms": self.rooms,
+            "requests": self.requests,
+            "ok": len(self.latencies),
+            "errors": dict(self.errors),
+            "error_rate": round(sum(self.errors.values()) / self.requests, 3) if self.requests else 0.0,
+            "cancelled": self.cancelled,
+            "p50": percentile(ranked, 0.5),
+            "p95": p95,
+            "p99": percentile(ranked, 0.99),
+            "max": ranked[-1] if ranked else 0.0,
+            "within_budget": p95 <= budget,
+        }
+
+
+def find_saturation(stages: list, budget: float) -> Optional[int]:
+    """Smallest room count whose p95 exceeds the budget (None = every stage stayed within it)."""
+    for stats in stages:
+        if stats.requests and percentile(stats.ranked(), 0.95) > budget:
+            return stats.rooms
+    return None
+
+
+class LoadDevice:
+    """One simulated room: wakes at random, streams a recording in real time, times the reply."""
+
+    def __init__(self, config: SimulatorConfig, clips: list, stats: LoadStats,
+                 wake_interval: float, timeout: float, rng: random.Random):
+        self.config = config
+        self.clips = clips
+        self.stats = stats
+        self.wake_interval = wake_interval
+        self.timeout = timeout
+        self.rng = rng
+        self.ws = None
+        self.replies: asyncio.Queue = asyncio.Queue()
+
+    @property
+    def ws_uri(self) -> str:
+        return f"ws://{self.config.host}:{self.config.port}/ws/{self.config.device_id}"
+
+    def envelope(self, msg_type: str, payload: dict) -> str:
+        return json.dumps({
+            "type": msg_type,
+            "device_id": self.config.device_id,
+            "timestamp": int(time.time() * 1000),
+            "payload": payload,
+        })
+
+    async def _reader_loop(self):
+        try:
+            async for raw in self.ws:
+                if isinstance(raw, bytes):
+                    continue   # downlink feedback audio
+                msg = json.loads(raw)
+                if msg.get("type") in REPLY_TYPES:
+                    await self.replies.put(msg)
+        except websockets.exceptions.ConnectionClosed:
+            pass
+
+    async def run(self, until: float):
+        """Issue requests until the stage deadline (monotonic); the last one is allowed to finish."""
+        try:
+            async with websockets.connect(self.ws_uri, max_size=None) as ws:
+                self.ws = ws
+                reader = asyncio.create_task(self._reader_loop())
+                try:
+                    # Rooms start out of phase, as real wake words would
+                    await asyncio.sleep(self.rng.uniform(0, self.wake_interval))
+                    while time.monotonic() < until:
+                        if not await self.request():
+                            break
+                        await asyncio.sleep(self.rng.expovariate(1 / self.wake_interval))
+                finally:
+                    reader.cancel()
+        except (OSError, websockets.exceptions.InvalidHandshake) as e:
+            self.stats.error("connect")
+            print(color(f"[{self.config.device_id}] connect failed: {e}", Colors.RED))
+
+    async def request(self) -> bool:
+        """One wake: audio_start, paced binary frames, audio_end, wait for the reply. False = link lost."""
+        clip = self.rng.choice(self.clips)
+        samples = len(clip) // 2
+        while not self.replies.empty():
+            self.replies.get_nowait()   # late reply to an earlier, timed-out request
+        try:
+            await self.ws.send(self.envelope("audio_start", {
+                "audio_format": "pcm_16k_16bit",
+                "transfer_mode": "binary",
+                "sample_rate": LOAD_SAMPLE_RATE,
+                # endpointing: total_samples is only a cap, the stream ends with audio_end as on the device
+                "total_samples": samples + LOAD_SAMPLE_RATE,
+                "preroll_samples": 0,
+                "chunk_header_bytes": 0,
+                "endpointing": True,
+                "confidence": 0.9,
+                "trace_id": f"{self.rng.getrandbits(32):08x}",
+            }))
+            start = time.monotonic()
+            step = LOAD_CHUNK_SAMPLES * 2
+            for offset in range(0, len(clip), step):
+                # Pace against the stream start so a slow send does not stretch the recording
+                delay = start + (offset + step) / 2 / LOAD_SAMPLE_RATE - time.monotonic()
+                if delay > 0:
+                    await asyncio.sleep(delay)
+                if not self.replies.empty():
+                    break   # audio_cancel (or an early streaming-ASR reply) mid-stream
+                await self.ws.send(clip[offset:offset + step])
+            else:
+                await self.ws.send(self.envelope("audio_end", {"total_samples": samples, "reason": "silence"}))
+            sent = time.monotonic()
+            try:
+                reply = await asyncio.wait_for(self.replies.get(), self.timeout)
+            except asyncio.TimeoutError:
+                self.stats.error("timeout")
+                return True
+            if reply["type"] == "audio_cancel":
+                self.stats.cancelled += 1
+                await self.ws.send(self.envelope("audio_end", {"total_samples": samples, "reason": "server_cancel"}))
+            else:
+                self.stats.latencies.append(round(time.monotonic() - sent, 4))
+            return True
+        except websockets.exceptions.ConnectionClosed:
+            self.stats.error("disconnect")
+            return False
+
+
+async def run_load_stage(config: SimulatorConfig, rooms: int, clips: list, duration: float,
+                         wake_interval: float, timeout: float, seed: int) -> LoadStats:
+    stats = LoadStats(rooms)
+    rng = random.Random(seed)
+    until = time.monotonic() + duration
+    devices = [
+        LoadDevice(SimulatorConfig(f"{config.device_id}_{i:02d}", config.host, config.port),
+                   clips, stats, wake_interval, timeout, random.Random(rng.getrandbits(64)))
+        for i in range(rooms)
+    ]
+    await asyncio.gather(*(d.run(until) for d in devices))
+    return stats
+
+
+def format_stage(summary: dict) -> str:
+    errors = ", ".join(f"{k}={v}" for k, v in sorted(summary["errors"].items())) or "none"
+    verdict = color("ok", Colors.GREEN) if summary["within_budget"] else color("OVER BUDGET", Colors.RED)
+    return (f"rooms={summary['rooms']:>3}  requests={summary['requests']:>4}  "
+            f"p50={summary['p50']:.3f}s  p95={summary['p95']:.3f}s  p99={summary['p99']:.3f}s  "
+            f"errors={errors} ({summary['error_rate']:.1%})  cancelled={summary['cancelled']}  {verdict}")
+
+
+async def run_load(config: SimulatorConfig, room_counts: list, clips: list, duration: float,
+                   wake_interval: float, timeout: float, budget: float, seed: int) -> list:
+    """Ramp through the room counts; stop after the first stage whose p95 exceeds the budget."""
+    stages = []
+    for rooms in room_counts:
+        print(color(f"--- {rooms} room(s), {duration:.0f}s, one wake per ~{wake_interval:.0f}s each ---", Colors.BOLD))
+        stats = await run_load_stage(config, rooms, clips, duration, wake_interval, timeout, seed + rooms)
+        stages.append(stats)
+        print(format_stage(stats.summary(budget)))
+        if find_saturation([stats], budget) is not None:
+            break
+    saturation = find_saturation(stages, budget)
+    if saturation is None:
+        print(color(f"p95 stayed within {budget:.1f}s up to {room_counts[-1]} rooms", Colors.GREEN))
+    else:
+        within = [s.rooms for s in stages if s.rooms < saturation]
+        print(color(f"Saturation: p95 exceeds {budget:.1f}s at {saturation} rooms"
+                    + (f" (last within budget: {within[-1]})" if within else ""), Colors.RED))
+    return [s.summary(budget) for s in stages]
+
+
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument("--device-id", default="esp32_01")
     parser.add_argument("--host", default="localhost")
     parser.add_argument("--port", type=int, default=8000)
+    load = parser.add_argument_group(
+        "load test", "Run the server with WAKE_DEDUP_WINDOW_S=0, otherwise concurrent rooms cancel each other")
+    load.add_argument("--load", metavar="ROOMS", help="comma-separated room counts to ramp through, e.g. 1,2,4,8")
+    load.add_argument("--audio", action="append", default=[], help="16 kHz mono PCM16 recording (.wav or raw); repeatable")
+    load.add_argument("--duration", type=float, default=60.0, help="seconds per stage")
+    load.add_argument("--wake-interval", type=float, default=15.0, help="mean seconds between wakes per room")
+    load.add_argument("--timeout", type=float, default=10.0, help="seconds to wait for a reply before counting an error")
+    load.add_argument("--budget", type=float, default=2.0, help="p95 latency budget in seconds")
+    load.add_argument("--seed", type=int, default=0)
+    load.add_argument("--report", help="write the per-stage summaries as JSON")
     args = parser.parse_args()
-    sim = ESP32Simulator(SimulatorConfig(args.device_id, args.host, args.port))
+    config = SimulatorConfig(args.device_id, args.host, args.port)
+
+    if args.load:
+        if not args.audio:
+            parser.error("--load needs at least one --audio recording")
+        rooms = sorted({int(n) for n in args.load.split(",") if n.strip()})
+        clips = [load_pcm(path) for path in args.audio]
+        try:
+            summaries = asyncio.run(run_load(config, rooms, clips, args.duration, args.wake_interval,
+                                             args.timeout, args.budget, args.seed))
+        except KeyboardInterrupt:
+            return
+        if args.report:
+            with open(args.report, "w", encoding="utf-8") as f:
+                json.dump(summaries, f, indent=2)
+        return
+
+    sim = ESP32Simulator(config)
     try: asyncio.run(sim.run())
     except KeyboardInterrupt: pass
 
@@ -0,0 +1,73 @@
+"""Flight records from devices that reset unexpectedly (previous boot's RTC-memory trace ring)."""
+
+from typing import Any, Dict, List
+
+from .config import EDGE_STACK_WARN_BYTES
+
+# 對應韌體 components/trace_points/trace_points.h 的 trace_point_t（只會往後新增）
+TRACE_POINTS = {1: "i2s_block", 2: "vad", 3: "infer_start", 4: "infer_end", 5: "ws_send", 6: "ui_frame"}
+I2S_STALL_MS = 100     # 最後一個 I2S 區塊早於最後一筆事件超過此值 → 擷取已停擺
+HEAP_LOW_BYTES = 16384  # internal heap 歷史最低低於此值 → 記憶體吃緊
+
+
+def _elapsed_us(later: int, earlier: int) -> int:
+    """t_us 只保留開機後時間的低 32 位元：以 32 位元差值計算（約 71 分鐘內正確）。"""
+    return (later - earlier) & 0xFFFFFFFF
+
+
+def summarize_flight_record(reset_reason: str, stages_us: Dict[str, int],
+                            health: List[list], events: List[List[int]]) -> Dict[str, Any]:
+    """整理重開機前的紀錄，並列出可能的效能異常（hints）。"""
+    summary: Dict[str, Any] = {"reset_reason": reset_reason, "stages_us": dict(stages_us), "events": len(events)}
+    hints = []
+
+    events = [e for e in events if len(e) == 4]
+    if events:
+        end = events[-1][0]
+        summary["span_ms"] = round(_elapsed_us(end, events[0][0]) / 1000, 1)
+        points: Dict[str, Dict[str, Any]] = {}
+        last_i2s = None
+        i2s_gap_max = 0
+        starts: Dict[int, int] = {}
+        infer_max = 0
+        for t_us, core, tid, _ in events:
+            name = TRACE_POINTS.get(tid, f"id{tid}")
+            point = points.setdefault(name, {"count": 0})
+            point["count"] += 1
+            point["last_ago_ms"] = round(_elapsed_us(end, t_us) / 1000, 1)
+            if name == "i2s_block":
+                if last_i2s is not None:
+                    i2s_gap_max = max(i2s_gap_max, _elapsed_us(t_us, last_i2s))
+                last_i2s = t_us
+            elif name == "infer_start":
+                starts[core] = t_us
+            elif name == "infer_end" and core in starts:
+                infer_max = max(infer_max, _elapsed_us(t_us, starts.pop(core)))
+        summary["points"] = points
+        summary["i2s_gap_max_ms"] = round(i2s_gap_max / 1000, 1)
+        summary["infer_max_us"] = infer_max
+
+        if starts:
+            hints.append(f"inference still running at the last event (started "
+                         f"{points['infer_start']['last_ago_ms']} ms earlier)")
+        i2s = points.get("i2s_block")
+        if i2s is None:
+            hints.append("no I2S blocks in the record")
+        elif i2s["last_ago_ms"] > I2S_STALL_MS:
+            hints.append(f"audio capture stalled {i2s['last_ago_ms']} ms before the last event")
+
+    samples = [h for h in health if len(h) == 6]
+    if samples:
+        heap_min = min(int(h[2]) for h in samples)
+        lowest = min(samples, key=lambda h: int(h[4]))
+        summary["heap_min"] = heap_min
+        summary["heap_largest_last"] = int(samples[-1][3])
+        summary["stack_min"] = {"task": str(lowest[5]), "bytes": int(lowest[4])}
+        summary["uptime_s"] = int(samples[-1][0])
+        if heap_min < HEAP_LOW_BYTES:
+            hints.append(f"internal heap fell to {heap_min} B")
+        if int(lowest[4]) < EDGE_STACK_WARN_BYTES:
+            hints.append(f"task {lowest[5]} had {lowest[4]} B of stack left")
+
+    summary["hints"] = hints
+    return summary
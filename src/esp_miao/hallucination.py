@@ -0,0 +1,84 @@
+"""Whisper segment post-processor: no-speech / hallucination rejection with early stop."""
+
+import logging
+from typing import Iterable, Iterator, Optional
+
+from .config import ASR_EARLY_STOP, ASR_NO_SPEECH_REJECT
+
+logger = logging.getLogger("esp-miao.hallucination")
+
+REJECT_REASONS = ("no_speech", "repeat", "same_char")
+
+
+def smallest_period(text: str) -> int:
+    """text 的最小週期 p（text[i] == text[i + p]），KMP 失敗函數一次線性掃描。"""
+    n = len(text)
+    fail = [0] * n
+    k = 0
+    for i in range(1, n):
+        while k and text[i] != text[k]:
+            k = fail[k - 1]
+        if text[i] == text[k]:
+            k += 1
+        fail[i] = k
+    return n - fail[-1] if n else 0
+
+
+class SegmentFilter:
+    """faster-whisper 片段的後處理：丟棄無語音與幻聽片段，並可提早結束解碼。
+
+    判定（4 字以上才檢查重複）：
+      - no_speech：no_speech_prob ≥ ASR_NO_SPEECH_REJECT
+      - repeat：整段由同一單元重複至少兩次（「打開打開」、「謝謝觀看謝謝觀看謝謝」）
+      - same_char：開頭連續 4 個同字
+    model.transcribe 的 segments 是惰性產生器，每取一段才解碼下一個 30 秒視窗；
+    ASR_EARLY_STOP 時第一個被丟棄的片段即關閉產生器，其後的視窗不再解碼（垃圾音訊多半整段都是）。
+    """
+
+    def __init__(self, early_stop: bool = ASR_EARLY_STOP, no_speech_reject: float = ASR_NO_SPEECH_REJECT):
+        self.early_stop = early_stop
+        self.no_speech_reject = no_speech_reject
+        self.segments = 0
+        self.rejected = dict.fromkeys(REJECT_REASONS, 0)
+        self.early_stops = 0
+
+    def reason(self, text: str, no_speech_prob: float) -> Optional[str]:
+        """丟棄的原因；可採用時回傳 None。"""
+        if no_speech_prob >= self.no_speech_reject:
+            return "no_speech"
+        if len(text) >= 4:
+            if smallest_period(text) * 2 <= len(text):
+                return "repeat"
+            if text[1:4] == text[0] * 3:
+                return "same_char"
+        return None
+
+    def accept(self, text: str, no_speech_prob: float) -> Optional[str]:
+        """單一片段：去除前後空白後的文字，丟棄時回傳 None。"""
+        clean_text = text.strip()
+        self.segments += 1
+        reason = self.reason(clean_text, no_speech_prob)
+        if reason is None:
+            return clean_text
+        self.rejected[reason] += 1
+        logger.debug(f"Rejected segment ({reason}, no_speech={no_speech_prob:.2f}): {clean_text!r}")
+        return None
+
+    def run(self, segments: Iterable) -> Iterator[tuple[str, float]]:
+        """逐段取出（驅動解碼）並過濾，產生 (文字, avg_logprob)；提早結束時關閉產生器。"""
+        for segment in segments:
+            clean_text = self.accept(segment.text, segment.no_speech_prob)
+            if clean_text is not None:
+                yield clean_text, segment.avg_logprob
+            elif self.early_stop:
+                self.early_stops += 1
+                close = getattr(segments, "close", None)
+                if close is not None:
+                    close()
+                return
+
+    def snapshot(self) -> dict:
+        return {"segments": self.segments, "rejected": dict(self.rejected), "early_stops": self.early_stops}
+
+
+segment_filter = SegmentFilter()
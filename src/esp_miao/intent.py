@@ -1,54 +1,393 @@
+import asyncio
 import json
 import re
 import time
 import logging
+import unicodedata
+from collections import OrderedDict
+from dataclasses import dataclass
 from typing import Optional
 import ollama
 from .connection import device_table
-from .config import ACTION_KEYWORDS
+from .matcher import leftmost_longest, non_overlapping
+from .scheduler import scheduler, LaneBusy
+from .config import (
+    ACTION_KEYWORDS, LLM_MODEL, LLM_TIMEOUT_S, LLM_MAX_TOKENS, LLM_KEEP_ALIVE,
+    LLM_JSON_SCHEMA, LLM_SCHEMA_MAX_TOKENS,
+    INTENT_CACHE_SIZE, INTENT_CACHE_TTL_S, INTENT_HOMOPHONES, INTENT_TRAILING_PARTICLES,
+    INTENT_INDEX,
+)
+from .intent_index import intent_index
 from .metrics import MetricsContext
 
 logger = logging.getLogger("esp-miao.intent")
 
+JSON_OBJECT_RE = re.compile(r"\{[^}]+\}")
+
+# Ollama 為獨立服務：以非同步 client 等待 HTTP 回應（經 scheduler 的 LLM lane），不佔用 event loop 與 ASR lane
+_llm_client: Optional[ollama.AsyncClient] = None
+
+
+def get_llm_client() -> ollama.AsyncClient:
+    global _llm_client
+    if _llm_client is None:
+        _llm_client = ollama.AsyncClient()
+    return _llm_client
+
+
+class LlmSession:
+    """常駐的 Ollama 模型與固定的 prompt 前綴（裝置清單 + 範例）。
+
+    每次請求帶 keep_alive，模型不會在 Ollama 預設 5 分鐘後卸載；
+    prompt 以前綴 + 指令組成，前綴只在裝置表 vocab_version 變更時重建，
+    Ollama runner 會沿用 KV cache 中相同的前綴 token，只需評估指令本身。
+    seed() 預先以前綴跑一次（載入模型並填入 KV cache），用於預熱與裝置變更後。
+    LLM_JSON_SCHEMA 時另隨前綴建立輸出 schema（target 限定目前的裝置），交給 Ollama 做受限解碼。
+    """
+
+    SUFFIX = '{text}"\nResponse in ONE LINE JSON format ONLY:\n'
+
+    def __init__(self):
+        self.prefix = ""
+        self.schema: dict = {}
+        self.prefix_version = -1     # prefix / schema 對應的 vocab_version
+        self.seeded_version = -1     # 已填入 KV cache 的 vocab_version
+        self.rebuilds = 0
+        self.seeds = 0
+        self.seed_prompt_tokens: Optional[int] = None
+        self.seed_prompt_eval_s: Optional[float] = None
+        self.first_token_s: Optional[float] = None   # 最近一次請求的首 token 延遲
+        self._seed_lock = asyncio.Lock()
+
+    def _refresh(self) -> str:
+        if self.prefix_version != device_table.vocab_version:
+            current_devices = [d.name for d in device_table.devices]
+            self.prefix = f"""Task: Convert voice command to JSON.
+Available devices: {current_devices}
+
+Examples:
+- Command: "幫我開燈" -> {{"action": "relay_set", "target": "light", "value": "on"}}
+- Command: "關掉風扇" -> {{"action": "relay_set", "target": "fan", "value": "off"}}
+
+Command: \""""
+            # "unknown" / "" 讓模型在指令與任何裝置無關時仍有合法輸出（之後同樣改用關鍵字結果）
+            self.schema = {
+                "type": "object",
+                "properties": {
+                    "action": {"type": "string", "enum": ["relay_set", "unknown"]},
+                    "target": {"type": "string", "enum": current_devices + [""]},
+                    "value": {"type": "string", "enum": ["on", "off"]},
+                },
+                "required": ["action", "target", "value"],
+            }
+            self.prefix_version = device_table.vocab_version
+            self.rebuilds += 1
+        return self.prefix
+
+    def prompt(self, text: str) -> str:
+        return self._refresh() + self.SUFFIX.format(text=text)
+
+    def output_format(self) -> Optional[dict]:
+        """Ollama format 參數：與目前 prompt 前綴同一版本的 JSON schema；停用時為 None。"""
+        if not LLM_JSON_SCHEMA:
+            return None
+        self._refresh()
+        return self.schema
+
+    async def seed(self) -> Optional[float]:
+        """載入模型並預先評估前綴；前綴已在 KV cache 時只刷新 keep_alive。回傳耗時秒數。"""
+        async with self._seed_lock:
+            prefix = self._refresh()
+            t0 = time.perf_counter()
+            if self.seeded_version == self.prefix_version:
+                # 空 prompt 只載入 / 刷新 keep_alive，不覆寫 KV cache 內的前綴
+                await get_llm_client().generate(model=LLM_MODEL, prompt="", keep_alive=LLM_KEEP_ALIVE)
+                return round(time.perf_counter() - t0, 3)
+            response = await get_llm_client().generate(
+                model=LLM_MODEL, prompt=prefix, keep_alive=LLM_KEEP_ALIVE, options={"num_predict": 1}
+            )
+            self.seeded_version = self.prefix_version
+            self.seeds += 1
+            self.seed_prompt_tokens = response.get("prompt_eval_count")
+            if response.get("prompt_eval_duration"):
+                self.seed_prompt_eval_s = round(response["prompt_eval_duration"] / 1e9, 3)
+            elapsed = round(time.perf_counter() - t0, 3)
+            logger.info(
+                f"LLM prefix seeded (vocab v{self.prefix_version}, {self.seed_prompt_tokens} tokens) in {elapsed}s"
+            )
+            return elapsed
+
+    def snapshot(self) -> dict:
+        return {
+            "model": LLM_MODEL,
+            "keep_alive": LLM_KEEP_ALIVE,
+            "json_schema": LLM_JSON_SCHEMA,
+            "prefix_version": self.prefix_version,
+            "prefix_seeded": self.seeded_version == self.prefix_version,
+            "rebuilds": self.rebuilds,
+            "seeds": self.seeds,
+            "seed_prompt_tokens": self.seed_prompt_tokens,
+            "seed_prompt_eval_s": self.seed_prompt_eval_s,
+            "first_token_s": self.first_token_s,
+        }
+
+
+llm_session = LlmSession()
+
+
+async def generate_json(prompt: str, metrics_ctx: Optional[MetricsContext] = None) -> str:
+    """串流取得 LLM 輸出，一出現完整 JSON 物件即停止（不等模型生成結束）。
+
+    LLM_JSON_SCHEMA 時以 schema 受限解碼：輸出必為單一合法物件，生成上限降為 LLM_SCHEMA_MAX_TOKENS。
+    """
+    t0 = time.perf_counter()
+    output_format = llm_session.output_format()
+    kwargs = {"format": output_format} if output_format is not None else {}
+    stream = await get_llm_client().generate(
+        model=LLM_MODEL, prompt=prompt, stream=True, keep_alive=LLM_KEEP_ALIVE,
+        options={"num_predict": LLM_SCHEMA_MAX_TOKENS if output_format is not None else LLM_MAX_TOKENS},
+        **kwargs,
+    )
+    text = ""
+    try:
+        async for part in stream:
+            if not text:
+                # 首 token 延遲 ≈ 載入 + prompt 評估（前綴命中 KV cache 時只評估指令）
+                llm_session.first_token_s = round(time.perf_counter() - t0, 3)
+                if metrics_ctx: metrics_ctx.record_latency("llm_first_token_latency", llm_session.first_token_s)
+            text += part["response"] or ""
+            match = JSON_OBJECT_RE.search(text)
+            if match:
+                return match.group()
+    finally:
+        aclose = getattr(stream, "aclose", None)
+        if aclose is not None:
+            await aclose()
+    return text
+
+
+async def warm_up_llm() -> Optional[float]:
+    """要求 Ollama 載入模型並保留 LLM_KEEP_ALIVE，裝置表變更後一併重新評估 prompt 前綴；回傳耗時秒數。
+
+    不經 scheduler 的 LLM lane：載入期間不佔用意圖解析的並行額度。
+    INTENT_INDEX 時一併重建過期的指令範例嵌入索引。
+    """
+    elapsed = await llm_session.seed()
+    if INTENT_INDEX:
+        try:
+            await intent_index.refresh()
+        except Exception as e:
+            logger.warning(f"Intent index rebuild failed: {e}")
+    return elapsed
+
+
+_HOMOPHONE_TABLE = str.maketrans(INTENT_HOMOPHONES)
+
+
+def normalize_transcript(text: str) -> str:
+    """快取鍵：全形轉半形、小寫、去空白與標點、折疊常見 ASR 誤字、去句尾語助詞。"""
+    text = unicodedata.normalize("NFKC", text).lower()
+    text = "".join(
+        ch for ch in text
+        if not ch.isspace() and unicodedata.category(ch)[0] not in ("P", "S")
+    )
+    return text.translate(_HOMOPHONE_TABLE).rstrip(INTENT_TRAILING_PARTICLES)
+
+
+@dataclass
+class CachedIntent:
+    intent: dict
+    keyword_intent: dict
+    vocab_version: int
+    created: float
+    llm_latency: float  # 產生此結果時 LLM 花費的秒數（命中即省下）
+
+
+class IntentCache:
+    """正規化轉錄文字 -> 最終意圖的 LRU / TTL 快取。
+
+    家中反覆下達的指令大多相同：命中時跳過關鍵字比對與 LLM。
+    裝置表 vocab_version 變更（別名、關鍵字、裝置增減）即視為失效；
+    目標裝置離線時不採用快取，交回正常流程（LLM 回饋）。
+    """
+
+    def __init__(self, max_size: int = INTENT_CACHE_SIZE, ttl_s: float = INTENT_CACHE_TTL_S):
+        self.max_size = max_size
+        self.ttl_s = ttl_s
+        self._entries: "OrderedDict[str, CachedIntent]" = OrderedDict()
+        self.lookups = 0
+        self.hits = 0
+        self.saved_llm_s = 0.0
+
+    @property
+    def enabled(self) -> bool:
+        return self.max_size > 0
+
+    @property
+    def hit_rate(self) -> float:
+        return round(self.hits / self.lookups, 3) if self.lookups else 0.0
+
+    def get(self, key: str) -> Optional[CachedIntent]:
+        if not self.enabled or not key:
+            return None
+        self.lookups += 1
+        entry = self._entries.get(key)
+        if entry is None:
+            return None
+        if (entry.vocab_version != device_table.vocab_version
+                or time.monotonic() - entry.created > self.ttl_s
+                or not self._target_online(entry.intent)):
+            del self._entries[key]
+            return None
+        self._entries.move_to_end(key)
+        self.hits += 1
+        self.saved_llm_s += entry.llm_latency
+        return entry
+
+    def put(self, key: str, intent: dict, keyword_intent: dict, llm_latency: float = 0.0):
+        if not self.enabled or not key:
+            return
+        self._entries[key] = CachedIntent(
+            dict(intent), keyword_intent, device_table.vocab_version, time.monotonic(), llm_latency
+        )
+        self._entries.move_to_end(key)
+        while len(self._entries) > self.max_size:
+            self._entries.popitem(last=False)
+
+    def clear(self):
+        self._entries.clear()
+
+    def __len__(self) -> int:
+        return len(self._entries)
+
+    @staticmethod
+    def _target_online(intent: dict) -> bool:
+        if intent.get("action") == "unknown":
+            return True
+        for command in intent_commands(intent):
+            device = device_table.get_device(command["target"])
+            if device is None or not device.is_online:
+                return False
+        return True
+
+
+intent_cache = IntentCache()
+
+
+# 拼音比對補上目標或動作的次數（GET / 的 "keyword_pinyin"）
+pinyin_stats = {"rescued": 0}
+
+
 def extract_intent_from_text(text: str) -> dict:
     """
-    使用從 DeviceRegistry 獲取的動態別名地圖進行匹配，並優先使用裝置專屬關鍵字。
+    以裝置表的 Aho-Corasick 自動機一次掃描找出目標與動作，並優先使用裝置專屬關鍵字。
+    別名重疊（如「燈」與「電燈」）時取最左、最長者。
+    原字找不到目標或動作時，再以拼音比對（同音 / 近音字）補上候選。
     """
     text_lower = text.replace(" ", "").lower()
+    intent = _resolve_intent(device_table.keyword_matcher.iter_matches(text_lower))
+    if intent["action"] != "unknown" or not device_table.pinyin_matcher:
+        return intent
+    matches = list(device_table.keyword_matcher.iter_matches(text_lower))
+    for match in device_table.pinyin_matcher.iter_matches(text_lower):
+        # 原字已找到目標時只補動作，不以同音字改換目標
+        values = tuple(v for v in match.values if not intent["target"] or v[0] == "action")
+        if values:
+            matches.append(match._replace(values=values))
+    rescued = _resolve_intent(matches)
+    if rescued["action"] == "unknown" and rescued["target"] == intent["target"]:
+        return intent
+    pinyin_stats["rescued"] += 1
+    logger.debug(f"Pinyin match for '{text}': {intent} -> {rescued}")
+    return rescued
 
-    # 1. 找出目標裝置 (動態查詢 alias_map)
-    target = None
-    for alias, device_name in device_table.alias_map.items():
-        if alias in text_lower:
-            target = device_name
-            break
 
-    if not target:
+def _resolve_intent(matches) -> dict:
+    """
+    目標依出現順序取互不重疊的別名 / 群組（群組展開為成員），每個裝置各自找動作：
+    只看到前後目標之間的命中，多個目標時取最靠近者（同距離取前方，中文多為「關燈」）；
+    沒有動作的裝置沿用前一個、再往後補（「把燈和風扇都關掉」）。
+    多於一個裝置時另附 "commands"，target / value 為第一個。
+    """
+    targets, actions = [], []
+    for match in matches:
+        for value in match.values:
+            (actions if value[0] == "action" else targets).append((match, value))
+
+    # 1. 找出目標裝置：別名優先於同字串的群組
+    spans = non_overlapping(m for m, _ in targets)
+    if not spans:
+        return {"action": "unknown", "target": "", "value": ""}
+    devices = []   # (span, device_name)
+    for span in spans:
+        values = [v for m, v in targets if m[:2] == span[:2]]
+        names = [v[1] for v in values if v[0] == "target"][:1]
+        if not names:
+            names = [n for v in values for n in device_table.group_members(v[1])]
+        devices += [(span, name) for name in names if name not in {d for _, d in devices}]
+    if not devices:
         return {"action": "unknown", "target": "", "value": ""}
 
-    # 2. 獲取該裝置的動作關鍵字 (有專屬用專屬，無則 fallback 全域)
-    device_keywords = device_table.get_action_keywords(target)
-
-    # 3. 找出動作
-    value = None
-    for action_value, keywords in device_keywords.items():
-        for keyword in keywords:
-            if keyword in text_lower:
-                value = action_value
-                break
-        if value:
-            break
-
-    if value:
-        return {"action": "relay_set", "target": target, "value": value}
-    
-    # 原有的「掃地機預設啟動」邏輯已依計畫刪除，統一行為
-    return {"action": "unknown", "target": target, "value": ""}
+    # 2. 各裝置的動作關鍵字 (有專屬用專屬，無則 fallback 全域)；與任何目標重疊的命中不算
+    commands = []
+    for i, span in enumerate(spans):
+        lo = spans[i - 1].end if i else 0
+        hi = spans[i + 1].start if i + 1 < len(spans) else float("inf")
+        for dev_span, name in devices:
+            if dev_span is not span:
+                continue
+            owner = name if device_table.get_action_keywords(name) is not ACTION_KEYWORDS else None
+            candidates = [
+                (m, v[2]) for m, v in actions
+                if v[1] == owner and lo <= m.start and m.end <= hi and (m.end <= span.start or m.start >= span.end)
+            ]
+            # 3. 找出動作
+            if len(spans) == 1:
+                action_match = leftmost_longest(m for m, _ in candidates)
+            else:
+                action_match = min(
+                    (m for m, _ in candidates),
+                    key=lambda m: (span.start - m.end if m.end <= span.start else m.start - span.end,
+                                   m.start > span.start),
+                    default=None,
+                )
+            value = next((a for m, a in candidates if m is action_match), "")
+            commands.append({"target": name, "value": value})
+
+    for pair in (zip(commands, commands[1:]), zip(commands[::-1], commands[-2::-1])):
+        for prev, cmd in pair:
+            cmd["value"] = cmd["value"] or prev["value"]
+    if not commands[0]["value"]:
+        # 原有的「掃地機預設啟動」邏輯已依計畫刪除，統一行為
+        return {"action": "unknown", "target": commands[0]["target"], "value": ""}
+    intent = {"action": "relay_set", **commands[0]}
+    if len(commands) > 1:
+        intent["commands"] = commands
+    return intent
 
 
-def parse_intent_with_llm(text: str, metrics_ctx: Optional[MetricsContext] = None) -> dict:
+def intent_commands(intent: dict) -> list[dict]:
+    """意圖涵蓋的 (target, value)；單一裝置的意圖沒有 "commands"。"""
+    return intent.get("commands") or [{"target": intent["target"], "value": intent["value"]}]
+
+
+async def parse_intent_with_llm(text: str, metrics_ctx: Optional[MetricsContext] = None) -> dict:
     """Use Ollama LLM to parse natural language intent with dynamic device list."""
-    current_devices = [d.name for d in device_table.devices]
+    cache_key = normalize_transcript(text)
+    cached = intent_cache.get(cache_key)
+    if metrics_ctx and intent_cache.enabled:
+        metrics_ctx.set_flag("intent_cache_hit", cached is not None)
+        metrics_ctx.mark_stage("intent_cache_hit_rate", intent_cache.hit_rate)
+    if cached is not None:
+        logger.info(f"Intent cache hit for '{text}' -> {cached.intent}")
+        if metrics_ctx:
+            metrics_ctx.set_flag("keyword_action_found", cached.keyword_intent["action"] != "unknown")
+            metrics_ctx.set_flag("keyword_target_found", cached.keyword_intent["target"] != "")
+            metrics_ctx.set_flag("llm_called", False)
+            metrics_ctx.record_latency("intent_cache_saved_llm", cached.llm_latency)
+        return dict(cached.intent)
+
+    current_devices = device_table.current.devices   # 名稱 -> Device 索引，整個請求沿用同一份快照
 
     # 先用關鍵字匹配提取意圖（作為驗證基準）
     keyword_intent = extract_intent_from_text(text)
@@ -60,57 +399,84 @@ def parse_intent_with_llm(text: str, metrics_ctx: Optional[MetricsContext] = Non
         metrics_ctx.set_flag("keyword_target_found", keyword_intent["target"] != "")
     
     # --- 優先攔截邏輯 (Priority Logic) ---
-    # 如果關鍵字已經能明確識別出目標與動作，直接返回，跳過 LLM 以降低延遲
-    if keyword_intent["action"] != "unknown" and keyword_intent["target"] in current_devices:
-        device = device_table.get_device(keyword_intent["target"])
-        if device and device.is_online:
+    # 如果關鍵字已經能明確識別出目標與動作，直接返回，跳過 LLM 以降低延遲（多個裝置須全部在線）
+    if keyword_intent["action"] != "unknown":
+        offline = [
+            c["target"] for c in intent_commands(keyword_intent)
+            if not (current_devices.get(c["target"]) and current_devices[c["target"]].is_online)
+        ]
+        if not offline:
             logger.info(f"Priority Logic: Keyword match successful for '{text}', skipping LLM.")
             if metrics_ctx: metrics_ctx.set_flag("llm_called", False)
+            intent_cache.put(cache_key, keyword_intent, keyword_intent)
             return keyword_intent
         else:
-            logger.warning(f"Target '{keyword_intent['target']}' found but is OFFLINE. Continuing to LLM for potential feedback.")
+            logger.warning(f"Target(s) {offline} found but OFFLINE. Continuing to LLM for potential feedback.")
+
+    # 方案 A2: 嵌入最近鄰（關鍵字沒中的常見說法變體，不必等 LLM 生成）
+    if INTENT_INDEX:
+        t_idx = time.time()
+        match = await intent_index.lookup(text)
+        if metrics_ctx: metrics_ctx.record_latency("intent_index_latency", round(time.time() - t_idx, 3))
+        if match is not None:
+            intent = match["intent"]
+            device = current_devices.get(intent["target"])
+            # 關鍵字已認出另一個（或多個）裝置時不採用
+            if (device and device.is_online and "commands" not in keyword_intent
+                    and keyword_intent["target"] in ("", intent["target"])):
+                if metrics_ctx:
+                    metrics_ctx.set_flag("intent_index_hit", True)
+                    metrics_ctx.mark_stage("intent_index_similarity", match["similarity"])
+                    metrics_ctx.set_flag("llm_called", False)
+                intent_cache.put(cache_key, intent, keyword_intent)
+                return intent
 
     # 方案 B: 動態 LLM Prompt (如果關鍵字沒中，或裝置離線)
     if metrics_ctx: metrics_ctx.set_flag("llm_called", True)
     
-    prompt = f"""Task: Convert voice command to JSON.
-Available devices: {current_devices}
-
-Examples:
-- Command: "幫我開燈" -> {{"action": "relay_set", "target": "light", "value": "on"}}
-- Command: "關掉風扇" -> {{"action": "relay_set", "target": "fan", "value": "off"}}
-
-Command: "{text}"
-Response in ONE LINE JSON format ONLY:
-"""
+    # 前綴（裝置清單 + 範例）固定，Ollama 沿用其 KV cache；只有指令本身需要評估
+    prompt = llm_session.prompt(text)
 
     try:
         t_llm = time.time()
-        response = ollama.generate(model="qwen2.5:0.5b", prompt=prompt)
-        if metrics_ctx: metrics_ctx.record_latency("llm_inference_latency", round(time.time() - t_llm, 3))
-        
-        result_text = response["response"]
-
-        # Extract JSON from response
-        json_match = re.search(r"\{[^}]+\}", result_text)
-        if json_match:
-            result_text = json_match.group()
+        device_id = metrics_ctx.device_id if metrics_ctx else ""
+        try:
+            # 排隊 + 生成合計不超過 LLM_TIMEOUT_S
+            result_text = await scheduler.run_llm(device_id, lambda: generate_json(prompt, metrics_ctx), timeout=LLM_TIMEOUT_S)
+        except LaneBusy:
+            logger.warning(f"LLM lane full, using keyword result for '{text}'")
+            if metrics_ctx: metrics_ctx.set_flag("llm_rejected", True)
+            return keyword_intent
+        except asyncio.TimeoutError:
+            # 單一慢回應不拖住其他裝置：逾時即採用關鍵字結果
+            logger.warning(f"LLM timed out after {LLM_TIMEOUT_S}s for '{text}', using keyword result")
+            if metrics_ctx:
+                metrics_ctx.set_flag("llm_timeout", True)
+                metrics_ctx.record_latency("llm_inference_latency", round(time.time() - t_llm, 3))
+            return keyword_intent
+        llm_latency = round(time.time() - t_llm, 3)
+        if metrics_ctx: metrics_ctx.record_latency("llm_inference_latency", llm_latency)
 
         result = json.loads(result_text.strip())
         logger.info(f"LLM parsed: {text} -> {result}")
 
         # 驗證邏輯：如果 LLM 回報無效裝置，使用關鍵字結果
         if result.get("target") not in current_devices or result.get("value") not in ["on", "off"]:
+            # 與逾時 / 例外相同不快取：同一句話下次仍查索引、重試 LLM
             logger.warning(f"LLM output invalid device or value, falling back to keywords")
             return keyword_intent
             
-        # 交叉驗證：以關鍵字匹配結果為準（如果存在）
+        # 交叉驗證：以關鍵字匹配結果為準（如果存在）；LLM 只回單一裝置，多裝置一律用關鍵字結果
         if keyword_intent["action"] != "unknown":
-            if result.get("target") != keyword_intent["target"] or result.get("value") != keyword_intent["value"]:
+            if (result.get("target") != keyword_intent["target"] or result.get("value") != keyword_intent["value"]
+                    or "commands" in keyword_intent):
                 logger.warning(f"LLM disagreed with keywords, prioritizing keywords: {keyword_intent}")
+                intent_cache.put(cache_key, keyword_intent, keyword_intent, llm_latency)
                 return keyword_intent
 
         if metrics_ctx: metrics_ctx.set_flag("llm_success", True)
+        # 逾時 / 例外的結果不快取，下次仍會重試 LLM
+        intent_cache.put(cache_key, result, keyword_intent, llm_latency)
         return result
 
     except Exception as e:
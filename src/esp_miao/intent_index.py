@@ -0,0 +1,164 @@
+"""Embedding nearest-neighbour intent lookup between keyword matching and the LLM."""
+
+import asyncio
+import logging
+import time
+from typing import Awaitable, Callable, Optional
+
+import numpy as np
+import ollama
+
+from .config import (
+    INTENT_EMBED_MODEL, INTENT_INDEX_MIN_SIMILARITY, INTENT_INDEX_MARGIN, INTENT_INDEX_MAX_EXEMPLARS,
+    LLM_TIMEOUT_S, LLM_KEEP_ALIVE,
+)
+from .connection import DynamicDeviceTable, device_table
+
+logger = logging.getLogger("esp-miao.intent_index")
+
+# 文字清單 -> 每段文字的嵌入向量
+Embedder = Callable[[list[str]], Awaitable[list[list[float]]]]
+
+_embed_client: Optional[ollama.AsyncClient] = None
+
+
+async def ollama_embed(texts: list[str]) -> list[list[float]]:
+    """以 Ollama 嵌入模型批次取得向量（與 LLM 同一個 Ollama 服務，模型常駐 LLM_KEEP_ALIVE）。"""
+    global _embed_client
+    if _embed_client is None:
+        _embed_client = ollama.AsyncClient()
+    response = await _embed_client.embed(model=INTENT_EMBED_MODEL, input=texts, keep_alive=LLM_KEEP_ALIVE)
+    return response["embeddings"]
+
+
+def build_exemplars(table: DynamicDeviceTable = device_table) -> list[tuple[str, dict]]:
+    """裝置名稱 / 別名 × 該裝置的動作關鍵字 → (指令範例, 意圖)。
+
+    中文關鍵字產生「打開電燈」「把電燈打開」兩種語序；英文關鍵字只搭配英文名稱。
+    """
+    exemplars: list[tuple[str, dict]] = []
+    for device in table.devices:
+        names = [device.name] + list(device.aliases or [])
+        for value, words in table.get_action_keywords(device.name).items():
+            intent = {"action": "relay_set", "target": device.name, "value": value}
+            for word in words:
+                for name in names:
+                    if word.isascii():
+                        if name.isascii():
+                            exemplars.append((f"{word} {name}", intent))
+                    elif not name.isascii():
+                        exemplars.append((f"{word}{name}", intent))
+                        exemplars.append((f"把{name}{word}", intent))
+    return exemplars[:INTENT_INDEX_MAX_EXEMPLARS]
+
+
+def _unit(vectors: np.ndarray) -> np.ndarray:
+    norms = np.linalg.norm(vectors, axis=1, keepdims=True)
+    return vectors / np.maximum(norms, 1e-12)
+
+
+class IntentIndex:
+    """指令範例的嵌入向量（記憶體內，逐一內積即可：範例數在數千以內）。
+
+    裝置表 vocab_version 變更後由 refresh() 整批重新嵌入（預熱時呼叫）；查詢時發現索引過期，
+    本次不比對、改在背景重建，不讓請求等待整批嵌入。
+    接受條件：最像的範例相似度 ≥ INTENT_INDEX_MIN_SIMILARITY，且比最像的「不同意圖」範例
+    高出 INTENT_INDEX_MARGIN（「打開電燈」與「關掉電燈」的向量很接近）。
+    """
+
+    def __init__(self, embed: Embedder = ollama_embed, table: DynamicDeviceTable = device_table):
+        self.embed = embed
+        self.table = table
+        self.version = -1
+        # (單位向量矩陣, 範例文字, 意圖, 意圖編號)，整組替換，查詢端不需加鎖
+        self._data: Optional[tuple[np.ndarray, list[str], list[dict], np.ndarray]] = None
+        self._lock = asyncio.Lock()
+        self._refresh_task: Optional[asyncio.Task] = None
+        self.rebuilds = 0
+        self.build_s: Optional[float] = None
+        self.hits = 0
+        self.misses = 0
+
+    @property
+    def ready(self) -> bool:
+        return self._data is not None and self.version == self.table.vocab_version
+
+    async def refresh(self) -> Optional[float]:
+        """重新嵌入所有範例（一次批次請求）；已是最新時不做事。回傳耗時秒數。"""
+        async with self._lock:
+            version = self.table.vocab_version
+            if self.version == version and self._data is not None:
+                return None
+            exemplars = build_exemplars(self.table)
+            t0 = time.perf_counter()
+            texts = [text for text, _ in exemplars]
+            intents = [intent for _, intent in exemplars]
+            if texts:
+                matrix = _unit(np.asarray(await self.embed(texts), dtype=np.float32))
+            else:
+                matrix = np.zeros((0, 1), dtype=np.float32)
+            ids: dict[tuple, int] = {}
+            labels = np.array([ids.setdefault(tuple(i.values()), len(ids)) for i in intents], dtype=np.int32)
+            self._data = (matrix, texts, intents, labels)
+            self.version = version
+            self.rebuilds += 1
+            self.build_s = round(time.perf_counter() - t0, 3)
+            logger.info(f"Intent index rebuilt: {len(texts)} exemplars (vocab v{version}) in {self.build_s}s")
+            return self.build_s
+
+    def _refresh_in_background(self):
+        if self._refresh_task is None or self._refresh_task.done():
+            self._refresh_task = asyncio.create_task(self._refresh_logged())
+
+    async def _refresh_logged(self):
+        try:
+            await self.refresh()
+        except Exception as e:
+            logger.warning(f"Intent index rebuild failed: {e}")
+
+    async def lookup(self, text: str) -> Optional[dict]:
+        """回傳 {"intent", "similarity", "margin", "exemplar"}；不夠像、索引未就緒或嵌入失敗時回傳 None。"""
+        if not self.ready:
+            self._refresh_in_background()
+            return None
+        matrix, texts, intents, labels = self._data
+        if len(texts) == 0:
+            return None
+        try:
+            vectors = await asyncio.wait_for(self.embed([text]), LLM_TIMEOUT_S)
+        except Exception as e:
+            logger.warning(f"Intent index embedding failed for '{text}': {e}")
+            return None
+        query = _unit(np.asarray(vectors, dtype=np.float32))[0]
+        similarity = matrix @ query
+        best = int(np.argmax(similarity))
+        rivals = similarity[labels != labels[best]]
+        margin = float(similarity[best] - rivals.max()) if len(rivals) else 1.0
+        result = {
+            "intent": dict(intents[best]),
+            "similarity": round(float(similarity[best]), 3),
+            "margin": round(margin, 3),
+            "exemplar": texts[best],
+        }
+        if similarity[best] < INTENT_INDEX_MIN_SIMILARITY or margin < INTENT_INDEX_MARGIN:
+            self.misses += 1
+            logger.debug(f"Intent index miss for '{text}': {result}")
+            return None
+        self.hits += 1
+        logger.info(f"Intent index hit for '{text}' ~ '{result['exemplar']}' ({result['similarity']})")
+        return result
+
+    def snapshot(self) -> dict:
+        data = self._data
+        return {
+            "model": INTENT_EMBED_MODEL,
+            "exemplars": len(data[1]) if data else 0,
+            "vocab_version": self.version,
+            "rebuilds": self.rebuilds,
+            "build_s": self.build_s,
+            "hits": self.hits,
+            "misses": self.misses,
+        }
+
+
+intent_index = IntentIndex()
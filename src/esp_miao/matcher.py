@@ -0,0 +1,178 @@
+"""Multi-pattern keyword matching (Aho-Corasick) for alias / action lookup."""
+
+from collections import deque
+from functools import lru_cache
+from typing import Any, Iterator, NamedTuple, Optional
+
+from pypinyin import Style, lazy_pinyin
+
+
+class Match(NamedTuple):
+    start: int
+    end: int                # exclusive
+    values: tuple           # 此字串登記的所有值（依加入順序）
+
+    @property
+    def length(self) -> int:
+        return self.end - self.start
+
+
+class AhoCorasick:
+    """Aho-Corasick 自動機：一次掃描找出所有模式的所有出現位置。
+
+    建置 O(Σ|pattern|)，掃描 O(|text| + 命中數)，與模式數量無關。
+    add() 之後須呼叫 build()；同一字串可登記多個值。
+    """
+
+    def __init__(self):
+        self._goto: list[dict[str, int]] = [{}]
+        self._fail: list[int] = [0]
+        self._values: list[list[Any]] = [[]]       # 節點本身結尾的模式值
+        self._outputs: list[list[tuple[int, tuple]]] = [[]]  # (模式長度, 值)，含 fail 鏈
+        self._depth: list[int] = [0]
+        self._built = True
+
+    def add(self, pattern: str, value: Any):
+        if not pattern:
+            return
+        node = 0
+        for ch in pattern:
+            nxt = self._goto[node].get(ch)
+            if nxt is None:
+                nxt = len(self._goto)
+                self._goto[node][ch] = nxt
+                self._goto.append({})
+                self._fail.append(0)
+                self._values.append([])
+                self._outputs.append([])
+                self._depth.append(self._depth[node] + 1)
+            node = nxt
+        self._values[node].append(value)
+        self._built = False
+
+    def build(self):
+        """計算 fail 連結並合併輸出（BFS，淺層先完成）。"""
+        queue = deque()
+        for nxt in self._goto[0].values():
+            self._fail[nxt] = 0
+            queue.append(nxt)
+        self._outputs[0] = []
+        while queue:
+            node = queue.popleft()
+            own = [(self._depth[node], tuple(self._values[node]))] if self._values[node] else []
+            self._outputs[node] = own + self._outputs[self._fail[node]]
+            for ch, nxt in self._goto[node].items():
+                f = self._fail[node]
+                while f and ch not in self._goto[f]:
+                    f = self._fail[f]
+                self._fail[nxt] = self._goto[f].get(ch, 0)
+                queue.append(nxt)
+        self._built = True
+
+    def iter_matches(self, text: str) -> Iterator[Match]:
+        """依結尾位置遞增，同一結尾由長到短。"""
+        if not self._built:
+            self.build()
+        node = 0
+        for i, ch in enumerate(text):
+            while node and ch not in self._goto[node]:
+                node = self._fail[node]
+            node = self._goto[node].get(ch, 0)
+            for length, values in self._outputs[node]:
+                yield Match(i + 1 - length, i + 1, values)
+
+    def __bool__(self) -> bool:
+        return bool(self._goto[0])
+
+
+def leftmost_longest(matches) -> Optional[Match]:
+    """重疊時取最左開始者，同一起點取最長（結果與模式登記順序無關）。"""
+    best = None
+    for m in matches:
+        if best is None or m.start < best.start or (m.start == best.start and m.end > best.end):
+            best = m
+    return best
+
+
+def non_overlapping(matches) -> list[Match]:
+    """由左至右反覆取 leftmost_longest，略過與已選重疊者（「燈和風扇」-> 燈、風扇）。"""
+    chosen = []
+    for m in sorted(matches, key=lambda m: (m.start, -m.end)):
+        if not chosen or m.start >= chosen[-1].end:
+            chosen.append(m)
+    return chosen
+
+
+def _is_han(ch: str) -> bool:
+    return "\u4e00" <= ch <= "\u9fff" or "\u3400" <= ch <= "\u4dbf"
+
+
+def pinyin_syllables(text: str) -> list[str]:
+    """每個字元一個不分聲調的音節；非漢字原樣保留，位置與原字串一一對應。"""
+    return lazy_pinyin(text, style=Style.NORMAL, errors=lambda s: list(s))
+
+
+@lru_cache(maxsize=4096)
+def syllable_distance(a: str, b: str) -> int:
+    """兩個音節的字母編輯距離（Levenshtein）。"""
+    prev = list(range(len(b) + 1))
+    for i, ca in enumerate(a, 1):
+        cur = [i]
+        for j, cb in enumerate(b, 1):
+            cur.append(min(prev[j] + 1, cur[j - 1] + 1, prev[j - 1] + (ca != cb)))
+        prev = cur
+    return prev[-1]
+
+
+class PinyinMatcher:
+    """以不分聲調的拼音比對別名 / 關鍵字：Whisper 輸出同音或近音字（「電等」、「關拎」）時仍能命中。
+
+    模式依音節編入 trie；比對時自每個漢字位置沿 trie 前進，音節相同免費，字母差一個的音節
+    計一次編輯。可用的編輯數隨模式長度增加：2 個音節只接受同音，3 個以上最多 max_edits 次
+    （(音節數 - 1) // 2 為上限），避免「打開」與「拉開」這類短詞互相誤判。
+    單一音節的模式（「開」、「燈」）同音字太多，不編入。
+    """
+
+    def __init__(self, max_edits: int = 1):
+        self.max_edits = max_edits
+        # 節點：(子節點 {音節: 節點}, 結尾值)
+        self._root: tuple[dict, list] = ({}, [])
+        self.patterns = 0
+
+    def add(self, pattern: str, value: Any):
+        if len(pattern) < 2 or not all(_is_han(ch) for ch in pattern):
+            return
+        node = self._root
+        for syllable in pinyin_syllables(pattern):
+            node = node[0].setdefault(syllable, ({}, []))
+        node[1].append(value)
+        self.patterns += 1
+
+    def _budget(self, length: int) -> int:
+        return min(self.max_edits, (length - 1) // 2)
+
+    def iter_matches(self, text: str) -> Iterator[Match]:
+        """所有在編輯數內命中的 (起點, 終點, 值)；text 與模式同樣需先去空白、轉小寫。"""
+        if not self._root[0]:
+            return
+        syllables = pinyin_syllables(text)
+        han = [_is_han(ch) for ch in text]
+        for start in range(len(text)):
+            if not han[start]:
+                continue
+            stack = [(self._root, start, 0)]
+            while stack:
+                node, pos, edits = stack.pop()
+                length = pos - start
+                if node[1] and length >= 2 and edits <= self._budget(length):
+                    yield Match(start, pos, tuple(node[1]))
+                if pos >= len(text) or not han[pos]:
+                    continue
+                syllable = syllables[pos]
+                for child_syllable, child in node[0].items():
+                    cost = 0 if child_syllable == syllable else syllable_distance(child_syllable, syllable)
+                    if cost <= 1 and edits + cost <= self.max_edits:
+                        stack.append((child, pos + 1, edits + cost))
+
+    def __bool__(self) -> bool:
+        return bool(self._root[0])
@@ -1,10 +1,21 @@
 from .context import MetricsContext
 from .aggregator import MetricsAggregator
 from .logger import MetricsLogger
+from .blocklog import BlockLogWriter
+from .loop_lag import LoopLagProbe
+from .stream_arrival import StreamArrival
+from ..config import (
+    METRICS_LOG_FORMAT, METRICS_LOG_DIR, METRICS_SEGMENT_MB, METRICS_MAX_SEGMENTS, WAKE_TUNE_WINDOW,
+    LOOP_LAG_INTERVAL_MS, LOOP_STALL_MS,
+)
 
 # Global singletons
-aggregator = MetricsAggregator()
-metrics_logger = MetricsLogger()
+aggregator = MetricsAggregator(wake_window=WAKE_TUNE_WINDOW)
+metrics_logger = MetricsLogger(block_log=BlockLogWriter(
+    METRICS_LOG_DIR, int(METRICS_SEGMENT_MB * (1 << 20)), METRICS_MAX_SEGMENTS,
+) if METRICS_LOG_FORMAT == "blocks" else None)
+
+loop_lag = LoopLagProbe(interval_s=LOOP_LAG_INTERVAL_MS / 1000, stall_s=LOOP_STALL_MS / 1000)
 
 def init_metrics():
     """Start the metrics background writer."""
@@ -1,23 +1,71 @@
 import threading
-from typing import Dict
+from collections import deque
+from typing import Any, Deque, Dict, List, Optional, Tuple
 from .context import MetricsContext
+from .histogram import LatencyHistogram
+
+# Stage name -> MetricsContext latency key recorded into a histogram
+LATENCY_STAGES = {
+    "network": "network_latency",
+    "asr": "asr_latency",
+    "asr_small": "asr_small_latency",   # cascade tiers (ASR_CASCADE_MODEL)
+    "asr_large": "asr_large_latency",
+    "llm": "llm_inference_latency",
+    "dispatch": "dispatch_ack_latency",
+    "total": "total_latency",
+}
+QUANTILES = (0.5, 0.9, 0.95, 0.99)
+# Telemetry "ui" array order (firmware eye_ui_frame_stats_t)
+UI_FRAME_FIELDS = ("frames", "late", "late_max_ms", "render_avg_us", "render_max_us", "push_avg_us", "push_max_us")
+# Telemetry "degrade" array order (firmware InferenceGovernor)
+DEGRADE_FIELDS = ("level", "stride", "noise_suppression", "load_pct", "steps_down", "overruns")
+# Telemetry "weights" array order (firmware model_weights_pin)
+WEIGHTS_FIELDS = ("pinned_bytes", "flash_bytes", "flash_nn_us", "pinned_nn_us")
 
 class MetricsAggregator:
     """
     In-memory aggregator for global statistics.
     Thread-safe counter management.
     """
-    def __init__(self):
+    def __init__(self, wake_window: int = 50):
         self._lock = threading.Lock()
         self.stats = {
             "total_requests": 0,
             "llm_calls": 0,
             "llm_success": 0,
             "keyword_success": 0,
+            "intent_cache_hits": 0,
+            "llm_saved_sum": 0.0,
             "total_latency_sum": 0.0,
             "asr_latency_sum": 0.0,
+            "trimmed_sum": 0.0,
+            "cascade_tried": 0,
+            "cascade_accepted": 0,
+            "dispatch_confirmed": 0,
+            "actuation_sum": 0.0,
             "errors": 0
         }
+        # Latest on-device profiler report per device: stage -> {count, min_us, avg_us, p99_us}
+        self.edge_stages: Dict[str, Dict[str, Dict[str, int]]] = {}
+        # Latest display-task frame profile per device (telemetry "ui")
+        self.edge_ui: Dict[str, Dict[str, Any]] = {}
+        # Latest device-observed server round trip per device (telemetry "server")
+        self.edge_round_trip: Dict[str, Dict[str, Dict[str, int]]] = {}
+        # Latest inference degradation state per device (telemetry "degrade")
+        self.edge_degrade: Dict[str, Dict[str, Any]] = {}
+        # Model weight placement per device (telemetry "weights", measured once at boot)
+        self.edge_weights: Dict[str, Dict[str, Any]] = {}
+        # Latest health report per device, plus the first one seen to expose heap drift
+        self.edge_health: Dict[str, Dict[str, Any]] = {}
+        self._health_baseline: Dict[str, Dict[str, int]] = {}
+        # Latest load report per server node in cluster mode (this node included)
+        self.cluster_nodes: Dict[str, Dict[str, Any]] = {}
+        # Per-stage latency distributions; averages hide the p95/p99 tail
+        self.latency = {stage: LatencyHistogram() for stage in LATENCY_STAGES}
+        # Recent wake outcomes per device: (wake confidence, false wake). A wake whose audio
+        # transcribed to nothing or to no known command is counted as a likely false accept.
+        self.wake_window = max(1, wake_window)
+        self.wake_outcomes: Dict[str, Deque[Tuple[float, bool]]] = {}
 
     def record(self, context: MetricsContext):
         """Update global stats from a finalized context."""
@@ -31,12 +79,37 @@ class MetricsAggregator:
             
             if data.get("keyword_action_found"):
                 self.stats["keyword_success"] += 1
+
+            if data.get("intent_cache_hit"):
+                self.stats["intent_cache_hits"] += 1
+                self.stats["llm_saved_sum"] += data.get("intent_cache_saved_llm", 0.0)
                 
             self.stats["total_latency_sum"] += data.get("total_latency", 0.0)
             self.stats["asr_latency_sum"] += data.get("asr_latency", 0.0)
+            self.stats["trimmed_sum"] += data.get("trimmed_s", 0.0)
+            if data.get("asr_tier"):
+                self.stats["cascade_tried"] += 1
+                if data["asr_tier"] == "small":
+                    self.stats["cascade_accepted"] += 1
+            if data.get("dispatch_confirmed"):
+                self.stats["dispatch_confirmed"] += 1
+                self.stats["actuation_sum"] += data.get("actuation_latency", 0.0)
             
             if data.get("error_type"):
                 self.stats["errors"] += 1
+            # Server-side failures say nothing about the wake itself
+            elif data.get("wake_confidence") is not None:
+                false_wake = bool(data.get("asr_empty") or data.get("not_understood"))
+                outcomes = self.wake_outcomes.get(context.device_id)
+                if outcomes is None:
+                    outcomes = self.wake_outcomes[context.device_id] = deque(maxlen=self.wake_window)
+                outcomes.append((data["wake_confidence"], false_wake))
+
+        # Stages that did not run keep their 0.0 default and are not recorded
+        for stage, key in LATENCY_STAGES.items():
+            value = data.get(key)
+            if value is not None and value > 0:
+                self.latency[stage].record(value)
 
     def snapshot(self) -> Dict[str, float]:
         """Return a snapshot of current stats."""
@@ -47,7 +120,249 @@ class MetricsAggregator:
         return {
             "requests": count,
             "llm_ratio": round(s["llm_calls"] / count if count else 0, 2),
+            "intent_cache_ratio": round(s["intent_cache_hits"] / count if count else 0, 2),
+            "llm_time_saved": round(s["llm_saved_sum"], 3),
             "avg_latency": round(s["total_latency_sum"] / count if count else 0, 3),
             "avg_asr": round(s["asr_latency_sum"] / count if count else 0, 3),
-            "error_rate": round(s["errors"] / count if count else 0, 2)
+            "avg_trimmed": round(s["trimmed_sum"] / count if count else 0, 3),
+            # Share of cascade attempts answered by the small model without escalating
+            "asr_small_hit_ratio": round(
+                s["cascade_accepted"] / s["cascade_tried"] if s["cascade_tried"] else 0, 2
+            ),
+            "avg_actuation": round(
+                s["actuation_sum"] / s["dispatch_confirmed"] if s["dispatch_confirmed"] else 0, 3
+            ),
+            "error_rate": round(s["errors"] / count if count else 0, 2),
+            "latency": self.latency_snapshot(),
+        }
+
+    def latency_snapshot(self) -> Dict[str, Dict[str, float]]:
+        """Per-stage count / sum / max and percentiles, merged across recording threads."""
+        return {stage: h.summary(QUANTILES) for stage, h in self.latency.items()}
+
+    def prometheus_text(self) -> str:
+        """Prometheus text exposition (0.0.4): request counters and per-stage latency summaries."""
+        with self._lock:
+            s = self.stats.copy()
+        lines = [
+            "# HELP esp_miao_requests_total Voice requests processed.",
+            "# TYPE esp_miao_requests_total counter",
+            f"esp_miao_requests_total {s['total_requests']}",
+            "# HELP esp_miao_errors_total Voice requests that ended in an error.",
+            "# TYPE esp_miao_errors_total counter",
+            f"esp_miao_errors_total {s['errors']}",
+            "# HELP esp_miao_llm_calls_total Requests that called the LLM.",
+            "# TYPE esp_miao_llm_calls_total counter",
+            f"esp_miao_llm_calls_total {s['llm_calls']}",
+            "# HELP esp_miao_stage_latency_seconds Per-stage request latency.",
+            "# TYPE esp_miao_stage_latency_seconds summary",
+        ]
+        for stage, summary in self.latency_snapshot().items():
+            for q in QUANTILES:
+                value = summary[f"p{round(q * 100):g}"] if summary["count"] else "NaN"
+                lines.append(f'esp_miao_stage_latency_seconds{{stage="{stage}",quantile="{q}"}} {value}')
+            lines.append(f'esp_miao_stage_latency_seconds_sum{{stage="{stage}"}} {summary["sum"]}')
+            lines.append(f'esp_miao_stage_latency_seconds_count{{stage="{stage}"}} {summary["count"]}')
+        nodes = self.cluster_snapshot()["nodes"]
+        if nodes:
+            lines += [
+                "# HELP esp_miao_node_utilisation Connected devices over capacity per server node.",
+                "# TYPE esp_miao_node_utilisation gauge",
+            ]
+            lines += [f'esp_miao_node_utilisation{{node="{n}"}} {v["utilisation"]}' for n, v in nodes.items()]
+        return "\n".join(lines) + "\n"
+
+    def wake_history(self, device_id: str) -> List[Tuple[float, bool]]:
+        """Recent (confidence, false_wake) outcomes for one device, oldest first."""
+        with self._lock:
+            return list(self.wake_outcomes.get(device_id, ()))
+
+    def reset_wake_history(self, device_id: str):
+        """Start a fresh window, e.g. after the device's thresholds changed."""
+        with self._lock:
+            self.wake_outcomes.pop(device_id, None)
+
+    def wake_snapshot(self) -> Dict[str, Dict[str, float]]:
+        """Per-device wake count and false-wake rate over the current window."""
+        with self._lock:
+            history = {dev: list(o) for dev, o in self.wake_outcomes.items()}
+        return {
+            dev: {
+                "wakes": len(o),
+                "false_wake_rate": round(sum(f for _, f in o) / len(o), 3) if o else 0.0,
+            }
+            for dev, o in history.items()
+        }
+
+    def record_telemetry(self, device_id: str, stages: Dict[str, List[int]]) -> Dict[str, Dict[str, int]]:
+        """Keep the latest device-side stage timing; stages with no samples are dropped."""
+        parsed = {}
+        for name, values in stages.items():
+            if len(values) != 4 or values[0] == 0:
+                continue
+            count, min_us, avg_us, p99_us = values
+            parsed[name] = {"count": count, "min_us": min_us, "avg_us": avg_us, "p99_us": p99_us}
+        with self._lock:
+            self.edge_stages[device_id] = parsed
+        return parsed
+
+    def edge_snapshot(self) -> Dict[str, Dict[str, Dict[str, int]]]:
+        """Return the latest device-side stage timing for every device."""
+        with self._lock:
+            return {dev: {k: v.copy() for k, v in st.items()} for dev, st in self.edge_stages.items()}
+
+    def record_round_trip(self, device_id: str, stages: Dict[str, List[int]]) -> Dict[str, Dict[str, int]]:
+        """Keep the device's view of the server round trip (end of stream -> progress event / reply)."""
+        parsed = {}
+        for name, values in stages.items():
+            if len(values) != 3 or values[0] == 0:
+                continue
+            count, avg_ms, max_ms = values
+            parsed[name] = {"count": count, "avg_ms": avg_ms, "max_ms": max_ms}
+        if parsed:
+            with self._lock:
+                self.edge_round_trip[device_id] = parsed
+        return parsed
+
+    def round_trip_snapshot(self) -> Dict[str, Dict[str, Dict[str, int]]]:
+        """Return the latest device-observed server round trip for every device."""
+        with self._lock:
+            return {dev: {k: v.copy() for k, v in st.items()} for dev, st in self.edge_round_trip.items()}
+
+    def record_ui_frames(self, device_id: str, values: List[int], interval_ms: int) -> Optional[Dict[str, Any]]:
+        """Keep the latest display-task frame profile; fps counts frames actually drawn per second."""
+        if len(values) != len(UI_FRAME_FIELDS):
+            return None
+        ui: Dict[str, Any] = dict(zip(UI_FRAME_FIELDS, values))
+        ui["fps"] = round(ui["frames"] * 1000 / interval_ms, 1) if interval_ms > 0 else 0.0
+        with self._lock:
+            self.edge_ui[device_id] = ui
+        return ui
+
+    def ui_snapshot(self) -> Dict[str, Dict[str, Any]]:
+        """Return the latest display-task frame profile for every device."""
+        with self._lock:
+            return {dev: ui.copy() for dev, ui in self.edge_ui.items()}
+
+    def record_degrade(self, device_id: str, values: List[int]) -> Optional[Dict[str, Any]]:
+        """Keep the latest inference governor state; level > 0 means the device is shedding work."""
+        if len(values) != len(DEGRADE_FIELDS):
+            return None
+        degrade: Dict[str, Any] = dict(zip(DEGRADE_FIELDS, values))
+        degrade["noise_suppression"] = bool(degrade["noise_suppression"])
+        with self._lock:
+            self.edge_degrade[device_id] = degrade
+        return degrade
+
+    def degrade_snapshot(self) -> Dict[str, Dict[str, Any]]:
+        """Return the latest inference degradation state for every device."""
+        with self._lock:
+            return {dev: d.copy() for dev, d in self.edge_degrade.items()}
+
+    def record_weights(self, device_id: str, values: List[int]) -> Optional[Dict[str, Any]]:
+        """Keep the device's weight placement; miss_us is the NN time saved per inference by pinning."""
+        if len(values) != len(WEIGHTS_FIELDS):
+            return None
+        weights: Dict[str, Any] = dict(zip(WEIGHTS_FIELDS, values))
+        weights["miss_us"] = max(0, weights["flash_nn_us"] - weights["pinned_nn_us"])
+        with self._lock:
+            self.edge_weights[device_id] = weights
+        return weights
+
+    def weights_snapshot(self) -> Dict[str, Dict[str, Any]]:
+        """Return the latest model weight placement for every device."""
+        with self._lock:
+            return {dev: w.copy() for dev, w in self.edge_weights.items()}
+
+    def record_health(self, device_id: str, uptime_s: int, heap: Dict[str, List[int]],
+                      stacks: Dict[str, int], cpu: List[int],
+                      power: Optional[List[int]] = None,
+                      contention: Optional[List[list]] = None,
+                      nvs: Optional[List[int]] = None) -> Dict[str, Any]:
+        """Keep the latest device health sample; min_free drift is measured from the first report."""
+        regions = {}
+        for name, values in heap.items():
+            if len(values) != 3:
+                continue
+            free, largest, min_free = values
+            regions[name] = {"free": free, "largest": largest, "min_free": min_free}
+        with self._lock:
+            baseline = self._health_baseline.get(device_id)
+            # A lower uptime means the device rebooted: start a new baseline
+            if baseline is None or uptime_s < self.edge_health.get(device_id, {}).get("uptime_s", 0):
+                baseline = {name: r["min_free"] for name, r in regions.items()}
+                self._health_baseline[device_id] = baseline
+            for name, r in regions.items():
+                r["min_free_drop"] = baseline.get(name, r["min_free"]) - r["min_free"]
+            parsed = {
+                "uptime_s": uptime_s,
+                "heap": regions,
+                "stacks": dict(sorted(stacks.items(), key=lambda kv: kv[1])),
+                "cpu": list(cpu),
+            }
+            # CPU frequency residency over the report interval (older firmware omits it)
+            if power and len(power) == 3 and sum(power) > 0:
+                total = sum(power)
+                parsed["power"] = {
+                    "max_ms": power[0], "awake_ms": power[1], "idle_ms": power[2],
+                    "full_clock_ratio": round(power[0] / total, 3),
+                }
+            # Cross-core blocking edges, longest first (only with CONFIG_ESP_MIAO_CONTENTION_MAP)
+            edges = [
+                {"resource": e[0], "holder": e[1], "waiter": e[2], "count": e[3],
+                 "total_us": e[4], "max_us": e[5], "inversions": e[6]}
+                for e in contention or [] if len(e) == 7
+            ]
+            if edges:
+                parsed["contention"] = edges
+            # NVS write-behind batches in the interval (deferral, flash cache busy time, failed keys;
+            # older firmware sends no failure count)
+            if nvs and len(nvs) in (8, 9) and nvs[1] > 0:
+                parsed["nvs"] = dict(zip(
+                    ("writes", "batches", "forced", "coalesced", "defer_max_ms", "defer_avg_ms",
+                     "busy_max_us", "busy_total_us", "failed"), list(nvs) + [0]))
+            self.edge_health[device_id] = parsed
+        return parsed
+
+    def health_snapshot(self) -> Dict[str, Dict[str, Any]]:
+        """Return the latest health sample for every device."""
+        with self._lock:
+            return {
+                dev: {
+                    "uptime_s": h["uptime_s"],
+                    "heap": {k: v.copy() for k, v in h["heap"].items()},
+                    "stacks": h["stacks"].copy(),
+                    "cpu": list(h["cpu"]),
+                    **({"power": h["power"].copy()} if "power" in h else {}),
+                    **({"contention": [e.copy() for e in h["contention"]]} if "contention" in h else {}),
+                    **({"nvs": h["nvs"].copy()} if "nvs" in h else {}),
+                }
+                for dev, h in self.edge_health.items()
+            }
+
+    def record_node(self, node_id: str, devices: int, streams: int, capacity: int):
+        """Keep the latest load report of one server node; utilisation = devices / capacity."""
+        with self._lock:
+            self.cluster_nodes[node_id] = {
+                "devices": devices,
+                "streams": streams,
+                "capacity": capacity,
+                "utilisation": round(devices / capacity, 3) if capacity > 0 else 0.0,
+            }
+
+    def forget_node(self, node_id: str):
+        """Drop a node that left the cluster or stopped reporting."""
+        with self._lock:
+            self.cluster_nodes.pop(node_id, None)
+
+    def cluster_snapshot(self) -> Dict[str, Any]:
+        """Per-node load plus cluster-wide utilisation (all devices over all capacity)."""
+        with self._lock:
+            nodes = {n: v.copy() for n, v in self.cluster_nodes.items()}
+        capacity = sum(v["capacity"] for v in nodes.values())
+        return {
+            "nodes": nodes,
+            "devices": sum(v["devices"] for v in nodes.values()),
+            "streams": sum(v["streams"] for v in nodes.values()),
+            "utilisation": round(sum(v["devices"] for v in nodes.values()) / capacity, 3) if capacity else 0.0,
         }
@@ -0,0 +1,158 @@
+import json
+import logging
+import os
+import struct
+import time
+import zlib
+from pathlib import Path
+from typing import Dict, Iterator, List, Optional
+
+logger = logging.getLogger("esp-miao.metrics")
+
+# Block = header + zlib-compressed JSON lines. The header carries the block's time range,
+# so a reader can skip blocks outside its window without decompressing them.
+MAGIC = b"EMB1"
+HEADER = struct.Struct("<4sIIII")  # magic, payload bytes, record count, first ts, last ts (epoch s)
+SEGMENT_SUFFIX = ".emb"
+INDEX_NAME = "index.json"
+
+
+def _segment_name(number: int) -> str:
+    return f"metrics-{number:06d}{SEGMENT_SUFFIX}"
+
+
+def _scan_segment(path: Path) -> Dict:
+    """Walk block headers only; returns the segment's index entry (bytes = end of the last whole block)."""
+    entry = {"file": path.name, "first_ts": None, "last_ts": None, "records": 0, "bytes": 0}
+    size = path.stat().st_size
+    with open(path, "rb") as f:
+        offset = 0
+        while offset + HEADER.size <= size:
+            magic, length, count, first, last = HEADER.unpack(f.read(HEADER.size))
+            if magic != MAGIC or offset + HEADER.size + length > size:
+                break
+            f.seek(length, os.SEEK_CUR)
+            offset += HEADER.size + length
+            entry["first_ts"] = first if entry["first_ts"] is None else min(entry["first_ts"], first)
+            entry["last_ts"] = last if entry["last_ts"] is None else max(entry["last_ts"], last)
+            entry["records"] += count
+            entry["bytes"] = offset
+    return entry
+
+
+def load_index(directory: Path) -> List[Dict]:
+    """Segment entries oldest first; rebuilt from the segment files when the index is missing or stale."""
+    directory = Path(directory)
+    files = sorted(p.name for p in directory.glob(f"metrics-*{SEGMENT_SUFFIX}"))
+    try:
+        with open(directory / INDEX_NAME, "r", encoding="utf-8") as f:
+            segments = json.load(f)["segments"]
+        if [s["file"] for s in segments] == files:
+            return segments
+    except (OSError, ValueError, KeyError):
+        pass
+    return [_scan_segment(directory / name) for name in files]
+
+
+class BlockLogWriter:
+    """
+    Size-bounded, rotating metrics log.
+    Each flush appends one compressed block to the current segment; a segment that would
+    exceed segment_bytes is closed and a new one started, and only the newest max_segments
+    are kept. index.json lists every segment's time range so analysis can open only the
+    segments (and, via block headers, only the blocks) that overlap the window it wants.
+    """
+    def __init__(self, directory: Path, segment_bytes: int = 8 << 20, max_segments: int = 16):
+        self.directory = Path(directory)
+        self.segment_bytes = segment_bytes
+        self.max_segments = max(1, max_segments)
+        self.segments: List[Dict] = []
+        self._file = None
+
+    def open(self):
+        self.directory.mkdir(parents=True, exist_ok=True)
+        self.segments = load_index(self.directory)
+        if self.segments:
+            # Resume the newest segment, dropping a block torn by a crash mid-write
+            current = _scan_segment(self.directory / self.segments[-1]["file"])
+            self.segments[-1] = current
+            self._file = open(self.directory / current["file"], "r+b")
+            self._file.truncate(current["bytes"])
+            self._file.seek(current["bytes"])
+
+    def close(self):
+        if self._file is not None:
+            self._file.close()
+            self._file = None
+
+    def write_block(self, records: List[Dict]):
+        if not records:
+            return
+        lines = "\n".join(json.dumps(r, ensure_ascii=False, separators=(",", ":")) for r in records)
+        payload = zlib.compress(lines.encode("utf-8"), 6)
+        now = int(time.time())
+        stamps = [int(r.get("timestamp") or now) for r in records]
+        block = HEADER.pack(MAGIC, len(payload), len(records), min(stamps), max(stamps)) + payload
+
+        if self._file is None or (self.segments[-1]["bytes"] and
+                                  self.segments[-1]["bytes"] + len(block) > self.segment_bytes):
+            self._rotate()
+        self._file.write(block)
+        self._file.flush()
+
+        current = self.segments[-1]
+        current["first_ts"] = min(stamps) if current["first_ts"] is None else min(current["first_ts"], *stamps)
+        current["last_ts"] = max(stamps) if current["last_ts"] is None else max(current["last_ts"], *stamps)
+        current["records"] += len(records)
+        current["bytes"] += len(block)
+        self._save_index()
+
+    def _rotate(self):
+        self.close()
+        number = int(self.segments[-1]["file"][8:14]) + 1 if self.segments else 1
+        name = _segment_name(number)
+        self._file = open(self.directory / name, "wb")
+        self.segments.append({"file": name, "first_ts": None, "last_ts": None, "records": 0, "bytes": 0})
+        while len(self.segments) > self.max_segments:
+            oldest = self.segments.pop(0)
+            try:
+                (self.directory / oldest["file"]).unlink()
+            except OSError as e:
+                logger.warning(f"Failed to remove old metrics segment {oldest['file']}: {e}")
+
+    def _save_index(self):
+        tmp = self.directory / (INDEX_NAME + ".tmp")
+        with open(tmp, "w", encoding="utf-8") as f:
+            json.dump({"segments": self.segments}, f)
+        os.replace(tmp, self.directory / INDEX_NAME)
+
+
+def read_records(directory: Path, since: Optional[float] = None,
+                 until: Optional[float] = None) -> Iterator[Dict]:
+    """Yield records with since <= timestamp <= until, decompressing only overlapping blocks."""
+    directory = Path(directory)
+    for segment in load_index(directory):
+        if segment["records"] == 0:
+            continue
+        if (since is not None and segment["last_ts"] < since) or (until is not None and segment["first_ts"] > until):
+            continue
+        with open(directory / segment["file"], "rb") as f:
+            while True:
+                header = f.read(HEADER.size)
+                if len(header) < HEADER.size:
+                    break
+                magic, length, count, first, last = HEADER.unpack(header)
+                if magic != MAGIC:
+                    logger.warning(f"Corrupt block in {segment['file']}, skipping rest of segment")
+                    break
+                if (since is not None and last < since) or (until is not None and first > until):
+                    f.seek(length, os.SEEK_CUR)
+                    continue
+                payload = f.read(length)
+                if len(payload) < length:
+                    break
+                for line in zlib.decompress(payload).decode("utf-8").split("\n"):
+                    record = json.loads(line)
+                    ts = record.get("timestamp", first)
+                    if (since is None or ts >= since) and (until is None or ts <= until):
+                        yield record
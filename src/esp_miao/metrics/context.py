@@ -30,6 +30,8 @@ class MetricsContext:
             "error_type": None,
             "total_latency": 0.0
         }
+        # Wall-clock points (epoch ms) on the request timeline, device and server stages alike
+        self._events: Dict[str, float] = {}
 
     def mark_stage(self, name: str, value: Any):
         """Record a generic stage value."""
@@ -43,6 +45,17 @@ class MetricsContext:
         """Record a latency measurement."""
         self.data[key] = seconds
 
+    def mark_event(self, name: str, epoch_ms: Optional[float] = None):
+        """Record a point on the request timeline (defaults to now)."""
+        self._events[name] = time.time() * 1000 if epoch_ms is None else epoch_ms
+
+    def merge_device_trace(self, trace_id: Optional[str], events: Dict[str, float]):
+        """Add device-side stages (already converted to wall-clock ms) under the device's trace id."""
+        if trace_id is not None:
+            self.data["trace_id"] = trace_id
+        for name, epoch_ms in events.items():
+            self.mark_event(name, epoch_ms)
+
     def set_error(self, error: str):
         """Record an error type."""
         self.data["error_type"] = str(error)
@@ -54,6 +67,16 @@ class MetricsContext:
         """
         end_time = time.time()
         self.data["total_latency"] = round(end_time - self.start_time, 3)
+
+        # Timeline as ms offsets from the earliest point (the device's wake when traced)
+        if self._events:
+            self._events.setdefault("request", self.start_time * 1000)
+            self._events["done"] = end_time * 1000
+            origin = min(self._events.values())
+            self.data["timeline_origin_ms"] = int(origin)
+            self.data["timeline"] = {
+                name: round(t - origin, 1) for name, t in sorted(self._events.items(), key=lambda kv: kv[1])
+            }
         
         # Ensure timestamp is integer for JSON compatibility
         if "timestamp" in self.data and isinstance(self.data["timestamp"], float):
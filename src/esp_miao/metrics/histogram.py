@@ -0,0 +1,105 @@
+import math
+import threading
+from typing import Dict, Iterable, List, Tuple
+
+
+class _Shard:
+    """One thread's counts; only the owning thread writes, snapshots only read."""
+    __slots__ = ("counts", "count", "total", "max")
+
+    def __init__(self, buckets: int):
+        self.counts = [0] * buckets
+        self.count = 0
+        self.total = 0.0
+        self.max = 0.0
+
+
+class LatencyHistogram:
+    """
+    Log-bucketed (HDR-style) latency histogram.
+    Buckets grow geometrically by 2^(1/sub_buckets) from min_s to max_s, so every
+    percentile is reported within ~4.4% (sub_buckets=16) regardless of magnitude.
+    Each recording thread gets its own shard, so record() takes no lock; shards are
+    merged when a snapshot is taken.
+    """
+    def __init__(self, min_s: float = 1e-4, max_s: float = 300.0, sub_buckets: int = 16):
+        self.min_s = min_s
+        self.sub_buckets = sub_buckets
+        # Bucket 0 holds values below min_s; the last bucket also absorbs anything above max_s
+        self.buckets = int(math.ceil(math.log2(max_s / min_s) * sub_buckets)) + 2
+        self._local = threading.local()
+        self._shards: List[_Shard] = []
+        self._register_lock = threading.Lock()
+
+    def _shard(self) -> _Shard:
+        shard = getattr(self._local, "shard", None)
+        if shard is None:
+            shard = _Shard(self.buckets)
+            with self._register_lock:
+                self._shards.append(shard)
+            self._local.shard = shard
+        return shard
+
+    def bucket_index(self, seconds: float) -> int:
+        if seconds < self.min_s:
+            return 0
+        index = int(math.log2(seconds / self.min_s) * self.sub_buckets) + 1
+        return min(index, self.buckets - 1)
+
+    def upper_bound(self, index: int) -> float:
+        """Upper edge of a bucket (percentiles report this, so they never understate)."""
+        return self.min_s * 2 ** (index / self.sub_buckets)
+
+    def record(self, seconds: float):
+        shard = self._shard()
+        shard.counts[self.bucket_index(seconds)] += 1
+        shard.count += 1
+        shard.total += seconds
+        if seconds > shard.max:
+            shard.max = seconds
+
+    def merged(self) -> Tuple[List[int], int, float, float]:
+        """Return (counts, count, sum, max) summed over all thread shards."""
+        with self._register_lock:
+            shards = list(self._shards)
+        counts = [0] * self.buckets
+        count, total, peak = 0, 0.0, 0.0
+        for shard in shards:
+            for i, c in enumerate(shard.counts):
+                if c:
+                    counts[i] += c
+            count += shard.count
+            total += shard.total
+            peak = max(peak, shard.max)
+        return counts, count, total, peak
+
+    def percentiles(self, quantiles: Iterable[float]) -> Dict[str, float]:
+        """Quantiles (e.g. 0.95) -> latency in seconds, capped at the largest value seen."""
+        counts, count, total, peak = self.merged()
+        return self._percentiles(counts, count, peak, quantiles)
+
+    def _percentiles(self, counts: List[int], count: int, peak: float,
+                     quantiles: Iterable[float]) -> Dict[str, float]:
+        result = {}
+        for q in quantiles:
+            if not count:
+                result[str(q)] = 0.0
+                continue
+            rank = max(1, math.ceil(q * count))
+            seen = 0
+            for i, c in enumerate(counts):
+                seen += c
+                if seen >= rank:
+                    result[str(q)] = round(min(self.upper_bound(i), peak), 4)
+                    break
+        return result
+
+    def summary(self, quantiles: Iterable[float] = (0.5, 0.95, 0.99)) -> Dict[str, float]:
+        counts, count, total, peak = self.merged()
+        return {
+            "count": count,
+            "sum": round(total, 4),
+            "max": round(peak, 4),
+            **{f"p{round(float(q) * 100):g}": v
+               for q, v in zip(quantiles, self._percentiles(counts, count, peak, quantiles).values())},
+        }
@@ -4,17 +4,22 @@ import queue
 import time
 import logging
 from pathlib import Path
-from typing import Dict, Any
+from typing import Dict, Any, Optional
+from .blocklog import BlockLogWriter
 
 logger = logging.getLogger("esp-miao.metrics")
 
 class MetricsLogger:
     """
-    Async JSONL writer using a background thread and queue.
+    Async metrics writer using a background thread and queue.
     Ensures main loop is never blocked by file I/O.
+    With a block_log each flush becomes one compressed, time-indexed block in a rotating
+    segment log; otherwise records are appended to log_path as JSON lines.
     """
-    def __init__(self, log_path: str = "metrics.jsonl", flush_interval: int = 2):
+    def __init__(self, log_path: str = "metrics.jsonl", flush_interval: int = 2,
+                 block_log: Optional[BlockLogWriter] = None):
         self.log_path = Path(log_path)
+        self.block_log = block_log
         self.queue: queue.Queue = queue.Queue()
         self.flush_interval = flush_interval
         self._stop_event = threading.Event()
@@ -25,14 +30,19 @@ class MetricsLogger:
         """Start the background writer thread."""
         if not self._thread.is_alive():
             self._stop_event.clear()
+            if self.block_log is not None:
+                self.block_log.open()
             self._thread.start()
-            logger.info(f"Metrics logger started. Writing to {self.log_path}")
+            target = self.block_log.directory if self.block_log is not None else self.log_path
+            logger.info(f"Metrics logger started. Writing to {target}")
 
     def stop(self):
         """Stop the writer thread gracefully."""
         self._stop_event.set()
         if self._thread.is_alive():
             self._thread.join(timeout=2.0)
+        if self.block_log is not None:
+            self.block_log.close()
         logger.info("Metrics logger stopped.")
 
     def log(self, data: Dict[str, Any]):
@@ -73,6 +83,9 @@ class MetricsLogger:
             return
             
         try:
+            if self.block_log is not None:
+                self.block_log.write_block(buffer)
+                return
             with open(self.log_path, "a", encoding="utf-8") as f:
                 for item in buffer:
                     f.write(json.dumps(item, ensure_ascii=False) + "\n")
@@ -0,0 +1,173 @@
+import asyncio
+import logging
+import sys
+import threading
+import time
+import traceback
+from collections import deque
+from typing import Any, Deque, Dict, List, Optional, Tuple
+
+from .histogram import LatencyHistogram
+
+logger = logging.getLogger("esp-miao.metrics")
+
+LAG_QUANTILES = (0.5, 0.9, 0.99)
+STACK_FRAMES = 12   # 每次停頓保留的最內層 frame 數
+
+
+class LoopLagProbe:
+    """
+    Samples event-loop responsiveness: a task sleeps interval_s and records how late it woke.
+    A late wake-up of lag seconds means the loop ran nothing else during [woke - lag, woke],
+    so lag_between() tells how much of a given interval the server itself was stalled.
+
+    With stall_s > 0 a watchdog thread also watches the task's heartbeat: once the loop has
+    not come back for stall_s, it snapshots the loop thread's stack (the blocking call is
+    still on it) and the asyncio task that was running, logs them, and keeps the last few.
+    """
+    def __init__(self, interval_s: float = 0.02, min_lag_s: float = 0.01, stall_s: float = 0.0,
+                 history: int = 512, keep_stalls: int = 8):
+        self.interval_s = interval_s
+        self.min_lag_s = min_lag_s
+        self.stall_s = stall_s
+        self.max_lag_s = 0.0
+        self.histogram = LatencyHistogram(min_s=1e-4, max_s=60.0)
+        self.stall_count = 0
+        self.recent_stalls: Deque[Dict[str, Any]] = deque(maxlen=keep_stalls)
+        self._stalls: Deque[Tuple[float, float]] = deque(maxlen=history)   # (woke, lag)
+        self._task: Optional[asyncio.Task] = None
+        self._loop: Optional[asyncio.AbstractEventLoop] = None
+        self._loop_thread: Optional[int] = None
+        self._beat = 0.0                   # 取樣 Task 最近一次醒來（monotonic）
+        self._open_stall: Optional[Dict[str, Any]] = None   # 監看執行緒已抓取、loop 尚未恢復的停頓
+        self._watchdog: Optional[threading.Thread] = None
+        self._stop = threading.Event()
+
+    def start(self):
+        """Start sampling on the running loop (and the watchdog thread when stall_s > 0)."""
+        if self._task is not None:
+            return
+        self._loop = asyncio.get_running_loop()
+        self._loop_thread = threading.get_ident()
+        self._beat = time.monotonic()
+        self._task = self._loop.create_task(self._run(), name="loop_lag_probe")
+        if self.stall_s > 0:
+            self._stop.clear()
+            self._watchdog = threading.Thread(target=self._watch, name="loop-stall-watchdog", daemon=True)
+            self._watchdog.start()
+
+    def stop(self):
+        if self._task is not None:
+            self._task.cancel()
+            self._task = None
+        self._stop.set()
+        if self._watchdog is not None:
+            self._watchdog.join(timeout=1.0)
+            self._watchdog = None
+
+    async def _run(self):
+        while True:
+            due = time.monotonic() + self.interval_s
+            await asyncio.sleep(self.interval_s)
+            woke = time.monotonic()
+            self._beat = woke
+            self.record(woke, woke - due)
+
+    def record(self, woke: float, lag: float):
+        lag = max(lag, 0.0)
+        self.histogram.record(lag)
+        stall = self._open_stall
+        if stall is not None:
+            self._open_stall = None
+            stall["lag_ms"] = round(lag * 1000, 1)   # 停頓結束：補上完整長度
+            logger.warning(f"Event loop stall ended after {stall['lag_ms']}ms (task {stall['task']})")
+        if lag >= self.min_lag_s:
+            self._stalls.append((woke, lag))
+            self.max_lag_s = max(self.max_lag_s, lag)
+
+    def lag_between(self, start: float, end: float) -> float:
+        """Seconds of [start, end] (monotonic) during which the loop was stalled."""
+        total = 0.0
+        for woke, lag in reversed(self._stalls):
+            if woke <= start:
+                break
+            total += max(0.0, min(end, woke) - max(start, woke - lag))
+        return total
+
+    # --- watchdog thread ---
+
+    def _watch(self):
+        poll = max(self.stall_s / 4, 0.005)
+        while not self._stop.wait(poll):
+            beat = self._beat
+            late = time.monotonic() - beat - self.interval_s
+            if late < self.stall_s or self._open_stall is not None:
+                continue
+            stall = self.capture_stall(late)
+            if stall is None:
+                continue
+            # 取樣 Task 在抓取期間已醒來：停頓已結束，只記錄抓到的長度
+            if self._beat == beat:
+                self._open_stall = stall
+            self.stall_count += 1
+            self.recent_stalls.append(stall)
+            logger.warning(
+                f"Event loop blocked for {stall['lag_ms']}ms+ in task {stall['task']}:\n"
+                + "".join(stall["stack"])
+            )
+
+    def capture_stall(self, late_s: float) -> Optional[Dict[str, Any]]:
+        """Stack of the loop thread and the asyncio task it is running right now."""
+        frame = sys._current_frames().get(self._loop_thread)
+        if frame is None:
+            return None
+        stack = traceback.format_stack(frame)[-STACK_FRAMES:]
+        task = None
+        try:
+            current = asyncio.current_task(self._loop)   # 只讀取 loop 的目前 Task 表
+            if current is not None:
+                coro = current.get_coro()
+                task = f"{current.get_name()} ({getattr(coro, '__qualname__', coro)})"
+        except RuntimeError:
+            pass
+        return {
+            "at": round(time.time(), 3),
+            "lag_ms": round(late_s * 1000, 1),
+            "task": task or "<callback>",
+            "stack": stack,
+        }
+
+    # --- export ---
+
+    def snapshot(self) -> Dict[str, Any]:
+        """Lag percentiles since start plus the most recent stalls (innermost frames first)."""
+        summary = self.histogram.summary(LAG_QUANTILES)
+        stalls: List[Dict[str, Any]] = [
+            {**s, "stack": [line.strip() for line in reversed(s["stack"][-4:])]} for s in self.recent_stalls
+        ]
+        return {
+            "samples": summary["count"],
+            **{f"{k}_ms": round(v * 1000, 2) for k, v in summary.items() if k.startswith("p") or k == "max"},
+            "stall_threshold_ms": round(self.stall_s * 1000),
+            "stalls": self.stall_count,
+            "recent_stalls": stalls,
+        }
+
+    def prometheus_text(self) -> str:
+        """Prometheus summary of the loop lag and the stall counter."""
+        summary = self.histogram.summary(LAG_QUANTILES)
+        lines = [
+            "# HELP esp_miao_event_loop_lag_seconds How late the asyncio loop ran a timer it had scheduled.",
+            "# TYPE esp_miao_event_loop_lag_seconds summary",
+        ]
+        for q in LAG_QUANTILES:
+            value = summary[f"p{round(q * 100):g}"] if summary["count"] else "NaN"
+            lines.append(f'esp_miao_event_loop_lag_seconds{{quantile="{q}"}} {value}')
+        lines += [
+            f"esp_miao_event_loop_lag_seconds_sum {summary['sum']}",
+            f"esp_miao_event_loop_lag_seconds_count {summary['count']}",
+            "# HELP esp_miao_event_loop_stalls_total Times the loop was blocked longer than the stall threshold.",
+            "# TYPE esp_miao_event_loop_stalls_total counter",
+            f"esp_miao_event_loop_stalls_total {self.stall_count}",
+        ]
+        return "\n".join(lines) + "\n"
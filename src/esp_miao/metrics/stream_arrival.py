@@ -0,0 +1,86 @@
+from dataclasses import dataclass, field
+from typing import List, Optional
+
+from .loop_lag import LoopLagProbe
+
+
+@dataclass
+class StreamArrival:
+    """
+    Receive-side timing of one WebSocket binary stream (monotonic seconds, taken when receive() returned).
+
+    Each gap longer than stall_s is attributed to whichever side explains at least half of it:
+    server (the read loop was busy with the previous message, or the event loop was stalled),
+    device (the frame's capture timestamp is itself that far from the previous one: pacing or
+    capture) or else network (radio, TCP retransmission, or the device's send blocking; the
+    audio_end link send_max_us separates the last one).
+    """
+
+    sample_rate: int = 16000
+    preroll_samples: int = 0          # pre-roll 一開始就整批送出，不列入即時長度
+    stall_s: float = 0.1
+    probe: Optional[LoopLagProbe] = field(default=None, repr=False)
+    first_rx: Optional[float] = None
+    last_rx: Optional[float] = None
+    chunks: int = 0
+    gaps: List[float] = field(default_factory=list, repr=False)
+    jitter_s: float = 0.0             # RFC 3550 到達抖動（需 chunk 標頭的擷取時間）
+    stalls: dict = field(default_factory=lambda: {"server": 0, "device": 0, "network": 0})
+    stall_total_s: float = 0.0
+    _prev_capture_us: Optional[int] = field(default=None, repr=False)
+    _prev_transit: Optional[float] = field(default=None, repr=False)
+
+    def record(self, rx: float, capture_us: Optional[int] = None, busy_s: float = 0.0):
+        """One binary frame arrived at rx; busy_s = how long the read loop spent on the previous message."""
+        self.chunks += 1
+        if self.first_rx is None:
+            self.first_rx = rx
+        else:
+            gap = rx - self.last_rx
+            self.gaps.append(gap)
+            if gap >= self.stall_s:
+                self.stall_total_s += gap
+                self.stalls[self._stall_cause(gap, capture_us, busy_s)] += 1
+        if capture_us:
+            transit = rx - capture_us / 1e6
+            if self._prev_transit is not None:
+                self.jitter_s += (abs(transit - self._prev_transit) - self.jitter_s) / 16
+            self._prev_transit = transit
+        self._prev_capture_us = capture_us or None
+        self.last_rx = rx
+
+    def _stall_cause(self, gap: float, capture_us: Optional[int], busy_s: float) -> str:
+        server = busy_s
+        if self.probe is not None:
+            server = max(server, self.probe.lag_between(self.last_rx, self.last_rx + gap))
+        if server >= gap / 2:
+            return "server"
+        if capture_us and self._prev_capture_us and (capture_us - self._prev_capture_us) / 1e6 >= gap / 2:
+            return "device"
+        return "network"
+
+    def summary(self, total_samples: int) -> dict:
+        """Metrics fields for a stream of total_samples; durations in ms."""
+        gaps = sorted(self.gaps)
+
+        def pct(p: float) -> float:
+            return round(gaps[min(len(gaps) - 1, int(p * len(gaps)))] * 1000, 1) if gaps else 0.0
+
+        rx_ms = (self.last_rx - self.first_rx) * 1000 if self.chunks > 1 else 0.0
+        live_ms = max(total_samples - self.preroll_samples, 0) * 1000 / self.sample_rate
+        return {
+            "chunks": self.chunks,
+            "duration_ms": round(rx_ms, 1),
+            "audio_ms": round(live_ms, 1),
+            # 即時串流約 1.0；明顯大於 1 = 送得比擷取慢（鏈路或裝置端節奏）
+            "realtime_ratio": round(rx_ms / live_ms, 3) if live_ms > 0 else None,
+            "gap_p50_ms": pct(0.5),
+            "gap_p95_ms": pct(0.95),
+            "gap_max_ms": round(gaps[-1] * 1000, 1) if gaps else 0.0,
+            "jitter_ms": round(self.jitter_s * 1000, 1),
+            "stalls": sum(self.stalls.values()),
+            "stall_ms": round(self.stall_total_s * 1000, 1),
+            "stalls_server": self.stalls["server"],
+            "stalls_device": self.stalls["device"],
+            "stalls_network": self.stalls["network"],
+        }
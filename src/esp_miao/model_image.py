@@ -0,0 +1,82 @@
+"""Wake word model images offered to devices (model partition update without reflashing)."""
+
+import logging
+import struct
+import zlib
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Optional
+
+from .config import MODEL_IMAGE
+
+logger = logging.getLogger("esp-miao.model_image")
+
+# 對應韌體 logic/model_store.h ModelImageHeader（32 bytes，little-endian）+ 酬載
+MODEL_HEADER = struct.Struct("<4sHHIIIIfI")
+MODEL_MAGIC = b"MMDL"
+MODEL_SLOT_BYTES = 0x8000   # 韌體 MODEL_SLOT_BYTES：超過則裝置無法寫入
+
+
+class ModelImageError(ValueError):
+    """檔案不是可提供給裝置的模型映像。"""
+
+
+@dataclass(frozen=True)
+class ModelImage:
+    path: Path
+    generation: int
+    size: int
+    crc32: int
+    layout: int
+
+
+def parse_model_image(path: Path, data: bytes) -> ModelImage:
+    """驗證 header 與酬載 CRC（裝置下載後也會再驗證一次）。"""
+    if len(data) < MODEL_HEADER.size or len(data) > MODEL_SLOT_BYTES:
+        raise ModelImageError(f"{path}: {len(data)} bytes does not fit a model slot")
+    magic, fmt, _, layout, generation, payload_bytes, crc32, _, _ = MODEL_HEADER.unpack_from(data)
+    if magic != MODEL_MAGIC or fmt != 1:
+        raise ModelImageError(f"{path}: unknown model image format {magic!r} v{fmt}")
+    payload = data[MODEL_HEADER.size:]
+    if len(payload) != payload_bytes or zlib.crc32(payload) != crc32:
+        raise ModelImageError(f"{path}: payload size / CRC mismatch")
+    if generation < 1:
+        raise ModelImageError(f"{path}: generation must be >= 1")
+    return ModelImage(path=path, generation=generation, size=len(data), crc32=crc32, layout=layout)
+
+
+class ModelImageStore:
+    """MODEL_IMAGE 的目前版本（檔案更新時重新讀取，替換檔案即可推出新模型）。"""
+
+    def __init__(self, path: str = MODEL_IMAGE):
+        self.path = Path(path) if path else None
+        self._cached: Optional[ModelImage] = None
+        self._mtime: Optional[float] = None
+        self._offered: dict[str, int] = {}   # device_id → 已推送的 generation
+
+    def current(self) -> Optional[ModelImage]:
+        if self.path is None or not self.path.is_file():
+            return None
+        mtime = self.path.stat().st_mtime
+        if mtime != self._mtime:
+            self._mtime = mtime
+            try:
+                self._cached = parse_model_image(self.path, self.path.read_bytes())
+                logger.info(f"Model image generation {self._cached.generation} ({self._cached.size} bytes)")
+            except ModelImageError as e:
+                logger.error(str(e))
+                self._cached = None
+        return self._cached
+
+    def offer(self, device_id: str, reported: Optional[int]) -> Optional[ModelImage]:
+        """裝置回報的 generation 較舊時回傳要推送的映像；每個 generation 對每台裝置只推送一次。"""
+        image = self.current()
+        if image is None or reported is None or reported >= image.generation:
+            return None
+        if self._offered.get(device_id) == image.generation:
+            return None
+        self._offered[device_id] = image.generation
+        return image
+
+
+model_images = ModelImageStore()
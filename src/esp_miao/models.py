@@ -165,13 +165,262 @@ class AudioRequest(BaseMessage):
     payload: AudioRequestPayload
 
 
+class WakeDetectedPayload(BaseModel):
+    """Payload announcing a wake word hit (replaces the HTTP /ack round trip)."""
+
+    confidence: Optional[float] = Field(None, ge=0.0, le=1.0, description="Wake word confidence")
+    chirp: bool = Field(False, description="Device already played the wake tone on its own speaker")
+    playback_format: Optional[str] = Field(
+        None, description="Downlink audio format of the device speaker (e.g. adpcm_16k_4bit), None = no speaker"
+    )
+
+
+class WakeDetected(BaseMessage):
+    """ESP32 reports a wake word; the server plays the ack sound."""
+
+    type: Literal["wake_detected"] = "wake_detected"
+    payload: WakeDetectedPayload = Field(default_factory=WakeDetectedPayload)
+
+
+class LinkWarmupPayload(BaseModel):
+    """Payload announcing sustained speech before any wake word (speculative warm-up)."""
+
+    speech_ms: int = Field(0, ge=0, description="Consecutive VAD speech before the warm-up was sent (ms)")
+    vad_energy: Optional[float] = Field(None, ge=0.0, description="FFT peak energy of the triggering slice")
+
+
+class LinkWarmup(BaseMessage):
+    """ESP32 heard speech; the server pre-warms ASR / LLM in case a wake word follows."""
+
+    type: Literal["link_warmup"] = "link_warmup"
+    payload: LinkWarmupPayload = Field(default_factory=LinkWarmupPayload)
+
+
+class ContinuousStartPayload(BaseModel):
+    """Payload opening a continuous (server-side wake word) UDP stream."""
+
+    session_id: int = Field(..., ge=0, le=0xFFFFFFFF, description="session_id in the chunk headers of the datagrams")
+    audio_format: str = Field("adpcm_16k_4bit", description="Encoding of each datagram (one ADPCM block)")
+    sample_rate: int = Field(16000, gt=0, description="Sample rate of the stream")
+    frame_samples: int = Field(0, ge=0, description="Samples per datagram")
+    timer_us: int = Field(0, description="Device esp_timer when the stream opened")
+
+
+class ContinuousStart(BaseMessage):
+    """ESP32 starts streaming VAD speech continuously; the server decides the wake word."""
+
+    type: Literal["continuous_start"] = "continuous_start"
+    payload: ContinuousStartPayload
+
+
+class WakeHintPayload(BaseModel):
+    """Payload of a local wake word detection during continuous streaming."""
+
+    session_id: int = Field(0, ge=0, le=0xFFFFFFFF, description="Continuous stream the hint belongs to")
+    confidence: float = Field(0.0, ge=0.0, le=1.0, description="Local wake word confidence")
+    sample_offset: int = Field(0, ge=0, description="Stream position of the triggering slice (samples)")
+
+
+class WakeHint(BaseMessage):
+    """ESP32 heard its wake word while the server runs the wake decision (used for confirmation)."""
+
+    type: Literal["wake_hint"] = "wake_hint"
+    payload: WakeHintPayload
+
+
+# Reconnect-time histogram bucket upper bounds (ms); the last bucket is ">= 5000"
+RECONNECT_BUCKETS_MS: tuple[int, ...] = (100, 250, 500, 1000, 2000, 5000)
+
+
+class HeartbeatPayload(BaseModel):
+    """Application-level heartbeat carrying the device's connection supervisor stats."""
+
+    seq: int = Field(0, ge=0, description="Heartbeat sequence number")
+    reconnects: int = Field(0, ge=0, description="Successful reconnects after a link loss")
+    failures: int = Field(0, ge=0, description="Failed connect attempts")
+    link_timeouts: int = Field(0, ge=0, description="Links declared dead after missing heartbeats")
+    reconnect_last_ms: int = Field(0, ge=0, description="Most recent link-loss-to-connected time (ms)")
+    reconnect_max_ms: int = Field(0, ge=0, description="Worst link-loss-to-connected time (ms)")
+    reconnect_hist: list[int] = Field(
+        default_factory=list, description="Reconnect-time counts per RECONNECT_BUCKETS_MS bucket"
+    )
+    endpoint: int = Field(0, ge=0, description="Index of the server endpoint in use (priority order)")
+    endpoint_rtt_us: int = Field(-1, description="Last TCP connect probe to that endpoint (us), -1 = not probed")
+    failovers: int = Field(0, ge=0, description="Background switches to a faster endpoint")
+    tls_handshake_ms: int = Field(-1, description="Last TCP + TLS connect time (ms), -1 = plain ws://")
+    tls_resumed: int = Field(0, ge=0, description="TLS connects that offered a cached session ticket")
+
+
+class Heartbeat(BaseMessage):
+    """ESP32 keeps the link warm; the server answers with heartbeat_ack."""
+
+    type: Literal["heartbeat"] = "heartbeat"
+    payload: HeartbeatPayload = Field(default_factory=HeartbeatPayload)
+
+
+# Inference pipeline stages reported by the device profiler, in payload order
+TELEMETRY_STAGES: tuple[str, ...] = ("i2s_wait", "convert", "vad", "mfcc", "nn", "post", "ui", "stage1")
+
+
+class TelemetryPayload(BaseModel):
+    """Per-stage inference timing aggregated on the device over one report interval."""
+
+    seq: int = Field(0, ge=0, description="Report sequence number")
+    interval_ms: int = Field(0, ge=0, description="Length of the aggregation window (ms)")
+    stages: dict[str, list[int]] = Field(
+        default_factory=dict, description="Stage name -> [count, min_us, avg_us, p99_us]"
+    )
+    ui: Optional[list[int]] = Field(
+        None,
+        description="Display task frames over the same window: [frames, late, late_max_ms, "
+                    "render_avg_us, render_max_us, push_avg_us, push_max_us]",
+    )
+    server: dict[str, list[int]] = Field(
+        default_factory=dict,
+        description="Device-observed server round trip, end of stream -> event: "
+                    "stage (asr_started / asr_done / intent_done / dispatched / reply) -> [count, avg_ms, max_ms]",
+    )
+    degrade: Optional[list[int]] = Field(
+        None,
+        description="Inference governor state: [level, stride, noise_suppression, load_pct, "
+                    "steps_down, overruns]; level 0 = full rate",
+    )
+    weights: Optional[list[int]] = Field(
+        None,
+        description="Model weights pinned in internal DRAM at boot: [pinned_bytes, flash_bytes, "
+                    "flash_nn_us, pinned_nn_us]; the NN time difference is the flash cache miss cost per inference",
+    )
+
+
+class Telemetry(BaseMessage):
+    """Periodic on-device profiler report."""
+
+    type: Literal["telemetry"] = "telemetry"
+    payload: TelemetryPayload = Field(default_factory=TelemetryPayload)
+
+
+class HealthPayload(BaseModel):
+    """Periodic heap, stack and CPU sample from the device health monitor."""
+
+    seq: int = Field(0, ge=0, description="Report sequence number")
+    uptime_s: int = Field(0, ge=0, description="Device uptime (s)")
+    heap: dict[str, list[int]] = Field(
+        default_factory=dict, description="Heap region -> [free, largest_free_block, min_free] (bytes)"
+    )
+    stacks: dict[str, int] = Field(
+        default_factory=dict, description="Task name -> minimum stack left since start (bytes)"
+    )
+    cpu: list[int] = Field(default_factory=list, description="Per-core load (%), -1 = not yet measured")
+    power: list[int] = Field(
+        default_factory=list,
+        description="Time (ms) since the last report at full clock / low clock awake / low clock with light sleep",
+    )
+    contention: list[list] = Field(
+        default_factory=list,
+        description="Longest blocking edges since the last report: "
+                    "[resource, holder task, blocked task ('*' = all), count, total_us, max_us, inversions]",
+    )
+    nvs: list[int] = Field(
+        default_factory=list,
+        description="NVS write-behind since the last report: [keys written, batches, forced batches, "
+                    "coalesced writes, max deferral ms, avg deferral ms, max flash busy us, total flash busy us, failed keys (requeued for retry)]; "
+                    "firmware before the failure count sends 8 fields",
+    )
+
+
+class Health(BaseMessage):
+    """Periodic on-device health report."""
+
+    type: Literal["health"] = "health"
+    payload: HealthPayload = Field(default_factory=HealthPayload)
+
+
+class LatencySloPayload(BaseModel):
+    """Wake-to-first-audio-byte latency over the device's recent wakes."""
+
+    state: Literal["degraded", "ok"] = Field(..., description="degraded = p90 above slo_ms, ok = recovered")
+    samples: int = Field(0, ge=0, description="Wakes in the window")
+    slo_ms: int = Field(0, ge=0, description="Configured p90 target (ms)")
+    p50_ms: int = Field(0, ge=0, description="Median wake-to-first-byte latency (ms)")
+    p90_ms: int = Field(0, ge=0, description="p90 wake-to-first-byte latency (ms)")
+    max_ms: int = Field(0, ge=0, description="Worst wake in the window (ms)")
+    stage: str = Field("", description="Stage most over its budget at p90 (queue / link / start / capture / send)")
+    stages_p90_ms: dict[str, int] = Field(default_factory=dict, description="Stage -> p90 duration (ms)")
+
+
+class LatencySlo(BaseMessage):
+    """Device reports that its wake latency SLO was missed or has recovered."""
+
+    type: Literal["latency_slo"] = "latency_slo"
+    payload: LatencySloPayload
+
+
+class FlightRecordPayload(BaseModel):
+    """Previous boot's RTC-memory flight recorder, sent once after a reset."""
+
+    reset_reason: str = Field("unknown", description="esp_reset_reason() of the current boot (task_wdt, panic, ...)")
+    stages_us: dict[str, int] = Field(
+        default_factory=dict, description="Inference stage -> last duration before the reset (us)"
+    )
+    health: list[list[Union[int, str]]] = Field(
+        default_factory=list,
+        description="Oldest first: [uptime_s, heap_free, heap_min, heap_largest, stack_min, stack_task]",
+    )
+    events: list[list[int]] = Field(
+        default_factory=list, description="Oldest first: [t_us (uptime, low 32 bits), core, trace point id, arg]"
+    )
+
+
+class FlightRecord(BaseMessage):
+    """Trace points and health samples that preceded a device reset."""
+
+    type: Literal["flight_record"] = "flight_record"
+    payload: FlightRecordPayload = Field(default_factory=FlightRecordPayload)
+
+
+class TimeSyncRequestPayload(BaseModel):
+    """NTP-style clock probe from the device."""
+
+    seq: int = Field(..., ge=0, description="Request sequence number")
+    t0: int = Field(..., description="Device esp_timer (us) at send time")
+
+
+class TimeSyncRequest(BaseMessage):
+    """ESP32 asks for a round-trip time_sync (offset = ((t1 - t0) + (t2 - t3)) / 2)."""
+
+    type: Literal["time_sync_request"] = "time_sync_request"
+    payload: TimeSyncRequestPayload
+
+
 class AudioStreamStartPayload(BaseModel):
     """Payload to start a chunked audio stream."""
 
     audio_format: str = Field("pcm_16k_16bit", description="Audio format")
-    transfer_mode: Literal["base64", "binary"] = Field("base64", description="Streaming transfer mode")
+    transfer_mode: Literal["base64", "binary", "udp"] = Field(
+        "base64", description="Streaming transfer mode (udp = frames as datagrams to UDP_AUDIO_PORT)"
+    )
     total_samples: int = Field(..., description="Total expected samples")
+    sample_rate: Optional[int] = Field(None, gt=0, description="PCM sample rate in Hz (defaults to audio_format)")
+    preroll_samples: int = Field(0, ge=0, description="Leading samples captured before wake confirmation")
+    frame_samples: int = Field(0, ge=0, description="Samples per streamed frame at sample_rate (0 = unknown)")
+    chunk_header_bytes: int = Field(0, ge=0, description="Per-frame binary header size (0 = raw PCM)")
+    timer_us: Optional[int] = Field(None, description="Device esp_timer value at the message timestamp")
+    clock_err_us: Optional[int] = Field(None, ge=0, description="Device clock uncertainty (half best RTT, 0 = unsynced)")
+    endpointing: bool = Field(False, description="Stream ends with audio_end; total_samples is an upper bound")
+    noise_suppression: bool = Field(False, description="Device applied spectral noise suppression before streaming")
+    session_id: Optional[int] = Field(None, ge=0, description="Stream id carried in each frame header (resumable)")
     confidence: Optional[float] = Field(None, ge=0.0, le=1.0, description="Wake word confidence")
+    trace_id: Optional[str] = Field(
+        None, max_length=32, description="Device-generated id tying wake, stream and server stages together"
+    )
+    wake_threshold: Optional[float] = Field(None, gt=0.0, le=1.0, description="Wake threshold in effect")
+    vad_threshold: Optional[float] = Field(None, gt=0.0, description="VAD threshold floor in effect")
+    tuning_version: Optional[int] = Field(None, ge=0, description="Last applied wake_tuning version (0 = built-in)")
+    model_generation: Optional[int] = Field(
+        None, ge=0, description="Wake word model image in use (0 = weights compiled into the firmware)"
+    )
+    followup: bool = Field(False, description="Opened by the follow-up window after an action, no wake word")
+    followup_of: Optional[str] = Field(None, max_length=32, description="trace_id of the utterance this one follows")
 
 
 class AudioStreamStart(BaseMessage):
@@ -181,6 +430,69 @@ class AudioStreamStart(BaseMessage):
     payload: AudioStreamStartPayload
 
 
+class AudioStreamLinkStats(BaseModel):
+    """Device-side uplink statistics for one stream (adaptive chunk sizing)."""
+
+    rssi: int = Field(0, description="RSSI at stream start (dBm, 0 = unknown)")
+    chunk_start: int = Field(0, ge=0, description="Initial chunk size (samples)")
+    chunk_end: int = Field(0, ge=0, description="Chunk size when the stream ended (samples)")
+    chunk_min: int = Field(0, ge=0)
+    chunk_max: int = Field(0, ge=0)
+    frames: int = Field(0, ge=0, description="Frames with a measured send time")
+    send_avg_us: int = Field(0, ge=0, description="Average per-frame send time (us)")
+    send_max_us: int = Field(0, ge=0, description="Worst per-frame send time (us)")
+    tx_waits: int = Field(0, ge=0, description="Times capture waited for a free TX buffer")
+    pace_min: Optional[int] = Field(None, ge=1, description="Lowest in-flight frame limit set by send pacing")
+    pace_backoffs: int = Field(0, ge=0, description="Times send pacing halved the in-flight limit")
+    resumes: int = Field(0, ge=0, description="Reconnect-and-resume cycles during the stream")
+    udp_dropped: int = Field(0, ge=0, description="UDP frames the device could not send")
+    ring_lag_max: int = Field(0, ge=0, description="Worst lag of the stream reader behind capture (samples)")
+    ring_lost: int = Field(0, ge=0, description="Samples lost in the capture ring (overwritten or held back)")
+
+
+class AudioStreamTrace(BaseModel):
+    """Device-side stage times for one wake session (esp_timer us, same clock as audio_start timer_us)."""
+
+    wake_us: Optional[int] = Field(None, description="Wake word confirmed")
+    ack_us: Optional[int] = Field(None, description="Wake acknowledgement queued")
+    stream_start_us: Optional[int] = Field(None, description="audio_start sent")
+    first_frame_us: Optional[int] = Field(None, description="First audio frame queued for sending")
+    first_sent_us: Optional[int] = Field(None, description="First audio frame handed to the network")
+    last_frame_us: Optional[int] = Field(None, description="Last audio frame sent")
+
+
+class AudioStreamEndPayload(BaseModel):
+    """Payload closing an endpointed audio stream."""
+
+    total_samples: int = Field(..., ge=0, description="Samples actually streamed (including pre-roll)")
+    reason: Optional[str] = Field(
+        None, description="Why the stream ended (silence / max_duration / local_command / server_cancel / user_cancel)"
+    )
+    link: Optional[AudioStreamLinkStats] = Field(None, description="Uplink statistics")
+    trace: Optional[AudioStreamTrace] = Field(None, description="Device stage times for the trace timeline")
+
+
+class AudioStreamEnd(BaseMessage):
+    """ESP32 signals end of an endpointed audio stream."""
+
+    type: Literal["audio_end"] = "audio_end"
+    payload: AudioStreamEndPayload
+
+
+class AudioStreamResumePayload(BaseModel):
+    """Payload asking to continue an interrupted binary stream."""
+
+    session_id: int = Field(..., ge=0, description="session_id from audio_start")
+    seq: int = Field(0, ge=0, description="Sequence number of the next frame the device sends")
+
+
+class AudioStreamResume(BaseMessage):
+    """ESP32 reconnected mid-stream and wants to continue it."""
+
+    type: Literal["audio_resume"] = "audio_resume"
+    payload: AudioStreamResumePayload
+
+
 class AudioStreamChunkPayload(BaseModel):
     """Payload for a single audio chunk."""
 
@@ -242,11 +554,151 @@ class Play(BaseModel):
     payload: PlayPayload
 
 
+class AudioResumeAckPayload(BaseModel):
+    """Payload answering audio_resume."""
+
+    session_id: int = Field(..., ge=0)
+    accepted: bool = Field(..., description="False = stream unknown or expired; device must abort")
+    received_samples: int = Field(0, ge=0, description="Contiguous samples held; resend from here")
+
+
+class AudioResumeAck(BaseMessage):
+    """Server tells the device where to resume an interrupted stream."""
+
+    type: Literal["audio_resume_ack"] = "audio_resume_ack"
+    payload: AudioResumeAckPayload
+
+
+class AudioCancelPayload(BaseModel):
+    """Payload telling a device to stop its stream."""
+
+    reason: Literal["duplicate_wake", "wake_rejected"] = Field(
+        ..., description="Another node's stream of the same wake was kept, or the wake-word window "
+                         "failed server-side verification"
+    )
+    winner: Optional[str] = Field(None, description="Device whose stream is processed instead")
+    session_id: Optional[int] = Field(None, ge=0, description="session_id of the cancelled stream")
+
+
+class AudioCancel(BaseMessage):
+    """Server cancels an in-progress stream; the device stops sending and returns to idle."""
+
+    type: Literal["audio_cancel"] = "audio_cancel"
+    payload: AudioCancelPayload
+
+
+class HeartbeatAckPayload(BaseModel):
+    """Payload answering heartbeat."""
+
+    seq: int = Field(0, ge=0, description="seq of the heartbeat being answered")
+
+
+class HeartbeatAck(BaseMessage):
+    """Server confirms the link is alive."""
+
+    type: Literal["heartbeat_ack"] = "heartbeat_ack"
+    payload: HeartbeatAckPayload
+
+
+class WakeTuningPayload(BaseModel):
+    """Payload with new wake / VAD thresholds for one device."""
+
+    wake_threshold: float = Field(..., gt=0.0, le=1.0, description="Smoothed wake posterior needed to trigger")
+    vad_threshold: float = Field(..., gt=0.0, description="VAD frame threshold floor (band energy)")
+    version: int = Field(..., ge=1, description="Increases with every push; echoed in audio_start")
+    false_wake_rate: float = Field(0.0, ge=0.0, le=1.0, description="Rate that triggered this push")
+
+
+class WakeTuning(BaseMessage):
+    """Server adjusts a device's wake thresholds; the device applies and persists them."""
+
+    type: Literal["wake_tuning"] = "wake_tuning"
+    payload: WakeTuningPayload
+
+
+class FalseWakePayload(BaseModel):
+    """Payload flagging a wake whose utterance turned out to be empty or not understood."""
+
+    trace_id: str = Field(..., description="trace_id of the wake (audio_start), hex")
+    reason: Literal["not_understood"] = Field("not_understood", description="Why the wake was judged false")
+
+
+class FalseWake(BaseMessage):
+    """Server tells the device a wake was false; a device with a clip recorder keeps its audio."""
+
+    type: Literal["false_wake"] = "false_wake"
+    payload: FalseWakePayload
+
+
+class ModelUpdatePayload(BaseModel):
+    """Payload announcing a newer wake word model image (downloaded from GET /model)."""
+
+    generation: int = Field(..., ge=1, description="Image generation; echoed as model_generation in audio_start")
+    size: int = Field(..., gt=0, description="Image size in bytes (header + payload)")
+    crc32: int = Field(..., ge=0, le=0xFFFFFFFF, description="CRC-32 of the image payload")
+
+
+class ModelUpdate(BaseMessage):
+    """Server offers a newer wake word model; the device downloads it into its spare model slot."""
+
+    type: Literal["model_update"] = "model_update"
+    payload: ModelUpdatePayload
+
+
+class ProgressPayload(BaseModel):
+    """Payload reporting how far the server got with the stream the device just finished."""
+
+    stage: Literal["asr_started", "asr_done", "intent_done", "dispatched"] = Field(
+        ..., description="Processing stage just reached"
+    )
+    elapsed_ms: int = Field(0, ge=0, description="Server time since processing of the request started")
+
+
+class Progress(BaseMessage):
+    """Server progress event while the device waits for the reply to its stream."""
+
+    type: Literal["progress"] = "progress"
+    payload: ProgressPayload
+
+
+class ContinuousPayload(BaseModel):
+    """Payload switching a device's continuous streaming (server-side wake word) on or off."""
+
+    enable: bool = Field(..., description="Stream VAD speech continuously over UDP")
+    max_kbps: int = Field(0, ge=0, le=0xFFFF, description="Average uplink cap (kbps, 0 = unlimited)")
+    confirm: bool = Field(False, description="Server also requires the local wake word (wake_hint)")
+
+
+class Continuous(BaseMessage):
+    """Server opt-in for continuous streaming, sent on connect to the configured devices."""
+
+    type: Literal["continuous"] = "continuous"
+    payload: ContinuousPayload
+
+
+class ServerListPayload(BaseModel):
+    """Payload steering a device to the cluster nodes in preference order."""
+
+    uris: str = Field(..., min_length=1, description="Comma-separated WebSocket URIs, preferred node first")
+
+
+class ServerList(BaseMessage):
+    """Server replaces the device's endpoint list (cluster mode; always sent as JSON text)."""
+
+    type: Literal["server_list"] = "server_list"
+    payload: ServerListPayload
+
+
 class TimeSyncPayload(BaseModel):
     """Payload for time synchronization."""
 
     seconds: int = Field(..., description="Unix Epoch seconds")
     ms: int = Field(0, description="Millisecond offset")
+    # Round-trip fields, present only when answering time_sync_request
+    seq: Optional[int] = Field(None, ge=0, description="seq of the request being answered")
+    t0: Optional[int] = Field(None, description="Device esp_timer (us) when the request was sent, echoed")
+    t1: Optional[int] = Field(None, description="Server Unix time (us) when the request was received")
+    t2: Optional[int] = Field(None, description="Server Unix time (us) when this reply was sent")
 
 
 class TimeSync(BaseMessage):
@@ -261,7 +713,7 @@ class TimeSync(BaseMessage):
 ESP32ToServerMessage = Union[
     CommandRequest, FallbackRequest, AudioRequest, ActionResult
 ]
-ServerToESP32Message = Union[Action, Play, TimeSync]
+ServerToESP32Message = Union[Action, Play, TimeSync, AudioCancel]
 
 
 
@@ -275,6 +727,7 @@ class Device(BaseModel):
     type: str = Field(..., description="Device type (relay, led, vacuum, etc.)")
     gpio: Optional[int] = Field(None, description="GPIO pin number (optional for MQTT/API devices)")
     aliases: list[str] = Field(default_factory=list, description="Alternative names for voice recognition")
+    groups: list[str] = Field(default_factory=list, description="Group aliases shared with other devices (e.g. 'all lights')")
     control_topic: Optional[str] = Field(None, description="MQTT topic for control")
     commands: dict[str, str] = Field(default_factory=dict, description="Map action value to MQTT/API payload")
     action_keywords: Optional[dict[str, list[str]]] = Field(None, description="Custom action keywords from discovery")
@@ -0,0 +1,85 @@
+"""Speculative backend warm-up when a device hears speech before any wake word."""
+
+import asyncio
+import logging
+import time
+from typing import Awaitable, Callable, Optional
+
+from .config import PREWARM_MIN_INTERVAL_S
+
+logger = logging.getLogger("esp-miao.prewarm")
+
+# link_warmup 之後這段時間內的 audio_start 視為預熱命中（用於評估推測是否值得）
+PREWARM_HIT_WINDOW_S = 10.0
+
+
+class BackendPrewarmer:
+    """裝置 VAD 上升緣送出 link_warmup：背景載入 Whisper、要求 Ollama 載入並保留模型。
+
+    喚醒詞多半在語音開始後 0.5–1 秒才觸發，這段時間足以把冷啟動移出關鍵路徑。
+    多數語音不含喚醒詞，因此每 PREWARM_MIN_INTERVAL_S 秒最多預熱一次（模型已常駐時只刷新 keep_alive）；
+    預熱不取消、不等待，也不影響正在處理的請求。
+    """
+
+    def __init__(self, min_interval_s: float = PREWARM_MIN_INTERVAL_S):
+        self.min_interval_s = min_interval_s
+        self.warmers: list[tuple[str, Callable[[], Awaitable[Optional[float]]]]] = []
+        self._last_run = 0.0
+        self._task: Optional[asyncio.Task] = None
+        self._pending: dict[str, float] = {}   # device_id -> 最近一次 link_warmup（monotonic）
+        self.received = 0
+        self.runs = 0
+        self.hits = 0          # PREWARM_HIT_WINDOW_S 內接著 audio_start
+        self.lead_sum_s = 0.0  # 命中時 link_warmup → audio_start 的總秒數
+        self.last_timings: dict[str, Optional[float]] = {}
+
+    def add(self, name: str, warm: Callable[[], Awaitable[Optional[float]]]):
+        """登記一個預熱步驟（回傳耗時秒數，None = 已是熱的、未做事）。"""
+        self.warmers.append((name, warm))
+
+    def request(self, device_id: str) -> bool:
+        """收到 link_warmup；回傳是否啟動了一次預熱。"""
+        now = time.monotonic()
+        self.received += 1
+        self._pending[device_id] = now
+        if self.min_interval_s <= 0 or (self._task is not None and not self._task.done()):
+            return False
+        if self._last_run and now - self._last_run < self.min_interval_s:
+            return False
+        self._last_run = now
+        self.runs += 1
+        self._task = asyncio.create_task(self._run(device_id))
+        return True
+
+    def stream_started(self, device_id: str) -> Optional[float]:
+        """audio_start：回傳距上次 link_warmup 的秒數（視窗外或未預熱為 None）。"""
+        sent = self._pending.pop(device_id, None)
+        if sent is None:
+            return None
+        lead = time.monotonic() - sent
+        if lead > PREWARM_HIT_WINDOW_S:
+            return None
+        self.hits += 1
+        self.lead_sum_s += lead
+        return round(lead, 3)
+
+    async def _run(self, device_id: str):
+        for name, warm in self.warmers:
+            try:
+                self.last_timings[name] = await warm()
+            except Exception as e:
+                self.last_timings[name] = None
+                logger.warning(f"Pre-warm {name} failed: {e}")
+        logger.info(f"Pre-warmed for {device_id}: {self.last_timings}")
+
+    def snapshot(self) -> dict:
+        return {
+            "received": self.received,
+            "runs": self.runs,
+            "hits": self.hits,
+            "avg_lead_s": round(self.lead_sum_s / self.hits, 3) if self.hits else None,
+            "last_timings": dict(self.last_timings),
+        }
+
+
+prewarmer = BackendPrewarmer()
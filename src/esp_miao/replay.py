@@ -0,0 +1,176 @@
+"""Stream captures: record a device's WebSocket session and replay it in-process without the device."""
+
+import asyncio
+import json
+import logging
+import struct
+import time
+from dataclasses import dataclass, field
+from pathlib import Path
+from typing import Awaitable, Callable, Dict, List, Optional, Union
+
+from .config import STREAM_CAPTURE_DIR
+
+logger = logging.getLogger("esp-miao.replay")
+
+# 檔案格式：MAGIC 後接一連串紀錄，每筆 <t_us, kind, length> + 內容；t_us 為距第一則訊息的時間。
+# 第一筆固定為 KIND_META（JSON：device_id、subprotocols、開始時間），之後為裝置送來的訊息原文
+MAGIC = b"MIAOCAP1"
+RECORD = struct.Struct("<QBI")
+KIND_META, KIND_TEXT, KIND_BYTES = 0, 1, 2
+# 一個 session 從喚醒（或沒有喚醒訊息時的 audio_start）開始、audio_end 之後結束
+SESSION_OPEN = ("wake_detected", "audio_start")
+SESSION_CLOSE = "audio_end"
+
+
+@dataclass
+class CapturedMessage:
+    t: float                        # 距 session 第一則訊息的秒數
+    payload: Union[str, bytes]
+
+
+@dataclass
+class Capture:
+    path: Path
+    device_id: str
+    subprotocols: List[str]
+    messages: List[CapturedMessage]
+
+    @property
+    def duration_s(self) -> float:
+        return self.messages[-1].t if self.messages else 0.0
+
+
+def _message_type(text: str) -> Optional[str]:
+    try:
+        return json.loads(text).get("type")
+    except (ValueError, AttributeError):
+        return None
+
+
+class SessionCapture:
+    """一條 WebSocket 連線的擷取：每個語音 session 寫成一個檔案。
+
+    訊息先累積在記憶體（一個 session 為數百 KB），audio_end 後才在執行緒寫檔，不阻塞讀取迴圈。
+    """
+
+    def __init__(self, directory: Path, device_id: str, subprotocols: List[str]):
+        self.directory = directory
+        self.device_id = device_id
+        self.subprotocols = subprotocols
+        self._buf: Optional[bytearray] = None
+        self._t0 = 0.0
+        self._started = 0.0
+
+    def record(self, payload: Union[str, bytes], rx: float):
+        """記錄一則裝置訊息；rx 為 time.monotonic() 到達時間。"""
+        msg_type = _message_type(payload) if isinstance(payload, str) else None
+        if self._buf is None:
+            if msg_type not in SESSION_OPEN:
+                return
+            self._buf = bytearray(MAGIC)
+            self._t0, self._started = rx, time.time()
+            meta = json.dumps({"device_id": self.device_id, "subprotocols": self.subprotocols,
+                               "started": round(self._started, 3)}).encode()
+            self._buf += RECORD.pack(0, KIND_META, len(meta)) + meta
+        data = payload.encode() if isinstance(payload, str) else payload
+        kind = KIND_TEXT if isinstance(payload, str) else KIND_BYTES
+        self._buf += RECORD.pack(round((rx - self._t0) * 1e6), kind, len(data)) + data
+        if msg_type == SESSION_CLOSE:
+            self._flush()
+
+    def close(self):
+        """連線結束：未完成的 session 丟棄（沒有 audio_end 無法完整重播）。"""
+        self._buf = None
+
+    def _flush(self):
+        data, self._buf = bytes(self._buf), None
+        stamp = time.strftime("%Y%m%d_%H%M%S", time.localtime(self._started))
+        path = self.directory / f"{self.device_id}_{stamp}_{int(self._started * 1000) % 1000:03d}.cap"
+        asyncio.get_running_loop().run_in_executor(None, self._write, path, data)
+
+    @staticmethod
+    def _write(path: Path, data: bytes):
+        try:
+            path.parent.mkdir(parents=True, exist_ok=True)
+            path.write_bytes(data)
+        except OSError as e:
+            logger.error(f"Stream capture {path.name} not written: {e}")
+
+
+def open_capture(device_id: str, subprotocols: List[str]) -> Optional[SessionCapture]:
+    """STREAM_CAPTURE_DIR 設定時擷取這條連線的語音 session。"""
+    if not STREAM_CAPTURE_DIR:
+        return None
+    return SessionCapture(Path(STREAM_CAPTURE_DIR), device_id, subprotocols)
+
+
+def read_capture(path: Path) -> Capture:
+    data = Path(path).read_bytes()
+    if not data.startswith(MAGIC):
+        raise ValueError(f"{path}: not a stream capture")
+    pos, meta, messages = len(MAGIC), {}, []
+    while pos + RECORD.size <= len(data):
+        t_us, kind, length = RECORD.unpack_from(data, pos)
+        pos += RECORD.size
+        body = data[pos:pos + length]
+        pos += length
+        if len(body) < length:
+            break   # 寫到一半的檔案：保留完整的部分
+        if kind == KIND_META:
+            meta = json.loads(body)
+        elif kind == KIND_TEXT:
+            messages.append(CapturedMessage(t_us / 1e6, body.decode()))
+        elif kind == KIND_BYTES:
+            messages.append(CapturedMessage(t_us / 1e6, body))
+    return Capture(Path(path), meta.get("device_id", ""), meta.get("subprotocols", []), messages)
+
+
+@dataclass
+class ReplayWebSocket:
+    """websocket_endpoint 看到的假 WebSocket：依原始間隔送出擷取的訊息，記錄伺服器的回覆。
+
+    speed = 1 照原速、2 兩倍速、0 不等待（盡快送出）。訊息送完後先等 settle() 完成
+    （例如該裝置的回覆處理結束）再回報斷線，讓端點的清理不會中斷仍在處理的 session。
+    """
+    capture: Capture
+    speed: float = 1.0
+    settle: Optional[Callable[[], Awaitable[None]]] = None
+    scope: Dict = field(default_factory=dict)
+    sent: List[Union[str, bytes]] = field(default_factory=list)
+    started: float = 0.0
+    finished: float = 0.0     # 最後一則訊息送出（等於裝置說完話）的 monotonic 時間
+    _next: int = 0
+
+    def __post_init__(self):
+        self.scope = {"subprotocols": list(self.capture.subprotocols)}
+
+    async def accept(self, subprotocol: Optional[str] = None):
+        self.started = time.monotonic()
+
+    async def receive(self) -> Dict:
+        if self._next >= len(self.capture.messages):
+            if self.settle is not None:
+                await self.settle()
+            return {"type": "websocket.disconnect", "code": 1000}
+        msg = self.capture.messages[self._next]
+        self._next += 1
+        if self.speed > 0:
+            delay = self.started + msg.t / self.speed - time.monotonic()
+            if delay > 0:
+                await asyncio.sleep(delay)
+        else:
+            await asyncio.sleep(0)   # 盡快送出，但仍讓出 event loop 給處理中的 Task
+        if self._next == len(self.capture.messages):
+            self.finished = time.monotonic()
+        key = "text" if isinstance(msg.payload, str) else "bytes"
+        return {"type": "websocket.receive", key: msg.payload}
+
+    async def send_text(self, data: str):
+        self.sent.append(data)
+
+    async def send_bytes(self, data: bytes):
+        self.sent.append(data)
+
+    async def close(self, code: int = 1000):
+        pass
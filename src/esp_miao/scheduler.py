@@ -0,0 +1,271 @@
+"""Inference scheduling: separate ASR / LLM lanes with per-device fairness and admission control."""
+
+import asyncio
+import heapq
+import itertools
+import logging
+import os
+import time
+from concurrent.futures import ThreadPoolExecutor
+from dataclasses import dataclass, field
+from typing import Any, Awaitable, Callable, Optional
+
+from .config import (
+    ASR_WORKERS, ASR_PROCESSES, ASR_QUEUE_MAX, LLM_CONCURRENCY, LLM_QUEUE_MAX, USER_PATIENCE_S,
+    WHISPER_CPU_AFFINITY,
+)
+
+logger = logging.getLogger("esp-miao.scheduler")
+
+
+class LaneBusy(Exception):
+    """佇列已滿，請求未被接受。"""
+
+
+class DeadlineExceeded(TimeoutError):
+    """請求在期限內未開始（或 abort_running 的 lane 未完成）。"""
+
+
+@dataclass(order=True)
+class _Job:
+    # 同一裝置內的順序：前景優先，其次最早期限（EDF），最後依提交順序
+    background: bool
+    deadline: float
+    seq: int
+    device_id: str = field(compare=False)
+    run: Callable[[], Awaitable[Any]] = field(compare=False)
+    future: asyncio.Future = field(compare=False)
+    enqueued: float = field(compare=False)
+    timer: Optional[asyncio.TimerHandle] = field(default=None, compare=False)
+
+
+class Lane:
+    """一條推論通道：最多 workers 個請求同時執行，其餘依裝置公平性與期限排隊。
+
+    - 每次挑選「最久未被服務的裝置」的最優先請求，單一裝置的連續請求不會餓死其他裝置
+    - 排隊超過期限的請求不再執行（DeadlineExceeded）；abort_running 時執行中超時亦取消
+    - background 請求（串流 partial）只在有空間時接受，且可被前景請求擠掉
+    """
+
+    def __init__(self, name: str, workers: int, max_queue: int, patience_s: float,
+                 abort_running: bool = False):
+        self.name = name
+        self.workers = max(1, workers)
+        self.max_queue = max_queue
+        self.patience_s = patience_s
+        self.abort_running = abort_running
+
+        self._queues: dict[str, list[_Job]] = {}
+        self._served: dict[str, int] = {}      # 裝置最後一次被服務的序號（越小越優先）
+        self._serve_seq = itertools.count(1)
+        self._job_seq = itertools.count()
+        self._running = 0
+        self._tasks: set[asyncio.Task] = set()
+
+        self.submitted = 0
+        self.completed = 0
+        self.rejected = 0
+        self.expired = 0
+        self.peak_depth = 0
+        self._wait_sum = 0.0
+        self._started = 0
+
+    @property
+    def depth(self) -> int:
+        return sum(len(q) for q in self._queues.values())
+
+    async def submit(self, device_id: str, run: Callable[[], Awaitable[Any]], *,
+                     timeout: Optional[float] = None, background: bool = False) -> Any:
+        """排入 run()（回傳 awaitable 的函式）並等待結果。
+
+        timeout：由提交算起的期限（預設 patience_s，取兩者較小值）。
+        """
+        loop = asyncio.get_running_loop()
+        now = time.monotonic()
+        budget = self.patience_s if timeout is None else min(timeout, self.patience_s)
+        job = _Job(background, now + budget, next(self._job_seq), device_id, run,
+                   loop.create_future(), now)
+
+        self._purge_expired(now)
+        if self.depth >= self.max_queue and (background or not self._evict_background()):
+            self.rejected += 1
+            raise LaneBusy(f"{self.name} queue full ({self.depth})")
+
+        heapq.heappush(self._queues.setdefault(device_id, []), job)
+        # 期限一到即通知等待中的呼叫端，不必等前面的請求做完
+        job.timer = loop.call_later(budget, self._expire, job)
+        self.submitted += 1
+        self.peak_depth = max(self.peak_depth, self.depth)
+        self._pump()
+        return await job.future
+
+    def snapshot(self) -> dict:
+        return {
+            "running": self._running,
+            "queued": self.depth,
+            "peak_queued": self.peak_depth,
+            "submitted": self.submitted,
+            "completed": self.completed,
+            "rejected": self.rejected,
+            "expired": self.expired,
+            "avg_wait_s": round(self._wait_sum / self._started, 3) if self._started else 0.0,
+        }
+
+    # --- 內部 ---
+
+    def _pump(self):
+        while self._running < self.workers:
+            job = self._next_job()
+            if job is None:
+                return
+            self._running += 1
+            self._started += 1
+            self._wait_sum += time.monotonic() - job.enqueued
+            self._served[job.device_id] = next(self._serve_seq)
+            job.timer.cancel()
+            task = asyncio.ensure_future(self._execute(job))
+            self._tasks.add(task)
+            task.add_done_callback(self._tasks.discard)
+
+    def _next_job(self) -> Optional[_Job]:
+        self._purge_expired(time.monotonic())
+        best_dev, best_key = None, None
+        for dev, queue in self._queues.items():
+            head = queue[0]
+            key = (head.background, self._served.get(dev, 0), head.deadline)
+            if best_key is None or key < best_key:
+                best_dev, best_key = dev, key
+        if best_dev is None:
+            return None
+        job = heapq.heappop(self._queues[best_dev])
+        if not self._queues[best_dev]:
+            del self._queues[best_dev]
+        return job
+
+    def _purge_expired(self, now: float):
+        for dev in list(self._queues):
+            kept = []
+            for job in self._queues[dev]:
+                if job.future.done():           # 呼叫端已取消
+                    continue
+                if job.deadline <= now:
+                    self.expired += 1
+                    logger.warning(
+                        f"{self.name}: dropped request from {job.device_id} "
+                        f"after waiting {now - job.enqueued:.2f}s"
+                    )
+                    job.future.set_exception(DeadlineExceeded(f"{self.name} request expired in queue"))
+                    continue
+                kept.append(job)
+            if kept:
+                heapq.heapify(kept)
+                self._queues[dev] = kept
+            else:
+                del self._queues[dev]
+
+    def _expire(self, job: _Job):
+        queue = self._queues.get(job.device_id)
+        if queue is None or job not in queue:
+            return                              # 已開始或已移除
+        job.deadline = float("-inf")            # 強制視為過期（計時器可能略早於 monotonic 期限觸發）
+        self._purge_expired(time.monotonic())
+
+    def _evict_background(self) -> bool:
+        """佇列滿時讓前景請求擠掉期限最晚的 background 請求。"""
+        victims = [(job.deadline, dev, job) for dev, q in self._queues.items() for job in q if job.background]
+        if not victims:
+            return False
+        _, dev, job = max(victims, key=lambda v: v[0])
+        self._queues[dev].remove(job)
+        heapq.heapify(self._queues[dev])
+        if not self._queues[dev]:
+            del self._queues[dev]
+        self.rejected += 1
+        job.timer.cancel()
+        job.future.set_exception(LaneBusy(f"{self.name} partial evicted by a foreground request"))
+        return True
+
+    async def _execute(self, job: _Job):
+        try:
+            if self.abort_running:
+                remaining = job.deadline - time.monotonic()
+                result = await asyncio.wait_for(job.run(), timeout=max(remaining, 0.0))
+            else:
+                result = await job.run()
+            if not job.future.done():
+                job.future.set_result(result)
+        except asyncio.TimeoutError as e:
+            if self.abort_running:
+                self.expired += 1
+                e = DeadlineExceeded(f"{self.name} request aborted at deadline")
+            if not job.future.done():
+                job.future.set_exception(e)
+        except Exception as e:
+            if not job.future.done():
+                job.future.set_exception(e)
+        finally:
+            self.completed += 1
+            self._running -= 1
+            self._pump()
+
+
+def parse_cpu_list(spec: str) -> set[int]:
+    """"1-3" / "0,2,3" → CPU 編號集合（空字串為空集合）。"""
+    cpus: set[int] = set()
+    for part in spec.replace(" ", "").split(","):
+        if not part:
+            continue
+        lo, _, hi = part.partition("-")
+        cpus.update(range(int(lo), int(hi or lo) + 1))
+    return cpus
+
+
+def _pin_current_thread(cpus: set[int]):
+    """Linux 上執行緒親和性會被其後建立的執行緒繼承（CTranslate2 / OpenMP 工作執行緒亦同）。"""
+    if not cpus or not hasattr(os, "sched_setaffinity"):
+        return
+    try:
+        os.sched_setaffinity(0, cpus)
+        logger.info(f"ASR thread pinned to CPU {sorted(cpus)}")
+    except OSError as e:
+        logger.warning(f"Failed to pin ASR thread to {sorted(cpus)}: {e}")
+
+
+class InferenceScheduler:
+    """ASR（Whisper，阻塞於專屬執行緒）與 LLM（Ollama，非同步 HTTP）各自一條 lane，互不阻塞。"""
+
+    def __init__(self):
+        # 在 RPi4 上建議 ASR_WORKERS=1，避免多個 Whisper 推論併發導致系統崩潰
+        self._asr_executor = ThreadPoolExecutor(
+            max_workers=max(1, ASR_WORKERS), thread_name_prefix="asr",
+            initializer=_pin_current_thread, initargs=(parse_cpu_list(WHISPER_CPU_AFFINITY),),
+        )
+        # 多行程模式下 lane 並行數即 worker 行程數（推論不在 _asr_executor 執行）
+        self.asr = Lane("asr", ASR_PROCESSES or ASR_WORKERS, ASR_QUEUE_MAX, USER_PATIENCE_S)
+        self.llm = Lane("llm", LLM_CONCURRENCY, LLM_QUEUE_MAX, USER_PATIENCE_S, abort_running=True)
+
+    async def run_asr(self, device_id: str, fn: Callable[[], Any], *, background: bool = False) -> Any:
+        """在 ASR 執行緒執行阻塞函式（Whisper 執行中無法中止，只在排隊時檢查期限）。"""
+        loop = asyncio.get_running_loop()
+        return await self.asr.submit(
+            device_id, lambda: loop.run_in_executor(self._asr_executor, fn), background=background
+        )
+
+    async def run_asr_async(self, device_id: str, coro_fn: Callable[[], Awaitable[Any]], *,
+                            background: bool = False) -> Any:
+        """經 ASR lane 排隊後執行 coroutine（多行程模式：推論在 worker 行程，lane 只負責排隊與公平性）。"""
+        return await self.asr.submit(device_id, coro_fn, background=background)
+
+    async def run_llm(self, device_id: str, coro_fn: Callable[[], Awaitable[Any]], *,
+                      timeout: Optional[float] = None) -> Any:
+        """排隊 + 執行合計不超過 timeout（逾時拋出 DeadlineExceeded，為 TimeoutError 子類）。"""
+        return await self.llm.submit(device_id, coro_fn, timeout=timeout)
+
+    def snapshot(self) -> dict:
+        return {"asr": self.asr.snapshot(), "llm": self.llm.snapshot()}
+
+    def shutdown(self):
+        self._asr_executor.shutdown(wait=False, cancel_futures=True)
+
+
+scheduler = InferenceScheduler()
@@ -1,7 +1,7 @@
 import uvicorn
 import os
 import logging
-from .config import LOG_LEVEL
+from .config import LOG_LEVEL, SSL_CERTFILE, SSL_KEYFILE
 from .version import __version__
 
 logger = logging.getLogger("esp-miao.server")
@@ -10,8 +10,10 @@ def main():
     """Run server with uvicorn."""
     # 讀取環境變數，預設關閉 reload 以節省 RPi4 資源
     reload_enabled = os.getenv("SERVER_RELOAD", "0") == "1"
-    
-    logger.info(f"Starting ESP-MIAO Server v{__version__} (reload={'enabled' if reload_enabled else 'disabled'})...")
+    tls = bool(SSL_CERTFILE and SSL_KEYFILE)
+
+    logger.info(f"Starting ESP-MIAO Server v{__version__} (reload={'enabled' if reload_enabled else 'disabled'}, "
+                f"tls={'enabled' if tls else 'disabled'})...")
 
     uvicorn.run(
         "esp_miao.app:app",
@@ -20,6 +22,8 @@ def main():
         reload=reload_enabled,
         reload_dirs=["src"] if reload_enabled else None,
         log_level="info",
+        ssl_certfile=SSL_CERTFILE if tls else None,
+        ssl_keyfile=SSL_KEYFILE if tls else None,
     )
 
 
@@ -0,0 +1,161 @@
+"""Feedback sounds preloaded into memory and played through a held-open output stream."""
+
+import asyncio
+import logging
+import time
+import wave
+from pathlib import Path
+from typing import Optional
+
+from .config import LOCAL_SOUND_DIR
+
+logger = logging.getLogger("esp-miao.sound_player")
+
+_APLAY_FORMATS = {1: "U8", 2: "S16_LE", 3: "S24_3LE", 4: "S32_LE"}
+
+
+class PreloadedSound:
+    __slots__ = ("pcm", "rate", "channels", "sampwidth")
+
+    def __init__(self, pcm: bytes, rate: int, channels: int, sampwidth: int):
+        self.pcm = pcm
+        self.rate = rate
+        self.channels = channels
+        self.sampwidth = sampwidth
+
+    @property
+    def fmt(self) -> tuple[int, int, int]:
+        return (self.rate, self.channels, self.sampwidth)
+
+
+class SoundPlayer:
+    """啟動時把 playsound/*.wav 解碼成 PCM 放在記憶體，單一 worker 依序寫入常駐的 aplay raw 串流。
+
+    每個音檔格式（取樣率、聲道、位寬）一條 `aplay -t raw -` 串流，第一次使用時開啟、之後保持開啟：
+    播放只剩一次 pipe 寫入，不再每個提示音 fork/exec + 開啟 ALSA 裝置（RPi4 上 50–150 ms）。
+    閒置時 aplay 只是 underrun 後重新 prepare，下一段 PCM 寫入即開始播放。
+    """
+
+    def __init__(self, sound_dir: Path = LOCAL_SOUND_DIR, max_queue: int = 4):
+        self.sound_dir = sound_dir
+        self.sounds: dict[str, PreloadedSound] = {}
+        self._queue: asyncio.Queue = asyncio.Queue(maxsize=max_queue)
+        self._streams: dict[tuple[int, int, int], asyncio.subprocess.Process] = {}
+        self._worker: Optional[asyncio.Task] = None
+        self.played = 0
+        self.dropped = 0        # 佇列已滿時丟棄的提示音
+        self.stream_opens = 0   # 開啟（或重開）aplay 串流的次數
+        self.last_queue_ms: Optional[float] = None   # play() → 寫入串流
+
+    @property
+    def running(self) -> bool:
+        return self._worker is not None and not self._worker.done()
+
+    def preload(self) -> int:
+        """讀入 sound_dir 下全部 wav；回傳載入數量（無法解析的檔案略過並記錄警告）。"""
+        self.sounds.clear()
+        if not self.sound_dir.exists():
+            logger.warning(f"Local sound directory not found: {self.sound_dir}")
+            return 0
+        for path in sorted(self.sound_dir.glob("*.wav")):
+            try:
+                with wave.open(str(path), "rb") as w:
+                    if w.getsampwidth() not in _APLAY_FORMATS:
+                        raise ValueError(f"unsupported sample width {w.getsampwidth()}")
+                    self.sounds[path.name] = PreloadedSound(
+                        w.readframes(w.getnframes()), w.getframerate(), w.getnchannels(), w.getsampwidth(),
+                    )
+            except (wave.Error, EOFError, ValueError) as e:
+                logger.warning(f"Skip local sound {path.name}: {e}")
+        logger.info(f"Preloaded {len(self.sounds)} local sounds from {self.sound_dir}")
+        return len(self.sounds)
+
+    def start(self):
+        if not self.running:
+            self._worker = asyncio.create_task(self._run())
+
+    async def stop(self):
+        if self._worker is not None:
+            self._worker.cancel()
+            try:
+                await self._worker
+            except asyncio.CancelledError:
+                pass
+            self._worker = None
+        for proc in self._streams.values():
+            await self._close(proc)
+        self._streams.clear()
+
+    def play(self, filename: str) -> bool:
+        """排入播放，不等待；回傳 False 表示未預載或 worker 未啟動（呼叫端改用 aplay 播檔案）。"""
+        sound = self.sounds.get(filename)
+        if sound is None or not self.running:
+            return False
+        try:
+            self._queue.put_nowait((filename, sound, time.perf_counter()))
+        except asyncio.QueueFull:
+            self.dropped += 1
+            logger.warning(f"Sound queue full, dropping {filename}")
+        return True
+
+    async def _run(self):
+        while True:
+            filename, sound, queued_at = await self._queue.get()
+            try:
+                await self._write(sound)
+                self.played += 1
+                self.last_queue_ms = round((time.perf_counter() - queued_at) * 1000, 2)
+                logger.info(f"Playing local sound: {filename}")
+            except Exception as e:
+                logger.error(f"Failed to play local sound {filename}: {e}")
+
+    async def _write(self, sound: PreloadedSound):
+        for attempt in range(2):
+            proc = self._streams.get(sound.fmt)
+            if proc is None or proc.returncode is not None:
+                proc = await self._open(sound)
+            try:
+                proc.stdin.write(sound.pcm)
+                await proc.stdin.drain()
+                return
+            except (BrokenPipeError, ConnectionResetError):
+                # aplay 結束（例如音效裝置被拔除）：重開一次
+                self._streams.pop(sound.fmt, None)
+                if attempt:
+                    raise
+
+    async def _open(self, sound: PreloadedSound) -> asyncio.subprocess.Process:
+        proc = await asyncio.create_subprocess_exec(
+            "aplay", "-q", "-t", "raw",
+            "-f", _APLAY_FORMATS[sound.sampwidth],
+            "-r", str(sound.rate), "-c", str(sound.channels), "-",
+            stdin=asyncio.subprocess.PIPE,
+            stdout=asyncio.subprocess.DEVNULL,
+            stderr=asyncio.subprocess.DEVNULL,
+        )
+        self._streams[sound.fmt] = proc
+        self.stream_opens += 1
+        return proc
+
+    @staticmethod
+    async def _close(proc: asyncio.subprocess.Process):
+        if proc.returncode is not None:
+            return
+        try:
+            proc.stdin.close()
+            await asyncio.wait_for(proc.wait(), timeout=1.0)
+        except (asyncio.TimeoutError, BrokenPipeError, ConnectionResetError):
+            proc.kill()
+
+    def snapshot(self) -> dict:
+        return {
+            "running": self.running,
+            "preloaded": sorted(self.sounds),
+            "played": self.played,
+            "dropped": self.dropped,
+            "stream_opens": self.stream_opens,
+            "last_queue_ms": self.last_queue_ms,
+        }
+
+
+sound_player = SoundPlayer()
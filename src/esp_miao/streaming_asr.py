@@ -0,0 +1,220 @@
+import asyncio
+import logging
+import time
+from typing import Awaitable, Callable, Optional
+
+from .audio import transcribe_audio, pcm_to_float32, sample_rate_from_format
+from .config import (
+    STREAMING_ASR_INTERVAL_S,
+    STREAMING_ASR_MIN_S,
+    STREAMING_ASR_STABLE,
+    STREAMING_ASR_TAIL_S,
+    STREAMING_SPECULATE_MIN_CHARS,
+)
+from .connection import device_table
+from .intent import extract_intent_from_text, normalize_transcript
+from .metrics import MetricsContext
+
+logger = logging.getLogger("esp-miao.streaming_asr")
+
+# (session, partial text, keyword intent)
+CommitCallback = Callable[["StreamingTranscriber", str, dict], Awaitable[None]]
+# (text, metrics context) -> intent，即 parse_intent_with_llm
+IntentParser = Callable[[str, MetricsContext], Awaitable[dict]]
+
+# 推測執行時記錄於自身 context、命中後併入請求 context 的意圖解析欄位
+SPECULATION_KEYS = (
+    "keyword_action_found", "keyword_target_found", "intent_cache_hit", "intent_cache_hit_rate",
+    "intent_cache_saved_llm", "llm_called", "llm_success", "llm_rejected", "llm_timeout",
+    "llm_first_token_latency", "llm_inference_latency",
+)
+
+
+class Speculation:
+    """An LLM intent parse started on a partial transcript, before the stream ended.
+
+    以 normalize_transcript 後的文字比對最終轉錄：相同即沿用（LLM 與 ASR 尾段重疊的時間即為節省），
+    不同則取消。
+    """
+
+    def __init__(self, device_id: str, text: str, parse: IntentParser):
+        self.text = text
+        self.key = normalize_transcript(text)
+        self.ctx = MetricsContext(f"{device_id}_speculative", device_id)
+        self.started = time.monotonic()
+        self.finished: Optional[float] = None
+        self.task = asyncio.create_task(parse(text, self.ctx))
+        self.task.add_done_callback(self._done)
+
+    def _done(self, task: asyncio.Task):
+        self.finished = time.monotonic()
+
+    def matches(self, text: str) -> bool:
+        return bool(text) and normalize_transcript(text) == self.key
+
+    def cancel(self):
+        if not self.task.done():
+            self.task.cancel()
+
+    async def join(self, metrics_ctx: MetricsContext) -> dict:
+        """Final transcript matched: wait for the parse and merge its metrics into the request."""
+        joined = time.monotonic()
+        intent = await self.task
+        for key in SPECULATION_KEYS:
+            if key in self.ctx.data:
+                metrics_ctx.data[key] = self.ctx.data[key]
+        metrics_ctx.mark_stage("speculation", "hit")
+        # 最終文字就緒前 LLM 已執行的時間（已完成時即整個 LLM 耗時）
+        metrics_ctx.record_latency("speculation_saved", round(min(joined, self.finished) - self.started, 3))
+        return intent
+
+
+class StreamingTranscriber:
+    """Partial ASR over a growing stream buffer; commits a keyword intent once partials agree.
+
+    At most one partial is in flight; audio that arrives meanwhile is picked up by the next
+    pass on the whole buffer. Partials run as background requests on the ASR lane, so final
+    transcriptions from other devices are served first and a busy lane simply skips a pass.
+    """
+
+    def __init__(
+        self,
+        device_id: str,
+        audio_format: str,
+        on_commit: CommitCallback,
+        transcribe: Callable[..., Awaitable[str]] = transcribe_audio,
+        speculate: Optional[IntentParser] = None,
+    ):
+        self.device_id = device_id
+        self.audio_format = audio_format
+        self.on_commit = on_commit
+        self.transcribe = transcribe
+        self.speculate = speculate
+
+        bytes_per_s = sample_rate_from_format(audio_format) * 2
+        self.min_bytes = int(STREAMING_ASR_MIN_S * bytes_per_s)
+        self.interval_bytes = max(2, int(STREAMING_ASR_INTERVAL_S * bytes_per_s))
+        self.tail_bytes = int(STREAMING_ASR_TAIL_S * bytes_per_s)
+
+        self.started = time.monotonic()
+        self.decoded_bytes = 0            # 最近一個 partial 涵蓋的位元組數
+        self.partial_text = ""
+        self.partials = 0
+        self.stable = 0                   # 連續解析出相同意圖的 partial 數
+        self.last_intent: Optional[dict] = None
+        self.committed: Optional[dict] = None
+        self.commit_latency: Optional[float] = None  # audio_start → 提前執行（秒）
+        self.speculation: Optional[Speculation] = None
+        self.speculations = 0             # 本次串流啟動的推測解析數（含被取消的）
+        self._task: Optional[asyncio.Task] = None
+        self._closed = False
+
+    def feed(self, buffer: memoryview):
+        """Called after each appended chunk; starts a partial pass when enough new audio arrived."""
+        if self._closed or self.committed is not None:
+            return
+        if self._task is not None and not self._task.done():
+            return
+        size = len(buffer)
+        if size < self.min_bytes or size - self.decoded_bytes < self.interval_bytes:
+            return
+        # 轉型即快照（一次複製），之後緩衝可繼續增長
+        self._task = asyncio.create_task(self._partial(pcm_to_float32(buffer)))
+
+    def covers(self, total_bytes: int) -> bool:
+        """True if the latest partial already transcribed (almost) the whole stream."""
+        return self.partials > 0 and total_bytes - self.decoded_bytes <= self.tail_bytes
+
+    async def finish(self):
+        """Stream ended: wait for the in-flight partial so the commit decision is final."""
+        task = self._task
+        if task is not None and not task.done():
+            try:
+                await task
+            except asyncio.CancelledError:
+                pass
+        self._closed = True
+
+    def cancel(self):
+        """Drop the session (stream discarded or superseded); an in-flight pass is ignored."""
+        self._closed = True
+        if self._task is not None and not self._task.done():
+            self._task.cancel()
+        self._drop_speculation()
+
+    def take_speculation(self, text: str) -> Optional[Speculation]:
+        """The speculative parse if it was started on the final transcript; otherwise cancel it."""
+        speculation = self.speculation
+        self.speculation = None
+        if speculation is None:
+            return None
+        if speculation.matches(text):
+            return speculation
+        speculation.cancel()
+        logger.info(f"Speculative parse for {self.device_id} missed: '{speculation.text}' vs final '{text}'")
+        return None
+
+    def _drop_speculation(self):
+        if self.speculation is not None:
+            self.speculation.cancel()
+            self.speculation = None
+
+    async def _partial(self, samples):
+        t0 = time.monotonic()
+        text = await self.transcribe(
+            samples, self.audio_format, beam_size=1, device_id=self.device_id, background=True
+        )
+        if self._closed:
+            return
+        previous_text = self.partial_text
+        self.decoded_bytes = len(samples) * 2
+        self.partial_text = text
+        self.partials += 1
+
+        intent = extract_intent_from_text(text) if text else None
+        if intent is None or intent["action"] == "unknown" or not self._target_online(intent):
+            self.stable = 0
+            self.last_intent = None
+        else:
+            self.stable = self.stable + 1 if intent == self.last_intent else 1
+            self.last_intent = intent
+        logger.debug(
+            f"Partial #{self.partials} {self.device_id}: {len(samples)} samples "
+            f"in {time.monotonic() - t0:.2f}s -> '{text}' (stable={self.stable})"
+        )
+
+        if self.stable < STREAMING_ASR_STABLE:
+            self._speculate(text, previous_text)
+            return
+        self._drop_speculation()
+        self.committed = intent
+        self.commit_latency = round(time.monotonic() - self.started, 3)
+        logger.info(
+            f"Streaming commit {self.device_id}: '{text}' -> {intent} "
+            f"after {self.partials} partials ({self.commit_latency}s after audio_start)"
+        )
+        await self.on_commit(self, text, intent)
+
+    def _speculate(self, text: str, previous_text: str):
+        """Start the LLM on a partial that stopped changing; a partial that changed cancels it.
+
+        關鍵字可直接採用的 partial 交給穩定提前執行，不推測。
+        """
+        if self.speculate is None:
+            return
+        key = normalize_transcript(text) if text else ""
+        if self.speculation is not None and self.speculation.key != key:
+            logger.debug(f"Speculative parse for {self.device_id} superseded: '{self.speculation.text}' -> '{text}'")
+            self._drop_speculation()
+        if (self.speculation is not None or self.last_intent is not None
+                or len(key) < STREAMING_SPECULATE_MIN_CHARS or key != normalize_transcript(previous_text)):
+            return
+        self.speculation = Speculation(self.device_id, text, self.speculate)
+        self.speculations += 1
+        logger.info(f"Speculative intent parse for {self.device_id} on partial #{self.partials}: '{text}'")
+
+    @staticmethod
+    def _target_online(intent: dict) -> bool:
+        # 只在關鍵字路徑會直接採用時提前執行（離線裝置仍交給 LLM 與完整轉錄）
+        device = device_table.get_device(intent["target"])
+        return device is not None and device.is_online
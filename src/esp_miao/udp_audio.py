@@ -0,0 +1,152 @@
+"""UDP audio uplink: datagram frames reordered in a small jitter buffer (control stays on the WebSocket)."""
+
+import asyncio
+import logging
+import struct
+from typing import Callable, Optional
+
+from .config import UDP_JITTER_FRAMES
+from .connection import CHUNK_HEADER_V2_FORMAT, CHUNK_HEADER_V2_SIZE
+
+logger = logging.getLogger("esp-miao.udp_audio")
+
+# datagram 內容同 WebSocket binary frame：StreamChunkHeader（24 bytes）+ payload，
+# header 的 seq 即 RTP 序號、capture_us 即時間戳、session_id 用來對應裝置
+_U32 = struct.Struct("<I")
+_SESSION_OFFSET = struct.calcsize(CHUNK_HEADER_V2_FORMAT[:4])   # seq + block_seq + capture_us
+
+FrameSink = Callable[[str, list[bytes]], None]
+
+
+class JitterBuffer:
+    """依 seq 重排亂序的 frame；缺少的 frame 最多等到後面暫存了 depth 個 frame。
+
+    放棄等待時直接跳過缺口：StreamTiming 依 sample_offset 偵測並補償遺失的樣本。
+    晚到（已被跳過或已送出）與重複的 frame 丟棄。
+    """
+
+    def __init__(self, depth: int = UDP_JITTER_FRAMES):
+        self.depth = max(0, depth)
+        self.next_seq = 0
+        self.pending: dict[int, bytes] = {}
+        self.reordered = 0   # 非依序到達、經重排後送出的 frame
+        self.skipped = 0     # 放棄等待的 frame（遺失）
+        self.late = 0        # 跳過後才到、或重複的 frame
+
+    def push(self, seq: int, frame: bytes) -> list[bytes]:
+        """加入一個 frame，回傳可依序送出的 frame（可能為空）。"""
+        if seq < self.next_seq or seq in self.pending:
+            self.late += 1
+            return []
+        if seq != self.next_seq:
+            self.reordered += 1
+        self.pending[seq] = frame
+        return self._release(force=False)
+
+    def flush(self) -> list[bytes]:
+        """串流結束：不再等待，依序送出全部暫存的 frame。"""
+        return self._release(force=True)
+
+    def _release(self, force: bool) -> list[bytes]:
+        out = []
+        while self.pending:
+            if self.next_seq not in self.pending:
+                if not force and len(self.pending) <= self.depth:
+                    break
+                first = min(self.pending)
+                self.skipped += first - self.next_seq
+                self.next_seq = first
+            out.append(self.pending.pop(self.next_seq))
+            self.next_seq += 1
+        return out
+
+
+class UdpAudioReceiver(asyncio.DatagramProtocol):
+    """接收 UDP 音訊 frame，依 header 的 session_id 對應到 audio_start 登記的裝置。
+
+    session_id 為裝置每次串流隨機產生的 32-bit 值，未登記的 datagram 一律丟棄。
+    回調在 event loop 內執行，on_frames 可直接寫入串流緩衝；登記時另給 sink 的 session
+    （連續串流）改交給該 sink。
+    """
+
+    def __init__(self):
+        self.on_frames: Optional[Callable[[str, list[bytes]], None]] = None
+        self.sessions: dict[int, tuple[str, JitterBuffer, Optional[FrameSink]]] = {}
+        self.transport: Optional[asyncio.DatagramTransport] = None
+        self.port = 0
+        self.datagrams = 0
+        self.unknown = 0     # session_id 未登記（串流已結束 / 非本服務的封包）
+        self.reordered = 0
+        self.skipped = 0
+        self.late = 0
+
+    async def start(self, port: int):
+        loop = asyncio.get_running_loop()
+        await loop.create_datagram_endpoint(lambda: self, local_addr=("0.0.0.0", port))
+        self.port = port
+        logger.info(f"UDP audio uplink listening on :{port}")
+
+    def stop(self):
+        if self.transport is not None:
+            self.transport.close()
+            self.transport = None
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def register(self, session_id: int, device_id: str, sink: Optional[FrameSink] = None):
+        """audio_start（transfer_mode=udp）/ continuous_start：同一裝置先前同類的串流一併移除。"""
+        stale = [sid for sid, (dev, _, s) in self.sessions.items()
+                 if dev == device_id and (s is None) == (sink is None)]
+        for sid in stale:
+            self._forget(sid)
+        self.sessions[session_id] = (device_id, JitterBuffer(), sink)
+
+    def finish(self, session_id: Optional[int]) -> list[bytes]:
+        """串流結束：回傳 jitter buffer 內剩餘的 frame，之後此 session 的 datagram 丟棄。"""
+        entry = self.sessions.get(session_id)
+        if entry is None:
+            return []
+        frames = entry[1].flush()
+        self._forget(session_id)
+        return frames
+
+    def _forget(self, session_id: int):
+        _, jitter, _ = self.sessions.pop(session_id)
+        self.reordered += jitter.reordered
+        self.skipped += jitter.skipped
+        self.late += jitter.late
+
+    def datagram_received(self, data: bytes, addr):
+        self.datagrams += 1
+        if len(data) < CHUNK_HEADER_V2_SIZE:
+            self.unknown += 1
+            return
+        (session_id,) = _U32.unpack_from(data, _SESSION_OFFSET)
+        entry = self.sessions.get(session_id)
+        if entry is None:
+            self.unknown += 1
+            return
+        device_id, jitter, sink = entry
+        (seq,) = _U32.unpack_from(data, 0)
+        frames = jitter.push(seq, data)
+        sink = sink or self.on_frames
+        if frames and sink is not None:
+            sink(device_id, frames)
+
+    def error_received(self, exc):
+        logger.warning(f"UDP audio socket error: {exc}")
+
+    def snapshot(self) -> dict:
+        return {
+            "port": self.port,
+            "active_sessions": len(self.sessions),
+            "datagrams": self.datagrams,
+            "unknown": self.unknown,
+            "reordered": self.reordered,
+            "skipped": self.skipped,
+            "late": self.late,
+        }
+
+
+udp_audio = UdpAudioReceiver()
@@ -1,6 +1,7 @@
 import asyncio
 import logging
 from .config import LOCAL_SOUND_DIR
+from .sound_player import sound_player
 
 logger = logging.getLogger("esp-miao.utils")
 
@@ -9,6 +10,10 @@ async def play_local_sound(filename: str):
     if not filename:
         return
 
+    # 預載的提示音直接寫入常駐輸出串流
+    if sound_player.play(filename):
+        return
+
     sound_path = LOCAL_SOUND_DIR / filename
     if not sound_path.exists():
         logger.warning(f"Local sound file not found: {sound_path}")
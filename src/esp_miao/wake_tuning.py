@@ -0,0 +1,123 @@
+"""Per-device wake threshold tuning driven by server-side outcomes (false-wake rate)."""
+
+import logging
+import math
+import time
+from dataclasses import dataclass
+from typing import List, Optional, Tuple
+
+from .config import (
+    WAKE_TUNING, WAKE_TUNE_TARGET, WAKE_TUNE_MIN_SAMPLES, WAKE_TUNE_STEP, WAKE_TUNE_COOLDOWN_S,
+)
+
+logger = logging.getLogger("esp-miao.wake_tuning")
+
+# 同韌體 config.h WAKE_TUNE_MAX；韌體另會夾限在編譯期預設以上
+WAKE_THRESHOLD_MAX = 0.98
+# 喚醒門檻已無空間（會擋掉正常喚醒）時改調 VAD 閾值下限的倍率
+VAD_STEP_RATIO = 1.25
+# 調高門檻時保留的正常喚醒比例：新門檻不超過正常喚醒信心值的第 10 百分位
+GOOD_WAKE_KEEP_QUANTILE = 0.1
+
+
+@dataclass
+class DeviceTuning:
+    """裝置最近一次 audio_start 回報的門檻；baseline 為回報過的最低值（編譯期預設）。"""
+    wake_threshold: float
+    vad_threshold: float
+    version: int
+    wake_baseline: float
+    vad_baseline: float
+    last_push: float = 0.0
+
+
+class WakeTuner:
+    """依裝置的誤喚醒率（喚醒後轉錄為空 / not_understood）決定是否下發新的 wake_tuning。
+
+    誤喚醒率高於 target：喚醒門檻調高一個 step，但不超過正常喚醒信心值的低百分位
+    （避免連真正的喚醒也擋掉）；已無空間時改調高 VAD 閾值下限（吵雜房間的噪音多半在此被擋下）。
+    誤喚醒率低於 target 的一半：逐步放回裝置回報過的最低值。
+    每次下發後冷卻 cooldown_s，並由呼叫端清除該裝置的統計視窗，只以新門檻下的結果判斷下一步。
+    裝置未回報門檻（舊韌體或 WAKE_TUNING_ENABLE=0）則不下發。
+    """
+
+    def __init__(self, enabled: bool = WAKE_TUNING, target: float = WAKE_TUNE_TARGET,
+                 min_samples: int = WAKE_TUNE_MIN_SAMPLES, step: float = WAKE_TUNE_STEP,
+                 cooldown_s: float = WAKE_TUNE_COOLDOWN_S):
+        self.enabled = enabled
+        self.target = target
+        self.min_samples = max(1, min_samples)
+        self.step = step
+        self.cooldown_s = cooldown_s
+        self.devices: dict[str, DeviceTuning] = {}
+        self.pushes = 0
+
+    def observe(self, device_id: str, wake_threshold: Optional[float], vad_threshold: Optional[float],
+                version: Optional[int]):
+        """audio_start 回報的目前門檻。"""
+        if wake_threshold is None or vad_threshold is None:
+            return
+        state = self.devices.get(device_id)
+        if state is None:
+            self.devices[device_id] = DeviceTuning(wake_threshold, vad_threshold, version or 0,
+                                                   wake_threshold, vad_threshold)
+            return
+        state.wake_threshold = wake_threshold
+        state.vad_threshold = vad_threshold
+        state.version = version or 0
+        state.wake_baseline = min(state.wake_baseline, wake_threshold)
+        state.vad_baseline = min(state.vad_baseline, vad_threshold)
+
+    def evaluate(self, device_id: str, history: List[Tuple[float, bool]],
+                 now: Optional[float] = None) -> Optional[dict]:
+        """回傳要下發的 wake_tuning payload；不需調整時為 None。"""
+        state = self.devices.get(device_id)
+        if not self.enabled or state is None or len(history) < self.min_samples:
+            return None
+        now = time.monotonic() if now is None else now
+        if state.last_push and now - state.last_push < self.cooldown_s:
+            return None
+
+        rate = sum(1 for _, false_wake in history if false_wake) / len(history)
+        wake, vad = state.wake_threshold, state.vad_threshold
+        if rate > self.target:
+            good = sorted(c for c, false_wake in history if not false_wake)
+            ceiling = WAKE_THRESHOLD_MAX
+            if good:
+                ceiling = min(ceiling, good[max(1, math.ceil(GOOD_WAKE_KEEP_QUANTILE * len(good))) - 1])
+            raised = min(wake + self.step, ceiling)
+            if raised > wake + 1e-3:
+                wake = raised
+            else:
+                vad = vad * VAD_STEP_RATIO
+        elif rate < self.target / 2 and (wake > state.wake_baseline or vad > state.vad_baseline):
+            wake = max(wake - self.step, state.wake_baseline)
+            vad = max(vad / VAD_STEP_RATIO, state.vad_baseline)
+        else:
+            return None
+
+        state.wake_threshold, state.vad_threshold = round(wake, 3), round(vad, 1)
+        state.version += 1
+        state.last_push = now
+        self.pushes += 1
+        logger.info(f"Wake tuning for {device_id} v{state.version}: false-wake rate {rate:.0%} over "
+                    f"{len(history)} wakes -> threshold {state.wake_threshold}, VAD floor {state.vad_threshold}")
+        return {
+            "wake_threshold": state.wake_threshold,
+            "vad_threshold": state.vad_threshold,
+            "version": state.version,
+            "false_wake_rate": round(rate, 3),
+        }
+
+    def snapshot(self) -> dict:
+        return {
+            "enabled": self.enabled,
+            "pushes": self.pushes,
+            "devices": {
+                dev: {"wake_threshold": s.wake_threshold, "vad_threshold": s.vad_threshold, "version": s.version}
+                for dev, s in self.devices.items()
+            },
+        }
+
+
+wake_tuner = WakeTuner()
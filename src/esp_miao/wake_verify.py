@@ -0,0 +1,87 @@
+"""Second-stage wake verification on the wake-word window at the start of each stream."""
+
+import logging
+from typing import Optional
+
+import numpy as np
+
+from .config import (
+    WAKE_VERIFY_TEMPLATES,
+    WAKE_VERIFY_MIN_TEMPLATES,
+    WAKE_VERIFY_SPREAD,
+)
+from .audio import pcm_to_float32, resample, sample_rate_from_format
+from .classifier import mfcc_features, dtw_distance
+
+logger = logging.getLogger("esp-miao.wake_verify")
+
+
+class WakeVerifier:
+    """以裝置自己的喚醒詞錄音為模板，對新喚醒的視窗做 DTW 最近鄰驗證。
+
+    模板來源（每台裝置各自，麥克風與房間不同）：
+      - 正例：該次喚醒後的指令被理解（回覆不是 not_understood）
+      - 反例：誤喚醒（空白 / 聽不懂，同 flag_false_wake）
+    拒絕需同時滿足：
+      - 正例已有至少 WAKE_VERIFY_MIN_TEMPLATES 個
+      - 最近正例距離超過正例彼此間平均距離 × WAKE_VERIFY_SPREAD（自我校準）
+      - 沒有反例，或最近反例比最近正例更近
+    模板不足或無法取得特徵時不拒絕（回傳 None），照常處理。
+    """
+
+    def __init__(self, max_templates: int = WAKE_VERIFY_TEMPLATES):
+        self.max_templates = max_templates
+        self._positive: dict[str, list[np.ndarray]] = {}
+        self._negative: dict[str, list[np.ndarray]] = {}
+        self._spread: dict[str, float] = {}
+        self.checked = 0
+        self.rejected = 0
+
+    @staticmethod
+    def features(window: bytes, audio_format: str) -> Optional[np.ndarray]:
+        """阻塞：喚醒視窗 PCM → MFCC 特徵（同指令分類器）。"""
+        samples = resample(pcm_to_float32(window), sample_rate_from_format(audio_format))
+        return mfcc_features(samples)
+
+    def verify(self, device_id: str, features: Optional[np.ndarray]) -> Optional[dict]:
+        """回傳 {"accepted", "distance", "spread"[, "negative"]}；無法判斷時回傳 None。"""
+        positive = list(self._positive.get(device_id, ()))   # 於背景執行緒呼叫：先複製
+        spread = self._spread.get(device_id)
+        if features is None or len(positive) < WAKE_VERIFY_MIN_TEMPLATES or not spread:
+            return None
+        d_pos = min(dtw_distance(features, t) for t in positive)
+        result = {"accepted": True, "distance": round(d_pos, 3), "spread": round(spread, 3)}
+        negative = list(self._negative.get(device_id, ()))
+        d_neg = min((dtw_distance(features, t) for t in negative), default=None)
+        if d_neg is not None:
+            result["negative"] = round(d_neg, 3)
+        if d_pos > spread * WAKE_VERIFY_SPREAD and (d_neg is None or d_neg < d_pos):
+            result["accepted"] = False
+        self.checked += 1
+        if not result["accepted"]:
+            self.rejected += 1
+        return result
+
+    def enroll(self, device_id: str, features: Optional[np.ndarray], genuine: bool):
+        """加入一筆已知結果的喚醒視窗（每類保留最新 max_templates 筆）。"""
+        if features is None or self.max_templates <= 0:
+            return
+        templates = (self._positive if genuine else self._negative).setdefault(device_id, [])
+        templates.append(features)
+        del templates[:-self.max_templates]
+        if genuine and len(templates) >= 2:
+            pairs = [dtw_distance(a, b) for i, a in enumerate(templates) for b in templates[i + 1:]]
+            finite = [d for d in pairs if d != float("inf")]
+            self._spread[device_id] = sum(finite) / len(finite) if finite else None
+        logger.debug(f"Wake verifier enrolled {'genuine' if genuine else 'false'} wake for {device_id}: "
+                     f"{len(templates)} templates")
+
+    def snapshot(self) -> dict:
+        return {
+            "checked": self.checked,
+            "rejected": self.rejected,
+            "templates": {d: [len(ts), len(self._negative.get(d, ()))] for d, ts in self._positive.items()},
+        }
+
+
+wake_verifier = WakeVerifier()
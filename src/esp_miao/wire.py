@@ -0,0 +1,137 @@
+"""Compact binary frames (server → device): control messages and downlink audio."""
+
+import struct
+from typing import Callable, Optional
+
+# 裝置於 WebSocket 握手時提供此 subprotocol 即表示能解析 binary 控制 frame；
+# 否則（或遇到未定義的訊息類型）照常送 JSON 文字訊息
+CONTROL_SUBPROTOCOL = "esp-miao.bin1"
+
+# 對應韌體 logic/server_action_queue.h：[magic 0xE5][version][type] + 各類型固定欄位（little-endian）
+CONTROL_MAGIC = 0xE5
+CONTROL_VERSION = 1
+HEADER = struct.Struct("<BBB")
+
+# type 值同韌體 ServerActionType
+TYPE_ACTION = 1
+TYPE_PLAY = 2
+TYPE_TIME_SYNC = 3
+TYPE_RESUME_ACK = 4
+TYPE_AUDIO_CANCEL = 5
+TYPE_HEARTBEAT_ACK = 6
+TYPE_WAKE_TUNING = 7
+TYPE_FALSE_WAKE = 8
+TYPE_MODEL_UPDATE = 9
+TYPE_PROGRESS = 10
+TYPE_CONTINUOUS = 11
+
+# 字串欄位為 NUL 補齊的定長 bytes，長度同韌體 ServerAction 的 char 陣列
+ACTION = struct.Struct("<16s24s12s32s")     # action, target, value, sound
+PLAY = struct.Struct("<32s")                 # audio
+TIME_SYNC = struct.Struct("<BqiIqqq")        # flags(bit0 = round_trip), seconds, ms, seq, t0, t1, t2
+RESUME_ACK = struct.Struct("<IIB")           # session_id, received_samples, accepted
+AUDIO_CANCEL = struct.Struct("<16s24s")      # reason, winner
+HEARTBEAT_ACK = struct.Struct("<I")          # seq
+WAKE_TUNING = struct.Struct("<ffI")          # wake_threshold, vad_threshold, version
+FALSE_WAKE = struct.Struct("<I16s")          # trace_id, reason
+MODEL_UPDATE = struct.Struct("<III")         # generation, size, crc32
+PROGRESS = struct.Struct("<BI")              # stage（PROGRESS_STAGES 的索引）, elapsed_ms
+CONTINUOUS = struct.Struct("<BH")            # flags(bit0 = enable, bit1 = confirm), max_kbps
+# 順序同韌體 ServerProgress
+PROGRESS_STAGES = ("asr_started", "asr_done", "intent_done", "dispatched")
+
+
+def _text(value: Optional[str], size: int) -> bytes:
+    """截斷至 size - 1 bytes（保留 NUL），不切斷 UTF-8 字元。"""
+    raw = (value or "").encode("utf-8")
+    if len(raw) < size:
+        return raw
+    return raw[:size - 1].decode("utf-8", "ignore").encode("utf-8")
+
+
+def _action(p: dict) -> bytes:
+    return ACTION.pack(_text(p.get("action"), 16), _text(p.get("target"), 24),
+                       _text(p.get("value"), 12), _text(p.get("sound"), 32))
+
+
+def _play(p: dict) -> bytes:
+    return PLAY.pack(_text(p.get("audio"), 32))
+
+
+def _time_sync(p: dict) -> bytes:
+    round_trip = all(p.get(k) is not None for k in ("seq", "t0", "t1", "t2"))
+    return TIME_SYNC.pack(1 if round_trip else 0, p.get("seconds", 0), p.get("ms", 0),
+                          p.get("seq") or 0, p.get("t0") or 0, p.get("t1") or 0, p.get("t2") or 0)
+
+
+def _resume_ack(p: dict) -> bytes:
+    return RESUME_ACK.pack(p.get("session_id", 0), p.get("received_samples", 0),
+                           1 if p.get("accepted") else 0)
+
+
+def _audio_cancel(p: dict) -> bytes:
+    return AUDIO_CANCEL.pack(_text(p.get("reason"), 16), _text(p.get("winner"), 24))
+
+
+def _heartbeat_ack(p: dict) -> bytes:
+    return HEARTBEAT_ACK.pack(p.get("seq", 0))
+
+
+def _wake_tuning(p: dict) -> bytes:
+    return WAKE_TUNING.pack(p.get("wake_threshold", 0.0), p.get("vad_threshold", 0.0), p.get("version", 0))
+
+
+def _false_wake(p: dict) -> bytes:
+    return FALSE_WAKE.pack(int(p.get("trace_id") or "0", 16) & 0xFFFFFFFF, _text(p.get("reason"), 16))
+
+
+def _model_update(p: dict) -> bytes:
+    return MODEL_UPDATE.pack(p.get("generation", 0), p.get("size", 0), p.get("crc32", 0))
+
+
+def _progress(p: dict) -> bytes:
+    return PROGRESS.pack(PROGRESS_STAGES.index(p.get("stage")), p.get("elapsed_ms", 0))
+
+
+def _continuous(p: dict) -> bytes:
+    flags = (1 if p.get("enable") else 0) | (2 if p.get("confirm") else 0)
+    return CONTINUOUS.pack(flags, min(p.get("max_kbps", 0), 0xFFFF))
+
+
+_ENCODERS: dict[str, tuple[int, Callable[[dict], bytes]]] = {
+    "action": (TYPE_ACTION, _action),
+    "play": (TYPE_PLAY, _play),
+    "time_sync": (TYPE_TIME_SYNC, _time_sync),
+    "audio_resume_ack": (TYPE_RESUME_ACK, _resume_ack),
+    "audio_cancel": (TYPE_AUDIO_CANCEL, _audio_cancel),
+    "heartbeat_ack": (TYPE_HEARTBEAT_ACK, _heartbeat_ack),
+    "wake_tuning": (TYPE_WAKE_TUNING, _wake_tuning),
+    "false_wake": (TYPE_FALSE_WAKE, _false_wake),
+    "model_update": (TYPE_MODEL_UPDATE, _model_update),
+    "progress": (TYPE_PROGRESS, _progress),
+    "continuous": (TYPE_CONTINUOUS, _continuous),
+}
+
+
+def encode_control(message: dict) -> Optional[bytes]:
+    """Server → 裝置訊息（model_dump() 的 dict）→ binary frame；未定義的類型回傳 None（改送 JSON）。"""
+    entry = _ENCODERS.get(message.get("type"))
+    if entry is None:
+        return None
+    msg_type, encode = entry
+    return HEADER.pack(CONTROL_MAGIC, CONTROL_VERSION, msg_type) + encode(message.get("payload") or {})
+
+
+# 下行音訊 frame（同一條 WebSocket 的 binary frame，不需協商 subprotocol；magic 與控制 frame 不同）
+# 對應韌體 audio/audio_player.h AudioDownlinkHeader：
+#   [magic 0xA5][codec][flags][stream_id][seq u16][samples u16] + payload（PCM16 或一個 IMA-ADPCM 區塊）
+DOWNLINK_MAGIC = 0xA5
+DOWNLINK_HEADER = struct.Struct("<BBBBHH")
+DOWNLINK_CODEC_PCM = 0
+DOWNLINK_CODEC_ADPCM = 1
+DOWNLINK_FLAG_START = 0x01   # 串流第一個 frame
+DOWNLINK_FLAG_END = 0x02     # 串流最後一個 frame（裝置不再等待 prebuffer，播完即止）
+
+
+def encode_downlink(codec: int, flags: int, stream_id: int, seq: int, samples: int, payload: bytes) -> bytes:
+    return DOWNLINK_HEADER.pack(DOWNLINK_MAGIC, codec, flags, stream_id & 0xFF, seq & 0xFFFF, samples) + payload
@@ -0,0 +1,155 @@
+"""Server hot-path benchmarks (pytest-benchmark).
+
+Not collected by a plain `pytest tests/` run; invoke the file explicitly. Baselines are
+machine-specific and saved under .benchmarks/ (not committed):
+
+    uv run pytest tests/bench_hot_path.py --benchmark-autosave           # record a baseline
+    uv run pytest tests/bench_hot_path.py --benchmark-compare \\
+        --benchmark-compare-fail=mean:15%                               # fail on a >15% regression
+"""
+
+import asyncio
+import json
+from types import SimpleNamespace
+from unittest.mock import patch
+
+import numpy as np
+import pytest
+
+pytest.importorskip("pytest_benchmark")
+
+from esp_miao import audio as audio_mod
+from esp_miao import wire
+from esp_miao.app import ingest_frame
+from esp_miao.audio import pcm_to_float32, resample_linear, trim_silence
+from esp_miao.connection import DynamicDeviceTable, manager
+from esp_miao.hallucination import SegmentFilter
+from esp_miao.intent import extract_intent_from_text
+from esp_miao.models import Action, ActionPayload, Device, Play, PlayPayload
+
+# 每個指令各走一條路徑：直接命中、別名 + 語序、拼音補救、聽不懂
+UTTERANCES = ["打開電燈", "幫我把客廳的電風扇關掉", "打開電等", "今天天氣如何"]
+FRAME_BYTES = 512            # 韌體每個 binary frame 的 PCM 量（16 ms @ 16 kHz）
+FRAMES_PER_ROUND = 94        # 約 1.5 秒的指令
+
+
+@pytest.fixture(scope="module")
+def table():
+    table = DynamicDeviceTable(devices=[
+        Device(name="light", type="relay", aliases=["電燈", "客廳燈"]),
+        Device(name="fan", type="relay", aliases=["電風扇", "電扇"]),
+    ])
+    for i in range(30):   # 一般住家規模的裝置表
+        table.update_device({"name": f"plug_{i}", "type": "relay", "aliases": [f"插座{i}號"]})
+    return table
+
+
+@pytest.fixture(scope="module")
+def speech_pcm() -> bytes:
+    """1.5 秒 16 kHz PCM：前後靜音夾一段 440 Hz（trim_silence 有事可做）。"""
+    t = np.arange(int(0.8 * 16000)) / 16000
+    tone = (np.sin(2 * np.pi * 440 * t) * 8000).astype(np.int16)
+    silence = np.zeros(int(0.35 * 16000), dtype=np.int16)
+    return np.concatenate([silence, tone, silence]).tobytes()
+
+
+def test_bench_extract_intent(benchmark, table):
+    with patch("esp_miao.intent.device_table", table):
+        results = benchmark(lambda: [extract_intent_from_text(u) for u in UTTERANCES])
+    assert results[0]["target"] == "light" and results[3]["action"] == "unknown"
+
+
+def test_bench_session_assembly(benchmark):
+    frame = b"\x01\x00" * (FRAME_BYTES // 2)
+
+    def assemble():
+        manager.start_session("bench", transfer_mode="base64", total_samples=FRAMES_PER_ROUND * FRAME_BYTES // 2)
+        for _ in range(FRAMES_PER_ROUND):
+            manager.append_audio_data("bench", frame)
+        session = manager.end_session("bench")
+        size = len(session.audio())
+        session.release()
+        return size
+
+    assert benchmark(assemble) == FRAMES_PER_ROUND * FRAME_BYTES
+
+
+def test_bench_binary_ingest(benchmark):
+    frame = b"\x01\x00" * (FRAME_BYTES // 2)
+
+    def ingest():
+        # 上限大於本輪的量：不觸發 finish_stream，只量收包 → 緩衝的路徑
+        manager.start_session("bench_bin", transfer_mode="binary", total_samples=FRAMES_PER_ROUND * FRAME_BYTES)
+        for _ in range(FRAMES_PER_ROUND):
+            ingest_frame("bench_bin", frame)
+        size = len(manager.sessions["bench_bin"])
+        manager.discard_session("bench_bin")
+        return size
+
+    assert benchmark(ingest) == FRAMES_PER_ROUND * FRAME_BYTES
+
+
+def test_bench_pcm_preparation(benchmark, speech_pcm):
+    def prepare():
+        samples = resample_linear(pcm_to_float32(speech_pcm), 16000)
+        return trim_silence(samples)[0]
+
+    trimmed = benchmark(prepare)
+    assert 0 < len(trimmed) < len(speech_pcm) // 2
+
+
+# 正常指令、長句、前後半重複、同字連續、無語音
+SEGMENTS = [("打開客廳的電燈", 0.05), ("幫我把臥室的冷氣調到二十六度然後關掉電風扇", 0.1),
+            ("謝謝觀看謝謝觀看", 0.2), ("嗯嗯嗯嗯嗯", 0.3), ("字幕", 0.9)]
+
+
+def test_bench_segment_filter(benchmark):
+    segment_filter = SegmentFilter(early_stop=False)
+    segments = [SimpleNamespace(text=t, no_speech_prob=p, avg_logprob=-0.3) for t, p in SEGMENTS]
+    kept = benchmark(lambda: [text for text, _ in segment_filter.run(segments)])
+    assert kept == ["打開客廳的電燈", "幫我把臥室的冷氣調到二十六度然後關掉電風扇"]
+
+
+def test_bench_segment_filter_early_stop(benchmark):
+    """幻聽的第一段即停止：後續視窗（此處以產生器模擬）不再被取出解碼。"""
+    segment_filter = SegmentFilter(early_stop=True)
+    decoded = []
+
+    def windows():
+        for i in range(10):
+            decoded.append(i)
+            yield SimpleNamespace(text="謝謝觀看謝謝觀看", no_speech_prob=0.2, avg_logprob=-0.3)
+
+    def run():
+        decoded.clear()
+        return list(segment_filter.run(windows()))
+
+    assert benchmark(run) == [] and decoded == [0]
+
+
+def test_bench_transcribe_stub_model(benchmark, speech_pcm):
+    """transcribe_audio 去掉模型推論後的固定成本：PCM 轉換、重取樣與詞彙 prompt。"""
+    loop = asyncio.new_event_loop()
+
+    def decode(device_id, samples, beam_size, prompt, background=False):
+        return asyncio.sleep(0, result=("打開電燈", "zh"))
+
+    # background=True：不經 whisper_batcher 的合併視窗與模型級聯，直接走 _run_decode
+    with patch.object(audio_mod, "_run_decode", side_effect=decode):
+        text = benchmark(lambda: loop.run_until_complete(
+            audio_mod.transcribe_audio(speech_pcm, device_id="bench", background=True)))
+    loop.close()
+    assert text == "打開電燈"
+
+
+def test_bench_message_serialisation(benchmark):
+    def serialise():
+        action = Action(
+            device_id="esp32_01", timestamp=1700000000000,
+            payload=ActionPayload(action="relay_set", target="light", value="on", sound="ok.wav"),
+        ).model_dump()
+        play = Play(payload=PlayPayload(audio="ding.wav")).model_dump()
+        return json.dumps(action), wire.encode_control(action), json.dumps(play), wire.encode_control(play)
+
+    action_json, action_frame, _, play_frame = benchmark(serialise)
+    assert '"relay_set"' in action_json and action_frame[0] == wire.CONTROL_MAGIC and play_frame is not None
@@ -28,7 +28,7 @@ async def test_websocket_audio_request():
     
     # 模擬轉錄與意圖解析，避免啟動重型模型
     with patch("esp_miao.app.transcribe_audio", new_callable=AsyncMock) as mock_asr, \
-         patch("esp_miao.app.parse_intent_with_llm") as mock_llm, \
+         patch("esp_miao.app.parse_intent_with_llm", new_callable=AsyncMock) as mock_llm, \
          patch("esp_miao.app.dispatch_command", new_callable=AsyncMock) as mock_dispatch, \
          patch("esp_miao.app.play_local_sound", new_callable=AsyncMock):
         
@@ -2,11 +2,49 @@ import pytest
 import json
 import asyncio
 from unittest.mock import MagicMock, patch, AsyncMock
-from esp_miao.connection import DynamicDeviceTable, device_table
-from esp_miao.intent import extract_intent_from_text
+import struct
+import zlib
+import time
+import numpy as np
+from esp_miao.connection import (
+    DynamicDeviceTable, device_table, StreamTiming, ConnectionManager, WakeArbiter, RequestWorker,
+    CHUNK_HEADER_FORMAT, CHUNK_HEADER_V2_FORMAT,
+)
+from esp_miao.intent import (
+    extract_intent_from_text, parse_intent_with_llm, normalize_transcript, IntentCache, LlmSession,
+)
 from esp_miao.utils import get_action_sound
-from esp_miao.models import Device
-from esp_miao.dispatch import dispatch_command
+from esp_miao.models import Device, AudioStreamStart, AudioStreamEnd, Heartbeat, Telemetry, Health, FlightRecord
+from esp_miao.metrics.aggregator import MetricsAggregator
+from esp_miao.metrics import MetricsContext
+from esp_miao.metrics.loop_lag import LoopLagProbe
+from esp_miao.metrics.stream_arrival import StreamArrival
+from esp_miao.dispatch import dispatch_command, dispatch_commands, MqttDispatcher
+from esp_miao.codec import codec_from_format, decode_ima_adpcm_block, encode_ima_adpcm_block, conceal_loss
+from esp_miao import wire
+from esp_miao.udp_audio import JitterBuffer, UdpAudioReceiver
+from esp_miao.continuous import ContinuousListener
+from esp_miao.prewarm import BackendPrewarmer
+from esp_miao.wake_tuning import WakeTuner
+from esp_miao.sound_player import SoundPlayer
+from esp_miao.downlink import AudioDownlink
+from esp_miao.streaming_asr import StreamingTranscriber
+from esp_miao.audio import (
+    pcm_to_float32, resample, resample_linear, WhisperBatcher, select_whisper_profile, vocabulary_prompt, _decode,
+    trim_silence,
+)
+from esp_miao.scheduler import Lane, LaneBusy, DeadlineExceeded, parse_cpu_list
+from esp_miao.classifier import CommandClassifier, mfcc_features
+from esp_miao.wake_verify import WakeVerifier
+from esp_miao.denoise import NoiseProfiles
+from esp_miao.hallucination import SegmentFilter, smallest_period
+from esp_miao.intent_index import IntentIndex, build_exemplars
+from esp_miao.debug_audio import DebugAudioWriter
+from esp_miao.replay import SessionCapture, ReplayWebSocket, read_capture
+from esp_miao.cluster import ClusterNode
+from esp_miao.clips import CLIP_HEADER, ClipError, parse_clip, save_clip
+from esp_miao.model_image import MODEL_HEADER, ModelImageError, ModelImageStore, parse_model_image
+from esp_miao.flight_record import summarize_flight_record
 
 # --- Test Connection Module (DynamicDeviceTable) ---
 
@@ -43,6 +81,919 @@ def test_device_table_update():
     assert "暖氣" in table.alias_map
     assert table.alias_map["暖氣"] == "heater"
 
+def test_device_table_snapshots_and_discovery_debounce():
+    """驗證裝置表：別名索引增量維護、已發佈快照不受後續變更影響、discovery 湧入時合併成一批套用。"""
+    table = DynamicDeviceTable(devices=[
+        Device(name="light", type="relay", aliases=["燈", "電燈"]),
+        Device(name="lamp", type="relay", aliases=["燈"]),
+    ], debounce_s=60)
+    assert table.alias_map["燈"] == "lamp" and table.alias_map["電燈"] == "light"
+    before = table.current
+    table.remove_device("lamp")
+    assert table.alias_map["燈"] == "light"                 # 別名交回仍列出它的裝置
+    table.set_device_status("light", False)
+    assert before.devices["lamp"].is_online and before.devices["light"].is_online
+    assert not table.get_device("light").is_online
+    assert table.vocab_version == before.vocab_version + 1  # 上下線不使詞彙（意圖快取）失效
+
+    version, publishes = table.vocab_version, table.publishes
+    for i in range(30):                                     # 停電復電：同一批裝置重複發佈
+        table.submit_discovery({"name": f"node_{i % 10}", "type": "relay", "aliases": [f"房間{i % 10}"]})
+    assert table.get_device("node_0") is None               # debounce 期間尚未套用
+    assert table.flush_discovery() == 10
+    assert table.publishes == publishes + 1 and table.vocab_version == version + 1
+    assert table.alias_map["房間3"] == "node_3" and len(table.devices) == 11
+    table.update_device({"name": "node_3", "type": "relay", "aliases": ["房間3"]})
+    assert table.publishes == publishes + 1 and table.snapshot()["discovery_unchanged"] == 1
+
+def test_stream_timing_chunk_header():
+    """驗證 binary chunk 標頭解析、序號缺漏偵測與擷取時間換算。"""
+    timing = StreamTiming(header_bytes=16, sample_rate=16000, epoch_ms=1_000_000, timer_us=5_000_000)
+    pcm = b"\x01\x00" * 1024
+
+    out = timing.consume(struct.pack(CHUNK_HEADER_FORMAT, 0, 10, 4_500_000) + pcm)
+    assert out == pcm
+    assert timing.first_capture_us == 4_500_000
+
+    # seq 1 遺失
+    timing.consume(struct.pack(CHUNK_HEADER_FORMAT, 2, 18, 4_628_000) + pcm)
+    assert timing.dropped_chunks == 1
+    assert timing.chunks == 2
+    assert timing.last_capture_end_us == 4_628_000 + 64_000
+    assert timing.to_epoch_ms(4_500_000) == 999_500.0
+
+def test_stream_resume_offsets():
+    """驗證可續傳標頭：重送部分去重、遺失部分補靜音、舊 session 的 frame 丟棄。"""
+    timing = StreamTiming(header_bytes=24, sample_rate=16000, session_id=0xABCD)
+    pcm = b"\x01\x00" * 512
+
+    def frame(seq, offset, session=0xABCD):
+        return struct.pack(CHUNK_HEADER_V2_FORMAT, seq, 0, 0, session, offset) + pcm
+
+    assert timing.consume(frame(0, 0)) == pcm
+    assert timing.consume(frame(1, 512)) == pcm
+    # 重連後自 offset 768 重送：前 256 個樣本重複
+    assert timing.consume(frame(2, 768)) == pcm[512:]
+    assert timing.duplicate_samples == 256
+    assert timing.received_samples == 1280
+    # 跳過 220 個樣本（環形緩衝已覆寫）
+    out = timing.consume(frame(3, 1500))
+    assert out == bytes(440) + pcm
+    assert timing.lost_samples == 220
+    assert timing.consume(frame(4, 2012, session=0x1234)) == b""
+    assert timing.received_samples == 2012
+
+def test_udp_jitter_buffer_and_concealment():
+    """驗證 UDP frame 亂序重排、放棄等待遺失的 frame，並以前文延續補償遺失的樣本。"""
+    pcm = struct.pack("<512h", *([1000] * 512))
+
+    def frame(seq, session=0x5151):
+        return struct.pack(CHUNK_HEADER_V2_FORMAT, seq, 0, 0, session, seq * 512) + pcm
+
+    jitter = JitterBuffer(depth=2)
+    assert jitter.push(0, b"0") == [b"0"]
+    assert jitter.push(2, b"2") == []          # 等待 seq 1
+    assert jitter.push(1, b"1") == [b"1", b"2"]
+    assert jitter.push(1, b"1") == []          # 重複
+    assert jitter.push(4, b"4") == []
+    assert jitter.push(5, b"5") == []
+    assert jitter.push(6, b"6") == [b"4", b"5", b"6"]   # 超過 depth：放棄 seq 3
+    assert (jitter.skipped, jitter.late, jitter.reordered) == (1, 1, 4)
+    assert jitter.push(7, b"7") == [b"7"]
+    assert jitter.push(9, b"9") == []
+    assert jitter.flush() == [b"9"]
+
+    # 無前文補靜音，有前文則延續並淡出
+    assert conceal_loss(b"", 4) == bytes(8)
+    filled = struct.unpack("<800h", conceal_loss(pcm, 800))
+    assert filled[0] == 1000 and 0 < filled[320] < 1000 and filled[-1] == 0
+
+    received = []
+    receiver = UdpAudioReceiver()
+    receiver.on_frames = lambda device_id, frames: received.extend((device_id, f) for f in frames)
+    receiver.register(0x5151, "esp32_01")
+    receiver.datagram_received(frame(0), None)
+    receiver.datagram_received(frame(1, session=0x9999), None)   # 未登記的 session
+    receiver.datagram_received(frame(2), None)
+    assert [f for _, f in received] == [frame(0)]
+    assert receiver.unknown == 1
+    assert receiver.finish(0x5151) == [frame(2)]
+    receiver.datagram_received(frame(3), None)                   # 已結束
+    assert receiver.unknown == 2
+
+    # seq 1 遺失：StreamTiming 依 sample_offset 以補償樣本填補
+    timing = StreamTiming(header_bytes=24, sample_rate=16000, session_id=0x5151, conceal=True)
+    assert timing.consume(frame(0)) == pcm
+    out = timing.consume(frame(2))
+    assert len(out) == 2048 and out[:2] == pcm[:2] and out[1024:] == pcm
+    assert timing.lost_samples == 512 and timing.dropped_chunks == 1
+
+@pytest.mark.asyncio
+async def test_continuous_listener_segments_and_matches_wake():
+    """驗證連續串流依 sample_offset 間隔切句（gap 內遺失補靜音）、wake_hint 配對、長度上限與喚醒片語比對。"""
+    listener = ContinuousListener(devices={"esp32_01"}, phrases=("嘿喵喵", "喵喵", "hey miaomiao"),
+                                  gap_ms=100, max_utterance_s=1, arm_s=5, confirm=True, max_kbps=48)
+    assert listener.opted_in("esp32_01") and not listener.opted_in("esp32_02")
+    config = listener.config_message()
+    assert config["type"] == "continuous"
+    assert config["payload"] == {"enable": True, "max_kbps": 48, "confirm": True}
+    assert wire.CONTINUOUS.unpack_from(wire.encode_control(config), wire.HEADER.size) == (3, 48)
+
+    assert listener.match_wake("嘿，喵喵，打開電燈。") == "打開電燈"
+    assert listener.match_wake("欸 嘿喵喵") == ""
+    assert listener.match_wake("Hey Miao Miao, turn on the fan") == "turn on the fan"
+    assert listener.match_wake("今天天氣很好，喵喵") is None
+
+    utterances = []
+    listener.on_utterance = utterances.append
+    block, _ = encode_ima_adpcm_block(struct.pack("<640h", *([500] * 640)))
+
+    def frame(seq, offset):
+        return struct.pack(CHUNK_HEADER_V2_FORMAT, seq, 0, 0, 0x77, offset) + block
+
+    listener.start("esp32_01", 0x77)
+    receiver = UdpAudioReceiver()
+    receiver.register(0x77, "esp32_01", sink=listener.on_frames)
+    receiver.register(0x78, "esp32_01")                      # 喚醒串流不取代連續串流
+    assert set(receiver.sessions) == {0x77, 0x78}
+    receiver.datagram_received(frame(0, 0), None)
+    receiver.datagram_received(frame(1, 1280), None)         # offset 640 的 frame 遺失
+    listener.hint("esp32_01", 1000, 0.9)
+    receiver.datagram_received(frame(2, 8000), None)         # 間隔超過 gap（1600 樣本）：切句
+    assert len(utterances) == 1
+    first = utterances[0]
+    assert (first.start, first.end, first.hint) == (0, 1920, 0.9)
+    assert len(first.pcm) == 1920 * 2 and first.pcm[1280:2560] == bytes(1280)
+
+    await asyncio.sleep(0.15)                                # gap 時間內沒有新 frame
+    assert len(utterances) == 2 and utterances[1].start == 8000 and utterances[1].hint is None
+
+    listener.on_frames("esp32_01", [frame(3 + i, 20000 + i * 640) for i in range(26)])
+    assert len(utterances) == 3 and utterances[2].end - utterances[2].start == 16000
+
+    listener.arm("esp32_01")
+    assert listener.take_armed("esp32_01") and not listener.take_armed("esp32_01")
+    assert listener.stop("esp32_01") == 0x77 and listener.stop("esp32_01") is None
+    listener.on_frames("esp32_01", [frame(40, 40000)])      # 已停止：丟棄
+    assert len(utterances) == 3
+
+def test_stream_suspend_and_resume():
+    """驗證串流中斷線後保留狀態，audio_resume 以相同 session_id 恢復。"""
+    mgr = ConnectionManager()
+
+    def start(session_id):
+        timing = StreamTiming(header_bytes=24, session_id=session_id)
+        mgr.start_session("dev", confidence=0.9, transfer_mode="binary",
+                          total_samples=0, timing=timing, bounded=False)
+        frame = struct.pack(CHUNK_HEADER_V2_FORMAT, 0, 0, 0, session_id, 0) + b"\x00\x00" * 100
+        mgr.append_audio_data("dev", timing.consume(frame))
+        mgr.disconnect("dev")
+        assert "dev" not in mgr.sessions
+        return timing
+
+    timing = start(7)
+    resumed = mgr.resume_stream("dev", session_id=7, seq=5)
+    assert resumed is timing
+    assert resumed.received_samples == 100
+    assert resumed.next_seq == 5 and resumed.resumes == 1
+    assert len(mgr.get_audio_data("dev")) == 200
+    assert mgr.sessions["dev"].confidence == 0.9
+    assert mgr.sessions["dev"].transfer_mode == "binary"
+
+    start(8)
+    assert mgr.resume_stream("dev", session_id=9) is None
+    assert "dev" not in mgr.suspended_streams
+
+def test_stream_session_buffer_pool():
+    """驗證串流緩衝依 total_samples 預配置、超出時擴充，處理完歸還 pool 供下一個串流重用。"""
+    mgr = ConnectionManager()
+    session = mgr.start_session("dev", transfer_mode="binary", total_samples=100)
+    assert len(session.buffer) == 200 and session.expected_bytes == 200
+    mgr.append_audio_data("dev", b"\x01\x00" * 60)
+    mgr.append_audio_data("dev", b"\x02\x00" * 60)      # 超出預估，加倍擴充
+    assert len(session) == 240 and len(session.buffer) >= 240
+    view = session.audio()
+    assert view.readonly and bytes(view[118:122]) == b"\x01\x00\x02\x00"
+
+    assert mgr.end_session("dev") is session and "dev" not in mgr.sessions
+    session.release()
+    reused = mgr.start_session("dev", transfer_mode="binary", total_samples=50, bounded=False)
+    assert reused.expected_bytes == 0 and len(reused) == 0
+    assert mgr.buffer_pool.reused == 1
+    assert mgr.streaming_devices() == []
+    mgr.append_audio_data("dev", b"\x00\x00")
+    assert mgr.streaming_devices() == ["dev"]
+
+def test_wake_arbiter_keeps_most_confident_stream():
+    """驗證多節點同一次喚醒只保留信心最高的串流，被取消的串流不再收音訊。"""
+    arbiter = WakeArbiter(window_s=0.3)
+    assert arbiter.register("living", 0.80, now=10.0) == []
+    assert arbiter.register("kitchen", 0.95, now=10.1) == ["living"]   # 後到但信心較高
+    assert arbiter.register("bedroom", 0.90, now=10.2) == ["bedroom"]
+    assert arbiter.winner == "kitchen"
+    assert arbiter.register("living", 0.70, now=11.0) == []              # 視窗外：新的一組
+    assert arbiter.snapshot() == {"window_s": 0.3, "groups": 2, "cancelled": 2}
+    assert WakeArbiter(window_s=0).register("a", 0.9) == []
+
+    mgr = ConnectionManager()
+    mgr.start_session("living", transfer_mode="binary", total_samples=100)
+    mgr.append_audio_data("living", b"\x01\x00" * 10)
+    session = mgr.cancel_session("living")
+    mgr.append_audio_data("living", b"\x01\x00" * 10)
+    assert session.cancelled and len(session) == 0 and mgr.streaming_devices() == []
+
+@pytest.mark.asyncio
+async def test_stale_socket_close_keeps_reconnected_stream():
+    """驗證裝置在舊連線被偵測中斷前重連並恢復串流時，舊連線關閉不拆掉新連線、控制格式與串流。"""
+    mgr = ConnectionManager()
+    sockets = []
+    for _ in range(2):
+        ws = AsyncMock()
+        ws.scope = {"subprotocols": [wire.CONTROL_SUBPROTOCOL]}
+        sockets.append(ws)
+    old, new = sockets
+
+    await mgr.connect("dev", old)
+    timing = StreamTiming(header_bytes=24, session_id=9)
+    mgr.start_session("dev", confidence=0.8, transfer_mode="binary",
+                      total_samples=0, timing=timing, bounded=False)
+    frame = struct.pack(CHUNK_HEADER_V2_FORMAT, 0, 0, 0, 9, 0) + b"\x00\x00" * 100
+    mgr.append_audio_data("dev", timing.consume(frame))
+
+    await mgr.connect("dev", new)
+    assert mgr.resume_stream("dev", session_id=9, seq=1) is timing
+
+    assert not mgr.disconnect("dev", old)
+    assert mgr.active_connections["dev"] is new
+    assert mgr.binary_control == {"dev"}
+    assert "dev" in mgr.sessions and "dev" not in mgr.suspended_streams
+    frame = struct.pack(CHUNK_HEADER_V2_FORMAT, 1, 1, 0, 9, 100) + b"\x01\x00" * 100
+    mgr.append_audio_data("dev", timing.consume(frame))
+    assert len(mgr.get_audio_data("dev")) == 400 and timing.received_samples == 200
+
+    # 新連線自己的中斷照常收掉並保留可恢復的串流
+    assert mgr.disconnect("dev", new)
+    assert "dev" not in mgr.active_connections and "dev" in mgr.suspended_streams
+
+@pytest.mark.asyncio
+async def test_binary_control_frames():
+    """驗證協商 subprotocol 的裝置收到定長 binary 控制 frame，其餘裝置與未定義類型照常 JSON。"""
+    frame = wire.encode_control({"type": "action", "payload": {
+        "action": "relay_set", "target": "light", "value": "on", "sound": "x" * 40}})
+    magic, version, msg_type = wire.HEADER.unpack_from(frame)
+    assert (magic, version, msg_type) == (0xE5, 1, wire.TYPE_ACTION)
+    action, target, value, sound = wire.ACTION.unpack_from(frame, wire.HEADER.size)
+    assert action.rstrip(b"\0") == b"relay_set" and target.rstrip(b"\0") == b"light"
+    assert sound.endswith(b"\0") and len(sound.rstrip(b"\0")) == 31   # 截斷後保留 NUL
+
+    sync = wire.encode_control({"type": "time_sync", "payload": {
+        "seconds": 1700000000, "ms": 5, "seq": 3, "t0": 10, "t1": 20, "t2": 30}})
+    assert wire.TIME_SYNC.unpack_from(sync, wire.HEADER.size) == (1, 1700000000, 5, 3, 10, 20, 30)
+    assert wire.encode_control({"type": "unknown"}) is None
+
+    mgr = ConnectionManager()
+    for device_id, offered in (("new", [wire.CONTROL_SUBPROTOCOL]), ("old", [])):
+        ws = AsyncMock()
+        ws.scope = {"subprotocols": offered}
+        await mgr.connect(device_id, ws)
+    assert mgr.binary_control == {"new"}
+    mgr.active_connections["new"].accept.assert_awaited_once_with(subprotocol=wire.CONTROL_SUBPROTOCOL)
+
+    message = {"type": "play", "payload": {"audio": "ok.wav"}}
+    assert await mgr.send_to_device("new", message) and await mgr.send_to_device("old", message)
+    mgr.active_connections["new"].send_bytes.assert_awaited_once_with(wire.encode_control(message))
+    mgr.active_connections["old"].send_text.assert_awaited_once_with(json.dumps(message))
+    mgr.disconnect("new")
+    assert mgr.binary_control == set()
+
+@pytest.mark.asyncio
+async def test_link_warmup_prewarms_backends_once_per_interval():
+    """驗證 link_warmup 觸發背景預熱、間隔內不重複，並統計接著 audio_start 的命中與提前量。"""
+    calls = []
+
+    async def warm_llm():
+        calls.append("llm")
+        return 0.5
+
+    async def warm_whisper():
+        raise RuntimeError("model missing")
+
+    prewarmer = BackendPrewarmer(min_interval_s=60)
+    prewarmer.add("whisper", warm_whisper)
+    prewarmer.add("llm", warm_llm)
+
+    assert prewarmer.request("esp32_01")
+    assert not prewarmer.request("esp32_02")       # 預熱進行中 / 間隔內
+    await asyncio.sleep(0)
+    assert calls == ["llm"]
+    assert prewarmer.last_timings == {"whisper": None, "llm": 0.5}
+    assert not prewarmer.request("esp32_01")
+    assert prewarmer.runs == 1 and prewarmer.received == 3
+
+    assert prewarmer.stream_started("esp32_01") is not None
+    assert prewarmer.stream_started("esp32_01") is None   # 每次 link_warmup 只計一次
+    assert prewarmer.stream_started("esp32_03") is None
+    assert prewarmer.snapshot()["hits"] == 1
+
+    disabled = BackendPrewarmer(min_interval_s=0)
+    disabled.add("llm", warm_llm)
+    assert not disabled.request("esp32_01")
+
+@pytest.mark.asyncio
+async def test_sound_player_preloads_and_reuses_stream(tmp_path):
+    """驗證提示音預載為 PCM，多次播放共用同一條常駐 aplay 串流；未預載的檔案交回呼叫端。"""
+    import wave
+    for name in ("ack.wav", "error.wav"):
+        with wave.open(str(tmp_path / name), "wb") as w:
+            w.setnchannels(1)
+            w.setsampwidth(2)
+            w.setframerate(16000)
+            w.writeframes(b"\x01\x00" * 160)
+    (tmp_path / "broken.wav").write_bytes(b"not a wav")
+
+    player = SoundPlayer(sound_dir=tmp_path)
+    assert player.preload() == 2
+    assert not player.play("ack.wav")              # worker 尚未啟動
+
+    proc = MagicMock(returncode=None)
+    proc.stdin.drain = AsyncMock()
+    proc.wait = AsyncMock(return_value=0)
+    with patch("asyncio.create_subprocess_exec", new_callable=AsyncMock, return_value=proc) as spawn:
+        player.start()
+        assert player.play("ack.wav") and player.play("error.wav")
+        assert not player.play("missing.wav")
+        for _ in range(5):
+            await asyncio.sleep(0)
+        await player.stop()
+
+    spawn.assert_awaited_once()
+    assert spawn.await_args.args[:3] == ("aplay", "-q", "-t")
+    assert proc.stdin.write.call_count == 2
+    assert proc.stdin.write.call_args.args[0] == b"\x01\x00" * 160
+    assert player.snapshot()["played"] == 2 and player.stream_opens == 1
+    proc.stdin.close.assert_called_once()
+
+@pytest.mark.asyncio
+async def test_downlink_streams_feedback_to_device_speaker():
+    """驗證下行音訊：IMA-ADPCM 編碼可由上行解碼器還原，frame 帶 START / END，新提示音中止前一段。"""
+    tone = (np.sin(np.arange(1600) * 2 * np.pi * 440 / 16000) * 8000).astype("<i2").tobytes()
+    block, state = encode_ima_adpcm_block(tone[:640])
+    assert len(block) == 4 + 160 and state != (0, 0)
+    block, state = encode_ima_adpcm_block(tone[640:1280], state)   # 狀態跨區塊延續，不再重新收斂
+    decoded = np.frombuffer(decode_ima_adpcm_block(block), dtype="<i2")
+    assert np.abs(decoded.astype(int) - np.frombuffer(tone[640:1280], dtype="<i2")).max() < 500
+
+    sent = []
+
+    async def send(device_id, frame):
+        sent.append((device_id, frame))
+        return True
+
+    downlink = AudioDownlink(send=send, frame_ms=20, prebuffer_ms=1000, lead_ms=1000)
+    assert not downlink.send_pcm("esp32_01", tone, 16000)    # 未宣告喇叭：改由 Server 播放
+    downlink.set_format("esp32_01", "adpcm_16k_4bit")
+    assert downlink.send_pcm("esp32_01", tone, 16000)
+    await asyncio.sleep(0.01)
+
+    headers = [wire.DOWNLINK_HEADER.unpack_from(frame) for _, frame in sent]
+    assert len(headers) == 5
+    assert all(h[0] == wire.DOWNLINK_MAGIC and h[1] == wire.DOWNLINK_CODEC_ADPCM for h in headers)
+    assert [h[2] for h in headers] == [wire.DOWNLINK_FLAG_START, 0, 0, 0, wire.DOWNLINK_FLAG_END]
+    assert [h[4] for h in headers] == [0, 1, 2, 3, 4] and {h[5] for h in headers} == {320}
+
+    # 節流中的串流被新的提示音中止
+    slow = AudioDownlink(send=send, frame_ms=20, prebuffer_ms=20, lead_ms=20)
+    slow.set_format("esp32_01", "pcm_16k_16bit")
+    sent.clear()
+    slow.send_pcm("esp32_01", tone * 10, 16000)
+    await asyncio.sleep(0)
+    slow.send_pcm("esp32_01", tone, 16000)
+    await asyncio.sleep(0.2)
+    assert slow.interrupted == 1
+    assert wire.DOWNLINK_HEADER.unpack_from(sent[-1][1])[2] & wire.DOWNLINK_FLAG_END
+    slow.forget("esp32_01")
+    assert not slow.send_pcm("esp32_01", tone, 16000)
+
+def test_heartbeat_reconnect_tracking():
+    """驗證心跳保存連線統計，只回報新增的重連；裝置重開機（計數歸零）不誤報。"""
+    mgr = ConnectionManager()
+
+    def beat(reconnects, hist):
+        msg = Heartbeat(device_id="dev", timestamp=1,
+                        payload={"seq": 1, "reconnects": reconnects, "reconnect_hist": hist})
+        return mgr.record_heartbeat("dev", msg.payload)
+
+    assert beat(0, [0] * 7) == 0
+    assert beat(2, [1, 1, 0, 0, 0, 0, 0]) == 2
+    assert beat(2, [1, 1, 0, 0, 0, 0, 0]) == 0
+    mgr.disconnect("dev")
+    assert mgr.link_health["dev"].reconnect_hist == [1, 1, 0, 0, 0, 0, 0]
+    assert beat(0, [0] * 7) == 0
+    assert mgr.link_health["dev"].tls_handshake_ms == -1   # 未回報 TLS 欄位（明文 ws:// 或舊韌體）
+
+def test_latency_histograms_report_tail_percentiles():
+    """驗證各階段延遲以對數分桶直方圖記錄：多執行緒各自記錄後合併，百分位誤差在一個分桶內。"""
+    import threading
+    agg = MetricsAggregator()
+
+    def run(offset):
+        for i in range(250):
+            ctx = MetricsContext(f"r{offset}{i}", "dev")
+            ctx.record_latency("asr_latency", (offset * 250 + i + 1) / 1000)   # 1 ms … 1 s
+            ctx.finalize()
+            agg.record(ctx)
+
+    threads = [threading.Thread(target=run, args=(n,)) for n in range(4)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    asr = agg.snapshot()["latency"]["asr"]
+    assert asr["count"] == 1000 and asr["max"] == 1.0
+    assert 0.95 <= asr["p95"] <= 0.95 * 1.05 and 0.5 <= asr["p50"] <= 0.5 * 1.05
+    assert agg.latency_snapshot()["llm"]["count"] == 0          # LLM 未呼叫：0.0 不列入
+
+    text = agg.prometheus_text()
+    assert "esp_miao_requests_total 1000" in text
+    assert 'esp_miao_stage_latency_seconds_count{stage="asr"} 1000' in text
+    assert 'esp_miao_stage_latency_seconds{stage="llm",quantile="0.99"} NaN' in text
+
+def test_device_trace_merges_into_request_timeline():
+    """驗證裝置端追蹤：audio_end 的階段時間換算為牆鐘後，與 Server 端階段併成同一條時間線。"""
+    msg = AudioStreamEnd(device_id="dev", timestamp=1, payload={
+        "total_samples": 16000, "reason": "silence",
+        "trace": {"wake_us": 4_100_000, "ack_us": 4_102_000, "stream_start_us": 4_400_000,
+                  "first_frame_us": 4_405_000, "last_frame_us": 5_500_000},
+    })
+    timing = StreamTiming(epoch_ms=1_000_000, timer_us=4_400_000, trace_id="5f3a9c01")
+    events = {name[:-3]: timing.to_epoch_ms(us) for name, us in msg.payload.trace.model_dump().items()}
+    assert events["wake"] == 999_700 and events["last_frame"] == 1_001_100
+
+    ctx = MetricsContext("r1", "dev")
+    ctx.merge_device_trace(timing.trace_id, {**events, "server_last_byte": 1_001_130})
+    ctx.mark_event("asr_done", 1_001_600)
+    data = ctx.finalize()
+    assert data["trace_id"] == "5f3a9c01" and data["timeline_origin_ms"] == 999_700
+    timeline = data["timeline"]
+    assert list(timeline)[:5] == ["wake", "ack", "stream_start", "first_frame", "last_frame"]
+    assert timeline["server_last_byte"] == 1430.0 and timeline["asr_done"] == 1900.0
+
+def test_stream_arrival_attributes_stalls():
+    """驗證 binary 串流到達統計：間隔百分位、即時比例（扣除 pre-roll），停頓依 Server 忙碌 / event loop 停頓 / 擷取間隔 / 其他歸因。"""
+    probe = LoopLagProbe()
+    arrival = StreamArrival(sample_rate=16000, preroll_samples=8000, stall_s=0.1, probe=probe)
+    rx, capture = 100.0, 5_000_000
+    for _ in range(50):                      # 20 ms frame，即時到達
+        arrival.record(rx, capture)
+        rx += 0.02
+        capture += 20_000
+    rx += 0.2
+    arrival.record(rx, capture, busy_s=0.15)                # 讀取迴圈忙於上一則訊息
+    rx += 0.2
+    probe.record(rx, 0.18)                                  # event loop 停頓
+    arrival.record(rx, capture + 20_000)
+    rx += 0.2
+    arrival.record(rx, capture + 240_000)                   # 裝置端本身隔了 220 ms 才擷取 / 送出
+    rx += 0.25
+    arrival.record(rx, capture + 260_000)                   # 無法由兩端解釋：網路
+
+    s = arrival.summary(8000 + 54 * 320)
+    assert s["chunks"] == 54
+    assert s["gap_p50_ms"] == 20.0
+    assert s["gap_max_ms"] == 250.0
+    assert (s["stalls_server"], s["stalls_device"], s["stalls_network"]) == (2, 1, 1)
+    assert s["stalls"] == 4
+    assert s["audio_ms"] == 1080.0
+    assert s["realtime_ratio"] > 1.5
+    assert s["jitter_ms"] > 0
+
+    quiet = StreamArrival()
+    quiet.record(1.0)
+    assert quiet.summary(0)["realtime_ratio"] is None
+
+
+def test_loop_lag_probe_captures_blocking_stack():
+    """驗證 event loop 停頓偵測：阻塞呼叫期間抓到 loop 執行緒的 stack 與 Task，結束後補上完整長度並計入延遲百分位。"""
+    import time as time_mod
+
+    def blocking_publish():
+        time_mod.sleep(0.3)   # 模擬在 event loop 上呼叫的同步 I/O
+
+    async def offender():
+        blocking_publish()
+
+    async def run():
+        probe = LoopLagProbe(interval_s=0.01, stall_s=0.1)
+        probe.start()
+        await asyncio.sleep(0.05)
+        await asyncio.create_task(offender(), name="handler")
+        await asyncio.sleep(0.05)
+        probe.stop()
+        return probe
+
+    probe = asyncio.run(run())
+    assert probe.stall_count == 1
+    stall = probe.recent_stalls[0]
+    assert "blocking_publish" in "".join(stall["stack"])
+    assert stall["task"].startswith("handler")
+    assert stall["lag_ms"] >= 250
+    snap = probe.snapshot()
+    assert snap["stalls"] == 1 and snap["max_ms"] >= 250
+    assert snap["samples"] > 5 and snap["p50_ms"] < 100
+    assert "esp_miao_event_loop_stalls_total 1" in probe.prometheus_text()
+
+
+def test_block_metrics_log_rotates_and_seeks_by_time(tmp_path):
+    """驗證區塊式 metrics 記錄：依大小輪替並只保留最新的 segment，時間索引跳過不相關的區塊，崩潰寫壞的區塊於重開時截掉。"""
+    from esp_miao.metrics.blocklog import BlockLogWriter, read_records, load_index
+
+    writer = BlockLogWriter(tmp_path, segment_bytes=400, max_segments=2)
+    writer.open()
+    for block in range(10):
+        writer.write_block([{"timestamp": 1000 + block * 10 + i, "request_id": f"r{block}{i}"} for i in range(5)])
+    writer.close()
+
+    segments = load_index(tmp_path)
+    assert len(segments) == 2 and sorted(p.name for p in tmp_path.glob("*.emb")) == [s["file"] for s in segments]
+    assert segments[0]["first_ts"] > 1000                       # 最舊的 segment 已刪除
+    assert [r["timestamp"] for r in read_records(tmp_path, 1080, 1082)] == [1080, 1081, 1082]
+
+    with open(tmp_path / segments[-1]["file"], "ab") as f:
+        f.write(b"EMB1torn")                                    # 寫到一半的區塊
+    writer = BlockLogWriter(tmp_path, segment_bytes=400, max_segments=2)
+    writer.open()
+    writer.write_block([{"timestamp": 2000}])
+    writer.close()
+    assert [r["timestamp"] for r in read_records(tmp_path, since=1094)] == [1094, 2000]
+
+def test_load_test_reports_saturation_point():
+    """驗證負載測試統計：失敗請求視為超出預算計入 p95，找出 p95 首次超過 2 秒預算的房間數。"""
+    from esp_miao.esp32_simulator import LoadStats, find_saturation, percentile
+
+    assert percentile([], 0.95) == 0.0 and percentile([1, 2, 3, 4], 0.5) == 2
+
+    light = LoadStats(2, latencies=[0.4] * 20)
+    busy = LoadStats(4, latencies=[0.8] * 19 + [1.9])
+    failing = LoadStats(8, latencies=[0.9] * 18)   # 回覆的請求都很快，但有逾時
+    failing.error("timeout")
+    failing.error("timeout")
+    failing.cancelled = 3
+
+    summary = failing.summary(budget=2.0)
+    assert summary["requests"] == 20 and summary["ok"] == 18 and summary["error_rate"] == 0.1
+    assert summary["p50"] == 0.9 and summary["p95"] == float("inf") and not summary["within_budget"]
+    assert busy.summary(budget=2.0)["p95"] == 0.8 and busy.summary(budget=2.0)["within_budget"]
+    assert find_saturation([light, busy, failing], budget=2.0) == 8
+    assert find_saturation([light, busy], budget=2.0) is None
+    assert find_saturation([LoadStats(1), light], budget=0.3) == 2   # 沒有請求的階段不算
+
+
+def test_wake_tuning_follows_false_wake_rate():
+    """驗證誤喚醒率：高於目標時調高門檻（不超過正常喚醒的信心值），無空間改調 VAD，偏低時放回預設。"""
+    agg = MetricsAggregator(wake_window=10)
+    for i in range(10):
+        ctx = MetricsContext(f"r{i}", "esp32_01")
+        ctx.mark_stage("wake_confidence", 0.9 if i % 2 else 0.81)
+        ctx.set_flag("asr_empty" if i % 2 == 0 else "validator_pass", True)   # 低信心的一半轉錄為空
+        agg.record(ctx)
+    errored = MetricsContext("err", "esp32_01")
+    errored.mark_stage("wake_confidence", 0.5)
+    errored.set_error("ASR crashed")                                           # Server 端失敗不計入
+    agg.record(errored)
+    history = agg.wake_history("esp32_01")
+    assert len(history) == 10 and agg.wake_snapshot()["esp32_01"]["false_wake_rate"] == 0.5
+
+    tuner = WakeTuner(enabled=True, target=0.2, min_samples=10, step=0.05, cooldown_s=60)
+    assert tuner.evaluate("esp32_01", history, now=100.0) is None              # 裝置未回報門檻
+    tuner.observe("esp32_01", 0.8, 4000.0, 0)
+    push = tuner.evaluate("esp32_01", history, now=100.0)
+    assert push == {"wake_threshold": 0.85, "vad_threshold": 4000.0, "version": 1, "false_wake_rate": 0.5}
+    assert tuner.evaluate("esp32_01", history, now=120.0) is None              # 冷卻中
+
+    tuner.observe("esp32_01", 0.88, 4000.0, 1)                                 # 已接近正常喚醒的 0.9
+    push = tuner.evaluate("esp32_01", history, now=200.0)
+    assert push["wake_threshold"] == 0.9 and push["version"] == 2
+    tuner.observe("esp32_01", 0.9, 4000.0, 2)
+    push = tuner.evaluate("esp32_01", history, now=300.0)
+    assert push["wake_threshold"] == 0.9 and push["vad_threshold"] == 5000.0   # 改調 VAD 閾值下限
+
+    quiet = [(0.95, False)] * 10
+    push = tuner.evaluate("esp32_01", quiet, now=400.0)
+    assert push["wake_threshold"] == 0.85 and push["vad_threshold"] == 4000.0
+    tuner.observe("esp32_01", 0.8, 4000.0, 4)
+    assert tuner.evaluate("esp32_01", quiet, now=500.0) is None                # 已回到預設
+
+    frame = wire.encode_control({"type": "wake_tuning", "payload": push})
+    assert frame[:3] == bytes([wire.CONTROL_MAGIC, wire.CONTROL_VERSION, wire.TYPE_WAKE_TUNING])
+    assert wire.WAKE_TUNING.unpack(frame[3:])[2] == 4
+
+
+def test_clip_upload_round_trip(tmp_path):
+    """驗證誤觸發片段：韌體格式（標頭 + 跨區塊延續狀態的 ADPCM）解碼存成 WAV + JSON，截斷則拒收。"""
+    t = np.arange(2500) / 16000
+    pcm = (3000 * np.sin(2 * np.pi * 440 * t)).astype("<i2").tobytes()
+    data = bytearray(CLIP_HEADER.pack(b"MCLP", 1, 1, 16000, 2500, 0.62, 0xABCD1234, 0, 1000, 0))
+    state = (0, 0)
+    for i in range(0, 2500, 1000):
+        block, state = encode_ima_adpcm_block(pcm[i * 2:(i + 1000) * 2], state)
+        data += block
+
+    meta, decoded = parse_clip(bytes(data))
+    assert meta["kind"] == "false_wake" and meta["trace_id"] == "abcd1234" and meta["device_time"] is None
+    assert len(decoded) == 5000
+    error = np.abs(np.frombuffer(decoded, "<i2")[200:].astype(int) - np.frombuffer(pcm, "<i2")[200:])
+    assert error.mean() < 200
+
+    path = save_clip("esp32/01", bytes(data), tmp_path)
+    assert path.parent == tmp_path / "false_wake" and path.name.startswith("esp32_01_")
+    assert json.loads(path.with_suffix(".json").read_text())["device_id"] == "esp32/01"
+    with pytest.raises(ClipError):
+        parse_clip(bytes(data[:-10]))
+
+    frame = wire.encode_control({"type": "false_wake", "payload": {"trace_id": "abcd1234", "reason": "not_understood"}})
+    assert frame[2] == wire.TYPE_FALSE_WAKE
+    assert wire.FALSE_WAKE.unpack(frame[3:]) == (0xABCD1234, b"not_understood\0\0")
+
+
+def test_model_image_offered_once_to_older_devices(tmp_path):
+    """驗證模型映像：CRC 正確才提供，只推送給回報較舊 generation 的裝置且每個 generation 一次。"""
+    payload = bytes(range(64))
+    header = MODEL_HEADER.pack(b"MMDL", 1, 23, 0xE6692057, 3, len(payload), zlib.crc32(payload), 0.8, 0)
+    path = tmp_path / "model.bin"
+    path.write_bytes(header + payload)
+
+    store = ModelImageStore(str(path))
+    assert store.offer("dev", None) is None          # 沒有 model 分區的韌體不回報
+    assert store.offer("dev", 3) is None
+    image = store.offer("dev", 0)
+    assert (image.generation, image.size, image.crc32) == (3, 96, zlib.crc32(payload))
+    assert store.offer("dev", 0) is None             # 同一 generation 不重複推送
+    assert store.offer("other", 2).generation == 3
+    with pytest.raises(ModelImageError):
+        parse_model_image(path, header + payload[:-1] + b"\xff")
+
+    frame = wire.encode_control({"type": "model_update", "payload": {"generation": 3, "size": 96, "crc32": image.crc32}})
+    assert frame[2] == wire.TYPE_MODEL_UPDATE
+    assert wire.MODEL_UPDATE.unpack(frame[3:]) == (3, 96, image.crc32)
+
+
+def test_edge_telemetry_aggregation():
+    """驗證裝置端推論剖析報告保存最新一份，沒有樣本的階段不列入。"""
+    agg = MetricsAggregator()
+    msg = Telemetry(device_id="dev", timestamp=1, payload={
+        "seq": 3, "interval_ms": 10000,
+        "stages": {"nn": [80, 9000, 9500, 11000], "mfcc": [0, 0, 0, 0]},
+    })
+    stages = agg.record_telemetry("dev", msg.payload.stages)
+    assert stages == {"nn": {"count": 80, "min_us": 9000, "avg_us": 9500, "p99_us": 11000}}
+    agg.record_telemetry("dev", {"vad": [80, 100, 150, 300]})
+    assert list(agg.edge_snapshot()["dev"]) == ["vad"]
+
+def test_edge_ui_frame_stats():
+    """驗證顯示 Task 幀統計：換算 fps，欄位數不符時忽略。"""
+    agg = MetricsAggregator()
+    msg = Telemetry(device_id="dev", timestamp=1, payload={
+        "seq": 4, "interval_ms": 10000, "stages": {},
+        "ui": [120, 2, 35, 2100, 6400, 5200, 9800],
+    })
+    ui = agg.record_ui_frames("dev", msg.payload.ui, msg.payload.interval_ms)
+    assert ui["fps"] == 12.0 and ui["late_max_ms"] == 35 and ui["push_max_us"] == 9800
+    assert agg.record_ui_frames("dev", [1, 2, 3], 10000) is None
+    assert agg.ui_snapshot()["dev"]["frames"] == 120
+
+def test_edge_server_round_trip():
+    """驗證裝置端觀察的 Server 往返：沒有樣本的階段略過，區間內沒有 session 時保留上一份。"""
+    agg = MetricsAggregator()
+    msg = Telemetry(device_id="dev", timestamp=1, payload={
+        "seq": 6, "interval_ms": 10000, "stages": {},
+        "server": {"asr_started": [2, 40, 55], "asr_done": [2, 610, 700], "intent_done": [2, 640, 720],
+                   "dispatched": [0, 0, 0], "reply": [2, 690, 760]},
+    })
+    rtt = agg.record_round_trip("dev", msg.payload.server)
+    assert list(rtt) == ["asr_started", "asr_done", "intent_done", "reply"]
+    assert rtt["reply"] == {"count": 2, "avg_ms": 690, "max_ms": 760}
+    assert agg.record_round_trip("dev", {}) == {}
+    assert agg.round_trip_snapshot()["dev"]["asr_done"]["max_ms"] == 700
+
+def test_progress_control_frame():
+    """驗證進度事件的 binary 控制 frame：stage 以索引編碼，與韌體 ServerProgress 順序一致。"""
+    from esp_miao.models import Progress
+    msg = Progress(device_id="server", timestamp=1, payload={"stage": "dispatched", "elapsed_ms": 812})
+    frame = wire.encode_control(msg.model_dump())
+    assert frame[:3] == bytes([wire.CONTROL_MAGIC, wire.CONTROL_VERSION, wire.TYPE_PROGRESS])
+    assert wire.PROGRESS.unpack(frame[3:]) == (3, 812)
+
+def test_edge_inference_degrade():
+    """驗證推論降級狀態：降噪旗標轉為布林，欄位數不符時忽略。"""
+    agg = MetricsAggregator()
+    msg = Telemetry(device_id="dev", timestamp=1, payload={
+        "seq": 5, "interval_ms": 10000, "stages": {},
+        "degrade": [2, 2, 0, 71, 2, 1],
+    })
+    d = agg.record_degrade("dev", msg.payload.degrade)
+    assert d["level"] == 2 and d["stride"] == 2 and d["noise_suppression"] is False
+    assert agg.record_degrade("dev", [1, 2]) is None
+    assert agg.degrade_snapshot()["dev"]["overruns"] == 1
+
+def test_edge_model_weights():
+    """驗證權重常駐回報：miss_us 為 flash 與 DRAM 權重的 NN 耗時差，欄位數不符時忽略。"""
+    agg = MetricsAggregator()
+    msg = Telemetry(device_id="dev", timestamp=1, payload={
+        "seq": 0, "interval_ms": 10000, "stages": {},
+        "weights": [1536, 0, 2900, 2400],
+    })
+    w = agg.record_weights("dev", msg.payload.weights)
+    assert w["pinned_bytes"] == 1536 and w["miss_us"] == 500
+    assert agg.record_weights("dev", [1536]) is None
+    assert agg.record_weights("dev", [1536, 0, 2400, 2500])["miss_us"] == 0
+    assert agg.weights_snapshot()["dev"]["pinned_nn_us"] == 2500
+
+def test_edge_health_aggregation():
+    """驗證裝置健康報告：heap 歷史最低的下降量以第一份（或重開機後第一份）為基準。"""
+    agg = MetricsAggregator()
+    msg = Health(device_id="dev", timestamp=1, payload={
+        "seq": 0, "uptime_s": 30,
+        "heap": {"internal": [120000, 90000, 110000], "dma": [100000, 80000, 95000]},
+        "stacks": {"ei_infer": 5200, "display": 900, "websocket_task": 1800},
+        "cpu": [-1, -1],
+    })
+    p = msg.payload
+    first = agg.record_health("dev", p.uptime_s, p.heap, p.stacks, p.cpu)
+    assert first["heap"]["internal"]["min_free_drop"] == 0
+    assert list(first["stacks"]) == ["display", "websocket_task", "ei_infer"]
+
+    later = agg.record_health("dev", 600, {"internal": [118000, 88000, 104000]}, {}, [35, 62])
+    assert later["heap"]["internal"]["min_free_drop"] == 6000
+    assert agg.health_snapshot()["dev"]["cpu"] == [35, 62]
+
+    rebooted = agg.record_health("dev", 30, {"internal": [121000, 91000, 111000]}, {}, [-1, -1])
+    assert rebooted["heap"]["internal"]["min_free_drop"] == 0
+
+def test_edge_health_power_residency():
+    """驗證健康報告的動態調頻駐留時間：換算全速比例，舊韌體未回報時不產生欄位。"""
+    agg = MetricsAggregator()
+    msg = Health(device_id="dev", timestamp=1, payload={
+        "seq": 3, "uptime_s": 120, "heap": {}, "stacks": {}, "cpu": [20, 40],
+        "power": [7500, 7500, 15000],
+    })
+    p = msg.payload
+    health = agg.record_health("dev", p.uptime_s, p.heap, p.stacks, p.cpu, p.power)
+    assert health["power"] == {"max_ms": 7500, "awake_ms": 7500, "idle_ms": 15000, "full_clock_ratio": 0.25}
+    assert agg.health_snapshot()["dev"]["power"]["full_clock_ratio"] == 0.25
+
+    legacy = agg.record_health("old", 60, {}, {}, [10, 10])
+    assert "power" not in legacy
+    assert "power" not in agg.health_snapshot()["old"]
+
+def test_edge_health_contention_edges():
+    """驗證健康報告的資源爭用邊：依欄位展開、略過格式不符的項目，未啟用時不產生欄位。"""
+    agg = MetricsAggregator()
+    msg = Health(device_id="dev", timestamp=1, payload={
+        "seq": 4, "uptime_s": 90, "heap": {}, "stacks": {}, "cpu": [30, 50],
+        "contention": [["spi", "display", "sdcard", 12, 48000, 9000, 12], ["flash", "wifi", "*", 1, 30000, 30000, 0],
+                       ["heap", "ei_infer"]],
+    })
+    p = msg.payload
+    health = agg.record_health("dev", p.uptime_s, p.heap, p.stacks, p.cpu, p.power, p.contention)
+    assert [e["resource"] for e in health["contention"]] == ["spi", "flash"]
+    assert health["contention"][0] == {"resource": "spi", "holder": "display", "waiter": "sdcard", "count": 12,
+                                       "total_us": 48000, "max_us": 9000, "inversions": 12}
+    assert agg.health_snapshot()["dev"]["contention"][1]["waiter"] == "*"
+
+    assert "contention" not in agg.record_health("old", 60, {}, {}, [10, 10])
+
+def test_edge_health_nvs_write_behind():
+    """驗證健康報告的 NVS 延後寫入統計：有批次時展開為欄位，區間內沒有寫入或舊韌體時不產生。"""
+    agg = MetricsAggregator()
+    msg = Health(device_id="dev", timestamp=1, payload={
+        "seq": 5, "uptime_s": 120, "heap": {}, "stacks": {}, "cpu": [20, 30],
+        "nvs": [3, 1, 0, 2, 4200, 2100, 9100, 9100],
+    })
+    p = msg.payload
+    health = agg.record_health("dev", p.uptime_s, p.heap, p.stacks, p.cpu, p.power, p.contention, p.nvs)
+    assert health["nvs"] == {"writes": 3, "batches": 1, "forced": 0, "coalesced": 2, "defer_max_ms": 4200,
+                             "defer_avg_ms": 2100, "busy_max_us": 9100, "busy_total_us": 9100, "failed": 0}
+    assert agg.health_snapshot()["dev"]["nvs"]["busy_max_us"] == 9100
+
+    # 寫入失敗的 key 數（第 9 欄）
+    failed = agg.record_health("dev", 140, {}, {}, [20, 30], None, None, [1, 1, 1, 0, 60000, 60000, 800, 800, 2])
+    assert failed["nvs"]["failed"] == 2 and failed["nvs"]["writes"] == 1
+
+    idle = agg.record_health("dev", 150, {}, {}, [20, 30], None, None, [0, 0, 0, 0, 0, 0, 0, 0, 0])
+    assert "nvs" not in idle
+    assert "nvs" not in agg.record_health("old", 60, {}, {}, [10, 10])
+
+def test_flight_record_summary_hints():
+    """驗證重開機前的飛行記錄：t_us 32 位元回繞、推論未結束與擷取停擺的提示、最低 heap / stack。"""
+    base = 0xFFFFFF00   # 事件跨越 t_us 回繞
+    events = [[base, 1, 1, 256], [(base + 16000) & 0xFFFFFFFF, 1, 1, 256],
+              [(base + 17000) & 0xFFFFFFFF, 1, 3, 0], [(base + 30000) & 0xFFFFFFFF, 1, 4, 0],
+              [(base + 32000) & 0xFFFFFFFF, 1, 1, 256], [(base + 33000) & 0xFFFFFFFF, 1, 3, 0],
+              [(base + 400000) & 0xFFFFFFFF, 0, 5, 1024]]
+    msg = FlightRecord(device_id="dev", timestamp=1, payload={
+        "reset_reason": "task_wdt", "stages_us": {"nn": 9000},
+        "health": [[30, 90000, 60000, 50000, 900, "ei_infer"], [60, 20000, 12000, 8000, 300, "display"]],
+        "events": events,
+    })
+    p = msg.payload
+    s = summarize_flight_record(p.reset_reason, p.stages_us, p.health, p.events)
+    assert s["span_ms"] == 400.0
+    assert s["infer_max_us"] == 13000
+    assert s["i2s_gap_max_ms"] == 16.0
+    assert s["points"]["i2s_block"] == {"count": 3, "last_ago_ms": 368.0}
+    assert (s["heap_min"], s["stack_min"]) == (12000, {"task": "display", "bytes": 300})
+    assert len(s["hints"]) == 4   # 推論未結束、擷取停擺、heap 過低、stack 過低
+
+    empty = summarize_flight_record("panic", {}, [], [])
+    assert empty["events"] == 0 and empty["hints"] == []
+
+def test_audio_stream_endpointing_messages():
+    """驗證端點偵測模式的 audio_start 旗標與 audio_end 訊息解析。"""
+    start = AudioStreamStart(**{
+        "device_id": "esp32_01", "timestamp": 1, "type": "audio_start",
+        "payload": {"total_samples": 88000, "transfer_mode": "binary", "endpointing": True},
+    })
+    assert start.payload.endpointing is True
+    legacy = AudioStreamStart(**{
+        "device_id": "esp32_01", "timestamp": 1, "type": "audio_start",
+        "payload": {"total_samples": 56000},
+    })
+    assert legacy.payload.endpointing is False
+
+    end = AudioStreamEnd(**{
+        "device_id": "esp32_01", "timestamp": 2, "type": "audio_end",
+        "payload": {"total_samples": 27648, "reason": "silence"},
+    })
+    assert end.payload.total_samples == 27648
+    assert end.payload.reason == "silence"
+    assert end.payload.link is None
+
+    with_link = AudioStreamEnd(**{
+        "device_id": "esp32_01", "timestamp": 3, "type": "audio_end",
+        "payload": {
+            "total_samples": 24000, "reason": "silence",
+            "link": {"rssi": -58, "chunk_start": 512, "chunk_end": 256, "chunk_min": 256,
+                     "chunk_max": 512, "frames": 60, "send_avg_us": 1800, "send_max_us": 9200,
+                     "tx_waits": 0},
+        },
+    })
+    assert with_link.payload.link.chunk_end == 256
+    assert with_link.payload.link.send_avg_us == 1800
+
+def test_followup_stream_start():
+    """驗證追問視窗的 audio_start：標示延續的前一句，串流不帶喚醒信心值。"""
+    start = AudioStreamStart(**{
+        "device_id": "esp32_01", "timestamp": 1, "type": "audio_start",
+        "payload": {"total_samples": 88000, "transfer_mode": "binary", "endpointing": True,
+                    "confidence": 0.0, "followup": True, "followup_of": "5f3a9c01"},
+    })
+    assert start.payload.followup and start.payload.followup_of == "5f3a9c01"
+    mgr = ConnectionManager()
+    stream = mgr.start_session("esp32_01", confidence=None, total_samples=16000, bounded=False, followup=True)
+    assert stream.followup and stream.confidence is None
+    assert not mgr.start_session("esp32_01", confidence=0.9, total_samples=16000).followup
+
+def test_ima_adpcm_stream_decode():
+    """驗證 IMA-ADPCM 區塊解碼（標頭狀態 + 低 nibble 在前）與 StreamTiming 的樣本換算。"""
+    assert codec_from_format("adpcm_16k_4bit") == "ima_adpcm"
+    assert codec_from_format("pcm_16k_16bit") == "pcm"
+
+    # predictor=0, index=0：code 4 → +7，code 4 → +(1+9)，code 0xC → -(1+11)，code 0 → +1
+    block = struct.pack("<hBB", 0, 0, 0) + bytes([0x44, 0x0C])
+    pcm = decode_ima_adpcm_block(block)
+    assert struct.unpack("<4h", pcm) == (7, 17, 5, 6)
+
+    timing = StreamTiming(header_bytes=16, sample_rate=16000, codec="ima_adpcm")
+    out = timing.consume(struct.pack(CHUNK_HEADER_FORMAT, 0, 0, 1_000_000) + block)
+    assert out == pcm
+    assert timing.last_capture_end_us == 1_000_000 + 4 * 1_000_000 // 16000
+
+def test_pcm_to_float32_view():
+    """驗證 ASR 輸入直接由 PCM bytearray 轉為 float32（不經 WAV），奇數尾端位元組捨棄。"""
+    buf = bytearray(struct.pack("<4h", 0, 16384, -32768, 32767) + b"\x01")
+    samples = pcm_to_float32(buf)
+    assert samples.dtype.name == "float32"
+    assert samples.tolist() == [0.0, 0.5, -1.0, 32767 / 32768]
+    # 轉換後的陣列不再引用緩衝，緩衝可繼續增長
+    buf.extend(b"\x00\x00")
+    assert len(resample_linear(samples.repeat(3), 48000)) == 4
+
+
+def test_resample_8k_stream_is_band_limited():
+    """驗證遠端節點 8 kHz 串流升到 16 kHz：長度加倍、音調保留、4–8 kHz 無明顯鏡像。"""
+    t = np.arange(8000) / 8000
+    tone = (0.5 * np.sin(2 * np.pi * 1000 * t)).astype(np.float32)
+    out = resample(tone, 8000)
+    assert out.dtype == np.float32 and len(out) == 16000
+    spectrum = np.abs(np.fft.rfft(out[1000:-1000]))
+    freqs = np.fft.rfftfreq(len(out) - 2000, 1 / 16000)
+    assert abs(freqs[np.argmax(spectrum)] - 1000) < 10
+    # 線性內插在 7 kHz 留下的鏡像約 -25 dB；帶限濾波應遠低於此
+    image = spectrum[(freqs > 6500) & (freqs < 7500)].max()
+    assert image < spectrum.max() * 0.01
+    assert resample(tone, 16000) is tone
+
 # --- Test Intent Module ---
 
 def test_extract_intent_keywords():
@@ -62,6 +1013,562 @@ def test_extract_intent_keywords():
     intent = extract_intent_from_text("今天天氣如何")
     assert intent["action"] == "unknown"
 
+def test_extract_intent_longest_alias():
+    """驗證別名重疊時取最左最長者，且裝置專屬關鍵字優先於全域。"""
+    table = DynamicDeviceTable(devices=[
+        Device(name="light", type="relay", aliases=["燈"]),
+        Device(name="desk_lamp", type="relay", aliases=["檯燈", "書桌檯燈"]),
+    ])
+    table.update_device({
+        "name": "curtain", "type": "relay", "aliases": ["窗簾"],
+        "action_keywords": {"on": ["拉開"], "off": ["拉上"]},
+    })
+    with patch("esp_miao.intent.device_table", table):
+        assert extract_intent_from_text("把書桌檯燈打開")["target"] == "desk_lamp"
+        assert extract_intent_from_text("關掉檯燈") == {"action": "relay_set", "target": "desk_lamp", "value": "off"}
+        assert extract_intent_from_text("燈 打開")["target"] == "light"
+        assert extract_intent_from_text("窗簾拉上")["value"] == "off"
+        # 專屬關鍵字裝置不吃全域「開」
+        assert extract_intent_from_text("窗簾打開")["action"] == "unknown"
+        assert extract_intent_from_text("開檯燈") == {"action": "relay_set", "target": "desk_lamp", "value": "on"}
+
+def test_extract_intent_pinyin_homophones():
+    """驗證原字沒命中時以不分聲調的拼音補上：同音字可，3 個音節以上容許近音，2 個音節只接受同音。"""
+    table = DynamicDeviceTable(devices=[
+        Device(name="light", type="relay", aliases=["電燈"]),
+        Device(name="fan", type="relay", aliases=["電風扇"]),
+    ])
+    table.update_device({
+        "name": "curtain", "type": "relay", "aliases": ["窗簾"],
+        "action_keywords": {"on": ["拉開"], "off": ["拉上"]},
+    })
+    with patch("esp_miao.intent.device_table", table):
+        assert extract_intent_from_text("打開電等") == {"action": "relay_set", "target": "light", "value": "on"}
+        assert extract_intent_from_text("關掉電鳳扇") == {"action": "relay_set", "target": "fan", "value": "off"}
+        assert extract_intent_from_text("打開電風三")["target"] == "fan"     # shan → san
+        assert extract_intent_from_text("打開電疼")["target"] == ""          # deng → teng：2 個音節不容許
+        assert extract_intent_from_text("窗簾打開")["action"] == "unknown"   # 「打開」不是「拉開」
+        assert extract_intent_from_text("窗簾辣開")["value"] == "on"         # 同音動作
+        assert extract_intent_from_text("今天天氣如何")["action"] == "unknown"
+
+    with patch("esp_miao.intent.device_table", table), patch("esp_miao.connection.KEYWORD_PINYIN", False):
+        table.update_device({"name": "heater", "type": "relay", "aliases": ["暖爐"]})   # 重建比對器
+        assert extract_intent_from_text("打開電等")["action"] == "unknown"
+
+
+@pytest.mark.asyncio
+async def test_multi_device_intent_and_batched_dispatch():
+    """驗證一句話控制多個裝置：各自取最近的動作、缺的沿用，群組別名展開，派發同時進行。"""
+    table = DynamicDeviceTable(devices=[
+        Device(name="light", type="relay", aliases=["燈"], groups=["所有燈"]),
+        Device(name="desk_lamp", type="relay", aliases=["檯燈"], groups=["所有燈"]),
+        Device(name="fan", type="relay", aliases=["風扇"]),
+    ])
+    with patch("esp_miao.intent.device_table", table):
+        intent = extract_intent_from_text("關燈和風扇")
+        assert intent["target"] == "light" and intent["value"] == "off"
+        assert intent["commands"] == [{"target": "light", "value": "off"}, {"target": "fan", "value": "off"}]
+        assert [c["value"] for c in extract_intent_from_text("燈打開，風扇關掉")["commands"]] == ["on", "off"]
+        assert [c["value"] for c in extract_intent_from_text("把燈和風扇都關掉")["commands"]] == ["off", "off"]
+        assert [c["target"] for c in extract_intent_from_text("打開所有燈")["commands"]] == ["light", "desk_lamp"]
+        assert "commands" not in extract_intent_from_text("打開檯燈")
+        assert extract_intent_from_text("燈和風扇")["action"] == "unknown"
+
+    async def slow_send(target, topic, payload, metrics_ctx=None):
+        await asyncio.sleep(0.1)
+        return target != "fan"
+
+    ctx = MetricsContext("req", "esp32_01")
+    with patch("esp_miao.dispatch.device_table", table), \
+         patch("esp_miao.dispatch.mqtt_dispatcher.send", side_effect=slow_send) as send:
+        t0 = time.monotonic()
+        ok = await dispatch_commands([{"target": "light", "value": "on"}, {"target": "desk_lamp", "value": "on"},
+                                      {"target": "fan", "value": "on"}], ctx)
+        assert time.monotonic() - t0 < 0.2     # 同時發佈，不是逐一等待
+    assert send.call_count == 3 and not ok
+    assert ctx.data["dispatch_commands"] == 3 and ctx.data["dispatch_success"] is False
+
+@pytest.mark.asyncio
+async def test_streaming_asr_commits_stable_partial():
+    """驗證 partial 連續解析出相同關鍵字意圖才提前執行，之後不再轉錄。"""
+    partials = iter(["幫我把", "幫我把燈打開", "幫我把燈打開了"])
+    calls = []
+
+    async def fake_transcribe(pcm, audio_format, beam_size=3, **kwargs):
+        calls.append((len(pcm), beam_size))
+        return next(partials)
+
+    commits = []
+
+    async def on_commit(session, text, intent):
+        commits.append((text, intent))
+
+    session = StreamingTranscriber("esp32_01", "pcm_16k_16bit", on_commit, transcribe=fake_transcribe)
+    buf = bytearray()
+    for _ in range(3):
+        buf.extend(bytes(session.min_bytes + session.interval_bytes))
+        session.feed(buf)
+        await session._task
+
+    assert [b for _, b in calls] == [1, 1, 1]
+    assert len(commits) == 1
+    assert commits[0][1] == {"action": "relay_set", "target": "light", "value": "on"}
+    assert session.partials == 3
+
+    # 已提前執行：後續音訊不再觸發 partial
+    buf.extend(bytes(session.interval_bytes * 2))
+    session.feed(buf)
+    assert len(calls) == 3
+    await session.finish()
+    assert not session.covers(len(buf))
+
+@pytest.mark.asyncio
+async def test_streaming_speculative_intent_parse():
+    """驗證 partial 不再變化時先啟動 LLM 解析：最終轉錄相同即沿用並記錄節省時間，之後改變則取消。"""
+    async def parse(text, ctx):
+        ctx.set_flag("llm_called", True)
+        await asyncio.sleep(0.01)
+        return {"action": "relay_set", "target": "fan", "value": "on"}
+
+    async def run(texts):
+        partials = iter(texts)
+
+        async def fake_transcribe(pcm, audio_format, beam_size=3, **kwargs):
+            return next(partials)
+
+        session = StreamingTranscriber("esp32_01", "pcm_16k_16bit", AsyncMock(),
+                                       transcribe=fake_transcribe, speculate=parse)
+        buf = bytearray()
+        for _ in texts:
+            buf.extend(bytes(session.min_bytes + session.interval_bytes))
+            session.feed(buf)
+            await session._task
+        await session.finish()
+        return session
+
+    session = await run(["幫我把那個", "幫我把那個打開", "幫我把那個打開。"])
+    assert session.speculations == 1
+    speculation = session.take_speculation("幫我把那個打開")
+    assert speculation is not None
+    ctx = MetricsContext("r1", "esp32_01")
+    assert (await speculation.join(ctx))["target"] == "fan"
+    assert ctx.data["speculation"] == "hit" and ctx.data["llm_called"]
+    assert ctx.data["speculation_saved"] >= 0
+
+    session = await run(["幫我把那個", "幫我把那個", "幫我把那個打開"])
+    assert session.speculations == 1 and session.speculation is None   # 第三個 partial 改變：已取消
+    assert session.take_speculation("幫我把那個打開") is None
+
+
+class _FakeLLM:
+    """ollama.AsyncClient 替身：逐 token 串流，可設定每個 token 的延遲。"""
+
+    def __init__(self, tokens, delay=0.0):
+        self.tokens = tokens
+        self.delay = delay
+        self.sent = 0
+        self.kwargs = {}
+
+    async def generate(self, **kwargs):
+        self.kwargs = kwargs
+
+        async def stream():
+            for token in self.tokens:
+                await asyncio.sleep(self.delay)
+                self.sent += 1
+                yield {"response": token}
+        return stream()
+
+
+@pytest.mark.asyncio
+async def test_llm_intent_stream_stops_at_json():
+    """驗證 LLM 串流一出現完整 JSON 即停止讀取。"""
+    llm = _FakeLLM(['{"action": "relay_set", ', '"target": "fan", "value": "on"}', " trailing", " tokens"])
+    with patch("esp_miao.intent.get_llm_client", return_value=llm):
+        intent = await parse_intent_with_llm("幫我弄涼一點")
+    assert intent == {"action": "relay_set", "target": "fan", "value": "on"}
+    assert llm.sent == 2
+
+
+@pytest.mark.asyncio
+async def test_llm_output_constrained_by_device_schema():
+    """驗證 LLM 以 JSON schema 受限解碼：target 限定目前裝置、value 限定 on / off，生成上限較低。"""
+    from esp_miao.config import LLM_SCHEMA_MAX_TOKENS
+    table = DynamicDeviceTable(devices=[Device(name="fan", type="relay")])
+    llm = _FakeLLM(['{"action": "relay_set", "target": "fan", "value": "on"}'])
+    with patch("esp_miao.intent.device_table", table), \
+         patch("esp_miao.intent.llm_session", LlmSession()), \
+         patch("esp_miao.intent.intent_cache", IntentCache(max_size=8, ttl_s=60)), \
+         patch("esp_miao.intent.get_llm_client", return_value=llm):
+        assert (await parse_intent_with_llm("讓房間涼快一點"))["target"] == "fan"
+        schema = llm.kwargs["format"]
+        assert schema["properties"]["target"]["enum"] == ["fan", ""]
+        assert schema["properties"]["value"]["enum"] == ["on", "off"]
+        assert llm.kwargs["options"]["num_predict"] == LLM_SCHEMA_MAX_TOKENS
+
+        table.update_device({"name": "light", "type": "relay"})
+        await parse_intent_with_llm("讓房間亮一點")
+        assert "light" in llm.kwargs["format"]["properties"]["target"]["enum"]
+
+        with patch("esp_miao.intent.LLM_JSON_SCHEMA", False):
+            await parse_intent_with_llm("讓房間暗一點")
+        assert "format" not in llm.kwargs
+
+
+@pytest.mark.asyncio
+async def test_llm_intent_timeout_falls_back_to_keywords():
+    """驗證 LLM 逾時改用關鍵字結果（目標離線時才會呼叫 LLM）。"""
+    llm = _FakeLLM(['{"action": "relay_set", "target": "light", "value": "off"}'], delay=1.0)
+    device_table.set_device_status("light", False)
+    try:
+        with patch("esp_miao.intent.get_llm_client", return_value=llm), \
+             patch("esp_miao.intent.LLM_TIMEOUT_S", 0.05):
+            intent = await parse_intent_with_llm("把燈打開")
+    finally:
+        device_table.set_device_status("light", True)
+    assert intent == {"action": "relay_set", "target": "light", "value": "on"}
+    assert llm.sent == 0
+
+def test_normalize_transcript():
+    """驗證快取鍵正規化：空白、標點、全形、簡體 / 同音字與句尾語助詞。"""
+    assert normalize_transcript("幫我 開燈。") == "幫我開燈"
+    assert normalize_transcript("帮我开灯吧！") == "幫我開燈"
+    assert normalize_transcript("Turn ON，the Fan") == "turnonthefan"
+
+
+@pytest.mark.asyncio
+async def test_intent_cache_skips_llm_until_vocab_changes():
+    """驗證相同指令命中快取不再呼叫 LLM，別名變更後失效。"""
+    table = DynamicDeviceTable(devices=[Device(name="fan", type="relay", aliases=["電扇"])])
+    llm = _FakeLLM(['{"action": "relay_set", "target": "fan", "value": "on"}'])
+    with patch("esp_miao.intent.device_table", table), \
+         patch("esp_miao.intent.intent_cache", IntentCache(max_size=8, ttl_s=60)) as cache, \
+         patch("esp_miao.intent.get_llm_client", return_value=llm):
+        assert (await parse_intent_with_llm("讓房間涼快一點"))["target"] == "fan"
+        assert llm.sent == 1
+
+        intent = await parse_intent_with_llm("讓房間 涼快一點吧。")
+        assert intent == {"action": "relay_set", "target": "fan", "value": "on"}
+        assert llm.sent == 1
+        assert cache.hits == 1
+
+        # Discovery 重送相同內容不影響；新增別名才失效
+        table.update_device({"name": "fan", "type": "relay", "aliases": ["電扇"]})
+        await parse_intent_with_llm("讓房間涼快一點")
+        assert llm.sent == 1
+        table.update_device({"name": "fan", "type": "relay", "aliases": ["電扇", "涼"]})
+        await parse_intent_with_llm("讓房間涼快一點")
+        assert llm.sent == 2
+
+@pytest.mark.asyncio
+async def test_intent_cache_skips_invalid_llm_output():
+    """驗證 LLM 回傳無效裝置時不快取關鍵字結果，同一句話下次仍呼叫 LLM。"""
+    table = DynamicDeviceTable(devices=[Device(name="fan", type="relay")])
+    llm = _FakeLLM(['{"action": "relay_set", "target": "heater", "value": "on"}'])
+    with patch("esp_miao.intent.device_table", table), \
+         patch("esp_miao.intent.intent_cache", IntentCache(max_size=8, ttl_s=3600)) as cache, \
+         patch("esp_miao.intent.get_llm_client", return_value=llm):
+        assert (await parse_intent_with_llm("讓房間涼快一點"))["action"] == "unknown"
+        assert llm.sent == 1
+
+        llm.tokens = ['{"action": "relay_set", "target": "fan", "value": "on"}']
+        intent = await parse_intent_with_llm("讓房間涼快一點")
+        assert intent == {"action": "relay_set", "target": "fan", "value": "on"}
+        assert llm.sent == 2
+        assert cache.hits == 0
+
+@pytest.mark.asyncio
+async def test_llm_session_reuses_prefix_until_devices_change():
+    """驗證 prompt 前綴固定（只在裝置表變更時重建）、帶 keep_alive，已評估的前綴不再重新 seed。"""
+    table = DynamicDeviceTable(devices=[Device(name="fan", type="relay")])
+    llm = MagicMock()
+    llm.generate = AsyncMock(return_value={"response": "", "prompt_eval_count": 90, "prompt_eval_duration": 120_000_000})
+    session = LlmSession()
+    with patch("esp_miao.intent.device_table", table), \
+         patch("esp_miao.intent.get_llm_client", return_value=llm):
+        first, second = session.prompt("開電扇"), session.prompt("關電扇")
+        prefix = first[:first.index("開電扇")]
+        assert second.startswith(prefix) and "['fan']" in prefix
+        assert session.rebuilds == 1
+
+        await session.seed()
+        kwargs = llm.generate.call_args.kwargs
+        assert kwargs["prompt"] == prefix and kwargs["keep_alive"]
+        assert session.seed_prompt_tokens == 90 and session.seed_prompt_eval_s == 0.12
+
+        # 前綴已在 KV cache：只刷新 keep_alive
+        await session.seed()
+        assert llm.generate.call_args.kwargs["prompt"] == ""
+        assert session.seeds == 1
+
+        table.update_device({"name": "light", "type": "relay"})
+        assert "'light'" in session.prompt("開燈")
+        await session.seed()
+        assert session.seeds == 2 and session.rebuilds == 2
+
+@pytest.mark.asyncio
+async def test_inference_lane_fairness_and_deadlines():
+    """驗證 lane 於裝置間輪流服務、丟棄過期請求，且佇列滿時 partial 讓位。"""
+    lane = Lane("asr", workers=1, max_queue=3, patience_s=5.0)
+    order = []
+    gate = asyncio.Event()
+
+    def job(name, wait=False):
+        async def run():
+            if wait:
+                await gate.wait()
+            order.append(name)
+            return name
+        return run
+
+    first = asyncio.create_task(lane.submit("a", job("a1", wait=True)))
+    await asyncio.sleep(0)
+    a2 = asyncio.create_task(lane.submit("a", job("a2")))
+    a3 = asyncio.create_task(lane.submit("a", job("a3")))
+    b1 = asyncio.create_task(lane.submit("b", job("b1")))
+    await asyncio.sleep(0)
+    with pytest.raises(LaneBusy):
+        await lane.submit("c", job("partial"), background=True)
+    assert lane.snapshot()["queued"] == 3
+
+    gate.set()
+    await asyncio.gather(first, a2, a3, b1)
+    assert order == ["a1", "b1", "a2", "a3"]    # b 不必等 a 的整串請求
+
+    # 排隊超過期限即丟棄，不執行
+    gate.clear()
+    blocker = asyncio.create_task(lane.submit("a", job("slow", wait=True)))
+    await asyncio.sleep(0)
+    with pytest.raises(DeadlineExceeded):
+        await lane.submit("b", job("late"), timeout=0.02)
+    gate.set()
+    await blocker
+    assert "late" not in order
+    assert lane.snapshot()["expired"] == 1
+
+@pytest.mark.asyncio
+async def test_whisper_batcher_groups_concurrent_requests():
+    """驗證時間窗內的完整轉錄合併為一次批次推論；無其他串流時立即單獨執行。"""
+    batch_calls, single_calls = [], []
+
+    def fake_batch(model, batch, beam_size, prompt=None):
+        batch_calls.append(len(batch))
+        return [f"text{len(s)}" for s in batch]
+
+    def fake_one(model, samples, beam_size, prompt=None):
+        single_calls.append(len(samples))
+        return "alone", "zh", 0.0
+
+    batcher = WhisperBatcher(window_s=0.05, max_batch=4)
+    with patch("esp_miao.audio.get_whisper_model", return_value=object()), \
+         patch("esp_miao.audio._transcribe_batch", fake_batch), \
+         patch("esp_miao.audio._transcribe_one", fake_one):
+        texts = await asyncio.gather(
+            batcher.submit("esp32_01", [0.0] * 3, 3),
+            batcher.submit("esp32_02", [0.0] * 5, 3),
+        )
+        assert texts == ["text3", "text5"]
+        assert batch_calls == [2] and single_calls == []
+
+        batcher.peer_probe = lambda device_id: False
+        assert await batcher.submit("esp32_01", [0.0] * 2, 3) == "alone"
+        assert single_calls == [2]
+
+@pytest.mark.asyncio
+async def test_asr_pool_hands_audio_through_shared_memory_and_survives_crash():
+    """驗證多行程 ASR：音訊經 shared memory 交給 worker，worker 崩潰時只有該請求失敗並自動重啟。"""
+    import os
+    from multiprocessing import shared_memory
+    from esp_miao.asr_pool import AsrProcessPool, AsrWorkerCrashed
+
+    def fake_worker(index, shm_name, capacity, requests, results):
+        shm = shared_memory.SharedMemory(name=shm_name)
+        buffer = np.ndarray((capacity,), dtype=np.float32, buffer=shm.buf)
+        results.put(("ready", index, None, {"model": "fake"}))
+        while (job := requests.get()) is not None:
+            job_id, n, beam_size, prompt = job
+            if beam_size == 99:
+                os._exit(3)    # 模擬解碼中 segfault
+            results.put(("done", index, job_id, (f"{n}:{buffer[:n].sum():.0f}", "zh", {"beam_fallback": 1})))
+
+    pool = AsrProcessPool(processes=2, max_s=0.01, target=fake_worker, start_method="fork")
+    assert (await pool.start())["processes"] == 2
+    try:
+        texts = await asyncio.gather(
+            pool.decode(np.ones(3, dtype=np.float32), 1, None),
+            pool.decode(np.full(5, 2.0, dtype=np.float32), 1, None),
+        )
+        assert [t[0] for t in texts] == ["3:3", "5:10"]
+        assert (await pool.decode(np.ones(1000, dtype=np.float32), 1, None))[0] == "160:160"   # 截斷至容量
+        with pytest.raises(AsrWorkerCrashed):
+            await pool.decode(np.ones(1, dtype=np.float32), 99, None)
+        for _ in range(50):
+            if pool.snapshot()["alive"] == 2:
+                break
+            await asyncio.sleep(0.1)
+        texts = await asyncio.gather(*(pool.decode(np.ones(n, dtype=np.float32), 1, None) for n in (1, 2, 3)))
+        assert [t[0] for t in texts] == ["1:1", "2:2", "3:3"]
+        snap = pool.snapshot()
+        assert snap["crashes"] == 1 and snap["alive"] == 2 and snap["truncated"] == 1
+    finally:
+        await pool.stop()
+
+def test_whisper_profile_selection():
+    """驗證依核心數選擇 cpu_threads 與依後端選擇 compute_type。"""
+    assert parse_cpu_list("0,2-3") == {0, 2, 3}
+    with patch("esp_miao.audio.available_cpus", return_value=4), \
+         patch("esp_miao.audio.ASR_WORKERS", 1):
+        profile = select_whisper_profile()
+        assert profile["cpu_threads"] == 3          # 保留一核給 event loop
+        assert profile["compute_type"] == "int8"
+        with patch("esp_miao.audio.WHISPER_DEVICE", "cuda"):
+            assert select_whisper_profile()["compute_type"] == "float16"
+    with patch("esp_miao.audio.available_cpus", return_value=2):
+        assert select_whisper_profile()["cpu_threads"] == 2
+
+def test_vocabulary_biased_decoding():
+    """驗證詞彙提示由別名與關鍵字組成，且 greedy 結果有信心時不再做 beam search。"""
+    table = DynamicDeviceTable(devices=[Device(name="fan", type="relay", aliases=["電扇"])])
+    with patch("esp_miao.audio.device_table", table), patch("esp_miao.audio.ASR_VOCAB_BIAS", True):
+        prompt = vocabulary_prompt()
+    assert prompt.startswith("電扇、") and "關閉" in prompt and "turn on" not in prompt
+
+    calls = []
+
+    class FakeModel:
+        def __init__(self, logprob):
+            self.logprob = logprob
+
+        def transcribe(self, samples, beam_size, initial_prompt=None, **kwargs):
+            calls.append((beam_size, initial_prompt))
+            seg = MagicMock(text="打開電扇", no_speech_prob=0.1, avg_logprob=self.logprob)
+            return iter([seg]), MagicMock(language="zh")
+
+    assert _decode(FakeModel(-0.2), [], 3, prompt) == ("打開電扇", "zh")
+    assert calls == [(1, prompt)]
+    calls.clear()
+    _decode(FakeModel(-1.2), [], 3, prompt)
+    assert calls == [(1, prompt), (3, prompt)]
+
+def test_command_classifier_templates():
+    """驗證模板分類器：相同指令高信心命中，兩類都不像時交回 Whisper。"""
+    rng = np.random.default_rng(0)
+    t = np.arange(8000) / 16000
+
+    def utterance(first, second, noise=0.01):
+        tone = np.concatenate([np.sin(2 * np.pi * first * t), np.sin(2 * np.pi * second * t)]) * 0.3
+        x = np.concatenate([np.zeros(4000), tone, np.zeros(4000)])
+        return (x + noise * rng.standard_normal(len(x))).astype(np.float32)
+
+    table = DynamicDeviceTable(devices=[Device(name="light", type="relay", aliases=["燈"])])
+    clf = CommandClassifier(max_templates=5)
+    with patch("esp_miao.classifier.device_table", table), \
+         patch("esp_miao.classifier.COMMAND_CLASSIFIER_SPREAD", 1.5):
+        clf.enroll(mfcc_features(utterance(400, 1500)), "light", "on")
+        clf.enroll(mfcc_features(utterance(1500, 400)), "light", "off")
+        assert clf.classify(mfcc_features(utterance(400, 1500))) is None   # 模板不足
+        for _ in range(2):
+            clf.enroll(mfcc_features(utterance(400, 1500)), "light", "on")
+            clf.enroll(mfcc_features(utterance(1500, 400)), "light", "off")
+
+        hit = clf.classify(mfcc_features(utterance(400, 1500)))
+        assert hit is not None and hit["intent"] == {"action": "relay_set", "target": "light", "value": "on"}
+        assert clf.classify(mfcc_features(utterance(800, 800))) is None
+        assert clf.classify(mfcc_features(np.zeros(16000, dtype=np.float32))) is None
+    assert clf.snapshot() == {"light:on": 3, "light:off": 3}
+
+def test_wake_verifier_rejects_unlike_window():
+    """驗證第二階段喚醒驗證：正例不足時不判斷；像已確認的喚醒則通過，像誤喚醒則拒絕。"""
+    rng = np.random.default_rng(1)
+    t = np.arange(8000) / 16000
+
+    def window(first, second, noise=0.01):
+        tone = np.concatenate([np.sin(2 * np.pi * first * t), np.sin(2 * np.pi * second * t)]) * 0.3
+        x = np.concatenate([np.zeros(2000), tone, np.zeros(2000)])
+        return (x + noise * rng.standard_normal(len(x))).astype(np.float32)
+
+    verifier = WakeVerifier(max_templates=8)
+    verifier.enroll("dev", mfcc_features(window(600, 1800)), genuine=True)
+    assert verifier.verify("dev", mfcc_features(window(2500, 300))) is None   # 正例不足
+    for _ in range(4):
+        verifier.enroll("dev", mfcc_features(window(600, 1800)), genuine=True)
+    verifier.enroll("dev", mfcc_features(window(2500, 300)), genuine=False)
+
+    assert verifier.verify("dev", mfcc_features(window(600, 1800)))["accepted"]
+    rejected = verifier.verify("dev", mfcc_features(window(2500, 300)))
+    assert not rejected["accepted"] and rejected["negative"] < rejected["distance"]
+    assert verifier.verify("other", mfcc_features(window(2500, 300))) is None   # 模板依裝置分開
+    assert verifier.snapshot() == {"checked": 2, "rejected": 1, "templates": {"dev": [5, 1]}}
+
+def test_segment_filter_rejects_and_stops_early():
+    """驗證幻聽 / 無語音片段丟棄，提早停止時不再取出後續片段（不解碼其後的視窗）。"""
+    assert smallest_period("打開打開") == 2 and smallest_period("打開電燈") == 4 and smallest_period("") == 0
+    f = SegmentFilter(early_stop=False, no_speech_reject=0.7)
+    assert f.accept(" 打開電燈 ", 0.1) == "打開電燈"
+    assert f.accept("打開電燈", 0.8) is None
+    assert f.accept("謝謝觀看謝謝觀看謝謝", 0.1) is None      # 重複兩次以上（含殘餘）
+    assert f.accept("嗯嗯嗯嗯好", 0.1) is None                # 開頭同字連續
+    assert f.accept("開燈開", 0.1) == "開燈開"                 # 少於 4 字不檢查
+    assert f.rejected == {"no_speech": 1, "repeat": 1, "same_char": 1}
+
+    pulled = []
+
+    def segments(texts):
+        for text in texts:
+            pulled.append(text)
+            yield type("Seg", (), {"text": text, "no_speech_prob": 0.1, "avg_logprob": -0.2})()
+
+    texts = ["打開電燈", "哈哈哈哈", "關掉風扇"]
+    assert list(SegmentFilter(early_stop=False).run(segments(texts))) == [("打開電燈", -0.2), ("關掉風扇", -0.2)]
+    pulled.clear()
+    stopper = SegmentFilter(early_stop=True)
+    assert list(stopper.run(segments(texts))) == [("打開電燈", -0.2)]
+    assert pulled == ["打開電燈", "哈哈哈哈"] and stopper.early_stops == 1
+
+
+def test_noise_profile_subtracts_room_noise():
+    """驗證噪音譜由前後靜音學習（太短不更新），相減後靜音段能量下降、語音音調保留。"""
+    rng = np.random.default_rng(1)
+    hum = lambda n: (0.02 * rng.standard_normal(n)).astype(np.float32)
+    profiles = NoiseProfiles()
+    assert profiles.suppress("esp32_01", hum(16000)) is None        # 尚無噪音譜
+    assert not profiles.learn("esp32_01", hum(1000))                 # 62 ms < NOISE_PROFILE_MIN_MS
+
+    t = np.arange(16000) / 16000
+    audio = hum(32000)
+    audio[8000:24000] += (0.3 * np.sin(2 * np.pi * 440 * t)).astype(np.float32)
+    out, denoised = profiles.process("esp32_01", audio, 8000, 24000)
+    assert denoised and len(out) == 16000
+    # 純噪音段：功率降 4 dB 以上（α = 1.5 時期望約 6 dB）；音調能量保留
+    quiet = profiles.suppress("esp32_01", hum(16000))
+    assert np.mean(quiet[1000:-1000] ** 2) < 0.4 * 0.02 ** 2
+    assert abs(np.sqrt(np.mean(out[1000:-1000] ** 2)) - 0.3 / np.sqrt(2)) < 0.03
+    assert profiles.snapshot()["devices"]["esp32_01"]["updates"] == 1
+
+
+def test_trim_silence():
+    """驗證 ASR 前的靜音裁切：保留語音前後 TRIM_PAD_MS，至少 TRIM_MIN_MS，全靜音不裁。"""
+    rng = np.random.default_rng(0)
+
+    def clip(tone_start_s, tone_s, total_s=3.0):
+        x = 0.002 * rng.standard_normal(int(total_s * 16000))
+        i = int(tone_start_s * 16000)
+        x[i:i + int(tone_s * 16000)] += 0.3 * np.sin(2 * np.pi * 1000 * np.arange(int(tone_s * 16000)) / 16000)
+        return x.astype(np.float32)
+
+    out, lead, trail = trim_silence(clip(0.5, 0.6))
+    assert 0.25 <= lead <= 0.35 and 1.6 <= trail <= 1.75
+    assert abs(len(out) / 16000 - (3.0 - lead - trail)) < 1e-6
+
+    out, _, _ = trim_silence(clip(1.5, 0.1))
+    assert len(out) == 600 * 16
+
+    silent = np.zeros(48000, dtype=np.float32)
+    out, lead, trail = trim_silence(silent)
+    assert out is silent and lead == trail == 0.0
+    with patch("esp_miao.audio.SERVER_TRIM", False):
+        assert len(trim_silence(clip(0.5, 0.6))[0]) == 48000
+
 # --- Test Utils Module ---
 
 def test_action_sound_mapping():
@@ -88,6 +1595,38 @@ async def test_dispatch_command_mqtt():
         args, kwargs = mock_mqtt.publish.call_args
         assert args[0] == "lamp/command"
         assert args[1] == "ON"
+        assert kwargs["qos"] == 1
+
+@pytest.mark.asyncio
+async def test_mqtt_dispatch_waits_for_state_echo():
+    """驗證 QoS 1 派發：等待 PUBACK 與裝置 state 回報，未確認才重送。"""
+    dispatcher = MqttDispatcher()
+    echoes = iter([False, True])   # 第一次發佈裝置沒有回報
+
+    def publish(topic, payload, qos=0):
+        mid = dispatcher.sent + 1
+        dispatcher.on_publish(None, None, mid)          # broker 立即 PUBACK
+        if next(echoes):
+            dispatcher.on_state("light_01", payload)
+        return MagicMock(rc=0, mid=mid)
+
+    dispatcher.on_state("light_01", "OFF")               # 曾回報 state：可確認
+    with patch("esp_miao.dispatch.mqtt_client") as mock_mqtt, \
+         patch("esp_miao.dispatch.MQTT_STATE_TIMEOUT_S", 0.05):
+        mock_mqtt.publish.side_effect = publish
+        ctx = MetricsContext("req", "esp32_01")
+        assert await dispatcher.send("light_01", "lamp/command", "ON", ctx)
+    assert mock_mqtt.publish.call_count == 2
+    assert ctx.data["dispatch_confirmed"] and ctx.data["dispatch_state"] == "ON"
+    assert ctx.data["dispatch_attempts"] == 2 and ctx.data["actuation_latency"] >= 0.05
+    assert dispatcher.snapshot()["retries"] == 1
+
+    # 不回報 state 的裝置：PUBACK 即成功，不重送
+    with patch("esp_miao.dispatch.mqtt_client") as mock_mqtt:
+        mock_mqtt.publish.side_effect = lambda topic, payload, qos=0: (
+            dispatcher.on_publish(None, None, 99), MagicMock(rc=0, mid=99))[1]
+        assert await dispatcher.send("fan_01", "home/fan/command", "ON")
+        assert mock_mqtt.publish.call_count == 1
 
 @pytest.mark.asyncio
 async def test_dispatch_command_http():
@@ -105,3 +1644,246 @@ async def test_dispatch_command_http():
         
         assert "192.168.1.16:8009" in url
         assert json_data["command"] == "start"
+
+@pytest.mark.asyncio
+async def test_request_worker_queues_off_reader():
+    """驗證請求於讀取迴圈外依序處理、佇列滿時丟棄、處理中可被中止。"""
+    sent = []
+    release = asyncio.Event()
+
+    async def send(device_id, response):
+        sent.append(response)
+        return True
+
+    async def handler(device_id, data):
+        if data.get("block"):
+            await release.wait()
+        return {"reply": data["n"]}
+
+    worker = RequestWorker("esp32_01", send, maxsize=2)
+    assert worker.submit(handler, {"n": 1, "block": True})
+    await asyncio.sleep(0)                      # 第 1 筆開始處理
+    assert worker.submit(handler, {"n": 2}) and worker.submit(handler, {"n": 3})
+    assert not worker.submit(handler, {"n": 4})  # 佇列已滿
+
+    assert worker.cancel_current("test")         # 第 1 筆不回覆
+    for _ in range(5):
+        await asyncio.sleep(0)
+    assert sent == [{"reply": 2}, {"reply": 3}]
+    assert not worker.cancel_current("idle")
+
+    worker.close()
+    with pytest.raises(asyncio.CancelledError):
+        await worker.task
+
+@pytest.mark.asyncio
+async def test_asr_cascade_escalates_unsure_small_model():
+    """驗證模型級聯：小模型可信且比對到指令即採用，否則升級大模型；過長的語音不經小模型。"""
+    from esp_miao import audio as audio_mod
+    small, large = MagicMock(), MagicMock()
+    small_result = ("開燈", "zh", -0.2)
+    calls = []
+
+    def fake_one(model, samples, beam_size, prompt=None):
+        calls.append("small" if model is small else "large")
+        return small_result if model is small else ("打開電燈", "zh", -0.1)
+
+    async def run_asr(device_id, fn, background=False):
+        return fn()
+
+    def fake_intent(text):
+        if "燈" in text:
+            return {"action": "relay_set", "target": "light_01", "value": "ON"}
+        return {"action": "unknown", "target": "", "value": ""}
+
+    sched = MagicMock(run_asr=run_asr)
+    short = np.zeros(16000, dtype=np.float32)
+    before = dict(audio_mod.cascade_stats)
+    with patch.object(audio_mod, "ASR_CASCADE_MODEL", "tiny"), patch.object(audio_mod, "scheduler", sched), \
+            patch.object(audio_mod, "get_cascade_model", return_value=small), \
+            patch.object(audio_mod, "get_whisper_model", return_value=large), \
+            patch.object(audio_mod, "_transcribe_one", side_effect=fake_one), \
+            patch.object(audio_mod, "extract_intent_from_text", side_effect=fake_intent), \
+            patch.object(audio_mod, "vocabulary_prompt", return_value=None), \
+            patch.object(audio_mod.whisper_batcher, "window_s", 0):
+        ctx = MetricsContext("r1", "dev")
+        assert await audio_mod.transcribe_audio(short, metrics_ctx=ctx) == "開燈"
+        assert calls == ["small"] and ctx.data["asr_tier"] == "small"
+        assert "asr_large_latency" not in ctx.data
+
+        small_result = ("開等", "zh", -0.2)          # 信心高但比對不到裝置
+        ctx = MetricsContext("r2", "dev")
+        assert await audio_mod.transcribe_audio(short, metrics_ctx=ctx) == "打開電燈"
+        assert calls[1:] == ["small", "large"] and ctx.data["asr_tier"] == "large"
+        assert "asr_small_latency" in ctx.data and "asr_large_latency" in ctx.data
+
+        small_result = ("開燈", "zh", -1.2)          # 比對得到但信心不足
+        assert await audio_mod.transcribe_audio(short) == "打開電燈"
+
+        calls.clear()
+        assert await audio_mod.transcribe_audio(np.zeros(32000, dtype=np.float32)) == "打開電燈"
+        assert calls == ["large"]
+
+    delta = {k: audio_mod.cascade_stats[k] - before[k] for k in before}
+    assert delta == {"tried": 3, "accepted": 1, "escalated": 2}
+
+@pytest.mark.asyncio
+async def test_intent_index_nearest_exemplar():
+    """驗證嵌入最近鄰意圖：範例由別名 × 動作關鍵字產生，夠像才採用，詞彙變更後重建。"""
+    def vector(text):
+        v = np.zeros(256, dtype=np.float32)
+        for ch in text:
+            v[ord(ch) % 256] += 1.0
+        return v
+
+    async def embed(texts):
+        return [vector(t) for t in texts]
+
+    table = DynamicDeviceTable(devices=[Device(name="fan", type="relay", aliases=["電扇"])])
+    exemplars = dict(build_exemplars(table))
+    assert exemplars["打開電扇"] == {"action": "relay_set", "target": "fan", "value": "on"}
+    assert exemplars["把電扇關掉"]["value"] == "off" and exemplars["turn on fan"]["target"] == "fan"
+
+    index = IntentIndex(embed=embed, table=table)
+    assert await index.lookup("電扇打開") is None        # 尚未建立：改在背景重建
+    await index._refresh_task
+    match = await index.lookup("電扇打開")
+    assert match["intent"] == {"action": "relay_set", "target": "fan", "value": "on"}
+    assert match["similarity"] == 1.0 and match["margin"] > 0
+    assert await index.lookup("今天天氣如何") is None
+
+    table.update_device({"name": "light", "type": "relay", "aliases": ["檯燈"]})
+    assert not index.ready
+    await index.refresh()
+    assert (await index.lookup("檯燈關掉"))["intent"] == {"action": "relay_set", "target": "light", "value": "off"}
+    assert index.snapshot()["rebuilds"] == 2 and index.hits == 2 and index.misses == 1
+
+def test_device_registry_survives_restart(tmp_path):
+    """驗證裝置表快照：發佈後寫入檔案，新的裝置表於 discovery 前即可載入，之後的 discovery 照常覆蓋。"""
+    path = tmp_path / "device_registry.json"
+    table = DynamicDeviceTable(debounce_s=0)
+    assert table.load_registry(path) == 0          # 第一次啟動：沒有快照
+    table.update_device({
+        "name": "curtain", "type": "relay", "aliases": ["窗簾"],
+        "action_keywords": {"on": ["拉開"], "off": ["拉上"]},
+    })
+    table.update_device({"name": "fan", "type": "relay", "aliases": ["電扇"]})
+    table.set_device_status("fan", False)
+    assert path.exists() and not path.with_name(path.name + ".tmp").exists()
+
+    restarted = DynamicDeviceTable(debounce_s=0)
+    assert restarted.load_registry(path) == 2
+    assert restarted.alias_map["窗簾"] == "curtain"
+    assert restarted.get_action_keywords("curtain") == {"on": ["拉開"], "off": ["拉上"]}
+    assert not restarted.get_device("fan").is_online
+    assert restarted.snapshot()["restored_unconfirmed"] == 2
+
+    restarted.update_device({"name": "fan", "type": "relay", "aliases": ["風扇"]})
+    assert restarted.alias_map.get("風扇") == "fan" and "電扇" not in restarted.alias_map
+    assert restarted.snapshot()["restored_unconfirmed"] == 1
+
+    path.write_text('{"format": 99, "devices": []}', encoding="utf-8")
+    assert DynamicDeviceTable(debounce_s=0).load_registry(path) == 0
+
+
+def test_debug_audio_writer_bounded_budget(tmp_path):
+    """驗證除錯錄音：背景寫入 WAV 並記入索引，超過容量由舊到新刪除，重啟後由索引還原。"""
+    import wave
+    pcm = b"\x01\x00" * 16000                       # 1 秒 16 kHz，約 32 KB
+    writer = DebugAudioWriter(tmp_path, max_queue=8, max_bytes=100_000, max_age_s=0)
+    for i in range(5):
+        assert writer.submit(f"dev{i}", pcm, 16000, confidence=0.9)
+    writer.stop()
+
+    files = writer.files()
+    assert writer.saved == 5 and writer.evicted > 0
+    assert writer.total_bytes <= 100_000 and len(files) == 5 - writer.evicted
+    assert files[0].startswith("conf0.90_recorded_dev4_")     # 新到舊
+    assert sorted(p.name for p in tmp_path.glob("*.wav")) == sorted(files)
+    with wave.open(str(tmp_path / files[0])) as w:
+        assert w.getframerate() == 16000 and w.getnframes() == 16000
+
+    restarted = DebugAudioWriter(tmp_path, max_bytes=100_000, max_age_s=0)
+    restarted.start()
+    assert restarted.files() == files and restarted.total_bytes == writer.total_bytes
+    restarted.stop()
+
+
+def test_stream_capture_replays_session(tmp_path):
+    """驗證串流擷取：喚醒前的訊息不錄，audio_end 後寫檔；重播時保留原始間隔與訊息內容。"""
+    cap = SessionCapture(tmp_path, "esp_a", ["miao.v1"])
+    start = json.dumps({"type": "audio_start", "payload": {}})
+    end = json.dumps({"type": "audio_end", "payload": {}})
+
+    async def record():
+        cap.record(json.dumps({"type": "heartbeat"}), 99.0)
+        cap.record(start, 100.0)
+        cap.record(b"\x01\x02" * 8, 100.25)
+        cap.record(end, 100.5)
+        await asyncio.sleep(0.05)   # 寫檔在執行緒
+
+    asyncio.run(record())
+    files = list(tmp_path.glob("esp_a_*.cap"))
+    assert len(files) == 1
+    capture = read_capture(files[0])
+    assert capture.device_id == "esp_a" and capture.subprotocols == ["miao.v1"]
+    assert [m.t for m in capture.messages] == [0.0, 0.25, 0.5]
+    assert capture.messages[1].payload == b"\x01\x02" * 8
+
+    async def replay():
+        ws = ReplayWebSocket(capture, speed=10)
+        await ws.accept()
+        got = [await ws.receive() for _ in range(4)]
+        return ws, got
+
+    ws, got = asyncio.run(replay())
+    assert got[0]["text"] == start and got[1]["bytes"] == b"\x01\x02" * 8
+    assert got[3]["type"] == "websocket.disconnect"
+    assert 0.04 <= ws.finished - ws.started < 0.5      # 0.5 秒的 session 以 10 倍速送出
+
+
+def test_cluster_steers_devices_by_node_load():
+    """驗證叢集模式：負載較低的節點排在端點清單前面，原節點在 margin 內保留，裝置表經 retained 訊息合併。"""
+    client = MagicMock()
+    table = DynamicDeviceTable(debounce_s=0)
+    node = ClusterNode("x86", "ws://10.0.0.1:8000", capacity=4, client=client, table=table, margin=0.25)
+    connected = ["esp_a", "esp_b", "esp_c", "esp_d"]
+    node.bind(lambda: connected, lambda: 0)
+    peer = {"node": "rpi", "url": "ws://10.0.0.2:8000", "devices": 0, "streams": 0, "capacity": 2}
+    node.on_message(None, None, MagicMock(topic="esp-miao/cluster/nodes/rpi", payload=json.dumps(peer).encode()))
+
+    sent = []
+
+    async def send(device_id, message):
+        sent.append((device_id, message))
+        return True
+
+    async def scenario():
+        # 本節點 4/4，rpi 加入一台後 1/2：差距超過 margin，導走一台；同一輪其餘裝置留在本節點
+        await node.run_once(send)
+        assert node.steered == 1 and len(node._leaving) == 1
+        first = sent[0][1]
+        assert first["type"] == "server_list"
+        assert first["payload"]["uris"] == "ws://10.0.0.2:8000/ws/esp_a,ws://10.0.0.1:8000/ws/esp_a"
+        assert all(m["payload"]["uris"].startswith("ws://10.0.0.1:8000/") for _, m in sent[1:])
+        # 清單未變不重送
+        count = len(sent)
+        await node.steer("esp_b", send, allow_leave=False)
+        assert len(sent) == count
+
+    asyncio.run(scenario())
+
+    registry = {"format": DynamicDeviceTable.REGISTRY_FORMAT, "devices": [
+        {"name": "fan", "type": "relay", "aliases": ["電扇"], "control_topic": "home/fan/set"},
+    ]}
+    node.on_message(None, None, MagicMock(topic="esp-miao/cluster/registry/rpi",
+                                          payload=json.dumps(registry).encode()))
+    assert table.alias_map["電扇"] == "fan" and node.registry_merged == 1
+    # 本節點裝置表變更後以 retained 訊息轉發
+    table.publish_listeners.append(node.publish_registry)
+    table.update_device({"name": "lamp", "type": "relay"})
+    topic, payload = client.publish.call_args[0][:2]
+    assert topic == "esp-miao/cluster/registry/x86" and "lamp" in payload
+
+    node.on_message(None, None, MagicMock(topic="esp-miao/cluster/nodes/rpi", payload=b""))
+    assert list(node.live_nodes()) == ["x86"]